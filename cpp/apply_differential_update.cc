@@ -21,9 +21,11 @@
 */
 
 #include <iostream>
+#include <functional>
 #include <map>
+#include <set>
 #include <stdexcept>
-#include <unordered_set>
+#include <thread>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -32,6 +34,7 @@
 #include "Compiler.h"
 #include "FileUtil.h"
 #include "MARC.h"
+#include "MarcControlNumberSet.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -47,14 +50,24 @@ namespace {
 }
 
 
-void CopyAndCollectPPNs(MARC::Reader * const reader, MARC::Writer * const writer,
-                        std::unordered_set<std::string> * const previously_seen_ppns)
+// Records that were already seen, i.e. replaced by the differential update or duplicates, are skipped and all others are
+// copied.  Records that already have an ORI field, which is the common case for the complete dump, are copied as raw
+// bytes w/o being parsed.
+void CopyAndCollectPPNs(MARC::BinaryReader * const reader, MARC::Writer * const writer,
+                        MARC::ControlNumberSet * const previously_seen_ppns, unsigned * const skipped_count)
 {
-    while (auto record = reader->read()) {
-        if (previously_seen_ppns->find(record.getControlNumber()) == previously_seen_ppns->end()) {
-            previously_seen_ppns->emplace(record.getControlNumber());
-            if (record.getFirstField("ORI") == record.end())
-                record.insertField("ORI", { { 'a', FileUtil::GetLastPathComponent(reader->getPath()) } });
+    const std::string ori_contents(FileUtil::GetLastPathComponent(reader->getPath()));
+    while (const MARC::RecordView record_view = reader->readView()) {
+        if (not previously_seen_ppns->insert(record_view.getControlNumber().toString())) {
+            ++*skipped_count;
+            continue;
+        }
+
+        if (record_view.hasTag("ORI"))
+            writer->write(record_view);
+        else {
+            auto record(record_view.toRecord());
+            record.insertField("ORI", { { 'a', ori_contents } });
             writer->write(record);
         }
     }
@@ -62,17 +75,37 @@ void CopyAndCollectPPNs(MARC::Reader * const reader, MARC::Writer * const writer
 
 
 void CopySelectedTypes(const std::vector<std::string> &archive_members, MARC::Writer * const writer,
-                       const std::set<BSZUtil::ArchiveType> &selected_types, std::unordered_set<std::string> * const previously_seen_ppns)
+                       const std::set<BSZUtil::ArchiveType> &selected_types, MARC::ControlNumberSet * const previously_seen_ppns,
+                       unsigned * const skipped_count)
 {
     for (const auto &archive_member : archive_members) {
         if (selected_types.find(BSZUtil::GetArchiveType(archive_member)) != selected_types.cend()) {
             const auto reader(MARC::Reader::Factory(archive_member, MARC::FileType::BINARY));
-            CopyAndCollectPPNs(reader.get(), writer, previously_seen_ppns);
+            CopyAndCollectPPNs(static_cast<MARC::BinaryReader *>(reader.get()), writer, previously_seen_ppns, skipped_count);
         }
     }
 }
 
 
+// Records from the differential update come first so that they replace their counterparts in the complete dump.
+void PatchRecords(const std::vector<std::string> &input_archive_members,
+                  const std::vector<std::string> &difference_archive_members, const std::set<BSZUtil::ArchiveType> &selected_types,
+                  const std::string &output_filename)
+{
+    const auto writer(MARC::Writer::Factory(output_filename, MARC::FileType::BINARY));
+    MARC::ControlNumberSet previously_seen_ppns;
+    unsigned replaced_count(0), duplicate_count(0);
+    CopySelectedTypes(difference_archive_members, writer.get(), selected_types, &previously_seen_ppns, &duplicate_count);
+    const size_t difference_count(previously_seen_ppns.size());
+    CopySelectedTypes(input_archive_members, writer.get(), selected_types, &previously_seen_ppns, &replaced_count);
+
+    LOG_INFO("wrote " + std::to_string(previously_seen_ppns.size()) + " record(s) to \"" + output_filename + "\" of which "
+             + std::to_string(difference_count) + " came from the differential update and replaced "
+             + std::to_string(replaced_count) + " record(s) of the complete dump.  ("
+             + std::to_string(duplicate_count) + " duplicate(s) in the differential update)");
+}
+
+
 void PatchArchiveMembersAndCreateOutputArchive(const std::vector<std::string> &input_archive_members,
                                                const std::vector<std::string> &difference_archive_members, const std::string &output_directory)
 {
@@ -81,23 +114,14 @@ void PatchArchiveMembersAndCreateOutputArchive(const std::vector<std::string> &i
     if (difference_archive_members.empty())
         LOG_WARNING("no difference archive members!");
 
-    //
-    // We process title data first and combine all inferior and superior records.
-    //
-
-    const auto title_writer(MARC::Writer::Factory(output_directory + "/tit.mrc", MARC::FileType::BINARY));
-    std::unordered_set<std::string> previously_seen_title_ppns;
-    CopySelectedTypes(difference_archive_members, title_writer.get(), { BSZUtil::TITLE_RECORDS, BSZUtil::SUPERIOR_TITLES },
-                      &previously_seen_title_ppns);
-    CopySelectedTypes(input_archive_members, title_writer.get(), { BSZUtil::TITLE_RECORDS, BSZUtil::SUPERIOR_TITLES },
-                      &previously_seen_title_ppns);
-
-    const auto authority_writer(MARC::Writer::Factory(output_directory + "/aut.mrc", MARC::FileType::BINARY));
-    std::unordered_set<std::string> previously_seen_authority_ppns;
-    CopySelectedTypes(difference_archive_members, authority_writer.get(), { BSZUtil::AUTHORITY_RECORDS },
-                      &previously_seen_authority_ppns);
-    CopySelectedTypes(input_archive_members, authority_writer.get(), { BSZUtil::AUTHORITY_RECORDS },
-                      &previously_seen_authority_ppns);
+    // Title data, where we combine all inferior and superior records, and authority data are independent of each other,
+    // so we process them concurrently:
+    std::thread title_thread(PatchRecords, std::cref(input_archive_members), std::cref(difference_archive_members),
+                             std::set<BSZUtil::ArchiveType>{ BSZUtil::TITLE_RECORDS, BSZUtil::SUPERIOR_TITLES },
+                             output_directory + "/tit.mrc");
+    PatchRecords(input_archive_members, difference_archive_members, { BSZUtil::AUTHORITY_RECORDS },
+                 output_directory + "/aut.mrc");
+    title_thread.join();
 }
 
 
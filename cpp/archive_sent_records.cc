@@ -64,84 +64,173 @@ std::string GetISSNType(const std::string &issn) {
 }
 
 
-void StoreRecords(DbConnection * const db_connection, MARC::Reader * const marc_reader) {
-    unsigned record_count(0);
-
-    std::string record_blob;
+// The number of records whose bookkeeping we do w/ a single round of queries.
+const size_t BATCH_SIZE(500);
+
+
+struct RecordInfo {
+    std::string hash_;
+    std::string url_;
+    std::string zeder_id_;
+    std::string journal_name_;
+    std::string main_title_;
+    std::string publication_year_, volume_, issue_, pages_; // Empty if not available.
+    std::string resource_type_;
+    std::string superior_title_;
+    std::string superior_control_number_;
+};
+
+
+RecordInfo GetRecordInfo(const MARC::Record &record) {
+    RecordInfo record_info;
+    record_info.hash_         = StringUtil::ToHexString(MARC::CalcChecksum(record));
+    record_info.url_          = record.getFirstSubfieldValue("URL", 'a');
+    record_info.zeder_id_     = record.getFirstSubfieldValue("ZID", 'a');
+    record_info.journal_name_ = record.getFirstSubfieldValue("JOU", 'a');
+    record_info.main_title_   = record.getMainTitle();
+
+    const auto _936_field(record.getFirstField("936"));
+    if (_936_field != record.end()) {
+        const MARC::Subfields subfields(_936_field->getSubfields());
+        record_info.publication_year_ = subfields.getFirstSubfieldWithCode('j');
+        record_info.volume_           = subfields.getFirstSubfieldWithCode('d');
+        record_info.issue_            = subfields.getFirstSubfieldWithCode('e');
+        record_info.pages_            = subfields.getFirstSubfieldWithCode('h');
+    }
 
-    while (const MARC::Record record = marc_reader->read()) {
-        const std::string hash(StringUtil::ToHexString(MARC::CalcChecksum(record)));
-        const std::string url(record.getFirstSubfieldValue("URL", 'a'));
-        const std::string zeder_id(record.getFirstSubfieldValue("ZID", 'a'));
-        const std::string journal_name(record.getFirstSubfieldValue("JOU", 'a'));
-        const std::string main_title(record.getMainTitle());
-
-        db_connection->queryOrDie("SELECT * FROM delivered_marc_records WHERE main_title="
-                                  + db_connection->escapeAndQuoteString(SqlUtil::TruncateToVarCharMaxLength(main_title)));
-        auto existing_records_with_title(db_connection->getLastResultSet());
-        if (not existing_records_with_title.empty()) {
-            while (auto row = existing_records_with_title.getNextRow()) {
-                const auto existing_hash(row["hash"]), existing_url(row["url"]);
-                if (existing_hash == hash and existing_url == url) {
-                    LOG_WARNING("hash+url collision! record title: '" + main_title + "'\n"
-                                "record hash: '" + existing_hash + "'\n record url: '" + existing_url + "'");
-                }
-            }
+    record_info.resource_type_ = "unknown";
+    for (const auto &issn : record.getISSNs()) {
+        const auto issn_type(GetISSNType(issn));
+        if (issn_type != "unknown") {
+            record_info.resource_type_ = issn_type;
+            break;
         }
+    }
 
-        ++record_count;
+    record_info.superior_title_ = record.getSuperiorTitle();
+    record_info.superior_control_number_ = record.getSuperiorControlNumber();
 
-        std::string publication_year, volume, issue, pages;
-        const auto _936_field(record.getFirstField("936"));
-        if (_936_field != record.end()) {
-            const MARC::Subfields subfields(_936_field->getSubfields());
-            if (subfields.hasSubfield('j'))
-                publication_year = ",publication_year=" + db_connection->escapeAndQuoteString(subfields.getFirstSubfieldWithCode('j'));
-            if (subfields.hasSubfield('d'))
-                volume = ",volume=" + db_connection->escapeAndQuoteString(subfields.getFirstSubfieldWithCode('d'));
-            if (subfields.hasSubfield('e'))
-                issue = ",issue=" + db_connection->escapeAndQuoteString(subfields.getFirstSubfieldWithCode('e'));
-            if (subfields.hasSubfield('h'))
-                pages = ",pages=" + db_connection->escapeAndQuoteString(subfields.getFirstSubfieldWithCode('h'));
-        }
+    return record_info;
+}
+
+
+// \return The quoted value or NULL if "value" is empty.
+inline std::string EscapeAndQuoteOrNull(DbConnection * const db_connection, const std::string &value) {
+    return value.empty() ? "NULL" : db_connection->escapeAndQuoteString(value);
+}
+
+
+std::string GetQuotedList(DbConnection * const db_connection, const std::unordered_set<std::string> &values) {
+    std::string list;
+    for (const auto &value : values) {
+        if (not list.empty())
+            list += ',';
+        list += db_connection->escapeAndQuoteString(value);
+    }
+
+    return list;
+}
 
-        std::string resource_type("unknown");
-        const auto issns(record.getISSNs());
-        for (const auto &issn : issns) {
-            const auto issn_type(GetISSNType(issn));
-            if (issn_type != "unknown") {
-                resource_type = issn_type;
-                break;
-            }
-        }
 
-        db_connection->queryOrDie("INSERT INTO delivered_marc_records SET url=" + db_connection->escapeAndQuoteString(url)
-                                  + ",zeder_id=" + db_connection->escapeAndQuoteString(zeder_id) + ",journal_name="
-                                  + db_connection->escapeAndQuoteString(journal_name) +  ",hash="
-                                  + db_connection->escapeAndQuoteString(hash) + ",main_title="
-                                  + db_connection->escapeAndQuoteString(SqlUtil::TruncateToVarCharMaxLength(main_title))
-                                  + publication_year + volume + issue + pages + ",resource_type='" + resource_type + "',record="
-                                  + db_connection->escapeAndQuoteString(GzStream::CompressString(record_blob, GzStream::GZIP)));
-
-        db_connection->queryOrDie("SELECT * FROM delivered_marc_records_superior_info WHERE zeder_id="
-                                  + db_connection->escapeAndQuoteString(zeder_id));
-
-        if (db_connection->getLastResultSet().empty()) {
-            const std::string superior_title(record.getSuperiorTitle());
-            const auto superior_control_number(record.getSuperiorControlNumber());
-            const std::string superior_control_number_sql(superior_control_number.empty() ? "" : ",control_number="
-                                                    + db_connection->escapeAndQuoteString(superior_control_number));
-
-            db_connection->queryOrDie("INSERT INTO delivered_marc_records_superior_info SET zeder_id="
-                                      + db_connection->escapeAndQuoteString(zeder_id) + ",title="
-                                      + db_connection->escapeAndQuoteString(SqlUtil::TruncateToVarCharMaxLength(superior_title))
-                                      + superior_control_number_sql);
+// \return The number of records that had not been archived before.
+unsigned StoreBatch(DbConnection * const db_connection, const std::vector<RecordInfo> &batch,
+                    std::unordered_set<std::string> * const zeder_ids_with_superior_info)
+{
+    // Fetch the hashes of all earlier deliveries of the URL's in this batch w/ a single query:
+    std::unordered_set<std::string> urls, archived_urls_and_hashes;
+    for (const auto &record_info : batch)
+        urls.emplace(record_info.url_);
+    db_connection->queryOrDie("SELECT url,hash FROM delivered_marc_records WHERE url IN (" + GetQuotedList(db_connection, urls) + ")");
+    auto result_set(db_connection->getLastResultSet());
+    while (const auto row = result_set.getNextRow())
+        archived_urls_and_hashes.emplace(row["url"] + '\t' + row["hash"]);
+
+    static const std::string EMPTY_RECORD_BLOB(GzStream::CompressString("", GzStream::GZIP));
+    std::string values;
+    unsigned stored_count(0);
+    std::unordered_set<std::string> zeder_ids_needing_superior_info;
+    for (const auto &record_info : batch) {
+        // Also catches repeated records w/in the current batch:
+        if (not archived_urls_and_hashes.emplace(record_info.url_ + '\t' + record_info.hash_).second) {
+            LOG_DEBUG("skipping unchanged record w/ URL \"" + record_info.url_ + "\" and hash " + record_info.hash_);
+            continue;
         }
 
-        record_blob.clear();
+        if (not values.empty())
+            values += ',';
+        values += "(" + db_connection->escapeAndQuoteString(record_info.url_) + ","
+                  + db_connection->escapeAndQuoteString(record_info.zeder_id_) + ","
+                  + db_connection->escapeAndQuoteString(record_info.journal_name_) + ","
+                  + db_connection->escapeAndQuoteString(record_info.hash_) + ","
+                  + db_connection->escapeAndQuoteString(SqlUtil::TruncateToVarCharMaxLength(record_info.main_title_)) + ","
+                  + EscapeAndQuoteOrNull(db_connection, record_info.publication_year_) + ","
+                  + EscapeAndQuoteOrNull(db_connection, record_info.volume_) + ","
+                  + EscapeAndQuoteOrNull(db_connection, record_info.issue_) + ","
+                  + EscapeAndQuoteOrNull(db_connection, record_info.pages_) + ","
+                  + "'" + record_info.resource_type_ + "',"
+                  + db_connection->escapeAndQuoteString(EMPTY_RECORD_BLOB) + ")";
+        ++stored_count;
+
+        if (zeder_ids_with_superior_info->find(record_info.zeder_id_) == zeder_ids_with_superior_info->cend())
+            zeder_ids_needing_superior_info.emplace(record_info.zeder_id_);
+    }
+
+    if (values.empty())
+        return 0;
+    db_connection->queryOrDie("INSERT INTO delivered_marc_records (url,zeder_id,journal_name,hash,main_title,publication_year,"
+                              "volume,issue,pages,resource_type,record) VALUES " + values);
+
+    if (zeder_ids_needing_superior_info.empty())
+        return stored_count;
+
+    db_connection->queryOrDie("SELECT zeder_id FROM delivered_marc_records_superior_info WHERE zeder_id IN ("
+                              + GetQuotedList(db_connection, zeder_ids_needing_superior_info) + ")");
+    auto superior_info_result_set(db_connection->getLastResultSet());
+    while (const auto row = superior_info_result_set.getNextRow()) {
+        zeder_ids_needing_superior_info.erase(row["zeder_id"]);
+        zeder_ids_with_superior_info->emplace(row["zeder_id"]);
+    }
+
+    // The superior info of a journal is taken from its first record:
+    values.clear();
+    for (const auto &record_info : batch) {
+        if (zeder_ids_needing_superior_info.erase(record_info.zeder_id_) == 0)
+            continue;
+
+        if (not values.empty())
+            values += ',';
+        values += "(" + db_connection->escapeAndQuoteString(record_info.zeder_id_) + ","
+                  + db_connection->escapeAndQuoteString(SqlUtil::TruncateToVarCharMaxLength(record_info.superior_title_)) + ","
+                  + EscapeAndQuoteOrNull(db_connection, record_info.superior_control_number_) + ")";
+        zeder_ids_with_superior_info->emplace(record_info.zeder_id_);
+    }
+    if (not values.empty())
+        db_connection->queryOrDie("INSERT INTO delivered_marc_records_superior_info (zeder_id,title,control_number) VALUES "
+                                  + values);
+
+    return stored_count;
+}
+
+
+void StoreRecords(DbConnection * const db_connection, MARC::Reader * const marc_reader) {
+    unsigned record_count(0), stored_count(0);
+    std::unordered_set<std::string> zeder_ids_with_superior_info;
+    std::vector<RecordInfo> batch;
+    batch.reserve(BATCH_SIZE);
+
+    SqlUtil::TransactionGuard transaction_guard(db_connection);
+    while (const MARC::Record record = marc_reader->read()) {
+        ++record_count;
+        batch.emplace_back(GetRecordInfo(record));
+        if (batch.size() == BATCH_SIZE) {
+            stored_count += StoreBatch(db_connection, batch, &zeder_ids_with_superior_info);
+            batch.clear();
+        }
     }
+    if (not batch.empty())
+        stored_count += StoreBatch(db_connection, batch, &zeder_ids_with_superior_info);
 
-    std::cout << "Stored " << record_count << " MARC record(s).\n";
+    std::cout << "Stored " << stored_count << " of " << record_count << " MARC record(s), the others had already been archived.\n";
 }
 
 
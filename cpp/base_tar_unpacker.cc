@@ -17,6 +17,8 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <cstdlib>
 #include "Archive.h"
 #include "Compiler.h"
@@ -32,44 +34,28 @@ __attribute__((noreturn)) void Usage() {
 
 
 void ProcessTarball(const bool verbose, const std::string &input_filename, File * const output) {
-    Archive::Reader reader(input_filename);
+    // The members get decompressed concurrently but have to be written in archive order.
+    std::mutex output_mutex;
+    std::map<size_t, std::string> decompressed_members;
+    size_t next_member_index(0);
+    Archive::ProcessEntriesConcurrently(input_filename, [&](const Archive::Entry &entry) {
+        std::string decompressed_member;
+        if (not entry.contents_.empty())
+            GzStream::Decompress(entry.contents_, &decompressed_member, GzStream::GUNZIP);
 
-    unsigned member_count(0);
-    Archive::Reader::EntryInfo entry_info;
-    while (reader.getNext(&entry_info)) {
-        ++member_count;
-
-        GzStream gunzip_streamer(GzStream::GUNZIP);
-        char compressed_data[8192];
-        ssize_t n_read;
-        unsigned bytes_consumed, bytes_produced;
-        bool more(false);
-        char decompressed_data[8192];
-        while ((n_read = reader.read(compressed_data, sizeof compressed_data)) > 0) {
-            unsigned total_processed(0);
-            do {
-                more = gunzip_streamer.decompress(compressed_data + total_processed,
-                                                  static_cast<unsigned>(n_read) - total_processed, decompressed_data,
-                                                  sizeof decompressed_data, &bytes_consumed, &bytes_produced);
-                if (unlikely(output->write(decompressed_data, bytes_produced) != bytes_produced))
-                    logger->error("unexpected error while writing to \"" + output->getPath() + "\"!");
-                total_processed += bytes_consumed;
-            } while (total_processed < n_read);
-        }
-
-        if (unlikely(n_read == -1))
-            logger->error("unexpected error while reading tar member data! (" + reader.getLastErrorMessage() + ")");
-
-        while (more) {
-            more = gunzip_streamer.decompress(nullptr, n_read, decompressed_data, sizeof(decompressed_data),
-                                              &bytes_consumed, &bytes_produced);
-            if (unlikely(output->write(decompressed_data, bytes_produced) != bytes_produced))
+        std::lock_guard<std::mutex> output_mutex_locker(output_mutex);
+        decompressed_members.emplace(entry.index_, std::move(decompressed_member));
+        for (auto index_and_member(decompressed_members.begin());
+             index_and_member != decompressed_members.end() and index_and_member->first == next_member_index;
+             index_and_member = decompressed_members.erase(index_and_member), ++next_member_index)
+        {
+            if (unlikely(not output->write(index_and_member->second)))
                 logger->error("unexpected error while writing to \"" + output->getPath() + "\"!");
         }
-    }
+    });
 
     if (verbose)
-        std::cerr << "The tarball contained " << member_count << " entries.\n";
+        std::cerr << "The tarball contained " << next_member_index << " entries.\n";
 }
 
 
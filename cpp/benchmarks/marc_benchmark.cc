@@ -0,0 +1,210 @@
+/** \brief Microbenchmarks for reading, writing and accessing MARC records.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <memory>
+#include <random>
+#include <vector>
+#include "FileUtil.h"
+#include "MARC.h"
+#include "MicroBenchmark.h"
+#include "util.h"
+
+
+namespace {
+
+
+const unsigned CORPUS_RECORD_COUNT(2000);
+
+
+std::string RandomWord(std::mt19937 * const generator) {
+    static const std::vector<std::string> LETTERS{ "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o",
+                                                   "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "ä", "ö", "ü", "ß" };
+    std::uniform_int_distribution<unsigned> length_distribution(2, 12), letter_distribution(0, LETTERS.size() - 1);
+    std::string word;
+    for (unsigned length(length_distribution(*generator)); length > 0; --length)
+        word += LETTERS[letter_distribution(*generator)];
+    return word;
+}
+
+
+std::string RandomWords(std::mt19937 * const generator, const unsigned count) {
+    std::string words;
+    for (unsigned i(0); i < count; ++i) {
+        if (i > 0)
+            words += ' ';
+        words += RandomWord(generator);
+    }
+    return words;
+}
+
+
+// Generates records that roughly resemble our title data w/ respect to the number and sizes of fields.
+// The generator is seeded w/ a constant so that all runs benchmark the same records.
+const std::vector<MARC::Record> &GetCorpus() {
+    static std::vector<MARC::Record> corpus;
+    if (not corpus.empty())
+        return corpus;
+
+    std::mt19937 generator(4711);
+    std::uniform_int_distribution<unsigned> subject_count_distribution(1, 8), author_count_distribution(0, 4);
+    for (unsigned record_no(0); record_no < CORPUS_RECORD_COUNT; ++record_no) {
+        MARC::Record record(MARC::Record::TypeOfRecord::LANGUAGE_MATERIAL, MARC::Record::BibliographicLevel::MONOGRAPH_OR_ITEM,
+                            std::to_string(100000000 + record_no));
+        record.insertField("005", "20190101120000.0");
+        record.insertField("008", "190101s2019    gw |||||o     00| ||ger c");
+        record.insertField("041", { { 'a', "ger" } });
+        record.insertField("100", { { 'a', RandomWord(&generator) + ", " + RandomWord(&generator) }, { '4', "aut" } }, '1');
+        record.insertField("245", { { 'a', RandomWords(&generator, 6) }, { 'b', RandomWords(&generator, 10) },
+                                    { 'c', RandomWords(&generator, 3) } }, '1', '0');
+        record.insertField("264", { { 'a', RandomWord(&generator) }, { 'b', RandomWords(&generator, 2) }, { 'c', "2019" } }, ' ', '1');
+        record.insertField("300", { { 'a', "XII, 345 Seiten" } });
+        for (unsigned i(subject_count_distribution(generator)); i > 0; --i)
+            record.insertField("650", { { 'a', RandomWords(&generator, 2) }, { '0', "(DE-588)" + std::to_string(4000000 + i) },
+                                        { '2', "gnd" } }, ' ', '7');
+        for (unsigned i(author_count_distribution(generator)); i > 0; --i)
+            record.insertField("700", { { 'a', RandomWord(&generator) + ", " + RandomWord(&generator) }, { '4', "oth" } }, '1');
+        record.insertField("935", { { 'a', "mteo" } });
+        record.insertField("LOK", { { '0', "852" }, { 'a', "DE-21" }, { 'c', RandomWord(&generator) } });
+        corpus.emplace_back(record);
+    }
+
+    return corpus;
+}
+
+
+// \return The path of a file that contains the corpus in the format "file_type".
+const std::string &GetCorpusPath(const MARC::FileType file_type) {
+    static const FileUtil::AutoTempFile binary_file("/tmp/marc_benchmark", ".mrc"), xml_file("/tmp/marc_benchmark", ".xml");
+    static bool written(false);
+    if (not written) {
+        auto binary_writer(MARC::Writer::Factory(binary_file.getFilePath(), MARC::FileType::BINARY));
+        auto xml_writer(MARC::Writer::Factory(xml_file.getFilePath(), MARC::FileType::XML));
+        for (const auto &record : GetCorpus()) {
+            binary_writer->write(record);
+            xml_writer->write(record);
+        }
+        written = true;
+    }
+
+    return (file_type == MARC::FileType::BINARY) ? binary_file.getFilePath() : xml_file.getFilePath();
+}
+
+
+void BenchmarkReader(MicroBenchmark::State * const state, const MARC::FileType file_type) {
+    const std::string &corpus_path(GetCorpusPath(file_type));
+    auto reader(MARC::Reader::Factory(corpus_path, file_type));
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        reader->rewind();
+        while (const MARC::Record record = reader->read())
+            MicroBenchmark::DoNotOptimize(record);
+    }
+    state->addBytesProcessed(state->getIterations() * FileUtil::GetFileSize(corpus_path));
+    state->addItemsProcessed(state->getIterations() * CORPUS_RECORD_COUNT);
+}
+
+
+void BenchmarkWriter(MicroBenchmark::State * const state, const MARC::FileType file_type) {
+    const auto &corpus(GetCorpus());
+    auto writer(MARC::Writer::Factory("/dev/null", file_type));
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        for (const auto &record : corpus)
+            writer->write(record);
+    }
+    writer->flush();
+    state->addBytesProcessed(state->getIterations() * FileUtil::GetFileSize(GetCorpusPath(file_type)));
+    state->addItemsProcessed(state->getIterations() * corpus.size());
+}
+
+
+} // unnamed namespace
+
+
+BENCHMARK(BinaryReader_read) {
+    BenchmarkReader(state, MARC::FileType::BINARY);
+}
+
+
+BENCHMARK(BinaryReader_readIntoExistingRecord) {
+    const std::string &corpus_path(GetCorpusPath(MARC::FileType::BINARY));
+    auto reader(MARC::Reader::Factory(corpus_path, MARC::FileType::BINARY));
+    MARC::Record record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        reader->rewind();
+        while (reader->read(&record))
+            MicroBenchmark::DoNotOptimize(record);
+    }
+    state->addBytesProcessed(state->getIterations() * FileUtil::GetFileSize(corpus_path));
+    state->addItemsProcessed(state->getIterations() * CORPUS_RECORD_COUNT);
+}
+
+
+BENCHMARK(BinaryReader_readView) {
+    const std::string &corpus_path(GetCorpusPath(MARC::FileType::BINARY));
+    auto reader(MARC::Reader::Factory(corpus_path, MARC::FileType::BINARY));
+    MARC::BinaryReader * const binary_reader(dynamic_cast<MARC::BinaryReader *>(reader.get()));
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        binary_reader->rewind();
+        while (const MARC::RecordView record_view = binary_reader->readView())
+            MicroBenchmark::DoNotOptimize(record_view);
+    }
+    state->addBytesProcessed(state->getIterations() * FileUtil::GetFileSize(corpus_path));
+    state->addItemsProcessed(state->getIterations() * CORPUS_RECORD_COUNT);
+}
+
+
+BENCHMARK(XmlReader_read) {
+    BenchmarkReader(state, MARC::FileType::XML);
+}
+
+
+BENCHMARK(BinaryWriter_write) {
+    BenchmarkWriter(state, MARC::FileType::BINARY);
+}
+
+
+BENCHMARK(XmlWriter_write) {
+    BenchmarkWriter(state, MARC::FileType::XML);
+}
+
+
+BENCHMARK(Subfields_parse) {
+    std::vector<std::string> field_contents;
+    for (const auto &field : GetCorpus().front())
+        if (not field.isControlField())
+            field_contents.emplace_back(field.getContents());
+
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        for (const auto &contents : field_contents)
+            MicroBenchmark::DoNotOptimize(MARC::Subfields(contents));
+    }
+    state->addItemsProcessed(state->getIterations() * field_contents.size());
+}
+
+
+BENCHMARK(Record_findTag) {
+    static const std::vector<MARC::Tag> TAGS{ "001", "100", "245", "650", "700", "856", "935", "LOK" };
+    const auto &corpus(GetCorpus());
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        for (const auto &tag : TAGS)
+            MicroBenchmark::DoNotOptimize(corpus[i % corpus.size()].findTag(tag));
+    }
+    state->addItemsProcessed(state->getIterations() * TAGS.size());
+}
+
+
+BENCHMARK_MAIN(marc_benchmark)
@@ -0,0 +1,136 @@
+/** \brief Microbenchmarks for the JSON and XML parsers.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <map>
+#include <memory>
+#include <random>
+#include "JSON.h"
+#include "MicroBenchmark.h"
+#include "StringDataSource.h"
+#include "StringUtil.h"
+#include "XMLSubsetParser.h"
+#include "util.h"
+
+
+namespace {
+
+
+std::string RandomText(std::mt19937 * const generator, const unsigned word_count) {
+    static const std::vector<std::string> WORDS{ "Kirche", "Geschichte", "theology", "Bibel", "Römerbrief", "ethics", "Reformation",
+                                                 "Mission", "\"quoted\"", "<tag>", "Paulus", "Äthiopien", "Straße", "κύριος" };
+    std::uniform_int_distribution<unsigned> word_distribution(0, WORDS.size() - 1);
+    std::string text;
+    for (unsigned i(0); i < word_count; ++i) {
+        if (i > 0)
+            text += ' ';
+        text += WORDS[word_distribution(*generator)];
+    }
+    return text;
+}
+
+
+// Resembles a Solr response w/ 500 documents.  The generator is seeded w/ a constant so that all runs benchmark the same
+// document.
+const std::string &GetJSONCorpus() {
+    static std::string corpus;
+    if (not corpus.empty())
+        return corpus;
+
+    std::mt19937 generator(4711);
+    corpus = "{\"responseHeader\":{\"status\":0,\"QTime\":12},\"response\":{\"numFound\":500,\"start\":0,\"docs\":[";
+    for (unsigned doc_no(0); doc_no < 500; ++doc_no) {
+        if (doc_no > 0)
+            corpus += ',';
+        corpus += "{\"id\":\"" + std::to_string(100000000 + doc_no) + "\",\"title\":\""
+                  + JSON::EscapeString(RandomText(&generator, 8)) + "\",\"topic\":[";
+        for (unsigned topic_no(0); topic_no < 5; ++topic_no) {
+            if (topic_no > 0)
+                corpus += ',';
+            corpus += "\"" + JSON::EscapeString(RandomText(&generator, 2)) + "\"";
+        }
+        corpus += "],\"year\":" + std::to_string(1900 + doc_no % 120) + ",\"score\":" + std::to_string(doc_no / 500.0)
+                  + ",\"is_open_access\":" + (doc_no % 3 == 0 ? "true" : "false") + ",\"url\":null}";
+    }
+    corpus += "]}}";
+
+    return corpus;
+}
+
+
+// Resembles MARC-XML w/ 500 records.
+const std::string &GetXMLCorpus() {
+    static std::string corpus;
+    if (not corpus.empty())
+        return corpus;
+
+    std::mt19937 generator(4711);
+    corpus = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<collection xmlns=\"http://www.loc.gov/MARC21/slim\">\n";
+    for (unsigned record_no(0); record_no < 500; ++record_no) {
+        corpus += "<record>\n  <leader>00000nam a2200000 c 4500</leader>\n  <controlfield tag=\"001\">"
+                  + std::to_string(100000000 + record_no) + "</controlfield>\n";
+        for (const std::string tag : { "100", "245", "650", "650", "700" }) {
+            corpus += "  <datafield tag=\"" + tag + "\" ind1=\"1\" ind2=\" \">\n";
+            for (const char code : { 'a', 'b', '0' }) {
+                std::string text(RandomText(&generator, 3));
+                corpus += "    <subfield code=\"" + std::string(1, code) + "\">"
+                          + StringUtil::Map(&text, "<>", "[]") + " &amp; more</subfield>\n";
+            }
+            corpus += "  </datafield>\n";
+        }
+        corpus += "</record>\n";
+    }
+    corpus += "</collection>\n";
+
+    return corpus;
+}
+
+
+} // unnamed namespace
+
+
+BENCHMARK(JSON_Parser_parse) {
+    const std::string &corpus(GetJSONCorpus());
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        JSON::Parser parser(corpus);
+        std::shared_ptr<JSON::JSONNode> tree_root;
+        if (unlikely(not parser.parse(&tree_root)))
+            LOG_ERROR("failed to parse the JSON corpus: " + parser.getErrorMessage());
+        MicroBenchmark::DoNotOptimize(tree_root);
+    }
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(XMLSubsetParser_getNext) {
+    StringDataSource data_source(GetXMLCorpus());
+    XMLSubsetParser<StringDataSource>::Type type;
+    std::map<std::string, std::string> attrib_map;
+    std::string data;
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        data_source.rewind();
+        XMLSubsetParser<StringDataSource> parser(&data_source);
+        while (parser.getNext(&type, &attrib_map, &data) and type != XMLSubsetParser<StringDataSource>::END_OF_DOCUMENT)
+            MicroBenchmark::DoNotOptimize(data);
+        if (unlikely(type == XMLSubsetParser<StringDataSource>::ERROR))
+            LOG_ERROR("failed to parse the XML corpus: " + parser.getLastErrorMessage());
+    }
+    state->addBytesProcessed(state->getIterations() * GetXMLCorpus().size());
+}
+
+
+BENCHMARK_MAIN(parser_benchmark)
@@ -0,0 +1,148 @@
+/** \brief Microbenchmarks for text processing: UTF-8 routines, regular expressions and language classification.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <memory>
+#include <random>
+#include <vector>
+#include "FileUtil.h"
+#include "MicroBenchmark.h"
+#include "NGram.h"
+#include "RegexMatcher.h"
+#include "TextUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+// Generates text from "vocabulary" w/ a constant seed so that all runs benchmark the same text.
+std::string GenerateText(const std::vector<std::string> &vocabulary, const unsigned word_count, const unsigned seed) {
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<unsigned> word_distribution(0, vocabulary.size() - 1), whitespace_distribution(0, 15);
+    std::string text;
+    for (unsigned i(0); i < word_count; ++i) {
+        if (i > 0)
+            text += (whitespace_distribution(generator) == 0) ? "  \t" : " ";
+        text += vocabulary[word_distribution(generator)];
+    }
+    return text;
+}
+
+
+const std::vector<std::string> GERMAN_WORDS{ "Die", "Geschichte", "der", "Kirche", "im", "Mittelalter", "und", "Reformation", "Über",
+                                             "Glauben", "Straße", "Gemeinde", "ökumenische", "Bewegung", "zwischen", "Überlieferung" };
+const std::vector<std::string> ENGLISH_WORDS{ "The", "history", "of", "the", "church", "in", "the", "Middle", "Ages", "and",
+                                              "reformation", "about", "faith", "community", "ecumenical", "movement", "between" };
+const std::vector<std::string> GREEK_WORDS{ "Ἐν", "ἀρχῇ", "ἦν", "ὁ", "λόγος", "καὶ", "πρὸς", "τὸν", "θεόν", "κύριος", "ἐκκλησία" };
+
+
+// About 64 KiB of mixed German, English and Greek text w/ some runs of whitespace.
+const std::string &GetTextCorpus() {
+    static std::string corpus;
+    if (corpus.empty()) {
+        std::vector<std::string> vocabulary(GERMAN_WORDS);
+        vocabulary.insert(vocabulary.end(), ENGLISH_WORDS.cbegin(), ENGLISH_WORDS.cend());
+        vocabulary.insert(vocabulary.end(), GREEK_WORDS.cbegin(), GREEK_WORDS.cend());
+        corpus = GenerateText(vocabulary, 8000, 4711);
+    }
+    return corpus;
+}
+
+
+// Language models for synthetic "German" and "English" so that we don't depend on the installed models.
+const std::string &GetLanguageModelsDirectory() {
+    static const FileUtil::AutoTempDirectory models_directory("/tmp/text_benchmark");
+    static bool models_written(false);
+    if (not models_written) {
+        NGram::CreateAndWriteLanguageModel(GenerateText(GERMAN_WORDS, 50000, 1), models_directory.getDirectoryPath() + "/de.lm");
+        NGram::CreateAndWriteLanguageModel(GenerateText(ENGLISH_WORDS, 50000, 2), models_directory.getDirectoryPath() + "/en.lm");
+        models_written = true;
+    }
+    return models_directory.getDirectoryPath();
+}
+
+
+} // unnamed namespace
+
+
+BENCHMARK(TextUtil_UTF8ToLower) {
+    const std::string &corpus(GetTextCorpus());
+    for (uint64_t i(0); i < state->getIterations(); ++i)
+        MicroBenchmark::DoNotOptimize(TextUtil::UTF8ToLower(corpus));
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(TextUtil_UTF8ToUTF32) {
+    const std::string &corpus(GetTextCorpus());
+    std::vector<uint32_t> utf32_chars;
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        utf32_chars.clear();
+        if (unlikely(not TextUtil::UTF8ToUTF32(corpus, &utf32_chars)))
+            LOG_ERROR("the corpus is not valid UTF-8!");
+        MicroBenchmark::DoNotOptimize(utf32_chars);
+    }
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(TextUtil_IsValidUTF8) {
+    const std::string &corpus(GetTextCorpus());
+    for (uint64_t i(0); i < state->getIterations(); ++i)
+        MicroBenchmark::DoNotOptimize(TextUtil::IsValidUTF8(corpus));
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(TextUtil_CollapseAndTrimWhitespace) {
+    const std::string &corpus(GetTextCorpus());
+    for (uint64_t i(0); i < state->getIterations(); ++i)
+        MicroBenchmark::DoNotOptimize(TextUtil::CollapseAndTrimWhitespace(corpus));
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(RegexMatcher_matched) {
+    static const std::unique_ptr<RegexMatcher> matcher(
+        RegexMatcher::RegexMatcherFactoryOrDie("\\b(kirche|church|ἐκκλησία)\\b.{0,40}\\b(reformation|mittelalter)\\b",
+                                               RegexMatcher::ENABLE_UTF8 | RegexMatcher::CASE_INSENSITIVE));
+    const std::string &corpus(GetTextCorpus());
+    uint64_t match_count(0);
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        size_t start_pos(0), end_pos(0);
+        while (end_pos < corpus.size() and matcher->matched(corpus, end_pos, nullptr, &start_pos, &end_pos))
+            ++match_count;
+    }
+    MicroBenchmark::DoNotOptimize(match_count);
+    state->addBytesProcessed(state->getIterations() * corpus.size());
+}
+
+
+BENCHMARK(NGram_ClassifyLanguage) {
+    const std::string &models_directory(GetLanguageModelsDirectory());
+    const std::string text(GetTextCorpus().substr(0, 1000));
+    std::vector<std::string> top_languages;
+    for (uint64_t i(0); i < state->getIterations(); ++i) {
+        NGram::ClassifyLanguage(text, &top_languages, { }, NGram::DEFAULT_ALTERNATIVE_CUTOFF_FACTOR, models_directory);
+        MicroBenchmark::DoNotOptimize(top_languages);
+    }
+    state->addItemsProcessed(state->getIterations());
+}
+
+
+BENCHMARK_MAIN(text_benchmark)
@@ -0,0 +1,97 @@
+/** \file    bible_ref_suggestions.cc
+ *  \brief   A CGI program that suggests completions for partially typed bible references.
+ *  \author  Dr. Johannes Ruscheinski
+ */
+
+/*
+    Copyright (C) 2019 Library of the University of Tübingen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "BibleUtil.h"
+#include "JSON.h"
+#include "StringUtil.h"
+#include "UBTools.h"
+#include "WebUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+const unsigned DEFAULT_LIMIT(10);
+const unsigned MAX_LIMIT(50);
+
+
+std::string GetCGIParameterOrDefault(const std::multimap<std::string, std::string> &cgi_args, const std::string &parameter_name,
+                                     const std::string &default_value = "")
+{
+    const auto key_and_value(cgi_args.find(parameter_name));
+    return (key_and_value == cgi_args.cend()) ? default_value : key_and_value->second;
+}
+
+
+// Emits a JSON array of objects w/ "suggestion" and "count" members, most popular first.
+void Suggest(const BibleUtil::SuggestionIndex &suggestion_index, const std::multimap<std::string, std::string> &cgi_args) {
+    unsigned limit;
+    if (not StringUtil::ToUnsigned(GetCGIParameterOrDefault(cgi_args, "limit", std::to_string(DEFAULT_LIMIT)), &limit)
+        or limit == 0 or limit > MAX_LIMIT)
+    {
+        std::cout << "Status: 400 Bad Request\r\nContent-Type: text/plain\r\n\r\n\"limit\" must be in [1," << MAX_LIMIT << "]!\n";
+        return;
+    }
+
+    std::vector<BibleUtil::SuggestionIndex::Suggestion> suggestions;
+    suggestion_index.suggest(GetCGIParameterOrDefault(cgi_args, "q"), limit, &suggestions);
+
+    std::string json;
+    JSON::Writer writer(&json);
+    writer.beginArray();
+    for (const auto &suggestion : suggestions) {
+        writer.beginObject();
+        writer.stringMember("suggestion", suggestion.text_);
+        writer.key("count").integerValue(suggestion.record_count_);
+        writer.endObject();
+    }
+    writer.endArray();
+
+    std::cout << "Content-Type: application/json; charset=utf-8\r\n\r\n" << json << '\n';
+}
+
+
+} // unnamed namespace
+
+
+int main(int argc, char *argv[]) {
+    ::progname = argv[0];
+
+    try {
+        // Under FastCGI the index is only loaded once for all requests.
+        const BibleUtil::SuggestionIndex suggestion_index(UBTools::GetTuelibPath() + "bibleRef/bible_ref_suggestions.index");
+
+        WebUtil::ProcessCgiRequests([argc, argv, &suggestion_index]() {
+            std::multimap<std::string, std::string> cgi_args;
+            WebUtil::GetAllCgiArgs(&cgi_args, argc, argv);
+            Suggest(suggestion_index, cgi_args);
+        });
+    } catch (const std::exception &e) {
+        logger->error(std::string("caught exception: ") + e.what());
+    }
+}
@@ -21,13 +21,15 @@
 */
 
 #include <iostream>
+#include <map>
+#include <unordered_map>
 #include <vector>
+#include <ctime>
 #include "DbConnection.h"
-#include "DbResultSet.h"
-#include "DbRow.h"
 #include "IniFile.h"
-#include "StringUtil.h"
+#include "TranslationUtil.h"
 #include "UBTools.h"
+#include "WebUtil.h"
 #include "util.h"
 
 
@@ -37,39 +39,78 @@ namespace {
 const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "translations.conf");
 
 
-void GetLanguageCodes(DbConnection * const db_connection, std::vector<std::string> * const language_codes) {
-    db_connection->queryOrDie("SELECT DISTINCT language_code FROM vufind_translations;");
-    DbResultSet result_set(db_connection->getLastResultSet());
-    DbRow row;
-    while ((row = result_set.getNextRow()))
-        language_codes->emplace_back(row["language_code"]);
-}
+// How long a generated page may be served from the cache.  Saved translations update the statistics immediately but may
+// take this long to show up on the page.
+const time_t MAX_PAGE_AGE(60); // seconds
 
 
-void GenerateStats(DbConnection * const db_connection, const std::vector<std::string> &language_codes,
-                   const std::string &table_name, const std::string &table_key_name)
+void GenerateStats(DbConnection * const db_connection, const std::string &language_code_filter,
+                   const std::string &table_name, const std::string &table_key_name, std::string * const page)
 {
-    for (const auto &language_code : language_codes) {
-        db_connection->queryOrDie("SELECT COUNT(*) FROM " + table_name + " WHERE language_code='" + language_code
-                                  + "';");
-        DbResultSet result_set(db_connection->getLastResultSet());
-        unsigned translated_count;
-        if (result_set.empty())
-            translated_count = 0;
-        else {
-            const DbRow row(result_set.getNextRow());
-            translated_count = StringUtil::ToUnsigned(row["COUNT(*)"]);
-        }
-
-        // Find tokens/PPN's where "language_code" is missing:
-        db_connection->queryOrDie("SELECT DISTINCT " + table_key_name + " FROM " + table_name + " WHERE "
-                                  + table_key_name + " NOT IN (SELECT DISTINCT " + table_key_name + " FROM "
-                                  + table_name + " WHERE language_code = \"" + language_code + "\");");
-        const unsigned not_yet_translated(db_connection->getLastResultSet().size());
-
-        std::cout << "        <tr>" << language_code << "</tr><tr>" << (translated_count + not_yet_translated)
-                  << "</tr><tr>" << translated_count << "</tr>\n";
+    for (const auto &stats : TranslationUtil::GetTranslationStats(db_connection, table_name, table_key_name)) {
+        if (not language_code_filter.empty() and stats.language_code_ != language_code_filter)
+            continue;
+
+        *page += "        <tr>" + stats.language_code_ + "</tr><tr>" + std::to_string(stats.total_count_) + "</tr><tr>"
+                 + std::to_string(stats.translated_count_) + "</tr>\n";
+    }
+}
+
+
+std::string GenerateStatsPage(DbConnection * const db_connection, const std::string &language_code_filter) {
+    std::string page("<html>\n");
+    page += "  <title>Translation Stats</table>\n";
+    page += "  <body>\n";
+    page += "    <h2>VuFind Interface Translations</h2>\n";
+    page += "    <table>\n";
+    page += "      <th>Language</th><th>Total count</th><th>Translated</th>>\n";
+    GenerateStats(db_connection, language_code_filter, "vufind_translations", "token", &page);
+    page += "    </table>\n";
+    page += "    <h2>Keyword Interface Translations</h2>\n";
+    page += "    <table>\n";
+    page += "      <th>Language</th><th>Total count</th><th>Translated</th>>\n";
+    GenerateStats(db_connection, language_code_filter, "keyword_translations", "ppn", &page);
+    page += "    </table>\n";
+    page += "  </body>\n";
+    page += "</html>\n";
+
+    return page;
+}
+
+
+struct CachedPage {
+    time_t creation_time_;
+    std::string contents_;
+};
+
+
+// Only useful when we are running as a FastCGI process, in which case it is shared by all requests.
+std::unordered_map<std::string, CachedPage> language_code_filter_to_cached_page;
+
+
+void ProcessRequest(DbConnection * const db_connection) {
+    std::multimap<std::string, std::string> cgi_args;
+    WebUtil::GetAllCgiArgs(&cgi_args);
+    const auto language_code_and_value(cgi_args.find("language_code"));
+    const std::string language_code_filter(language_code_and_value == cgi_args.end() ? "" : language_code_and_value->second);
+    if (not language_code_filter.empty()
+        and not TranslationUtil::IsValidFake3Or4LetterEnglishLanguagesCode(language_code_filter))
+    {
+        std::cout << "Status: 400 Bad Request\r\nContent-Type: text/plain; charset=utf-8\r\n\r\n"
+                  << "invalid language code!\n";
+        return;
+    }
+
+    const time_t now(std::time(nullptr));
+    CachedPage &cached_page(language_code_filter_to_cached_page[language_code_filter]);
+    if (cached_page.contents_.empty() or now - cached_page.creation_time_ >= MAX_PAGE_AGE) {
+        cached_page.creation_time_ = now;
+        cached_page.contents_ = GenerateStatsPage(db_connection, language_code_filter);
     }
+
+    std::cout << "Content-Type: text/html; charset=utf-8\r\n";
+    std::cout << "Cache-Control: max-age=" << (MAX_PAGE_AGE - (now - cached_page.creation_time_)) << "\r\n\r\n";
+    std::cout << cached_page.contents_;
 }
 
 
@@ -85,25 +126,7 @@ int Main(int /*argc*/, char *argv[]) {
     const std::string sql_password(ini_file.getString("", "sql_password"));
     DbConnection db_connection(sql_database, sql_username, sql_password);
 
-    std::vector<std::string> language_codes;
-    GetLanguageCodes(&db_connection, &language_codes);
-
-    std::cout << "Content-Type: text/html; charset=utf-8\r\n\r\n";
-    std::cout << "<html>\n";
-    std::cout << "  <title>Translation Stats</table>\n";
-    std::cout << "  <body>\n";
-    std::cout << "    <h2>VuFind Interface Translations</h2>\n";
-    std::cout << "    <table>\n";
-    std::cout << "      <th>Language</th><th>Total count</th><th>Translated</th>>\n";
-    GenerateStats(&db_connection, language_codes, "vufind_translations", "token");
-    std::cout << "    </table>\n";
-    std::cout << "    <h2>Keyword Interface Translations</h2>\n";
-    std::cout << "    <table>\n";
-    std::cout << "      <th>Language</th><th>Total count</th><th>Translated</th>>\n";
-    GenerateStats(&db_connection, language_codes, "keyword_translations", "ppn");
-    std::cout << "    </table>\n";
-    std::cout << "  </body>\n";
-    std::cout << "</html>\n";
+    WebUtil::ProcessCgiRequests([&db_connection]() { ProcessRequest(&db_connection); });
 
     return EXIT_SUCCESS;
 }
@@ -22,7 +22,6 @@
 #include <algorithm>
 #include <iostream>
 #include <set>
-#include <sstream>
 #include <string>
 #include <vector>
 #include "FileUtil.h"
@@ -53,10 +52,7 @@ std::multimap<std::string, std::string> cgi_args;
 
 
 void ExpandTemplate(const std::string &template_name, std::string * const body, const Template::Map &template_variables = {}) {
-    std::ifstream template_html(template_directory + template_name + ".html");
-    std::ostringstream template_out;
-    Template::ExpandTemplate(template_html, template_out, template_variables);
-    *body += template_out.str();
+    Template::CompiledTemplate::Load(template_directory + template_name + ".html")->expand(template_variables, body);
 }
 
 
@@ -75,9 +71,19 @@ void ShowError(const std::string &error_message, std::string * const body) {
 }
 
 
+// \return The stats last stored by FullTextCache::updateStats() or NULL if there are none, in which case we have to
+//         fall back to querying the cache itself.
+const FullTextCache::Stats *GetStats(FullTextCache * const cache) {
+    static FullTextCache::Stats stats;
+    static const bool have_stats(cache->getStats(&stats));
+    return have_stats ? &stats : nullptr;
+}
+
+
 void ShowPageHeader(FullTextCache * const cache, std::string * const body) {
-    unsigned cache_size = cache->getSize();
-    unsigned error_count = cache->getErrorCount();
+    const FullTextCache::Stats * const stats(GetStats(cache));
+    unsigned cache_size = (stats != nullptr) ? stats->cache_size_ : cache->getSize();
+    unsigned error_count = (stats != nullptr) ? stats->error_count_ : cache->getErrorCount();
     std::string error_rate_string("-");
     if (cache_size > 0) {
         float error_rate((static_cast<float>(error_count) / cache_size) * 100);
@@ -140,7 +146,9 @@ void ShowPageIdDetails(FullTextCache * const cache, std::string * const body) {
 
 void ShowPageErrorSummary(FullTextCache * const cache, std::string * const body) {
     std::vector<std::string> error_messages, counts, domains, urls, ids, links_details, links_error_details;
-    std::vector<FullTextCache::EntryGroup> groups = cache->getEntryGroupsByDomainAndErrorMessage();
+    const FullTextCache::Stats * const stats(GetStats(cache));
+    std::vector<FullTextCache::EntryGroup> groups = (stats != nullptr) ? stats->error_groups_
+                                                                       : cache->getEntryGroupsByDomainAndErrorMessage();
     for (auto const &group : groups) {
         counts.emplace_back(std::to_string(group.count_));
         domains.emplace_back("<a href=\"http://" + group.domain_ + "\">" + group.domain_ + "</a>");
@@ -160,6 +168,7 @@ void ShowPageErrorSummary(FullTextCache * const cache, std::string * const body)
     template_variables.insertArray("url", urls);
     template_variables.insertArray("link_details", links_details);
     template_variables.insertArray("link_error_details", links_error_details);
+    template_variables.insertScalar("stats_creation_time", (stats != nullptr) ? TimeUtil::TimeTToString(stats->creation_time_) : "now");
     ExpandTemplate("error_summary", body, template_variables);
 }
 
@@ -25,6 +25,7 @@
 #include <cstdlib>
 #include <cstring>
 #include "FullTextCache.h"
+#include "WebUtil.h"
 #include "util.h"
 
 
@@ -42,19 +43,15 @@ bool GetIdFromCGI(std::string * const id) {
 }
 
 
-void Lookup(const std::string &id) {
-    try {
-        FullTextCache cache;
-
-        std::string data;
-        if (not cache.getFullText(id, &data))
-            throw std::runtime_error("fulltext not found for id: " + id);
-
-        std::cout << "Content-Type: text/plain\r\n\r\n";
-        std::cout << data;
-    } catch (const std::exception &e) {
-        logger->error(std::string("caught exception: ") + e.what());
+void Lookup(FullTextCache * const cache, const std::string &id) {
+    std::string data;
+    if (not cache->getFullText(id, &data)) {
+        std::cout << "Status: 404 Not Found\r\nContent-Type: text/plain\r\n\r\nfulltext not found for id: " << id << '\n';
+        return;
     }
+
+    std::cout << "Content-Type: text/plain\r\n\r\n";
+    std::cout << data;
 }
 
 
@@ -64,13 +61,22 @@ void Lookup(const std::string &id) {
 int main(int argc, char* argv[]) {
     ::progname = argv[0];
 
-    std::string id;
-    if (argc == 2)
-        id = argv[1];
-    else if (not GetIdFromCGI(&id)) {
-        std::cerr << "ERROR: couldn't parse input!\n";
-        return EXIT_FAILURE;
-    }
+    try {
+        // Under FastCGI the cache and its database connection are shared by all requests.
+        FullTextCache cache;
 
-    Lookup(id);
+        WebUtil::ProcessCgiRequests([argc, argv, &cache]() {
+            std::string id;
+            if (argc == 2)
+                id = argv[1];
+            else if (not GetIdFromCGI(&id)) {
+                std::cout << "Status: 400 Bad Request\r\nContent-Type: text/plain\r\n\r\ncouldn't parse input!\n";
+                return;
+            }
+
+            Lookup(&cache, id);
+        });
+    } catch (const std::exception &e) {
+        logger->error(std::string("caught exception: ") + e.what());
+    }
 }
@@ -33,6 +33,7 @@
 #include "IniFile.h"
 #include "StringUtil.h"
 #include "Template.h"
+#include "TranslationUtil.h"
 #include "UBTools.h"
 #include "UrlUtil.h"
 #include "util.h"
@@ -67,27 +68,6 @@ DbResultSet ExecSqlAndReturnResultsOrDie(const std::string &select_statement, Db
 }
 
 
-std::vector<std::string> GetLanguageCodesFromTable(DbConnection &db_connection, const std::string &table_name) {
-    const std::string query("SELECT DISTINCT language_code from " + table_name + " ORDER BY language_code;");
-    DbResultSet result_set(ExecSqlAndReturnResultsOrDie(query, &db_connection));
-    std::vector <std::string> language_codes;
-    while (const DbRow db_row = result_set.getNextRow())
-        language_codes.emplace_back(db_row["language_code"]);
-
-    return language_codes;
-}
-
-
-std::vector<std::string> GetLanguageCodes(DbConnection &db_connection) {
-    std::vector <std::string> language_codes(GetLanguageCodesFromTable(db_connection, "vufind_translations"));
-    for (auto &language_code : GetLanguageCodesFromTable(db_connection, "keyword_translations")) {
-        if (std::find(language_codes.begin(), language_codes.end(), language_code) == language_codes.end())
-            language_codes.emplace_back(language_code);
-    }
-    return language_codes;
-}
-
-
 void ShowErrorPageAndDie(const std::string &title, const std::string &error_message, const std::string &description = "") {
     std::cout << "Content-Type: text/html; charset=utf-8\r\n\r\n";
     std::cout << "<!DOCTYPE html><html><head><title>" + title + "</title></head>"
@@ -203,36 +183,6 @@ std::string CreateNonEditableUpdateHintEntry(const std::string &value, const std
 }
 
 
-void GetSynonymsForGNDCode(DbConnection &db_connection, const std::string &gnd_code,
-                           std::vector<std::string> *const synonyms)
-{
-    synonyms->clear();
-    const std::string synonym_query("SELECT translation FROM keyword_translations WHERE gnd_code='" + gnd_code
-                                    + "' AND status='reliable_synonym' AND language_code='ger'");
-    DbResultSet result_set(ExecSqlAndReturnResultsOrDie(synonym_query, &db_connection));
-    if (result_set.empty())
-        return;
-
-    while (auto db_row = result_set.getNextRow())
-        synonyms->emplace_back(db_row["translation"]);
-}
-
-
-void GetMACSTranslationsForGNDCode(DbConnection &db_connection, const std::string &gnd_code,
-                                   std::vector<std::string> *const translations)
-{
-    translations->clear();
-    const std::string macs_query("SELECT translation FROM keyword_translations WHERE gnd_code='" + gnd_code + "' "
-                                 "AND origin=750 AND status='unreliable'");
-    DbResultSet result_set(ExecSqlAndReturnResultsOrDie(macs_query, &db_connection));
-    if (result_set.empty())
-        return;
-
-    while (auto db_row = result_set.getNextRow())
-        translations->emplace_back(db_row["translation"]);
-}
-
-
 int GetColumnIndexForColumnHeading(const std::vector<std::string> &column_headings,
                                    const std::vector<std::string> &row_values, const std::string &heading)
 {
@@ -359,7 +309,6 @@ void GetVuFindTranslationsAsHTMLRowsFromDatabase(DbConnection &db_connection, co
                                        " INNER JOIN vufind_sort_limit AS u USING (token)");
     DbResultSet result_set(ExecSqlAndReturnResultsOrDie(create_result_with_limit, &db_connection));
 
-    std::vector<std::string> language_codes(GetLanguageCodes(db_connection));
     std::vector<std::string> display_languages;
     GetDisplayLanguages(&display_languages, translator_languages, additional_view_languages, VUFIND);
     *headline = "<th>" + StringUtil::Join(display_languages, "</th><th>") + "</th>";
@@ -474,9 +423,20 @@ void GetKeyWordTranslationsAsHTMLRowsFromDatabase(DbConnection &db_connection, c
                                                "german_updated FROM keywords_ger_sorted AS v INNER JOIN sort_limit AS u USING "
                                                "(ppn)");
 
-    DbResultSet result_set(ExecSqlAndReturnResultsOrDie(create_result_with_limit, &db_connection));
+    // Fetch the synonyms and MACS translations for all GND codes on this page w/ one query each instead of two per row:
+    DbResultSet gnd_codes_result_set(ExecSqlAndReturnResultsOrDie("SELECT DISTINCT gnd_code FROM keywords_ger_sorted AS v "
+                                                                  "INNER JOIN sort_limit AS u USING (ppn)", &db_connection));
+    std::set<std::string> gnd_codes;
+    while (const auto db_row = gnd_codes_result_set.getNextRow())
+        gnd_codes.emplace(db_row["gnd_code"]);
+    TranslationUtil::TranslationCache synonym_cache(&db_connection, "keyword_translations", "gnd_code",
+                                                    "status='reliable_synonym'");
+    synonym_cache.prefetch(gnd_codes);
+    TranslationUtil::TranslationCache macs_translation_cache(&db_connection, "keyword_translations", "gnd_code",
+                                                             "origin=750 AND status='unreliable'");
+    macs_translation_cache.prefetch(gnd_codes);
 
-    std::vector<std::string> language_codes(GetLanguageCodes(db_connection));
+    DbResultSet result_set(ExecSqlAndReturnResultsOrDie(create_result_with_limit, &db_connection));
 
     std::vector<std::string> display_languages;
     GetDisplayLanguages(&display_languages, translator_languages, additional_view_languages);
@@ -510,16 +470,14 @@ void GetKeyWordTranslationsAsHTMLRowsFromDatabase(DbConnection &db_connection, c
                                                               "", gnd_code);
            }
            // Insert Synonyms
-           std::vector<std::string> synonyms;
-           GetSynonymsForGNDCode(db_connection, gnd_code, &synonyms);
+           const std::vector<std::string> synonyms(synonym_cache.lookup(gnd_code, "ger"));
            int synonym_index(GetColumnIndexForColumnHeading(display_languages, row_values, SYNONYM_COLUMN_DESCRIPTOR));
            if (synonym_index == NO_INDEX)
                continue;
            row_values[synonym_index] = CreateNonEditableSynonymEntry(synonyms, "<br/>");
 
            // Insert MACS Translations display table
-           std::vector<std::string> macs_translations;
-           GetMACSTranslationsForGNDCode(db_connection, gnd_code, &macs_translations);
+           const std::vector<std::string> macs_translations(macs_translation_cache.lookup(gnd_code));
            int macs_index(GetColumnIndexForColumnHeading(display_languages, row_values, MACS_COLUMN_DESCRIPTOR));
            if (macs_index == NO_INDEX)
                continue;
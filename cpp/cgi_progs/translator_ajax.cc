@@ -114,9 +114,7 @@ void Insert(const std::multimap<std::string, std::string> &cgi_args, const std::
 }
 
 
-int main(int argc, char *argv[]) {
-    ::progname = argv[0];
-
+void ProcessRequest(int argc, char *argv[]) {
     try {
         std::multimap<std::string, std::string> cgi_args;
         WebUtil::GetAllCgiArgs(&cgi_args, argc, argv);
@@ -145,3 +143,10 @@ int main(int argc, char *argv[]) {
         LOG_ERROR("caught exception: " + std::string(x.what()));
     }
 }
+
+
+int main(int argc, char *argv[]) {
+    ::progname = argv[0];
+
+    WebUtil::ProcessCgiRequests([argc, argv]() { ProcessRequest(argc, argv); });
+}
@@ -52,7 +52,7 @@ void GetUnreferencedPPNsFromDB(DbConnection * const db_connection, const std::un
                                std::vector<std::string> * const unreferenced_ppns) {
     // Get the ppn from the resources table
     db_connection->queryOrDie("SELECT DISTINCT record_id FROM resource");
-    DbResultSet result_set(db_connection->getLastResultSet());
+    DbResultSet result_set(db_connection->getLastResultSet(DbConnection::RSM_STREAM));
     if (result_set.empty())
         return;
 
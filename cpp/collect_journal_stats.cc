@@ -17,14 +17,19 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <cstdlib>
+#include <ctime>
 #include "Compiler.h"
+#include "DbBulkInserter.h"
 #include "DbConnection.h"
 #include "DnsUtil.h"
 #include "IniFile.h"
 #include "MapUtil.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
 #include "SqlUtil.h"
 #include "StringUtil.h"
 #include "UBTools.h"
@@ -74,61 +79,181 @@ unsigned short YearStringToShort(const std::string &year_as_string) {
 }
 
 
-void ProcessRecords(MARC::Reader * const reader, const std::unordered_map<std::string, std::string> &journal_ppn_to_type_and_title_map,
-                    DbConnection * const db_connection)
+// The columns that identify a row.  "N_Aufsaetze" is the number of articles w/ the same values for all of these.
+const std::vector<std::string> KEY_COLUMNS{ "Zeder_ID", "PPN_Typ", "PPN", "Jahr", "Band", "Heft", "Seitenbereich" };
+const char KEY_SEPARATOR('\t');
+
+
+typedef std::unordered_map<std::string, unsigned> KeysToArticleCountsMap;
+
+
+std::string MakeKey(const std::vector<std::string> &key_column_values) {
+    return StringUtil::Join(key_column_values, KEY_SEPARATOR);
+}
+
+
+// \note Unlike StringUtil::Split we have to keep empty leading and trailing values.
+std::vector<std::string> SplitKey(const std::string &key) {
+    std::vector<std::string> key_column_values;
+    size_t start(0), separator_pos;
+    while ((separator_pos = key.find(KEY_SEPARATOR, start)) != std::string::npos) {
+        key_column_values.emplace_back(key.substr(start, separator_pos - start));
+        start = separator_pos + 1;
+    }
+    key_column_values.emplace_back(key.substr(start));
+
+    return key_column_values;
+}
+
+
+// \return An empty string if "record" is not an article of one of our journals.
+std::string GetArticleKey(const MARC::Record &record,
+                          const std::unordered_map<std::string, std::string> &journal_ppn_to_type_and_title_map)
+{
+    const std::string superior_control_number(record.getSuperiorControlNumber());
+    if (superior_control_number.empty())
+        return "";
+
+    const auto journal_ppn_and_type_and_title(journal_ppn_to_type_and_title_map.find(superior_control_number));
+    if (journal_ppn_and_type_and_title == journal_ppn_to_type_and_title_map.cend())
+        return "";
+
+    const auto _936_field(record.findTag("936"));
+    if (_936_field == record.end())
+        return "";
+
+    std::string zeder_id, type, title;
+    SplitValue(journal_ppn_and_type_and_title->second, &zeder_id, &type, &title);
+
+    const std::string pages(_936_field->getFirstSubfieldWithCode('h'));
+    std::string volume;
+    std::string issue(_936_field->getFirstSubfieldWithCode('e'));
+    if (issue.empty())
+        issue = _936_field->getFirstSubfieldWithCode('d');
+    else
+        volume = _936_field->getFirstSubfieldWithCode('d');
+    const std::string year(_936_field->getFirstSubfieldWithCode('j'));
+
+    return MakeKey({ zeder_id, type, journal_ppn_and_type_and_title->first, std::to_string(YearStringToShort(year)), volume,
+                     issue, pages });
+}
+
+
+// Scans all records once.  Each worker thread counts into its own map and the maps are merged at the end.
+void CollectArticleCounts(MARC::Reader * const reader,
+                          const std::unordered_map<std::string, std::string> &journal_ppn_to_type_and_title_map,
+                          KeysToArticleCountsMap * const keys_to_article_counts_map)
 {
-    const auto JOB_START_TIME(std::to_string(std::time(nullptr)));
+    std::mutex worker_maps_mutex;
+    std::vector<std::unique_ptr<KeysToArticleCountsMap>> worker_maps;
+
+    MARC::ParallelProcessor processor(reader, /* writer = */nullptr);
+    const size_t total_count(processor.process([&](MARC::Record * const record) {
+        const std::string key(GetArticleKey(*record, journal_ppn_to_type_and_title_map));
+        if (key.empty())
+            return false;
+
+        thread_local KeysToArticleCountsMap *worker_map(nullptr);
+        if (unlikely(worker_map == nullptr)) {
+            std::lock_guard<std::mutex> worker_maps_locker(worker_maps_mutex);
+            worker_maps.emplace_back(new KeysToArticleCountsMap);
+            worker_map = worker_maps.back().get();
+        }
+        ++(*worker_map)[key];
+
+        return false;
+    }));
+
+    unsigned article_count(0);
+    for (const auto &worker_map : worker_maps) {
+        for (const auto &key_and_article_count : *worker_map) {
+            (*keys_to_article_counts_map)[key_and_article_count.first] += key_and_article_count.second;
+            article_count += key_and_article_count.second;
+        }
+    }
+
+    LOG_INFO("Processed " + std::to_string(total_count) + " records and found " + std::to_string(article_count)
+             + " articles in " + std::to_string(keys_to_article_counts_map->size()) + " distinct issues and page ranges.");
+}
+
+
+void LoadCurrentArticleCounts(DbConnection * const db_connection, const std::string &hostname,
+                              KeysToArticleCountsMap * const keys_to_article_counts_map)
+{
+    db_connection->queryOrDie("SELECT " + StringUtil::Join(KEY_COLUMNS, ',') + ",N_Aufsaetze FROM zeder.erschliessung "
+                              "WHERE Systemtyp='ixtheo' AND Quellrechner=" + db_connection->escapeAndQuoteString(hostname));
+    auto result_set(db_connection->getLastResultSet(DbConnection::RSM_STREAM));
+    std::vector<std::string> key_column_values(KEY_COLUMNS.size());
+    while (const auto row = result_set.getNextRow()) {
+        for (size_t column_no(0); column_no < KEY_COLUMNS.size(); ++column_no)
+            key_column_values[column_no] = row[column_no];
+        unsigned article_count;
+        if (unlikely(not StringUtil::ToUnsigned(row["N_Aufsaetze"], &article_count)))
+            article_count = 0; // Forces an update.
+        (*keys_to_article_counts_map)[MakeKey(key_column_values)] = article_count;
+    }
+}
+
+
+// Deletes the rows w/ the given keys w/ as few statements as possible.
+void DeleteRows(DbConnection * const db_connection, const std::string &hostname, const std::vector<std::string> &keys) {
+    const size_t MAX_ROWS_PER_STATEMENT(500);
+    const std::string STATEMENT_PREFIX("DELETE FROM zeder.erschliessung WHERE Systemtyp='ixtheo' AND Quellrechner="
+                                       + db_connection->escapeAndQuoteString(hostname) + " AND ("
+                                       + StringUtil::Join(KEY_COLUMNS, ',') + ") IN (");
+    std::string statement;
+    size_t row_count(0);
+    for (const auto &key : keys) {
+        std::vector<std::string> key_column_values(SplitKey(key));
+        for (auto &value : key_column_values)
+            value = db_connection->escapeAndQuoteString(value);
+        statement += (row_count == 0 ? STATEMENT_PREFIX : ",") + ("(" + StringUtil::Join(key_column_values, ',') + ")");
+        if (++row_count == MAX_ROWS_PER_STATEMENT) {
+            db_connection->queryOrDie(statement + ")");
+            statement.clear();
+            row_count = 0;
+        }
+    }
+    if (row_count > 0)
+        db_connection->queryOrDie(statement + ")");
+}
+
+
+void UpdateDatabase(DbConnection * const db_connection, const KeysToArticleCountsMap &keys_to_article_counts_map) {
+    const auto JOB_START_TIME(SqlUtil::TimeTToDatetime(std::time(nullptr)));
     const auto HOSTNAME(DnsUtil::GetHostname());
 
-    unsigned total_count(0), inserted_count(0);
-    while (const auto record = reader->read()) {
-        ++total_count;
-
-        const std::string superior_control_number(record.getSuperiorControlNumber());
-        if (superior_control_number.empty())
-            continue;
-
-        const auto journal_ppn_and_type_and_title(journal_ppn_to_type_and_title_map.find(superior_control_number));
-        if (journal_ppn_and_type_and_title == journal_ppn_to_type_and_title_map.cend())
-            continue;
-
-        const auto _936_field(record.findTag("936"));
-        if (_936_field == record.end())
-            continue;
-
-        std::string zeder_id, type, title;
-        SplitValue(journal_ppn_and_type_and_title->second, &zeder_id, &type, &title);
-
-        const std::string pages(_936_field->getFirstSubfieldWithCode('h'));
-        std::string volume;
-        std::string issue(_936_field->getFirstSubfieldWithCode('e'));
-        if (issue.empty())
-            issue = _936_field->getFirstSubfieldWithCode('d');
-        else
-            volume = _936_field->getFirstSubfieldWithCode('d');
-        const std::string year(_936_field->getFirstSubfieldWithCode('j'));
-
-        db_connection->insertIntoTableOrDie( "zeder.erschliessung",
-                                            {
-                                                { "timestamp=",    "JOB_START_TIME"                        },
-                                                { "Quellrechner=", HOSTNAME                                },
-                                                { "Systemtyp",     "ixtheo",                               },
-                                                { "Zeder_ID",      zeder_id                                },
-                                                { "Zeder_URL",     ZEDER_URL_PREFIX + zeder_id             },
-                                                { "PPN_Typ",       type                                    },
-                                                { "PPN",           journal_ppn_and_type_and_title->first   },
-                                                { "Jahr",          std::to_string(YearStringToShort(year)) },
-                                                { "Band",          volume                                  },
-                                                { "Heft",          issue                                   },
-                                                { "Seitenbereich", pages                                   },
-                                                { "N_Aufsaetze",   "1"                                     }
-                                            });
-
-        ++inserted_count;
+    KeysToArticleCountsMap current_keys_to_article_counts_map;
+    LoadCurrentArticleCounts(db_connection, HOSTNAME, &current_keys_to_article_counts_map);
+
+    // Rows whose article count changed are deleted and then inserted again like new rows:
+    std::vector<std::string> new_keys, changed_keys;
+    for (const auto &key_and_article_count : keys_to_article_counts_map) {
+        const auto current_key_and_article_count(current_keys_to_article_counts_map.find(key_and_article_count.first));
+        if (current_key_and_article_count == current_keys_to_article_counts_map.cend())
+            new_keys.emplace_back(key_and_article_count.first);
+        else if (current_key_and_article_count->second != key_and_article_count.second)
+            changed_keys.emplace_back(key_and_article_count.first);
+    }
+    DeleteRows(db_connection, HOSTNAME, changed_keys);
+
+    std::vector<std::string> column_names{ "timestamp", "Quellrechner", "Systemtyp", "Zeder_URL", "N_Aufsaetze" };
+    column_names.insert(column_names.end(), KEY_COLUMNS.cbegin(), KEY_COLUMNS.cend());
+    DbBulkInserter bulk_inserter(db_connection, "zeder.erschliessung", column_names);
+    for (const auto keys : { &new_keys, &changed_keys }) {
+        for (const auto &key : *keys) {
+            std::vector<std::string> key_column_values(SplitKey(key));
+            std::vector<std::string> values{ JOB_START_TIME, HOSTNAME, "ixtheo", ZEDER_URL_PREFIX + key_column_values[0],
+                                             std::to_string(keys_to_article_counts_map.find(key)->second) };
+            values.insert(values.end(), key_column_values.cbegin(), key_column_values.cend());
+            bulk_inserter.insert(values);
+        }
     }
+    bulk_inserter.flush();
 
-    LOG_INFO("Processed " + std::to_string(total_count) + " records and inserted " + std::to_string(inserted_count)
-             + " into Ingo's database.");
+    LOG_INFO("Inserted " + std::to_string(new_keys.size()) + " and updated " + std::to_string(changed_keys.size())
+             + " rows in Ingo's database, " + std::to_string(keys_to_article_counts_map.size() - new_keys.size()
+             - changed_keys.size()) + " rows were unchanged.");
 }
 
 
@@ -146,7 +271,9 @@ int Main(int argc, char *argv[]) {
     DbConnection db_connection(ini_file);
 
     const auto marc_reader(MARC::Reader::Factory(argv[1]));
-    ProcessRecords(marc_reader.get(), journal_ppn_to_type_and_title_map, &db_connection);
+    KeysToArticleCountsMap keys_to_article_counts_map;
+    CollectArticleCounts(marc_reader.get(), journal_ppn_to_type_and_title_map, &keys_to_article_counts_map);
+    UpdateDatabase(&db_connection, keys_to_article_counts_map);
 
     return EXIT_SUCCESS;
 }
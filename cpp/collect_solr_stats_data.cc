@@ -19,7 +19,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include <cstdlib>
 #include <ctime>
 #include "DbConnection.h"
@@ -28,7 +31,9 @@
 #include "IniFile.h"
 #include "JSON.h"
 #include "Solr.h"
+#include "SqlUtil.h"
 #include "TimeUtil.h"
+#include "UrlUtil.h"
 #include "util.h"
 
 
@@ -44,101 +49,173 @@ void Usage() {
 }
 
 
-void IssueQueryAndWriteOutput(const std::string &query, const std::string &system_type, const std::string &category,
-                              const std::string &variable, DbConnection * const db_connection)
+struct StatsQuery {
+    std::string query_, category_, variable_;
+    int64_t count_;
+public:
+    StatsQuery(const std::string &query, const std::string &category, const std::string &variable)
+        : query_(query), category_(category), variable_(variable), count_(0) { }
+};
+
+
+void AddQuery(const std::string &query, const std::string &category, const std::string &variable,
+              std::vector<StatsQuery> * const stats_queries)
+{
+    stats_queries->emplace_back(query, category, variable);
+}
+
+
+// We don't send one request per query but combine up to MAX_QUERIES_PER_REQUEST queries as query facets of a single request
+// and send up to MAX_CONCURRENT_REQUESTS of those requests at a time.
+const size_t MAX_QUERIES_PER_REQUEST(25);
+const unsigned MAX_CONCURRENT_REQUESTS(4);
+
+
+bool IssueCombinedRequest(Solr::Client * const solr_client, std::vector<StatsQuery>::iterator first_query,
+                          const std::vector<StatsQuery>::iterator last_query, std::string * const err_msg)
 {
-    static const time_t JOB_START_TIME(std::time(nullptr));
-    static const std::string HOSTNAME(DnsUtil::GetHostname());
+    std::string facets;
+    unsigned facet_no(0);
+    for (auto stats_query(first_query); stats_query != last_query; ++stats_query, ++facet_no)
+        facets += std::string(facets.empty() ? "" : ",") + "\"q" + std::to_string(facet_no) + "\":{\"type\":\"query\",\"q\":\""
+                  + JSON::EscapeString(stats_query->query_) + "\"}";
 
-    std::string json_result, err_msg;
-    if (not Solr::Query(query, /* fields = */"", &json_result, &err_msg, "localhost:8080",
-                        /* timeout in seconds = */Solr::DEFAULT_TIMEOUT, Solr::JSON, /* max_no_of_rows = */0))
-        LOG_ERROR("Solr query \"" + query + "\" failed! (" + err_msg + ")");
+    std::string json_result;
+    if (not solr_client->jsonRequest("select", "q=" + UrlUtil::UrlEncode("*:*") + "&rows=0&json.facet="
+                                     + UrlUtil::UrlEncode("{" + facets + "}"), &json_result, err_msg))
+        return false;
 
     JSON::Parser parser(json_result);
     std::shared_ptr<JSON::JSONNode> tree_root;
-    if (not parser.parse(&tree_root))
-        LOG_ERROR("JSON parser failed: " + parser.getErrorMessage());
-
-    const time_t NOW(std::time(nullptr));
-    db_connection->queryOrDie("INSERT INTO solr SET id_lauf=" + std::to_string(JOB_START_TIME) + ", timestamp='"
-                              + TimeUtil::TimeTToZuluString(NOW) + "', Quellrechner='" + HOSTNAME + "', Zielrechner='" + HOSTNAME
-                              + "', Systemtyp='" + system_type + "', Kategorie='" + category + "', Unterkategorie='" + variable + "', value="
-                              + std::to_string(JSON::LookupInteger("/response/numFound", tree_root)));
+    if (not parser.parse(&tree_root)) {
+        *err_msg = "JSON parser failed: " + parser.getErrorMessage();
+        return false;
+    }
+
+    // Solr omits the individual facets if the whole index is empty, hence the default:
+    facet_no = 0;
+    for (auto stats_query(first_query); stats_query != last_query; ++stats_query, ++facet_no)
+        stats_query->count_ = JSON::LookupInteger("/facets/q" + std::to_string(facet_no) + "/count", tree_root, 0);
+
+    return true;
+}
+
+
+void IssueQueries(std::vector<StatsQuery> * const stats_queries) {
+    const size_t request_count((stats_queries->size() + MAX_QUERIES_PER_REQUEST - 1) / MAX_QUERIES_PER_REQUEST);
+    std::vector<std::string> error_messages(request_count);
+    std::atomic<size_t> next_request_no(0);
+    std::vector<std::thread> threads;
+    for (unsigned thread_no(0); thread_no < std::min(request_count, static_cast<size_t>(MAX_CONCURRENT_REQUESTS)); ++thread_no)
+        threads.emplace_back([&]() {
+            Solr::Client solr_client("localhost:8080", /* timeout in seconds = */Solr::DEFAULT_TIMEOUT);
+            size_t request_no;
+            while ((request_no = next_request_no++) < request_count) {
+                const auto first_query(stats_queries->begin() + request_no * MAX_QUERIES_PER_REQUEST);
+                const auto last_query(stats_queries->begin() + std::min((request_no + 1) * MAX_QUERIES_PER_REQUEST,
+                                                                         stats_queries->size()));
+                if (not IssueCombinedRequest(&solr_client, first_query, last_query, &error_messages[request_no])
+                    and error_messages[request_no].empty())
+                    error_messages[request_no] = "unknown error";
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t request_no(0); request_no < request_count; ++request_no) {
+        if (unlikely(not error_messages[request_no].empty()))
+            LOG_ERROR("Solr request for \"" + (*stats_queries)[request_no * MAX_QUERIES_PER_REQUEST].query_ + "\" et al. failed! ("
+                      + error_messages[request_no] + ")");
+    }
 }
 
 
-void CollectGeneralStats(const std::string &system_type, DbConnection * const db_connection) {
+void WriteResults(const std::string &system_type, const std::vector<StatsQuery> &stats_queries,
+                  DbConnection * const db_connection)
+{
+    const std::string JOB_START_TIME(std::to_string(std::time(nullptr)));
+    const std::string HOSTNAME(DnsUtil::GetHostname());
+    const std::string NOW(TimeUtil::TimeTToZuluString(std::time(nullptr)));
+
+    std::vector<std::vector<std::string>> rows;
+    for (const auto &stats_query : stats_queries)
+        rows.emplace_back(std::vector<std::string>{ JOB_START_TIME, NOW, HOSTNAME, HOSTNAME, system_type, stats_query.category_,
+                                                    stats_query.variable_, std::to_string(stats_query.count_) });
+
+    SqlUtil::TransactionGuard transaction_guard(db_connection);
+    db_connection->insertIntoTableOrDie("solr", { "id_lauf", "timestamp", "Quellrechner", "Zielrechner", "Systemtyp", "Kategorie",
+                                                  "Unterkategorie", "value" }, rows);
+}
+
+
+void CollectGeneralStats(const std::string &system_type, std::vector<StatsQuery> * const stats_queries) {
     const std::string EXTRA(system_type == "relbib" ? RELBIB_EXTRA : "");
-    IssueQueryAndWriteOutput("*:*" + EXTRA, system_type, "Gesamt", "Gesamttreffer", db_connection);
-    IssueQueryAndWriteOutput("format:Book" + EXTRA, system_type, "Format", "Buch", db_connection);
-    IssueQueryAndWriteOutput("format:Article" + EXTRA, system_type, "Format", "Artikel", db_connection);
-    IssueQueryAndWriteOutput("mediatype:Electronic" + EXTRA, system_type, "Medientyp", "elektronisch", db_connection);
-    IssueQueryAndWriteOutput("mediatype:Non-Electronic" + EXTRA, system_type, "Medientyp", "non-elektronisch", db_connection);
+    AddQuery("*:*" + EXTRA, "Gesamt", "Gesamttreffer", stats_queries);
+    AddQuery("format:Book" + EXTRA, "Format", "Buch", stats_queries);
+    AddQuery("format:Article" + EXTRA, "Format", "Artikel", stats_queries);
+    AddQuery("mediatype:Electronic" + EXTRA, "Medientyp", "elektronisch", stats_queries);
+    AddQuery("mediatype:Non-Electronic" + EXTRA, "Medientyp", "non-elektronisch", stats_queries);
 }
 
 
-void CollectKrimDokSpecificStats(DbConnection * const db_connection) {
-    IssueQueryAndWriteOutput("language:German", "krimdok", "Sprache", "Deutsch", db_connection);
-    IssueQueryAndWriteOutput("language:English", "krimdok", "Sprache", "Englisch", db_connection);
+void CollectKrimDokSpecificStats(std::vector<StatsQuery> * const stats_queries) {
+    AddQuery("language:German", "Sprache", "Deutsch", stats_queries);
+    AddQuery("language:English", "Sprache", "Englisch", stats_queries);
 }
 
 
 void EmitNotationStats(const char notation_group, const std::string &system_type, const std::string &label,
-                       DbConnection * const db_connection)
+                       std::vector<StatsQuery> * const stats_queries)
 {
     const std::string EXTRA(system_type == "relbib" ? RELBIB_EXTRA : "");
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[1975 TO 2000]" + EXTRA,
-                             system_type, "IxTheo Notationen", label + "(Alle Medienarten, 1975-2000)", db_connection);
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[2001 TO *]" + EXTRA,
-                             system_type, "IxTheo Notationen", label + "(Alle Medienarten, 2001-heute)", db_connection);
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group)
-                             + "* AND publishDate:[1975 TO 2000] AND format:Book" + EXTRA, system_type, "IxTheo Notationen",
-                             label + "(Bücher, 1975-2000)", db_connection);
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[2001 TO *] AND format:Book"
-                             + EXTRA, system_type, "IxTheo Notationen", label + "(Bücher, 2001-heute)", db_connection);
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group)
-                             + "* AND publishDate:[1975 TO 2000] AND format:Article" + EXTRA, system_type, "IxTheo Notationen",
-                             label + "(Bücher, 1975-2000)", db_connection);
-    IssueQueryAndWriteOutput("ixtheo_notation:" + std::string(1, notation_group)
-                             + "* AND publishDate:[2001 TO *] AND format:Article" + EXTRA, system_type, "IxTheo Notationen",
-                             label + "(Aufsätze, 2001-heute)", db_connection);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[1975 TO 2000]" + EXTRA,
+             "IxTheo Notationen", label + "(Alle Medienarten, 1975-2000)", stats_queries);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[2001 TO *]" + EXTRA,
+             "IxTheo Notationen", label + "(Alle Medienarten, 2001-heute)", stats_queries);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[1975 TO 2000] AND format:Book" + EXTRA,
+             "IxTheo Notationen", label + "(Bücher, 1975-2000)", stats_queries);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[2001 TO *] AND format:Book" + EXTRA,
+             "IxTheo Notationen", label + "(Bücher, 2001-heute)", stats_queries);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[1975 TO 2000] AND format:Article" + EXTRA,
+             "IxTheo Notationen", label + "(Bücher, 1975-2000)", stats_queries);
+    AddQuery("ixtheo_notation:" + std::string(1, notation_group) + "* AND publishDate:[2001 TO *] AND format:Article" + EXTRA,
+             "IxTheo Notationen", label + "(Aufsätze, 2001-heute)", stats_queries);
 }
 
 
-void CollectIxTheoOrRelBibSpecificStats(const std::string &system_type, DbConnection * const db_connection) {
+void CollectIxTheoOrRelBibSpecificStats(const std::string &system_type, std::vector<StatsQuery> * const stats_queries) {
     const std::string EXTRA(system_type == "relbib" ? RELBIB_EXTRA : "");
-    IssueQueryAndWriteOutput("dewey-raw:*" + EXTRA, system_type, "DDC", "Anzahl der Datensätze", db_connection);
-    IssueQueryAndWriteOutput("rvk:*" + EXTRA, system_type, "RVK", "Anzahl der Datensätze", db_connection);
-    IssueQueryAndWriteOutput("is_open_access:open-access" + EXTRA, system_type, "Open Access", "ja", db_connection);
-    IssueQueryAndWriteOutput("is_open_access:non-open-access" + EXTRA, system_type, "Open Access", "nein", db_connection);
-
-    IssueQueryAndWriteOutput("language:German" + EXTRA, system_type, "Sprache", "Deutsch", db_connection);
-    IssueQueryAndWriteOutput("language:English" + EXTRA, system_type, "Sprache", "Englisch", db_connection);
-    IssueQueryAndWriteOutput("language:French" + EXTRA, system_type, "Sprache", "Französisch", db_connection);
-    IssueQueryAndWriteOutput("language:Italian" + EXTRA, system_type, "Sprache", "Italienisch", db_connection);
-    IssueQueryAndWriteOutput("language:Latin" + EXTRA, system_type, "Sprache", "Latein", db_connection);
-    IssueQueryAndWriteOutput("language:Spanish" + EXTRA, system_type, "Sprache", "Spanisch", db_connection);
-    IssueQueryAndWriteOutput("language:Dutch" + EXTRA, system_type, "Sprache", "Holländisch", db_connection);
-    IssueQueryAndWriteOutput("language:\"Ancient Greek\"" + EXTRA, system_type, "Sprache", "Altgriechisch", db_connection);
-    IssueQueryAndWriteOutput("language:Hebrew" + EXTRA, system_type, "Sprache", "Hebräisch", db_connection);
-    IssueQueryAndWriteOutput("language:Portugese" + EXTRA, system_type, "Sprache", "Portugiesisch", db_connection);
-
-    IssueQueryAndWriteOutput("ixtheo_notation:*" + EXTRA, system_type, "IxTheo Notationen", "Mit Notation", db_connection);
-    IssueQueryAndWriteOutput("-ixtheo_notation:*" + EXTRA, system_type, "IxTheo Notationen", "Ohne Notation", db_connection);
-    EmitNotationStats('A', system_type, "Religionswissenschaft allgemein", db_connection);
-    EmitNotationStats('B', system_type, "Einzelne Religionen", db_connection);
-    EmitNotationStats('C', system_type, "Christentum", db_connection);
-    EmitNotationStats('F', system_type, "Christliche Theologie", db_connection);
-    EmitNotationStats('H', system_type, "Bibel; Bibelwissenschaft", db_connection);
-    EmitNotationStats('K', system_type, "Kirchen- und Theologiegeschichte; Konfessionskunde", db_connection);
-    EmitNotationStats('N', system_type, "Systematische Theologie", db_connection);
-    EmitNotationStats('R', system_type, "Praktische Theologie", db_connection);
-    EmitNotationStats('S', system_type, "Kirchenrecht", db_connection);
-    EmitNotationStats('T', system_type, "(Profan-) Geschichte", db_connection);
-    EmitNotationStats('V', system_type, "Philosophie", db_connection);
-    EmitNotationStats('X', system_type, "Recht allgemein", db_connection);
-    EmitNotationStats('Z', system_type, "Sozialwissenschaften", db_connection);
+    AddQuery("dewey-raw:*" + EXTRA, "DDC", "Anzahl der Datensätze", stats_queries);
+    AddQuery("rvk:*" + EXTRA, "RVK", "Anzahl der Datensätze", stats_queries);
+    AddQuery("is_open_access:open-access" + EXTRA, "Open Access", "ja", stats_queries);
+    AddQuery("is_open_access:non-open-access" + EXTRA, "Open Access", "nein", stats_queries);
+
+    AddQuery("language:German" + EXTRA, "Sprache", "Deutsch", stats_queries);
+    AddQuery("language:English" + EXTRA, "Sprache", "Englisch", stats_queries);
+    AddQuery("language:French" + EXTRA, "Sprache", "Französisch", stats_queries);
+    AddQuery("language:Italian" + EXTRA, "Sprache", "Italienisch", stats_queries);
+    AddQuery("language:Latin" + EXTRA, "Sprache", "Latein", stats_queries);
+    AddQuery("language:Spanish" + EXTRA, "Sprache", "Spanisch", stats_queries);
+    AddQuery("language:Dutch" + EXTRA, "Sprache", "Holländisch", stats_queries);
+    AddQuery("language:\"Ancient Greek\"" + EXTRA, "Sprache", "Altgriechisch", stats_queries);
+    AddQuery("language:Hebrew" + EXTRA, "Sprache", "Hebräisch", stats_queries);
+    AddQuery("language:Portugese" + EXTRA, "Sprache", "Portugiesisch", stats_queries);
+
+    AddQuery("ixtheo_notation:*" + EXTRA, "IxTheo Notationen", "Mit Notation", stats_queries);
+    AddQuery("-ixtheo_notation:*" + EXTRA, "IxTheo Notationen", "Ohne Notation", stats_queries);
+    EmitNotationStats('A', system_type, "Religionswissenschaft allgemein", stats_queries);
+    EmitNotationStats('B', system_type, "Einzelne Religionen", stats_queries);
+    EmitNotationStats('C', system_type, "Christentum", stats_queries);
+    EmitNotationStats('F', system_type, "Christliche Theologie", stats_queries);
+    EmitNotationStats('H', system_type, "Bibel; Bibelwissenschaft", stats_queries);
+    EmitNotationStats('K', system_type, "Kirchen- und Theologiegeschichte; Konfessionskunde", stats_queries);
+    EmitNotationStats('N', system_type, "Systematische Theologie", stats_queries);
+    EmitNotationStats('R', system_type, "Praktische Theologie", stats_queries);
+    EmitNotationStats('S', system_type, "Kirchenrecht", stats_queries);
+    EmitNotationStats('T', system_type, "(Profan-) Geschichte", stats_queries);
+    EmitNotationStats('V', system_type, "Philosophie", stats_queries);
+    EmitNotationStats('X', system_type, "Recht allgemein", stats_queries);
+    EmitNotationStats('Z', system_type, "Sozialwissenschaften", stats_queries);
 }
 
 
@@ -161,11 +238,15 @@ int main(int argc, char **argv) {
         const IniFile ini_file;
         DbConnection db_connection(ini_file);
 
-        CollectGeneralStats(system_type, &db_connection);
+        std::vector<StatsQuery> stats_queries;
+        CollectGeneralStats(system_type, &stats_queries);
         if (system_type == "krimdok")
-            CollectKrimDokSpecificStats(&db_connection);
+            CollectKrimDokSpecificStats(&stats_queries);
         else
-            CollectIxTheoOrRelBibSpecificStats(system_type, &db_connection);
+            CollectIxTheoOrRelBibSpecificStats(system_type, &stats_queries);
+
+        IssueQueries(&stats_queries);
+        WriteResults(system_type, stats_queries, &db_connection);
     } catch (const std::exception &x) {
         LOG_ERROR("caught exception: " + std::string(x.what()));
     }
@@ -19,10 +19,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
-#include <set>
-#include <unordered_map>
+#include <vector>
 #include <cstdlib>
 #include "Compiler.h"
 #include "DbConnection.h"
@@ -41,85 +41,72 @@ namespace {
 }
 
 
-void PopulateResourceIdToRecordIdMap(
-    DbConnection * const connection,
-    std::unordered_map<std::string, std::string> * const resource_id_to_record_id_map)
-{
-    resource_id_to_record_id_map->clear();
+struct RecordTags {
+    std::string ppn_;
+    std::vector<std::string> tags_; // Sorted and unique.
+public:
+    explicit RecordTags(const std::string &ppn): ppn_(ppn) { }
+    inline bool operator<(const RecordTags &rhs) const { return ppn_ < rhs.ppn_; }
+};
 
-    connection->queryOrDie("SELECT id,record_id FROM resource");
-    DbResultSet result_set(connection->getLastResultSet());
 
-    while (const auto db_row = result_set.getNextRow())
-        resource_id_to_record_id_map->emplace(db_row["id"], db_row["record_id"]);
-
-    std::cout << "Found " << resource_id_to_record_id_map->size() << " mappings from resource ID's to record ID's.\n";
-}
-
-
-void PopulateTagIdToResourceIdMap(
-    DbConnection * const connection,
-    std::unordered_map<std::string, std::string> * const tag_id_to_resource_id_map)
-{
-    tag_id_to_resource_id_map->clear();
-
-    connection->queryOrDie("SELECT tag_id,resource_id FROM resource_tags");
-    DbResultSet result_set(connection->getLastResultSet());
-
-    while (const auto db_row = result_set.getNextRow())
-        tag_id_to_resource_id_map->emplace(db_row["tag_id"], db_row["resource_id"]);
-
-    std::cout << "Found " << tag_id_to_resource_id_map->size() << " mappings from tag ID's to resource ID's.\n";
+void SortAndUniqueTags(std::vector<std::string> * const tags) {
+    std::sort(tags->begin(), tags->end());
+    tags->erase(std::unique(tags->begin(), tags->end()), tags->end());
 }
 
 
-void ExtractTags(DbConnection * const connection,
-                 const std::unordered_map<std::string, std::string> &tag_id_to_resource_id_map,
-                 const std::unordered_map<std::string, std::string> &resource_id_to_record_id_map,
-                 std::unordered_map<std::string, std::set<std::string>> * const record_id_to_tags_map)
-{
-    record_id_to_tags_map->clear();
+// Streams all (record ID, tag) pairs in a single scan, ordered by record ID, so that the tags of a record are
+// adjacent and can be grouped w/o a hash table.  Resources w/ many tags and tags on many resources are both fine.
+void ExtractTags(DbConnection * const connection, std::vector<RecordTags> * const records_tags) {
+    records_tags->clear();
 
-    connection->queryOrDie("SELECT id,tag FROM tags");
-    DbResultSet result_set(connection->getLastResultSet());
+    connection->queryOrDie("SELECT resource.record_id,tags.tag FROM resource_tags JOIN resource ON resource.id=resource_tags.resource_id "
+                           "JOIN tags ON tags.id=resource_tags.tag_id ORDER BY resource.record_id");
+    DbResultSet result_set(connection->getLastResultSet(DbConnection::RSM_STREAM));
 
     unsigned tag_count(0);
     while (const auto db_row = result_set.getNextRow()) {
         ++tag_count;
+        const std::string record_id(db_row["record_id"]);
+        if (records_tags->empty() or records_tags->back().ppn_ != record_id)
+            records_tags->emplace_back(record_id);
+        records_tags->back().tags_.emplace_back(db_row["tag"]);
+    }
 
-        const auto tag_id_and_resource_id(tag_id_to_resource_id_map.find(db_row["id"]));
-        if (unlikely(tag_id_and_resource_id == tag_id_to_resource_id_map.end())) {
-            LOG_WARNING("no resource ID for tag ID \"" + db_row["id"] + "\" found!");
-            continue;
-        }
-
-        const auto resource_id_and_record_id(resource_id_to_record_id_map.find(tag_id_and_resource_id->second));
-        if (unlikely(resource_id_and_record_id == resource_id_to_record_id_map.end())) {
-            LOG_WARNING("no record ID for resource ID \"" + tag_id_and_resource_id->second + "\" found!");
-            continue;
+    // The database's collation need not agree w/ std::string's ordering, which we need for the binary searches in
+    // AddTagsToRecords(), and may even have split up the tags of a record:
+    if (not std::is_sorted(records_tags->begin(), records_tags->end())) {
+        std::stable_sort(records_tags->begin(), records_tags->end());
+        auto merged_end(records_tags->begin());
+        for (auto record_tags(records_tags->begin()); record_tags != records_tags->end(); ++record_tags) {
+            if (merged_end != records_tags->begin() and (merged_end - 1)->ppn_ == record_tags->ppn_)
+                (merged_end - 1)->tags_.insert((merged_end - 1)->tags_.end(), record_tags->tags_.begin(), record_tags->tags_.end());
+            else {
+                if (merged_end != record_tags)
+                    *merged_end = std::move(*record_tags);
+                ++merged_end;
+            }
         }
-
-        const auto record_id_and_tags(record_id_to_tags_map->find(resource_id_and_record_id->second));
-        if (record_id_and_tags == record_id_to_tags_map->end())
-            record_id_to_tags_map->emplace(resource_id_and_record_id->second, std::set<std::string>{ db_row["tag"] });
-        else
-            record_id_and_tags->second.insert(db_row["tag"]);
+        records_tags->erase(merged_end, records_tags->end());
     }
 
-    std::cout << "Found " << tag_count << " tag(s).\n";
+    for (auto &record_tags : *records_tags)
+        SortAndUniqueTags(&record_tags.tags_);
+
+    std::cout << "Found " << tag_count << " tag(s) for " << records_tags->size() << " record(s).\n";
 }
 
 
-void AddTagsToRecords(MARC::Reader * const reader, MARC::Writer * const writer,
-                      const std::unordered_map<std::string, std::set<std::string>> &record_id_to_tags_map)
-{
+void AddTagsToRecords(MARC::Reader * const reader, MARC::Writer * const writer, const std::vector<RecordTags> &records_tags) {
     unsigned total_count(0), modified_count(0);
     while (MARC::Record record = reader->read()) {
         ++total_count;
 
-        const auto record_id_and_tags(record_id_to_tags_map.find(record.getControlNumber()));
-        if (record_id_and_tags != record_id_to_tags_map.end()) {
-            for (const auto &tag : record_id_and_tags->second)
+        const RecordTags key(record.getControlNumber());
+        const auto record_tags(std::lower_bound(records_tags.cbegin(), records_tags.cend(), key));
+        if (record_tags != records_tags.cend() and record_tags->ppn_ == key.ppn_) {
+            for (const auto &tag : record_tags->tags_)
                 record.insertField("653", { { 'a', tag } });
             ++modified_count;
         }
@@ -143,16 +130,10 @@ int Main(int argc, char *argv[]) {
 
     std::shared_ptr<DbConnection> db_connection(VuFind::GetDbConnection());
 
-    std::unordered_map<std::string, std::string> resource_id_to_record_id_map;
-    PopulateResourceIdToRecordIdMap(db_connection.get(), &resource_id_to_record_id_map);
-
-    std::unordered_map<std::string, std::string> tag_id_to_resource_id_map;
-    PopulateTagIdToResourceIdMap(db_connection.get(), &tag_id_to_resource_id_map);
-
-    std::unordered_map<std::string, std::set<std::string>> record_id_to_tags_map;
-    ExtractTags(db_connection.get(), tag_id_to_resource_id_map, resource_id_to_record_id_map, &record_id_to_tags_map);
+    std::vector<RecordTags> records_tags;
+    ExtractTags(db_connection.get(), &records_tags);
 
-    AddTagsToRecords(reader.get(), writer.get(), record_id_to_tags_map);
+    AddTagsToRecords(reader.get(), writer.get(), records_tags);
 
     return EXIT_SUCCESS;
 }
@@ -1,7 +1,7 @@
 /** \brief Utility for counting references to GND numbers.
  *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
  *
- *  \copyright 2017 Universitätsbibliothek Tübingen.  All rights reserved.
+ *  \copyright 2017,2019 Universitätsbibliothek Tübingen.  All rights reserved.
  *
  *  This program is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU Affero General Public License as
@@ -18,11 +18,16 @@
 */
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
-#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <cstdlib>
 #include "FileUtil.h"
 #include "MARC.h"
+#include "MarcAuthorityIdTable.h"
+#include "MarcParallelProcessor.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -41,57 +46,79 @@ void Usage() {
 }
 
 
-void LoadGNDNumbers(File * const input, std::unordered_map<std::string, unsigned> * const gnd_numbers_and_counts) {
+// The id of each GND number is its index in "gnd_numbers".
+void LoadGNDNumbers(File * const input, MARC::AuthorityIdTable * const gnd_number_id_table,
+                    std::vector<std::string> * const gnd_numbers)
+{
     while (not input->eof()) {
         std::string line;
-        if (input->getline(&line) > 0)
-            gnd_numbers_and_counts->emplace(line, 0);
+        if (input->getline(&line) > 0 and gnd_number_id_table->getIdForGNDNumber(line) == MARC::AuthorityIdTable::NO_ID) {
+            gnd_number_id_table->add(/* ppn = */"", line);
+            gnd_numbers->emplace_back(line);
+        }
     }
 
-    std::cout << "Loaded " << gnd_numbers_and_counts->size() << " GND numbers.\n";
+    std::cout << "Loaded " << gnd_numbers->size() << " GND numbers.\n";
 }
 
 
-const std::vector<std::string> GND_REFERENCE_FIELDS{ "100", "600", "689", "700" };
+const std::vector<MARC::Tag> GND_REFERENCE_FIELDS{ "100", "600", "689", "700" };
 
 
 void ProcessRecords(MARC::Reader * const marc_reader, const std::unordered_set<std::string> &filter_set,
-                    std::unordered_map<std::string, unsigned> * const gnd_numbers_and_counts)
+                    const MARC::AuthorityIdTable &gnd_number_id_table, std::vector<unsigned> * const counts)
 {
-    unsigned matched_count(0);
-    while (const MARC::Record record = marc_reader->read()) {
+    counts->assign(gnd_number_id_table.size(), 0);
+
+    // Each worker thread counts into its own array so that no locking is needed while we process the records:
+    std::mutex worker_counts_mutex;
+    std::vector<std::unique_ptr<std::vector<unsigned>>> worker_counts;
+
+    // BinaryReader::readView() would restrict us to the reader thread.  Instead, projected reads keep the records small.
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+    processor.process([&](MARC::Record * const record) {
+        thread_local std::vector<unsigned> *worker_count(nullptr);
+        if (unlikely(worker_count == nullptr)) {
+            std::lock_guard<std::mutex> worker_counts_locker(worker_counts_mutex);
+            worker_counts.emplace_back(new std::vector<unsigned>(counts->size(), 0));
+            worker_count = worker_counts.back().get();
+        }
+
         if (not filter_set.empty()) {
-            if (filter_set.find(record.getControlNumber()) == filter_set.cend())
-                continue;
+            if (filter_set.find(record->getControlNumber()) == filter_set.cend())
+                return false;
         }
 
+        thread_local std::vector<uint32_t> ids;
         for (const auto &gnd_reference_field : GND_REFERENCE_FIELDS) {
-            for (const auto &field : record.getTagRange(gnd_reference_field)) {
-                const MARC::Subfields subfields(field.getSubfields());
-                for (const auto &subfield0 : subfields.extractSubfields('0')) {
-                    if (subfield0.length() <= __builtin_strlen("(DE-588)") or not StringUtil::StartsWith(subfield0, "(DE-588)"))
-                        continue;
-
-                    const std::string gnd_number(subfield0.substr(__builtin_strlen("(DE-588)")));
-                    const auto gnd_number_and_count(gnd_numbers_and_counts->find(gnd_number));
-                    if (gnd_number_and_count != gnd_numbers_and_counts->end()) {
-                        ++gnd_number_and_count->second;
-                        ++matched_count;
-                    }
-                }
+            for (const auto &field : record->getTagRange(gnd_reference_field)) {
+                ids.clear();
+                gnd_number_id_table.getReferencedIds(field.getContents(), &ids);
+                for (const uint32_t id : ids)
+                    ++(*worker_count)[id];
             }
         }
+
+        return false;
+    });
+
+    unsigned matched_count(0);
+    for (const auto &worker_count : worker_counts) {
+        for (size_t id(0); id < counts->size(); ++id) {
+            (*counts)[id] += (*worker_count)[id];
+            matched_count += (*worker_count)[id];
+        }
     }
 
-    std::cerr << "Found " << matched_count << " reference(s) to " << gnd_numbers_and_counts->size()
+    std::cerr << "Found " << matched_count << " reference(s) to " << counts->size()
               << " matching GND number(s).\n";
 }
 
 
-void WriteCounts(const std::unordered_map<std::string, unsigned> &gnd_numbers_and_counts, File * const output) {
-    for (const auto &gnd_number_and_count : gnd_numbers_and_counts) {
-        if (gnd_number_and_count.second > 0)
-            (*output) << gnd_number_and_count.first << '|' << gnd_number_and_count.second << '\n';
+void WriteCounts(const std::vector<std::string> &gnd_numbers, const std::vector<unsigned> &counts, File * const output) {
+    for (size_t id(0); id < gnd_numbers.size(); ++id) {
+        if (counts[id] > 0)
+            (*output) << gnd_numbers[id] << '|' << counts[id] << '\n';
     }
 }
 
@@ -130,14 +157,18 @@ int main(int argc, char *argv[]) {
 
     try {
         std::unique_ptr<File> gnd_numbers_and_counts_file(FileUtil::OpenInputFileOrDie(argv[1]));
-        std::unordered_map<std::string, unsigned> gnd_numbers_and_counts;
-        LoadGNDNumbers(gnd_numbers_and_counts_file.get(), &gnd_numbers_and_counts);
+        MARC::AuthorityIdTable gnd_number_id_table;
+        std::vector<std::string> gnd_numbers;
+        LoadGNDNumbers(gnd_numbers_and_counts_file.get(), &gnd_number_id_table, &gnd_numbers);
 
-        std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[2]));
-        ProcessRecords(marc_reader.get(), filter_set, &gnd_numbers_and_counts);
+        // We only decode the fields that we inspect which saves a lot of work on large collections:
+        std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[2], MARC::FileType::AUTO,
+                                                                        GND_REFERENCE_FIELDS));
+        std::vector<unsigned> counts;
+        ProcessRecords(marc_reader.get(), filter_set, gnd_number_id_table, &counts);
 
         std::unique_ptr<File> counts_file(FileUtil::OpenOutputFileOrDie(argv[3]));
-        WriteCounts(gnd_numbers_and_counts, counts_file.get());
+        WriteCounts(gnd_numbers, counts, counts_file.get());
     } catch (const std::exception &e) {
         logger->error("Caught exception: " + std::string(e.what()));
     }
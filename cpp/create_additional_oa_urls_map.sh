@@ -52,4 +52,6 @@ cd "$TMP_DIR"
 CreateDoiToUrlMap
 mv "$output_file" ..
 cd ..
-echo "Successfully created file \"${output_file}\""
+# Lets add_oa_urls memory-map the DOI's instead of having to parse the JSON:
+create_oadoi_url_table "$output_file"
+echo "Successfully created files \"${output_file}\" and \"${output_file}.table\""
@@ -18,19 +18,22 @@
  */
 
 #include <algorithm>
+#include <condition_variable>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include "ExecUtil.h"
+#include <cstring>
+#include "FullTextAcquisition.h"
+#include "FullTextCache.h"
 #include "MARC.h"
-#include "MiscUtil.h"
-#include "Semaphore.h"
 #include "StringUtil.h"
+#include "ThreadUtil.h"
 #include "UrlUtil.h"
 #include "util.h"
 
@@ -41,16 +44,26 @@ namespace {
 constexpr unsigned DEFAULT_PDF_EXTRACTION_TIMEOUT = 120; // seconds
 
 
+constexpr unsigned DEFAULT_DOWNLOAD_THREAD_COUNT(10);
+constexpr unsigned MAX_CONCURRENT_DOWNLOADS_PER_SERVER(2);
+
+
 [[noreturn]] void Usage() {
     std::cerr << "Usage: " << ::progname
-              << " [--process-count-low-and-high-watermarks low:high] [--pdf-extraction-timeout=timeout] [--only-open-access] marc_input marc_output\n"
-              << "       \"--process-count-low-and-high-watermarks\" sets the maximum and minimum number of spawned\n"
-              << "           child processes.  When we hit the high water mark we wait for child processes to exit\n"
-              << "           until we reach the low watermark.\n"
+              << " [--download-thread-count=n] [--extraction-thread-count=n] [--pdf-extraction-timeout=timeout] [--only-open-access]\n"
+              << "       marc_input marc_output\n"
+              << "       \"--download-thread-count\" sets the number of threads that download documents, the default is "
+              << DEFAULT_DOWNLOAD_THREAD_COUNT << ".\n"
+              << "           No more than " << MAX_CONCURRENT_DOWNLOADS_PER_SERVER
+              << " downloads from the same server will ever be active at the same time.\n"
+              << "       \"--extraction-thread-count\" sets the number of threads that convert downloaded documents to plain\n"
+              << "           text, the default is the number of hardware threads.\n"
               << "       \"--pdf-extraction-timeout\" which has a default of " << DEFAULT_PDF_EXTRACTION_TIMEOUT << '\n'
-              << "           seconds is the maximum amount of time spent by a subprocess in attemting text extraction from a\n"
+              << "           seconds is the maximum amount of time spent in attemting text extraction from a\n"
               << "           downloaded PDF document.\n"
-              << "       \"--only-open-access\" means that only open access texts will be processed.\n\n";
+              << "       \"--only-open-access\" means that only open access texts will be processed.\n"
+              << "       For backwards compatibility \"--process-count-low-and-high-watermarks low:high\" is also accepted\n"
+              << "       and sets the number of download threads to \"high\".\n\n";
 
     std::exit(EXIT_FAILURE);
 }
@@ -113,121 +126,213 @@ void ProcessNoDownloadRecords(const bool only_open_access, MARC::Reader * const
 }
 
 
-// Returns the number of child processes that returned a non-zero exit code.
-void CleanUpZombies(const unsigned no_of_zombies_to_collect,
-                    std::map<std::string, unsigned> * const hostname_to_outstanding_request_count_map,
-                    std::map<int, std::string> * const process_id_to_hostname_map,
-                    unsigned * const child_reported_failure_count, unsigned * const active_child_count)
-{
-    for (unsigned zombie_no(0); zombie_no < no_of_zombies_to_collect; ++zombie_no) {
-        int exit_code;
-        const pid_t zombie_pid(::wait(&exit_code));
-        if (exit_code != 0)
-            ++*child_reported_failure_count;
-        --*active_child_count;
-
-        const auto process_id_and_hostname(process_id_to_hostname_map->find(zombie_pid));
-        if (unlikely(process_id_and_hostname == process_id_to_hostname_map->end()))
-            LOG_ERROR("This should *never* happen!");
-
-        if (--(*hostname_to_outstanding_request_count_map)[process_id_and_hostname->second] == 0)
-            hostname_to_outstanding_request_count_map->erase(process_id_and_hostname->second);
-        process_id_to_hostname_map->erase(process_id_and_hostname);
-    }
+// Limits the number of concurrent downloads from any single server.
+class ServerSlots {
+    std::mutex mutex_;
+    std::condition_variable slot_released_condition_;
+    std::unordered_map<std::string, unsigned> hostname_to_outstanding_request_count_map_;
+public:
+    void acquire(const std::string &server_hostname);
+    void release(const std::string &server_hostname);
+};
+
+
+void ServerSlots::acquire(const std::string &server_hostname) {
+    if (server_hostname.empty())
+        return;
+
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    slot_released_condition_.wait(mutex_locker, [this, &server_hostname] {
+        const auto hostname_and_count(hostname_to_outstanding_request_count_map_.find(server_hostname));
+        return hostname_and_count == hostname_to_outstanding_request_count_map_.end()
+               or hostname_and_count->second < MAX_CONCURRENT_DOWNLOADS_PER_SERVER;
+    });
+    ++hostname_to_outstanding_request_count_map_[server_hostname];
 }
 
 
-const std::string UPDATE_FULL_TEXT_DB_PATH("/usr/local/bin/update_full_text_db");
+void ServerSlots::release(const std::string &server_hostname) {
+    if (server_hostname.empty())
+        return;
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    if (--hostname_to_outstanding_request_count_map_[server_hostname] == 0)
+        hostname_to_outstanding_request_count_map_.erase(server_hostname);
+    slot_released_condition_.notify_all();
+}
+
+
+// A record on its way through our download, extraction and output stages.
+struct Job {
+    MARC::Record record_;
+    std::string server_hostname_;
+    bool write_unchanged_, cached_;
+    std::vector<std::string> urls_;
+    std::vector<FullTextAcquisition::Document> documents_;
+    std::string full_text_;
+    std::vector<FullTextCache::EntryUrl> entry_urls_;
+public:
+    Job(MARC::Record &&record, const std::string &server_hostname, const bool write_unchanged)
+        : record_(std::move(record)), server_hostname_(server_hostname), write_unchanged_(write_unchanged), cached_(false) { }
+};
+
+
+typedef ThreadUtil::BoundedQueue<std::unique_ptr<Job>> JobQueue;
+
 
+// Loads cached full texts or downloads the documents of each job.
+void DownloadThread(const std::shared_ptr<const BloomFilter> &id_filter, ServerSlots * const server_slots,
+                    JobQueue * const download_queue, JobQueue * const extraction_queue, JobQueue * const output_queue)
+{
+    FullTextCache cache;
+    cache.setIdFilter(id_filter);
+    std::unique_ptr<Job> job;
+    while (download_queue->pop(&job)) {
+        try {
+            job->urls_ = FullTextAcquisition::GetUrls(job->record_);
+            if (not cache.entryExpired(job->record_.getControlNumber(), job->urls_)) {
+                cache.getFullText(job->record_.getControlNumber(), &job->full_text_);
+                job->cached_ = true;
+                output_queue->push(std::move(job));
+                continue;
+            }
+
+            server_slots->acquire(job->server_hostname_);
+            job->documents_.resize(job->urls_.size());
+            for (size_t url_no(0); url_no < job->urls_.size(); ++url_no)
+                FullTextAcquisition::Download(job->urls_[url_no], FullTextAcquisition::PER_DOC_TIMEOUT, &job->documents_[url_no]);
+            server_slots->release(job->server_hostname_);
+        } catch (const std::exception &x) {
+            LOG_WARNING("caught exception while downloading for PPN " + job->record_.getControlNumber() + ": "
+                        + std::string(x.what()));
+            server_slots->release(job->server_hostname_);
+            job->write_unchanged_ = true;
+            output_queue->push(std::move(job));
+            continue;
+        }
+
+        extraction_queue->push(std::move(job));
+    }
+}
 
-void ScheduleSubprocess(const std::string &server_hostname, const off_t marc_record_start, const unsigned pdf_extraction_timeout,
-                        const std::string &marc_input_filename, const std::string &marc_output_filename,
-                        std::map<std::string, unsigned> * const hostname_to_outstanding_request_count_map,
-                        std::map<int, std::string> * const process_id_to_hostname_map,
-                        unsigned * const child_reported_failure_count, unsigned * const active_child_count)
+
+void ExtractionThread(const unsigned pdf_extraction_timeout, FullTextAcquisition::ExtractedTextCache * const extracted_text_cache,
+                      JobQueue * const extraction_queue, JobQueue * const output_queue)
 {
-    constexpr unsigned MAX_CONCURRENT_DOWNLOADS_PER_SERVER = 2;
-
-    // Wait until we have a slot available for the server:
-    for (;;) {
-        auto hostname_and_count(hostname_to_outstanding_request_count_map->find(server_hostname));
-        if (hostname_and_count == hostname_to_outstanding_request_count_map->end()) {
-            (*hostname_to_outstanding_request_count_map)[server_hostname] = 1;
-            break;
-        } else if (server_hostname.empty() or hostname_and_count->second < MAX_CONCURRENT_DOWNLOADS_PER_SERVER) {
-            ++hostname_and_count->second;
-            break;
+    std::unique_ptr<Job> job;
+    while (extraction_queue->pop(&job)) {
+        try {
+            job->full_text_ = FullTextAcquisition::ExtractFullText(job->record_, job->documents_, pdf_extraction_timeout,
+                                                                   &job->entry_urls_, extracted_text_cache);
+        } catch (const std::exception &x) {
+            LOG_WARNING("caught exception while extracting the full text for PPN " + job->record_.getControlNumber() + ": "
+                        + std::string(x.what()));
+            job->write_unchanged_ = true;
         }
+        job->documents_.clear(); // Release downloaded documents and temporary PDF files early.
 
-        CleanUpZombies(/*no_of_zombies*/ 1, hostname_to_outstanding_request_count_map, process_id_to_hostname_map,
-                       child_reported_failure_count, active_child_count);
+        output_queue->push(std::move(job));
     }
+}
+
+
+// The only thread that writes to the full-text cache and to "marc_writer".
+void OutputThread(MARC::Writer * const marc_writer, JobQueue * const output_queue, unsigned * const cached_count,
+                  unsigned * const failure_count)
+{
+    FullTextCache cache; // Buffers new entries and sends them to Elasticsearch in bulk.
+    std::unique_ptr<Job> job;
+    while (output_queue->pop(&job)) {
+        if (job->write_unchanged_) {
+            ++*failure_count;
+            marc_writer->write(job->record_);
+            continue;
+        }
 
-    std::vector<std::string> args;
-    args.emplace_back("--pdf-extraction-timeout=" + std::to_string(pdf_extraction_timeout));
-    args.emplace_back(std::to_string(marc_record_start));
-    args.emplace_back(marc_input_filename);
-    args.emplace_back(marc_output_filename);
+        if (job->cached_)
+            ++*cached_count;
+        else {
+            bool at_least_one_error(false);
+            for (const auto &entry_url : job->entry_urls_)
+                at_least_one_error = at_least_one_error or not entry_url.error_message_.empty();
+            if (at_least_one_error or job->urls_.empty())
+                ++*failure_count;
 
-    const int child_pid(ExecUtil::Spawn(UPDATE_FULL_TEXT_DB_PATH, args));
-    if (unlikely(child_pid == -1))
-        LOG_ERROR("ExecUtil::Spawn failed! (no more resources?)");
+            cache.insertEntry(job->record_.getControlNumber(), job->full_text_, job->entry_urls_);
+        }
 
-    (*process_id_to_hostname_map)[child_pid] = server_hostname;
-    ++*active_child_count;
+        if (not job->full_text_.empty())
+            FullTextAcquisition::AddFullTextLink(&job->record_);
+        marc_writer->write(job->record_);
+    }
 }
 
 
 void ProcessDownloadRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
                             const unsigned pdf_extraction_timeout,
                             const std::vector<std::pair<off_t, std::string>> &download_record_offsets_and_urls,
-                            const unsigned process_count_low_watermark, const unsigned process_count_high_watermark)
+                            const unsigned download_thread_count, const unsigned extraction_thread_count)
 {
-    Semaphore semaphore("/full_text_cached_counter", Semaphore::CREATE);
-    unsigned active_child_count(0), child_reported_failure_count(0);
-
-    std::map<std::string, unsigned> hostname_to_outstanding_request_count_map;
-    std::map<int, std::string> process_id_to_hostname_map;
+    // Lets our download threads skip the cache lookups for records that have never been cached:
+    const auto id_filter(FullTextCache().getIdFilter());
+
+    // Print/online pairs and multiple 856 links often lead to the same document:
+    FullTextAcquisition::ExtractedTextCache extracted_text_cache;
+
+    ServerSlots server_slots;
+    JobQueue download_queue(2 * download_thread_count), extraction_queue(2 * extraction_thread_count),
+             output_queue(2 * (download_thread_count + extraction_thread_count));
+
+    unsigned cached_count(0), failure_count(0);
+    std::thread output_thread(OutputThread, marc_writer, &output_queue, &cached_count, &failure_count);
+    std::vector<std::thread> extraction_threads;
+    for (unsigned thread_no(0); thread_no < extraction_thread_count; ++thread_no)
+        extraction_threads.emplace_back(ExtractionThread, pdf_extraction_timeout, &extracted_text_cache, &extraction_queue,
+                                        &output_queue);
+    std::vector<std::thread> download_threads;
+    for (unsigned thread_no(0); thread_no < download_thread_count; ++thread_no)
+        download_threads.emplace_back(DownloadThread, id_filter, &server_slots, &download_queue, &extraction_queue, &output_queue);
 
     for (const auto &offset_and_url : download_record_offsets_and_urls) {
+        if (unlikely(not marc_reader->seek(offset_and_url.first)))
+            LOG_ERROR("seek failed!");
+        MARC::Record record(marc_reader->read());
+
         const std::string &url(offset_and_url.second);
         std::string scheme, username_password, authority, port, path, params, query, fragment, relative_url;
         if (not url.empty() and not UrlUtil::ParseUrl(url, &scheme, &username_password, &authority, &port, &path, &params,
                                                       &query, &fragment, &relative_url))
         {
             LOG_WARNING("failed to parse URL: " + url);
-
-            // Safely append the MARC data to the MARC output file:
-            if (unlikely(not marc_reader->seek(offset_and_url.first)))
-                LOG_ERROR("seek failed!");
-            const MARC::Record record = marc_reader->read();
-            MARC::FileLockedComposeAndWriteRecord(marc_writer, record);
-
+            output_queue.push(std::unique_ptr<Job>(new Job(std::move(record), authority, /* write_unchanged = */true)));
             continue;
         }
 
-        ScheduleSubprocess(authority, offset_and_url.first, pdf_extraction_timeout, marc_reader->getPath(),
-                           marc_writer->getFile().getPath(), &hostname_to_outstanding_request_count_map,
-                           &process_id_to_hostname_map, &child_reported_failure_count, &active_child_count);
-
-        if (active_child_count > process_count_high_watermark)
-            CleanUpZombies(active_child_count - process_count_low_watermark, &hostname_to_outstanding_request_count_map,
-                           &process_id_to_hostname_map, &child_reported_failure_count, &active_child_count);
+        download_queue.push(std::unique_ptr<Job>(new Job(std::move(record), authority, /* write_unchanged = */false)));
     }
 
-    // Wait for stragglers:
-    CleanUpZombies(active_child_count, &hostname_to_outstanding_request_count_map, &process_id_to_hostname_map,
-                   &child_reported_failure_count, &active_child_count);
+    // Drain the pipeline stage by stage:
+    download_queue.close();
+    for (auto &download_thread : download_threads)
+        download_thread.join();
+    extraction_queue.close();
+    for (auto &extraction_thread : extraction_threads)
+        extraction_thread.join();
+    output_queue.close();
+    output_thread.join();
 
-    std::cerr << "Spawned " << download_record_offsets_and_urls.size() << " subprocesses.\n";
-    std::cerr << semaphore.getValue()
-              << " documents were not downloaded because their cached values had not yet expired.\n";
-    std::cerr << child_reported_failure_count << " children reported a failure!\n";
-}
+    // The full-text cache monitor and full_text_stats only read the precomputed stats:
+    FullTextCache().updateStats();
 
+    if (unlikely(not marc_writer->flush()))
+        LOG_ERROR("flush to \"" + marc_writer->getFile().getPath() + "\" failed!");
 
-constexpr unsigned PROCESS_COUNT_DEFAULT_HIGH_WATERMARK(10);
-constexpr unsigned PROCESS_COUNT_DEFAULT_LOW_WATERMARK(5);
+    std::cerr << "Processed " << download_record_offsets_and_urls.size() << " records w/ "
+              << download_thread_count << " download and " << extraction_thread_count << " extraction threads.\n";
+    std::cerr << cached_count << " documents were not downloaded because their cached values had not yet expired.\n";
+    std::cerr << extracted_text_cache.getHitCount() << " downloaded documents were duplicates that needed no text extraction.\n";
+    std::cerr << failure_count << " records reported a failure!\n";
+}
 
 
 void ExtractLowAndHighWatermarks(const std::string &arg, unsigned * const process_count_low_watermark,
@@ -244,25 +349,44 @@ void ExtractLowAndHighWatermarks(const std::string &arg, unsigned * const proces
 }
 
 
+unsigned ExtractThreadCount(const char * const arg, const std::string &option_prefix) {
+    unsigned thread_count;
+    if (not StringUtil::ToNumber(arg + option_prefix.length(), &thread_count) or thread_count == 0)
+        LOG_ERROR("bad value for " + option_prefix.substr(0, option_prefix.length() - 1) + "!");
+    return thread_count;
+}
+
+
 } // unnamed namespace
 
 
 int main(int argc, char **argv) {
     ::progname = argv[0];
-    MiscUtil::SetEnv("LOGGER_FORMAT", "process_pids");
 
     if (argc < 3)
         Usage();
 
     // Process optional args:
-    unsigned process_count_low_watermark(PROCESS_COUNT_DEFAULT_LOW_WATERMARK),
-             process_count_high_watermark(PROCESS_COUNT_DEFAULT_HIGH_WATERMARK);
+    unsigned download_thread_count(DEFAULT_DOWNLOAD_THREAD_COUNT);
     if (std::strcmp(argv[1], "--process-count-low-and-high-watermarks") == 0) {
+        unsigned process_count_low_watermark, process_count_high_watermark;
         ExtractLowAndHighWatermarks(argv[2], &process_count_low_watermark, &process_count_high_watermark);
+        download_thread_count = process_count_high_watermark;
         argv += 2;
         argc -= 2;
     }
 
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--download-thread-count=")) {
+        download_thread_count = ExtractThreadCount(argv[1], "--download-thread-count=");
+        ++argv, --argc;
+    }
+
+    unsigned extraction_thread_count(std::max(std::thread::hardware_concurrency(), 1u));
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--extraction-thread-count=")) {
+        extraction_thread_count = ExtractThreadCount(argv[1], "--extraction-thread-count=");
+        ++argv, --argc;
+    }
+
     unsigned pdf_extraction_timeout(DEFAULT_PDF_EXTRACTION_TIMEOUT);
     if (argc > 1 and StringUtil::StartsWith(argv[1], "--pdf-extraction-timeout=")) {
         if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--pdf-extraction-timeout="), &pdf_extraction_timeout)
@@ -296,7 +420,7 @@ int main(int argc, char **argv) {
         std::random_shuffle(download_record_offsets_and_urls.begin(), download_record_offsets_and_urls.end());
 
         ProcessDownloadRecords(marc_reader.get(), marc_writer.get(), pdf_extraction_timeout, download_record_offsets_and_urls,
-                               process_count_low_watermark, process_count_high_watermark);
+                               download_thread_count, extraction_thread_count);
     } catch (const std::exception &e) {
         LOG_ERROR("Caught exception: " + std::string(e.what()));
     }
@@ -22,9 +22,11 @@
 #include <unordered_set>
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
 #include "BSZUtil.h"
 #include "Compiler.h"
 #include "ControlNumberGuesser.h"
+#include "ControlNumberIndex.h"
 #include "MARC.h"
 #include "util.h"
 
@@ -33,7 +35,9 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " [--min-log-level=min_verbosity] marc_titles\n";
+    std::cerr << "Usage: " << ::progname << " [--min-log-level=min_verbosity] [--index-only] marc_titles\n"
+              << "       Populates the control number guesser's database as well as the memory-mapped control number index.\n"
+              << "       If \"--index-only\" has been specified, only the index will be generated.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -82,12 +86,26 @@ void PopulateTables(ControlNumberGuesser * const control_number_guesser, MARC::R
 
 
 int Main(int argc, char **argv) {
+    bool index_only(false);
+    if (argc > 1 and std::strcmp(argv[1], "--index-only") == 0) {
+        index_only = true;
+        --argc;
+        ++argv;
+    }
+
     if (argc != 2)
         Usage();
 
-    ControlNumberGuesser control_number_guesser;
     auto reader(MARC::Reader::Factory(argv[1]));
-    PopulateTables(&control_number_guesser, reader.get());
+    if (not index_only) {
+        ControlNumberGuesser control_number_guesser(DbConnection::SP_BULK_LOAD);
+        PopulateTables(&control_number_guesser, reader.get());
+        reader->rewind();
+    }
+
+    const size_t record_count(ControlNumberIndex::Create(reader.get()));
+    LOG_INFO("Wrote an index for " + std::to_string(record_count) + " records to \"" + ControlNumberIndex::DEFAULT_INDEX_PATH
+             + "\".");
 
     return EXIT_SUCCESS;
 }
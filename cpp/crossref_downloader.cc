@@ -18,21 +18,23 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <unordered_set>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
-#include <kchashdb.h>
 #include "Compiler.h"
+#include "DownloadBatch.h"
 #include "Downloader.h"
 #include "FileUtil.h"
-#include "HttpHeader.h"
 #include "JSON.h"
+#include "KeyValueStore.h"
 #include "MARC.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
 #include "UBTools.h"
+#include "UrlUtil.h"
 #include "util.h"
 
 
@@ -40,7 +42,8 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " [--timeout seconds] journal_list marc_output\n";
+    std::cerr << "Usage: " << ::progname << " [--timeout seconds] [--max-concurrent-requests count] journal_list marc_output\n"
+              << "       Each journal's works are fetched page by page using Crossref's deep paging cursors.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -423,7 +426,7 @@ bool AddTitle(const JSON::ObjectNode &message_tree, MARC::Record * const marc_re
 
 
 /** \return True, if we wrote a record and false if we suppressed a duplicate. */
-bool CreateAndWriteMarcRecord(MARC::Writer * const marc_writer, kyotocabinet::HashDB * const notified_db,
+bool CreateAndWriteMarcRecord(MARC::Writer * const marc_writer, KeyValueStore::WriteTransaction * const notified_db,
                               const std::string &DOI, const std::string &ISSN, const JSON::ObjectNode &message_tree,
                               const std::vector<MapDescriptor *> &map_descriptors)
 {
@@ -457,14 +460,11 @@ bool CreateAndWriteMarcRecord(MARC::Writer * const marc_writer, kyotocabinet::Ha
     AddIssueInfo(message_tree, &record);
 
     // If we have already encountered the exact same record in the past we skip writing it:
-    std::string old_hash, new_hash(MARC::CalcChecksum(record));
-    if (notified_db->get(DOI, &old_hash)) {
-        if (old_hash == new_hash)
-            return false;
-    }
-    if (unlikely(not notified_db->set(DOI, new_hash)))
-        LOG_ERROR("failed to write the DOI \"" + DOI + "\" into \"" + notified_db->path() + "\"! ("
-                  + std::string(notified_db->error().message()) + ")");
+    const std::string new_hash(MARC::CalcChecksum(record));
+    StringView old_hash;
+    if (notified_db->get(DOI, &old_hash) and old_hash == new_hash)
+        return false;
+    notified_db->put(DOI, new_hash);
 
     marc_writer->write(record);
     return true;
@@ -498,95 +498,138 @@ bool GetISSNsAndJournalName(const std::string &line, std::vector<std::string> *
 }
 
 
-void ProcessISSN(const std::string &ISSN, const unsigned timeout, MARC::Writer * const marc_writer,
-                 kyotocabinet::HashDB * const notified_db, const std::vector<MapDescriptor *> &map_descriptors,
-                 std::unordered_set<std::string> * const already_seen, unsigned * const written_count,
-                 unsigned * const suppressed_count)
+const std::string CROSSREF_JOURNALS_URL("https://api.crossref.org/v1/journals/");
+const unsigned ROWS_PER_PAGE(1000); // The maximum that Crossref allows.
+
+
+struct Journal {
+    std::string name_;
+    std::unordered_set<std::string> already_seen_; // DOI's of the items of all of our ISSN's.
+    unsigned written_count_, suppressed_count_;
+public:
+    explicit Journal(const std::string &name): name_(name), written_count_(0), suppressed_count_(0) { }
+};
+
+
+// Changes to the notified DB are committed in batches of this size.
+constexpr unsigned NOTIFIED_DB_COMMIT_INTERVAL(1000);
+
+
+struct HarvestContext {
+    DownloadBatch download_batch_;
+    const unsigned timeout_; // In seconds.
+    MARC::Writer * const marc_writer_;
+    KeyValueStore * const notified_db_;
+    std::unique_ptr<KeyValueStore::WriteTransaction> notified_db_transaction_;
+    unsigned uncommitted_record_count_;
+    const std::vector<MapDescriptor *> &map_descriptors_;
+public:
+    HarvestContext(const unsigned max_concurrent_requests, const unsigned timeout, MARC::Writer * const marc_writer,
+                   KeyValueStore * const notified_db, const std::vector<MapDescriptor *> &map_descriptors)
+        : download_batch_(max_concurrent_requests, max_concurrent_requests), timeout_(timeout), marc_writer_(marc_writer),
+          notified_db_(notified_db), notified_db_transaction_(new KeyValueStore::WriteTransaction(notified_db)),
+          uncommitted_record_count_(0), map_descriptors_(map_descriptors) { }
+
+    void commitNotifiedDBChanges() {
+        notified_db_transaction_->commit();
+        notified_db_transaction_.reset(new KeyValueStore::WriteTransaction(notified_db_));
+        uncommitted_record_count_ = 0;
+    }
+};
+
+
+void ProcessItem(HarvestContext * const context, Journal * const journal, const std::string &ISSN,
+                 const std::shared_ptr<JSON::JSONNode> &item_node)
 {
-    *written_count = *suppressed_count = 0;
+    const std::shared_ptr<const JSON::ObjectNode> item(JSON::JSONNode::CastToObjectNodeOrDie("items", item_node));
+    const std::string DOI(JSON::LookupString("/DOI", item, /* default_value = */ ""));
+    if (unlikely(DOI.empty()))
+        LOG_ERROR("No \"DOI\" for an item returned for the ISSN " + ISSN + "!");
+
+    // Have we already seen this item?
+    if (not journal->already_seen_.emplace(DOI).second) {
+        ++journal->suppressed_count_;
+        return;
+    }
+
+    if (CreateAndWriteMarcRecord(context->marc_writer_, context->notified_db_transaction_.get(), DOI, ISSN, *item,
+                                 context->map_descriptors_))
+    {
+        ++journal->written_count_;
+        if (++context->uncommitted_record_count_ == NOTIFIED_DB_COMMIT_INTERVAL)
+            context->commitNotifiedDBChanges();
+    } else
+        ++journal->suppressed_count_;
+}
+
 
-    const std::string DOWNLOAD_URL("https://api.crossref.org/v1/journals/" + ISSN + "/works");
-    Downloader downloader(DOWNLOAD_URL, Downloader::Params(), timeout * 1000);
-    if (downloader.anErrorOccurred()) {
-        LOG_WARNING("Error while downloading metadata for ISSN " + ISSN + ": " + downloader.getLastErrorMessage());
+void RequestPage(HarvestContext * const context, Journal * const journal, const std::string &ISSN, const std::string &cursor);
+
+
+// Writes the items of one page as soon as each of them has been parsed and requests the next page, if there is one.
+void ProcessPage(HarvestContext * const context, Journal * const journal, const std::string &ISSN,
+                 const DownloadBatch::Result &result)
+{
+    if (result.anErrorOccurred()) {
+        LOG_WARNING("Error while downloading metadata for ISSN " + ISSN + ": " + result.error_message_);
         return;
     }
 
     // Check for rate limiting and error status codes:
-    const HttpHeader http_header(downloader.getMessageHeader());
-    if (http_header.getStatusCode() == 429)
+    if (result.response_code_ == 429)
         LOG_ERROR("we got rate limited!");
-    else if (http_header.getStatusCode() != 200) {
-        LOG_WARNING("Crossref returned HTTP status code " + std::to_string(http_header.getStatusCode()) + "!");
+    else if (result.response_code_ != 200) {
+        LOG_WARNING("Crossref returned HTTP status code " + std::to_string(result.response_code_) + "!");
         return;
     }
 
-    const std::string &json_document(downloader.getMessageBody());
+    unsigned item_count(0);
     std::shared_ptr<JSON::JSONNode> full_tree;
-    JSON::Parser parser(json_document);
-    if (not parser.parse(&full_tree))
-        LOG_ERROR("failed to parse JSON (" + parser.getErrorMessage() + "), download URL was: " + DOWNLOAD_URL);
-
-    const std::shared_ptr<const JSON::ObjectNode> top_node(JSON::JSONNode::CastToObjectNodeOrDie("full_tree", full_tree));
-    if (unlikely(top_node == nullptr))
-        LOG_ERROR("JSON returned from Crossref is not an object! (URL was " + DOWNLOAD_URL + ")");
-
-    const std::shared_ptr<const JSON::ObjectNode> message_node(top_node->getOptionalObjectNode("message"));
-    if (unlikely(message_node == nullptr))
+    JSON::Parser parser(result.message_body_);
+    if (not parser.parse(&full_tree, "/message/items",
+                         [context, journal, &ISSN, &item_count](const std::shared_ptr<JSON::JSONNode> &item_node) {
+                             ++item_count;
+                             ProcessItem(context, journal, ISSN, item_node);
+                             return true;
+                         }))
+        LOG_ERROR("failed to parse JSON (" + parser.getErrorMessage() + "), download URL was: " + result.url_);
+
+    // A short page is the last one:
+    if (item_count < ROWS_PER_PAGE)
         return;
 
-    const std::shared_ptr<const JSON::ArrayNode> items(message_node->getOptionalArrayNode("items"));
-    if (unlikely(items == nullptr))
-        return;
-
-    for (auto item_iter : *items) {
-        const std::shared_ptr<const JSON::ObjectNode> item(JSON::JSONNode::CastToObjectNodeOrDie("items", item_iter));
-        const std::string DOI(JSON::LookupString("/DOI", item, /* default_value = */ ""));
-        if (unlikely(DOI.empty()))
-            LOG_ERROR("No \"DOI\" for an item returned for the ISSN " + ISSN + "!");
+    const std::string next_cursor(JSON::LookupString("/message/next-cursor", full_tree, /* default_value = */ ""));
+    if (not next_cursor.empty())
+        RequestPage(context, journal, ISSN, next_cursor);
+}
 
-        // Have we already seen this item?
-        if (already_seen->find(DOI) != already_seen->cend()) {
-            ++*suppressed_count;
-            continue;
-        }
-        already_seen->insert(DOI);
 
-        if (CreateAndWriteMarcRecord(marc_writer, notified_db, DOI, ISSN, *item, map_descriptors))
-            ++*written_count;
-        else
-            ++*suppressed_count;
-    }
+void RequestPage(HarvestContext * const context, Journal * const journal, const std::string &ISSN, const std::string &cursor) {
+    const std::string page_url(CROSSREF_JOURNALS_URL + ISSN + "/works?rows=" + std::to_string(ROWS_PER_PAGE) + "&cursor="
+                               + UrlUtil::UrlEncode(cursor));
+    context->download_batch_.addUrl(page_url, Downloader::Params(), context->timeout_ * 1000,
+                                    [context, journal, ISSN](const DownloadBatch::Result &result) {
+                                        ProcessPage(context, journal, ISSN, result);
+                                    });
 }
 
 
-void ProcessJournal(const unsigned timeout, const std::string &line, MARC::Writer * const marc_writer,
-                    kyotocabinet::HashDB * const notified_db, const std::vector<MapDescriptor *> &map_descriptors,
-                    unsigned * const total_written_count, unsigned * const total_suppressed_count)
-{
+void QueueJournal(HarvestContext * const context, const std::string &line, std::vector<std::unique_ptr<Journal>> * const journals) {
     std::vector<std::string> issns;
     std::string journal_name;
     if (unlikely(not GetISSNsAndJournalName(line, &issns, &journal_name)))
         LOG_ERROR("bad input line \"" + line + "\"!");
-    std::cout << "Processing " << journal_name << '\n';
-
-    std::unordered_set<std::string> already_seen;
-    for (const auto &issn : issns) {
-        unsigned written_count, suppressed_count;
-        ProcessISSN(issn, timeout, marc_writer, notified_db, map_descriptors, &already_seen, &written_count,
-                    &suppressed_count);
-        *total_written_count    += written_count;
-        *total_suppressed_count += suppressed_count;
-    }
+
+    journals->emplace_back(new Journal(journal_name));
+    for (const auto &issn : issns)
+        RequestPage(context, journals->back().get(), issn, "*" /* Starts a new deep paging cursor. */);
 }
 
 
-std::unique_ptr<kyotocabinet::HashDB> CreateOrOpenKeyValueDB() {
-    const std::string DB_FILENAME(UBTools::GetTuelibPath() + "crossref_downloader/notified.db");
-    std::unique_ptr<kyotocabinet::HashDB> db(new kyotocabinet::HashDB());
-    if (not (db->open(DB_FILENAME, kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OREADER | kyotocabinet::HashDB::OCREATE)))
-        LOG_ERROR("failed to open or create \"" + DB_FILENAME + "\"!");
-    return db;
+std::unique_ptr<KeyValueStore> CreateOrOpenKeyValueDB() {
+    const std::string DB_FILENAME(UBTools::GetTuelibPath() + "crossref_downloader/notified.lmdb");
+    KeyValueStore::MigrateFromKyotoCabinetDB(UBTools::GetTuelibPath() + "crossref_downloader/notified.db", DB_FILENAME);
+    return std::unique_ptr<KeyValueStore>(new KeyValueStore(DB_FILENAME, KeyValueStore::CREATE));
 }
 
 
@@ -594,14 +637,21 @@ std::unique_ptr<kyotocabinet::HashDB> CreateOrOpenKeyValueDB() {
 
 
 int Main(int argc, char *argv[]) {
-    if (argc != 3 and argc != 5)
+    if (argc < 3)
         Usage();
 
     const unsigned DEFAULT_TIMEOUT(20); // seconds
     unsigned timeout(DEFAULT_TIMEOUT);
-    if (std::strcmp(argv[1], "--timeout") == 0) {
-        if (not StringUtil::ToUnsigned(argv[2], &timeout))
-            LOG_ERROR("bad timeout \"" + std::string(argv[2]) + "\"!");
+    unsigned max_concurrent_requests(DownloadBatch::DEFAULT_MAX_TRANSFERS_PER_HOST);
+    while (argc > 3) {
+        if (std::strcmp(argv[1], "--timeout") == 0) {
+            if (not StringUtil::ToUnsigned(argv[2], &timeout))
+                LOG_ERROR("bad timeout \"" + std::string(argv[2]) + "\"!");
+        } else if (std::strcmp(argv[1], "--max-concurrent-requests") == 0) {
+            if (not StringUtil::ToUnsigned(argv[2], &max_concurrent_requests) or max_concurrent_requests == 0)
+                LOG_ERROR("bad maximum number of concurrent requests \"" + std::string(argv[2]) + "\"!");
+        } else
+            Usage();
         argc -= 2;
         argv += 2;
     }
@@ -612,7 +662,7 @@ int Main(int argc, char *argv[]) {
     const std::string journal_list_filename(argv[1]);
     const std::string marc_output_filename(argv[2]);
 
-    std::unique_ptr<kyotocabinet::HashDB> notified_db(CreateOrOpenKeyValueDB());
+    std::unique_ptr<KeyValueStore> notified_db(CreateOrOpenKeyValueDB());
 
     const auto journal_list_file(FileUtil::OpenInputFileOrDie(journal_list_filename));
     const auto marc_writer(MARC::Writer::Factory(marc_output_filename));
@@ -620,18 +670,27 @@ int Main(int argc, char *argv[]) {
     std::vector<MapDescriptor *> map_descriptors;
     InitCrossrefToMarcMapping(&map_descriptors);
 
-    unsigned journal_success_count(0), total_written_count(0), total_suppressed_count(0);
+    // All callbacks run in this thread, so neither the MARC writer nor the database need any locking:
+    HarvestContext context(max_concurrent_requests, timeout, marc_writer.get(), notified_db.get(), map_descriptors);
+    std::vector<std::unique_ptr<Journal>> journals;
     while (not journal_list_file->eof()) {
         std::string line;
         journal_list_file->getline(&line);
         StringUtil::Trim(&line);
-        if (not line.empty()) {
-            const unsigned old_total_written_count(total_written_count);
-            ProcessJournal(timeout, line, marc_writer.get(), notified_db.get(), map_descriptors,
-                           &total_written_count , &total_suppressed_count);
-            if (old_total_written_count < total_written_count)
-                ++journal_success_count;
-        }
+        if (not line.empty())
+            QueueJournal(&context, line, &journals);
+    }
+    context.download_batch_.run();
+    context.commitNotifiedDBChanges();
+
+    unsigned journal_success_count(0), total_written_count(0), total_suppressed_count(0);
+    for (const auto &journal : journals) {
+        LOG_INFO(journal->name_ + ": " + std::to_string(journal->written_count_) + " written, "
+                 + std::to_string(journal->suppressed_count_) + " suppressed");
+        if (journal->written_count_ > 0)
+            ++journal_success_count;
+        total_written_count    += journal->written_count_;
+        total_suppressed_count += journal->suppressed_count_;
     }
 
     std::cout << "Downloaded metadata for at least one article from " << journal_success_count << " journals.\n";
@@ -33,6 +33,16 @@ CREATE TABLE keyword_translations (
   UNIQUE KEY ppn_language_code_status_translator (ppn, language_code, status, translator)
 ) DEFAULT CHARSET=utf8mb4;
 
+-- Materialised per-language statistics of the translation tables, maintained by TranslationUtil.
+-- The row w/ an empty language code holds the number of distinct keys of a table.
+CREATE TABLE translation_stats (
+  table_name VARCHAR(30) NOT NULL,
+  language_code CHAR(4) NOT NULL,
+  translated_count INT UNSIGNED NOT NULL,
+  key_count INT UNSIGNED NOT NULL,
+  PRIMARY KEY (table_name, language_code)
+) DEFAULT CHARSET=utf8mb4;
+
 CREATE TABLE translators (
   translator VARCHAR(30) NOT NULL,
   translation_target VARCHAR(20) NOT NULL,
@@ -1,5 +1,5 @@
 /** \file    db_lookup.cc
- *  \brief   A tool for database lookups in a kyotokabinet key/value database.
+ *  \brief   A tool for database lookups in a KeyValueStore.
  *  \author  Dr. Johannes Ruscheinski
  */
 
@@ -21,7 +21,7 @@
 */
 #include <iostream>
 #include <cstdlib>
-#include <kchashdb.h>
+#include "KeyValueStore.h"
 #include "util.h"
 
 
@@ -37,16 +37,11 @@ int main(int argc, char *argv[]) {
     if (argc != 3)
         Usage();
 
-    kyotocabinet::HashDB db;
-    if (not db.open(argv[1], kyotocabinet::HashDB::OREADER | kyotocabinet::HashDB::ONOLOCK))
-        logger->error("Failed to open database \"" + std::string(argv[1]) + "\" for reading ("
-                      + std::string(db.error().message()) + ")!");
-
-    std::string data;
-    if (not db.get(argv[2], &data))
-        logger->error("Lookup failed: " + std::string(db.error().message()));
+    const KeyValueStore db(argv[1], KeyValueStore::READ_ONLY);
+    const KeyValueStore::ReadTransaction transaction(db);
+    StringView data;
+    if (not transaction.get(argv[2], &data))
+        logger->error("Lookup failed: key \"" + std::string(argv[2]) + "\" not found!");
 
     std::cout << data;
-
-    db.close();
 }
@@ -21,9 +21,11 @@
 #include <memory>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include "BSZUtil.h"
 #include "FileUtil.h"
 #include "MARC.h"
+#include "PPNMappingStore.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -32,13 +34,15 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " deletion_list input_marc21 output_marc21\n";
+    std::cerr << "Usage: " << ::progname << " [--ppn-mapping-store] deletion_list input_marc21 output_marc21\n"
+              << "       --ppn-mapping-store also removes references to authors that earlier deletion lists have deleted,\n"
+              << "       as recorded by patch_ppns_in_databases.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
 void ProcessTag(MARC::Record * const record, const std::string &tag, const std::unordered_set <std::string> &title_deletion_ids,
-                unsigned * const deleted_reference_count)
+                const PPNMappingStore * const ppn_mapping_store, unsigned * const deleted_reference_count)
 {
     for (auto &field : record->getTagRange(tag)) {
         auto subfields(field.getSubfields());
@@ -51,7 +55,9 @@ void ProcessTag(MARC::Record * const record, const std::string &tag, const std::
                 const std::string author_reference(subfield.value_);
                 if (StringUtil::StartsWith(author_reference, "(DE-627)")) {
                     const std::string ppn(author_reference.substr(8));
-                    if (title_deletion_ids.find(ppn) != title_deletion_ids.end()) {
+                    if (title_deletion_ids.find(ppn) != title_deletion_ids.end()
+                        or (ppn_mapping_store != nullptr and ppn_mapping_store->isDeleted(ppn)))
+                    {
                         LOG_INFO("deleting author " + ppn + " from title " + record->getControlNumber());
                         remove_subfield = true;
                     }
@@ -71,7 +77,7 @@ void ProcessTag(MARC::Record * const record, const std::string &tag, const std::
 }
 
 
-void ProcessRecords(const std::unordered_set <std::string> &title_deletion_ids,
+void ProcessRecords(const std::unordered_set <std::string> &title_deletion_ids, const PPNMappingStore * const ppn_mapping_store,
                     MARC::Reader * const marc_reader, MARC::Writer * const marc_writer)
 {
     const std::vector<std::string> tags{ "100", "110", "111", "700", "710", "711" };
@@ -81,7 +87,7 @@ void ProcessRecords(const std::unordered_set <std::string> &title_deletion_ids,
         ++total_record_count;
 
         for (const std::string &tag : tags)
-            ProcessTag(&record, tag, title_deletion_ids, &deleted_reference_count);
+            ProcessTag(&record, tag, title_deletion_ids, ppn_mapping_store, &deleted_reference_count);
 
         marc_writer->write(record);
     }
@@ -95,6 +101,12 @@ void ProcessRecords(const std::unordered_set <std::string> &title_deletion_ids,
 
 
 int Main(int argc, char *argv[]) {
+    std::unique_ptr<PPNMappingStore> ppn_mapping_store;
+    if (argc > 1 and std::strcmp(argv[1], "--ppn-mapping-store") == 0) {
+        ppn_mapping_store.reset(new PPNMappingStore());
+        --argc, ++argv;
+    }
+
     if (argc != 4)
         Usage();
 
@@ -105,7 +117,7 @@ int Main(int argc, char *argv[]) {
     const auto marc_reader(MARC::Reader::Factory(argv[2]));
     const auto marc_writer(MARC::Writer::Factory(argv[3]));
 
-    ProcessRecords(title_deletion_ids, marc_reader.get(), marc_writer.get());
+    ProcessRecords(title_deletion_ids, ppn_mapping_store.get(), marc_reader.get(), marc_writer.get());
 
     return EXIT_SUCCESS;
 }
@@ -25,7 +25,10 @@
 */
 
 #include <iostream>
+#include <string>
+#include <vector>
 #include "MARC.h"
+#include "MarcPipeline.h"
 #include "util.h"
 
 
@@ -38,46 +41,24 @@ namespace {
 }
 
 
-bool IsUnusedLocalBlock(const MARC::Record &record,
-                        const MARC::Record::const_iterator &block_start) {
-    for (const auto &field : record.findFieldsInLocalBlock("852", block_start)) {
-        const std::string field_data(field.getContents());
-        if (field_data.find("aTü 135") != std::string::npos)
-            return false;
-        const size_t index = field_data.find("aDE-21");
-        if (index != std::string::npos)
-            return false;
-    }
-    return true;
-}
-
-
-void DeleteUnusedLocalData(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer) {
-    ssize_t count(0), before_count(0), after_count(0);
-
-    while (MARC::Record record = marc_reader->read()) {
-        ++count;
-
-        std::vector<MARC::Record::iterator> local_block_heads(record.findStartOfAllLocalDataBlocks()),                                                    local_blocks_to_delete;
-        size_t local_data_count(local_block_heads.size());
-        if (local_data_count == 0)
-            return;
-
-        before_count += local_data_count;
-        for (const auto &local_block_start : local_block_heads) {
-            if (IsUnusedLocalBlock(record, local_block_start)) {
-                local_blocks_to_delete.emplace_back(local_block_start);
-                --local_data_count;
-            }
+// Records w/o local data are copied as they are, w/o ever being decoded.
+void ProcessRawRecords(MARC::BinaryReader * const marc_reader, MARC::Writer * const marc_writer) {
+    const auto stage(MARC::PipelineStage::Factory("delete_unused_local_data", std::vector<std::string>{}));
+    unsigned raw_count(0);
+    while (const MARC::RecordView record_view = marc_reader->readView()) {
+        if (not record_view.hasTag("LOK")) {
+            marc_writer->write(record_view);
+            ++raw_count;
+            continue;
         }
 
-        record.deleteLocalBlocks(local_blocks_to_delete);
-
-        after_count += local_data_count;
+        MARC::Record record(record_view.toRecord());
+        stage->processRecord(&record);
         marc_writer->write(record);
     }
-    std::cerr << ::progname << ": Deleted " << (before_count - after_count) << " of " << before_count
-              << " local data blocks.\n";
+    stage->finish();
+
+    LOG_INFO("Copied " + std::to_string(raw_count) + " records w/o local data unchanged.");
 }
 
 
@@ -88,10 +69,15 @@ int Main(int argc, char **argv) {
     if (argc != 3)
         Usage();
 
-    std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[1]));
-    std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[2]));
-
-    DeleteUnusedLocalData(marc_reader.get(), marc_writer.get());
+    const auto marc_reader(MARC::Reader::Factory(argv[1]));
+    const auto marc_writer(MARC::Writer::Factory(argv[2]));
+    if (marc_reader->getReaderType() == MARC::FileType::BINARY or marc_reader->getReaderType() == MARC::FileType::INDEXED)
+        ProcessRawRecords(static_cast<MARC::BinaryReader *>(marc_reader.get()), marc_writer.get());
+    else {
+        MARC::Pipeline pipeline;
+        pipeline.addStage(MARC::PipelineStage::Factory("delete_unused_local_data", std::vector<std::string>{}));
+        pipeline.run(marc_reader.get(), marc_writer.get());
+    }
 
     return EXIT_SUCCESS;
 }
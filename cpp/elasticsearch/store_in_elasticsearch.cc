@@ -18,13 +18,18 @@
 */
 
 #include <iostream>
+#include <memory>
+#include <set>
 #include <stdexcept>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include "ControlNumberIndex.h"
 #include "FileUtil.h"
 #include "FullTextCache.h"
 #include "FullTextImport.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
@@ -32,23 +37,29 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    ::Usage("[--force-overwrite] [--verbose] fulltext_file1  [fulltext_file2 .. fulltext_fileN]");
+    ::Usage("[--force-overwrite] [--verbose] [--control-number-index=path] fulltext_file1  [fulltext_file2 .. fulltext_fileN]\n"
+            "If --control-number-index has been specified, the memory-mapped index created by \"create_match_db --index-only\"\n"
+            "will be used instead of the control number guesser's database.");
 }
 
 
-bool ImportDocument(const ControlNumberGuesser &control_number_guesser, FullTextCache * const full_text_cache,
-                    const std::string &filename, const bool force_overwrite = false, const bool verbose = false)
-{
-    const auto input(FileUtil::OpenInputFileOrDie(filename));
-    FullTextImport::FullTextData full_text_data;
-    FullTextImport::ReadExtractedTextFromDisk(input.get(), &full_text_data);
+// Reading in and correlating this many files at a time keeps the memory usage bounded.
+constexpr size_t BATCH_SIZE(1000);
+
 
-    std::string ppn;
-    if (not FullTextImport::CorrelateFullTextData(control_number_guesser, full_text_data, &ppn)) {
+bool ImportDocument(FullTextCache * const full_text_cache, const std::string &filename,
+                    const FullTextImport::FullTextData &full_text_data, const std::set<std::string> &control_numbers,
+                    const bool force_overwrite, const bool verbose)
+{
+    if (control_numbers.empty()) {
         if (verbose)
             LOG_INFO("Could not correlate data for file \"" + filename + "\"");
         return false;
     }
+    if (control_numbers.size() > 1)
+        LOG_WARNING(std::to_string(control_numbers.size()) + " matching PPNs found!");
+    const std::string &ppn(*control_numbers.cbegin());
+
     FullTextCache::Entry entry;
     const bool entry_present(full_text_cache->getEntry(ppn, &entry));
     if (not force_overwrite and entry_present) {
@@ -66,6 +77,33 @@ bool ImportDocument(const ControlNumberGuesser &control_number_guesser, FullText
 }
 
 
+// Exactly one of "control_number_guesser" and "control_number_index" must be non-NULL.
+unsigned ImportBatch(ControlNumberGuesser * const control_number_guesser, const ControlNumberIndex * const control_number_index,
+                     FullTextCache * const full_text_cache, const std::vector<std::string> &filenames, const bool force_overwrite,
+                     const bool verbose)
+{
+    std::vector<FullTextImport::FullTextData> full_text_data(filenames.size());
+    for (size_t i(0); i < filenames.size(); ++i) {
+        const auto input(FileUtil::OpenInputFileOrDie(filenames[i]));
+        FullTextImport::ReadExtractedTextFromDisk(input.get(), &full_text_data[i]);
+    }
+
+    std::vector<std::set<std::string>> control_numbers;
+    if (control_number_index != nullptr)
+        FullTextImport::CorrelateFullTextData(*control_number_index, full_text_data, &control_numbers);
+    else
+        FullTextImport::CorrelateFullTextData(control_number_guesser, full_text_data, &control_numbers);
+
+    unsigned failure_count(0);
+    for (size_t i(0); i < filenames.size(); ++i) {
+        if (not ImportDocument(full_text_cache, filenames[i], full_text_data[i], control_numbers[i], force_overwrite, verbose))
+            ++failure_count;
+    }
+
+    return failure_count;
+}
+
+
 } // unnamed namespace
 
 
@@ -83,16 +121,30 @@ int Main(int argc, char *argv[]) {
         --argc;
         ++argv;
     }
+
+    std::unique_ptr<ControlNumberIndex> control_number_index;
+    std::unique_ptr<ControlNumberGuesser> control_number_guesser;
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--control-number-index=")) {
+        control_number_index.reset(new ControlNumberIndex(argv[1] + __builtin_strlen("--control-number-index=")));
+        --argc;
+        ++argv;
+    } else
+        control_number_guesser.reset(new ControlNumberGuesser());
+
     if (argc < 2)
         Usage();
-    ControlNumberGuesser control_number_guesser;
     FullTextCache full_text_cache;
 
     unsigned total_count(0), failure_count(0);
+    std::vector<std::string> filenames;
     for (int arg_no(1); arg_no < argc; ++arg_no) {
         ++total_count;
-        if (not ImportDocument(control_number_guesser, &full_text_cache, argv[arg_no], force_overwrite, verbose))
-            ++failure_count;
+        filenames.emplace_back(argv[arg_no]);
+        if (filenames.size() == BATCH_SIZE or arg_no == argc - 1) {
+            failure_count += ImportBatch(control_number_guesser.get(), control_number_index.get(), &full_text_cache, filenames,
+                                         force_overwrite, verbose);
+            filenames.clear();
+        }
     }
 
     LOG_INFO("Failed to import " + std::to_string(failure_count) + " documents of " + std::to_string(total_count) + ".");
@@ -18,14 +18,12 @@
  */
 
 #include <iostream>
-#include <memory>
-#include <set>
-#include <unordered_map>
+#include <string>
+#include <vector>
 #include <cstdlib>
-#include <cstring>
 #include "MARC.h"
-#include "RegexMatcher.h"
-#include "StringUtil.h"
+#include "MarcParallelProcessor.h"
+#include "MarcPipeline.h"
 #include "util.h"
 
 
@@ -33,139 +31,13 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "usage: " << ::progname << " input_title_data norm_data output_title_data\n";
+    std::cerr << "usage: " << ::progname << " input_title_data norm_data output_title_data\n"
+              << "       The DDC's of the norm data are taken from its authority store which will be created if it is\n"
+              << "       missing or stale, see create_authority_store.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-bool IsPossibleDDC(const std::string &ddc_candidate) {
-    static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("^\\d\\d\\d"));
-    std::string err_msg;
-    if (not matcher->matched(ddc_candidate, &err_msg)) {
-        if (err_msg.empty())
-            return false;
-        LOG_ERROR("unexpected regex error while trying to match \"" + ddc_candidate + "\": " + err_msg);
-    }
-
-    return true;
-}
-
-
-void ExtractDDCsFromField(const std::string &tag, const MARC::Record &record, std::set<std::string> * const ddcs) {
-    for (const auto &field : record.getTagRange(tag)) {
-        const auto subfields(field.getSubfields());
-        if (subfields.hasSubfield('z')) // Auxillary table number => not a regular DDC in $a!
-            continue;
-
-        for (auto ddc : subfields.extractSubfields('a')) {
-            if (IsPossibleDDC(ddc))
-                ddcs->insert(ddc);
-        }
-    }
-}
-
-
-void ExtractDDCsFromAuthorityData(MARC::Reader * const authority_reader,
-                                  std::unordered_map<std::string, std::set<std::string>> * const norm_ids_to_ddcs_map)
-{
-    norm_ids_to_ddcs_map->clear();
-    LOG_INFO("Starting loading of norm data.");
-
-    unsigned count(0), ddc_record_count(0);
-    while (const MARC::Record record = authority_reader->read()) {
-        ++count;
-
-        if (not record.hasTag("001"))
-            continue;
-
-        std::set<std::string> ddcs;
-        ExtractDDCsFromField("083", record, &ddcs);
-        ExtractDDCsFromField("089", record, &ddcs);
-
-        if (not ddcs.empty()) {
-            ++ddc_record_count;
-            norm_ids_to_ddcs_map->insert(std::make_pair(record.getControlNumber(), ddcs));
-        }
-    }
-
-    LOG_INFO("Read " + std::to_string(count) + " norm data records.");
-    LOG_INFO(std::to_string(ddc_record_count) + " records had DDC entries.");
-}
-
-
-void ExtractTopicIDs(const std::string &tags, const MARC::Record &record, const std::set<std::string> &existing_ddcs,
-                     std::set<std::string> * const topic_ids)
-{
-    topic_ids->clear();
-
-    std::vector<std::string> individual_tags;
-    StringUtil::Split(tags, ':', &individual_tags, /* suppress_empty_components = */true);
-
-    for (const auto &tag : individual_tags) {
-        for (const auto &field : record.getTagRange(tag)) {
-            for (const auto &subfield_value : field.getSubfields().extractSubfields('0')) {
-                if (not StringUtil::StartsWith(subfield_value, "(DE-627)"))
-                    continue;
-
-                const std::string topic_id(subfield_value.substr(8));
-                if (existing_ddcs.find(topic_id) == existing_ddcs.end()) // This one is new!
-                    topic_ids->insert(topic_id);
-            }
-        }
-    }
-}
-
-
-void AugmentRecordsWithDDCs(MARC::Reader * const title_reader, MARC::Writer * const title_writer,
-                            const std::unordered_map<std::string, std::set<std::string>> &norm_ids_to_ddcs_map)
-{
-    LOG_INFO("Starting augmenting of data.");
-
-    unsigned count(0), augmented_count(0), already_had_ddcs(0), never_had_ddcs_and_now_have_ddcs(0);
-    while (MARC::Record record = title_reader->read()) {
-        ++count;
-
-        // Extract already existing DDCs:
-        std::set<std::string> existing_ddcs;
-        ExtractDDCsFromField("082", record, &existing_ddcs);
-        ExtractDDCsFromField("083", record, &existing_ddcs);
-        if (not existing_ddcs.empty())
-            ++already_had_ddcs;
-
-        std::set<std::string> topic_ids; // = the IDs of the corresponding norm data records
-        ExtractTopicIDs("600:610:611:630:650:653:656:689", record, existing_ddcs, &topic_ids);
-        if (topic_ids.empty()) {
-            title_writer->write(record);
-            continue;
-        }
-
-        std::set<std::string> new_ddcs;
-        for (const auto &topic_id : topic_ids) {
-            const auto iter(norm_ids_to_ddcs_map.find(topic_id));
-            if (iter != norm_ids_to_ddcs_map.end())
-                new_ddcs.insert(iter->second.begin(), iter->second.end());
-        }
-
-        if (not new_ddcs.empty()) {
-            ++augmented_count;
-            if (existing_ddcs.empty())
-                ++never_had_ddcs_and_now_have_ddcs;
-            for (const auto &new_ddc : new_ddcs) {
-                const std::string new_field("0 ""\x1F""a" + new_ddc + "\x1F""cfrom_topic_norm_data");
-                record.insertField("082", new_field);
-            }
-        }
-
-        title_writer->write(record);
-    }
-
-    LOG_INFO("Read " + std::to_string(count) + " title data records.");
-    LOG_INFO(std::to_string(already_had_ddcs) + " already had DDCs.");
-    LOG_INFO("Augmented " + std::to_string(augmented_count) + " records.");
-    LOG_INFO(std::to_string(never_had_ddcs_and_now_have_ddcs) + " now have DDCs but didn't before.");
-}
-
-
 } // unnamed namespace
 
 
@@ -184,12 +56,12 @@ int Main(int argc, char *argv[]) {
         LOG_ERROR("Authority data input file name equals title output file name!");
 
     auto title_reader(MARC::Reader::Factory(title_input_filename));
-    auto authority_reader(MARC::Reader::Factory(authority_input_filename));
     auto title_writer(MARC::Writer::Factory(title_output_filename));
 
-    std::unordered_map<std::string, std::set<std::string>> authority_ids_to_ddcs_map;
-    ExtractDDCsFromAuthorityData(authority_reader.get(), &authority_ids_to_ddcs_map);
-    AugmentRecordsWithDDCs(title_reader.get(), title_writer.get(), authority_ids_to_ddcs_map);
+    const auto stage(MARC::PipelineStage::Factory("enrich_ddcs", { authority_input_filename }));
+    MARC::ParallelProcessor processor(title_reader.get(), title_writer.get());
+    processor.process([&stage](MARC::Record * const record) { return stage->processRecord(record); });
+    stage->finish();
 
     return EXIT_SUCCESS;
 }
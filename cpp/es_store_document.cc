@@ -21,8 +21,12 @@
 #include <stdexcept>
 #include <cstdlib>
 #include "Downloader.h"
+#include "Elasticsearch.h"
+#include "File.h"
 #include "FileUtil.h"
 #include "JSON.h"
+#include "StringUtil.h"
+#include "TimeUtil.h"
 #include "util.h"
 
 
@@ -32,17 +36,70 @@ namespace {
 static void Usage() __attribute__((noreturn));
 
 static std::string DEFAULT_SERVER_URL("http://localhost:9200");
+const unsigned DEFAULT_CONCURRENCY(4);
 
     
 static void Usage() {
     std::cerr << "Usage: " << ::progname << " [--debug] [--server-url=url] --title=title_data (--text=document_contents|--text-from-file=path) other_fields_to_submit\n"
               << "       If not specified with \"--server\" the default server URL is \"" << DEFAULT_SERVER_URL << "\".\n"     
               << "       other_fields_to_submit must have the format --field-name=field_value.  \"field-name\" can be any\n"
-              << "       name except for \"title\", \"text\", or \"text-from-file\".\n\n";
+              << "       name except for \"title\", \"text\", or \"text-from-file\".\n"
+              << "       " << ::progname << " --bulk [--concurrency=N] [--batch-size=MiB] index ndjson_file\n"
+              << "       Indexes the JSON documents in \"ndjson_file\", one per line, w/ the _bulk API using the\n"
+              << "       Elasticsearch settings from Elasticsearch.conf.  \"--concurrency\" is the number of requests that\n"
+              << "       may be in flight at the same time and defaults to " << DEFAULT_CONCURRENCY << ".\n\n";
     std::exit(EXIT_FAILURE);
 }
 
 
+void BulkIndex(int argc, char *argv[]) {
+    unsigned concurrency(DEFAULT_CONCURRENCY);
+    size_t batch_size(Elasticsearch::BulkWriter::DEFAULT_MAX_BUFFER_SIZE);
+    for (; argc > 1 and StringUtil::StartsWith(argv[1], "--"); --argc, ++argv) {
+        if (StringUtil::StartsWith(argv[1], "--concurrency=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--concurrency="), &concurrency) or concurrency == 0)
+                LOG_ERROR("bad concurrency!");
+        } else if (StringUtil::StartsWith(argv[1], "--batch-size=")) {
+            unsigned batch_size_in_mib;
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--batch-size="), &batch_size_in_mib)
+                or batch_size_in_mib == 0)
+                LOG_ERROR("bad batch size!");
+            batch_size = batch_size_in_mib * 1024ul * 1024ul;
+        } else
+            Usage();
+    }
+    if (argc != 3)
+        Usage();
+
+    const Elasticsearch elasticsearch(argv[1]);
+    const auto input(FileUtil::OpenInputFileOrDie(argv[2]));
+    const uint64_t start_time(TimeUtil::GetCurrentTimeInMilliseconds());
+    size_t document_count(0), byte_count(0);
+    unsigned failed_count;
+    {
+        // The age limit only matters for trickling input, so a large one is fine here:
+        Elasticsearch::BulkWriter bulk_writer(elasticsearch, batch_size, 60 * 1000, concurrency);
+        while (not input->eof()) {
+            const std::string line(input->getline());
+            if (line.empty())
+                continue;
+            bulk_writer.indexJSON(line);
+            ++document_count;
+            byte_count += line.size();
+        }
+        failed_count = bulk_writer.flush();
+    }
+
+    const double elapsed_seconds(std::max(TimeUtil::GetCurrentTimeInMilliseconds() - start_time, uint64_t(1)) / 1000.0);
+    LOG_INFO("indexed " + std::to_string(document_count - failed_count) + " of " + std::to_string(document_count)
+             + " document(s) in " + StringUtil::ToString(elapsed_seconds, 1) + " s, i.e. "
+             + StringUtil::ToString(document_count / elapsed_seconds, 0) + " documents/s and "
+             + StringUtil::ToString(byte_count / elapsed_seconds / (1024.0 * 1024.0), 1) + " MiB/s.");
+    if (failed_count > 0)
+        LOG_ERROR(std::to_string(failed_count) + " document(s) were rejected!");
+}
+
+
 } // unnamed namespace
 
 
@@ -55,6 +112,11 @@ int main(int argc, char *argv[]) {
         --argc, ++argv;
     }
 
+    if (argc > 1 and std::strcmp(argv[1], "--bulk") == 0) {
+        BulkIndex(argc - 1, argv + 1);
+        return EXIT_SUCCESS;
+    }
+
     std::string server_url(DEFAULT_SERVER_URL);
     if (argc > 1 and std::strncmp(argv[1], "--server-url=", __builtin_strlen("--server-url=")) == 0) {
         server_url = argv[1] + __builtin_strlen("--server-url=");
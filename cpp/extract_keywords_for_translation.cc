@@ -6,7 +6,7 @@
  */
 
 /*
-    Copyright (C) 2016-2018, Library of the University of Tübingen
+    Copyright (C) 2016-2019, Library of the University of Tübingen
 
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU Affero General Public License as
@@ -29,9 +29,12 @@
 #include <utility>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include "Compiler.h"
+#include "DbBulkInserter.h"
 #include "DbConnection.h"
 #include "IniFile.h"
+#include "KeyValueStore.h"
 #include "MARC.h"
 #include "StringUtil.h"
 #include "TranslationUtil.h"
@@ -39,16 +42,23 @@
 #include "util.h"
 
 
+const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "translations.conf");
+const std::string DEFAULT_INDEX_PATH(UBTools::GetTuelibPath() + "keyword_translations.index");
+
+
 void Usage() {
-    std::cerr << "Usage: " << ::progname << " norm_data_input\n";
+    std::cerr << "Usage: " << ::progname << " [--full-extraction] [--index=seen_keyword_index] norm_data_input\n"
+              << "  Only authority records whose keywords and translations differ from what \"seen_keyword_index\" recorded\n"
+              << "  during earlier runs are written to the translation database, so \"norm_data_input\" would typically be\n"
+              << "  a differential update.  \"--full-extraction\" discards the index before processing \"norm_data_input\".\n"
+              << "  The default index is \"" << DEFAULT_INDEX_PATH << "\".\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-static unsigned keyword_count, translation_count, additional_hits, synonym_count, german_term_count;
+static unsigned keyword_count, unchanged_count, translation_count, additional_hits, synonym_count, german_term_count;
 static DbConnection *shared_connection;
 enum Status { RELIABLE, UNRELIABLE, RELIABLE_SYNONYM, UNRELIABLE_SYNONYM };
-const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "translations.conf");
 
 
 std::string StatusToString(const Status status) {
@@ -172,16 +182,6 @@ void ExtractNonGermanTranslations(
 }
 
 
-// Helper function for ExtractTranslations().
-void FlushToDatabase(std::string &insert_statement) {
-    // Remove trailing comma and space:
-    insert_statement.resize(insert_statement.size() - 2);
-
-    insert_statement += ';';
-    shared_connection->queryOrDie(insert_statement);
-}
-
-
 // Returns a string that looks like "(language_code='deu' OR language_code='eng')" etc.
 std::string GenerateLanguageCodeWhereClause(
     const std::vector<TextLanguageCodeStatusAndOriginTag> &text_language_codes_statuses_and_origin_tags)
@@ -205,10 +205,36 @@ std::string GenerateLanguageCodeWhereClause(
 }
 
 
+// \return A checksum over everything that we'd store in the database for a single record.
+std::string CalcChecksum(const std::string &gnd_code, const std::string &gnd_system,
+                         const std::vector<TextLanguageCodeStatusAndOriginTag> &text_language_codes_statuses_and_origin_tags)
+{
+    StringUtil::XXHash64 hash;
+    hash.update(gnd_code);
+    hash.update('\0');
+    hash.update(gnd_system);
+    for (const auto &text_language_code_status_and_origin : text_language_codes_statuses_and_origin_tags) {
+        hash.update('\0');
+        hash.update(std::get<0>(text_language_code_status_and_origin));
+        hash.update('\0');
+        hash.update(std::get<1>(text_language_code_status_and_origin));
+        hash.update(static_cast<char>(std::get<2>(text_language_code_status_and_origin)));
+        hash.update(std::get<3>(text_language_code_status_and_origin));
+        hash.update(std::get<4>(text_language_code_status_and_origin) ? '1' : '0');
+    }
+
+    const uint64_t digest(hash.digest());
+    return std::string(reinterpret_cast<const char *>(&digest), sizeof(digest));
+}
+
+
 static unsigned no_gnd_code_count;
 
 
-bool ExtractTranslationsForASingleRecord(const MARC::Record * const record) {
+// \param seen_keyword_index  Maps PPN's to the checksums of what we extracted from the corresponding records.
+bool ExtractTranslationsForASingleRecord(const MARC::Record * const record, DbBulkInserter * const bulk_inserter,
+                                         KeyValueStore::WriteTransaction * const seen_keyword_index)
+{
     // Skip records that are not GND records:
     std::string gnd_code;
     if (not MARC::GetGNDCode(*record, &gnd_code))
@@ -222,63 +248,55 @@ bool ExtractTranslationsForASingleRecord(const MARC::Record * const record) {
     if (text_language_codes_statuses_and_origin_tags.empty())
         return true;
 
-    ++keyword_count;
-
-    // Remove entries for which authoritative translation were shipped to us from the BSZ:
-    const std::string ppn(record->getControlNumber());
-    shared_connection->queryOrDie("DELETE FROM keyword_translations WHERE ppn=\"" + ppn + "\" AND "
-                                  + "translator IS NULL AND "
-                                  + GenerateLanguageCodeWhereClause(text_language_codes_statuses_and_origin_tags));
-
-    if (not MARC::GetGNDCode(*record, &gnd_code)) {
-        ++no_gnd_code_count;
-        gnd_code = "0";
-    }
-
     std::vector<std::string> gnd_systems;
     for (const auto &_065_field : record->getTagRange("065")) {
         std::vector<std::string> _065a_subfields(_065_field.getSubfields().extractSubfields('a'));
         gnd_systems.insert(gnd_systems.begin(), _065a_subfields.begin(), _065a_subfields.end());
     }
-    std::string gnd_system(StringUtil::Join(gnd_systems, ","));
+    const std::string gnd_system(StringUtil::Join(gnd_systems, ","));
+
+    const std::string ppn(record->getControlNumber());
+    const std::string checksum(CalcChecksum(gnd_code, gnd_system, text_language_codes_statuses_and_origin_tags));
+    std::string previous_checksum;
+    if (seen_keyword_index->get(ppn, &previous_checksum) and previous_checksum == checksum) {
+        ++unchanged_count;
+        return true;
+    }
+    seen_keyword_index->put(ppn, checksum);
 
-    const std::string INSERT_STATEMENT_START("INSERT IGNORE INTO keyword_translations (ppn,gnd_code,language_code,"
-                                             "translation,status,origin,gnd_system,german_updated) VALUES ");
-    std::string insert_statement(INSERT_STATEMENT_START);
+    ++keyword_count;
 
-    size_t row_counter(0);
-    const size_t MAX_ROW_COUNT(1000);
+    // Should a record occur more than once in our input, the rows of its earlier occurrence may still be buffered.
+    // They have to make it into the database before the DELETE below, which would otherwise miss them:
+    static std::unordered_set<std::string> processed_ppns;
+    if (not processed_ppns.emplace(ppn).second)
+        bulk_inserter->flush();
 
-    // Update the database:
-    for (const auto &text_language_code_status_and_origin : text_language_codes_statuses_and_origin_tags) {
-        const std::string language_code(
-            shared_connection->escapeString(std::get<1>(text_language_code_status_and_origin)));
-        const std::string translation(
-            shared_connection->escapeString(std::get<0>(text_language_code_status_and_origin)));
-        const std::string status(StatusToString(std::get<2>(text_language_code_status_and_origin)));
-        const std::string &origin(std::get<3>(text_language_code_status_and_origin));
-        const bool updated_german(std::get<4>(text_language_code_status_and_origin));
-        insert_statement += "('" + ppn + "', '" + gnd_code + "', '" + language_code + "', '" + translation
-                            + "', '" + status + "', '" + origin + "', '" + gnd_system  + "', " + (updated_german ? "true" : "false")
-                            +  "), ";
-        if (++row_counter > MAX_ROW_COUNT) {
-            FlushToDatabase(insert_statement);
-            insert_statement = INSERT_STATEMENT_START;
-            row_counter = 0;
-        }
-    }
-    FlushToDatabase(insert_statement);
+    // Remove entries for which authoritative translation were shipped to us from the BSZ:
+    shared_connection->queryOrDie("DELETE FROM keyword_translations WHERE ppn=\"" + ppn + "\" AND "
+                                  + "translator IS NULL AND "
+                                  + GenerateLanguageCodeWhereClause(text_language_codes_statuses_and_origin_tags));
+
+    for (const auto &text_language_code_status_and_origin : text_language_codes_statuses_and_origin_tags)
+        bulk_inserter->insert({ ppn, gnd_code, std::get<1>(text_language_code_status_and_origin),
+                                std::get<0>(text_language_code_status_and_origin),
+                                StatusToString(std::get<2>(text_language_code_status_and_origin)),
+                                std::get<3>(text_language_code_status_and_origin), gnd_system,
+                                std::get<4>(text_language_code_status_and_origin) ? "1" : "0" });
 
     return true;
 }
 
 
-void ExtractTranslationsForAllRecords(MARC::Reader * const authority_reader) {
+void ExtractTranslationsForAllRecords(MARC::Reader * const authority_reader, DbBulkInserter * const bulk_inserter,
+                                      KeyValueStore::WriteTransaction * const seen_keyword_index)
+{
     while (const MARC::Record record = authority_reader->read()) {
-        if (not ExtractTranslationsForASingleRecord(&record))
+        if (not ExtractTranslationsForASingleRecord(&record, bulk_inserter, seen_keyword_index))
             LOG_ERROR("error while extracting translations from \"" + authority_reader->getPath() + "\"");
     }
     std::cerr << "Added " << keyword_count << " keywords to the translation database.\n";
+    std::cerr << "Skipped " << unchanged_count << " records whose keywords had already been extracted.\n";
     std::cerr << "Found " << german_term_count << " german terms.\n";
     std::cerr << "Found " << translation_count << " translations in the norm data. (" << additional_hits
               << " due to 'ram' and 'lcsh' entries.)\n";
@@ -292,6 +310,18 @@ void ExtractTranslationsForAllRecords(MARC::Reader * const authority_reader) {
 int main(int argc, char **argv) {
     ::progname = argv[0];
 
+    bool full_extraction(false);
+    if (argc > 1 and std::strcmp(argv[1], "--full-extraction") == 0) {
+        full_extraction = true;
+        --argc, ++argv;
+    }
+
+    std::string index_path(DEFAULT_INDEX_PATH);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--index=")) {
+        index_path = argv[1] + std::strlen("--index=");
+        --argc, ++argv;
+    }
+
     if (argc != 2)
         Usage();
 
@@ -304,7 +334,23 @@ int main(int argc, char **argv) {
         DbConnection db_connection(sql_database, sql_username, sql_password);
         shared_connection = &db_connection;
 
-        ExtractTranslationsForAllRecords(authority_marc_reader.get());
+        KeyValueStore seen_keyword_index(index_path, KeyValueStore::CREATE);
+        KeyValueStore::WriteTransaction seen_keyword_index_transaction(&seen_keyword_index);
+        if (full_extraction)
+            seen_keyword_index_transaction.clear();
+
+        {
+            DbBulkInserter bulk_inserter(&db_connection, "keyword_translations",
+                                         { "ppn", "gnd_code", "language_code", "translation", "status", "origin", "gnd_system",
+                                           "german_updated" }, DbConnection::DKB_IGNORE);
+            ExtractTranslationsForAllRecords(authority_marc_reader.get(), &bulk_inserter, &seen_keyword_index_transaction);
+        }
+
+        // Only now that all rows have been written may we remember that we've seen the corresponding records:
+        seen_keyword_index_transaction.commit();
+
+        if (keyword_count > 0)
+            TranslationUtil::RebuildTranslationStats(&db_connection, "keyword_translations", "ppn");
     } catch (const std::exception &x) {
         LOG_ERROR("caught exception: " + std::string(x.what()));
     }
@@ -19,28 +19,33 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
-#include <libgen.h>
 #include <unistd.h>
-#include "ExecUtil.h"
 #include "FileUtil.h"
 #include "PdfUtil.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
 void Usage() {
-    std::cerr << "Usage: " << ::progname << " pdf_image_file_name [language_code_or_codes]\n";
+    std::cerr << "Usage: " << ::progname << " [--timeout=seconds] pdf_image_file_name [language_code_or_codes]\n";
     std::cerr << "       When no language code has been specified, \"deu\" is used as a default.\n";
+    std::cerr << "       The pages are OCR'ed in parallel, \"--timeout\" limits the time spent on the whole document and\n";
+    std::cerr << "       defaults to " << PdfUtil::DEFAULT_PDF_EXTRACTION_TIMEOUT << " seconds.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-const std::string BASH_HELPER("pdf_images_to_text.sh");
-
-
 int main(int argc, char *argv[]) {
     ::progname = argv[0];
 
     try {
+        unsigned timeout(PdfUtil::DEFAULT_PDF_EXTRACTION_TIMEOUT);
+        if (argc > 1 and StringUtil::StartsWith(argv[1], "--timeout=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--timeout="), &timeout) or timeout == 0)
+                logger->error("bad timeout!");
+            --argc, ++argv;
+        }
+
         if (argc != 2 and argc != 3)
             Usage();
         const std::string input_filename(argv[1]);
@@ -55,30 +60,8 @@ int main(int argc, char *argv[]) {
         if (not PdfUtil::PdfDocContainsNoText(pdf))
             logger->error("input file \"" + input_filename + "\" contains text!");
 
-        char output_filename[] = "OCR_OUT_XXXXXX";
-        const int output_fd(::mkstemp(output_filename));
-        if (output_fd == -1)
-            logger->error("failed to create a temporary file!");
-        const FileUtil::AutoDeleteFile auto_deleter(output_filename);
-
-        #pragma GCC diagnostic ignored "-Wvla"
-        char path[std::strlen(argv[0]) + 1];
-        #pragma GCC diagnostic warning "-Wvla"
-        std::strcpy(path, argv[0]);
-        const std::string dir_path(::dirname(path));
-
-        std::vector<std::string> args { input_filename, output_filename };
-        if (argc == 3)
-            args.emplace_back(argv[2]);
-
-        if (ExecUtil::Exec(dir_path + "/" + BASH_HELPER, args, "", "", "", 20 /* seconds */) != 0)
-            logger->error("failed to execute conversion script!");
-
         std::string extracted_text;
-        if (not FileUtil::ReadString(output_filename, &extracted_text))
-            logger->error("failed to read contents of \"" + std::string(output_filename) + "\"!");
-
-        if (extracted_text.empty())
+        if (not PdfUtil::GetOCRedTextFromPDF(input_filename, argc == 3 ? argv[2] : "deu", &extracted_text, timeout))
             logger->error("No text was extracted from \"" + input_filename + "\"!");
 
         std::cout.write(extracted_text.data(), extracted_text.size());
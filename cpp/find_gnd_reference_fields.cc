@@ -40,12 +40,26 @@ void ProcessRecords(MARC::Reader * const marc_reader) {
 
     unsigned record_count(0);
     std::set<std::string> gnd_reference_tags;
-    while (const MARC::Record record = marc_reader->read()) {
-        ++record_count;
+    if (marc_reader->getReaderType() == MARC::FileType::BINARY or marc_reader->getReaderType() == MARC::FileType::INDEXED) {
+        // We only look at the raw field contents and can therefore use the cheaper views.
+        MARC::BinaryReader * const binary_reader(static_cast<MARC::BinaryReader *>(marc_reader));
+        while (const MARC::RecordView record_view = binary_reader->readView()) {
+            ++record_count;
 
-        for (const auto &field : record) {
-            if (matcher->matched(field.getContents()))
-                gnd_reference_tags.emplace(field.getTag().toString());
+            for (const auto &field_view : record_view) {
+                if (field_view.getContents().find('\x1F') != StringView::npos
+                    and matcher->matched(field_view.getContents().toString()))
+                    gnd_reference_tags.emplace(field_view.getTag().toString());
+            }
+        }
+    } else {
+        while (const MARC::Record record = marc_reader->read()) {
+            ++record_count;
+
+            for (const auto &field : record) {
+                if (matcher->matched(field.getContents()))
+                    gnd_reference_tags.emplace(field.getTag().toString());
+            }
         }
     }
 
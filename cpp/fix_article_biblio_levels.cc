@@ -23,12 +23,13 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <iostream>
-#include <unordered_set>
 #include <vector>
 #include <cstdlib>
 #include "MARC.h"
-#include "RegexMatcher.h"
+#include "MarcControlNumberSet.h"
+#include "MarcParallelProcessor.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -47,7 +48,7 @@ namespace {
 
 
 void CollectMonographs(const std::vector<std::unique_ptr<MARC::Reader>> &marc_readers,
-                       std::unordered_set<std::string> * const monograph_control_numbers)
+                       MARC::ControlNumberSet * const monograph_control_numbers)
 {
     for (auto &marc_reader : marc_readers) {
         LOG_INFO("Extracting serial control numbers from \"" + marc_reader->getPath() + "\".");
@@ -61,8 +62,38 @@ void CollectMonographs(const std::vector<std::unique_ptr<MARC::Reader>> &marc_re
 }
 
 
+// Extracts the PPN from references like "(DE-627)123456789".  Equivalent to the regex "\\(.+\\)(\\d{8}[\\dX])" which
+// we can't use here as RegexMatcher instances can't be shared between threads.
+bool ExtractParentId(const std::string &subfield_contents, std::string * const parent_id) {
+    const size_t open_paren_pos(subfield_contents.find('('));
+    if (open_paren_pos == std::string::npos)
+        return false;
+
+    // As in the regex, the last closing parenthesis that is followed by a PPN wins:
+    for (size_t close_paren_pos(subfield_contents.rfind(')'));
+         close_paren_pos != std::string::npos and close_paren_pos > open_paren_pos + 1;
+         close_paren_pos = subfield_contents.rfind(')', close_paren_pos - 1))
+    {
+        const size_t ppn_start(close_paren_pos + 1);
+        if (subfield_contents.length() - ppn_start < 9)
+            continue;
+
+        size_t digit_count(0);
+        while (digit_count < 8 and StringUtil::IsDigit(subfield_contents[ppn_start + digit_count]))
+            ++digit_count;
+        const char check_digit(subfield_contents[ppn_start + 8]);
+        if (digit_count == 8 and (StringUtil::IsDigit(check_digit) or check_digit == 'X')) {
+            *parent_id = subfield_contents.substr(ppn_start, 9);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 bool HasMonographParent(const std::string &subfield, const MARC::Record &record,
-                        std::unordered_set<std::string> * const monograph_control_numbers)
+                        const MARC::ControlNumberSet &monograph_control_numbers)
 {
     const std::string tag(subfield.substr(0, 3));
     const char subfield_code(subfield[3]);
@@ -74,20 +105,14 @@ bool HasMonographParent(const std::string &subfield, const MARC::Record &record,
     if (subfield_contents.empty())
         return false;
 
-    static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("\\(.+\\)(\\d{8}[\\dX])"));
-    if (not matcher->matched(subfield_contents))
-        return false;
-
-    const std::string parent_id((*matcher)[1]);
-    return monograph_control_numbers->find(parent_id) != monograph_control_numbers->cend();
+    std::string parent_id;
+    return ExtractParentId(subfield_contents, &parent_id) and monograph_control_numbers.contains(parent_id);
 }
 
 
-bool HasAtLeastOneMonographParent(const std::string &subfield_list, const MARC::Record &record,
-                                  std::unordered_set<std::string> * const monograph_control_numbers)
+bool HasAtLeastOneMonographParent(const std::vector<std::string> &subfields, const MARC::Record &record,
+                                  const MARC::ControlNumberSet &monograph_control_numbers)
 {
-    std::vector<std::string> subfields;
-    StringUtil::Split(subfield_list, ':', &subfields, /* suppress_empty_components = */true);
     for (const auto &subfield : subfields) {
         if (HasMonographParent(subfield, record, monograph_control_numbers))
             return true;
@@ -100,18 +125,21 @@ bool HasAtLeastOneMonographParent(const std::string &subfield_list, const MARC::
 // Iterates over all records in a collection and retags all book component parts as articles
 // unless the object has a monograph as a parent.
 // Changes the bibliographic level of a record from 'a' to 'b' (= serial component part) if the parent is not a
-// monograph.  Also writes all records to "output_ptr".
+// monograph.  Also writes all records, in their original order, to "marc_writer".
 void PatchUpBookComponentParts(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                               std::unordered_set<std::string> * const monograph_control_numbers)
+                               const MARC::ControlNumberSet &monograph_control_numbers)
 {
-    unsigned patch_count(0);
-    while (auto record = marc_reader->read()) {
-        if (record.isArticle() and not HasAtLeastOneMonographParent("800w:810w:830w:773w", record, monograph_control_numbers)) {
-            record.setBibliographicLevel(MARC::Record::SERIAL_COMPONENT_PART);
+    const std::vector<std::string> PARENT_SUBFIELDS{ "800w", "810w", "830w", "773w" };
+
+    std::atomic<unsigned> patch_count(0);
+    MARC::ParallelProcessor processor(marc_reader, marc_writer);
+    processor.process([&](MARC::Record * const record) {
+        if (record->isArticle() and not HasAtLeastOneMonographParent(PARENT_SUBFIELDS, *record, monograph_control_numbers)) {
+            record->setBibliographicLevel(MARC::Record::SERIAL_COMPONENT_PART);
             ++patch_count;
         }
-        marc_writer->write(record);
-    }
+        return true;
+    });
 
     LOG_INFO("Fixed the bibliographic level of " + std::to_string(patch_count) + " article records.");
 }
@@ -129,11 +157,11 @@ int Main(int argc, char **argv) {
         marc_readers.emplace_back(MARC::Reader::Factory(argv[arg_no]));
     std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[argc - 1]));
 
-    std::unordered_set<std::string> monograph_control_numbers;
+    MARC::ControlNumberSet monograph_control_numbers;
 
     CollectMonographs(marc_readers, &monograph_control_numbers);
     marc_readers[0]->rewind();
-    PatchUpBookComponentParts(marc_readers[0].get(), marc_writer.get(), &monograph_control_numbers);
+    PatchUpBookComponentParts(marc_readers[0].get(), marc_writer.get(), monograph_control_numbers);
 
     return EXIT_SUCCESS;
 }
@@ -30,7 +30,8 @@ static void Usage() __attribute__((noreturn));
 
 void Usage() {
     std::cerr << "Usage: " << ::progname << "\n";
-    std::cerr << "       Deletes all expired records from the full text cache\n";
+    std::cerr << "       Updates the stats of the full text cache and starts the deletion of all expired records from the cache\n";
+    std::cerr << "       in the background.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -43,12 +44,9 @@ int main(int argc, char *argv[]) {
 
     try {
         FullTextCache cache;
-        const unsigned size_before_deletion(cache.getSize());
-        cache.expireEntries();
-        const unsigned size_after_deletion(cache.getSize());
-
-        std::cerr << "Deleted " << (size_before_deletion - size_after_deletion)
-                  << " records from the full-text cache.\n";
+        cache.updateStats();
+        const std::string task_id(cache.expireEntries());
+        std::cerr << "Started Elasticsearch task " << task_id << " to delete the expired records from the full-text cache.\n";
     } catch (const std::exception &x) {
         logger->error("caught exception: " + std::string(x.what()));
     }
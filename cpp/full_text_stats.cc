@@ -71,16 +71,11 @@ void DetermineNewStats(std::vector<std::pair<std::string, unsigned>> * const dom
     domains_and_counts->clear();
 
     FullTextCache cache;
-    std::unordered_map<std::string, unsigned> domains_to_counts_map;
-    for (const auto &domain : cache.getDomains()) {
-        const auto domain_and_count_iter(domains_to_counts_map.find(domain));
-        if (domain_and_count_iter == domains_to_counts_map.end())
-            domains_to_counts_map[domain] = 1;
-        else
-            ++domains_to_counts_map[domain];
-    }
+    FullTextCache::Stats stats;
+    if (not cache.getStats(&stats))
+        stats = cache.computeStats();
 
-    for (const auto &domain_and_count : domains_to_counts_map)
+    for (const auto &domain_and_count : stats.domains_and_counts_)
         domains_and_counts->emplace_back(domain_and_count);
 }
 
@@ -19,18 +19,75 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 #include <stdexcept>
+#include <vector>
 #include <cstdlib>
+#include <cstring>
+#include "MARC.h"
 #include "NGram.h"
 #include "StringUtil.h"
 #include "util.h"
 
 
 [[noreturn]] void Usage() {
-    ::Usage("[--topmost-use-count=N] language_blob language_model\n"
-            "The default for N is " + std::to_string(NGram::DEFAULT_TOPMOST_USE_COUNT) + ".\n"
+    ::Usage("[--topmost-use-count=N] [--thread-count=M] (language_blob language_model | --marc marc_input output_directory [language_code1 ...])\n"
+            "The default for N is " + std::to_string(NGram::DEFAULT_TOPMOST_USE_COUNT) + ", M defaults to the number of cores.\n"
             "The \"language_blob\" should be a file containing example text w/o markup in whatever language.\n"
-            "\"language_model\" should be named after the language followed by \".lm\".\n");
+            "\"language_model\" should be named after the language followed by \".lm\".\n"
+            "In MARC mode, titles and abstracts are grouped by the language code in 008 and a model named after the\n"
+            "language code followed by \".lm\" is written to \"output_directory\" for each language.  If language codes have\n"
+            "been specified, only models for those languages will be generated.\n");
+}
+
+
+// Collects the titles and abstracts of all records per language code.
+void CollectTrainingTexts(MARC::Reader * const marc_reader, const std::set<std::string> &language_codes,
+                          std::map<std::string, std::vector<std::string>> * const language_codes_to_texts)
+{
+    unsigned record_count(0), used_record_count(0);
+    while (const auto record = marc_reader->read()) {
+        ++record_count;
+
+        const std::string language_code(MARC::GetLanguageCode(record));
+        if (language_code.empty() or (not language_codes.empty() and language_codes.find(language_code) == language_codes.end()))
+            continue;
+
+        auto &texts((*language_codes_to_texts)[language_code]);
+        const size_t old_text_count(texts.size());
+        for (auto &title_part : record.getSubfieldValues("245", "ab"))
+            texts.emplace_back(std::move(title_part));
+        for (auto &abstract : record.getSubfieldValues("520", 'a'))
+            texts.emplace_back(std::move(abstract));
+        if (texts.size() > old_text_count)
+            ++used_record_count;
+    }
+
+    LOG_INFO("used " + std::to_string(used_record_count) + " of " + std::to_string(record_count) + " record(s) for "
+             + std::to_string(language_codes_to_texts->size()) + " language(s).");
+}
+
+
+void GenerateModelsFromMARC(const std::string &marc_input_filename, const std::string &output_directory,
+                            const std::set<std::string> &language_codes, const unsigned topmost_use_count,
+                            const unsigned thread_count)
+{
+    std::map<std::string, std::vector<std::string>> language_codes_to_texts;
+    auto marc_reader(MARC::Reader::Factory(marc_input_filename));
+    CollectTrainingTexts(marc_reader.get(), language_codes, &language_codes_to_texts);
+
+    for (const auto &language_code : language_codes) {
+        if (language_codes_to_texts.find(language_code) == language_codes_to_texts.end())
+            LOG_WARNING("no training texts found for language \"" + language_code + "\"!");
+    }
+
+    for (const auto &language_code_and_texts : language_codes_to_texts) {
+        const std::string model_path(output_directory + "/" + language_code_and_texts.first + ".lm");
+        NGram::CreateAndWriteLanguageModel(language_code_and_texts.second, model_path, NGram::DEFAULT_NGRAM_NUMBER_THRESHOLD,
+                                           topmost_use_count, thread_count);
+        LOG_INFO("wrote \"" + model_path + "\" based on " + std::to_string(language_code_and_texts.second.size()) + " text(s).");
+    }
 }
 
 
@@ -44,6 +101,19 @@ int Main(int argc, char *argv[]) {
         --argc, ++argv;
     }
 
+    unsigned thread_count(0);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--thread-count=")) {
+        thread_count = StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--thread-count="));
+        --argc, ++argv;
+    }
+
+    if (argc > 1 and std::strcmp(argv[1], "--marc") == 0) {
+        if (argc < 4)
+            Usage();
+        GenerateModelsFromMARC(argv[2], argv[3], std::set<std::string>(argv + 4, argv + argc), topmost_use_count, thread_count);
+        return EXIT_SUCCESS;
+    }
+
     if (argc != 3)
         Usage();
 
@@ -51,7 +121,9 @@ int Main(int argc, char *argv[]) {
     if (not input)
         LOG_ERROR("failed to open \"" + std::string(argv[1]) + "\" for reading!");
 
-    NGram::CreateAndWriteLanguageModel(input, argv[2], NGram::DEFAULT_NGRAM_NUMBER_THRESHOLD, topmost_use_count);
+    const std::string language_blob(std::istreambuf_iterator<char>(input), {});
+    NGram::CreateAndWriteLanguageModel(std::vector<std::string>{ language_blob }, argv[2], NGram::DEFAULT_NGRAM_NUMBER_THRESHOLD,
+                                       topmost_use_count, thread_count);
 
     return EXIT_SUCCESS;
 }
@@ -19,10 +19,12 @@
 
 #include <algorithm>
 #include <iostream>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
+#include "DirectedGraph.h"
 #include "ExecUtil.h"
 #include "FileUtil.h"
 #include "StringUtil.h"
@@ -105,6 +107,37 @@ void ListSymbols(const std::string &library_path, const std::string &description
 }
 
 
+// \return For each library, the libraries that provide at least one of the symbols it needs.
+DirectedGraph BuildDependencyGraph(const std::vector<LibraryAndSymbols> &libraries_and_symbols,
+                                   std::unordered_set<std::string> * const found_external_references)
+{
+    std::unordered_map<std::string, std::vector<DirectedGraph::NodeId>> symbols_to_providers;
+    for (DirectedGraph::NodeId library_id(0); library_id < libraries_and_symbols.size(); ++library_id) {
+        for (const auto &provided_symbol : libraries_and_symbols[library_id].provided_)
+            symbols_to_providers[provided_symbol].emplace_back(library_id);
+    }
+
+    std::vector<DirectedGraph::Edge> edges;
+    for (DirectedGraph::NodeId library_id(0); library_id < libraries_and_symbols.size(); ++library_id) {
+        const auto &library(libraries_and_symbols[library_id]);
+        for (const auto &external_symbol : library.needed_) {
+            const auto symbol_and_providers(symbols_to_providers.find(external_symbol));
+            if (symbol_and_providers == symbols_to_providers.cend())
+                continue;
+
+            for (const auto provider_id : symbol_and_providers->second) {
+                if (libraries_and_symbols[provider_id].library_path_ != library.library_path_) {
+                    edges.emplace_back(library_id, provider_id);
+                    found_external_references->emplace(external_symbol);
+                }
+            }
+        }
+    }
+
+    return DirectedGraph(libraries_and_symbols.size(), edges);
+}
+
+
 } // unnamed namespace
 
 
@@ -132,20 +165,9 @@ int Main(int argc, char *argv[]) {
             libraries_and_symbols.emplace_back(new_library_and_symbols);
     }
 
+    std::unordered_set<std::string> found_external_references;
+    const DirectedGraph dependency_graph(BuildDependencyGraph(libraries_and_symbols, &found_external_references));
     if (debug) {
-        std::unordered_set<std::string> found_external_references;
-        for (const auto &lib1 : libraries_and_symbols) {
-            for (const auto &lib2 : libraries_and_symbols) {
-                if (lib1.library_path_ == lib2.library_path_)
-                    continue;
-
-                for (const auto &external_symbol : lib1.needed_) {
-                    if (lib2.provided_.find(external_symbol) != lib2.provided_.cend())
-                        found_external_references.emplace(external_symbol);
-                }
-            }
-        }
-
         std::cout << "Missing external references:\n";
         for (const auto &lib : libraries_and_symbols) {
             for (const auto &external_symbol : lib.needed_) {
@@ -154,19 +176,10 @@ int Main(int argc, char *argv[]) {
             }
         }
     } else {
-        for (const auto &lib1 : libraries_and_symbols) {
-            for (const auto &lib2 : libraries_and_symbols) {
-                if (lib1.library_path_ == lib2.library_path_)
-                    continue;
-
-                for (const auto &external_symbol : lib1.needed_) {
-                    if (lib2.provided_.find(external_symbol) != lib2.provided_.cend()) {
-                        std::cout << FileUtil::GetLastPathComponent(lib1.library_path_) << " -> "
-                                  << FileUtil::GetLastPathComponent(lib2.library_path_) << '\n';
-                        break;
-                    }
-                }
-            }
+        for (DirectedGraph::NodeId library_id(0); library_id < dependency_graph.getNodeCount(); ++library_id) {
+            for (const auto provider_id : dependency_graph.getSuccessors(library_id))
+                std::cout << FileUtil::GetLastPathComponent(libraries_and_symbols[library_id].library_path_) << " -> "
+                          << FileUtil::GetLastPathComponent(libraries_and_symbols[provider_id].library_path_) << '\n';
         }
     }
 
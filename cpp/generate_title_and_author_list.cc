@@ -1,7 +1,7 @@
 /** \brief Utility for generating a list of titles and authors from a collection of MARC records.
  *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
  *
- *  \copyright 2017-2018 Universitätsbibliothek Tübingen.  All rights reserved.
+ *  \copyright 2017-2019 Universitätsbibliothek Tübingen.  All rights reserved.
  *
  *  This program is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU Affero General Public License as
@@ -18,12 +18,17 @@
 */
 
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include "Compiler.h"
+#include "ExternalSorter.h"
+#include "Locale.h"
+#include "MarcParallelProcessor.h"
 #include "MARC.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
@@ -31,7 +36,12 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " marc_data\n";
+    std::cerr << "Usage: " << ::progname << " [--locale=locale_name] [--max-memory=MiB] marc_data\n"
+              << "  Writes the main titles, each followed by its authors on lines starting w/ a tab, to stdout.\n"
+              << "  The titles are sorted according to the collation rules of \"locale_name\", e.g. \"de_DE.UTF-8\",\n"
+              << "  which defaults to the locale of the environment.  If the titles and authors require more than\n"
+              << "  \"--max-memory\" MiB, which defaults to " << (ExternalSorter::DEFAULT_MAX_MEMORY_USAGE >> 20u)
+              << ", they will be sorted w/ the help of temporary files.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -48,28 +58,44 @@ void ExtractAuthors(const MARC::Record &record, std::vector<std::string> * const
 }
 
 
-void ProcessRecords(MARC::Reader * const marc_reader) {
-    unsigned record_count(0);
-    while (const MARC::Record record = marc_reader->read()) {
-        ++record_count;
+// Appends "n" in big-endian byte order so that bytewise comparisons order the numbers correctly.
+inline void AppendBigEndian(const uint64_t n, std::string * const s) {
+    for (int shift(56); shift >= 0; shift -= 8)
+        *s += static_cast<char>((n >> shift) & 0xFFu);
+}
+
 
-        const auto field_245(record.findTag("245"));
-        if (unlikely(field_245 == record.end()))
-            continue;
+// Sort keys consist of the collation key of the main title, a NUL byte, which can't occur in a collation key, and the
+// record's position in the input.  The latter keeps the output independent of the scheduling of the worker threads.
+void ProcessRecords(MARC::Reader * const marc_reader, const Collator &collator, ExternalSorter * const sorter) {
+    std::mutex sorter_mutex;
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+    const size_t record_count(processor.process([&collator, sorter, &sorter_mutex](MARC::Record * const record) {
+        const auto field_245(record->findTag("245"));
+        if (unlikely(field_245 == record->end()))
+            return false;
 
         const std::string main_title(field_245->getSubfields().getFirstSubfieldWithCode('a'));
         if (unlikely(main_title.empty()))
-            continue;
+            return false;
 
-        std::cout << main_title << '\n';
+        std::string sort_key(collator.getSortKey(main_title));
+        sort_key += '\0';
+        AppendBigEndian(MARC::ParallelProcessor::GetCurrentSequenceNo(), &sort_key);
 
-        std::vector<std::string> authors;
-        ExtractAuthors(record, &authors);
+        std::string title_and_authors(main_title + '\n');
+        thread_local std::vector<std::string> authors;
+        ExtractAuthors(*record, &authors);
         for (const auto &author : authors)
-            std::cout << '\t' << author << '\n';
-    }
+            title_and_authors += '\t' + author + '\n';
+
+        std::lock_guard<std::mutex> sorter_locker(sorter_mutex);
+        sorter->add(sort_key, title_and_authors);
+        return false;
+    }));
 
-    std::cout << "Processed " << record_count << " MARC record(s).\n";
+    LOG_INFO("Processed " + std::to_string(record_count) + " MARC record(s) w/ " + std::to_string(sorter->size())
+             + " title(s).");
 }
 
 
@@ -77,11 +103,36 @@ void ProcessRecords(MARC::Reader * const marc_reader) {
 
 
 int Main(int argc, char *argv[]) {
+    std::string locale_name;
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--locale=")) {
+        locale_name = argv[1] + __builtin_strlen("--locale=");
+        --argc, ++argv;
+    }
+
+    size_t max_memory_usage(ExternalSorter::DEFAULT_MAX_MEMORY_USAGE);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--max-memory=")) {
+        unsigned max_memory_usage_in_mib;
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-memory="), &max_memory_usage_in_mib)
+            or max_memory_usage_in_mib == 0)
+            LOG_ERROR("bad memory limit \"" + std::string(argv[1]) + "\"!");
+        max_memory_usage = static_cast<size_t>(max_memory_usage_in_mib) << 20u;
+        --argc, ++argv;
+    }
+
     if (argc != 2)
         Usage();
 
+    const Collator collator(locale_name);
+    ExternalSorter sorter(max_memory_usage);
     auto marc_reader(MARC::Reader::Factory(argv[1]));
-    ProcessRecords(marc_reader.get());
+    ProcessRecords(marc_reader.get(), collator, &sorter);
+
+    sorter.finish([](const StringView &/* sort_key */, const StringView &title_and_authors) {
+        std::cout.write(title_and_authors.data(), title_and_authors.size());
+    });
+    std::cout.flush();
+    if (unlikely(not std::cout))
+        LOG_ERROR("failed to write the list!");
 
     return EXIT_SUCCESS;
 }
@@ -18,13 +18,17 @@
 */
 
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include "Compiler.h"
 #include "FileUtil.h"
 #include "StringUtil.h"
 #include "MARC.h"
+#include "MarcOffsetIndex.h"
+#include "MarcParallelProcessor.h"
 #include "util.h"
 
 namespace {
@@ -40,44 +44,62 @@ static  const std::vector<MARC::Tag> REFERENCE_FIELDS{ MARC::Tag("775"), MARC::T
 } // unnamed namespace
 
 
-void CollectAllPPNs(MARC::Reader * const reader, std::unordered_set<std::string> * const all_ppns) {
-   while (const auto record = reader->read())
-      all_ppns->emplace(record.getControlNumber());
-}
-
-bool IsPartOfTitleData(const std::unordered_set<std::string> &all_ppns, const std::string &referenced_ppn) {
-    return all_ppns.find(referenced_ppn) != all_ppns.cend();
-}
+// Scans all records in a single parallel pass and logs the references to PPN's that are not part of the title data.  The
+// existence checks are binary searches in the persistent offset index of "reader"'s file.
+void CheckCrossReferences(MARC::Reader * const reader, const MARC::OffsetIndex &offset_index, File * const dangling_log,
+                          const bool patch_to_k10plus, const std::unordered_map<std::string, std::string> &concordance_map)
+{
+    std::mutex sequence_nos_and_references_mutex;
+    std::unordered_map<size_t, std::vector<std::string>> sequence_nos_and_referenced_ppns;
 
-
-void CheckCrossReferences(MARC::Reader * const reader, const std::unordered_set<std::string> &all_ppns,
-                          std::unique_ptr<File> &dangling_log, bool patch_to_k10plus, std::unordered_map<std::string, std::string> &concordance_map) {
-     int unreferenced_ppns(0);
-     while (const auto record = reader->read()) {
-        for (auto &field : record) {
+    MARC::ParallelProcessor processor(reader, /* writer = */nullptr);
+    unsigned unreferenced_ppns(0);
+    processor.process([&](MARC::Record * const record) {
+        std::vector<std::string> dangling_referenced_ppns;
+        for (const auto &field : *record) {
             std::string referenced_ppn;
-            if (MARC::IsCrossLinkField(field, &referenced_ppn, REFERENCE_FIELDS)) {
-                if (not IsPartOfTitleData(all_ppns, referenced_ppn)) {
-                    std::string ppn = record.getControlNumber();
-                    if (patch_to_k10plus) {
-                        auto new_ppn = concordance_map.find(ppn);
-                        if (new_ppn == concordance_map.end())
-                            LOG_ERROR("Could not find K10plus-PPN for PPN " + ppn);
-                        auto new_referenced_ppn = concordance_map.find(referenced_ppn);
-                        if (new_referenced_ppn == concordance_map.end()) {
-                            LOG_WARNING("Could not find K10plus-PPN for referenced PPN " + referenced_ppn + " [PPN: " + ppn + "]");
-                            *dangling_log << new_ppn->second << ", K10+ PPN DOES NOT EXIST FOR \"" << referenced_ppn + "\"\n";
-                        }
-                        *dangling_log << new_ppn->second << "," << new_referenced_ppn->second << '\n';
-                    } else
-                        *dangling_log << ppn << "," << referenced_ppn << '\n';
-
-                    ++unreferenced_ppns;
-                }
-            }
+            off_t offset;
+            if (MARC::IsCrossLinkField(field, &referenced_ppn, REFERENCE_FIELDS) and not offset_index.find(referenced_ppn, &offset))
+                dangling_referenced_ppns.emplace_back(referenced_ppn);
         }
-     }
-     LOG_INFO("Detected " + std::to_string(unreferenced_ppns) + " unreferenced ppns");
+        if (dangling_referenced_ppns.empty())
+            return false;
+
+        std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_references_mutex);
+        sequence_nos_and_referenced_ppns.emplace(MARC::ParallelProcessor::GetCurrentSequenceNo(),
+                                                 std::move(dangling_referenced_ppns));
+        return true;
+    }, [&](const MARC::Record &record) {
+        // We get called in input order, so the log is the same as if we had processed the records sequentially.
+        std::vector<std::string> dangling_referenced_ppns;
+        {
+            std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_references_mutex);
+            const auto sequence_no_and_referenced_ppns(
+                sequence_nos_and_referenced_ppns.find(MARC::ParallelProcessor::GetCurrentSequenceNo()));
+            dangling_referenced_ppns.swap(sequence_no_and_referenced_ppns->second);
+            sequence_nos_and_referenced_ppns.erase(sequence_no_and_referenced_ppns);
+        }
+
+        const std::string ppn(record.getControlNumber());
+        for (const auto &referenced_ppn : dangling_referenced_ppns) {
+            if (patch_to_k10plus) {
+                const auto new_ppn(concordance_map.find(ppn));
+                if (new_ppn == concordance_map.end())
+                    LOG_ERROR("Could not find K10plus-PPN for PPN " + ppn);
+                const auto new_referenced_ppn(concordance_map.find(referenced_ppn));
+                if (new_referenced_ppn == concordance_map.end()) {
+                    LOG_WARNING("Could not find K10plus-PPN for referenced PPN " + referenced_ppn + " [PPN: " + ppn + "]");
+                    *dangling_log << new_ppn->second << ", K10+ PPN DOES NOT EXIST FOR \"" << referenced_ppn + "\"\n";
+                } else
+                    *dangling_log << new_ppn->second << "," << new_referenced_ppn->second << '\n';
+            } else
+                *dangling_log << ppn << "," << referenced_ppn << '\n';
+
+            ++unreferenced_ppns;
+        }
+    });
+
+    LOG_INFO("Detected " + std::to_string(unreferenced_ppns) + " unreferenced ppns");
 }
 
 
@@ -123,10 +145,9 @@ int Main(int argc, char *argv[]) {
         PopulateConcordanceMap(swb_to_k10plus_file, &swb_to_k10plus_map);
     }
 
-    std::unordered_set<std::string> all_ppns;
-    CollectAllPPNs(marc_reader.get(), &all_ppns);
-    marc_reader->rewind();
-    CheckCrossReferences(marc_reader.get(), all_ppns, dangling_log, patch_to_k10plus, swb_to_k10plus_map);
+    // Usually just memory-maps the sidecar index that is maintained alongside the title data:
+    const MARC::OffsetIndex offset_index(marc_reader.get());
+    CheckCrossReferences(marc_reader.get(), offset_index, dangling_log.get(), patch_to_k10plus, swb_to_k10plus_map);
 
     return EXIT_SUCCESS;
 }
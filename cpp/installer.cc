@@ -422,6 +422,9 @@ void InstallUBTools(const bool make_install, const bool omit_systemctl, const OS
     if (SELinuxUtil::IsEnabled()) {
         SELinuxUtil::FileContext::AddRecordIfMissing(ISSN_TO_MISC_BITS_MAP_PATH, "httpd_sys_content_t",
                                                      ISSN_TO_MISC_BITS_MAP_PATH);
+        // The binary lookup table that BSZTransform generates next to the map:
+        SELinuxUtil::FileContext::AddRecordIfMissing(ISSN_TO_MISC_BITS_MAP_PATH + ".table", "httpd_sys_content_t",
+                                                     ISSN_TO_MISC_BITS_MAP_PATH + "\\.table");
         SELinuxUtil::FileContext::AddRecordIfMissing(ZOTERO_ENHANCEMENT_MAPS_DIRECTORY, "httpd_sys_content_t",
                                                      ZOTERO_ENHANCEMENT_MAPS_DIRECTORY + "(/.*)?");
     }
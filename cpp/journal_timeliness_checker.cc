@@ -17,6 +17,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <unordered_map>
 #include <ctime>
 #include <cstdlib>
 #include "DbConnection.h"
@@ -40,21 +41,41 @@ namespace {
 }
 
 
-void ProcessJournal(DbConnection * const db_connection, const std::string &journal_name, const std::string &journal_ppn,
-                    const unsigned update_window, std::string * tardy_list)
+// Uses a single grouped query which can be answered from the (zeder_id, delivered_at) index instead of one query per journal.
+void LoadLastDeliveryTimes(DbConnection * const db_connection,
+                           std::unordered_map<std::string, std::string> * const zeder_ids_to_last_delivery_times)
 {
-    db_connection->queryOrDie("SELECT MAX(created_at) AS max_created_at FROM marc_records WHERE superior_control_number="
-                              + db_connection->escapeAndQuoteString(journal_ppn));
+    db_connection->queryOrDie("SELECT zeder_id, MAX(delivered_at) AS max_delivered_at FROM delivered_marc_records GROUP BY zeder_id");
+    DbResultSet result_set(db_connection->getLastResultSet());
+    while (const auto row = result_set.getNextRow())
+        (*zeder_ids_to_last_delivery_times)[row["zeder_id"]] = row["max_delivered_at"];
+}
+
 
+// Needed for journals w/o a Zeder ID in our config file.
+void LoadPPNsToZederIDsMap(DbConnection * const db_connection, std::unordered_map<std::string, std::string> * const ppns_to_zeder_ids) {
+    db_connection->queryOrDie("SELECT zeder_id, control_number FROM delivered_marc_records_superior_info WHERE control_number IS NOT NULL");
     DbResultSet result_set(db_connection->getLastResultSet());
-    if (result_set.empty())
+    while (const auto row = result_set.getNextRow())
+        (*ppns_to_zeder_ids)[row["control_number"]] = row["zeder_id"];
+}
+
+
+void ProcessJournal(const std::unordered_map<std::string, std::string> &zeder_ids_to_last_delivery_times,
+                    const std::string &journal_name, const std::string &zeder_id, const unsigned update_window, const time_t now,
+                    std::string * tardy_list)
+{
+    const auto zeder_id_and_last_delivery_time(zeder_ids_to_last_delivery_times.find(zeder_id));
+    if (zeder_id_and_last_delivery_time == zeder_ids_to_last_delivery_times.cend()) {
+        LOG_DEBUG("no deliveries found for \"" + journal_name + "\"!");
         return;
+    }
 
-    const std::string max_created_at_string(result_set.getNextRow()["max_created_at"]);
-    const time_t max_created_at(SqlUtil::DatetimeToTimeT(max_created_at_string));
+    const std::string &max_delivered_at_string(zeder_id_and_last_delivery_time->second);
+    const time_t max_delivered_at(SqlUtil::DatetimeToTimeT(max_delivered_at_string));
 
-    if (max_created_at < ::time(nullptr) - update_window * 86400)
-        *tardy_list += journal_name + ": " + max_created_at_string + "\n";
+    if (max_delivered_at < now - update_window * 86400)
+        *tardy_list += journal_name + ": " + max_delivered_at_string + "\n";
 }
 
 
@@ -70,7 +91,7 @@ int Main(int argc, char *argv[]) {
 
     unsigned default_update_window(DEFAULT_DEFAULT_UPDATE_WINDOW);
     if (StringUtil::StartsWith(argv[1], "--default-update-window=")) {
-        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--default-update-window=")))
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--default-update-window="), &default_update_window))
             LOG_ERROR("invalid default update window: \"" + std::string(argv[1] + __builtin_strlen("--default-update-window=")) + "\"!");
         --argc, ++argv;
     }
@@ -81,6 +102,11 @@ int Main(int argc, char *argv[]) {
     const std::string sender_email_address(argv[2]), notification_email_address(argv[3]);
     DbConnection db_connection;
 
+    std::unordered_map<std::string, std::string> zeder_ids_to_last_delivery_times, ppns_to_zeder_ids;
+    LoadLastDeliveryTimes(&db_connection, &zeder_ids_to_last_delivery_times);
+    LoadPPNsToZederIDsMap(&db_connection, &ppns_to_zeder_ids);
+    const time_t now(::time(nullptr));
+
     IniFile ini_file(UBTools::GetTuelibPath() + "zts_harvester.conf");
     std::string tardy_list;
     for (const auto &section : ini_file) {
@@ -94,11 +120,18 @@ int Main(int argc, char *argv[]) {
 
         const std::string journal_name(section.getSectionName());
 
-        std::string journal_ppn(section.getString("online_ppn", ""));
-        if (journal_ppn.empty())
-            journal_ppn = section.getString("print_ppn", "");
-        if (journal_ppn.empty()) {
-            LOG_WARNING("no PPN found for \"" + journal_name + "\"!");
+        std::string zeder_id(section.getString("zeder_id", ""));
+        if (zeder_id.empty()) {
+            for (const auto &ppn_key : { "online_ppn", "print_ppn" }) {
+                const auto ppn_and_zeder_id(ppns_to_zeder_ids.find(section.getString(ppn_key, "")));
+                if (ppn_and_zeder_id != ppns_to_zeder_ids.cend()) {
+                    zeder_id = ppn_and_zeder_id->second;
+                    break;
+                }
+            }
+        }
+        if (zeder_id.empty()) {
+            LOG_WARNING("neither a Zeder ID nor a known PPN found for \"" + journal_name + "\"!");
             continue;
         }
 
@@ -107,9 +140,9 @@ int Main(int argc, char *argv[]) {
             LOG_WARNING("no update window found for \"" + journal_name + "\", using " + std::to_string(default_update_window) + "!");
             update_window = default_update_window;
         } else
-            update_window = section.getUnsigned("update_window");
+            update_window = section.getUnsigned("zeder_update_window");
 
-        ProcessJournal(&db_connection, journal_name, journal_ppn, update_window, &tardy_list);
+        ProcessJournal(zeder_ids_to_last_delivery_times, journal_name, zeder_id, update_window, now, &tardy_list);
     }
 
     if (not tardy_list.empty()) {
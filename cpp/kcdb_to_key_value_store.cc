@@ -0,0 +1,47 @@
+/** \brief Converts a Kyotocabinet hash database to a KeyValueStore.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <cstdlib>
+#include "KeyValueStore.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    ::Usage("kyotocabinet_database key_value_store\n"
+            "Copies all entries.  Existing entries in \"key_value_store\" w/ the same keys will be overwritten.");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc != 3)
+        Usage();
+
+    KeyValueStore key_value_store(argv[2], KeyValueStore::CREATE);
+    const size_t entry_count(KeyValueStore::ImportKyotoCabinetDB(argv[1], &key_value_store));
+
+    LOG_INFO("Copied " + std::to_string(entry_count) + " entries.");
+
+    return EXIT_SUCCESS;
+}
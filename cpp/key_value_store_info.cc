@@ -0,0 +1,52 @@
+/** \brief Reports various bits of information about a KeyValueStore.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <cstdlib>
+#include "KeyValueStore.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    ::Usage("path_to_key_value_store");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc != 2)
+        Usage();
+
+    const KeyValueStore db(argv[1], KeyValueStore::READ_ONLY);
+    const KeyValueStore::Stats stats(db.getStats());
+    std::cout << "count: " << stats.entry_count_ << '\n';
+    std::cout << "depth: " << stats.depth_ << '\n';
+    std::cout << "map_size: " << stats.map_size_ << '\n';
+    std::cout << "max_readers: " << stats.max_reader_count_ << '\n';
+    std::cout << "page_size: " << stats.page_size_ << '\n';
+    std::cout << "path: " << db.getPath() << '\n';
+    std::cout << "readers: " << stats.reader_count_ << '\n';
+    std::cout << "size: " << stats.used_page_count_ * stats.page_size_ << '\n';
+
+    return EXIT_SUCCESS;
+}
@@ -20,95 +20,102 @@
 
 #include <algorithm>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <cstdio>
 #include <cstdlib>
+#include "Compiler.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
+#include "MarcSubjectHeadingIndex.h"
 #include "StringUtil.h"
 #include "util.h"
 
 
-void Usage() {
+namespace {
+
+
+[[noreturn]] void Usage() {
     std::cerr << "usage: " << ::progname << " marc_input subject1 [subject2 .. [subjectN]]\n\n"
-              << "       where \"subject_list\" must contain LCSH's, one per line.\n";
+              << "       where the subjects are LCSH's, optionally w/ subdivisions appended w/ \"--\".\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-/** Returns true if we match at least one subject in "subjects". */
-inline bool Matched(const std::vector<std::string> &subjects,
-                    const std::unordered_set<std::string> &loc_subject_headings)
-{
-    for (const auto &subject : subjects) {
-        if (loc_subject_headings.find(subject) != loc_subject_headings.cend())
-            return true;
-    }
-
-    return false;
-}
-
+// Each worker thread collects its own statistics, which are merged after all records have been processed.
+struct Statistics {
+    unsigned match_count_, duplicate_count_, empty_count_;
+    std::unordered_map<std::string, unsigned> subjects_to_counts_map_;
+public:
+    Statistics(): match_count_(0), duplicate_count_(0), empty_count_(0) { }
+    void add(const MARC::Record &record, const MARC::SubjectHeadingIndex &subject_heading_index);
+    void merge(const Statistics &other);
+};
 
-// \return The number of entries that were removed.
-size_t RemoveEmptyEntries(std::vector<std::string> * const entries) {
-    std::vector<std::string> cleaned_up_entries;
-    cleaned_up_entries.reserve(entries->size());
 
-    for (const auto &entry : *entries) {
-        if (not entry.empty())
-            cleaned_up_entries.emplace_back(entry);
+void Statistics::add(const MARC::Record &record, const MARC::SubjectHeadingIndex &subject_heading_index) {
+    bool matched(false);
+    for (const auto &field : record.getTagRange("650")) {
+        if (subject_heading_index.lookup(field.getContents()) != MARC::SubjectHeadingIndex::NO_HEADING) {
+            matched = true;
+            break;
+        }
     }
+    if (not matched)
+        return;
+
+    ++match_count_;
+
+    // Record our findings:
+    std::unordered_set<std::string> already_inserted;
+    for (auto &subject : record.getSubfieldValues("650", 'a')) {
+        StringUtil::RightTrim(" .", &subject);
+        if (subject.empty())
+            ++empty_count_;
+        else if (not already_inserted.emplace(subject).second)
+            ++duplicate_count_;
+        else
+            ++subjects_to_counts_map_[subject];
+    }
+}
 
-    const size_t removed_count(entries->size() - cleaned_up_entries.size());
-    entries->swap(cleaned_up_entries);
-    return removed_count;
+
+void Statistics::merge(const Statistics &other) {
+    match_count_ += other.match_count_;
+    duplicate_count_ += other.duplicate_count_;
+    empty_count_ += other.empty_count_;
+    for (const auto &subject_and_count : other.subjects_to_counts_map_)
+        subjects_to_counts_map_[subject_and_count.first] += subject_and_count.second;
 }
 
 
-void CollectStats(MARC::Reader * const marc_reader, const std::unordered_set<std::string> &loc_subject_headings,
-                  std::unordered_map<std::string, unsigned> * const subjects_to_counts_map,
-                  unsigned * const match_count)
+void CollectStats(MARC::Reader * const marc_reader, const MARC::SubjectHeadingIndex &subject_heading_index,
+                  Statistics * const statistics)
 {
-    *match_count = 0;
-    unsigned total_count(0), duplicate_count(0), empty_count(0);
-    while (const MARC::Record record = marc_reader->read()) {
-        ++total_count;
-
-        std::vector<std::string> subjects(record.getSubfieldValues("650", 'a'));
-        if (subjects.empty())
-            continue;
-
-        for (auto &subject : subjects)
-            StringUtil::RightTrim(" .", &subject);
-
-        empty_count += RemoveEmptyEntries(&subjects);
-
-        if (not Matched(subjects, loc_subject_headings))
-            continue;
-
-        ++*match_count;
-
-        // Record our findings:
-        std::unordered_set<std::string> already_inserted;
-        for (const auto &subject : subjects) {
-            if (already_inserted.find(subject) != already_inserted.cend()) {
-                ++duplicate_count;
-                continue;
-            } else
-                already_inserted.insert(subject);
-
-            auto subject_and_count(subjects_to_counts_map->find(subject));
-            if (subject_and_count == subjects_to_counts_map->end())
-                (*subjects_to_counts_map)[subject] = 1;
-            else
-                ++subject_and_count->second;
+    std::mutex worker_statistics_mutex;
+    std::vector<std::unique_ptr<Statistics>> all_worker_statistics;
+
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+    const size_t total_count(processor.process([&](MARC::Record * const record) {
+        thread_local Statistics *worker_statistics(nullptr);
+        if (unlikely(worker_statistics == nullptr)) {
+            std::lock_guard<std::mutex> worker_statistics_locker(worker_statistics_mutex);
+            all_worker_statistics.emplace_back(new Statistics);
+            worker_statistics = all_worker_statistics.back().get();
         }
-    }
+        worker_statistics->add(*record, subject_heading_index);
+        return false;
+    }));
+
+    for (const auto &worker_statistics : all_worker_statistics)
+        statistics->merge(*worker_statistics);
 
     std::cerr << "Processed a total of " << total_count << " record(s).\n";
-    std::cerr << "Matched " << (*match_count) << " record(s).\n";
-    std::cerr << "Found " << duplicate_count << " duplicate LCSH entries in some records.\n";
-    std::cerr << "Removed " << empty_count << " empty entries.\n";
+    std::cerr << "Matched " << statistics->match_count_ << " record(s).\n";
+    std::cerr << "Found " << statistics->duplicate_count_ << " duplicate LCSH entries in some records.\n";
+    std::cerr << "Removed " << statistics->empty_count_ << " empty entries.\n";
 }
 
 
@@ -129,31 +136,28 @@ void DisplayStats(const std::unordered_map<std::string, unsigned> &subjects_to_c
 
     std::sort(subjects_and_counts.begin(), subjects_and_counts.end(), CompSubjectsAndSizes);
 
-    for (const auto subject_and_count : subjects_and_counts)
+    for (const auto &subject_and_count : subjects_and_counts)
         std::cout << subject_and_count.first << ' '
                   << StringUtil::ToString(subject_and_count.second * 100.0 / total_count, 5) << "%\n";
 }
 
 
-int Main(int /*argc*/, char **argv) {
-    ::progname = argv[0];
-    ++argv;
-    if (*argv == nullptr)
-        Usage();
+} // unnamed namespace
 
 
-    std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(*argv++));
-    if (*argv == nullptr)
+int Main(int argc, char **argv) {
+    if (argc < 3)
         Usage();
 
-    std::unordered_set<std::string> loc_subject_headings;
-    while (*argv != nullptr)
-        loc_subject_headings.insert(*argv++);
+    const auto marc_reader(MARC::Reader::Factory(argv[1]));
+
+    MARC::SubjectHeadingIndex subject_heading_index;
+    for (int arg_no(2); arg_no < argc; ++arg_no)
+        subject_heading_index.add(argv[arg_no]);
 
-    std::unordered_map<std::string, unsigned> subjects_to_counts_map;
-    unsigned match_count;
-    CollectStats(marc_reader.get(), loc_subject_headings, &subjects_to_counts_map, &match_count);
-    DisplayStats(subjects_to_counts_map, match_count);
+    Statistics statistics;
+    CollectStats(marc_reader.get(), subject_heading_index, &statistics);
+    DisplayStats(statistics.subjects_to_counts_map_, statistics.match_count_);
 
     return EXIT_SUCCESS;
 }
@@ -20,6 +20,8 @@
 #pragma once
 
 
+#include <functional>
+#include <memory>
 #include <archive.h>
 #include <archive_entry.h>
 #include <unordered_set>
@@ -27,6 +29,9 @@
 #include <unordered_set>
 
 
+class ParallelGzStream;
+
+
 namespace Archive {
 
 
@@ -75,10 +80,13 @@ class Writer {
     archive *archive_handle_;
     archive_entry *archive_entry_;
     std::unordered_set<std::string> already_seen_archive_names_;
+    int output_fd_;                               // Only used for gzipped archives.
+    std::unique_ptr<ParallelGzStream> compressor_; // Only used for gzipped archives.
 public:
     enum class FileType { AUTO, TAR, GZIPPED_TAR };
 public:
     // \param archive_write_options  Currently supported is only "compression-level" for gzipped archives!
+    // \note  Gzipped archives are compressed on all cores.
     explicit Writer(const std::string &archive_file_name, const std::string &archive_write_options,
 			   const FileType file_type = FileType::AUTO);
 
@@ -87,11 +95,36 @@ public:
     ~Writer();
 
     void add(const std::string &filename, std::string archive_name = "");
+private:
+    void openGzippedTar(const std::string &archive_file_name, const std::string &archive_write_options);
+    static ssize_t WriteCompressed(archive *archive_handle, void *client_data, const void *buffer, size_t length);
+    static int CloseCompressed(archive *archive_handle, void *client_data);
+};
+
+
+/** \brief A regular file member of an archive, see ProcessEntriesConcurrently(). */
+struct Entry {
+    size_t index_; // The position among the regular file members of the archive, starting at 0.
+    std::string name_;
+    std::string contents_;
 };
 
 
+/** \brief Reads "archive_name" in a single pass and calls "entry_processor" on a thread pool for each regular file
+ *         member.  The member contents are handed over in memory, so there is no need to extract them to disk first.
+ *  \param thread_count        The number of worker threads, 0 meaning one per core.
+ *  \param max_buffered_size   While the contents of the members that have been read but not yet processed exceed
+ *                             this, we stop reading.  A single larger member will still be processed.
+ *  \note  Members that are not regular files, e.g. directories, are skipped.
+ *  \note  "entry_processor" will be called concurrently and in no particular order.  The first exception that it
+ *         throws will be rethrown after all started calls have returned.  No further calls will be started then.
+ */
+void ProcessEntriesConcurrently(const std::string &archive_name, const std::function<void(const Entry &entry)> &entry_processor,
+                                const unsigned thread_count = 0, const size_t max_buffered_size = 256 * 1024 * 1024);
+
+
 /** \brief Extracts the members of "archive_name" into directory "directory".
- *  \note  We only support regular file members here.
+ *  \note  We only support regular file members here.  Members are written concurrently.
  */
 void UnpackArchive(const std::string &archive_name, const std::string &directory);
 
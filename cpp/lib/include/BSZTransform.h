@@ -17,8 +17,12 @@
 #pragma once
 
 
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <ctime>
+#include "StringView.h"
 #include "UBTools.h"
 
 
@@ -42,6 +46,50 @@ public:
 };
 
 
+/** \class ISSNToMiscBitsTable
+ *  \brief Maps ISSN's to the PPN's and titles of their superior works as listed in "issn_to_misc_bits.map".
+ *  \note  Like OADOIUrlTable, the table lives in a sidecar file, "issn_to_misc_bits.map.table", which is only used if
+ *         the recorded size and modification time of the CSV map still match.  The entries are sorted by ISSN so that
+ *         we can memory-map the file and use binary searches instead of parsing the CSV map in every process.
+ *  \note  If an ISSN occurs more than once, the first occurrence wins.
+ */
+class ISSNToMiscBitsTable {
+    struct StringRef;
+    struct Entry;
+
+    std::string table_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    std::string in_memory_table_; // Only used if we failed to write the sidecar file.
+    const Entry *entries_;
+    size_t entry_count_;
+    const char *string_pool_;
+public:
+    /** \brief Memory-maps the sidecar table of "map_path" or, if it is missing or stale, creates it first.
+     *  \note  If the sidecar file can't be written we warn and keep the table in memory instead.
+     */
+    explicit ISSNToMiscBitsTable(const std::string &map_path = ISSN_TO_MISC_BITS_MAP_PATH_LOCAL);
+    ~ISSNToMiscBitsTable();
+
+    inline size_t size() const { return entry_count_; }
+
+    /** \return True if "issn" was found, else false.  The views point into our storage and are valid for our lifetime. */
+    bool lookup(const std::string &issn, StringView * const ppn, StringView * const title) const;
+
+    static inline std::string GetTablePath(const std::string &map_path) { return map_path + ".table"; }
+private:
+    ISSNToMiscBitsTable(const ISSNToMiscBitsTable &) = delete;
+    ISSNToMiscBitsTable &operator=(const ISSNToMiscBitsTable &) = delete;
+
+    /** \return The serialised table, header included. */
+    static std::string Generate(const std::string &map_path);
+
+    bool mapTable(const std::string &map_path);
+    void setTables(const char * const table_start);
+    inline StringView getString(const StringRef &string_ref) const;
+};
+
+
 struct AugmentMaps {
     std::unordered_map<std::string, std::string> ISSN_to_SSG_map_;
     std::unordered_map<std::string, std::string> ISSN_to_keyword_field_map_;
@@ -49,15 +97,36 @@ struct AugmentMaps {
     std::unordered_map<std::string, std::string> ISSN_to_licence_map_;
     std::unordered_map<std::string, std::string> ISSN_to_volume_map_;
     std::unordered_map<std::string, std::string> language_to_language_code_map_;
-    std::unordered_map<std::string, PPNandTitle> ISSN_to_superior_ppn_and_title_map_;
+    std::shared_ptr<const ISSNToMiscBitsTable> ISSN_to_superior_ppn_and_title_table_; // Shared by all copies.
 public:
     explicit AugmentMaps(const std::string &map_directory_path);
+
+    bool lookupSuperiorPPNAndTitle(const std::string &issn, PPNandTitle * const ppn_and_title) const;
 };
 
 
+// Persistently cached author PPN lookups are reused for this long.  Failed lookups are retried sooner as authors may
+// get a PPN at any time.
+const time_t AUTHOR_PPN_CACHE_TTL(30 * 86400);          // seconds
+const time_t AUTHOR_PPN_NEGATIVE_CACHE_TTL(3 * 86400);  // seconds
+const std::string AUTHOR_PPN_CACHE_PATH(UBTools::GetTuelibPath() + "author_ppn_cache.db");
+
+
+/** \brief Looks up the PPN of "author", which must be in the "lastname, firstname" format.
+ *  \return The PPN or the empty string if none was found.
+ */
 std::string DownloadAuthorPPN(const std::string &author, const std::string &author_download_base_url);
 
 
+/** \brief Like DownloadAuthorPPN() but all lookups that are neither in our in-process nor in our persistent cache,
+ *         AUTHOR_PPN_CACHE_PATH, run concurrently.
+ *  \return A map from those authors for which a PPN was found to their PPN's.
+ *  \note   If we can't write to the persistent cache, e.g. when running as a CGI program, only the in-process cache is used.
+ */
+std::unordered_map<std::string, std::string> DownloadAuthorPPNs(const std::vector<std::string> &authors,
+                                                                const std::string &author_download_base_url);
+
+
 class BSZTransform {
 public:
       AugmentMaps augment_maps_;
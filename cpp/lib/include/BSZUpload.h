@@ -18,8 +18,12 @@
 
 #pragma once
 
+#include <deque>
 #include <map>
+#include <string>
 #include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
 #include "DbConnection.h"
 #include "SqlUtil.h"
 
@@ -80,4 +84,59 @@ private:
 };
 
 
+/** \class FtpUploader
+ *  \brief Uploads files to the BSZ FTP server over several concurrent connections.
+ *  \note  Connections are kept open and reused, so each of them only logs in once per FtpUploader.
+ *  \note  Files are streamed from their descriptors under a temporary name, "name.tmp" for "name.ext", and renamed once
+ *         they are complete so that the BSZ never picks up partial deliveries.  Failed uploads are retried and, for big
+ *         files, resumed from where the previous attempt left off.
+ */
+class FtpUploader {
+public:
+    static const unsigned DEFAULT_MAX_CONNECTIONS = 3; // The BSZ server only allows a few concurrent logins per account.
+    static const unsigned MAX_ATTEMPTS            = 3;
+    static const curl_off_t RESUME_THRESHOLD      = 16 * 1024 * 1024; // Smaller files are re-sent in full on retries.
+
+    struct Result {
+        std::string local_path_;
+        std::string remote_path_;
+        unsigned attempt_count_;
+        std::string error_message_; // Empty if the upload succeeded.
+    };
+private:
+    struct Upload;
+
+    CURLM *multi_handle_;
+    const std::string host_, username_, password_;
+    const unsigned max_connections_;
+    std::deque<Upload *> pending_uploads_;
+    std::unordered_map<CURL *, Upload *> active_uploads_;
+    std::vector<Result> results_;
+public:
+    FtpUploader(const std::string &host, const std::string &username, const std::string &password,
+                const unsigned max_connections = DEFAULT_MAX_CONNECTIONS);
+    ~FtpUploader();
+
+    /** \param remote_directory  An absolute path on the server, e.g. "/pub/UBTuebingen_Default/". */
+    void addFile(const std::string &local_path, const std::string &remote_directory);
+
+    /** \brief Uploads all files that have been added so far.
+     *  \return The results for those files in the order in which the uploads finished.
+     */
+    const std::vector<Result> &run();
+private:
+    FtpUploader(const FtpUploader &) = delete;
+    FtpUploader &operator=(const FtpUploader &) = delete;
+
+    /** \return An empty string if "upload" is now active, o/w an error message. */
+    std::string startUpload(Upload * const upload);
+
+    void performUploads();
+    void finishUpload(Upload * const upload, const std::string &error_message);
+
+    static size_t ReadFunction(char *buffer, size_t size, size_t nitems, void *upload);
+    static int SeekFunction(void *upload, curl_off_t offset, int origin);
+};
+
+
 } // namespace BSZUpload
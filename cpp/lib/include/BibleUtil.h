@@ -20,11 +20,14 @@
 #pragma once
 
 
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
+#include <cstdint>
+#include "MultiPatternMatcher.h"
 
 
 namespace BibleUtil {
@@ -83,6 +86,35 @@ public:
 };
 
 
+/** \class BibleBookMatcher
+ *  \brief Finds mentions of books of the bible in lowercase text w/ a single scan, regardless of the number of known
+ *         book names.
+ *  \note  Like SplitIntoBooksAndChaptersAndVerses() we ignore whitespace, e.g. "1. mose" matches "1.mose".  Mentions have
+ *         to start and end at word boundaries.
+ */
+class BibleBookMatcher {
+    std::unique_ptr<MultiPatternMatcher> matcher_;
+    std::vector<std::string> book_codes_; // Parallel to the patterns of "matcher_".
+public:
+    struct Mention {
+        size_t start_, length_; // Byte offset and length in the scanned text, embedded whitespace included.
+        std::string book_code_;
+    public:
+        Mention(const size_t start, const size_t length, const std::string &book_code)
+            : start_(start), length_(length), book_code_(book_code) { }
+    };
+public:
+    /** \note All canonical and noncanonical forms for which we know a book code will be matched. */
+    BibleBookMatcher(const std::string &books_of_the_bible_to_canonical_form_map_filename,
+                     const std::string &books_of_the_bible_to_code_map_filename);
+
+    /** \brief Finds non-overlapping mentions in "lowercase_text", preferring longer book names.
+     *  \note  "mentions" will be ordered by start position.
+     */
+    void findMentions(const std::string &lowercase_text, std::vector<Mention> * const mentions) const;
+};
+
+
 class BibleAliasMapper {
     std::unordered_map<std::string, std::string> aliases_to_canonical_forms_map_;
 public:
@@ -95,4 +127,92 @@ public:
 };
 
 
+/** \class RangeIndex
+ *  \brief Finds the records whose bible ranges, as stored in BIB_REF_RANGE_TAG, overlap a query range.
+ *  \note  The ranges are kept sorted by their start codes, forming an implicit binary tree in which every node knows the
+ *         largest end code of its subtree.  Overlap queries take O(log n + k) time, where k is the number of hits.
+ */
+class RangeIndex {
+public:
+    struct PPNAndRange {
+        std::string ppn_;
+        uint32_t start_, end_;
+    public:
+        PPNAndRange(const std::string &ppn, const uint32_t start, const uint32_t end): ppn_(ppn), start_(start), end_(end) { }
+    };
+private:
+    struct Range {
+        uint32_t start_, end_, max_end_, ppn_index_;
+    };
+    std::vector<Range> ranges_;
+    std::vector<std::string> ppns_;
+    unsigned root_level_;
+public:
+    explicit RangeIndex(const std::vector<PPNAndRange> &ppns_and_ranges);
+
+    /** \brief Loads an index that has previously been stored with write(). */
+    explicit RangeIndex(const std::string &index_filename);
+
+    void write(const std::string &index_filename) const;
+
+    inline size_t size() const { return ranges_.size(); }
+
+    /** \brief Adds the PPNs of all records w/ at least one range that overlaps the closed range ["start", "end"]. */
+    void findOverlapping(const uint32_t start, const uint32_t end, std::set<std::string> * const ppns) const;
+
+    /** \brief Parses ranges like "start:end" and "start_end" as generated by ParseBibleReference() and stored in
+     *         BIB_REF_RANGE_TAG.
+     */
+    static bool ParseRange(const std::string &range, uint32_t * const start, uint32_t * const end);
+private:
+    void computeMaxEnds();
+    uint32_t computeMaxEnds(const size_t node_index, const unsigned level);
+    void findOverlapping(const size_t node_index, const unsigned level, const uint32_t start, const uint32_t end,
+                         std::set<std::string> * const ppns) const;
+};
+
+
+/** \class SuggestionIndex
+ *  \brief Autocompletion of bible references, e.g. for search forms.
+ *  \note  Suggestions are books of the bible and chapters thereof in canonical form, e.g. "johannesevangelium 3", ranked by
+ *         the number of records that refer to them.  Any known name of a book, canonical or not, can be completed.
+ *  \note  The keys, book names w/o whitespace optionally followed by a chapter number, are kept in a sorted array.  All keys
+ *         w/ a common prefix therefore form a contiguous slice which we locate w/ a binary search.
+ */
+class SuggestionIndex {
+public:
+    struct Suggestion {
+        std::string text_;
+        uint32_t record_count_;
+    public:
+        Suggestion() = default;
+        Suggestion(const std::string &text, const uint32_t record_count): text_(text), record_count_(record_count) { }
+    };
+private:
+    std::vector<Suggestion> suggestions_;
+    std::vector<std::pair<std::string, uint32_t>> keys_and_suggestion_indices_; // Sorted by key.
+public:
+    // Ranges that span more chapters than this only count as references to their book.
+    static constexpr unsigned MAX_CHAPTERS_PER_RANGE = 10;
+public:
+    /** \param ppns_and_ranges  All ranges of a record have to be adjacent.  This is what augment_bible_references produces. */
+    SuggestionIndex(const std::vector<RangeIndex::PPNAndRange> &ppns_and_ranges,
+                    const std::string &books_of_the_bible_to_canonical_form_map_filename,
+                    const std::string &books_of_the_bible_to_code_map_filename);
+
+    /** \brief Loads an index that has previously been stored with write(). */
+    explicit SuggestionIndex(const std::string &index_filename);
+
+    void write(const std::string &index_filename) const;
+
+    inline size_t size() const { return suggestions_.size(); }
+
+    /** \brief Finds the "max_count" most popular suggestions that complete "prefix", best first.
+     *  \note  Like our other bible reference parsers we lowercase "prefix" and ignore whitespace.  Verses, i.e. anything
+     *         starting at the first colon or comma, are ignored as well.
+     */
+    void suggest(const std::string &prefix, const size_t max_count, std::vector<Suggestion> * const suggestions) const;
+};
+
+
 } // namespace BibleUtil
@@ -0,0 +1,47 @@
+/** \file   BloomFilter.h
+ *  \brief  A compact probabilistic set of strings.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+class BloomFilter {
+    std::vector<uint64_t> words_;
+    uint64_t bit_count_;
+    unsigned hash_count_;
+public:
+    /** \param expected_element_count  The number of elements that will probably be added.
+     *  \param false_positive_rate     The desired probability of contains() returning true for an element that has never
+     *                                 been added, provided no more than "expected_element_count" elements have been added.
+     */
+    explicit BloomFilter(const size_t expected_element_count, const double false_positive_rate = 0.01);
+
+    void add(const std::string &element);
+
+    /** \return False if "element" has certainly never been added and true if it probably has been added.
+     *  \note   Safe to call concurrently as long as no thread calls add() at the same time.
+     */
+    bool contains(const std::string &element) const;
+private:
+    void getHashes(const std::string &element, uint64_t * const hash1, uint64_t * const hash2) const;
+};
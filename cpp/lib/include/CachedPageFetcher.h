@@ -30,6 +30,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <cinttypes>
 #include "CookieJar.h"
 #include "DbConnection.h"
@@ -53,6 +54,16 @@
  *  The CachedPageFetcher is stored in a database as defined in the [Page cache] section of the CachedPageFetcher.conf
  *  configuration file if requested.  The page_cache is a MySQL database.
  *
+ *  \par The in-memory cache
+ *  Entries of the page cache are also kept in a process-wide LRU cache in front of the database.  Its size in bytes can
+ *  be set w/ the "memory_cache_size" entry of the [Page cache] section, a size of zero disables it.  While it is
+ *  enabled, new entries are written to the database in batches, at the latest when the writing instance is destroyed.
+ *
+ *  \par Revalidation
+ *  Expired entries for successful downloads are kept if they have an ETag or a Last-Modified date.  The next download
+ *  of such a page is a conditional request, and a "304 Not Modified" answer just refreshes the cached copy's
+ *  expiration.
+ *
  *  \par Timeout Overrides
  *  Additionally there can be an optional configuration file section called [TimeoutOverrides].  If it exists it
  *  should contain pairs of entries of the form "error_msg_patternXXX=..." and "timeoutXXX=..." where the XXX has to
@@ -107,6 +118,8 @@ public:
     // Default configuration options.  These should be in the configuration file.
     static const unsigned    DEFAULT_TIMEOUT       = 10000; // milliseconds
     static const long        DEFAULT_MAX_REDIRECTS = 10;
+    static const unsigned    DEFAULT_MEMORY_CACHE_SIZE = 64 * 1024 * 1024; // bytes
+    static const unsigned    MAX_PENDING_STORES    = 32;
     static const std::string DEFAULT_ACCEPTABLE_LANGUAGES;
 
     /** The exact error message that is returned when a download is blocked by robots.txt. */
@@ -158,15 +171,37 @@ private:
     mutable std::string last_error_message_;
     unsigned last_error_code_;
 
-    /** The robots.txt file for the site we are accessing (or last accessed). */
-    RobotsDotTxt robots_dot_txt_;
-
     std::string media_type_;
     std::string message_body_;
     std::vector<std::string> message_headers_;
 
     CookieJar cookie_jar_;
 
+    /** A row of the cache table together w/ the redirect metadata that goes into the redirect table. */
+    struct PageCacheEntry {
+        std::string escaped_url_;
+        std::string retrieval_datetime_;
+        std::string expiration_datetime_;
+        std::string status_;
+        RobotsDotTxtOption robots_dot_txt_option_;
+        unsigned redirect_count_;
+        std::string redirected_url_;
+        std::string compressed_document_source_;
+        size_t uncompressed_document_source_size_;
+        std::string http_header_;
+        std::string etag_;
+    public:
+        size_t size() const;
+    };
+
+    /** Our cache entries that have not been written to the database yet. */
+    mutable std::vector<PageCacheEntry> pending_stores_;
+
+    class MemoryCache;
+
+    /** The process-wide in-memory cache in front of the database. */
+    static MemoryCache memory_cache_;
+
     // Configurable parameters read from the configuration file:
 
     struct TimeoutOverride {
@@ -229,6 +264,9 @@ private:
     /** The maximum size of document that may be saved in the cache. Longer documents are truncated. */
     static unsigned maximum_document_size_;
 
+    /** The maximum total size of the entries in "memory_cache_" (in bytes). */
+    static unsigned memory_cache_size_;
+
     /** The HTTP proxy, or empty if none is in use. */
     static std::string http_proxy_;
 
@@ -257,6 +295,9 @@ public:
      */
     explicit CachedPageFetcher(const Params &params = Params());
 
+    /** \brief  Writes our pending cache entries to the database. */
+    ~CachedPageFetcher() { flushPendingStores(); }
+
     /** \brief  Download a new URL using an exising CachedPageFetcher object.
      *  \param  url          The new URL to download.
      *  \param  time_limit   A TimeLimit object
@@ -468,7 +509,11 @@ private:
      */
     static void ReadIniFile();
 
-    void getRobotsDotTxtForUrl(const class Url &url, const TimeLimit &time_limit, const long max_redirects);
+    /** \return The robots.txt for "url"'s site from the RobotsDotTxtCache, downloaded if necessary, or nullptr if
+     *          there is none or we ran out of time.
+     */
+    std::shared_ptr<const RobotsDotTxt> getRobotsDotTxtForUrl(const class Url &url, const TimeLimit &time_limit,
+                                                              const long max_redirects);
 
     bool accessAllowed(const std::string &url, const TimeLimit &time_limit, const long max_redirects);
     void retrieveDocument(const std::string &url, const TimeLimit &time_limit, const long max_redirects);
@@ -502,8 +547,16 @@ private:
     bool retrieveFromCache(const std::string &url, std::string * const message_header,
                            std::string * const message_body) const;
 
+    /** \brief  Looks for an expired cache entry for "url" that can be revalidated w/ a conditional request.
+     *  \return True if we found one, else false.
+     */
+    bool getStaleEntry(const std::string &url, PageCacheEntry * const entry) const;
+
     void requireDbConnection() const;
 
+    /** \brief  Writes "pending_stores_" to the database in a single transaction. */
+    void flushPendingStores() const;
+
     /** Wrapper for the actual store operation to the cache database. */
     void actualStoreInCache(const std::string &escaped_url, const std::string &retrieval_datetime,
                             const std::string &expiration_datetime, const std::string &status,
@@ -514,6 +567,17 @@ private:
     static void AddUrlToRedirectTable(DbConnection * const db_connection, const std::string &escaped_url,
                                       const std::string &url_id);
 
+    /** Compresses the document source. */
+    static PageCacheEntry MakePageCacheEntry(const std::string &escaped_url, const std::string &retrieval_datetime,
+                                             const std::string &expiration_datetime, const std::string &status,
+                                             const RobotsDotTxtOption robots_dot_txt_option,
+                                             const unsigned redirect_count, const std::string &redirected_url,
+                                             const std::string &document_source, const std::string &http_header,
+                                             const std::string &etag);
+
+    /** Writes "entry" to the cache and redirect tables. */
+    static void StoreEntryInDatabase(const PageCacheEntry &entry, DbConnection * const db_connection);
+
     /** Performs the actual store operation to the cache database. */
     static void ActualStoreInCache(const std::string &escaped_url, const std::string &retrieval_datetime,
                                    const std::string &expiration_datetime, const std::string &status,
@@ -0,0 +1,49 @@
+/** \brief Utility functions for handling canon law references, e.g. "Codex Iuris Canonici (1983), Can. 204-207".
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <unordered_map>
+#include "MARC.h"
+
+
+namespace CanonLawUtil {
+
+
+/** \brief Converts a codex, e.g. "Codex Iuris Canonici", a year and a canon range specification to a numeric range code
+ *         like "200000204_200000207".
+ *  \note  To understand this code read https://github.com/ubtue/tuefind/wiki/Codices.  Aborts on unparseable input.
+ *         The conversions are memoised, as the same references occur in many records, and this function may be called
+ *         concurrently from multiple threads.
+ */
+std::string FieldToCanonLawCode(const std::string &ppn, const std::string &subfield_codex, const std::string &subfield_year,
+                                const std::string &subfield_part);
+
+
+/** \brief Extracts the canon law codes of all canon law authority records from "authority_filename".
+ *  \note  As this requires a complete scan of the authority data, the result is cached in the sidecar file
+ *         "<authority_filename>.canon_law_codes", which will only be used as long as the size and modification time of
+ *         the authority data still match.
+ */
+void LoadAuthorityPPNsToCanonLawCodes(const std::string &authority_filename,
+                                      std::unordered_map<std::string, std::string> * const authority_ppns_to_canon_law_codes_map);
+
+
+} // namespace CanonLawUtil
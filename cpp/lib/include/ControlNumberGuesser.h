@@ -32,19 +32,38 @@ class ControlNumberGuesser {
     static const std::set<std::string> EMPTY_SET;
     static const std::string DATABASE_PATH;
     static const std::string INSTALLER_SCRIPT_PATH;
+    static constexpr unsigned UPDATE_BATCH_SIZE = 50000; // Updates per transaction between beginUpdate() and endUpdate().
 
     const size_t MAX_CONTROL_NUMBER_LENGTH;
     std::unique_ptr<DbConnection> db_connection_;
     mutable std::unique_ptr<DbResultSet> title_cursor_, author_cursor_, year_cursor_;
+    const DbConnection::SqliteProfile sqlite_profile_;
     bool transaction_in_progress_;
+    unsigned uncommitted_update_count_;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> in_memory_tables_; // table => key => control numbers
 public:
-    explicit ControlNumberGuesser()
-        : MAX_CONTROL_NUMBER_LENGTH(BSZUtil::PPN_LENGTH_NEW), db_connection_(new DbConnection(DATABASE_PATH, DbConnection::CREATE)),
-          transaction_in_progress_(false) {}
+    /** \brief The lookup keys for a single document, normalised the same way the insert*() member functions normalise them. */
+    struct NormalisedQuery {
+        std::string title_;
+        std::set<std::string> authors_;
+        std::string year_, doi_, issn_, isbn_;
+    };
+public:
+    /** \param sqlite_profile  Use DbConnection::SP_BULK_LOAD if you intend to (re)populate the database and
+     *                         DbConnection::SP_READ_MOSTLY if you only want to look things up.
+     */
+    explicit ControlNumberGuesser(const DbConnection::SqliteProfile sqlite_profile = DbConnection::SP_DEFAULT)
+        : MAX_CONTROL_NUMBER_LENGTH(BSZUtil::PPN_LENGTH_NEW),
+          db_connection_(new DbConnection(DATABASE_PATH, DbConnection::CREATE, sqlite_profile)), sqlite_profile_(sqlite_profile),
+          transaction_in_progress_(false), uncommitted_update_count_(0) {}
     ~ControlNumberGuesser();
 public:
     void clearDatabase();
+
+    /** \brief Starts a series of inserts.  They will be committed in batches of UPDATE_BATCH_SIZE. */
     void beginUpdate();
+
+    /** \brief Commits the remaining inserts and creates any indices that were deferred by clearDatabase(). */
     void endUpdate();
 
     void insertTitle(const std::string &title, const std::string &control_number);
@@ -57,6 +76,15 @@ public:
                                                    const std::string &year = "", const std::string &doi = "",
                                                    const std::string &issn = "", const std::string &isbn = "") const;
 
+    /** \note Thread-safe after a call to loadIntoMemory(). */
+    std::set<std::string> getGuessedControlNumbers(const NormalisedQuery &normalised_query) const;
+
+    /** \brief Reads all lookup tables into memory.  Afterwards lookups no longer touch the database and may be issued from
+     *         several threads at once, but the database can no longer be updated through this instance.
+     */
+    void loadIntoMemory();
+    inline bool isInMemory() const { return not in_memory_tables_.empty(); }
+
     bool getNextTitle(std::string * const title, std::set<std::string> * const control_numbers) const;
     bool getNextAuthor(std::string * const author_name, std::set<std::string> * const control_numbers) const;
     bool getNextYear(std::string * const year, std::unordered_set<std::string> * const control_numbers) const;
@@ -71,9 +99,19 @@ public:
     /** For testing purposes. */
     static std::string NormaliseTitle(const std::string &title);
     static std::string NormaliseAuthorName(const std::string &author_name);
+
+    /** \note Not thread-safe as the underlying character set conversions share state. */
+    static NormalisedQuery NormaliseQuery(const std::string &title, const std::set<std::string> &authors,
+                                          const std::string &year = "", const std::string &doi = "",
+                                          const std::string &issn = "", const std::string &isbn = "");
 private:
+    void lookupNormalised(const std::string &table, const std::string &column_name, const std::string &normalised_value,
+                          std::set<std::string> * const control_numbers) const;
     void insertNewControlNumber(const std::string &table, const std::string &column_name, const std::string &column_value,
                                 const std::string &control_number);
+
+    /** \brief Commits and starts a new transaction after every UPDATE_BATCH_SIZE updates. */
+    void noteUpdate();
     bool lookupControlNumber(const std::string &table, const std::string &column_name, const std::string &column_value,
                              std::string * const control_numbers) const;
     void splitControlNumbers(const std::string &concatenated_control_numbers, std::unordered_set<std::string> * const control_numbers) const;
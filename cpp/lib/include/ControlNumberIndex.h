@@ -0,0 +1,111 @@
+/** \file   ControlNumberIndex.h
+ *  \brief  A memory-mapped alternative to the Sqlite database of the ControlNumberGuesser.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ControlNumberGuesser.h"
+#include "MARC.h"
+#include "StringView.h"
+
+
+/** \class ControlNumberIndex
+ *  \brief Maps the normalised titles, authors, years, DOI's, ISSN's and ISBN's of MARC records to their control numbers.
+ *  \note  Keys are normalised exactly like ControlNumberGuesser normalises them, so that lookups w/ a
+ *         ControlNumberGuesser::NormalisedQuery yield the same results as the Sqlite database.  All keys are interned in a
+ *         single string pool, control numbers are replaced by their positions in a sorted table and each key refers to a
+ *         sorted posting list of those integers.  Additionally there is an index of the byte trigrams of the normalised
+ *         titles which allows us to retrieve candidates for near matches.  All tables are sorted so that the file can be
+ *         memory-mapped and searched w/o any parsing.
+ *  \note  Lookups are thread-safe.
+ */
+class ControlNumberIndex {
+public:
+    enum KeyType { TITLE, AUTHOR, YEAR, DOI, ISSN, ISBN };
+    static constexpr unsigned KEY_TYPE_COUNT = 6;
+
+    struct TitleCandidate {
+        std::string normalised_title_;
+        double similarity_; // The Jaccard coefficient of the trigram sets, in (0.0, 1.0].
+    public:
+        TitleCandidate(const std::string &normalised_title, const double similarity)
+            : normalised_title_(normalised_title), similarity_(similarity) { }
+    };
+
+    // The on-disk layouts of the table entries:
+    struct KeyEntry;
+    struct TrigramEntry;
+private:
+    std::string index_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    const char *control_numbers_; // Fixed-width, NUL-padded.
+    size_t control_number_count_, control_number_width_;
+    const KeyEntry *key_entries_[KEY_TYPE_COUNT];
+    size_t key_entry_counts_[KEY_TYPE_COUNT];
+    const TrigramEntry *trigram_entries_;
+    size_t trigram_entry_count_;
+    const uint32_t *postings_;
+    const char *string_pool_;
+public:
+    static const std::string DEFAULT_INDEX_PATH;
+
+    /** \brief Memory-maps the index at "index_path".  Aborts if there is no usable index. */
+    explicit ControlNumberIndex(const std::string &index_path = DEFAULT_INDEX_PATH);
+    ~ControlNumberIndex();
+
+    /** \return The number of distinct control numbers. */
+    inline size_t size() const { return control_number_count_; }
+    inline const std::string &getIndexPath() const { return index_path_; }
+
+    /** \brief Looks up an already normalised key. */
+    void lookup(const KeyType key_type, const std::string &normalised_key, std::set<std::string> * const control_numbers) const;
+
+    /** \brief Implements the same matching strategy as ControlNumberGuesser::getGuessedControlNumbers(). */
+    std::set<std::string> getGuessedControlNumbers(const ControlNumberGuesser::NormalisedQuery &normalised_query) const;
+
+    /** \brief Finds indexed titles that are similar to "normalised_title", most similar first.
+     *  \note  Trigrams that occur in very many titles are not used to find candidates, but they are taken into account when
+     *         the similarities of the candidates are calculated.
+     */
+    std::vector<TitleCandidate> getTitleCandidates(const std::string &normalised_title, const double min_similarity = 0.6,
+                                                   const size_t max_candidate_count = 10) const;
+
+    /** \brief Writes an index for all records of "marc_reader" to "index_path".  The records are normalised on
+     *         "worker_count" threads, or one per core if "worker_count" is 0.
+     *  \return The number of records that were read.
+     */
+    static size_t Create(MARC::Reader * const marc_reader, const std::string &index_path = DEFAULT_INDEX_PATH,
+                         const unsigned worker_count = 0);
+private:
+    ControlNumberIndex(const ControlNumberIndex &) = delete;
+    ControlNumberIndex &operator=(const ControlNumberIndex &) = delete;
+
+    inline StringView getKey(const KeyEntry &key_entry) const;
+    const KeyEntry *findKeyEntry(const KeyType key_type, const std::string &normalised_key) const;
+    const TrigramEntry *findTrigramEntry(const uint32_t trigram) const;
+
+    /** \return The sorted control number ID's for "normalised_key". */
+    std::vector<uint32_t> lookupIDs(const KeyType key_type, const std::string &normalised_key) const;
+    std::set<std::string> idsToControlNumbers(const std::vector<uint32_t> &ids) const;
+};
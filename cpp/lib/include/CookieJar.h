@@ -27,8 +27,10 @@
 #pragma once
 
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <ctime>
 #include "TextUtil.h"
 
@@ -39,6 +41,9 @@ class HttpHeader;
 
 /** \class  CookieJar
  *  \brief  Implements a class representing HTTP cookies.
+ *  \note   Cookies are indexed by domain and, per domain, ordered by path specificity.  Generating the "Cookie:" headers for
+ *          a request therefore only has to look at the cookies of the request host and its parent domains.
+ *  \note   All public member functions are thread-safe.
  */
 class CookieJar {
 public:
@@ -62,29 +67,34 @@ public:
         Cookie(const std::string &name, const std::string &value, const std::string &version,
                const std::string &domain, const std::string &path, const time_t expiration_time)
             : name_(name), value_(value), version_(version), domain_(domain), path_(path), secure_(false),
-              discard_(false), expiration_time_(expiration_time) { }
+              discard_(false), http_only_(false), expiration_time_(expiration_time) { }
         bool empty() const { return name_.empty(); }
         std::string getCookieHeader() const;
         std::string getKey() const { return TextUtil::UTF8ToLower(name_) + " " + domain_ + " " + path_; }
+
+        /** \return The lowercase domain w/o a leading period, or the request host if we have no domain. */
+        std::string getIndexDomain() const;
+
         std::string toString() const;
         bool setDomain(const std::string &domain, const std::string &request_host);
     };
 
-    typedef std::unordered_map<std::string, Cookie>::iterator iterator;
-    typedef std::unordered_map<std::string, Cookie>::const_iterator const_iterator;
 private:
-    mutable std::unordered_map<std::string, Cookie> cookies_;
+    mutable std::mutex mutex_;
+
+    // Keys are the results of Cookie::getIndexDomain().  More specific paths come first within each bucket.
+    mutable std::unordered_map<std::string, std::vector<Cookie>> domains_to_cookies_;
+    mutable size_t cookie_count_;
 public:
-    CookieJar() { }
-    CookieJar(const HttpHeader &http_header, const std::string &default_domain)
+    CookieJar(): cookie_count_(0) { }
+    CookieJar(const HttpHeader &http_header, const std::string &default_domain): cookie_count_(0)
         { addCookies(http_header, default_domain); }
 
-    bool empty() const { return cookies_.empty();}
-    size_t size() const { return cookies_.size(); }
+    bool empty() const { return size() == 0; }
+    size_t size() const { std::lock_guard<std::mutex> mutex_locker(mutex_); return cookie_count_; }
 
     void addCookie(const std::string &name, const std::string &value, const std::string &version,
-                   const std::string &domain, const std::string &path, const time_t expiration_time)
-        { addCookie(Cookie(name, value, version, domain, path.empty() ? "/" : path, expiration_time)); }
+                   const std::string &domain, const std::string &path, const time_t expiration_time);
     void addCookies(const HttpHeader &http_header, const std::string &default_domain);
 
     /** \brief  Generates the "Cookie:" headers for a given domain name and path.
@@ -96,11 +106,23 @@ public:
     void getCookieHeaders(const std::string &domain_name, const std::string &path, std::string * const cookie_headers)
         const;
 
-    const_iterator begin() const { return cookies_.begin(); }
-    const_iterator end() const { return cookies_.end(); }
+    /** \brief  Writes all unexpired cookies that don't have the "Discard" attribute to "jar_filename".
+     *  \note   The file is replaced atomically, so several processes may share a jar file.
+     */
+    void saveSnapshot(const std::string &jar_filename) const;
+
+    /** \brief  Adds the unexpired cookies of a jar file written by saveSnapshot().
+     *  \return The number of cookies that were added.
+     */
+    unsigned loadSnapshot(const std::string &jar_filename);
 private:
+    CookieJar(const CookieJar &rhs) = delete;
+    const CookieJar &operator=(const CookieJar &rhs) = delete;
+
     void parseCookie(const std::string &raw_cookie, const std::string &default_domain = "");
-    void addCookie(const Cookie &cookie) { cookies_.insert(std::make_pair(cookie.getKey(), cookie)); }
+
+    /** \note Must be called w/ "mutex_" held. */
+    void nonThreadSafeAddCookie(const Cookie &cookie);
 
     /** Comparison function for std::sort(). */
     static bool PathCompare(const Cookie &cookie1, const Cookie &cookie2) {
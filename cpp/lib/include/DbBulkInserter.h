@@ -0,0 +1,70 @@
+/** \file   DbBulkInserter.h
+ *  \brief  Interface for the DbBulkInserter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include "DbConnection.h"
+
+
+/** \class DbBulkInserter
+ *  \brief Buffers rows and writes them w/ a few large statements instead of one INSERT per row.
+ *  \note  Buffered rows are written whenever their estimated size exceeds "max_batch_size" bytes, when flush() is called
+ *         and when the DbBulkInserter is destroyed.
+ */
+class DbBulkInserter {
+public:
+    enum Method {
+        MULTI_ROW_INSERT,      // INSERT ... VALUES (...),(...),...
+        LOAD_DATA_LOCAL_INFILE // Writes a temporary tab-separated file and loads it.  MySQL only!
+    };
+
+    // Stays well below the default max_allowed_packet of MySQL:
+    static constexpr size_t DEFAULT_MAX_BATCH_SIZE = 1024 * 1024;
+private:
+    DbConnection * const db_connection_;
+    const std::string table_name_;
+    const std::vector<std::string> column_names_;
+    const DbConnection::DuplicateKeyBehaviour duplicate_key_behaviour_;
+    const Method method_;
+    const size_t max_batch_size_;
+    std::vector<std::vector<std::string>> rows_;
+    size_t batch_size_;
+    size_t row_count_;
+public:
+    DbBulkInserter(DbConnection * const db_connection, const std::string &table_name,
+                   const std::vector<std::string> &column_names,
+                   const DbConnection::DuplicateKeyBehaviour duplicate_key_behaviour = DbConnection::DKB_FAIL,
+                   const Method method = MULTI_ROW_INSERT, const size_t max_batch_size = DEFAULT_MAX_BATCH_SIZE);
+    ~DbBulkInserter() { flush(); }
+
+    /** \note "values" must contain one value for each of our column names. */
+    void insert(const std::vector<std::string> &values);
+
+    /** \brief Writes all buffered rows. */
+    void flush();
+
+    /** \return The number of rows that have been passed to insert() so far. */
+    inline size_t getRowCount() const { return row_count_; }
+private:
+    DbBulkInserter(const DbBulkInserter &) = delete;
+    DbBulkInserter &operator=(const DbBulkInserter &) = delete;
+};
@@ -0,0 +1,121 @@
+/** \file   DbConnectionPool.h
+ *  \brief  A thread-safe pool of MySQL database connections.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <ctime>
+#include "DbConnection.h"
+
+
+// Forward declaration:
+class IniFile;
+
+
+/** \brief Hands out DbConnection's to concurrently running threads.
+ *  \note  A connection that has been checked out must only be used by one thread at a time.  It is returned to the pool when
+ *         the Guard that holds it goes out of scope.
+ */
+class DbConnectionPool {
+public:
+    struct Stats {
+        unsigned open_connection_count_, idle_connection_count_;
+        uint64_t checkout_count_;       // The total number of successful calls to checkout().
+        uint64_t wait_count_;           // How many of the checkouts had to wait for another thread to return a connection.
+        uint64_t total_wait_time_;      // In milliseconds.
+        uint64_t failed_health_check_count_;
+        uint64_t reconnect_count_;      // The number of connections that had to be replaced or were newly opened after startup.
+    };
+
+    /** \brief An RAII handle for a checked out connection. */
+    class Guard {
+        friend class DbConnectionPool;
+        DbConnectionPool *pool_;
+        std::unique_ptr<DbConnection> connection_;
+    private:
+        Guard(DbConnectionPool * const pool, std::unique_ptr<DbConnection> &&connection)
+            : pool_(pool), connection_(std::move(connection)) { }
+    public:
+        Guard(Guard &&other) = default;
+        Guard(const Guard &rhs) = delete;
+        Guard &operator=(const Guard &rhs) = delete;
+        ~Guard() { if (connection_ != nullptr) pool_->checkin(std::move(connection_)); }
+
+        inline DbConnection *get() const { return connection_.get(); }
+        inline DbConnection *operator->() const { return connection_.get(); }
+        inline DbConnection &operator*() const { return *connection_; }
+    };
+private:
+    struct IdleConnection {
+        std::unique_ptr<DbConnection> connection_;
+        time_t idle_since_;
+    public:
+        IdleConnection(std::unique_ptr<DbConnection> &&connection, const time_t idle_since)
+            : connection_(std::move(connection)), idle_since_(idle_since) { }
+    };
+
+    std::string database_name_, user_, passwd_, host_;
+    unsigned port_;
+    DbConnection::Charset charset_;
+    DbConnection::TimeZone time_zone_;
+    const unsigned min_size_, max_size_;
+    const unsigned health_check_interval_, max_idle_time_; // In seconds.
+    std::deque<IdleConnection> idle_connections_; // Most recently returned connections last.
+    unsigned open_connection_count_;
+    Stats stats_;
+    mutable std::mutex mutex_;
+    std::condition_variable connection_returned_;
+public:
+    static constexpr unsigned DEFAULT_HEALTH_CHECK_INTERVAL = 60; // in seconds
+    static constexpr unsigned DEFAULT_MAX_IDLE_TIME = 300;        // in seconds
+public:
+    /** \brief Opens "min_size" connections right away.  The connection parameters are read from "ini_file_section" the same
+     *         way the corresponding DbConnection constructor does it.
+     *  \param health_check_interval  Connections that have been idle for at least this many seconds are pinged before they
+     *                                are handed out and are replaced if they are no longer usable.
+     *  \param max_idle_time          Connections beyond "min_size" that have been idle for at least this many seconds will
+     *                                be closed.
+     */
+    DbConnectionPool(const IniFile &ini_file, const std::string &ini_file_section = "Database", const unsigned min_size = 1,
+                     const unsigned max_size = 10, const unsigned health_check_interval = DEFAULT_HEALTH_CHECK_INTERVAL,
+                     const unsigned max_idle_time = DEFAULT_MAX_IDLE_TIME,
+                     const DbConnection::TimeZone time_zone = DbConnection::TZ_SYSTEM);
+    DbConnectionPool(const DbConnectionPool &rhs) = delete;
+    DbConnectionPool &operator=(const DbConnectionPool &rhs) = delete;
+
+    /** \note All guards have to have been destroyed before the pool is destroyed. */
+    ~DbConnectionPool() = default;
+
+    /** \brief Returns an idle connection or opens a new one.  Blocks if "max_size" connections are already in use. */
+    Guard checkout();
+
+    Stats getStats() const;
+private:
+    DbConnectionPool(std::unique_ptr<DbConnection> &&first_connection, const unsigned min_size, const unsigned max_size,
+                     const unsigned health_check_interval, const unsigned max_idle_time);
+    std::unique_ptr<DbConnection> openConnection() const;
+    void checkin(std::unique_ptr<DbConnection> &&connection);
+    void closeExpiredIdleConnections(const time_t now);
+};
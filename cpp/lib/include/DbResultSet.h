@@ -30,18 +30,26 @@
 
 class DbResultSet {
     friend class DbConnection;
+    friend class DbStatement;
     MYSQL_RES *result_set_;
+    bool streaming_; // If true, "result_set_" was obtained via mysql_use_result() and rows are fetched one at a time.
+    MYSQL_ROW peeked_row_;
     sqlite3_stmt *stmt_handle_;
+    bool finalise_; // If false, "stmt_handle_" belongs to a DbStatement and will only be reset.
     size_t no_of_rows_, column_count_;
     std::map<std::string, unsigned> field_name_to_index_map_;
 private:
-    explicit DbResultSet(MYSQL_RES * const result_set);
-    explicit DbResultSet(sqlite3_stmt * const stmt_handle);
+    explicit DbResultSet(MYSQL_RES * const result_set, const bool streaming = false);
+    explicit DbResultSet(sqlite3_stmt * const stmt_handle, const bool finalise = true);
+    void releaseStmtHandle();
 public:
     DbResultSet(DbResultSet &&other);
     ~DbResultSet();
 
-    /** \return The number of rows in the result set. */
+    /** \return The number of rows in the result set.
+     *  \note   For streamed MySQL result sets this is only the number of rows that have been read so far, except that it
+     *         is at least 1 if the result set is not empty.
+     */
     inline size_t size() const { return no_of_rows_; }
 
     /** \return The number of columns in a row. */
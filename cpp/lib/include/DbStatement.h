@@ -0,0 +1,94 @@
+/** \file   DbStatement.h
+ *  \brief  Interface for the DbStatement class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <mysql/mysql.h>
+#include <sqlite3.h>
+#include "DbResultSet.h"
+
+
+// Forward declaration:
+class DbConnection;
+
+
+/** \brief A parsed SQL statement w/ '?' placeholders that can be executed many times w/ different parameters.
+ *  \note  Instances are created by DbConnection::prepare() and must not outlive the connection that created them.
+ *  \note  A statement must not be executed again while a result set obtained from it is still being iterated over.
+ *  \note  MySQL statements that return a result set are executed by substituting the escaped parameters into the
+ *         statement text as DbResultSet can only wrap ordinary MySQL result sets.
+ */
+class DbStatement {
+    friend class DbConnection;
+    struct Parameter {
+        enum Type { UNBOUND, NULL_VALUE, STRING, INTEGER } type_;
+        std::string string_value_;
+        int64_t integer_value_;
+    public:
+        Parameter(): type_(UNBOUND), integer_value_(0) { }
+    };
+    DbConnection * const connection_;
+    const std::string statement_;
+    sqlite3_stmt *sqlite3_stmt_;
+    MYSQL_STMT *mysql_stmt_;
+    std::vector<std::string> statement_fragments_; // Only used for MySQL statements that return a result set.
+    std::vector<Parameter> parameters_;
+private:
+    DbStatement(DbConnection * const connection, const std::string &statement);
+public:
+    DbStatement(const DbStatement &rhs) = delete;
+    DbStatement &operator=(const DbStatement &rhs) = delete;
+    ~DbStatement();
+
+    inline const std::string &getStatement() const { return statement_; }
+    inline size_t getParameterCount() const { return parameters_.size(); }
+
+    /** \brief Binds a value to the "parameter_no"th placeholder.  Parameter numbers start at 0.
+     *  \note  Bindings stay in effect for subsequent executions until they are replaced or cleared.
+     */
+    void bind(const unsigned parameter_no, const std::string &value);
+    inline void bind(const unsigned parameter_no, const char * const value) { bind(parameter_no, std::string(value)); }
+    void bind(const unsigned parameter_no, const int64_t value);
+    void bindNull(const unsigned parameter_no);
+
+    void clearBindings();
+
+    /** \return False if the statement could not be executed, in which case DbConnection::getLastErrorMessage() may
+     *          have further information.
+     *  \note   All parameters have to have been bound.
+     */
+    bool execute();
+
+    void executeOrDie();
+
+    /** \return The rows returned by the last execution of a statement that returns rows, e.g. a SELECT.  */
+    DbResultSet getResultSet();
+
+    /** \return The number of rows changed, deleted, or inserted by the last execution. */
+    unsigned getNoOfAffectedRows() const;
+private:
+    void checkParameterNo(const unsigned parameter_no) const;
+    std::string substituteParameters() const;
+    bool executeSqlite();
+    bool executeMySQL();
+};
@@ -0,0 +1,114 @@
+/** \brief Compact directed graphs w/ millions of nodes, e.g. for dependencies between records.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <climits>
+#include <cstdint>
+
+
+/** \class DirectedGraph
+ *  \brief An immutable directed graph whose nodes are numbered 0 to N-1.
+ *  \note  The successors of all nodes are stored back to back in a single array, a.k.a. compressed sparse row format, so
+ *         that we only need 4 bytes per edge and 8 bytes per node.  None of the algorithms below is recursive, so they
+ *         also work for very deep graphs.
+ */
+class DirectedGraph {
+public:
+    typedef uint32_t NodeId;
+    typedef std::pair<NodeId, NodeId> Edge;
+
+    class Successors {
+        const NodeId *begin_, *end_;
+    public:
+        Successors(const NodeId * const begin, const NodeId * const end): begin_(begin), end_(end) { }
+        inline const NodeId *begin() const { return begin_; }
+        inline const NodeId *end() const { return end_; }
+        inline size_t size() const { return end_ - begin_; }
+        inline bool empty() const { return begin_ == end_; }
+    };
+private:
+    std::vector<size_t> offsets_; // The successors of node N start at offsets_[N] and end at offsets_[N + 1].
+    std::vector<NodeId> successors_;
+public:
+    /** \param add_reverse_edges  If true, we also add the edge (B, A) for each edge (A, B), which turns the graph into an
+     *                            undirected one.
+     *  \note  Duplicate edges are dropped and successors are sorted in ascending order.
+     *  \note  Aborts if any node in "edges" is not less than "node_count".
+     */
+    DirectedGraph(const size_t node_count, const std::vector<Edge> &edges, const bool add_reverse_edges = false);
+
+    inline size_t getNodeCount() const { return offsets_.size() - 1; }
+    inline size_t getEdgeCount() const { return successors_.size(); }
+    inline Successors getSuccessors(const NodeId node) const
+        { return Successors(successors_.data() + offsets_[node], successors_.data() + offsets_[node + 1]); }
+
+    /** \brief Sorts the nodes so that each node comes before its successors.
+     *  \param cycle  If not nullptr and the graph is cyclic, the nodes of one of the cycles will be returned here in
+     *                order.
+     *  \return False if the graph contains a cycle, in which case "node_order" only contains the nodes that are not on
+     *          or reachable from a cycle.
+     *  \note   Of the nodes that could come next, the one w/ the smallest ID always comes first, so the result is
+     *          deterministic.
+     */
+    bool topologicalSort(std::vector<NodeId> * const node_order, std::vector<NodeId> * const cycle = nullptr) const;
+
+    /** \brief Finds the strongly connected components w/ Tarjan's algorithm.
+     *  \param component_ids  For each node, the ID of its component.  Components are numbered in reverse topological
+     *                        order, i.e. edges between components always go from higher to lower IDs.
+     *  \return The number of components.
+     */
+    size_t findStronglyConnectedComponents(std::vector<NodeId> * const component_ids) const;
+
+    /** \brief Finds all nodes that can be reached from "start_nodes" w/ at most "max_depth" edges.
+     *  \param level_sizes   If not nullptr, the number of nodes that were found at each distance, starting at 0 for the
+     *                       start nodes, will be returned here.
+     *  \param thread_count  The number of threads to use for large levels or 0 for one thread per core.
+     *  \return The reached nodes including the start nodes, ordered by distance and within the same distance by ID.
+     */
+    std::vector<NodeId> breadthFirstSearch(const std::vector<NodeId> &start_nodes, const unsigned max_depth = UINT_MAX,
+                                           std::vector<size_t> * const level_sizes = nullptr,
+                                           const unsigned thread_count = 0) const;
+private:
+    void findCycle(std::vector<NodeId> * const cycle) const;
+};
+
+
+/** \class NodeNameTable
+ *  \brief Assigns consecutive node IDs to names, e.g. to the lines of a text file, so that they can be used w/ DirectedGraph.
+ */
+class NodeNameTable {
+    std::unordered_map<std::string, DirectedGraph::NodeId> names_to_ids_;
+    std::vector<const std::string *> ids_to_names_; // Point to the keys of "names_to_ids_" which never move.
+public:
+    static constexpr DirectedGraph::NodeId NO_ID = UINT32_MAX;
+public:
+    /** \return The ID of "name".  If "name" had no ID yet, it gets the next unused one. */
+    DirectedGraph::NodeId getOrAddId(const std::string &name);
+
+    /** \return The ID of "name" or NO_ID if "name" has not been added. */
+    DirectedGraph::NodeId getId(const std::string &name) const;
+
+    inline const std::string &getName(const DirectedGraph::NodeId id) const { return *ids_to_names_[id]; }
+    inline size_t size() const { return ids_to_names_.size(); }
+};
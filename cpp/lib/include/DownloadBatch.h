@@ -0,0 +1,114 @@
+/** \brief Concurrent downloading of many URL's w/ a single thread, built on curl's "multi" interface.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <curl/curl.h>
+#include "Downloader.h"
+#include "TimeLimit.h"
+
+
+/** \class DownloadBatch
+ *  \brief Runs many downloads concurrently, subject to a global and a per-host cap on the number of simultaneous
+ *         transfers.
+ *  \note  Requests beyond the caps wait in FIFO order and their time limits only start to count down once their
+ *         transfers have actually been started.
+ *  \note  The per-request Downloader::Params are applied like Downloader does it, except that honouring robots.txt,
+ *         text translation and body chunk callbacks are not supported and that HTTP-EQUIV "Refresh" redirects will not
+ *         be followed.  Use a Downloader where you need those.
+ *  \note  Completion callbacks are invoked in the thread that calls run() or getNextCompletion() and may add new URL's.
+ */
+class DownloadBatch {
+public:
+    static const unsigned DEFAULT_MAX_TOTAL_TRANSFERS    = 32;
+    static const unsigned DEFAULT_MAX_TRANSFERS_PER_HOST = 4;
+
+    struct Result {
+        size_t request_id_;
+        std::string url_, effective_url_; // The latter is the URL after following "Location:" redirects.
+        CURLcode curl_error_code_;
+        std::string error_message_; // Empty if there was no error.
+        long response_code_;        // Zero if we never got a response.
+        std::string message_header_; // The header of the last response if there were redirects.
+        std::string message_body_;
+    public:
+        inline bool anErrorOccurred() const { return not error_message_.empty(); }
+    };
+
+    /** \note Requests w/o a callback end up in the completion queue, see getNextCompletion(). */
+    typedef std::function<void(const Result &result)> CompletionCallback;
+private:
+    struct Transfer;
+
+    CURLM *multi_handle_;
+    const unsigned max_total_transfers_, max_transfers_per_host_;
+    size_t next_request_id_;
+    std::deque<Transfer *> pending_transfers_;
+    std::unordered_map<CURL *, Transfer *> active_transfers_;
+    std::unordered_map<std::string, unsigned> hosts_to_active_transfer_counts_;
+    std::deque<Result> completion_queue_;
+public:
+    explicit DownloadBatch(const unsigned max_total_transfers = DEFAULT_MAX_TOTAL_TRANSFERS,
+                           const unsigned max_transfers_per_host = DEFAULT_MAX_TRANSFERS_PER_HOST);
+    ~DownloadBatch();
+
+    /** \return An ID that is unique for the lifetime of the batch and will be reported in the Result for "url".
+     *  \note   Calls LOG_ERROR if "params" asks for anything that we don't support.
+     */
+    size_t addUrl(const std::string &url, const Downloader::Params &params = Downloader::Params(),
+                  const TimeLimit &time_limit = Downloader::DEFAULT_TIME_LIMIT,
+                  const CompletionCallback &completion_callback = nullptr);
+
+    /** \return The number of requests that have not completed yet. */
+    inline size_t size() const { return pending_transfers_.size() + active_transfers_.size(); }
+    inline bool empty() const { return size() == 0; }
+
+    /** \brief Runs transfers until all requests have completed.
+     *  \note  Results for requests w/o a callback stay in the completion queue.
+     */
+    void run();
+
+    /** \brief Runs transfers until a request w/o a callback has completed.
+     *  \return False if there are neither queued results nor unfinished requests left, o/w true.
+     */
+    bool getNextCompletion(Result * const result);
+private:
+    DownloadBatch(const DownloadBatch &) = delete;
+    DownloadBatch &operator=(const DownloadBatch &) = delete;
+
+    /** \brief Starts as many pending transfers as our caps allow. */
+    void startTransfers();
+
+    /** \return CURLE_OK if "transfer" is now active, o/w the caller has to finish it. */
+    CURLcode startTransfer(Transfer * const transfer);
+
+    /** \brief Waits for activity on any of our transfers and processes all transfers that have completed. */
+    void performTransfers();
+
+    /** \brief Delivers the result of "transfer" and deletes it. */
+    void finishTransfer(Transfer * const transfer, const CURLcode curl_error_code, const std::string &error_message = "");
+
+    static size_t WriteFunction(void *data, size_t size, size_t nmemb, void *transfer);
+    static size_t HeaderFunction(void *data, size_t size, size_t nmemb, void *transfer);
+    static int DebugFunction(CURL *handle, curl_infotype infotype, char *data, size_t size, void *transfer);
+};
@@ -22,13 +22,18 @@
 #pragma once
 
 
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <ctime>
 #include <curl/curl.h>
 #include "Compiler.h"
-#include "PerlCompatRegExp.h"
+#include "HttpHeader.h"
+#include "RegexMatcher.h"
 #include "RobotsDotTxt.h"
 #include "TimeLimit.h"
 #include "Url.h"
@@ -38,15 +43,24 @@
  *  \brief  Implements an object that can download Web pages, grab files off of FTP servers etc.
  */
 class Downloader {
+    friend class DownloadBatch;
+
     CURL *easy_handle_;
     static CURLSH *share_handle_;
     static unsigned instance_count_;
     static std::mutex dns_mutex_;
     static std::mutex cookie_mutex_;
     static std::mutex header_mutex_;
-    static std::mutex robots_dot_txt_mutex_;
+    static std::mutex ssl_session_mutex_;
     static std::mutex write_mutex_;
-    static std::unordered_map<std::string, RobotsDotTxt> url_to_robots_dot_txt_map_;
+
+    // Easy handles keep their connections alive, so we hand them on to later instances downloading from the same host.
+    struct IdleEasyHandle {
+        CURL *easy_handle_;
+        time_t last_use_time_;
+    };
+    static std::mutex easy_handle_pool_mutex_;
+    static std::unordered_map<std::string, std::vector<IdleEasyHandle>> easy_handle_pool_; // Key is scheme/host/port.
 protected:
     bool multi_mode_;
 public:
@@ -57,15 +71,23 @@ public:
     static const std::string DEFAULT_ACCEPTABLE_LANGUAGES;
     static const unsigned DEFAULT_TIME_LIMIT    = 20000; // In ms.
     static const long DEFAULT_META_REDIRECT_THRESHOLD = 30; // In s
+    static const unsigned MAX_IDLE_EASY_HANDLES_PER_HOST = 4;
+    static const time_t MAX_EASY_HANDLE_IDLE_TIME = 60; // In s
 private:
     CURLcode curl_error_code_;
     mutable std::string last_error_message_;
     std::string concatenated_headers_;
+    size_t last_header_start_; // Where the header of the last response starts in "concatenated_headers_".
+    mutable bool last_header_is_current_;
+    mutable std::string last_header_;
+    mutable HttpHeader last_http_header_;
     std::string body_;
     std::vector<std::string> redirect_urls_;
     char error_buffer_[CURL_ERROR_SIZE];
     Url current_url_;
     curl_slist *additional_http_headers_;
+    curl_slist *resolve_list_; // Our own DNS lookup result for the current URL's host, if any.
+    std::string easy_handle_pool_key_; // Empty as long as "easy_handle_" has not been used for a download.
     class UploadBuffer *upload_buffer_;
     static std::string default_user_agent_string_;
 public:
@@ -84,7 +106,7 @@ public:
         long dns_cache_timeout_;  // How long to keep cache entries around.  (In seconds.)  -1 means forever
         bool honour_robots_dot_txt_;
         TextTranslationMode text_translation_mode_;
-        PerlCompatRegExps banned_reg_exps_; // Do not download anything matching these regular expressions.
+        RegexSet banned_reg_exps_; // Do not download anything matching these regular expressions.
         bool debugging_;
         bool follow_redirects_;
         unsigned meta_redirect_threshold_; // only redirect if less than this value in seconds
@@ -94,6 +116,19 @@ public:
         std::string post_data_;
         std::string authentication_username_;
         std::string authentication_password_;
+
+        // Validators of a previously downloaded copy.  If set, servers may answer w/ "304 Not Modified" and no body.
+        std::string if_none_match_; // An ETag.
+        time_t if_modified_since_;  // Zero means unset.
+
+        // If true, hostnames will be looked up w/ SimpleResolver::GetDefaultInstance(), whose cache honours TTL's and
+        // remembers unresolvable hosts, and the result will be handed to curl via CURLOPT_RESOLVE.
+        bool use_simple_resolver_;
+
+        // If set, the message body is handed to this function chunk by chunk as it arrives instead of being collected
+        // for getMessageBody().  Returning false aborts the transfer.  HTTP-EQUIV "Refresh" redirects will not be
+        // followed and honouring robots.txt is not supported in this mode.
+        std::function<bool(const char * const data, const size_t size)> body_chunk_callback_;
     public:
         explicit Params(const std::string &user_agent = DEFAULT_USER_AGENT_STRING,
                         const std::string &acceptable_languages = DEFAULT_ACCEPTABLE_LANGUAGES,
@@ -101,7 +136,7 @@ public:
                         const long dns_cache_timeout = DEFAULT_DNS_CACHE_TIMEOUT,
                         const bool honour_robots_dot_txt = false,
                         const TextTranslationMode text_translation_mode = TRANSPARENT,
-                        const PerlCompatRegExps &banned_reg_exps = PerlCompatRegExps(), const bool debugging = false,
+                        const RegexSet &banned_reg_exps = RegexSet(), const bool debugging = false,
                         const bool follow_redirects = true, const unsigned meta_redirect_threshold = DEFAULT_META_REDIRECT_THRESHOLD,
                         const bool ignore_ssl_certificates = false,
                         const std::string &proxy_host_and_port = "",
@@ -118,7 +153,8 @@ public:
     typedef int (*DebugFunc)(CURL *handle, curl_infotype infotype, char *data, size_t size, void *this_pointer);
 public:
     explicit Downloader(const Params &params = Params()): multi_mode_(false), additional_http_headers_(nullptr),
-                                                          upload_buffer_(nullptr), params_(params) { init(); }
+                                                          resolve_list_(nullptr), upload_buffer_(nullptr), params_(params)
+        { init(); }
     explicit Downloader(const Url &url, const Params &params = Params(),
                         const TimeLimit &time_limit = DEFAULT_TIME_LIMIT);
     explicit Downloader(const std::string &url, const Params &params = Params(),
@@ -142,7 +178,12 @@ public:
     bool deleteUrl(const std::string &url, const TimeLimit &time_limit = DEFAULT_TIME_LIMIT)
         { return deleteUrl(Url(url), time_limit); }
 
-    std::string getMessageHeader() const;
+    /** \return The header of the last response, e.g. after any redirects. */
+    const std::string &getMessageHeader() const;
+
+    /** \return The parsed header of the last response.  The header is only parsed once per download. */
+    const HttpHeader &getHttpHeader() const;
+
     const std::string &getMessageBody() const { return body_; }
 
     /** \brief  Tries its best to get the MIME type of the most recently downloaded document.
@@ -166,9 +207,16 @@ public:
     /** \note Get HTTP response code */
     unsigned getResponseCode();
 
+    /** \brief   Returns the robots.txt for "url"'s site, downloading it if it is not in the RobotsDotTxtCache yet.
+     *  \return  An empty, i.e. allow-everything, object if the site has no robots.txt or nullptr if "url" has none.
+     *  \warning A download replaces the results of the last download by this instance!
+     */
+    std::shared_ptr<const RobotsDotTxt> getRobotsDotTxt(const Url &url,
+                                                        const TimeLimit &time_limit = DEFAULT_TIME_LIMIT);
+
     static unsigned GetInstanceCount() { return instance_count_; }
 
-    /** \brief    Get's rid of all memory allocations related to Downloader instances.
+    /** \brief    Get's rid of all memory allocations related to Downloader instances, incl. pooled connections.
      *  \param    forever  If true, no new instances can be created in the current process!
      *  \warning  Must only be called when there are no more existing Downloader instances!
      */
@@ -176,7 +224,7 @@ public:
 
     /** \brief  Returns the default list of banned URL regular expressions as found in BannedUrlRegExps.conf.
      */
-    static const PerlCompatRegExps &GetBannedUrlRegExps();
+    static const RegexSet &GetBannedUrlRegExps();
 
     static const std::string &GetDefaultUserAgentString();
 
@@ -194,6 +242,27 @@ private:
                                    DebugFunc debug_func, CURL ** const easy_handle, std::string * const user_agent,
                                    const bool follow_redirect);
     void init();
+
+    /** \brief Sets all options on "easy_handle_" that don't depend on the URL to be downloaded. */
+    void setUpEasyHandle();
+
+    /** \brief Makes sure that we use an easy handle that may have a live connection to the host of "url". */
+    void switchEasyHandle(const Url &url);
+
+    /** \return A previously used easy handle for "easy_handle_pool_key" or nullptr if there is none. */
+    static CURL *CheckOutEasyHandle(const std::string &easy_handle_pool_key);
+
+    /** \brief Keeps "easy_handle" around for reuse or cleans it up if the pool for "easy_handle_pool_key" is full. */
+    static void ReturnEasyHandle(const std::string &easy_handle_pool_key, CURL * const easy_handle);
+
+    /** \note Must be called w/ "easy_handle_pool_mutex_" locked. */
+    static void EvictIdleEasyHandles(const time_t now);
+
+    /** \brief Sets the curl options that only depend on "params".
+     *  \return The additional HTTP headers, which the caller has to free w/ curl_slist_free_all(3), or nullptr.
+     */
+    static curl_slist *ApplyParams(const Params &params, CURL * const easy_handle);
+
     bool internalNewUrl(const Url &url, const TimeLimit &time_limit);
     size_t writeFunction(void *data, size_t size, size_t nmemb);
     static size_t WriteFunction(void *data, size_t size, size_t nmemb, void *this_pointer);
@@ -204,7 +273,11 @@ private:
     void debugFunction(CURL *handle, curl_infotype infotype, char *data, size_t size);
     static int DebugFunction(CURL *handle, curl_infotype infotype, char *data, size_t size, void *this_pointer);
     bool allowedByRobotsDotTxt(const Url &url, const TimeLimit &time_limit);
+
+    /** \brief Resolves "url"'s host w/ our own resolver and, if that succeeds, tells curl to use the result. */
+    void setResolveList(const Url &url, const TimeLimit &time_limit);
     bool getHttpEquivRedirect(std::string * const redirect_url) const;
+    void updateLastHeader() const;
     long getRemainingNoOfRedirects() const
         { return params_.max_redirect_count_ - static_cast<long>(redirect_urls_.size()); }
 };
@@ -218,6 +291,26 @@ private:
 bool Download(const std::string &url, const std::string &output_filename, const TimeLimit &time_limit);
 
 
+/** \brief Downloads a Web document straight into a file descriptor, e.g. of a file or a pipe, w/o ever holding the
+ *         complete document in memory.
+ *  \param url                The address.
+ *  \param fd                 Where the message body will be written to.
+ *  \param time_limit         Max. amount of time to try to download a document in milliseconds.
+ *  \param error_message      Will be set if we return false.
+ *  \param params             Any body_chunk_callback_ will be replaced.
+ *  \param message_header     If not nullptr, the message header of the final response will be stored here.
+ *  \param sha1_hash          If not nullptr, the binary SHA-1 hash of the message body will be stored here.
+ *  \param max_document_size  If non-zero, the download will be aborted once the message body exceeds this many
+ *                            bytes.
+ *  \return True if the download succeeded, else false.
+ *  \note   "fd" may have received partial data even if we return false.
+ */
+bool DownloadToFileDescriptor(const std::string &url, const int fd, const TimeLimit &time_limit,
+                              std::string * const error_message, Downloader::Params params = Downloader::Params(),
+                              std::string * const message_header = nullptr, std::string * const sha1_hash = nullptr,
+                              const size_t max_document_size = 0);
+
+
 /** \brief Downloads a Web document.
  *  \param url         The address.
  *  \param time_limit  Max. amount of time to try to download a document in milliseconds.
@@ -20,12 +20,20 @@
 #pragma once
 
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
+#include <cstdint>
 #include "JSON.h"
 #include "REST.h"
+#include "ThreadUtil.h"
 
 
 class Elasticsearch {
@@ -33,6 +41,77 @@ class Elasticsearch {
     bool ignore_ssl_certificates_;
 public:
     enum RangeOperator { RO_GT, RO_GTE, RO_LT, RO_LTE, RO_NOOP };
+    struct ValueGroup {
+        std::vector<std::string> values_; // One per grouping field.
+        unsigned count_;
+        std::map<std::string, std::string> example_document_;
+    };
+
+    /** \class  BulkWriter
+     *  \brief  Buffers index, update and delete actions and sends them to the _bulk API over persistent connections.
+     *  \note   The buffer is flushed when it exceeds "max_buffer_size" bytes, when an action is added more than
+     *          "max_buffer_age" milliseconds after the oldest buffered action, on explicit calls to flush() and on destruction.
+     *  \note   If "max_concurrent_requests" is greater than 1, full buffers are handed to as many sender threads.  Adding
+     *          actions blocks while all of them are busy and another buffer is already waiting.
+     *  \note   Requests and items that Elasticsearch rejects w/ status 429 ("Too Many Requests") are resent after an
+     *          exponentially growing delay.
+     */
+    class BulkWriter {
+        struct Batch {
+            std::string actions_;
+            std::vector<size_t> item_offsets_; // Where each action starts in "actions_".
+        };
+
+        const Elasticsearch &elasticsearch_;
+        const size_t max_buffer_size_;
+        const unsigned max_buffer_age_;
+        Downloader downloader_; // Only used if we have no sender threads.
+        Batch batch_;
+        uint64_t oldest_buffered_action_time_;
+        std::atomic<unsigned> failed_item_count_;
+        unsigned failed_item_count_at_last_flush_;
+        std::unique_ptr<ThreadUtil::BoundedQueue<Batch>> batch_queue_;
+        std::vector<std::thread> senders_;
+        std::mutex pending_batch_count_mutex_;
+        std::condition_variable all_batches_sent_;
+        unsigned pending_batch_count_; // Queued or currently being sent.
+    public:
+        static constexpr size_t DEFAULT_MAX_BUFFER_SIZE = 5 * 1024 * 1024; // in bytes
+        static constexpr unsigned DEFAULT_MAX_BUFFER_AGE = 5000; // in milliseconds
+        static constexpr unsigned MAX_RETRY_COUNT = 10;
+    public:
+        explicit BulkWriter(const Elasticsearch &elasticsearch, const size_t max_buffer_size = DEFAULT_MAX_BUFFER_SIZE,
+                            const unsigned max_buffer_age = DEFAULT_MAX_BUFFER_AGE, const unsigned max_concurrent_requests = 1);
+        ~BulkWriter();
+
+        /** \param document_id  If empty, Elasticsearch will assign an ID. */
+        void index(const std::map<std::string, std::string> &fields_and_values, const std::string &document_id = "");
+
+        /** \brief Like the above but for a document that already is a serialised JSON object. */
+        void indexJSON(const std::string &json_document, const std::string &document_id = "");
+
+        /** \brief Sets the fields in "fields_and_values" for the document w/ the Elasticsearch ID "document_id". */
+        void update(const std::string &document_id, const std::map<std::string, std::string> &fields_and_values);
+
+        void deleteDocument(const std::string &document_id);
+
+        /** \brief Sends all buffered actions and waits until all requests have been answered.  Items that Elasticsearch
+         *         rejected are logged as warnings.
+         *  \return The number of items that were rejected since the last call to flush().
+         */
+        unsigned flush();
+
+        /** \return The total number of rejected items since construction. */
+        inline unsigned getFailedItemCount() const { return failed_item_count_; }
+    private:
+        BulkWriter(const BulkWriter &) = delete;
+        BulkWriter &operator=(const BulkWriter &) = delete;
+
+        void appendActionLine(const std::string &action, const std::string &document_id);
+        void flushIfNecessary();
+        void submitBatch();
+        void sendBatch(Downloader * const downloader, Batch * const batch);
+    };
 public:
     /* \note   Some paramters are loaded from Elasticsearch.conf (located at the default ub_tools location) must contain
      *         a section name "Elasticsearch" w/ entries name "host", "username" (optional), "password" (optional) and
@@ -60,6 +139,13 @@ public:
 
     bool deleteDocument(const std::string &document_id);
 
+    /** \brief Counts the documents per distinct combination of values of "fields" w/ a server-side aggregation.
+     *  \param example_fields  If not empty, these fields of one document per group will be returned in "example_document_".
+     *  \note  Documents that lack any of "fields" are not counted.  All of "fields" have to be of type "keyword".
+     */
+    std::vector<ValueGroup> countDistinctValues(const std::vector<std::string> &fields,
+                                                const std::set<std::string> &example_fields = {}) const;
+
     /** \brief Returns all values, excluding duplicates contained in field "field". */
     std::unordered_set<std::string> selectAll(const std::string &field) const;
 
@@ -84,13 +170,31 @@ public:
     bool deleteRange(const std::string &field, const RangeOperator operator1, const std::string &operand1,
                      const RangeOperator operator2 = RO_NOOP, const std::string &operand2 = "");
 
+    /** \brief Like deleteRange() but Elasticsearch deletes the documents in a background task that is throttled to
+     *         "requests_per_second" so that it doesn't compete w/ concurrent insertions.
+     *  \return The ID of the Elasticsearch task.
+     */
+    std::string startDeleteRange(const std::string &field, const RangeOperator operator1, const std::string &operand1,
+                                 const unsigned requests_per_second, const RangeOperator operator2 = RO_NOOP,
+                                 const std::string &operand2 = "");
+
     bool fieldWithValueExists(const std::string &field, const std::string &value);
 private:
+    Downloader::Params getDownloaderParams(const std::string &content_type) const;
+
     /** \brief A powerful general query.
      */
     std::shared_ptr<JSON::ObjectNode> query(const std::string &action, const REST::QueryType query_type,
                                             const JSON::ObjectNode &data, const bool add_type=true, const bool suppress_index_name=false) const;
-    std::string extractScrollId(const std::shared_ptr<JSON::ObjectNode> &result_node) const;
-    std::vector<std::map<std::string, std::string>> extractResultsHelper(const std::shared_ptr<JSON::ObjectNode> &result_node,
+
+    /** \brief Like the above but parses the result into "result" which is a lot cheaper for large search results. */
+    void query(const std::string &action, const REST::QueryType query_type, const JSON::ObjectNode &data,
+               JSON::Document * const result, const bool add_type=true, const bool suppress_index_name=false) const;
+
+    Url getQueryUrl(const std::string &action, const bool add_type, const bool suppress_index_name) const;
+    std::string extractScrollId(const JSON::Document &result) const;
+    std::vector<std::map<std::string, std::string>> scrollSlice(const std::string &query_string_prefix, const unsigned slice_no,
+                                                                const unsigned slice_count, const std::set<std::string> &fields) const;
+    std::vector<std::map<std::string, std::string>> extractResultsHelper(const JSON::Document &result,
                                                                          const std::set<std::string> &fields) const;
 };
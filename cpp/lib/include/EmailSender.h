@@ -20,6 +20,7 @@
 #pragma once
 
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,41 @@ unsigned short SendEmail(const std::string &sender, const std::vector<std::strin
                          const Format format = PLAIN_TEXT, const std::string &reply_to = "", const bool use_ssl = true,
                          const bool use_authentication = true, const std::vector<std::string> &attachments = {});
 
+/** \class Batch
+ *  \brief Sends a series of emails over a single SMTP connection, which saves the TCP, TLS and authentication setup for all but
+ *         the first message.
+ *  \note  The connection is only opened when the first email is sent.  Commands are pipelined if the server advertises
+ *         support for it (RFC 2920).  If the server drops the connection between two messages, we reconnect once.
+ */
+class Batch {
+    class Session;
+    const bool use_ssl_, use_authentication_;
+    std::unique_ptr<Session> session_;
+public:
+    explicit Batch(const bool use_ssl = true, const bool use_authentication = true);
+    ~Batch();
+
+    /** \brief Like SendEmail() above. */
+    unsigned short sendEmail(const std::string &sender, const std::vector<std::string> &recipients,
+                             const std::vector<std::string> &cc_recipients, const std::vector<std::string> &bcc_recipients,
+                             const std::string &subject, const std::string &message_body, const Priority priority = DO_NOT_SET_PRIORITY,
+                             const Format format = PLAIN_TEXT, const std::string &reply_to = "",
+                             const std::vector<std::string> &attachments = {});
+
+    inline unsigned short sendEmail(const std::string &sender, const std::string &recipient, const std::string &subject,
+                                    const std::string &message_body, const Priority priority = DO_NOT_SET_PRIORITY,
+                                    const Format format = PLAIN_TEXT, const std::string &reply_to = "",
+                                    const std::vector<std::string> &attachments = {})
+    {
+        return sendEmail(sender, { recipient }, /* cc_recipients = */ { }, /* bcc_recipients = */ { }, subject, message_body,
+                         priority, format, reply_to, attachments);
+    }
+private:
+    Batch(const Batch &) = delete;
+    Batch &operator=(const Batch &) = delete;
+};
+
+
 inline unsigned short SendEmail(const std::string &sender, const std::string &recipient, const std::string &subject,
                                 const std::string &message_body, const Priority priority = DO_NOT_SET_PRIORITY,
                                 const Format format = PLAIN_TEXT, const std::string &reply_to = "", const bool use_ssl = true,
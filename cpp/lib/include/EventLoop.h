@@ -0,0 +1,168 @@
+/** \brief A single-threaded epoll(7)-based event loop and non-blocking TCP and TLS connections on top of it.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+
+
+// Forward declaration(s):
+class SslConnection;
+
+
+/** \class EventLoop
+ *  \brief Dispatches readiness events for any number of file descriptors and expired timers on a single thread.
+ *  \note  Handlers may add or remove file descriptors and timers, including their own, but an instance must not be used
+ *         by more than one thread.
+ */
+class EventLoop {
+public:
+    /** \param events  The epoll(7) events that occurred, e.g. EPOLLIN, EPOLLOUT, EPOLLERR or EPOLLHUP. */
+    typedef std::function<void(const uint32_t events)> IoHandler;
+    typedef std::function<void()> TimerHandler;
+    typedef uint64_t TimerId;
+private:
+    struct Registration {
+        uint32_t serial_number_; // Protects against events for a closed and reused file descriptor.
+        std::shared_ptr<IoHandler> handler_;
+    };
+
+    int epoll_fd_, timer_fd_;
+    std::unordered_map<int, Registration> fds_to_registrations_;
+    uint32_t next_serial_number_;
+    std::set<std::pair<uint64_t, TimerId>> timer_queue_; // Deadlines in microseconds and timer IDs.
+    std::unordered_map<TimerId, std::pair<uint64_t, TimerHandler>> ids_to_timers_;
+    TimerId next_timer_id_;
+    uint64_t armed_deadline_;
+    bool stopped_;
+public:
+    EventLoop();
+    ~EventLoop();
+
+    /** \brief Calls "handler" whenever one of "events", e.g. EPOLLIN | EPOLLOUT, occurs on "fd".  Errors and hangups will
+     *         always be reported.
+     *  \note  Aborts if "fd" has already been added.
+     */
+    void addFd(const int fd, const uint32_t events, const IoHandler &handler);
+
+    void modifyFd(const int fd, const uint32_t events);
+
+    /** \brief Stops watching "fd".  Must be called before "fd" is closed. */
+    void removeFd(const int fd);
+
+    /** \brief Calls "handler" once after "delay" milliseconds. */
+    TimerId addTimer(const unsigned delay, const TimerHandler &handler);
+
+    /** \return False if the timer had already expired or been cancelled, else true. */
+    bool cancelTimer(const TimerId timer_id);
+
+    inline size_t getFdCount() const { return fds_to_registrations_.size(); }
+    inline size_t getTimerCount() const { return ids_to_timers_.size(); }
+
+    /** \brief Dispatches events until stop() is called or there are no more file descriptors and timers. */
+    void run();
+
+    /** \brief Waits up to "timeout" milliseconds, or indefinitely if "timeout" is negative, for events and dispatches them.
+     *  \return False if there was nothing to wait for, else true.
+     */
+    bool runOnce(const int timeout = -1);
+
+    /** \brief Makes run() return after the current round of events has been dispatched. */
+    inline void stop() { stopped_ = true; }
+private:
+    EventLoop(const EventLoop &rhs) = delete;
+    const EventLoop &operator=(const EventLoop &rhs) = delete;
+
+    void processExpiredTimers();
+    void armTimerFd();
+};
+
+
+/** \class AsyncTcpConnection
+ *  \brief A client-side TCP connection, optionally w/ TLS, that never blocks and is driven by an EventLoop.
+ *  \note  Connecting, the TLS handshake, reading and writing are state machines that advance whenever the socket becomes
+ *         ready.  Thus a single thread can handle thousands of connections.
+ *  \note  None of the handlers may destroy the connection object.  They may call close() though.
+ */
+class AsyncTcpConnection {
+public:
+    enum State { IDLE, CONNECTING, HANDSHAKING, OPEN, CLOSED };
+    typedef std::function<void(AsyncTcpConnection * const connection)> OpenHandler;
+    typedef std::function<void(AsyncTcpConnection * const connection, const char * const data, const size_t size)>
+        DataHandler;
+
+    /** \param error_message  Empty if the peer closed the connection, else the reason for the failure. */
+    typedef std::function<void(AsyncTcpConnection * const connection, const std::string &error_message)> CloseHandler;
+private:
+    EventLoop * const event_loop_;
+    OpenHandler open_handler_;
+    DataHandler data_handler_;
+    CloseHandler close_handler_;
+    State state_;
+    bool use_tls_;
+    int fd_;
+    uint32_t watched_events_;
+    std::unique_ptr<SslConnection> ssl_connection_;
+    EventLoop::TimerId timeout_timer_id_;
+    std::string output_buffer_;
+    size_t output_buffer_start_;
+public:
+    AsyncTcpConnection(EventLoop * const event_loop, const OpenHandler &open_handler, const DataHandler &data_handler,
+                       const CloseHandler &close_handler);
+    ~AsyncTcpConnection();
+
+    /** \brief Starts connecting to "address" and, if "use_tls" is true, the TLS handshake.
+     *  \param time_limit  How many milliseconds connecting and the handshake may take in total.
+     *  \note  The outcome will be reported via the open or the close handler, never from within this call.
+     */
+    void connect(const in_addr_t address, const unsigned short port, const bool use_tls, const unsigned time_limit);
+
+    inline State getState() const { return state_; }
+
+    /** \brief Queues "data" for sending.  Data written before the connection has been opened will be sent as soon as
+     *         it is.
+     */
+    void write(const char * const data, const size_t size);
+    inline void write(const std::string &data) { write(data.data(), data.size()); }
+
+    /** \return The number of bytes that have been written but not yet handed to the kernel. */
+    inline size_t getPendingOutputSize() const { return output_buffer_.size() - output_buffer_start_; }
+
+    /** \brief Closes the connection w/o calling the close handler. */
+    void close();
+private:
+    AsyncTcpConnection(const AsyncTcpConnection &rhs) = delete;
+    const AsyncTcpConnection &operator=(const AsyncTcpConnection &rhs) = delete;
+
+    void processEvents(const uint32_t events);
+    void continueHandshake();
+    void opened();
+    void readAvailableData();
+    void flushOutput();
+    void watchEvents(const uint32_t events);
+    void fail(const std::string &error_message);
+};
@@ -0,0 +1,87 @@
+/** \brief A sorter for key/value pairs that don't necessarily fit into memory.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FileUtil.h"
+#include "StringView.h"
+
+
+/** \class ExternalSorter
+ *  \brief Sorts key/value pairs w/ a bounded amount of memory.
+ *  \note  Pairs are buffered until the buffer reaches the memory limit, at which point the buffer is sorted and written to
+ *         a temporary file, a so-called run.  finish() then merges all runs.  If everything fits into memory, no temporary
+ *         files are used.
+ *  \note  Keys are compared bytewise, so for a locale-aware order they should be collation keys, see Collator in Locale.h.
+ *         Pairs w/ equal keys are returned in the order in which they were added.
+ */
+class ExternalSorter {
+    struct Entry {
+        uint64_t offset_; // Into arena_, where the key is immediately followed by the value.
+        uint32_t key_size_, value_size_;
+    };
+
+    const size_t max_memory_usage_;
+    const std::string temp_file_prefix_;
+    std::string arena_;
+    std::vector<Entry> entries_;
+    std::vector<std::unique_ptr<FileUtil::AutoTempFile>> runs_;
+    size_t count_;
+    bool finished_;
+public:
+    static constexpr size_t DEFAULT_MAX_MEMORY_USAGE = static_cast<size_t>(1) << 30u; // 1 GiB
+
+    typedef std::function<void(const StringView &key, const StringView &value)> Consumer;
+public:
+    /** \param max_memory_usage  An upper limit for the memory that we use for buffering pairs.  The actual usage may be
+     *                           somewhat higher due to the growth strategy of our buffers.
+     *  \param temp_file_prefix  Where to put the runs.
+     */
+    explicit ExternalSorter(const size_t max_memory_usage = DEFAULT_MAX_MEMORY_USAGE,
+                            const std::string &temp_file_prefix = "/tmp/ExternalSorter");
+
+    void add(const StringView &key, const StringView &value = StringView());
+
+    /** \brief Passes all pairs to "consumer" in ascending key order.
+     *  \note  No more pairs can be added afterwards.
+     */
+    void finish(const Consumer &consumer);
+
+    /** \return The number of pairs that have been added so far. */
+    inline size_t size() const { return count_; }
+
+    /** \return The number of runs that have been written to disk so far. */
+    inline size_t getRunCount() const { return runs_.size(); }
+private:
+    ExternalSorter(const ExternalSorter &) = delete;
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    inline StringView getKey(const Entry &entry) const { return StringView(arena_.data() + entry.offset_, entry.key_size_); }
+    inline StringView getValue(const Entry &entry) const
+        { return StringView(arena_.data() + entry.offset_ + entry.key_size_, entry.value_size_); }
+    inline size_t getMemoryUsage() const { return arena_.size() + entries_.size() * sizeof(Entry); }
+    void sortBuffer();
+    void writeRun();
+    void mergeRuns(const Consumer &consumer);
+};
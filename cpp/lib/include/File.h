@@ -27,6 +27,7 @@
 #pragma once
 
 
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <cstdio>
@@ -43,11 +44,24 @@ public:
     };
 
     enum ThrowOnOpenBehaviour { THROW_ON_ERROR, DO_NOT_THROW_ON_ERROR };
+
+    /** \brief How we expect to access a file, see setAccessPattern(). */
+    enum AccessPattern {
+        NORMAL_ACCESS,              // No hints.
+        SEQUENTIAL_ACCESS,          // The kernel should read ahead aggressively.
+        SEQUENTIAL_ACCESS_NO_REUSE  // Like SEQUENTIAL_ACCESS but we also evict the data that we're done w/ from the page
+                                    // cache so that a multi-gigabyte pass doesn't push out data that is worth caching.
+    };
+
+    // A good buffer size for large sequentially processed files like our MARC dumps:
+    static constexpr size_t BULK_BUFFER_SIZE = 1024 * 1024;
 private:
     enum OpenMode { READING, WRITING, READING_AND_WRITING };
+    class AsyncStream;
 private:
     std::string filename_;
-    char buffer_[BUFSIZ];
+    std::unique_ptr<char[]> buffer_;
+    size_t buffer_size_;
     char *buffer_ptr_;
     size_t read_count_;
     FILE *file_;
@@ -55,13 +69,24 @@ private:
     char pushed_back_chars_[2];
     int precision_;
     OpenMode open_mode_;
+    bool compressed_;
+    AccessPattern access_pattern_;
+    size_t bytes_since_drop_behind_; // Only used for SEQUENTIAL_ACCESS_NO_REUSE.
+    off_t dropped_offset_;           // Only used for SEQUENTIAL_ACCESS_NO_REUSE.
+    off_t writeback_offset_;         // Only used for SEQUENTIAL_ACCESS_NO_REUSE.
+    AsyncStream *async_stream_;      // Owned by "file_", only non-NULL after a successful call to enableAsynchronousIO().
+
+    // How often, in bytes, we evict already processed data from the page cache for SEQUENTIAL_ACCESS_NO_REUSE:
+    static constexpr size_t DROP_BEHIND_INTERVAL = 8 * 1024 * 1024;
 public:
     /** \brief  Creates and initalises a File object.
      *  \param  path                      The pathname for the file (see fopen(3) for details).
      *  \param  mode                      The open mode (see fopen(3) for details).  An extension to the fopen modes
      *                                    are either "c" or "u".  "c" meaning "compress" can only be combined with "w"
-     *                                    and "u" meaning "uncompress" with "r".  Using either flag makes seeking or
-     *                                    rewinding impossible.
+     *                                    or "a" and "u" meaning "uncompress" with "r".  The compressed format is gzip.
+     *                                    Using "u" makes seeking expensive, backward seeks and rewinding require
+     *                                    decompressing from the start, and seeking relative to the end impossible.
+     *                                    "c" compresses on all cores but rules out seeking altogether.
      *  \param  throw_on_error_behaviour  If true, any open failure will cause an exception to be thrown.  If not true
      *                                    you must use the fail() member function.
      */
@@ -75,18 +100,50 @@ public:
      */
     explicit File(const int fd, const std::string &mode = "");
 
-    ~File() { if (file_ != nullptr) std::fclose(file_); }
+    ~File() { if (file_ != nullptr) close(); }
 
     /** Closes this File.  If this fails you may consult the global "errno" for the reason. */
     bool close();
 
-    inline int getFileDescriptor() const { return fileno(file_); }
+    /** \brief Replaces our default buffer size of BUFSIZ for reading and, via setvbuf(3), for writing.
+     *  \note  Must be called before the first I/O operation!  Larger buffers, e.g. BULK_BUFFER_SIZE, result in far
+     *         fewer system calls for files that we stream through.
+     */
+    void setBufferSize(const size_t new_buffer_size);
+
+    /** \brief Passes "access_pattern" on to the kernel via posix_fadvise(2).
+     *  \note  For SEQUENTIAL_ACCESS_NO_REUSE we periodically evict what we have read from the page cache and, when
+     *         writing, what has been written back to disk.  This is only a good idea for data that won't be read again
+     *         soon, e.g. final outputs or inputs that we only scan once.
+     *  \note  This is a no-op for compressed files.  After enableAsynchronousIO(), SEQUENTIAL_ACCESS_NO_REUSE is
+     *         treated like SEQUENTIAL_ACCESS.
+     */
+    void setAccessPattern(const AccessPattern access_pattern);
+
+    /** \brief Switches to io_uring-based I/O.  Readers will then keep "queue_depth" reads of the buffer size in flight
+     *         ahead of the consumer and writers return as soon as a buffer has been handed to the kernel, so that
+     *         processing overlaps w/ disk or pipe I/O instead of alternating w/ it.
+     *  \return False, in which case we continue w/ ordinary synchronous I/O, if the kernel doesn't support io_uring
+     *          or if this is a compressed or an "r+" File.
+     *  \note  Must be called before the first I/O operation and after setBufferSize(), if any.  Pipes and files
+     *         opened for appending only get a single request in flight as their requests would otherwise complete
+     *         in arbitrary order.  Write errors may only be reported by a later write(), flush() or close().
+     */
+    bool enableAsynchronousIO(const unsigned queue_depth = 4);
+
+    inline bool isAsynchronous() const { return async_stream_ != nullptr; }
+
+    /** \warning Returns -1 for compressed files! */
+    int getFileDescriptor() const;
+
+    /** \return True if we were opened w/ either the "c" or the "u" mode flag. */
+    inline bool isCompressed() const { return compressed_; }
 
     inline off_t tell() const {
         const off_t file_pos(::ftello(file_));
         if (open_mode_ == WRITING)
             return file_pos;
-        return file_pos - read_count_ + (buffer_ptr_ - buffer_) - pushed_back_count_;
+        return file_pos - read_count_ + (buffer_ptr_ - buffer_.get()) - pushed_back_count_;
     }
 
     /** \brief  Set the file pointer for the next I/O operation.
@@ -106,13 +163,20 @@ public:
             return pushed_back_char;
         }
 
-        if (unlikely(buffer_ptr_ == buffer_ + read_count_))
+        if (unlikely(buffer_ptr_ == buffer_.get() + read_count_))
             fillBuffer();
         if (unlikely(read_count_ == 0))
             return EOF;
         return *buffer_ptr_++;
     }
 
+    /** \brief  Appends all characters up to, but not including, the next occurrence of "terminator" to "s".
+     *  \return The number of appended characters.
+     *  \note   The terminator, if found, will be what the next call to get() returns.  This is a lot faster than
+     *          repeatedly calling get() as we copy straight out of our buffer.
+     */
+    size_t appendUntil(std::string * const s, const char terminator);
+
     /** \brief  Read some data from a file.
      *  \param  buf       The data to read.
      *  \param  buf_size  How much data to read.
@@ -185,7 +249,7 @@ public:
     /** Returns a File's size in bytes. */
     off_t size() const;
 
-    inline bool eof() const { return (buffer_ptr_ == buffer_ + read_count_) and std::feof(file_) != 0; }
+    inline bool eof() const { return (buffer_ptr_ == buffer_.get() + read_count_) and std::feof(file_) != 0; }
     inline bool anErrorOccurred() const { return file_ == nullptr or std::ferror(file_) != 0; }
 
     /** Will the next I/O operation fail? */
@@ -209,8 +273,9 @@ public:
     void rewind();
 
     /** \brief  Flush all internal I/O buffers.
-     *  \return True on success and false on failure.  Sets errno if there is a failure. */
-    inline bool flush() const { return std::fflush(file_) == 0; }
+     *  \return True on success and false on failure.  Sets errno if there is a failure.
+     *  \note   After enableAsynchronousIO() we also wait for all outstanding writes. */
+    bool flush() const;
 
     /** Appends the contents of the file corresponding to "fd" to the current File. (Maintains "fd"'s original
         offset.) */
@@ -231,5 +296,16 @@ public:
         return SingleArgManipulator<int>(SetPrecision, new_precision); }
 private:
     void fillBuffer();
+
+    /** \brief Implements the page cache eviction for SEQUENTIAL_ACCESS_NO_REUSE.
+     *  \param final  If true, we have finished writing and evict everything, otherwise we only evict data that was
+     *                processed at least DROP_BEHIND_INTERVAL bytes ago.
+     */
+    void dropBehind(const bool final = false);
+    inline void countProcessedBytes(const size_t count) {
+        if (unlikely(access_pattern_ == SEQUENTIAL_ACCESS_NO_REUSE)
+            and (bytes_since_drop_behind_ += count) >= DROP_BEHIND_INTERVAL)
+            dropBehind();
+    }
     static File &SetPrecision(File &f, int new_precision) { f.precision_ = new_precision; return f; }
 };
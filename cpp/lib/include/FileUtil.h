@@ -29,6 +29,7 @@
 #pragma once
 
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -170,6 +171,38 @@ public:
 };
 
 
+enum TreeWalkAction { CONTINUE_WALK, SKIP_DIRECTORY, ABORT_WALK };
+
+
+/** \brief Called by WalkDirectoryTree() w/ the path of an entry and its type, one of the DT_* constants from <dirent.h>.
+ *  \return SKIP_DIRECTORY only makes sense for directories and is treated like CONTINUE_WALK otherwise.  If you return
+ *          ABORT_WALK you should set errno.
+ */
+typedef std::function<TreeWalkAction(const std::string &path, const unsigned char type)> TreeVisitor;
+
+
+/** \brief Called by WalkDirectoryTree() once all entries of a directory have been visited.
+ *  \return False aborts the walk, in which case you should set errno.
+ */
+typedef std::function<bool(const std::string &directory_path)> TreePostVisitor;
+
+
+/** \brief Walks the directory tree rooted at "root_directory" on multiple threads.
+ *  \param visitor       Called for every entry below "root_directory" except for "." and "..".
+ *  \param post_visitor  If not empty, called for "root_directory" and every directory that we descended into after all
+ *                       of its entries have been visited, i.e. in post-order.  This is where you'd rmdir(2).
+ *  \param thread_count  If 0, we use one thread per core.
+ *  \return False if a directory couldn't be read or a callback aborted the walk, in which case errno will be set.
+ *  \note   Directories are read w/ getdents64(2) and large buffers.  Entry types come from the directory entries, so
+ *          we only stat entries on filesystems that don't provide them.  Symlinks are reported but never followed.
+ *  \note   Subdirectories are handed to a work-stealing ThreadPool, which we only start once we find the first
+ *          subdirectory.  The callbacks will therefore be called concurrently and in no particular order.  If a
+ *          callback throws, no further directories will be read and the first exception will be rethrown.
+ */
+bool WalkDirectoryTree(const std::string &root_directory, const TreeVisitor &visitor,
+                       const TreePostVisitor &post_visitor = TreePostVisitor(), const unsigned thread_count = 0);
+
+
 /** \return The size of the file named by "path".
  *  \note   Exits with an error message if "path" does not exist or we don't have the rights to stat it.
  */
@@ -315,6 +348,7 @@ void MakeDirectoryOrDie(const std::string &path, const bool recursive = false, c
  *  \return True if we succeeded in removing the directory tree, else false.
  *  \note   If the function returns false, it sets errno which you can consult to determine the reason
  *          for the failure.
+ *  \note   Subtrees are removed in parallel, see WalkDirectoryTree().
  */
 bool RemoveDirectory(const std::string &dir_name);
 
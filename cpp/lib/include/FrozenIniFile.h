@@ -0,0 +1,125 @@
+/** \brief An immutable, hash-indexed snapshot of an IniFile for programs that do many configuration lookups.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Forward declaration:
+class IniFile;
+
+
+/** \class FrozenIniFile
+ *  \brief A read-only view of an IniFile w/ constant-time section and entry lookups.
+ *  \note  Sections and entries are located via perfect hash tables that are built once, so that an entry lookup costs a
+ *         single hash computation over the section and variable names followed by one comparison of each name.  All
+ *         strings are interned, so the same value, e.g. "true", is only stored once and find() can hand out pointers.
+ *  \note  Optionally the frozen contents are cached in a binary file.  The cache remembers the modification times and
+ *         sizes of all files that the IniFile parser consulted, including includes and host-specific overrides, and
+ *         is only used if none of them have changed.  This saves processes that get spawned many times, e.g. by the
+ *         harvesters or by CGI requests, from having to re-parse the same configuration.
+ */
+class FrozenIniFile {
+    struct Section {
+        uint32_t name_index_;
+        uint32_t first_entry_index_;
+        uint32_t entry_count_;
+    };
+
+    struct Entry {
+        uint32_t section_index_;
+        uint32_t name_index_;
+        uint32_t value_index_;
+    };
+
+    // For each bucket the hash seed that maps all keys in the bucket to distinct slots.
+    struct PerfectHashTable {
+        std::vector<uint32_t> seeds_;
+        std::vector<uint32_t> slots_; // Indices of sections or entries or NO_INDEX.
+    };
+
+    std::string ini_file_name_;
+    std::vector<std::string> strings_;
+    std::vector<Section> sections_;
+    std::vector<Entry> entries_;
+    PerfectHashTable section_table_, entry_table_;
+    bool loaded_from_cache_;
+public:
+    /** \brief Takes a snapshot of "ini_file".  Later changes to "ini_file" will not be reflected. */
+    explicit FrozenIniFile(const IniFile &ini_file);
+
+    /** \brief Parses "ini_file_name" or, if "cache_path" is not empty and up to date, loads the cached copy.
+     *  \note  If the cache is missing or stale, we try to replace it.  Failing to do so, e.g. because of missing
+     *         permissions, is not an error.
+     */
+    explicit FrozenIniFile(const std::string &ini_file_name, const std::string &cache_path = "");
+
+    inline const std::string &getFilename() const { return ini_file_name_; }
+    inline bool loadedFromCache() const { return loaded_from_cache_; }
+
+    /** \return The interned value or nullptr if the section or the entry doesn't exist.
+     *  \note   The returned pointer stays valid as long as this object exists.
+     */
+    const std::string *find(const std::string &section_name, const std::string &variable_name) const;
+
+    bool lookup(const std::string &section_name, const std::string &variable_name, std::string * const s) const;
+
+    inline bool sectionIsDefined(const std::string &section_name) const { return findSection(section_name) != NO_INDEX; }
+    inline bool variableIsDefined(const std::string &section_name, const std::string &variable_name) const
+        { return find(section_name, variable_name) != nullptr; }
+
+    std::vector<std::string> getSections() const;
+
+    // \return The entry names of "section_name" in file order or an empty vector if the section doesn't exist.
+    std::vector<std::string> getSectionEntryNames(const std::string &section_name) const;
+
+    // The following mirror the IniFile member functions of the same names.  Those w/o a default value abort if the
+    // variable doesn't exist and all abort if the value can't be converted.
+    const std::string &getString(const std::string &section_name, const std::string &variable_name) const;
+    std::string getString(const std::string &section_name, const std::string &variable_name,
+                          const std::string &default_value) const;
+    unsigned getUnsigned(const std::string &section_name, const std::string &variable_name) const;
+    unsigned getUnsigned(const std::string &section_name, const std::string &variable_name,
+                         const unsigned default_value) const;
+    uint64_t getUint64T(const std::string &section_name, const std::string &variable_name) const;
+    uint64_t getUint64T(const std::string &section_name, const std::string &variable_name,
+                        const uint64_t default_value) const;
+    long getInteger(const std::string &section_name, const std::string &variable_name) const;
+    long getInteger(const std::string &section_name, const std::string &variable_name, const long default_value) const;
+    double getDouble(const std::string &section_name, const std::string &variable_name) const;
+    double getDouble(const std::string &section_name, const std::string &variable_name, const double default_value) const;
+    bool getBool(const std::string &section_name, const std::string &variable_name) const;
+    bool getBool(const std::string &section_name, const std::string &variable_name, const bool default_value) const;
+private:
+    static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    FrozenIniFile(const FrozenIniFile &) = delete;
+    FrozenIniFile &operator=(const FrozenIniFile &) = delete;
+
+    void freeze(const IniFile &ini_file);
+    uint32_t findSection(const std::string &section_name) const;
+    const std::string &getStringOrDie(const std::string &section_name, const std::string &variable_name) const;
+
+    /** \return False if "cache_path" doesn't exist, is corrupt or has been made for another or an outdated ini file. */
+    bool loadCache(const std::string &cache_path);
+    void writeCache(const std::string &cache_path, const std::vector<std::string> &consulted_files) const;
+};
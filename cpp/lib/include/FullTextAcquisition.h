@@ -0,0 +1,115 @@
+/** \file   FullTextAcquisition.h
+ *  \brief  Downloading of the documents linked from MARC records and extraction of their full texts.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2015-2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FileUtil.h"
+#include "FullTextCache.h"
+#include "MARC.h"
+
+
+namespace FullTextAcquisition {
+
+
+constexpr unsigned PER_DOC_TIMEOUT(30000); // in milliseconds
+
+
+/** \brief A downloaded document.  Direct links to PDF's are streamed into a temporary file instead of into memory. */
+struct Document {
+    std::string url_;
+    std::string contents_; // Empty if "pdf_file_" holds the document.
+    std::unique_ptr<FileUtil::AutoTempFile> pdf_file_;
+    std::string media_type_, media_subtype_, http_header_charset_;
+    std::string error_message_; // Non-empty if the download failed.
+    std::string content_hash_; // The SHA-1 hash of the document's bytes, set by a successful Download().
+public:
+    Document() = default;
+    Document(Document &&other) = default;
+    Document &operator=(Document &&rhs) = default;
+
+    inline bool anErrorOccurred() const { return not error_message_.empty(); }
+    inline bool isPdfFile() const { return pdf_file_ != nullptr and contents_.empty(); }
+};
+
+
+/** \brief Remembers the texts extracted from downloaded documents by their content hashes, so that documents that are
+ *         linked from more than one record only have to be converted once.
+ *  \note  Thread-safe.  Once more than "max_total_size" bytes of text are held, the oldest entries will be evicted.
+ */
+class ExtractedTextCache {
+    struct Entry {
+        std::string text_, error_message_;
+    };
+    const size_t max_total_size_;
+    size_t total_size_, hit_count_;
+    std::unordered_map<std::string, Entry> key_to_entry_map_;
+    std::deque<std::string> keys_in_insertion_order_;
+    mutable std::mutex mutex_;
+public:
+    static constexpr size_t DEFAULT_MAX_TOTAL_SIZE = 100 * 1024 * 1024; // in bytes
+public:
+    explicit ExtractedTextCache(const size_t max_total_size = DEFAULT_MAX_TOTAL_SIZE)
+        : max_total_size_(max_total_size), total_size_(0), hit_count_(0) { }
+
+    /** \return True if we have an entry for "key", else false. */
+    bool lookup(const std::string &key, std::string * const text, std::string * const error_message);
+
+    void insert(const std::string &key, const std::string &text, const std::string &error_message);
+
+    /** \return The number of successful lookups so far. */
+    size_t getHitCount() const;
+};
+
+
+/** \return The URL's of all 856 fields that don't have a first indicator of '7' and are probably not reviews. */
+std::vector<std::string> GetUrls(const MARC::Record &record);
+
+
+/** \brief Downloads "url" w/ a time limit of "timeout" milliseconds into "document".
+ *  \return False if an error occurred, in which case "document->error_message_" will have been set.
+ *  \note   Thread-safe.
+ */
+bool Download(const std::string &url, const unsigned timeout, Document * const document);
+
+
+/** \brief Combines the 520$a contents of "record" w/ the texts extracted from "documents", which must have been downloaded from
+ *         the URL's returned by GetUrls() for "record".
+ *  \param entry_urls            Here we return an entry per document, which will have an error message if we failed to get
+ *                              its text.
+ *  \param extracted_text_cache  If not NULL, documents whose contents we have already seen will not be converted again.
+ *  \return The combined text w/ collapsed and trimmed whitespace.
+ *  \note   Thread-safe.
+ */
+std::string ExtractFullText(const MARC::Record &record, const std::vector<Document> &documents, const unsigned pdf_extraction_timeout,
+                            std::vector<FullTextCache::EntryUrl> * const entry_urls,
+                            ExtractedTextCache * const extracted_text_cache = nullptr);
+
+
+/** \brief Adds the field that links "record" to its entry in our full-text cache. */
+void AddFullTextLink(MARC::Record * const record);
+
+
+} // namespace FullTextAcquisition
@@ -22,12 +22,16 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "BloomFilter.h"
 #include "Elasticsearch.h"
 
 
 class FullTextCache {
-    Elasticsearch full_text_cache_, full_text_cache_urls_;
+    Elasticsearch full_text_cache_, full_text_cache_urls_, full_text_cache_stats_;
+    Elasticsearch::BulkWriter full_text_cache_writer_, full_text_cache_urls_writer_;
+    std::shared_ptr<const BloomFilter> id_filter_;
 public:
     struct Entry {
         std::string id_;
@@ -54,8 +58,18 @@ public:
                    const std::string &id, const std::string &url)
             : count_(count), domain_(domain), error_message_(error_message), example_entry_(id, url, domain, error_message) { }
     };
+    /** \brief Aggregate figures that would otherwise require scanning the entire cache. */
+    struct Stats {
+        time_t creation_time_;
+        unsigned cache_size_;
+        unsigned error_count_;
+        std::vector<EntryGroup> error_groups_; // Sorted in descending order of the count_ fields.
+        std::unordered_map<std::string, unsigned> domains_and_counts_;
+    };
 public:
-    FullTextCache(): full_text_cache_("full_text_cache"), full_text_cache_urls_("full_text_cache_urls") { }
+    FullTextCache(): full_text_cache_("full_text_cache"), full_text_cache_urls_("full_text_cache_urls"),
+                     full_text_cache_stats_("full_text_cache_stats"), full_text_cache_writer_(full_text_cache_),
+                     full_text_cache_urls_writer_(full_text_cache_urls_) { }
 
     /** \brief Test whether an entry in the cache has expired or not.
      *  \return True if we don't find "id" in the database, or the entry is older than now-CACHE_EXPIRE_TIME_DELTA,
@@ -64,8 +78,18 @@ public:
      */
     bool entryExpired(const std::string &key, std::vector<std::string> urls);
 
-    /** \brief Delete all records whose expiration field is in the past */
-    void expireEntries();
+    /** \return A filter for the IDs of all current entries that can be shared between threads and instances. */
+    std::shared_ptr<const BloomFilter> getIdFilter() const;
+
+    /** \brief Makes entryExpired() consult "id_filter" first, so IDs that are certainly not cached need no queries.
+     *  \note  Entries inserted after the creation of "id_filter" will be treated as expired.
+     */
+    inline void setIdFilter(const std::shared_ptr<const BloomFilter> &id_filter) { id_filter_ = id_filter; }
+
+    /** \brief Starts the deletion of all records whose expiration field is in the past as a throttled background task.
+     *  \return The ID of the Elasticsearch task.
+     */
+    std::string expireEntries();
     inline std::unordered_multiset<std::string> getDomains() const { return full_text_cache_urls_.selectAllNonUnique("domain"); }
     bool getDomainFromUrl(const std::string &url, std::string * const domain) const;
     bool getEntry(const std::string &id, Entry * const entry) const;
@@ -92,10 +116,25 @@ public:
     /** \brief Get the number of datasets in full_text_cache table */
     unsigned getSize() const;
 
+    /** \brief Aggregates the current contents of the cache, which is expensive. */
+    Stats computeStats() const;
+
+    /** \brief Stores the results of computeStats() in the full_text_cache_stats index, replacing the previous ones. */
+    void updateStats();
+
+    /** \brief Retrieves the stats stored by the last call to updateStats(), which is cheap.
+     *  \return False if there are no stored stats yet.
+     */
+    bool getStats(Stats * const stats) const;
+
     /* \note If "data" is empty only an entry will be made in the SQL database but not in the key/value store.  Also
      *       either "data" must be non-empty or "error_message" must be non-empty.
+     * \note New entries are buffered and sent to Elasticsearch in bulk, call flush() if they have to be visible right away.
      */
     void insertEntry(const std::string &id, const std::string &full_text, const std::vector<EntryUrl> &entry_urls);
 
+    /** \brief Sends all buffered new entries to Elasticsearch. */
+    inline void flush() { full_text_cache_writer_.flush(); full_text_cache_urls_writer_.flush(); }
+
     bool deleteEntry(const std::string &id);
 };
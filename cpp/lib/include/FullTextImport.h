@@ -23,9 +23,11 @@
 #include <iostream>
 #include <set>
 #include <unordered_set>
+#include <vector>
 #include <cctype>
 #include <cstdlib>
 #include "ControlNumberGuesser.h"
+#include "ControlNumberIndex.h"
 #include "Elasticsearch.h"
 #include "MARC.h"
 #include "StringUtil.h"
@@ -83,4 +85,16 @@ bool CorrelateFullTextData(const ControlNumberGuesser &control_number_guesser, c
                            std::string * const control_number);
 
 
+// \brief Like the above but for many documents at once.  All inputs are normalised up front, the guesser's tables are loaded
+//        into memory and the lookups are then spread over "thread_count" threads, or one per core if "thread_count" is 0.
+// \note  (*control_numbers)[i] holds the matches for full_text_data[i] regardless of the number of threads.
+void CorrelateFullTextData(ControlNumberGuesser * const control_number_guesser, const std::vector<FullTextData> &full_text_data,
+                           std::vector<std::set<std::string>> * const control_numbers, unsigned thread_count = 0);
+
+
+// \brief Like the above but uses a memory-mapped ControlNumberIndex instead of the guesser's tables.
+void CorrelateFullTextData(const ControlNumberIndex &control_number_index, const std::vector<FullTextData> &full_text_data,
+                           std::vector<std::set<std::string>> * const control_numbers, unsigned thread_count = 0);
+
+
 } // namespace FullTextImport
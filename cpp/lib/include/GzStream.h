@@ -27,8 +27,13 @@
 #pragma once
 
 
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <cstdint>
 #include <zlib.h>
 
 
@@ -40,6 +45,9 @@
 #endif
 
 
+class ThreadPool;
+
+
 /** \class  GzStream
  *  \brief  A wrapper around the low-level facilities of zlib.
  */
@@ -120,3 +128,81 @@ private:
     GzStream(const GzStream &rhs);            // Intentionally unimplemented!
     GzStream &operator=(const GzStream &rhs); // Intentionally unimplemented!
 };
+
+
+/** \class  ParallelGzStream
+ *  \brief  Compresses a stream of data on multiple threads.
+ *  \note   Like pigz(1) we split the input into blocks that get deflated independently, each w/ the tail of its
+ *          predecessor as the dictionary so that we lose hardly any compression, and concatenate the results.  The
+ *          output is an ordinary zlib or gzip stream that any decompressor, including GzStream, can handle.
+ *  \note   Typical usage:
+ *          \code{.cpp}
+ *              ParallelGzStream compressor(GzStream::GZIP, [&output](const char * const data, const size_t data_size) {
+ *                                                              output.write(data, data_size); });
+ *              while (ReadChunk(&chunk))
+ *                  compressor.write(chunk);
+ *              compressor.finish();
+ *          \endcode
+ */
+class ParallelGzStream {
+public:
+    typedef std::function<void(const char * const data, const size_t data_size)> OutputFunction;
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 128 * 1024;
+private:
+    struct CompressedBlock {
+        std::string data_;
+        uLong checksum_;
+        size_t uncompressed_size_;
+    };
+
+    const GzStream::Type type_;
+    const OutputFunction output_function_;
+    const int compression_level_;
+    const unsigned thread_count_;
+    const size_t block_size_;
+    std::unique_ptr<ThreadPool> thread_pool_; // Only created once we have more than one block.
+    std::string current_block_, dictionary_;
+    std::deque<std::future<CompressedBlock>> pending_blocks_;
+    uLong checksum_;
+    uint64_t uncompressed_size_;
+    bool header_written_, finished_;
+public:
+    /** \param type               Must be either GzStream::COMPRESS or GzStream::GZIP.
+     *  \param output_function    Will be called w/ the compressed data, in order, on the thread that calls write() or
+     *                            finish().
+     *  \param compression_level  0 to 9 or Z_DEFAULT_COMPRESSION.
+     *  \param thread_count       If 0, we use one thread per core.
+     *  \param block_size         The amount of input that gets compressed by a single task.
+     */
+    ParallelGzStream(const GzStream::Type type, const OutputFunction &output_function, const int compression_level = 9,
+                     const unsigned thread_count = 0, const size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    /** \note Does not call finish(), i.e. unless you did, the output will be truncated. */
+    ~ParallelGzStream();
+
+    void write(const char * const data, const size_t data_size);
+    inline void write(const std::string &data) { write(data.data(), data.size()); }
+
+    /** \brief Compresses what is left, waits for all blocks and emits the stream trailer.  Must be called exactly once. */
+    void finish();
+
+    /** \brief Like GzStream::CompressString() but uses multiple threads for large inputs. */
+    static std::string CompressString(const std::string &input, const GzStream::Type type = GzStream::COMPRESS,
+                                      const int compression_level = 9, const unsigned thread_count = 0);
+private:
+    ParallelGzStream(const ParallelGzStream &rhs) = delete;
+    ParallelGzStream &operator=(const ParallelGzStream &rhs) = delete;
+
+    void writeHeader();
+
+    /** \brief Hands "current_block_" to a worker thread or, if "last_block" is true, compresses it on our thread. */
+    void dispatchCurrentBlock(const bool last_block);
+
+    /** \brief Passes on the oldest pending block. */
+    void emitOldestBlock();
+
+    void emit(const CompressedBlock &block);
+    static CompressedBlock CompressBlock(const GzStream::Type type, const int compression_level, const std::string &block,
+                                         const std::string &dictionary, const bool last_block);
+};
@@ -144,6 +144,12 @@ public:
     inline const std::string getDocumentLocalCharset() const { return document_local_charset_; }
 
     static std::string ChunkTypeToString(const unsigned chunk_type);
+
+    /** \brief Decodes a named or numeric entity, w/o the leading ampersand and the trailing semicolon.
+     *  \param is_utf8  If false, "decoded" will be encoded as MS-ANSI.
+     *  \return False if "entity" is unknown.
+     */
+    static bool DecodeEntity(const std::string &entity, std::string * const decoded, const bool is_utf8 = true);
 protected:
 
     /** A filter for notify().  Allows descendents to modify or suppress some chunks as they are reported to
@@ -155,6 +161,8 @@ private:
     int getChar(bool * const is_entity = nullptr);
     bool endOfStream() const { return end_of_stream_; }
     void ungetChar();
+    void advanceTo(const char * const new_cp);
+    const char *findNextTagStart() const;
     bool parseTag();
     void parseWord();
     void parseText();
@@ -32,25 +32,47 @@
 #include <stdexcept>
 #include <vector>
 #include <ctime>
+#include "StringView.h"
 #include "TimeUtil.h"
 
 
 /** \class  HttpHeader
  *  \brief  Holds and allows access to the information in a HTTP header.
+ *  \note   The header is scanned exactly once.  All fields are kept as offsets into a private copy of the raw header and
+ *          the common fields are indexed so that accessing them requires no further searching.
  */
 class HttpHeader {
-    std::string server_response_;
+public:
+    enum KnownField { DATE, LAST_MODIFIED, CONTENT_LENGTH, CONTENT_TYPE, CONTENT_ENCODING, LOCATION, CONTENT_LANGUAGE, URI,
+                      ETAG, CACHE_CONTROL, PRAGMA, EXPIRES, SERVER, ACCEPT_RANGES, VARY, CONNECTION, KNOWN_FIELD_COUNT };
+private:
+    // We store offsets instead of StringView's so that copies of an instance remain valid.
+    struct Range {
+        size_t offset_, length_;
+    public:
+        Range(): offset_(0), length_(0) { }
+        Range(const size_t offset, const size_t length): offset_(offset), length_(length) { }
+    };
+    struct Field {
+        Range name_, value_;
+    public:
+        Field(const Range &name, const Range &value): name_(name), value_(value) { }
+    };
+
+    std::string buffer_; // The raw header, followed by any values that have been set via setContentType() etc.
+    Range server_response_, status_line_;
+    std::vector<Field> fields_;
+    Range known_field_values_[KNOWN_FIELD_COUNT]; // The first non-empty occurrence of each field.
     unsigned status_code_;
     time_t date_, last_modified_, expires_;
     size_t content_length_;
-    std::string content_type_, content_encoding_, location_, etag_, cache_control_, pragma_, server_, accept_ranges_, vary_, connection_,
-        content_languages_, uri_, status_line_;
+    std::string content_encoding_;
     bool is_valid_;
     std::vector<std::string> cookies_;
 public:
     HttpHeader()
-        : status_code_(0), date_(TimeUtil::BAD_TIME_T), last_modified_(TimeUtil::BAD_TIME_T), expires_(TimeUtil::BAD_TIME_T),
-          content_length_(0), is_valid_(false) { }
+        : known_field_values_(), status_code_(0), date_(TimeUtil::BAD_TIME_T), last_modified_(TimeUtil::BAD_TIME_T),
+          expires_(TimeUtil::BAD_TIME_T), content_length_(0), is_valid_(false) { }
     explicit HttpHeader(const std::string &header);
 
     bool isValid() const { return is_valid_; }
@@ -59,21 +81,34 @@ public:
         if isValid() returns false! */
     std::string toString() const;
 
-    bool isRedirect() const { return status_code_ == 302 and not location_.empty(); }
+    bool isRedirect() const { return status_code_ == 302 and known_field_values_[LOCATION].length_ != 0; }
     inline unsigned getStatusCode() const  __attribute__((pure)) { return status_code_; }
-    std::string getStatusLine() const { return status_line_; }
+    std::string getStatusLine() const { return getView(status_line_).toString(); }
+
+    /** \return The value of the first "known_field" or an empty view if there is no such field.
+     *  \note   The returned view becomes invalid when this instance is destroyed or modified.
+     */
+    inline StringView getFieldValue(const KnownField known_field) const
+        { return getView(known_field_values_[known_field]); }
+
+    /** \return The value of the first field whose name matches "field_name" case-insensitively or an empty view if
+     *          there is no such field.
+     *  \note   The returned view becomes invalid when this instance is destroyed or modified.
+     */
+    StringView getFieldValue(const StringView &field_name) const;
 
     time_t getDate() const { return date_; }
     time_t getLastModified() const { return last_modified_; }
 
-    std::string getContentLanguages() const { return content_languages_; }
-    void setContentLanguages(const std::string &new_content_languages) { content_languages_ = new_content_languages; }
+    std::string getContentLanguages() const { return getFieldValue(CONTENT_LANGUAGE).toString(); }
+    void setContentLanguages(const std::string &new_content_languages)
+        { setKnownFieldValue(CONTENT_LANGUAGE, new_content_languages); }
 
     size_t getContentLength() const { return content_length_; }
     void setContentLength(const size_t new_content_length) { content_length_ = new_content_length; }
 
-    std::string getContentType() const { return content_type_; }
-    void setContentType(const std::string &new_content_type) { content_type_ = new_content_type; }
+    std::string getContentType() const { return getFieldValue(CONTENT_TYPE).toString(); }
+    void setContentType(const std::string &new_content_type) { setKnownFieldValue(CONTENT_TYPE, new_content_type); }
 
     /** Returns the trimmed and lowercase-converted Content-encoding. */
     std::string getContentEncoding() const { return content_encoding_; }
@@ -81,16 +116,16 @@ public:
     /** Sets the Content-encoding to the trimmed and lowercase-converted value of "new_content_encoding." */
     void setContentEncoding(const std::string &new_content_encoding);
 
-    std::string getLocation() const { return location_; }
-    std::string getETag() const { return etag_; }
-    std::string getCacheControl() const { return cache_control_; }
-    std::string getPragma() const { return pragma_; }
+    std::string getLocation() const { return getFieldValue(LOCATION).toString(); }
+    std::string getETag() const { return getFieldValue(ETAG).toString(); }
+    std::string getCacheControl() const { return getFieldValue(CACHE_CONTROL).toString(); }
+    std::string getPragma() const { return getFieldValue(PRAGMA).toString(); }
     time_t getExpires() const { return expires_; }
-    std::string getServer() const { return server_; }
-    std::string getAcceptRanges() const { return accept_ranges_; }
-    std::string getVary() const { return vary_; }
-    std::string getConnection() const { return connection_; }
-    std::string getUri() const { return uri_; }
+    std::string getServer() const { return getFieldValue(SERVER).toString(); }
+    std::string getAcceptRanges() const { return getFieldValue(ACCEPT_RANGES).toString(); }
+    std::string getVary() const { return getFieldValue(VARY).toString(); }
+    std::string getConnection() const { return getFieldValue(CONNECTION).toString(); }
+    std::string getUri() const { return getFieldValue(URI).toString(); }
 
     bool dateIsValid() const { return date_ != TimeUtil::BAD_TIME_T; }
     bool lastModifiedIsValid() const { return last_modified_ != TimeUtil::BAD_TIME_T; }
@@ -102,7 +137,7 @@ public:
 
     /** \brief   Get the charset of the associated body from the Content-Type header.
      *  \return  The charset, or an empty string if none can be determined. */
-    std::string getCharset() const { return GetCharsetFromContentType(content_type_); }
+    std::string getCharset() const { return GetCharsetFromContentType(getContentType()); }
 
     const std::vector<std::string> &getCookies() const { return cookies_; }
 
@@ -127,6 +162,9 @@ public:
     static std::string GetLanguagePrimarySubtag(const std::string &language_tag);
 
     static std::string GetCharsetFromContentType(const std::string &content_type);
+private:
+    inline StringView getView(const Range &range) const { return StringView(buffer_.data() + range.offset_, range.length_); }
+    void setKnownFieldValue(const KnownField known_field, const std::string &new_value);
 };
 
 
@@ -258,6 +258,7 @@ protected:
         explicit IncludeFileInfo(const std::string &filename): filename_(filename), current_lineno_(0) { }
     };
     std::stack<IncludeFileInfo> include_file_infos_;
+    std::vector<std::string> consulted_files_;
 
     bool ignore_failed_includes_;
 public:
@@ -302,6 +303,12 @@ public:
      */
     std::string getFilename() const { return ini_file_name_; }
 
+    /** \return The paths of all files whose presence or contents determined what we parsed, i.e. the main file, all
+     *          included files and the host-specific overrides that we looked for, whether they exist or not.
+     *  \note   FrozenIniFile uses this to decide whether a cached copy is still up to date.
+     */
+    inline const std::vector<std::string> &getConsultedFiles() const { return consulted_files_; }
+
     bool lookup(const std::string &section_name, const std::string &variable_name, std::string * const s) const;
 
     /** \brief   Retrieves an integer value from a configuration file.
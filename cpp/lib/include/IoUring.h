@@ -0,0 +1,88 @@
+/** \brief A minimal wrapper around the Linux io_uring interface for asynchronous reads and writes.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+/** \class IoUring
+ *  \brief Submission and completion queues for asynchronous reads and writes w/o a dependency on liburing.
+ *  \note  An instance must not be shared between threads w/o external locking.
+ */
+class IoUring {
+    int ring_fd_;
+    unsigned entries_;
+    void *sq_ring_, *cq_ring_;
+    size_t sq_ring_size_, cq_ring_size_;
+    unsigned *sq_head_, *sq_tail_, *sq_ring_mask_, *sq_array_;
+    io_uring_sqe *sqes_;
+    size_t sqes_size_;
+    unsigned *cq_head_, *cq_tail_, *cq_ring_mask_;
+    io_uring_cqe *cqes_;
+    unsigned unsubmitted_count_, in_flight_count_;
+public:
+    /** \brief Sets up queues for up to "entries" simultaneous requests.
+     *  \note  Throws a std::runtime_error if io_uring is unavailable, e.g. on kernels older than 5.6 or when it has been
+     *         disabled by the administrator.  Use IsAvailable() if you want to fall back to synchronous I/O instead.
+     */
+    explicit IoUring(const unsigned entries);
+
+    ~IoUring();
+
+    /** \return True if the running kernel lets us use io_uring for reads and writes. */
+    static bool IsAvailable();
+
+    inline unsigned getInFlightCount() const { return in_flight_count_ + unsubmitted_count_; }
+
+    /** \brief Queues a read of up to "count" bytes at "offset" into "buffer".  An offset of -1 means the current file
+     *         position, which is what you want for pipes and sockets.
+     *  \note  Requests are only handed to the kernel by the next call to submit() or getCompletion().
+     */
+    void prepareRead(const int fd, void * const buffer, const unsigned count, const off_t offset, const uint64_t user_data);
+
+    /** \brief Like prepareRead() but for writes. */
+    void prepareWrite(const int fd, const void * const buffer, const unsigned count, const off_t offset,
+                      const uint64_t user_data);
+
+    /** \brief Hands all prepared requests to the kernel. */
+    void submit();
+
+    /** \brief Retrieves one completion.
+     *  \param user_data  The value that was passed to prepareRead() or prepareWrite().
+     *  \param result     The return value of the corresponding read(2) or write(2), i.e. a negated errno on failure.
+     *  \param wait       If true, we block until a completion is available.
+     *  \return False if "wait" was false and no completion was available.
+     *  \note  Also submits all prepared requests.
+     */
+    bool getCompletion(uint64_t * const user_data, int * const result, const bool wait = true);
+private:
+    IoUring(const IoUring &rhs) = delete;
+    IoUring &operator=(const IoUring &rhs) = delete;
+
+    io_uring_sqe *getSubmissionQueueEntry();
+    void unmapRings();
+    int enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags);
+};
@@ -20,15 +20,22 @@
 #pragma once
 
 
+#include <functional>
 #include <string>
 #include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
 #include <cinttypes>
+#include <cstdio>
+#include "StringView.h"
 #include "util.h"
 
 
+// Forward declaration:
+class File;
+
+
 namespace JSON {
 
 
@@ -342,8 +349,14 @@ public:
 
 
 class Parser {
+public:
+    typedef std::function<bool(const std::shared_ptr<JSONNode> &element)> ElementHandler;
+private:
     Scanner scanner_;
     std::string error_message_;
+    std::string streamed_array_path_;
+    ElementHandler element_handler_;
+    std::string current_path_; // Only maintained if we have an "element_handler_".
 public:
     explicit Parser(const std::string &json_document): scanner_(json_document) { }
 
@@ -355,6 +368,16 @@ public:
     //  ...
     bool parse(std::shared_ptr<JSONNode> * const tree_root);
 
+    /** \brief  Like parse() but hands each element of the array at "array_path" to "element_handler" as soon as it
+     *          has been parsed, instead of storing it in the tree, where that array will therefore be empty.
+     *  \param  array_path  A path of the form /X/Y/Z as used by LookupString().  Array components are not supported.
+     *  \return False if a parse error occurred or if "element_handler" returned false, o/w true.
+     *  \note   Useful to process big arrays, e.g. search results, one element at a time w/o ever holding on to all
+     *          of their trees.
+     */
+    bool parse(std::shared_ptr<JSONNode> * const tree_root, const std::string &array_path,
+               const ElementHandler &element_handler);
+
     const std::string &getErrorMessage() const { return error_message_; }
 private:
     bool parseObject(std::shared_ptr<JSONNode> * const new_object_node);
@@ -363,6 +386,349 @@ private:
 };
 
 
+/** \class PullReader
+ *  \brief A streaming JSON reader that hands out its input one event at a time instead of building a tree.
+ *  \note  Only a bounded buffer of the input is held in memory, unless the input is a string or a memory-mapped file.
+ *  \note  The input may consist of a sequence of top-level values, e.g. JSON Lines.
+ *  \note  Typical use, materialising only the elements of a big array:
+ *
+ *          JSON::PullReader reader(json_document);
+ *          JSON::PullReader::EventType event;
+ *          while ((event = reader.next()) != JSON::PullReader::END_OF_INPUT) {
+ *              if (event == JSON::PullReader::ERROR)
+ *                  LOG_ERROR(reader.getErrorMessage());
+ *              if (event == JSON::PullReader::START_OBJECT and reader.getPath().compare(0, 11, "/hits/hits/") == 0) {
+ *                  std::shared_ptr<JSON::JSONNode> hit;
+ *                  if (not reader.readValue(&hit))
+ *                      LOG_ERROR(reader.getErrorMessage());
+ *                  ...
+ *              }
+ *          }
+ */
+class PullReader {
+public:
+    enum EventType { START_OBJECT, END_OBJECT, START_ARRAY, END_ARRAY, KEY, STRING_VALUE, INTEGER_VALUE, DOUBLE_VALUE,
+                     BOOLEAN_VALUE, NULL_VALUE, END_OF_INPUT, ERROR };
+
+    /** \brief Stores up to "buffer_size" bytes in "buffer".
+     *  \return The number of stored bytes or 0 at the end of the input.
+     */
+    typedef std::function<size_t(char * const buffer, const size_t buffer_size)> InputFunction;
+
+    static constexpr size_t BUFFER_SIZE = 65536;
+private:
+    enum State { EXPECT_KEY_OR_END, EXPECT_KEY, EXPECT_VALUE_OR_END, EXPECT_VALUE, EXPECT_COMMA_OR_END };
+    struct Container {
+        bool is_object_;
+        State state_;
+        size_t element_count_; // Only used for arrays.
+        std::string key_;      // Only used for objects, the key of the current member.
+    public:
+        explicit Container(const bool is_object)
+            : is_object_(is_object), state_(is_object ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END), element_count_(0) { }
+    };
+
+    InputFunction input_function_;
+    std::string buffer_;
+    const char *ch_, *end_;
+    void *mmap_;
+    size_t mmap_size_;
+    unsigned line_no_;
+    std::vector<Container> containers_;
+    EventType last_event_;
+    std::string string_value_;
+    int64_t integer_value_;
+    double double_value_;
+    bool boolean_value_;
+    std::string error_message_;
+public:
+    explicit PullReader(const InputFunction &input_function);
+
+    /** \note "json_document" is not copied and must outlive the reader. */
+    explicit PullReader(const std::string &json_document);
+
+    /** \brief Reads "path" via a read-only memory mapping. */
+    static std::unique_ptr<PullReader> FromFile(const std::string &path);
+
+    ~PullReader();
+
+    /** \return The next event.  END_OF_INPUT and ERROR are sticky. */
+    EventType next();
+
+    inline EventType getLastEvent() const { return last_event_; }
+
+    /** \return The key for KEY events and the value for STRING_VALUE events. */
+    inline const std::string &getString() const { return string_value_; }
+
+    inline int64_t getInteger() const { return integer_value_; }
+    inline double getDouble() const { return double_value_; }
+    inline bool getBoolean() const { return boolean_value_; }
+
+    /** \return The JSON pointer (RFC 6901) of the last value, e.g. "/hits/hits/3".  For KEY events it is the path of the
+     *          value that follows and for END_OBJECT/END_ARRAY events that of the closed container.
+     */
+    std::string getPath() const;
+
+    /** \return True if getPath() matches "pattern", a JSON pointer where "*" components match any single component. */
+    bool pathMatches(const std::string &pattern) const;
+
+    /** \return The number of containers that we are currently in. */
+    inline size_t getDepth() const { return containers_.size(); }
+
+    /** \brief Builds a tree for the value that started w/ the last event.
+     *  \note  Afterwards the last event will be the END_OBJECT or END_ARRAY event of the value, unless it was a scalar.
+     */
+    bool readValue(std::shared_ptr<JSONNode> * const value);
+
+    /** \brief Like readValue() but discards the value. */
+    bool skipValue();
+
+    inline const std::string &getErrorMessage() const { return error_message_; }
+    inline unsigned getLineNumber() const { return line_no_; }
+private:
+    PullReader(const PullReader &rhs) = delete;
+    PullReader &operator=(const PullReader &rhs) = delete;
+
+    bool fillBuffer();
+    inline int peekChar() { return (ch_ != end_ or fillBuffer()) ? static_cast<unsigned char>(*ch_) : EOF; }
+    inline int getChar() {
+        const int ch(peekChar());
+        if (ch != EOF) {
+            ++ch_;
+            if (ch == '\n')
+                ++line_no_;
+        }
+        return ch;
+    }
+    void skipWhite();
+    EventType error(const std::string &error_message);
+    EventType parseValue();
+    EventType parseKey();
+    bool parseString(std::string * const s);
+    bool parseUTF16Escape(std::string * const utf8);
+    EventType parseNumber();
+    EventType expectSequence(const std::string &sequence, const EventType success_event);
+};
+
+
+/** \class Document
+ *  \brief A read-only alternative to the JSONNode trees for large or frequently parsed documents.
+ *  \note  All values live in an arena owned by the document and strings w/o escapes point directly into the (copied) input,
+ *         so parsing only needs a handful of allocations and no reference counting.  Values, and views returned by them,
+ *         are valid for as long as the document exists and has not been reparsed.
+ *  \note  The members of objects w/ more than LINEAR_SEARCH_LIMIT members are sorted by key so that find() can use a
+ *         binary search.  Smaller objects keep the document order.  For duplicate keys find() returns the first one.
+ *  \note  Typical use:
+ *
+ *          JSON::Document document;
+ *          if (not document.parse(json_text))
+ *              LOG_ERROR(document.getErrorMessage());
+ *          const JSON::Document::Value * const hits(document.getRoot().lookup("/hits/hits"));
+ *          if (hits != nullptr) {
+ *              for (size_t i(0); i < hits->size(); ++i)
+ *                  ... (*hits)[i].find("_id") ...
+ *          }
+ */
+class Document {
+public:
+    enum Type { NULL_TYPE, BOOLEAN_TYPE, INTEGER_TYPE, DOUBLE_TYPE, STRING_TYPE, ARRAY_TYPE, OBJECT_TYPE };
+
+    static constexpr size_t LINEAR_SEARCH_LIMIT = 16;
+    static constexpr size_t MAX_NESTING_DEPTH   = 1000;
+
+    struct Member;
+
+    class Value {
+        friend class Document;
+        Type type_;
+        size_t size_; // Length of strings and the number of array elements or object members.
+        union {
+            bool boolean_;
+            int64_t integer_;
+            double double_;
+            const char *string_;
+            const Value *elements_;
+            const Member *members_;
+        };
+    public:
+        Value(): type_(NULL_TYPE), size_(0), integer_(0) { }
+
+        inline Type getType() const { return type_; }
+        inline bool isNull() const { return type_ == NULL_TYPE; }
+        inline bool isString() const { return type_ == STRING_TYPE; }
+        inline bool isArray() const { return type_ == ARRAY_TYPE; }
+        inline bool isObject() const { return type_ == OBJECT_TYPE; }
+
+        // The following getters abort if the value has a different type.
+        bool getBoolean() const;
+        int64_t getInteger() const;
+        double getDouble() const; // Also accepts integers.
+        StringView getString() const;
+
+        /** \return The number of elements or members of arrays and objects, and 0 for all other types. */
+        inline size_t size() const { return (type_ == ARRAY_TYPE or type_ == OBJECT_TYPE) ? size_ : 0; }
+
+        /** \brief Array element access.  Aborts if this is not an array or "index" is out of range. */
+        const Value &operator[](const size_t index) const;
+
+        /** \brief Object member access in document order, unless the object has been sorted (see above).
+         *         Aborts if this is not an object or "index" is out of range.
+         */
+        const Member &getMember(const size_t index) const;
+
+        /** \return The member value for "key" or nullptr if this is not an object or has no such member. */
+        const Value *find(const StringView &key) const;
+
+        /** \return The string value of member "key" or "default_value" if there is no such member or it is not a string. */
+        std::string getOptionalString(const StringView &key, const std::string &default_value = "") const;
+
+        /** \param path  A JSON pointer (RFC 6901), e.g. "/hits/hits/0/_id".
+         *  \return The addressed value or nullptr if it does not exist.
+         */
+        const Value *lookup(const std::string &path) const;
+
+        /** \return The value serialised as compact JSON. */
+        std::string toString() const;
+
+        /** \brief Converts the value to a conventional tree, e.g. to pass it to code that expects JSONNode's. */
+        std::shared_ptr<JSONNode> toJSONNode() const;
+    };
+
+    struct Member {
+        StringView key_;
+        Value value_;
+    };
+private:
+    class Arena {
+        static constexpr size_t BLOCK_SIZE = 65536;
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        char *next_;
+        size_t remaining_;
+    public:
+        Arena(): next_(nullptr), remaining_(0) { }
+        void *allocate(size_t size);
+        void clear() { blocks_.clear(); next_ = nullptr; remaining_ = 0; }
+    };
+
+    std::string json_document_;
+    Arena arena_;
+    Value root_;
+    std::string error_message_;
+    const char *ch_, *end_;
+    unsigned line_no_, depth_;
+    std::vector<Value> element_stack_; // Scratch space for the elements of the arrays that are currently being parsed.
+    std::vector<Member> member_stack_; // Scratch space for the members of the objects that are currently being parsed.
+public:
+    Document(): ch_(nullptr), end_(nullptr), line_no_(1), depth_(0) { }
+
+    /** \note "json_document" is moved into the document, pass an rvalue to avoid the copy. */
+    explicit Document(std::string json_document);
+
+    /** \brief Replaces the current contents of the document.
+     *  \return False if "json_document" is not valid JSON, in which case the root will be a null value.
+     */
+    bool parse(std::string json_document);
+
+    inline const Value &getRoot() const { return root_; }
+    inline const std::string &getErrorMessage() const { return error_message_; }
+private:
+    Document(const Document &rhs) = delete;
+    Document &operator=(const Document &rhs) = delete;
+
+    bool error(const std::string &error_message);
+    void skipWhite();
+    bool parseValue(Value * const value);
+    bool parseObject(Value * const value);
+    bool parseArray(Value * const value);
+    bool parseString(StringView * const s);
+    bool parseUTF16Escape(std::string * const utf8);
+    bool parseNumber(Value * const value);
+    bool parseLiteral(const char * const literal, const size_t literal_length);
+};
+
+
+/** \class Writer
+ *  \brief Serialises JSON directly into a string or a File, w/o building a tree first.
+ *  \note  Typical use, producing {"id":"abc","tags":["x","y"]}:
+ *
+ *          std::string json;
+ *          JSON::Writer writer(&json);
+ *          writer.beginObject();
+ *          writer.key("id").stringValue("abc");
+ *          writer.key("tags").beginArray().stringValue("x").stringValue("y").endArray();
+ *          writer.endObject();
+ *
+ *  \note  Commas are inserted automatically.  Structural mistakes, like a value w/o a key inside of an object, abort.
+ */
+class Writer {
+public:
+    enum Style { COMPACT, PRETTY };
+
+    // When writing to a File, output is buffered up to this size.
+    static constexpr size_t FILE_BUFFER_SIZE = 65536;
+private:
+    struct Container {
+        bool is_object_;
+        size_t entry_count_;
+    public:
+        explicit Container(const bool is_object): is_object_(is_object), entry_count_(0) { }
+    };
+
+    std::string *output_;
+    File *output_file_;
+    std::string file_buffer_;
+    const Style style_;
+    std::vector<Container> containers_;
+    bool after_key_;
+public:
+    /** \note Output will be appended to "*output". */
+    explicit Writer(std::string * const output, const Style style = COMPACT);
+
+    /** \note Output is buffered until flush() is called, the buffer is full or the writer is destroyed. */
+    explicit Writer(File * const output, const Style style = COMPACT);
+
+    ~Writer() { flush(); }
+
+    Writer &beginObject();
+    Writer &endObject();
+    Writer &beginArray();
+    Writer &endArray();
+
+    Writer &key(const StringView &key);
+
+    Writer &stringValue(const StringView &value);
+    Writer &integerValue(const int64_t value);
+    Writer &doubleValue(const double value);
+    Writer &booleanValue(const bool value);
+    Writer &nullValue();
+
+    /** \brief Writes "node" and all of its descendants. */
+    Writer &nodeValue(const JSONNode &node);
+
+    /** \brief Writes "json", which must be a valid JSON value, e.g. the result of an earlier serialisation, verbatim. */
+    Writer &rawValue(const StringView &json);
+
+    /** \brief Convenience function for the most common case of an object member w/ a string value. */
+    inline Writer &stringMember(const StringView &key, const StringView &value) { return this->key(key).stringValue(value); }
+
+    /** \return The number of containers that have not been closed yet. */
+    inline size_t getDepth() const { return containers_.size(); }
+
+    /** \brief Writes any buffered output to the File.  A no-op when writing to a string. */
+    void flush();
+private:
+    Writer(const Writer &rhs) = delete;
+    Writer &operator=(const Writer &rhs) = delete;
+
+    void beginValue();
+    void newLineAndIndent();
+    inline void flushIfFull() {
+        if (output_file_ != nullptr and file_buffer_.size() >= FILE_BUFFER_SIZE)
+            flush();
+    }
+};
+
+
 std::string TokenTypeToString(const TokenType token);
 
 
@@ -432,6 +798,10 @@ int64_t LookupInteger(const std::string &path, const std::shared_ptr<const JSONN
 std::string EscapeString(const std::string &unescaped_string);
 
 
+// Like EscapeString() but appends the escaped version of "unescaped_string" to "*escaped_string".
+void AppendEscapedString(const StringView &unescaped_string, std::string * const escaped_string);
+
+
 bool IsValidUTF8(const JSONNode &node);
 
 
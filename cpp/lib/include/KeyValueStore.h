@@ -0,0 +1,172 @@
+/** \file   KeyValueStore.h
+ *  \brief  A memory-mapped, transactional key/value store based on LMDB.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+
+#include <string>
+#include <lmdb.h>
+#include "StringView.h"
+
+
+/** \class KeyValueStore
+ *  \brief Maps binary keys to binary values.  Keys are kept in sorted order.
+ *  \note  The whole store lives in a single memory-mapped file, so that lookups of recently used entries are plain memory reads.
+ *         Any number of threads and processes may read concurrently w/ a single writer.  Readers see a consistent snapshot as of
+ *         the beginning of their transaction.
+ *  \note  LMDB creates a lock file, "path" + "-lock", next to the store.
+ */
+class KeyValueStore {
+public:
+    enum OpenMode { READ_ONLY, READ_WRITE, CREATE };
+
+    // This is the size of the address space that we reserve, not the size of the file on disk.
+    static constexpr size_t DEFAULT_MAP_SIZE = static_cast<size_t>(64) << 30u; // 64 GiB
+
+    struct Stats {
+        size_t entry_count_;
+        size_t page_size_;
+        size_t depth_; // Of the B+ tree.
+        size_t used_page_count_;
+        size_t map_size_;
+        unsigned max_reader_count_, reader_count_;
+    };
+
+    class Cursor;
+
+    /** \brief Base class for read and write transactions.
+     *  \note  A transaction must only be used by one thread at a time, but it does not have to be the thread that created it.
+     */
+    class Transaction {
+        friend class Cursor;
+        friend class KeyValueStore;
+    protected:
+        const KeyValueStore &store_;
+        MDB_txn *txn_;
+    public:
+        virtual ~Transaction();
+
+        /** \brief Zero-copy lookup.
+         *  \note  "value" points into the memory map and stays valid until this transaction ends or, for write transactions,
+         *         until the next modification.
+         */
+        bool get(const std::string &key, StringView * const value) const;
+
+        bool get(const std::string &key, std::string * const value) const;
+        bool contains(const std::string &key) const;
+    protected:
+        Transaction(const KeyValueStore &store, const bool read_only);
+    private:
+        Transaction(const Transaction &rhs) = delete;
+        Transaction &operator=(const Transaction &rhs) = delete;
+    };
+
+    class ReadTransaction final : public Transaction {
+    public:
+        explicit ReadTransaction(const KeyValueStore &store): Transaction(store, /* read_only = */true) { }
+    };
+
+    /** \brief Groups modifications.  Nothing becomes visible to other transactions until commit() has been called.
+     *  \note  Only one write transaction can exist at any time, across all processes.  Constructing a second one blocks.
+     *  \note  The destructor discards uncommitted changes.
+     */
+    class WriteTransaction final : public Transaction {
+    public:
+        explicit WriteTransaction(KeyValueStore * const store);
+
+        void put(const std::string &key, const std::string &value);
+
+        /** \return False if "key" already existed, in which case its value is left unchanged. */
+        bool add(const std::string &key, const std::string &value);
+
+        /** \return False if "key" did not exist. */
+        bool remove(const std::string &key);
+
+        /** \brief Deletes all entries. */
+        void clear();
+
+        /** \note The transaction can't be used anymore after this. */
+        void commit();
+    };
+
+    /** \brief Iterates over the entries of a transaction in key order.
+     *  \note  Use like this:
+     *             KeyValueStore::Cursor cursor(transaction);
+     *             StringView key, value;
+     *             while (cursor.next(&key, &value))
+     *                 ...
+     *  \note  The views point into the memory map and have the same lifetime as those returned by Transaction::get().
+     */
+    class Cursor {
+        MDB_cursor *cursor_;
+        MDB_cursor_op next_op_;
+        bool at_end_;
+    public:
+        explicit Cursor(const Transaction &transaction);
+        ~Cursor();
+
+        /** \brief Positions the cursor so that the next call to next() returns the first entry w/ a key >= "key".
+         *  \return False if there is no such entry.
+         */
+        bool seek(const std::string &key);
+
+        bool next(StringView * const key, StringView * const value);
+    private:
+        Cursor(const Cursor &rhs) = delete;
+        Cursor &operator=(const Cursor &rhs) = delete;
+    };
+private:
+    std::string path_;
+    OpenMode open_mode_;
+    MDB_env *env_;
+    MDB_dbi dbi_;
+public:
+    /** \param map_size  The upper limit for the size of the store.  Readers may pass a smaller size.
+     *  \note  READ_ONLY stores disable read-ahead which speeds up random lookups in stores that are larger than RAM.
+     */
+    explicit KeyValueStore(const std::string &path, const OpenMode open_mode = READ_ONLY, const size_t map_size = DEFAULT_MAP_SIZE);
+    ~KeyValueStore();
+
+    inline const std::string &getPath() const { return path_; }
+    inline bool isReadOnly() const { return open_mode_ == READ_ONLY; }
+
+    // Convenience functions that each run in a transaction of their own.  Use explicit transactions for batches.
+    bool get(const std::string &key, std::string * const value) const;
+    bool contains(const std::string &key) const;
+    void put(const std::string &key, const std::string &value);
+    bool add(const std::string &key, const std::string &value);
+    bool remove(const std::string &key);
+
+    size_t size() const;
+    Stats getStats() const;
+
+    /** \brief Copies all entries of the Kyotocabinet hash database "kcdb_path" to "store", overwriting entries w/ the same keys.
+     *  \return The number of copied entries.
+     */
+    static size_t ImportKyotoCabinetDB(const std::string &kcdb_path, KeyValueStore * const store);
+
+    /** \brief Creates the store "path" from the Kyotocabinet hash database "kcdb_path" that it replaces, unless "path" already
+     *         exists or "kcdb_path" doesn't.  The Kyotocabinet database is left alone.
+     *  \return True if we migrated the database, else false.
+     */
+    static bool MigrateFromKyotoCabinetDB(const std::string &kcdb_path, const std::string &path);
+private:
+    KeyValueStore(const KeyValueStore &rhs) = delete;
+    KeyValueStore &operator=(const KeyValueStore &rhs) = delete;
+};
@@ -20,6 +20,7 @@
 
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -31,8 +32,21 @@ namespace LobidUtil {
  *  \see   - http://lobid.org/gnd/api
  *         - http://lobid.org/organisations/api/de
  *         - http://lobid.org/resources/api
+ *  \note  Lookup results are cached in memory and, for CACHE_TTL seconds, in an SQLite database under the tuelib
+ *         directory, so that repeated lookups neither cost us a round trip nor count against Lobid's rate limits.
  */
+constexpr unsigned CACHE_TTL(7 * 86400); // in seconds
+
+
 std::string GetAuthorGNDNumber(const std::string &author, const std::string &additional_query_params="");
+
+
+/** \brief  Like GetAuthorGNDNumber() but for many authors at once.
+ *  \return A map from the authors to their GND numbers.  Authors w/o a unique match are not in the map.
+ *  \note   Lookups that are not cached yet will be sent to Lobid concurrently.
+ */
+std::unordered_map<std::string, std::string> GetAuthorGNDNumbers(const std::vector<std::string> &authors,
+                                                                 const std::string &additional_query_params="");
 std::vector<std::string> GetAuthorProfessions(const std::string &author, const std::string &additional_query_params="");
 std::string GetOrganisationISIL(const std::string &organisation, const std::string &additional_query_params="");
 std::string GetTitleDOI(const std::string &title, const std::string &additional_query_params="");
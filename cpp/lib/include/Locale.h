@@ -60,3 +60,23 @@ public:
      */
     static std::string GetLocaleName(const int category = LC_CTYPE);
 };
+
+
+/** \class Collator
+ *  \brief Turns strings into sort keys that, when compared bytewise, order the strings like strcoll(3) would in a given
+ *         locale.
+ *  \note  Unlike Locale, this never changes the global locale and is therefore safe to use from multiple threads.
+ */
+class Collator {
+    locale_t locale_;
+public:
+    /** \note Throws an exception if "locale_name", e.g. "de_DE.UTF-8", is not installed. */
+    explicit Collator(const std::string &locale_name);
+    ~Collator() { ::freelocale(locale_); }
+
+    /** \return A key that can be compared w/ memcmp(3) and therefore be computed once instead of on every comparison. */
+    std::string getSortKey(const std::string &s) const;
+private:
+    Collator(const Collator &) = delete;
+    Collator &operator=(const Collator &) = delete;
+};
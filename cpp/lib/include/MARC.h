@@ -30,12 +30,15 @@
 #include <arpa/inet.h>
 #include "Compiler.h"
 #include "File.h"
+#include "MarcIOStatistics.h"
 #include "MarcXmlWriter.h"
+#include "StringView.h"
 #include "XMLSubsetParser.h"
 
 
-// Forward declaration:
+// Forward declarations:
 class RegexMatcher;
+class ShmRing;
 
 
 namespace MARC {
@@ -271,6 +274,64 @@ public:
 };
 
 
+/** \class SubfieldIterator
+ *  \brief Walks the subfields of the raw contents of a variable field in place, i.e. w/o copying or allocating anything.
+ *  \note  Dereferencing yields (subfield code, subfield value) pairs.  The values reference the field contents and are only
+ *         valid as long as those contents don't change.
+ */
+class SubfieldIterator {
+    const char *subfield_start_; // Points at the delimiter of the current subfield or equals end_.
+    const char *value_end_;
+    const char *end_;
+public:
+    typedef std::pair<char, StringView> CodeAndValue;
+public:
+    /** \param contents_start  Where the field contents, starting w/ the two indicators, begin.
+     *  \param contents_end    One past the last character of the field contents.
+     */
+    inline SubfieldIterator(const char * const contents_start, const char * const contents_end)
+        : subfield_start_(contents_start), value_end_(contents_start), end_(contents_end)
+    {
+        if (contents_end - contents_start > 2 /* indicators */)
+            subfield_start_ = FindDelimiter(contents_start + 2, contents_end);
+        else
+            subfield_start_ = contents_end;
+        locateValueEnd();
+    }
+
+    inline char getCode() const { return subfield_start_[1]; }
+    inline StringView getValue() const { return StringView(subfield_start_ + 2, value_end_ - (subfield_start_ + 2)); }
+    inline CodeAndValue operator*() const { return CodeAndValue(getCode(), getValue()); }
+    inline SubfieldIterator &operator++() { subfield_start_ = value_end_; locateValueEnd(); return *this; }
+    inline bool operator==(const SubfieldIterator &rhs) const { return subfield_start_ == rhs.subfield_start_; }
+    inline bool operator!=(const SubfieldIterator &rhs) const { return subfield_start_ != rhs.subfield_start_; }
+private:
+    static inline const char *FindDelimiter(const char * const start, const char * const end) {
+        const void * const delimiter(std::memchr(start, '\x1F', end - start));
+        return (delimiter == nullptr) ? end : reinterpret_cast<const char *>(delimiter);
+    }
+
+    inline void locateValueEnd() {
+        if (subfield_start_ + 1 >= end_) { // A trailing delimiter w/o a subfield code is not a subfield.
+            subfield_start_ = value_end_ = end_;
+            return;
+        }
+        value_end_ = FindDelimiter(subfield_start_ + 2, end_);
+    }
+};
+
+
+/** \brief A range of subfields that can be used in a for-each loop.  See SubfieldIterator for details. */
+class SubfieldRange {
+    SubfieldIterator begin_, end_;
+public:
+    explicit SubfieldRange(const StringView &field_contents)
+        : begin_(field_contents.begin(), field_contents.end()), end_(field_contents.end(), field_contents.end()) { }
+    inline SubfieldIterator begin() const { return begin_; }
+    inline SubfieldIterator end() const { return end_; }
+};
+
+
 enum EditInstructionType { INSERT_FIELD, INSERT_SUBFIELD, ADD_SUBFIELD };
 
 
@@ -307,6 +368,7 @@ public:
         std::string contents_;
     public:
         Field(const Field &other): tag_(other.tag_), contents_(other.contents_) { }
+        Field(Field &&other) = default;
         Field(const std::string &tag, const std::string &contents): tag_(tag), contents_(contents) { }
         Field(const Tag &tag, const std::string &contents): tag_(tag), contents_(contents) { }
         Field(const Tag &tag, const char indicator1 = ' ', const char indicator2 = ' ')
@@ -314,10 +376,16 @@ public:
         Field(const Tag &tag, const Subfields &subfields, const char indicator1 = ' ', const char indicator2 = ' ')
             : Field(tag, std::string(1, indicator1) + std::string(1, indicator2) + subfields.toString()) { }
         Field &operator=(const Field &rhs) = default;
+        Field &operator=(Field &&rhs) = default;
         inline bool operator==(const Field &rhs) const { return tag_ == rhs.tag_ and contents_ == rhs.contents_; }
         inline bool operator!=(const Field &rhs) const { return not operator==(rhs); }
         bool operator<(const Field &rhs) const;
         inline const Tag &getTag() const { return tag_; }
+
+        /** \warning Records keep their fields sorted by tag.  If you change the tag of a field that is part of a Record,
+         *           you must restore that order, e.g. by calling Record::sortFieldTags(), before using any of the
+         *           Record's tag lookup functions.
+         */
         inline void setTag(const Tag &new_tag) { tag_ = new_tag; }
         inline const std::string &getContents() const { return contents_; }
         inline std::string getContents() { return contents_; }
@@ -330,6 +398,30 @@ public:
         inline char getIndicator1() const { return unlikely(contents_.empty()) ? '\0' : contents_[0]; }
         inline char getIndicator2() const { return unlikely(contents_.size() < 2) ? '\0' : contents_[1]; }
         inline Subfields getSubfields() const { return Subfields(contents_); }
+
+        /** \brief Allocation-free alternative to getSubfields() for read-only access.
+         *  \remark {
+         *     Typical usage looks like this:<br />
+         *     \code{.cpp}
+         *         for (const auto &code_and_value : field.getSubfieldRange()) {
+         *             if (code_and_value.first == 'a')
+         *                 DoSomething(code_and_value.second);
+         *         }
+         *     \endcode
+         *  }
+         *  \warning Do not call this on control fields!
+         */
+        inline SubfieldRange getSubfieldRange() const { return SubfieldRange(contents_); }
+
+        /** \brief Calls "callback" w/ the code and the value, a StringView, of each subfield.
+         *  \note  If "callback" returns false, we stop iterating.
+         */
+        template<typename Callback> inline void forEachSubfield(Callback callback) const {
+            for (const auto &code_and_value : getSubfieldRange()) {
+                if (not callback(code_and_value.first, code_and_value.second))
+                    return;
+            }
+        }
         inline void setSubfields(const Subfields &subfields) {
             setContents(subfields, getIndicator1(), getIndicator2());
         }
@@ -348,6 +440,12 @@ public:
         bool hasSubfield(const char subfield_code) const;
         bool hasSubfieldWithValue(const char subfield_code, const std::string &value) const;
 
+        /** \brief Extracts all values from subfields with codes in the "list" of codes in "subfield_codes". */
+        std::vector<std::string> extractSubfields(const std::string &subfield_codes) const;
+
+        /** \brief Extracts all values from subfields with a matching subfield code. */
+        std::vector<std::string> extractSubfields(const char subfield_code) const;
+
         /** \param value  Where to store the extracted data, if we have a match.
          *  \return True, if a subfield with subfield code "subfield_code" matching "regex" exists, else false.
          */
@@ -439,10 +537,11 @@ private:
     friend class BinaryWriter;
     friend class XmlWriter;
     friend std::string CalcChecksum(const Record &record, const std::set<Tag> &excluded_fields, const bool suppress_local_fields);
+    friend uint64_t CalcFastChecksum(const Record &record, const std::set<Tag> &excluded_fields, const bool suppress_local_fields);
     friend bool UBTueIsElectronicResource(const Record &marc_record);
     size_t record_size_; // in bytes
     std::string leader_;
-    std::vector<Field> fields_;
+    std::vector<Field> fields_; // Always sorted by tag, which allows us to use binary searches for tag lookups.
 public:
     static constexpr unsigned MAX_RECORD_LENGTH                        = 99999;
     static constexpr unsigned MAX_VARIABLE_FIELD_DATA_LENGTH           = 9998; // Max length without trailing terminator
@@ -455,6 +554,13 @@ private:
 public:
     explicit Record(const std::string &leader); // Make an empty record that only has a leader.
     explicit Record(const size_t record_size, const char * const record_start);
+
+    /** \brief Like the constructor with the same arguments but reuses our existing field storage.
+     *  \param projected_tags  If not nullptr, a sorted list of tags.  Only fields w/ these tags will be decoded.
+     */
+    void assign(const size_t record_size, const char * const record_start,
+                const std::vector<Tag> * const projected_tags = nullptr);
+
     Record(const TypeOfRecord type_of_record, const BibliographicLevel bibliographic_level,
            const std::string &control_number = "");
     Record(const Record &other) = default;
@@ -536,16 +642,10 @@ public:
     bool getKeywordAndSynonyms(KeywordAndSynonyms * const keyword_synonyms);
 
     /** \return An iterator pointing to the first field w/ tag "field_tag" or end() if no such field was found. */
-    inline const_iterator getFirstField(const Tag &field_tag) const {
-        return std::find_if(fields_.cbegin(), fields_.cend(),
-                            [&field_tag](const Field &field){ return field.getTag() == field_tag; });
-    }
+    inline const_iterator getFirstField(const Tag &field_tag) const { return findTag(field_tag); }
 
     /** \return An iterator pointing to the first field w/ tag "field_tag" or end() if no such field was found. */
-    inline iterator getFirstField(const Tag &field_tag) {
-        return std::find_if(fields_.begin(), fields_.end(),
-                            [&field_tag](const Field &field){ return field.getTag() == field_tag; });
-    }
+    inline iterator getFirstField(const Tag &field_tag) { return findTag(field_tag); }
 
     /** \return Returns the content of the first field with given tag or an empty string if the tag is not present. */
     const std::string getFirstFieldContents(const Tag &field_tag) const {
@@ -701,7 +801,10 @@ public:
      *     \endcode
      *  }
      */
-    inline ConstantRange getTagRange(const Tag &tag) const { return getTagRange(std::vector<Tag>{ tag }); }
+    inline ConstantRange getTagRange(const Tag &tag) const {
+        const auto range(std::equal_range(fields_.cbegin(), fields_.cend(), tag, FieldAndTagCompare()));
+        return ConstantRange(range.first, range.second);
+    }
 
     /** \return Iterators pointing to the half-open interval of the first range of fields corresponding to the tag "tag".
      *  \remark {
@@ -719,13 +822,14 @@ public:
 
     /** \return An iterator that references the first fields w/ tag "tag" or end() if no such fields exist. */
     inline iterator findTag(const Tag &tag) {
-        return std::find_if(fields_.begin(), fields_.end(), [&tag](const Field &field) -> bool { return field.getTag() == tag; });
+        const auto field(std::lower_bound(fields_.begin(), fields_.end(), tag, FieldTagIsLess));
+        return (field != fields_.end() and field->getTag() == tag) ? field : fields_.end();
     }
 
     /** \return An iterator that references the first fields w/ tag "tag" or end() if no such fields exist. */
-    const_iterator findTag(const Tag &tag) const {
-        return std::find_if(fields_.cbegin(), fields_.cend(),
-                            [&tag](const Field &field) -> bool { return field.getTag() == tag; });
+    inline const_iterator findTag(const Tag &tag) const {
+        const auto field(std::lower_bound(fields_.cbegin(), fields_.cend(), tag, FieldTagIsLess));
+        return (field != fields_.cend() and field->getTag() == tag) ? field : fields_.cend();
     }
 
     /** \brief  Changes all from-tags to to-tags.
@@ -746,6 +850,12 @@ public:
      *  \return The iterator following pos.
      */
     inline iterator erase(const iterator pos) { return fields_.erase(pos); }
+    inline iterator erase(const iterator first, const iterator last) { return fields_.erase(first, last); }
+
+    /** \brief Exchanges our fields w/ "fields", which must be sorted by tag.  This allows for rebuilding the fields of a
+     *         record in a single pass, e.g. when applying many edits at once.
+     */
+    void swapFields(std::vector<Field> * const fields);
 
     /** \brief Removes one or more fields w/ tag "tag".
      *  \param  tag                    Delete fields w/ this tag.
@@ -817,11 +927,128 @@ public:
     std::vector<iterator> getMatchedFields(const std::string &field_or_field_and_subfield_code, RegexMatcher * const regex_matcher);
 
     static std::string BibliographicLevelToString(const BibliographicLevel bibliographic_level);
+private:
+    static inline bool FieldTagIsLess(const Field &field, const Tag &tag) { return field.tag_ < tag; }
+
+    // Needed for std::equal_range() which compares in both directions.
+    struct FieldAndTagCompare {
+        inline bool operator()(const Field &field, const Tag &tag) const { return field.tag_ < tag; }
+        inline bool operator()(const Tag &tag, const Field &field) const { return tag < field.tag_; }
+    };
+};
+
+
+/** \class RecordView
+ *  \brief A read-only view of a binary MARC-21 record that references the raw record data instead of copying it.
+ *  \warning A RecordView, and any FieldView or StringView obtained from it, is only valid as long as the underlying raw data
+ *           exists.  For views obtained from BinaryReader::readView() this means until the next call to a member function
+ *           of the reader that changes the read position or until the reader gets destroyed.
+ */
+class RecordView {
+public:
+    class FieldView {
+        friend class RecordView;
+        Tag tag_;
+        StringView contents_;
+    public:
+        FieldView(const Tag &tag, const StringView &contents): tag_(tag), contents_(contents) { }
+        inline const Tag &getTag() const { return tag_; }
+        inline const StringView &getContents() const { return contents_; }
+        inline bool isControlField() const __attribute__ ((pure)) { return tag_ <= "009"; }
+        inline bool isDataField() const __attribute__ ((pure)) { return tag_ > "009"; }
+        inline char getIndicator1() const { return unlikely(contents_.empty()) ? '\0' : contents_[0]; }
+        inline char getIndicator2() const { return unlikely(contents_.size() < 2) ? '\0' : contents_[1]; }
+
+        inline SubfieldRange getSubfieldRange() const { return SubfieldRange(contents_); }
+
+        /** \return Either the contents of the subfield or an empty view if no corresponding subfield was found. */
+        inline StringView getFirstSubfieldWithCode(const char subfield_code) const {
+            for (const auto &code_and_value : getSubfieldRange()) {
+                if (code_and_value.first == subfield_code)
+                    return code_and_value.second;
+            }
+            return StringView();
+        }
+
+        inline bool hasSubfield(const char subfield_code) const {
+            for (const auto &code_and_value : getSubfieldRange()) {
+                if (code_and_value.first == subfield_code)
+                    return true;
+            }
+            return false;
+        }
+
+        /** \return A mutable copy of this field. */
+        inline Record::Field toField() const { return Record::Field(tag_, contents_.toString()); }
+    };
+
+    /** \brief Iterates over the directory entries of the referenced record, decoding one field at a time. */
+    class const_iterator {
+        friend class RecordView;
+        const char *directory_entry_;
+        const char *base_address_of_data_;
+    private:
+        const_iterator(const char * const directory_entry, const char * const base_address_of_data)
+            : directory_entry_(directory_entry), base_address_of_data_(base_address_of_data) { }
+    public:
+        FieldView operator*() const;
+        inline const_iterator &operator++() { directory_entry_ += Record::DIRECTORY_ENTRY_LENGTH; return *this; }
+        inline bool operator==(const const_iterator &rhs) const { return directory_entry_ == rhs.directory_entry_; }
+        inline bool operator!=(const const_iterator &rhs) const { return directory_entry_ != rhs.directory_entry_; }
+
+        /** \return True if the tag of the referenced directory entry equals "tag".  Cheaper than (*iter).getTag() == tag. */
+        inline bool hasTag(const Tag &tag) const { return std::memcmp(directory_entry_, tag.c_str(), Record::TAG_LENGTH) == 0; }
+    };
+private:
+    const char *record_start_;
+    size_t record_size_;
+    const char *base_address_of_data_;
+public:
+    RecordView(): record_start_(nullptr), record_size_(0), base_address_of_data_(nullptr) { }
+    RecordView(const size_t record_size, const char * const record_start);
+    RecordView(const RecordView &other) = default;
+    RecordView &operator=(const RecordView &rhs) = default;
+
+    operator bool () const { return record_start_ != nullptr; }
+    inline size_t size() const { return record_size_; }
+    inline const char *data() const { return record_start_; }
+    inline StringView getLeader() const { return StringView(record_start_, Record::LEADER_LENGTH); }
+    inline size_t getNumberOfFields() const
+        { return (base_address_of_data_ - 1 - (record_start_ + Record::LEADER_LENGTH)) / Record::DIRECTORY_ENTRY_LENGTH; }
+
+    inline bool isMonograph() const { return record_start_[7] == 'm'; }
+    inline bool isSerial() const { return record_start_[7] == 's'; }
+    inline bool isArticle() const { return record_start_[7] == 'a' or record_start_[7] == 'b'; }
+
+    inline const_iterator begin() const { return const_iterator(record_start_ + Record::LEADER_LENGTH, base_address_of_data_); }
+    inline const_iterator end() const { return const_iterator(base_address_of_data_ - 1, base_address_of_data_); }
+
+    /** \return An iterator that references the first field w/ tag "tag" or end() if no such field exists. */
+    inline const_iterator findTag(const Tag &tag) const {
+        const_iterator iter(begin());
+        while (iter != end() and not iter.hasTag(tag))
+            ++iter;
+        return iter;
+    }
+
+    inline bool hasTag(const Tag &tag) const { return findTag(tag) != end(); }
+
+    /** \return The contents of the first field w/ tag "field_tag" or an empty view if there is no such field. */
+    inline StringView getFirstFieldContents(const Tag &field_tag) const {
+        const const_iterator field(findTag(field_tag));
+        return (field == end()) ? StringView() : (*field).getContents();
+    }
+
+    inline StringView getControlNumber() const { return getFirstFieldContents("001"); }
+
+    /** \return A mutable copy of the referenced record. */
+    inline Record toRecord() const { return Record(record_size_, record_start_); }
 };
 
 
 
-enum class FileType { AUTO, BINARY, XML };
+// INDEXED files contain MARC-21 records followed by a record directory, see IndexedReader and IndexedWriter.
+enum class FileType { AUTO, BINARY, XML, INDEXED };
 enum class GuessFileTypeBehaviour { ATTEMPT_A_READ, USE_THE_FILENAME_ONLY };
 
 
@@ -833,6 +1060,8 @@ std::string FileTypeToString(const FileType file_type);
  *  \param  guess_file_type_behaviour  Whether to just use the filename or, for existing files, to attempt a read.
  *  \return FileType::BINARY or FileType::XML.
  *  \note   Aborts if we can't determine the file type or if it is not FileType::BINARY nor FileType::XML.
+ *  \note   For gzip-compressed files, i.e. files ending in ".gz", we only look at the filename w/o the ".gz" suffix.
+ *  \note   Shared memory rings, i.e. "shm://name", always carry FileType::BINARY.
  */
 FileType GuessFileType(const std::string &filename,
                        const GuessFileTypeBehaviour guess_file_type_behaviour = GuessFileTypeBehaviour::ATTEMPT_A_READ);
@@ -841,6 +1070,8 @@ FileType GuessFileType(const std::string &filename,
 class Reader {
 protected:
     File *input_;
+    std::vector<Tag> projected_tags_; // Sorted.  If not empty, only fields w/ these tags will be part of our records.
+    std::unique_ptr<IOStatistics> io_statistics_; // Only set by Factory() if IOStatistics::IsEnabled().
     Reader(File * const input): input_(input) { }
 public:
     virtual ~Reader() { delete input_; }
@@ -848,6 +1079,17 @@ public:
     virtual FileType getReaderType() = 0;
     virtual Record read() = 0;
 
+    /** \brief Reads the next record into "record", recycling its memory where possible.
+     *  \return False if we reached the end of our input, o/w true.
+     *  \note   This is cheaper than read() if the same Record instance is passed in for all calls, e.g.
+     *         \code{.cpp}
+     *             MARC::Record record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+     *             while (reader->read(&record))
+     *                 ProcessRecord(&record);
+     *         \endcode
+     */
+    virtual bool read(Record * const record) { *record = read(); return static_cast<bool>(*record); }
+
     /** \brief Rewind the underlying file. */
     virtual void rewind() = 0;
 
@@ -859,24 +1101,60 @@ public:
 
     virtual bool seek(const off_t offset, const int whence = SEEK_SET) = 0;
 
-    /** \return a BinaryMarcReader or an XmlMarcReader. */
-    static std::unique_ptr<Reader> Factory(const std::string &input_filename, FileType reader_type = FileType::AUTO);
+    /** \brief Restricts the fields of the records returned by read() to those w/ tags in "projected_tags".
+     *  \note  The control number field, 001, is always included as we need it to merge physically adjacent records.
+     *  \note  An empty list of tags turns the projection off.  Tools that need to copy the skipped fields to their
+     *         output should use BinaryReader::readView() instead.
+     */
+    void setProjection(const std::vector<Tag> &projected_tags);
+
+    /** \return a BinaryMarcReader or an XmlMarcReader.
+     *  \param  projected_tags  If not empty, the returned reader only decodes fields w/ these tags.  See setProjection().
+     *  \note   Files whose names end in ".gz" will be transparently decompressed.
+     *  \note   "shm://name" reads binary MARC from the shared memory ring "name" that another process writes to w/
+     *          Writer::Factory("shm://name").  See ShmRing for the details.  Such readers can't seek or rewind.
+     *  \note   See IOStatistics for how to make the returned reader report its throughput.
+     *  \note   Setting the environment variable MARC_ASYNC_IO to "true" makes readers and writers of plain files use
+     *          io_uring-based I/O, see File::enableAsynchronousIO().  The default is ordinary stdio.
+     */
+    static std::unique_ptr<Reader> Factory(const std::string &input_filename, FileType reader_type = FileType::AUTO,
+                                           const std::vector<Tag> &projected_tags = {});
 };
 
 
 class BinaryReader: public Reader {
     friend class Reader;
     Record last_record_;
+    bool last_record_is_valid_; // If false, we have to read "last_record_" before we can use it.
     off_t next_record_start_;
+protected:
     const char *mmap_;
     size_t offset_, input_file_size_;
+    size_t data_size_; // The size of the memory-mapped record data which, for indexed files, excludes the footer.
 private:
+    std::string view_buffer_; // Only used by readView() for non-memory-mapped input.
+    Record spare_record_; // Recycled storage for read(Record * const).
+    std::unique_ptr<ShmRing> ring_; // Only set if we read from a shared memory ring.
+    size_t ring_view_size_; // The size of the record last returned by readView() that we have not yet consumed.
+protected:
     explicit BinaryReader(File * const input);
+private:
+    BinaryReader(File * const input, ShmRing * const ring);
 public:
-    virtual ~BinaryReader() final;
+    virtual ~BinaryReader();
 
-    virtual FileType getReaderType() override final { return FileType::BINARY; }
+    virtual FileType getReaderType() override { return FileType::BINARY; }
     virtual Record read() override final;
+    virtual bool read(Record * const record) override final;
+
+    /** \brief Returns the next record w/o copying any of its data.
+     *  \return The next record or an empty view if we reached the end of our input.
+     *  \note   Unlike read(), this does not merge physically adjacent records sharing the same control number.
+     *  \note   For non-memory-mappable input, e.g. FIFOs, calls to read() and readView() must not be mixed.
+     *  \warning The returned view is invalidated by the next call to read(), readView(), rewind() or seek().
+     */
+    RecordView readView();
+
     virtual void rewind() override final;
 
     /** \return The file position of the start of the next record. */
@@ -885,6 +1163,53 @@ public:
     virtual inline bool seek(const off_t offset, const int whence = SEEK_SET) override final;
 private:
     Record actualRead();
+    void actualRead(Record * const record);
+    inline off_t getCurrentOffset() const;
+
+    /** \return The length of the next record in "ring_", which is available in its entirety, or 0 at the end of the data. */
+    size_t waitForRingRecord();
+};
+
+
+/** \class IndexedReader
+ *  \brief Reads FileType::INDEXED files and allows for O(log n) lookups by control number.
+ *  \note  An indexed file consists of ordinary MARC-21 records followed by a footer.  The footer holds the offsets of
+ *         all records in file order, a table of NUL-padded control numbers and record numbers that is sorted by
+ *         control number, and a fixed-size trailer w/ the table sizes.  Record numbers count records as returned by
+ *         read(), i.e. physical records that get merged count once, which lets us split the file into shards by record
+ *         number.
+ *  \note  Indexed files must be memory-mappable and can therefore not be compressed.
+ */
+class IndexedReader final : public BinaryReader {
+    friend class Reader;
+    const char *record_offsets_;
+    const char *keys_;
+    size_t record_count_, key_count_, key_width_;
+private:
+    explicit IndexedReader(File * const input);
+public:
+    virtual FileType getReaderType() override final { return FileType::INDEXED; }
+
+    inline size_t getRecordCount() const { return record_count_; }
+
+    /** \return The file offset of record number "record_no" which must be less than getRecordCount(). */
+    off_t getRecordOffset(const size_t record_no) const;
+
+    /** \brief Positions us so that the next call to read() will return record number "record_no".
+     *  \return False if "record_no" is not less than getRecordCount(), else true.
+     */
+    bool seekToRecord(const size_t record_no);
+
+    /** \return True if "control_number" was found, else false. */
+    bool findControlNumber(const std::string &control_number, size_t * const record_no) const;
+
+    /** \brief Positions us so that the next call to read() will return the record w/ control number "control_number".
+     *  \return False if "control_number" was not found, else true.
+     */
+    bool seekToControlNumber(const std::string &control_number);
+
+    /** \brief Calls "callback" w/ each control number and the offset of its record in control number order. */
+    void forEachControlNumber(const std::function<void(const std::string &control_number, const off_t offset)> &callback) const;
 };
 
 
@@ -909,6 +1234,7 @@ public:
 
     virtual FileType getReaderType() override final { return FileType::XML; }
     virtual Record read() override final;
+    using Reader::read;
     virtual void rewind() override final;
 
     /** \return The file position of the start of the next record. */
@@ -930,11 +1256,16 @@ private:
 class Writer {
 public:
     enum WriterMode { OVERWRITE, APPEND };
+protected:
+    std::unique_ptr<IOStatistics> io_statistics_; // Only set by Factory() if IOStatistics::IsEnabled().
 public:
     virtual ~Writer() { }
 
     virtual void write(const Record &record) = 0;
 
+    /** \brief Writes "record_view" as if it had been converted to a Record first. */
+    virtual void write(const RecordView &record_view) { write(record_view.toRecord()); }
+
     /** \return a reference to the underlying, assocaiated file. */
     virtual File &getFile() = 0;
 
@@ -943,7 +1274,12 @@ public:
      */
     virtual bool flush() = 0;
 
-    /** \note If you pass in AUTO for "writer_type", "output_filename" must end in ".mrc" or ".xml"! */
+    /** \note If you pass in AUTO for "writer_type", "output_filename" must end in ".mrc" or ".xml", optionally followed
+     *        by ".gz"!  Files whose names end in ".gz" will be gzip-compressed.
+     *  \note "shm://name" writes binary MARC to the shared memory ring "name" instead of a file, see Reader::Factory().
+     *  \note See IOStatistics for how to make the returned writer report its throughput.
+     *  \note See Reader::Factory() for MARC_ASYNC_IO.
+     */
     static std::unique_ptr<Writer> Factory(const std::string &output_filename, FileType writer_type = FileType::AUTO,
                                            const WriterMode writer_mode = WriterMode::OVERWRITE);
 };
@@ -952,26 +1288,83 @@ public:
 class BinaryWriter: public Writer {
     friend class Writer;
     File * const output_;
+protected:
+    std::string output_buffer_; // Serialised records that have not yet been handed to "output_".
 private:
-    BinaryWriter(File * const output): output_(output) { }
+    size_t flush_threshold_;
+    size_t bytes_written_; // Does not include "output_buffer_".
+    std::unique_ptr<ShmRing> ring_; // If set, we write to it instead of to "output_".
+public:
+    static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 1024 * 1024;
+protected:
+    explicit BinaryWriter(File * const output, ShmRing * const ring = nullptr);
 public:
-    virtual ~BinaryWriter() { delete output_; }
+    virtual ~BinaryWriter();
 
-    virtual void write(const Record &record) override final;
+    virtual void write(const Record &record) override;
 
-    /** \return a reference to the underlying, associated file. */
-    virtual File &getFile() override final { return *output_; }
+    /** \brief Copies the raw data of "record_view" to our output w/o decoding or re-encoding it. */
+    virtual void write(const RecordView &record_view) override;
+
+    /** \return a reference to the underlying, associated file.
+     *  \note   Any buffered records will be written to the file first.
+     *  \note   For shared memory rings this is the shared memory object which must not be written to directly.
+     */
+    virtual File &getFile() override final { writeBuffer(); return *output_; }
 
     /** \brief Flushes the buffers of the underlying File to the storage medium.
      *  \return True on success and false on failure.  Sets errno if there is a failure.
      */
-    virtual bool flush() override final { return output_->flush(); }
+    virtual bool flush() override final { writeBuffer(); return output_->flush(); }
+
+    /** \brief Sets how many bytes of serialised records we collect before writing them to the underlying file.
+     *  \note  A threshold of 0 means that each record will be written as soon as it has been serialised.
+     */
+    inline void setFlushThreshold(const size_t new_flush_threshold) {
+        flush_threshold_ = new_flush_threshold;
+        if (output_buffer_.size() >= flush_threshold_)
+            writeBuffer();
+    }
+
+    /** \brief Serialises "record" and appends it to "raw_records".  Oversized records are split like write() does. */
+    static void AppendRecord(const Record &record, std::string * const raw_records);
+protected:
+    /** \return The number of bytes that we have written so far, including buffered bytes. */
+    inline size_t getOutputSize() const { return bytes_written_ + output_buffer_.size(); }
+private:
+    void writeBuffer();
+};
+
+
+/** \class IndexedWriter
+ *  \brief Writes FileType::INDEXED files.  See IndexedReader for a description of the format.
+ *  \note  The footer will be written when the writer is destroyed.  Indexed files can therefore not be appended to.
+ *  \note  If a control number is written more than once, the last occurrence wins for lookups.
+ */
+class IndexedWriter final : public BinaryWriter {
+    friend class Writer;
+    std::vector<uint64_t> record_offsets_;
+    std::vector<std::pair<std::string, uint64_t>> control_numbers_and_record_numbers_;
+    std::string last_control_number_;
+private:
+    explicit IndexedWriter(File * const output): BinaryWriter(output) { }
+public:
+    virtual ~IndexedWriter() final;
+
+    virtual void write(const Record &record) override final;
+    virtual void write(const RecordView &record_view) override final;
+private:
+    void addToIndex(const std::string &control_number);
 };
 
 
 class XmlWriter: public Writer {
     friend class Writer;
     MarcXmlWriter *xml_writer_;
+    const MarcXmlWriter::TextConversionType text_conversion_type_;
+    std::string record_buffer_; // Each record is assembled here and then written in one go.
+    std::string indents_[3];    // For the record, its children and the subfields.
+    std::vector<std::string> subfield_start_tags_; // Indexed by subfield code.
 private:
     explicit XmlWriter(File * const output_file, const unsigned indent_amount = 0,
                        const MarcXmlWriter::TextConversionType text_conversion_type = MarcXmlWriter::NoConversion);
@@ -980,10 +1373,16 @@ public:
                        const MarcXmlWriter::TextConversionType text_conversion_type = MarcXmlWriter::NoConversion);
     virtual ~XmlWriter() final { delete xml_writer_; }
 
+    /** \note  The output is the same as if it had been generated w/ MarcXmlWriter element by element, but we generate the
+     *         markup ourselves, which is several times faster.
+     */
     virtual void write(const Record &record) override final;
+    using Writer::write;
 
     /** \return a reference to the underlying, assocaiated file. */
     virtual File &getFile() override final { return *xml_writer_->getAssociatedOutputFile(); }
+private:
+    void init();
 
     /** \brief Flushes the buffers of the underlying File to the storage medium.
      *  \return True on success and false on failure.  Sets errno if there is a failure.
@@ -1034,6 +1433,36 @@ bool GetGNDCode(const MARC::Record &record, std::string * const gnd_code);
 std::string CalcChecksum(const Record &record, const std::set<Tag> &excluded_fields = { "001" }, const bool suppress_local_fields = true);
 
 
+/** \brief Like CalcChecksum() but much cheaper.  We use a streaming 64 bit xxHash and never copy any field contents.
+ *  \note  Only leader positions that BinaryWriter copies verbatim are included, i.e. the record length and the base
+ *         address of data are not, so that writing and rereading a record does not change its checksum.
+ *  \warning The results are unrelated to those of CalcChecksum() and must never be compared to them.
+ */
+uint64_t CalcFastChecksum(const Record &record, const std::set<Tag> &excluded_fields = { "001" },
+                          const bool suppress_local_fields = true);
+
+
+/** \brief Calculates a checksum w/ CalcFastChecksum(), excluding "checksum_tag", and stores it in subfield a of
+ *         "checksum_tag", replacing an existing checksum.
+ *  \return The new checksum.
+ *  \note   Tools running incrementally can compare the checksum of a new record against the stored checksum of the
+ *         previously processed version of the record and skip records that have not changed.
+ */
+uint64_t StoreFastChecksum(Record * const record, const Tag &checksum_tag = "CHK",
+                           const std::set<Tag> &excluded_fields = { "001" }, const bool suppress_local_fields = true);
+
+
+/** \return True if "record" has a checksum, that was stored by StoreFastChecksum(), in "checksum_tag", else false. */
+bool GetStoredFastChecksum(const Record &record, uint64_t * const checksum, const Tag &checksum_tag = "CHK");
+
+
+/** \return True if "record" has a stored checksum in "checksum_tag" and it still matches the record's contents.
+ *  \note   The arguments must match those that were passed to StoreFastChecksum().
+ */
+bool StoredFastChecksumMatches(const Record &record, const Tag &checksum_tag = "CHK",
+                               const std::set<Tag> &excluded_fields = { "001" }, const bool suppress_local_fields = true);
+
+
 bool IsRepeatableField(const Tag &tag);
 bool IsStandardTag(const Tag &tag);
 
@@ -1056,10 +1485,12 @@ bool IsOpenAccess(const Record &marc_record);
 
 
 // \warning After a call to this function you may want to rewind the MARC Reader.
+// \note    For indexed files we use the footer and don't read any records.
 size_t CollectRecordOffsets(MARC::Reader * const marc_reader, std::unordered_map<std::string, off_t> * const control_number_to_offset_map);
 
 
-/** \brief Handles optional command-line arguments of the form "--input-format=marc-21" and "--input-format=marc-xml"
+/** \brief Handles optional command-line arguments of the form "--input-format=marc-21", "--input-format=marc-xml" and
+ *         "--input-format=marc-21-indexed"
  *
  *  If an optional argument of one of the expected forms is found in argv[arg_no], argc and argv will be incremented and
  *  decremented respectively and the corresponding file type will be returned.  If not, the value of "default_file_type" will
@@ -1068,7 +1499,8 @@ size_t CollectRecordOffsets(MARC::Reader * const marc_reader, std::unordered_map
 FileType GetOptionalReaderType(int * const argc, char *** const argv, const int arg_no, const FileType default_file_type = FileType::AUTO);
 
 
-/** \brief Handles optional command-line arguments of the form "--output-format=marc-21" and "--output-format=marc-xml"
+/** \brief Handles optional command-line arguments of the form "--output-format=marc-21", "--output-format=marc-xml" and
+ *         "--output-format=marc-21-indexed"
  *
  *  If an optional argument of one of the expected forms is found in argv[arg_no], argc and argv will be incremented and
  *  decremented respectively and the corresponding file type will be returned.  If not, the value of "default_file_type" will
@@ -0,0 +1,73 @@
+/** \brief Dense integer ids for authority records, looked up by PPN or GND number.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include "MarcControlNumberSet.h"
+#include "StringView.h"
+
+
+namespace MARC {
+
+
+/** \class AuthorityIdTable
+ *  \brief Assigns consecutive ids, starting at 0, to authority records and maps their PPN's and GND numbers to these ids.
+ *  \note  Tools that count or mark references to authority records can use plain arrays or bitmaps indexed by id instead
+ *         of sets or maps of strings.  Both kinds of keys are kept in ControlNumberSet's and therefore typically need 16
+ *         bytes each.
+ *  \note  After construction all member functions are const and may be called concurrently.
+ */
+class AuthorityIdTable {
+    ControlNumberSet ppns_to_ids_, gnd_numbers_to_ids_;
+    uint32_t size_;
+public:
+    static constexpr uint32_t NO_ID = UINT32_MAX;
+public:
+    AuthorityIdTable(): ppns_to_ids_(/* store_values = */true), gnd_numbers_to_ids_(/* store_values = */true), size_(0) { }
+
+    /** \brief Assigns the next id to the authority record w/ PPN "ppn" and GND number "gnd_number".
+     *  \note  Either may be empty.  Should the PPN or the GND number already be known, it keeps referring to its old id.
+     *  \return The newly assigned id.
+     */
+    uint32_t add(const std::string &ppn, const std::string &gnd_number);
+
+    /** \return The id of the record w/ PPN "ppn" or NO_ID if there is no such record. */
+    uint32_t getIdForPPN(const std::string &ppn) const;
+
+    /** \return The id of the record w/ GND number "gnd_number" or NO_ID if there is no such record. */
+    uint32_t getIdForGNDNumber(const std::string &gnd_number) const;
+
+    /** \return The id of the record that "reference", e.g. "(DE-588)118540238" or "(DE-627)104125306", refers to or
+     *          NO_ID if "reference" is not a GND or K10plus reference or if we don't know the referenced record.
+     */
+    uint32_t getIdForReference(const StringView &reference) const;
+
+    /** \brief Appends the ids of all known authority records that are referenced in $0 subfields of "field_contents".
+     *  \note  "field_contents" must be the contents of a data field, i.e. include the indicators.
+     */
+    void getReferencedIds(const StringView &field_contents, std::vector<uint32_t> * const ids) const;
+
+    inline uint32_t size() const { return size_; }
+};
+
+
+} // namespace MARC
@@ -0,0 +1,145 @@
+/** \brief A persistent, memory-mapped snapshot of the lookup tables that our pipeline phases derive from authority data.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+#include "MARC.h"
+#include "StringView.h"
+
+
+namespace MARC {
+
+
+/** \class AuthorityStore
+ *  \brief Maps PPN's to record offsets and DDC's, GND numbers to PPN's, personal names to PPN's and personal names to
+ *         their synonyms w/o having to parse the authority data.
+ *  \note  Like OffsetIndex, the store lives in a sidecar file next to the authority data, e.g. "Normdaten.mrc.authority"
+ *         for "Normdaten.mrc", and will only be used if the recorded size and modification time of the authority data
+ *         still match.  All strings are interned in a single pool and all tables are sorted so that we can memory-map
+ *         the file and use binary searches.  Processes that open the same store share its pages via the page cache.
+ *  \note  Personal names are the space-separated contents of the a, b, c and d subfields of 100 fields, synonyms those of
+ *         the 400 fields.  If the same name occurs in more than one authority record, the first record wins.  If a PPN
+ *         or GND number occurs more than once, the last occurrence wins.
+ *  \note  The DDC's of a record are those found by ExtractDDCs() in its 083 and 089 fields.  Each distinct DDC has an
+ *         integer id and the ids are assigned in the lexicographical order of the DDC's.
+ */
+class AuthorityStore {
+    struct StringRef;
+    struct PPNEntry;
+    struct GNDEntry;
+    struct NameEntry;
+
+    std::string store_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    std::string in_memory_store_; // Only used if we failed to write the sidecar file.
+    const PPNEntry *ppn_entries_;
+    size_t ppn_entry_count_;
+    const GNDEntry *gnd_entries_;
+    size_t gnd_entry_count_;
+    const NameEntry *name_entries_;
+    size_t name_entry_count_;
+    const StringRef *synonyms_;
+    const StringRef *ddcs_;
+    size_t ddc_count_;
+    const uint32_t *ddc_ids_;
+    const char *string_pool_;
+public:
+    /** \brief Memory-maps the sidecar store of "authority_reader"'s file or, if it is missing or stale, creates it first.
+     *  \note  If the sidecar file can't be written we warn and keep the store in memory instead.
+     *  \note  Creating the store requires a full pass over "authority_reader" which will be rewound afterwards.
+     */
+    explicit AuthorityStore(Reader * const authority_reader);
+    ~AuthorityStore();
+
+    /** \return The number of distinct PPN's. */
+    inline size_t size() const { return ppn_entry_count_; }
+    inline const std::string &getStorePath() const { return store_path_; }
+
+    /** \return True if "ppn" was found, else false. */
+    bool findRecordOffset(const std::string &ppn, off_t * const offset) const;
+
+    /** \brief Reads the authority record w/ PPN "ppn" from "authority_reader" which must read the file we were created for.
+     *  \return True if "ppn" was found, else false.
+     */
+    bool getRecord(const std::string &ppn, Reader * const authority_reader, Record * const authority_record) const;
+
+    /** \return True if "gnd_number" was found, else false. */
+    bool findPPNForGNDNumber(const std::string &gnd_number, std::string * const ppn) const;
+
+    /** \return True if "personal_name" was found, else false.
+     *  \note   See GetPersonalName() for how to obtain matching names from title data.
+     */
+    bool findPPNForPersonalName(const std::string &personal_name, std::string * const ppn) const;
+
+    /** \return True if "personal_name" was found, else false.  "synonyms" may be empty even if we return true.
+     *  \note   The returned views point into our storage and are valid for our lifetime.
+     */
+    bool getSynonyms(const std::string &personal_name, std::vector<StringView> * const synonyms) const;
+
+    /** \brief Appends the ids of the DDC's of the authority record w/ PPN "ppn" to "ddc_ids".
+     *  \return The number of appended ids, which is 0 if "ppn" was not found.
+     */
+    size_t appendDDCIds(const std::string &ppn, std::vector<uint32_t> * const ddc_ids) const;
+
+    /** \return The number of distinct DDC's.  Valid DDC ids are less than this. */
+    inline size_t getDDCCount() const { return ddc_count_; }
+
+    /** \note The returned view points into our storage and is valid for our lifetime. */
+    StringView getDDC(const uint32_t ddc_id) const;
+
+    static inline std::string GetStorePath(const std::string &authority_path) { return authority_path + ".authority"; }
+
+    /** \return True if "authority_path" has a sidecar store that matches its current size and modification time. */
+    static bool IsUpToDate(const std::string &authority_path);
+
+    /** \brief Writes the sidecar store for "authority_reader"'s file.  This should be called once after new authority
+     *         data has been downloaded so that the pipeline phases don't race to create it.
+     *  \return The number of distinct PPN's in the new store.
+     *  \note   "authority_reader" will be rewound.
+     */
+    static size_t Create(Reader * const authority_reader);
+
+    /** \return The space-separated contents of the a, b, c and d subfields of "field" in the order in which they occur. */
+    static std::string GetPersonalName(const Record::Field &field);
+
+    /** \brief Appends the $a subfields of all "tag" fields of "record" that look like DDC's, i.e. start w/ three digits,
+     *         to "ddcs".  Fields w/ a $z subfield are skipped as they contain auxiliary table numbers.
+     */
+    static void ExtractDDCs(const Record &record, const Tag &tag, std::vector<std::string> * const ddcs);
+private:
+    AuthorityStore(const AuthorityStore &) = delete;
+    AuthorityStore &operator=(const AuthorityStore &) = delete;
+
+    /** \return The serialised store, header included. */
+    static std::string Generate(Reader * const authority_reader);
+
+    bool mapStore(const std::string &authority_path);
+    void setTables(const char * const store_start);
+    inline StringView getString(const StringRef &string_ref) const;
+    template<typename EntryType> const EntryType *findEntry(const EntryType * const entries, const size_t entry_count,
+                                                            const std::string &key) const;
+};
+
+
+} // namespace MARC
@@ -0,0 +1,122 @@
+/** \brief A simple chunked, columnar file format for extracts of MARC records, e.g. PPN's, titles and authors.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include "File.h"
+
+
+namespace MARC {
+
+
+/** \brief  Column files consist of a header listing the column names followed by chunks of rows.  Each chunk stores the
+ *          values of one column contiguously and starts w/ the byte sizes of its column blocks, so that readers can skip
+ *          the columns that they are not interested in w/o decoding them.
+ *  \note   All values are strings.  Multi-valued columns, e.g. authors, separate their values w/ VALUE_SEPARATOR.
+ */
+namespace ColumnFile {
+
+
+constexpr char VALUE_SEPARATOR('\x1F');
+
+
+/** \return "values" joined w/ VALUE_SEPARATOR. */
+template<typename Container> std::string JoinValues(const Container &values) {
+    std::string joined_values;
+    for (const auto &value : values) {
+        if (not joined_values.empty())
+            joined_values += VALUE_SEPARATOR;
+        joined_values += value;
+    }
+    return joined_values;
+}
+
+
+/** \return The individual values of a multi-valued column.  An empty column value has no values. */
+std::vector<std::string> SplitValues(const std::string &column_value);
+
+
+} // namespace ColumnFile
+
+
+class ColumnFileWriter {
+    const std::string path_;
+    std::unique_ptr<File> output_;
+    const size_t chunk_size_;
+    size_t column_count_, rows_in_chunk_;
+    std::vector<std::string> column_blocks_;
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 65536; // in rows
+public:
+    /** \note Aborts if "path" can't be written.  The data goes to a temporary file which will only be renamed to "path"
+     *        by close(), so readers never see a partially written file.
+     */
+    ColumnFileWriter(const std::string &path, const std::vector<std::string> &column_names,
+                     const size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    ~ColumnFileWriter() { close(); }
+
+    /** \note "column_values" must be in the order of the column names that were passed into our constructor. */
+    void addRow(const std::vector<std::string> &column_values);
+
+    /** \brief Flushes any buffered rows and moves the file into place.  Calling close() more than once is harmless. */
+    void close();
+private:
+    void flushChunk();
+    ColumnFileWriter(const ColumnFileWriter &) = delete;
+    ColumnFileWriter &operator=(const ColumnFileWriter &) = delete;
+};
+
+
+class ColumnFileReader {
+    const std::string path_;
+    File input_;
+    std::vector<std::string> column_names_;
+    std::vector<size_t> selected_column_indices_;
+    std::vector<std::string> selected_column_blocks_; // Parallel to "selected_column_indices_".
+    std::vector<size_t> selected_column_block_offsets_; // Parallel to "selected_column_indices_".
+    size_t rows_left_in_chunk_;
+public:
+    /** \param  selected_column_names  The columns we will return for each row in this order.  If empty, all columns
+     *                                 will be returned.
+     *  \note   Aborts if "path" can't be opened or is not a column file or if any of the selected columns don't exist.
+     */
+    ColumnFileReader(const std::string &path, const std::vector<std::string> &selected_column_names = {});
+
+    inline const std::vector<std::string> &getColumnNames() const { return column_names_; }
+
+    /** \brief Reads the values of the selected columns of the next row.
+     *  \return False if there are no more rows, else true.
+     */
+    bool readRow(std::vector<std::string> * const column_values);
+
+    /** \return True if "path" starts w/ the magic of a column file, else false. */
+    static bool IsColumnFile(const std::string &path);
+private:
+    bool readChunk();
+    void readOrDie(void * const buf, const size_t size);
+    ColumnFileReader(const ColumnFileReader &) = delete;
+    ColumnFileReader &operator=(const ColumnFileReader &) = delete;
+};
+
+
+} // namespace MARC
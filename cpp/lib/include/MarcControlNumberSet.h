@@ -0,0 +1,72 @@
+/** \brief A compact set of MARC control numbers w/ optional 64 bit values.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cinttypes>
+
+
+namespace MARC {
+
+
+/** \class ControlNumberSet
+ *  \brief A set of control numbers that needs a lot less memory than a std::unordered_set<std::string>.
+ *  \note  PPN's and GND numbers, i.e. control numbers that consist of up to 17 digits, "X"'s and hyphens, are packed into
+ *         a 64 bit integer and stored in an open-addressing hash table.  We therefore need 8 to 16 bytes per PPN or twice that if we also
+ *         store values.  Any other control numbers are kept in a conventional hash table.
+ */
+class ControlNumberSet {
+    static constexpr uint64_t EMPTY_SLOT = 0; // Never the result of packing a control number.
+    static constexpr size_t INITIAL_CAPACITY = 1u << 16u; // Must be a power of 2.
+
+    const bool store_values_;
+    std::vector<uint64_t> keys_;
+    std::vector<uint64_t> values_; // Parallel to "keys_" but only used if "store_values_" is true.
+    size_t packed_count_;
+    std::unordered_map<std::string, uint64_t> unpackable_control_numbers_and_values_;
+public:
+    /** \param store_values  If true, we store a 64 bit value, e.g. a checksum, for each control number. */
+    explicit ControlNumberSet(const bool store_values = false);
+
+    /** \brief Adds "control_number" and stores "value" for it if "control_number" was not already in the set.
+     *  \return True if "control_number" was not already in the set, o/w false.
+     *  \note   If the control number was already in the set, we keep its original value.
+     */
+    bool insert(const std::string &control_number, const uint64_t value = 0);
+
+    /** \return True if "control_number" is in the set, o/w false.
+     *  \note   If "value" is not nullptr and we store values, the value associated w/ "control_number" will be
+     *          returned here.
+     */
+    bool find(const std::string &control_number, uint64_t * const value = nullptr) const;
+
+    inline bool contains(const std::string &control_number) const { return find(control_number); }
+    inline size_t size() const { return packed_count_ + unpackable_control_numbers_and_values_.size(); }
+    inline bool empty() const { return size() == 0; }
+private:
+    static bool Pack(const std::string &control_number, uint64_t * const key);
+    size_t findSlot(const uint64_t key) const;
+    void grow();
+};
+
+
+} // namespace MARC
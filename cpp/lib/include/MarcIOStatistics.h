@@ -0,0 +1,103 @@
+/** \brief Optional throughput counters and latency histograms for MARC::Reader and MARC::Writer instances.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include "Compiler.h"
+
+
+namespace MARC {
+
+
+/** \class IOStatistics
+ *  \brief Counts the records and bytes that pass through a single reader or writer and keeps a histogram of the time
+ *         spent per record.
+ *  \note  Statistics are only collected if the environment variable MARC_IO_STATISTICS is set to "true".  In that case
+ *         the readers and writers returned by Reader::Factory() and Writer::Factory() report their totals via LOG_INFO
+ *         when they are destroyed and all live instances report their current totals after the process received a
+ *         SIGUSR1.
+ *  \note  Each instance must only be updated by a single thread but may be reported on by any thread.
+ */
+class IOStatistics {
+public:
+    // Bucket i counts the operations that took [2^i, 2^(i+1)) nanoseconds, the last bucket everything longer.
+    static constexpr unsigned HISTOGRAM_BUCKET_COUNT = 40;
+
+    enum Direction { READ, WRITE };
+
+    /** \brief Times a single operation.  Does nothing, apart from updating the process-wide record and byte counters
+     *         in Metrics, if "statistics" is nullptr.
+     */
+    class Probe {
+        IOStatistics * const statistics_;
+        const Direction direction_;
+        std::chrono::steady_clock::time_point start_;
+    public:
+        inline Probe(IOStatistics * const statistics, const Direction direction): statistics_(statistics), direction_(direction) {
+            if (unlikely(statistics_ != nullptr))
+                start_ = std::chrono::steady_clock::now();
+        }
+
+        /** \brief Records an operation that transferred "byte_count" bytes.  Probes that are never completed, e.g. for
+         *         attempts to read past the end of the input, are not counted.
+         */
+        inline void complete(const size_t byte_count) {
+            UpdateMetrics(direction_, byte_count);
+            if (unlikely(statistics_ != nullptr))
+                statistics_->add(byte_count, std::chrono::steady_clock::now() - start_);
+        }
+    };
+private:
+    std::string description_;
+    std::chrono::steady_clock::time_point creation_time_;
+    std::atomic<uint64_t> record_count_, byte_count_, total_nanoseconds_;
+    std::atomic<uint64_t> histogram_[HISTOGRAM_BUCKET_COUNT];
+public:
+    /** \param description  Used to identify us in our reports, e.g. "reader for \"title_data.mrc\"". */
+    explicit IOStatistics(const std::string &description);
+    ~IOStatistics();
+
+    void add(const size_t byte_count, const std::chrono::steady_clock::duration elapsed_time);
+
+    /** \brief Logs our totals, our throughput and some percentiles of the time spent per record. */
+    void report() const;
+
+    /** \return True if MARC_IO_STATISTICS is set to "true", else false. */
+    static bool IsEnabled();
+
+    /** \brief Reports on all live instances.  This is what happens after a SIGUSR1. */
+    static void ReportAll();
+private:
+    IOStatistics(const IOStatistics &) = delete;
+    IOStatistics &operator=(const IOStatistics &) = delete;
+
+    // Single writer, so we don't need an atomic read-modify-write.
+    static inline void Increment(std::atomic<uint64_t> * const counter, const uint64_t amount)
+        { counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+
+    uint64_t getPercentile(const unsigned percentage, const uint64_t record_count) const;
+    static void UpdateMetrics(const Direction direction, const size_t byte_count);
+};
+
+
+} // namespace MARC
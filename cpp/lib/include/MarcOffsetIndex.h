@@ -0,0 +1,89 @@
+/** \brief A persistent, memory-mapped control number to file offset index for MARC-21 files.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <sys/types.h>
+#include "MARC.h"
+
+
+namespace MARC {
+
+
+/** \class OffsetIndex
+ *  \brief Maps control numbers to the offsets of the corresponding records w/o having to read the whole MARC file.
+ *  \note  The index is stored in a sidecar file next to the MARC file, e.g. "norm_data.mrc.idx" for "norm_data.mrc".  It
+ *         consists of a header followed by fixed-width entries that are sorted by control number, which lets us
+ *         memory-map it and use binary searches.  The header records the size and the modification time of the MARC
+ *         file and the index will only be used if both still match.
+ *  \note  Like CollectRecordOffsets(), if a control number occurs more than once, the last occurrence wins.
+ */
+class OffsetIndex {
+    std::string index_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    std::string in_memory_index_; // Only used if we failed to write the sidecar file.
+    const char *entries_;
+    size_t entry_count_, key_width_;
+public:
+    /** \brief Memory-maps the sidecar index of "marc_reader"'s file or, if it is missing or stale, creates it first.
+     *  \note  If the sidecar file can't be written we warn and keep the index in memory instead.
+     *  \note  Creating the index requires a full pass over "marc_reader" which will be rewound afterwards.
+     */
+    explicit OffsetIndex(Reader * const marc_reader);
+    ~OffsetIndex();
+
+    inline size_t size() const { return entry_count_; }
+    inline const std::string &getIndexPath() const { return index_path_; }
+
+    /** \return True if "control_number" was found, else false. */
+    bool find(const std::string &control_number, off_t * const offset) const;
+
+    /** \brief Maps "control_number" to its position in our sorted table.  Ordinals are dense, i.e. in [0, size()), and
+     *         stay the same for as long as the MARC file doesn't change, which makes them suitable for bitmaps and
+     *         vectors that annotate records, see RecordBitmap.
+     *  \return True if "control_number" was found, else false.
+     */
+    bool findOrdinal(const std::string &control_number, size_t * const ordinal) const;
+
+    static inline std::string GetIndexPath(const std::string &marc_path) { return marc_path + ".idx"; }
+
+    /** \return True if "marc_path" has a sidecar index that matches its current size and modification time. */
+    static bool IsUpToDate(const std::string &marc_path);
+
+    /** \brief Writes the sidecar index for "marc_reader"'s file.  This should be called by the tools that generate MARC
+     *         files that others look up records in.
+     *  \return The number of entries in the new index.
+     *  \note   "marc_reader" will be rewound.
+     */
+    static size_t Create(Reader * const marc_reader);
+private:
+    OffsetIndex(const OffsetIndex &) = delete;
+    OffsetIndex &operator=(const OffsetIndex &) = delete;
+
+    bool mapIndex(const std::string &marc_path);
+    void setEntries(const char * const index_start);
+
+    /** \return The entry for "control_number" or nullptr if there is none. */
+    const char *findEntry(const std::string &control_number) const;
+};
+
+
+} // namespace MARC
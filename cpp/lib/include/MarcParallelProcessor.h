@@ -0,0 +1,120 @@
+/** \brief A multi-threaded engine for the typical "read a record, modify it, write it" loop of our MARC tools.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "MARC.h"
+
+
+namespace MARC {
+
+
+/** \class ParallelProcessor
+ *  \brief Reads records on one thread, hands them to N worker threads and writes the results in the original input order.
+ *  \note  The typical replacement for
+ *         \code{.cpp}
+ *             while (MARC::Record record = reader->read()) {
+ *                 ProcessRecord(&record);
+ *                 writer->write(record);
+ *             }
+ *         \endcode
+ *         looks like this:
+ *         \code{.cpp}
+ *             MARC::ParallelProcessor processor(reader.get(), writer.get());
+ *             processor.process([](MARC::Record * const record) { ProcessRecord(record); return true; });
+ *         \endcode
+ *  \warning The record processing function will be called concurrently from multiple threads!  Any state shared
+ *           between invocations, e.g. counters, RegexMatcher instances or caches, must be made thread-safe.
+ */
+class ParallelProcessor {
+public:
+    /** \return True if the, possibly modified, record should be written and false if it should be dropped. */
+    typedef std::function<bool(Record * const record)> RecordProcessor;
+
+    /** \brief Called on the thread that called process(), in input order, for each record that should be kept. */
+    typedef std::function<void(const Record &record)> RecordConsumer;
+
+    /** \brief Called on the reader thread, in input order, before a record is handed to the workers.
+     *  \return True if the record should be processed and false if it should be skipped.
+     *  \note   Setting "*stop" to true ends the reading of records.  The current record will then be discarded.
+     */
+    typedef std::function<bool(const Record &record, bool * const stop)> RecordSelector;
+private:
+    Reader * const reader_;
+    Writer * const writer_;
+    const unsigned worker_count_;
+    const size_t max_records_in_flight_;
+
+    std::mutex mutex_;
+    std::condition_variable work_available_, result_available_, room_available_;
+    std::deque<std::pair<size_t, Record>> work_queue_;
+    std::unordered_map<size_t, std::pair<bool, Record>> results_; // Sequence number => (keep, processed record).
+    size_t records_in_flight_, read_count_;
+    bool input_exhausted_, aborted_;
+    std::exception_ptr worker_exception_; // The first exception thrown by the reader or a record processor.
+    RecordSelector record_selector_;
+public:
+    /** \param writer              Where to write the processed records.  May be nullptr if we only want to inspect records.
+     *  \param worker_count        The number of threads calling the record processor.  If 0, we use one thread per core.
+     *  \param max_records_in_flight  The maximum number of records that have been read but not yet written.  This bounds
+     *                             our memory usage.  If 0, we use 64 times the number of worker threads.
+     */
+    explicit ParallelProcessor(Reader * const reader, Writer * const writer, const unsigned worker_count = 0,
+                               const size_t max_records_in_flight = 0);
+
+    /** \brief Processes all remaining records of our reader.
+     *  \return The number of records that were read.
+     *  \note   Exceptions thrown by our reader or by "record_processor" will be rethrown on the calling thread after all
+     *          threads have been joined.  If our reader throws, the records that were read before will still be processed.
+     *  \note   Unless it already is, the logger operates in asynchronous mode until we return.
+     */
+    size_t process(const RecordProcessor &record_processor);
+
+    /** \brief Like the other overload but hands the kept records to "record_consumer" instead of our writer.
+     *  \return The number of records that were processed.
+     */
+    size_t process(const RecordProcessor &record_processor, const RecordConsumer &record_consumer);
+
+    /** \brief Cheap, order dependent filtering, e.g. sampling or limits, that should run before the workers. */
+    inline void setRecordSelector(const RecordSelector &record_selector) { record_selector_ = record_selector; }
+
+    inline unsigned getWorkerCount() const { return worker_count_; }
+
+    /** \return The 0-based position in the input of the record that has been handed to the record processor or the
+     *          record consumer that is executing on the calling thread.
+     *  \note   This allows record processors to pass additional per-record results on to the record consumer, e.g. via a
+     *          mutex-protected map keyed by the sequence number.
+     */
+    static size_t GetCurrentSequenceNo();
+private:
+    ParallelProcessor(const ParallelProcessor &) = delete;
+    ParallelProcessor &operator=(const ParallelProcessor &) = delete;
+
+    void readerThread();
+    void workerThread(const RecordProcessor &record_processor);
+};
+
+
+} // namespace MARC
@@ -0,0 +1,96 @@
+/** \brief In-process chaining of MARC record processing stages that run on separate threads.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "MARC.h"
+
+
+namespace MARC {
+
+
+/** \class PipelineStage
+ *  \brief The per-record logic of one of our pipeline programs, e.g. normalise_urls.
+ *  \note  Each stage runs on its own thread, so stages need not be thread-safe as long as they don't share state with
+ *         other stages.
+ */
+class PipelineStage {
+    std::string name_;
+protected:
+    explicit PipelineStage(const std::string &name): name_(name) { }
+public:
+    virtual ~PipelineStage() = default;
+
+    inline const std::string &getName() const { return name_; }
+
+    /** \return True if the, possibly modified, record should be passed on to the next stage and false if it should be
+     *          dropped.
+     */
+    virtual bool processRecord(Record * const record) = 0;
+
+    /** \brief Will be called after the last record has been processed, typically used to report statistics. */
+    virtual void finish() { }
+
+    /** \brief Creates one of the registered stages.
+     *  \param  stage_name  The name of the stage, which is the name of the corresponding pipeline program.
+     *  \param  arguments   Stage-specific arguments, typically the same as the non-file arguments of the program.
+     *  \note   Aborts if "stage_name" is unknown or if "arguments" are invalid for the stage.
+     */
+    static std::unique_ptr<PipelineStage> Factory(const std::string &stage_name, const std::vector<std::string> &arguments);
+
+    /** \return The names of all stages that Factory() knows about, in alphabetical order. */
+    static std::vector<std::string> GetStageNames();
+};
+
+
+/** \class Pipeline
+ *  \brief Passes records through a chain of stages w/o serialising and reparsing them between stages.
+ *  \note  The reader, each stage and the writer run on separate threads which are connected by bounded queues.  The
+ *         record order is preserved.
+ */
+class Pipeline {
+    std::vector<std::unique_ptr<PipelineStage>> stages_;
+    const size_t queue_capacity_;
+public:
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 1000;
+public:
+    /** \param queue_capacity  The maximum number of records waiting in front of each stage.  This bounds our memory
+     *                         usage.
+     */
+    explicit Pipeline(const size_t queue_capacity = DEFAULT_QUEUE_CAPACITY): queue_capacity_(queue_capacity) { }
+
+    inline void addStage(std::unique_ptr<PipelineStage> stage) { stages_.emplace_back(std::move(stage)); }
+    inline size_t getStageCount() const { return stages_.size(); }
+
+    /** \brief Processes all remaining records of "reader".
+     *  \param writer  Where to write the records that made it through all stages.  May be nullptr.
+     *  \return The number of records that were read.
+     *  \note   Exceptions thrown by stages will be rethrown on the calling thread after all threads have been joined.
+     */
+    size_t run(Reader * const reader, Writer * const writer);
+private:
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+};
+
+
+} // namespace MARC
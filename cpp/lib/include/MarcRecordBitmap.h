@@ -0,0 +1,74 @@
+/** \brief A bitmap that flags records of a MARC-21 file by their OffsetIndex ordinals.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include "MarcOffsetIndex.h"
+
+
+namespace MARC {
+
+
+/** \class RecordBitmap
+ *  \brief One bit per record of a MARC file, e.g. "has holdings in Tübingen", addressed via OffsetIndex::findOrdinal().
+ *  \note  Bitmaps can be saved to sidecar files next to the MARC file, e.g. "GesamtTiteldaten.mrc.de21_superiors.bitmap"
+ *         for "GesamtTiteldaten.mrc" and the name "de21_superiors", so that later runs and phases don't have to
+ *         recompute them.  Like the offset index, a saved bitmap will only be loaded if the recorded size and
+ *         modification time of the MARC file still match.
+ */
+class RecordBitmap {
+    const OffsetIndex &offset_index_;
+    std::vector<uint64_t> words_;
+public:
+    /** \note "offset_index" must outlive us. */
+    explicit RecordBitmap(const OffsetIndex &offset_index)
+        : offset_index_(offset_index), words_((offset_index.size() + 63) / 64, 0) { }
+
+    inline void set(const size_t ordinal) { words_[ordinal / 64] |= UINT64_C(1) << (ordinal % 64); }
+    inline bool test(const size_t ordinal) const { return (words_[ordinal / 64] >> (ordinal % 64)) & 1u; }
+
+    /** \return False if "control_number" is not in our offset index, else true. */
+    bool set(const std::string &control_number);
+
+    /** \return True if "control_number" is in our offset index and its bit is set, else false. */
+    bool test(const std::string &control_number) const;
+
+    /** \return The number of set bits. */
+    size_t count() const;
+
+    /** \brief Replaces our bits w/ those of a saved bitmap.
+     *  \return False if there is no up-to-date saved bitmap for "marc_path" and "name", else true.
+     */
+    bool load(const std::string &marc_path, const std::string &name);
+
+    /** \return True if we were able to write the sidecar file for "marc_path" and "name", else false. */
+    bool save(const std::string &marc_path, const std::string &name) const;
+
+    static inline std::string GetBitmapPath(const std::string &marc_path, const std::string &name)
+        { return marc_path + "." + name + ".bitmap"; }
+private:
+    RecordBitmap(const RecordBitmap &) = delete;
+    RecordBitmap &operator=(const RecordBitmap &) = delete;
+};
+
+
+} // namespace MARC
@@ -0,0 +1,83 @@
+/** \brief A trie of subject headings, e.g. LCSH's, that maps subject fields to heading ids.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cinttypes>
+#include "StringView.h"
+
+
+namespace MARC {
+
+
+/** \class SubjectHeadingIndex
+ *  \brief Assigns consecutive ids, starting at 0, to subject headings w/ optional subdivisions and finds the heading
+ *         that a subject field, e.g. a 650, refers to.
+ *  \note  Headings are written as in "Church history -- 20th century", i.e. the main heading followed by the subdivisions,
+ *         each separated by "--".  All components are compared after conversion to lowercase and after stripping
+ *         surrounding whitespace and trailing periods.
+ *  \note  The headings form a trie whose edges, (parent node, component), are kept in a single hash table, so that the
+ *         lookup of a field needs one probe per subfield.
+ *  \note  After construction all const member functions may be called concurrently.
+ */
+class SubjectHeadingIndex {
+public:
+    typedef uint32_t HeadingId;
+    static constexpr HeadingId NO_HEADING = UINT32_MAX;
+private:
+    std::unordered_map<std::string, uint32_t> edges_to_nodes_; // 4 bytes parent node number + component => node number.
+    std::vector<HeadingId> node_headings_;                     // NO_HEADING for nodes at which no heading ends.
+    std::vector<std::string> headings_;
+public:
+    SubjectHeadingIndex(): node_headings_(1, NO_HEADING) { }
+
+    /** \brief Loads one heading per line.  Empty lines are ignored. */
+    explicit SubjectHeadingIndex(const std::string &headings_path);
+
+    /** \return The id of "heading".  If "heading" is new, it gets the next unused id. */
+    HeadingId add(const std::string &heading);
+
+    /** \return The id of the most specific heading that matches "field_contents" or NO_HEADING if none does.
+     *  \note   "field_contents" must be the contents of a data field, i.e. include the indicators.  The main heading is
+     *          taken from subfield $a, subdivisions from subfields $v, $x, $y and $z in field order.  A heading w/o
+     *          subdivisions also matches fields w/ subdivisions, but a heading w/ subdivisions only matches fields that
+     *          have at least the same subdivisions.
+     */
+    HeadingId lookup(const StringView &field_contents) const;
+
+    inline const std::string &getHeading(const HeadingId heading_id) const { return headings_[heading_id]; }
+    inline size_t size() const { return headings_.size(); }
+    inline bool empty() const { return headings_.empty(); }
+
+    /** \return The lowercase version of "component" w/o surrounding whitespace and trailing periods. */
+    static std::string NormaliseComponent(const StringView &component);
+private:
+    static inline void MakeEdgeKey(const uint32_t parent_node, const std::string &normalised_component,
+                                   std::string * const key)
+    {
+        key->assign(reinterpret_cast<const char *>(&parent_node), sizeof(parent_node));
+        key->append(normalised_component);
+    }
+};
+
+
+} // namespace MARC
@@ -0,0 +1,114 @@
+/** \brief A memory-mapped table of the titles, ISBN's, ISSN's and open-access status of superior works.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include "MARC.h"
+#include "StringView.h"
+
+
+namespace MARC {
+
+
+/** \class SuperiorWorksTable
+ *  \brief Maps PPN's to the title, last ISBN, last ISSN and open-access status of the records they identify so that tools
+ *         that patch component parts don't each need their own prepass over the title data.
+ *  \note  Titles are recorded for all records, ISBN's, ISSN's and the open-access status only for serials and monographs.
+ *         Records w/ an invalid PPN, as defined by ::PPN, are ignored as they can't be referenced by (DE-627) uplinks.
+ *  \note  Unlike OADOIUrlTable, which this class borrows its layout from, the table is not tied to a single input file.
+ *         It is written once by the first pipeline phase that needs it and then shared by later phases, which is only
+ *         correct as long as the phases in between neither add superior works nor change their titles or identifiers.
+ */
+class SuperiorWorksTable {
+public:
+    static constexpr size_t MAX_PPN_LENGTH = 10;
+    struct StringRef {
+        uint32_t offset_, length_; // Offsets are relative to the start of the string pool.
+    };
+    struct Entry {
+        char ppn_[MAX_PPN_LENGTH]; // NUL-padded.
+        uint8_t is_open_access_;
+        uint8_t padding_[5];
+        StringRef title_, isbn_, issn_;
+    };
+    struct Info {
+        StringView title_, isbn_, issn_;
+        bool is_open_access_;
+    public:
+        /** \return The ISBN if there is one, o/w the ISSN, like add_isbns_or_issns_to_articles has always done it. */
+        inline StringView getISBNOrISSN() const { return isbn_.empty() ? issn_ : isbn_; }
+    };
+
+    /** \class Builder
+     *  \brief Collects the entries while a caller makes its own pass over the title data.
+     */
+    class Builder {
+        struct RawEntry {
+            std::string ppn_, title_, isbn_, issn_;
+            bool is_open_access_;
+        };
+        std::vector<RawEntry> raw_entries_;
+    public:
+        /** \return True if "record" resulted in an entry, else false. */
+        bool addRecord(const Record &record);
+
+        inline size_t size() const { return raw_entries_.size(); }
+
+        /** \brief Writes the table to "table_path" atomically.  If a PPN was added more than once, the last record wins.
+         *  \return The number of distinct PPN's in the new table.
+         */
+        size_t write(const std::string &table_path);
+    };
+private:
+    std::string table_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    const Entry *entries_;
+    size_t entry_count_;
+    const char *string_pool_;
+public:
+    /** \brief Memory-maps "table_path" and aborts if it is missing or corrupt. */
+    explicit SuperiorWorksTable(const std::string &table_path);
+    ~SuperiorWorksTable();
+
+    inline size_t size() const { return entry_count_; }
+    inline const std::string &getTablePath() const { return table_path_; }
+
+    /** \return True if "ppn" was found, else false.
+     *  \note   The views in "info" point into our mapping and are valid for our lifetime.
+     */
+    bool lookup(const std::string &ppn, Info * const info) const;
+
+    /** \brief Makes a pass over "marc_reader" and writes the table for its records to "table_path".
+     *  \return The number of distinct PPN's in the new table.
+     */
+    static size_t Create(Reader * const marc_reader, const std::string &table_path);
+private:
+    SuperiorWorksTable(const SuperiorWorksTable &) = delete;
+    SuperiorWorksTable &operator=(const SuperiorWorksTable &) = delete;
+
+    inline StringView getString(const StringRef &string_ref) const
+        { return StringView(string_pool_ + string_ref.offset_, string_ref.length_); }
+};
+
+
+} // namespace MARC
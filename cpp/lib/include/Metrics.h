@@ -0,0 +1,177 @@
+/** \brief A process-wide registry of named counters, gauges and latency histograms.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+
+/** \namespace Metrics
+ *  \brief Named metrics that are cheap enough to be updated on hot paths.
+ *  \note  Metrics are looked up by name, which takes a lock, so the usual idiom is to bind a function-local static
+ *         reference once:
+ *         \code{.cpp}
+ *             static Metrics::Histogram &query_durations(Metrics::GetHistogram("db_query_duration_ns"));
+ *             Metrics::ScopedTimer timer(&query_durations);
+ *         \endcode
+ *  \note  Names must be valid Prometheus metric names, i.e. match [a-zA-Z_:][a-zA-Z0-9_:]*.  By convention counter names
+ *         end in "_total" and histogram names name their unit, e.g. "_ns" or "_bytes".
+ *  \note  If the environment variable METRICS_JSON_FILE and/or METRICS_PROMETHEUS_FILE is set, all metrics will be
+ *         written to the named file(s) at exit(3) and whenever the process receives a SIGUSR1.  The latter format is
+ *         suitable for the textfile collector of the Prometheus node exporter.
+ */
+namespace Metrics {
+
+
+// Counters and histograms are split into this many shards so that threads rarely update the same cache line.
+constexpr unsigned SHARD_COUNT = 8;
+
+
+// \return The shard that the calling thread should update.
+inline unsigned GetShardIndex() {
+    static std::atomic<unsigned> next_shard_index(0);
+    thread_local const unsigned shard_index(next_shard_index++ % SHARD_COUNT);
+    return shard_index;
+}
+
+
+class Counter {
+    struct Shard {
+        std::atomic<uint64_t> value_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>)];
+    } shards_[SHARD_COUNT];
+public:
+    Counter();
+
+    inline void increment(const uint64_t amount = 1) { shards_[GetShardIndex()].value_.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t get() const;
+private:
+    Counter(const Counter &) = delete;
+    Counter &operator=(const Counter &) = delete;
+};
+
+
+// Unlike a counter, a gauge can go down, e.g. the number of open connections or the size of a queue.
+class Gauge {
+    std::atomic<int64_t> value_;
+public:
+    Gauge(): value_(0) { }
+
+    inline void set(const int64_t new_value) { value_.store(new_value, std::memory_order_relaxed); }
+    inline void add(const int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    inline int64_t get() const { return value_.load(std::memory_order_relaxed); }
+private:
+    Gauge(const Gauge &) = delete;
+    Gauge &operator=(const Gauge &) = delete;
+};
+
+
+/** \class Histogram
+ *  \brief Records a distribution of non-negative values, typically durations in nanoseconds.
+ *  \note  Like an HDR histogram, we use SUB_BUCKET_COUNT linear sub-buckets per power of two, so that all reported
+ *         percentiles are accurate to within 1/SUB_BUCKET_COUNT of the true value over the entire 64-bit range.
+ */
+class Histogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr unsigned SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+    static constexpr unsigned BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+private:
+    struct Shard {
+        std::atomic<uint64_t> count_, sum_;
+        std::atomic<uint64_t> buckets_[BUCKET_COUNT];
+    } shards_[SHARD_COUNT];
+public:
+    Histogram();
+
+    inline void record(const uint64_t value) {
+        Shard &shard(shards_[GetShardIndex()]);
+        shard.count_.fetch_add(1, std::memory_order_relaxed);
+        shard.sum_.fetch_add(value, std::memory_order_relaxed);
+        shard.buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+
+    /** \return An upper bound for the "percentile"th percentile, e.g. 99.9, of the recorded values or 0 if nothing has
+     *          been recorded yet.
+     */
+    uint64_t getPercentile(const double percentile) const;
+
+    static inline unsigned GetBucketIndex(const uint64_t value) {
+        if (value < 2 * SUB_BUCKET_COUNT)
+            return static_cast<unsigned>(value);
+        const unsigned shift(63 - __builtin_clzll(value) - SUB_BUCKET_BITS);
+        return (shift + 1) * SUB_BUCKET_COUNT + static_cast<unsigned>((value >> shift) - SUB_BUCKET_COUNT);
+    }
+
+    // \return The largest value that ends up in the bucket w/ index "bucket_index".
+    static uint64_t GetBucketUpperBound(const unsigned bucket_index);
+private:
+    Histogram(const Histogram &) = delete;
+    Histogram &operator=(const Histogram &) = delete;
+};
+
+
+/** \class ScopedTimer
+ *  \brief Records the number of nanoseconds between its construction and its destruction in a histogram.
+ */
+class ScopedTimer {
+    Histogram * const histogram_;
+    const std::chrono::steady_clock::time_point start_;
+public:
+    explicit ScopedTimer(Histogram * const histogram): histogram_(histogram), start_(std::chrono::steady_clock::now()) { }
+    ~ScopedTimer() {
+        histogram_->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    }
+};
+
+
+/** \brief Returns the metric named "name", creating it if it doesn't exist yet.
+ *  \param description  Used as the help text of the Prometheus export.  Only the description passed to the call that
+ *                      created the metric counts.
+ *  \note  Aborts if "name" is not a valid name or if it is already being used for a metric of a different kind.
+ *  \note  The returned references remain valid until the process exits.
+ */
+Counter &GetCounter(const std::string &name, const std::string &description = "");
+Gauge &GetGauge(const std::string &name, const std::string &description = "");
+Histogram &GetHistogram(const std::string &name, const std::string &description = "");
+
+
+/** \brief Returns all metrics as a JSON object.  Histograms are summarised by their count, sum and some percentiles. */
+std::string ToJSON();
+
+
+/** \brief Returns all metrics in the Prometheus text exposition format.  Each metric gets a "program" label w/ the name
+ *         of the current executable and histograms are exported as summaries.
+ */
+std::string ToPrometheusText();
+
+
+/** \brief Writes all metrics to the files named by METRICS_JSON_FILE and METRICS_PROMETHEUS_FILE, if set.
+ *  \note  The files are replaced atomically so that readers never see partial contents.
+ */
+void Export();
+
+
+} // namespace Metrics
@@ -0,0 +1,92 @@
+/** \brief A small harness for microbenchmarks of library hot paths.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <cstdint>
+
+
+/** \namespace MicroBenchmark
+ *  \brief Benchmarks are registered w/ the BENCHMARK macro and a program that consists of benchmarks ends w/
+ *         BENCHMARK_MAIN, which provides Main().  Each benchmark executes its measured code state->getIterations()
+ *         times.  The harness picks the iteration count so that a run takes at least --min-time seconds:
+ *         \code{.cpp}
+ *             BENCHMARK(UTF8ToLower) {
+ *                 const std::string text(GenerateText());
+ *                 for (uint64_t i(0); i < state->getIterations(); ++i)
+ *                     MicroBenchmark::DoNotOptimize(TextUtil::UTF8ToLower(text));
+ *                 state->addBytesProcessed(state->getIterations() * text.size());
+ *             }
+ *
+ *             BENCHMARK_MAIN(text_benchmark)
+ *         \endcode
+ *  \note  Setup code, like the generation of input data above, is measured too.  Benchmarks w/ expensive setup should
+ *         therefore cache their inputs in function-local statics.
+ */
+namespace MicroBenchmark {
+
+
+class State {
+    const uint64_t iterations_;
+    uint64_t bytes_processed_, items_processed_;
+public:
+    explicit State(const uint64_t iterations): iterations_(iterations), bytes_processed_(0), items_processed_(0) { }
+
+    inline uint64_t getIterations() const { return iterations_; }
+
+    // If set, throughput in MiB/s resp. items/s gets reported in addition to the time per iteration.
+    inline void addBytesProcessed(const uint64_t bytes) { bytes_processed_ += bytes; }
+    inline void addItemsProcessed(const uint64_t items) { items_processed_ += items; }
+
+    inline uint64_t getBytesProcessed() const { return bytes_processed_; }
+    inline uint64_t getItemsProcessed() const { return items_processed_; }
+};
+
+
+typedef void (*BenchmarkFunc)(State * const state);
+
+
+// \return Always 0.  (Only there so that BENCHMARK can call us during static initialisation.)
+int Register(const std::string &name, const BenchmarkFunc benchmark_func);
+
+
+/** \brief Parses the command-line, runs all matching benchmarks and reports the results.
+ *  \note  Pass --json to get machine-readable results, e.g. for tracking them over time.
+ */
+int RunAll(const std::string &suite_name, int argc, char *argv[]);
+
+
+// Keeps the compiler from optimising away the computation of "value".
+template<typename Type> inline void DoNotOptimize(const Type &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+
+} // namespace MicroBenchmark
+
+
+#define BENCHMARK(benchmark_name)                                                                           \
+    static void benchmark_name(MicroBenchmark::State * const state);                                        \
+    __attribute__((unused)) static int dummy_ ## benchmark_name(MicroBenchmark::Register(#benchmark_name, benchmark_name)); \
+    static void benchmark_name(MicroBenchmark::State * const state)
+
+
+#define BENCHMARK_MAIN(suite_name) \
+    int Main(int argc, char *argv[]) { return MicroBenchmark::RunAll(#suite_name, argc, argv); }
@@ -0,0 +1,66 @@
+/** \brief An Aho-Corasick automaton that finds occurrences of many fixed strings in a single pass over a text.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+
+
+/** \class MultiPatternMatcher
+ *  \brief Matches all patterns at once, the cost of a scan only depends on the length of the text and the number of matches.
+ *  \note  Patterns are byte strings, i.e. UTF-8 works as long as patterns and texts are normalised the same way, e.g. both
+ *         lowercased.  We precompute a complete transition table over the bytes that occur in the patterns.
+ */
+class MultiPatternMatcher {
+public:
+    struct Match {
+        size_t pattern_index_; // Index into the vector that was passed into our constructor.
+        size_t start_, length_; // Byte offset and length in the scanned text.
+    public:
+        Match(const size_t pattern_index, const size_t start, const size_t length)
+            : pattern_index_(pattern_index), start_(start), length_(length) { }
+    };
+private:
+    uint8_t byte_to_class_[256]; // Class 0 is for bytes that occur in no pattern.
+    unsigned class_count_;
+    std::vector<uint32_t> transitions_; // "class_count_" entries per state, state 0 is the start state.
+    std::vector<uint32_t> pattern_indices_plus_one_; // Per state, 0 if no pattern ends in a state.
+    std::vector<uint32_t> dictionary_links_; // Per state, the next state on the failure chain where a pattern ends or 0.
+    std::vector<size_t> pattern_lengths_;
+public:
+    /** \note Empty patterns will never match.  If a pattern occurs more than once, matches will refer to its first
+     *        occurrence.
+     */
+    explicit MultiPatternMatcher(const std::vector<std::string> &patterns);
+
+    inline size_t getPatternCount() const { return pattern_lengths_.size(); }
+
+    /** \brief Finds all, possibly overlapping, occurrences of all patterns.
+     *  \note  "matches" will be ordered by end position.  Matches w/ the same end position are ordered by decreasing
+     *         length.
+     */
+    void findAll(const std::string &text, std::vector<Match> * const matches) const;
+
+    /** \brief Finds non-overlapping occurrences, preferring the leftmost and, among those, the longest matches.
+     *  \note  "matches" will be ordered by start position.
+     */
+    void findLeftmostLongest(const std::string &text, std::vector<Match> * const matches) const;
+};
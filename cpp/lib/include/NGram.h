@@ -34,6 +34,7 @@
 #include <unordered_map>
 #include <utility>
 #include <vector>
+#include <cinttypes>
 
 
 // Forward declaration:
@@ -48,6 +49,7 @@ namespace NGram {
 const unsigned DEFAULT_NGRAM_NUMBER_THRESHOLD  =   0; // 0 means no threshold.
 const unsigned DEFAULT_TOPMOST_USE_COUNT       = 400;
 const double DEFAULT_ALTERNATIVE_CUTOFF_FACTOR = 1.0; // textcat = 1.05
+const unsigned MIN_BATCH_LETTER_COUNT         =   3; // Shorter texts are not classified by ClassifyBatch().
 
 
 typedef std::vector<std::pair<std::wstring, double>> NGramCounts;
@@ -62,19 +64,85 @@ public:
 };
 
 
+/** \return A 64-bit ID for the "length" wide characters starting at "ngram". */
+uint64_t HashNGram(const wchar_t * const ngram, const size_t length);
+
+
+/** \class HashedUnitVector
+ *  \brief A unit vector w/ the n-grams replaced by their hashes.  Comparing 64-bit IDs instead of strings makes similarity
+ *         computations a lot cheaper.
+ */
+class HashedUnitVector {
+    friend class HashedUnitVectorIndex;
+    std::vector<uint64_t> ngram_ids_; // Sorted.
+    std::vector<double> weights_;     // Parallel to "ngram_ids_".
+public:
+    HashedUnitVector() = default;
+    explicit HashedUnitVector(const UnitVector &unit_vector);
+
+    /** \note "ngram_ids_and_weights" will be normalised and does not need to be sorted. */
+    explicit HashedUnitVector(std::vector<std::pair<uint64_t, double>> ngram_ids_and_weights);
+
+    inline size_t size() const { return ngram_ids_.size(); }
+    double dotProduct(const HashedUnitVector &rhs) const;
+private:
+    void assign(std::vector<std::pair<uint64_t, double>> * const ngram_ids_and_weights);
+};
+
+
+/** \class HashedUnitVectorIndex
+ *  \brief An inverted index over a collection of HashedUnitVector's.  Scoring a query against all indexed vectors at once
+ *         only touches the n-grams the query shares w/ them instead of merging the query w/ each vector in turn.
+ *  \note  Weights are stored in single precision, which halves the memory traffic of the lookups.  The resulting dot
+ *         products may therefore differ from HashedUnitVector::dotProduct() in the 7th significant digit.
+ */
+class HashedUnitVectorIndex {
+    std::vector<uint64_t> ngram_ids_;       // Sorted and unique.
+    std::vector<uint32_t> postings_starts_; // Where the postings of each n-gram start, followed by the total count.
+    std::vector<uint32_t> vector_indices_;  // Postings, i.e. which vectors contain a given n-gram...
+    std::vector<float> weights_;            // ...and w/ which weight.
+    size_t vector_count_;
+public:
+    HashedUnitVectorIndex(): vector_count_(0) { }
+    explicit HashedUnitVectorIndex(const std::vector<const HashedUnitVector *> &vectors);
+
+    inline size_t size() const { return vector_count_; }
+
+    /** \brief  Computes the dot products of "query" w/ all indexed vectors.
+     *  \param  dot_products  Will be resized to size().  The i-th entry corresponds to the i-th indexed vector.
+     */
+    void dotProducts(const HashedUnitVector &query, std::vector<double> * const dot_products) const;
+};
+
+
 class LanguageModel: public UnitVector {
     std::string language_;
+    HashedUnitVector hashed_unit_vector_;
 public:
     LanguageModel() = default;
-    LanguageModel(const std::string &language, const NGramCounts &ngram_counts): UnitVector(ngram_counts), language_(language) { }
+    LanguageModel(const std::string &language, const NGramCounts &ngram_counts)
+        : UnitVector(ngram_counts), language_(language), hashed_unit_vector_(*this) { }
     inline const std::string &getLanguage() const { return language_; }
     inline void setLanguage(const std::string &language) { language_ = language; }
     inline double similarity(const NGram::UnitVector &rhs) const { return dotProduct(rhs); }
+
+    // Much faster than the above.
+    inline double similarity(const NGram::HashedUnitVector &rhs) const { return hashed_unit_vector_.dotProduct(rhs); }
+
+    inline const HashedUnitVector &getHashedUnitVector() const { return hashed_unit_vector_; }
+
     void serialise(File &output) const;
     void deserialise(File &input);
 };
 
 
+/** \brief  Like CreateLanguageModel() but w/ hashed n-grams and w/o a language.  This is what ClassifyLanguage() uses.
+ *  \param  text               UTF-8.
+ *  \param  topmost_use_count  The topmost number of ngrams that should be used.
+ */
+HashedUnitVector CreateHashedUnitVector(const std::string &text, const unsigned topmost_use_count = DEFAULT_TOPMOST_USE_COUNT);
+
+
 /** \brief Loads a language model from a file.
  *  \override_language_models_directory  If empty the default directory for language models will be used.
  */
@@ -110,6 +178,21 @@ inline void CreateLanguageModel(const std::string &input_text, LanguageModel * c
 }
 
 
+/** \brief  Create a language model from many texts, e.g. the titles and abstracts of a MARC collection.
+ *  \param  texts                   The texts are treated as if they had been concatenated w/ whitespace in between.
+ *  \param  language_model          Nomen est omen.
+ *  \param  ngram_number_threshold  Don't used ngrams that occur less than this many times.
+ *                                  A value of 0 means: use all ngrams.
+ *  \param  topmost_use_count       The topmost number of ngrams that should be used.
+ *  \param  thread_count            0 means use as many threads as there are cores.
+ *  \note   "texts" get split into one shard per thread, each w/ its own n-gram counts, which are merged at the end.  The
+ *          result does not depend on "thread_count".
+ */
+void CreateLanguageModel(const std::vector<std::string> &texts, LanguageModel * const language_model,
+                         const unsigned ngram_number_threshold = DEFAULT_NGRAM_NUMBER_THRESHOLD,
+                         const unsigned topmost_use_count = DEFAULT_TOPMOST_USE_COUNT, unsigned thread_count = 0);
+
+
 /** \brief  Tell which language(s) "input" might contain.
  *  \param  input                      Where to read the to be classified text from.
  *  \param  top_languages              The list of most likely languages with the most likely language first.
@@ -150,6 +233,24 @@ inline void ClassifyLanguage(const std::string &input_text, std::vector<std::str
 }
 
 
+/** \brief  Classifies many texts at once, using up to "thread_count" threads.
+ *  \param  texts                      The texts to classify.
+ *  \param  considered_languages       If non-empty only the specified languages will be used for classification o/w all
+ *                                     languages will be considered.
+ *  \param  alternative_cutoff_factor  See ClassifyLanguage().
+ *  \param  override_language_models_directory  If set, it specifies alternative location of language models.
+ *  \param  thread_count               0 means use as many threads as there are cores.
+ *  \return The top languages for each text in the order of "texts".  The list for a text is empty if the text has
+ *          fewer than MIN_BATCH_LETTER_COUNT letters, e.g. if it is purely numeric.
+ *  \note   The language models are loaded only once and are shared by all threads.
+ */
+std::vector<std::vector<std::string>> ClassifyBatch(const std::vector<std::string> &texts,
+                                                    const std::set<std::string> &considered_languages = { },
+                                                    const double alternative_cutoff_factor = DEFAULT_ALTERNATIVE_CUTOFF_FACTOR,
+                                                    const std::string &override_language_models_directory = "",
+                                                    unsigned thread_count = 0);
+
+
 /** \brief  Tell which language(s) "input_text" might be.
  *  \param  input                   Where to read the to be classified text from.
  *  \param  output_path             Where to write the model.
@@ -178,4 +279,12 @@ inline void CreateAndWriteLanguageModel(const std::string &input_text, const std
 }
 
 
+/** \brief  Like CreateLanguageModel() for many texts but writes the model to "output_path".
+ *  \param  thread_count  0 means use as many threads as there are cores.
+ */
+void CreateAndWriteLanguageModel(const std::vector<std::string> &texts, const std::string &output_path,
+                                 const unsigned ngram_number_threshold = DEFAULT_NGRAM_NUMBER_THRESHOLD,
+                                 const unsigned topmost_use_count = DEFAULT_TOPMOST_USE_COUNT, const unsigned thread_count = 0);
+
+
 } // namespace NGram
@@ -0,0 +1,87 @@
+/** \brief A persistent, memory-mapped table that maps DOI's to the open access URL's found by oaDOI/Unpaywall.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include "StringView.h"
+
+
+/** \class OADOIUrlTable
+ *  \brief Maps DOI's to the URL, evidence and host type of their best open access location.
+ *  \note  Like MARC::AuthorityStore, the table lives in a sidecar file next to the JSON input, e.g.
+ *         "doi_to_url_map.json.table" for "doi_to_url_map.json", and will only be used if the recorded size and
+ *         modification time of the JSON input still match.  The entries are sorted by DOI so that we can memory-map the
+ *         file and use binary searches.
+ *  \note  The JSON input may either be an array of objects or a sequence of objects, as produced by
+ *         MongoDB's printjson(), each w/ a "doi" member and a "best_oa_location" object that contains "url", "evidence"
+ *         and "host_type" members.  It is processed one object at a time.  If a DOI occurs more than once, the first
+ *         occurrence wins.
+ */
+class OADOIUrlTable {
+    struct StringRef;
+    struct Entry;
+
+    std::string table_path_;
+    const char *mmap_;
+    size_t mmap_size_;
+    std::string in_memory_table_; // Only used if we failed to write the sidecar file.
+    const Entry *entries_;
+    size_t entry_count_;
+    const char *string_pool_;
+public:
+    struct OAInfo {
+        StringView url_, evidence_, host_type_;
+    };
+public:
+    /** \brief Memory-maps the sidecar table of "json_path" or, if it is missing or stale, creates it first.
+     *  \note  If the sidecar file can't be written we warn and keep the table in memory instead.
+     */
+    explicit OADOIUrlTable(const std::string &json_path);
+    ~OADOIUrlTable();
+
+    /** \return The number of distinct DOI's. */
+    inline size_t size() const { return entry_count_; }
+    inline const std::string &getTablePath() const { return table_path_; }
+
+    /** \return True if "doi" was found, else false.
+     *  \note   The views in "oa_info" point into our storage and are valid for our lifetime.
+     */
+    bool lookup(const std::string &doi, OAInfo * const oa_info) const;
+
+    static inline std::string GetTablePath(const std::string &json_path) { return json_path + ".table"; }
+
+    /** \return True if "json_path" has a sidecar table that matches its current size and modification time. */
+    static bool IsUpToDate(const std::string &json_path);
+
+    /** \brief Writes the sidecar table for "json_path".
+     *  \return The number of distinct DOI's in the new table.
+     */
+    static size_t Create(const std::string &json_path);
+private:
+    OADOIUrlTable(const OADOIUrlTable &) = delete;
+    OADOIUrlTable &operator=(const OADOIUrlTable &) = delete;
+
+    /** \return The serialised table, header included. */
+    static std::string Generate(const std::string &json_path);
+
+    bool mapTable(const std::string &json_path);
+    void setTables(const char * const table_start);
+    inline StringView getString(const StringRef &string_ref) const;
+};
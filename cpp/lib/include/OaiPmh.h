@@ -67,6 +67,18 @@ enum HarvestMode {
 HarvestMode StringToHarvestMode(const std::string &harvest_mode_str);
 
 
+/** \brief   Extracts the resumptionToken from a ListRecords, ListIdentifiers or ListSets response.
+ *  \param   xml_document        The server's response.
+ *  \param   cursor              If not NULL, the token's "cursor" attribute, if any, will be returned here.
+ *  \param   complete_list_size  If not NULL, the token's "completeListSize" attribute, if any, will be returned here.
+ *  \return  The token or the empty string if "xml_document" is the last page of a list.
+ *  \note    Only scans for the token and is therefore much cheaper than a full parse of the records, which makes it
+ *           possible to request the next page before the current one has been processed.
+ */
+std::string ExtractResumptionToken(const std::string &xml_document, std::string * const cursor = NULL,
+                                   std::string * const complete_list_size = NULL);
+
+
 /** \brief  Represents a generic metadata element as a field (or name), a value, and an optional type attribute.
  */
 class Field {
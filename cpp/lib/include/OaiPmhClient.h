@@ -95,6 +95,9 @@ protected:
 
     /** The date that the first response was returned in this run of the program. */
     std::string first_response_date_;
+
+    /** How many ListRecords responses we download ahead of the one that is being processed. */
+    unsigned max_prefetched_pages_;
 public:
     struct MetadataFormatDescriptor {
         std::string metadata_prefix_, schema_, metadata_namespace_;
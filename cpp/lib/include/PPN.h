@@ -0,0 +1,186 @@
+/** \brief A compact representation of BSZ/K10plus PPN's and sets and maps keyed by them.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <cinttypes>
+#include "Compiler.h"
+#include "util.h"
+
+
+/** \class PPN
+ *  \brief A PPN packed into 64 bits.
+ *  \note  Valid PPN's have either BSZUtil::PPN_LENGTH_OLD or BSZUtil::PPN_LENGTH_NEW characters.  All but the last
+ *         character must be decimal digits, the last character, the check digit, may also be an "X".  We don't verify
+ *         the check digit.
+ */
+class PPN {
+    friend class PPNTable;
+    uint64_t packed_; // Zero iff we're a default-constructed PPN.
+public:
+    inline PPN(): packed_(0) { }
+    PPN(const PPN &other) = default;
+    PPN &operator=(const PPN &rhs) = default;
+
+    inline bool empty() const { return packed_ == 0; }
+    std::string toString() const;
+
+    inline bool operator==(const PPN &rhs) const { return packed_ == rhs.packed_; }
+    inline bool operator!=(const PPN &rhs) const { return packed_ != rhs.packed_; }
+
+    /** \note Orders PPN's of the same length like their string representations and shorter PPN's before longer ones. */
+    inline bool operator<(const PPN &rhs) const { return packed_ < rhs.packed_; }
+
+    /** \return True if "ppn_candidate" is a valid PPN, else false.  "ppn" will only be modified if we return true. */
+    static bool Parse(const std::string &ppn_candidate, PPN * const ppn);
+
+    /** \brief Like Parse() but calls LOG_ERROR if "ppn_candidate" is not a valid PPN. */
+    static PPN ParseOrDie(const std::string &ppn_candidate);
+};
+
+
+/** \class PPNTable
+ *  \brief The open-addressing hash table w/ linear probing that PPNSet and PPNMap are built on.
+ */
+class PPNTable {
+protected:
+    static constexpr uint64_t EMPTY_SLOT = 0; // The packed representation of an empty PPN.
+    static constexpr size_t INITIAL_CAPACITY = 1u << 10u; // Must be a power of 2.
+
+    std::vector<uint64_t> keys_;
+    size_t size_;
+protected:
+    inline PPNTable(): keys_(INITIAL_CAPACITY, EMPTY_SLOT), size_(0) { }
+
+    static inline uint64_t GetKey(const PPN &ppn) { return ppn.packed_; }
+    static inline PPN GetPPN(const uint64_t key) { PPN ppn; ppn.packed_ = key; return ppn; }
+
+    /** \return The slot that contains "key" or the empty slot where "key" would have to be inserted. */
+    size_t findSlot(const uint64_t key) const;
+
+    /** \return True if we have to grow before we can insert another key.  We keep the load factor at or below 3/4. */
+    inline bool isFull() const { return 4 * (size_ + 1) > 3 * keys_.size(); }
+
+    /** \brief Doubles the capacity and rehashes the keys.
+     *  \return A mapping from old slots to new slots for all occupied old slots.
+     */
+    std::vector<std::pair<size_t, size_t>> grow();
+public:
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+};
+
+
+class PPNSet : public PPNTable {
+public:
+    /** \return True if "ppn" was not already in the set, o/w false. */
+    bool insert(const PPN &ppn);
+
+    /** \brief Convenience overload that ignores invalid PPN's.
+     *  \return True if "ppn_candidate" was a valid PPN that was not already in the set, o/w false.
+     */
+    bool insert(const std::string &ppn_candidate);
+
+    inline bool contains(const PPN &ppn) const { return not ppn.empty() and keys_[findSlot(GetKey(ppn))] == GetKey(ppn); }
+    bool contains(const std::string &ppn_candidate) const;
+
+    /** \return All members of the set in ascending order. */
+    std::vector<PPN> getSortedPPNs() const;
+};
+
+
+template<typename ValueType> class PPNMap : public PPNTable {
+    std::vector<ValueType> values_; // Parallel to "keys_".
+public:
+    inline PPNMap(): values_(keys_.size()) { }
+
+    /** \brief Adds "ppn" and stores "value" for it if "ppn" was not already in the map.
+     *  \return True if "ppn" was not already in the map, o/w false.
+     *  \note   If the PPN was already in the map, we keep its original value.
+     */
+    bool insert(const PPN &ppn, const ValueType &value);
+
+    /** \return The value for "ppn" which will be default constructed if "ppn" was not already in the map. */
+    ValueType &operator[](const PPN &ppn);
+
+    /** \return A pointer to the value associated w/ "ppn" or nullptr if "ppn" is not in the map.
+     *  \note   The pointer will be invalidated by later insertions.
+     */
+    const ValueType *find(const PPN &ppn) const;
+    inline const ValueType *find(const std::string &ppn_candidate) const {
+        PPN ppn;
+        return PPN::Parse(ppn_candidate, &ppn) ? find(ppn) : nullptr;
+    }
+
+    inline bool contains(const PPN &ppn) const { return find(ppn) != nullptr; }
+private:
+    size_t findOrInsertSlot(const PPN &ppn, bool * const inserted);
+};
+
+
+template<typename ValueType> bool PPNMap<ValueType>::insert(const PPN &ppn, const ValueType &value) {
+    bool inserted;
+    const size_t slot(findOrInsertSlot(ppn, &inserted));
+    if (inserted)
+        values_[slot] = value;
+    return inserted;
+}
+
+
+template<typename ValueType> ValueType &PPNMap<ValueType>::operator[](const PPN &ppn) {
+    bool inserted;
+    return values_[findOrInsertSlot(ppn, &inserted)];
+}
+
+
+template<typename ValueType> const ValueType *PPNMap<ValueType>::find(const PPN &ppn) const {
+    if (ppn.empty())
+        return nullptr;
+    const size_t slot(findSlot(GetKey(ppn)));
+    return keys_[slot] == GetKey(ppn) ? &values_[slot] : nullptr;
+}
+
+
+template<typename ValueType> size_t PPNMap<ValueType>::findOrInsertSlot(const PPN &ppn, bool * const inserted) {
+    if (unlikely(ppn.empty()))
+        LOG_ERROR("can't insert an empty PPN!");
+
+    const uint64_t key(GetKey(ppn));
+    size_t slot(findSlot(key));
+    if (keys_[slot] == key) {
+        *inserted = false;
+        return slot;
+    }
+
+    if (isFull()) {
+        std::vector<ValueType> old_values(keys_.size() * 2);
+        old_values.swap(values_);
+        for (const auto &old_and_new_slot : grow())
+            values_[old_and_new_slot.second] = std::move(old_values[old_and_new_slot.first]);
+        slot = findSlot(key);
+    }
+
+    keys_[slot] = key;
+    ++size_;
+    *inserted = true;
+    return slot;
+}
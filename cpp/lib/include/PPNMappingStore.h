@@ -0,0 +1,89 @@
+/** \brief A persistent store of PPN replacements and deletions, e.g. from K10+ PPN swaps and LÖPPN deletion lists.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "File.h"
+
+
+/** \class PPNMappingStore
+ *  \brief Answers "what is the current PPN for X" and "has X been deleted" for all tools that patch databases or MARC
+ *         data w/ the same, incrementally maintained data.
+ *  \note  The store consists of two files: "<path>.log", an append-only text log of all changes w/ lines of the form
+ *         "M old_ppn new_ppn" or "D ppn", and "<path>.table", a compacted table of fixed-size entries sorted by PPN.  New
+ *         changes are only appended to the log, compact() merges the log into the table.  Replaying an already compacted
+ *         log is harmless, so a crash during compaction never loses data.
+ *  \note  There must never be more than one writer.
+ */
+class PPNMappingStore {
+public:
+    static constexpr size_t MAX_PPN_LENGTH = 10;
+    struct Entry {
+        char ppn_[MAX_PPN_LENGTH];     // NUL-padded.
+        char new_ppn_[MAX_PPN_LENGTH]; // NUL-padded, all NUL's if "ppn_" has been deleted.
+    };
+private:
+    const std::string log_path_, table_path_;
+    std::vector<Entry> table_; // Sorted by "ppn_".
+    std::unordered_map<std::string, std::string> log_ppns_to_new_ppns_; // An empty new PPN means "deleted".
+    std::unique_ptr<File> log_;
+public:
+    /** \note Aborts if either of the files exists but can't be read or is corrupt.  Missing files yield an empty store. */
+    explicit PPNMappingStore(const std::string &path = GetDefaultPath());
+    ~PPNMappingStore();
+
+    /** \return The number of PPN's that have been replaced or deleted. */
+    size_t size() const;
+    inline bool empty() const { return size() == 0; }
+
+    /** \brief Follows chains of replacements, i.e. if A was replaced by B and B by C, C is the current PPN for A.
+     *  \return True if "ppn" has been replaced, else false.  "current_ppn" will only be modified if we return true.
+     *  \note   The current PPN may itself have been deleted, use isDeleted() to find out.
+     */
+    bool getCurrentPPN(const std::string &ppn, std::string * const current_ppn) const;
+
+    /** \return The direct replacement of "ppn" or the empty string if "ppn" hasn't been replaced. */
+    std::string getNewPPN(const std::string &ppn) const;
+
+    bool isDeleted(const std::string &ppn) const;
+
+    /** \note Replaces any earlier replacement or deletion of "old_ppn".  Aborts if either PPN is invalid. */
+    void addMapping(const std::string &old_ppn, const std::string &new_ppn);
+
+    /** \note Replaces any earlier replacement of "ppn".  Aborts if "ppn" is invalid. */
+    void addDeletion(const std::string &ppn);
+
+    /** \return The number of changes that have not yet been merged into the compacted table. */
+    inline size_t getUncompactedCount() const { return log_ppns_to_new_ppns_.size(); }
+
+    /** \brief Merges the log into the table and truncates the log. */
+    void compact();
+
+    static std::string GetDefaultPath();
+private:
+    // \return False if "ppn" is neither in the log nor in the table.  An empty "new_ppn" means that "ppn" has been deleted.
+    bool lookup(const std::string &ppn, std::string * const new_ppn) const;
+    void appendToLog(const std::string &line, const std::string &ppn, const std::string &new_ppn);
+    PPNMappingStore(const PPNMappingStore &) = delete;
+    PPNMappingStore &operator=(const PPNMappingStore &) = delete;
+};
@@ -20,6 +20,7 @@
 #pragma once
 
 
+#include <functional>
 #include <string>
 
 
@@ -27,9 +28,36 @@ namespace PdfUtil {
 
 
 constexpr unsigned DEFAULT_PDF_EXTRACTION_TIMEOUT(60); // seconds
+
+
+/** \return True if we have been built w/ poppler-cpp and can therefore parse PDF documents w/o running subprocesses. */
+bool HaveInProcessExtraction();
+
+
+typedef std::function<bool(const unsigned page_no, const std::string &page_text)> PageTextHandler;
+
+
+/** \brief Parses "pdf_document" in-process and calls "page_text_handler" w/ the 1-based number and the UTF-8 text of each
+ *         page in the range ["first_page", "last_page"].  Stops early if "page_text_handler" returns false.
+ *  \param last_page  If zero, we process up to the last page of the document.
+ *  \param timeout    If non-zero, we give up after this many seconds.  This is checked between pages.
+ *  \return False if in-process extraction is unavailable, the document could not be parsed or we ran out of time.
+ */
+bool ForEachPageText(const std::string &pdf_document, const PageTextHandler &page_text_handler, const unsigned first_page = 1,
+                     const unsigned last_page = 0, const unsigned timeout = 0);
+
+
+/** \note Uses ForEachPageText() where possible and falls back to pdftotext o/w. */
 bool ExtractText(const std::string &pdf_document, std::string * const extracted_text,
                  const std::string &start_page = "", const std::string &end_page = "");
 
+
+/** \brief Like ExtractText() but for a PDF document that is already stored in a file.
+ *  \param timeout  If non-zero, we give up after this many seconds.
+ */
+bool ExtractTextFromFile(const std::string &path, std::string * const extracted_text,
+                         const std::string &start_page = "", const std::string &end_page = "", const unsigned timeout = 0);
+
 /** \brief Returns whether a document contains text or not.
  *
  *  If this returns false it is likely that the document contains only images.
@@ -40,6 +68,7 @@ bool PdfFileContainsNoText(const std::string &path);
 /** \brief Returns whether a document contains text or not.
  *
  *  If this returns false it is likely that the document contains only images.
+ *  \note  Works in-process where possible and falls back to pdffonts o/w.
  */
 bool PdfDocContainsNoText(const std::string &document);
 
@@ -53,6 +82,11 @@ bool GetTextFromImage(const std::string &img_path, const std::string &tesseract_
 bool GetTextFromImagePDF(const std::string &pdf_document, const std::string &tesseract_language_code,
                          std::string * const extracted_text, unsigned timeout=DEFAULT_PDF_EXTRACTION_TIMEOUT /* in s */);
 
+
+/** \brief Like GetTextFromImagePDF() but for a PDF document that is already stored in a file. */
+bool GetTextFromImagePDFFile(const std::string &path, const std::string &tesseract_language_code,
+                             std::string * const extracted_text, unsigned timeout=DEFAULT_PDF_EXTRACTION_TIMEOUT /* in s */);
+
 /** \brief Convert pdf to image and then attempt tesseract OCR. */
 bool GetOCRedTextFromPDF(const std::string &pdf_document_path, const std::string &tesseract_language_code,
                          std::string * const extracted_text, unsigned timeout=DEFAULT_PDF_EXTRACTION_TIMEOUT);
@@ -0,0 +1,180 @@
+/** \brief Perfect hash tables for static key sets that are looked up very frequently.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include "Compiler.h"
+#include "StringView.h"
+#include "util.h"
+
+
+namespace PerfectHash {
+
+
+constexpr uint32_t NO_INDEX = UINT32_MAX;
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+
+inline uint64_t HashBytes(const char *data, size_t length, uint64_t hash) {
+    for (/* Intentionally empty! */; length > 0; --length, ++data) {
+        hash ^= static_cast<unsigned char>(*data);
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+inline uint64_t HashBytes(const std::string &s, const uint64_t hash) { return HashBytes(s.data(), s.size(), hash); }
+
+
+// FNV-1a alone distributes short, similar keys poorly over the low bits, hence the final avalanche step.
+inline uint64_t Avalanche(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+/** \return The initial FNV-1a state for "seed". */
+inline uint64_t SeedState(const uint32_t seed) { return FNV_OFFSET_BASIS ^ (seed * 0x9E3779B97F4A7C15ULL); }
+
+
+inline uint64_t HashString(const StringView &s, const uint32_t seed) {
+    return Avalanche(HashBytes(s.data(), s.size(), SeedState(seed)));
+}
+
+
+/** \brief Builds a perfect hash table using the "hash and displace" method: keys are first distributed over buckets w/
+ *         seed 0 and then, largest bucket first, we search for a seed for each bucket that maps all of its keys to
+ *         slots that are still free.
+ *  \param hash   Called as hash(key_index, seed).
+ *  \param slots  On return, each slot contains either the index of a key or NO_INDEX.
+ *  \note  The keys must be distinct.
+ */
+template<typename HashFunction> void BuildTable(const size_t key_count, const HashFunction &hash,
+                                                std::vector<uint32_t> * const seeds, std::vector<uint32_t> * const slots)
+{
+    const size_t bucket_count(std::max(key_count / 2, static_cast<size_t>(1)));
+    const size_t slot_count(key_count + key_count / 4 + 1); // A load factor of 0.8 keeps the seed search short.
+
+    std::vector<std::vector<uint32_t>> buckets(bucket_count);
+    for (size_t key_index(0); key_index < key_count; ++key_index)
+        buckets[hash(key_index, 0) % bucket_count].emplace_back(key_index);
+
+    std::vector<uint32_t> bucket_order(bucket_count);
+    std::iota(bucket_order.begin(), bucket_order.end(), 0);
+    std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](const uint32_t bucket1, const uint32_t bucket2) {
+        return buckets[bucket1].size() > buckets[bucket2].size();
+    });
+
+    seeds->assign(bucket_count, 0);
+    slots->assign(slot_count, NO_INDEX);
+    std::vector<size_t> candidate_slots;
+    for (const auto bucket_index : bucket_order) {
+        const auto &bucket(buckets[bucket_index]);
+        if (bucket.empty())
+            break;
+
+        const uint32_t MAX_SEED(1u << 20);
+        uint32_t seed(1);
+        for (/* Intentionally empty! */; seed < MAX_SEED; ++seed) {
+            candidate_slots.clear();
+            for (const auto key_index : bucket) {
+                const size_t slot(hash(key_index, seed) % slot_count);
+                if ((*slots)[slot] != NO_INDEX
+                    or std::find(candidate_slots.cbegin(), candidate_slots.cend(), slot) != candidate_slots.cend())
+                    break;
+                candidate_slots.emplace_back(slot);
+            }
+            if (candidate_slots.size() == bucket.size())
+                break;
+        }
+        if (unlikely(seed == MAX_SEED))
+            LOG_ERROR("failed to find a perfect hash function, are there duplicate keys?");
+
+        (*seeds)[bucket_index] = seed;
+        for (size_t i(0); i < bucket.size(); ++i)
+            (*slots)[candidate_slots[i]] = bucket[i];
+    }
+}
+
+
+/** \param hash  Called as hash(seed).
+ *  \return The index of the only key that may be equal to the hashed key or NO_INDEX.  The caller has to compare the
+ *          keys in order to detect keys that are not in the table.
+ */
+template<typename HashFunction> inline uint32_t LookupTable(const std::vector<uint32_t> &seeds,
+                                                            const std::vector<uint32_t> &slots, const HashFunction &hash)
+{
+    return slots[hash(seeds[hash(0) % seeds.size()]) % slots.size()];
+}
+
+
+/** \class StringMap
+ *  \brief An immutable map from strings to values.  A lookup costs two hash computations over the key and a single key
+ *         comparison and never allocates memory.
+ */
+template<typename Value> class StringMap {
+    std::vector<std::pair<std::string, Value>> keys_and_values_;
+    std::vector<uint32_t> seeds_, slots_;
+public:
+    /** \note Aborts if there are duplicate keys. */
+    explicit StringMap(std::vector<std::pair<std::string, Value>> keys_and_values = {});
+
+    inline size_t size() const { return keys_and_values_.size(); }
+    inline bool empty() const { return keys_and_values_.empty(); }
+
+    /** \return A pointer to the value for "key" or nullptr if "key" is not in the map. */
+    inline const Value *find(const StringView &key) const {
+        const uint32_t index(LookupTable(seeds_, slots_, [&key](const uint32_t seed) { return HashString(key, seed); }));
+        if (index == NO_INDEX or StringView(keys_and_values_[index].first) != key)
+            return nullptr;
+        return &keys_and_values_[index].second;
+    }
+};
+
+
+template<typename Value> StringMap<Value>::StringMap(std::vector<std::pair<std::string, Value>> keys_and_values)
+    : keys_and_values_(std::move(keys_and_values))
+{
+    std::vector<StringView> sorted_keys;
+    sorted_keys.reserve(keys_and_values_.size());
+    for (const auto &key_and_value : keys_and_values_)
+        sorted_keys.emplace_back(key_and_value.first);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    const auto duplicate_key(std::adjacent_find(sorted_keys.cbegin(), sorted_keys.cend()));
+    if (unlikely(duplicate_key != sorted_keys.cend()))
+        LOG_ERROR("duplicate key \"" + duplicate_key->toString() + "\"!");
+
+    BuildTable(keys_and_values_.size(), [this](const size_t key_index, const uint32_t seed) {
+                   return HashString(keys_and_values_[key_index].first, seed);
+               }, &seeds_, &slots_);
+}
+
+
+} // namespace PerfectHash
@@ -20,23 +20,38 @@
 #pragma once
 
 
+#include <memory>
 #include <string>
 #include <stdexcept>
 #include <vector>
 #include <pcre.h>
+#include "StringView.h"
 
 
 /** \class RegexMatcher
  *  \brief Wrapper class for simple use cases of the PCRE library and UTF-8 strings.
+ *  \note  Patterns are JIT compiled if the PCRE library supports it.  Compiled patterns are cached and shared by all matchers w/
+ *         the same pattern and options, but a single RegexMatcher instance must not be used by more than one thread at a time.
  */
 class RegexMatcher {
+    friend class RegexSet;
+
+    // Immutable once constructed, which is why it can be shared across threads.
+    struct CompiledPattern {
+        pcre *pcre_;
+        pcre_extra *pcre_extra_;
+    public:
+        CompiledPattern(pcre * const pcre_arg, pcre_extra * const pcre_extra_arg): pcre_(pcre_arg), pcre_extra_(pcre_extra_arg) { }
+        ~CompiledPattern();
+    };
+
     static bool utf8_configured_;
     std::string pattern_;
     unsigned options_;
-    pcre *pcre_;
-    pcre_extra* pcre_extra_;
+    std::shared_ptr<const CompiledPattern> compiled_pattern_;
     static constexpr size_t MAX_SUBSTRING_MATCHES = 20;
     mutable std::string last_subject_;
+    mutable StringView last_subject_view_; // Either refers to "last_subject_" or to a subject that was passed in as a StringView.
     mutable std::vector<int> substr_vector_;
     mutable unsigned last_match_count_;
 public:
@@ -49,10 +64,7 @@ public:
     RegexMatcher(RegexMatcher &&that);
 
     /** Destructor. */
-    virtual ~RegexMatcher() {
-        ::pcre_free_study(pcre_extra_);
-        ::pcre_free(pcre_);
-    }
+    virtual ~RegexMatcher() = default;
 
     /** Returns true if "s" was matched, false, if an error occurred or no match was found. In the case of an
      *  error "err_msg", if provided, will be set to a non-empty string, otherwise "err_msg" will be cleared.
@@ -65,6 +77,21 @@ public:
     bool matched(const std::string &subject, const size_t subject_start_offset, std::string * const err_msg = nullptr,
                  size_t * const start_pos = nullptr, size_t * const end_pos = nullptr);
 
+    /** \brief Like the std::string versions but w/o copying "subject".
+     *  \note  The memory referenced by "subject" has to stay valid for as long as operator[] is used to access the
+     *         matched groups.
+     */
+    inline bool matched(const StringView &subject, std::string * const err_msg = nullptr, size_t * const start_pos = nullptr,
+                        size_t * const end_pos = nullptr)
+        { return matched(subject, 0, err_msg, start_pos, end_pos); }
+    bool matched(const StringView &subject, const size_t subject_start_offset, std::string * const err_msg = nullptr,
+                 size_t * const start_pos = nullptr, size_t * const end_pos = nullptr);
+
+    // Needed to resolve the ambiguity between the std::string and StringView versions for string literals.
+    inline bool matched(const char * const subject, std::string * const err_msg = nullptr, size_t * const start_pos = nullptr,
+                        size_t * const end_pos = nullptr)
+        { return matched(std::string(subject), 0, err_msg, start_pos, end_pos); }
+
     // Replaces all matches of the pattern with the replacement string.
     std::string replaceAll(const std::string &subject, const std::string &replacement);
 
@@ -114,8 +141,71 @@ public:
     static bool Matched(const std::string &regex, const std::string &subject, const unsigned options = 0,
                         std::string * const err_msg = nullptr, size_t * const start_pos = nullptr, size_t * const end_pos = nullptr);
 private:
-    RegexMatcher(const std::string &pattern, const unsigned options, pcre * const pcre_arg,
-                 pcre_extra * const pcre_extra_arg)
-        : pattern_(pattern), options_(options), pcre_(pcre_arg), pcre_extra_(pcre_extra_arg),
+    RegexMatcher(const std::string &pattern, const unsigned options, const std::shared_ptr<const CompiledPattern> &compiled_pattern)
+        : pattern_(pattern), options_(options), compiled_pattern_(compiled_pattern),
           substr_vector_((1 + MAX_SUBSTRING_MATCHES) * 3), last_match_count_(0) {}
+
+    /** \return nullptr if "pattern" failed to compile and then also sets "err_msg". */
+    static std::shared_ptr<const CompiledPattern> GetCompiledPattern(const std::string &pattern, const unsigned options,
+                                                                     std::string * const err_msg);
+    void copyLastSubject(const RegexMatcher &that);
+
+    /** \brief A wrapper around pcre_exec() which falls back to the interpreter if the JIT stack is exhausted.
+     *  \return See pcre_exec(3).
+     */
+    static int Execute(const CompiledPattern &compiled_pattern, const StringView &subject, const size_t subject_start_offset,
+                       int * const ovector, const size_t ovector_size);
+};
+
+
+/** \class RegexSet
+ *  \brief Matches a subject against many patterns at once.
+ *  \note  Runs of patterns are combined into alternations, so a failed match against a whole run costs a single PCRE call.
+ *         Patterns that can't safely be combined, see IsCombinable(), are matched on their own.
+ *  \note  Unlike RegexMatcher, instances of this class can be used by any number of threads concurrently.
+ */
+class RegexSet {
+    struct Group {
+        std::shared_ptr<const RegexMatcher::CompiledPattern> combined_pattern_; // nullptr if there is only one pattern.
+        size_t first_pattern_, end_pattern_;
+        bool combinable_;
+    public:
+        Group(const size_t first_pattern, const bool combinable)
+            : first_pattern_(first_pattern), end_pattern_(first_pattern + 1), combinable_(combinable) { }
+    };
+
+    static constexpr size_t MAX_GROUP_SIZE = 256;
+    unsigned options_;
+    std::vector<std::string> patterns_;
+    std::vector<std::shared_ptr<const RegexMatcher::CompiledPattern>> compiled_patterns_;
+    std::vector<Group> groups_;
+public:
+    /** \param options  Or'ed together values of type RegexMatcher::Option. */
+    explicit RegexSet(const unsigned options = 0): options_(options) { }
+    explicit RegexSet(const std::vector<std::string> &patterns, const unsigned options = 0);
+
+    inline bool empty() const { return patterns_.empty(); }
+    inline size_t size() const { return patterns_.size(); }
+    inline const std::vector<std::string> &getPatterns() const { return patterns_; }
+
+    /** \note Aborts if "pattern" fails to compile. */
+    void addPattern(const std::string &pattern);
+
+    bool matchedAny(const StringView &subject) const;
+
+    /** \brief  Determines the first of our patterns, in the order in which they were added, that matches "subject".
+     *  \return False if none matched.
+     */
+    bool matchedFirst(const StringView &subject, size_t * const pattern_index) const;
+
+    /** \return The indices of all patterns that matched "subject" in ascending order. */
+    std::vector<size_t> getMatchingPatterns(const StringView &subject) const;
+
+    /** \return False if "pattern" can't safely be embedded in an alternation w/ other patterns, e.g. because it contains
+     *          back-references whose group numbers would change.  We err on the side of caution.
+     */
+    static bool IsCombinable(const std::string &pattern);
+private:
+    static bool Matched(const RegexMatcher::CompiledPattern &compiled_pattern, const StringView &subject);
+    void combineWithLastGroup(const size_t pattern_index);
 };
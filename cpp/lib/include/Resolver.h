@@ -26,6 +26,7 @@
 #pragma once
 
 
+#include <condition_variable>
 #include <list>
 #include <mutex>
 #include <set>
@@ -197,25 +198,67 @@ private:
 
 
 /** \class  ThreadSafeDnsCache
- *  \brief  A thread-safe DNS lookup cache.
+ *  \brief  A thread-safe DNS lookup cache that honours TTL's and also remembers unresolvable hostnames.
+ *  \note   The cache is split into shards w/ their own locks so that concurrent lookups of different hostnames rarely
+ *          contend for the same mutex.
  */
 class ThreadSafeDnsCache {
+public:
+    static const unsigned SHARD_COUNT          = 16;
+    static const unsigned MAX_SHARD_SIZE       = 100000 / SHARD_COUNT;
+    static const uint32_t MIN_TTL              = 30;    // In s.
+    static const uint32_t MAX_TTL              = 86400; // In s.
+    static const uint32_t DEFAULT_NEGATIVE_TTL = 300;   // In s.
+    static const unsigned HOT_HIT_COUNT        = 3;     // Entries w/ at least this many hits get refreshed before they expire.
+
+    enum LookupResult { NOT_CACHED, RESOLVED, UNRESOLVABLE };
+private:
     struct ThreadSafeDnsCacheEntry {
         time_t expire_time_;
-        std::set<in_addr_t> ip_addresses_;
+        time_t prefetch_time_; // After this we're willing to refresh the entry of a hot hostname.
+        std::set<in_addr_t> ip_addresses_; // Empty for unresolvable hostnames.
+        unsigned hit_count_;
+        bool prefetch_pending_;
     public:
-        ThreadSafeDnsCacheEntry(const time_t expire_time, const std::set<in_addr_t> &ip_addresses)
-            : expire_time_(expire_time), ip_addresses_(ip_addresses) { }
+        ThreadSafeDnsCacheEntry(const time_t now, const uint32_t ttl, const std::set<in_addr_t> &ip_addresses)
+            : expire_time_(now + ttl), prefetch_time_(expire_time_ - ttl / 10), ip_addresses_(ip_addresses),
+              hit_count_(0), prefetch_pending_(false) { }
     };
-    std::unordered_map<std::string, ThreadSafeDnsCacheEntry> resolved_hostnames_cache_;
-    std::mutex cache_access_mutex_;
+    struct Shard {
+        std::unordered_map<std::string, ThreadSafeDnsCacheEntry> resolved_hostnames_cache_;
+        std::mutex cache_access_mutex_;
+    } shards_[SHARD_COUNT];
+    const uint32_t negative_ttl_;
 public:
-    ThreadSafeDnsCache() { }
-    bool lookup(const std::string &hostname, std::set<in_addr_t> * const ip_addresses);
+    explicit ThreadSafeDnsCache(const uint32_t negative_ttl = DEFAULT_NEGATIVE_TTL): negative_ttl_(negative_ttl) { }
+
+    /** \brief  Looks up "hostname".
+     *  \param  ip_addresses    Where to store the cached IP addresses, if we have any.
+     *  \param  needs_prefetch  If non-nullptr, will be set to true if "hostname" is frequently used and will expire
+     *                          soon.  Only one caller per entry and TTL will be asked to refresh it, which should be
+     *                          done by calling insert() or insertUnresolvable() w/ the result of a new lookup.
+     */
+    LookupResult lookup(const std::string &hostname, std::set<in_addr_t> * const ip_addresses,
+                        bool * const needs_prefetch = nullptr);
+
+    /** \note "ttl" will be clamped to [MIN_TTL, MAX_TTL]. */
     void insert(const std::string &hostname, const std::set<in_addr_t> &ip_addresses, const uint32_t ttl);
+
+    /** \brief Caches a negative lookup result for "negative_ttl" seconds as set in the constructor. */
+    void insertUnresolvable(const std::string &hostname);
+
+    /** \return True if we have a resolved or unresolvable entry for "hostname", else false.
+     *  \note   Unlike lookup() this does not count as a use of "hostname".
+     */
+    bool contains(const std::string &hostname);
+
+    /** \brief Allows another caller to refresh "hostname" after a failed prefetch. */
+    void cancelPrefetch(const std::string &hostname);
 private:
     ThreadSafeDnsCache(const ThreadSafeDnsCache &rhs);                 // Intentionally unimplemented!
     const ThreadSafeDnsCache operator=(const ThreadSafeDnsCache &rhs); // Intentionally unimplemented!
+    Shard &getShard(const std::string &hostname) { return shards_[std::hash<std::string>()(hostname) % SHARD_COUNT]; }
+    void insertEntry(const std::string &hostname, const std::set<in_addr_t> &ip_addresses, const uint32_t ttl);
 };
 
 
@@ -230,27 +273,65 @@ class SimpleResolver {
     std::mutex dns_server_ip_addresses_and_busy_count_access_mutex_;
     uint16_t next_request_id_;
     std::mutex request_id_mutex_;
+    const unsigned max_in_flight_queries_;
+    unsigned available_query_slots_;
+    std::mutex query_slots_mutex_;
+    std::condition_variable query_slots_condition_;
+    static const size_t MAX_UDP_REPLY_PACKET_SIZE = 512;
+public:
+    static const unsigned DEFAULT_MAX_IN_FLIGHT_QUERIES = 64;
 public:
     /** \brief  Creates a resolver.
-     *  \param  dns_servers  If non-empty these DNS servers will be used.  Otherwise  DNS servers in listed ETC_DIR "/Resolver.conf" and if that
-     *                       doesn't exist from servers listed in /etc/resolv.conf will be used.
+     *  \param  dns_servers            If non-empty these DNS servers will be used.  Otherwise  DNS servers in listed ETC_DIR "/Resolver.conf" and if that
+     *                                 doesn't exist from servers listed in /etc/resolv.conf will be used.
+     *  \param  max_in_flight_queries  Up to how many queries we will have outstanding w/ our DNS servers at any time, summed over all threads.
+     *  \param  negative_ttl           For how long, in seconds, we remember that a hostname could not be resolved.
      */
-    explicit SimpleResolver(const std::vector<std::string> &dns_servers = std::vector<std::string>());
+    explicit SimpleResolver(const std::vector<std::string> &dns_servers = std::vector<std::string>(),
+                            const unsigned max_in_flight_queries = DEFAULT_MAX_IN_FLIGHT_QUERIES,
+                            const uint32_t negative_ttl = ThreadSafeDnsCache::DEFAULT_NEGATIVE_TTL);
 
     /** \brief  Attempts to resolve a hostname to one or more IP addresses.
      *  \param  hostname      The hostname to resolve.  Is allowed to be an IP address.
      *  \param  time_limit    Lookup time limit in milliseconds.
      *  \param  ip_addresses  If the lookup succeeds, this is where some or all of the IP addresses corresponding to "hostname" will be returned.
      *  \return True if the lookup succeeded or false if the lookup failed within the given time constraints.
+     *  \note   Frequently used hostnames are refreshed shortly before their cache entries expire.  Only the caller that gets to do the refresh
+     *          will wait for a DNS server, everybody else is served from the cache.
      */
     bool resolve(const std::string &hostname, const TimeLimit &time_limit, std::set<in_addr_t> * const ip_addresses);
+
+    /** \brief  Resolves "hostnames" concurrently over a single non-blocking socket and stores the results in our cache.
+     *  \param  hostnames   Hostnames we will probably need soon, e.g. those of the links of a freshly downloaded Web page.
+     *  \param  time_limit  Overall time limit in milliseconds.
+     *  \return The number of hostnames that are cached as either resolved or unresolvable upon return.
+     *  \note   Up to "max_in_flight_queries" queries will be outstanding at any time.
+     */
+    unsigned prefetch(const std::vector<std::string> &hostnames, const TimeLimit &time_limit);
+
+    /** \return A process-wide instance using the default DNS servers. */
+    static SimpleResolver &GetDefaultInstance();
 private:
     SimpleResolver(const SimpleResolver &rhs);                 // Intentionally unimplemented!
     const SimpleResolver operator=(const SimpleResolver &rhs); // Intentionally unimplemented!
     void init(const std::vector<std::string> &dns_servers, ThreadSafeDnsCache * const cache);
+    bool lookUp(const std::string &hostname, const TimeLimit &time_limit, std::set<in_addr_t> * const ip_addresses);
     in_addr_t getLeastBusyDnsServerAndIncUsageCount();
     void decDnsServerUsageCount(const in_addr_t server_ip_address);
     uint16_t getNextRequestId();
-    bool processServerReply(const unsigned char * const reply_packet, const size_t reply_packet_size, const uint16_t expected_reply_id,
-                            std::set<in_addr_t> * const ip_addresses);
+
+    /** \brief  Blocks until at least one query slot is available.
+     *  \return The number of acquired slots, between 1 and "max_count".
+     */
+    unsigned acquireQuerySlots(const unsigned max_count);
+
+    void releaseQuerySlots(const unsigned count);
+    void sendRequest(const int udp_fd, const std::string &hostname, const in_addr_t resolver_address, const uint16_t request_id);
+
+    // GARBLED_REPLY's are ignored and FAILED_REPLY's are replies that we can't cache, e.g. truncated ones.
+    enum ReplyType { GARBLED_REPLY, FAILED_REPLY, RESOLVED_REPLY, UNRESOLVABLE_REPLY };
+
+    /** \brief Decodes "reply_packet", which should be the answer to our query for "hostname", and updates our cache. */
+    ReplyType processServerReply(const unsigned char * const reply_packet, const size_t reply_packet_size, const uint16_t expected_reply_id,
+                                 const std::string &hostname, std::set<in_addr_t> * const ip_addresses);
 };
@@ -27,6 +27,8 @@
 #pragma once
 
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <cinttypes>
@@ -145,41 +147,79 @@ private:
 
 
 /** \class  RobotsDotTxtCache
- *  \brief  Implements a cache of robots.txt objects as a threadsafe singleton.
+ *  \brief  Implements a process-wide cache of parsed robots.txt objects as a threadsafe singleton.
+ *  \note   Entries are keyed by the URL of the robots.txt file, i.e. by scheme, authority and port, and expire after a
+ *          configurable time-to-live.  Lookups never block: they work on an immutable snapshot of the cache which
+ *          writers replace atomically.
  */
 class RobotsDotTxtCache {
-    unsigned max_cache_size_;
-    std::unordered_map<std::string, RobotsDotTxt *> hostname_to_robots_dot_txt_map_;
-    static std::mutex mutex_;
-    static RobotsDotTxtCache *the_singleton_;
+public:
+    static const unsigned DEFAULT_MAX_CACHE_SIZE = 10000;
+    static const unsigned DEFAULT_TIME_TO_LIVE   = 86400; // in seconds
+private:
+    struct Entry {
+        RobotsDotTxt robots_dot_txt_;
+        std::string robots_dot_txt_contents_; // Needed for snapshots.
+        time_t expiration_time_;
+        Entry(const std::string &robots_dot_txt_contents, const time_t expiration_time)
+            : robots_dot_txt_(robots_dot_txt_contents), robots_dot_txt_contents_(robots_dot_txt_contents),
+              expiration_time_(expiration_time) { }
+    };
+    typedef std::unordered_map<std::string, std::shared_ptr<const Entry>> KeyToEntryMap;
+
+    std::atomic<unsigned> max_cache_size_, time_to_live_;
+    std::shared_ptr<const KeyToEntryMap> key_to_entry_map_; // Only access w/ std::atomic_load and std::atomic_store!
+    static std::mutex mutex_; // Serialises writers.
 public:
     void clear();
 
-    /** \brief  Associates a robots.txt entry with a hostname.
-     *  \param  new_hostname        The hostname (key) to associate with "new_robots_dot_txt."
-     *  \param  new_robots_dot_txt  The contents of a robots.txt file.
+    /** \brief  Parses "robots_dot_txt_contents" and associates the result with "robots_dot_txt_url".
+     *  \param  robots_dot_txt_url       The URL of a robots.txt file, typically generated by Url::getRobotsDotTxtUrl().
+     *  \param  robots_dot_txt_contents  The contents of the robots.txt file, use an empty string if none was found.
+     *  \return The newly parsed robots.txt object.
      */
-    void insert(const std::string &new_hostname, const std::string &new_robots_dot_txt);
+    std::shared_ptr<const RobotsDotTxt> insert(const std::string &robots_dot_txt_url,
+                                               const std::string &robots_dot_txt_contents);
 
-    /** Adds a robots.txt reference for the robots.txt associated with "original_hostname".  Throws an
-        exception if no robots.txt entry can be found for "original_hostname." */
-    void addAlias(const std::string &original_hostname, const std::string &new_hostname);
+    /** Adds a robots.txt reference for the robots.txt associated with "original_robots_dot_txt_url".  Throws an
+        exception if no robots.txt entry can be found for "original_robots_dot_txt_url." */
+    void addAlias(const std::string &original_robots_dot_txt_url, const std::string &new_robots_dot_txt_url);
 
-    bool hasHostname(const std::string &hostname) const;
+    bool hasEntry(const std::string &robots_dot_txt_url) const {
+        return getRobotsDotTxt(robots_dot_txt_url) != nullptr;
+    }
 
     unsigned getMaxCacheSize() const { return max_cache_size_; }
     void setMaxCacheSize(const unsigned new_max_cache_size);
 
-    /** Returns the RobotsDotTxt for "hostname" or nullptr if "hostname" has not been found. */
-    const RobotsDotTxt *getRobotsDotTxt(const std::string &hostname) const;
+    unsigned getTimeToLive() const { return time_to_live_; }
+
+    /** \note  Only affects entries inserted after the call. */
+    void setTimeToLive(const unsigned new_time_to_live) { time_to_live_ = new_time_to_live; }
+
+    /** Returns the RobotsDotTxt for "robots_dot_txt_url" or nullptr if no unexpired entry has been found. */
+    std::shared_ptr<const RobotsDotTxt> getRobotsDotTxt(const std::string &robots_dot_txt_url) const;
+
+    /** \brief  Writes all unexpired entries to "snapshot_filename" so that a later process can reuse them. */
+    void saveSnapshot(const std::string &snapshot_filename) const;
+
+    /** \brief  Adds the unexpired entries of a snapshot written by saveSnapshot() to the cache.
+     *  \return The number of entries that were added.
+     */
+    unsigned loadSnapshot(const std::string &snapshot_filename);
 
     static RobotsDotTxtCache &GetInstance();
 private:
-    RobotsDotTxtCache(): max_cache_size_(10000) { }
-    ~RobotsDotTxtCache() { clear(); }
+    RobotsDotTxtCache()
+        : max_cache_size_(DEFAULT_MAX_CACHE_SIZE), time_to_live_(DEFAULT_TIME_TO_LIVE),
+          key_to_entry_map_(std::make_shared<const KeyToEntryMap>()) { }
+    ~RobotsDotTxtCache() = default;
 
     RobotsDotTxtCache(const RobotsDotTxtCache &rhs) = delete;
     const RobotsDotTxtCache &operator=(const RobotsDotTxtCache &rhs) = delete;
 
-    void nonThreadSafeClear();
+    /** \brief  Publishes a copy of the current snapshot w/o its expired entries but with "new_entries" added.
+     *  \note   Must be called w/ "mutex_" held.
+     */
+    void nonThreadSafeInsert(const KeyToEntryMap &new_entries);
 };
@@ -0,0 +1,182 @@
+/** \brief Vectorised scanning of character buffers for small sets of special characters.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <cstring>
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+#include "Compiler.h"
+#include "StringView.h"
+
+
+namespace ScanUtil {
+
+
+// Sets with more members than this are scanned one byte at a time.
+constexpr size_t MAX_VECTORISED_SET_SIZE(8);
+
+
+/** \return A pointer to the first occurrence of "ch" in [start, end) or "end" if "ch" does not occur. */
+inline const char *FindChar(const char * const start, const char * const end, const char ch) {
+    const void * const match(std::memchr(start, ch, end - start));
+    return (match == nullptr) ? end : reinterpret_cast<const char *>(match);
+}
+
+
+/** \return A pointer to the first occurrence of any of the characters in "chars" in [start, end) or "end" if none of
+ *          them occur.
+ *  \note   We use AVX2 or SSE2 if the compiler targets them, we're built w/ -march=native, and "chars" has no more than
+ *          MAX_VECTORISED_SET_SIZE members.  Otherwise, and for the tail of the buffer, we fall back to scalar code.
+ */
+inline const char *FindFirstOf(const char *start, const char * const end, const StringView &chars) {
+    if (unlikely(chars.empty()))
+        return end;
+    if (chars.size() == 1)
+        return FindChar(start, end, chars[0]);
+
+    if (chars.size() <= MAX_VECTORISED_SET_SIZE) {
+#if defined(__AVX2__)
+        __m256i wide_needles[MAX_VECTORISED_SET_SIZE];
+        for (size_t i(0); i < chars.size(); ++i)
+            wide_needles[i] = _mm256_set1_epi8(chars[i]);
+        while (end - start >= 32) {
+            const __m256i block(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(start)));
+            __m256i matches(_mm256_cmpeq_epi8(block, wide_needles[0]));
+            for (size_t i(1); i < chars.size(); ++i)
+                matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, wide_needles[i]));
+            const unsigned mask(static_cast<unsigned>(_mm256_movemask_epi8(matches)));
+            if (mask != 0)
+                return start + __builtin_ctz(mask);
+            start += 32;
+        }
+#endif
+#if defined(__SSE2__)
+        __m128i needles[MAX_VECTORISED_SET_SIZE];
+        for (size_t i(0); i < chars.size(); ++i)
+            needles[i] = _mm_set1_epi8(chars[i]);
+        while (end - start >= 16) {
+            const __m128i block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(start)));
+            __m128i matches(_mm_cmpeq_epi8(block, needles[0]));
+            for (size_t i(1); i < chars.size(); ++i)
+                matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[i]));
+            const unsigned mask(static_cast<unsigned>(_mm_movemask_epi8(matches)));
+            if (mask != 0)
+                return start + __builtin_ctz(mask);
+            start += 16;
+        }
+#endif
+    }
+
+    for (/* Intentionally empty! */; start < end; ++start) {
+        if (std::memchr(chars.data(), *start, chars.size()) != nullptr)
+            return start;
+    }
+
+    return end;
+}
+
+
+inline size_t FindFirstOf(const std::string &s, const StringView &chars, const size_t start_pos = 0) {
+    if (unlikely(start_pos >= s.size()))
+        return std::string::npos;
+    const char * const match(FindFirstOf(s.data() + start_pos, s.data() + s.size(), chars));
+    return (match == s.data() + s.size()) ? std::string::npos : match - s.data();
+}
+
+
+/** \return A pointer to the first byte in [start, end) that has its high bit set, i.e. that is not ASCII, or "end". */
+inline const char *FindFirstNonASCII(const char *start, const char * const end) {
+#if defined(__AVX2__)
+    while (end - start >= 32) {
+        const unsigned mask(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(start)))));
+        if (mask != 0)
+            return start + __builtin_ctz(mask);
+        start += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - start >= 16) {
+        const unsigned mask(static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(start)))));
+        if (mask != 0)
+            return start + __builtin_ctz(mask);
+        start += 16;
+    }
+#endif
+    for (/* Intentionally empty! */; start < end; ++start) {
+        if (static_cast<unsigned char>(*start) & 0x80u)
+            return start;
+    }
+
+    return end;
+}
+
+
+namespace detail {
+
+
+// Adds "delta" to all bytes in [first, last] and copies everything else unchanged.
+inline void MapASCIIRange(const char *start, const char * const end, char *output, const char first, const char last,
+                          const char delta)
+{
+#if defined(__AVX2__)
+    const __m256i wide_below_first(_mm256_set1_epi8(first - 1)), wide_above_last(_mm256_set1_epi8(last + 1)),
+                  wide_delta(_mm256_set1_epi8(delta));
+    while (end - start >= 32) {
+        const __m256i block(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(start)));
+        const __m256i in_range(_mm256_and_si256(_mm256_cmpgt_epi8(block, wide_below_first),
+                                                _mm256_cmpgt_epi8(wide_above_last, block)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                            _mm256_add_epi8(block, _mm256_and_si256(in_range, wide_delta)));
+        start += 32, output += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i below_first(_mm_set1_epi8(first - 1)), above_last(_mm_set1_epi8(last + 1)), delta_vector(_mm_set1_epi8(delta));
+    while (end - start >= 16) {
+        const __m128i block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(start)));
+        const __m128i in_range(_mm_and_si128(_mm_cmpgt_epi8(block, below_first), _mm_cmpgt_epi8(above_last, block)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_add_epi8(block, _mm_and_si128(in_range, delta_vector)));
+        start += 16, output += 16;
+    }
+#endif
+    for (/* Intentionally empty! */; start < end; ++start, ++output)
+        *output = (*start >= first and *start <= last) ? static_cast<char>(*start + delta) : *start;
+}
+
+
+} // namespace detail
+
+
+/** \brief Copies [start, end) to "output" while converting ASCII uppercase letters to lowercase.
+ *  \note  Bytes w/ the high bit set are copied unchanged, so this is only a complete case mapping for ASCII text.
+ */
+inline void ASCIIToLower(const char * const start, const char * const end, char * const output)
+    { detail::MapASCIIRange(start, end, output, 'A', 'Z', 'a' - 'A'); }
+
+
+/** \brief Like ASCIIToLower() but converts lowercase letters to uppercase. */
+inline void ASCIIToUpper(const char * const start, const char * const end, char * const output)
+    { detail::MapASCIIRange(start, end, output, 'a', 'z', 'A' - 'a'); }
+
+
+} // namespace ScanUtil
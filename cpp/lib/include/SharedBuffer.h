@@ -20,41 +20,161 @@
 #pragma once
 
 
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <utility>
+#include <vector>
+#include <cstdint>
 
 
-/** Implements a buffer or queue that can be shared between threads. */
+/** Implements a buffer or queue that can be shared between threads.
+ *  \note Producers block while the buffer is full, i.e. contains "high_watermark" items.  Once that has happened, they
+ *        will only be woken up after the consumers have drained the buffer down to "low_watermark" items.  This keeps
+ *        producers and consumers from waking each other up for every single item.
+ *  \note Items are moved in and out of the buffer, so move-only types like std::unique_ptr or MARC::Record can be used.
+ */
 template<typename ItemType> class SharedBuffer {
-    const size_t max_size_;
+public:
+    /** Lets you diagnose which side of a buffer is the bottleneck of a pipeline. */
+    struct Statistics {
+        uint64_t producer_wait_count_, producer_wait_time_; // The times are in microseconds.
+        uint64_t consumer_wait_count_, consumer_wait_time_;
+        size_t max_size_; // The largest number of items that were buffered at any one time.
+    public:
+        Statistics(): producer_wait_count_(0), producer_wait_time_(0), consumer_wait_count_(0), consumer_wait_time_(0),
+                      max_size_(0) { }
+    };
+private:
+    const size_t high_watermark_, low_watermark_;
     std::mutex mutex_;
-    std::condition_variable condition_;
+    std::condition_variable not_full_, not_empty_;
     std::deque<ItemType> buffer_;
+    bool draining_; // True after we reached the high watermark and until we're back down to the low watermark.
+    Statistics statistics_;
 public:
-    explicit SharedBuffer(const size_t max_size): max_size_(max_size) { }
+    explicit SharedBuffer(const size_t max_size): SharedBuffer(max_size, max_size - 1) { }
+
+    /** \param high_watermark  The maximum number of buffered items.  Must be at least 1.
+     *  \param low_watermark   Blocked producers will be woken up when we're back down to this many items.  Must be less
+     *                         than "high_watermark".
+     */
+    SharedBuffer(const size_t high_watermark, const size_t low_watermark)
+        : high_watermark_(high_watermark), low_watermark_(low_watermark), draining_(false) { }
 
     bool empty() {
         std::unique_lock<std::mutex> mutex_locker(mutex_);
-        volatile const bool is_empty(buffer_.empty());
-        return is_empty;
+        return buffer_.empty();
+    }
+
+    size_t size() {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        return buffer_.size();
     }
 
-    void push_back(const ItemType new_item) {
+    void push_back(const ItemType &new_item) {
         std::unique_lock<std::mutex> mutex_locker(mutex_);
-        condition_.wait(mutex_locker, [this](){ return buffer_.size() < max_size_; });
+        waitUntilNotFull(&mutex_locker);
         buffer_.emplace_back(new_item);
-        mutex_locker.unlock();
-        condition_.notify_all();
+        itemsAdded(&mutex_locker);
+    }
+
+    void push_back(ItemType &&new_item) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        waitUntilNotFull(&mutex_locker);
+        buffer_.emplace_back(std::move(new_item));
+        itemsAdded(&mutex_locker);
+    }
+
+    /** \brief Moves all of "new_items" into the buffer, acquiring the lock once per run of items that fit.
+     *  \note  "new_items" will be empty after the call.
+     */
+    void push_back_batch(std::vector<ItemType> * const new_items) {
+        auto next_item(new_items->begin());
+        while (next_item != new_items->end()) {
+            std::unique_lock<std::mutex> mutex_locker(mutex_);
+            waitUntilNotFull(&mutex_locker);
+            while (next_item != new_items->end() and buffer_.size() < high_watermark_)
+                buffer_.emplace_back(std::move(*next_item++));
+            itemsAdded(&mutex_locker);
+        }
+        new_items->clear();
     }
 
     ItemType pop_front() {
         std::unique_lock<std::mutex> mutex_locker(mutex_);
-        condition_.wait(mutex_locker, [this]() { return not buffer_.empty(); });
-        const ItemType item(buffer_.front());
+        waitUntilNotEmpty(&mutex_locker);
+        ItemType item(std::move(buffer_.front()));
         buffer_.pop_front();
-        mutex_locker.unlock();
-        condition_.notify_all();
+        itemsRemoved(&mutex_locker);
         return item;
     }
+
+    /** \brief Blocks until at least one item is available and then moves up to "max_count" items to the end of "items".
+     *  \return The number of items that were appended to "items".
+     */
+    size_t pop_front_batch(std::vector<ItemType> * const items, const size_t max_count) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        waitUntilNotEmpty(&mutex_locker);
+        size_t count(0);
+        for (/* Intentionally empty! */; count < max_count and not buffer_.empty(); ++count) {
+            items->emplace_back(std::move(buffer_.front()));
+            buffer_.pop_front();
+        }
+        itemsRemoved(&mutex_locker);
+        return count;
+    }
+
+    Statistics getStatistics() {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        return statistics_;
+    }
+private:
+    SharedBuffer(const SharedBuffer &rhs) = delete;
+    const SharedBuffer &operator=(const SharedBuffer &rhs) = delete;
+
+    static inline uint64_t MicrosecondsSince(const std::chrono::steady_clock::time_point &start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void waitUntilNotFull(std::unique_lock<std::mutex> * const mutex_locker) {
+        if (not draining_ and buffer_.size() < high_watermark_)
+            return;
+
+        const auto wait_start(std::chrono::steady_clock::now());
+        not_full_.wait(*mutex_locker, [this]() { return not draining_ and buffer_.size() < high_watermark_; });
+        ++statistics_.producer_wait_count_;
+        statistics_.producer_wait_time_ += MicrosecondsSince(wait_start);
+    }
+
+    void waitUntilNotEmpty(std::unique_lock<std::mutex> * const mutex_locker) {
+        if (not buffer_.empty())
+            return;
+
+        const auto wait_start(std::chrono::steady_clock::now());
+        not_empty_.wait(*mutex_locker, [this]() { return not buffer_.empty(); });
+        ++statistics_.consumer_wait_count_;
+        statistics_.consumer_wait_time_ += MicrosecondsSince(wait_start);
+    }
+
+    // Must be called w/ the mutex held which will be released.
+    void itemsAdded(std::unique_lock<std::mutex> * const mutex_locker) {
+        if (buffer_.size() > statistics_.max_size_)
+            statistics_.max_size_ = buffer_.size();
+        if (buffer_.size() >= high_watermark_)
+            draining_ = true;
+        mutex_locker->unlock();
+        not_empty_.notify_all();
+    }
+
+    // Must be called w/ the mutex held which will be released.
+    void itemsRemoved(std::unique_lock<std::mutex> * const mutex_locker) {
+        const bool wake_up_producers(draining_ and buffer_.size() <= low_watermark_);
+        if (wake_up_producers)
+            draining_ = false;
+        mutex_locker->unlock();
+        if (wake_up_producers)
+            not_full_.notify_all();
+    }
 };
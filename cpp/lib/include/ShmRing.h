@@ -0,0 +1,114 @@
+/** \brief A byte ring in POSIX shared memory that connects a writing and a reading process w/o a pipe.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+
+/** \class ShmRing
+ *  \brief A single-producer, single-consumer ring buffer in a named POSIX shared memory object, i.e. a file on the
+ *         tmpfs mounted on /dev/shm.
+ *  \note  The data area is mapped twice in a row, so that any span of up to getCapacity() bytes is contiguous in
+ *         memory, even if it wraps around.  A reader can therefore decode records in place.
+ *  \note  Both sides wait on futexes in the shared mapping and only wake the other side if it is actually waiting for
+ *         the amount of data or space that has become available.  As long as neither side has to wait, no system calls
+ *         are made at all.
+ *  \note  The writer creates the object, replacing any stale object of the same name, and the reader unlinks it as
+ *         soon as it has attached, so either side may be started first.  Readers ignore objects whose writer is no
+ *         longer alive, which is why writers don't exit before a reader has attached.  If the other process dies, the
+ *         waiting side aborts within about a second.
+ */
+class ShmRing {
+public:
+    enum Role { READER, WRITER };
+    static constexpr size_t DEFAULT_CAPACITY = 32 * 1024 * 1024;
+    static constexpr const char *PATH_PREFIX = "shm://";
+private:
+    struct Header;
+    const std::string name_;
+    const Role role_;
+    int fd_;
+    Header *header_;
+    char *data_;
+    size_t capacity_, mapping_size_;
+    uint64_t position_; // The write position for writers, the read position for readers.
+    bool closed_;
+public:
+    /** \param name      The name of the shared memory object, w/o slashes.
+     *  \param capacity  Only used by writers and rounded up to a multiple of the page size.  Readers use the capacity
+     *                   of the ring that they attach to.
+     *  \note  Readers wait for a writer to create the ring.
+     */
+    ShmRing(const std::string &name, const Role role, const size_t capacity = DEFAULT_CAPACITY);
+
+    /** \brief Writers close() the ring and wait for a reader to attach, readers let the writer know that they have gone
+     *         away.
+     */
+    ~ShmRing();
+
+    inline const std::string &getName() const { return name_; }
+    inline size_t getCapacity() const { return capacity_; }
+
+    /** \return A descriptor for the shared memory object, e.g. for fstat(2) or to wrap it in a File. */
+    inline int getFileDescriptor() const { return fd_; }
+
+    /** \return The number of bytes that we have committed or consumed so far. */
+    inline uint64_t tell() const { return position_; }
+
+    /** \brief Waits until "size" bytes are free.
+     *  \return Where to put up to "size" bytes.  They will only be seen by the reader after a call to commit().
+     */
+    char *reserve(const size_t size);
+
+    /** \brief Makes "size" bytes at the address returned by the preceding call to reserve() visible to the reader. */
+    void commit(const size_t size);
+
+    /** \brief Copies "size" bytes into the ring, waiting for space as often as necessary. */
+    void write(const char *data, size_t size);
+
+    /** \brief Tells the reader that no more data will follow.  Called by the destructor if necessary. */
+    void close();
+
+    /** \brief Waits until "size" bytes are available or the writer has closed the ring.
+     *  \return The number of available bytes which is only less than "size" if the writer has closed the ring.
+     */
+    size_t waitForData(const size_t size);
+
+    /** \return Where the available data starts.  See waitForData() for how much of it can be accessed. */
+    inline const char *getReadPointer() const { return data_ + position_ % capacity_; }
+
+    /** \brief Hands the first "size" available bytes back to the writer. */
+    void consume(const size_t size);
+
+    /** \return True if "path" starts w/ PATH_PREFIX, in which case the rest of "path" will be stored in "name". */
+    static bool ParsePath(const std::string &path, std::string * const name);
+private:
+    ShmRing(const ShmRing &rhs) = delete;
+    ShmRing &operator=(const ShmRing &rhs) = delete;
+
+    void createRing(const size_t capacity);
+    void attachToRing();
+    void mapRing(const size_t capacity);
+    void waitForReader();
+    void checkPeer(const pid_t peer_pid) const;
+};
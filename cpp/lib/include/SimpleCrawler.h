@@ -27,7 +27,9 @@
 #include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 #include <cerrno>
+#include <cinttypes>
 #include <cstring>
 #include "Downloader.h"
 #include "RegexMatcher.h"
@@ -37,6 +39,8 @@
 class SimpleCrawler {
     std::queue<std::string> url_queue_current_depth_;
     std::queue<std::string> url_queue_next_depth_;
+    std::unordered_set<uint64_t> seen_url_hashes_; // Of all URL's that we have queued so far.
+    std::unordered_set<std::string> next_depth_hostnames_; // Will be resolved in bulk before we switch to the next depth.
     unsigned remaining_crawl_depth_;
     Downloader downloader_;
     std::shared_ptr<RegexMatcher> url_regex_matcher_;
@@ -45,6 +49,7 @@ class SimpleCrawler {
 public:
     static const unsigned DEFAULT_TIMEOUT = 5000; // ms
     static const unsigned DEFAULT_MIN_URL_PROCESSING_TIME = 200; // ms
+    static const unsigned DEFAULT_MAX_CONCURRENT_HOSTS = 8;
 
     struct Params {
         std::string acceptable_languages_;
@@ -58,6 +63,7 @@ public:
         std::string url_ignore_pattern_;
         bool ignore_ssl_certificates_;
         std::string proxy_host_and_port_;
+        unsigned max_concurrent_hosts_; // Only used by ProcessSites().
     public:
         explicit Params(const std::string &acceptable_languages = "",
                         const unsigned timeout = DEFAULT_TIMEOUT,
@@ -69,7 +75,8 @@ public:
                         const std::string &user_agent = "ub_tools (https://ixtheo.de/docs/user_agents)",
                         const std::string &url_ignore_pattern = "(?i)\\.(js|css|bmp|pdf|jpg|gif|png|tif|tiff)(\\?[^?]*)?$",
                         const bool ignore_ssl_certificates_ = false,
-                        const std::string &proxy_host_and_port = ""
+                        const std::string &proxy_host_and_port = "",
+                        const unsigned max_concurrent_hosts = DEFAULT_MAX_CONCURRENT_HOSTS
                         );
         ~Params() = default;
     } params_;
@@ -110,8 +117,22 @@ public:
      */
     static void ProcessSite(const SiteDesc &site_desc, const Params &params, std::vector<std::string> * const extracted_urls);
 
+    /** \brief  Process all sites listed in "config_path" and return all URL's.
+     *  \note   Sites on different hosts are crawled concurrently, up to "params.max_concurrent_hosts_" at a time.
+     *          Sites on the same host are crawled one after the other, so that we never hit a host w/ more than one
+     *          request at a time.  The URL's are returned in the order of the sites in the config file.
+     */
     static void ProcessSites(const std::string &config_path, const Params &params, std::vector<std::string> * const extracted_urls);
 private:
+    /** \brief  Queues "url" for the next depth unless we have already seen it. */
+    void enqueueUrl(const std::string &url);
+
+    /** \brief  Makes sure that we wait at least as long between downloads as robots.txt asks us to. */
+    void applyCrawlDelay(const std::string &start_url);
+
+    /** \brief  Resolves the hosts of the next depth's URL's concurrently so that their downloads don't wait for DNS. */
+    void prefetchNextDepthHostnames();
+
     /** \brief  try to continue with the next url at the current depth
      *          if all is done at the current depth, switch to next depth
      *          returns false if no URL's are left or remaining depth is 0, else true
@@ -108,6 +108,25 @@ int TcpConnect(const std::string &address, const unsigned short port, const Time
                const ReuseAddrOptionType reuse_addr_option = DONT_REUSE_ADDR);
 
 
+/** \brief  Creates a non-blocking TCP socket and starts connecting it.
+ *  \param  address        The IP address to connect to.
+ *  \param  port           The TCP port number.
+ *  \param  error_message  The resulting error message (if any) from the connection attempt
+ *  \param  nagle_option   Enables of disables nagleing on the socket.
+ *  \return -1 on error or a valid socket file descriptor.
+ *  \note   The connection has usually not been established yet when we return.  Wait for the socket to become writable,
+ *          e.g. w/ an EventLoop, and then use GetPendingError() to find out whether the connection attempt succeeded.
+ */
+int NonblockingTcpConnect(const in_addr_t address, const unsigned short port, std::string * const error_message,
+                          const NagleOptionType nagle_option = USE_NAGLE);
+
+
+/** \return The pending error on "socket_fd", e.g. the outcome of a non-blocking connect(2), as an errno value or 0 if there
+ *          is none.
+ */
+int GetPendingError(const int socket_fd);
+
+
 /** \brief  Allows reading from a socket file descriptor with a given time limit.
  *  \param  socket_fd       The socket to read from.
  *  \param  time_limit      Timeout in milliseconds.
@@ -20,9 +20,15 @@
 #pragma once
 
 
+#include <functional>
+#include <memory>
 #include <string>
 
 
+class Downloader;
+namespace JSON { class ObjectNode; }
+
+
 namespace Solr {
 
 
@@ -41,12 +47,70 @@ enum QueryResultFormat { XML, JSON };
  *  \param  err_msg             An error message will be stored here if anything goes.
  *  \param  host_and_port       Where we want to contact a Solr instance.
  *  \param  timeout             Up to how long, in seconds, we're willing to wait for a response.
+ *  \param  filter_query        If non-empty, will be sent as the "fq" parameter, e.g. "{!terms f=superior_ppn}123,456".
  *  \return True if we got a valid response, else false.
  */
 bool Query(const std::string &query, const std::string &fields, std::string * const xml_or_json_result,
            std::string * const err_msg, const std::string &host_and_port = DEFAULT_HOST_AND_PORT,
            const unsigned timeout = DEFAULT_TIMEOUT, const QueryResultFormat query_result_format = XML,
-           const unsigned max_no_of_rows = JAVA_INT_MAX);
+           const unsigned max_no_of_rows = JAVA_INT_MAX, const std::string &filter_query = "");
+
+
+/** \class Client
+ *  \brief A Solr client that keeps its connection alive across queries and can retrieve result sets that are too large
+ *         for a single response.
+ *  \note  Instances must not be shared between threads.
+ */
+class Client {
+    std::string host_and_port_, core_;
+    unsigned timeout_; // in s
+    std::unique_ptr<Downloader> downloader_;
+public:
+    static constexpr unsigned DEFAULT_ROWS_PER_PAGE = 1000;
+
+    /** \return False if processing should be aborted. */
+    typedef std::function<bool(const std::shared_ptr<const JSON::ObjectNode> &document)> DocumentHandler;
+public:
+    explicit Client(const std::string &host_and_port = DEFAULT_HOST_AND_PORT, const unsigned timeout = DEFAULT_TIMEOUT,
+                    const std::string &core = "biblio");
+    ~Client();
+
+    /** \brief Like Solr::Query() but reuses our connection. */
+    bool query(const std::string &query, const std::string &fields, std::string * const xml_or_json_result,
+               std::string * const err_msg, const QueryResultFormat query_result_format = XML,
+               const unsigned max_no_of_rows = JAVA_INT_MAX, const std::string &filter_query = "");
+
+    /** \brief Sends a request w/ arbitrary parameters, e.g. JSON facets, to "request_handler" and retrieves the JSON response.
+     *  \param  url_parameters  Already URL-encoded parameters w/o a leading ampersand, e.g. "q=*%3A*&rows=0".
+     */
+    bool jsonRequest(const std::string &request_handler, const std::string &url_parameters, std::string * const json_result,
+                     std::string * const err_msg);
+
+    /** \brief Retrieves all matching documents page by page using Solr's "cursorMark" deep paging and hands them to
+     *         "document_handler" one at a time.
+     *  \param  sort  Has to include the unique key field, e.g. "id asc" or "last_modification_time desc,id asc".
+     *  \return False if a request failed, in which case "err_msg" will be set, or if "document_handler" returned false.
+     *  \note   Unlike large "rows" values, the cost of each request is independent of how deep we are in the result set.
+     */
+    bool queryAll(const std::string &query, const std::string &fields, const DocumentHandler &document_handler,
+                  std::string * const err_msg, const std::string &filter_query = "", const std::string &sort = "id asc",
+                  const unsigned rows_per_page = DEFAULT_ROWS_PER_PAGE);
+
+    /** \brief Streams all matching documents using Solr's "/export" request handler and hands them to "document_handler"
+     *         as soon as each of them has arrived.
+     *  \param  fields  All fields as well as all "sort" fields have to have docValues.
+     *  \param  sort    Mandatory for "/export", e.g. "id asc".
+     *  \return False if the request failed, in which case "err_msg" will be set, or if "document_handler" returned false.
+     *  \note   This is the fastest way to retrieve a huge number of documents, as Solr neither has to page nor to hold
+     *         the complete response in memory, and neither do we.
+     */
+    bool exportAll(const std::string &query, const std::string &fields, const std::string &sort,
+                   const DocumentHandler &document_handler, std::string * const err_msg, const std::string &filter_query = "");
+private:
+    std::string getBaseUrl(const std::string &request_handler) const;
+    bool download(const std::string &url, const QueryResultFormat result_format, std::string * const xml_or_json_result,
+                  std::string * const err_msg);
+};
 
 
 } // namespace Solr
@@ -44,6 +44,7 @@ public:
     };
     enum ClientServerMode { CLIENT, SERVER, CLIENT_AND_SERVER };
     enum ThreadingSupportMode { SUPPORT_MULTITHREADING, DO_NOT_SUPPORT_MULTITHREADING };
+    enum HandshakeMode { BLOCKING_HANDSHAKE, NONBLOCKING_HANDSHAKE };
 private:
     ThreadingSupportMode threading_support_mode_;
     SSL_CTX *ssl_context_;
@@ -65,10 +66,21 @@ public:
 private:
     static std::list<ContextInfo> context_infos_;
 public:
+    /** \param handshake_mode  If NONBLOCKING_HANDSHAKE, we don't attempt to connect and you have to call handshake()
+     *                         until it succeeds or fails.  This is what you want for non-blocking sockets.
+     */
     explicit SslConnection(const int fd, const Method method = ALL_STREAM_METHODS,
                            const ClientServerMode client_server_mode = CLIENT,
-                           const ThreadingSupportMode threading_support_mode = DO_NOT_SUPPORT_MULTITHREADING );
+                           const ThreadingSupportMode threading_support_mode = DO_NOT_SUPPORT_MULTITHREADING,
+                           const HandshakeMode handshake_mode = BLOCKING_HANDSHAKE);
     ~SslConnection();
+
+    /** \brief Advances the client-side TLS handshake on a non-blocking socket.
+     *  \return 1 if the handshake has been completed, 0 if we have to wait until the socket becomes readable or writable,
+     *          as indicated by getLastErrorCode() returning SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE, or -1 if the
+     *          handshake failed.
+     */
+    int handshake();
     ssize_t read(void * const data, size_t data_size);
     ssize_t write(const void * const data, size_t data_size);
     int getLastErrorCode() const;
@@ -2,6 +2,7 @@
 
 
 #include <string>
+#include <cinttypes>
 #ifndef LIBSTEMMER_H
 #       include "libstemmer.h"
 #       define LIBSTEMMER_H
@@ -32,3 +33,34 @@ public:
      */
     static const Stemmer *StemmerFactory(const std::string &language_name_or_code);
 };
+
+
+/** \class CachingStemmer
+ *  \brief A thread-safe front end for libstemmer that memoises the stems of recently seen words.
+ *  \note  Every thread gets its own sb_stemmer and its own cache per CachingStemmer, so no locking is needed while
+ *         stemming.  Each cache holds at most "max_cache_size" words and evicts the least recently used ones.
+ */
+class CachingStemmer {
+    const std::string language_name_or_code_;
+    const size_t max_cache_size_;
+    const uint64_t id_; // Unique over the lifetime of the process, selects our per-thread state.
+public:
+    static constexpr size_t DEFAULT_MAX_CACHE_SIZE = 100000;
+public:
+    /** \throws std::runtime_error if an unsupported language name or code was passed in. */
+    explicit CachingStemmer(const std::string &language_name_or_code, const size_t max_cache_size = DEFAULT_MAX_CACHE_SIZE);
+
+    /** \note May be called concurrently from any number of threads. */
+    std::string stem(const std::string &word) const;
+
+    inline const std::string &getLanguageNameOrCode() const { return language_name_or_code_; }
+
+    /** \brief Like Stemmer::StemmerFactory() but thread-safe and the returned stemmers can be used from any thread.
+     *  \return A pointer to a stemmer if we were able to construct one, o/w nullptr.
+     *  \warning  Never delete CachingStemmers returned by this factory!!
+     */
+    static const CachingStemmer *CachingStemmerFactory(const std::string &language_name_or_code);
+private:
+    CachingStemmer(const CachingStemmer &) = delete;
+    CachingStemmer &operator=(const CachingStemmer &) = delete;
+};
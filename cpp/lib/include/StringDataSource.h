@@ -46,6 +46,11 @@ public:
      *        you may call it again! */
     void putback(const char ch);
 
+    /** \brief  Appends all characters up to, but not including, the next occurrence of "terminator" to "s".
+     *  \return The number of appended characters.
+     */
+    size_t appendUntil(std::string * const s, const char terminator);
+
     /** \return The next character that get() would have returned.
      *  \note must not be called after get returned EOF!
      */
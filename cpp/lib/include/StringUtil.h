@@ -47,6 +47,7 @@
 #include <cstring>
 #include <inttypes.h>
 #include "Compiler.h"
+#include "StringView.h"
 
 
 #ifndef BITSPERBYTE
@@ -273,6 +274,12 @@ std::string Trim(const std::string &s, char trim_char=' ');
 std::string Trim(const std::string &trim_set, std::string * const s);
 
 
+/** \brief  Like the Trim() functions above but w/o copying.
+ *  \return A view of the part of "s" that remains after removing all leading and trailing characters that are in "trim_set".
+ */
+StringView TrimView(const StringView &s, const std::string &trim_set);
+
+
 /** \brief   Remove all occurences of a set of characters from either end of a string.
  *  \param   s          The string to trim.
  *  \param   trim_set  The set of characters to remove.
@@ -410,7 +417,7 @@ std::string FromHexString(const std::string &hex_string);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToNumber(const std::string &s, int * const n, const unsigned base = 10);
+bool ToNumber(const StringView &s, int * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a number.
@@ -421,7 +428,7 @@ bool ToNumber(const std::string &s, int * const n, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToNumber(const std::string &s, long * const n, const unsigned base = 10);
+bool ToNumber(const StringView &s, long * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a number.
@@ -432,7 +439,7 @@ bool ToNumber(const std::string &s, long * const n, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToNumber(const std::string &s, unsigned * const n, const unsigned base = 10);
+bool ToNumber(const StringView &s, unsigned * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a number.
@@ -445,7 +452,7 @@ bool ToNumber(const std::string &s, unsigned * const n, const unsigned base = 10
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-long ToNumber(const std::string &s, const unsigned base = 10);
+long ToNumber(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a short unsigned number.
@@ -458,7 +465,7 @@ long ToNumber(const std::string &s, const unsigned base = 10);
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-unsigned short ToUnsignedShort(const std::string &s, const unsigned base = 10);
+unsigned short ToUnsignedShort(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a short unsigned number.
@@ -469,7 +476,7 @@ unsigned short ToUnsignedShort(const std::string &s, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToUnsignedShort(const std::string &s, unsigned short * const n, const unsigned base = 10);
+bool ToUnsignedShort(const StringView &s, unsigned short * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into an unsigned number.
@@ -482,7 +489,7 @@ bool ToUnsignedShort(const std::string &s, unsigned short * const n, const unsig
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-unsigned ToUnsigned(const std::string &s, const unsigned base = 10);
+unsigned ToUnsigned(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into an unsigned number.
@@ -493,7 +500,26 @@ unsigned ToUnsigned(const std::string &s, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToUnsigned(const std::string &s, unsigned * const n, const unsigned base = 10);
+bool ToUnsigned(const StringView &s, unsigned * const n, const unsigned base = 10);
+
+
+/** \brief   Converts exactly "width" decimal digits, e.g. a MARC record length or directory entry component.
+ *  \param   digits  Points to the first digit.  No whitespace or signs are allowed.
+ *  \param   width   The number of digits.  Must be at most 9 as we don't check for overflows.
+ *  \param   n       Number that will hold the result.
+ *  \return  true if all "width" characters were decimal digits, false otherwise.
+ */
+inline bool FixedWidthToUnsigned(const char *digits, const unsigned width, unsigned * const n) {
+    unsigned value(0), non_digit_seen(0);
+    for (const char * const end(digits + width); digits != end; ++digits) {
+        const unsigned digit(static_cast<unsigned char>(*digits) - '0');
+        non_digit_seen |= digit > 9;
+        value = value * 10 + digit;
+    }
+    *n = value;
+
+    return non_digit_seen == 0;
+}
 
 
 /** \brief   Convert a string into a long unsigned number.
@@ -506,7 +532,7 @@ bool ToUnsigned(const std::string &s, unsigned * const n, const unsigned base =
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-unsigned long ToUnsignedLong(const std::string &s, const unsigned base = 10);
+unsigned long ToUnsignedLong(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a long unsigned number.
@@ -517,7 +543,7 @@ unsigned long ToUnsignedLong(const std::string &s, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToUnsignedLong(const std::string &s, unsigned long * const n, const unsigned base = 10);
+bool ToUnsignedLong(const StringView &s, unsigned long * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a long long unsigned number.
@@ -530,7 +556,7 @@ bool ToUnsignedLong(const std::string &s, unsigned long * const n, const unsigne
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-unsigned long long ToUnsignedLongLong(const std::string &s, const unsigned base = 10);
+unsigned long long ToUnsignedLongLong(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a long long unsigned number.
@@ -541,7 +567,7 @@ unsigned long long ToUnsignedLongLong(const std::string &s, const unsigned base
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToUnsignedLongLong(const std::string &s, unsigned long long * const n, const unsigned base = 10);
+bool ToUnsignedLongLong(const StringView &s, unsigned long long * const n, const unsigned base = 10);
 
 
 /** \brief   Convert a string into a uint64_t number.
@@ -552,7 +578,7 @@ bool ToUnsignedLongLong(const std::string &s, unsigned long long * const n, cons
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToUInt64T(const std::string &s, uint64_t * const n, const unsigned base = 0);
+bool ToUInt64T(const StringView &s, uint64_t * const n, const unsigned base = 0);
 
 
 /** \brief   Convert a string into a uint64_t number.
@@ -565,7 +591,7 @@ bool ToUInt64T(const std::string &s, uint64_t * const n, const unsigned base = 0
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-uint64_t ToUInt64T(const std::string &s, const unsigned base = 10);
+uint64_t ToUInt64T(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string into an int64_t number.
@@ -576,7 +602,7 @@ uint64_t ToUInt64T(const std::string &s, const unsigned base = 10);
  *                 with "0x" the base is assumed to be 16, in all other cases the base is assumed to be 10.
  *  \return  true if the conversion was successful, false otherwise.
  */
-bool ToInt64T(const std::string &s, int64_t * const n, const unsigned base = 0);
+bool ToInt64T(const StringView &s, int64_t * const n, const unsigned base = 0);
 
 
 /** \brief   Convert a string into a uint64_t number.
@@ -589,7 +615,7 @@ bool ToInt64T(const std::string &s, int64_t * const n, const unsigned base = 0);
  *  If the input is not comprised solely of digits (except for base "0" and a leading "0x"), then this function will
  *  generate an error.  (Unlike the other version, which will simply return false.)
  */
-int64_t ToInt64T(const std::string &s, const unsigned base = 10);
+int64_t ToInt64T(const StringView &s, const unsigned base = 10);
 
 
 /** \brief   Convert a string to a double-precision number.
@@ -600,8 +626,9 @@ int64_t ToInt64T(const std::string &s, const unsigned base = 10);
  *  \return  The converted number.
  *
  *  \note If the input is not well-formed, then this function will generate an error.
+ *  \note The conversion always uses the "C" locale, i.e. the decimal separator is a period.
  */
-bool ToDouble(const std::string &s, double * const n);
+bool ToDouble(const StringView &s, double * const n);
 
 
 /** \brief   Convert a string to a double-precision number.
@@ -611,7 +638,7 @@ bool ToDouble(const std::string &s, double * const n);
  *  If the input is not well-formed, then this function will generate an error.  (Unlike the other version, which will
  *  simply return false.)
  */
-double ToDouble(const std::string &s);
+double ToDouble(const StringView &s);
 
 
 /** \brief   Convert a string to a float-precision number.
@@ -619,7 +646,7 @@ double ToDouble(const std::string &s);
  *  \param   n     Number that will hold the result.
  *  \return  True if the conversion was successfyl, otherwise false.
  */
-bool ToFloat(const std::string &s, float * const n);
+bool ToFloat(const StringView &s, float * const n);
 
 
 /** \brief   Convert a string to a float-precision number.
@@ -629,7 +656,7 @@ bool ToFloat(const std::string &s, float * const n);
  *  If the input is not well-formed, then this function will generate an error.  (Unlike the other version, which will
  *  simply return false.)
  */
-float ToFloat(const std::string &s);
+float ToFloat(const StringView &s);
 
 
 /** \brief  Converts a string to a boolean value.
@@ -799,6 +826,53 @@ inline std::string BackslashEscape(const std::string &chars_to_escape, const std
 std::string ExtractHead(std::string * const target, const std::string &delimiter_string = " ", std::string::size_type start = 0);
 
 
+/** \class Splitter
+ *  \brief Lazily splits a string around any of a set of delimiter characters w/o copying anything.
+ *  \note  The fields are the same as those that Split() returns, i.e. an empty source has no fields and a delimiter at the
+ *         very end of the source does not start a final, empty field.
+ *  \note  Use like this:
+ *             for (const StringView field : StringUtil::Splitter(line, '|'))
+ *                 ...
+ *         The views point into the source which has to outlive them.
+ */
+class Splitter {
+    const char *next_; // nullptr after the last field.
+    const char *end_;
+    std::string delimiters_;
+    bool suppress_empty_fields_;
+public:
+    class const_iterator {
+        Splitter *splitter_; // nullptr for the end iterator.
+        StringView field_;
+    public:
+        explicit const_iterator(Splitter * const splitter): splitter_(splitter) { ++*this; }
+        inline const StringView &operator*() const { return field_; }
+        inline const StringView *operator->() const { return &field_; }
+        inline const_iterator &operator++() {
+            if (not splitter_->next(&field_))
+                splitter_ = nullptr;
+            return *this;
+        }
+        inline bool operator==(const const_iterator &rhs) const { return splitter_ == rhs.splitter_; }
+        inline bool operator!=(const const_iterator &rhs) const { return splitter_ != rhs.splitter_; }
+    private:
+        friend class Splitter;
+        const_iterator(): splitter_(nullptr) { }
+    };
+public:
+    Splitter(const StringView &source, const char delimiter, const bool suppress_empty_fields = false)
+        : Splitter(source, StringView(&delimiter, 1), suppress_empty_fields) { }
+    Splitter(const StringView &source, const StringView &delimiters, const bool suppress_empty_fields = false);
+
+    /** \return False if there are no more fields. */
+    bool next(StringView * const field);
+
+    // Single pass only!
+    inline const_iterator begin() { return const_iterator(this); }
+    inline const_iterator end() { return const_iterator(); }
+};
+
+
 /** \brief  Split a string around a delimiter string.
  *  \param  source                     The string to split.
  *  \param  delimiter_string           The string to split around.
@@ -905,6 +979,19 @@ template<typename StringType, typename InsertableContainer> unsigned Split(const
 }
 
 
+// A faster version of the above for the common case of std::string's.
+template<typename InsertableContainer> unsigned Split(const std::string &source, const char delimiter,
+                                                      InsertableContainer * const container,
+                                                      const bool suppress_empty_components = false)
+{
+    container->clear();
+    for (const StringView field : Splitter(source, delimiter, suppress_empty_components))
+        container->insert(container->end(), field.toString());
+
+    return container->size();
+}
+
+
 /** \brief  Split a string around any delimiter as specified by a set.
  *  \param  source                     The string to split.
  *  \param  delimiters                 The characters to split around.
@@ -997,27 +1084,12 @@ template<typename InsertableContainer> inline unsigned SplitThenTrim(const std::
 
     container->clear();
     unsigned count(0);
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end()) {
-        // We have the start of a new word:
-        std::string::const_iterator word_start(ch);
-
-        // Look for valid chars that may make up a word:
-        while (ch != s.end() and std::strchr(field_separators.c_str(), *ch) == nullptr)
-            ++ch;
-
-        // Extract the word:
-        std::string new_word(s.substr(word_start - s.begin(), ch - word_start));
-        StringUtil::Trim(trim_chars, &new_word);
-
+    for (const StringView field : Splitter(s, field_separators)) {
+        const StringView new_word(TrimView(field, trim_chars));
         if (not new_word.empty() or not suppress_empty_words) {
-            container->insert(container->end(), new_word);
+            container->insert(container->end(), new_word.toString());
             ++count;
         }
-
-        // Skip over separators:
-        if (ch != s.end() and std::strchr(field_separators.c_str(), *ch) != nullptr)
-            ++ch;
     }
 
     return count;
@@ -2068,6 +2140,38 @@ uint32_t Adler32(const char * const s, const size_t s_length);
 inline uint32_t Adler32(const std::string &s) { return Adler32(s.c_str(), s.size()); }
 
 
+/** \class   XXHash64
+ *  \brief   Incrementally calculates the 64 bit xxHash (XXH64) of a sequence of bytes.
+ *  \note    Splitting the input into different chunks does not change the result.
+ *  \warning Like Adler-32, this is not a cryptographic hash, but it is much faster than SHA-1 and has no known
+ *           weaknesses for short messages.
+ *  \note    See https://github.com/Cyan4973/xxHash for documentation.
+ */
+class XXHash64 {
+    const uint64_t seed_;
+    uint64_t accumulators_[4];
+    char buffer_[32]; // Bytes that don't yet make up a full 32-byte stripe.
+    size_t buffer_size_;
+    uint64_t total_length_;
+public:
+    explicit XXHash64(const uint64_t seed = 0);
+
+    void update(const char *data, size_t length);
+    inline void update(const std::string &s) { update(s.data(), s.size()); }
+    inline void update(const char ch) { update(&ch, 1); }
+
+    /** \return The hash of all the data passed to update() so far.  More data may be added afterwards. */
+    uint64_t digest() const;
+};
+
+
+inline uint64_t CalcXXHash64(const std::string &s) {
+    XXHash64 hash;
+    hash.update(s);
+    return hash.digest();
+}
+
+
 /** Returns the string of all chars that pass isprint(). */
 std::string GetPrintableChars();
 
@@ -0,0 +1,100 @@
+/** \brief A non-owning, read-only reference to a contiguous sequence of characters.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <iostream>
+#include <string>
+#include <cstring>
+
+
+/** \class StringView
+ *  \brief A poor man's std::string_view, as we can't rely on C++17 being available everywhere.
+ *  \warning A StringView never owns the referenced data.  It is the caller's responsibility to ensure that the referenced
+ *           characters outlive the StringView.
+ */
+class StringView {
+    const char *data_;
+    size_t size_;
+public:
+    typedef const char *const_iterator;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+public:
+    inline StringView(): data_(nullptr), size_(0) { }
+    inline StringView(const char * const data, const size_t size): data_(data), size_(size) { }
+    inline StringView(const char * const cstring): data_(cstring), size_(std::strlen(cstring)) { }
+    inline StringView(const std::string &s): data_(s.data()), size_(s.size()) { }
+    StringView(const StringView &other) = default;
+    StringView &operator=(const StringView &rhs) = default;
+
+    inline const char *data() const { return data_; }
+    inline size_t size() const { return size_; }
+    inline size_t length() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+    inline const_iterator begin() const { return data_; }
+    inline const_iterator end() const { return data_ + size_; }
+    inline char operator[](const size_t index) const { return data_[index]; }
+
+    // \warning Only call the following on non-empty views!
+    inline char front() const { return data_[0]; }
+    inline char back() const { return data_[size_ - 1]; }
+
+    /** \return The position of the first occurrence of "ch" at or after "start_pos" or npos if "ch" was not found. */
+    inline size_t find(const char ch, const size_t start_pos = 0) const {
+        if (start_pos >= size_)
+            return npos;
+        const void * const match(std::memchr(data_ + start_pos, ch, size_ - start_pos));
+        return (match == nullptr) ? npos : reinterpret_cast<const char *>(match) - data_;
+    }
+
+    /** \note Like std::string::substr(), "count" will be truncated if it reaches past our end. */
+    inline StringView substr(const size_t pos, size_t count = npos) const {
+        if (pos >= size_)
+            return StringView(data_ + size_, 0);
+        if (count > size_ - pos)
+            count = size_ - pos;
+        return StringView(data_ + pos, count);
+    }
+
+    inline bool startsWith(const StringView &prefix) const
+        { return prefix.size_ <= size_ and std::memcmp(data_, prefix.data_, prefix.size_) == 0; }
+    inline bool endsWith(const StringView &suffix) const
+        { return suffix.size_ <= size_ and std::memcmp(data_ + size_ - suffix.size_, suffix.data_, suffix.size_) == 0; }
+
+    inline bool operator==(const StringView &rhs) const
+        { return size_ == rhs.size_ and (size_ == 0 or std::memcmp(data_, rhs.data_, size_) == 0); }
+    inline bool operator!=(const StringView &rhs) const { return not operator==(rhs); }
+    inline bool operator==(const std::string &rhs) const { return operator==(StringView(rhs)); }
+    inline bool operator!=(const std::string &rhs) const { return not operator==(StringView(rhs)); }
+    inline bool operator==(const char * const rhs) const { return operator==(StringView(rhs)); }
+    inline bool operator!=(const char * const rhs) const { return not operator==(StringView(rhs)); }
+
+    /** \brief Orders views like std::string orders strings. */
+    inline bool operator<(const StringView &rhs) const {
+        const size_t common_size(size_ < rhs.size_ ? size_ : rhs.size_);
+        const int result(common_size == 0 ? 0 : std::memcmp(data_, rhs.data_, common_size));
+        return result < 0 or (result == 0 and size_ < rhs.size_);
+    }
+
+    /** \note This is the only place where we allocate memory. */
+    inline std::string toString() const { return std::string(data_, size_); }
+
+    friend std::ostream &operator<<(std::ostream &output, const StringView &view)
+        { return output.write(view.data_, view.size_); }
+};
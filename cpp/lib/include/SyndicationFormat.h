@@ -1,7 +1,7 @@
 /** \brief Interface of the SyndicationFormat class and descendents thereof.
  *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
  *
- *  \copyright 2018 Universitätsbibliothek Tübingen.  All rights reserved.
+ *  \copyright 2018,2019 Universitätsbibliothek Tübingen.  All rights reserved.
  *
  *  This program is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU Affero General Public License as
@@ -23,6 +23,8 @@
 #include <string>
 #include <unordered_map>
 #include <ctime>
+#include "Downloader.h"
+#include "TimeLimit.h"
 #include "XMLParser.h"
 
 
@@ -78,15 +80,18 @@ public:
         std::string strptime_format_; // If empty we use the standard format based on the syndication format type.
     };
 protected:
+    class FeedStream;
     friend class const_iterator;
+    std::unique_ptr<FeedStream> feed_stream_; // Only set if we parse the feed while it is being downloaded.
     XMLParser xml_parser_;
     std::string title_, link_, description_, id_;
     time_t last_build_date_;
     AugmentParams augment_params_;
 protected:
     SyndicationFormat(const std::string &xml_document, const AugmentParams &augment_params);
+    SyndicationFormat(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params);
 public:
-    virtual ~SyndicationFormat() = default;
+    virtual ~SyndicationFormat();
 
     virtual std::string getFormatName() const = 0;
 
@@ -103,6 +108,18 @@ public:
     // \return an instance of a subclass of SyndicationFormat on success or a nullptr upon failure.
     static std::unique_ptr<SyndicationFormat> Factory(const std::string &xml_document, const AugmentParams &augment_params,
                                                       std::string * const err_msg);
+
+    /** \brief  Like Factory() but parses the feed while it is being downloaded from "feed_url".
+     *  \return an instance of a subclass of SyndicationFormat on success or a nullptr upon failure.
+     *  \note   Items become available as soon as they have been received.  Destroying the returned instance before all
+     *          items have been iterated over aborts the download, so callers that stop early save the rest of the
+     *          transfer as well as the parsing.
+     *  \note   The iteration throws an exception if the download fails after the start of the feed has been received.
+     */
+    static std::unique_ptr<SyndicationFormat> StreamingFactory(const std::string &feed_url,
+                                                               const Downloader::Params &downloader_params,
+                                                               const TimeLimit &time_limit,
+                                                               const AugmentParams &augment_params, std::string * const err_msg);
 protected:
     virtual std::unique_ptr<Item> getNextItem() = 0;
 };
@@ -110,44 +127,64 @@ protected:
 
 class RSS20 final : public SyndicationFormat {
 public:
-    explicit RSS20(const std::string &xml_document, const AugmentParams &augment_params);
+    explicit RSS20(const std::string &xml_document, const AugmentParams &augment_params)
+        : SyndicationFormat(xml_document, augment_params) { parseChannel(); }
+    RSS20(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params)
+        : SyndicationFormat(std::move(feed_stream), augment_params) { parseChannel(); }
     virtual ~RSS20() final { }
 
     virtual std::string getFormatName() const override { return "RSS 2.0"; }
 protected:
     virtual std::unique_ptr<Item> getNextItem() override;
+private:
+    void parseChannel();
 };
 
 
 class RSS091 final : public SyndicationFormat {
 public:
-    explicit RSS091(const std::string &xml_document, const AugmentParams &augment_params);
+    explicit RSS091(const std::string &xml_document, const AugmentParams &augment_params)
+        : SyndicationFormat(xml_document, augment_params) { parseChannel(); }
+    RSS091(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params)
+        : SyndicationFormat(std::move(feed_stream), augment_params) { parseChannel(); }
     virtual ~RSS091() final { }
 
     virtual std::string getFormatName() const override { return "RSS 0.91"; }
 protected:
     virtual std::unique_ptr<Item> getNextItem() override;
+private:
+    void parseChannel();
 };
 
 
 class Atom final : public SyndicationFormat {
     std::string item_tag_; // Either "item" or "entry".
 public:
-    explicit Atom(const std::string &xml_document, const AugmentParams &augment_params);
+    explicit Atom(const std::string &xml_document, const AugmentParams &augment_params)
+        : SyndicationFormat(xml_document, augment_params) { parseChannel(); }
+    Atom(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params)
+        : SyndicationFormat(std::move(feed_stream), augment_params) { parseChannel(); }
     virtual ~Atom() final { }
 
     virtual std::string getFormatName() const override { return "Atom"; }
     virtual std::unique_ptr<Item> getNextItem() override;
+private:
+    void parseChannel();
 };
 
 
 class RDF final : public SyndicationFormat {
     std::string rss_namespace_, dc_namespace_, prism_namespace_;
 public:
-    explicit RDF(const std::string &xml_document, const AugmentParams &augment_params);
+    explicit RDF(const std::string &xml_document, const AugmentParams &augment_params)
+        : SyndicationFormat(xml_document, augment_params) { parseChannel(); }
+    RDF(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params)
+        : SyndicationFormat(std::move(feed_stream), augment_params) { parseChannel(); }
     virtual ~RDF() final { }
 
     virtual std::string getFormatName() const override { return "RDF"; }
 protected:
     virtual std::unique_ptr<Item> getNextItem() override;
+private:
+    void parseChannel();
 };
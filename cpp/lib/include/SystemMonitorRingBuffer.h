@@ -0,0 +1,124 @@
+/** \brief The fixed-size sample file that is written by system_monitor and read by system_monitor_viewer.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+/** \class SystemMonitorRingBuffer
+ *  \brief A header followed by a fixed number of fixed-size records.  Once the file is full, the oldest records get
+ *         overwritten, so the file never grows beyond the size that corresponds to the configured retention.
+ *  \note  As records are appended in chronological order, the logical sequence of records, i.e. starting at the
+ *         oldest one, is sorted by timestamp.  This lets readers locate any time window w/ a binary search.
+ *  \note  A file either holds raw samples or summaries of the samples of a fixed interval, e.g. a minute or an hour.
+ *  \note  The writer uses pwrite(2) and the reader a read-only mapping.  We don't use a writable shared mapping because
+ *         the files typically live on a network file system.
+ */
+class SystemMonitorRingBuffer {
+public:
+    enum class RecordType { SAMPLES, SUMMARIES };
+
+    struct Sample {
+        uint32_t timestamp_; // Seconds since the epoch.
+        uint32_t value_;
+        uint8_t ordinal_;    // Identifies the metric, see the "Label Ordinals" section of system_monitor.conf.
+        uint8_t padding_[3];
+    public:
+        Sample() = default;
+        Sample(const uint32_t timestamp, const uint8_t ordinal, const uint32_t value)
+            : timestamp_(timestamp), value_(value), ordinal_(ordinal), padding_{ 0, 0, 0 } { }
+    };
+
+    struct Summary {
+        uint32_t timestamp_; // The start of the summarised interval.
+        uint32_t minimum_, maximum_, average_;
+        uint8_t ordinal_;
+        uint8_t padding_[3];
+    public:
+        Summary() = default;
+        Summary(const uint32_t timestamp, const uint8_t ordinal, const uint32_t minimum, const uint32_t maximum,
+                const uint32_t average)
+            : timestamp_(timestamp), minimum_(minimum), maximum_(maximum), average_(average), ordinal_(ordinal),
+              padding_{ 0, 0, 0 } { }
+    };
+private:
+    struct Header {
+        char magic_[8];
+        uint32_t version_;
+        uint32_t sample_size_; // The size of a record, which also identifies the record type.
+        uint64_t capacity_;    // In records.
+        uint64_t write_count_; // The number of records that have ever been appended.
+        char reserved_[32];
+    };
+
+    std::string path_;
+    size_t record_size_;
+    int fd_;
+    Header header_;              // Only used by writers.
+    const Header *mapped_header_; // Only used by readers.
+    const char *mapped_records_;
+    size_t mapping_size_;
+public:
+    /** \brief Opens "path" for appending, creating it w/ room for "capacity" records if it doesn't exist yet.
+     *  \note  If "path" already is a ring buffer, we keep its capacity and contents.
+     */
+    SystemMonitorRingBuffer(const std::string &path, const uint64_t capacity, const RecordType record_type = RecordType::SAMPLES);
+
+    /** \brief Opens "path" for reading. */
+    explicit SystemMonitorRingBuffer(const std::string &path, const RecordType record_type = RecordType::SAMPLES);
+
+    ~SystemMonitorRingBuffer();
+
+    /** \brief Writes "samples" or "summaries" w/ at most three system calls. */
+    void append(const std::vector<Sample> &samples);
+    void append(const std::vector<Summary> &summaries);
+
+    uint64_t getCapacity() const;
+
+    /** \return The number of records that are currently available. */
+    uint64_t size() const;
+
+    /** \return The "index"th oldest sample.  Only for readers of samples. */
+    const Sample &operator[](const uint64_t index) const;
+
+    /** \return The "index"th oldest summary.  Only for readers of summaries. */
+    const Summary &getSummary(const uint64_t index) const;
+
+    /** \return The index of the oldest record whose timestamp is not smaller than "timestamp" or size() if there is
+     *          no such record.  Only for readers.
+     */
+    uint64_t lowerBound(const uint32_t timestamp) const;
+
+    /** \return True if "path" starts w/ our magic number, false if it doesn't, e.g. for log files in the old format
+     *          which was simply a sequence of unpadded samples.
+     */
+    static bool IsRingBuffer(const std::string &path);
+private:
+    SystemMonitorRingBuffer(const SystemMonitorRingBuffer &) = delete;
+    SystemMonitorRingBuffer &operator=(const SystemMonitorRingBuffer &) = delete;
+
+    inline uint64_t getWriteCount() const
+        { return (mapped_header_ == nullptr) ? header_.write_count_ : __atomic_load_n(&mapped_header_->write_count_, __ATOMIC_ACQUIRE); }
+    void appendRecords(const void * const records, const uint64_t record_count, const size_t record_size);
+    const char *getRecord(const uint64_t index, const size_t record_size) const;
+    void writeOrDie(const void * const data, const size_t size, const off_t offset);
+};
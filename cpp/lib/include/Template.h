@@ -143,4 +143,32 @@ std::string ExpandTemplate(const std::string &template_string, const Map &names_
                            const std::vector<Function *> &functions = {});
 
 
+/** \brief A template that has been parsed once and can then be expanded any number of times, also concurrently.
+ *  \note  The syntax is the same as for ExpandTemplate() above.  Only the branches of IFs that are taken get evaluated.
+ */
+class CompiledTemplate {
+public:
+    struct Node;
+private:
+    std::vector<std::unique_ptr<Node>> nodes_;
+public:
+    /** \throws std::runtime_error if "template_string" contains a syntax error. */
+    explicit CompiledTemplate(const std::string &template_string, const std::vector<Function *> &functions = {});
+    ~CompiledTemplate();
+
+    /** \brief Appends the expanded template to "output". */
+    void expand(const Map &names_to_values_map, std::string * const output) const;
+    void expand(const Map &names_to_values_map, std::ostream &output) const;
+
+    /** \brief Returns the compiled contents of the template file "path".
+     *  \note  Compiled templates are cached per process and recompiled when the modification time of "path" changes.
+     *  \throws std::runtime_error if "path" can't be read or contains a syntax error.
+     */
+    static std::shared_ptr<const CompiledTemplate> Load(const std::string &path, const std::vector<Function *> &functions = {});
+private:
+    CompiledTemplate(const CompiledTemplate &rhs) = delete;
+    CompiledTemplate &operator=(const CompiledTemplate &rhs) = delete;
+};
+
+
 } // namespace MiscUtil
@@ -34,6 +34,7 @@
 #include <vector>
 #include <cwchar>
 #include <iconv.h>
+#include "StringView.h"
 
 
 namespace TextUtil {
@@ -93,12 +94,63 @@ public:
 };
 
 
+/** \brief Extracts the text from an HTML document that arrives in pieces, e.g. via a Downloader::Params::body_chunk_callback_,
+ *         w/o ever holding the complete document.  Tags, comments, scripts and style sheets are dropped and entities are
+ *         replaced.  The character set is taken from a BOM, the HTTP header or a <meta> tag within the first
+ *         CHARSET_SNIFFING_SIZE bytes, in that order of precedence, and defaults to UTF-8.
+ */
+class HtmlTextStreamExtractor {
+    enum State { TEXT, TAG_START, TAG, COMMENT, SCRIPT_OR_STYLE };
+    const std::string http_header_charset_;
+    const size_t max_text_size_;
+    std::string charset_;
+    std::unique_ptr<EncodingConverter> encoding_converter_;
+    std::string sniffing_buffer_; // Holds the start of the document until we know its character set.
+    bool charset_determined_, ascii_incompatible_, size_limit_exceeded_;
+    State state_;
+    std::string pending_text_;    // Text in the document's character set that we have yet to convert.
+    std::string tag_;             // The tag we're in, or the tail of the comment we're in.
+    std::string end_tag_;         // Either "</script" or "</style" while we're in the SCRIPT_OR_STYLE state.
+    size_t end_tag_match_length_;
+    char quote_;                  // Non-zero if we're inside of a quoted attribute value.
+    std::string extracted_text_;
+public:
+    static constexpr size_t CHARSET_SNIFFING_SIZE = 1024;
+public:
+    /** \param max_text_size  If non-zero, we stop consuming input once we have extracted at least this many bytes of text. */
+    explicit HtmlTextStreamExtractor(const std::string &http_header_charset = "", const size_t max_text_size = 0)
+        : http_header_charset_(http_header_charset), max_text_size_(max_text_size), charset_determined_(false),
+          ascii_incompatible_(false), size_limit_exceeded_(false), state_(TEXT), end_tag_match_length_(0), quote_('\0') { }
+
+    /** \return False if "max_text_size" has been reached, in which case the remaining input would be ignored anyway. */
+    bool feed(const char * const data, const size_t size);
+    inline bool feed(const std::string &data) { return feed(data.data(), data.size()); }
+
+    /** \brief Processes any buffered input.
+     *  \return The extracted text as UTF-8 w/ leading and trailing whitespace removed.
+     */
+    std::string finish();
+
+    inline bool sizeLimitExceeded() const { return size_limit_exceeded_; }
+
+    /** \return The character set that we used or an empty string if we have yet to determine it. */
+    inline const std::string &getCharset() const { return charset_; }
+private:
+    void determineCharset();
+    void process(const char *data, const size_t size);
+    void processTag();
+    void flushPendingText();
+    void appendSeparator();
+};
+
+
 /** \brief Strips HTML tags and converts entities.
  *  \param html             The HTML to process.
  *  \param initial_charset  Typically the content-type header's charset, if any.
+ *  \param max_text_size    If non-zero, we stop processing "html" once we have extracted at least this many bytes.
  *  \return The extracted and converted text as UTF-8.
  */
-std::string ExtractTextFromHtml(const std::string &html, const std::string &initial_charset = "");
+std::string ExtractTextFromHtml(const std::string &html, const std::string &initial_charset = "", const size_t max_text_size = 0);
 
 
 /** \brief Extracts text from TEI files.
@@ -213,6 +265,37 @@ inline bool IsValidSingleUTF16Char(const uint16_t u) {
 bool IsValidUTF8(const std::string &utf8_candidate);
 
 
+/** \class WordTokenizer
+ *  \brief Breaks UTF-8 text into words w/o copying anything.  The words are the same as those that ChopIntoWords() returns.
+ *  \note  Use like this:
+ *             TextUtil::WordTokenizer tokenizer(text);
+ *             StringView word;
+ *             while (tokenizer.next(&word))
+ *                 ...
+ *             if (tokenizer.hasError())
+ *                 ...
+ *         The views point into "text" which has to outlive them.
+ */
+class WordTokenizer {
+    const char *ch_, *end_;
+    const unsigned min_word_length_;
+    const char *word_start_, *word_end_;
+    unsigned word_length_; // In characters.
+    bool leading_, word_is_number_, done_, error_;
+public:
+    explicit WordTokenizer(const StringView &text, const unsigned min_word_length = 1)
+        : ch_(text.begin()), end_(text.end()), min_word_length_(min_word_length), word_start_(ch_), word_end_(ch_),
+          word_length_(0), leading_(true), word_is_number_(false), done_(false), error_(false) { }
+
+    /** \return False if there are no more words or if we encountered an invalid UTF-8 sequence. */
+    bool next(StringView * const word);
+
+    inline bool hasError() const { return error_; }
+private:
+    bool finishWord(const bool trim_quotes, StringView * const word);
+};
+
+
 /** \brief Break up text into individual lowercase "words".
  *
  *  \param text             Assumed to be in UTF8.
@@ -255,6 +338,8 @@ std::string Base64Encode(const std::string &s, const char symbol63 = '+', const
  *  \param  symbol63  The character that was used for symbol 63.
  *  \param  symbol64  The character that was used for symbol 64.
  *  \return The decoded string.
+ *  \note   Decoding stops at the first padding character and line breaks, spaces and tabs are skipped.  Any other
+ *          character that is not part of the alphabet results in a std::runtime_error being thrown.
  */
 std::string Base64Decode(const std::string &s, const char symbol63 = '+', const char symbol64 = '/');
 
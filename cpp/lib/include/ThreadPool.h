@@ -0,0 +1,133 @@
+/** \brief A work-stealing thread pool with futures and parallel loops.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/** \class ThreadPool
+ *  \brief Runs tasks on a fixed set of worker threads.
+ *  \note  Each worker owns a task deque.  Tasks submitted from a worker go to the back of that worker's own deque and are
+ *         taken from there in LIFO order, which keeps nested work cache-friendly.  Idle workers steal from the front
+ *         of the other workers' deques.  Tasks submitted from other threads are distributed round-robin.
+ *  \note  Typical usage:
+ *         \code{.cpp}
+ *             ThreadPool thread_pool;
+ *             auto future(thread_pool.submit([]{ return ExpensiveComputation(); }));
+ *             thread_pool.parallelFor(0, texts.size(), [&](const size_t index) { Process(texts[index]); });
+ *             const auto result(future.get());
+ *         \endcode
+ *  \warning Do not block a worker on the future of a task that has not been started yet, e.g. by calling get() from
+ *           inside a task.  With all workers blocked like that nobody is left to run the awaited task.  parallelFor()
+ *           does not have this problem as the calling thread helps to run the pending tasks.
+ */
+class ThreadPool {
+    typedef std::function<void()> Task;
+
+    struct Worker {
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+        std::thread thread_;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> queued_task_count_, next_worker_index_;
+    std::atomic<bool> cancelled_;
+    bool stopping_;
+    std::mutex sleep_mutex_;
+    std::condition_variable work_available_;
+public:
+    /** \param thread_count         The number of worker threads.  If 0, we use one thread per core.
+     *  \param pin_threads_to_cpus  If true, worker i only runs on the i-th CPU, modulo the number of CPUs, that we are
+     *                              allowed to use.  This only pays off if the pool has the machine to itself.
+     */
+    explicit ThreadPool(const unsigned thread_count = 0, const bool pin_threads_to_cpus = false);
+
+    /** \brief Waits for all queued tasks, unless we have been cancelled, and joins all worker threads. */
+    ~ThreadPool();
+
+    inline unsigned size() const { return workers_.size(); }
+
+    /** \brief Queues "function" for execution on one of our worker threads.
+     *  \return A future for the return value of "function".  Exceptions thrown by "function" will be rethrown by the
+     *          future's get().  If the pool gets cancelled before "function" has been started, get() throws a
+     *          std::future_error w/ the error code std::future_errc::broken_promise.
+     */
+    template<typename Function> std::future<typename std::result_of<Function()>::type> submit(Function &&function);
+
+    /** \brief Calls "body(index)" for all indices in [begin, end) on our worker threads and the calling thread.
+     *  \param chunk_size  The number of consecutive indices that will be handed to a thread at a time.  If 0, we pick a
+     *                     size that results in about 8 chunks per thread.
+     *  \note  The first exception thrown by "body" will be rethrown after all chunks have been completed or skipped.
+     *         After an exception, or if we get cancelled, the chunks that have not been started yet are skipped.
+     *  \note  Nested calls, i.e. calls from inside a task or a "body", are fine.
+     */
+    template<typename Body> void parallelFor(const size_t begin, const size_t end, const Body &body, const size_t chunk_size = 0) {
+        parallelForChunks(begin, end, [&body](const size_t chunk_begin, const size_t chunk_end) {
+                                          for (size_t index(chunk_begin); index < chunk_end; ++index)
+                                              body(index);
+                                      }, chunk_size);
+    }
+
+    /** \brief Requests cooperative cancellation.  Tasks that have not been started yet will be discarded, running tasks
+     *         should poll isCancelled() if they can take a long time.
+     *  \note  Cancellation is permanent, i.e. tasks submitted after a call to this function will be discarded as well.
+     */
+    void cancel();
+
+    inline bool isCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+private:
+    ThreadPool(const ThreadPool &rhs) = delete;
+    ThreadPool &operator=(const ThreadPool &rhs) = delete;
+
+    void enqueue(Task &&task);
+
+    /** \brief Runs one queued task, preferably one of "worker_index"'s own, or steals one from another worker.
+     *  \param worker_index  Our index or size() if the calling thread is not one of our workers.
+     *  \return False if there was no task to run.
+     */
+    bool runPendingTask(const size_t worker_index);
+
+    void workerLoop(const size_t worker_index, const int cpu);
+    void parallelForChunks(const size_t begin, const size_t end, const std::function<void(size_t, size_t)> &chunk_body,
+                           size_t chunk_size);
+};
+
+
+template<typename Function> std::future<typename std::result_of<Function()>::type> ThreadPool::submit(Function &&function) {
+    typedef typename std::result_of<Function()>::type ResultType;
+
+    // std::function requires copyable targets, hence the shared_ptr around the move-only std::packaged_task.
+    const auto packaged_task(std::make_shared<std::packaged_task<ResultType()>>(std::forward<Function>(function)));
+    std::future<ResultType> future(packaged_task->get_future());
+    enqueue([packaged_task]{ (*packaged_task)(); });
+
+    return future;
+}
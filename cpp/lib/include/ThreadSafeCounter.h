@@ -19,28 +19,25 @@
 #pragma once
 
 
-#include <mutex>
+#include <atomic>
+#include <type_traits>
 
 
-template<typename NumericType> class ThreadSafeCounter {
-    NumericType counter_;
-    std::mutex mutex_;
+/** \brief A counter that can be incremented from multiple threads w/o locking.
+ *  \note  For pure statistics counters, where the value is only inspected after the threads have been joined,
+ *         std::memory_order_relaxed is sufficient and considerably cheaper under contention.
+ */
+template<typename NumericType, std::memory_order MEMORY_ORDER = std::memory_order_seq_cst> class ThreadSafeCounter {
+    static_assert(std::is_integral<NumericType>::value, "ThreadSafeCounter requires an integral type!");
+    std::atomic<NumericType> counter_;
 public:
     explicit ThreadSafeCounter(const NumericType initial_counter_value = 0)
         : counter_(initial_counter_value) { }
 
-    void operator++() {
-        std::unique_lock<std::mutex> mutex_locker(mutex_);
-        ++counter_;
-    }
-
-    void operator++(int) {
-        std::unique_lock<std::mutex> mutex_locker(mutex_);
-        ++counter_;
-    }
+    void operator++() { counter_.fetch_add(1, MEMORY_ORDER); }
+    void operator++(int) { counter_.fetch_add(1, MEMORY_ORDER); }
+    void operator+=(const NumericType increment) { counter_.fetch_add(increment, MEMORY_ORDER); }
 
-    NumericType get() {
-        std::unique_lock<std::mutex> mutex_locker(mutex_);
-        return counter_;
-    }
+    NumericType get() const { return counter_.load(MEMORY_ORDER == std::memory_order_relaxed ? std::memory_order_relaxed
+                                                                                                : std::memory_order_seq_cst); }
 };
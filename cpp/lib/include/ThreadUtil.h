@@ -26,10 +26,18 @@
 #pragma once
 
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <pthread.h>
 #include <semaphore.h>
+#include "Compiler.h"
 
 
 namespace ThreadUtil {
@@ -101,64 +109,54 @@ private:
  *  \brief  Implements a numeric counter that can safely be shared between threads.
  *  \note   Typical usage would be to create an instance of this class in some "main" thread and pass references into
  *          worker threads that call the increment and decrement operators as needed.
+ *  \note   The counter is a std::atomic.  Use std::memory_order_relaxed for "MEMORY_ORDER" if the counter does not
+ *          have to synchronise anything else, e.g. if it only collects statistics.
  */
-template <typename NumericType> class ThreadSafeCounter {
-    mutable std::mutex mutex_;
-    NumericType counter_;
+template <typename NumericType, std::memory_order MEMORY_ORDER = std::memory_order_seq_cst> class ThreadSafeCounter {
+    static_assert(std::is_arithmetic<NumericType>::value and not std::is_floating_point<NumericType>::value,
+                  "ThreadSafeCounter requires an integral type!");
+    std::atomic<NumericType> counter_;
 public:
     explicit ThreadSafeCounter(const NumericType initial_value = 0): counter_(initial_value) { }
-    operator NumericType() const;
-    NumericType operator++();
+    operator NumericType() const { return counter_.load(LOAD_ORDER); }
+    NumericType operator++() { return counter_.fetch_add(1, MEMORY_ORDER) + 1; }
     NumericType operator--();
-    NumericType operator++(int);
+    NumericType operator++(int) { return counter_.fetch_add(1, MEMORY_ORDER); }
     NumericType operator--(int);
 private:
-    void screwPointers() { counter_ /= 1; } // Prevent this template class from being instantiated w/ a pointer type!
-};
-
-
-template <typename NumericType> ThreadSafeCounter<NumericType>::operator NumericType() const {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-
-    return counter_;
-}
+    // Loads can't have release semantics.
+    static constexpr std::memory_order LOAD_ORDER = (MEMORY_ORDER == std::memory_order_relaxed) ? std::memory_order_relaxed
+                                                                                                 : std::memory_order_seq_cst;
 
-
-template <typename NumericType> NumericType ThreadSafeCounter<NumericType>::operator++() {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    ++counter_;
-
-    return counter_;
-}
+    /** \return The previous value. */
+    NumericType decrementIfNonZero(const char * const caller);
+};
 
 
-template <typename NumericType> NumericType ThreadSafeCounter<NumericType>::operator++(int) {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    const NumericType previous_value(counter_);
-    ++counter_;
+template <typename NumericType, std::memory_order MEMORY_ORDER>
+    NumericType ThreadSafeCounter<NumericType, MEMORY_ORDER>::decrementIfNonZero(const char * const caller)
+{
+    NumericType previous_value(counter_.load(LOAD_ORDER));
+    do {
+        if (unlikely(previous_value == 0))
+            throw std::runtime_error("in ThreadSafeCounter::" + std::string(caller) + ": trying to decrement a zero counter!");
+    } while (not counter_.compare_exchange_weak(previous_value, previous_value - 1, MEMORY_ORDER, LOAD_ORDER));
 
     return previous_value;
 }
 
 
-template <typename NumericType> NumericType ThreadSafeCounter<NumericType>::operator--() {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    if (unlikely(counter_ == 0))
-        throw std::runtime_error("in ThreadSafeCounter::operator--: trying to decrement a zero counter!");
-    --counter_;
-
-    return counter_;
+template <typename NumericType, std::memory_order MEMORY_ORDER>
+    NumericType ThreadSafeCounter<NumericType, MEMORY_ORDER>::operator--()
+{
+    return decrementIfNonZero("operator--") - 1;
 }
 
 
-template <typename NumericType> NumericType ThreadSafeCounter<NumericType>::operator--(int) {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    if (unlikely(counter_ == 0))
-        throw std::runtime_error("in ThreadSafeCounter::operator--(int): trying to decrement a zero counter!");
-    const NumericType previous_value(counter_);
-    --counter_;
-
-    return previous_value;
+template <typename NumericType, std::memory_order MEMORY_ORDER>
+    NumericType ThreadSafeCounter<NumericType, MEMORY_ORDER>::operator--(int)
+{
+    return decrementIfNonZero("operator--(int)");
 }
 
 
@@ -193,6 +191,280 @@ private:
 };
 
 
+/** \class  BoundedQueue
+ *  \brief  A FIFO queue that can safely be shared between producer and consumer threads.
+ *  \note   push() blocks while the queue is full and pop() blocks while it is empty.  After a call to close() both
+ *          return false once no more elements can be transferred, which lets either side abort the other.
+ */
+template <typename ElementType> class BoundedQueue {
+    const size_t max_size_;
+    std::deque<ElementType> elements_;
+    bool closed_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_condition_, not_full_condition_;
+public:
+    explicit BoundedQueue(const size_t max_size): max_size_(max_size), closed_(false) {
+        if (unlikely(max_size_ == 0))
+            throw std::runtime_error("in ThreadUtil::BoundedQueue::BoundedQueue: max_size must be positive!");
+    }
+
+    /** \return False if the queue has been closed, in which case "element" was dropped. */
+    bool push(ElementType &&element);
+
+    /** \return False if the queue has been closed and all elements have been consumed. */
+    bool pop(ElementType * const element);
+
+    /** \brief Wakes up all waiting threads.  Elements that have already been queued can still be popped. */
+    void close();
+private:
+    BoundedQueue(const BoundedQueue &rhs) = delete;
+    BoundedQueue &operator=(const BoundedQueue &rhs) = delete;
+};
+
+
+template <typename ElementType> bool BoundedQueue<ElementType>::push(ElementType &&element) {
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    not_full_condition_.wait(mutex_locker, [this]{ return closed_ or elements_.size() < max_size_; });
+    if (closed_)
+        return false;
+
+    elements_.emplace_back(std::move(element));
+    not_empty_condition_.notify_one();
+
+    return true;
+}
+
+
+template <typename ElementType> bool BoundedQueue<ElementType>::pop(ElementType * const element) {
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    not_empty_condition_.wait(mutex_locker, [this]{ return closed_ or not elements_.empty(); });
+    if (elements_.empty())
+        return false;
+
+    *element = std::move(elements_.front());
+    elements_.pop_front();
+    not_full_condition_.notify_one();
+
+    return true;
+}
+
+
+template <typename ElementType> void BoundedQueue<ElementType>::close() {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    closed_ = true;
+    not_empty_condition_.notify_all();
+    not_full_condition_.notify_all();
+}
+
+
+
+/** \class  LockFreeBoundedQueue
+ *  \brief  A bounded FIFO for any number of producer and consumer threads that only locks when it has to wait.
+ *  \note   This is Dmitry Vyukov's ring buffer: each slot carries a sequence number that tells producers and consumers
+ *          whether it is theirs to fill or to drain.  tryPush() and tryPop() never block.  push() and pop() spin
+ *          briefly and then sleep on a condition variable while the queue is full or empty, respectively.  Sleepers
+ *          are counted so that the non-waiting path never touches the mutex.
+ *  \note   The interface, including the semantics of close(), is the same as that of BoundedQueue, which should be
+ *          preferred unless the queue operations are a measurable cost, e.g. for per-record hand-offs.
+ */
+template <typename ElementType> class LockFreeBoundedQueue {
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct Slot {
+        std::atomic<size_t> sequence_;
+        typename std::aligned_storage<sizeof(ElementType), alignof(ElementType)>::type storage_;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    char padding1_[CACHE_LINE_SIZE];
+    std::atomic<size_t> enqueue_position_;
+    char padding2_[CACHE_LINE_SIZE];
+    std::atomic<size_t> dequeue_position_;
+    char padding3_[CACHE_LINE_SIZE];
+    std::atomic<bool> closed_;
+    std::atomic<unsigned> waiting_producer_count_, waiting_consumer_count_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_condition_, not_full_condition_;
+public:
+    /** \param min_size  The capacity will be the smallest power of two that is >= "min_size". */
+    explicit LockFreeBoundedQueue(const size_t min_size);
+    ~LockFreeBoundedQueue();
+
+    inline size_t capacity() const { return mask_ + 1; }
+
+    /** \return False if the queue is full or has been closed, in which case "element" remains untouched. */
+    bool tryPush(ElementType &&element);
+
+    /** \return False if the queue is empty. */
+    bool tryPop(ElementType * const element);
+
+    /** \return False if the queue has been closed, in which case "element" was dropped. */
+    bool push(ElementType &&element);
+
+    /** \return False if the queue has been closed and all elements have been consumed. */
+    bool pop(ElementType * const element);
+
+    /** \brief Wakes up all waiting threads.  Elements that have already been queued can still be popped. */
+    void close();
+private:
+    LockFreeBoundedQueue(const LockFreeBoundedQueue &rhs) = delete;
+    LockFreeBoundedQueue &operator=(const LockFreeBoundedQueue &rhs) = delete;
+
+    // Both of the following are snapshots that may be outdated by the time the caller looks at them.
+    bool seemsEmpty() const;
+    bool seemsFull() const;
+
+    void wakeUp(std::atomic<unsigned> * const waiting_count, std::condition_variable * const condition);
+
+    // The number of unsuccessful attempts before push() and pop() go to sleep.
+    static constexpr unsigned SPIN_COUNT = 64;
+};
+
+
+template <typename ElementType> LockFreeBoundedQueue<ElementType>::LockFreeBoundedQueue(const size_t min_size)
+    : mask_([min_size]{
+          if (unlikely(min_size == 0))
+              throw std::runtime_error("in ThreadUtil::LockFreeBoundedQueue::LockFreeBoundedQueue: min_size must be positive!");
+          size_t size(1);
+          while (size < min_size)
+              size <<= 1u;
+          return size - 1;
+      }()),
+      slots_(new Slot[mask_ + 1]), enqueue_position_(0), dequeue_position_(0), closed_(false), waiting_producer_count_(0),
+      waiting_consumer_count_(0)
+{
+    for (size_t slot_index(0); slot_index <= mask_; ++slot_index)
+        slots_[slot_index].sequence_.store(slot_index, std::memory_order_relaxed);
+}
+
+
+template <typename ElementType> LockFreeBoundedQueue<ElementType>::~LockFreeBoundedQueue() {
+    // Destroy the elements that nobody has popped:
+    const size_t enqueue_position(enqueue_position_.load());
+    for (size_t position(dequeue_position_.load()); position != enqueue_position; ++position)
+        reinterpret_cast<ElementType *>(&slots_[position & mask_].storage_)->~ElementType();
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::tryPush(ElementType &&element) {
+    if (unlikely(closed_.load(std::memory_order_relaxed)))
+        return false;
+
+    size_t position(enqueue_position_.load(std::memory_order_relaxed));
+    for (;;) {
+        Slot &slot(slots_[position & mask_]);
+        const size_t sequence(slot.sequence_.load(std::memory_order_acquire));
+        const intptr_t difference(static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position));
+        if (difference == 0) { // The slot is free.
+            if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                new (&slot.storage_) ElementType(std::move(element));
+                slot.sequence_.store(position + 1, std::memory_order_release);
+                wakeUp(&waiting_consumer_count_, &not_empty_condition_);
+                return true;
+            }
+        } else if (difference < 0) // The slot still holds an element from the previous lap, i.e. we're full.
+            return false;
+        else // Another producer got here first.
+            position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::tryPop(ElementType * const element) {
+    size_t position(dequeue_position_.load(std::memory_order_relaxed));
+    for (;;) {
+        Slot &slot(slots_[position & mask_]);
+        const size_t sequence(slot.sequence_.load(std::memory_order_acquire));
+        const intptr_t difference(static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1));
+        if (difference == 0) { // The slot has been filled.
+            if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                ElementType * const stored_element(reinterpret_cast<ElementType *>(&slot.storage_));
+                *element = std::move(*stored_element);
+                stored_element->~ElementType();
+                slot.sequence_.store(position + mask_ + 1, std::memory_order_release);
+                wakeUp(&waiting_producer_count_, &not_full_condition_);
+                return true;
+            }
+        } else if (difference < 0) // Empty.
+            return false;
+        else // Another consumer got here first.
+            position = dequeue_position_.load(std::memory_order_relaxed);
+    }
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::push(ElementType &&element) {
+    for (unsigned attempt(1); /* Intentionally empty! */; ++attempt) {
+        if (tryPush(std::move(element)))
+            return true;
+        if (closed_.load(std::memory_order_relaxed))
+            return false;
+        if (attempt < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // The sequentially consistent increment pairs w/ the fence in wakeUp(): either the consumer sees us waiting
+        // or we see the room it has made.
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        ++waiting_producer_count_;
+        not_full_condition_.wait(mutex_locker, [this]{ return closed_ or not seemsFull(); });
+        --waiting_producer_count_;
+    }
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::pop(ElementType * const element) {
+    for (unsigned attempt(1); /* Intentionally empty! */; ++attempt) {
+        if (tryPop(element))
+            return true;
+        if (closed_ and seemsEmpty())
+            return false;
+        if (attempt < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        ++waiting_consumer_count_;
+        not_empty_condition_.wait(mutex_locker, [this]{ return closed_ or not seemsEmpty(); });
+        --waiting_consumer_count_;
+    }
+}
+
+
+template <typename ElementType> void LockFreeBoundedQueue<ElementType>::close() {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    closed_ = true;
+    not_empty_condition_.notify_all();
+    not_full_condition_.notify_all();
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::seemsEmpty() const {
+    const size_t position(dequeue_position_.load(std::memory_order_seq_cst));
+    return slots_[position & mask_].sequence_.load(std::memory_order_seq_cst) != position + 1;
+}
+
+
+template <typename ElementType> bool LockFreeBoundedQueue<ElementType>::seemsFull() const {
+    const size_t position(enqueue_position_.load(std::memory_order_seq_cst));
+    return slots_[position & mask_].sequence_.load(std::memory_order_seq_cst) != position;
+}
+
+
+template <typename ElementType> void LockFreeBoundedQueue<ElementType>::wakeUp(std::atomic<unsigned> * const waiting_count,
+                                                                              std::condition_variable * const condition)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (likely(waiting_count->load(std::memory_order_relaxed) == 0))
+        return;
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    condition->notify_all();
+}
+
 pid_t GetThreadId();
 
 
@@ -114,6 +114,7 @@ std::string TimeTToString(const time_t &the_time, const std::string &format = DE
 /** \brief  Inverse of gmtime(3).
  *  \param  tm  Broken-down time, expressed in Coordinated Universal Time (UTC).
  *  \return The calendar time or TimeUtil::BAD_TIME_T on error.
+ *  \note   Out-of-range fields are normalised like mktime(3) does.  Unlike mktime(3) this is thread-safe.
  */
 time_t TimeGm(const struct tm &tm);
 
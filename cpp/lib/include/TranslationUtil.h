@@ -20,9 +20,11 @@
 #pragma once
 
 
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #include "DbConnection.h"
 
 
@@ -38,6 +40,75 @@ namespace TranslationUtil {
 std::string GetId(DbConnection * const connection, const std::string &german_text);
 
 
+/** \class TranslationCache
+ *  \brief A read-through cache for the translations in one of the translation tables, keyed by (key, language code).
+ *  \note  "key_column" is e.g. "token" for vufind_translations or "ppn" or "gnd_code" for keyword_translations.
+ *  \note  Call prefetch() w/ all the keys that you are going to need, e.g. for all the entries on a page, in order to replace
+ *         one query per key w/ a single query.  Keys that have not been prefetched are loaded on demand by lookup().
+ *  \note  After modifying the underlying table through the same process, call invalidate() for the affected keys.
+ */
+class TranslationCache {
+    DbConnection * const db_connection_;
+    const std::string table_name_, key_column_, condition_;
+    std::unordered_map<std::string, std::vector<std::pair<LanguageCode, std::string>>> key_to_languages_and_translations_;
+public:
+    /** \param condition  If not empty, an additional SQL condition that all cached rows have to satisfy,
+     *                    e.g. "status='reliable_synonym'".
+     */
+    TranslationCache(DbConnection * const db_connection, const std::string &table_name, const std::string &key_column,
+                     const std::string &condition = "")
+        : db_connection_(db_connection), table_name_(table_name), key_column_(key_column), condition_(condition) { }
+
+    /** \brief Loads the translations for all keys in "keys" that are not yet cached w/ a single query. */
+    void prefetch(const std::set<std::string> &keys);
+
+    /** \return All translations for "key" in the language "language_code", in database order. */
+    std::vector<std::string> lookup(const std::string &key, const LanguageCode &language_code);
+
+    /** \return All translations for "key" regardless of the language, in database order. */
+    std::vector<std::string> lookup(const std::string &key);
+
+    inline void invalidate(const std::string &key) { key_to_languages_and_translations_.erase(key); }
+    inline void clear() { key_to_languages_and_translations_.clear(); }
+private:
+    const std::vector<std::pair<LanguageCode, std::string>> &getEntries(const std::string &key);
+};
+
+
+/** \brief Per-language translation coverage of one of the translation tables.
+ *  \note  The statistics are materialised in the translation_stats table, which has one row per table and language code
+ *         and an additional row w/ an empty language code that holds the number of distinct keys of the table.
+ */
+struct TranslationStats {
+    LanguageCode language_code_;
+    unsigned translated_count_; // The number of rows for "language_code_".
+    unsigned total_count_;      // "translated_count_" plus the number of keys that have no translation into "language_code_".
+
+    TranslationStats(const LanguageCode &language_code, const unsigned translated_count, const unsigned total_count)
+        : language_code_(language_code), translated_count_(translated_count), total_count_(total_count) { }
+};
+
+
+/** \brief Recomputes the materialised statistics of "table_name" from scratch.
+ *  \param key_column  E.g. "token" for vufind_translations or "ppn" for keyword_translations.
+ *  \note  Tools that bulk-modify a translation table should call this when they are done.
+ */
+void RebuildTranslationStats(DbConnection * const db_connection, const std::string &table_name, const std::string &key_column);
+
+
+/** \brief Incrementally updates the materialised statistics after a single row for "key" and "language_code" has been
+ *         inserted into "table_name".
+ *  \note  Does nothing if the statistics for "table_name" have never been built.
+ */
+void UpdateTranslationStatsAfterInsert(DbConnection * const db_connection, const std::string &table_name,
+                                       const std::string &key_column, const std::string &key, const LanguageCode &language_code);
+
+
+/** \return The materialised statistics of "table_name" sorted by language code.  If they don't exist yet, we build them. */
+std::vector<TranslationStats> GetTranslationStats(DbConnection * const db_connection, const std::string &table_name,
+                                                  const std::string &key_column);
+
+
 /** \note Aborts if "international_2letter_code" is unknown. */
 std::string MapInternational2LetterCodeToGerman3Or4LetterCode(const std::string &international_2letter_code);
 
@@ -52,6 +52,10 @@
  *  result in Url errors if your network connection goes down.
  *
  *  Note that when a URL is canonized, it is necessarily also cleaned.
+ *
+ *  Constructing a Url from a string w/o the AUTO_CANONIZE flag is memoised in a process-wide, thread-safe LRU cache.
+ *  Therefore a URL that is seen repeatedly, e.g. while crawling, is only parsed, made absolute and validated once for
+ *  a given base URL and set of creation flags.  See SetConstructionCacheSize().
  */
 class Url {
     friend bool operator==(const Url &lhs, const Url &rhs);
@@ -111,7 +115,11 @@ private:
     bool throw_exceptions_; // Enable error reporting by throwing exceptions if "true."
 
     static std::string default_user_agent_;
+    static size_t construction_cache_size_;
 public:
+    /** The default maximum number of entries of the construction cache. */
+    static constexpr size_t DEFAULT_CONSTRUCTION_CACHE_SIZE = 10000;
+
     /** Constructor flag for performing no automatic operations. */
     enum { NO_AUTO_OPERATIONS     = 1u << 0u };
 
@@ -577,7 +585,23 @@ public:
     /** Sets the default user agent string for Url::makeCanonical(). */
     static void SetDefaultUserAgentString(const std::string &new_default_user_agent_string)
     { default_user_agent_ = new_default_user_agent_string; }
+
+    /** \brief  Sets the maximum number of entries of the cache of constructed Url's.
+     *  \note   A size of zero disables the cache.  Must be called before any Url's are constructed by other threads.
+     */
+    static void SetConstructionCacheSize(const size_t new_construction_cache_size)
+    { construction_cache_size_ = new_construction_cache_size; }
 private:
+    /** \brief  Applies the creation flags of the two constructors that take a string URL, possibly by retrieving the
+     *          outcome from the construction cache.
+     */
+    void initialise(const unsigned creation_flags);
+
+    void applyCreationFlags(const unsigned creation_flags);
+
+    /** Copies everything that applyCreationFlags() may have changed from "other" to us. */
+    void copyConstructionState(const Url &other);
+
     /** \brief   Force "url_" to be an absolute HTTP URL if it is not relative.
      *  \return  True if we came up with something sensible and false if the relative "url_" did not start out
      *           with a valid hostname.
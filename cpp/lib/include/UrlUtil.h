@@ -270,6 +270,16 @@ std::string CanoniseUrlAsKey(const std::string &url);
 bool IsRobotsDotTxtUrl(const Url &test_url);
 
 
+/** \brief  Lowercases the scheme and the host name and drops a default port, e.g. "HTTP://Www.Example.ORG:80/A?b" turns
+ *          into "http://www.example.org/A?b".  Anything following the authority is returned unchanged.
+ *  \return The normalised URL or "url" itself if it doesn't contain "://".
+ *  \note   This is cheap enough to be called on every URL of every MARC record: the normalised "scheme://authority"
+ *          prefixes are memoised in a bounded, process-wide cache that may be used from any number of threads.  As
+ *          there are far fewer distinct hosts than URL's, each normalised prefix is only computed and stored once.
+ */
+std::string NormaliseUrlPrefix(const std::string &url);
+
+
 inline bool IsValidWebUrl(const std::string &url) { return Url(url).isValidWebUrl(); }
 
 
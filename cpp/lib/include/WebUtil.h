@@ -29,6 +29,7 @@
 #pragma once
 
 
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -154,6 +155,24 @@ void GetArgvArgs(const int argc, char * argv[], std::multimap<std::string, std::
 void GetAllCgiArgs(std::multimap<std::string, std::string> * const cgi_args, int argc = 1, char *argv[] = NULL);
 
 
+/** \return True if we have been started by a FastCGI process manager, i.e. if our stdin is a listening socket. */
+bool IsFastCgiProcess();
+
+
+/** \brief  Calls "request_handler" once for each HTTP request that we have to serve.
+ *  \note   If we have been started by a FastCGI process manager, e.g. Apache's mod_fcgid, we keep serving requests until
+ *          we get killed.  Database connections, parsed configuration files and compiled templates that have been set
+ *          up before calling this function can then be reused by all requests.  For the duration of each call to
+ *          "request_handler" the request's parameters replace those of the previous request in our environment,
+ *          std::cin reads the request body and whatever gets written to std::cout becomes the response.  Otherwise,
+ *          i.e. if we have been started as a classic CGI program, we call "request_handler" exactly once.
+ *  \note   "request_handler" must obtain the CGI arguments anew for each request, e.g. via GetAllCgiArgs(), and must
+ *          not write to stdout via stdio.  Calling exit(3), e.g. via LOG_ERROR, ends the process, which is safe but
+ *          loses the response to the current request.
+ */
+void ProcessCgiRequests(const std::function<void()> &request_handler);
+
+
 /** \brief  Excutes a CGI script via POST.
  *  \param  username_password    A colon-separated username/password pair.  Currently we only support "Basic"
  *                               authorization!
@@ -21,6 +21,7 @@
 
 
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <deque>
@@ -51,7 +52,12 @@ public:
     };
     typedef std::map<std::string, std::string> Attributes;
 
-    enum Type { XML_FILE, XML_STRING };
+    enum Type { XML_FILE, XML_STRING, XML_STREAM };
+
+    /** \brief Copies up to "buffer_size" bytes of a document to "buffer".
+     *  \return The number of bytes that were copied, zero at the end of the document.
+     */
+    typedef std::function<size_t(char * const buffer, const size_t buffer_size)> ReadFunction;
 
     struct Options {
         /** \brief Parser enforces all the constraints / rules specified by the NameSpace specification (default false).*/
@@ -84,6 +90,8 @@ public:
 private:
     Type type_;
     Options options_;
+    ReadFunction read_function_; // Only used for XML_STREAM.
+    off_t stream_offset_;        // The number of bytes we got from "read_function_" so far.
 
     static void ConvertAndThrowException(const xercesc::RuntimeException &exc);
     static void ConvertAndThrowException(const xercesc::SAXParseException &exc);
@@ -121,7 +129,11 @@ private:
     std::deque<XMLPart> buffer_;
     inline void appendToBuffer(XMLPart &xml_part) { buffer_.emplace_back(xml_part); }
 
-    /** \brief depending on type_: returns either length of the file or length of the string.*/
+    void init();
+
+    /** \brief depending on type_: returns either length of the file or length of the string or, for streams, the
+     *         number of bytes read so far.
+     */
     off_t getMaxOffset();
 
     friend class Handler;
@@ -130,11 +142,18 @@ private:
     static std::string ToStdString(const XMLCh * const xmlch);
 public:
     explicit XMLParser(const std::string &xml_filename_or_string, const Type type, const Options &options = DEFAULT_OPTIONS);
+
+    /** \brief Parses a document that is handed to us piecemeal by "read_function", e.g. while it is being downloaded.
+     *  \note  Parsing only ever asks for as much of the document as is needed to return the next element.  Streams can't
+     *         be rewound.
+     */
+    explicit XMLParser(const ReadFunction &read_function, const Options &options = DEFAULT_OPTIONS);
     ~XMLParser() { delete parser_; delete handler_; delete error_handler_; xercesc::XMLPlatformUtils::Terminate(); }
 
     /** \brief Restarts parsing of a new file or string. */
     void reset(const std::string &xml_filename_or_string, const Type type, const Options &options = DEFAULT_OPTIONS);
 
+    /** \throws XMLParser::Error if we are parsing an XML_STREAM. */
     inline void rewind() { reset(xml_filename_or_string_, type_, options_); }
 
     bool peek(XMLPart * const xml_part);
@@ -64,6 +64,7 @@ private:
     std::string internal_encoding_;
     std::string external_encoding_;
     std::unique_ptr<TextUtil::ToUTF32Decoder> to_utf32_decoder_;
+    bool utf8_input_; // If true, we can copy character data straight from our DataSource w/o decoding it.
     off_t datasource_content_start_pos_;    // offset in the datasource that denotes the start of the content (excluding BOMs)
 
     static const std::deque<int> CDATA_START_DEQUE;
@@ -153,12 +154,14 @@ template<typename DataSource> const std::string XMLSubsetParser<DataSource>::CAN
 
 
 template<typename DataSource> XMLSubsetParser<DataSource>::XMLSubsetParser(DataSource * const input, const std::string &external_encoding)
-    : input_(input), line_no_(1), last_type_(UNINITIALISED), last_element_was_empty_(false), data_collector_(nullptr), datasource_content_start_pos_(0)
+    : input_(input), line_no_(1), last_type_(UNINITIALISED), last_element_was_empty_(false), data_collector_(nullptr),
+      utf8_input_(false), datasource_content_start_pos_(0)
 {
     if (not external_encoding.empty())
         external_encoding_ = external_encoding;
 
     detectEncoding();
+    utf8_input_ = TextUtil::CanonizeCharset(to_utf32_decoder_->getInputEncoding()) == "utf8";
 }
 
 
@@ -562,6 +565,14 @@ template<typename DataSource> bool XMLSubsetParser<DataSource>::getNext(
         last_type_ = *type = CHARACTERS;
 
 collect_next_character:
+        // Fast path: copy everything up to the next '<' in bulk.  Comments and CDATA sections, both of which start
+        // with a '<', will be handled by the character-at-a-time loop below.
+        if (utf8_input_ and pushed_back_chars_.empty() and data_collector_ == nullptr) {
+            const size_t old_data_size(data->size());
+            if (input_->appendUntil(data, '<') > 0 and line_no_ != 0)
+                line_no_ += std::count(data->cbegin() + old_data_size, data->cend(), '\n');
+        }
+
         bool cdata_start(false);
         while ((ch = get(/* skip_comment = */true, &cdata_start)) != '<') {
             if (cdata_start) {
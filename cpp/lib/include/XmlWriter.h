@@ -137,6 +137,14 @@ public:
     /** Emits the number of spaces corresponding to the current nesting level to the output file. */
     void indent();
 
+    /** \brief  Writes "length" bytes of "text" as is, i.e. w/o escaping or text conversion.
+     *  \note   This is meant for callers that generate markup themselves and they are responsible for its well-formedness.
+     */
+    void writeRaw(const char * const text, const size_t length);
+
+    inline unsigned getIndentAmount() const { return indent_amount_; }
+    inline unsigned getNestingLevel() const { return nesting_level_; }
+
     /** \brief Flushes the buffers of the underlying File to the storage medium.
      *  \return True on success and false on failure.  Sets errno if there is a failure.
      */
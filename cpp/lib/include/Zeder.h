@@ -128,8 +128,10 @@ public:
 
 
 // A collection of related entries (from the same Zeder Instance)
+// N.B. The IDs of entries must not be changed while they are part of a collection as they are indexed.
 class EntryCollection {
     std::vector<Entry> entries_;
+    std::unordered_map<unsigned, size_t> ids_to_indices_map_;  // Zeder ID => index into "entries_"
 public:
     using iterator = std::vector<Entry>::iterator;
     using const_iterator = std::vector<Entry>::const_iterator;
@@ -147,27 +149,31 @@ public:
     const_iterator begin() const { return entries_.begin(); }
     const_iterator end() const { return entries_.end(); }
     size_t size() const { return entries_.size(); }
-    void clear() { entries_.clear(); }
-    iterator erase(iterator entry) { return entries_.erase(entry); }
+    void clear() { entries_.clear(); ids_to_indices_map_.clear(); }
+    iterator erase(iterator entry);
     bool empty() const { return entries_.empty(); }
+private:
+    // Updates "ids_to_indices_map_" for all entries starting at "first_index".
+    void reindex(const size_t first_index = 0);
 };
 
 
 inline void EntryCollection::sortEntries() {
     std::sort(entries_.begin(), entries_.end(),
               [](const Entry &a, const Entry &b) { return a.getId() < b.getId(); });
+    reindex();
 }
 
 
 inline EntryCollection::iterator EntryCollection::find(const unsigned id) {
-    return std::find_if(entries_.begin(), entries_.end(),
-                        [id] (const Entry &entry) { return entry.getId() == id; });
+    const auto id_and_index(ids_to_indices_map_.find(id));
+    return (id_and_index == ids_to_indices_map_.end()) ? entries_.end() : entries_.begin() + id_and_index->second;
 }
 
 
 inline EntryCollection::const_iterator EntryCollection::find(const unsigned id) const {
-    return std::find_if(entries_.begin(), entries_.end(),
-                        [id] (const Entry &entry) { return entry.getId() == id; });
+    const auto id_and_index(ids_to_indices_map_.find(id));
+    return (id_and_index == ids_to_indices_map_.end()) ? entries_.cend() : entries_.cbegin() + id_and_index->second;
 }
 
 
@@ -438,6 +444,17 @@ public:
 
 std::string GetFullDumpEndpointPath(Flavour zeder_flavour);
 
+
+// Full dumps younger than this are used w/o asking the Zeder server whether they are still current.
+constexpr unsigned DEFAULT_MAX_SNAPSHOT_AGE(3600); // in seconds
+
+
+// Retrieves the full dump (JSON) available at "endpoint_url".  Dumps are kept as snapshots in a local directory that is
+// shared by all Zeder tools.  Snapshots older than "max_snapshot_age" are refreshed w/ a conditional request based on
+// their ETag.  If the refresh fails, an existing snapshot will be used.
+bool GetFullDump(const std::string &endpoint_url, std::string * const json_blob,
+                 const unsigned max_snapshot_age = DEFAULT_MAX_SNAPSHOT_AGE);
+
 Flavour ParseFlavour(const std::string &flavour, const bool case_sensitive = false);
 
 
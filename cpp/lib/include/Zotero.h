@@ -149,7 +149,7 @@ bool Export(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::
 bool Import(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Params downloader_params,
             const std::string &input_content, std::string * const output_json, std::string * const error_message);
 
-/** \brief Download single URL and return as JSON. (If harvested_html is not empty, URL is not downloaded again.) */
+/** \brief Have the server download a single URL and return the extracted metadata as JSON. */
 bool Web(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Params downloader_params,
          const Url &harvest_url, std::string * const response_body, unsigned * response_code,
          std::string * const error_message);
@@ -161,6 +161,11 @@ bool Web(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Par
          const std::string &request_body, std::string * const response_body, unsigned * response_code,
          std::string * const error_message);
 
+/** \brief Returns one line per endpoint w/ the number of requests made by this process so far and the 50th, 90th and 99th
+ *         percentile as well as the maximum of their round-trip times, or an empty string if there were no requests.
+ */
+std::string GetLatencyReport();
+
 
 } // namespace TranslationServer
 
@@ -261,7 +266,7 @@ protected:
     BSZUpload::DeliveryTracker delivery_tracker_;
     std::string output_format_;
     std::string output_file_;
-    SiteParams *site_params_;
+    const SiteParams *site_params_;
     const std::shared_ptr<const HarvestParams> harvest_params_;
 protected:
     FormatHandler(DbConnection * const db_connection, const std::string &output_format, const std::string &output_file,
@@ -272,7 +277,7 @@ protected:
 public:
     virtual ~FormatHandler() = default;
 
-    inline void setAugmentParams(SiteParams * const new_site_params) { site_params_ = new_site_params; }
+    inline void setAugmentParams(const SiteParams * const new_site_params) { site_params_ = new_site_params; }
     inline BSZUpload::DeliveryTracker &getDeliveryTracker() { return delivery_tracker_; }
 
     /** \brief Convert & write single record to output file */
@@ -287,8 +292,8 @@ public:
 
 
 class JsonFormatHandler final : public FormatHandler {
-    unsigned record_count_;
     File *output_file_object_;
+    JSON::Writer json_writer_;
 public:
     JsonFormatHandler(DbConnection * const db_connection, const std::string &output_format, const std::string &output_file,
                       const std::shared_ptr<const HarvestParams> &harvest_params);
@@ -298,8 +303,8 @@ public:
 
 
 class ZoteroFormatHandler final : public FormatHandler {
-    unsigned record_count_;
     std::string json_buffer_;
+    JSON::Writer json_writer_;
 public:
     ZoteroFormatHandler(DbConnection * const db_connection, const std::string &output_format, const std::string &output_file,
                         const std::shared_ptr<const HarvestParams> &harvest_params);
@@ -309,7 +314,24 @@ public:
 
 
 class MarcFormatHandler final : public FormatHandler {
+    // The parts of the MARC conversion that only depend on the site and not on the individual item.  They are prepared
+    // once per site so that we don't have to validate the additional fields and locate the placeholders of the
+    // non-standard metadata fields again for each record.
+    struct SitePlan {
+        struct NonStandardMetadataField {
+            std::string field_template_;
+            std::string placeholder_;                // The name of the "notes" key.
+            std::string placeholder_and_delimiters_; // The text in "field_template_" that will be replaced.
+        };
+
+        std::vector<std::pair<MARC::Tag, std::string>> additional_fields_; // Those of the site followed by those of the group.
+        std::vector<NonStandardMetadataField> non_standard_metadata_fields_;
+    public:
+        explicit SitePlan(const SiteParams &site_params);
+    };
+
     std::unique_ptr<MARC::Writer> marc_writer_;
+    std::unordered_map<const SiteParams *, std::unique_ptr<const SitePlan>> site_params_to_plan_map_;
 public:
     MarcFormatHandler(DbConnection * const db_connection, const std::string &output_file,
                       const std::shared_ptr<const HarvestParams> &harvest_params, const std::string &output_format = "");
@@ -357,7 +379,12 @@ private:
     void extractItemParameters(std::shared_ptr<const JSON::ObjectNode> object_node,
                                struct ItemParameters * const item_parameters);
 
-    void generateMarcRecord(MARC::Record * const record, const struct ItemParameters &item_parameters);
+    void generateMarcRecord(MARC::Record * const record, const struct ItemParameters &item_parameters, const SitePlan &site_plan);
+
+    const SitePlan &getSitePlan();
+
+    static void InsertNonStandardMetadata(MARC::Record * const record, const std::map<std::string, std::string> &notes_key_value_pairs,
+                                          const std::vector<SitePlan::NonStandardMetadataField> &non_standard_metadata_fields);
 
     void mergeCustomParametersToItemParameters(struct ItemParameters * const item_parameters,
                                                struct CustomNodeParameters &custom_node_params);
@@ -372,6 +399,16 @@ private:
 const std::shared_ptr<RegexMatcher> LoadSupportedURLsRegex(const std::string &map_directory_path);
 
 
+/** \brief  Makes it safe to call the harvesting functions below from several threads at the same time.
+ *  \param  max_concurrent_zts_requests  The maximum number of requests to the Zotero Translation Server that may be in
+ *                                       flight at any one time.
+ *  \note   Must be called before the first harvesting thread is started.  The harvesting functions then serialise all of
+ *          their work except for waiting on the network, i.e. on downloads, crawl delays and the translation server.
+ *          Harvests of URL's on the same domain are spaced out by that domain's crawl delay.
+ */
+void EnableConcurrentHarvesting(const unsigned max_concurrent_zts_requests);
+
+
 /** \brief  Harvest a single URL.
  *  \return count of all records / previously downloaded records => The number of newly downloaded records is the
  *          difference (first - second).
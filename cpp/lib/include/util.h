@@ -20,6 +20,7 @@
 #pragma once
 
 
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -44,20 +45,42 @@
  */
 class Logger {
     friend Logger *LoggerInstantiator();
+    class AsynchronousWriter;
     std::mutex mutex_;
     int fd_;
     bool log_process_pids_, log_no_decorations_, log_strip_call_site_;
+    std::atomic<AsynchronousWriter *> asynchronous_writer_;
 public:
     enum LogLevel { LL_ERROR = 1, LL_WARNING = 2, LL_INFO = 3, LL_DEBUG = 4 };
+    enum OverflowPolicy { BLOCK_ON_OVERFLOW, DROP_ON_OVERFLOW };
 private:
     LogLevel min_log_level_;
     Logger();
 public:
-    void redirectOutput(const int new_fd) { fd_ = new_fd; }
+    void redirectOutput(const int new_fd) { flush(); fd_ = new_fd; }
 
     void setMinimumLogLevel(const LogLevel min_log_level) { min_log_level_ = min_log_level; }
     LogLevel getMinimumLogLevel() const { return min_log_level_; }
 
+    /** \brief Hands warnings, informational and debug messages to a background thread instead of writing them ourselves.
+     *  \param max_buffered_size  The maximum number of bytes that may be waiting to be written.
+     *  \param overflow_policy    What to do w/ a message that would exceed "max_buffered_size".  If we drop messages, the
+     *                            number of dropped messages will be reported once there is space again.
+     *  \note  Each thread buffers its own messages, so messages from different threads may be written in a different
+     *         order than they were logged in.  The timestamps are those of the calls to the logger though.
+     *  \note  Errors are always written synchronously, after all buffered messages.  We also flush at exit(3).
+     */
+    void enableAsynchronousMode(const size_t max_buffered_size = 4 * 1024 * 1024,
+                                const OverflowPolicy overflow_policy = BLOCK_ON_OVERFLOW);
+
+    //* Writes all buffered messages and returns to writing each message as it is being logged.
+    void disableAsynchronousMode();
+
+    inline bool isAsynchronous() const { return asynchronous_writer_.load() != nullptr; }
+
+    //* Waits until all buffered messages have been written.  A no-op if we are not in asynchronous mode.
+    void flush();
+
     //* Emits "msg" and then calls exit(3), also generates a call stack trace if the environment variable BACKTRACE has been set.
     [[noreturn]] void error(const std::string &msg) __attribute__((noreturn));
     [[noreturn]] inline void error(const std::string &function_name, const std::string &msg) __attribute__((noreturn))
@@ -81,7 +104,9 @@ public:
     // \brief Returns a string representation of "log_level".
     static std::string LogLevelToString(const LogLevel log_level);
 private:
-    void writeString(const std::string &level, std::string msg);
+    void log(const std::string &level, const std::string &msg);
+    std::string formatMessage(const std::string &level, std::string msg, const bool decorate) const;
+    void writeString(const std::string &level, const std::string &msg, const bool decorate = true);
 };
 extern Logger *logger;
 
@@ -18,18 +18,44 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "Archive.h"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
 #include <cstring>
 #include <fcntl.h>
 #include "Compiler.h"
 #include "File.h"
 #include "FileUtil.h"
+#include "GzStream.h"
 #include "StringUtil.h"
+#include "ThreadPool.h"
 #include "util.h"
 
 
 namespace Archive {
 
 
+namespace {
+
+
+void WriteOrThrow(const int fd, const char *data, size_t data_size) {
+    while (data_size > 0) {
+        const ssize_t write_count(::write(fd, data, data_size));
+        if (unlikely(write_count == -1)) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("write(2) failed: " + std::string(std::strerror(errno)));
+        }
+        data      += write_count;
+        data_size -= write_count;
+    }
+}
+
+
+} // unnamed namespace
+
+
 const std::string Reader::EntryInfo::getFilename() const {
     return ::archive_entry_pathname(archive_entry_);
 }
@@ -127,7 +153,7 @@ bool Reader::extractEntry(const std::string &member_name, std::string output_fil
 
 
 Writer::Writer(const std::string &archive_file_name, const std::string &archive_write_options, const FileType file_type)
-    : archive_entry_(nullptr)
+    : archive_entry_(nullptr), output_fd_(-1)
 {
     archive_handle_ = ::archive_write_new();
 
@@ -138,10 +164,8 @@ Writer::Writer(const std::string &archive_file_name, const std::string &archive_
                 LOG_ERROR("no write options are currently supported for the uncompressed tar format!");
             ::archive_write_set_format_pax_restricted(archive_handle_);
         } else if (StringUtil::EndsWith(archive_file_name, ".tar.gz")) {
-            ::archive_write_add_filter_gzip(archive_handle_);
-            if (unlikely(::archive_write_set_options(archive_handle_, archive_write_options.c_str()) != ARCHIVE_OK))
-                LOG_ERROR("failed to call archive_write_set_options(3) w/ \"" + archive_write_options + "\"!");
-            ::archive_write_set_format_pax_restricted(archive_handle_);
+            openGzippedTar(archive_file_name, archive_write_options);
+            return;
         } else
             LOG_ERROR("FileType::AUTO selected but," " can't guess the file type from the given filename \"" + archive_file_name + "\"!");
         break;
@@ -151,11 +175,8 @@ Writer::Writer(const std::string &archive_file_name, const std::string &archive_
         ::archive_write_set_format_pax_restricted(archive_handle_);
         break;
     case FileType::GZIPPED_TAR:
-        ::archive_write_add_filter_gzip(archive_handle_);
-        if (unlikely(::archive_write_set_options(archive_handle_, archive_write_options.c_str()) != ARCHIVE_OK))
-            LOG_ERROR("failed to call archive_write_set_options(3) w/ \"" + archive_write_options + "\"! (2)");
-        ::archive_write_set_format_pax_restricted(archive_handle_);
-        break;
+        openGzippedTar(archive_file_name, archive_write_options);
+        return;
     }
 
     if (unlikely(::archive_write_open_filename(archive_handle_, archive_file_name.c_str()) != ARCHIVE_OK))
@@ -211,30 +232,168 @@ void Writer::add(const std::string &filename, std::string archive_name) {
 }
 
 
-void UnpackArchive(const std::string &archive_name, const std::string &directory) {
-    if (unlikely(not FileUtil::MakeDirectory(directory)))
-        LOG_ERROR("failed to create directory \"" + directory + "\"!");
+// Instead of libarchive's single-threaded gzip filter we let libarchive produce a plain tar stream and compress that
+// ourselves on all cores.
+void Writer::openGzippedTar(const std::string &archive_file_name, const std::string &archive_write_options) {
+    int compression_level(Z_DEFAULT_COMPRESSION);
+    if (not archive_write_options.empty()) {
+        std::string option(archive_write_options);
+        if (StringUtil::StartsWith(option, "gzip:"))
+            option = option.substr(__builtin_strlen("gzip:"));
+        unsigned level;
+        if (unlikely(not StringUtil::StartsWith(option, "compression-level=")
+                     or not StringUtil::ToUnsigned(option.substr(__builtin_strlen("compression-level=")), &level)
+                     or level > 9))
+            LOG_ERROR("unsupported archive write options \"" + archive_write_options + "\"!");
+        compression_level = static_cast<int>(level);
+    }
+
+    output_fd_ = ::open(archive_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (unlikely(output_fd_ == -1))
+        LOG_ERROR("failed to open \"" + archive_file_name + "\" for writing!");
+    const int output_fd(output_fd_);
+    compressor_.reset(new ParallelGzStream(GzStream::GZIP,
+                                           [output_fd](const char * const data, const size_t data_size) {
+                                               WriteOrThrow(output_fd, data, data_size); },
+                                           compression_level));
+
+    ::archive_write_set_format_pax_restricted(archive_handle_);
+    if (unlikely(::archive_write_open(archive_handle_, this, /* opener = */nullptr, WriteCompressed, CloseCompressed)
+                 != ARCHIVE_OK))
+        LOG_ERROR("archive_write_open(3) failed: " + std::string(::archive_error_string(archive_handle_)));
+}
+
+
+ssize_t Writer::WriteCompressed(archive *archive_handle, void *client_data, const void *buffer, size_t length) {
+    try {
+        reinterpret_cast<Writer *>(client_data)->compressor_->write(reinterpret_cast<const char *>(buffer), length);
+    } catch (const std::exception &x) { // We must not throw through libarchive.
+        ::archive_set_error(archive_handle, errno, "%s", x.what());
+        return ARCHIVE_FATAL;
+    }
+
+    return length;
+}
+
+
+int Writer::CloseCompressed(archive *archive_handle, void *client_data) {
+    Writer &writer(*reinterpret_cast<Writer *>(client_data));
+    int status(ARCHIVE_OK);
+    try {
+        writer.compressor_->finish();
+    } catch (const std::exception &x) {
+        ::archive_set_error(archive_handle, errno, "%s", x.what());
+        status = ARCHIVE_FATAL;
+    }
+
+    if (unlikely(::close(writer.output_fd_) != 0) and status == ARCHIVE_OK) {
+        ::archive_set_error(archive_handle, errno, "close(2) failed");
+        status = ARCHIVE_FATAL;
+    }
+    writer.output_fd_ = -1;
+
+    return status;
+}
+
+
+void ProcessEntriesConcurrently(const std::string &archive_name, const std::function<void(const Entry &entry)> &entry_processor,
+                                const unsigned thread_count, const size_t max_buffered_size)
+{
+    // Must outlive "thread_pool" as the tasks use them:
+    std::mutex buffered_size_mutex;
+    std::condition_variable buffer_space_available;
+    size_t buffered_size(0);
+
+    ThreadPool thread_pool(thread_count);
+    std::deque<std::future<void>> outstanding_calls;
+    std::exception_ptr first_exception;
+    const auto collect_oldest_call([&outstanding_calls, &first_exception]() {
+        try {
+            outstanding_calls.front().get();
+        } catch (const std::future_error &) {
+            // The call was discarded after an earlier exception.
+        } catch (...) {
+            if (not first_exception)
+                first_exception = std::current_exception();
+        }
+        outstanding_calls.pop_front();
+    });
 
     Reader reader(archive_name);
-    Reader::EntryInfo file_info;
-    while (reader.getNext(&file_info)) {
-        if (file_info.empty())
+    Reader::EntryInfo entry_info;
+    size_t entry_index(0);
+    while (not thread_pool.isCancelled() and reader.getNext(&entry_info)) {
+        if (not entry_info.isRegularFile())
             continue;
 
-        if (unlikely(not file_info.isRegularFile()))
-            LOG_ERROR("unexpectedly, the entry \"" + file_info.getFilename() + "\" in \"" + archive_name + "\" is not a regular file!");
-
-        const std::string output_filename(directory + "/" + file_info.getFilename());
-        const auto output(FileUtil::OpenOutputFileOrDie(output_filename));
+        // Wait until we may buffer another member:
+        const size_t expected_size(entry_info.size() > 0 ? entry_info.size() : 0);
+        {
+            std::unique_lock<std::mutex> buffered_size_locker(buffered_size_mutex);
+            buffer_space_available.wait(buffered_size_locker, [&] {
+                return buffered_size == 0 or buffered_size + expected_size <= max_buffered_size or thread_pool.isCancelled();
+            });
+        }
 
-        char buf[8192];
-        size_t read_count;
-        while ((read_count = reader.read(buf, sizeof buf)) > 0) {
-            if (unlikely(output->write(buf, read_count) != read_count))
-                LOG_ERROR("failed to write data to \"" + output->getPath() + "\"! (No room?)");
+        const auto entry(std::make_shared<Entry>());
+        entry->index_ = entry_index++;
+        entry->name_  = entry_info.getFilename();
+        entry->contents_.reserve(expected_size);
+        char buffer[64 * 1024];
+        ssize_t read_count;
+        while ((read_count = reader.read(buffer, sizeof buffer)) > 0)
+            entry->contents_.append(buffer, read_count);
+        if (unlikely(read_count < 0))
+            LOG_ERROR("failed to read \"" + entry->name_ + "\" from \"" + archive_name + "\": " + reader.getLastErrorMessage());
+
+        const size_t entry_size(entry->contents_.size());
+        {
+            std::lock_guard<std::mutex> buffered_size_locker(buffered_size_mutex);
+            buffered_size += entry_size;
         }
+
+        outstanding_calls.emplace_back(thread_pool.submit([&, entry, entry_size] {
+            const auto release_buffer_space([&] {
+                std::lock_guard<std::mutex> buffered_size_locker(buffered_size_mutex);
+                buffered_size -= entry_size;
+                buffer_space_available.notify_all();
+            });
+
+            try {
+                entry_processor(*entry);
+            } catch (...) {
+                thread_pool.cancel();
+                release_buffer_space();
+                throw;
+            }
+            release_buffer_space();
+        }));
+
+        while (not outstanding_calls.empty()
+               and outstanding_calls.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            collect_oldest_call();
     }
-    
+
+    while (not outstanding_calls.empty())
+        collect_oldest_call();
+    if (first_exception)
+        std::rethrow_exception(first_exception);
+}
+
+
+void UnpackArchive(const std::string &archive_name, const std::string &directory) {
+    if (unlikely(not FileUtil::MakeDirectory(directory)))
+        LOG_ERROR("failed to create directory \"" + directory + "\"!");
+
+    // Writing the members concurrently keeps the disk busy while we decompress the archive.
+    ProcessEntriesConcurrently(archive_name, [&directory](const Entry &entry) {
+        if (entry.contents_.empty())
+            return;
+
+        const std::string output_filename(directory + "/" + entry.name_);
+        if (unlikely(not FileUtil::WriteString(output_filename, entry.contents_)))
+            LOG_ERROR("failed to write data to \"" + output_filename + "\"! (No room?)");
+    });
 }
 
 
@@ -17,8 +17,19 @@
 #include <set>
 #include "StlHelpers.h"
 #include "BSZTransform.h"
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "DownloadBatch.h"
 #include "Downloader.h"
+#include "File.h"
 #include "FileUtil.h"
+#include "KeyValueStore.h"
 #include "MapUtil.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
@@ -29,48 +40,365 @@
 namespace BSZTransform {
 
 
-void LoadISSNToPPNMap(std::unordered_map<std::string, PPNandTitle> * const ISSN_to_superior_ppn_map) {
-     enum ISSN_TO_PPN_OFFSET {ISSN_OFFSET = 0, PPN_OFFSET = 1, TITLE_OFFSET = 4};
-     std::vector<std::vector<std::string>> parsed_issn_to_superior_content;
-     TextUtil::ParseCSVFileOrDie(ISSN_TO_MISC_BITS_MAP_PATH_LOCAL, &parsed_issn_to_superior_content, ',', (char) 0x00);
-     for (const auto parsed_line : parsed_issn_to_superior_content) {
-         const std::string ISSN(parsed_line[ISSN_OFFSET]);
-         const std::string PPN(parsed_line[PPN_OFFSET]);
-         const std::string title(StringUtil::RightTrim(" \t", parsed_line[TITLE_OFFSET]));
-         ISSN_to_superior_ppn_map->emplace(ISSN, PPNandTitle(PPN, title));
-     }
+// Offsets are relative to the start of the string pool.
+struct ISSNToMiscBitsTable::StringRef {
+    uint32_t offset_, length_;
+};
+
+
+struct ISSNToMiscBitsTable::Entry {
+    StringRef issn_, ppn_, title_;
+};
+
+
+namespace {
+
+
+const char TABLE_MAGIC[8]{ 'U', 'B', 'I', 'S', 'S', 'N', 'M', 'B' };
+const uint64_t TABLE_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the entry table and finally the
+// string pool.
+struct TableHeader {
+    char magic_[sizeof TABLE_MAGIC];
+    uint64_t version_;
+    uint64_t map_file_size_;
+    int64_t map_mtime_seconds_;
+    int64_t map_mtime_nanoseconds_;
+    uint64_t entry_count_;
+    uint64_t string_pool_size_;
+};
+
+
+void StatOrDie(const std::string &path, struct stat * const stat_buf) {
+    if (unlikely(::stat(path.c_str(), stat_buf) != 0))
+        LOG_ERROR("stat(2) on \"" + path + "\" failed!");
+}
+
+
+inline bool HeaderMatchesFile(const TableHeader &header, const struct stat &stat_buf) {
+    return std::memcmp(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC) == 0 and header.version_ == TABLE_VERSION
+           and header.map_file_size_ == static_cast<uint64_t>(stat_buf.st_size)
+           and header.map_mtime_seconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_sec)
+           and header.map_mtime_nanoseconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_nsec);
+}
+
+
+// Uses the same ordering as std::string, i.e. bytes compare as unsigned chars.
+inline int Compare(const StringView &lhs, const std::string &rhs) {
+    const int cmp(std::memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size())));
+    if (cmp != 0)
+        return cmp;
+    return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+
+// Writes the table to a temporary file first so that concurrent readers never see a partially written table.
+bool WriteTable(const std::string &table_path, const std::string &table) {
+    const std::string temp_path(table_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(table) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, table_path, /* remove_target = */true);
+}
+
+
+} // unnamed namespace
+
+
+ISSNToMiscBitsTable::ISSNToMiscBitsTable(const std::string &map_path)
+    : table_path_(GetTablePath(map_path)), mmap_(nullptr), mmap_size_(0), entries_(nullptr), entry_count_(0),
+      string_pool_(nullptr)
+{
+    if (mapTable(map_path))
+        return;
+
+    in_memory_table_ = Generate(map_path);
+    if (not WriteTable(table_path_, in_memory_table_))
+        LOG_WARNING("failed to write \"" + table_path_ + "\", keeping the ISSN table in memory!");
+    else if (mapTable(map_path)) {
+        in_memory_table_.clear();
+        in_memory_table_.shrink_to_fit();
+        return;
+    }
+
+    setTables(in_memory_table_.data());
+}
+
+
+ISSNToMiscBitsTable::~ISSNToMiscBitsTable() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + table_path_ + "\" failed!");
+}
+
+
+bool ISSNToMiscBitsTable::lookup(const std::string &issn, StringView * const ppn, StringView * const title) const {
+    size_t low(0), high(entry_count_);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const int cmp(Compare(getString(entries_[middle].issn_), issn));
+        if (cmp < 0)
+            low = middle + 1;
+        else if (cmp > 0)
+            high = middle;
+        else {
+            *ppn   = getString(entries_[middle].ppn_);
+            *title = getString(entries_[middle].title_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+std::string ISSNToMiscBitsTable::Generate(const std::string &map_path) {
+    struct stat stat_buf;
+    StatOrDie(map_path, &stat_buf);
+
+    enum ISSN_TO_PPN_OFFSET { ISSN_OFFSET = 0, PPN_OFFSET = 1, TITLE_OFFSET = 4 };
+    std::vector<std::vector<std::string>> parsed_issn_to_superior_content;
+    TextUtil::ParseCSVFileOrDie(map_path, &parsed_issn_to_superior_content, ',', (char) 0x00);
+
+    // The stable sort and skipping all but the first of equal ISSN's has the same effect as the emplace()'s into the
+    // unordered_map that we used to have.
+    std::vector<const std::vector<std::string> *> lines;
+    lines.reserve(parsed_issn_to_superior_content.size());
+    for (const auto &parsed_line : parsed_issn_to_superior_content) {
+        if (likely(parsed_line.size() > TITLE_OFFSET))
+            lines.emplace_back(&parsed_line);
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const std::vector<std::string> *lhs, const std::vector<std::string> *rhs)
+                                                     { return (*lhs)[ISSN_OFFSET] < (*rhs)[ISSN_OFFSET]; });
+
+    std::string string_pool;
+    const auto append([&string_pool](const std::string &s) {
+        if (unlikely(string_pool.size() + s.length() > std::numeric_limits<uint32_t>::max()))
+            LOG_ERROR("string pool overflow!");
+        const StringRef string_ref{ static_cast<uint32_t>(string_pool.size()), static_cast<uint32_t>(s.length()) };
+        string_pool += s;
+        return string_ref;
+    });
+
+    std::vector<Entry> entries;
+    entries.reserve(lines.size());
+    for (auto line(lines.cbegin()); line != lines.cend(); ++line) {
+        if (line != lines.cbegin() and (**(line - 1))[ISSN_OFFSET] == (**line)[ISSN_OFFSET])
+            continue; // The first occurrence wins.
+
+        entries.emplace_back(Entry{ append((**line)[ISSN_OFFSET]), append((**line)[PPN_OFFSET]),
+                                    append(StringUtil::RightTrim(" \t", (**line)[TITLE_OFFSET])) });
+    }
+
+    TableHeader header;
+    std::memcpy(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC);
+    header.version_               = TABLE_VERSION;
+    header.map_file_size_         = stat_buf.st_size;
+    header.map_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.map_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.entry_count_           = entries.size();
+    header.string_pool_size_      = string_pool.size();
+
+    std::string table(reinterpret_cast<const char *>(&header), sizeof header);
+    table.append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    table += string_pool;
+
+    return table;
 }
 
 
-AugmentMaps::AugmentMaps(const std::string &map_directory_path) {
+bool ISSNToMiscBitsTable::mapTable(const std::string &map_path) {
+    const int fd(::open(table_path_.c_str(), O_RDONLY));
+    if (fd == -1)
+        return false;
+
+    struct stat table_stat_buf;
+    if (unlikely(::fstat(fd, &table_stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + table_path_ + "\" failed!");
+    if (static_cast<size_t>(table_stat_buf.st_size) < sizeof(TableHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * const mapping(::mmap(nullptr, table_stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + table_path_ + "\"!");
+
+    struct stat map_stat_buf;
+    StatOrDie(map_path, &map_stat_buf);
+    const TableHeader * const header(reinterpret_cast<const TableHeader *>(mapping));
+    if (not HeaderMatchesFile(*header, map_stat_buf)
+        or static_cast<size_t>(table_stat_buf.st_size)
+           != sizeof(TableHeader) + header->entry_count_ * sizeof(Entry) + header->string_pool_size_)
+    {
+        ::munmap(mapping, table_stat_buf.st_size);
+        return false;
+    }
+
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = table_stat_buf.st_size;
+    setTables(mmap_);
+
+    return true;
+}
+
+
+void ISSNToMiscBitsTable::setTables(const char * const table_start) {
+    const TableHeader * const header(reinterpret_cast<const TableHeader *>(table_start));
+    entries_      = reinterpret_cast<const Entry *>(table_start + sizeof(TableHeader));
+    entry_count_  = header->entry_count_;
+    string_pool_  = table_start + sizeof(TableHeader) + entry_count_ * sizeof(Entry);
+}
+
+
+inline StringView ISSNToMiscBitsTable::getString(const StringRef &string_ref) const {
+    return StringView(string_pool_ + string_ref.offset_, string_ref.length_);
+}
+
+
+AugmentMaps::AugmentMaps(const std::string &map_directory_path)
+    : ISSN_to_superior_ppn_and_title_table_(std::make_shared<const ISSNToMiscBitsTable>())
+{
     MapUtil::DeserialiseMap(map_directory_path + "language_to_language_code.map", &language_to_language_code_map_);
     MapUtil::DeserialiseMap(map_directory_path + "ISSN_to_language_code.map", &ISSN_to_language_code_map_);
     MapUtil::DeserialiseMap(map_directory_path + "ISSN_to_licence.map", &ISSN_to_licence_map_);
     MapUtil::DeserialiseMap(map_directory_path + "ISSN_to_keyword_field.map", &ISSN_to_keyword_field_map_);
     MapUtil::DeserialiseMap(map_directory_path + "ISSN_to_volume.map", &ISSN_to_volume_map_);
     MapUtil::DeserialiseMap(map_directory_path + "ISSN_to_SSG.map", &ISSN_to_SSG_map_);
-    LoadISSNToPPNMap(&ISSN_to_superior_ppn_and_title_map_);
 }
 
 
-// "author" must be in the lastname,firstname format. Returns the empty string if no PPN was found.
+bool AugmentMaps::lookupSuperiorPPNAndTitle(const std::string &issn, PPNandTitle * const ppn_and_title) const {
+    StringView ppn, title;
+    if (not ISSN_to_superior_ppn_and_title_table_->lookup(issn, &ppn, &title))
+        return false;
+
+    *ppn_and_title = PPNandTitle(std::string(ppn.data(), ppn.size()), std::string(title.data(), title.size()));
+    return true;
+}
+
+
+namespace {
+
+
+// Protects the in-process cache and the lazy opening of the persistent one.
+std::mutex author_ppn_cache_mutex;
+std::unordered_map<std::string, std::string> url_to_lookup_result_cache;
+
+
+// \return nullptr if the persistent cache can't be used by this process.
+KeyValueStore *GetPersistentAuthorPPNCache() {
+    static std::unique_ptr<KeyValueStore> persistent_cache;
+    static bool initialised(false);
+    if (not initialised) {
+        initialised = true;
+        // KeyValueStore aborts if it can't open the store, so we have to check first:
+        if (::access(FileUtil::GetDirname(AUTHOR_PPN_CACHE_PATH).c_str(), W_OK) == 0
+            and (not FileUtil::Exists(AUTHOR_PPN_CACHE_PATH) or ::access(AUTHOR_PPN_CACHE_PATH.c_str(), W_OK) == 0))
+            persistent_cache.reset(new KeyValueStore(AUTHOR_PPN_CACHE_PATH, KeyValueStore::CREATE));
+        else
+            LOG_DEBUG("can't write to \"" + AUTHOR_PPN_CACHE_PATH + "\", author PPN's will only be cached in memory.");
+    }
+
+    return persistent_cache.get();
+}
+
+
+// Persistent entries have the form "lookup_time,PPN" w/ an empty PPN if the lookup found nothing.
+bool LookupPersistentAuthorPPN(KeyValueStore * const persistent_cache, const std::string &url, std::string * const ppn) {
+    std::string value;
+    if (not persistent_cache->get(url, &value))
+        return false;
+
+    const auto comma_pos(value.find(','));
+    unsigned long lookup_time;
+    if (unlikely(comma_pos == std::string::npos or not StringUtil::ToUnsignedLong(value.substr(0, comma_pos), &lookup_time)))
+        return false;
+
+    *ppn = value.substr(comma_pos + 1);
+    const time_t ttl(ppn->empty() ? AUTHOR_PPN_NEGATIVE_CACHE_TTL : AUTHOR_PPN_CACHE_TTL);
+    return static_cast<time_t>(lookup_time) + ttl > std::time(nullptr);
+}
+
+
+std::string ExtractAuthorPPN(const std::string &lookup_result) {
+    static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactoryOrDie("<SMALL>PPN</SMALL>.*<div><SMALL>([0-9X]+)"));
+    return matcher->matched(lookup_result) ? (*matcher)[1] : "";
+}
+
+
+} // unnamed namespace
+
+
 std::string DownloadAuthorPPN(const std::string &author, const std::string &author_lookup_base_url) {
-    const std::string LOOKUP_URL(author_lookup_base_url + UrlUtil::UrlEncode(author));
-    static std::unordered_map<std::string, std::string> url_to_lookup_result_cache;
-    const auto url_and_lookup_result(url_to_lookup_result_cache.find(LOOKUP_URL));
-    if (url_and_lookup_result == url_to_lookup_result_cache.end()) {
-        static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("<SMALL>PPN</SMALL>.*<div><SMALL>([0-9X]+)"));
-        Downloader downloader(LOOKUP_URL);
-        if (downloader.anErrorOccurred())
-            LOG_WARNING("couldn't download author PPN! downloader error: " + downloader.getLastErrorMessage());
-        else if (matcher->matched(downloader.getMessageBody())) {
-            url_to_lookup_result_cache.emplace(LOOKUP_URL, (*matcher)[1]);
-            return (*matcher)[1];
-        } else
-            url_to_lookup_result_cache.emplace(LOOKUP_URL, "");
-    } else
-        return url_and_lookup_result->second;
-    return "";
+    const auto authors_to_ppns(DownloadAuthorPPNs({ author }, author_lookup_base_url));
+    const auto author_and_ppn(authors_to_ppns.find(author));
+    return (author_and_ppn == authors_to_ppns.cend()) ? "" : author_and_ppn->second;
+}
+
+
+std::unordered_map<std::string, std::string> DownloadAuthorPPNs(const std::vector<std::string> &authors,
+                                                                const std::string &author_lookup_base_url)
+{
+    std::lock_guard<std::mutex> lock(author_ppn_cache_mutex);
+    KeyValueStore * const persistent_cache(GetPersistentAuthorPPNCache());
+
+    std::unordered_map<std::string, std::string> authors_to_ppns;
+    std::unordered_map<std::string, std::vector<std::string>> urls_to_authors_to_look_up;
+    for (const auto &author : authors) {
+        const std::string lookup_url(author_lookup_base_url + UrlUtil::UrlEncode(author));
+        auto url_and_ppn(url_to_lookup_result_cache.find(lookup_url));
+        if (url_and_ppn == url_to_lookup_result_cache.end()) {
+            std::string ppn;
+            if (persistent_cache == nullptr or not LookupPersistentAuthorPPN(persistent_cache, lookup_url, &ppn)) {
+                urls_to_authors_to_look_up[lookup_url].emplace_back(author);
+                continue;
+            }
+            url_and_ppn = url_to_lookup_result_cache.emplace(lookup_url, ppn).first;
+        }
+        if (not url_and_ppn->second.empty())
+            authors_to_ppns[author] = url_and_ppn->second;
+    }
+
+    if (urls_to_authors_to_look_up.empty())
+        return authors_to_ppns;
+
+    std::vector<std::pair<std::string, std::string>> new_lookup_results;
+    DownloadBatch download_batch;
+    for (const auto &url_and_authors : urls_to_authors_to_look_up) {
+        download_batch.addUrl(url_and_authors.first, Downloader::Params(), Downloader::DEFAULT_TIME_LIMIT,
+                              [&](const DownloadBatch::Result &result) {
+                                  // Download errors are not cached, we'll try again next time:
+                                  if (result.anErrorOccurred()) {
+                                      LOG_WARNING("couldn't download author PPN! downloader error: " + result.error_message_);
+                                      return;
+                                  }
+
+                                  const std::string ppn(ExtractAuthorPPN(result.message_body_));
+                                  url_to_lookup_result_cache.emplace(result.url_, ppn);
+                                  new_lookup_results.emplace_back(result.url_, ppn);
+                                  if (not ppn.empty()) {
+                                      for (const auto &author : urls_to_authors_to_look_up[result.url_])
+                                          authors_to_ppns[author] = ppn;
+                                  }
+                              });
+    }
+    download_batch.run();
+
+    if (persistent_cache != nullptr and not new_lookup_results.empty()) {
+        const std::string now(std::to_string(std::time(nullptr)));
+        KeyValueStore::WriteTransaction transaction(persistent_cache);
+        for (const auto &url_and_ppn : new_lookup_results)
+            transaction.put(url_and_ppn.first, now + "," + url_and_ppn.second);
+        transaction.commit();
+    }
+
+    return authors_to_ppns;
 }
 
 
@@ -17,10 +17,17 @@
 */
 
 #include "BSZUpload.h"
+#include "DbStatement.h"
+#include "FileUtil.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "TimeUtil.h"
 #include <memory>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 namespace BSZUpload {
@@ -41,9 +48,10 @@ bool DeliveryTracker::hasAlreadyBeenDelivered(const std::string &url, const std:
     std::string truncated_url(url);
     truncateURL(&truncated_url);
 
-    db_connection_->queryOrDie("SELECT url, delivered_at, journal_name, hash FROM delivered_marc_records WHERE url='"
-                               + db_connection_->escapeString(truncated_url) + "'");
-    auto result_set(db_connection_->getLastResultSet());
+    const auto statement(db_connection_->prepare("SELECT url, delivered_at, journal_name, hash FROM delivered_marc_records WHERE url=?"));
+    statement->bind(0, truncated_url);
+    statement->executeOrDie();
+    auto result_set(statement->getResultSet());
     if (result_set.empty())
         return false;
 
@@ -83,9 +91,11 @@ size_t DeliveryTracker::listOutdatedJournals(const unsigned cutoff_days, std::un
 
 
 time_t DeliveryTracker::getLastDeliveryTime(const std::string &journal_name) const {
-    db_connection_->queryOrDie("SELECT delivered_at FROM delivered_marc_records WHERE journal_name='" +
-                                db_connection_->escapeString(journal_name) + "' ORDER BY delivered_at DESC");
-    auto result_set(db_connection_->getLastResultSet());
+    const auto statement(db_connection_->prepare("SELECT delivered_at FROM delivered_marc_records WHERE journal_name=?"
+                                                 " ORDER BY delivered_at DESC"));
+    statement->bind(0, journal_name);
+    statement->executeOrDie();
+    auto result_set(statement->getResultSet());
     if (result_set.empty())
         return TimeUtil::BAD_TIME_T;
 
@@ -93,4 +103,234 @@ time_t DeliveryTracker::getLastDeliveryTime(const std::string &journal_name) con
 }
 
 
+struct FtpUploader::Upload {
+    std::string local_path_, remote_directory_, filename_, temp_filename_;
+    int fd_;
+    curl_off_t file_size_;
+    unsigned attempt_count_;
+    CURL *easy_handle_;
+    curl_slist *rename_commands_;
+    char error_buffer_[CURL_ERROR_SIZE];
+public:
+    Upload(const std::string &local_path, const std::string &remote_directory);
+    ~Upload() { cleanUp(); }
+
+    inline std::string getRemotePath() const { return remote_directory_ + filename_; }
+    void cleanUp();
+};
+
+
+FtpUploader::Upload::Upload(const std::string &local_path, const std::string &remote_directory)
+    : local_path_(local_path), remote_directory_(remote_directory), filename_(FileUtil::GetLastPathComponent(local_path)),
+      fd_(-1), file_size_(0), attempt_count_(0), easy_handle_(nullptr), rename_commands_(nullptr)
+{
+    if (not StringUtil::StartsWith(remote_directory_, "/"))
+        remote_directory_.insert(0, 1, '/');
+    if (not StringUtil::EndsWith(remote_directory_, '/'))
+        remote_directory_ += '/';
+
+    // Same naming convention as our old upload script:
+    const auto last_dot_pos(filename_.rfind('.'));
+    temp_filename_ = (last_dot_pos == std::string::npos ? filename_ : filename_.substr(0, last_dot_pos)) + ".tmp";
+    error_buffer_[0] = '\0';
+}
+
+
+void FtpUploader::Upload::cleanUp() {
+    if (easy_handle_ != nullptr) {
+        ::curl_easy_cleanup(easy_handle_);
+        easy_handle_ = nullptr;
+    }
+    if (rename_commands_ != nullptr) {
+        ::curl_slist_free_all(rename_commands_);
+        rename_commands_ = nullptr;
+    }
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+
+FtpUploader::FtpUploader(const std::string &host, const std::string &username, const std::string &password,
+                         const unsigned max_connections)
+    : multi_handle_(::curl_multi_init()), host_(host), username_(username), password_(password),
+      max_connections_(max_connections)
+{
+    if (unlikely(multi_handle_ == nullptr))
+        throw std::runtime_error("in BSZUpload::FtpUploader::FtpUploader: curl_multi_init() failed!");
+    if (unlikely(max_connections_ == 0))
+        throw std::runtime_error("in BSZUpload::FtpUploader::FtpUploader: the maximum number of connections must be positive!");
+
+    // The multi handle's connection cache lets consecutive uploads reuse the logged-in control connections:
+    ::curl_multi_setopt(multi_handle_, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(max_connections_));
+    ::curl_multi_setopt(multi_handle_, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(max_connections_));
+    ::curl_multi_setopt(multi_handle_, CURLMOPT_MAXCONNECTS, static_cast<long>(max_connections_));
+}
+
+
+FtpUploader::~FtpUploader() {
+    for (const auto &easy_handle_and_upload : active_uploads_) {
+        ::curl_multi_remove_handle(multi_handle_, easy_handle_and_upload.first);
+        delete easy_handle_and_upload.second;
+    }
+    for (const auto upload : pending_uploads_)
+        delete upload;
+    ::curl_multi_cleanup(multi_handle_);
+}
+
+
+void FtpUploader::addFile(const std::string &local_path, const std::string &remote_directory) {
+    pending_uploads_.emplace_back(new Upload(local_path, remote_directory));
+}
+
+
+const std::vector<FtpUploader::Result> &FtpUploader::run() {
+    while (not pending_uploads_.empty() or not active_uploads_.empty()) {
+        while (not pending_uploads_.empty() and active_uploads_.size() < max_connections_) {
+            Upload * const upload(pending_uploads_.front());
+            pending_uploads_.pop_front();
+            const std::string error_message(startUpload(upload));
+            if (unlikely(not error_message.empty()))
+                finishUpload(upload, error_message);
+        }
+
+        if (not active_uploads_.empty())
+            performUploads();
+    }
+
+    return results_;
+}
+
+
+std::string FtpUploader::startUpload(Upload * const upload) {
+    ++upload->attempt_count_;
+    upload->error_buffer_[0] = '\0';
+
+    // We only open the file when we need it so that long upload lists don't exhaust our file descriptors:
+    if (upload->fd_ == -1) {
+        upload->fd_ = ::open(upload->local_path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (unlikely(upload->fd_ == -1))
+            return "failed to open \"" + upload->local_path_ + "\" for reading!";
+        struct stat stat_buf;
+        if (unlikely(::fstat(upload->fd_, &stat_buf) != 0))
+            return "failed to fstat(2) \"" + upload->local_path_ + "\"!";
+        upload->file_size_ = stat_buf.st_size;
+        ::posix_fadvise(upload->fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    if (unlikely(::lseek(upload->fd_, 0, SEEK_SET) == -1))
+        return "failed to rewind \"" + upload->local_path_ + "\"!";
+
+    upload->easy_handle_ = ::curl_easy_init();
+    if (unlikely(upload->easy_handle_ == nullptr))
+        return "curl_easy_init() failed!";
+
+    upload->rename_commands_ = ::curl_slist_append(upload->rename_commands_, ("RNFR " + upload->temp_filename_).c_str());
+    upload->rename_commands_ = ::curl_slist_append(upload->rename_commands_, ("RNTO " + upload->filename_).c_str());
+
+    // A retried upload of a big file only sends what the server doesn't have yet.  We never resume on the first attempt
+    // since a left-over temporary file may belong to an earlier version of the file.
+    const bool resume(upload->attempt_count_ > 1 and upload->file_size_ >= RESUME_THRESHOLD);
+
+    const std::string url("ftp://" + host_ + upload->remote_directory_ + upload->temp_filename_);
+    CURL * const easy_handle(upload->easy_handle_);
+    if (::curl_easy_setopt(easy_handle, CURLOPT_URL, url.c_str()) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_USERNAME, username_.c_str()) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_PASSWORD, password_.c_str()) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_UPLOAD, 1L) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_INFILESIZE_LARGE, upload->file_size_) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_READFUNCTION, ReadFunction) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_READDATA, upload) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_SEEKFUNCTION, SeekFunction) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_SEEKDATA, upload) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(resume ? -1 : 0)) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_POSTQUOTE, upload->rename_commands_) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_ERRORBUFFER, upload->error_buffer_) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_NOSIGNAL, 1L) != CURLE_OK
+        // Give up on stalled transfers, they'll be retried:
+        or ::curl_easy_setopt(easy_handle, CURLOPT_LOW_SPEED_LIMIT, 1L) != CURLE_OK
+        or ::curl_easy_setopt(easy_handle, CURLOPT_LOW_SPEED_TIME, 60L) != CURLE_OK)
+        return "failed to set up the upload of \"" + upload->local_path_ + "\"!";
+
+    if (unlikely(::curl_multi_add_handle(multi_handle_, easy_handle) != CURLM_OK))
+        throw std::runtime_error("in BSZUpload::FtpUploader::startUpload: curl_multi_add_handle() failed!");
+    active_uploads_.emplace(easy_handle, upload);
+
+    return "";
+}
+
+
+void FtpUploader::performUploads() {
+    int running_handles;
+    if (unlikely(::curl_multi_perform(multi_handle_, &running_handles) != CURLM_OK))
+        throw std::runtime_error("in BSZUpload::FtpUploader::performUploads: curl_multi_perform() failed!");
+
+    std::vector<std::pair<Upload *, CURLcode>> completed_uploads;
+    int messages_in_queue;
+    while (const CURLMsg * const message = ::curl_multi_info_read(multi_handle_, &messages_in_queue)) {
+        if (message->msg != CURLMSG_DONE)
+            continue;
+
+        const auto easy_handle_and_upload(active_uploads_.find(message->easy_handle));
+        if (unlikely(easy_handle_and_upload == active_uploads_.end()))
+            throw std::runtime_error("in BSZUpload::FtpUploader::performUploads: unknown easy handle!");
+        completed_uploads.emplace_back(easy_handle_and_upload->second, message->data.result);
+    }
+
+    for (const auto &upload_and_curl_error_code : completed_uploads) {
+        Upload * const upload(upload_and_curl_error_code.first);
+        ::curl_multi_remove_handle(multi_handle_, upload->easy_handle_);
+        active_uploads_.erase(upload->easy_handle_);
+
+        const CURLcode curl_error_code(upload_and_curl_error_code.second);
+        if (curl_error_code == CURLE_OK) {
+            finishUpload(upload, "");
+            continue;
+        }
+
+        const std::string error_message(upload->error_buffer_[0] != '\0' ? upload->error_buffer_
+                                                                          : ::curl_easy_strerror(curl_error_code));
+        if (upload->attempt_count_ >= MAX_ATTEMPTS)
+            finishUpload(upload, error_message);
+        else {
+            LOG_WARNING("attempt #" + std::to_string(upload->attempt_count_) + " to upload \"" + upload->local_path_
+                        + "\" failed: " + error_message);
+            ::curl_easy_cleanup(upload->easy_handle_);
+            upload->easy_handle_ = nullptr;
+            ::curl_slist_free_all(upload->rename_commands_);
+            upload->rename_commands_ = nullptr;
+            pending_uploads_.emplace_back(upload);
+        }
+    }
+
+    if (completed_uploads.empty() and running_handles > 0) {
+        const int MAX_WAIT_TIME(1000); // In ms.
+        if (unlikely(::curl_multi_wait(multi_handle_, nullptr, 0, MAX_WAIT_TIME, nullptr) != CURLM_OK))
+            throw std::runtime_error("in BSZUpload::FtpUploader::performUploads: curl_multi_wait() failed!");
+    }
+}
+
+
+void FtpUploader::finishUpload(Upload * const upload, const std::string &error_message) {
+    results_.emplace_back(Result{ upload->local_path_, upload->getRemotePath(), upload->attempt_count_, error_message });
+    delete upload;
+}
+
+
+size_t FtpUploader::ReadFunction(char *buffer, size_t size, size_t nitems, void *upload) {
+    for (;;) {
+        const ssize_t read_count(::read(reinterpret_cast<Upload *>(upload)->fd_, buffer, size * nitems));
+        if (likely(read_count != -1))
+            return static_cast<size_t>(read_count);
+        if (errno != EINTR)
+            return CURL_READFUNC_ABORT;
+    }
+}
+
+
+int FtpUploader::SeekFunction(void *upload, curl_off_t offset, int origin) {
+    return (::lseek(reinterpret_cast<Upload *>(upload)->fd_, offset, origin) == -1) ? CURL_SEEKFUNC_FAIL : CURL_SEEKFUNC_OK;
+}
+
+
 } // namespace BSZUpload
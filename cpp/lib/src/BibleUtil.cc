@@ -18,8 +18,15 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "BibleUtil.h"
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
+#include <unordered_map>
 #include <cctype>
+#include "BinaryIO.h"
+#include "File.h"
+#include "FileUtil.h"
 #include "Locale.h"
 #include "MapUtil.h"
 #include "RegexMatcher.h"
@@ -494,6 +501,77 @@ std::string BibleBookToCodeMapper::mapToCode(const std::string &bible_book_candi
 }
 
 
+BibleBookMatcher::BibleBookMatcher(const std::string &books_of_the_bible_to_canonical_form_map_filename,
+                                   const std::string &books_of_the_bible_to_code_map_filename)
+{
+    std::unordered_map<std::string, std::string> books_of_the_bible_to_canonical_form_map, bible_books_to_codes_map;
+    MapUtil::DeserialiseMap(books_of_the_bible_to_canonical_form_map_filename, &books_of_the_bible_to_canonical_form_map);
+    MapUtil::DeserialiseMap(books_of_the_bible_to_code_map_filename, &bible_books_to_codes_map);
+
+    // We use an ordered map so that our patterns don't depend on the iteration order of hash tables:
+    std::map<std::string, std::string> book_names_to_codes_map(bible_books_to_codes_map.cbegin(), bible_books_to_codes_map.cend());
+    for (const auto &non_canonical_and_canonical_form : books_of_the_bible_to_canonical_form_map) {
+        const auto canonical_form_and_code(bible_books_to_codes_map.find(non_canonical_and_canonical_form.second));
+        if (canonical_form_and_code != bible_books_to_codes_map.cend())
+            book_names_to_codes_map.emplace(non_canonical_and_canonical_form.first, canonical_form_and_code->second);
+    }
+
+    std::vector<std::string> patterns;
+    for (const auto &book_name_and_code : book_names_to_codes_map) {
+        patterns.emplace_back(StringUtil::RemoveChars(" \t", book_name_and_code.first));
+        book_codes_.emplace_back(book_name_and_code.second);
+    }
+    matcher_.reset(new MultiPatternMatcher(patterns));
+}
+
+
+static inline bool IsWordCharacter(const char ch) {
+    return StringUtil::IsAsciiLetter(ch) or StringUtil::IsDigit(ch) or static_cast<unsigned char>(ch) >= 0x80u;
+}
+
+
+void BibleBookMatcher::findMentions(const std::string &lowercase_text, std::vector<Mention> * const mentions) const {
+    mentions->clear();
+
+    // Book names don't contain whitespace, so we scan a compacted copy of "lowercase_text" and remember where each
+    // remaining character came from:
+    std::string compacted_text;
+    std::vector<size_t> original_positions;
+    for (size_t pos(0); pos < lowercase_text.length(); ++pos) {
+        if (not StringUtil::IsWhitespace(lowercase_text[pos])) {
+            compacted_text += lowercase_text[pos];
+            original_positions.emplace_back(pos);
+        }
+    }
+
+    std::vector<MultiPatternMatcher::Match> matches;
+    matcher_->findAll(compacted_text, &matches);
+
+    // Only keep mentions that start and end at word boundaries in the original text.  Among overlapping mentions
+    // we prefer the leftmost and then the longest:
+    std::vector<Mention> candidates;
+    for (const auto &match : matches) {
+        const size_t start(original_positions[match.start_]);
+        const size_t end(original_positions[match.start_ + match.length_ - 1] + 1);
+        if ((start > 0 and IsWordCharacter(lowercase_text[start - 1]))
+            or (end < lowercase_text.length() and StringUtil::IsAsciiLetter(lowercase_text[end])))
+            continue;
+        candidates.emplace_back(start, end - start, book_codes_[match.pattern_index_]);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Mention &lhs, const Mention &rhs) {
+        return lhs.start_ < rhs.start_ or (lhs.start_ == rhs.start_ and lhs.length_ > rhs.length_);
+    });
+
+    size_t next_free_pos(0);
+    for (const auto &candidate : candidates) {
+        if (candidate.start_ >= next_free_pos) {
+            mentions->emplace_back(candidate);
+            next_free_pos = candidate.start_ + candidate.length_;
+        }
+    }
+}
+
+
 BibleAliasMapper::BibleAliasMapper(const std::string &bible_aliases_map_filename) {
     MapUtil::DeserialiseMap(bible_aliases_map_filename, &aliases_to_canonical_forms_map_);
 }
@@ -548,4 +626,329 @@ std::string BibleAliasMapper::map(const std::string &bible_reference_candidate,
 }
 
 
+
+RangeIndex::RangeIndex(const std::vector<PPNAndRange> &ppns_and_ranges) {
+    std::unordered_map<std::string, uint32_t> ppns_to_indices_map;
+    ranges_.reserve(ppns_and_ranges.size());
+    for (const auto &ppn_and_range : ppns_and_ranges) {
+        if (unlikely(ppn_and_range.start_ > ppn_and_range.end_))
+            LOG_ERROR("bad range " + std::to_string(ppn_and_range.start_) + ":" + std::to_string(ppn_and_range.end_)
+                      + " for PPN " + ppn_and_range.ppn_ + "!");
+
+        const auto ppn_and_index(ppns_to_indices_map.emplace(ppn_and_range.ppn_, ppns_.size()));
+        if (ppn_and_index.second)
+            ppns_.emplace_back(ppn_and_range.ppn_);
+        ranges_.emplace_back(Range{ ppn_and_range.start_, ppn_and_range.end_, 0, ppn_and_index.first->second });
+    }
+
+    std::sort(ranges_.begin(), ranges_.end(),
+              [](const Range &lhs, const Range &rhs) { return lhs.start_ < rhs.start_
+                                                              or (lhs.start_ == rhs.start_ and lhs.end_ < rhs.end_); });
+    computeMaxEnds();
+}
+
+
+RangeIndex::RangeIndex(const std::string &index_filename) {
+    const auto input(FileUtil::OpenInputFileOrDie(index_filename));
+
+    uint32_t ppn_count;
+    BinaryIO::ReadOrDie(*input, &ppn_count);
+    ppns_.resize(ppn_count);
+    for (auto &ppn : ppns_)
+        BinaryIO::ReadOrDie(*input, &ppn);
+
+    uint32_t range_count;
+    BinaryIO::ReadOrDie(*input, &range_count);
+    ranges_.resize(range_count);
+    for (auto &range : ranges_) {
+        BinaryIO::ReadOrDie(*input, &range.start_);
+        BinaryIO::ReadOrDie(*input, &range.end_);
+        BinaryIO::ReadOrDie(*input, &range.ppn_index_);
+        if (unlikely(range.ppn_index_ >= ppn_count or range.start_ > range.end_))
+            LOG_ERROR("\"" + index_filename + "\" is corrupt!");
+    }
+
+    // The ranges were written in sorted order.
+    computeMaxEnds();
+}
+
+
+void RangeIndex::write(const std::string &index_filename) const {
+    const auto output(FileUtil::OpenOutputFileOrDie(index_filename));
+
+    BinaryIO::WriteOrDie(*output, static_cast<uint32_t>(ppns_.size()));
+    for (const auto &ppn : ppns_)
+        BinaryIO::WriteOrDie(*output, ppn);
+
+    BinaryIO::WriteOrDie(*output, static_cast<uint32_t>(ranges_.size()));
+    for (const auto &range : ranges_) {
+        BinaryIO::WriteOrDie(*output, range.start_);
+        BinaryIO::WriteOrDie(*output, range.end_);
+        BinaryIO::WriteOrDie(*output, range.ppn_index_);
+    }
+}
+
+
+// In the implicit tree the leaves are the even indices and the node at index i on level k > 0 has the children
+// i - 2^(k-1) and i + 2^(k-1).  If the number of ranges is not of the form 2^n - 1, some nodes on the right edge of the tree
+// don't exist.  We recurse through them anyway, so that their existing descendants will be visited.
+void RangeIndex::computeMaxEnds() {
+    root_level_ = 0;
+    if (ranges_.empty())
+        return;
+
+    while ((size_t(1) << (root_level_ + 1)) <= ranges_.size())
+        ++root_level_;
+    computeMaxEnds((size_t(1) << root_level_) - 1, root_level_);
+}
+
+
+// \return The largest end of all the ranges in the subtree rooted at "node_index" or 0 if there are none.
+uint32_t RangeIndex::computeMaxEnds(const size_t node_index, const unsigned level) {
+    uint32_t max_end(0);
+    if (level > 0) {
+        const size_t child_offset(size_t(1) << (level - 1));
+        max_end = computeMaxEnds(node_index - child_offset, level - 1);
+        if (node_index + 1 < ranges_.size())
+            max_end = std::max(max_end, computeMaxEnds(node_index + child_offset, level - 1));
+    }
+
+    if (node_index >= ranges_.size())
+        return max_end;
+
+    max_end = std::max(max_end, ranges_[node_index].end_);
+    ranges_[node_index].max_end_ = max_end;
+    return max_end;
+}
+
+
+void RangeIndex::findOverlapping(const uint32_t start, const uint32_t end, std::set<std::string> * const ppns) const {
+    if (not ranges_.empty())
+        findOverlapping((size_t(1) << root_level_) - 1, root_level_, start, end, ppns);
+}
+
+
+void RangeIndex::findOverlapping(const size_t node_index, const unsigned level, const uint32_t start, const uint32_t end,
+                                 std::set<std::string> * const ppns) const
+{
+    const size_t child_offset(level == 0 ? 0 : size_t(1) << (level - 1));
+
+    // A node that doesn't exist only has a left subtree w/ existing nodes.
+    if (node_index >= ranges_.size()) {
+        if (level > 0)
+            findOverlapping(node_index - child_offset, level - 1, start, end, ppns);
+        return;
+    }
+
+    const Range &range(ranges_[node_index]);
+    if (range.max_end_ < start) // Nothing in this subtree reaches "start".
+        return;
+
+    if (level > 0)
+        findOverlapping(node_index - child_offset, level - 1, start, end, ppns);
+
+    if (range.start_ > end) // This range and all the ranges in the right subtree start after "end".
+        return;
+
+    if (range.end_ >= start)
+        ppns->emplace(ppns_[range.ppn_index_]);
+
+    if (level > 0)
+        findOverlapping(node_index + child_offset, level - 1, start, end, ppns);
+}
+
+
+bool RangeIndex::ParseRange(const std::string &range, uint32_t * const start, uint32_t * const end) {
+    const auto separator_pos(range.find_first_of(":_"));
+    if (separator_pos == std::string::npos)
+        return false;
+
+    unsigned start_code, end_code;
+    if (not StringUtil::ToUnsigned(range.substr(0, separator_pos), &start_code)
+        or not StringUtil::ToUnsigned(range.substr(separator_pos + 1), &end_code) or start_code > end_code)
+        return false;
+
+    *start = start_code;
+    *end   = end_code;
+    return true;
+}
+
+
+namespace {
+
+
+inline unsigned GetBookCode(const uint32_t code) {
+    return code / 1000000u;
+}
+
+
+inline unsigned GetChapter(const uint32_t code) {
+    return (code / 1000u) % 1000u;
+}
+
+
+const unsigned WHOLE_BOOK(0); // Used instead of a chapter number.
+
+
+} // unnamed namespace
+
+
+SuggestionIndex::SuggestionIndex(const std::vector<RangeIndex::PPNAndRange> &ppns_and_ranges,
+                                 const std::string &books_of_the_bible_to_canonical_form_map_filename,
+                                 const std::string &books_of_the_bible_to_code_map_filename)
+{
+    std::unordered_map<std::string, std::string> books_of_the_bible_to_canonical_form_map, bible_books_to_codes_map;
+    MapUtil::DeserialiseMap(books_of_the_bible_to_canonical_form_map_filename, &books_of_the_bible_to_canonical_form_map);
+    MapUtil::DeserialiseMap(books_of_the_bible_to_code_map_filename, &bible_books_to_codes_map);
+
+    // Count the records that refer to each book and chapter:
+    std::map<std::pair<unsigned, unsigned>, uint32_t> books_and_chapters_to_record_counts_map;
+    std::set<std::pair<unsigned, unsigned>> books_and_chapters_of_current_record;
+    for (auto ppn_and_range(ppns_and_ranges.cbegin()); ppn_and_range != ppns_and_ranges.cend(); ++ppn_and_range) {
+        if (ppn_and_range == ppns_and_ranges.cbegin() or ppn_and_range->ppn_ != (ppn_and_range - 1)->ppn_)
+            books_and_chapters_of_current_record.clear();
+
+        const unsigned start_book(GetBookCode(ppn_and_range->start_)), end_book(GetBookCode(ppn_and_range->end_));
+        std::vector<std::pair<unsigned, unsigned>> books_and_chapters{ { start_book, WHOLE_BOOK }, { end_book, WHOLE_BOOK } };
+        const unsigned start_chapter(GetChapter(ppn_and_range->start_)), end_chapter(GetChapter(ppn_and_range->end_));
+        if (start_book == end_book and start_chapter != WHOLE_BOOK and end_chapter - start_chapter < MAX_CHAPTERS_PER_RANGE) {
+            for (unsigned chapter(start_chapter); chapter <= end_chapter; ++chapter)
+                books_and_chapters.emplace_back(start_book, chapter);
+        }
+
+        for (const auto &book_and_chapter : books_and_chapters) {
+            if (books_and_chapters_of_current_record.emplace(book_and_chapter).second)
+                ++books_and_chapters_to_record_counts_map[book_and_chapter];
+        }
+    }
+
+    // All books get a suggestion, even if no record refers to them:
+    std::map<unsigned, std::string> book_codes_to_canonical_names_map;
+    for (const auto &canonical_name_and_code : bible_books_to_codes_map) {
+        unsigned book_code;
+        if (unlikely(not StringUtil::ToUnsigned(canonical_name_and_code.second, &book_code)))
+            LOG_ERROR("bad book code \"" + canonical_name_and_code.second + "\" in \"" + books_of_the_bible_to_code_map_filename
+                      + "\"!");
+        book_codes_to_canonical_names_map[book_code] = canonical_name_and_code.first;
+        books_and_chapters_to_record_counts_map.emplace(std::make_pair(book_code, WHOLE_BOOK), 0);
+    }
+
+    std::map<std::pair<unsigned, unsigned>, uint32_t> books_and_chapters_to_suggestion_indices_map;
+    std::multimap<unsigned, unsigned> book_codes_to_chapters_map;
+    for (const auto &book_and_chapter_and_record_count : books_and_chapters_to_record_counts_map) {
+        const auto &book_and_chapter(book_and_chapter_and_record_count.first);
+        const auto book_code_and_canonical_name(book_codes_to_canonical_names_map.find(book_and_chapter.first));
+        if (book_code_and_canonical_name == book_codes_to_canonical_names_map.cend())
+            continue; // E.g. pericopes that have codes outside of the regular books.
+
+        books_and_chapters_to_suggestion_indices_map[book_and_chapter] = suggestions_.size();
+        if (book_and_chapter.second == WHOLE_BOOK)
+            suggestions_.emplace_back(book_code_and_canonical_name->second, book_and_chapter_and_record_count.second);
+        else {
+            suggestions_.emplace_back(book_code_and_canonical_name->second + " " + std::to_string(book_and_chapter.second),
+                                      book_and_chapter_and_record_count.second);
+            book_codes_to_chapters_map.emplace(book_and_chapter.first, book_and_chapter.second);
+        }
+    }
+
+    // Every name of a book, canonical or not, leads to the book and all of its chapters:
+    std::map<std::string, unsigned> book_names_to_codes_map;
+    for (const auto &canonical_name_and_code : bible_books_to_codes_map)
+        book_names_to_codes_map[canonical_name_and_code.first] = StringUtil::ToUnsigned(canonical_name_and_code.second);
+    for (const auto &non_canonical_and_canonical_form : books_of_the_bible_to_canonical_form_map) {
+        const auto canonical_form_and_code(bible_books_to_codes_map.find(non_canonical_and_canonical_form.second));
+        if (canonical_form_and_code != bible_books_to_codes_map.cend())
+            book_names_to_codes_map.emplace(non_canonical_and_canonical_form.first,
+                                            StringUtil::ToUnsigned(canonical_form_and_code->second));
+    }
+
+    for (const auto &book_name_and_code : book_names_to_codes_map) {
+        const std::string key(StringUtil::RemoveChars(" \t", book_name_and_code.first));
+        const unsigned book_code(book_name_and_code.second);
+        keys_and_suggestion_indices_.emplace_back(key, books_and_chapters_to_suggestion_indices_map.at({ book_code, WHOLE_BOOK }));
+        const auto chapters(book_codes_to_chapters_map.equal_range(book_code));
+        for (auto book_code_and_chapter(chapters.first); book_code_and_chapter != chapters.second; ++book_code_and_chapter)
+            keys_and_suggestion_indices_.emplace_back(key + std::to_string(book_code_and_chapter->second),
+                                                      books_and_chapters_to_suggestion_indices_map.at(*book_code_and_chapter));
+    }
+
+    std::sort(keys_and_suggestion_indices_.begin(), keys_and_suggestion_indices_.end());
+}
+
+
+SuggestionIndex::SuggestionIndex(const std::string &index_filename) {
+    const auto input(FileUtil::OpenInputFileOrDie(index_filename));
+
+    uint32_t suggestion_count;
+    BinaryIO::ReadOrDie(*input, &suggestion_count);
+    suggestions_.resize(suggestion_count);
+    for (auto &suggestion : suggestions_) {
+        BinaryIO::ReadOrDie(*input, &suggestion.text_);
+        BinaryIO::ReadOrDie(*input, &suggestion.record_count_);
+    }
+
+    uint32_t key_count;
+    BinaryIO::ReadOrDie(*input, &key_count);
+    keys_and_suggestion_indices_.resize(key_count);
+    for (auto &key_and_suggestion_index : keys_and_suggestion_indices_) {
+        BinaryIO::ReadOrDie(*input, &key_and_suggestion_index.first);
+        BinaryIO::ReadOrDie(*input, &key_and_suggestion_index.second);
+        if (unlikely(key_and_suggestion_index.second >= suggestion_count))
+            LOG_ERROR("\"" + index_filename + "\" is corrupt!");
+    }
+
+    // The keys were written in sorted order.
+}
+
+
+void SuggestionIndex::write(const std::string &index_filename) const {
+    const auto output(FileUtil::OpenOutputFileOrDie(index_filename));
+
+    BinaryIO::WriteOrDie(*output, static_cast<uint32_t>(suggestions_.size()));
+    for (const auto &suggestion : suggestions_) {
+        BinaryIO::WriteOrDie(*output, suggestion.text_);
+        BinaryIO::WriteOrDie(*output, suggestion.record_count_);
+    }
+
+    BinaryIO::WriteOrDie(*output, static_cast<uint32_t>(keys_and_suggestion_indices_.size()));
+    for (const auto &key_and_suggestion_index : keys_and_suggestion_indices_) {
+        BinaryIO::WriteOrDie(*output, key_and_suggestion_index.first);
+        BinaryIO::WriteOrDie(*output, key_and_suggestion_index.second);
+    }
+}
+
+
+void SuggestionIndex::suggest(const std::string &prefix, const size_t max_count, std::vector<Suggestion> * const suggestions) const {
+    suggestions->clear();
+
+    std::string normalised_prefix(StringUtil::RemoveChars(" \t", TextUtil::UTF8ToLower(prefix)));
+    const auto verses_start(normalised_prefix.find_first_of(":,"));
+    if (verses_start != std::string::npos)
+        normalised_prefix.resize(verses_start);
+    if (normalised_prefix.empty() or max_count == 0)
+        return;
+
+    // Several names of the same book may match, so we have to deduplicate:
+    std::set<uint32_t> suggestion_indices;
+    for (auto key_and_suggestion_index(std::lower_bound(keys_and_suggestion_indices_.cbegin(), keys_and_suggestion_indices_.cend(),
+                                                        std::make_pair(normalised_prefix, uint32_t(0))));
+         key_and_suggestion_index != keys_and_suggestion_indices_.cend()
+         and key_and_suggestion_index->first.compare(0, normalised_prefix.length(), normalised_prefix) == 0;
+         ++key_and_suggestion_index)
+        suggestion_indices.emplace(key_and_suggestion_index->second);
+
+    std::vector<uint32_t> ranked_suggestion_indices(suggestion_indices.cbegin(), suggestion_indices.cend());
+    const auto ranked_end(ranked_suggestion_indices.begin() + std::min(max_count, ranked_suggestion_indices.size()));
+    std::partial_sort(ranked_suggestion_indices.begin(), ranked_end, ranked_suggestion_indices.end(),
+                      [this](const uint32_t lhs, const uint32_t rhs) {
+                          if (suggestions_[lhs].record_count_ != suggestions_[rhs].record_count_)
+                              return suggestions_[lhs].record_count_ > suggestions_[rhs].record_count_;
+                          return lhs < rhs; // Books before their chapters and chapters in numerical order.
+                      });
+
+    for (auto suggestion_index(ranked_suggestion_indices.begin()); suggestion_index != ranked_end; ++suggestion_index)
+        suggestions->emplace_back(suggestions_[*suggestion_index]);
+}
+
+
 } // namespace BibleUtil
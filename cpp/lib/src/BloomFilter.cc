@@ -0,0 +1,74 @@
+/** \file   BloomFilter.cc
+ *  \brief  Implementation of the BloomFilter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "BloomFilter.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cmath>
+#include "Compiler.h"
+
+
+BloomFilter::BloomFilter(const size_t expected_element_count, const double false_positive_rate) {
+    if (unlikely(false_positive_rate <= 0.0 or false_positive_rate >= 1.0))
+        throw std::runtime_error("in BloomFilter::BloomFilter: false_positive_rate must be in (0,1)!");
+
+    // The optimal number of bits and hash functions for the requested false positive rate:
+    const double element_count(std::max(expected_element_count, size_t(1)));
+    bit_count_ = std::max(uint64_t(64), uint64_t(std::ceil(-element_count * std::log(false_positive_rate)
+                                                           / (std::log(2.0) * std::log(2.0)))));
+    hash_count_ = std::min(16u, std::max(1u, unsigned(std::round(bit_count_ / element_count * std::log(2.0)))));
+    words_.resize((bit_count_ + 63) / 64);
+}
+
+
+void BloomFilter::add(const std::string &element) {
+    uint64_t hash1, hash2;
+    getHashes(element, &hash1, &hash2);
+    for (unsigned i(0); i < hash_count_; ++i) {
+        const uint64_t bit_no((hash1 + i * hash2) % bit_count_);
+        words_[bit_no / 64] |= uint64_t(1) << (bit_no % 64);
+    }
+}
+
+
+bool BloomFilter::contains(const std::string &element) const {
+    uint64_t hash1, hash2;
+    getHashes(element, &hash1, &hash2);
+    for (unsigned i(0); i < hash_count_; ++i) {
+        const uint64_t bit_no((hash1 + i * hash2) % bit_count_);
+        if ((words_[bit_no / 64] & (uint64_t(1) << (bit_no % 64))) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+// We derive all our hash functions from two independent ones, see Kirsch & Mitzenmacher, "Less Hashing, Same Performance".
+void BloomFilter::getHashes(const std::string &element, uint64_t * const hash1, uint64_t * const hash2) const {
+    // 64 bit FNV-1a:
+    *hash1 = 14695981039346656037ull;
+    for (const char ch : element) {
+        *hash1 ^= static_cast<unsigned char>(ch);
+        *hash1 *= 1099511628211ull;
+    }
+
+    *hash2 = std::hash<std::string>()(element) | 1u; // A zero step would make all probes hit the same bit.
+}
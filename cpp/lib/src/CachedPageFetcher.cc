@@ -30,8 +30,12 @@
 
 #include "CachedPageFetcher.h"
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <cerrno>
 #include "DbRow.h"
 #include "DnsUtil.h"
@@ -41,6 +45,7 @@
 #include "HttpHeader.h"
 #include "IniFile.h"
 #include "MediaTypeUtil.h"
+#include "PerlCompatRegExp.h"
 #include "SqlUtil.h"
 #include "StringUtil.h"
 #include "Url.h"
@@ -61,6 +66,7 @@ std::string CachedPageFetcher::page_cache_schema_name_("page_cache");
 unsigned CachedPageFetcher::default_expiration_time_(720 * 3600); //30 days, in seconds
 unsigned CachedPageFetcher::minimum_expiration_time_(24 * 3600); // 1 day, in seconds
 unsigned CachedPageFetcher::maximum_document_size_(2147483648U); // 2 Gi, in bytes
+unsigned CachedPageFetcher::memory_cache_size_(CachedPageFetcher::DEFAULT_MEMORY_CACHE_SIZE);
 std::string CachedPageFetcher::http_proxy_;
 std::string CachedPageFetcher::default_user_agent_package_("ub_utils/5.5.0");
 std::string CachedPageFetcher::default_user_agent_url_("http://ivia.ucr.edu/useragent.shtml");
@@ -115,9 +121,103 @@ std::string UrlToCacheKey(const std::string &url) {
 }
 
 
+// CanBeRevalidated -- we can only send a conditional request for successful downloads w/ validators.
+//
+bool CanBeRevalidated(const std::string &status, const std::string &etag, const std::string &http_header) {
+    if (status != "ok" or http_header.empty())
+        return false;
+
+    const HttpHeader header(http_header);
+    return header.getStatusCode() == 200 and (not etag.empty() or header.lastModifiedIsValid());
+}
+
+
 } // unnamed namespace
 
 
+size_t CachedPageFetcher::PageCacheEntry::size() const {
+    return sizeof(PageCacheEntry) + escaped_url_.size() + retrieval_datetime_.size() + expiration_datetime_.size()
+           + status_.size() + redirected_url_.size() + compressed_document_source_.size() + http_header_.size()
+           + etag_.size();
+}
+
+
+/** \class  CachedPageFetcher::MemoryCache
+ *  \brief  A thread-safe LRU cache of page cache entries whose total size is limited to "memory_cache_size_" bytes.
+ */
+class CachedPageFetcher::MemoryCache {
+    std::list<PageCacheEntry> entries_; // Most recently used first.
+    std::unordered_map<std::string, std::list<PageCacheEntry>::iterator> escaped_urls_to_entries_map_;
+    size_t size_;
+    std::mutex mutex_;
+public:
+    MemoryCache(): size_(0) { }
+
+    /** \brief  Inserts "entry" or replaces an existing entry w/ the same URL. */
+    void insert(const PageCacheEntry &entry);
+
+    /** \return True if we have an entry for "escaped_url", else false. */
+    bool lookup(const std::string &escaped_url, PageCacheEntry * const entry);
+
+    void erase(const std::string &escaped_url);
+private:
+    /** \note  Must be called w/ "mutex_" locked. */
+    void eraseEntry(const std::list<PageCacheEntry>::iterator &entry);
+};
+
+
+void CachedPageFetcher::MemoryCache::insert(const PageCacheEntry &entry) {
+    const size_t entry_size(entry.size());
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    const auto escaped_url_and_entry(escaped_urls_to_entries_map_.find(entry.escaped_url_));
+    if (escaped_url_and_entry != escaped_urls_to_entries_map_.end())
+        eraseEntry(escaped_url_and_entry->second);
+
+    if (entry_size > memory_cache_size_)
+        return;
+
+    while (size_ + entry_size > memory_cache_size_)
+        eraseEntry(std::prev(entries_.end()));
+
+    entries_.emplace_front(entry);
+    escaped_urls_to_entries_map_[entry.escaped_url_] = entries_.begin();
+    size_ += entry_size;
+}
+
+
+bool CachedPageFetcher::MemoryCache::lookup(const std::string &escaped_url, PageCacheEntry * const entry) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    const auto escaped_url_and_entry(escaped_urls_to_entries_map_.find(escaped_url));
+    if (escaped_url_and_entry == escaped_urls_to_entries_map_.end())
+        return false;
+
+    entries_.splice(entries_.begin(), entries_, escaped_url_and_entry->second);
+    *entry = entries_.front();
+    return true;
+}
+
+
+void CachedPageFetcher::MemoryCache::erase(const std::string &escaped_url) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    const auto escaped_url_and_entry(escaped_urls_to_entries_map_.find(escaped_url));
+    if (escaped_url_and_entry != escaped_urls_to_entries_map_.end())
+        eraseEntry(escaped_url_and_entry->second);
+}
+
+
+void CachedPageFetcher::MemoryCache::eraseEntry(const std::list<PageCacheEntry>::iterator &entry) {
+    size_ -= entry->size();
+    escaped_urls_to_entries_map_.erase(entry->escaped_url_);
+    entries_.erase(entry);
+}
+
+
+CachedPageFetcher::MemoryCache CachedPageFetcher::memory_cache_;
+
+
 std::string CachedPageFetcher::TimeoutOverrides::getTimeoutForError(const std::string &error_message,
                                                                     const long default_timeout_override) const
 {
@@ -162,6 +262,7 @@ void CachedPageFetcher::ReadIniFile() {
     minimum_expiration_time_ *= 3600;
 
     maximum_document_size_ = ini_file.getUnsigned("Page cache", "maximum_document_size");
+    memory_cache_size_ = ini_file.getUnsigned("Page cache", "memory_cache_size", DEFAULT_MEMORY_CACHE_SIZE);
 
     http_proxy_ = ini_file.getString("Connection", "http_proxy", "");
 
@@ -187,7 +288,7 @@ void CachedPageFetcher::ReadIniFile() {
 
 
 CachedPageFetcher::CachedPageFetcher(const std::string &url, const TimeLimit &time_limit, const Params &params)
-    : params_(params), last_url_(url), last_error_code_(0), robots_dot_txt_("")
+    : params_(params), last_url_(url), last_error_code_(0)
 {
     ThrowIfUrlIsNotAcceptable(url, "CachedPageFetcher::CachedPageFetcher");
     ReadIniFile();
@@ -196,7 +297,7 @@ CachedPageFetcher::CachedPageFetcher(const std::string &url, const TimeLimit &ti
 
 
 CachedPageFetcher::CachedPageFetcher(const Params &params)
-    : params_(params), last_url_(""), last_error_code_(0), robots_dot_txt_("")
+    : params_(params), last_url_(""), last_error_code_(0)
 {
     ReadIniFile();
 }
@@ -375,6 +476,7 @@ unsigned CachedPageFetcher::getMessageBodyHash() const {
     last_error_message_.clear();
 
     // Retrieve body data from the database
+    flushPendingStores();
     requireDbConnection();
     std::string select_stmt("SELECT status, LENGTH(compressed_document_source) AS compressed_document_source_size "
                             "FROM ");
@@ -406,6 +508,7 @@ unsigned CachedPageFetcher::getRedirectCount() const {
 
     std::string escaped_url(UrlToCacheKey(last_url_));
 
+    flushPendingStores();
     requireDbConnection();
     std::string select_stmt("SELECT count(*) FROM " + CreateRedirectTableName(page_cache_schema_name_) +
                             " WHERE cache_id = (SELECT url_id FROM "
@@ -430,6 +533,7 @@ std::string CachedPageFetcher::getRedirectedUrl() const {
 
     std::string escaped_url(UrlToCacheKey(last_url_));
 
+    flushPendingStores();
     requireDbConnection();
     const std::string SELECT_STMT("SELECT status,redirected_url FROM " + getCacheTableName() + " WHERE url='"
                                   + escaped_url + "'");
@@ -451,10 +555,20 @@ std::string CachedPageFetcher::getRedirectedUrl() const {
 }
 
 
-// CachedPageFetcher::getRobotsDotTxtForUrl -- generate a RobotsDotTxt object based on a Url object.
+// CachedPageFetcher::getRobotsDotTxtForUrl -- look up or generate a RobotsDotTxt object based on a Url object.
 //
-void CachedPageFetcher::getRobotsDotTxtForUrl(const Url &url, const TimeLimit &time_limit, const long max_redirects) {
+std::shared_ptr<const RobotsDotTxt> CachedPageFetcher::getRobotsDotTxtForUrl(const Url &url,
+                                                                             const TimeLimit &time_limit,
+                                                                             const long max_redirects)
+{
     const std::string robots_txt_url(url.getRobotsDotTxtUrl());
+    if (robots_txt_url.empty())
+        return nullptr;
+
+    RobotsDotTxtCache &robots_dot_txt_cache(RobotsDotTxtCache::GetInstance());
+    const auto cached_robots_dot_txt(robots_dot_txt_cache.getRobotsDotTxt(robots_txt_url));
+    if (cached_robots_dot_txt != nullptr)
+        return cached_robots_dot_txt;
 
     // Save the current state variables and set temporary ones:
     const RobotsDotTxtOption saved_robots_dot_txt_option(params_.robots_dot_txt_option_);
@@ -463,17 +577,13 @@ void CachedPageFetcher::getRobotsDotTxtForUrl(const Url &url, const TimeLimit &t
     last_url_                      = robots_txt_url;
 
     // Download the robots.txt file.
-    if (not robots_txt_url.empty()) {
-        retrieveDocument(robots_txt_url, time_limit, max_redirects);
-        if (not anErrorOccurred()) {
-            robots_dot_txt_.reinitialize(getMessageBody());
+    retrieveDocument(robots_txt_url, time_limit, max_redirects);
+    if (not anErrorOccurred()) {
+        // Restore the saved state:
+        params_.robots_dot_txt_option_ = saved_robots_dot_txt_option;
+        last_url_                      = saved_last_url;
 
-            // Restore the saved state:
-            params_.robots_dot_txt_option_ = saved_robots_dot_txt_option;
-            last_url_                      = saved_last_url;
-
-            return;
-        }
+        return robots_dot_txt_cache.insert(robots_txt_url, getMessageBody());
     }
 
     // Restore the saved state:
@@ -481,7 +591,10 @@ void CachedPageFetcher::getRobotsDotTxtForUrl(const Url &url, const TimeLimit &t
     params_.robots_dot_txt_option_ = saved_robots_dot_txt_option;
     last_url_                      = saved_last_url;
 
-    robots_dot_txt_.clear();
+    // Don't remember a robots.txt that we merely failed to download in time:
+    if (time_limit.limitExceeded())
+        return nullptr;
+    return robots_dot_txt_cache.insert(robots_txt_url, "");
 }
 
 
@@ -497,18 +610,10 @@ bool CachedPageFetcher::accessAllowed(const std::string &url, const TimeLimit &t
     if (not test_url.isValidWebUrl() or ::strcasecmp("/robots.txt", test_url.getPath().c_str()) == 0)
         return true;
 
-    // Can we use the "cached" robots.txt object?
-    static std::string last_domain;
-    std::string new_domain(test_url.getAuthority());
-    if (last_domain == new_domain)
-        return robots_dot_txt_.accessAllowed(params_.user_agent_, test_url.getPath());
-
-    // Create a robots.txt file for the current domain:
-    getRobotsDotTxtForUrl(test_url, time_limit, max_redirects);
-    if (time_limit.limitExceeded())
+    const auto robots_dot_txt(getRobotsDotTxtForUrl(test_url, time_limit, max_redirects));
+    if (robots_dot_txt == nullptr)
         return true;
-    last_domain = new_domain;
-    return robots_dot_txt_.accessAllowed(params_.user_agent_, test_url.getPath());
+    return robots_dot_txt->accessAllowed(params_.user_agent_, test_url.getPath());
 }
 
 
@@ -752,7 +857,17 @@ bool CachedPageFetcher::downloadPage(const std::string &url, const TimeLimit &ti
             params.max_redirect_count_ = 0;
             params.follow_redirects_ = false;
             params.acceptable_languages_ = params_.acceptable_languages_;
-            
+
+            // If we have an expired copy, we only need to download the page if it has changed since:
+            PageCacheEntry stale_entry;
+            const bool revalidating(useCache() and getStaleEntry(redirected_url, &stale_entry));
+            if (revalidating) {
+                params.if_none_match_ = stale_entry.etag_;
+                const HttpHeader stale_http_header(stale_entry.http_header_);
+                if (stale_http_header.lastModifiedIsValid())
+                    params.if_modified_since_ = stale_http_header.getLastModified();
+            }
+
             Downloader downloader(redirected_url, params, time_limit);
 
             // Handle downloader errors:
@@ -782,6 +897,15 @@ bool CachedPageFetcher::downloadPage(const std::string &url, const TimeLimit &ti
             current_header   = downloader.getMessageHeader();
             message_body_    = downloader.getMessageBody();
             last_error_code_ = downloader.getLastErrorCode();
+
+            // Our copy is still current, storing it again below refreshes its expiration:
+            if (revalidating and HttpHeader(current_header).getStatusCode() == 304) {
+                if (verbosity_ >= 4)
+                    logger->info("Revalidated: '" + redirected_url.toString() + "'");
+                current_header = stale_entry.http_header_;
+                message_body_  = stale_entry.compressed_document_source_.size() > 1
+                                 ? GzStream::DecompressString(stale_entry.compressed_document_source_) : "";
+            }
         }
 
         StringUtil::TrimWhite(&current_header);
@@ -987,11 +1111,27 @@ bool CachedPageFetcher::retrieveFromCache(const std::string &url, std::string *
     message_body->clear();
     message_header->clear();
 
+    const std::string escaped_url(UrlToCacheKey(url));
+    PageCacheEntry entry;
+    if (memory_cache_.lookup(escaped_url, &entry)) {
+        if (entry.status_ != "ok") {
+            last_error_message_ = entry.status_;
+            return false;
+        }
+
+        *message_header = entry.http_header_;
+        if (entry.compressed_document_source_.size() > 1)
+            *message_body = GzStream::DecompressString(entry.compressed_document_source_);
+
+        return true;
+    }
+
     // Retrieve the header(s) from the database
     requireDbConnection();
-    const std::string escaped_url(UrlToCacheKey(url));
     const std::string SELECT_STMT("SELECT status, http_header, compressed_document_source, "
-                                  "LENGTH(compressed_document_source) AS compressed_document_source_size "
+                                  "LENGTH(compressed_document_source) AS compressed_document_source_size, "
+                                  "retrieval_datetime, expiration_datetime, honor_robots_dot_txt, etag, "
+                                  "uncompressed_document_source_size "
                                   "FROM " + CreateCacheTableName(page_cache_schema_name_) + " WHERE url='"
                                   + escaped_url + "'");
     db_connection_->queryOrDie(SELECT_STMT);
@@ -1020,6 +1160,21 @@ bool CachedPageFetcher::retrieveFromCache(const std::string &url, std::string *
         }
     }
 
+    // Keep the row around, so that we don't have to go to the database again during the current crawl:
+    if (memory_cache_size_ > 0 and row.size() > 8) {
+        entry.escaped_url_                       = escaped_url;
+        entry.retrieval_datetime_                = row[4];
+        entry.expiration_datetime_               = row[5];
+        entry.status_                            = row[0];
+        entry.robots_dot_txt_option_             = BoolToRobotsDotTxtOption(row[6]);
+        entry.redirect_count_                    = 0;
+        entry.compressed_document_source_        = row[2];
+        entry.uncompressed_document_source_size_ = StringUtil::ToUnsigned(row[8]);
+        entry.http_header_                       = row[1];
+        entry.etag_                              = row[7];
+        memory_cache_.insert(entry);
+    }
+
     return true;
 }
 
@@ -1033,8 +1188,24 @@ bool CachedPageFetcher::IsCached(const std::string &url,
     ReadIniFile();
 
     std::string escaped_url(UrlToCacheKey(url));
-    db_connection->queryOrDie("SELECT NOW(), expiration_datetime, status, honor_robots_dot_txt FROM " +
-                              CreateCacheTableName(page_cache_schema_name_) + " WHERE url='" + escaped_url + "'");
+
+    PageCacheEntry entry;
+    if (memory_cache_.lookup(escaped_url, &entry)) {
+        if (SqlUtil::GetDatetime() < entry.expiration_datetime_
+            and entry.robots_dot_txt_option_ == robots_dot_txt_option)
+        {
+            if (error_message != nullptr and entry.status_ != "ok")
+                *error_message = entry.status_;
+            return true;
+        }
+        if (entry.robots_dot_txt_option_ != robots_dot_txt_option
+            or not CanBeRevalidated(entry.status_, entry.etag_, entry.http_header_))
+            memory_cache_.erase(escaped_url);
+        return false;
+    }
+
+    db_connection->queryOrDie("SELECT NOW(), expiration_datetime, status, honor_robots_dot_txt, etag, http_header FROM "
+                              + CreateCacheTableName(page_cache_schema_name_) + " WHERE url='" + escaped_url + "'");
     ++CachedPageFetcher::no_of_queries_;
 
     DbResultSet result_set(db_connection->getLastResultSet());
@@ -1047,18 +1218,17 @@ bool CachedPageFetcher::IsCached(const std::string &url,
     const std::string expiration_datetime(row[1]);
     bool is_cached(current_database_datetime < expiration_datetime);
 
-    if (is_cached) {
-        // Only consider records to be cached if they have the same robots.txt option as the requested one:
-        const RobotsDotTxtOption cached_robots_dot_txt_option(BoolToRobotsDotTxtOption(row[3]));
-        if (cached_robots_dot_txt_option != robots_dot_txt_option)
-            is_cached = false;
-    }
-
-    // If the record is expired, delete it!
-    if (not is_cached)
-        db_connection->queryOrDie("DELETE FROM " + CreateCacheTableName(page_cache_schema_name_) + " WHERE url='"
-                                  + escaped_url + "'");
-    else if (error_message != nullptr) {
+    // Only consider records to be cached if they have the same robots.txt option as the requested one:
+    const RobotsDotTxtOption cached_robots_dot_txt_option(BoolToRobotsDotTxtOption(row[3]));
+    if (cached_robots_dot_txt_option != robots_dot_txt_option)
+        is_cached = false;
+
+    // If the record is expired, delete it, unless we can revalidate it w/ a conditional request:
+    if (not is_cached) {
+        if (cached_robots_dot_txt_option != robots_dot_txt_option or not CanBeRevalidated(row[2], row[4], row[5]))
+            db_connection->queryOrDie("DELETE FROM " + CreateCacheTableName(page_cache_schema_name_) + " WHERE url='"
+                                      + escaped_url + "'");
+    } else if (error_message != nullptr) {
         const std::string status(row[2]);
         if (status != "ok")
             *error_message = status;
@@ -1132,6 +1302,38 @@ void CachedPageFetcher::StoreInCache(const std::string &url, const std::string &
 }
 
 
+bool CachedPageFetcher::getStaleEntry(const std::string &url, PageCacheEntry * const entry) const {
+    const std::string escaped_url(UrlToCacheKey(url));
+    if (memory_cache_.lookup(escaped_url, entry))
+        return entry->robots_dot_txt_option_ == params_.robots_dot_txt_option_
+               and CanBeRevalidated(entry->status_, entry->etag_, entry->http_header_);
+
+    requireDbConnection();
+    db_connection_->queryOrDie("SELECT status, http_header, compressed_document_source, etag, honor_robots_dot_txt, "
+                               "retrieval_datetime, expiration_datetime, uncompressed_document_source_size FROM "
+                               + CreateCacheTableName(page_cache_schema_name_) + " WHERE url='" + escaped_url + "'");
+    ++CachedPageFetcher::no_of_queries_;
+    DbResultSet result_set(db_connection_->getLastResultSet());
+    if (result_set.empty())
+        return false;
+
+    const DbRow row(result_set.getNextRow());
+    entry->escaped_url_                       = escaped_url;
+    entry->retrieval_datetime_                = row[5];
+    entry->expiration_datetime_               = row[6];
+    entry->status_                            = row[0];
+    entry->robots_dot_txt_option_             = BoolToRobotsDotTxtOption(row[4]);
+    entry->redirect_count_                    = 0;
+    entry->compressed_document_source_        = row[2];
+    entry->uncompressed_document_source_size_ = StringUtil::ToUnsigned(row[7]);
+    entry->http_header_                       = row[1];
+    entry->etag_                              = row[3];
+
+    return entry->robots_dot_txt_option_ == params_.robots_dot_txt_option_
+           and CanBeRevalidated(entry->status_, entry->etag_, entry->http_header_);
+}
+
+
 // requireDbConnection -- ensure we have a valid database connection
 //
 void CachedPageFetcher::requireDbConnection() const {
@@ -1153,17 +1355,49 @@ void CachedPageFetcher::actualStoreInCache(const std::string &escaped_url, const
     if (unlikely(not useCache()))
         logger->error("in CachedPageFetcher::actualStoreInCache: called but useCache() returned false!");
 
-    requireDbConnection();
+    PageCacheEntry entry(MakePageCacheEntry(escaped_url, retrieval_datetime, expiration_datetime, status,
+                                            params_.robots_dot_txt_option_, redirect_count, redirected_url,
+                                            document_source, http_header, etag));
+    if (memory_cache_size_ == 0) {
+        requireDbConnection();
+        StoreEntryInDatabase(entry, db_connection_.get());
+        ++CachedPageFetcher::no_of_queries_;
+        return;
+    }
 
-    CachedPageFetcher::ActualStoreInCache(escaped_url, retrieval_datetime, expiration_datetime, status,
-                                          params_.robots_dot_txt_option_, db_connection_.get(), redirect_count,
-                                          redirected_url, document_source, http_header, etag);
+    memory_cache_.insert(entry);
 
-    ++CachedPageFetcher::no_of_queries_;
+    // A later entry for the same URL, e.g. after following a redirect, supersedes an earlier one:
+    for (auto &pending_store : pending_stores_) {
+        if (pending_store.escaped_url_ == entry.escaped_url_) {
+            pending_store = std::move(entry);
+            return;
+        }
+    }
+
+    pending_stores_.emplace_back(std::move(entry));
+    if (pending_stores_.size() >= MAX_PENDING_STORES)
+        flushPendingStores();
+}
+
+
+void CachedPageFetcher::flushPendingStores() const {
+    if (pending_stores_.empty())
+        return;
+
+    requireDbConnection();
+    SqlUtil::TransactionGuard transaction_guard(db_connection_.get());
+    for (const auto &pending_store : pending_stores_) {
+        StoreEntryInDatabase(pending_store, db_connection_.get());
+        ++CachedPageFetcher::no_of_queries_;
+    }
+    pending_stores_.clear();
 }
 
 
 std::string CachedPageFetcher::getCacheIdByUrl(const std::string &url) {
+    flushPendingStores();
+    requireDbConnection();
     std::string escaped_url("'" + url + "'");
     db_connection_->queryOrDie("SELECT url_id FROM " + getCacheTableName() + " WHERE url="+ escaped_url);
     DbResultSet result_set(db_connection_->getLastResultSet());
@@ -1180,26 +1414,61 @@ void CachedPageFetcher::ActualStoreInCache(const std::string &escaped_url, const
                                            DbConnection * const db_connection, const unsigned redirect_count,
                                            const std::string &redirected_url, const std::string &document_source,
 					   const std::string &http_header, const std::string &etag)
+{
+    const PageCacheEntry entry(MakePageCacheEntry(escaped_url, retrieval_datetime, expiration_datetime, status,
+                                                  robots_dot_txt_option, redirect_count, redirected_url,
+                                                  document_source, http_header, etag));
+    StoreEntryInDatabase(entry, db_connection);
+
+    // Don't let the in-memory cache serve an outdated entry:
+    if (memory_cache_size_ > 0)
+        memory_cache_.insert(entry);
+}
+
+
+CachedPageFetcher::PageCacheEntry CachedPageFetcher::MakePageCacheEntry(
+    const std::string &escaped_url, const std::string &retrieval_datetime, const std::string &expiration_datetime,
+    const std::string &status, const RobotsDotTxtOption robots_dot_txt_option, const unsigned redirect_count,
+    const std::string &redirected_url, const std::string &document_source, const std::string &http_header,
+    const std::string &etag)
 {
     if (redirect_count > 0 and redirected_url.empty())
-        throw std::runtime_error("in CachedPageFetcher::ActualStoreInCache: redirect count > 0 but no redirected "
+        throw std::runtime_error("in CachedPageFetcher::MakePageCacheEntry: redirect count > 0 but no redirected "
                                  "URL provided!");
 
-    std::string escaped_redirected_url(redirected_url);
-    SqlUtil::EscapeBlob(&escaped_redirected_url);
+    PageCacheEntry entry;
+    entry.escaped_url_           = escaped_url;
+    entry.retrieval_datetime_    = retrieval_datetime;
+    entry.expiration_datetime_   = expiration_datetime;
+    entry.status_                = status;
+    entry.robots_dot_txt_option_ = robots_dot_txt_option;
+    entry.redirect_count_        = redirect_count;
+    entry.redirected_url_        = redirected_url;
+    entry.http_header_           = http_header;
+    entry.etag_                  = etag;
 
     // Compress the document source:
-    std::string compressed_document_source;
+    entry.uncompressed_document_source_size_ = document_source.size();
     if (not document_source.empty()) {
         if (unlikely(document_source.size() > maximum_document_size_))
-            throw std::runtime_error("in CachedPageFetcher::ActualStoreInCache: uncompressed document size "
+            throw std::runtime_error("in CachedPageFetcher::MakePageCacheEntry: uncompressed document size "
                                      + std::to_string(document_source.size())
                                      + " exceeds maximum allowed size of " + std::to_string(maximum_document_size_)
                                      + "!");
 
-        compressed_document_source = GzStream::CompressString(document_source);
+        entry.compressed_document_source_ = GzStream::CompressString(document_source);
     }
 
+    return entry;
+}
+
+
+void CachedPageFetcher::StoreEntryInDatabase(const PageCacheEntry &entry, DbConnection * const db_connection) {
+    const std::string &escaped_url(entry.escaped_url_);
+    const std::string &status(entry.status_);
+    std::string escaped_redirected_url(entry.redirected_url_);
+    SqlUtil::EscapeBlob(&escaped_redirected_url);
+
     const std::string cache_table_name(CreateCacheTableName(page_cache_schema_name_));
     const std::string redirect_table_name(CreateRedirectTableName(page_cache_schema_name_));
     const std::string query_by_url("SELECT cache_id FROM " + redirect_table_name + " WHERE url='" + escaped_url
@@ -1212,19 +1481,19 @@ void CachedPageFetcher::ActualStoreInCache(const std::string &escaped_url, const
     if (result_set.empty()) {
         std::string insert_stmt("INSERT INTO " + cache_table_name + " SET ");
         insert_stmt += "url='" + (escaped_redirected_url.empty() ? escaped_url : escaped_redirected_url) + "',";
-        insert_stmt += "retrieval_datetime='" + retrieval_datetime + "',";
-        insert_stmt += "expiration_datetime='" + expiration_datetime + "',";
-        insert_stmt += "honor_robots_dot_txt=" + RobotsDotTxtOptionToBool(robots_dot_txt_option) + ",";
-        insert_stmt += "etag='" + db_connection->escapeString(etag) + "',";
-        insert_stmt += "http_header='" + db_connection->escapeString(http_header) + "',";
+        insert_stmt += "retrieval_datetime='" + entry.retrieval_datetime_ + "',";
+        insert_stmt += "expiration_datetime='" + entry.expiration_datetime_ + "',";
+        insert_stmt += "honor_robots_dot_txt=" + RobotsDotTxtOptionToBool(entry.robots_dot_txt_option_) + ",";
+        insert_stmt += "etag='" + db_connection->escapeString(entry.etag_) + "',";
+        insert_stmt += "http_header='" + db_connection->escapeString(entry.http_header_) + "',";
 
         // Insert the status message (max length = 255 chars):
         insert_stmt += "status='" + db_connection->escapeString(status.length() < 255 ? status : status.substr(0, 250)
                                                           + "...") + "',";
 
-        insert_stmt += "compressed_document_source='" + db_connection->escapeString(compressed_document_source)
+        insert_stmt += "compressed_document_source='" + db_connection->escapeString(entry.compressed_document_source_)
                        + "',";
-        insert_stmt += "uncompressed_document_source_size=" + std::to_string(document_source.size());
+        insert_stmt += "uncompressed_document_source_size=" + std::to_string(entry.uncompressed_document_source_size_);
 
         logger->info(insert_stmt);
 
@@ -1239,26 +1508,26 @@ void CachedPageFetcher::ActualStoreInCache(const std::string &escaped_url, const
         DbRow row(result_set.getNextRow());
         url_id = row[0];
         std::string update_stmt("UPDATE " + cache_table_name + " SET ");
-        update_stmt += "retrieval_datetime='" + retrieval_datetime + "', ";
-        update_stmt += "expiration_datetime='" + expiration_datetime + "', ";
-        update_stmt += "honor_robots_dot_txt=" + RobotsDotTxtOptionToBool(robots_dot_txt_option) +", ";
-        update_stmt += "etag='" + db_connection->escapeString(etag) + "', ";
-        update_stmt += "http_header='" + db_connection->escapeString(http_header) + "', ";
+        update_stmt += "retrieval_datetime='" + entry.retrieval_datetime_ + "', ";
+        update_stmt += "expiration_datetime='" + entry.expiration_datetime_ + "', ";
+        update_stmt += "honor_robots_dot_txt=" + RobotsDotTxtOptionToBool(entry.robots_dot_txt_option_) +", ";
+        update_stmt += "etag='" + db_connection->escapeString(entry.etag_) + "', ";
+        update_stmt += "http_header='" + db_connection->escapeString(entry.http_header_) + "', ";
 
         // Update the status message (max length = 255 chars):
         update_stmt += "status='"
                     + db_connection->escapeString(status.length() < 255 ? status : status.substr(0, 250) + "...")
                     + "', ";
 
-        update_stmt += "compressed_document_source='" + db_connection->escapeString(compressed_document_source)
+        update_stmt += "compressed_document_source='" + db_connection->escapeString(entry.compressed_document_source_)
                        + "', ";
-        update_stmt += "uncompressed_document_source_size=" + std::to_string(document_source.size());
+        update_stmt += "uncompressed_document_source_size=" + std::to_string(entry.uncompressed_document_source_size_);
         update_stmt += " WHERE url_id=" + url_id;
         logger->info(update_stmt);
         db_connection->queryOrDie(update_stmt);
     }
 
-    if (not redirected_url.empty())
+    if (not escaped_redirected_url.empty())
         AddUrlToRedirectTable(db_connection, escaped_redirected_url, url_id);
 }
 
@@ -0,0 +1,218 @@
+/** \brief Utility functions for handling canon law references, e.g. "Codex Iuris Canonici (1983), Can. 204-207".
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CanonLawUtil.h"
+#include <mutex>
+#include <cstring>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "MiscUtil.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace CanonLawUtil {
+
+
+namespace {
+
+
+std::string ComputeCanonLawCode(const std::string &ppn, const std::string &subfield_codex, const std::string &subfield_year,
+                                const std::string &subfield_part)
+{
+    enum Codex { CIC1917, CIC1983, CCEO } codex;
+    if (::strcasecmp(subfield_codex.c_str(), "Codex canonum ecclesiarum orientalium") == 0)
+        codex = CCEO;
+    else {
+        if (unlikely(subfield_year.empty()))
+            LOG_ERROR("missing year for Codex Iuris Canonici! (PPN: " + ppn + ")");
+        if (subfield_year == "1917")
+            codex = CIC1917;
+        else if (subfield_year == "1983")
+            codex = CIC1983;
+        else
+            LOG_ERROR("bad year for Codex Iuris Canonici \"" + subfield_year + "\"! (PPN: " + ppn + ")");
+    }
+
+    unsigned range_start, range_end;
+    if (subfield_part.empty()) {
+        range_start = 0;
+        range_end = 99999999;
+    } else if (not MiscUtil::ParseCanonLawRanges(subfield_part, &range_start, &range_end))
+        LOG_ERROR("don't know how to parse codex parts \"" + subfield_part + "\"! (PPN: " + ppn + ")");
+
+    switch (codex) {
+    case CIC1917:
+        return StringUtil::ToString(100000000 + range_start) + "_" + StringUtil::ToString(100000000 + range_end);
+    case CIC1983:
+        return StringUtil::ToString(200000000 + range_start) + "_" + StringUtil::ToString(200000000 + range_end);
+    case CCEO:
+        return StringUtil::ToString(300000000 + range_start) + "_" + StringUtil::ToString(300000000 + range_end);
+    default:
+        LOG_ERROR("unknown codex: " + std::to_string(codex));
+    }
+}
+
+
+const char SIDECAR_MAGIC[8]{ 'U', 'B', 'C', 'A', 'N', 'O', 'N', 'S' };
+const uint64_t SIDECAR_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by lines of the form "PPN\tcode\n".
+struct SidecarHeader {
+    char magic_[sizeof SIDECAR_MAGIC];
+    uint64_t version_;
+    uint64_t authority_file_size_;
+    int64_t authority_mtime_seconds_;
+    int64_t authority_mtime_nanoseconds_;
+};
+
+
+bool InitHeader(const std::string &authority_filename, SidecarHeader * const header) {
+    struct stat stat_buf;
+    if (unlikely(::stat(authority_filename.c_str(), &stat_buf) != 0))
+        return false;
+
+    std::memcpy(header->magic_, SIDECAR_MAGIC, sizeof SIDECAR_MAGIC);
+    header->version_                     = SIDECAR_VERSION;
+    header->authority_file_size_         = stat_buf.st_size;
+    header->authority_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header->authority_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    return true;
+}
+
+
+inline std::string GetSidecarPath(const std::string &authority_filename) {
+    return authority_filename + ".canon_law_codes";
+}
+
+
+bool LoadSidecar(const std::string &authority_filename,
+                 std::unordered_map<std::string, std::string> * const authority_ppns_to_canon_law_codes_map)
+{
+    SidecarHeader expected_header;
+    std::string sidecar_contents;
+    if (not InitHeader(authority_filename, &expected_header)
+        or not FileUtil::ReadString(GetSidecarPath(authority_filename), &sidecar_contents)
+        or sidecar_contents.size() < sizeof expected_header
+        or std::memcmp(sidecar_contents.data(), &expected_header, sizeof expected_header) != 0)
+        return false;
+
+    std::unordered_map<std::string, std::string> ppns_to_codes_map;
+    size_t line_start(sizeof expected_header);
+    while (line_start < sidecar_contents.size()) {
+        const size_t tab_pos(sidecar_contents.find('\t', line_start));
+        const size_t newline_pos(sidecar_contents.find('\n', line_start));
+        if (unlikely(tab_pos == std::string::npos or newline_pos == std::string::npos or tab_pos > newline_pos))
+            return false;
+        ppns_to_codes_map.emplace(sidecar_contents.substr(line_start, tab_pos - line_start),
+                                  sidecar_contents.substr(tab_pos + 1, newline_pos - tab_pos - 1));
+        line_start = newline_pos + 1;
+    }
+
+    authority_ppns_to_canon_law_codes_map->swap(ppns_to_codes_map);
+    return true;
+}
+
+
+// Writes the sidecar to a temporary file first so that concurrent readers never see a partially written file.
+void SaveSidecar(const std::string &authority_filename,
+                 const std::unordered_map<std::string, std::string> &authority_ppns_to_canon_law_codes_map)
+{
+    SidecarHeader header;
+    if (not InitHeader(authority_filename, &header))
+        return;
+
+    std::string sidecar_contents(reinterpret_cast<const char *>(&header), sizeof header);
+    for (const auto &ppn_and_code : authority_ppns_to_canon_law_codes_map)
+        sidecar_contents += ppn_and_code.first + '\t' + ppn_and_code.second + '\n';
+
+    const std::string sidecar_path(GetSidecarPath(authority_filename)), temp_path(sidecar_path + ".tmp");
+    if (not FileUtil::WriteString(temp_path, sidecar_contents)
+        or not FileUtil::RenameFile(temp_path, sidecar_path, /* remove_target = */true))
+    {
+        ::unlink(temp_path.c_str());
+        LOG_WARNING("failed to write \"" + sidecar_path + "\"!");
+    }
+}
+
+
+} // unnamed namespace
+
+
+std::string FieldToCanonLawCode(const std::string &ppn, const std::string &subfield_codex, const std::string &subfield_year,
+                                const std::string &subfield_part)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::string> references_to_codes_map;
+
+    // The PPN is only used for error messages, and we never memoise errors as they are fatal.
+    const std::string reference(subfield_codex + '\x1F' + subfield_year + '\x1F' + subfield_part);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto reference_and_code(references_to_codes_map.find(reference));
+        if (reference_and_code != references_to_codes_map.cend())
+            return reference_and_code->second;
+    }
+
+    const std::string code(ComputeCanonLawCode(ppn, subfield_codex, subfield_year, subfield_part));
+    std::lock_guard<std::mutex> lock(mutex);
+    references_to_codes_map.emplace(reference, code);
+    return code;
+}
+
+
+void LoadAuthorityPPNsToCanonLawCodes(const std::string &authority_filename,
+                                      std::unordered_map<std::string, std::string> * const authority_ppns_to_canon_law_codes_map)
+{
+    if (LoadSidecar(authority_filename, authority_ppns_to_canon_law_codes_map)) {
+        LOG_INFO("loaded " + std::to_string(authority_ppns_to_canon_law_codes_map->size()) + " canon law codes from \""
+                 + GetSidecarPath(authority_filename) + "\".");
+        return;
+    }
+
+    const auto reader(MARC::Reader::Factory(authority_filename));
+    unsigned total_count(0);
+    while (auto record = reader->read()) {
+        ++total_count;
+
+        const auto _110_field(record.findTag("110"));
+        if (_110_field == record.end() or ::strcasecmp(_110_field->getFirstSubfieldWithCode('a').c_str(), "Katholische Kirche") != 0)
+            continue;
+
+        const std::string t_subfield(_110_field->getFirstSubfieldWithCode('t'));
+        if (::strcasecmp(t_subfield.c_str(),"Codex Iuris Canonici") != 0
+            and ::strcasecmp(t_subfield.c_str(), "Codex canonum ecclesiarum orientalium") != 0)
+            continue;
+
+        (*authority_ppns_to_canon_law_codes_map)[record.getControlNumber()] = FieldToCanonLawCode(record.getControlNumber(),
+                                                                                                  t_subfield,
+                                                                                                  _110_field->getFirstSubfieldWithCode('f'),
+                                                                                                  _110_field->getFirstSubfieldWithCode('p'));
+    }
+
+    LOG_INFO("found " + std::to_string(authority_ppns_to_canon_law_codes_map->size()) + " canon law records among "
+             + std::to_string(total_count) + " authority records.");
+    SaveSidecar(authority_filename, *authority_ppns_to_canon_law_codes_map);
+}
+
+
+} // namespace CanonLawUtil
@@ -24,6 +24,7 @@
 #include <unordered_set>
 #include <vector>
 #include "Compiler.h"
+#include "DbStatement.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
@@ -38,15 +39,16 @@ const std::string ControlNumberGuesser::INSTALLER_SCRIPT_PATH("/usr/local/ub_too
 
 ControlNumberGuesser::~ControlNumberGuesser() {
     if (transaction_in_progress_)
-        db_connection_->queryOrDie("COMMIT");
+        endUpdate();
 }
 
 
 void ControlNumberGuesser::clearDatabase() {
+    in_memory_tables_.clear();
     db_connection_.reset();
 
     ::unlink(DATABASE_PATH.c_str());
-    db_connection_.reset(new DbConnection(DATABASE_PATH, DbConnection::CREATE));
+    db_connection_.reset(new DbConnection(DATABASE_PATH, DbConnection::CREATE, sqlite_profile_));
     db_connection_->queryFileOrDie(INSTALLER_SCRIPT_PATH);
 }
 
@@ -57,6 +59,7 @@ void ControlNumberGuesser::beginUpdate() {
 
     db_connection_->queryOrDie("BEGIN TRANSACTION");
     transaction_in_progress_ = true;
+    uncommitted_update_count_ = 0;
 }
 
 
@@ -66,6 +69,8 @@ void ControlNumberGuesser::endUpdate() {
 
     db_connection_->queryOrDie("COMMIT");
     transaction_in_progress_ = false;
+
+    db_connection_->createDeferredIndicesOrDie();
 }
 
 
@@ -92,13 +97,17 @@ void ControlNumberGuesser::insertAuthors(const std::set<std::string> &authors, c
 
 
 void ControlNumberGuesser::insertYear(const std::string &year, const std::string &control_number) {
+    if (unlikely(isInMemory()))
+        LOG_ERROR("can't update the database after it has been loaded into memory!");
     if (unlikely(control_number.length() > MAX_CONTROL_NUMBER_LENGTH))
         LOG_ERROR("\"" + control_number + "\" is too large to fit!");
 
     std::string control_numbers;
     size_t padded_length(MAX_CONTROL_NUMBER_LENGTH + 1 /* terminating zero byte */);
-    db_connection_->queryOrDie("SELECT control_numbers FROM publication_year WHERE year='" + year + "'");
-    auto query_result(db_connection_->getLastResultSet());
+    const auto select_statement(db_connection_->prepare("SELECT control_numbers FROM publication_year WHERE year=?"));
+    select_statement->bind(0, year);
+    select_statement->executeOrDie();
+    auto query_result(select_statement->getResultSet());
 
     if (not query_result.empty()) {
         if (query_result.size() != 1)
@@ -112,10 +121,13 @@ void ControlNumberGuesser::insertYear(const std::string &year, const std::string
     for (auto i(control_numbers.size()); i < padded_length; ++i)
         control_numbers += '|';
 
-    if (not query_result.empty())
-        db_connection_->queryOrDie("UPDATE publication_year SET control_numbers='" + control_numbers + "' WHERE year='" + year + "'");
-    else
-        db_connection_->queryOrDie("INSERT INTO publication_year VALUES('" + year + "', '" + control_numbers + "')");
+    const auto update_or_insert_statement(query_result.empty()
+                                          ? db_connection_->prepare("INSERT INTO publication_year (control_numbers, year) VALUES(?, ?)")
+                                          : db_connection_->prepare("UPDATE publication_year SET control_numbers=? WHERE year=?"));
+    update_or_insert_statement->bind(0, control_numbers);
+    update_or_insert_statement->bind(1, year);
+    update_or_insert_statement->executeOrDie();
+    noteUpdate();
 }
 
 
@@ -159,62 +171,80 @@ std::set<std::string> ControlNumberGuesser::getGuessedControlNumbers(const std::
                                                                      const std::string &year, const std::string &doi,
                                                                      const std::string &issn, const std::string &isbn) const
 {
-    if (not doi.empty()) {
+    return getGuessedControlNumbers(NormaliseQuery(title, authors, year, doi, issn, isbn));
+}
+
+
+std::set<std::string> ControlNumberGuesser::getGuessedControlNumbers(const NormalisedQuery &normalised_query) const {
+    if (not normalised_query.doi_.empty()) {
         std::set<std::string> doi_control_numbers;
-        lookupDOI(doi, &doi_control_numbers);
+        lookupNormalised("doi", "doi", normalised_query.doi_, &doi_control_numbers);
         if (not doi_control_numbers.empty())
             return doi_control_numbers;
     }
 
-    if (not isbn.empty()) {
+    if (not normalised_query.isbn_.empty()) {
         std::set<std::string> isbn_control_numbers;
-        lookupISBN(isbn, &isbn_control_numbers);
+        lookupNormalised("isbn", "isbn", normalised_query.isbn_, &isbn_control_numbers);
         if (not isbn_control_numbers.empty())
             return isbn_control_numbers;
     }
 
-    const auto normalised_title(NormaliseTitle(title));
-    std::set<std::string> title_control_numbers, all_author_control_numbers, doi_control_numbers;
-    std::unordered_set<std::string> year_control_numbers;
-
-    lookupTitle(normalised_title, &title_control_numbers);
+    std::set<std::string> title_control_numbers, all_author_control_numbers;
+    lookupNormalised("normalised_titles", "title", normalised_query.title_, &title_control_numbers);
     if (title_control_numbers.empty()) {
-        LOG_DEBUG("no entries found for normalised title \"" + normalised_title + "\"");
+        LOG_DEBUG("no entries found for normalised title \"" + normalised_query.title_ + "\"");
         return { };
     }
 
-    std::set<std::string> normalised_authors;
-    for (const auto &author : authors) {
-        const auto normalised_author(NormaliseAuthorName(author));
-        normalised_authors.insert(normalised_author);
-
+    for (const auto &normalised_author : normalised_query.authors_) {
         std::set<std::string> author_control_numbers;
-        lookupAuthor(normalised_author, &author_control_numbers);
+        lookupNormalised("normalised_authors", "author", normalised_author, &author_control_numbers);
         all_author_control_numbers.insert(author_control_numbers.begin(), author_control_numbers.end());
     }
 
     if (all_author_control_numbers.empty()) {
-        LOG_DEBUG("no entries found for normalised authors \"" + StringUtil::Join(normalised_authors, ',') + "\"");
+        LOG_DEBUG("no entries found for normalised authors \"" + StringUtil::Join(normalised_query.authors_, ',') + "\"");
         return { };
     }
 
     auto common_control_numbers(MiscUtil::Intersect(title_control_numbers, all_author_control_numbers));
 
-    if (not issn.empty()) {
+    if (not normalised_query.issn_.empty()) {
         std::set<std::string> issn_control_numbers;
-        lookupISSN(issn, &issn_control_numbers);
+        lookupNormalised("issn", "issn", normalised_query.issn_, &issn_control_numbers);
         if (not issn_control_numbers.empty())
             common_control_numbers = MiscUtil::Intersect(common_control_numbers, issn_control_numbers);
     }
 
-    if (year.empty())
+    if (normalised_query.year_.empty())
         return common_control_numbers;
 
-    lookupYear(year, &year_control_numbers);
+    std::unordered_set<std::string> year_control_numbers;
+    lookupYear(normalised_query.year_, &year_control_numbers);
     return MiscUtil::Intersect(common_control_numbers, year_control_numbers);
 }
 
 
+void ControlNumberGuesser::loadIntoMemory() {
+    static const std::vector<std::pair<std::string, std::string>> TABLES_AND_KEY_COLUMNS{
+        { "normalised_titles", "title" }, { "normalised_authors", "author" }, { "publication_year", "year" },
+        { "doi", "doi" }, { "issn", "issn" }, { "isbn", "isbn" } };
+
+    for (const auto &table_and_key_column : TABLES_AND_KEY_COLUMNS) {
+        db_connection_->queryOrDie("SELECT " + table_and_key_column.second + ", control_numbers FROM " + table_and_key_column.first);
+        auto result_set(db_connection_->getLastResultSet());
+
+        auto &key_to_control_numbers_map(in_memory_tables_[table_and_key_column.first]);
+        key_to_control_numbers_map.reserve(result_set.size());
+        while (const DbRow row = result_set.getNextRow())
+            key_to_control_numbers_map.emplace(row[table_and_key_column.second], row["control_numbers"]);
+        LOG_DEBUG("loaded " + std::to_string(key_to_control_numbers_map.size()) + " rows of \"" + table_and_key_column.first
+                  + "\" into memory.");
+    }
+}
+
+
 bool ControlNumberGuesser::getNextTitle(std::string * const title, std::set<std::string> * const control_numbers) const {
     if (title_cursor_ == nullptr) {
         db_connection_->queryOrDie("SELECT * FROM normalised_titles");
@@ -426,27 +456,87 @@ std::string ControlNumberGuesser::NormaliseAuthorName(const std::string &author_
 }
 
 
+ControlNumberGuesser::NormalisedQuery ControlNumberGuesser::NormaliseQuery(const std::string &title, const std::set<std::string> &authors,
+                                                                          const std::string &year, const std::string &doi,
+                                                                          const std::string &issn, const std::string &isbn)
+{
+    NormalisedQuery normalised_query;
+    normalised_query.title_ = TextUtil::UTF8ToLower(NormaliseTitle(title));
+    for (const auto &author : authors)
+        normalised_query.authors_.emplace(TextUtil::UTF8ToLower(NormaliseAuthorName(author)));
+    normalised_query.year_ = year;
+    if (not doi.empty())
+        MiscUtil::NormaliseDOI(doi, &normalised_query.doi_);
+    if (not issn.empty())
+        MiscUtil::NormaliseISSN(issn, &normalised_query.issn_);
+    if (not isbn.empty())
+        MiscUtil::NormaliseISBN(isbn, &normalised_query.isbn_);
+
+    return normalised_query;
+}
+
+
 void ControlNumberGuesser::insertNewControlNumber(const std::string &table, const std::string &column_name, const std::string &column_value,
                                                   const std::string &control_number)
 {
+    if (unlikely(isInMemory()))
+        LOG_ERROR("can't update the database after it has been loaded into memory!");
+
     std::string control_numbers;
+    std::shared_ptr<DbStatement> update_or_insert_statement;
     if (lookupControlNumber(table, column_name, column_value, &control_numbers)) {
         control_numbers += '|' + control_number;
-        db_connection_->queryOrDie("UPDATE " + table + " SET control_numbers='" + control_numbers +
-                                   "' WHERE " + column_name + "='" + db_connection_->escapeString(column_value) + "'");
+        update_or_insert_statement = db_connection_->prepare("UPDATE " + table + " SET control_numbers=? WHERE " + column_name + "=?");
     } else {
-        db_connection_->queryOrDie("INSERT INTO " + table + " VALUES('" + db_connection_->escapeString(column_value)
-                                   + "', '" + control_number + "')");
+        control_numbers = control_number;
+        update_or_insert_statement = db_connection_->prepare("INSERT INTO " + table + " (control_numbers, " + column_name
+                                                             + ") VALUES(?, ?)");
     }
+    update_or_insert_statement->bind(0, control_numbers);
+    update_or_insert_statement->bind(1, column_value);
+    update_or_insert_statement->executeOrDie();
+    noteUpdate();
+}
+
+
+void ControlNumberGuesser::noteUpdate() {
+    if (not transaction_in_progress_ or ++uncommitted_update_count_ < UPDATE_BATCH_SIZE)
+        return;
+
+    // Committing every now and then keeps the journal from growing w/o bounds:
+    db_connection_->queryOrDie("COMMIT");
+    db_connection_->queryOrDie("BEGIN TRANSACTION");
+    uncommitted_update_count_ = 0;
+}
+
+
+void ControlNumberGuesser::lookupNormalised(const std::string &table, const std::string &column_name,
+                                            const std::string &normalised_value, std::set<std::string> * const control_numbers) const
+{
+    control_numbers->clear();
+
+    std::string concatenated_control_numbers;
+    if (lookupControlNumber(table, column_name, normalised_value, &concatenated_control_numbers))
+        StringUtil::Split(concatenated_control_numbers, '|', control_numbers, /* suppress_empty_components = */true);
 }
 
 
 bool ControlNumberGuesser::lookupControlNumber(const std::string &table, const std::string &column_name,
                                                const std::string &column_value, std::string * const control_numbers) const
 {
-    db_connection_->queryOrDie("SELECT control_numbers FROM " + table + " WHERE " + column_name + "='"
-                               + db_connection_->escapeString(column_value) + "'");
-    auto query_result(db_connection_->getLastResultSet());
+    if (isInMemory()) {
+        const auto &key_to_control_numbers_map(in_memory_tables_.find(table)->second);
+        const auto key_and_control_numbers(key_to_control_numbers_map.find(column_value));
+        if (key_and_control_numbers == key_to_control_numbers_map.cend())
+            return false;
+        *control_numbers = key_and_control_numbers->second;
+        return true;
+    }
+
+    const auto select_statement(db_connection_->prepare("SELECT control_numbers FROM " + table + " WHERE " + column_name + "=?"));
+    select_statement->bind(0, column_value);
+    select_statement->executeOrDie();
+    auto query_result(select_statement->getResultSet());
     if (query_result.empty())
         return false;
     else if (query_result.size() != 1)
@@ -0,0 +1,581 @@
+/** \file   ControlNumberIndex.cc
+ *  \brief  Implementation of the ControlNumberIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ControlNumberIndex.h"
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BSZUtil.h"
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "MarcParallelProcessor.h"
+#include "MiscUtil.h"
+#include "StringUtil.h"
+#include "TextUtil.h"
+#include "UBTools.h"
+#include "util.h"
+
+
+const std::string ControlNumberIndex::DEFAULT_INDEX_PATH(UBTools::GetTuelibPath() + "control_number_index.bin");
+
+
+// Key offsets are relative to the start of the string pool.  Postings are positions in the control number table.
+struct ControlNumberIndex::KeyEntry {
+    uint32_t key_offset_, key_length_;
+    uint32_t first_posting_, posting_count_;
+};
+
+
+// Postings are positions in the title table.
+struct ControlNumberIndex::TrigramEntry {
+    uint32_t trigram_;
+    uint32_t first_posting_, posting_count_;
+    uint32_t unused_;
+};
+
+
+namespace {
+
+
+const char INDEX_MAGIC[8]{ 'U', 'B', 'C', 'N', 'I', 'D', 'X', '1' };
+const uint64_t INDEX_VERSION(1);
+
+
+// Trigrams that occur in more titles than this are too unspecific to be used for retrieving candidates.
+constexpr uint32_t MAX_TRIGRAM_POSTING_COUNT(100000);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the control number table, which is
+// padded to a multiple of 8 bytes, the key tables in KeyType order, the trigram table, the postings, again padded to a
+// multiple of 8 bytes, and finally the string pool.
+struct IndexHeader {
+    char magic_[sizeof INDEX_MAGIC];
+    uint64_t version_;
+    uint64_t control_number_count_;
+    uint64_t control_number_width_;
+    uint64_t key_entry_counts_[ControlNumberIndex::KEY_TYPE_COUNT];
+    uint64_t trigram_entry_count_;
+    uint64_t posting_count_;
+    uint64_t string_pool_size_;
+};
+
+
+inline size_t PadTo8(const size_t size) {
+    return (size + 7u) & ~static_cast<size_t>(7u);
+}
+
+
+size_t GetExpectedIndexSize(const IndexHeader &header, const size_t key_entry_size, const size_t trigram_entry_size) {
+    size_t size(sizeof(IndexHeader) + PadTo8(header.control_number_count_ * header.control_number_width_));
+    for (unsigned key_type(0); key_type < ControlNumberIndex::KEY_TYPE_COUNT; ++key_type)
+        size += header.key_entry_counts_[key_type] * key_entry_size;
+    size += header.trigram_entry_count_ * trigram_entry_size;
+    size += PadTo8(header.posting_count_ * sizeof(uint32_t));
+    return size + header.string_pool_size_;
+}
+
+
+// Uses the same ordering as std::string, i.e. bytes compare as unsigned chars.
+inline int Compare(const StringView &lhs, const std::string &rhs) {
+    const int cmp(std::memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size())));
+    if (cmp != 0)
+        return cmp;
+    return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+
+// Returns the sorted, distinct byte trigrams of "title" padded w/ a leading and a trailing space.
+std::vector<uint32_t> GetTrigrams(const StringView &title) {
+    std::vector<uint32_t> trigrams;
+    if (title.empty())
+        return trigrams;
+
+    std::string padded_title;
+    padded_title.reserve(title.size() + 2);
+    padded_title += ' ';
+    padded_title.append(title.data(), title.size());
+    padded_title += ' ';
+
+    trigrams.reserve(padded_title.size() - 2);
+    for (size_t i(0); i + 2 < padded_title.size(); ++i)
+        trigrams.emplace_back((static_cast<uint32_t>(static_cast<unsigned char>(padded_title[i])) << 16u)
+                              | (static_cast<uint32_t>(static_cast<unsigned char>(padded_title[i + 1])) << 8u)
+                              | static_cast<uint32_t>(static_cast<unsigned char>(padded_title[i + 2])));
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    return trigrams;
+}
+
+
+std::vector<uint32_t> Intersect(const std::vector<uint32_t> &lhs, const std::vector<uint32_t> &rhs) {
+    std::vector<uint32_t> intersection;
+    std::set_intersection(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend(), std::back_inserter(intersection));
+    return intersection;
+}
+
+
+// The keys of a single record, normalised like ControlNumberGuesser normalises them.  DOI's can't be normalised
+// concurrently and are therefore kept as is.
+struct RecordKeys {
+    std::string control_number_;
+    std::vector<std::string> keys_[ControlNumberIndex::KEY_TYPE_COUNT];
+    std::vector<std::string> raw_dois_;
+};
+
+
+void ExtractRecordKeys(const MARC::Record &record, RecordKeys * const record_keys) {
+    record_keys->control_number_ = record.getControlNumber();
+
+    const std::string normalised_title(ControlNumberGuesser::NormaliseTitle(record.getCompleteTitle()));
+    if (not normalised_title.empty())
+        record_keys->keys_[ControlNumberIndex::TITLE].emplace_back(normalised_title);
+
+    for (const auto &author : record.getAllAuthors()) {
+        const std::string normalised_author(TextUtil::UTF8ToLower(ControlNumberGuesser::NormaliseAuthorName(author)));
+        if (not normalised_author.empty())
+            record_keys->keys_[ControlNumberIndex::AUTHOR].emplace_back(normalised_author);
+    }
+
+    std::string year, volume, issue;
+    BSZUtil::ExtractYearVolumeIssue(record, &year, &volume, &issue);
+    if (not year.empty())
+        record_keys->keys_[ControlNumberIndex::YEAR].emplace_back(year);
+
+    for (const auto &issn : record.getISSNs()) {
+        std::string normalised_issn;
+        MiscUtil::NormaliseISSN(issn, &normalised_issn);
+        if (not normalised_issn.empty())
+            record_keys->keys_[ControlNumberIndex::ISSN].emplace_back(normalised_issn);
+    }
+
+    for (const auto &isbn : record.getISBNs()) {
+        std::string normalised_isbn;
+        MiscUtil::NormaliseISBN(isbn, &normalised_isbn);
+        if (not normalised_isbn.empty())
+            record_keys->keys_[ControlNumberIndex::ISBN].emplace_back(normalised_isbn);
+    }
+
+    for (const auto &doi : record.getDOIs())
+        record_keys->raw_dois_.emplace_back(doi);
+}
+
+
+// Collects the keys of all records.  Control number ID's are handed out in the order in which records arrive.
+class IndexBuilder {
+    std::mutex mutex_;
+    std::unordered_map<std::string, uint32_t> control_numbers_to_ids_map_;
+    std::vector<std::string> control_numbers_;
+    std::unordered_map<std::string, std::vector<uint32_t>> keys_to_ids_maps_[ControlNumberIndex::KEY_TYPE_COUNT];
+public:
+    void add(const RecordKeys &record_keys);
+    std::string generate();
+};
+
+
+void IndexBuilder::add(const RecordKeys &record_keys) {
+    if (unlikely(record_keys.control_number_.empty()))
+        return;
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    uint32_t id;
+    const auto control_number_and_id(control_numbers_to_ids_map_.find(record_keys.control_number_));
+    if (control_number_and_id != control_numbers_to_ids_map_.cend())
+        id = control_number_and_id->second;
+    else {
+        id = control_numbers_.size();
+        control_numbers_to_ids_map_.emplace(record_keys.control_number_, id);
+        control_numbers_.emplace_back(record_keys.control_number_);
+    }
+
+    for (unsigned key_type(0); key_type < ControlNumberIndex::KEY_TYPE_COUNT; ++key_type) {
+        for (const auto &key : record_keys.keys_[key_type])
+            keys_to_ids_maps_[key_type][key].emplace_back(id);
+    }
+
+    for (const auto &raw_doi : record_keys.raw_dois_) {
+        std::string normalised_doi;
+        MiscUtil::NormaliseDOI(raw_doi, &normalised_doi);
+        if (not normalised_doi.empty())
+            keys_to_ids_maps_[ControlNumberIndex::DOI][normalised_doi].emplace_back(id);
+    }
+}
+
+
+template<typename EntryType> void AppendTable(const std::vector<EntryType> &entries, std::string * const index) {
+    index->append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(EntryType));
+}
+
+
+std::string IndexBuilder::generate() {
+    // Renumber the control numbers in sorted order so that the index doesn't depend on the order in which our worker
+    // threads happened to finish:
+    std::vector<uint32_t> sorted_positions(control_numbers_.size());
+    for (uint32_t id(0); id < sorted_positions.size(); ++id)
+        sorted_positions[id] = id;
+    std::sort(sorted_positions.begin(), sorted_positions.end(),
+              [this](const uint32_t lhs, const uint32_t rhs) { return control_numbers_[lhs] < control_numbers_[rhs]; });
+    std::vector<uint32_t> old_to_new_ids(control_numbers_.size());
+    size_t control_number_width(1);
+    for (uint32_t new_id(0); new_id < sorted_positions.size(); ++new_id) {
+        old_to_new_ids[sorted_positions[new_id]] = new_id;
+        control_number_width = std::max(control_number_width, control_numbers_[sorted_positions[new_id]].length());
+    }
+
+    std::string control_number_table;
+    control_number_table.reserve(PadTo8(control_numbers_.size() * control_number_width));
+    for (const uint32_t position : sorted_positions) {
+        control_number_table += control_numbers_[position];
+        control_number_table.append(control_number_width - control_numbers_[position].length(), '\0');
+    }
+    control_number_table.resize(PadTo8(control_number_table.size()), '\0');
+
+    std::vector<uint32_t> postings;
+    std::string string_pool;
+    std::vector<ControlNumberIndex::KeyEntry> key_tables[ControlNumberIndex::KEY_TYPE_COUNT];
+    std::vector<const std::string *> sorted_titles;
+    for (unsigned key_type(0); key_type < ControlNumberIndex::KEY_TYPE_COUNT; ++key_type) {
+        std::vector<std::pair<const std::string *, std::vector<uint32_t> *>> sorted_keys;
+        sorted_keys.reserve(keys_to_ids_maps_[key_type].size());
+        for (auto &key_and_ids : keys_to_ids_maps_[key_type])
+            sorted_keys.emplace_back(&key_and_ids.first, &key_and_ids.second);
+        std::sort(sorted_keys.begin(), sorted_keys.end(),
+                  [](const std::pair<const std::string *, std::vector<uint32_t> *> &lhs,
+                     const std::pair<const std::string *, std::vector<uint32_t> *> &rhs) { return *lhs.first < *rhs.first; });
+
+        key_tables[key_type].reserve(sorted_keys.size());
+        for (const auto &key_and_ids : sorted_keys) {
+            std::vector<uint32_t> &ids(*key_and_ids.second);
+            for (auto &id : ids)
+                id = old_to_new_ids[id];
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+            if (unlikely(string_pool.size() + key_and_ids.first->size() > std::numeric_limits<uint32_t>::max()
+                         or postings.size() + ids.size() > std::numeric_limits<uint32_t>::max()))
+                LOG_ERROR("control number index overflow!");
+            key_tables[key_type].emplace_back(ControlNumberIndex::KeyEntry{
+                static_cast<uint32_t>(string_pool.size()), static_cast<uint32_t>(key_and_ids.first->size()),
+                static_cast<uint32_t>(postings.size()), static_cast<uint32_t>(ids.size()) });
+            string_pool += *key_and_ids.first;
+            postings.insert(postings.end(), ids.cbegin(), ids.cend());
+
+            if (key_type == ControlNumberIndex::TITLE)
+                sorted_titles.emplace_back(key_and_ids.first);
+        }
+    }
+
+    // Two passes over the titles give us the trigram posting lists w/o having to hold them all in separate containers:
+    std::unordered_map<uint32_t, uint32_t> trigrams_to_counts_map;
+    for (const auto title : sorted_titles) {
+        for (const uint32_t trigram : GetTrigrams(*title))
+            ++trigrams_to_counts_map[trigram];
+    }
+    std::vector<ControlNumberIndex::TrigramEntry> trigram_table;
+    trigram_table.reserve(trigrams_to_counts_map.size());
+    for (const auto &trigram_and_count : trigrams_to_counts_map)
+        trigram_table.emplace_back(ControlNumberIndex::TrigramEntry{ trigram_and_count.first, 0, 0, 0 });
+    std::sort(trigram_table.begin(), trigram_table.end(),
+              [](const ControlNumberIndex::TrigramEntry &lhs, const ControlNumberIndex::TrigramEntry &rhs)
+                  { return lhs.trigram_ < rhs.trigram_; });
+    std::unordered_map<uint32_t, ControlNumberIndex::TrigramEntry *> trigrams_to_entries_map;
+    trigrams_to_entries_map.reserve(trigram_table.size());
+    for (auto &trigram_entry : trigram_table) {
+        const uint32_t count(trigrams_to_counts_map[trigram_entry.trigram_]);
+        if (unlikely(postings.size() + count > std::numeric_limits<uint32_t>::max()))
+            LOG_ERROR("control number index overflow!");
+        trigram_entry.first_posting_ = postings.size();
+        postings.resize(postings.size() + count);
+        trigrams_to_entries_map.emplace(trigram_entry.trigram_, &trigram_entry);
+    }
+    for (uint32_t title_position(0); title_position < sorted_titles.size(); ++title_position) {
+        for (const uint32_t trigram : GetTrigrams(*sorted_titles[title_position])) {
+            ControlNumberIndex::TrigramEntry * const trigram_entry(trigrams_to_entries_map[trigram]);
+            postings[trigram_entry->first_posting_ + trigram_entry->posting_count_++] = title_position;
+        }
+    }
+
+    IndexHeader header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic_, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    header.version_               = INDEX_VERSION;
+    header.control_number_count_  = control_numbers_.size();
+    header.control_number_width_  = control_number_width;
+    for (unsigned key_type(0); key_type < ControlNumberIndex::KEY_TYPE_COUNT; ++key_type)
+        header.key_entry_counts_[key_type] = key_tables[key_type].size();
+    header.trigram_entry_count_   = trigram_table.size();
+    header.posting_count_         = postings.size();
+    header.string_pool_size_      = string_pool.size();
+
+    std::string index(reinterpret_cast<const char *>(&header), sizeof header);
+    index += control_number_table;
+    for (const auto &key_table : key_tables)
+        AppendTable(key_table, &index);
+    AppendTable(trigram_table, &index);
+    AppendTable(postings, &index);
+    index.resize(PadTo8(index.size()), '\0');
+    index += string_pool;
+
+    return index;
+}
+
+
+} // unnamed namespace
+
+
+ControlNumberIndex::ControlNumberIndex(const std::string &index_path)
+    : index_path_(index_path), mmap_(nullptr), mmap_size_(0), control_numbers_(nullptr), control_number_count_(0),
+      control_number_width_(0), trigram_entries_(nullptr), trigram_entry_count_(0), postings_(nullptr), string_pool_(nullptr)
+{
+    const int fd(::open(index_path_.c_str(), O_RDONLY));
+    if (fd == -1)
+        LOG_ERROR("failed to open \"" + index_path_ + "\" for reading!");
+
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd, &stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + index_path_ + "\" failed!");
+    if (static_cast<size_t>(stat_buf.st_size) < sizeof(IndexHeader))
+        LOG_ERROR("\"" + index_path_ + "\" is too small to be a control number index!");
+
+    void * const mapping(::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + index_path_ + "\"!");
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = stat_buf.st_size;
+
+    const IndexHeader * const header(reinterpret_cast<const IndexHeader *>(mmap_));
+    if (std::memcmp(header->magic_, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0 or header->version_ != INDEX_VERSION
+        or GetExpectedIndexSize(*header, sizeof(KeyEntry), sizeof(TrigramEntry)) != mmap_size_)
+        LOG_ERROR("\"" + index_path_ + "\" is not a valid control number index!");
+
+    const char *table_start(mmap_ + sizeof(IndexHeader));
+    control_numbers_       = table_start;
+    control_number_count_  = header->control_number_count_;
+    control_number_width_  = header->control_number_width_;
+    table_start           += PadTo8(control_number_count_ * control_number_width_);
+
+    for (unsigned key_type(0); key_type < KEY_TYPE_COUNT; ++key_type) {
+        key_entries_[key_type]       = reinterpret_cast<const KeyEntry *>(table_start);
+        key_entry_counts_[key_type]  = header->key_entry_counts_[key_type];
+        table_start                 += key_entry_counts_[key_type] * sizeof(KeyEntry);
+    }
+
+    trigram_entries_       = reinterpret_cast<const TrigramEntry *>(table_start);
+    trigram_entry_count_   = header->trigram_entry_count_;
+    table_start           += trigram_entry_count_ * sizeof(TrigramEntry);
+
+    postings_              = reinterpret_cast<const uint32_t *>(table_start);
+    table_start           += PadTo8(header->posting_count_ * sizeof(uint32_t));
+
+    string_pool_           = table_start;
+}
+
+
+ControlNumberIndex::~ControlNumberIndex() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + index_path_ + "\" failed!");
+}
+
+
+void ControlNumberIndex::lookup(const KeyType key_type, const std::string &normalised_key,
+                                std::set<std::string> * const control_numbers) const
+{
+    *control_numbers = idsToControlNumbers(lookupIDs(key_type, normalised_key));
+}
+
+
+std::set<std::string> ControlNumberIndex::getGuessedControlNumbers(const ControlNumberGuesser::NormalisedQuery &normalised_query) const {
+    if (not normalised_query.doi_.empty()) {
+        const auto doi_ids(lookupIDs(DOI, normalised_query.doi_));
+        if (not doi_ids.empty())
+            return idsToControlNumbers(doi_ids);
+    }
+
+    if (not normalised_query.isbn_.empty()) {
+        const auto isbn_ids(lookupIDs(ISBN, normalised_query.isbn_));
+        if (not isbn_ids.empty())
+            return idsToControlNumbers(isbn_ids);
+    }
+
+    const auto title_ids(lookupIDs(TITLE, normalised_query.title_));
+    if (title_ids.empty()) {
+        LOG_DEBUG("no entries found for normalised title \"" + normalised_query.title_ + "\"");
+        return { };
+    }
+
+    std::vector<uint32_t> all_author_ids;
+    for (const auto &normalised_author : normalised_query.authors_) {
+        const auto author_ids(lookupIDs(AUTHOR, normalised_author));
+        all_author_ids.insert(all_author_ids.end(), author_ids.cbegin(), author_ids.cend());
+    }
+    if (all_author_ids.empty()) {
+        LOG_DEBUG("no entries found for normalised authors \"" + StringUtil::Join(normalised_query.authors_, ',') + "\"");
+        return { };
+    }
+    std::sort(all_author_ids.begin(), all_author_ids.end());
+    all_author_ids.erase(std::unique(all_author_ids.begin(), all_author_ids.end()), all_author_ids.end());
+
+    auto common_ids(Intersect(title_ids, all_author_ids));
+
+    if (not normalised_query.issn_.empty()) {
+        const auto issn_ids(lookupIDs(ISSN, normalised_query.issn_));
+        if (not issn_ids.empty())
+            common_ids = Intersect(common_ids, issn_ids);
+    }
+
+    if (normalised_query.year_.empty())
+        return idsToControlNumbers(common_ids);
+
+    return idsToControlNumbers(Intersect(common_ids, lookupIDs(YEAR, normalised_query.year_)));
+}
+
+
+std::vector<ControlNumberIndex::TitleCandidate> ControlNumberIndex::getTitleCandidates(const std::string &normalised_title,
+                                                                                      const double min_similarity,
+                                                                                      const size_t max_candidate_count) const
+{
+    const auto query_trigrams(GetTrigrams(normalised_title));
+    if (query_trigrams.empty())
+        return { };
+
+    // Count how many of the query's trigrams each title shares:
+    unsigned skipped_trigram_count(0);
+    std::unordered_map<uint32_t, unsigned> title_positions_to_shared_counts_map;
+    for (const uint32_t trigram : query_trigrams) {
+        const TrigramEntry * const trigram_entry(findTrigramEntry(trigram));
+        if (trigram_entry == nullptr)
+            continue;
+        if (trigram_entry->posting_count_ > MAX_TRIGRAM_POSTING_COUNT) {
+            ++skipped_trigram_count;
+            continue;
+        }
+        for (const uint32_t *title_position(postings_ + trigram_entry->first_posting_);
+             title_position != postings_ + trigram_entry->first_posting_ + trigram_entry->posting_count_; ++title_position)
+            ++title_positions_to_shared_counts_map[*title_position];
+    }
+
+    // As the Jaccard coefficient can't exceed shared/|query trigrams|, we only have to look at titles that share at least
+    // that many of the trigrams that we used:
+    const double min_shared_count(min_similarity * query_trigrams.size() - skipped_trigram_count);
+
+    std::vector<TitleCandidate> candidates;
+    for (const auto &title_position_and_shared_count : title_positions_to_shared_counts_map) {
+        if (title_position_and_shared_count.second < min_shared_count)
+            continue;
+
+        const StringView title(getKey(key_entries_[TITLE][title_position_and_shared_count.first]));
+        const auto title_trigrams(GetTrigrams(title));
+        const size_t shared_count(Intersect(query_trigrams, title_trigrams).size());
+        const double similarity(static_cast<double>(shared_count)
+                                / (query_trigrams.size() + title_trigrams.size() - shared_count));
+        if (similarity >= min_similarity)
+            candidates.emplace_back(title.toString(), similarity);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const TitleCandidate &lhs, const TitleCandidate &rhs) {
+        return lhs.similarity_ > rhs.similarity_ or (lhs.similarity_ == rhs.similarity_
+                                                     and lhs.normalised_title_ < rhs.normalised_title_);
+    });
+    if (candidates.size() > max_candidate_count)
+        candidates.erase(candidates.begin() + max_candidate_count, candidates.end());
+
+    return candidates;
+}
+
+
+size_t ControlNumberIndex::Create(MARC::Reader * const marc_reader, const std::string &index_path, const unsigned worker_count) {
+    IndexBuilder index_builder;
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr, worker_count);
+    const size_t record_count(processor.process([&index_builder](MARC::Record * const record) {
+        RecordKeys record_keys;
+        ExtractRecordKeys(*record, &record_keys);
+        index_builder.add(record_keys);
+        return false;
+    }));
+
+    // Write to a temporary file first so that concurrent readers never see a partially written index:
+    const std::string temp_path(index_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(index_builder.generate()) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        LOG_ERROR("failed to write \"" + temp_path + "\"!");
+    }
+    if (unlikely(not FileUtil::RenameFile(temp_path, index_path, /* remove_target = */true)))
+        LOG_ERROR("failed to rename \"" + temp_path + "\" to \"" + index_path + "\"!");
+
+    return record_count;
+}
+
+
+inline StringView ControlNumberIndex::getKey(const KeyEntry &key_entry) const {
+    return StringView(string_pool_ + key_entry.key_offset_, key_entry.key_length_);
+}
+
+
+const ControlNumberIndex::KeyEntry *ControlNumberIndex::findKeyEntry(const KeyType key_type, const std::string &normalised_key) const {
+    size_t low(0), high(key_entry_counts_[key_type]);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const int cmp(Compare(getKey(key_entries_[key_type][middle]), normalised_key));
+        if (cmp == 0)
+            return key_entries_[key_type] + middle;
+        if (cmp < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return nullptr;
+}
+
+
+const ControlNumberIndex::TrigramEntry *ControlNumberIndex::findTrigramEntry(const uint32_t trigram) const {
+    const TrigramEntry * const entry(std::lower_bound(trigram_entries_, trigram_entries_ + trigram_entry_count_, trigram,
+                                                      [](const TrigramEntry &lhs, const uint32_t rhs) { return lhs.trigram_ < rhs; }));
+    return (entry == trigram_entries_ + trigram_entry_count_ or entry->trigram_ != trigram) ? nullptr : entry;
+}
+
+
+std::vector<uint32_t> ControlNumberIndex::lookupIDs(const KeyType key_type, const std::string &normalised_key) const {
+    const KeyEntry * const key_entry(findKeyEntry(key_type, normalised_key));
+    if (key_entry == nullptr)
+        return { };
+    return std::vector<uint32_t>(postings_ + key_entry->first_posting_, postings_ + key_entry->first_posting_ + key_entry->posting_count_);
+}
+
+
+std::set<std::string> ControlNumberIndex::idsToControlNumbers(const std::vector<uint32_t> &ids) const {
+    std::set<std::string> control_numbers;
+    for (const uint32_t id : ids) {
+        const char * const control_number(control_numbers_ + id * control_number_width_);
+        control_numbers.emplace(control_number, ::strnlen(control_number, control_number_width_));
+    }
+
+    return control_numbers;
+}
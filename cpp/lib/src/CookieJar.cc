@@ -28,8 +28,12 @@
 #include "CookieJar.h"
 #include <algorithm>
 #include <stdexcept>
+#include <cstdio>
+#include <unistd.h>
+#include "BinaryIO.h"
 #include "Compiler.h"
 #include "DnsUtil.h"
+#include "FileUtil.h"
 #include "HttpHeader.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
@@ -105,6 +109,12 @@ inline bool RequestHostHasMoreDotsThanDomain(const std::string &domain, const st
 } // unnamed namespace
 
 
+std::string CookieJar::Cookie::getIndexDomain() const {
+    const std::string &domain(domain_.empty() ? request_host_ : domain_);
+    return TextUtil::UTF8ToLower((not domain.empty() and domain[0] == '.') ? domain.substr(1) : domain);
+}
+
+
 bool CookieJar::Cookie::setDomain(const std::string &domain, const std::string &request_host) {
     if (domain.empty())
         return true;
@@ -129,11 +139,6 @@ public:
 };
 
 
-inline bool DomainMatch(const std::string &domain_pattern, const std::string &domain_name) {
-    return StringUtil::IsSuffixOf(domain_pattern, "." + domain_name);
-}
-
-
 } // unnamed namespace
 
 
@@ -144,12 +149,46 @@ void CookieJar::addCookies(const HttpHeader &http_header, const std::string &def
 
     const std::string lowercase_default_domain(TextUtil::UTF8ToLower(default_domain));
 
-    const std::vector<std::string> raw_cookies(http_header.getCookies());
-    for (const auto &raw_cookie : raw_cookies)
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    for (const auto &raw_cookie : http_header.getCookies())
         parseCookie(raw_cookie, lowercase_default_domain);
 }
 
 
+void CookieJar::addCookie(const std::string &name, const std::string &value, const std::string &version,
+                          const std::string &domain, const std::string &path, const time_t expiration_time)
+{
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    nonThreadSafeAddCookie(Cookie(name, value, version, domain, path.empty() ? "/" : path, expiration_time));
+}
+
+
+void CookieJar::nonThreadSafeAddCookie(const Cookie &cookie) {
+    const std::string index_domain(cookie.getIndexDomain());
+    std::vector<Cookie> &domain_cookies(domains_to_cookies_[index_domain]);
+
+    // A cookie w/ the same name, domain and path replaces an existing one, an already expired cookie deletes it:
+    const std::string lowercase_name(TextUtil::UTF8ToLower(cookie.name_));
+    for (auto existing_cookie(domain_cookies.begin()); existing_cookie != domain_cookies.end(); ++existing_cookie) {
+        if (existing_cookie->path_ == cookie.path_ and existing_cookie->domain_ == cookie.domain_
+            and TextUtil::UTF8ToLower(existing_cookie->name_) == lowercase_name)
+        {
+            domain_cookies.erase(existing_cookie);
+            --cookie_count_;
+            break;
+        }
+    }
+    if (cookie.expiration_time_ <= std::time(nullptr)) {
+        if (domain_cookies.empty())
+            domains_to_cookies_.erase(index_domain);
+        return;
+    }
+
+    domain_cookies.insert(std::upper_bound(domain_cookies.begin(), domain_cookies.end(), cookie, PathCompare), cookie);
+    ++cookie_count_;
+}
+
+
 namespace {
 
 
@@ -170,27 +209,125 @@ void CookieJar::getCookieHeaders(const std::string &domain_name, const std::stri
 
     const time_t now(std::time(nullptr));
     std::vector<Cookie> matching_cookies;
-    for (iterator key_and_cookie(cookies_.begin()); key_and_cookie != cookies_.end(); /* Empty */) {
-        // Delete the cookie if it has expired:
-        if (now > key_and_cookie->second.expiration_time_)
-            cookies_.erase(key_and_cookie++);
-        else {
-            const Cookie cookie(key_and_cookie->second);
-            const std::string domain((cookie.domain_.empty()) ? cookie.request_host_ : cookie.domain_);
-            if (DomainMatch(domain, lowercase_domain_name) and (PathMatch(cookie.path_, normalised_path)))
-                matching_cookies.push_back(cookie);
-
-
-            ++key_and_cookie;
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    // Only the buckets of "domain_name" itself and its parent domains can contain matching cookies:
+    for (size_t domain_start(0); domain_start != std::string::npos; /* Empty */) {
+        const auto domain_and_cookies(domains_to_cookies_.find(lowercase_domain_name.substr(domain_start)));
+        if (domain_and_cookies != domains_to_cookies_.end()) {
+            std::vector<Cookie> &domain_cookies(domain_and_cookies->second);
+            for (auto cookie(domain_cookies.begin()); cookie != domain_cookies.end(); /* Empty */) {
+                // Delete the cookie if it has expired:
+                if (now > cookie->expiration_time_) {
+                    cookie = domain_cookies.erase(cookie);
+                    --cookie_count_;
+                    continue;
+                }
+
+                // Cookies w/o a domain attribute are only sent back to the host that set them:
+                if ((not cookie->domain_.empty() or domain_start == 0) and PathMatch(cookie->path_, normalised_path))
+                    matching_cookies.emplace_back(*cookie);
+                ++cookie;
+            }
+
+            if (domain_cookies.empty())
+                domains_to_cookies_.erase(domain_and_cookies);
         }
+
+        domain_start = lowercase_domain_name.find('.', domain_start);
+        if (domain_start != std::string::npos)
+            ++domain_start;
     }
 
-    std::sort(matching_cookies.begin(), matching_cookies.end(), PathCompare);
+    // Each bucket is already ordered, but we have to merge the cookies from different buckets:
+    std::stable_sort(matching_cookies.begin(), matching_cookies.end(), PathCompare);
 
     // Now generate the "Cookie:" headers:
-    for (std::vector<Cookie>::const_iterator matching_cookie(matching_cookies.begin());
-         matching_cookie != matching_cookies.end(); ++matching_cookie)
-        *cookie_headers += matching_cookie->getCookieHeader();
+    for (const auto &matching_cookie : matching_cookies)
+        *cookie_headers += matching_cookie.getCookieHeader();
+}
+
+
+void CookieJar::saveSnapshot(const std::string &jar_filename) const {
+    // We write to a temporary file first and then rename it so that concurrent readers never see a partial jar:
+    const std::string temp_filename(jar_filename + "." + std::to_string(::getpid()) + ".tmp");
+    {
+        const auto jar(FileUtil::OpenOutputFileOrDie(temp_filename));
+        const time_t now(std::time(nullptr));
+
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        uint64_t persistent_cookie_count(0);
+        for (const auto &domain_and_cookies : domains_to_cookies_) {
+            for (const auto &cookie : domain_and_cookies.second) {
+                if (not cookie.discard_ and cookie.expiration_time_ > now)
+                    ++persistent_cookie_count;
+            }
+        }
+
+        BinaryIO::WriteOrDie(*jar, persistent_cookie_count);
+        for (const auto &domain_and_cookies : domains_to_cookies_) {
+            for (const auto &cookie : domain_and_cookies.second) {
+                if (cookie.discard_ or cookie.expiration_time_ <= now)
+                    continue;
+
+                BinaryIO::WriteOrDie(*jar, cookie.name_);
+                BinaryIO::WriteOrDie(*jar, cookie.value_);
+                BinaryIO::WriteOrDie(*jar, cookie.comment_);
+                BinaryIO::WriteOrDie(*jar, cookie.comment_url_);
+                BinaryIO::WriteOrDie(*jar, cookie.version_);
+                BinaryIO::WriteOrDie(*jar, cookie.domain_);
+                BinaryIO::WriteOrDie(*jar, cookie.request_host_);
+                BinaryIO::WriteOrDie(*jar, cookie.port_);
+                BinaryIO::WriteOrDie(*jar, cookie.path_);
+                BinaryIO::WriteOrDie(*jar, cookie.cookies_supported_);
+                BinaryIO::WriteOrDie(*jar, cookie.secure_);
+                BinaryIO::WriteOrDie(*jar, cookie.http_only_);
+                BinaryIO::WriteOrDie(*jar, static_cast<int64_t>(cookie.expiration_time_));
+            }
+        }
+    }
+
+    if (::rename(temp_filename.c_str(), jar_filename.c_str()) != 0)
+        LOG_ERROR("failed to rename \"" + temp_filename + "\" to \"" + jar_filename + "\"!");
+}
+
+
+unsigned CookieJar::loadSnapshot(const std::string &jar_filename) {
+    const auto jar(FileUtil::OpenInputFileOrDie(jar_filename));
+    const time_t now(std::time(nullptr));
+
+    uint64_t cookie_count;
+    BinaryIO::ReadOrDie(*jar, &cookie_count);
+
+    std::vector<Cookie> unexpired_cookies;
+    for (uint64_t i(0); i < cookie_count; ++i) {
+        Cookie cookie;
+        BinaryIO::ReadOrDie(*jar, &cookie.name_);
+        BinaryIO::ReadOrDie(*jar, &cookie.value_);
+        BinaryIO::ReadOrDie(*jar, &cookie.comment_);
+        BinaryIO::ReadOrDie(*jar, &cookie.comment_url_);
+        BinaryIO::ReadOrDie(*jar, &cookie.version_);
+        BinaryIO::ReadOrDie(*jar, &cookie.domain_);
+        BinaryIO::ReadOrDie(*jar, &cookie.request_host_);
+        BinaryIO::ReadOrDie(*jar, &cookie.port_);
+        BinaryIO::ReadOrDie(*jar, &cookie.path_);
+        BinaryIO::ReadOrDie(*jar, &cookie.cookies_supported_);
+        BinaryIO::ReadOrDie(*jar, &cookie.secure_);
+        BinaryIO::ReadOrDie(*jar, &cookie.http_only_);
+
+        int64_t expiration_time;
+        BinaryIO::ReadOrDie(*jar, &expiration_time);
+        cookie.expiration_time_ = static_cast<time_t>(expiration_time);
+
+        if (cookie.expiration_time_ > now)
+            unexpired_cookies.emplace_back(cookie);
+    }
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    for (const auto &cookie : unexpired_cookies)
+        nonThreadSafeAddCookie(cookie);
+
+    return unexpired_cookies.size();
 }
 
 
@@ -413,7 +550,7 @@ void CookieJar::parseCookie(const std::string &raw_cookie, const std::string &de
             // Take care of the previous cookie if there was one:
             if (not cookie.empty()) {
                 cookie.request_host_ = default_domain;
-                addCookie(cookie);
+                nonThreadSafeAddCookie(cookie);
             }
             cookie = Cookie(name, value);
             break;
@@ -450,6 +587,6 @@ void CookieJar::parseCookie(const std::string &raw_cookie, const std::string &de
 
     if (not cookie.empty()) {
         cookie.request_host_ = default_domain;
-        addCookie(cookie);
+        nonThreadSafeAddCookie(cookie);
     }
 }
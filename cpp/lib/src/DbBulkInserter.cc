@@ -0,0 +1,113 @@
+/** \file   DbBulkInserter.cc
+ *  \brief  Implementation of the DbBulkInserter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DbBulkInserter.h"
+#include "FileUtil.h"
+#include "util.h"
+
+
+constexpr size_t DbBulkInserter::DEFAULT_MAX_BATCH_SIZE;
+
+
+DbBulkInserter::DbBulkInserter(DbConnection * const db_connection, const std::string &table_name,
+                               const std::vector<std::string> &column_names,
+                               const DbConnection::DuplicateKeyBehaviour duplicate_key_behaviour, const Method method,
+                               const size_t max_batch_size)
+    : db_connection_(db_connection), table_name_(table_name), column_names_(column_names),
+      duplicate_key_behaviour_(duplicate_key_behaviour), method_(method), max_batch_size_(max_batch_size), batch_size_(0),
+      row_count_(0)
+{
+    if (unlikely(column_names_.empty()))
+        LOG_ERROR("need at least one column name for \"" + table_name_ + "\"!");
+    if (unlikely(method_ == LOAD_DATA_LOCAL_INFILE and db_connection_->getType() != DbConnection::T_MYSQL))
+        LOG_ERROR("LOAD_DATA_LOCAL_INFILE is only supported for MySQL!");
+}
+
+
+void DbBulkInserter::insert(const std::vector<std::string> &values) {
+    if (unlikely(values.size() != column_names_.size()))
+        LOG_ERROR("expected " + std::to_string(column_names_.size()) + " values for \"" + table_name_ + "\" but got "
+                  + std::to_string(values.size()) + "!");
+
+    rows_.emplace_back(values);
+    ++row_count_;
+
+    // Quotes and separators, escaping may add a little more but we stay far enough below any hard limits:
+    batch_size_ += 3 * values.size();
+    for (const auto &value : values)
+        batch_size_ += value.size();
+
+    if (batch_size_ >= max_batch_size_)
+        flush();
+}
+
+
+// Backslash-escapes the characters that LOAD DATA INFILE's default field and line format treats specially.
+static std::string EscapeTSVValue(const std::string &value) {
+    std::string escaped_value;
+    escaped_value.reserve(value.size());
+    for (const char ch : value) {
+        switch (ch) {
+        case '\\':
+            escaped_value += "\\\\";
+            break;
+        case '\t':
+            escaped_value += "\\t";
+            break;
+        case '\n':
+            escaped_value += "\\n";
+            break;
+        case '\0':
+            escaped_value += "\\0";
+            break;
+        default:
+            escaped_value += ch;
+        }
+    }
+
+    return escaped_value;
+}
+
+
+void DbBulkInserter::flush() {
+    if (rows_.empty())
+        return;
+
+    if (method_ == MULTI_ROW_INSERT)
+        db_connection_->insertIntoTableOrDie(table_name_, column_names_, rows_, duplicate_key_behaviour_);
+    else {
+        const FileUtil::AutoTempFile tsv_file("/tmp/DbBulkInserter");
+        {
+            const auto tsv_output(FileUtil::OpenOutputFileOrDie(tsv_file.getFilePath()));
+            for (const auto &row : rows_) {
+                for (auto value(row.cbegin()); value != row.cend(); ++value) {
+                    if (value != row.cbegin())
+                        *tsv_output << '\t';
+                    *tsv_output << EscapeTSVValue(*value);
+                }
+                *tsv_output << '\n';
+            }
+        }
+        db_connection_->mySQLLoadDataLocalInfileOrDie(tsv_file.getFilePath(), table_name_, column_names_,
+                                                      duplicate_key_behaviour_);
+    }
+
+    rows_.clear();
+    batch_size_ = 0;
+}
@@ -20,8 +20,10 @@
 #include "DbConnection.h"
 #include <stdexcept>
 #include <cstdlib>
+#include "DbStatement.h"
 #include "FileUtil.h"
 #include "IniFile.h"
+#include "Metrics.h"
 #include "MiscUtil.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
@@ -80,7 +82,9 @@ DbConnection::DbConnection(const IniFile &ini_file, const std::string &ini_file_
 }
 
 
-DbConnection::DbConnection(const std::string &database_path, const OpenMode open_mode): type_(T_SQLITE), stmt_handle_(nullptr) {
+DbConnection::DbConnection(const std::string &database_path, const OpenMode open_mode, const SqliteProfile sqlite_profile)
+    : type_(T_SQLITE), stmt_handle_(nullptr), sqlite_profile_(sqlite_profile)
+{
     int flags(0);
     switch (open_mode) {
     case READONLY:
@@ -93,15 +97,23 @@ DbConnection::DbConnection(const std::string &database_path, const OpenMode open
         flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
         break;
     }
+    if (sqlite_profile_ == SP_READ_MOSTLY)
+        flags |= SQLITE_OPEN_SHAREDCACHE;
 
     if (::sqlite3_open_v2(database_path.c_str(), &sqlite3_, flags, nullptr) != SQLITE_OK)
         LOG_ERROR("failed to create or open an Sqlite3 database with path \"" + database_path + "\"!");
     stmt_handle_ = nullptr;
     initialised_ = true;
+
+    applySqliteProfile(open_mode);
 }
 
 
 DbConnection::~DbConnection() {
+    // Prepared statements have to be released before the connection is closed:
+    statement_to_cache_entry_map_.clear();
+    statement_cache_.clear();
+
     if (initialised_) {
         if (type_ == T_MYSQL)
             ::mysql_close(&mysql_);
@@ -130,7 +142,29 @@ int DbConnection::getLastErrorCode() const {
 const std::string DbConnection::DEFAULT_CONFIG_FILE_PATH(UBTools::GetTuelibPath() + "ub_tools.conf");
 
 
+std::shared_ptr<DbStatement> DbConnection::prepare(const std::string &statement) {
+    const auto statement_and_cache_entry(statement_to_cache_entry_map_.find(statement));
+    if (statement_and_cache_entry != statement_to_cache_entry_map_.end()) {
+        statement_cache_.splice(statement_cache_.begin(), statement_cache_, statement_and_cache_entry->second);
+        return statement_cache_.front().second;
+    }
+
+    std::shared_ptr<DbStatement> prepared_statement(new DbStatement(this, statement));
+    statement_cache_.emplace_front(statement, prepared_statement);
+    statement_to_cache_entry_map_[statement] = statement_cache_.begin();
+    if (statement_cache_.size() > STATEMENT_CACHE_SIZE) {
+        statement_to_cache_entry_map_.erase(statement_cache_.back().first);
+        statement_cache_.pop_back();
+    }
+
+    return prepared_statement;
+}
+
+
 bool DbConnection::query(const std::string &query_statement) {
+    static Metrics::Histogram &query_durations(Metrics::GetHistogram("db_query_duration_ns", "Time spent per SQL statement"));
+    Metrics::ScopedTimer timer(&query_durations);
+
     if (MiscUtil::SafeGetEnv("UTIL_LOG_DEBUG") == "true")
         FileUtil::AppendString("/usr/local/var/log/tuefind/sql_debug.log",
                                std::string(::progname) + ": " +  query_statement + '\n');
@@ -278,10 +312,16 @@ bool DbConnection::queryFile(const std::string &filename) {
         ::mysql_set_server_option(&mysql_, MYSQL_OPTION_MULTI_STATEMENTS_OFF);
         return query_result;
     } else {
+        static RegexMatcher * const create_index_matcher(
+            RegexMatcher::RegexMatcherFactoryOrDie("^CREATE\\s+(UNIQUE\\s+)?INDEX\\s", RegexMatcher::CASE_INSENSITIVE));
+
         std::vector<std::string> individual_statements;
         SplitSqliteStatements(statements, &individual_statements);
         for (const auto &statement : individual_statements) {
-            if (not query(statement))
+            // Maintaining indices while loading lots of rows is much slower than creating them afterwards:
+            if (sqlite_profile_ == SP_BULK_LOAD and create_index_matcher->matched(statement))
+                deferred_index_statements_.emplace_back(statement);
+            else if (not query(statement))
                 return false;
         }
 
@@ -296,7 +336,26 @@ void DbConnection::queryFileOrDie(const std::string &filename) {
 }
 
 
-bool DbConnection::backup(const std::string &output_filename, std::string * const err_msg) {
+bool DbConnection::createDeferredIndices() {
+    while (not deferred_index_statements_.empty()) {
+        if (not query(deferred_index_statements_.front()))
+            return false;
+        deferred_index_statements_.erase(deferred_index_statements_.begin());
+    }
+
+    return true;
+}
+
+
+void DbConnection::createDeferredIndicesOrDie() {
+    if (not createDeferredIndices())
+        LOG_ERROR("failed to create deferred indices! (" + getLastErrorMessage() + ")");
+}
+
+
+bool DbConnection::backup(const std::string &output_filename, std::string * const err_msg, const int pages_per_step,
+                          const unsigned sleep_interval)
+{
     if (type_ != T_SQLITE) {
         *err_msg = "only Sqlite is supported at this time!";
         return false;
@@ -306,6 +365,7 @@ bool DbConnection::backup(const std::string &output_filename, std::string * cons
     int return_code;
     if ((return_code = ::sqlite3_open(output_filename.c_str(), &sqlite3_backup_file)) != SQLITE_OK) {
         *err_msg = "failed to create backup to \"" + output_filename + "\": " + std::string(::sqlite3_errmsg(sqlite3_backup_file));
+        ::sqlite3_close(sqlite3_backup_file);
         return false;
     }
 
@@ -317,32 +377,48 @@ bool DbConnection::backup(const std::string &output_filename, std::string * cons
         return false;
     }
 
-    const int DATABASE_PAGE_COUNT(500); // How many pages to copy to the backup at each iteration.
-    const int SLEEP_INTERVAL(100);      // in milliseconds.
+    // In WAL mode an open read transaction gives us a stable snapshot w/o locking out any writers.  Otherwise we must not hold on
+    // to our shared lock between steps as writers would be unable to commit.
+    bool holding_read_transaction(false);
+    if (::sqlite3_get_autocommit(sqlite3_) != 0) {
+        sqlite3_stmt *journal_mode_stmt;
+        if (::sqlite3_prepare_v2(sqlite3_, "PRAGMA journal_mode", -1, &journal_mode_stmt, nullptr) == SQLITE_OK) {
+            if (::sqlite3_step(journal_mode_stmt) == SQLITE_ROW
+                and ::strcasecmp(reinterpret_cast<const char *>(::sqlite3_column_text(journal_mode_stmt, 0)), "wal") == 0)
+                holding_read_transaction =
+                    ::sqlite3_exec(sqlite3_, "BEGIN; SELECT COUNT(*) FROM sqlite_master", nullptr, nullptr, nullptr) == SQLITE_OK;
+            ::sqlite3_finalize(journal_mode_stmt);
+        }
+    }
+
     bool backup_incomplete;
     do {
-        return_code = ::sqlite3_backup_step(backup_handle, DATABASE_PAGE_COUNT);
+        return_code = ::sqlite3_backup_step(backup_handle, pages_per_step);
         backup_incomplete = return_code == SQLITE_OK or return_code == SQLITE_BUSY or return_code == SQLITE_LOCKED;
         if (backup_incomplete)
-            ::sqlite3_sleep(SLEEP_INTERVAL);
+            ::sqlite3_sleep(sleep_interval);
     } while (backup_incomplete);
     ::sqlite3_backup_finish(backup_handle);
 
+    if (holding_read_transaction)
+        ::sqlite3_exec(sqlite3_, "COMMIT", nullptr, nullptr, nullptr);
+
     return_code = ::sqlite3_errcode(sqlite3_backup_file);
-    ::sqlite3_close(sqlite3_backup_file);
     if (return_code != SQLITE_OK) {
         *err_msg = "an error occurred during the backup to \"" + output_filename + "\": "
                    + std::string(::sqlite3_errmsg(sqlite3_backup_file));
+        ::sqlite3_close(sqlite3_backup_file);
         return false;
     }
+    ::sqlite3_close(sqlite3_backup_file);
 
     return true;
 }
 
 
-void DbConnection::backupOrDie(const std::string &output_filename) {
+void DbConnection::backupOrDie(const std::string &output_filename, const int pages_per_step, const unsigned sleep_interval) {
     std::string err_msg;
-    if (not backup(output_filename, &err_msg))
+    if (not backup(output_filename, &err_msg, pages_per_step, sleep_interval))
         LOG_ERROR(err_msg);
 }
 
@@ -388,14 +464,87 @@ void DbConnection::insertIntoTableOrDie(const std::string &table_name,
 }
 
 
-DbResultSet DbConnection::getLastResultSet() {
+void DbConnection::insertIntoTableOrDie(const std::string &table_name, const std::vector<std::string> &column_names,
+                                        const std::vector<std::vector<std::string>> &rows,
+                                        const DuplicateKeyBehaviour duplicate_key_behaviour)
+{
+    if (rows.empty())
+        return;
+
+    std::string insert_stmt(duplicate_key_behaviour == DKB_REPLACE ? "REPLACE" : "INSERT");
+    if (duplicate_key_behaviour == DKB_IGNORE)
+        insert_stmt += (type_ == T_MYSQL) ? " IGNORE" : " OR IGNORE";
+    insert_stmt += " INTO " + table_name + " (";
+
+    const char column_name_quote(type_ == T_MYSQL ? '`' : '"');
+    for (auto column_name(column_names.cbegin()); column_name != column_names.cend(); ++column_name) {
+        if (column_name != column_names.cbegin())
+            insert_stmt += ',';
+        insert_stmt += column_name_quote;
+        insert_stmt += *column_name;
+        insert_stmt += column_name_quote;
+    }
+
+    insert_stmt += ") VALUES ";
+
+    for (auto row(rows.cbegin()); row != rows.cend(); ++row) {
+        if (unlikely(row->size() != column_names.size()))
+            LOG_ERROR("expected " + std::to_string(column_names.size()) + " values for \"" + table_name + "\" but got "
+                      + std::to_string(row->size()) + "!");
+
+        if (row != rows.cbegin())
+            insert_stmt += ',';
+        insert_stmt += '(';
+        for (auto value(row->cbegin()); value != row->cend(); ++value) {
+            if (value != row->cbegin())
+                insert_stmt += ',';
+            insert_stmt += escapeAndQuoteString(*value);
+        }
+        insert_stmt += ')';
+    }
+
+    queryOrDie(insert_stmt);
+}
+
+
+void DbConnection::mySQLLoadDataLocalInfileOrDie(const std::string &tsv_filename, const std::string &table_name,
+                                                 const std::vector<std::string> &column_names,
+                                                 const DuplicateKeyBehaviour duplicate_key_behaviour)
+{
+    if (unlikely(type_ != T_MYSQL))
+        LOG_ERROR("LOAD DATA LOCAL INFILE is only supported for MySQL!");
+
+    // The client library refuses to send local files unless we explicitly allow it:
+    unsigned int enable_local_infile(1);
+    if (unlikely(::mysql_options(&mysql_, MYSQL_OPT_LOCAL_INFILE, &enable_local_infile) != 0))
+        LOG_ERROR("failed to enable LOAD DATA LOCAL INFILE! (" + getLastErrorMessage() + ")");
+
+    std::string load_stmt("LOAD DATA LOCAL INFILE " + escapeAndQuoteString(tsv_filename));
+    if (duplicate_key_behaviour == DKB_REPLACE)
+        load_stmt += " REPLACE";
+    else if (duplicate_key_behaviour == DKB_IGNORE)
+        load_stmt += " IGNORE";
+    load_stmt += " INTO TABLE " + table_name + " CHARACTER SET " + CharsetToString(charset_)
+                 + " FIELDS TERMINATED BY '\\t' ESCAPED BY '\\\\' LINES TERMINATED BY '\\n' (";
+    for (auto column_name(column_names.cbegin()); column_name != column_names.cend(); ++column_name) {
+        if (column_name != column_names.cbegin())
+            load_stmt += ',';
+        load_stmt += '`' + *column_name + '`';
+    }
+    load_stmt += ')';
+
+    queryOrDie(load_stmt);
+}
+
+
+DbResultSet DbConnection::getLastResultSet(const ResultSetMode mode) {
     if (sqlite3_ == nullptr) {
-        MYSQL_RES * const result_set(::mysql_store_result(&mysql_));
+        MYSQL_RES * const result_set(mode == RSM_STREAM ? ::mysql_use_result(&mysql_) : ::mysql_store_result(&mysql_));
         if (result_set == nullptr)
-            throw std::runtime_error("in DbConnection::getLastResultSet: mysql_store_result() failed! ("
+            throw std::runtime_error("in DbConnection::getLastResultSet: failed to retrieve the result set! ("
                                      + getLastErrorMessage() + ")");
 
-        return DbResultSet(result_set);
+        return DbResultSet(result_set, /* streaming = */mode == RSM_STREAM);
     } else {
         const auto temp_handle(stmt_handle_);
         stmt_handle_ = nullptr;
@@ -449,10 +598,39 @@ void DbConnection::setTimeZone(const TimeZone time_zone) {
 }
 
 
+void DbConnection::applySqliteProfile(const OpenMode open_mode) {
+    std::vector<std::string> pragmas;
+    switch (sqlite_profile_) {
+    case SP_DEFAULT:
+        return;
+    case SP_BULK_LOAD:
+        if (unlikely(open_mode == READONLY))
+            LOG_ERROR("the bulk load profile requires a writable database!");
+        pragmas = { "PRAGMA journal_mode=WAL", "PRAGMA synchronous=NORMAL", "PRAGMA cache_size=-262144" /* 256 MiB */,
+                    "PRAGMA temp_store=MEMORY" };
+        break;
+    case SP_READ_MOSTLY:
+        pragmas = { "PRAGMA mmap_size=1073741824" /* 1 GiB */, "PRAGMA cache_size=-65536" /* 64 MiB */ };
+        break;
+    }
+
+    // We use sqlite3_exec() because some of the pragmas return a row that we don't care about:
+    for (const auto &pragma : pragmas) {
+        char *error_message(nullptr);
+        if (::sqlite3_exec(sqlite3_, pragma.c_str(), nullptr, nullptr, &error_message) != SQLITE_OK) {
+            const std::string error_message_copy(error_message == nullptr ? "unknown error" : error_message);
+            ::sqlite3_free(error_message);
+            LOG_ERROR("\"" + pragma + "\" failed! (" + error_message_copy + ")");
+        }
+    }
+}
+
+
 void DbConnection::init(const std::string &database_name, const std::string &user, const std::string &passwd,
                         const std::string &host, const unsigned port, const Charset charset, const TimeZone time_zone)
 {
     initialised_ = false;
+    sqlite_profile_ = SP_DEFAULT;
 
     if (::mysql_init(&mysql_) == nullptr)
         throw std::runtime_error("in DbConnection::init: mysql_init() failed!");
@@ -484,6 +662,7 @@ void DbConnection::init(const std::string &user, const std::string &passwd, cons
                         const Charset charset, const TimeZone time_zone)
 {
     initialised_ = false;
+    sqlite_profile_ = SP_DEFAULT;
 
     if (::mysql_init(&mysql_) == nullptr)
         throw std::runtime_error("in DbConnection::init: mysql_init() failed!");
@@ -0,0 +1,128 @@
+/** \file   DbConnectionPool.cc
+ *  \brief  Implementation of the DbConnectionPool class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DbConnectionPool.h"
+#include <chrono>
+#include "IniFile.h"
+#include "util.h"
+
+
+DbConnectionPool::DbConnectionPool(const IniFile &ini_file, const std::string &ini_file_section, const unsigned min_size,
+                                   const unsigned max_size, const unsigned health_check_interval, const unsigned max_idle_time,
+                                   const DbConnection::TimeZone time_zone)
+    : DbConnectionPool(std::unique_ptr<DbConnection>(new DbConnection(ini_file, ini_file_section, time_zone)), min_size, max_size,
+                       health_check_interval, max_idle_time)
+{
+}
+
+
+DbConnectionPool::DbConnectionPool(std::unique_ptr<DbConnection> &&first_connection, const unsigned min_size,
+                                   const unsigned max_size, const unsigned health_check_interval, const unsigned max_idle_time)
+    : database_name_(first_connection->getDbName()), user_(first_connection->getUser()), passwd_(first_connection->getPasswd()),
+      host_(first_connection->getHost()), port_(first_connection->getPort()), charset_(first_connection->getCharset()),
+      time_zone_(first_connection->getTimeZone()), min_size_(min_size), max_size_(max_size),
+      health_check_interval_(health_check_interval), max_idle_time_(max_idle_time), open_connection_count_(1), stats_()
+{
+    if (unlikely(max_size_ == 0 or min_size_ > max_size_))
+        LOG_ERROR("bad pool sizes: min=" + std::to_string(min_size_) + ", max=" + std::to_string(max_size_) + "!");
+
+    const time_t now(std::time(nullptr));
+    idle_connections_.emplace_back(std::move(first_connection), now);
+    while (open_connection_count_ < min_size_) {
+        idle_connections_.emplace_back(openConnection(), now);
+        ++open_connection_count_;
+    }
+}
+
+
+DbConnectionPool::Guard DbConnectionPool::checkout() {
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    if (idle_connections_.empty() and open_connection_count_ >= max_size_) {
+        ++stats_.wait_count_;
+        const auto wait_start(std::chrono::steady_clock::now());
+        connection_returned_.wait(mutex_locker,
+                                  [this]{ return not idle_connections_.empty() or open_connection_count_ < max_size_; });
+        stats_.total_wait_time_ +=
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wait_start).count();
+    }
+
+    std::unique_ptr<DbConnection> connection;
+    time_t idle_since(0);
+    if (not idle_connections_.empty()) {
+        connection = std::move(idle_connections_.back().connection_);
+        idle_since = idle_connections_.back().idle_since_;
+        idle_connections_.pop_back();
+    } else
+        ++open_connection_count_; // Reserve a slot for the connection that we're about to open.
+    ++stats_.checkout_count_;
+    mutex_locker.unlock();
+
+    // Talking to the server happens w/o holding the lock:
+    bool failed_health_check(false);
+    if (connection != nullptr and std::time(nullptr) - idle_since >= health_check_interval_ and not connection->ping()) {
+        LOG_WARNING("replacing a pooled connection to " + database_name_ + "@" + host_ + " that failed a health check: "
+                    + connection->getLastErrorMessage());
+        connection.reset();
+        failed_health_check = true;
+    }
+    if (connection == nullptr) {
+        connection = openConnection();
+
+        mutex_locker.lock();
+        ++stats_.reconnect_count_;
+        if (failed_health_check)
+            ++stats_.failed_health_check_count_;
+    }
+
+    return Guard(this, std::move(connection));
+}
+
+
+DbConnectionPool::Stats DbConnectionPool::getStats() const {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    Stats stats(stats_);
+    stats.open_connection_count_ = open_connection_count_;
+    stats.idle_connection_count_ = idle_connections_.size();
+
+    return stats;
+}
+
+
+std::unique_ptr<DbConnection> DbConnectionPool::openConnection() const {
+    return std::unique_ptr<DbConnection>(new DbConnection(database_name_, user_, passwd_, host_, port_, charset_, time_zone_));
+}
+
+
+void DbConnectionPool::checkin(std::unique_ptr<DbConnection> &&connection) {
+    const time_t now(std::time(nullptr));
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    idle_connections_.emplace_back(std::move(connection), now);
+    closeExpiredIdleConnections(now);
+    connection_returned_.notify_one();
+}
+
+
+void DbConnectionPool::closeExpiredIdleConnections(const time_t now) {
+    while (open_connection_count_ > min_size_ and not idle_connections_.empty()
+           and idle_connections_.front().idle_since_ + static_cast<time_t>(max_idle_time_) <= now)
+    {
+        idle_connections_.pop_front();
+        --open_connection_count_;
+    }
+}
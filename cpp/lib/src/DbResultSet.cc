@@ -22,18 +22,25 @@
 #include "util.h"
 
 
-DbResultSet::DbResultSet(MYSQL_RES * const result_set)
-    : result_set_(result_set), stmt_handle_(nullptr), column_count_(::mysql_num_fields(result_set))
+DbResultSet::DbResultSet(MYSQL_RES * const result_set, const bool streaming)
+    : result_set_(result_set), streaming_(streaming), peeked_row_(nullptr), stmt_handle_(nullptr), finalise_(true),
+      column_count_(::mysql_num_fields(result_set))
 {
     const MYSQL_FIELD * const fields(::mysql_fetch_fields(result_set_));
     for (unsigned col_no(0); col_no < column_count_; ++col_no)
         field_name_to_index_map_.insert(std::pair<std::string, unsigned>(fields[col_no].name, col_no));
-    no_of_rows_ = ::mysql_num_rows(result_set_);
+
+    if (streaming_) {
+        // We read the first row ahead of time so that empty() works before any row has been retrieved:
+        peeked_row_ = ::mysql_fetch_row(result_set_);
+        no_of_rows_ = (peeked_row_ == nullptr) ? 0 : 1;
+    } else
+        no_of_rows_ = ::mysql_num_rows(result_set_);
 }
 
 
-DbResultSet::DbResultSet(sqlite3_stmt * const stmt_handle)
-    : result_set_(nullptr), stmt_handle_(stmt_handle), column_count_(::sqlite3_column_count(stmt_handle))
+DbResultSet::DbResultSet(sqlite3_stmt * const stmt_handle, const bool finalise)
+    : result_set_(nullptr), streaming_(false), peeked_row_(nullptr), stmt_handle_(stmt_handle), finalise_(finalise), column_count_(::sqlite3_column_count(stmt_handle))
 {
     for (unsigned col_no(0); col_no < column_count_; ++col_no) {
         const char * const column_name(::sqlite3_column_name(stmt_handle_, col_no));
@@ -47,21 +54,32 @@ DbResultSet::DbResultSet(sqlite3_stmt * const stmt_handle)
 }
 
 
-DbResultSet::DbResultSet(DbResultSet &&other) {
-    if (&other != this) {
-        result_set_ = other.result_set_;
-        other.result_set_ = nullptr;
-        stmt_handle_ = other.stmt_handle_;
-        other.stmt_handle_ = nullptr;
-    }
+DbResultSet::DbResultSet(DbResultSet &&other)
+    : result_set_(other.result_set_), streaming_(other.streaming_), peeked_row_(other.peeked_row_),
+      stmt_handle_(other.stmt_handle_), finalise_(other.finalise_),
+      no_of_rows_(other.no_of_rows_), column_count_(other.column_count_),
+      field_name_to_index_map_(std::move(other.field_name_to_index_map_))
+{
+    other.result_set_ = nullptr;
+    other.stmt_handle_ = nullptr;
 }
 
 
 DbResultSet::~DbResultSet() {
     if (result_set_ != nullptr)
         ::mysql_free_result(result_set_);
-    else if (stmt_handle_ != nullptr and sqlite3_finalize(stmt_handle_) != SQLITE_OK)
-        LOG_ERROR("failed to finalise an Sqlite3 statement!");
+    else if (stmt_handle_ != nullptr)
+        releaseStmtHandle();
+}
+
+
+void DbResultSet::releaseStmtHandle() {
+    if (finalise_) {
+        if (::sqlite3_finalize(stmt_handle_) != SQLITE_OK)
+            LOG_ERROR("failed to finalise an Sqlite3 statement!");
+    } else
+        ::sqlite3_reset(stmt_handle_);
+    stmt_handle_ = nullptr;
 }
 
 
@@ -70,9 +88,7 @@ DbRow DbResultSet::getNextRow() {
         switch (::sqlite3_step(stmt_handle_)) {
         case SQLITE_DONE:
         case SQLITE_OK:
-            if (::sqlite3_finalize(stmt_handle_) != SQLITE_OK)
-                LOG_ERROR("failed to finalise an Sqlite3 statement!");
-            stmt_handle_ = nullptr;
+            releaseStmtHandle();
             field_name_to_index_map_.clear();
             break;
         case SQLITE_ROW:
@@ -83,7 +99,15 @@ DbRow DbResultSet::getNextRow() {
 
         return DbRow(stmt_handle_, field_name_to_index_map_);
     } else {
-        const MYSQL_ROW row(::mysql_fetch_row(result_set_));
+        MYSQL_ROW row;
+        if (peeked_row_ != nullptr) {
+            row = peeked_row_;
+            peeked_row_ = nullptr;
+        } else {
+            row = ::mysql_fetch_row(result_set_);
+            if (streaming_ and row != nullptr)
+                ++no_of_rows_;
+        }
 
         unsigned long *field_sizes;
         unsigned field_count;
@@ -0,0 +1,282 @@
+/** \file   DbStatement.cc
+ *  \brief  Implementation of the DbStatement class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DbStatement.h"
+#include <stdexcept>
+#include <cstring>
+#include "DbConnection.h"
+#include "util.h"
+
+
+namespace {
+
+
+// Splits "statement" at the '?' placeholders that are not part of a quoted string or identifier.
+std::vector<std::string> SplitAtPlaceholders(const std::string &statement) {
+    std::vector<std::string> fragments;
+    std::string current_fragment;
+    char quote('\0');
+    for (auto ch(statement.cbegin()); ch != statement.cend(); ++ch) {
+        if (quote != '\0') {
+            current_fragment += *ch;
+            if (*ch == '\\' and quote != '`' and ch + 1 != statement.cend())
+                current_fragment += *++ch;
+            else if (*ch == quote)
+                quote = '\0';
+        } else if (*ch == '\'' or *ch == '"' or *ch == '`') {
+            quote = *ch;
+            current_fragment += *ch;
+        } else if (*ch == '?') {
+            fragments.emplace_back(current_fragment);
+            current_fragment.clear();
+        } else
+            current_fragment += *ch;
+    }
+    fragments.emplace_back(current_fragment);
+
+    return fragments;
+}
+
+
+} // unnamed namespace
+
+
+DbStatement::DbStatement(DbConnection * const connection, const std::string &statement)
+    : connection_(connection), statement_(statement), sqlite3_stmt_(nullptr), mysql_stmt_(nullptr)
+{
+    if (connection_->getType() == DbConnection::T_SQLITE) {
+        const char *rest;
+        if (::sqlite3_prepare_v2(connection_->sqlite3_, statement_.c_str(), statement_.length(), &sqlite3_stmt_, &rest)
+            != SQLITE_OK)
+            throw std::runtime_error("in DbStatement::DbStatement: failed to prepare \"" + statement_ + "\"! ("
+                                     + connection_->getLastErrorMessage() + ")");
+        if (rest != nullptr and *rest != '\0')
+            throw std::runtime_error("in DbStatement::DbStatement: junk after SQL statement (" + statement_ + "): \""
+                                     + std::string(rest) + "\"!");
+        parameters_.resize(::sqlite3_bind_parameter_count(sqlite3_stmt_));
+        return;
+    }
+
+    mysql_stmt_ = ::mysql_stmt_init(&connection_->mysql_);
+    if (mysql_stmt_ == nullptr)
+        throw std::runtime_error("in DbStatement::DbStatement: mysql_stmt_init() failed! ("
+                                 + connection_->getLastErrorMessage() + ")");
+    if (::mysql_stmt_prepare(mysql_stmt_, statement_.c_str(), statement_.length()) != 0) {
+        const std::string error_message(::mysql_stmt_error(mysql_stmt_));
+        ::mysql_stmt_close(mysql_stmt_);
+        throw std::runtime_error("in DbStatement::DbStatement: failed to prepare \"" + statement_ + "\"! (" + error_message + ")");
+    }
+    parameters_.resize(::mysql_stmt_param_count(mysql_stmt_));
+
+    // Statements that return rows are executed as ordinary queries so that their results can be wrapped in a DbResultSet:
+    MYSQL_RES * const result_metadata(::mysql_stmt_result_metadata(mysql_stmt_));
+    if (result_metadata != nullptr) {
+        ::mysql_free_result(result_metadata);
+        ::mysql_stmt_close(mysql_stmt_);
+        mysql_stmt_ = nullptr;
+
+        statement_fragments_ = SplitAtPlaceholders(statement_);
+        if (unlikely(statement_fragments_.size() != parameters_.size() + 1))
+            throw std::runtime_error("in DbStatement::DbStatement: failed to locate the placeholders in \"" + statement_ + "\"!");
+    }
+}
+
+
+DbStatement::~DbStatement() {
+    if (sqlite3_stmt_ != nullptr and ::sqlite3_finalize(sqlite3_stmt_) != SQLITE_OK)
+        LOG_ERROR("failed to finalise an Sqlite3 statement!");
+    if (mysql_stmt_ != nullptr and ::mysql_stmt_close(mysql_stmt_))
+        LOG_ERROR("failed to close a MySQL statement!");
+}
+
+
+void DbStatement::checkParameterNo(const unsigned parameter_no) const {
+    if (unlikely(parameter_no >= parameters_.size()))
+        throw std::runtime_error("in DbStatement::checkParameterNo: parameter number " + std::to_string(parameter_no)
+                                 + " is out of range for \"" + statement_ + "\"!");
+}
+
+
+void DbStatement::bind(const unsigned parameter_no, const std::string &value) {
+    checkParameterNo(parameter_no);
+    parameters_[parameter_no].type_ = Parameter::STRING;
+    parameters_[parameter_no].string_value_ = value;
+}
+
+
+void DbStatement::bind(const unsigned parameter_no, const int64_t value) {
+    checkParameterNo(parameter_no);
+    parameters_[parameter_no].type_ = Parameter::INTEGER;
+    parameters_[parameter_no].integer_value_ = value;
+}
+
+
+void DbStatement::bindNull(const unsigned parameter_no) {
+    checkParameterNo(parameter_no);
+    parameters_[parameter_no].type_ = Parameter::NULL_VALUE;
+}
+
+
+void DbStatement::clearBindings() {
+    for (auto &parameter : parameters_) {
+        parameter.type_ = Parameter::UNBOUND;
+        parameter.string_value_.clear();
+    }
+}
+
+
+bool DbStatement::execute() {
+    for (unsigned parameter_no(0); parameter_no < parameters_.size(); ++parameter_no) {
+        if (unlikely(parameters_[parameter_no].type_ == Parameter::UNBOUND))
+            throw std::runtime_error("in DbStatement::execute: parameter " + std::to_string(parameter_no) + " of \"" + statement_
+                                     + "\" has not been bound!");
+    }
+
+    return (sqlite3_stmt_ != nullptr) ? executeSqlite() : executeMySQL();
+}
+
+
+void DbStatement::executeOrDie() {
+    if (not execute())
+        LOG_ERROR("failed to execute \"" + statement_ + "\"! (" + connection_->getLastErrorMessage() + ")");
+}
+
+
+DbResultSet DbStatement::getResultSet() {
+    if (sqlite3_stmt_ != nullptr)
+        return DbResultSet(sqlite3_stmt_, /* finalise = */false);
+    if (mysql_stmt_ != nullptr)
+        throw std::runtime_error("in DbStatement::getResultSet: \"" + statement_ + "\" does not return a result set!");
+    return connection_->getLastResultSet();
+}
+
+
+unsigned DbStatement::getNoOfAffectedRows() const {
+    return (mysql_stmt_ != nullptr) ? ::mysql_stmt_affected_rows(mysql_stmt_) : connection_->getNoOfAffectedRows();
+}
+
+
+std::string DbStatement::substituteParameters() const {
+    std::string substituted_statement(statement_fragments_.front());
+    for (unsigned parameter_no(0); parameter_no < parameters_.size(); ++parameter_no) {
+        const Parameter &parameter(parameters_[parameter_no]);
+        switch (parameter.type_) {
+        case Parameter::NULL_VALUE:
+            substituted_statement += "NULL";
+            break;
+        case Parameter::STRING:
+            substituted_statement += connection_->escapeAndQuoteString(parameter.string_value_);
+            break;
+        case Parameter::INTEGER:
+            substituted_statement += std::to_string(parameter.integer_value_);
+            break;
+        case Parameter::UNBOUND:
+            LOG_ERROR("unexpected unbound parameter!");
+        }
+        substituted_statement += statement_fragments_[parameter_no + 1];
+    }
+
+    return substituted_statement;
+}
+
+
+bool DbStatement::executeSqlite() {
+    ::sqlite3_reset(sqlite3_stmt_);
+
+    for (unsigned parameter_no(0); parameter_no < parameters_.size(); ++parameter_no) {
+        const Parameter &parameter(parameters_[parameter_no]);
+        int result_code;
+        switch (parameter.type_) {
+        case Parameter::NULL_VALUE:
+            result_code = ::sqlite3_bind_null(sqlite3_stmt_, parameter_no + 1);
+            break;
+        case Parameter::STRING:
+            result_code = ::sqlite3_bind_text(sqlite3_stmt_, parameter_no + 1, parameter.string_value_.data(),
+                                              parameter.string_value_.size(), SQLITE_TRANSIENT);
+            break;
+        case Parameter::INTEGER:
+            result_code = ::sqlite3_bind_int64(sqlite3_stmt_, parameter_no + 1, parameter.integer_value_);
+            break;
+        default:
+            LOG_ERROR("unexpected unbound parameter!");
+        }
+        if (result_code != SQLITE_OK) {
+            LOG_WARNING("failed to bind parameter " + std::to_string(parameter_no) + " of \"" + statement_ + "\"! ("
+                        + connection_->getLastErrorMessage() + ")");
+            return false;
+        }
+    }
+
+    switch (::sqlite3_step(sqlite3_stmt_)) {
+    case SQLITE_DONE:
+    case SQLITE_OK:
+        ::sqlite3_reset(sqlite3_stmt_);
+        return true;
+    case SQLITE_ROW:
+        return true;
+    default:
+        LOG_WARNING("Could not successfully execute statement \"" + statement_ + "\": " + connection_->getLastErrorMessage());
+        ::sqlite3_reset(sqlite3_stmt_);
+        return false;
+    }
+}
+
+
+bool DbStatement::executeMySQL() {
+    if (mysql_stmt_ == nullptr)
+        return connection_->query(substituteParameters());
+
+    std::vector<MYSQL_BIND> binds(parameters_.size());
+    std::vector<unsigned long> lengths(parameters_.size());
+    for (unsigned parameter_no(0); parameter_no < parameters_.size(); ++parameter_no) {
+        Parameter &parameter(parameters_[parameter_no]);
+        MYSQL_BIND &bind(binds[parameter_no]);
+        std::memset(&bind, 0, sizeof bind);
+        switch (parameter.type_) {
+        case Parameter::NULL_VALUE:
+            bind.buffer_type = MYSQL_TYPE_NULL;
+            break;
+        case Parameter::STRING:
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = const_cast<char *>(parameter.string_value_.data());
+            bind.buffer_length = lengths[parameter_no] = parameter.string_value_.size();
+            bind.length = &lengths[parameter_no];
+            break;
+        case Parameter::INTEGER:
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = &parameter.integer_value_;
+            break;
+        default:
+            LOG_ERROR("unexpected unbound parameter!");
+        }
+    }
+
+    if (not binds.empty() and ::mysql_stmt_bind_param(mysql_stmt_, binds.data())) {
+        LOG_WARNING("failed to bind the parameters of \"" + statement_ + "\"! (" + ::mysql_stmt_error(mysql_stmt_) + ")");
+        return false;
+    }
+
+    if (::mysql_stmt_execute(mysql_stmt_) != 0) {
+        LOG_WARNING("Could not successfully execute statement \"" + statement_ + "\": SQL error code:"
+                    + std::to_string(::mysql_stmt_errno(mysql_stmt_)) + " (" + ::mysql_stmt_error(mysql_stmt_) + ")");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,315 @@
+/** \brief Implementation of the DirectedGraph and NodeNameTable classes.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "DirectedGraph.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <thread>
+#include "Compiler.h"
+#include "util.h"
+
+
+DirectedGraph::DirectedGraph(const size_t node_count, const std::vector<Edge> &edges, const bool add_reverse_edges)
+    : offsets_(node_count + 1, 0)
+{
+    if (unlikely(node_count > UINT32_MAX))
+        LOG_ERROR("too many nodes!");
+
+    // Count the successors of each node...
+    for (const auto &edge : edges) {
+        if (unlikely(edge.first >= node_count or edge.second >= node_count))
+            LOG_ERROR("edge (" + std::to_string(edge.first) + ", " + std::to_string(edge.second) + ") refers to a node "
+                      "outside of 0.." + std::to_string(node_count - 1) + "!");
+        ++offsets_[edge.first + 1];
+        if (add_reverse_edges)
+            ++offsets_[edge.second + 1];
+    }
+    for (size_t node(1); node <= node_count; ++node)
+        offsets_[node] += offsets_[node - 1];
+
+    // ...then place them w/ the help of a copy of the offsets that we advance as we go...
+    successors_.resize(offsets_.back());
+    std::vector<size_t> next_positions(offsets_.cbegin(), offsets_.cend() - 1);
+    for (const auto &edge : edges) {
+        successors_[next_positions[edge.first]++] = edge.second;
+        if (add_reverse_edges)
+            successors_[next_positions[edge.second]++] = edge.first;
+    }
+
+    // ...and finally sort them and drop duplicates, compacting the array in place:
+    size_t new_size(0);
+    for (size_t node(0); node < node_count; ++node) {
+        const auto begin(successors_.begin() + offsets_[node]), end(successors_.begin() + offsets_[node + 1]);
+        std::sort(begin, end);
+        const auto new_end(std::unique(begin, end));
+        offsets_[node] = new_size;
+        new_size = std::move(begin, new_end, successors_.begin() + new_size) - successors_.begin();
+    }
+    offsets_[node_count] = new_size;
+    successors_.resize(new_size);
+    successors_.shrink_to_fit();
+}
+
+
+bool DirectedGraph::topologicalSort(std::vector<NodeId> * const node_order, std::vector<NodeId> * const cycle) const {
+    node_order->clear();
+    node_order->reserve(getNodeCount());
+
+    std::vector<NodeId> indegrees(getNodeCount(), 0);
+    for (const auto successor : successors_)
+        ++indegrees[successor];
+
+    // Kahn's algorithm w/ a min-heap in order to get a unique result:
+    std::priority_queue<NodeId, std::vector<NodeId>, std::greater<NodeId>> ready_nodes;
+    for (NodeId node(0); node < getNodeCount(); ++node) {
+        if (indegrees[node] == 0)
+            ready_nodes.push(node);
+    }
+
+    while (not ready_nodes.empty()) {
+        const NodeId node(ready_nodes.top());
+        ready_nodes.pop();
+        node_order->emplace_back(node);
+        for (const auto successor : getSuccessors(node)) {
+            if (--indegrees[successor] == 0)
+                ready_nodes.push(successor);
+        }
+    }
+
+    if (node_order->size() == getNodeCount())
+        return true;
+
+    if (cycle != nullptr)
+        findCycle(cycle);
+    return false;
+}
+
+
+// An iterative depth-first search.  A cycle exists iff we find an edge to a node that is still on the search path.
+void DirectedGraph::findCycle(std::vector<NodeId> * const cycle) const {
+    cycle->clear();
+
+    enum Colour : uint8_t { UNVISITED, ON_PATH, DONE };
+    std::vector<Colour> colours(getNodeCount(), UNVISITED);
+    std::vector<std::pair<NodeId, size_t>> path; // Nodes and the positions of their next successors to look at.
+    for (NodeId root(0); root < getNodeCount(); ++root) {
+        if (colours[root] != UNVISITED)
+            continue;
+
+        colours[root] = ON_PATH;
+        path.emplace_back(root, offsets_[root]);
+        while (not path.empty()) {
+            const NodeId node(path.back().first);
+            size_t &next_position(path.back().second);
+            if (next_position == offsets_[node + 1]) {
+                colours[node] = DONE;
+                path.pop_back();
+                continue;
+            }
+
+            const NodeId successor(successors_[next_position++]);
+            if (colours[successor] == UNVISITED) {
+                colours[successor] = ON_PATH;
+                path.emplace_back(successor, offsets_[successor]);
+            } else if (colours[successor] == ON_PATH) {
+                auto cycle_start(path.cbegin());
+                while (cycle_start->first != successor)
+                    ++cycle_start;
+                for (auto path_entry(cycle_start); path_entry != path.cend(); ++path_entry)
+                    cycle->emplace_back(path_entry->first);
+                return;
+            }
+        }
+    }
+}
+
+
+size_t DirectedGraph::findStronglyConnectedComponents(std::vector<NodeId> * const component_ids) const {
+    const NodeId UNVISITED(UINT32_MAX);
+    std::vector<NodeId> indices(getNodeCount(), UNVISITED), lowlinks(getNodeCount());
+    std::vector<bool> on_stack(getNodeCount(), false);
+    std::vector<NodeId> stack;
+    std::vector<std::pair<NodeId, size_t>> call_stack; // Replaces the recursion of the textbook version.
+    component_ids->assign(getNodeCount(), UNVISITED);
+
+    NodeId next_index(0), component_count(0);
+    const auto visit([&](const NodeId node) {
+        indices[node] = lowlinks[node] = next_index++;
+        stack.emplace_back(node);
+        on_stack[node] = true;
+        call_stack.emplace_back(node, offsets_[node]);
+    });
+
+    for (NodeId root(0); root < getNodeCount(); ++root) {
+        if (indices[root] != UNVISITED)
+            continue;
+
+        visit(root);
+        while (not call_stack.empty()) {
+            const NodeId node(call_stack.back().first);
+            size_t &next_position(call_stack.back().second);
+            if (next_position < offsets_[node + 1]) {
+                const NodeId successor(successors_[next_position++]);
+                if (indices[successor] == UNVISITED)
+                    visit(successor);
+                else if (on_stack[successor])
+                    lowlinks[node] = std::min(lowlinks[node], indices[successor]);
+                continue;
+            }
+
+            // All successors of "node" have been processed.
+            call_stack.pop_back();
+            if (lowlinks[node] == indices[node]) {
+                NodeId member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    on_stack[member] = false;
+                    (*component_ids)[member] = component_count;
+                } while (member != node);
+                ++component_count;
+            }
+            if (not call_stack.empty()) {
+                const NodeId parent(call_stack.back().first);
+                lowlinks[parent] = std::min(lowlinks[parent], lowlinks[node]);
+            }
+        }
+    }
+
+    return component_count;
+}
+
+
+namespace {
+
+
+// Levels w/ fewer nodes than this are not worth the overhead of starting threads.
+const size_t MIN_PARALLEL_LEVEL_SIZE(16384);
+
+
+class AtomicBitmap {
+    std::unique_ptr<std::atomic<uint64_t>[]> words_;
+public:
+    explicit AtomicBitmap(const size_t bit_count): words_(new std::atomic<uint64_t>[(bit_count + 63) / 64]) {
+        for (size_t word_no(0); word_no < (bit_count + 63) / 64; ++word_no)
+            words_[word_no].store(0, std::memory_order_relaxed);
+    }
+
+    // \return True if we set the bit and false if it had already been set.
+    inline bool testAndSet(const size_t bit_no) {
+        const uint64_t mask(uint64_t(1) << (bit_no % 64));
+        auto &word(words_[bit_no / 64]);
+        if (word.load(std::memory_order_relaxed) & mask) // Avoid the expensive atomic write if we can.
+            return false;
+        return (word.fetch_or(mask, std::memory_order_relaxed) & mask) == 0;
+    }
+};
+
+
+} // unnamed namespace
+
+
+std::vector<DirectedGraph::NodeId> DirectedGraph::breadthFirstSearch(const std::vector<NodeId> &start_nodes,
+                                                                     const unsigned max_depth,
+                                                                     std::vector<size_t> * const level_sizes,
+                                                                     const unsigned thread_count) const
+{
+    const unsigned actual_thread_count(thread_count != 0 ? thread_count
+                                                         : std::max(std::thread::hardware_concurrency(), 1u));
+    AtomicBitmap reached(getNodeCount());
+    if (level_sizes != nullptr)
+        level_sizes->clear();
+
+    std::vector<NodeId> reached_nodes, frontier;
+    for (const auto start_node : start_nodes) {
+        if (unlikely(start_node >= getNodeCount()))
+            LOG_ERROR("start node " + std::to_string(start_node) + " is not part of the graph!");
+        if (reached.testAndSet(start_node))
+            frontier.emplace_back(start_node);
+    }
+
+    // Processes the nodes frontier[first, last) and collects their successors that had not yet been reached:
+    const auto expand([this, &reached](const std::vector<NodeId> &current_frontier, const size_t first, const size_t last,
+                                       std::vector<NodeId> * const next_frontier)
+    {
+        for (size_t i(first); i < last; ++i) {
+            for (const auto successor : getSuccessors(current_frontier[i])) {
+                if (reached.testAndSet(successor))
+                    next_frontier->emplace_back(successor);
+            }
+        }
+    });
+
+    for (unsigned depth(0); /* Intentionally empty! */; ++depth) {
+        // Which thread claims a node depends on scheduling, but the set of nodes at each level doesn't:
+        std::sort(frontier.begin(), frontier.end());
+        reached_nodes.insert(reached_nodes.end(), frontier.cbegin(), frontier.cend());
+        if (level_sizes != nullptr)
+            level_sizes->emplace_back(frontier.size());
+        if (depth == max_depth or frontier.empty())
+            break;
+
+        std::vector<NodeId> next_frontier;
+        if (actual_thread_count == 1 or frontier.size() < MIN_PARALLEL_LEVEL_SIZE)
+            expand(frontier, 0, frontier.size(), &next_frontier);
+        else {
+            std::vector<std::vector<NodeId>> next_frontiers(actual_thread_count);
+            std::vector<std::thread> threads;
+            const size_t chunk_size((frontier.size() + actual_thread_count - 1) / actual_thread_count);
+            for (unsigned thread_no(0); thread_no < actual_thread_count; ++thread_no) {
+                const size_t first(std::min(thread_no * chunk_size, frontier.size()));
+                const size_t last(std::min(first + chunk_size, frontier.size()));
+                threads.emplace_back(expand, std::cref(frontier), first, last, &next_frontiers[thread_no]);
+            }
+            for (auto &thread : threads)
+                thread.join();
+            for (const auto &partial_next_frontier : next_frontiers)
+                next_frontier.insert(next_frontier.end(), partial_next_frontier.cbegin(), partial_next_frontier.cend());
+        }
+        frontier.swap(next_frontier);
+    }
+
+    if (level_sizes != nullptr and level_sizes->size() > 1 and level_sizes->back() == 0)
+        level_sizes->pop_back();
+
+    return reached_nodes;
+}
+
+
+constexpr DirectedGraph::NodeId NodeNameTable::NO_ID;
+
+
+DirectedGraph::NodeId NodeNameTable::getOrAddId(const std::string &name) {
+    const auto name_and_id(names_to_ids_.emplace(name, static_cast<DirectedGraph::NodeId>(ids_to_names_.size())));
+    if (name_and_id.second) {
+        if (unlikely(ids_to_names_.size() == NO_ID))
+            LOG_ERROR("too many names!");
+        ids_to_names_.emplace_back(&name_and_id.first->first);
+    }
+
+    return name_and_id.first->second;
+}
+
+
+DirectedGraph::NodeId NodeNameTable::getId(const std::string &name) const {
+    const auto name_and_id(names_to_ids_.find(name));
+    return (name_and_id == names_to_ids_.cend()) ? NO_ID : name_and_id->second;
+}
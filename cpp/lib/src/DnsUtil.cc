@@ -180,10 +180,8 @@ bool TimedGetHostByName(const std::string &hostname, const TimeLimit &time_limit
     const TimeLimit local_time_limit(time_limit.getRemainingTime() < 20000 ? time_limit.getRemainingTime() : 20000);
 
     try {
-        static SimpleResolver resolver;
-
         std::set<in_addr_t> ip_addresses;
-        if (resolver.resolve(hostname, local_time_limit, &ip_addresses)) {
+        if (SimpleResolver::GetDefaultInstance().resolve(hostname, local_time_limit, &ip_addresses)) {
             *ip_address = *(ip_addresses.begin());
             return true;
         }
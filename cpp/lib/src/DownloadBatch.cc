@@ -0,0 +1,316 @@
+/** \brief Concurrent downloading of many URL's w/ a single thread, built on curl's "multi" interface.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "DownloadBatch.h"
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <cstring>
+#include "Compiler.h"
+#include "StringUtil.h"
+#include "Url.h"
+#include "util.h"
+
+
+struct DownloadBatch::Transfer {
+    size_t request_id_;
+    std::string url_, host_;
+    Downloader::Params params_; // Must outlive "easy_handle_" as curl doesn't copy e.g. the POST data.
+    TimeLimit time_limit_;
+    CompletionCallback completion_callback_;
+    CURL *easy_handle_;
+    curl_slist *additional_http_headers_;
+    char error_buffer_[CURL_ERROR_SIZE];
+    std::string message_header_, message_body_;
+public:
+    Transfer(const size_t request_id, const std::string &url, const Downloader::Params &params, const TimeLimit &time_limit,
+             const CompletionCallback &completion_callback)
+        : request_id_(request_id), url_(url), host_(StringUtil::ASCIIToLower(Url(url).getAuthority())), params_(params),
+          time_limit_(time_limit), completion_callback_(completion_callback), easy_handle_(nullptr),
+          additional_http_headers_(nullptr) { error_buffer_[0] = '\0'; }
+    ~Transfer();
+};
+
+
+DownloadBatch::Transfer::~Transfer() {
+    if (additional_http_headers_ != nullptr)
+        ::curl_slist_free_all(additional_http_headers_);
+    if (easy_handle_ != nullptr)
+        ::curl_easy_cleanup(easy_handle_);
+}
+
+
+DownloadBatch::DownloadBatch(const unsigned max_total_transfers, const unsigned max_transfers_per_host)
+    : multi_handle_(::curl_multi_init()), max_total_transfers_(max_total_transfers),
+      max_transfers_per_host_(max_transfers_per_host), next_request_id_(0)
+{
+    if (unlikely(multi_handle_ == nullptr))
+        throw std::runtime_error("in DownloadBatch::DownloadBatch: curl_multi_init() failed!");
+    if (unlikely(max_total_transfers_ == 0 or max_transfers_per_host_ == 0))
+        throw std::runtime_error("in DownloadBatch::DownloadBatch: the transfer caps must be positive!");
+
+    // Our easy handles use Downloader's share handle which must not be cleaned up while we exist.
+    ++Downloader::instance_count_;
+}
+
+
+DownloadBatch::~DownloadBatch() {
+    for (const auto &easy_handle_and_transfer : active_transfers_) {
+        ::curl_multi_remove_handle(multi_handle_, easy_handle_and_transfer.first);
+        delete easy_handle_and_transfer.second;
+    }
+    for (const auto transfer : pending_transfers_)
+        delete transfer;
+    ::curl_multi_cleanup(multi_handle_);
+
+    --Downloader::instance_count_;
+}
+
+
+size_t DownloadBatch::addUrl(const std::string &url, const Downloader::Params &params, const TimeLimit &time_limit,
+                             const CompletionCallback &completion_callback)
+{
+    if (unlikely(params.honour_robots_dot_txt_))
+        LOG_ERROR("honouring robots.txt is not supported!");
+    if (unlikely(params.text_translation_mode_ != Downloader::TRANSPARENT))
+        LOG_ERROR("text translation is not supported!");
+    if (unlikely(params.body_chunk_callback_ != nullptr))
+        LOG_ERROR("body chunk callbacks are not supported!");
+
+    const size_t request_id(next_request_id_++);
+    pending_transfers_.emplace_back(new Transfer(request_id, url, params, time_limit, completion_callback));
+    return request_id;
+}
+
+
+void DownloadBatch::run() {
+    while (not empty()) {
+        startTransfers();
+        if (not active_transfers_.empty())
+            performTransfers();
+    }
+}
+
+
+bool DownloadBatch::getNextCompletion(Result * const result) {
+    while (completion_queue_.empty() and not empty()) {
+        startTransfers();
+        if (not active_transfers_.empty())
+            performTransfers();
+    }
+
+    if (completion_queue_.empty())
+        return false;
+
+    *result = std::move(completion_queue_.front());
+    completion_queue_.pop_front();
+    return true;
+}
+
+
+void DownloadBatch::startTransfers() {
+    // Transfers that fail right away are only finished after the loop as callbacks may add to "pending_transfers_":
+    std::vector<std::pair<Transfer *, CURLcode>> failed_transfers;
+    std::vector<Transfer *> banned_transfers;
+
+    for (auto transfer(pending_transfers_.begin());
+         transfer != pending_transfers_.end() and active_transfers_.size() < max_total_transfers_;)
+    {
+        unsigned &host_active_transfer_count(hosts_to_active_transfer_counts_[(*transfer)->host_]);
+        if (host_active_transfer_count >= max_transfers_per_host_) {
+            ++transfer;
+            continue;
+        }
+
+        Transfer * const started_transfer(*transfer);
+        transfer = pending_transfers_.erase(transfer);
+
+        if (not started_transfer->params_.banned_reg_exps_.empty()
+            and started_transfer->params_.banned_reg_exps_.matchedAny(started_transfer->url_))
+        {
+            banned_transfers.emplace_back(started_transfer);
+            continue;
+        }
+
+        const CURLcode curl_error_code(startTransfer(started_transfer));
+        if (curl_error_code == CURLE_OK)
+            ++host_active_transfer_count;
+        else
+            failed_transfers.emplace_back(started_transfer, curl_error_code);
+    }
+
+    for (const auto banned_transfer : banned_transfers)
+        finishTransfer(banned_transfer, CURLE_OK, "URL banned by regular expression!");
+    for (const auto &failed_transfer_and_curl_error_code : failed_transfers)
+        finishTransfer(failed_transfer_and_curl_error_code.first, failed_transfer_and_curl_error_code.second);
+}
+
+
+CURLcode DownloadBatch::startTransfer(Transfer * const transfer) {
+    // Unlike Downloader, we start the clock when the transfer starts and not when the request was made:
+    transfer->time_limit_.restart();
+
+    std::string user_agent(transfer->params_.user_agent_);
+    Downloader::InitCurlEasyHandle(transfer->params_.dns_cache_timeout_, transfer->error_buffer_,
+                                   transfer->params_.debugging_, WriteFunction, Downloader::LockFunction,
+                                   Downloader::UnlockFunction, HeaderFunction, DebugFunction, &transfer->easy_handle_,
+                                   &user_agent, transfer->params_.follow_redirects_);
+    transfer->additional_http_headers_ = Downloader::ApplyParams(transfer->params_, transfer->easy_handle_);
+
+    if (unlikely(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_WRITEDATA, reinterpret_cast<void *>(transfer))
+                 != CURLE_OK))
+        throw std::runtime_error("in DownloadBatch::startTransfer: curl_easy_setopt() failed (1)!");
+    if (unlikely(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_WRITEHEADER, reinterpret_cast<void *>(transfer))
+                 != CURLE_OK))
+        throw std::runtime_error("in DownloadBatch::startTransfer: curl_easy_setopt() failed (2)!");
+    if (transfer->params_.debugging_) {
+        if (unlikely(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_DEBUGDATA, reinterpret_cast<void *>(transfer))
+                     != CURLE_OK))
+            throw std::runtime_error("in DownloadBatch::startTransfer: curl_easy_setopt() failed (3)!");
+    }
+    if (unlikely(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_MAXREDIRS, transfer->params_.max_redirect_count_)
+                 != CURLE_OK))
+        throw std::runtime_error("in DownloadBatch::startTransfer: curl_easy_setopt() failed (4)!");
+    if (unlikely(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_TIMEOUT_MS,
+                                    static_cast<long>(transfer->time_limit_.getLimit())) != CURLE_OK))
+        throw std::runtime_error("in DownloadBatch::startTransfer: curl_easy_setopt() failed (5)!");
+
+    CURLcode curl_error_code(::curl_easy_setopt(transfer->easy_handle_, CURLOPT_URL, transfer->url_.c_str()));
+    if (curl_error_code == CURLE_OK and transfer->additional_http_headers_ != nullptr
+        and Url(transfer->url_).isValidWebUrl())
+        curl_error_code = ::curl_easy_setopt(transfer->easy_handle_, CURLOPT_HTTPHEADER,
+                                             transfer->additional_http_headers_);
+    if (unlikely(curl_error_code != CURLE_OK))
+        return curl_error_code;
+
+    if (unlikely(::curl_multi_add_handle(multi_handle_, transfer->easy_handle_) != CURLM_OK))
+        throw std::runtime_error("in DownloadBatch::startTransfer: curl_multi_add_handle() failed!");
+    active_transfers_.emplace(transfer->easy_handle_, transfer);
+
+    return CURLE_OK;
+}
+
+
+void DownloadBatch::performTransfers() {
+    int running_handles;
+    if (unlikely(::curl_multi_perform(multi_handle_, &running_handles) != CURLM_OK))
+        throw std::runtime_error("in DownloadBatch::performTransfers: curl_multi_perform() failed!");
+
+    // Collect first, finishing a transfer may invoke a callback that adds new URL's.
+    std::vector<std::pair<Transfer *, CURLcode>> completed_transfers;
+    int messages_in_queue;
+    while (const CURLMsg * const message = ::curl_multi_info_read(multi_handle_, &messages_in_queue)) {
+        if (message->msg != CURLMSG_DONE)
+            continue;
+
+        const auto easy_handle_and_transfer(active_transfers_.find(message->easy_handle));
+        if (unlikely(easy_handle_and_transfer == active_transfers_.end()))
+            throw std::runtime_error("in DownloadBatch::performTransfers: unknown easy handle!");
+        completed_transfers.emplace_back(easy_handle_and_transfer->second, message->data.result);
+    }
+
+    for (const auto &transfer_and_curl_error_code : completed_transfers) {
+        Transfer * const transfer(transfer_and_curl_error_code.first);
+        ::curl_multi_remove_handle(multi_handle_, transfer->easy_handle_);
+        active_transfers_.erase(transfer->easy_handle_);
+        --hosts_to_active_transfer_counts_[transfer->host_];
+        finishTransfer(transfer, transfer_and_curl_error_code.second);
+    }
+
+    if (completed_transfers.empty() and running_handles > 0) {
+        const int MAX_WAIT_TIME(1000); // In ms.
+        if (unlikely(::curl_multi_wait(multi_handle_, nullptr, 0, MAX_WAIT_TIME, nullptr) != CURLM_OK))
+            throw std::runtime_error("in DownloadBatch::performTransfers: curl_multi_wait() failed!");
+    }
+}
+
+
+void DownloadBatch::finishTransfer(Transfer * const transfer, const CURLcode curl_error_code,
+                                   const std::string &error_message)
+{
+    Result result;
+    result.request_id_      = transfer->request_id_;
+    result.url_             = transfer->url_;
+    result.effective_url_   = transfer->url_;
+    result.curl_error_code_ = curl_error_code;
+    result.error_message_   = error_message;
+    result.response_code_   = 0;
+    if (result.error_message_.empty() and curl_error_code != CURLE_OK)
+        result.error_message_ = (transfer->error_buffer_[0] != '\0') ? transfer->error_buffer_
+                                                                     : ::curl_easy_strerror(curl_error_code);
+
+    if (transfer->easy_handle_ != nullptr) {
+        char *effective_url;
+        if (::curl_easy_getinfo(transfer->easy_handle_, CURLINFO_EFFECTIVE_URL, &effective_url) == CURLE_OK
+            and effective_url != nullptr)
+            result.effective_url_ = effective_url;
+        ::curl_easy_getinfo(transfer->easy_handle_, CURLINFO_RESPONSE_CODE, &result.response_code_);
+    }
+    result.message_header_.swap(transfer->message_header_);
+    result.message_body_.swap(transfer->message_body_);
+
+    const CompletionCallback completion_callback(transfer->completion_callback_);
+    delete transfer;
+
+    if (completion_callback)
+        completion_callback(result);
+    else
+        completion_queue_.emplace_back(std::move(result));
+}
+
+
+size_t DownloadBatch::WriteFunction(void *data, size_t size, size_t nmemb, void *transfer) {
+    const size_t total_size(size * nmemb);
+    reinterpret_cast<Transfer *>(transfer)->message_body_.append(reinterpret_cast<char *>(data), total_size);
+    return total_size;
+}
+
+
+size_t DownloadBatch::HeaderFunction(void *data, size_t size, size_t nmemb, void *transfer) {
+    const size_t total_size(size * nmemb);
+    std::string &message_header(reinterpret_cast<Transfer *>(transfer)->message_header_);
+
+    // Only keep the header of the last response, like Downloader::getMessageHeader() does:
+    if (total_size >= 5 and std::strncmp(reinterpret_cast<char *>(data), "HTTP/", 5) == 0)
+        message_header.clear();
+    message_header.append(reinterpret_cast<char *>(data), total_size);
+
+    return total_size;
+}
+
+
+int DownloadBatch::DebugFunction(CURL */* handle */, curl_infotype infotype, char *data, size_t size,
+                                 void *transfer)
+{
+    const std::string &url(reinterpret_cast<Transfer *>(transfer)->url_);
+    switch (infotype) {
+    case CURLINFO_TEXT:
+        LOG_INFO(url + ": informational text: " + std::string(data, size));
+        break;
+    case CURLINFO_HEADER_IN:
+        LOG_INFO(url + ": received header:\n" + std::string(data, size));
+        break;
+    case CURLINFO_HEADER_OUT:
+        LOG_INFO(url + ": sent header:\n" + std::string(data, size));
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
@@ -26,11 +26,18 @@
  */
 
 #include "Downloader.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <openssl/sha.h>
 #include "FileUtil.h"
 #include "HttpHeader.h"
 #include "IniFile.h"
 #include "MediaTypeUtil.h"
+#include "Metrics.h"
+#include "NetUtil.h"
 #include "RegexMatcher.h"
+#include "Resolver.h"
 #include "StringUtil.h"
 #include "util.h"
 #include "WebUtil.h"
@@ -90,9 +97,10 @@ unsigned Downloader::instance_count_(0);
 std::mutex Downloader::cookie_mutex_;
 std::mutex Downloader::dns_mutex_;
 std::mutex Downloader::header_mutex_;
-std::mutex Downloader::robots_dot_txt_mutex_;
+std::mutex Downloader::ssl_session_mutex_;
 std::mutex Downloader::write_mutex_;
-std::unordered_map<std::string, RobotsDotTxt> Downloader::url_to_robots_dot_txt_map_;
+std::mutex Downloader::easy_handle_pool_mutex_;
+std::unordered_map<std::string, std::vector<Downloader::IdleEasyHandle>> Downloader::easy_handle_pool_;
 const std::string Downloader::DEFAULT_USER_AGENT_STRING("UB Tübingen C++ Downloader");
 const std::string Downloader::DEFAULT_ACCEPTABLE_LANGUAGES("en,eng,english");
 const std::string Downloader::DENIED_BY_ROBOTS_DOT_TXT_ERROR_MSG("Disallowed by robots.txt.");
@@ -102,7 +110,7 @@ std::string Downloader::default_user_agent_string_;
 Downloader::Params::Params(const std::string &user_agent, const std::string &acceptable_languages,
                            const long max_redirect_count, const long dns_cache_timeout,
                            const bool honour_robots_dot_txt, const TextTranslationMode text_translation_mode,
-                           const PerlCompatRegExps &banned_reg_exps, const bool debugging,
+                           const RegexSet &banned_reg_exps, const bool debugging,
                            const bool follow_redirects, const unsigned meta_redirect_threshold, const bool ignore_ssl_certificates,
                            const std::string &proxy_host_and_port, const std::vector<std::string> &additional_headers,
                            const std::string &post_data,
@@ -112,7 +120,8 @@ Downloader::Params::Params(const std::string &user_agent, const std::string &acc
       text_translation_mode_(text_translation_mode), banned_reg_exps_(banned_reg_exps), debugging_(debugging),
       follow_redirects_(follow_redirects), meta_redirect_threshold_(meta_redirect_threshold), ignore_ssl_certificates_(ignore_ssl_certificates),
       proxy_host_and_port_(proxy_host_and_port), additional_headers_(additional_headers),
-      post_data_(post_data), authentication_username_(authentication_username), authentication_password_(authentication_password)
+      post_data_(post_data), authentication_username_(authentication_username), authentication_password_(authentication_password),
+      if_modified_since_(0), use_simple_resolver_(false)
 {
     max_redirect_count_ = follow_redirects_ ? max_redirect_count_ : 0 ;
 
@@ -124,7 +133,7 @@ Downloader::Params::Params(const std::string &user_agent, const std::string &acc
 
 
 Downloader::Downloader(const Url &url, const Params &params, const TimeLimit &time_limit)
-    : multi_mode_(false), additional_http_headers_(nullptr), upload_buffer_(nullptr), params_(params)
+    : multi_mode_(false), additional_http_headers_(nullptr), resolve_list_(nullptr), upload_buffer_(nullptr), params_(params)
 {
     init();
     newUrl(url, time_limit);
@@ -132,7 +141,7 @@ Downloader::Downloader(const Url &url, const Params &params, const TimeLimit &ti
 
 
 Downloader::Downloader(const std::string &url, const Params &params, const TimeLimit &time_limit, bool multimode)
-    : multi_mode_(multimode), additional_http_headers_(nullptr), upload_buffer_(nullptr), params_(params)
+    : multi_mode_(multimode), additional_http_headers_(nullptr), resolve_list_(nullptr), upload_buffer_(nullptr), params_(params)
 {
     init();
     newUrl(url, time_limit);
@@ -144,8 +153,14 @@ Downloader::~Downloader() {
 
     if (additional_http_headers_ != nullptr)
         ::curl_slist_free_all(additional_http_headers_);
-    if (likely(easy_handle_ != nullptr))
-        ::curl_easy_cleanup(easy_handle_);
+    if (likely(easy_handle_ != nullptr)) {
+        if (easy_handle_pool_key_.empty())
+            ::curl_easy_cleanup(easy_handle_);
+        else
+            ReturnEasyHandle(easy_handle_pool_key_, easy_handle_);
+    }
+    if (resolve_list_ != nullptr)
+        ::curl_slist_free_all(resolve_list_);
     delete upload_buffer_;
 }
 
@@ -153,18 +168,10 @@ Downloader::~Downloader() {
 namespace {
 
 
-void SplitHttpHeaders(std::string possible_combo_headers, std::vector<std::string> * const individual_headers) {
-    individual_headers->clear();
-    if (possible_combo_headers.empty())
-        return;
-
-    // Sometimes we get HTTP headers that end in LF/LF sequences:
-    StringUtil::ReplaceString("\r\n", "\n", &possible_combo_headers);
-    StringUtil::ReplaceString("\n", "\r\n", &possible_combo_headers);
-
-    StringUtil::Split(possible_combo_headers, std::string("\r\n\r\n"), individual_headers, /* suppress_empty_components = */true);
-    for (auto &individual_header : *individual_headers)
-        individual_header += "\r\n\r\n";
+// \return Identifies the connections that can be reused for downloading "url".
+std::string GetEasyHandlePoolKey(const Url &url) {
+    return StringUtil::ASCIIToLower(url.getScheme()) + "://" + StringUtil::ASCIIToLower(url.getAuthority()) + ":"
+           + url.getPortAsString(/* get_default_when_port_not_set = */true);
 }
 
 
@@ -172,6 +179,11 @@ void SplitHttpHeaders(std::string possible_combo_headers, std::vector<std::strin
 
 
 bool Downloader::newUrl(const Url &url, const TimeLimit &time_limit) {
+    switchEasyHandle(url);
+
+    if (unlikely(params_.body_chunk_callback_ != nullptr and params_.honour_robots_dot_txt_))
+        throw std::runtime_error("in Downloader::newUrl: can't honour robots.txt w/ a body chunk callback!");
+
     redirect_urls_.clear();
     current_url_ = url;
     last_error_message_.clear();
@@ -181,6 +193,8 @@ bool Downloader::newUrl(const Url &url, const TimeLimit &time_limit) {
     }
 
     concatenated_headers_.clear();
+    last_header_start_ = 0;
+    last_header_is_current_ = false;
     body_.clear();
 
     for (;;) {
@@ -190,7 +204,7 @@ bool Downloader::newUrl(const Url &url, const TimeLimit &time_limit) {
             return false;
         }
 
-        if (not params_.banned_reg_exps_.empty() and params_.banned_reg_exps_.matchAny(current_url_)) {
+        if (not params_.banned_reg_exps_.empty() and params_.banned_reg_exps_.matchedAny(current_url_.toString())) {
             last_error_message_ = "URL banned by regular expression!";
             return false;
         }
@@ -210,7 +224,7 @@ bool Downloader::newUrl(const Url &url, const TimeLimit &time_limit) {
 
             // If we have a Web page we attempt a translation to Latin-9 if requested:
             if (params_.text_translation_mode_ == MAP_TO_LATIN9 and not concatenated_headers_.empty())
-                body_ = WebUtil::ConvertToLatin9(HttpHeader(getMessageHeader()), body_);
+                body_ = WebUtil::ConvertToLatin9(getHttpHeader(), body_);
         }
 
         return true;
@@ -219,6 +233,7 @@ bool Downloader::newUrl(const Url &url, const TimeLimit &time_limit) {
 
 
 bool Downloader::postData(const Url &url, const std::string &data, const TimeLimit &time_limit) {
+    switchEasyHandle(url);
     if (::curl_easy_setopt(easy_handle_, CURLOPT_POST, 1L) != CURLE_OK)
         throw std::runtime_error("in Downloader::postData: curl_easy_setopt() failed! (1)");
     if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_POSTFIELDS, data.c_str())))
@@ -229,6 +244,7 @@ bool Downloader::postData(const Url &url, const std::string &data, const TimeLim
 
 
 bool Downloader::putData(const Url &url, const std::string &data, const TimeLimit &time_limit) {
+    switchEasyHandle(url);
     if (::curl_easy_setopt(easy_handle_, CURLOPT_UPLOAD, 1L) != CURLE_OK)
         throw std::runtime_error("in Downloader::putData: curl_easy_setopt() failed! (1)");
     if (::curl_easy_setopt(easy_handle_, CURLOPT_READFUNCTION, UploadCallback) != CURLE_OK)
@@ -246,6 +262,7 @@ bool Downloader::putData(const Url &url, const std::string &data, const TimeLimi
 
 
 bool Downloader::deleteUrl(const Url &url, const TimeLimit &time_limit) {
+    switchEasyHandle(url);
     if (::curl_easy_setopt(easy_handle_, CURLOPT_CUSTOMREQUEST, "DELETE") != CURLE_OK)
         throw std::runtime_error("in Downloader::deleteUrl: curl_easy_setopt() failed!");
 
@@ -253,28 +270,27 @@ bool Downloader::deleteUrl(const Url &url, const TimeLimit &time_limit) {
 }
 
 
-std::string Downloader::getMessageHeader() const {
-    if (concatenated_headers_.empty())
-        return "";
+const std::string &Downloader::getMessageHeader() const {
+    if (not last_header_is_current_)
+        updateLastHeader();
+    return last_header_;
+}
+
 
-    std::vector<std::string> headers;
-    SplitHttpHeaders(concatenated_headers_, &headers);
-    return headers.back();
+const HttpHeader &Downloader::getHttpHeader() const {
+    if (not last_header_is_current_)
+        updateLastHeader();
+    return last_http_header_;
 }
 
 
 std::string Downloader::getMediaType(const bool auto_simplify) const {
-    return MediaTypeUtil::GetMediaType(getMessageHeader(), body_, auto_simplify);
+    return MediaTypeUtil::GetMediaType(getHttpHeader(), body_, auto_simplify);
 }
 
 
 std::string Downloader::getCharset() const {
-    std::vector<std::string> headers;
-    SplitHttpHeaders(concatenated_headers_, &headers);
-    if (headers.empty())
-        return "";
-    HttpHeader http_header(headers.back());
-    return http_header.getCharset();
+    return getHttpHeader().getCharset();
 }
 
 
@@ -287,75 +303,202 @@ const std::string &Downloader::getLastErrorMessage() const {
 
 
 unsigned Downloader::getResponseCode() {
-    std::string err_msg;
-    const std::string regex_pattern("HTTP(/\\d\\.\\d)?\\s*(\\d{3})\\s*");
-    RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory(regex_pattern, &err_msg));
-    if (matcher == nullptr)
-        LOG_ERROR("Failed to compile pattern \"" + regex_pattern + "\": " + err_msg);
+    const HttpHeader &http_header(getHttpHeader());
+    if (not http_header.isValid() or http_header.getStatusCode() < 100 or http_header.getStatusCode() > 999)
+        LOG_ERROR("Failed to get HTTP response code from header: " + getMessageHeader());
+
+    return http_header.getStatusCode();
+}
+
+
+void Downloader::updateLastHeader() const {
+    last_header_.assign(concatenated_headers_, last_header_start_, std::string::npos);
+
+    // Sometimes we get HTTP headers that end in LF/LF sequences:
+    if (last_header_.find('\n') != std::string::npos) {
+        StringUtil::ReplaceString("\r\n", "\n", &last_header_);
+        StringUtil::ReplaceString("\n", "\r\n", &last_header_);
+    }
 
-    const std::string header(getMessageHeader());
-    if (not matcher->matched(header))
-        LOG_ERROR("Failed to get HTTP response code from header: " + header);
+    // Normalise the end of the header to a single empty line:
+    while (not last_header_.empty() and (last_header_.back() == '\r' or last_header_.back() == '\n'))
+        last_header_.pop_back();
+    if (not last_header_.empty())
+        last_header_ += "\r\n\r\n";
 
-    return StringUtil::ToUnsigned((*matcher)[2]);
+    last_http_header_ = HttpHeader(last_header_);
+    last_header_is_current_ = true;
 }
 
 
 void Downloader::init() {
     ++instance_count_;
 
+    last_header_start_ = 0;
+    last_header_is_current_ = false;
+
     last_error_message_.clear();
 
+    easy_handle_ = nullptr;
+    setUpEasyHandle();
+}
+
+
+void Downloader::setUpEasyHandle() {
     Downloader::InitCurlEasyHandle(params_.dns_cache_timeout_, error_buffer_, params_.debugging_, WriteFunction,
                                    LockFunction, UnlockFunction, HeaderFunction, DebugFunction, &easy_handle_,
                                    &params_.user_agent_, params_.follow_redirects_);
 
-    if (not params_.acceptable_languages_.empty())
-        additional_http_headers_ = curl_slist_append(additional_http_headers_,
-                                                     ("Accept-Language: " + params_.acceptable_languages_).c_str());
-
-    for (const auto &additional_header : params_.additional_headers_)
-        additional_http_headers_ = curl_slist_append(additional_http_headers_, additional_header.c_str());
+    if (additional_http_headers_ != nullptr)
+        ::curl_slist_free_all(additional_http_headers_);
+    additional_http_headers_ = ApplyParams(params_, easy_handle_);
 
     if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_WRITEDATA, reinterpret_cast<void *>(this)) != CURLE_OK))
-        throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (1)!");
+        throw std::runtime_error("in Downloader::setUpEasyHandle: curl_easy_setopt() failed (1)!");
 
     if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_WRITEHEADER, reinterpret_cast<void *>(this)) != CURLE_OK))
-        throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (2)!");
+        throw std::runtime_error("in Downloader::setUpEasyHandle: curl_easy_setopt() failed (2)!");
 
     if (params_.debugging_) {
         if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_DEBUGDATA, reinterpret_cast<void *>(this)) != CURLE_OK))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (3)!");
+            throw std::runtime_error("in Downloader::setUpEasyHandle: curl_easy_setopt() failed (3)!");
     }
+}
 
-    if (params_.ignore_ssl_certificates_) {
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_SSL_VERIFYPEER, 0L) != CURLE_OK))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (4)!");
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_SSL_VERIFYHOST, 0L) != CURLE_OK))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (5)!");
+
+void Downloader::switchEasyHandle(const Url &url) {
+    // In multi mode our caller owns the transfer and may already hold on to "easy_handle_":
+    if (multi_mode_)
+        return;
+
+    const std::string easy_handle_pool_key(GetEasyHandlePoolKey(url));
+    if (easy_handle_pool_key == easy_handle_pool_key_)
+        return;
+
+    CURL * const pooled_easy_handle(CheckOutEasyHandle(easy_handle_pool_key));
+    if (easy_handle_pool_key_.empty()) { // Our current handle has never been used and has no connections.
+        if (pooled_easy_handle != nullptr) {
+            ::curl_easy_cleanup(easy_handle_);
+            easy_handle_ = pooled_easy_handle;
+            setUpEasyHandle();
+        }
+    } else {
+        ReturnEasyHandle(easy_handle_pool_key_, easy_handle_);
+        easy_handle_ = pooled_easy_handle; // If this is nullptr, setUpEasyHandle() will create a new handle.
+        setUpEasyHandle();
     }
 
-    if (not params_.proxy_host_and_port_.empty())  {
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_PROXY, params_.proxy_host_and_port_.c_str())
+    easy_handle_pool_key_ = easy_handle_pool_key;
+}
+
+
+CURL *Downloader::CheckOutEasyHandle(const std::string &easy_handle_pool_key) {
+    std::lock_guard<std::mutex> mutex_locker(easy_handle_pool_mutex_);
+    EvictIdleEasyHandles(std::time(nullptr));
+
+    const auto key_and_idle_easy_handles(easy_handle_pool_.find(easy_handle_pool_key));
+    if (key_and_idle_easy_handles == easy_handle_pool_.end())
+        return nullptr;
+
+    // The most recently used handle is the one most likely to still have a live connection:
+    CURL * const easy_handle(key_and_idle_easy_handles->second.back().easy_handle_);
+    key_and_idle_easy_handles->second.pop_back();
+    if (key_and_idle_easy_handles->second.empty())
+        easy_handle_pool_.erase(key_and_idle_easy_handles);
+
+    return easy_handle;
+}
+
+
+void Downloader::ReturnEasyHandle(const std::string &easy_handle_pool_key, CURL * const easy_handle) {
+    // Drop our callback data, which points to the returning instance, while keeping the live connections:
+    ::curl_easy_reset(easy_handle);
+
+    std::lock_guard<std::mutex> mutex_locker(easy_handle_pool_mutex_);
+    const time_t now(std::time(nullptr));
+    EvictIdleEasyHandles(now);
+
+    auto &idle_easy_handles(easy_handle_pool_[easy_handle_pool_key]);
+    if (idle_easy_handles.size() >= MAX_IDLE_EASY_HANDLES_PER_HOST) {
+        ::curl_easy_cleanup(idle_easy_handles.front().easy_handle_);
+        idle_easy_handles.erase(idle_easy_handles.begin());
+    }
+    idle_easy_handles.emplace_back(IdleEasyHandle{ easy_handle, now });
+}
+
+
+void Downloader::EvictIdleEasyHandles(const time_t now) {
+    for (auto key_and_idle_easy_handles(easy_handle_pool_.begin()); key_and_idle_easy_handles != easy_handle_pool_.end();) {
+        auto &idle_easy_handles(key_and_idle_easy_handles->second);
+
+        // Handles are ordered by their last use, so the stale ones are at the front:
+        auto first_fresh_easy_handle(idle_easy_handles.begin());
+        while (first_fresh_easy_handle != idle_easy_handles.end()
+               and now - first_fresh_easy_handle->last_use_time_ > MAX_EASY_HANDLE_IDLE_TIME)
+        {
+            ::curl_easy_cleanup(first_fresh_easy_handle->easy_handle_);
+            ++first_fresh_easy_handle;
+        }
+        idle_easy_handles.erase(idle_easy_handles.begin(), first_fresh_easy_handle);
+
+        if (idle_easy_handles.empty())
+            key_and_idle_easy_handles = easy_handle_pool_.erase(key_and_idle_easy_handles);
+        else
+            ++key_and_idle_easy_handles;
+    }
+}
+
+
+curl_slist *Downloader::ApplyParams(const Params &params, CURL * const easy_handle) {
+    curl_slist *additional_http_headers(nullptr);
+    if (not params.acceptable_languages_.empty())
+        additional_http_headers = ::curl_slist_append(additional_http_headers,
+                                                      ("Accept-Language: " + params.acceptable_languages_).c_str());
+
+    for (const auto &additional_header : params.additional_headers_)
+        additional_http_headers = ::curl_slist_append(additional_http_headers, additional_header.c_str());
+
+    if (not params.if_none_match_.empty())
+        additional_http_headers = ::curl_slist_append(additional_http_headers,
+                                                      ("If-None-Match: " + params.if_none_match_).c_str());
+
+    if (params.ignore_ssl_certificates_) {
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_SSL_VERIFYPEER, 0L) != CURLE_OK))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (1)!");
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_SSL_VERIFYHOST, 0L) != CURLE_OK))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (2)!");
+    }
+
+    if (not params.proxy_host_and_port_.empty())  {
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_PROXY, params.proxy_host_and_port_.c_str())
                      != CURLE_OK))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (6)!");
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (3)!");
     }
 
-    if (not params_.post_data_.empty()) {
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_POSTFIELDS, params_.post_data_.c_str())))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (7)!");
+    if (not params.post_data_.empty()) {
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_POSTFIELDS, params.post_data_.c_str())))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (4)!");
     }
 
-    if (not params_.authentication_username_.empty() or not params_.authentication_password_.empty()) {
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_HTTPAUTH, CURLAUTH_ANY)))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (8)!");
+    if (not params.authentication_username_.empty() or not params.authentication_password_.empty()) {
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_HTTPAUTH, CURLAUTH_ANY)))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (5)!");
+
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_USERNAME, params.authentication_username_.c_str())))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (6)!");
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_PASSWORD, params.authentication_password_.c_str())))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (7)!");
+    }
 
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_USERNAME, params_.authentication_username_.c_str())))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (9)!");
-        if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_PASSWORD, params_.authentication_password_.c_str())))
-            throw std::runtime_error("in Downloader::init: curl_easy_setopt() failed (10)!");
+    if (params.if_modified_since_ != 0) {
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_TIMECONDITION, CURL_TIMECOND_IFMODSINCE) != CURLE_OK))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (8)!");
+        if (unlikely(::curl_easy_setopt(easy_handle, CURLOPT_TIMEVALUE, static_cast<long>(params.if_modified_since_))
+                     != CURLE_OK))
+            throw std::runtime_error("in Downloader::ApplyParams: curl_easy_setopt() failed (9)!");
     }
 
+    return additional_http_headers;
 }
 
 
@@ -365,9 +508,14 @@ void Downloader::InitCurlEasyHandle(const long dns_cache_timeout, const char * c
                                     DebugFunc debug_func, CURL ** const easy_handle, std::string * const user_agent,
                                     const bool follow_redirects)
 {
-    *easy_handle = ::curl_easy_init();
-    if (unlikely(*easy_handle == nullptr))
-        throw std::runtime_error("in Downloader::InitCurlEasyHandle: curl_easy_init() failed!");
+    // curl_easy_reset(3) keeps live connections and the SSL session ID cache which is what we're after w/ reuse:
+    if (*easy_handle != nullptr)
+        ::curl_easy_reset(*easy_handle);
+    else {
+        *easy_handle = ::curl_easy_init();
+        if (unlikely(*easy_handle == nullptr))
+            throw std::runtime_error("in Downloader::InitCurlEasyHandle: curl_easy_init() failed!");
+    }
 
     if (share_handle_ == nullptr) {
         share_handle_ = ::curl_share_init( );
@@ -381,6 +529,9 @@ void Downloader::InitCurlEasyHandle(const long dns_cache_timeout, const char * c
             throw std::runtime_error("in Downloader::InitCurlEasyHandle: curl_share_setopt() failed (3)!");
         if (unlikely(::curl_share_setopt(share_handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE) != 0))
             throw std::runtime_error("in Downloader::InitCurlEasyHandle: curl_share_setopt() failed (4)!");
+        // N.B. We don't share CURL_LOCK_DATA_CONNECT as libcurl doesn't support sharing connections between threads.
+        if (unlikely(::curl_share_setopt(share_handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != 0))
+            throw std::runtime_error("in Downloader::InitCurlEasyHandle: curl_share_setopt() failed (5)!");
     }
 
     if (unlikely(::curl_easy_setopt(*easy_handle, CURLOPT_SHARE, share_handle_) != CURLE_OK))
@@ -455,6 +606,9 @@ bool Downloader::internalNewUrl(const Url &url, const TimeLimit &time_limit) {
     if ((curl_error_code_ = ::curl_easy_setopt(easy_handle_, CURLOPT_TIMEOUT_MS, timeout_in_ms)))
         return false;
 
+    if (params_.use_simple_resolver_ and url.isValidWebUrl() and params_.proxy_host_and_port_.empty())
+        setResolveList(url, time_limit);
+
     // Add additional HTTP headers:
     if (url.isValidWebUrl() and additional_http_headers_ != nullptr) {
         if (::curl_easy_setopt(easy_handle_, CURLOPT_HTTPHEADER, additional_http_headers_) != CURLE_OK)
@@ -462,7 +616,19 @@ bool Downloader::internalNewUrl(const Url &url, const TimeLimit &time_limit) {
     }
 
     if (not multi_mode_) {
-        curl_error_code_ = ::curl_easy_perform(easy_handle_);
+        static Metrics::Histogram &request_durations(Metrics::GetHistogram("downloader_request_duration_ns",
+                                                                           "Time spent per URL in Downloader"));
+        static Metrics::Counter &failed_requests(Metrics::GetCounter("downloader_failed_requests_total",
+                                                                     "Downloader requests that failed at the transport level"));
+        static Metrics::Counter &received_bytes(Metrics::GetCounter("downloader_received_bytes_total",
+                                                                    "Message body bytes received by Downloader"));
+        {
+            Metrics::ScopedTimer timer(&request_durations);
+            curl_error_code_ = ::curl_easy_perform(easy_handle_);
+        }
+        if (curl_error_code_ != CURLE_OK)
+            failed_requests.increment();
+        received_bytes.increment(body_.size());
         return curl_error_code_ == CURLE_OK;
     } else
         return false;
@@ -478,6 +644,11 @@ size_t Downloader::writeFunction(void *data, size_t size, size_t nmemb) {
 
 size_t Downloader::WriteFunction(void *data, size_t size, size_t nmemb, void *this_pointer) {
     Downloader *downloader(reinterpret_cast<Downloader *>(this_pointer));
+    if (downloader->params_.body_chunk_callback_ != nullptr) { // May block, so we must not hold "write_mutex_"!
+        const size_t total_size(size * nmemb);
+        return downloader->params_.body_chunk_callback_(reinterpret_cast<char *>(data), total_size) ? total_size : 0;
+    }
+
     std::lock_guard<std::mutex> mutex_locker(write_mutex_);
     return downloader->writeFunction(data, size, nmemb);
 }
@@ -490,6 +661,8 @@ void Downloader::LockFunction(CURL */* handle */, curl_lock_data data, curl_lock
         Downloader::dns_mutex_.lock();
     else if (data == CURL_LOCK_DATA_COOKIE)
         Downloader::cookie_mutex_.lock();
+    else if (data == CURL_LOCK_DATA_SSL_SESSION)
+        Downloader::ssl_session_mutex_.lock();
 }
 
 
@@ -498,13 +671,21 @@ void Downloader::UnlockFunction(CURL */* handle */, curl_lock_data data, void */
         Downloader::dns_mutex_.unlock();
     else if (data == CURL_LOCK_DATA_COOKIE)
         Downloader::cookie_mutex_.unlock();
+    else if (data == CURL_LOCK_DATA_SSL_SESSION)
+        Downloader::ssl_session_mutex_.unlock();
 }
 
 
 size_t Downloader::headerFunction(void *data, size_t size, size_t nmemb) {
     const size_t total_size(size * nmemb);
     const std::string chunk(reinterpret_cast<char *>(data), total_size);
+
+    // libcurl passes us complete header lines.  A status line starts the header of a new response, e.g. after a
+    // redirect or a "100 Continue":
+    if (chunk.compare(0, 5, "HTTP/") == 0)
+        last_header_start_ = concatenated_headers_.size();
     concatenated_headers_ += chunk;
+    last_header_is_current_ = false;
 
     // Look for "Location:" fields when dealing with HTTP or HTTPS:
     if (current_url_.isValidWebUrl()) {
@@ -571,31 +752,55 @@ bool Downloader::allowedByRobotsDotTxt(const Url &url, const TimeLimit &time_lim
     if (robots_txt_url.empty() or ::strcasecmp(robots_txt_url.c_str(), url.c_str()) == 0)
         return true;
 
-    {
-        // Check to see if we already have a robots.txt object for the current URL:
-        std::lock_guard<std::mutex> mutex_locker(robots_dot_txt_mutex_);
-        const std::unordered_map<std::string, RobotsDotTxt>::const_iterator
-            url_and_robots_dot_txt(url_to_robots_dot_txt_map_.find(robots_txt_url));
-        if (url_and_robots_dot_txt != url_to_robots_dot_txt_map_.end())
-            return url_and_robots_dot_txt->second.accessAllowed(getUserAgent(), url);
+    return getRobotsDotTxt(url, time_limit)->accessAllowed(getUserAgent(), url.getPath());
+}
+
+
+void Downloader::setResolveList(const Url &url, const TimeLimit &time_limit) {
+    // The old list must not be freed while "easy_handle_" still refers to it:
+    if (resolve_list_ != nullptr) {
+        ::curl_easy_setopt(easy_handle_, CURLOPT_RESOLVE, nullptr);
+        ::curl_slist_free_all(resolve_list_);
+        resolve_list_ = nullptr;
     }
 
-    //
-    // If we made it here we don't yet have a robots.txt object for the current URL!
-    //
+    const std::string hostname(url.getAuthority());
+    if (hostname.empty() or hostname[0] == '[') // No IPv6 support in SimpleResolver.
+        return;
 
-    // Site doesn't have a robots.txt or for some reason we couldn't get it?
-    if (not internalNewUrl(Url(robots_txt_url), time_limit)) {
-        std::lock_guard<std::mutex> mutex_locker(robots_dot_txt_mutex_);
-        url_to_robots_dot_txt_map_.insert(std::make_pair(robots_txt_url, RobotsDotTxt()));
-        return true;
+    // If anything goes wrong we let curl do its own lookup:
+    std::set<in_addr_t> ip_addresses;
+    try {
+        if (not SimpleResolver::GetDefaultInstance().resolve(hostname, time_limit, &ip_addresses))
+            return;
+    } catch (const std::exception &x) {
+        LOG_WARNING("failed to resolve \"" + hostname + "\": " + std::string(x.what()));
+        return;
     }
 
-    RobotsDotTxt new_robots_txt(body_);
-    std::lock_guard<std::mutex> mutex_locker(robots_dot_txt_mutex_);
-    url_to_robots_dot_txt_map_.insert(std::make_pair(robots_txt_url, new_robots_txt));
+    // Entries replace any earlier entry for the same host and port in curl's (shared) DNS cache:
+    resolve_list_ = ::curl_slist_append(nullptr, (hostname + ":" + std::to_string(url.getPort()) + ":"
+                                                  + NetUtil::NetworkAddressToString(*ip_addresses.begin())).c_str());
+    if (unlikely(::curl_easy_setopt(easy_handle_, CURLOPT_RESOLVE, resolve_list_) != CURLE_OK))
+        LOG_WARNING("failed to set CURLOPT_RESOLVE for \"" + hostname + "\"!");
+}
+
+
+std::shared_ptr<const RobotsDotTxt> Downloader::getRobotsDotTxt(const Url &url, const TimeLimit &time_limit) {
+    const std::string robots_txt_url(url.getRobotsDotTxtUrl());
+    if (robots_txt_url.empty())
+        return nullptr;
+
+    RobotsDotTxtCache &robots_dot_txt_cache(RobotsDotTxtCache::GetInstance());
+    const auto cached_robots_dot_txt(robots_dot_txt_cache.getRobotsDotTxt(robots_txt_url));
+    if (cached_robots_dot_txt != nullptr)
+        return cached_robots_dot_txt;
 
-    return new_robots_txt.accessAllowed(params_.user_agent_, url.getPath());
+    // Site doesn't have a robots.txt or for some reason we couldn't get it?
+    if (not internalNewUrl(Url(robots_txt_url), time_limit))
+        return robots_dot_txt_cache.insert(robots_txt_url, "");
+
+    return robots_dot_txt_cache.insert(robots_txt_url, body_);
 }
 
 
@@ -603,6 +808,15 @@ void Downloader::GlobalCleanup(const bool forever) {
     if (unlikely(GetInstanceCount() != 0))
         throw std::runtime_error("in Downloader::GlobalCleanup: can't cleanup with existing instances of class Downloader!");
 
+    {
+        std::lock_guard<std::mutex> mutex_locker(easy_handle_pool_mutex_);
+        for (const auto &key_and_idle_easy_handles : easy_handle_pool_) {
+            for (const auto &idle_easy_handle : key_and_idle_easy_handles.second)
+                ::curl_easy_cleanup(idle_easy_handle.easy_handle_);
+        }
+        easy_handle_pool_.clear();
+    }
+
     if (share_handle_ != nullptr) {
         ::curl_share_cleanup(share_handle_);
         share_handle_ = nullptr;
@@ -613,9 +827,9 @@ void Downloader::GlobalCleanup(const bool forever) {
 }
 
 
-const PerlCompatRegExps &Downloader::GetBannedUrlRegExps() {
+const RegexSet &Downloader::GetBannedUrlRegExps() {
     static bool initialised(false);
-    static PerlCompatRegExps ini_file_reg_exps(PerlCompatRegExp::DONT_OPTIMIZE_FOR_MULTIPLE_USE, PCRE_CASELESS);
+    static RegexSet ini_file_reg_exps(RegexMatcher::CASE_INSENSITIVE);
     if (not initialised) {
         initialised = true;
         const IniFile ini_file(ETC_DIR "/BannedUrlRegExps.conf");
@@ -642,11 +856,8 @@ bool Downloader::getHttpEquivRedirect(std::string * const redirect_url) const {
     if (not current_url_.isValidWebUrl() or concatenated_headers_.empty())
         return false;
 
-    std::vector<std::string> headers;
-    SplitHttpHeaders(concatenated_headers_, &headers);
-
     // Only look for redirects in Web pages:
-    const std::string media_type(MediaTypeUtil::GetMediaType(HttpHeader(headers.back()), body_));
+    const std::string media_type(MediaTypeUtil::GetMediaType(getHttpHeader(), body_));
     if (media_type != "text/html" and media_type != "text/xhtml")
         return false;
 
@@ -678,11 +889,89 @@ bool Downloader::getHttpEquivRedirect(std::string * const redirect_url) const {
 
 
 bool Download(const std::string &url, const std::string &output_filename, const TimeLimit &time_limit) {
-    Downloader downloader(url, Downloader::Params(), time_limit);
-    if (downloader.anErrorOccurred())
+    const int fd(::open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+    if (unlikely(fd == -1))
+        return false;
+
+    std::string error_message;
+    const bool success(DownloadToFileDescriptor(url, fd, time_limit, &error_message));
+    if (unlikely(::close(fd) != 0))
+        return false;
+
+    return success;
+}
+
+
+namespace {
+
+
+bool WriteToFileDescriptor(const int fd, const char *data, size_t size) {
+    while (size > 0) {
+        const ssize_t written(::write(fd, data, size));
+        if (unlikely(written == -1)) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+
+} // unnamed namespace
+
+
+bool DownloadToFileDescriptor(const std::string &url, const int fd, const TimeLimit &time_limit,
+                              std::string * const error_message, Downloader::Params params,
+                              std::string * const message_header, std::string * const sha1_hash,
+                              const size_t max_document_size)
+{
+    SHA_CTX sha1_context;
+    if (sha1_hash != nullptr)
+        ::SHA1_Init(&sha1_context);
+
+    size_t document_size(0);
+    std::string sink_error_message;
+    params.body_chunk_callback_ = [&](const char * const data, const size_t size) {
+        document_size += size;
+        if (max_document_size != 0 and document_size > max_document_size) {
+            sink_error_message = "document exceeds the maximum size of " + std::to_string(max_document_size) + " bytes!";
+            return false;
+        }
+
+        if (sha1_hash != nullptr)
+            ::SHA1_Update(&sha1_context, data, size);
+        if (unlikely(not WriteToFileDescriptor(fd, data, size))) {
+            sink_error_message = "write(2) failed: " + std::string(std::strerror(errno));
+            return false;
+        }
+
+        return true;
+    };
+
+    Downloader downloader(url, params, time_limit);
+    if (not sink_error_message.empty()) {
+        *error_message = sink_error_message;
+        return false;
+    }
+    if (downloader.anErrorOccurred()) {
+        *error_message = downloader.getLastErrorMessage();
         return false;
+    }
 
-    return FileUtil::WriteString(output_filename, downloader.getMessageBody());
+    if (message_header != nullptr)
+        *message_header = downloader.getMessageHeader();
+    if (sha1_hash != nullptr) {
+        unsigned char cryptographic_hash[SHA_DIGEST_LENGTH];
+        ::SHA1_Final(cryptographic_hash, &sha1_context);
+        sha1_hash->assign(reinterpret_cast<char *>(cryptographic_hash), SHA_DIGEST_LENGTH);
+    }
+
+    error_message->clear();
+    return true;
 }
 
 
@@ -19,8 +19,11 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "Elasticsearch.h"
+#include <thread>
 #include "FileUtil.h"
 #include "IniFile.h"
+#include "Metrics.h"
+#include "TimeUtil.h"
 #include "UBTools.h"
 #include "Url.h"
 #include "UrlUtil.h"
@@ -97,73 +100,166 @@ bool Elasticsearch::deleteDocument(const std::string &document_id) {
 }
 
 
+std::vector<Elasticsearch::ValueGroup> Elasticsearch::countDistinctValues(const std::vector<std::string> &fields,
+                                                                          const std::set<std::string> &example_fields) const
+{
+    const unsigned GROUPS_PER_REQUEST(10000);
+
+    std::string aggregation_prefix("{ \"size\": 0, \"aggs\": { \"groups\": { \"composite\": { \"size\": "
+                                   + std::to_string(GROUPS_PER_REQUEST) + ", \"sources\": [");
+    for (const auto &field : fields)
+        aggregation_prefix += " { \"" + field + "\": { \"terms\": { \"field\": \"" + field + "\" } } },";
+    aggregation_prefix.back() = ']';
+
+    std::string aggregation_suffix(" }");
+    if (not example_fields.empty()) {
+        aggregation_suffix += ", \"aggs\": { \"example\": { \"top_hits\": { \"size\": 1, \"_source\": [";
+        for (const auto &example_field : example_fields)
+            aggregation_suffix += " \"" + example_field + "\",";
+        aggregation_suffix.back() = ']';
+        aggregation_suffix += " } } }";
+    }
+    aggregation_suffix += " } } }";
+
+    // We page through the groups w/ the "after" key of the previous response:
+    std::vector<ValueGroup> value_groups;
+    std::string after_key;
+    for (;;) {
+        const auto result_node(query("_search", REST::POST,
+                                     JSON::ObjectNode(aggregation_prefix + (after_key.empty() ? "" : ", \"after\": " + after_key)
+                                                      + aggregation_suffix)));
+        const auto groups_node(result_node->getObjectNode("aggregations")->getObjectNode("groups"));
+        const auto buckets_node(groups_node->getArrayNode("buckets"));
+        if (buckets_node->empty())
+            return value_groups;
+
+        for (const auto &bucket : *buckets_node) {
+            const auto bucket_object(JSON::JSONNode::CastToObjectNodeOrDie("bucket", bucket));
+            const auto key_object(bucket_object->getObjectNode("key"));
+
+            ValueGroup value_group;
+            for (const auto &field : fields)
+                value_group.values_.emplace_back(key_object->getStringValue(field));
+            value_group.count_ = bucket_object->getIntegerValue("doc_count");
+            if (not example_fields.empty()) {
+                const auto example_hits(bucket_object->getObjectNode("example")->getObjectNode("hits")->getArrayNode("hits"));
+                const auto source_object(example_hits->getObjectNode(0)->getObjectNode("_source"));
+                for (const auto &field_and_value : *source_object)
+                    value_group.example_document_[field_and_value.first] =
+                        JSON::JSONNode::CastToStringNodeOrDie(field_and_value.first, field_and_value.second)->getValue();
+            }
+            value_groups.emplace_back(value_group);
+        }
+
+        const auto after_key_node(groups_node->getOptionalObjectNode("after_key"));
+        if (after_key_node == nullptr)
+            return value_groups;
+        after_key = after_key_node->toString();
+    }
+}
+
+
 std::unordered_set<std::string> Elasticsearch::selectAll(const std::string &field) const {
-    const std::vector<std::map<std::string, std::string>> result(simpleSelect({ field }));
     std::unordered_set<std::string> unique_values;
-    for (const auto &map : result) {
-        const auto key_and_value(map.find(field));
-        if (key_and_value != map.cend())
-            unique_values.emplace(key_and_value->second);
-    }
+    for (const auto &value_group : countDistinctValues({ field }))
+        unique_values.emplace(value_group.values_.front());
 
     return unique_values;
 }
 
 
 std::unordered_multiset<std::string> Elasticsearch::selectAllNonUnique(const std::string &field) const {
-    const std::vector<std::map<std::string, std::string>> result(simpleSelect({ field }));
     std::unordered_multiset<std::string> values;
-    for (const auto &map : result) {
-        const auto key_and_value(map.find(field));
-        if (key_and_value != map.cend())
-            values.emplace(key_and_value->second);
+    for (const auto &value_group : countDistinctValues({ field })) {
+        for (unsigned i(0); i < value_group.count_; ++i)
+            values.emplace(value_group.values_.front());
     }
 
     return values;
 }
 
 
-std::vector<std::map<std::string, std::string>> Elasticsearch::extractResultsHelper(const std::shared_ptr<JSON::ObjectNode> &result_node,
+namespace {
+
+
+std::string GetStringValueOrDie(const std::string &name, const JSON::Document::Value &value) {
+    if (unlikely(not value.isString()))
+        LOG_ERROR("expected \"" + name + "\" to be a string in an Elasticsearch result, found " + value.toString() + "!");
+    return value.getString().toString();
+}
+
+
+} // unnamed namespace
+
+
+std::vector<std::map<std::string, std::string>> Elasticsearch::extractResultsHelper(const JSON::Document &result,
                                                                                     const std::set<std::string> &fields) const
 {
-    const auto hits_object_node(result_node->getObjectNode("hits"));
-    if (unlikely(hits_object_node == nullptr))
+    const auto hits_object(result.getRoot().find("hits"));
+    if (unlikely(hits_object == nullptr or not hits_object->isObject()))
         LOG_ERROR("missing \"hits\" object node in Elasticsearch result node!");
-    const auto hits_array_node(hits_object_node->getArrayNode("hits"));
-    if (unlikely(hits_array_node == nullptr))
+    const auto hits_array(hits_object->find("hits"));
+    if (unlikely(hits_array == nullptr or not hits_array->isArray()))
         LOG_ERROR("missing \"hits\" array node in Elasticsearch result node!");
 
-    std::vector<std::map<std::string, std::string>> search_results;
-    search_results.reserve(hits_array_node->size());
-    for (const auto entry_node : *hits_array_node) {
-        std::map<std::string, std::string> new_map;
-        const auto entry_object_node(JSON::JSONNode::CastToObjectNodeOrDie("entry_object_node", entry_node));
-        for (const auto &entry : *entry_object_node) {
-            if (fields.empty() or fields.find(entry.first) != fields.cend() or entry.first == "_source") {
+    std::vector<std::map<std::string, std::string>> search_results(hits_array->size());
+    for (size_t hit_no(0); hit_no < hits_array->size(); ++hit_no) {
+        const auto &entry_object((*hits_array)[hit_no]);
+        if (unlikely(not entry_object.isObject()))
+            LOG_ERROR("expected an object in the \"hits\" array of an Elasticsearch result, found " + entry_object.toString() + "!");
+
+        auto &new_map(search_results[hit_no]);
+        for (size_t member_no(0); member_no < entry_object.size(); ++member_no) {
+            const auto &entry(entry_object.getMember(member_no));
+            const std::string key(entry.key_.toString());
+            if (key == "_source") {
                 // Copy existing fields but flatten the contents of _source
-                if (entry.first == "_source") {
-                    const auto source_object_node(JSON::JSONNode::CastToObjectNodeOrDie("source_object_node", entry.second));
-                    for (const auto &source_entry : *source_object_node)
-                         new_map[source_entry.first] = JSON::JSONNode::CastToStringNodeOrDie("new_map[source_entry.first]",
-                                                                                             source_entry.second)->getValue();
-                } else
-                    new_map[entry.first] = JSON::JSONNode::CastToStringNodeOrDie("new_map[entry.first]", entry.second)->getValue();
-            }
+                if (unlikely(not entry.value_.isObject()))
+                    LOG_ERROR("expected \"_source\" to be an object in an Elasticsearch result!");
+                for (size_t source_member_no(0); source_member_no < entry.value_.size(); ++source_member_no) {
+                    const auto &source_entry(entry.value_.getMember(source_member_no));
+                    const std::string source_key(source_entry.key_.toString());
+                    new_map[source_key] = GetStringValueOrDie(source_key, source_entry.value_);
+                }
+            } else if (fields.empty() or fields.find(key) != fields.cend())
+                new_map[key] = GetStringValueOrDie(key, entry.value_);
         }
-
-        search_results.resize(search_results.size() + 1);
-        std::swap(search_results.back(), new_map);
     }
 
     return search_results;
 }
 
 
-std::string Elasticsearch::extractScrollId(const std::shared_ptr<JSON::ObjectNode> &result_node) const {
-    const auto scroll_id_string_node(result_node->getStringNode("_scroll_id"));
-    if (unlikely(scroll_id_string_node == nullptr))
+std::string Elasticsearch::extractScrollId(const JSON::Document &result) const {
+    const auto scroll_id(result.getRoot().find("_scroll_id"));
+    if (unlikely(scroll_id == nullptr or not scroll_id->isString()))
         LOG_ERROR("missing \"_scroll_id\" string node in Elasticsearch result");
-    return scroll_id_string_node->getValue();
+    return scroll_id->getString().toString();
+}
+
+
+std::vector<std::map<std::string, std::string>> Elasticsearch::scrollSlice(const std::string &query_string_prefix,
+                                                                          const unsigned slice_no, const unsigned slice_count,
+                                                                          const std::set<std::string> &fields) const
+{
+    const std::string query_string(query_string_prefix + ",\n    \"slice\": { \"id\": " + std::to_string(slice_no) + ", \"max\": "
+                                   + std::to_string(slice_count) + " },\n    \"sort\": [ \"_doc\" ]\n}\n");
+    JSON::Document result;
+    query("_search?scroll=1m", REST::POST, JSON::ObjectNode(query_string), &result);
+
+    std::vector<std::map<std::string, std::string>> search_results_all;
+    std::vector<std::map<std::string, std::string>> search_results_bunch(extractResultsHelper(result, fields));
+    // Iterate until hits are empty
+    while (search_results_bunch.size()) {
+        search_results_all.insert(std::end(search_results_all), std::make_move_iterator(std::begin(search_results_bunch)),
+                                  std::make_move_iterator(std::end(search_results_bunch)));
+        const std::string scroll_id(extractScrollId(result));
+        query("_search/scroll", REST::POST, JSON::ObjectNode("{ \"scroll\": \"1m\", \"scroll_id\" : \"" + scroll_id + "\"}"),
+              &result, false /* do not add type */, true /* suppress index name */ );
+        search_results_bunch = extractResultsHelper(result, fields);
+    }
+
+    return search_results_all;
 }
 
 
@@ -172,6 +268,7 @@ std::vector<std::map<std::string, std::string>> Elasticsearch::simpleSelect(cons
                                                                             const unsigned int max_count) const
 {
     const unsigned int MAX_RESULTS_PER_REQUEST(10000); // Elasticsearch Default
+    const unsigned SCROLL_SLICE_COUNT(4);
     const bool use_scrolling(max_count > MAX_RESULTS_PER_REQUEST);
     std::string query_string("{\n");
 
@@ -196,26 +293,29 @@ std::vector<std::map<std::string, std::string>> Elasticsearch::simpleSelect(cons
     }
 
     query_string += "    },\n";
-    query_string += "    \"size\": " + std::to_string(use_scrolling ? MAX_RESULTS_PER_REQUEST : max_count) + "\n";
-    query_string += "}\n";
-
-    const std::string search_parameter(use_scrolling ?  "_search?scroll=1m" : "_search");
-    auto result_node(query(search_parameter, REST::POST, JSON::ObjectNode(query_string)));
-
-    if (use_scrolling) {
-        std::vector<std::map<std::string, std::string>> search_results_all;
-        std::vector<std::map<std::string, std::string>> search_results_bunch(extractResultsHelper(result_node, fields));
-        // Iterate until hits are empty
-        while (search_results_bunch.size()) {
-            search_results_all.insert(std::end(search_results_all), std::begin(search_results_bunch), std::end(search_results_bunch));
-            std::string scroll_id(extractScrollId(result_node));
-            result_node = query("_search/scroll", REST::POST, JSON::ObjectNode("{ \"scroll\": \"1m\", \"scroll_id\" : \"" + scroll_id + "\"}"),
-                                false /* do not add type */, true /* suppress index name */ );
-            search_results_bunch = extractResultsHelper(result_node, fields);
-        }
-        return search_results_all;
-   }
-   return extractResultsHelper(result_node, fields);
+    query_string += "    \"size\": " + std::to_string(use_scrolling ? MAX_RESULTS_PER_REQUEST : max_count);
+
+    if (not use_scrolling) {
+        JSON::Document result;
+        query("_search", REST::POST, JSON::ObjectNode(query_string + "\n}\n"), &result);
+        return extractResultsHelper(result, fields);
+    }
+
+    // Fetch the slices of a sliced scroll concurrently:
+    std::vector<std::vector<std::map<std::string, std::string>>> slice_results(SCROLL_SLICE_COUNT);
+    std::vector<std::thread> slice_threads;
+    for (unsigned slice_no(0); slice_no < SCROLL_SLICE_COUNT; ++slice_no)
+        slice_threads.emplace_back([this, &query_string, slice_no, &fields, &slice_results] {
+            slice_results[slice_no] = scrollSlice(query_string, slice_no, SCROLL_SLICE_COUNT, fields);
+        });
+    for (auto &slice_thread : slice_threads)
+        slice_thread.join();
+
+    std::vector<std::map<std::string, std::string>> search_results_all;
+    for (auto &slice_result : slice_results)
+        search_results_all.insert(std::end(search_results_all), std::make_move_iterator(std::begin(slice_result)),
+                                  std::make_move_iterator(std::end(slice_result)));
+    return search_results_all;
 }
 
 
@@ -231,27 +331,43 @@ static std::string ToString(const Elasticsearch::RangeOperator op) {
 }
 
 
+static std::string GenerateRangeQuery(const std::string &field, const Elasticsearch::RangeOperator operator1,
+                                      const std::string &operand1, const Elasticsearch::RangeOperator operator2,
+                                      const std::string &operand2)
+{
+    return "{ \"query\":"
+           "    { \"range\":"
+           "        { \"" + JSON::EscapeString(field) + "\": {"
+           "            \"" + ToString(operator1) + "\": \"" + JSON::EscapeString(operand1) + "\""
+           + ((operator2 == Elasticsearch::RO_NOOP or operand2.empty())
+              ? std::string()
+              : "            ,\"" + ToString(operator2) + "\": \"" + JSON::EscapeString(operand2) + "\"") +
+           "        } }"
+           "    }"
+           "}";
+}
+
+
 bool Elasticsearch::deleteRange(const std::string &field, const RangeOperator operator1, const std::string &operand1,
                                 const RangeOperator operator2, const std::string &operand2)
 {
-    const std::string range_node((operator2 == RO_NOOP or operand2.empty()) ?
-                                    "{ \"query\":"
-                                    "    { \"range\":"
-                                    "        \"" + field + "\": {"
-                                    "            \"" + ToString(operator1) + "\"" + operand1 + "\""
-                                        + ((operator2 == RO_NOOP or operand2.empty())
-                                               ? std::string()
-                                               : "      ,\"" + ToString(operator2) + "\"" + operand2 + "\"") +
-                                    "        }"
-                                    "    }"
-                                    "}"
-                                                                            :
-                                    "");
-    const auto result_node(query("_delete", REST::POST, range_node));
+    const auto result_node(query("_delete_by_query", REST::POST,
+                                 JSON::ObjectNode(GenerateRangeQuery(field, operator1, operand1, operator2, operand2))));
     return result_node->getIntegerNode("deleted")->getValue() > 0;
 }
 
 
+std::string Elasticsearch::startDeleteRange(const std::string &field, const RangeOperator operator1, const std::string &operand1,
+                                            const unsigned requests_per_second, const RangeOperator operator2,
+                                            const std::string &operand2)
+{
+    const auto result_node(query("_delete_by_query?wait_for_completion=false&conflicts=proceed&slices=auto&requests_per_second="
+                                 + std::to_string(requests_per_second), REST::POST,
+                                 JSON::ObjectNode(GenerateRangeQuery(field, operator1, operand1, operator2, operand2))));
+    return result_node->getStringValue("task");
+}
+
+
 bool Elasticsearch::fieldWithValueExists(const std::string &field, const std::string &value) {
 
    const auto result_node(
@@ -274,25 +390,309 @@ bool Elasticsearch::fieldWithValueExists(const std::string &field, const std::st
 }
 
 
-std::shared_ptr<JSON::ObjectNode> Elasticsearch::query(const std::string &action, const REST::QueryType query_type,
-                                                       const JSON::ObjectNode &data, const bool add_type,
-                                                       const bool suppress_index_name) const
-{
+Downloader::Params Elasticsearch::getDownloaderParams(const std::string &content_type) const {
     Downloader::Params downloader_params;
     downloader_params.authentication_username_ = username_;
     downloader_params.authentication_password_ = password_;
     downloader_params.ignore_ssl_certificates_ = ignore_ssl_certificates_;
-    downloader_params.additional_headers_.push_back("Content-Type: application/json");
-    Url url;
-    if (add_type)
-        url = Url(host_ + "/" + (not suppress_index_name ? index_ + "/" : "") + type_ + (action.empty() ? "" : "/" + action));
-    else
-        url = Url(host_ + (not suppress_index_name? "/" + index_ : "" ) + (action.empty() ? "" : "/" + action));
+    downloader_params.additional_headers_.push_back("Content-Type: " + content_type);
+    return downloader_params;
+}
+
+
+static Metrics::Histogram &ElasticsearchRequestDurations() {
+    static Metrics::Histogram &request_durations(Metrics::GetHistogram("elasticsearch_request_duration_ns",
+                                                                       "Time spent per Elasticsearch request"));
+    return request_durations;
+}
+
+
+std::shared_ptr<JSON::ObjectNode> Elasticsearch::query(const std::string &action, const REST::QueryType query_type,
+                                                       const JSON::ObjectNode &data, const bool add_type,
+                                                       const bool suppress_index_name) const
+{
+    const Downloader::Params downloader_params(getDownloaderParams("application/json"));
+    const Url url(getQueryUrl(action, add_type, suppress_index_name));
 
-    std::shared_ptr<JSON::JSONNode> result(REST::QueryJSON(url, query_type, &data, downloader_params));
+    std::shared_ptr<JSON::JSONNode> result;
+    {
+        Metrics::ScopedTimer timer(&ElasticsearchRequestDurations());
+        result = REST::QueryJSON(url, query_type, &data, downloader_params);
+    }
     std::shared_ptr<JSON::ObjectNode> result_object(JSON::JSONNode::CastToObjectNodeOrDie("Elasticsearch result", result));
     if (result_object->hasNode("error"))
         LOG_ERROR("Elasticsearch " + action + " query failed: " + result_object->getNode("error")->toString());
 
     return result_object;
 }
+
+
+void Elasticsearch::query(const std::string &action, const REST::QueryType query_type, const JSON::ObjectNode &data,
+                          JSON::Document * const result, const bool add_type, const bool suppress_index_name) const
+{
+    const Downloader::Params downloader_params(getDownloaderParams("application/json"));
+    const Url url(getQueryUrl(action, add_type, suppress_index_name));
+
+    std::string response;
+    {
+        Metrics::ScopedTimer timer(&ElasticsearchRequestDurations());
+        response = REST::Query(url, query_type, data.toString(), downloader_params);
+    }
+    if (unlikely(not result->parse(response)))
+        LOG_ERROR("could not parse the result of an Elasticsearch " + action + " query: " + result->getErrorMessage());
+    if (unlikely(not result->getRoot().isObject()))
+        LOG_ERROR("the result of an Elasticsearch " + action + " query is not an object!");
+    const auto error(result->getRoot().find("error"));
+    if (error != nullptr)
+        LOG_ERROR("Elasticsearch " + action + " query failed: " + error->toString());
+}
+
+
+Url Elasticsearch::getQueryUrl(const std::string &action, const bool add_type, const bool suppress_index_name) const {
+    if (add_type)
+        return Url(host_ + "/" + (not suppress_index_name ? index_ + "/" : "") + type_ + (action.empty() ? "" : "/" + action));
+    else
+        return Url(host_ + (not suppress_index_name? "/" + index_ : "" ) + (action.empty() ? "" : "/" + action));
+}
+
+
+static Metrics::Counter &BulkItemsSent() {
+    static Metrics::Counter &items_sent(Metrics::GetCounter("elasticsearch_bulk_items_sent", "Items sent to the _bulk API"));
+    return items_sent;
+}
+
+
+static Metrics::Counter &BulkBytesSent() {
+    static Metrics::Counter &bytes_sent(Metrics::GetCounter("elasticsearch_bulk_bytes_sent",
+                                                            "Size of the bodies of all _bulk requests"));
+    return bytes_sent;
+}
+
+
+static Metrics::Counter &BulkRetries() {
+    static Metrics::Counter &retries(Metrics::GetCounter("elasticsearch_bulk_retries",
+                                                         "_bulk requests that were resent because of status 429"));
+    return retries;
+}
+
+
+constexpr unsigned Elasticsearch::BulkWriter::MAX_RETRY_COUNT;
+
+
+Elasticsearch::BulkWriter::BulkWriter(const Elasticsearch &elasticsearch, const size_t max_buffer_size,
+                                      const unsigned max_buffer_age, const unsigned max_concurrent_requests)
+    : elasticsearch_(elasticsearch), max_buffer_size_(max_buffer_size), max_buffer_age_(max_buffer_age),
+      downloader_(elasticsearch.getDownloaderParams("application/x-ndjson")), oldest_buffered_action_time_(0),
+      failed_item_count_(0), failed_item_count_at_last_flush_(0), pending_batch_count_(0)
+{
+    if (max_concurrent_requests <= 1)
+        return;
+
+    // At most one batch waits while all senders are busy, which bounds our memory usage and throttles the caller:
+    batch_queue_.reset(new ThreadUtil::BoundedQueue<Batch>(1));
+    for (unsigned sender_no(0); sender_no < max_concurrent_requests; ++sender_no) {
+        senders_.emplace_back([this]() {
+            Downloader downloader(elasticsearch_.getDownloaderParams("application/x-ndjson"));
+            Batch batch;
+            while (batch_queue_->pop(&batch)) {
+                sendBatch(&downloader, &batch);
+                std::lock_guard<std::mutex> pending_batch_count_locker(pending_batch_count_mutex_);
+                if (--pending_batch_count_ == 0)
+                    all_batches_sent_.notify_all();
+            }
+        });
+    }
+}
+
+
+Elasticsearch::BulkWriter::~BulkWriter() {
+    flush();
+    if (batch_queue_ != nullptr) {
+        batch_queue_->close();
+        for (auto &sender : senders_)
+            sender.join();
+    }
+}
+
+
+void Elasticsearch::BulkWriter::index(const std::map<std::string, std::string> &fields_and_values, const std::string &document_id) {
+    appendActionLine("index", document_id);
+    JSON::Writer writer(&batch_.actions_);
+    writer.beginObject();
+    for (const auto &field_and_value : fields_and_values)
+        writer.stringMember(field_and_value.first, field_and_value.second);
+    writer.endObject();
+    batch_.actions_ += '\n';
+    flushIfNecessary();
+}
+
+
+void Elasticsearch::BulkWriter::indexJSON(const std::string &json_document, const std::string &document_id) {
+    // Each source line has to be a single line of the NDJSON request body:
+    if (unlikely(json_document.find('\n') != std::string::npos))
+        LOG_ERROR("JSON documents must not contain newlines!");
+
+    appendActionLine("index", document_id);
+    batch_.actions_ += json_document;
+    batch_.actions_ += '\n';
+    flushIfNecessary();
+}
+
+
+void Elasticsearch::BulkWriter::update(const std::string &document_id, const std::map<std::string, std::string> &fields_and_values) {
+    appendActionLine("update", document_id);
+    JSON::Writer writer(&batch_.actions_);
+    writer.beginObject().key("doc").beginObject();
+    for (const auto &field_and_value : fields_and_values)
+        writer.stringMember(field_and_value.first, field_and_value.second);
+    writer.endObject().endObject();
+    batch_.actions_ += '\n';
+    flushIfNecessary();
+}
+
+
+void Elasticsearch::BulkWriter::deleteDocument(const std::string &document_id) {
+    appendActionLine("delete", document_id);
+    flushIfNecessary();
+}
+
+
+// The _bulk API expects newline-delimited JSON w/ an action line that is followed by a source line, except for deletes.
+void Elasticsearch::BulkWriter::appendActionLine(const std::string &action, const std::string &document_id) {
+    if (batch_.actions_.empty())
+        oldest_buffered_action_time_ = TimeUtil::GetCurrentTimeInMilliseconds();
+
+    batch_.item_offsets_.emplace_back(batch_.actions_.size());
+    JSON::Writer writer(&batch_.actions_);
+    writer.beginObject().key(action).beginObject();
+    if (not document_id.empty())
+        writer.stringMember("_id", document_id);
+    writer.endObject().endObject();
+    batch_.actions_ += '\n';
+}
+
+
+void Elasticsearch::BulkWriter::flushIfNecessary() {
+    if (batch_.actions_.size() >= max_buffer_size_
+        or TimeUtil::GetCurrentTimeInMilliseconds() - oldest_buffered_action_time_ >= max_buffer_age_)
+        submitBatch();
+}
+
+
+void Elasticsearch::BulkWriter::submitBatch() {
+    if (batch_.actions_.empty())
+        return;
+
+    if (batch_queue_ == nullptr)
+        sendBatch(&downloader_, &batch_);
+    else {
+        {
+            std::lock_guard<std::mutex> pending_batch_count_locker(pending_batch_count_mutex_);
+            ++pending_batch_count_;
+        }
+        batch_queue_->push(std::move(batch_)); // Blocks while all senders are busy.
+    }
+
+    batch_.actions_.clear();
+    batch_.item_offsets_.clear();
+}
+
+
+unsigned Elasticsearch::BulkWriter::flush() {
+    submitBatch();
+    if (batch_queue_ != nullptr) {
+        std::unique_lock<std::mutex> pending_batch_count_locker(pending_batch_count_mutex_);
+        all_batches_sent_.wait(pending_batch_count_locker, [this]{ return pending_batch_count_ == 0; });
+    }
+
+    const unsigned failed_item_count(failed_item_count_ - failed_item_count_at_last_flush_);
+    failed_item_count_at_last_flush_ = failed_item_count_;
+    return failed_item_count;
+}
+
+
+// Sends "batch" and, if Elasticsearch is overloaded, resends the rejected part after exponentially growing delays.
+// "batch" gets consumed in the process.
+void Elasticsearch::BulkWriter::sendBatch(Downloader * const downloader, Batch * const batch) {
+    const Url url(elasticsearch_.host_ + "/" + elasticsearch_.index_ + "/" + elasticsearch_.type_ + "/_bulk");
+    unsigned retry_delay(100); // in milliseconds
+    for (unsigned retry_count(0); /* Intentionally empty! */; ++retry_count) {
+        BulkItemsSent().increment(batch->item_offsets_.size());
+        BulkBytesSent().increment(batch->actions_.size());
+        bool success;
+        {
+            Metrics::ScopedTimer timer(&ElasticsearchRequestDurations());
+            success = downloader->postData(url, batch->actions_);
+        }
+        if (unlikely(not success))
+            LOG_ERROR("bulk request to \"" + url.toString() + "\" failed: " + downloader->getLastErrorMessage());
+
+        // Responses contain an entry for each action, so we only materialise the top-level "error" and the failed items:
+        std::vector<size_t> items_to_retry;
+        if (downloader->getResponseCode() == 429) {
+            items_to_retry.resize(batch->item_offsets_.size());
+            for (size_t item_no(0); item_no < items_to_retry.size(); ++item_no)
+                items_to_retry[item_no] = item_no;
+        } else {
+            const std::string &response(downloader->getMessageBody());
+            JSON::PullReader reader(response);
+            size_t item_no(0);
+            JSON::PullReader::EventType event;
+            while ((event = reader.next()) != JSON::PullReader::END_OF_INPUT) {
+                if (unlikely(event == JSON::PullReader::ERROR))
+                    LOG_ERROR("could not parse the response to a bulk request: " + reader.getErrorMessage());
+
+                if (event == JSON::PullReader::KEY and reader.pathMatches("/error")) {
+                    std::shared_ptr<JSON::JSONNode> error;
+                    reader.next();
+                    reader.readValue(&error);
+                    LOG_ERROR("Elasticsearch bulk request failed: "
+                              + (error == nullptr ? reader.getErrorMessage() : error->toString()));
+                } else if (event == JSON::PullReader::BOOLEAN_VALUE and reader.pathMatches("/errors") and not reader.getBoolean())
+                    break; // All actions succeeded.
+                else if (event == JSON::PullReader::START_OBJECT and reader.pathMatches("/items/*/*")) {
+                    // Each item is an object w/ a single entry whose key is the action and whose value describes the outcome.
+                    // Items are reported in the order in which the actions were sent:
+                    const std::string action(reader.getPath().substr(reader.getPath().rfind('/') + 1));
+                    std::shared_ptr<JSON::JSONNode> outcome;
+                    if (unlikely(not reader.readValue(&outcome)))
+                        LOG_ERROR("could not parse the response to a bulk request: " + reader.getErrorMessage());
+                    const auto outcome_object(JSON::JSONNode::CastToObjectNodeOrDie("bulk item outcome", outcome));
+                    if (outcome_object->hasNode("error")) {
+                        if (outcome_object->getOptionalIntegerValue("status", 0) == 429 and item_no < batch->item_offsets_.size()
+                            and retry_count < MAX_RETRY_COUNT)
+                            items_to_retry.emplace_back(item_no);
+                        else {
+                            ++failed_item_count_;
+                            LOG_WARNING("Elasticsearch bulk " + action + " failed: " + outcome_object->getNode("error")->toString());
+                        }
+                    }
+                    ++item_no;
+                }
+            }
+        }
+
+        if (items_to_retry.empty())
+            return;
+        if (unlikely(retry_count == MAX_RETRY_COUNT))
+            LOG_ERROR("Elasticsearch kept rejecting a bulk request w/ status 429 after " + std::to_string(MAX_RETRY_COUNT)
+                      + " retries!");
+
+        // Cut the rejected actions, each consisting of an action line and possibly a source line, out of the batch:
+        Batch retry_batch;
+        for (const auto item_no : items_to_retry) {
+            const size_t start(batch->item_offsets_[item_no]);
+            const size_t end(item_no + 1 < batch->item_offsets_.size() ? batch->item_offsets_[item_no + 1]
+                                                                        : batch->actions_.size());
+            retry_batch.item_offsets_.emplace_back(retry_batch.actions_.size());
+            retry_batch.actions_.append(batch->actions_, start, end - start);
+        }
+        *batch = std::move(retry_batch);
+
+        LOG_DEBUG("resending " + std::to_string(batch->item_offsets_.size()) + " item(s) in " + std::to_string(retry_delay)
+                  + " ms.");
+        BulkRetries().increment();
+        std::this_thread::sleep_for(std::chrono::milliseconds(retry_delay));
+        retry_delay = std::min(retry_delay * 2, 30000u);
+    }
+}
@@ -24,7 +24,6 @@
 #include <stdexcept>
 #include <vector>
 #include <cstdlib>
-#include <openssl/bio.h>
 #include "Compiler.h"
 #include "DnsUtil.h"
 #include "FileDescriptor.h"
@@ -46,47 +45,6 @@
 namespace {
 
 
-// For some reason we can't use the version in TextUtil even though that one also seems correct.
-std::string Base64Encode(const std::string &s) {
-    // Create BIO to perform base64 encoding:
-    BIO * const b64(::BIO_new(::BIO_f_base64()));
-    ::BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-
-    // Create BIO that holds the result:
-    BIO * const mem(::BIO_new(::BIO_s_mem()));
-
-    // Chain base64 with mem, so writing to b64 will encode base64 and write to mem:
-    ::BIO_push(b64, mem);
-
-    // Write data:
-    bool done(false);
-    while (not done) {
-        const int res(::BIO_write(b64, s.data(), s.size()));
-        if (res <= 0) {
-            if (::BIO_should_retry(b64))
-                continue;
-            else {
-                ::BIO_free_all(b64);
-                LOG_ERROR("encoding error!");
-            }
-        } else // success!
-            done = true;
-    }
-
-    BIO_flush(b64);
-
-    char *data;
-    const long len(::BIO_get_mem_data(mem, &data));
-
-    // assign data to output
-    std::string retval(data, len);
-
-    ::BIO_free_all(b64);
-
-    return retval;
-}
-
-
 bool perform_logging;
 
 
@@ -174,49 +132,6 @@ void CheckResponse(const std::string &command, const std::string &server_respons
 }
 
 
-std::string PerformExchange(const int socket_fd, const TimeLimit &time_limit, const std::string &command,
-                            const std::string &expected_response_pattern,
-                            SslConnection * const ssl_connection = nullptr)
-{
-    if (perform_logging)
-        std::clog << "In PerformExchange: sending: " << command << '\n';
-    if (unlikely(SocketUtil::TimedWrite(socket_fd, time_limit, command + "\r\n", ssl_connection) == -1))
-        throw SMTPException(523,
-                            "in PerformExchange(EmailSender.cc) SocketUtil::TimedWrite failed! (sent: " + command + ", error: "
-                            + std::string(strerror(errno)) + ")");
-
-    // Read the response:
-    ssize_t response_size;
-    char buf[1000];
-    if ((response_size = SocketUtil::TimedRead(socket_fd, time_limit, buf, sizeof(buf), ssl_connection)) <= 0)
-        throw SMTPException(524,
-                            "in PerformExchange(EmailSender.cc): Can't read SMTP server's response to \"" + command + "\"! ("
-                            + std::string(strerror(errno)) + ")");
-    buf[std::min(static_cast<size_t>(response_size), sizeof(buf) - 1)] = NUL;
-    if (perform_logging)
-        std::clog << "In PerformExchange: received: " << buf << '\n';
-    CheckResponse(command, buf, expected_response_pattern);
-    return buf;
-}
-
-
-void Authenticate(const int socket_fd, const TimeLimit &time_limit, SslConnection * const ssl_connection) {
-    std::string server_response(PerformExchange(socket_fd, time_limit, "AUTH LOGIN", "3[0-9][0-9]*", ssl_connection));
-    const std::string local_server_user(GetServerUser());
-    if (perform_logging) {
-        std::clog << "Decoded server response: " << TextUtil::Base64Decode(server_response.substr(4)) << '\n';
-        std::clog << "Sending user name: " << local_server_user << '\n';
-    }
-    server_response = PerformExchange(socket_fd, time_limit, Base64Encode(local_server_user), "3[0-9][0-9]*", ssl_connection);
-    const std::string local_server_password(GetServerPassword());
-    if (perform_logging) {
-        std::clog << "Decoded server response: " << TextUtil::Base64Decode(server_response.substr(4)) << '\n';
-        std::clog << "Sending server password: " << local_server_password << '\n';
-    }
-    PerformExchange(socket_fd, time_limit, Base64Encode(local_server_password), "2[0-9][0-9]*", ssl_connection);
-}
-
-
 std::string GetDotStuffedMessage(const std::string &message) {
     std::list<std::string> lines;
     StringUtil::SplitThenTrim(message, "\n", "\r", &lines, /* suppress_empty_words = */ false);
@@ -288,17 +203,12 @@ std::string &CreateMultiPartEmail(const EmailSender::Priority priority, const Em
         message->append("Content-Disposition: attachment; filename=\"" + FileUtil::GetBasename(attachment) + "\"\r\n");
         message->append("Content-Transfer-Encoding: base64\r\n");
         message->append("\r\n");
-        unsigned line_length(0);
-        for (const char ch : Base64Encode(data)) {
-            *message += ch;
-            ++line_length;
-            if (line_length == MAX_ENCODED_LINE_LENGTH) {
-                message->append("\r\n");
-                line_length = 0;
-            }
-        }
-        if (line_length > 0)
+        const std::string encoded_data(TextUtil::Base64Encode(data));
+        message->reserve(message->size() + encoded_data.size() + 2 * (encoded_data.size() / MAX_ENCODED_LINE_LENGTH + 1));
+        for (size_t offset(0); offset < encoded_data.size(); offset += MAX_ENCODED_LINE_LENGTH) {
+            message->append(encoded_data, offset, MAX_ENCODED_LINE_LENGTH);
             message->append("\r\n");
+        }
     }
 
     message->append("\r\n--" + BOUNDARY + "--\r\n");
@@ -346,100 +256,297 @@ bool CleanAddress(const std::string &email_address, std::string * const cleaned_
 }
 
 
-bool ProcessRecipients(const int socket_fd, const TimeLimit &time_limit, const std::vector<std::string> &recipients,
-                       SslConnection * const ssl_connection)
-{
+// Appends an "RCPT TO" command for each of "recipients" to "commands".
+bool AppendRecipientCommands(const std::vector<std::string> &recipients, std::vector<std::string> * const commands) {
     for (const auto &recipient : recipients) {
         std::string cleaned_up_email_address;
         if (unlikely(not CleanAddress(recipient, &cleaned_up_email_address)))
             return false;
-        PerformExchange(socket_fd, time_limit, "RCPT TO:<" + cleaned_up_email_address + ">", "2[0-9][0-9]*", ssl_connection);
+        commands->emplace_back("RCPT TO:<" + cleaned_up_email_address + ">");
     }
 
     return true;
 }
 
 
+const unsigned SMTP_TIME_LIMIT(20000); // ms
+
+
+// The response codes that we use to report that we lost our connection to the server.
+inline bool IsConnectionFailure(const unsigned short response_code) {
+    return response_code >= 521 and response_code <= 524;
+}
+
+
 } // unnamed namespace
 
 
 namespace EmailSender {
 
 
-unsigned short SendEmail(const std::string &sender, const std::vector<std::string> &recipients,
-                         const std::vector<std::string> &cc_recipients, const std::vector<std::string> &bcc_recipients,
-                         const std::string &subject, const std::string &message_body, const Priority priority, const Format format,
-                         const std::string &reply_to, const bool use_ssl, const bool use_authentication,
-                         const std::vector<std::string> &attachments)
-{
-    if (unlikely(sender.empty() and reply_to.empty()))
-        LOG_ERROR("both \"sender\" and \"reply_to\" can't be empty!");
-
-    const TimeLimit time_limit(20000 /* ms */);
+// A connection to our SMTP server that is ready to accept "MAIL FROM" commands.
+class Batch::Session {
+    FileDescriptor socket_fd_;
+    std::unique_ptr<SslConnection> ssl_connection_;
+    std::string read_buffer_; // Pipelined replies may arrive in a single read.
+    bool supports_pipelining_;
+    bool out_of_sync_; // Set if the server may expect something different than a command now.
+public:
+    /** \throws SMTPException if we failed to connect or authenticate. */
+    Session(const TimeLimit &time_limit, const bool use_ssl, const bool use_authentication);
+
+    /** \brief Says goodbye to the server. */
+    ~Session();
+
+    inline bool outOfSync() const { return out_of_sync_; }
+
+    /** \brief Sends a single command and checks the reply against "expected_reply_pattern".
+     *  \throws SMTPException if the reply did not match or if the server couldn't be talked to.
+     */
+    std::string performExchange(const TimeLimit &time_limit, const std::string &command, const std::string &expected_reply_pattern);
+
+    /** \brief Sends "commands" and checks that all replies match "expected_reply_pattern" except for the last one which has
+     *         to match "expected_last_reply_pattern".  If the server supports it, the commands will be pipelined.
+     *  \throws SMTPException for the first bad reply, but only after all replies have been read.
+     */
+    void performExchanges(const TimeLimit &time_limit, const std::vector<std::string> &commands,
+                          const std::string &expected_reply_pattern, const std::string &expected_last_reply_pattern);
+private:
+    void authenticate(const TimeLimit &time_limit);
+    void sendCommands(const TimeLimit &time_limit, const std::string &commands);
+    std::string readReply(const TimeLimit &time_limit, const std::string &command);
+};
 
-    perform_logging = not MiscUtil::SafeGetEnv("ENABLE_SMPT_CLIENT_PERFORM_LOGGING").empty();
 
-    // Open connection:
+Batch::Session::Session(const TimeLimit &time_limit, const bool use_ssl, const bool use_authentication)
+    : supports_pipelining_(false), out_of_sync_(false)
+{
     const unsigned short PORT(587);
     std::string error_message;
-    const FileDescriptor socket_fd(
-        SocketUtil::TcpConnect(GetSmtpServer(), PORT, time_limit, &error_message, SocketUtil::DISABLE_NAGLE));
-    if (socket_fd == -1) {
+    socket_fd_ = SocketUtil::TcpConnect(GetSmtpServer(), PORT, time_limit, &error_message, SocketUtil::DISABLE_NAGLE);
+    if (socket_fd_ == -1) {
         LOG_WARNING("can't connect to SMTP server \"" + GetSmtpServer() + ":" + std::to_string(PORT) + " (" + error_message + ")!");
-        return 521;
+        throw SMTPException(521, "in EmailSender::Batch::Session::Session: can't connect to the SMTP server!");
     }
 
     // Read the welcome message:
-    char buf[1000];
-    ssize_t response_size;
-    if ((response_size = SocketUtil::TimedRead(socket_fd, time_limit, buf, sizeof(buf))) <= 0) {
+    try {
+        readReply(time_limit, "");
+    } catch (const SMTPException &smtp_exception) {
         LOG_WARNING("can't read SMTP server's welcome message!");
-        return 522;
+        throw SMTPException(522, smtp_exception.getDescription());
     }
-    if (perform_logging) {
-        buf[std::min(static_cast<size_t>(response_size), sizeof(buf) - 1)] = NUL;
-        std::clog << "Server sent: " << buf << '\n';
+
+    std::string ehlo_reply(performExchange(time_limit, "EHLO " + DnsUtil::GetHostname(), "2[0-9][0-9]*"));
+    if (use_ssl) {
+        performExchange(time_limit, "STARTTLS", "2[0-9][0-9]*");
+        ssl_connection_.reset(new SslConnection(socket_fd_));
+
+        // The capabilities may have changed now that we have switched to TLS:
+        ehlo_reply = performExchange(time_limit, "EHLO " + DnsUtil::GetHostname(), "2[0-9][0-9]*");
     }
+    supports_pipelining_ = ehlo_reply.find("PIPELINING") != std::string::npos;
+
+    if (use_authentication)
+        authenticate(time_limit);
+}
+
+
+Batch::Session::~Session() {
+    if (out_of_sync_)
+        return;
 
     try {
-        PerformExchange(socket_fd, time_limit, "EHLO " + DnsUtil::GetHostname(), "2[0-9][0-9]*");
+        performExchange(SMTP_TIME_LIMIT, "QUIT", "2[0-9][0-9]*");
+    } catch (const SMTPException &smtp_exception) {
+        if (perform_logging)
+            std::clog << smtp_exception.getDescription() << '\n';
+    }
+}
+
 
-        std::unique_ptr<SslConnection> ssl_connection;
-        if (use_ssl) {
-            PerformExchange(socket_fd, time_limit, "STARTTLS", "2[0-9][0-9]*");
-            ssl_connection.reset(new SslConnection(socket_fd));
+std::string Batch::Session::performExchange(const TimeLimit &time_limit, const std::string &command,
+                                            const std::string &expected_reply_pattern)
+{
+    sendCommands(time_limit, command + "\r\n");
+    const std::string reply(readReply(time_limit, command));
+    CheckResponse(command, reply, expected_reply_pattern);
+    return reply;
+}
+
+
+void Batch::Session::performExchanges(const TimeLimit &time_limit, const std::vector<std::string> &commands,
+                                      const std::string &expected_reply_pattern, const std::string &expected_last_reply_pattern)
+{
+    if (not supports_pipelining_) {
+        for (auto command(commands.cbegin()); command != commands.cend(); ++command)
+            performExchange(time_limit, *command, (command + 1 == commands.cend()) ? expected_last_reply_pattern
+                                                                                   : expected_reply_pattern);
+        return;
+    }
+
+    std::string pipelined_commands;
+    for (const auto &command : commands)
+        pipelined_commands += command + "\r\n";
+    sendCommands(time_limit, pipelined_commands);
+
+    std::unique_ptr<SMTPException> first_smtp_exception;
+    for (auto command(commands.cbegin()); command != commands.cend(); ++command) {
+        const std::string reply(readReply(time_limit, *command));
+        try {
+            CheckResponse(*command, reply, (command + 1 == commands.cend()) ? expected_last_reply_pattern : expected_reply_pattern);
+        } catch (const SMTPException &smtp_exception) {
+            if (first_smtp_exception == nullptr)
+                first_smtp_exception.reset(new SMTPException(smtp_exception));
+            continue;
         }
 
-        PerformExchange(socket_fd, time_limit, "EHLO " + DnsUtil::GetHostname(), "2[0-9][0-9]*", ssl_connection.get());
+        // E.g. a "DATA" that has been accepted after a rejected "RCPT TO" leaves the server waiting for a message that we
+        // won't send:
+        if (first_smtp_exception != nullptr and command + 1 == commands.cend())
+            out_of_sync_ = true;
+    }
 
-        if (use_authentication)
-            Authenticate(socket_fd, time_limit, ssl_connection.get());
+    if (first_smtp_exception != nullptr)
+        throw *first_smtp_exception;
+}
 
-        PerformExchange(socket_fd, time_limit, "MAIL FROM:<" + sender + ">", "2[0-9][0-9]*", ssl_connection.get());
 
-        // Send email to each recipient:
-        if (unlikely(recipients.empty() and cc_recipients.empty() and bcc_recipients.empty()))
-            return false;
-        if (unlikely(not ProcessRecipients(socket_fd, time_limit, recipients, ssl_connection.get())))
-            return false;
-        if (unlikely(not ProcessRecipients(socket_fd, time_limit, cc_recipients, ssl_connection.get())))
-            return false;
-        if (unlikely(not ProcessRecipients(socket_fd, time_limit, bcc_recipients, ssl_connection.get())))
-            return false;
+void Batch::Session::authenticate(const TimeLimit &time_limit) {
+    std::string server_response(performExchange(time_limit, "AUTH LOGIN", "3[0-9][0-9]*"));
+    const std::string local_server_user(GetServerUser());
+    if (perform_logging) {
+        std::clog << "Decoded server response: " << TextUtil::Base64Decode(server_response.substr(4)) << '\n';
+        std::clog << "Sending user name: " << local_server_user << '\n';
+    }
+    server_response = performExchange(time_limit, TextUtil::Base64Encode(local_server_user), "3[0-9][0-9]*");
+    const std::string local_server_password(GetServerPassword());
+    if (perform_logging) {
+        std::clog << "Decoded server response: " << TextUtil::Base64Decode(server_response.substr(4)) << '\n';
+        std::clog << "Sending server password: " << local_server_password << '\n';
+    }
+    performExchange(time_limit, TextUtil::Base64Encode(local_server_password), "2[0-9][0-9]*");
+}
 
-        PerformExchange(socket_fd, time_limit, "DATA", "3[0-9][0-9]*", ssl_connection.get());
-        PerformExchange(socket_fd, time_limit,
-                        CreateEmailMessage(priority, format, sender, recipients, cc_recipients, bcc_recipients, subject,
-                                           message_body, attachments),
-                        "2[0-9][0-9]*", ssl_connection.get());
-        PerformExchange(socket_fd, time_limit, "QUIT", "2[0-9][0-9]*", ssl_connection.get());
-    } catch (const SMTPException &smtp_exception) {
-        if (perform_logging)
-            std::clog << smtp_exception.getDescription() << '\n';
-        return smtp_exception.getResponseCode();
+
+void Batch::Session::sendCommands(const TimeLimit &time_limit, const std::string &commands) {
+    if (perform_logging)
+        std::clog << "In EmailSender::Batch::Session::sendCommands: sending: " << commands << '\n';
+    if (unlikely(SocketUtil::TimedWrite(socket_fd_, time_limit, commands, ssl_connection_.get()) == -1)) {
+        out_of_sync_ = true;
+        throw SMTPException(523,
+                            "in EmailSender::Batch::Session::sendCommands: SocketUtil::TimedWrite failed! (sent: " + commands
+                            + ", error: " + std::string(strerror(errno)) + ")");
     }
+}
+
 
-    return 200;
+// A reply is complete once we have seen a line where the reply code is not followed by a hyphen, see RFC 5321, section 4.2.1.
+std::string Batch::Session::readReply(const TimeLimit &time_limit, const std::string &command) {
+    for (;;) {
+        size_t line_start(0), line_end;
+        while ((line_end = read_buffer_.find('\n', line_start)) != std::string::npos) {
+            if (line_end - line_start < 4 or read_buffer_[line_start + 3] != '-') {
+                const std::string reply(read_buffer_.substr(0, line_end + 1));
+                read_buffer_.erase(0, line_end + 1);
+                if (perform_logging)
+                    std::clog << "In EmailSender::Batch::Session::readReply: received: " << reply << '\n';
+                return reply;
+            }
+            line_start = line_end + 1;
+        }
+
+        char buf[1000];
+        const ssize_t response_size(SocketUtil::TimedRead(socket_fd_, time_limit, buf, sizeof(buf), ssl_connection_.get()));
+        if (response_size <= 0) {
+            out_of_sync_ = true;
+            throw SMTPException(524,
+                                "in EmailSender::Batch::Session::readReply: Can't read SMTP server's response to \"" + command
+                                + "\"! (" + std::string(strerror(errno)) + ")");
+        }
+        read_buffer_.append(buf, response_size);
+    }
+}
+
+
+Batch::Batch(const bool use_ssl, const bool use_authentication)
+    : use_ssl_(use_ssl), use_authentication_(use_authentication) { }
+
+
+Batch::~Batch() = default;
+
+
+unsigned short Batch::sendEmail(const std::string &sender, const std::vector<std::string> &recipients,
+                                const std::vector<std::string> &cc_recipients, const std::vector<std::string> &bcc_recipients,
+                                const std::string &subject, const std::string &message_body, const Priority priority,
+                                const Format format, const std::string &reply_to, const std::vector<std::string> &attachments)
+{
+    if (unlikely(sender.empty() and reply_to.empty()))
+        LOG_ERROR("both \"sender\" and \"reply_to\" can't be empty!");
+
+    perform_logging = not MiscUtil::SafeGetEnv("ENABLE_SMPT_CLIENT_PERFORM_LOGGING").empty();
+
+    // Send email to each recipient:
+    if (unlikely(recipients.empty() and cc_recipients.empty() and bcc_recipients.empty()))
+        return false;
+    std::vector<std::string> commands{ "MAIL FROM:<" + sender + ">" };
+    if (unlikely(not AppendRecipientCommands(recipients, &commands)))
+        return false;
+    if (unlikely(not AppendRecipientCommands(cc_recipients, &commands)))
+        return false;
+    if (unlikely(not AppendRecipientCommands(bcc_recipients, &commands)))
+        return false;
+    commands.emplace_back("DATA");
+
+    const std::string message(CreateEmailMessage(priority, format, sender, recipients, cc_recipients, bcc_recipients, subject,
+                                                 message_body, attachments));
+
+    // If we reuse a session the server may have dropped the connection in the meantime, in which case we try again once
+    // with a new session:
+    for (;;) {
+        const bool reusing_session(session_ != nullptr);
+        const TimeLimit time_limit(SMTP_TIME_LIMIT);
+        try {
+            if (session_ == nullptr)
+                session_.reset(new Session(time_limit, use_ssl_, use_authentication_));
+            session_->performExchanges(time_limit, commands, "2[0-9][0-9]*", "3[0-9][0-9]*");
+            session_->performExchange(time_limit, message, "2[0-9][0-9]*");
+            return 200;
+        } catch (const SMTPException &smtp_exception) {
+            if (perform_logging)
+                std::clog << smtp_exception.getDescription() << '\n';
+
+            if (IsConnectionFailure(smtp_exception.getResponseCode())) {
+                session_.reset();
+                if (reusing_session)
+                    continue;
+            } else if (session_ != nullptr) {
+                // Abort the current mail transaction so that the session can be used for the next message:
+                try {
+                    if (session_->outOfSync())
+                        session_.reset();
+                    else
+                        session_->performExchange(time_limit, "RSET", "2[0-9][0-9]*");
+                } catch (const SMTPException &) {
+                    session_.reset();
+                }
+            }
+
+            return smtp_exception.getResponseCode();
+        }
+    }
+}
+
+
+unsigned short SendEmail(const std::string &sender, const std::vector<std::string> &recipients,
+                         const std::vector<std::string> &cc_recipients, const std::vector<std::string> &bcc_recipients,
+                         const std::string &subject, const std::string &message_body, const Priority priority, const Format format,
+                         const std::string &reply_to, const bool use_ssl, const bool use_authentication,
+                         const std::vector<std::string> &attachments)
+{
+    Batch batch(use_ssl, use_authentication);
+    return batch.sendEmail(sender, recipients, cc_recipients, bcc_recipients, subject, message_body, priority, format, reply_to,
+                           attachments);
 }
 
 
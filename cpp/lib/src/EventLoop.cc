@@ -0,0 +1,445 @@
+/** \brief Implementation of the EventLoop and AsyncTcpConnection classes.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "EventLoop.h"
+#include <stdexcept>
+#include <cerrno>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "SocketUtil.h"
+#include "SslConnection.h"
+#include "util.h"
+
+
+namespace {
+
+
+// Marks the events of our timer file descriptor.  Registered file descriptors use their serial number in the upper and
+// the file descriptor in the lower half.
+const uint64_t TIMER_FD_DATA(UINT64_MAX);
+
+const uint64_t NOT_ARMED(UINT64_MAX);
+
+
+inline uint64_t GetMonotonicMicroseconds() {
+    timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000u + now.tv_nsec / 1000u;
+}
+
+
+} // unnamed namespace
+
+
+EventLoop::EventLoop(): next_serial_number_(0), next_timer_id_(1), armed_deadline_(NOT_ARMED), stopped_(false) {
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (unlikely(epoll_fd_ == -1))
+        LOG_ERROR("epoll_create1(2) failed!");
+
+    timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (unlikely(timer_fd_ == -1))
+        LOG_ERROR("timerfd_create(2) failed!");
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = TIMER_FD_DATA;
+    if (unlikely(::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event) == -1))
+        LOG_ERROR("failed to add the timer file descriptor!");
+}
+
+
+EventLoop::~EventLoop() {
+    ::close(timer_fd_);
+    ::close(epoll_fd_);
+}
+
+
+void EventLoop::addFd(const int fd, const uint32_t events, const IoHandler &handler) {
+    const uint32_t serial_number(next_serial_number_++);
+    if (unlikely(not fds_to_registrations_.emplace(fd, Registration{ serial_number, std::make_shared<IoHandler>(handler) })
+                     .second))
+        LOG_ERROR("file descriptor " + std::to_string(fd) + " has already been added!");
+
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = (static_cast<uint64_t>(serial_number) << 32u) | static_cast<uint32_t>(fd);
+    if (unlikely(::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1))
+        LOG_ERROR("epoll_ctl(2) failed to add file descriptor " + std::to_string(fd) + "!");
+}
+
+
+void EventLoop::modifyFd(const int fd, const uint32_t events) {
+    const auto fd_and_registration(fds_to_registrations_.find(fd));
+    if (unlikely(fd_and_registration == fds_to_registrations_.end()))
+        LOG_ERROR("file descriptor " + std::to_string(fd) + " has not been added!");
+
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = (static_cast<uint64_t>(fd_and_registration->second.serial_number_) << 32u) | static_cast<uint32_t>(fd);
+    if (unlikely(::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == -1))
+        LOG_ERROR("epoll_ctl(2) failed to modify file descriptor " + std::to_string(fd) + "!");
+}
+
+
+void EventLoop::removeFd(const int fd) {
+    if (unlikely(fds_to_registrations_.erase(fd) == 0))
+        LOG_ERROR("file descriptor " + std::to_string(fd) + " has not been added!");
+    if (unlikely(::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) == -1))
+        LOG_ERROR("epoll_ctl(2) failed to remove file descriptor " + std::to_string(fd) + "!");
+}
+
+
+EventLoop::TimerId EventLoop::addTimer(const unsigned delay, const TimerHandler &handler) {
+    const uint64_t deadline(GetMonotonicMicroseconds() + delay * UINT64_C(1000));
+    const TimerId timer_id(next_timer_id_++);
+    timer_queue_.emplace(deadline, timer_id);
+    ids_to_timers_.emplace(timer_id, std::make_pair(deadline, handler));
+    if (deadline < armed_deadline_)
+        armTimerFd();
+
+    return timer_id;
+}
+
+
+bool EventLoop::cancelTimer(const TimerId timer_id) {
+    const auto id_and_timer(ids_to_timers_.find(timer_id));
+    if (id_and_timer == ids_to_timers_.end())
+        return false;
+
+    // We don't bother to rearm the timer file descriptor.  At worst we'll wake up once for nothing.
+    timer_queue_.erase(std::make_pair(id_and_timer->second.first, timer_id));
+    ids_to_timers_.erase(id_and_timer);
+    return true;
+}
+
+
+void EventLoop::run() {
+    stopped_ = false;
+    while (not stopped_ and runOnce())
+        /* Intentionally empty! */;
+}
+
+
+bool EventLoop::runOnce(const int timeout) {
+    if (fds_to_registrations_.empty() and ids_to_timers_.empty())
+        return false;
+
+    const int MAX_EVENT_COUNT(256);
+    epoll_event events[MAX_EVENT_COUNT];
+    const int event_count(::epoll_wait(epoll_fd_, events, MAX_EVENT_COUNT, timeout));
+    if (unlikely(event_count == -1)) {
+        if (errno == EINTR)
+            return true;
+        LOG_ERROR("epoll_wait(2) failed!");
+    }
+
+    for (int event_no(0); event_no < event_count; ++event_no) {
+        if (events[event_no].data.u64 == TIMER_FD_DATA) {
+            uint64_t expiration_count;
+            if (::read(timer_fd_, &expiration_count, sizeof(expiration_count)) == sizeof(expiration_count))
+                armed_deadline_ = NOT_ARMED;
+            continue;
+        }
+
+        // A handler that ran earlier in this round may have removed the file descriptor or even closed it and added a
+        // new one w/ the same number:
+        const int fd(static_cast<int>(events[event_no].data.u64 & UINT32_MAX));
+        const auto fd_and_registration(fds_to_registrations_.find(fd));
+        if (fd_and_registration == fds_to_registrations_.end()
+            or fd_and_registration->second.serial_number_ != events[event_no].data.u64 >> 32u)
+            continue;
+
+        const std::shared_ptr<IoHandler> handler(fd_and_registration->second.handler_); // Survives a removeFd(fd).
+        (*handler)(events[event_no].events);
+    }
+
+    processExpiredTimers();
+    return true;
+}
+
+
+void EventLoop::processExpiredTimers() {
+    const uint64_t now(GetMonotonicMicroseconds());
+    while (not timer_queue_.empty() and timer_queue_.cbegin()->first <= now) {
+        const TimerId timer_id(timer_queue_.cbegin()->second);
+        timer_queue_.erase(timer_queue_.cbegin());
+        const auto id_and_timer(ids_to_timers_.find(timer_id));
+        const TimerHandler handler(std::move(id_and_timer->second.second));
+        ids_to_timers_.erase(id_and_timer);
+        handler();
+    }
+
+    armTimerFd();
+}
+
+
+void EventLoop::armTimerFd() {
+    const uint64_t deadline(timer_queue_.empty() ? NOT_ARMED : timer_queue_.cbegin()->first);
+    if (deadline == armed_deadline_)
+        return;
+
+    itimerspec timer_spec = {};
+    if (deadline != NOT_ARMED) {
+        timer_spec.it_value.tv_sec = deadline / 1000000u;
+        timer_spec.it_value.tv_nsec = (deadline % 1000000u) * 1000u;
+    }
+    if (unlikely(::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &timer_spec, nullptr) == -1))
+        LOG_ERROR("timerfd_settime(2) failed!");
+    armed_deadline_ = deadline;
+}
+
+
+AsyncTcpConnection::AsyncTcpConnection(EventLoop * const event_loop, const OpenHandler &open_handler,
+                                       const DataHandler &data_handler, const CloseHandler &close_handler)
+    : event_loop_(event_loop), open_handler_(open_handler), data_handler_(data_handler), close_handler_(close_handler),
+      state_(IDLE), use_tls_(false), fd_(-1), watched_events_(0), timeout_timer_id_(0), output_buffer_start_(0)
+{
+}
+
+
+AsyncTcpConnection::~AsyncTcpConnection() {
+    close();
+}
+
+
+void AsyncTcpConnection::connect(const in_addr_t address, const unsigned short port, const bool use_tls,
+                                 const unsigned time_limit)
+{
+    if (unlikely(state_ != IDLE))
+        LOG_ERROR("connect() must only be called once!");
+
+    state_ = CONNECTING;
+    use_tls_ = use_tls;
+
+    // We buffer our output ourselves, so there's no point in delaying partial packets:
+    std::string error_message;
+    fd_ = SocketUtil::NonblockingTcpConnect(address, port, &error_message, SocketUtil::DISABLE_NAGLE);
+    if (fd_ == -1) {
+        timeout_timer_id_ = event_loop_->addTimer(0, [this, error_message]() { timeout_timer_id_ = 0; fail(error_message); });
+        return;
+    }
+
+    watched_events_ = EPOLLOUT;
+    event_loop_->addFd(fd_, watched_events_, [this](const uint32_t events) { processEvents(events); });
+    timeout_timer_id_ = event_loop_->addTimer(time_limit, [this]() {
+        timeout_timer_id_ = 0;
+        fail(state_ == CONNECTING ? "connect timed out!" : "TLS handshake timed out!");
+    });
+}
+
+
+void AsyncTcpConnection::write(const char * const data, const size_t size) {
+    if (unlikely(state_ == CLOSED))
+        LOG_ERROR("attempt to write to a closed connection!");
+
+    const bool was_empty(getPendingOutputSize() == 0);
+    output_buffer_.append(data, size);
+    if (state_ == OPEN and was_empty)
+        flushOutput();
+}
+
+
+void AsyncTcpConnection::close() {
+    if (state_ == CLOSED)
+        return;
+
+    if (timeout_timer_id_ != 0) {
+        event_loop_->cancelTimer(timeout_timer_id_);
+        timeout_timer_id_ = 0;
+    }
+    ssl_connection_.reset();
+    if (fd_ != -1) {
+        event_loop_->removeFd(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    state_ = CLOSED;
+}
+
+
+void AsyncTcpConnection::processEvents(const uint32_t events) {
+    switch (state_) {
+    case CONNECTING: {
+        const int error(SocketUtil::GetPendingError(fd_));
+        if (error != 0) {
+            fail("connect(2) failed (" + std::to_string(error) + ")!");
+            return;
+        }
+        if (not (events & EPOLLOUT))
+            return;
+
+        if (not use_tls_) {
+            opened();
+            return;
+        }
+
+        try {
+            ssl_connection_.reset(new SslConnection(fd_, SslConnection::ALL_STREAM_METHODS, SslConnection::CLIENT,
+                                                    SslConnection::DO_NOT_SUPPORT_MULTITHREADING,
+                                                    SslConnection::NONBLOCKING_HANDSHAKE));
+        } catch (const std::exception &x) {
+            fail(x.what());
+            return;
+        }
+        state_ = HANDSHAKING;
+        continueHandshake();
+        return;
+    }
+    case HANDSHAKING:
+        continueHandshake();
+        return;
+    case OPEN:
+        // TLS may have to read in order to write and vice versa, so we try both if we have a TLS connection:
+        if (use_tls_ or (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            readAvailableData();
+        if (state_ == OPEN and getPendingOutputSize() > 0 and (use_tls_ or (events & EPOLLOUT)))
+            flushOutput();
+        return;
+    default:
+        return;
+    }
+}
+
+
+void AsyncTcpConnection::continueHandshake() {
+    switch (ssl_connection_->handshake()) {
+    case 1:
+        opened();
+        return;
+    case 0:
+        watchEvents(ssl_connection_->getLastErrorCode() == SSL_ERROR_WANT_READ ? EPOLLIN : EPOLLOUT);
+        return;
+    default:
+        fail("TLS handshake failed (" + std::to_string(ssl_connection_->getLastErrorCode()) + ")!");
+    }
+}
+
+
+void AsyncTcpConnection::opened() {
+    state_ = OPEN;
+    if (timeout_timer_id_ != 0) {
+        event_loop_->cancelTimer(timeout_timer_id_);
+        timeout_timer_id_ = 0;
+    }
+    watchEvents(EPOLLIN);
+
+    if (getPendingOutputSize() > 0)
+        flushOutput();
+    if (state_ == OPEN and open_handler_)
+        open_handler_(this);
+
+    // The handshake may have left decrypted data in OpenSSL's buffers which epoll(7) knows nothing about:
+    if (state_ == OPEN and use_tls_)
+        readAvailableData();
+}
+
+
+void AsyncTcpConnection::readAvailableData() {
+    char buffer[16384];
+    for (;;) {
+        ssize_t read_count;
+        if (use_tls_) {
+            read_count = ssl_connection_->read(buffer, sizeof(buffer));
+            if (read_count <= 0) {
+                const int error_code(ssl_connection_->getLastErrorCode());
+                if (error_code == SSL_ERROR_WANT_READ)
+                    return;
+                if (error_code == SSL_ERROR_WANT_WRITE) {
+                    watchEvents(EPOLLIN | EPOLLOUT);
+                    return;
+                }
+                fail(error_code == SSL_ERROR_ZERO_RETURN ? "" : "SSL_read failed (" + std::to_string(error_code) + ")!");
+                return;
+            }
+        } else {
+            read_count = ::read(fd_, buffer, sizeof(buffer));
+            if (read_count == 0) {
+                fail("");
+                return;
+            }
+            if (read_count < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN and errno != EWOULDBLOCK)
+                    fail("read(2) failed (" + std::to_string(errno) + ")!");
+                return;
+            }
+        }
+
+        if (data_handler_)
+            data_handler_(this, buffer, static_cast<size_t>(read_count));
+        if (state_ != OPEN)
+            return;
+
+        // W/o TLS a short read means that the socket has been drained, so we can save ourselves another system call:
+        if (not use_tls_ and static_cast<size_t>(read_count) < sizeof(buffer))
+            return;
+    }
+}
+
+
+void AsyncTcpConnection::flushOutput() {
+    while (getPendingOutputSize() > 0) {
+        ssize_t write_count;
+        if (use_tls_) {
+            write_count = ssl_connection_->write(output_buffer_.data() + output_buffer_start_, getPendingOutputSize());
+            if (write_count <= 0) {
+                const int error_code(ssl_connection_->getLastErrorCode());
+                if (error_code == SSL_ERROR_WANT_READ or error_code == SSL_ERROR_WANT_WRITE)
+                    watchEvents(EPOLLIN | EPOLLOUT);
+                else
+                    fail("SSL_write failed (" + std::to_string(error_code) + ")!");
+                return;
+            }
+        } else {
+            write_count = ::send(fd_, output_buffer_.data() + output_buffer_start_, getPendingOutputSize(), MSG_NOSIGNAL);
+            if (write_count < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN or errno == EWOULDBLOCK)
+                    watchEvents(EPOLLIN | EPOLLOUT);
+                else
+                    fail("send(2) failed (" + std::to_string(errno) + ")!");
+                return;
+            }
+        }
+        output_buffer_start_ += write_count;
+    }
+
+    output_buffer_.clear();
+    output_buffer_start_ = 0;
+    watchEvents(EPOLLIN);
+}
+
+
+void AsyncTcpConnection::watchEvents(const uint32_t events) {
+    if (events != watched_events_) {
+        event_loop_->modifyFd(fd_, events);
+        watched_events_ = events;
+    }
+}
+
+
+void AsyncTcpConnection::fail(const std::string &error_message) {
+    close();
+    if (close_handler_)
+        close_handler_(this, error_message);
+}
@@ -26,6 +26,7 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "ExecUtil.h"
+#include <algorithm>
 #include <stdexcept>
 #include <cassert>
 #include <cerrno>
@@ -34,6 +35,7 @@
 #include <cstring>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -43,21 +45,33 @@
 #include "FileUtil.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
+#include "TimeLimit.h"
 #include "util.h"
 
 
 namespace {
 
 
-// The following variables are set in Execute.
-static bool alarm_went_off;
-pid_t child_pid;
-
-
-// SigAlarmHandler -- Used by Execute.
-//
-void SigAlarmHandler(int /* sig_no */) {
-    alarm_went_off = true;
+// Waits for "pid" to exit for at most "timeout_in_seconds" seconds.
+// \return True if the child exited in time, o/w false.
+// \note   We poll instead of using alarm(2) because there is only one alarm clock per process and we need to support
+//         concurrent calls from multiple threads.
+bool WaitWithTimeout(const pid_t pid, const unsigned timeout_in_seconds, int * const child_exit_status) {
+    const TimeLimit time_limit(timeout_in_seconds * 1000);
+    unsigned sleep_interval(1); // in ms
+    for (;;) {
+        const pid_t wait_retval(::waitpid(pid, child_exit_status, WNOHANG));
+        if (wait_retval == pid)
+            return true;
+        if (unlikely(wait_retval == -1 and errno != EINTR))
+            throw std::runtime_error("in ExecUtil::WaitWithTimeout: waitpid(2) failed: " + std::string(std::strerror(errno)));
+
+        if (time_limit.limitExceeded())
+            return false;
+        ::usleep(std::min(sleep_interval, time_limit.getRemainingTime()) * 1000);
+        if (sleep_interval < 100)
+            sleep_interval *= 2;
+    }
 }
 
 
@@ -73,131 +87,170 @@ enum class ExecMode {
 };
 
 
-int Exec(const std::string &command, const std::vector<std::string> &args, const std::string &new_stdin, const std::string &new_stdout,
-         const std::string &new_stderr, const ExecMode exec_mode, unsigned timeout_in_seconds, const int tardy_child_signal,
-         const std::unordered_map<std::string, std::string> &envs)
+const int EXECVE_FAILURE(248);
+
+
+// \return Our own environment w/ the entries of "envs" added or replacing existing entries of the same name.
+std::vector<std::string> BuildChildEnvironment(const std::unordered_map<std::string, std::string> &envs) {
+    std::vector<std::string> child_environment;
+    for (char **entry(::environ); *entry != nullptr; ++entry) {
+        const char * const equal_sign(std::strchr(*entry, '='));
+        if (equal_sign == nullptr or envs.find(std::string(*entry, equal_sign - *entry)) == envs.cend())
+            child_environment.emplace_back(*entry);
+    }
+    for (const auto &env : envs)
+        child_environment.emplace_back(env.first + "=" + env.second);
+
+    return child_environment;
+}
+
+
+// \return A nullptr-terminated array suitable for execve(2) and posix_spawn(3).  The pointers are only valid as long as
+//         "strings" is neither modified nor destroyed.
+std::vector<char *> MakeCStringArray(const std::vector<std::string> &strings) {
+    std::vector<char *> c_strings;
+    c_strings.reserve(strings.size() + 1);
+    for (const auto &string : strings)
+        c_strings.emplace_back(const_cast<char *>(string.c_str()));
+    c_strings.emplace_back(nullptr);
+
+    return c_strings;
+}
+
+
+#ifdef POSIX_SPAWN_SETSID
+
+
+// Unlike fork(2), posix_spawn(3) does not have to copy our page tables, which makes a huge difference for processes w/ a
+// large resident set.  Failures in the child, e.g. if a redirection target can't be opened, are reported to us by the
+// return value of posix_spawn(3).
+pid_t StartChild(const std::string &command, char * const argv[], char * const envp[], const std::string &new_stdin,
+                 const std::string &new_stdout, const std::string &new_stderr)
 {
-    errno = 0;
-    if (::access(command.c_str(), X_OK) != 0)
-        throw std::runtime_error("in ExecUtil::Exec: can't execute \"" + command + "\"!");
+    posix_spawn_file_actions_t file_actions;
+    ::posix_spawn_file_actions_init(&file_actions);
+    if (not new_stdin.empty())
+        ::posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, new_stdin.c_str(), O_RDONLY, 0);
+    if (not new_stdout.empty())
+        ::posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, new_stdout.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (not new_stderr.empty())
+        ::posix_spawn_file_actions_addopen(&file_actions, STDERR_FILENO, new_stderr.c_str(), O_WRONLY | O_CREAT, 0644);
+
+    // Make the child the leader of a new session and thereby of a new process group:
+    posix_spawnattr_t attributes;
+    ::posix_spawnattr_init(&attributes);
+    ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID);
+
+    pid_t pid;
+    const int error_code(::posix_spawn(&pid, command.c_str(), &file_actions, &attributes, argv, envp));
+    ::posix_spawnattr_destroy(&attributes);
+    ::posix_spawn_file_actions_destroy(&file_actions);
+    if (unlikely(error_code != 0))
+        throw std::runtime_error("in ExecUtil::Exec: posix_spawn(3) failed for \"" + command + "\": "
+                                 + std::string(std::strerror(error_code)));
+
+    return pid;
+}
 
-    if (exec_mode == ExecMode::DETACH and timeout_in_seconds > 0)
-        throw std::runtime_error("in ExecUtil::Exec: non-zero timeout is incompatible w/ ExecMode::DETACH!");
 
-    const int EXECVE_FAILURE(248);
+#else // Our C library can't create a new session for us so we have to do it ourselves.
+
+
+bool RedirectFileDescriptor(const std::string &path, const int flags, const int target_fd) {
+    const int new_fd(::open(path.c_str(), flags, 0644));
+    if (new_fd == -1)
+        return false;
+    if (::dup2(new_fd, target_fd) == -1)
+        return false;
+    ::close(new_fd);
+    return true;
+}
+
 
-    const pid_t pid = ::fork();
+pid_t StartChild(const std::string &command, char * const argv[], char * const envp[], const std::string &new_stdin,
+                 const std::string &new_stdout, const std::string &new_stderr)
+{
+    const pid_t pid(::fork());
     if (pid == -1)
         throw std::runtime_error("in Exec: ::fork() failed: " + std::to_string(errno) + "!");
 
-    // The child process:
-    else if (pid == 0) {
+    // The child process.  Only async-signal-safe functions may be called here, which is why "argv" and "envp" have
+    // been prepared by our parent.
+    if (pid == 0) {
         // Make us the leader of a new process group:
         if (::setsid() == static_cast<pid_t>(-1))
-            logger->error("in Exec(): child failed to become a new session leader!");
-
-        if (not new_stdin.empty()) {
-            const int new_stdin_fd(::open(new_stdin.c_str(), O_RDONLY));
-            if (new_stdin_fd == -1)
-                ::_exit(-1);
-            if (::dup2(new_stdin_fd, STDIN_FILENO) == -1)
-                ::_exit(-1);
-            ::close(new_stdin_fd);
-        }
-
-        if (not new_stdout.empty()) {
-            const int new_stdout_fd(::open(new_stdout.c_str(), O_WRONLY | O_CREAT, 0644));
-            if (new_stdout_fd == -1)
-                ::_exit(-1);
-            if (::dup2(new_stdout_fd, STDOUT_FILENO) == -1)
-                ::_exit(-1);
-            ::close(new_stdout_fd);
-        }
-
-        if (not new_stderr.empty()) {
-            const int new_stderr_fd(::open(new_stderr.c_str(), O_WRONLY | O_CREAT, 0644));
-            if (new_stderr_fd == -1)
-                ::_exit(-1);
-            if (::dup2(new_stderr_fd, STDERR_FILENO) == -1)
-                ::_exit(-1);
-            ::close(new_stderr_fd);
-        }
+            ::_exit(-1);
 
-        // Set environment variables
-        for (const auto &env : envs)
-            ::setenv(env.first.c_str(), env.second.c_str(), 1);
-
-        // Build the argument list for execve(2):
-        #pragma GCC diagnostic ignored "-Wvla"
-        char *argv[1 + args.size() + 1];
-        #ifndef __clang__
-        #pragma GCC diagnostic ignored "+Wvla"
-        #endif
-        unsigned arg_no(0);
-        argv[arg_no++] = ::strdup(command.c_str());
-        for (const auto &arg : args)
-            argv[arg_no++] = ::strdup(arg.c_str());
-        argv[arg_no] = nullptr;
-        ::execv(command.c_str(), argv);
+        if (not new_stdin.empty() and not RedirectFileDescriptor(new_stdin, O_RDONLY, STDIN_FILENO))
+            ::_exit(-1);
+        if (not new_stdout.empty() and not RedirectFileDescriptor(new_stdout, O_WRONLY | O_CREAT, STDOUT_FILENO))
+            ::_exit(-1);
+        if (not new_stderr.empty() and not RedirectFileDescriptor(new_stderr, O_WRONLY | O_CREAT, STDERR_FILENO))
+            ::_exit(-1);
 
+        ::execve(command.c_str(), argv, envp);
         ::_exit(EXECVE_FAILURE); // We typically never get here.
     }
 
-    // The parent of the fork:
-    else {
-        if (exec_mode == ExecMode::DETACH)
-            return pid;
+    return pid;
+}
 
-        void (*old_alarm_handler)(int) = nullptr;
 
-        if (timeout_in_seconds > 0) {
-            // Install new alarm handler...
-            alarm_went_off = false;
-            child_pid = pid;
-            old_alarm_handler = ::signal(SIGALRM, SigAlarmHandler);
+#endif // POSIX_SPAWN_SETSID
 
-            // ...and wind the clock:
-            ::alarm(timeout_in_seconds);
-        }
 
-        int child_exit_status;
+int Exec(const std::string &command, const std::vector<std::string> &args, const std::string &new_stdin, const std::string &new_stdout,
+         const std::string &new_stderr, const ExecMode exec_mode, unsigned timeout_in_seconds, const int tardy_child_signal,
+         const std::unordered_map<std::string, std::string> &envs)
+{
+    errno = 0;
+    if (::access(command.c_str(), X_OK) != 0)
+        throw std::runtime_error("in ExecUtil::Exec: can't execute \"" + command + "\"!");
+
+    if (exec_mode == ExecMode::DETACH and timeout_in_seconds > 0)
+        throw std::runtime_error("in ExecUtil::Exec: non-zero timeout is incompatible w/ ExecMode::DETACH!");
+
+    // Build the argument list and the environment for the child:
+    std::vector<std::string> argv_strings{ command };
+    argv_strings.insert(argv_strings.end(), args.cbegin(), args.cend());
+    const std::vector<char *> argv(MakeCStringArray(argv_strings));
+    const std::vector<std::string> envp_strings(BuildChildEnvironment(envs));
+    const std::vector<char *> envp(MakeCStringArray(envp_strings));
+
+    const pid_t pid(StartChild(command, argv.data(), envp.data(), new_stdin, new_stdout, new_stderr));
+    if (exec_mode == ExecMode::DETACH)
+        return pid;
+
+    int child_exit_status;
+    if (timeout_in_seconds > 0) {
+        if (not WaitWithTimeout(pid, timeout_in_seconds, &child_exit_status)) {
+            // Snuff out all of our offspring.
+            ::kill(-pid, tardy_child_signal);
+            while (::wait4(-pid, &child_exit_status, 0, nullptr) != -1)
+                /* Intentionally empty! */;
+
+            errno = ETIME;
+            return -1;
+        }
+    } else {
         errno = 0;
         int wait_retval = ::wait4(pid, &child_exit_status, 0, nullptr);
         assert(wait_retval == pid or errno == EINTR);
+    }
 
-        if (timeout_in_seconds > 0) {
-            // Cancel any outstanding alarm:
-            ::alarm(0);
-
-            // Restore the old alarm handler:
-            ::signal(SIGALRM, old_alarm_handler);
-
-            // Check to see whether the test timed out or not:
-            if (alarm_went_off) {
-                // Snuff out all of our offspring.
-                ::kill(-pid, tardy_child_signal);
-                while (::wait4(-pid, &child_exit_status, 0, nullptr) != -1)
-                    /* Intentionally empty! */;
-
-                errno = ETIME;
-                return -1;
-            }
+    // Now process the child's various exit status values:
+    if (WIFEXITED(child_exit_status)) {
+        switch (WEXITSTATUS(child_exit_status)) {
+        case EXECVE_FAILURE:
+            throw std::runtime_error("in Exec: failed to execve(2) in child!");
+        default:
+            return WEXITSTATUS(child_exit_status);
         }
-
-        // Now process the child's various exit status values:
-        if (WIFEXITED(child_exit_status)) {
-            switch (WEXITSTATUS(child_exit_status)) {
-            case EXECVE_FAILURE:
-                throw std::runtime_error("in Exec: failed to execve(2) in child!");
-            default:
-                return WEXITSTATUS(child_exit_status);
-            }
-        } else if (WIFSIGNALED(child_exit_status))
-            throw std::runtime_error("in Exec: \"" + command + "\" killed by signal "
-                                     + std::to_string(WTERMSIG(child_exit_status)) + "!");
-        else // I have no idea how we got here!
-            logger->error("in Exec: dazed and confused!");
-    }
+    } else if (WIFSIGNALED(child_exit_status))
+        throw std::runtime_error("in Exec: \"" + command + "\" killed by signal "
+                                 + std::to_string(WTERMSIG(child_exit_status)) + "!");
+    else // I have no idea how we got here!
+        logger->error("in Exec: dazed and confused!");
 
     return 0; // Keep the compiler happy!
 }
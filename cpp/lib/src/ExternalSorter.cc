@@ -0,0 +1,166 @@
+/** \brief Implementation of the ExternalSorter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ExternalSorter.h"
+#include <algorithm>
+#include <queue>
+#include "Compiler.h"
+#include "File.h"
+#include "util.h"
+
+
+constexpr size_t ExternalSorter::DEFAULT_MAX_MEMORY_USAGE;
+
+
+ExternalSorter::ExternalSorter(const size_t max_memory_usage, const std::string &temp_file_prefix)
+    : max_memory_usage_(max_memory_usage), temp_file_prefix_(temp_file_prefix), count_(0), finished_(false)
+{
+    if (unlikely(max_memory_usage_ == 0))
+        LOG_ERROR("the memory limit must be positive!");
+}
+
+
+void ExternalSorter::add(const StringView &key, const StringView &value) {
+    if (unlikely(finished_))
+        LOG_ERROR("can't add pairs after finish() has been called!");
+    if (unlikely(key.size() > UINT32_MAX or value.size() > UINT32_MAX))
+        LOG_ERROR("key or value too large!");
+
+    entries_.emplace_back(Entry{ arena_.size(), static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size()) });
+    arena_.append(key.data(), key.size());
+    arena_.append(value.data(), value.size());
+    ++count_;
+
+    if (getMemoryUsage() >= max_memory_usage_)
+        writeRun();
+}
+
+
+void ExternalSorter::sortBuffer() {
+    std::stable_sort(entries_.begin(), entries_.end(),
+                     [this](const Entry &entry1, const Entry &entry2) { return getKey(entry1) < getKey(entry2); });
+}
+
+
+namespace {
+
+
+// Runs are sequences of entries, each consisting of the key size, the value size, the key and the value.
+
+
+inline void WriteRunEntry(File * const run, const StringView &key, const StringView &value) {
+    const uint32_t sizes[2] = { static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size()) };
+    if (unlikely(run->write(sizes, sizeof(sizes)) != sizeof(sizes) or run->write(key.data(), key.size()) != key.size()
+                 or run->write(value.data(), value.size()) != value.size()))
+        LOG_ERROR("failed to write to \"" + run->getPath() + "\"!");
+}
+
+
+// \return False at the end of "run".
+bool ReadRunEntry(File * const run, std::string * const key, std::string * const value) {
+    uint32_t sizes[2];
+    const size_t read_count(run->read(sizes, sizeof(sizes)));
+    if (read_count == 0 and run->eof())
+        return false;
+    if (unlikely(read_count != sizeof(sizes)))
+        LOG_ERROR("truncated run \"" + run->getPath() + "\"! (1)");
+
+    key->resize(sizes[0]);
+    value->resize(sizes[1]);
+    if (unlikely(run->read(&(*key)[0], key->size()) != key->size() or run->read(&(*value)[0], value->size()) != value->size()))
+        LOG_ERROR("truncated run \"" + run->getPath() + "\"! (2)");
+
+    return true;
+}
+
+
+struct RunReader {
+    std::unique_ptr<File> run_;
+    std::string key_, value_;
+};
+
+
+} // unnamed namespace
+
+
+void ExternalSorter::writeRun() {
+    sortBuffer();
+
+    runs_.emplace_back(new FileUtil::AutoTempFile(temp_file_prefix_));
+    const auto run(FileUtil::OpenOutputFileOrDie(runs_.back()->getFilePath()));
+    for (const auto &entry : entries_)
+        WriteRunEntry(run.get(), getKey(entry), getValue(entry));
+    if (unlikely(not run->close()))
+        LOG_ERROR("failed to close \"" + runs_.back()->getFilePath() + "\"!");
+
+    // Release the memory rather than just clearing the buffers, as we may be at the limit of what we're allowed to use:
+    std::string().swap(arena_);
+    std::vector<Entry>().swap(entries_);
+}
+
+
+void ExternalSorter::mergeRuns(const Consumer &consumer) {
+    std::vector<RunReader> run_readers(runs_.size());
+    for (size_t run_no(0); run_no < runs_.size(); ++run_no)
+        run_readers[run_no].run_ = FileUtil::OpenInputFileOrDie(runs_[run_no]->getFilePath());
+
+    // The heap contains the indices of all runs that haven't been exhausted yet.  For equal keys the earlier run wins,
+    // which keeps the merge stable:
+    const auto greater([&run_readers](const size_t run_no1, const size_t run_no2) {
+        const int comparison(run_readers[run_no1].key_.compare(run_readers[run_no2].key_));
+        return comparison > 0 or (comparison == 0 and run_no1 > run_no2);
+    });
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t run_no(0); run_no < run_readers.size(); ++run_no) {
+        auto &run_reader(run_readers[run_no]);
+        if (ReadRunEntry(run_reader.run_.get(), &run_reader.key_, &run_reader.value_))
+            heap.push(run_no);
+    }
+
+    while (not heap.empty()) {
+        const size_t run_no(heap.top());
+        heap.pop();
+        auto &run_reader(run_readers[run_no]);
+        consumer(run_reader.key_, run_reader.value_);
+        if (ReadRunEntry(run_reader.run_.get(), &run_reader.key_, &run_reader.value_))
+            heap.push(run_no);
+    }
+}
+
+
+void ExternalSorter::finish(const Consumer &consumer) {
+    if (unlikely(finished_))
+        LOG_ERROR("finish() must only be called once!");
+    finished_ = true;
+
+    if (runs_.empty()) { // Everything fit into memory.
+        sortBuffer();
+        for (const auto &entry : entries_)
+            consumer(getKey(entry), getValue(entry));
+    } else {
+        if (not entries_.empty())
+            writeRun();
+        LOG_DEBUG("merging " + std::to_string(runs_.size()) + " run(s) w/ a total of " + std::to_string(count_)
+                  + " pair(s).");
+        mergeRuns(consumer);
+    }
+
+    std::string().swap(arena_);
+    std::vector<Entry>().swap(entries_);
+    runs_.clear();
+}
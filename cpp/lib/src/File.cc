@@ -25,17 +25,466 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "File.h"
+#include <algorithm>
+#include <vector>
 #include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <zlib.h>
 #include "FileUtil.h"
+#include "GzStream.h"
+#include "IoUring.h"
 #include "util.h"
 
 
+namespace {
+
+
+ssize_t GzipRead(void *cookie, char *buf, size_t size) {
+    const int bytes_read(::gzread(reinterpret_cast<gzFile>(cookie), buf, static_cast<unsigned>(size)));
+    return (bytes_read < 0) ? -1 : bytes_read;
+}
+
+
+int GzipSeek(void *cookie, off64_t *offset, int whence) {
+    if (whence == SEEK_END) { // Not supported by zlib.
+        errno = EINVAL;
+        return -1;
+    }
+
+    const z_off_t new_offset(::gzseek(reinterpret_cast<gzFile>(cookie), static_cast<z_off_t>(*offset), whence));
+    if (new_offset == -1)
+        return -1;
+    *offset = new_offset;
+    return 0;
+}
+
+
+int GzipClose(void *cookie) {
+    return (::gzclose(reinterpret_cast<gzFile>(cookie)) == Z_OK) ? 0 : EOF;
+}
+
+
+// Compression is the expensive direction, so we spread it over all cores.
+class GzipWriter {
+    const int fd_;
+    off64_t uncompressed_offset_;
+    ParallelGzStream compressor_;
+public:
+    explicit GzipWriter(const int fd)
+        : fd_(fd), uncompressed_offset_(0),
+          compressor_(GzStream::GZIP,
+                      [fd](const char * const data, const size_t data_size) { WriteOrThrow(fd, data, data_size); },
+                      Z_DEFAULT_COMPRESSION) { }
+    ~GzipWriter() { ::close(fd_); }
+
+    static ssize_t Write(void *cookie, const char *buf, size_t size);
+    static int Seek(void *cookie, off64_t *offset, int whence);
+    static int Close(void *cookie);
+private:
+    static void WriteOrThrow(const int fd, const char *data, size_t data_size);
+};
+
+
+ssize_t GzipWriter::Write(void *cookie, const char *buf, size_t size) {
+    GzipWriter &writer(*reinterpret_cast<GzipWriter *>(cookie));
+    try {
+        writer.compressor_.write(buf, size);
+    } catch (const std::exception &x) { // We must not throw through stdio.
+        LOG_WARNING(x.what());
+        if (errno == 0)
+            errno = EIO;
+        return -1;
+    }
+
+    writer.uncompressed_offset_ += size;
+    return size;
+}
+
+
+// We can only report the current position.
+int GzipWriter::Seek(void *cookie, off64_t *offset, int whence) {
+    const GzipWriter &writer(*reinterpret_cast<GzipWriter *>(cookie));
+    if ((whence == SEEK_CUR and *offset == 0) or (whence == SEEK_SET and *offset == writer.uncompressed_offset_)) {
+        *offset = writer.uncompressed_offset_;
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+
+int GzipWriter::Close(void *cookie) {
+    GzipWriter * const writer(reinterpret_cast<GzipWriter *>(cookie));
+    int retval(0);
+    try {
+        writer->compressor_.finish();
+    } catch (const std::exception &x) {
+        LOG_WARNING(x.what());
+        retval = EOF;
+    }
+
+    const int saved_errno(errno);
+    delete writer;
+    errno = saved_errno;
+    return retval;
+}
+
+
+void GzipWriter::WriteOrThrow(const int fd, const char *data, size_t data_size) {
+    while (data_size > 0) {
+        const ssize_t write_count(::write(fd, data, data_size));
+        if (unlikely(write_count == -1)) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("in GzipWriter::WriteOrThrow: write(2) failed: " + std::string(std::strerror(errno)));
+        }
+        data      += write_count;
+        data_size -= write_count;
+    }
+}
+
+
+// \param mode  "r", "w" or "a".
+FILE *OpenGzipStream(const std::string &path, const std::string &mode) {
+    if (mode != "r") {
+        const int fd(::open(path.c_str(), O_WRONLY | O_CREAT | (mode == "w" ? O_TRUNC : O_APPEND), 0666));
+        if (fd == -1)
+            return nullptr;
+
+        static const cookie_io_functions_t GZIP_WRITER_IO_FUNCTIONS{ nullptr, GzipWriter::Write, GzipWriter::Seek,
+                                                                     GzipWriter::Close };
+        GzipWriter * const gzip_writer(new GzipWriter(fd));
+        FILE * const file(::fopencookie(gzip_writer, "w", GZIP_WRITER_IO_FUNCTIONS));
+        if (file == nullptr)
+            delete gzip_writer;
+        return file;
+    }
+
+    const gzFile gz_file(::gzopen(path.c_str(), "rb"));
+    if (gz_file == nullptr)
+        return nullptr;
+    ::gzbuffer(gz_file, 128 * 1024);
+
+    static const cookie_io_functions_t GZIP_IO_FUNCTIONS{ GzipRead, nullptr, GzipSeek, GzipClose };
+    FILE * const file(::fopencookie(gz_file, "r", GZIP_IO_FUNCTIONS));
+    if (file == nullptr)
+        ::gzclose(gz_file);
+    return file;
+}
+
+
+} // unnamed namespace
+
+
+// A stdio cookie that keeps several reads in flight ahead of the consumer, or lets writes complete in the background,
+// via io_uring.  For seekable files reads are issued at explicit offsets.  Pipes, sockets and files opened for appending
+// only ever have a single request in flight as concurrent requests at the current file position may complete out of
+// order.
+class File::AsyncStream {
+    enum ChunkState { FREE, IN_FLIGHT, READY };
+    struct Chunk {
+        std::unique_ptr<char[]> data_;
+        ChunkState state_;
+        off_t offset_;       // Only used for seekable files.
+        size_t size_;        // The number of valid bytes for reads and the number of bytes to write for writes.
+        size_t processed_;   // The number of bytes already handed to stdio for reads and already written for writes.
+        int errno_;          // Only used for reads.
+    };
+
+    const int fd_;
+    const bool writing_, seekable_;
+    const size_t chunk_size_;
+    IoUring io_uring_;
+    std::vector<Chunk> chunks_;
+    size_t head_, tail_;       // The next chunk to consume and the next chunk to issue.  Only used for reads.
+    size_t issued_count_;      // The number of non-free chunks.
+    off_t logical_offset_;     // What we have handed to stdio or accepted from it.
+    off_t next_offset_;        // Where the next read or write will be issued.
+    int pending_errno_;        // An asynchronous write error that we report on the next call.
+public:
+    AsyncStream(const int fd, const bool writing, const unsigned queue_depth, const size_t chunk_size);
+    ~AsyncStream() { ::close(fd_); }
+
+    inline int getFileDescriptor() const { return fd_; }
+
+    /** \return False if an asynchronous write failed, in which case errno will have been set. */
+    bool drain();
+
+    static ssize_t Read(void *cookie, char *buf, size_t size);
+    static ssize_t Write(void *cookie, const char *buf, size_t size);
+    static int Seek(void *cookie, off64_t *offset, int whence);
+    static int Close(void *cookie);
+private:
+    void issueReads();
+    void issueWrite(Chunk * const chunk);
+
+    /** \brief Waits for one request to complete and updates the state of its chunk accordingly. */
+    void processCompletion();
+
+    /** \return The distance of a read chunk from "head_" in issue order. */
+    inline size_t getChunkPosition(const size_t chunk_index) const {
+        return (chunk_index + chunks_.size() - head_) % chunks_.size();
+    }
+
+    /** \brief Waits for all requests and forgets all read-ahead data. */
+    void reset(const off_t new_offset);
+};
+
+
+File::AsyncStream::AsyncStream(const int fd, const bool writing, const unsigned queue_depth, const size_t chunk_size)
+    : fd_(fd), writing_(writing),
+      seekable_(::lseek(fd, 0, SEEK_CUR) != -1 and (::fcntl(fd, F_GETFL) & O_APPEND) == 0),
+      chunk_size_(std::min<size_t>(chunk_size, 1u << 30)), io_uring_(queue_depth), chunks_(queue_depth), head_(0),
+      tail_(0), issued_count_(0), pending_errno_(0)
+{
+    for (auto &chunk : chunks_) {
+        chunk.data_.reset(new char[chunk_size_]);
+        chunk.state_ = FREE;
+    }
+    logical_offset_ = next_offset_ = seekable_ ? ::lseek(fd, 0, SEEK_CUR) : 0;
+}
+
+
+bool File::AsyncStream::drain() {
+    while (io_uring_.getInFlightCount() > 0)
+        processCompletion();
+
+    if (pending_errno_ != 0) {
+        errno = pending_errno_;
+        pending_errno_ = 0;
+        return false;
+    }
+    return true;
+}
+
+
+ssize_t File::AsyncStream::Read(void *cookie, char *buf, size_t size) {
+    AsyncStream &stream(*reinterpret_cast<AsyncStream *>(cookie));
+    if (stream.issued_count_ == 0)
+        stream.issueReads();
+
+    Chunk &chunk(stream.chunks_[stream.head_]);
+    while (chunk.state_ == IN_FLIGHT)
+        stream.processCompletion();
+    stream.issueReads(); // Only does something for pipes where the next read can't start before this one completed.
+
+    if (unlikely(chunk.errno_ != 0)) {
+        errno = chunk.errno_;
+        stream.reset(stream.logical_offset_);
+        return -1;
+    }
+    if (chunk.size_ == 0) { // EOF, we forget everything so that a later read can pick up data appended in the meantime.
+        stream.reset(stream.logical_offset_);
+        return 0;
+    }
+
+    const size_t copy_count(std::min(size, chunk.size_ - chunk.processed_));
+    std::memcpy(buf, chunk.data_.get() + chunk.processed_, copy_count);
+    chunk.processed_ += copy_count;
+    stream.logical_offset_ += copy_count;
+    if (chunk.processed_ == chunk.size_) {
+        chunk.state_ = FREE;
+        stream.head_ = (stream.head_ + 1) % stream.chunks_.size();
+        --stream.issued_count_;
+        stream.issueReads();
+    }
+
+    return copy_count;
+}
+
+
+ssize_t File::AsyncStream::Write(void *cookie, const char *buf, size_t size) {
+    AsyncStream &stream(*reinterpret_cast<AsyncStream *>(cookie));
+
+    // stdio treats a short count as an error, so we have to accept everything.
+    size_t accepted_count(0);
+    while (accepted_count < size) {
+        // We have to wait for a free chunk and, for non-seekable files, for the previous write to complete.  Writes to
+        // seekable files may complete in any order, hence the search for a free chunk.
+        while (stream.issued_count_ == stream.chunks_.size() or (not stream.seekable_ and stream.issued_count_ > 0))
+            stream.processCompletion();
+        if (stream.pending_errno_ != 0) {
+            errno = stream.pending_errno_;
+            stream.pending_errno_ = 0;
+            return (accepted_count > 0) ? static_cast<ssize_t>(accepted_count) : -1;
+        }
+
+        Chunk &chunk(*std::find_if(stream.chunks_.begin(), stream.chunks_.end(),
+                                   [](const Chunk &candidate) { return candidate.state_ == FREE; }));
+        ++stream.issued_count_;
+        chunk.size_      = std::min(size - accepted_count, stream.chunk_size_);
+        chunk.processed_ = 0;
+        chunk.offset_    = stream.next_offset_;
+        std::memcpy(chunk.data_.get(), buf + accepted_count, chunk.size_);
+        stream.next_offset_    += chunk.size_;
+        stream.logical_offset_ += chunk.size_;
+        accepted_count         += chunk.size_;
+        stream.issueWrite(&chunk);
+        stream.io_uring_.submit();
+    }
+
+    return accepted_count;
+}
+
+
+int File::AsyncStream::Seek(void *cookie, off64_t *offset, int whence) {
+    AsyncStream &stream(*reinterpret_cast<AsyncStream *>(cookie));
+    if (not stream.seekable_) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    // ftello(3) asks for the current position a lot.  This must not cost us our read-ahead.
+    if (whence == SEEK_CUR and *offset == 0) {
+        *offset = stream.logical_offset_;
+        return 0;
+    }
+
+    off_t new_offset;
+    if (whence == SEEK_SET)
+        new_offset = *offset;
+    else if (whence == SEEK_CUR)
+        new_offset = stream.logical_offset_ + *offset;
+    else {
+        if (not stream.drain())
+            return -1;
+        struct stat stat_buf;
+        if (::fstat(stream.fd_, &stat_buf) == -1)
+            return -1;
+        new_offset = stat_buf.st_size + *offset;
+    }
+    if (new_offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (stream.writing_) {
+        if (not stream.drain())
+            return -1;
+    }
+    stream.reset(new_offset);
+    *offset = new_offset;
+    return 0;
+}
+
+
+int File::AsyncStream::Close(void *cookie) {
+    AsyncStream * const stream(reinterpret_cast<AsyncStream *>(cookie));
+    const bool drained(stream->drain());
+    const int saved_errno(errno);
+    delete stream;
+    errno = saved_errno;
+    return drained ? 0 : EOF;
+}
+
+
+void File::AsyncStream::issueReads() {
+    if (not seekable_ and io_uring_.getInFlightCount() > 0)
+        return;
+
+    while (issued_count_ < chunks_.size()) {
+        Chunk &chunk(chunks_[tail_]);
+        chunk.state_     = IN_FLIGHT;
+        chunk.offset_    = next_offset_;
+        chunk.size_      = 0;
+        chunk.processed_ = 0;
+        chunk.errno_     = 0;
+        io_uring_.prepareRead(fd_, chunk.data_.get(), chunk_size_, seekable_ ? chunk.offset_ : -1, tail_);
+        next_offset_ += chunk_size_;
+        tail_ = (tail_ + 1) % chunks_.size();
+        ++issued_count_;
+        if (not seekable_)
+            break;
+    }
+    io_uring_.submit();
+}
+
+
+void File::AsyncStream::issueWrite(Chunk * const chunk) {
+    chunk->state_ = IN_FLIGHT;
+    io_uring_.prepareWrite(fd_, chunk->data_.get() + chunk->processed_, chunk->size_ - chunk->processed_,
+                           seekable_ ? chunk->offset_ + chunk->processed_ : -1, chunk - chunks_.data());
+}
+
+
+void File::AsyncStream::processCompletion() {
+    uint64_t chunk_index;
+    int result;
+    io_uring_.getCompletion(&chunk_index, &result);
+    Chunk &chunk(chunks_[chunk_index]);
+
+    if (writing_) {
+        if (unlikely(result < 0)) {
+            if (result != -EINTR and result != -EAGAIN)
+                pending_errno_ = -result;
+            result = 0;
+        }
+        chunk.processed_ += result;
+        if (chunk.processed_ == chunk.size_ or pending_errno_ != 0) {
+            chunk.state_ = FREE;
+            --issued_count_;
+        } else // A short write, we have to write the rest.
+            issueWrite(&chunk);
+        return;
+    }
+
+    chunk.state_ = READY;
+    if (unlikely(result < 0)) {
+        chunk.errno_ = -result;
+        return;
+    }
+    chunk.size_ = result;
+
+    if (seekable_ and static_cast<size_t>(result) < chunk_size_) {
+        // A short read, typically at the end of the file.  The reads that we issued after this one assumed a full
+        // chunk and have to be repeated at the right offset, if at all.
+        const size_t position(getChunkPosition(chunk_index));
+        while (io_uring_.getInFlightCount() > 0) {
+            uint64_t other_chunk_index;
+            int other_result;
+            io_uring_.getCompletion(&other_chunk_index, &other_result);
+            if (getChunkPosition(other_chunk_index) < position) { // Still valid.
+                Chunk &other_chunk(chunks_[other_chunk_index]);
+                other_chunk.state_ = READY;
+                if (other_result < 0)
+                    other_chunk.errno_ = -other_result;
+                else
+                    other_chunk.size_ = other_result;
+            }
+        }
+
+        for (size_t later_position(position + 1); later_position < issued_count_; ++later_position)
+            chunks_[(head_ + later_position) % chunks_.size()].state_ = FREE;
+        issued_count_ = position + 1;
+        tail_         = (chunk_index + 1) % chunks_.size();
+        next_offset_  = chunk.offset_ + result;
+    }
+}
+
+
+void File::AsyncStream::reset(const off_t new_offset) {
+    uint64_t chunk_index;
+    int result;
+    while (io_uring_.getInFlightCount() > 0)
+        io_uring_.getCompletion(&chunk_index, &result);
+
+    for (auto &chunk : chunks_)
+        chunk.state_ = FREE;
+    head_ = tail_ = issued_count_ = 0;
+    logical_offset_ = next_offset_ = new_offset;
+    if (seekable_)
+        ::lseek(fd_, new_offset, SEEK_SET); // For the benefit of anybody else using the descriptor.
+}
+
+
 File::File(const std::string &filename, const std::string &mode, const ThrowOnOpenBehaviour throw_on_error_behaviour)
-    : filename_(filename), buffer_ptr_(buffer_), read_count_(0), file_(nullptr), pushed_back_count_(0), precision_(6)
+    : filename_(filename), buffer_(new char[BUFSIZ]), buffer_size_(BUFSIZ), buffer_ptr_(buffer_.get()), read_count_(0),
+      file_(nullptr), pushed_back_count_(0), precision_(6), compressed_(false), access_pattern_(NORMAL_ACCESS),
+      bytes_since_drop_behind_(0), dropped_offset_(0), writeback_offset_(0), async_stream_(nullptr)
 {
     if (mode == "w")
         open_mode_ = WRITING;
@@ -45,13 +494,16 @@ File::File(const std::string &filename, const std::string &mode, const ThrowOnOp
         open_mode_ = READING;
     else if (mode == "r+")
         open_mode_ = READING_AND_WRITING;
-    else {
+    else if (mode == "wc" or mode == "ac" or mode == "ru") {
+        open_mode_ = (mode[0] == 'r') ? READING : WRITING;
+        compressed_ = true;
+    } else {
         if (throw_on_error_behaviour == THROW_ON_ERROR)
             throw std::runtime_error("in File::File: open mode \"" + mode + "\" not supported! (1)");
         return;
     }
 
-    file_ = std::fopen(filename.c_str(), mode.c_str());
+    file_ = compressed_ ? OpenGzipStream(filename, mode.substr(0, 1)) : std::fopen(filename.c_str(), mode.c_str());
     if (file_ == nullptr) {
         if (throw_on_error_behaviour == THROW_ON_ERROR)
             throw std::runtime_error("in File::File: could not open \"" + filename + "\" w/ mode \"" + mode + "\"!");
@@ -62,8 +514,10 @@ File::File(const std::string &filename, const std::string &mode, const ThrowOnOp
 
 
 File::File(const int fd, const std::string &mode)
-    : filename_(FileUtil::GetPathFromFileDescriptor(fd)), buffer_ptr_(buffer_), read_count_(0), file_(nullptr),
-      pushed_back_count_(0), precision_(6)
+    : filename_(FileUtil::GetPathFromFileDescriptor(fd)), buffer_(new char[BUFSIZ]), buffer_size_(BUFSIZ),
+      buffer_ptr_(buffer_.get()), read_count_(0), file_(nullptr), pushed_back_count_(0), precision_(6), compressed_(false),
+      access_pattern_(NORMAL_ACCESS), bytes_since_drop_behind_(0), dropped_offset_(0), writeback_offset_(0),
+      async_stream_(nullptr)
 {
     std::string local_mode;
     if (mode.empty()) {
@@ -108,17 +562,185 @@ bool File::close() {
         return false;
     }
 
+    if (access_pattern_ == SEQUENTIAL_ACCESS_NO_REUSE and open_mode_ == WRITING and std::fflush(file_) == 0)
+        dropBehind(/* final = */true);
+
     const bool retval(std::fclose(file_) == 0);
     file_ = nullptr;
+    async_stream_ = nullptr;
     return retval;
 }
 
 
+void File::setBufferSize(const size_t new_buffer_size) {
+    if (unlikely(file_ == nullptr))
+        throw std::runtime_error("in File::setBufferSize: can't change the buffer size of non-open file \"" + filename_
+                                 + "\"!");
+    if (unlikely(new_buffer_size == 0))
+        throw std::runtime_error("in File::setBufferSize: the buffer size must be positive!");
+    if (unlikely(read_count_ != 0 or pushed_back_count_ != 0))
+        throw std::runtime_error("in File::setBufferSize: must be called before reading from \"" + filename_ + "\"!");
+
+    // stdio's buffer also has to grow as read() and write() go through it.
+    if (unlikely(std::setvbuf(file_, nullptr, _IOFBF, new_buffer_size) != 0))
+        throw std::runtime_error("in File::setBufferSize: setvbuf(3) failed for \"" + filename_ + "\"!");
+
+    buffer_.reset(new char[new_buffer_size]);
+    buffer_size_ = new_buffer_size;
+    buffer_ptr_  = buffer_.get();
+}
+
+
+void File::setAccessPattern(const AccessPattern access_pattern) {
+    if (unlikely(file_ == nullptr))
+        throw std::runtime_error("in File::setAccessPattern: can't set the access pattern of non-open file \"" + filename_
+                                 + "\"!");
+    if (compressed_)
+        return;
+
+    // Failures, e.g. ESPIPE for pipes, only mean that there is no page cache for us to influence.
+    const int fd(getFileDescriptor());
+    if (::posix_fadvise(fd, 0, 0, access_pattern == NORMAL_ACCESS ? POSIX_FADV_NORMAL : POSIX_FADV_SEQUENTIAL) != 0)
+        return;
+
+    // We don't know what an "r+" File will read again, so we don't evict anything in that case.  The eviction relies on
+    // the kernel's file offset which asynchronous I/O doesn't maintain.
+    access_pattern_ = (access_pattern == SEQUENTIAL_ACCESS_NO_REUSE
+                       and (open_mode_ == READING_AND_WRITING or async_stream_ != nullptr)) ? SEQUENTIAL_ACCESS
+                                                                                            : access_pattern;
+    if (access_pattern_ == SEQUENTIAL_ACCESS_NO_REUSE) {
+        const off_t current_offset(::lseek(fd, 0, SEEK_CUR));
+        dropped_offset_ = writeback_offset_ = (current_offset == -1) ? 0 : current_offset;
+        bytes_since_drop_behind_ = 0;
+    }
+}
+
+
+bool File::enableAsynchronousIO(const unsigned queue_depth) {
+    if (unlikely(file_ == nullptr))
+        throw std::runtime_error("in File::enableAsynchronousIO: can't enable asynchronous I/O for non-open file \""
+                                 + filename_ + "\"!");
+    if (unlikely(queue_depth == 0))
+        throw std::runtime_error("in File::enableAsynchronousIO: the queue depth must be positive!");
+    if (async_stream_ != nullptr)
+        return true;
+    if (compressed_ or open_mode_ == READING_AND_WRITING or not IoUring::IsAvailable())
+        return false;
+
+    if (open_mode_ == WRITING and unlikely(std::fflush(file_) != 0))
+        throw std::runtime_error("in File::enableAsynchronousIO: fflush(3) failed for \"" + filename_ + "\"!");
+    const int fd(fileno(file_));
+    if (unlikely(read_count_ != 0 or pushed_back_count_ != 0 or ::ftello(file_) != ::lseek(fd, 0, SEEK_CUR)))
+        throw std::runtime_error("in File::enableAsynchronousIO: must be called before reading from \"" + filename_
+                                 + "\"!");
+
+    // The new stream gets its own descriptor as fclose(3)'ing the old stream closes the original one.
+    const int async_fd(::dup(fd));
+    if (unlikely(async_fd == -1))
+        return false;
+    AsyncStream *async_stream;
+    try {
+        async_stream = new AsyncStream(async_fd, open_mode_ == WRITING, queue_depth, buffer_size_);
+    } catch (const std::exception &x) { // E.g. io_uring_setup(2) failing due to RLIMIT_MEMLOCK.
+        LOG_WARNING("falling back to synchronous I/O for \"" + filename_ + "\": " + std::string(x.what()));
+        ::close(async_fd);
+        return false;
+    }
+
+    static const cookie_io_functions_t ASYNC_IO_FUNCTIONS{ AsyncStream::Read, AsyncStream::Write, AsyncStream::Seek,
+                                                           AsyncStream::Close };
+    FILE * const async_file(::fopencookie(async_stream, open_mode_ == READING ? "r" : "w", ASYNC_IO_FUNCTIONS));
+    if (unlikely(async_file == nullptr)) {
+        delete async_stream;
+        return false;
+    }
+    if (unlikely(std::setvbuf(async_file, nullptr, _IOFBF, buffer_size_) != 0))
+        throw std::runtime_error("in File::enableAsynchronousIO: setvbuf(3) failed for \"" + filename_ + "\"!");
+
+    std::fclose(file_);
+    file_ = async_file;
+    async_stream_ = async_stream;
+    if (access_pattern_ == SEQUENTIAL_ACCESS_NO_REUSE)
+        access_pattern_ = SEQUENTIAL_ACCESS;
+
+    return true;
+}
+
+
+int File::getFileDescriptor() const {
+    return (async_stream_ != nullptr) ? async_stream_->getFileDescriptor() : fileno(file_);
+}
+
+
 void File::fillBuffer() {
-    read_count_ = std::fread(reinterpret_cast<void *>(buffer_), 1, BUFSIZ, file_);
+    read_count_ = std::fread(reinterpret_cast<void *>(buffer_.get()), 1, buffer_size_, file_);
     if (unlikely(std::ferror(file_) != 0))
         throw std::runtime_error("in File:fillBuffer: error while reading \"" + filename_ + "\"!");
-    buffer_ptr_ = buffer_;
+    buffer_ptr_ = buffer_.get();
+    countProcessedBytes(read_count_);
+}
+
+
+void File::dropBehind(const bool final) {
+    bytes_since_drop_behind_ = 0;
+
+    // The kernel's file offset only covers what stdio has already read or flushed, i.e. the part that we can safely
+    // evict.
+    const int fd(getFileDescriptor());
+    const off_t current_offset(::lseek(fd, 0, SEEK_CUR));
+    if (unlikely(current_offset == -1))
+        return;
+
+    if (open_mode_ == READING) {
+        if (current_offset > dropped_offset_)
+            ::posix_fadvise(fd, dropped_offset_, current_offset - dropped_offset_, POSIX_FADV_DONTNEED);
+        dropped_offset_ = current_offset; // Also correct after backward seeks.
+        return;
+    }
+
+    // Dirty pages can't be evicted.  We therefore start the writeback of each range on one call and wait for it and
+    // evict the range on the next call, which keeps the writer from stalling on the disk most of the time.
+    const off_t wait_until(final ? current_offset : writeback_offset_);
+    if (wait_until > dropped_offset_) {
+        ::sync_file_range(fd, dropped_offset_, wait_until - dropped_offset_,
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(fd, dropped_offset_, wait_until - dropped_offset_, POSIX_FADV_DONTNEED);
+        dropped_offset_ = wait_until;
+    }
+    if (current_offset > writeback_offset_) {
+        if (not final)
+            ::sync_file_range(fd, writeback_offset_, current_offset - writeback_offset_, SYNC_FILE_RANGE_WRITE);
+        writeback_offset_ = current_offset;
+    }
+}
+
+
+size_t File::appendUntil(std::string * const s, const char terminator) {
+    size_t appended_count(0);
+    while (pushed_back_count_ > 0) {
+        if (pushed_back_chars_[0] == terminator)
+            return appended_count;
+        *s += static_cast<char>(get());
+        ++appended_count;
+    }
+
+    for (;;) {
+        if (buffer_ptr_ == buffer_.get() + read_count_) {
+            fillBuffer();
+            if (unlikely(read_count_ == 0))
+                return appended_count;
+        }
+
+        char * const buffer_end(buffer_.get() + read_count_);
+        char *terminator_pos(reinterpret_cast<char *>(std::memchr(buffer_ptr_, terminator, buffer_end - buffer_ptr_)));
+        if (terminator_pos == nullptr)
+            terminator_pos = buffer_end;
+        s->append(buffer_ptr_, terminator_pos);
+        appended_count += terminator_pos - buffer_ptr_;
+        buffer_ptr_ = terminator_pos;
+        if (terminator_pos != buffer_end)
+            return appended_count;
+    }
 }
 
 
@@ -128,7 +750,7 @@ off_t File::size() const {
                                  + "\"!");
 
     struct stat stat_buf;
-    if (unlikely(::fstat(fileno(file_), &stat_buf) == -1))
+    if (unlikely(::fstat(getFileDescriptor(), &stat_buf) == -1))
         throw std::runtime_error("in File::size: fstat(2) failed on \"" + filename_ + "\" ("
                                  + std::string(::strerror(errno)) + ")!");
 
@@ -146,7 +768,7 @@ bool File::seek(const off_t offset, const int whence) {
 
     pushed_back_count_ = 0;
     read_count_        = 0;
-    buffer_ptr_        = buffer_;
+    buffer_ptr_        = buffer_.get();
 
     return true;
 }
@@ -156,7 +778,9 @@ size_t File::read(void * const buf, const size_t buf_size) {
     if (unlikely(file_ == nullptr))
         throw std::runtime_error("in File::read: can't read from non-open file \"" + filename_ + "\"!");
 
-    return ::fread(buf, 1, buf_size, file_);
+    const size_t read_count(::fread(buf, 1, buf_size, file_));
+    countProcessedBytes(read_count);
+    return read_count;
 }
 
 
@@ -164,7 +788,9 @@ size_t File::write(const void * const buf, const size_t buf_size) {
     if (unlikely(file_ == nullptr))
         throw std::runtime_error("in File::write: can't write to non-open file \"" + filename_ + "\"!");
 
-    return ::fwrite(buf, 1, buf_size, file_);
+    const size_t write_count(::fwrite(buf, 1, buf_size, file_));
+    countProcessedBytes(write_count);
+    return write_count;
 }
 
 
@@ -236,6 +862,13 @@ File &File::operator<<(const double d) {
 }
 
 
+bool File::flush() const {
+    if (std::fflush(file_) != 0)
+        return false;
+    return async_stream_ == nullptr or open_mode_ != WRITING or async_stream_->drain();
+}
+
+
 void File::rewind() {
     if (unlikely(file_ == nullptr))
         LOG_ERROR("can't rewind a non-open file!");
@@ -247,7 +880,7 @@ void File::rewind() {
 
     if (open_mode_ != WRITING) {
         read_count_ = 0;
-        buffer_ptr_ = buffer_;
+        buffer_ptr_ = buffer_.get();
     }
 }
 
@@ -258,7 +891,7 @@ bool File::append(const int fd) {
         return false;
 
     flush();
-    const int target_fd(fileno(file_));
+    const int target_fd(getFileDescriptor());
     char buf[BUFSIZ];
     ssize_t read_count;
     errno = 0;
@@ -277,7 +910,7 @@ bool File::append(const int fd) {
 bool File::append(const File &file) {
     if (unlikely(not file.flush()))
         return false;
-    return append(fileno(file.file_));
+    return append(file.getFileDescriptor());
 }
 
 
@@ -286,5 +919,5 @@ bool File::truncate(const off_t new_length) {
         throw std::runtime_error("in File::setNewSize: can't get non-open file's size \"" + filename_ + "\"!");
 
     flush();
-    return ::ftruncate(fileno(file_), new_length) == 0;
+    return ::ftruncate(getFileDescriptor(), new_length) == 0;
 }
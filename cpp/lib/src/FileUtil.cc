@@ -18,9 +18,12 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "FileUtil.h"
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <cassert>
 #include <climits>
@@ -34,6 +37,7 @@
 #endif
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include "Compiler.h"
 #include "FileDescriptor.h"
@@ -41,6 +45,7 @@
 #include "SocketUtil.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
+#include "ThreadPool.h"
 #include "RegexMatcher.h"
 #include "util.h"
 
@@ -227,6 +232,196 @@ void Directory::const_iterator::operator++() {
 }
 
 
+namespace {
+
+
+class ParallelTreeWalker {
+    struct DirectoryNode {
+        const std::string path_;
+        const std::shared_ptr<DirectoryNode> parent_;
+        std::atomic<size_t> pending_count_; // Our own scan plus the subdirectories that haven't been completed yet.
+    public:
+        DirectoryNode(const std::string &path, const std::shared_ptr<DirectoryNode> &parent)
+            : path_(path), parent_(parent), pending_count_(1) { }
+    };
+
+    // The layout of the records returned by getdents64(2), which glibc only declares as of version 2.30.  Like glibc's
+    // struct dirent we declare the maximum size for the name which a record's d_reclen usually falls short of.
+    struct LinuxDirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[256];
+    };
+
+    static constexpr size_t DIRENT_BUFFER_SIZE = 256 * 1024; // The kernel's own buffers are only 32 KiB.
+
+    const TreeVisitor &visitor_;
+    const TreePostVisitor &post_visitor_;
+    const unsigned thread_count_;
+    std::atomic<bool> aborted_;
+    int abort_errno_;
+    std::exception_ptr first_exception_;
+    std::mutex mutex_;
+    std::condition_variable root_completed_;
+    bool root_is_completed_;
+    std::unique_ptr<ThreadPool> thread_pool_; // Must be the last member so that it gets destroyed first.
+public:
+    ParallelTreeWalker(const TreeVisitor &visitor, const TreePostVisitor &post_visitor, const unsigned thread_count)
+        : visitor_(visitor), post_visitor_(post_visitor), thread_count_(thread_count), aborted_(false), abort_errno_(0),
+          root_is_completed_(false) { }
+
+    bool walk(const std::string &root_directory);
+private:
+    void scan(const std::shared_ptr<DirectoryNode> &node);
+
+    /** \brief Called once "node"'s own scan or one of its subdirectories has been completed. */
+    void complete(const std::shared_ptr<DirectoryNode> &node);
+
+    void abort(const int error_code);
+    void abort(const std::exception_ptr &exception);
+};
+
+
+bool ParallelTreeWalker::walk(const std::string &root_directory) {
+    // We scan the root directory ourselves and only start threads if there are subdirectories.
+    scan(std::make_shared<DirectoryNode>(root_directory, nullptr));
+    {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        root_completed_.wait(mutex_locker, [this]{ return root_is_completed_; });
+    }
+
+    if (first_exception_)
+        std::rethrow_exception(first_exception_);
+    if (aborted_) {
+        errno = abort_errno_;
+        return false;
+    }
+    return true;
+}
+
+
+void ParallelTreeWalker::scan(const std::shared_ptr<DirectoryNode> &node) {
+    if (aborted_) {
+        complete(node);
+        return;
+    }
+
+    const int directory_fd(::open(node->path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (unlikely(directory_fd == -1)) {
+        abort(errno);
+        complete(node);
+        return;
+    }
+
+    thread_local std::unique_ptr<char[]> dirent_buffer;
+    if (dirent_buffer == nullptr)
+        dirent_buffer.reset(new char[DIRENT_BUFFER_SIZE]);
+
+    for (;;) {
+        const long buffer_fill(::syscall(SYS_getdents64, directory_fd, dirent_buffer.get(), DIRENT_BUFFER_SIZE));
+        if (buffer_fill <= 0) {
+            if (unlikely(buffer_fill == -1))
+                abort(errno);
+            break;
+        }
+
+        for (long offset(0); offset < buffer_fill and not aborted_;) {
+            const LinuxDirent64 &dirent(*reinterpret_cast<const LinuxDirent64 *>(dirent_buffer.get() + offset));
+            offset += dirent.d_reclen;
+            if (dirent.d_name[0] == '.'
+                and (dirent.d_name[1] == '\0' or (dirent.d_name[1] == '.' and dirent.d_name[2] == '\0')))
+                continue;
+
+            unsigned char type(dirent.d_type);
+            if (unlikely(type == DT_UNKNOWN)) { // Not all filesystems provide the type.
+                struct stat stat_buf;
+                if (::fstatat(directory_fd, dirent.d_name, &stat_buf, AT_SYMLINK_NOFOLLOW) == 0)
+                    type = IFTODT(stat_buf.st_mode);
+            }
+
+            const std::string path(node->path_ + "/" + dirent.d_name);
+            TreeWalkAction action;
+            try {
+                action = visitor_(path, type);
+            } catch (...) {
+                abort(std::current_exception());
+                break;
+            }
+
+            if (action == ABORT_WALK)
+                abort(errno);
+            else if (type == DT_DIR and action == CONTINUE_WALK) {
+                if (thread_pool_ == nullptr) // Only the root directory is scanned before we have a pool.
+                    thread_pool_.reset(new ThreadPool(thread_count_));
+                const auto subdirectory_node(std::make_shared<DirectoryNode>(path, node));
+                ++node->pending_count_;
+                thread_pool_->submit([this, subdirectory_node]{ scan(subdirectory_node); });
+            }
+        }
+
+        if (aborted_)
+            break;
+    }
+
+    ::close(directory_fd);
+    complete(node);
+}
+
+
+void ParallelTreeWalker::complete(const std::shared_ptr<DirectoryNode> &node) {
+    if (--node->pending_count_ != 0)
+        return;
+
+    if (post_visitor_ and not aborted_) {
+        try {
+            if (not post_visitor_(node->path_))
+                abort(errno);
+        } catch (...) {
+            abort(std::current_exception());
+        }
+    }
+
+    if (node->parent_ != nullptr)
+        complete(node->parent_);
+    else {
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        root_is_completed_ = true;
+        root_completed_.notify_all();
+    }
+}
+
+
+void ParallelTreeWalker::abort(const int error_code) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    if (not aborted_) {
+        abort_errno_ = error_code;
+        aborted_ = true;
+    }
+}
+
+
+void ParallelTreeWalker::abort(const std::exception_ptr &exception) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    if (not aborted_) {
+        first_exception_ = exception;
+        aborted_ = true;
+    }
+}
+
+
+} // unnamed namespace
+
+
+bool WalkDirectoryTree(const std::string &root_directory, const TreeVisitor &visitor, const TreePostVisitor &post_visitor,
+                       const unsigned thread_count)
+{
+    ParallelTreeWalker tree_walker(visitor, post_visitor, thread_count);
+    return tree_walker.walk(root_directory);
+}
+
+
 bool Directory::const_iterator::operator==(const const_iterator &rhs) {
     if (rhs.dir_handle_ == nullptr and dir_handle_ == nullptr)
         return true;
@@ -670,42 +865,13 @@ static void CloseDirWhilePreservingErrno(DIR * const dir_handle) {
 
 
 bool RemoveDirectory(const std::string &dir_name) {
-    errno = 0;
-    DIR *dir_handle(::opendir(dir_name.c_str()));
-    if (unlikely(dir_handle == nullptr))
-        return false;
-
-    struct dirent *entry;
-    while ((entry = ::readdir(dir_handle)) != nullptr) {
-        if (std::strcmp(entry->d_name, ".") == 0 or std::strcmp(entry->d_name, "..") == 0)
-            continue;
-
-        const std::string path(dir_name + "/" + std::string(entry->d_name));
-
-        if (entry->d_type == DT_DIR) {
-            if (unlikely(not RemoveDirectory(path))) {
-                CloseDirWhilePreservingErrno(dir_handle);
-                return false;
-            }
-        } else
-            ::unlink(path.c_str());
-
-        if (unlikely(errno != 0)) {
-            CloseDirWhilePreservingErrno(dir_handle);
-            return false;
-        }
-    }
-    if (unlikely(errno != 0)) { // readdir(2) failed!
-        CloseDirWhilePreservingErrno(dir_handle);
-        return false;
-    }
-
-    if (::unlikely(::rmdir(dir_name.c_str()) != 0)) {
-        CloseDirWhilePreservingErrno(dir_handle);
-        return false;
-    }
-
-    return likely(::closedir(dir_handle) == 0);
+    return WalkDirectoryTree(dir_name,
+                             [](const std::string &path, const unsigned char type) {
+                                 if (type == DT_DIR)
+                                     return CONTINUE_WALK;
+                                 return (::unlink(path.c_str()) == 0) ? CONTINUE_WALK : ABORT_WALK;
+                             },
+                             [](const std::string &directory_path) { return ::rmdir(directory_path.c_str()) == 0; });
 }
 
 
@@ -0,0 +1,473 @@
+/** \brief Implementation of the FrozenIniFile class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "FrozenIniFile.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "IniFile.h"
+#include "PerfectHash.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+const char CACHE_MAGIC[8] = { 'U', 'B', 'F', 'R', 'Z', 'I', 'N', 'I' };
+const uint32_t CACHE_VERSION(1);
+
+
+inline uint64_t HashEntryKey(const std::string &section_name, const std::string &variable_name, const uint32_t seed) {
+    uint64_t hash(PerfectHash::HashBytes(section_name, PerfectHash::SeedState(seed)));
+    hash ^= 0xFFu; // Can't occur in UTF-8 and therefore separates the section name from the variable name.
+    hash *= PerfectHash::FNV_PRIME;
+    return PerfectHash::Avalanche(PerfectHash::HashBytes(variable_name, hash));
+}
+
+
+static_assert(PerfectHash::NO_INDEX == UINT32_MAX, "PerfectHash::NO_INDEX must match FrozenIniFile::NO_INDEX!");
+
+
+struct FileSignature {
+    bool exists_;
+    int64_t modification_time_seconds_, modification_time_nanoseconds_;
+    uint64_t size_;
+public:
+    explicit FileSignature(const std::string &path) {
+        struct stat stat_buf;
+        exists_ = ::stat(path.c_str(), &stat_buf) == 0;
+        modification_time_seconds_     = exists_ ? stat_buf.st_mtim.tv_sec : 0;
+        modification_time_nanoseconds_ = exists_ ? stat_buf.st_mtim.tv_nsec : 0;
+        size_                          = exists_ ? stat_buf.st_size : 0;
+    }
+};
+
+
+inline void AppendUint32(const uint32_t value, std::string * const data) {
+    data->append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+
+inline void AppendUint64(const uint64_t value, std::string * const data) {
+    data->append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+
+inline void AppendString(const std::string &s, std::string * const data) {
+    AppendUint32(s.size(), data);
+    data->append(s);
+}
+
+
+void AppendUint32Vector(const std::vector<uint32_t> &values, std::string * const data) {
+    AppendUint32(values.size(), data);
+    data->append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(uint32_t));
+}
+
+
+// Reads what the Append* functions above have written.  All read functions return false if we run out of data.
+class CacheReader {
+    const char *next_, * const end_;
+public:
+    explicit CacheReader(const std::string &data): next_(data.data()), end_(data.data() + data.size()) { }
+
+    inline bool atEnd() const { return next_ == end_; }
+
+    bool readBytes(void * const bytes, const size_t count) {
+        if (unlikely(static_cast<size_t>(end_ - next_) < count))
+            return false;
+        std::memcpy(bytes, next_, count);
+        next_ += count;
+        return true;
+    }
+
+    inline bool readUint32(uint32_t * const value) { return readBytes(value, sizeof *value); }
+    inline bool readUint64(uint64_t * const value) { return readBytes(value, sizeof *value); }
+
+    bool readString(std::string * const s) {
+        uint32_t size;
+        if (not readUint32(&size) or unlikely(static_cast<size_t>(end_ - next_) < size))
+            return false;
+        s->assign(next_, size);
+        next_ += size;
+        return true;
+    }
+
+    template<typename PlainOldData> bool readVector(std::vector<PlainOldData> * const values) {
+        uint32_t size;
+        if (not readUint32(&size) or unlikely(static_cast<size_t>(end_ - next_) / sizeof(PlainOldData) < size))
+            return false;
+        values->resize(size);
+        return readBytes(values->data(), size * sizeof(PlainOldData));
+    }
+};
+
+
+} // unnamed namespace
+
+
+FrozenIniFile::FrozenIniFile(const IniFile &ini_file): ini_file_name_(ini_file.getFilename()), loaded_from_cache_(false) {
+    freeze(ini_file);
+}
+
+
+FrozenIniFile::FrozenIniFile(const std::string &ini_file_name, const std::string &cache_path)
+    : ini_file_name_(FileUtil::MakeAbsolutePath(ini_file_name.empty() ? IniFile::DefaultIniFileName() : ini_file_name)),
+      loaded_from_cache_(false)
+{
+    if (not cache_path.empty() and loadCache(cache_path)) {
+        loaded_from_cache_ = true;
+        return;
+    }
+
+    const IniFile ini_file(ini_file_name_);
+    freeze(ini_file);
+    if (not cache_path.empty())
+        writeCache(cache_path, ini_file.getConsultedFiles());
+}
+
+
+const std::string *FrozenIniFile::find(const std::string &section_name, const std::string &variable_name) const {
+    const uint32_t entry_index(PerfectHash::LookupTable(entry_table_.seeds_, entry_table_.slots_,
+                                                        [&section_name, &variable_name](const uint32_t seed) {
+                                                            return HashEntryKey(section_name, variable_name, seed);
+                                                        }));
+    if (entry_index == NO_INDEX)
+        return nullptr;
+
+    // The slot may belong to another key, so we have to verify the match:
+    const Entry &entry(entries_[entry_index]);
+    if (strings_[entry.name_index_] != variable_name
+        or strings_[sections_[entry.section_index_].name_index_] != section_name)
+        return nullptr;
+
+    return &strings_[entry.value_index_];
+}
+
+
+bool FrozenIniFile::lookup(const std::string &section_name, const std::string &variable_name, std::string * const s) const {
+    const std::string * const value(find(section_name, variable_name));
+    if (value == nullptr) {
+        s->clear();
+        return false;
+    }
+
+    *s = *value;
+    return true;
+}
+
+
+std::vector<std::string> FrozenIniFile::getSections() const {
+    std::vector<std::string> section_names;
+    section_names.reserve(sections_.size());
+    for (const auto &section : sections_)
+        section_names.emplace_back(strings_[section.name_index_]);
+
+    return section_names;
+}
+
+
+std::vector<std::string> FrozenIniFile::getSectionEntryNames(const std::string &section_name) const {
+    std::vector<std::string> entry_names;
+    const uint32_t section_index(findSection(section_name));
+    if (section_index == NO_INDEX)
+        return entry_names;
+
+    const Section &section(sections_[section_index]);
+    entry_names.reserve(section.entry_count_);
+    for (uint32_t entry_index(section.first_entry_index_); entry_index < section.first_entry_index_ + section.entry_count_;
+         ++entry_index)
+        entry_names.emplace_back(strings_[entries_[entry_index].name_index_]);
+
+    return entry_names;
+}
+
+
+const std::string &FrozenIniFile::getString(const std::string &section_name, const std::string &variable_name) const {
+    return getStringOrDie(section_name, variable_name);
+}
+
+
+std::string FrozenIniFile::getString(const std::string &section_name, const std::string &variable_name,
+                                     const std::string &default_value) const
+{
+    const std::string * const value(find(section_name, variable_name));
+    return (value == nullptr) ? default_value : *value;
+}
+
+
+unsigned FrozenIniFile::getUnsigned(const std::string &section_name, const std::string &variable_name) const {
+    unsigned number;
+    if (unlikely(not StringUtil::ToUnsigned(getStringOrDie(section_name, variable_name), &number)))
+        LOG_ERROR("invalid unsigned entry \"" + variable_name + "\" in section \"" + section_name + "\"!");
+
+    return number;
+}
+
+
+unsigned FrozenIniFile::getUnsigned(const std::string &section_name, const std::string &variable_name,
+                                    const unsigned default_value) const
+{
+    return variableIsDefined(section_name, variable_name) ? getUnsigned(section_name, variable_name) : default_value;
+}
+
+
+uint64_t FrozenIniFile::getUint64T(const std::string &section_name, const std::string &variable_name) const {
+    uint64_t number;
+    if (unlikely(not StringUtil::ToUInt64T(getStringOrDie(section_name, variable_name), &number)))
+        LOG_ERROR("invalid uint64_t entry \"" + variable_name + "\" in section \"" + section_name + "\"!");
+
+    return number;
+}
+
+
+uint64_t FrozenIniFile::getUint64T(const std::string &section_name, const std::string &variable_name,
+                                   const uint64_t default_value) const
+{
+    return variableIsDefined(section_name, variable_name) ? getUint64T(section_name, variable_name) : default_value;
+}
+
+
+long FrozenIniFile::getInteger(const std::string &section_name, const std::string &variable_name) const {
+    long number;
+    if (unlikely(not StringUtil::ToNumber(getStringOrDie(section_name, variable_name), &number)))
+        LOG_ERROR("invalid long entry \"" + variable_name + "\" in section \"" + section_name + "\"!");
+
+    return number;
+}
+
+
+long FrozenIniFile::getInteger(const std::string &section_name, const std::string &variable_name,
+                               const long default_value) const
+{
+    return variableIsDefined(section_name, variable_name) ? getInteger(section_name, variable_name) : default_value;
+}
+
+
+double FrozenIniFile::getDouble(const std::string &section_name, const std::string &variable_name) const {
+    double number;
+    if (unlikely(not StringUtil::ToDouble(getStringOrDie(section_name, variable_name), &number)))
+        LOG_ERROR("invalid double entry \"" + variable_name + "\" in section \"" + section_name + "\"!");
+
+    return number;
+}
+
+
+double FrozenIniFile::getDouble(const std::string &section_name, const std::string &variable_name,
+                                const double default_value) const
+{
+    return variableIsDefined(section_name, variable_name) ? getDouble(section_name, variable_name) : default_value;
+}
+
+
+bool FrozenIniFile::getBool(const std::string &section_name, const std::string &variable_name) const {
+    const std::string &value(getStringOrDie(section_name, variable_name));
+    bool retval;
+    if (unlikely(not StringUtil::ToBool(value, &retval)))
+        LOG_ERROR("invalid boolean value in section \"" + section_name + "\", entry \"" + variable_name + "\" (bad value is \""
+                  + value + "\")!");
+
+    return retval;
+}
+
+
+bool FrozenIniFile::getBool(const std::string &section_name, const std::string &variable_name,
+                            const bool default_value) const
+{
+    return variableIsDefined(section_name, variable_name) ? getBool(section_name, variable_name) : default_value;
+}
+
+
+void FrozenIniFile::freeze(const IniFile &ini_file) {
+    std::unordered_map<std::string, uint32_t> strings_and_indices;
+    const auto intern([this, &strings_and_indices](const std::string &s) {
+        const auto string_and_index(strings_and_indices.emplace(s, strings_.size()));
+        if (string_and_index.second)
+            strings_.emplace_back(s);
+        return string_and_index.first->second;
+    });
+
+    for (const auto &ini_section : ini_file) {
+        Section section;
+        section.name_index_        = intern(ini_section.getSectionName());
+        section.first_entry_index_ = entries_.size();
+        for (const auto &ini_entry : ini_section) {
+            if (ini_entry.name_.empty()) // A comment-only line.
+                continue;
+
+            Entry entry;
+            entry.section_index_ = sections_.size();
+            entry.name_index_    = intern(ini_entry.name_);
+            entry.value_index_   = intern(ini_entry.value_);
+            entries_.emplace_back(entry);
+        }
+        section.entry_count_ = entries_.size() - section.first_entry_index_;
+        sections_.emplace_back(section);
+    }
+
+    PerfectHash::BuildTable(sections_.size(), [this](const size_t section_index, const uint32_t seed) {
+                                return PerfectHash::HashString(strings_[sections_[section_index].name_index_], seed);
+                            }, &section_table_.seeds_, &section_table_.slots_);
+    PerfectHash::BuildTable(entries_.size(), [this](const size_t entry_index, const uint32_t seed) {
+                                const Entry &entry(entries_[entry_index]);
+                                return HashEntryKey(strings_[sections_[entry.section_index_].name_index_],
+                                                    strings_[entry.name_index_], seed);
+                            }, &entry_table_.seeds_, &entry_table_.slots_);
+}
+
+
+uint32_t FrozenIniFile::findSection(const std::string &section_name) const {
+    const uint32_t section_index(PerfectHash::LookupTable(section_table_.seeds_, section_table_.slots_,
+                                                          [&section_name](const uint32_t seed) {
+                                                              return PerfectHash::HashString(section_name, seed);
+                                                          }));
+    if (section_index == NO_INDEX or strings_[sections_[section_index].name_index_] != section_name)
+        return NO_INDEX;
+
+    return section_index;
+}
+
+
+const std::string &FrozenIniFile::getStringOrDie(const std::string &section_name, const std::string &variable_name) const {
+    const std::string * const value(find(section_name, variable_name));
+    if (unlikely(value == nullptr)) {
+        if (not sectionIsDefined(section_name))
+            LOG_ERROR("no such section: \"" + section_name + "\"! (variable: \"" + variable_name + "\")");
+        LOG_ERROR("can't find \"" + variable_name + "\" in section \"" + section_name + "\"!");
+    }
+
+    return *value;
+}
+
+
+bool FrozenIniFile::loadCache(const std::string &cache_path) {
+    std::string data;
+    if (not FileUtil::ReadString(cache_path, &data))
+        return false;
+    CacheReader reader(data);
+
+    char magic[sizeof CACHE_MAGIC];
+    uint32_t version;
+    std::string ini_file_name;
+    if (not reader.readBytes(magic, sizeof magic) or std::memcmp(magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0
+        or not reader.readUint32(&version) or version != CACHE_VERSION or not reader.readString(&ini_file_name)
+        or ini_file_name != ini_file_name_)
+        return false;
+
+    // Is the cache still up to date?
+    uint32_t consulted_file_count;
+    if (not reader.readUint32(&consulted_file_count))
+        return false;
+    for (uint32_t i(0); i < consulted_file_count; ++i) {
+        std::string path;
+        uint32_t exists;
+        uint64_t modification_time_seconds, modification_time_nanoseconds, size;
+        if (not reader.readString(&path) or not reader.readUint32(&exists) or not reader.readUint64(&modification_time_seconds)
+            or not reader.readUint64(&modification_time_nanoseconds) or not reader.readUint64(&size))
+            return false;
+
+        const FileSignature signature(path);
+        if (signature.exists_ != (exists != 0) or static_cast<uint64_t>(signature.modification_time_seconds_) != modification_time_seconds
+            or static_cast<uint64_t>(signature.modification_time_nanoseconds_) != modification_time_nanoseconds
+            or signature.size_ != size)
+            return false;
+    }
+
+    uint32_t string_count;
+    if (not reader.readUint32(&string_count))
+        return false;
+    strings_.resize(string_count);
+    for (auto &s : strings_) {
+        if (not reader.readString(&s))
+            return false;
+    }
+
+    if (not reader.readVector(&sections_) or not reader.readVector(&entries_) or not reader.readVector(&section_table_.seeds_)
+        or not reader.readVector(&section_table_.slots_) or not reader.readVector(&entry_table_.seeds_)
+        or not reader.readVector(&entry_table_.slots_) or not reader.atEnd())
+        return false;
+
+    // Guard against corrupt caches, as our lookups don't do any range checks:
+    if (section_table_.seeds_.empty() or section_table_.slots_.empty() or entry_table_.seeds_.empty()
+        or entry_table_.slots_.empty())
+        return false;
+    for (const auto &section : sections_) {
+        if (section.name_index_ >= strings_.size() or section.first_entry_index_ > entries_.size()
+            or section.entry_count_ > entries_.size() - section.first_entry_index_)
+            return false;
+    }
+    for (const auto &entry : entries_) {
+        if (entry.section_index_ >= sections_.size() or entry.name_index_ >= strings_.size()
+            or entry.value_index_ >= strings_.size())
+            return false;
+    }
+    for (const auto section_index : section_table_.slots_) {
+        if (section_index != NO_INDEX and section_index >= sections_.size())
+            return false;
+    }
+    for (const auto entry_index : entry_table_.slots_) {
+        if (entry_index != NO_INDEX and entry_index >= entries_.size())
+            return false;
+    }
+
+    return true;
+}
+
+
+void FrozenIniFile::writeCache(const std::string &cache_path, const std::vector<std::string> &consulted_files) const {
+    std::string data;
+    data.append(CACHE_MAGIC, sizeof CACHE_MAGIC);
+    AppendUint32(CACHE_VERSION, &data);
+    AppendString(ini_file_name_, &data);
+
+    AppendUint32(consulted_files.size(), &data);
+    for (const auto &consulted_file : consulted_files) {
+        const FileSignature signature(consulted_file);
+        AppendString(consulted_file, &data);
+        AppendUint32(signature.exists_, &data);
+        AppendUint64(signature.modification_time_seconds_, &data);
+        AppendUint64(signature.modification_time_nanoseconds_, &data);
+        AppendUint64(signature.size_, &data);
+    }
+
+    AppendUint32(strings_.size(), &data);
+    for (const auto &s : strings_)
+        AppendString(s, &data);
+
+    AppendUint32(sections_.size(), &data);
+    data.append(reinterpret_cast<const char *>(sections_.data()), sections_.size() * sizeof(Section));
+    AppendUint32(entries_.size(), &data);
+    data.append(reinterpret_cast<const char *>(entries_.data()), entries_.size() * sizeof(Entry));
+    AppendUint32Vector(section_table_.seeds_, &data);
+    AppendUint32Vector(section_table_.slots_, &data);
+    AppendUint32Vector(entry_table_.seeds_, &data);
+    AppendUint32Vector(entry_table_.slots_, &data);
+
+    // Concurrently started processes may race to replace the cache, hence the write to a private file and the atomic rename.
+    const std::string temp_path(cache_path + "." + std::to_string(::getpid()));
+    if (not FileUtil::WriteString(temp_path, data) or ::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        LOG_DEBUG("failed to write the cache \"" + cache_path + "\" for \"" + ini_file_name_ + "\"!");
+    }
+}
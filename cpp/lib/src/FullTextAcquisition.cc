@@ -0,0 +1,439 @@
+/** \file   FullTextAcquisition.cc
+ *  \brief  Downloading of the documents linked from MARC records and extraction of their full texts.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2015-2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FullTextAcquisition.h"
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+#include "Compiler.h"
+#include "Downloader.h"
+#include "HttpHeader.h"
+#include "MediaTypeUtil.h"
+#include "OCR.h"
+#include "PdfUtil.h"
+#include "SmartDownloader.h"
+#include "StringUtil.h"
+#include "TextUtil.h"
+#include "UrlUtil.h"
+#include "util.h"
+
+
+namespace FullTextAcquisition {
+
+
+namespace {
+
+
+// In bytes.  We stop extracting text from an HTML page once we have this much.
+constexpr size_t MAX_HTML_TEXT_SIZE(4 * 1024 * 1024);
+
+
+// \note Sets "error_message" when it returns false.
+bool GetDocumentAndMediaType(const std::string &url, const unsigned timeout, std::string * const document,
+                             std::string * const media_type, std::string * const media_subtype,
+                             std::string * const http_header_charset, std::string * const error_message)
+{
+    if (not SmartDownload(url, timeout, document, http_header_charset, error_message))
+        return false;
+
+    *media_type = MediaTypeUtil::GetMediaType(*document, media_subtype);
+    if (media_type->empty()) {
+        *error_message = "Failed to get media type";
+        return false;
+    }
+
+    return true;
+}
+
+
+// Direct links to PDF documents would be handled by SmartDownload()'s SimpleSuffixDownloader w/ a plain download.
+bool IsDirectPdfLink(const std::string &url) {
+    return StringUtil::IsProperSuffixOfIgnoreCase(".pdf", url) and url.find("dspace") == std::string::npos;
+}
+
+
+// Streams the download of "url" into "pdf_path" so that large PDF's never have to be held in memory.  If we did not
+// get a PDF, e.g. because the server sent us an HTML error page, the document will be returned in "document".
+// \note Sets "error_message" when it returns false.
+bool GetPdfFileOrDocumentAndMediaType(const std::string &url, const unsigned timeout, const std::string &pdf_path,
+                                      std::string * const document, std::string * const media_type,
+                                      std::string * const media_subtype, std::string * const http_header_charset,
+                                      std::string * const error_message)
+{
+    const int fd(::open(pdf_path.c_str(), O_WRONLY | O_TRUNC));
+    if (unlikely(fd == -1)) {
+        *error_message = "failed to open \"" + pdf_path + "\" for writing";
+        return false;
+    }
+
+    std::string message_header;
+    const bool download_succeeded(DownloadToFileDescriptor(url, fd, timeout, error_message, Downloader::Params(),
+                                                           &message_header));
+    ::close(fd);
+    if (not download_succeeded)
+        return false;
+
+    const HttpHeader http_header(message_header);
+    if (http_header.getStatusCode() < 200 or http_header.getStatusCode() > 299) {
+        *error_message = "got HTTP status code " + std::to_string(http_header.getStatusCode());
+        return false;
+    }
+    *http_header_charset = http_header.getCharset();
+
+    *media_type = MediaTypeUtil::GetFileMediaType(pdf_path);
+    if (StringUtil::StartsWith(*media_type, "application/pdf"))
+        return true;
+
+    if (not FileUtil::ReadString(pdf_path, document)) {
+        *error_message = "failed to read \"" + pdf_path + "\"";
+        return false;
+    }
+    *media_type = MediaTypeUtil::GetMediaType(*document, media_subtype);
+    if (media_type->empty()) {
+        *error_message = "Failed to get media type";
+        return false;
+    }
+
+    return true;
+}
+
+
+const std::map<std::string, std::string> marc_to_tesseract_language_codes_map {
+    { "bul", "bul" },
+    { "cze", "ces" },
+    { "dan", "dan" },
+    { "dut", "nld" },
+    { "eng", "eng" },
+    { "fin", "fin" },
+    { "fre", "fra" },
+    { "ger", "deu" },
+    { "grc", "grc" },
+    { "heb", "heb" },
+    { "hun", "hun" },
+    { "ita", "ita" },
+    { "lat", "lat" },
+    { "nor", "nor" },
+    { "pol", "pol" },
+    { "por", "por" },
+    { "rus", "rus" },
+    { "slv", "slv" },
+    { "spa", "spa" },
+    { "swe", "swe" },
+};
+
+
+std::string GetTesseractLanguageCode(const MARC::Record &record) {
+    const auto map_iter(marc_to_tesseract_language_codes_map.find(MARC::GetLanguageCode(record)));
+    return (map_iter == marc_to_tesseract_language_codes_map.cend()) ? "" : map_iter->second;
+}
+
+
+// Checks subfields "3" and "z" to see if they start w/ "Rezension".
+bool IsProbablyAReview(const MARC::Subfields &subfields) {
+    const std::vector<std::string> _3_subfields(subfields.extractSubfields('3'));
+    if (not _3_subfields.empty()) {
+        for (const auto &subfield_value : _3_subfields) {
+            if (StringUtil::StartsWith(subfield_value, "Rezension"))
+                return true;
+        }
+    } else {
+        const std::vector<std::string> z_subfields(subfields.extractSubfields('z'));
+        for (const auto &subfield_value : z_subfields) {
+            if (StringUtil::StartsWith(subfield_value, "Rezension"))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+// \return The concatenated contents of all 520$a subfields.
+std::string GetTextFrom520a(const MARC::Record &record) {
+    std::string concatenated_text;
+
+    for (const auto &field : record.getTagRange("520")) {
+        const MARC::Subfields subfields(field.getSubfields());
+        if (subfields.hasSubfield('a')) {
+            if (not concatenated_text.empty())
+                concatenated_text += ' ';
+            concatenated_text += subfields.getFirstSubfieldWithCode('a');
+        }
+    }
+
+    return concatenated_text;
+}
+
+
+bool IsUTF8(const std::string &charset) {
+    return charset == "utf-8" or charset == "utf8" or charset == "UFT-8" or charset == "UTF8";
+}
+
+
+std::string ConvertPdfFileToPlainText(const std::string &pdf_path, const std::string &tesseract_language_code,
+                                      const unsigned pdf_extraction_timeout, std::string * const error_message)
+{
+    std::string extracted_text;
+    if (PdfUtil::PdfFileContainsNoText(pdf_path)) {
+        if (not PdfUtil::GetTextFromImagePDFFile(pdf_path, tesseract_language_code, &extracted_text, pdf_extraction_timeout)) {
+            *error_message = "Failed to extract text from an image PDF!";
+            LOG_WARNING(*error_message);
+            return "";
+        }
+        return TextUtil::CollapseWhitespace(&extracted_text);
+    }
+    PdfUtil::ExtractTextFromFile(pdf_path, &extracted_text, "", "", pdf_extraction_timeout);
+    return TextUtil::CollapseWhitespace(&extracted_text);
+}
+
+
+std::string ConvertToPlainText(const std::string &media_type, const std::string &media_subtype, const std::string &http_header_charset,
+                               const std::string &tesseract_language_code, const std::string &document,
+                               const unsigned pdf_extraction_timeout, std::string * const error_message)
+{
+    std::string extracted_text;
+    if (media_type == "text/html" or media_type == "text/xhtml") {
+        extracted_text = TextUtil::ExtractTextFromHtml(document, http_header_charset, MAX_HTML_TEXT_SIZE);
+        return TextUtil::CollapseWhitespace(&extracted_text);
+    }
+
+    if (media_type == "text/xml" and media_subtype == "tei") {
+        extracted_text = TextUtil::ExtractTextFromUBTei(document);
+        return TextUtil::CollapseWhitespace(&extracted_text);
+    }
+
+    if (StringUtil::StartsWith(media_type, "text/")) {
+        if (not (media_type == "text/plain"))
+            LOG_WARNING("treating " + media_type + " as text/plain");
+
+        if (IsUTF8(http_header_charset))
+            return document;
+
+        std::string error_msg;
+        std::unique_ptr<TextUtil::EncodingConverter> encoding_converter(TextUtil::EncodingConverter::Factory(http_header_charset,
+                                                                                                             "utf8", &error_msg));
+        if (encoding_converter.get() == nullptr) {
+            LOG_WARNING("can't convert from \"" + http_header_charset + "\" to UTF-8! (" + error_msg + ")");
+            return document;
+        }
+
+        std::string utf8_document;
+        if (unlikely(not encoding_converter->convert(document, &utf8_document)))
+            LOG_WARNING("conversion error while converting text from \"" + http_header_charset + "\" to UTF-8!");
+        return TextUtil::CollapseWhitespace(&utf8_document);
+    }
+
+    if (StringUtil::StartsWith(media_type, "application/pdf")) {
+        // Text PDF's can be handled straight from memory, image PDF's need a file for pdfimages:
+        if (PdfUtil::HaveInProcessExtraction() and not PdfUtil::PdfDocContainsNoText(document)
+            and PdfUtil::ForEachPageText(document,
+                                         [&extracted_text](const unsigned /*page_no*/, const std::string &page_text) {
+                                             extracted_text += page_text;
+                                             extracted_text += ' ';
+                                             return true;
+                                         }, /* first_page = */1, /* last_page = */0, pdf_extraction_timeout))
+            return TextUtil::CollapseWhitespace(&extracted_text);
+
+        extracted_text.clear();
+        const FileUtil::AutoTempFile pdf_file;
+        if (not FileUtil::WriteString(pdf_file.getFilePath(), document)) {
+            *error_message = "Failed to write the PDF to a temp file!";
+            LOG_WARNING(*error_message);
+            return "";
+        }
+        return ConvertPdfFileToPlainText(pdf_file.getFilePath(), tesseract_language_code, pdf_extraction_timeout, error_message);
+    }
+
+    if (media_type == "image/jpeg" or media_type == "image/png") {
+        if (OCR(document, &extracted_text, tesseract_language_code) != 0) {
+            *error_message = "Failed to extract text by using OCR on " + media_type;
+            LOG_WARNING(*error_message);
+            return "";
+        }
+        return TextUtil::CollapseWhitespace(&extracted_text);
+    }
+
+    *error_message = "Don't know how to handle media type: " + media_type;
+    LOG_WARNING(*error_message);
+    return "";
+}
+
+
+// \return The SHA-1 hash of the contents of the file "path" or the empty string if we could not read the file.
+std::string GetFileHash(const std::string &path) {
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (unlikely(fd == -1))
+        return "";
+
+    SHA_CTX context;
+    ::SHA1_Init(&context);
+    char buffer[64 * 1024];
+    ssize_t count;
+    while ((count = ::read(fd, buffer, sizeof(buffer))) > 0)
+        ::SHA1_Update(&context, buffer, count);
+    ::close(fd);
+    if (unlikely(count == -1))
+        return "";
+
+    unsigned char hash[SHA_DIGEST_LENGTH];
+    ::SHA1_Final(hash, &context);
+    return std::string(reinterpret_cast<const char *>(hash), SHA_DIGEST_LENGTH);
+}
+
+
+} // unnamed namespace
+
+
+bool ExtractedTextCache::lookup(const std::string &key, std::string * const text, std::string * const error_message) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    const auto key_and_entry(key_to_entry_map_.find(key));
+    if (key_and_entry == key_to_entry_map_.cend())
+        return false;
+
+    *text = key_and_entry->second.text_;
+    *error_message = key_and_entry->second.error_message_;
+    ++hit_count_;
+    return true;
+}
+
+
+void ExtractedTextCache::insert(const std::string &key, const std::string &text, const std::string &error_message) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    if (not key_to_entry_map_.emplace(key, Entry{ text, error_message }).second)
+        return;
+    keys_in_insertion_order_.emplace_back(key);
+    total_size_ += text.size();
+
+    while (total_size_ > max_total_size_ and keys_in_insertion_order_.size() > 1) {
+        const auto oldest_key_and_entry(key_to_entry_map_.find(keys_in_insertion_order_.front()));
+        total_size_ -= oldest_key_and_entry->second.text_.size();
+        key_to_entry_map_.erase(oldest_key_and_entry);
+        keys_in_insertion_order_.pop_front();
+    }
+}
+
+
+size_t ExtractedTextCache::getHitCount() const {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    return hit_count_;
+}
+
+
+std::vector<std::string> GetUrls(const MARC::Record &record) {
+    std::vector<std::string> urls;
+    for (const auto &_856_field : record.getTagRange("856")) {
+        const MARC::Subfields _856_subfields(_856_field.getSubfields());
+
+        if (_856_field.getIndicator1() == '7' or not _856_subfields.hasSubfield('u'))
+            continue;
+
+        if (IsProbablyAReview(_856_subfields))
+            continue;
+
+        urls.emplace_back(_856_subfields.getFirstSubfieldWithCode('u'));
+    }
+
+    return urls;
+}
+
+
+bool Download(const std::string &url, const unsigned timeout, Document * const document) {
+    document->url_ = url;
+
+    std::string error_message;
+    bool success;
+    if (IsDirectPdfLink(url)) {
+        document->pdf_file_.reset(new FileUtil::AutoTempFile());
+        success = GetPdfFileOrDocumentAndMediaType(url, timeout, document->pdf_file_->getFilePath(), &document->contents_,
+                                                   &document->media_type_, &document->media_subtype_,
+                                                   &document->http_header_charset_, &error_message);
+    } else
+        success = GetDocumentAndMediaType(url, timeout, &document->contents_, &document->media_type_, &document->media_subtype_,
+                                          &document->http_header_charset_, &error_message);
+    if (not success) {
+        LOG_WARNING("URL " + url + ": could not get document and media type! (" + error_message + ")");
+        document->error_message_ = "could not get document and media type! (" + error_message + ")";
+    } else
+        document->content_hash_ = document->isPdfFile() ? GetFileHash(document->pdf_file_->getFilePath())
+                                                        : StringUtil::Sha1(document->contents_);
+
+    return success;
+}
+
+
+std::string ExtractFullText(const MARC::Record &record, const std::vector<Document> &documents, const unsigned pdf_extraction_timeout,
+                            std::vector<FullTextCache::EntryUrl> * const entry_urls, ExtractedTextCache * const extracted_text_cache)
+{
+    const std::string ppn(record.getControlNumber());
+    const std::string tesseract_language_code(GetTesseractLanguageCode(record));
+    std::string combined_text(GetTextFrom520a(record));
+
+    entry_urls->clear();
+    for (const auto &document : documents) {
+        FullTextCache::EntryUrl entry_url;
+        entry_url.id_ = ppn;
+        entry_url.url_ = document.url_;
+        std::string scheme, username_password, authority, port, path, params, query, fragment, relative_url;
+        if (UrlUtil::ParseUrl(document.url_, &scheme, &username_password, &authority, &port, &path, &params, &query, &fragment,
+                              &relative_url))
+            entry_url.domain_ = authority;
+
+        if (document.anErrorOccurred())
+            entry_url.error_message_ = document.error_message_;
+        else {
+            // OCR results depend on the language, so identical documents only share their text if the language matches:
+            const std::string cache_key(document.content_hash_.empty() ? "" : document.content_hash_ + tesseract_language_code);
+            std::string extracted_text, error_message;
+            if (extracted_text_cache == nullptr or cache_key.empty()
+                or not extracted_text_cache->lookup(cache_key, &extracted_text, &error_message))
+            {
+                extracted_text = document.isPdfFile()
+                                 ? ConvertPdfFileToPlainText(document.pdf_file_->getFilePath(), tesseract_language_code,
+                                                             pdf_extraction_timeout, &error_message)
+                                 : ConvertToPlainText(document.media_type_, document.media_subtype_, document.http_header_charset_,
+                                                      tesseract_language_code, document.contents_, pdf_extraction_timeout,
+                                                      &error_message);
+                if (extracted_text_cache != nullptr and not cache_key.empty())
+                    extracted_text_cache->insert(cache_key, extracted_text, error_message);
+            }
+
+            if (unlikely(extracted_text.empty())) {
+                LOG_WARNING("URL " + document.url_ + ": failed to extract text from the downloaded document! (" + error_message + ")");
+                entry_url.error_message_ = "failed to extract text from the downloaded document! (" + error_message + ")";
+            } else {
+                if (combined_text.empty())
+                    combined_text.swap(extracted_text);
+                else
+                    combined_text += " " + extracted_text;
+            }
+        }
+        entry_urls->emplace_back(entry_url);
+    }
+
+    return TextUtil::CollapseAndTrimWhitespace(&combined_text);
+}
+
+
+void AddFullTextLink(MARC::Record * const record) {
+    record->insertField("FUL", { { 'e', "http://localhost/cgi-bin/full_text_lookup?id=" + record->getControlNumber() } });
+}
+
+
+} // namespace FullTextAcquisition
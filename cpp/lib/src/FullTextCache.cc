@@ -19,7 +19,6 @@
  */
 #include "FullTextCache.h"
 #include <algorithm>
-#include <tuple>
 #include <ctime>
 #include "Compiler.h"
 #include "DbRow.h"
@@ -33,6 +32,7 @@
 
 constexpr unsigned MIN_CACHE_EXPIRE_TIME_ON_ERROR(42300 * 60); // About 1 month in seconds.
 constexpr unsigned MAX_CACHE_EXPIRE_TIME_ON_ERROR(42300 * 60 * 2); // About 2 months in seconds.
+constexpr unsigned EXPIRATION_REQUESTS_PER_SECOND(500); // Keeps expiration from slowing down concurrent insertions.
 
 
 bool FullTextCache::getDomainFromUrl(const std::string &url, std::string * const domain) const {
@@ -47,6 +47,9 @@ bool FullTextCache::getDomainFromUrl(const std::string &url, std::string * const
 
 
 bool FullTextCache::entryExpired(const std::string &id, std::vector<std::string> urls) {
+    if (id_filter_ != nullptr and not id_filter_->contains(id))
+        return true;
+
     Entry entry;
     if (not getEntry(id, &entry))
         return true;
@@ -64,8 +67,18 @@ bool FullTextCache::entryExpired(const std::string &id, std::vector<std::string>
 }
 
 
-void FullTextCache::expireEntries() {
-    full_text_cache_urls_.deleteRange("expiration", Elasticsearch::RO_LTE, "now");
+std::shared_ptr<const BloomFilter> FullTextCache::getIdFilter() const {
+    const auto ids(full_text_cache_.selectAll("id"));
+    std::shared_ptr<BloomFilter> id_filter(new BloomFilter(ids.size()));
+    for (const auto &id : ids)
+        id_filter->add(id);
+
+    return id_filter;
+}
+
+
+std::string FullTextCache::expireEntries() {
+    return full_text_cache_.startDeleteRange("expiration", Elasticsearch::RO_LTE, "now", EXPIRATION_REQUESTS_PER_SECOND);
 }
 
 
@@ -136,42 +149,16 @@ bool FullTextCache::getFullText(const std::string &id, std::string * const full_
 }
 
 
-const std::string US("\x1F"); // ASCII unit separator
-
-
 std::vector<FullTextCache::EntryGroup> FullTextCache::getEntryGroupsByDomainAndErrorMessage() const {
-    const auto results(full_text_cache_urls_.simpleSelect({ "url", "domain", "error_message", "id" }));
-
-    std::unordered_map<std::string, std::tuple<std::string, std::string, unsigned>> domains_and_errors_to_ids_and_urls_and_counts_map;
-    for (const auto &map : results) {
-        const auto url_pair(map.find("url"));
-        const auto domain_pair(map.find("domain"));
-        const auto error_message_pair(map.find("error_message"));
-        if (url_pair == map.cend() or domain_pair == map.cend() or error_message_pair == map.cend())
-            continue;
-
-        const auto id_pair(map.find("id"));
-        const auto key(domain_pair->second + US + error_message_pair->second);
-        auto id_and_url_and_count(domains_and_errors_to_ids_and_urls_and_counts_map.find(key));
-        if (id_and_url_and_count != domains_and_errors_to_ids_and_urls_and_counts_map.end())
-            ++std::get<2>(id_and_url_and_count->second);
-        else
-            domains_and_errors_to_ids_and_urls_and_counts_map[key] = std::make_tuple(id_pair->second, url_pair->second, 1);
-    }
+    const auto value_groups(full_text_cache_urls_.countDistinctValues({ "domain", "error_message" },
+                                                                      /* example_fields = */{ "id", "url" }));
 
     std::vector<EntryGroup> groups;
-    groups.reserve(domains_and_errors_to_ids_and_urls_and_counts_map.size());
-    for (const auto &domain_and_error_to_id_and_url_and_count : domains_and_errors_to_ids_and_urls_and_counts_map) {
-        std::vector<std::string> parts;
-        if (unlikely(StringUtil::Split(domain_and_error_to_id_and_url_and_count.first, US, &parts) != 2))
-            LOG_ERROR("This should never happen (" + std::to_string(parts.size()) + "): "
-                      + StringUtil::CStyleEscape(domain_and_error_to_id_and_url_and_count.first));
-
-        groups.emplace_back(EntryGroup(std::get<2>(domain_and_error_to_id_and_url_and_count.second),
-                                       parts[0], parts[1],
-                                       std::get<0>(domain_and_error_to_id_and_url_and_count.second),
-                                       std::get<1>(domain_and_error_to_id_and_url_and_count.second)));
-    }
+    groups.reserve(value_groups.size());
+    for (const auto &value_group : value_groups)
+        groups.emplace_back(EntryGroup(value_group.count_, value_group.values_[0], value_group.values_[1],
+                                       GetValueOrEmptyString(value_group.example_document_, "id"),
+                                       GetValueOrEmptyString(value_group.example_document_, "url")));
 
     std::sort(groups.begin(), groups.end(), [](const EntryGroup &eg1, const EntryGroup &eg2){ return eg1.count_ > eg2.count_;});
     return groups;
@@ -222,6 +209,75 @@ unsigned FullTextCache::getSize() const {
 }
 
 
+FullTextCache::Stats FullTextCache::computeStats() const {
+    Stats stats;
+    stats.creation_time_ = std::time(nullptr);
+    stats.cache_size_ = getSize();
+    stats.error_count_ = getErrorCount();
+    stats.error_groups_ = getEntryGroupsByDomainAndErrorMessage();
+    for (const auto &value_group : full_text_cache_urls_.countDistinctValues({ "domain" }))
+        stats.domains_and_counts_[value_group.values_[0]] = value_group.count_;
+
+    return stats;
+}
+
+
+void FullTextCache::updateStats() {
+    const Stats stats(computeStats());
+    const std::string creation_time(TimeUtil::TimeTToString(stats.creation_time_, TimeUtil::ISO_8601_FORMAT));
+
+    Elasticsearch::BulkWriter writer(full_text_cache_stats_);
+    for (const auto &group : stats.error_groups_)
+        writer.index({ { "type", "error_group" }, { "creation_time", creation_time }, { "domain", group.domain_ },
+                       { "error_message", group.error_message_ }, { "count", std::to_string(group.count_) },
+                       { "example_id", group.example_entry_.id_ }, { "example_url", group.example_entry_.url_ } });
+    for (const auto &domain_and_count : stats.domains_and_counts_)
+        writer.index({ { "type", "domain" }, { "creation_time", creation_time }, { "domain", domain_and_count.first },
+                       { "count", std::to_string(domain_and_count.second) } });
+    writer.flush();
+    if (unlikely(writer.getFailedItemCount() != 0))
+        LOG_ERROR("failed to store " + std::to_string(writer.getFailedItemCount()) + " new stats documents!");
+
+    // Only now that all of its details are in place do we replace the summary that getStats() starts from:
+    writer.index({ { "type", "summary" }, { "creation_time", creation_time }, { "cache_size", std::to_string(stats.cache_size_) },
+                   { "error_count", std::to_string(stats.error_count_) } }, /* id = */"summary");
+    if (unlikely(writer.flush() != 0))
+        LOG_ERROR("failed to store the new stats summary!");
+
+    full_text_cache_stats_.deleteRange("creation_time", Elasticsearch::RO_LT, creation_time);
+}
+
+
+bool FullTextCache::getStats(Stats * const stats) const {
+    const auto summaries(full_text_cache_stats_.simpleSelect({ "creation_time", "cache_size", "error_count" }, "type", "summary"));
+    if (summaries.empty())
+        return false;
+
+    const std::string creation_time(GetValueOrEmptyString(summaries.front(), "creation_time"));
+    stats->creation_time_ = TimeUtil::Iso8601StringToTimeT(creation_time);
+    stats->cache_size_ = StringUtil::ToUnsigned(GetValueOrEmptyString(summaries.front(), "cache_size"));
+    stats->error_count_ = StringUtil::ToUnsigned(GetValueOrEmptyString(summaries.front(), "error_count"));
+
+    stats->error_groups_.clear();
+    stats->domains_and_counts_.clear();
+    for (const auto &document : full_text_cache_stats_.simpleSelect({}, "creation_time", creation_time)) {
+        const std::string type(GetValueOrEmptyString(document, "type"));
+        const unsigned count(StringUtil::ToUnsigned(GetValueOrEmptyString(document, "count")));
+        if (type == "error_group")
+            stats->error_groups_.emplace_back(EntryGroup(count, GetValueOrEmptyString(document, "domain"),
+                                                         GetValueOrEmptyString(document, "error_message"),
+                                                         GetValueOrEmptyString(document, "example_id"),
+                                                         GetValueOrEmptyString(document, "example_url")));
+        else if (type == "domain")
+            stats->domains_and_counts_[GetValueOrEmptyString(document, "domain")] = count;
+    }
+
+    std::sort(stats->error_groups_.begin(), stats->error_groups_.end(),
+              [](const EntryGroup &eg1, const EntryGroup &eg2){ return eg1.count_ > eg2.count_;});
+    return true;
+}
+
+
 void FullTextCache::insertEntry(const std::string &id, const std::string &full_text, const std::vector<EntryUrl> &entry_urls) {
     const time_t now(std::time(nullptr));
     Random::Rand rand(now);
@@ -236,18 +292,18 @@ void FullTextCache::insertEntry(const std::string &id, const std::string &full_t
 
     std::string expiration_string;
     if (expiration == TimeUtil::BAD_TIME_T) {
-        full_text_cache_.simpleInsert({ { "id", id }, { "full_text", full_text } });
+        full_text_cache_writer_.index({ { "id", id }, { "full_text", full_text } });
     }
     else {
         expiration_string = TimeUtil::TimeTToString(expiration, TimeUtil::ISO_8601_FORMAT);
-        full_text_cache_.simpleInsert({ { "id", id }, { "expiration", expiration_string }, { "full_text", full_text } });
+        full_text_cache_writer_.index({ { "id", id }, { "expiration", expiration_string }, { "full_text", full_text } });
     }
 
     for (const auto &entry_url : entry_urls) {
         if (entry_url.error_message_.empty())
-            full_text_cache_urls_.simpleInsert({ { "id", id }, { "url", entry_url.url_ }, { "domain", entry_url.domain_ } });
+            full_text_cache_urls_writer_.index({ { "id", id }, { "url", entry_url.url_ }, { "domain", entry_url.domain_ } });
         else
-            full_text_cache_urls_.simpleInsert({ { "id", id }, { "url", entry_url.url_ }, { "domain", entry_url.domain_ },
+            full_text_cache_urls_writer_.index({ { "id", id }, { "url", entry_url.url_ }, { "domain", entry_url.domain_ },
                                                  { "error_message", entry_url.error_message_ } });
     }
 }
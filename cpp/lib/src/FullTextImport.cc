@@ -19,7 +19,10 @@
  */
 
 #include "FullTextImport.h"
+#include <algorithm>
+#include <thread>
 #include "StringUtil.h"
+#include "ThreadPool.h"
 
 
 namespace FullTextImport {
@@ -126,7 +129,73 @@ bool CorrelateFullTextData(const ControlNumberGuesser &control_number_guesser, c
 }
 
 
+namespace {
 
 
+// The normalisation is not thread-safe so we have to do it up front, on the calling thread.
+std::vector<ControlNumberGuesser::NormalisedQuery> NormaliseQueries(const std::vector<FullTextData> &full_text_data) {
+    std::vector<ControlNumberGuesser::NormalisedQuery> normalised_queries;
+    normalised_queries.reserve(full_text_data.size());
+    for (const auto &data : full_text_data)
+        normalised_queries.emplace_back(ControlNumberGuesser::NormaliseQuery(data.title_, data.authors_, data.year_, data.doi_,
+                                                                             data.issn_, data.isbn_));
+    return normalised_queries;
+}
+
+
+// Calls "lookup" for all of "normalised_queries" on "thread_count" threads.  "lookup" has to be thread-safe.
+template<typename Lookup> void LookupConcurrently(const std::vector<ControlNumberGuesser::NormalisedQuery> &normalised_queries,
+                                                  const Lookup &lookup, std::vector<std::set<std::string>> * const control_numbers,
+                                                  unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    if (thread_count > normalised_queries.size())
+        thread_count = normalised_queries.size();
+
+    // The calling thread helps out in parallelFor(), hence one worker less:
+    ThreadPool thread_pool(thread_count > 1 ? thread_count - 1 : 1);
+    thread_pool.parallelFor(0, normalised_queries.size(),
+                            [&](const size_t index) { (*control_numbers)[index] = lookup(normalised_queries[index]); });
+}
+
+
+} // unnamed namespace
+
+
+void CorrelateFullTextData(ControlNumberGuesser * const control_number_guesser, const std::vector<FullTextData> &full_text_data,
+                           std::vector<std::set<std::string>> * const control_numbers, unsigned thread_count)
+{
+    control_numbers->clear();
+    control_numbers->resize(full_text_data.size());
+    if (full_text_data.empty())
+        return;
+
+    const auto normalised_queries(NormaliseQueries(full_text_data));
+
+    if (not control_number_guesser->isInMemory())
+        control_number_guesser->loadIntoMemory();
+
+    LookupConcurrently(normalised_queries,
+                       [control_number_guesser](const ControlNumberGuesser::NormalisedQuery &normalised_query)
+                           { return control_number_guesser->getGuessedControlNumbers(normalised_query); },
+                       control_numbers, thread_count);
+}
+
+
+void CorrelateFullTextData(const ControlNumberIndex &control_number_index, const std::vector<FullTextData> &full_text_data,
+                           std::vector<std::set<std::string>> * const control_numbers, unsigned thread_count)
+{
+    control_numbers->clear();
+    control_numbers->resize(full_text_data.size());
+    if (full_text_data.empty())
+        return;
+
+    LookupConcurrently(NormaliseQueries(full_text_data),
+                       [&control_number_index](const ControlNumberGuesser::NormalisedQuery &normalised_query)
+                           { return control_number_index.getGuessedControlNumbers(normalised_query); },
+                       control_numbers, thread_count);
+}
+
 
 } // namespace FullTextImport
@@ -26,8 +26,10 @@
  */
 
 #include "GzStream.h"
+#include <chrono>
 #include <cstring>
 #include "Compiler.h"
+#include "ThreadPool.h"
 
 
 GzStream::GzStream(const Type type, const unsigned compression_level,
@@ -180,6 +182,10 @@ std::string GzStream::CompressString(const std::string &input, const Type type)
         throw std::runtime_error("in GzStream::CompressString: type must be either GzStream::COMPRESS or "
                                  "GzStream::GZIP!");
 
+    // Beyond a few blocks it pays to spread the work over multiple cores:
+    if (input.length() >= 8 * ParallelGzStream::DEFAULT_BLOCK_SIZE)
+        return ParallelGzStream::CompressString(input, type);
+
     // The compressed string to output
     std::string compressed_output;
 
@@ -245,3 +251,221 @@ std::string GzStream::DecompressString(const std::string &input, const Type type
 
     return decompressed_output;
 }
+
+
+namespace {
+
+
+// deflate(3) needs the last 32 KiB of the preceding data to find all back-references.
+constexpr size_t MAX_DICTIONARY_SIZE = 32 * 1024;
+
+
+inline void AppendLittleEndian32(std::string * const s, const uint32_t value) {
+    for (unsigned shift(0); shift < 32; shift += 8)
+        *s += static_cast<char>((value >> shift) & 0xFFu);
+}
+
+
+inline void AppendBigEndian32(std::string * const s, const uint32_t value) {
+    for (int shift(24); shift >= 0; shift -= 8)
+        *s += static_cast<char>((value >> shift) & 0xFFu);
+}
+
+
+} // unnamed namespace
+
+
+ParallelGzStream::ParallelGzStream(const GzStream::Type type, const OutputFunction &output_function,
+                                   const int compression_level, const unsigned thread_count, const size_t block_size)
+    : type_(type), output_function_(output_function), compression_level_(compression_level), thread_count_(thread_count),
+      block_size_(block_size), header_written_(false), finished_(false)
+{
+    if (unlikely(type_ != GzStream::COMPRESS and type_ != GzStream::GZIP))
+        throw std::runtime_error("in ParallelGzStream::ParallelGzStream: type must be either GzStream::COMPRESS or "
+                                 "GzStream::GZIP!");
+    if (unlikely((compression_level_ < 0 or compression_level_ > 9) and compression_level_ != Z_DEFAULT_COMPRESSION))
+        throw std::runtime_error("in ParallelGzStream::ParallelGzStream: invalid compression level "
+                                 + std::to_string(compression_level_) + "!");
+    if (unlikely(block_size_ == 0))
+        throw std::runtime_error("in ParallelGzStream::ParallelGzStream: the block size must be positive!");
+
+    checksum_ = (type_ == GzStream::GZIP) ? ::crc32(0, Z_NULL, 0) : ::adler32(0, Z_NULL, 0);
+    uncompressed_size_ = 0;
+    current_block_.reserve(block_size_);
+}
+
+
+ParallelGzStream::~ParallelGzStream() {
+    // The ThreadPool's destructor waits for the blocks that are still being compressed.
+}
+
+
+void ParallelGzStream::write(const char * const data, const size_t data_size) {
+    if (unlikely(finished_))
+        throw std::runtime_error("in ParallelGzStream::write: can't write after finish() has been called!");
+
+    size_t consumed_count(0);
+    while (consumed_count < data_size) {
+        const size_t copy_count(std::min(data_size - consumed_count, block_size_ - current_block_.size()));
+        current_block_.append(data + consumed_count, copy_count);
+        consumed_count += copy_count;
+        if (current_block_.size() == block_size_)
+            dispatchCurrentBlock(/* last_block = */false);
+    }
+}
+
+
+void ParallelGzStream::finish() {
+    if (unlikely(finished_))
+        throw std::runtime_error("in ParallelGzStream::finish: must not be called more than once!");
+    finished_ = true;
+
+    dispatchCurrentBlock(/* last_block = */true);
+    while (not pending_blocks_.empty())
+        emitOldestBlock();
+
+    std::string trailer;
+    if (type_ == GzStream::GZIP) {
+        AppendLittleEndian32(&trailer, static_cast<uint32_t>(checksum_));
+        AppendLittleEndian32(&trailer, static_cast<uint32_t>(uncompressed_size_)); // ISIZE is the size modulo 2^32.
+    } else
+        AppendBigEndian32(&trailer, static_cast<uint32_t>(checksum_));
+    output_function_(trailer.data(), trailer.size());
+}
+
+
+std::string ParallelGzStream::CompressString(const std::string &input, const GzStream::Type type,
+                                             const int compression_level, const unsigned thread_count)
+{
+    std::string compressed_output;
+    ParallelGzStream compressor(type, [&compressed_output](const char * const data, const size_t data_size) {
+                                          compressed_output.append(data, data_size); },
+                                compression_level, thread_count);
+    compressor.write(input);
+    compressor.finish();
+
+    return compressed_output;
+}
+
+
+void ParallelGzStream::writeHeader() {
+    std::string header;
+    if (type_ == GzStream::GZIP) {
+        // ID1, ID2, CM = deflate, FLG = 0, MTIME = 0 (4 bytes), XFL = 0, OS = Unix, as written by zlib.
+        static const char GZIP_HEADER[] = { '\x1F', '\x8B', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x03' };
+        header.assign(GZIP_HEADER, sizeof(GZIP_HEADER));
+    } else {
+        // CMF = deflate w/ a 32 KiB window, FLG = the level hint as computed by zlib plus the check bits.
+        const unsigned level_hint(compression_level_ == Z_DEFAULT_COMPRESSION ? 2 : compression_level_ < 2 ? 0
+                                  : compression_level_ < 6 ? 1 : compression_level_ == 6 ? 2 : 3);
+        unsigned zlib_header((0x78u << 8) | (level_hint << 6));
+        zlib_header += 31 - zlib_header % 31;
+        header += static_cast<char>(zlib_header >> 8);
+        header += static_cast<char>(zlib_header & 0xFFu);
+    }
+
+    output_function_(header.data(), header.size());
+    header_written_ = true;
+}
+
+
+void ParallelGzStream::dispatchCurrentBlock(const bool last_block) {
+    if (last_block) {
+        // The last block is typically short, and it may be the only one, so we don't bother w/ a thread.
+        std::promise<CompressedBlock> promise;
+        promise.set_value(CompressBlock(type_, compression_level_, current_block_, dictionary_, /* last_block = */true));
+        pending_blocks_.emplace_back(promise.get_future());
+    } else {
+        if (thread_pool_ == nullptr)
+            thread_pool_.reset(new ThreadPool(thread_count_));
+
+        // Limit the memory that we tie up in blocks that are waiting to be compressed or emitted:
+        while (pending_blocks_.size() >= 2 * thread_pool_->size())
+            emitOldestBlock();
+
+        const GzStream::Type type(type_);
+        const int compression_level(compression_level_);
+        auto block(std::make_shared<std::string>(std::move(current_block_)));
+        auto dictionary(std::make_shared<std::string>(dictionary_));
+        pending_blocks_.emplace_back(thread_pool_->submit([type, compression_level, block, dictionary] {
+            return CompressBlock(type, compression_level, *block, *dictionary, /* last_block = */false);
+        }));
+
+        dictionary_.assign(*block, block->size() > MAX_DICTIONARY_SIZE ? block->size() - MAX_DICTIONARY_SIZE : 0,
+                           std::string::npos);
+        current_block_.clear();
+        current_block_.reserve(block_size_);
+    }
+
+    // Pass on whatever is already done so that the output doesn't lag behind unnecessarily:
+    while (not pending_blocks_.empty()
+           and pending_blocks_.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        emitOldestBlock();
+}
+
+
+void ParallelGzStream::emitOldestBlock() {
+    const CompressedBlock block(pending_blocks_.front().get());
+    pending_blocks_.pop_front();
+    emit(block);
+}
+
+
+void ParallelGzStream::emit(const CompressedBlock &block) {
+    if (not header_written_)
+        writeHeader();
+
+    if (type_ == GzStream::GZIP)
+        checksum_ = ::crc32_combine(checksum_, block.checksum_, static_cast<z_off_t>(block.uncompressed_size_));
+    else
+        checksum_ = ::adler32_combine(checksum_, block.checksum_, static_cast<z_off_t>(block.uncompressed_size_));
+    uncompressed_size_ += block.uncompressed_size_;
+
+    output_function_(block.data_.data(), block.data_.size());
+}
+
+
+ParallelGzStream::CompressedBlock ParallelGzStream::CompressBlock(const GzStream::Type type, const int compression_level,
+                                                                  const std::string &block, const std::string &dictionary,
+                                                                  const bool last_block)
+{
+    z_stream stream;
+    std::memset(&stream, '\0', sizeof stream);
+    if (unlikely(::deflateInit2(&stream, compression_level, Z_DEFLATED, /* windowBits = raw deflate */ -15,
+                                /* memLevel = */ 8, Z_DEFAULT_STRATEGY) != Z_OK))
+        throw std::runtime_error("in ParallelGzStream::CompressBlock: deflateInit2() failed!");
+    if (not dictionary.empty())
+        ::deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()),
+                               static_cast<uInt>(dictionary.size()));
+
+    CompressedBlock compressed_block;
+    compressed_block.uncompressed_size_ = block.size();
+    compressed_block.checksum_ = (type == GzStream::GZIP)
+        ? ::crc32(::crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(block.data()), static_cast<uInt>(block.size()))
+        : ::adler32(::adler32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(block.data()),
+                    static_cast<uInt>(block.size()));
+
+    // All but the last block end w/ a sync flush, which byte-aligns the output so that we can simply concatenate.
+    // The extra 16 bytes are for the empty stored block that a sync flush appends.
+    compressed_block.data_.resize(::deflateBound(&stream, block.size()) + 16);
+    stream.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(block.data()));
+    stream.avail_in = static_cast<uInt>(block.size());
+    size_t compressed_size(0);
+    int retcode;
+    for (;;) {
+        stream.next_out  = reinterpret_cast<Bytef *>(&compressed_block.data_[compressed_size]);
+        stream.avail_out = static_cast<uInt>(compressed_block.data_.size() - compressed_size);
+        retcode = ::deflate(&stream, last_block ? Z_FINISH : Z_SYNC_FLUSH);
+        compressed_size = compressed_block.data_.size() - stream.avail_out;
+        if (retcode != Z_OK or stream.avail_out != 0) // No more pending output.
+            break;
+        compressed_block.data_.resize(2 * compressed_block.data_.size());
+    }
+    ::deflateEnd(&stream);
+    if (unlikely(retcode != (last_block ? Z_STREAM_END : Z_OK) or stream.avail_in != 0))
+        throw std::runtime_error("in ParallelGzStream::CompressBlock: deflate() failed (return code = "
+                                 + std::to_string(retcode) + ")!");
+
+    compressed_block.data_.resize(compressed_size);
+    return compressed_block;
+}
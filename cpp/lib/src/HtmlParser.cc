@@ -26,9 +26,11 @@
 #include "HtmlParser.h"
 #include <stdexcept>
 #include <unordered_map>
+#include <algorithm>
 #include <cctype>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <cerrno>
 #include "Compiler.h"
 #include "StringUtil.h"
@@ -335,6 +337,11 @@ inline bool IsAsciiLetterOrDigit(const int ch) {
 } // unnamed namespace
 
 
+bool HtmlParser::DecodeEntity(const std::string &entity, std::string * const decoded, const bool is_utf8) {
+    return ::DecodeEntity(entity.c_str(), decoded, is_utf8);
+}
+
+
 // HtmlParser::AttributeMap::toString -- Construct a string representation of an attribute map.
 //
 std::string HtmlParser::AttributeMap::toString() const {
@@ -467,9 +474,13 @@ void HtmlParser::replaceEntitiesInString() {
 
     while (likely(*read_ptr != '\0')) {
         if (likely(*read_ptr != '&')) {
-            *write_ptr = *read_ptr;
-            ++read_ptr;
-            ++write_ptr;
+            // Move everything up to the next ampersand in one go.  (strchr(3) is vectorised in any decent libc.)
+            const char * const next_ampersand(std::strchr(read_ptr, '&'));
+            const size_t run_length(next_ampersand == nullptr ? std::strlen(read_ptr) : next_ampersand - read_ptr);
+            if (write_ptr != read_ptr)
+                std::memmove(write_ptr, read_ptr, run_length);
+            read_ptr += run_length;
+            write_ptr += run_length;
             continue;
         }
 
@@ -553,6 +564,34 @@ int HtmlParser::getChar(bool * const is_entity) {
 }
 
 
+// HtmlParser::advanceTo -- moves the read position forward to "new_cp" w/o handling each skipped character
+//                          individually while keeping the line count up to date.
+//
+void HtmlParser::advanceTo(const char * const new_cp) {
+    lineno_ += std::count(cp_, new_cp, '\n');
+    cp_ = new_cp;
+}
+
+
+// HtmlParser::findNextTagStart -- returns a pointer to the next '<' at or after the current read position that
+//                                 did not result from the expansion of an entity or, if there is no such '<',
+//                                 a pointer to the terminating zero byte of our input.
+//
+const char *HtmlParser::findNextTagStart() const {
+    const char *next_cp(cp_);
+    for (;;) {
+        const char * const angle_bracket(std::strchr(next_cp, '<'));
+        if (angle_bracket == nullptr)
+            return next_cp + std::strlen(next_cp);
+        if (likely(angle_bracket_entity_positions_.empty())
+            or angle_bracket_entity_positions_.find(const_cast<char *>(angle_bracket))
+               == angle_bracket_entity_positions_.end())
+            return angle_bracket;
+        next_cp = angle_bracket + 1;
+    }
+}
+
+
 void HtmlParser::ungetChar() {
     if (unlikely(cp_ == cp_start_))
         logger->error("in HtmlParser::ungetChar: trying to push back at beginning of input!");
@@ -708,33 +747,21 @@ void HtmlParser::processDoctype() {
 //
 void HtmlParser::skipComment() {
     const unsigned start_lineno(lineno_);
-    std::string comment_text;
-    unsigned hyphen_count = 0;
-    for (;;) {
-        int ch = getChar();
-        if (unlikely(ch == EOF)) {
-            Chunk unexpected_eof_chunk(UNEXPECTED_END_OF_STREAM, lineno_,
-                                       "unexpected EOF within HTML comment (started on line "
-                                       + std::to_string(start_lineno) + ")");
-            preNotify(&unexpected_eof_chunk);
-            return;
-        }
-
-        comment_text += static_cast<char>(ch);
-
-        if (ch == '>') {
-            if (hyphen_count >= 2)
-                break;
-            hyphen_count = 0;
-        } else if (ch != '-')
-            hyphen_count = 0;
-        else
-            ++hyphen_count;
+    const char * const comment_start(cp_);
+    const char * const comment_end(std::strstr(cp_, "-->"));
+    if (unlikely(comment_end == nullptr)) {
+        advanceTo(cp_ + std::strlen(cp_));
+        Chunk unexpected_eof_chunk(UNEXPECTED_END_OF_STREAM, lineno_,
+                                   "unexpected EOF within HTML comment (started on line "
+                                   + std::to_string(start_lineno) + ")");
+        preNotify(&unexpected_eof_chunk);
+        return;
     }
+    advanceTo(comment_end + __builtin_strlen("-->"));
 
     if (chunk_mask_ & COMMENT) {
-        // report the contents of the comments without the "--" at the end:
-        Chunk comment_chunk(COMMENT, comment_text.substr(0, comment_text.length()-2), start_lineno);
+        // report the contents of the comments without the "->" at the end:
+        Chunk comment_chunk(COMMENT, std::string(comment_start, comment_end + 1 - comment_start), start_lineno);
         preNotify(&comment_chunk);
     }
 }
@@ -767,17 +794,16 @@ void HtmlParser::skipToEndOfTag(const std::string &tag_name, const unsigned tag_
 bool HtmlParser::skipToEndOfScriptOrStyle(const std::string &tag_name, const unsigned tag_start_lineno) {
     int ch;
     for (;;) {
-        ch = getChar();
-        if (ch == EOF) {
+        const char * const angle_bracket(std::strchr(cp_, '<'));
+        if (angle_bracket == nullptr) { // No end in sight.
+            advanceTo(cp_ + std::strlen(cp_));
             Chunk unexpected_eof_chunk(UNEXPECTED_END_OF_STREAM, lineno_,
                                        "unexpected end-of-stream while skipping tag \"" + tag_name
                                        + "\" opened on line " + std::to_string(lineno_));
             preNotify(&unexpected_eof_chunk);
             return false;
         }
-
-        if (ch != '<') // No end in sight, keep going.
-            continue;
+        advanceTo(angle_bracket + 1);
 
         ch = getChar();
         if (ch == EOF) {
@@ -855,19 +881,9 @@ void HtmlParser::parseWord() {
 
 
 void HtmlParser::parseText() {
-    std::string text;
-    for (;;) {
-        bool is_entity;
-        const int ch(getChar(&is_entity));
-        if (endOfStream())
-            break;
-
-        if (unlikely(ch == '<') and not is_entity) {
-            ungetChar();
-            break;
-        } else
-            text += static_cast<char>(ch);
-    }
+    const char * const text_start(cp_);
+    advanceTo(findNextTagStart());
+    const std::string text(text_start, cp_ - text_start);
 
     std::string utf8_text;
     if (unlikely(not encoding_converter_->convert(text, &utf8_text)))
@@ -1072,12 +1088,15 @@ bool HtmlParser::parseTag() {
     }
 
     if (not is_end_tag) {
+        // We only need to collect the attributes if we report opening tags or need to look for a charset:
+        const bool need_attributes((chunk_mask_ & OPENING_TAG) or (http_header_charset_.empty() and tag_name == "meta"));
+
         std::string attribute_name, attribute_value;
         bool more;
         do {
             skipWhiteSpace();
             more = extractAttribute(tag_name, &attribute_name, &attribute_value);
-            if (attribute_name.length() > 0)
+            if (need_attributes and attribute_name.length() > 0)
                 attribute_map.insert(attribute_name, attribute_value);
         } while (more);
     }
@@ -1159,8 +1178,14 @@ bool HtmlParser::parseTag() {
 void HtmlParser::parse() {
     const unsigned NBSP(0xA0); // Non-breaking space.
 
+    // If we don't report anything that may occur between tags we can skip directly to the next tag:
+    const bool skip_text(not (chunk_mask_ & (TEXT | WORD | PUNCTUATION | WHITESPACE)));
+
     try {
         for (;;) {
+            if (skip_text)
+                advanceTo(findNextTagStart());
+
             bool is_entity;
             int ch(getChar(&is_entity));
 
@@ -41,238 +41,210 @@
 namespace {
 
 
-// a Boolean predicate class
-class StartsWith {
-    std::string prefix_;
-public:
-    StartsWith(const std::string &prefix): prefix_(prefix) { }
-    bool operator()(const std::string &s) const { return ::strncasecmp(prefix_.c_str(), s.c_str(), prefix_.length()) == 0; }
+const struct {
+    const char *name_;
+    size_t name_length_;
+    HttpHeader::KnownField known_field_;
+} KNOWN_FIELD_NAMES[] = {
+    { "Date",              4, HttpHeader::DATE             },
+    { "Last-Modified",    13, HttpHeader::LAST_MODIFIED    },
+    { "Content-Length",   14, HttpHeader::CONTENT_LENGTH   },
+    { "Content-Type",     12, HttpHeader::CONTENT_TYPE     },
+    { "Content-Encoding", 16, HttpHeader::CONTENT_ENCODING },
+    { "Location",          8, HttpHeader::LOCATION         },
+    { "Content-Language", 16, HttpHeader::CONTENT_LANGUAGE },
+    { "URI",               3, HttpHeader::URI              },
+    { "ETag",              4, HttpHeader::ETAG             },
+    { "Cache-Control",    13, HttpHeader::CACHE_CONTROL    },
+    { "Pragma",            6, HttpHeader::PRAGMA           },
+    { "Expires",           7, HttpHeader::EXPIRES          },
+    { "Server",            6, HttpHeader::SERVER           },
+    { "Accept-Ranges",    13, HttpHeader::ACCEPT_RANGES    },
+    { "Vary",              4, HttpHeader::VARY             },
+    { "Connection",       10, HttpHeader::CONNECTION       },
 };
 
 
-} // unnamed namespace
+inline bool IsHorizontalWhitespace(const char ch) {
+    return ch == ' ' or ch == '\t';
+}
 
 
-HttpHeader::HttpHeader(const std::string &header) {
-    // Assume the header is not valid until we discover otherwise:
-    is_valid_ = false;
+// \return True if the first "name_length" characters of "s1" and "s2" match case-insensitively.
+inline bool NamesMatch(const char * const s1, const char * const s2, const size_t name_length) {
+    return ::strncasecmp(s1, s2, name_length) == 0;
+}
 
-    // Empty headers are not valid:
-    if (header.empty())
-        return;
 
-    // Split the header into several lines:
-    std::list<std::string> lines;
-    StringUtil::Split(header, std::string("\r\n"), &lines, /* suppress_empty_components = */true);
+} // unnamed namespace
 
-    // Some Web servers incorrectly use '\n' instead of '\r\n'.
-    // Detect (and compensate for) this behaviour:
-    if (lines.size() == 1) {
-        lines.clear();
-        StringUtil::Split(header, '\n', &lines, /* suppress_empty_components = */true);
+
+HttpHeader::HttpHeader(const std::string &header)
+    : buffer_(header), known_field_values_(), status_code_(0), date_(TimeUtil::BAD_TIME_T),
+      last_modified_(TimeUtil::BAD_TIME_T), expires_(TimeUtil::BAD_TIME_T), content_length_(0), is_valid_(false)
+{
+    // Split the header into lines in a single pass.  Some Web servers incorrectly use '\n' instead of '\r\n', so we
+    // split on '\n' and strip any trailing carriage returns.  Empty lines are ignored:
+    std::vector<Range> lines;
+    for (size_t line_start(0); line_start < buffer_.size(); /* Intentionally empty! */) {
+        size_t line_end(buffer_.find('\n', line_start));
+        const size_t next_line_start(line_end == std::string::npos ? buffer_.size() : line_end + 1);
+        if (line_end == std::string::npos)
+            line_end = buffer_.size();
+        while (line_end > line_start and buffer_[line_end - 1] == '\r')
+            --line_end;
+        if (line_end > line_start)
+            lines.emplace_back(line_start, line_end - line_start);
+        line_start = next_line_start;
     }
 
     // If we couldn't split the headers, then it was probably trivially small:
     if (lines.empty())
         return;
 
-    // Parse each of the lines:
-    if ((lines.front().length() > 5 and lines.front().substr(0, 5) == "HTTP/")
-        or StringUtil::Match("[A-Za-z][A-Za-z]*: *", lines.front()))
-    {
-        // Okay, we're happy the header is valid:
-        is_valid_ = true;
+    const StringView first_line(getView(lines.front()));
+    const bool have_status_line(first_line.length() > 5 and first_line.startsWith("HTTP/"));
+    if (not have_status_line and not StringUtil::Match("[A-Za-z][A-Za-z]*: *", first_line.toString())) {
+        // Set some default values.  Note that "is_valid_" is false.  We do something really crazy:
+        status_code_    = 200;
+        content_length_ = header.length();
+        setContentType("text/html"); // Yeah, right!?
+        return;
+    }
 
-        server_response_ = lines.front();
+    // Okay, we're happy the header is valid:
+    is_valid_ = true;
+    server_response_ = lines.front();
+
+    // Read the status code and the additional information from the status line, e.g. "HTTP/1.1 200 OK" or "HTTP/2 200":
+    if (have_status_line) {
+        size_t pos(first_line.find(' '));
+        while (pos < first_line.length() and IsHorizontalWhitespace(first_line[pos]))
+            ++pos;
+        while (pos < first_line.length() and StringUtil::IsDigit(first_line[pos]))
+            status_code_ = status_code_ * 10 + (first_line[pos++] - '0');
+        while (pos < first_line.length() and IsHorizontalWhitespace(first_line[pos]))
+            ++pos;
+        if (pos < first_line.length())
+            status_line_ = Range(server_response_.offset_ + pos, first_line.length() - pos);
+    } else
+        status_code_ = 200; // Too optimistic?
+
+    // Index the fields:
+    for (auto line(have_status_line ? lines.cbegin() + 1 : lines.cbegin()); line != lines.cend(); ++line) {
+        const StringView line_view(getView(*line));
+        const size_t colon_pos(line_view.find(':'));
+        if (colon_pos == StringView::npos or colon_pos == 0)
+            continue;
+
+        size_t value_start(colon_pos + 1), value_end(line_view.length());
+        while (value_start < value_end and IsHorizontalWhitespace(line_view[value_start]))
+            ++value_start;
+        while (value_end > value_start and IsHorizontalWhitespace(line_view[value_end - 1]))
+            --value_end;
+        fields_.emplace_back(Range(line->offset_, colon_pos), Range(line->offset_ + value_start, value_end - value_start));
+        const Field &field(fields_.back());
+
+        for (const auto &known_field_name : KNOWN_FIELD_NAMES) {
+            if (known_field_name.name_length_ == colon_pos
+                and NamesMatch(known_field_name.name_, line_view.data(), colon_pos))
+            {
+                Range &known_field_value(known_field_values_[known_field_name.known_field_]);
+                if (known_field_value.length_ == 0)
+                    known_field_value = field.value_;
+                break;
+            }
+        }
 
-        // Read the status code from the first line (e.g. HTTP/1.0 200):
-        if (lines.front().substr(0, 5) == "HTTP/")
-            std::sscanf(lines.front().c_str(), "HTTP/%*u.%*u %u", &status_code_);
-        else
-            status_code_ = 200; // Too optimistic?
+        if (colon_pos == 10 and NamesMatch("Set-Cookie", line_view.data(), colon_pos) and field.value_.length_ != 0)
+            cookies_.emplace_back(getView(field.value_).toString());
+    }
 
-        // Read additional information on the status line
-        if (lines.front().size() > 12)
-            status_line_ = lines.front().substr(13);
+    const StringView date(getFieldValue(DATE));
+    if (not date.empty())
+        date_ = WebUtil::ParseWebDateAndTime(date.toString());
 
-        // Read the date:
-        std::list<std::string>::const_iterator server_header;
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Date:"));
-        if (server_header == lines.end() or server_header->length() <= 6)
-            date_ = TimeUtil::BAD_TIME_T;
-        else
-            date_ = WebUtil::ParseWebDateAndTime(server_header->substr(6));
+    const StringView last_modified(getFieldValue(LAST_MODIFIED));
+    if (not last_modified.empty())
+        last_modified_ = WebUtil::ParseWebDateAndTime(last_modified.toString());
 
-        // Find  the last modification header:
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Last-Modified:"));
-        if (server_header == lines.end() or server_header->length() <= 15)
-            last_modified_ = TimeUtil::BAD_TIME_T;
-        else
-            last_modified_ = WebUtil::ParseWebDateAndTime(server_header->substr(15));
+    const StringView content_length(getFieldValue(CONTENT_LENGTH));
+    if (not content_length.empty() and std::sscanf(content_length.toString().c_str(), "%zu", &content_length_) != 1)
+        is_valid_ = false;
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Content-Length:"));
-        if (server_header == lines.end() or server_header->length() <= 16)
-            content_length_ = 0;
-        else if (std::sscanf(server_header->substr(16).c_str(), "%zu", &content_length_) != 1)
-            is_valid_ = false;
+    const StringView content_encoding(getFieldValue(CONTENT_ENCODING));
+    if (not content_encoding.empty())
+        content_encoding_ = StringUtil::ASCIIToLower(content_encoding.toString());
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Content-Type:"));
-        if (server_header == lines.end() or server_header->length() <= 14)
-            content_type_ = "";
-        else
-            content_type_ = server_header->substr(14);
+    if (not getFieldValue(LOCATION).empty() and status_code_ == 200) // Deal with overly optimistic assumption above!
+        status_code_ = 300;
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Content-Encoding:"));
-        if (server_header == lines.end() or server_header->length() <= 18)
-            content_encoding_ = "";
-        else
-            content_encoding_ = StringUtil::ASCIIToLower(StringUtil::Trim(server_header->substr(18)));
-
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Location:"));
-        if (server_header == lines.end() or server_header->length() <= 10)
-            location_ = "";
-        else {
-            location_ = server_header->substr(10);
-            if (status_code_ == 200) // Deal with overly optimistic assumption above!
-                status_code_ = 300;
-        }
+    const StringView expires(getFieldValue(EXPIRES));
+    if (not expires.empty())
+        expires_ = (expires == "0") ? 0 : WebUtil::ParseWebDateAndTime(expires.toString());
+}
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Content-Language:"));
-        if (server_header == lines.end() or server_header->length() <= 18)
-            content_languages_ = "";
-        else
-            content_languages_ = server_header->substr(18);
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("URI:"));
-        if (server_header == lines.end() or server_header->length() <= 4)
-            uri_ = "";
-        else
-            uri_ = server_header->substr(4);
+StringView HttpHeader::getFieldValue(const StringView &field_name) const {
+    for (const auto &field : fields_) {
+        if (field.name_.length_ == field_name.length()
+            and NamesMatch(buffer_.data() + field.name_.offset_, field_name.data(), field_name.length()))
+            return getView(field.value_);
+    }
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("ETag:"));
-        if (server_header == lines.end() or server_header->length() <= 6)
-            etag_ = "";
-        else
-            etag_ = server_header->substr(6);
+    return StringView();
+}
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Cache-Control:"));
-        if (server_header == lines.end() or server_header->length() <= 15)
-            cache_control_ = "";
-        else
-            cache_control_ = server_header->substr(15);
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Pragma:"));
-        if (server_header == lines.end() or server_header->length() <= 8)
-            pragma_ = "";
-        else
-            pragma_ = server_header->substr(8);
-
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Expires:"));
-        if (server_header == lines.end() or server_header->length() <= 9)
-            expires_ = TimeUtil::BAD_TIME_T;
-        else {
-            std::string http_time(server_header->substr(9));
-            if (StringUtil::Trim(&http_time) == "0")
-                expires_ = 0;
-            else
-                expires_ = WebUtil::ParseWebDateAndTime(server_header->substr(9));
-        }
+void HttpHeader::setKnownFieldValue(const KnownField known_field, const std::string &new_value) {
+    known_field_values_[known_field] = Range(buffer_.size(), new_value.size());
+    buffer_ += new_value;
+}
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Server:"));
-        if (server_header == lines.end() or server_header->length() <= 8)
-            server_ = "";
-        else
-            server_ = server_header->substr(8);
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Accept-Ranges:"));
-        if (server_header == lines.end() or server_header->length() <= 15)
-            accept_ranges_ = "";
-        else
-            accept_ranges_ = server_header->substr(15);
+namespace {
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Vary:"));
-        if (server_header == lines.end() or server_header->length() <= 6)
-            vary_ = "";
-        else
-            vary_ = server_header->substr(6);
 
-        server_header = find_if(lines.begin(), lines.end(), StartsWith("Connection:"));
-        if (server_header == lines.end() or server_header->length() <= 12)
-            connection_ = "";
-        else
-            connection_ = server_header->substr(12);
-
-        // Attempt to extract all "Set-Cookie:" headers:
-        std::list<std::string>::const_iterator search_start(lines.begin());
-        while (search_start != lines.end()) {
-            server_header = std::find_if(search_start, std::list<std::string>::const_iterator(lines.end()),
-                                         StartsWith("Set-Cookie:"));
-            if (server_header != lines.end() and server_header->length() > 12)
-                cookies_.push_back(server_header->substr(12));
-            search_start = server_header;
-            if (search_start != lines.end())
-                ++search_start;
-        }
-    } else {
-        // Set some default values.  Note that "is_valid_" is false.  We do something really crazy:
-        status_code_    = 200;
-        content_type_   = "text/html"; // Yeah, right!?
-        date_           = TimeUtil::BAD_TIME_T;
-        last_modified_  = TimeUtil::BAD_TIME_T;
-        content_length_ = header.length();
-        location_       = "";
-        etag_           = "";
-        cache_control_  = "";
-        pragma_         = "";
-        server_         = "";
-    }
+inline void AppendField(std::string * const string_rep, const char * const field_name, const StringView &field_value) {
+    if (not field_value.empty())
+        string_rep->append(field_name).append(": ").append(field_value.data(), field_value.size()).append("\r\n");
 }
 
 
+} // unnamed namespace
+
+
 std::string HttpHeader::toString() const {
     if (unlikely(not is_valid_))
         throw std::runtime_error("in HttpHeader::toString: can't create a string representation of an invalid header!");
 
-    std::string string_rep(server_response_ + "\r\n");
-    if (not content_type_.empty())
-        string_rep += "Content-Type: " + content_type_ + "\r\n";
+    std::string string_rep(getView(server_response_).toString() + "\r\n");
+    AppendField(&string_rep, "Content-Type", getFieldValue(CONTENT_TYPE));
     if (date_ != TimeUtil::BAD_TIME_T)
         string_rep += "Date: " + TimeUtil::TimeTToString(date_, TimeUtil::ZULU_FORMAT, TimeUtil::UTC) + "\r\n";
-    if (not server_.empty())
-        string_rep += "Server: " + server_ + "\r\n";
-    if (not accept_ranges_.empty())
-        string_rep += "Accept-Ranges: " + accept_ranges_ + "\r\n";
-    if (not vary_.empty())
-        string_rep += "Vary: " + vary_ + "\r\n";
-    if (not connection_.empty())
-        string_rep += "Connection: " + connection_ + "\r\n";
+    AppendField(&string_rep, "Server", getFieldValue(SERVER));
+    AppendField(&string_rep, "Accept-Ranges", getFieldValue(ACCEPT_RANGES));
+    AppendField(&string_rep, "Vary", getFieldValue(VARY));
+    AppendField(&string_rep, "Connection", getFieldValue(CONNECTION));
     if (last_modified_ != TimeUtil::BAD_TIME_T)
         string_rep += "Last-Modified: " + TimeUtil::TimeTToString(last_modified_, TimeUtil::ZULU_FORMAT, TimeUtil::UTC) + "\r\n";
     if (content_length_ != 0)
         string_rep += "Content-Length: " + StringUtil::ToString(content_length_) + "\r\n";
-    if (not location_.empty())
-        string_rep += "Location: " + location_ + "\r\n";
-    if (not content_languages_.empty())
-        string_rep += "Content-Language: " + content_languages_ + "\r\n";
-    if (not uri_.empty())
-        string_rep += "URI: " + uri_ + "\r\n";
-    if (not etag_.empty())
-        string_rep += "ETag: " + etag_ + "\r\n";
-    if (not cache_control_.empty())
-        string_rep += "Cache-Control: " + cache_control_ + "\r\n";
-    if (not pragma_.empty())
-        string_rep += "Pragma: " + pragma_ + "\r\n";
+    AppendField(&string_rep, "Location", getFieldValue(LOCATION));
+    AppendField(&string_rep, "Content-Language", getFieldValue(CONTENT_LANGUAGE));
+    AppendField(&string_rep, "URI", getFieldValue(URI));
+    AppendField(&string_rep, "ETag", getFieldValue(ETAG));
+    AppendField(&string_rep, "Cache-Control", getFieldValue(CACHE_CONTROL));
+    AppendField(&string_rep, "Pragma", getFieldValue(PRAGMA));
     if (expires_ != TimeUtil::BAD_TIME_T) {
         if (expires_ == 0)
             string_rep += "Expires: 0\r\n";
         else
             string_rep += "Expires: " + TimeUtil::TimeTToString(expires_, TimeUtil::ZULU_FORMAT, TimeUtil::UTC) + "\r\n";
     }
-    if (not cookies_.empty())
-        for (std::vector<std::string>::const_iterator cookie(cookies_.begin()); cookie != cookies_.end(); ++cookie)
-            string_rep += "Cookie: " + *cookie + "\r\n";
-    if (not content_type_.empty())
-        string_rep += "Content-Type: " + content_type_ + "\r\n";
+    for (const auto &cookie : cookies_)
+        string_rep += "Cookie: " + cookie + "\r\n";
+    AppendField(&string_rep, "Content-Type", getFieldValue(CONTENT_TYPE));
 
     return string_rep;
 }
@@ -285,10 +257,11 @@ void HttpHeader::setContentEncoding(const std::string &new_content_encoding) {
 
 std::string HttpHeader::getMediaType() const {
     // If there's no Content-Type header, do nothing:
-    if (content_type_.empty())
+    const StringView content_type(getFieldValue(CONTENT_TYPE));
+    if (content_type.empty())
         return "";
 
-    std::string simplified_media_type(content_type_);
+    std::string simplified_media_type(content_type.toString());
     MediaTypeUtil::SimplifyMediaType(&simplified_media_type);
     return simplified_media_type;
 }
@@ -334,7 +307,8 @@ bool LanguageMatch::operator()(const std::string &acceptable_language) const {
 
 
 bool HttpHeader::hasAcceptableLanguage(const std::string &acceptable_languages) const {
-    if (content_languages_.empty())
+    const StringView content_languages_view(getFieldValue(CONTENT_LANGUAGE));
+    if (content_languages_view.empty())
         return true;
 
     std::vector<std::string> acceptable_languages_set;
@@ -343,7 +317,7 @@ bool HttpHeader::hasAcceptableLanguage(const std::string &acceptable_languages)
         return true;
 
     std::vector<std::string> content_languages;
-    StringUtil::SplitThenTrimWhite(content_languages_, ',', &content_languages);
+    StringUtil::SplitThenTrimWhite(content_languages_view.toString(), ',', &content_languages);
     if (unlikely(content_languages.empty()))
         return true;
 
@@ -537,10 +537,15 @@ void IniFile::processFile(const std::string &external_filename) {
         LOG_ERROR("gethostname(2) failed!");
 
     std::string filename;
-    if (not dirname.empty() and FileUtil::Exists(dirname + "/" + std::string(hostname) + "/" + basename))
-        filename = dirname + "/" + std::string(hostname) + "/" + basename;
-    else
+    if (not dirname.empty()) {
+        consulted_files_.emplace_back(dirname + "/" + std::string(hostname) + "/" + basename);
+        if (FileUtil::Exists(consulted_files_.back()))
+            filename = consulted_files_.back();
+    }
+    if (filename.empty()) {
         filename = external_filename;
+        consulted_files_.emplace_back(filename);
+    }
 
     // Open the file:
     if (unlikely(not FileUtil::Exists(filename))) {
@@ -606,9 +611,11 @@ void IniFile::assign(const IniFile &rhs, const bool clear) {
 
     ignore_failed_includes_ = rhs.ignore_failed_includes_;
     if (clear) {
-        sections_      = rhs.sections_;
-        ini_file_name_ = rhs.ini_file_name_;
+        sections_        = rhs.sections_;
+        ini_file_name_   = rhs.ini_file_name_;
+        consulted_files_ = rhs.consulted_files_;
     } else {
+        consulted_files_.insert(consulted_files_.end(), rhs.consulted_files_.cbegin(), rhs.consulted_files_.cend());
         for (auto &rhs_section : rhs.sections_) {
             const auto lhs_section(std::find(sections_.begin(), sections_.end(), rhs_section.getSectionName()));
             if (lhs_section == sections_.end())
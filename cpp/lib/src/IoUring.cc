@@ -0,0 +1,217 @@
+/** \brief Implementation of the IoUring class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "IoUring.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Compiler.h"
+
+
+namespace {
+
+
+int IoUringSetup(const unsigned entries, io_uring_params * const params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+
+inline unsigned LoadAcquire(const unsigned * const p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+
+inline void StoreRelease(unsigned * const p, const unsigned value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+
+template<typename Type> Type *Offset(void * const base, const size_t offset) {
+    return reinterpret_cast<Type *>(reinterpret_cast<char *>(base) + offset);
+}
+
+
+} // unnamed namespace
+
+
+bool IoUring::IsAvailable() {
+    static const bool is_available([]{
+        io_uring_params params;
+        std::memset(&params, 0, sizeof params);
+        const int ring_fd(IoUringSetup(1, &params));
+        if (ring_fd == -1)
+            return false;
+        ::close(ring_fd);
+
+        // IORING_FEAT_RW_CUR_POS arrived w/ Linux 5.6, as did the IORING_OP_READ and IORING_OP_WRITE opcodes that we use.
+        return (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+    }());
+
+    return is_available;
+}
+
+
+IoUring::IoUring(const unsigned entries)
+    : sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_(reinterpret_cast<io_uring_sqe *>(MAP_FAILED)), unsubmitted_count_(0),
+      in_flight_count_(0)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof params);
+    ring_fd_ = IoUringSetup(entries, &params);
+    if (unlikely(ring_fd_ == -1))
+        throw std::runtime_error("in IoUring::IoUring: io_uring_setup(2) failed: " + std::string(std::strerror(errno)));
+    entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+    if (single_mmap)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ != MAP_FAILED) {
+        cq_ring_ = single_mmap ? sq_ring_ : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                   ring_fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = reinterpret_cast<io_uring_sqe *>(::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    }
+    if (unlikely(sq_ring_ == MAP_FAILED or cq_ring_ == MAP_FAILED or sqes_ == MAP_FAILED)) {
+        const int mmap_errno(errno);
+        unmapRings();
+        ::close(ring_fd_);
+        throw std::runtime_error("in IoUring::IoUring: mmap(2) failed: " + std::string(std::strerror(mmap_errno)));
+    }
+
+    sq_head_      = Offset<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_      = Offset<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_ring_mask_ = Offset<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_     = Offset<unsigned>(sq_ring_, params.sq_off.array);
+    cq_head_      = Offset<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_      = Offset<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_ring_mask_ = Offset<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_         = Offset<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+}
+
+
+IoUring::~IoUring() {
+    unmapRings();
+    ::close(ring_fd_);
+}
+
+
+void IoUring::prepareRead(const int fd, void * const buffer, const unsigned count, const off_t offset, const uint64_t user_data) {
+    io_uring_sqe * const sqe(getSubmissionQueueEntry());
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len       = count;
+    sqe->off       = static_cast<uint64_t>(offset);
+    sqe->user_data = user_data;
+}
+
+
+void IoUring::prepareWrite(const int fd, const void * const buffer, const unsigned count, const off_t offset,
+                           const uint64_t user_data)
+{
+    io_uring_sqe * const sqe(getSubmissionQueueEntry());
+    sqe->opcode    = IORING_OP_WRITE;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len       = count;
+    sqe->off       = static_cast<uint64_t>(offset);
+    sqe->user_data = user_data;
+}
+
+
+void IoUring::submit() {
+    while (unsubmitted_count_ > 0) {
+        const int submitted_count(enter(unsubmitted_count_, 0, 0));
+        if (unlikely(submitted_count < 0))
+            throw std::runtime_error("in IoUring::submit: io_uring_enter(2) failed: " + std::string(std::strerror(-submitted_count)));
+        unsubmitted_count_ -= submitted_count;
+        in_flight_count_ += submitted_count;
+    }
+}
+
+
+bool IoUring::getCompletion(uint64_t * const user_data, int * const result, const bool wait) {
+    submit();
+
+    for (;;) {
+        const unsigned head(*cq_head_);
+        if (head != LoadAcquire(cq_tail_)) {
+            const io_uring_cqe &cqe(cqes_[head & *cq_ring_mask_]);
+            *user_data = cqe.user_data;
+            *result    = cqe.res;
+            StoreRelease(cq_head_, head + 1);
+            --in_flight_count_;
+            return true;
+        }
+
+        if (not wait)
+            return false;
+        if (unlikely(in_flight_count_ == 0))
+            throw std::runtime_error("in IoUring::getCompletion: waiting w/o any requests in flight!");
+
+        const int retval(enter(0, 1, IORING_ENTER_GETEVENTS));
+        if (unlikely(retval < 0 and retval != -EINTR))
+            throw std::runtime_error("in IoUring::getCompletion: io_uring_enter(2) failed: " + std::string(std::strerror(-retval)));
+    }
+}
+
+
+io_uring_sqe *IoUring::getSubmissionQueueEntry() {
+    const unsigned tail(*sq_tail_);
+    if (tail - LoadAcquire(sq_head_) == entries_) { // The submission queue is full.
+        submit();
+        if (unlikely(tail - LoadAcquire(sq_head_) == entries_))
+            throw std::runtime_error("in IoUring::getSubmissionQueueEntry: submission queue overflow!");
+    }
+
+    const unsigned index(tail & *sq_ring_mask_);
+    io_uring_sqe * const sqe(&sqes_[index]);
+    std::memset(sqe, 0, sizeof *sqe);
+    sq_array_[index] = index;
+    StoreRelease(sq_tail_, tail + 1);
+    ++unsubmitted_count_;
+
+    return sqe;
+}
+
+
+void IoUring::unmapRings() {
+    if (sqes_ != MAP_FAILED)
+        ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED and cq_ring_ != sq_ring_)
+        ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+        ::munmap(sq_ring_, sq_ring_size_);
+}
+
+
+int IoUring::enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags) {
+    const long retval(::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0));
+    return (retval == -1) ? -errno : static_cast<int>(retval);
+}
@@ -18,12 +18,23 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "JSON.h"
+#include <algorithm>
 #include <deque>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <cctype>
+#include <cinttypes>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Compiler.h"
+#include "File.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 
@@ -149,6 +160,7 @@ TokenType Scanner::parseNumber() {
     }
 
     if (*ch_ == '.') {
+        number_as_string += *ch_;
         for (++ch_; ch_ != end_ and StringUtil::IsDigit(*ch_); ++ch_)
             number_as_string += *ch_;
     }
@@ -164,10 +176,10 @@ TokenType Scanner::parseNumber() {
         return DOUBLE_CONST;
     }
 
-    ++ch_;
-    if (*ch_ == '+' or *ch_ == '-')
+    number_as_string += *ch_++;
+    if (ch_ != end_ and (*ch_ == '+' or *ch_ == '-'))
         number_as_string += *ch_++;
-    if (unlikely(not StringUtil::IsDigit(*ch_))) {
+    if (unlikely(ch_ == end_ or not StringUtil::IsDigit(*ch_))) {
         last_error_message_ = "missing digits for the exponent!";
         return ERROR;
     }
@@ -410,19 +422,54 @@ std::shared_ptr<JSONNode> ObjectNode::clone() const {
 }
 
 
-std::string ObjectNode::toString() const {
-    std::string as_string;
-    as_string += "{ ";
-    for (const auto &entry : entries_) {
-        as_string += "\"" + EscapeString(entry.first) + "\"";
-        as_string += ": ";
-        as_string += entry.second->toString();
-        as_string += ", ";
+namespace {
+
+
+// Produces the same output as the toString() member functions but w/o creating a temporary string per node.
+void AppendNodeAsString(const JSONNode &node, std::string * const output) {
+    switch (node.getType()) {
+    case JSONNode::STRING_NODE:
+        *output += '"';
+        AppendEscapedString(reinterpret_cast<const StringNode &>(node).getValue(), output);
+        *output += '"';
+        return;
+    case JSONNode::OBJECT_NODE: {
+        const auto &object_node(reinterpret_cast<const ObjectNode &>(node));
+        *output += "{ ";
+        for (auto entry(object_node.begin()); entry != object_node.end(); ++entry) {
+            if (entry != object_node.begin())
+                *output += ", ";
+            *output += '"';
+            AppendEscapedString(entry->first, output);
+            *output += "\": ";
+            AppendNodeAsString(*entry->second, output);
+        }
+        *output += " }";
+        return;
+    }
+    case JSONNode::ARRAY_NODE: {
+        const auto &array_node(reinterpret_cast<const ArrayNode &>(node));
+        *output += "[ ";
+        for (auto element(array_node.begin()); element != array_node.end(); ++element) {
+            if (element != array_node.begin())
+                *output += ", ";
+            AppendNodeAsString(**element, output);
+        }
+        *output += " ]";
+        return;
     }
-    if (not entries_.empty())
-        as_string.resize(as_string.size() - 2); // Strip off final comma+space.
-    as_string += " }";
+    default:
+        *output += node.toString();
+    }
+}
+
 
+} // unnamed namespace
+
+
+std::string ObjectNode::toString() const {
+    std::string as_string;
+    AppendNodeAsString(*this, &as_string);
     return as_string;
 }
 
@@ -483,15 +530,7 @@ std::shared_ptr<JSONNode> ArrayNode::clone() const {
 
 std::string ArrayNode::toString() const {
     std::string as_string;
-    as_string += "[ ";
-    for (const auto &value : values_) {
-        as_string += value->toString();
-        as_string += ", ";
-    }
-    if (not values_.empty())
-        as_string.resize(as_string.size() - 2); // Strip off final comma+space.
-    as_string += " ]";
-
+    AppendNodeAsString(*this, &as_string);
     return as_string;
 }
 
@@ -503,6 +542,20 @@ bool ArrayNode::isNullNode(const size_t index) const {
 }
 
 
+// Backslash-escapes slashes and backslashes as expected by ParsePath().
+static std::string EscapePathComponent(const std::string &component) {
+    std::string escaped_component;
+    escaped_component.reserve(component.length());
+    for (const char ch : component) {
+        if (ch == '/' or ch == '\\')
+            escaped_component += '\\';
+        escaped_component += ch;
+    }
+
+    return escaped_component;
+}
+
+
 bool Parser::parseObject(std::shared_ptr<JSONNode> * const new_object_node) {
     *new_object_node = std::shared_ptr<ObjectNode>(new ObjectNode());
     TokenType token(scanner_.getToken());
@@ -524,10 +577,17 @@ bool Parser::parseObject(std::shared_ptr<JSONNode> * const new_object_node) {
             return false;
         }
 
+        const size_t old_path_length(current_path_.length());
+        if (element_handler_)
+            current_path_ += "/" + EscapePathComponent(label);
+
         std::shared_ptr<JSONNode> new_node;
         if (unlikely(not parseAny(&new_node)))
             return false;
 
+        if (element_handler_)
+            current_path_.resize(old_path_length);
+
         JSONNode::CastToObjectNodeOrDie("new_object_node", *new_object_node)->insert(label, new_node);
 
         token = scanner_.getToken();
@@ -551,19 +611,33 @@ bool Parser::parseArray(std::shared_ptr<JSONNode> * const new_array_node) {
         return true; // Empty array.
     scanner_.ungetToken(token);
 
+    const bool stream_elements(element_handler_ and current_path_ == streamed_array_path_);
+    const size_t old_path_length(current_path_.length());
+    if (element_handler_)
+        current_path_ += "/*"; // Keeps arrays nested in our elements from matching "streamed_array_path_".
+
     for (;;) {
         std::shared_ptr<JSONNode> new_node(nullptr);
         if (unlikely(not parseAny(&new_node))) {
             return false;
         }
-        JSONNode::CastToArrayNodeOrDie("new_array_node", *new_array_node)->push_back(new_node);
+        if (not stream_elements)
+            JSONNode::CastToArrayNodeOrDie("new_array_node", *new_array_node)->push_back(new_node);
+        else if (unlikely(not element_handler_(new_node))) {
+            error_message_ = "element handler failed for an element of \"" + streamed_array_path_ + "\" ending on line "
+                             + std::to_string(scanner_.getLineNumber()) + "!";
+            return false;
+        }
 
 
         token = scanner_.getToken();
         if (token == COMMA)
             /* Intentionally empty! */;
-        else if (token == CLOSE_BRACKET)
+        else if (token == CLOSE_BRACKET) {
+            if (element_handler_)
+                current_path_.resize(old_path_length);
             return true;
+        }
         else {
             error_message_ = "expected ',' or ']' on line " + std::to_string(scanner_.getLineNumber())
                              + " but found '" + TokenTypeToString(token) + "!";
@@ -632,6 +706,480 @@ bool Parser::parse(std::shared_ptr<JSONNode> * const tree_root) {
 }
 
 
+bool Parser::parse(std::shared_ptr<JSONNode> * const tree_root, const std::string &array_path,
+                   const ElementHandler &element_handler)
+{
+    if (unlikely(not element_handler))
+        throw std::runtime_error("in JSON::Parser::parse: missing element handler!");
+
+    streamed_array_path_ = array_path;
+    element_handler_     = element_handler;
+    current_path_.clear();
+
+    const bool success(parse(tree_root));
+    element_handler_ = nullptr;
+
+    return success;
+}
+
+
+PullReader::PullReader(const InputFunction &input_function)
+    : input_function_(input_function), ch_(nullptr), end_(nullptr), mmap_(nullptr), mmap_size_(0), line_no_(1),
+      last_event_(NULL_VALUE), integer_value_(0), double_value_(0.0), boolean_value_(false) { }
+
+
+PullReader::PullReader(const std::string &json_document)
+    : ch_(json_document.data()), end_(json_document.data() + json_document.size()), mmap_(nullptr), mmap_size_(0),
+      line_no_(1), last_event_(NULL_VALUE), integer_value_(0), double_value_(0.0), boolean_value_(false) { }
+
+
+std::unique_ptr<PullReader> PullReader::FromFile(const std::string &path) {
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (unlikely(fd == -1))
+        throw std::runtime_error("in JSON::PullReader::FromFile: can't open \"" + path + "\" for reading!");
+
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd, &stat_buf) != 0)) {
+        ::close(fd);
+        throw std::runtime_error("in JSON::PullReader::FromFile: can't stat \"" + path + "\"!");
+    }
+
+    static const std::string EMPTY_DOCUMENT;
+    std::unique_ptr<PullReader> reader(new PullReader(EMPTY_DOCUMENT));
+    if (stat_buf.st_size > 0) { // mmap(2) fails for empty files.
+        void * const mapping(::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (unlikely(mapping == MAP_FAILED)) {
+            ::close(fd);
+            throw std::runtime_error("in JSON::PullReader::FromFile: failed to mmap \"" + path + "\"!");
+        }
+        ::madvise(mapping, stat_buf.st_size, MADV_SEQUENTIAL);
+
+        reader->mmap_      = mapping;
+        reader->mmap_size_ = stat_buf.st_size;
+        reader->ch_        = reinterpret_cast<const char *>(mapping);
+        reader->end_       = reader->ch_ + stat_buf.st_size;
+    }
+    ::close(fd);
+
+    return reader;
+}
+
+
+PullReader::~PullReader() {
+    if (mmap_ != nullptr)
+        ::munmap(mmap_, mmap_size_);
+}
+
+
+bool PullReader::fillBuffer() {
+    if (not input_function_)
+        return false;
+
+    buffer_.resize(BUFFER_SIZE);
+    const size_t count(input_function_(&buffer_[0], BUFFER_SIZE));
+    if (count == 0) {
+        input_function_ = nullptr;
+        return false;
+    }
+
+    ch_  = buffer_.data();
+    end_ = ch_ + count;
+    return true;
+}
+
+
+void PullReader::skipWhite() {
+    int ch;
+    while ((ch = peekChar()) != EOF and std::isspace(ch))
+        getChar();
+}
+
+
+PullReader::EventType PullReader::error(const std::string &error_message) {
+    error_message_ = error_message + " (line: " + std::to_string(line_no_) + ")";
+    return last_event_ = ERROR;
+}
+
+
+PullReader::EventType PullReader::next() {
+    if (unlikely(last_event_ == ERROR or last_event_ == END_OF_INPUT))
+        return last_event_;
+
+    skipWhite();
+    if (containers_.empty()) {
+        if (peekChar() == EOF)
+            return last_event_ = END_OF_INPUT;
+        return last_event_ = parseValue();
+    }
+
+    Container &container(containers_.back());
+    const int ch(peekChar());
+    if (unlikely(ch == EOF))
+        return error("unexpected end of input!");
+
+    switch (container.state_) {
+    case EXPECT_KEY_OR_END:
+    case EXPECT_VALUE_OR_END:
+        if (ch == (container.is_object_ ? '}' : ']')) {
+            getChar();
+            const bool is_object(container.is_object_);
+            containers_.pop_back();
+            return last_event_ = is_object ? END_OBJECT : END_ARRAY;
+        }
+        return last_event_ = container.is_object_ ? parseKey() : parseValue();
+    case EXPECT_KEY:
+        return last_event_ = parseKey();
+    case EXPECT_VALUE:
+        return last_event_ = parseValue();
+    case EXPECT_COMMA_OR_END:
+        getChar();
+        if (ch == ',') {
+            container.state_ = container.is_object_ ? EXPECT_KEY : EXPECT_VALUE;
+            return next();
+        }
+        if (ch == (container.is_object_ ? '}' : ']')) {
+            const bool is_object(container.is_object_);
+            containers_.pop_back();
+            return last_event_ = is_object ? END_OBJECT : END_ARRAY;
+        }
+        return error("expected ',' or '" + std::string(container.is_object_ ? "}" : "]") + "' but found '"
+                     + std::string(1, static_cast<char>(ch)) + "'!");
+    }
+
+    return error("internal error: unknown state!");
+}
+
+
+PullReader::EventType PullReader::parseKey() {
+    if (unlikely(peekChar() != '"'))
+        return error("expected a key!");
+    if (unlikely(not parseString(&string_value_)))
+        return ERROR;
+
+    skipWhite();
+    if (unlikely(getChar() != ':'))
+        return error("expected ':' after the key \"" + string_value_ + "\"!");
+
+    Container &container(containers_.back());
+    container.key_ = string_value_;
+    container.state_ = EXPECT_VALUE;
+    return KEY;
+}
+
+
+PullReader::EventType PullReader::parseValue() {
+    if (not containers_.empty()) {
+        Container &container(containers_.back());
+        container.state_ = EXPECT_COMMA_OR_END;
+        if (not container.is_object_)
+            ++container.element_count_;
+    }
+
+    switch (peekChar()) {
+    case '{':
+        getChar();
+        containers_.emplace_back(/* is_object = */true);
+        return START_OBJECT;
+    case '[':
+        getChar();
+        containers_.emplace_back(/* is_object = */false);
+        return START_ARRAY;
+    case '"':
+        return parseString(&string_value_) ? STRING_VALUE : ERROR;
+    case 't':
+        boolean_value_ = true;
+        return expectSequence("true", BOOLEAN_VALUE);
+    case 'f':
+        boolean_value_ = false;
+        return expectSequence("false", BOOLEAN_VALUE);
+    case 'n':
+        return expectSequence("null", NULL_VALUE);
+    case '-':
+    case '+':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        return parseNumber();
+    default:
+        const int ch(peekChar());
+        if (ch == EOF)
+            return error("unexpected end of input!");
+        return error("unexpected character '" + (::isprint(ch) ? std::string(1, static_cast<char>(ch))
+                                                 : "\\x" + StringUtil::ToHexString(static_cast<unsigned char>(ch))) + "'!");
+    }
+}
+
+
+PullReader::EventType PullReader::expectSequence(const std::string &sequence, const EventType success_event) {
+    for (const char expected_ch : sequence) {
+        if (unlikely(getChar() != expected_ch))
+            return error("expected \"" + sequence + "\"!");
+    }
+
+    return success_event;
+}
+
+
+PullReader::EventType PullReader::parseNumber() {
+    std::string number_as_string;
+    bool is_integer(true);
+    int ch;
+    while ((ch = peekChar()) != EOF and (StringUtil::IsDigit(ch) or ch == '+' or ch == '-' or ch == '.' or ch == 'e' or ch == 'E')) {
+        if (ch == '.' or ch == 'e' or ch == 'E')
+            is_integer = false;
+        number_as_string += static_cast<char>(getChar());
+    }
+
+    if (is_integer) {
+        if (likely(StringUtil::ToInt64T(number_as_string, &integer_value_)))
+            return INTEGER_VALUE;
+        // Integers that don't fit into 64 bits are returned as doubles, like JSON::Scanner does.
+    }
+
+    if (unlikely(not StringUtil::ToDouble(number_as_string, &double_value_)))
+        return error("failed to convert \"" + number_as_string + "\" to a number!");
+    return DOUBLE_VALUE;
+}
+
+
+bool PullReader::parseUTF16Escape(std::string * const utf8) {
+    uint16_t u[2];
+    for (unsigned i(0); i < 2; ++i) {
+        if (i == 1 and (getChar() != '\\' or getChar() != 'u')) {
+            error("missing the 2nd half of a UTF-16 surrogate pair!");
+            return false;
+        }
+
+        std::string hex_codes;
+        for (unsigned j(0); j < 4; ++j) {
+            const int ch(getChar());
+            if (unlikely(ch == EOF)) {
+                error("unexpected end of input in a \\unnnn escape!");
+                return false;
+            }
+            hex_codes += static_cast<char>(ch);
+        }
+        if (unlikely(not StringUtil::ToUnsignedShort(hex_codes, &u[i], 16))) {
+            error("invalid hex sequence \\u" + hex_codes + "!");
+            return false;
+        }
+
+        if (i == 0) {
+            if (TextUtil::IsValidSingleUTF16Char(u[0])) {
+                *utf8 = TextUtil::UTF32ToUTF8(TextUtil::UTF16ToUTF32(u[0]));
+                return true;
+            }
+            if (unlikely(not TextUtil::IsFirstHalfOfSurrogatePair(u[0]))) {
+                error("\\u" + hex_codes + " is neither a standalone character nor the first half of a surrogate pair!");
+                return false;
+            }
+        } else if (unlikely(not TextUtil::IsSecondHalfOfSurrogatePair(u[1]))) {
+            error("invalid 2nd half of a surrogate pair: \\u" + hex_codes + "!");
+            return false;
+        }
+    }
+
+    *utf8 = TextUtil::UTF32ToUTF8(TextUtil::UTF16ToUTF32(u[0], u[1]));
+    return true;
+}
+
+
+bool PullReader::parseString(std::string * const s) {
+    getChar(); // Skip over the opening double quote.
+
+    s->clear();
+    for (;;) {
+        // Copy runs of plain characters in one go:
+        const char *run_start(ch_);
+        while (ch_ != end_ and *ch_ != '"' and *ch_ != '\\' and *ch_ != '\n')
+            ++ch_;
+        s->append(run_start, ch_ - run_start);
+
+        int ch(getChar());
+        switch (ch) {
+        case EOF:
+            error("unexpected end of input in a string constant!");
+            return false;
+        case '"':
+            return true;
+        default: // A plain character at the beginning of a new chunk or a newline.
+            *s += static_cast<char>(ch);
+            break;
+        case '\\':
+            switch (ch = getChar()) {
+            case '/':
+            case '"':
+            case '\\':
+                *s += static_cast<char>(ch);
+                break;
+            case 'b':
+                *s += '\b';
+                break;
+            case 'f':
+                *s += '\f';
+                break;
+            case 'n':
+                *s += '\n';
+                break;
+            case 'r':
+                *s += '\r';
+                break;
+            case 't':
+                *s += '\t';
+                break;
+            case 'u': {
+                std::string utf8;
+                if (unlikely(not parseUTF16Escape(&utf8)))
+                    return false;
+                *s += utf8;
+                break;
+            }
+            default:
+                error(ch == EOF ? "unexpected end of input in a string constant!"
+                                : "unexpected escape \\" + std::string(1, static_cast<char>(ch)) + " in a string constant!");
+                return false;
+            }
+        }
+    }
+}
+
+
+// Escapes a reference token as described in RFC 6901.
+static std::string EscapeJSONPointerComponent(const std::string &component) {
+    std::string escaped_component;
+    escaped_component.reserve(component.length());
+    for (const char ch : component) {
+        if (ch == '~')
+            escaped_component += "~0";
+        else if (ch == '/')
+            escaped_component += "~1";
+        else
+            escaped_component += ch;
+    }
+
+    return escaped_component;
+}
+
+
+std::string PullReader::getPath() const {
+    // For START_OBJECT and START_ARRAY events the new container has already been pushed, but the path is that of the
+    // container itself:
+    const size_t container_count((last_event_ == START_OBJECT or last_event_ == START_ARRAY) ? containers_.size() - 1
+                                                                                               : containers_.size());
+    std::string path;
+    for (size_t i(0); i < container_count; ++i) {
+        path += '/';
+        if (containers_[i].is_object_)
+            path += EscapeJSONPointerComponent(containers_[i].key_);
+        else
+            path += std::to_string(containers_[i].element_count_ - 1);
+    }
+
+    return path;
+}
+
+
+bool PullReader::pathMatches(const std::string &pattern) const {
+    const std::string path(getPath());
+    auto path_ch(path.cbegin()), pattern_ch(pattern.cbegin());
+    while (path_ch != path.cend() and pattern_ch != pattern.cend()) {
+        if (*path_ch != '/' or *pattern_ch != '/')
+            return false;
+        ++path_ch, ++pattern_ch;
+
+        const auto path_component_end(std::find(path_ch, path.cend(), '/'));
+        const auto pattern_component_end(std::find(pattern_ch, pattern.cend(), '/'));
+        if (not (pattern_component_end - pattern_ch == 1 and *pattern_ch == '*')
+            and not std::equal(path_ch, path_component_end, pattern_ch, pattern_component_end))
+            return false;
+
+        path_ch    = path_component_end;
+        pattern_ch = pattern_component_end;
+    }
+
+    return path_ch == path.cend() and pattern_ch == pattern.cend();
+}
+
+
+bool PullReader::readValue(std::shared_ptr<JSONNode> * const value) {
+    switch (last_event_) {
+    case STRING_VALUE:
+        *value = std::make_shared<StringNode>(string_value_);
+        return true;
+    case INTEGER_VALUE:
+        *value = std::make_shared<IntegerNode>(integer_value_);
+        return true;
+    case DOUBLE_VALUE:
+        *value = std::make_shared<DoubleNode>(double_value_);
+        return true;
+    case BOOLEAN_VALUE:
+        *value = std::make_shared<BooleanNode>(boolean_value_);
+        return true;
+    case NULL_VALUE:
+        *value = std::make_shared<NullNode>();
+        return true;
+    case START_OBJECT: {
+        const auto object_node(std::make_shared<ObjectNode>());
+        for (;;) {
+            const EventType event(next());
+            if (event == END_OBJECT)
+                break;
+            if (unlikely(event != KEY))
+                return event == ERROR ? false : error("expected a key!") != ERROR;
+            const std::string key(string_value_);
+
+            std::shared_ptr<JSONNode> member;
+            if (unlikely(next() == ERROR or not readValue(&member)))
+                return false;
+            object_node->insert(key, member);
+        }
+        *value = object_node;
+        return true;
+    }
+    case START_ARRAY: {
+        const auto array_node(std::make_shared<ArrayNode>());
+        for (;;) {
+            const EventType event(next());
+            if (event == END_ARRAY)
+                break;
+
+            std::shared_ptr<JSONNode> element;
+            if (unlikely(event == ERROR or not readValue(&element)))
+                return false;
+            array_node->push_back(element);
+        }
+        *value = array_node;
+        return true;
+    }
+    case ERROR:
+        return false;
+    default:
+        return error("the last event did not start a value!") != ERROR;
+    }
+}
+
+
+bool PullReader::skipValue() {
+    if (last_event_ != START_OBJECT and last_event_ != START_ARRAY)
+        return last_event_ != ERROR and last_event_ != END_OF_INPUT and last_event_ != KEY;
+
+    const size_t depth(containers_.size());
+    while (containers_.size() >= depth) {
+        if (unlikely(next() == ERROR or last_event_ == END_OF_INPUT))
+            return false;
+    }
+
+    return true;
+}
+
+
 std::string TokenTypeToString(const TokenType token) {
     switch (token) {
     case COMMA:
@@ -890,45 +1438,785 @@ int64_t LookupInteger(const std::string &path, const std::shared_ptr<const JSONN
 
 
 // See https://www.ietf.org/rfc/rfc4627.txt section 2.5 in order to understand this.
-std::string EscapeString(const std::string &unescaped_string) {
-    std::string escaped_string;
-    for (const char ch : unescaped_string) {
-        switch (ch) {
-        case '\\':
-            escaped_string += "\\\\";
-            break;
-        case '"':
-            escaped_string += "\\\"";
-            break;
-        case '/':
-            escaped_string += "\\/";
-            break;
-        case '\b':
-            escaped_string += "\\b";
-            break;
-        case '\f':
-            escaped_string += "\\f";
+void *Document::Arena::allocate(size_t size) {
+    size = (size + 7u) & ~static_cast<size_t>(7u); // Keep everything 8-byte aligned.
+    if (size > remaining_) {
+        const size_t block_size(size > BLOCK_SIZE ? size : BLOCK_SIZE);
+        blocks_.emplace_back(new char[block_size]);
+        next_ = blocks_.back().get();
+        remaining_ = block_size;
+    }
+
+    void * const allocation(next_);
+    next_ += size;
+    remaining_ -= size;
+    return allocation;
+}
+
+
+bool Document::Value::getBoolean() const {
+    if (unlikely(type_ != BOOLEAN_TYPE))
+        LOG_ERROR("not a boolean value!");
+    return boolean_;
+}
+
+
+int64_t Document::Value::getInteger() const {
+    if (unlikely(type_ != INTEGER_TYPE))
+        LOG_ERROR("not an integer value!");
+    return integer_;
+}
+
+
+double Document::Value::getDouble() const {
+    if (type_ == INTEGER_TYPE)
+        return static_cast<double>(integer_);
+    if (unlikely(type_ != DOUBLE_TYPE))
+        LOG_ERROR("not a numeric value!");
+    return double_;
+}
+
+
+StringView Document::Value::getString() const {
+    if (unlikely(type_ != STRING_TYPE))
+        LOG_ERROR("not a string value!");
+    return StringView(string_, size_);
+}
+
+
+const Document::Value &Document::Value::operator[](const size_t index) const {
+    if (unlikely(type_ != ARRAY_TYPE))
+        LOG_ERROR("not an array!");
+    if (unlikely(index >= size_))
+        LOG_ERROR("index " + std::to_string(index) + " is out of range for an array of size " + std::to_string(size_) + "!");
+    return elements_[index];
+}
+
+
+const Document::Member &Document::Value::getMember(const size_t index) const {
+    if (unlikely(type_ != OBJECT_TYPE))
+        LOG_ERROR("not an object!");
+    if (unlikely(index >= size_))
+        LOG_ERROR("index " + std::to_string(index) + " is out of range for an object w/ " + std::to_string(size_) + " members!");
+    return members_[index];
+}
+
+
+const Document::Value *Document::Value::find(const StringView &key) const {
+    if (type_ != OBJECT_TYPE)
+        return nullptr;
+
+    if (size_ <= LINEAR_SEARCH_LIMIT) {
+        for (const Member *member(members_); member != members_ + size_; ++member) {
+            if (member->key_ == key)
+                return &member->value_;
+        }
+        return nullptr;
+    }
+
+    const Member * const member(std::lower_bound(members_, members_ + size_, key,
+                                                 [](const Member &lhs, const StringView &rhs) { return lhs.key_ < rhs; }));
+    return (member != members_ + size_ and member->key_ == key) ? &member->value_ : nullptr;
+}
+
+
+std::string Document::Value::getOptionalString(const StringView &key, const std::string &default_value) const {
+    const Value * const value(find(key));
+    return (value == nullptr or value->type_ != STRING_TYPE) ? default_value : std::string(value->string_, value->size_);
+}
+
+
+const Document::Value *Document::Value::lookup(const std::string &path) const {
+    if (path.empty())
+        return this;
+    if (unlikely(path[0] != '/'))
+        LOG_ERROR("\"" + path + "\" is not a valid JSON pointer!");
+
+    const Value *value(this);
+    size_t component_start(1);
+    for (;;) {
+        size_t component_end(path.find('/', component_start));
+        if (component_end == std::string::npos)
+            component_end = path.length();
+        std::string component(path.substr(component_start, component_end - component_start));
+        if (component.find('~') != std::string::npos) {
+            StringUtil::ReplaceString("~1", "/", &component);
+            StringUtil::ReplaceString("~0", "~", &component);
+        }
+
+        if (value->type_ == OBJECT_TYPE)
+            value = value->find(component);
+        else if (value->type_ == ARRAY_TYPE) {
+            unsigned index;
+            if (not StringUtil::ToUnsigned(component, &index) or index >= value->size_)
+                return nullptr;
+            value = value->elements_ + index;
+        } else
+            return nullptr;
+
+        if (value == nullptr or component_end == path.length())
+            return value;
+        component_start = component_end + 1;
+    }
+}
+
+
+std::string Document::Value::toString() const {
+    switch (type_) {
+    case NULL_TYPE:
+        return "null";
+    case BOOLEAN_TYPE:
+        return boolean_ ? "true" : "false";
+    case INTEGER_TYPE:
+        return std::to_string(integer_);
+    case DOUBLE_TYPE:
+        return DoubleNode(double_).toString();
+    case STRING_TYPE:
+        return "\"" + EscapeString(std::string(string_, size_)) + "\"";
+    case ARRAY_TYPE: {
+        std::string as_string("[");
+        for (size_t i(0); i < size_; ++i) {
+            if (i > 0)
+                as_string += ',';
+            as_string += elements_[i].toString();
+        }
+        return as_string + "]";
+    }
+    case OBJECT_TYPE: {
+        std::string as_string("{");
+        for (size_t i(0); i < size_; ++i) {
+            if (i > 0)
+                as_string += ',';
+            as_string += "\"" + EscapeString(members_[i].key_.toString()) + "\":" + members_[i].value_.toString();
+        }
+        return as_string + "}";
+    }
+    }
+
+    __builtin_unreachable();
+}
+
+
+std::shared_ptr<JSONNode> Document::Value::toJSONNode() const {
+    switch (type_) {
+    case NULL_TYPE:
+        return std::make_shared<NullNode>();
+    case BOOLEAN_TYPE:
+        return std::make_shared<BooleanNode>(boolean_);
+    case INTEGER_TYPE:
+        return std::make_shared<IntegerNode>(integer_);
+    case DOUBLE_TYPE:
+        return std::make_shared<DoubleNode>(double_);
+    case STRING_TYPE:
+        return std::make_shared<StringNode>(std::string(string_, size_));
+    case ARRAY_TYPE: {
+        const auto array_node(std::make_shared<ArrayNode>());
+        for (size_t i(0); i < size_; ++i)
+            array_node->push_back(elements_[i].toJSONNode());
+        return array_node;
+    }
+    case OBJECT_TYPE: {
+        const auto object_node(std::make_shared<ObjectNode>());
+        for (size_t i(0); i < size_; ++i)
+            object_node->insert(members_[i].key_.toString(), members_[i].value_.toJSONNode());
+        return object_node;
+    }
+    }
+
+    __builtin_unreachable();
+}
+
+
+Document::Document(std::string json_document): ch_(nullptr), end_(nullptr), line_no_(1), depth_(0) {
+    if (not parse(std::move(json_document)))
+        LOG_ERROR("failed to parse a JSON document: " + error_message_);
+}
+
+
+bool Document::parse(std::string json_document) {
+    json_document_.swap(json_document);
+    arena_.clear();
+    root_ = Value();
+    error_message_.clear();
+    ch_ = json_document_.data();
+    end_ = ch_ + json_document_.size();
+    line_no_ = 1;
+    depth_ = 0;
+    element_stack_.clear();
+    member_stack_.clear();
+
+    skipWhite();
+    if (unlikely(ch_ == end_))
+        return error("empty JSON document!");
+    if (parseValue(&root_)) {
+        skipWhite();
+        if (likely(ch_ == end_))
+            return true;
+        error("unexpected trailing input!");
+    }
+
+    root_ = Value();
+    arena_.clear();
+    return false;
+}
+
+
+bool Document::error(const std::string &error_message) {
+    error_message_ = error_message + " (line: " + std::to_string(line_no_) + ")";
+    return false;
+}
+
+
+void Document::skipWhite() {
+    while (ch_ != end_ and std::isspace(*ch_)) {
+        if (*ch_ == '\n')
+            ++line_no_;
+        ++ch_;
+    }
+}
+
+
+// \note Expects to be called w/ leading whitespace already skipped.
+bool Document::parseValue(Value * const value) {
+    if (unlikely(ch_ == end_))
+        return error("unexpected end of input while looking for a value!");
+
+    switch (*ch_) {
+    case '{':
+        return parseObject(value);
+    case '[':
+        return parseArray(value);
+    case '"': {
+        StringView s;
+        if (unlikely(not parseString(&s)))
+            return false;
+        value->type_ = STRING_TYPE;
+        value->string_ = s.data();
+        value->size_ = s.size();
+        return true;
+    }
+    case 't':
+        value->type_ = BOOLEAN_TYPE;
+        value->boolean_ = true;
+        return parseLiteral("true", __builtin_strlen("true"));
+    case 'f':
+        value->type_ = BOOLEAN_TYPE;
+        value->boolean_ = false;
+        return parseLiteral("false", __builtin_strlen("false"));
+    case 'n':
+        value->type_ = NULL_TYPE;
+        return parseLiteral("null", __builtin_strlen("null"));
+    default:
+        if (StringUtil::IsDigit(*ch_) or *ch_ == '-' or *ch_ == '+')
+            return parseNumber(value);
+        return error("unexpected character '" + std::string(1, *ch_) + "' while looking for a value!");
+    }
+}
+
+
+bool Document::parseObject(Value * const value) {
+    if (unlikely(++depth_ > MAX_NESTING_DEPTH))
+        return error("maximum nesting depth exceeded!");
+    ++ch_; // Skip over the opening brace.
+
+    const size_t first_member(member_stack_.size());
+    skipWhite();
+    if (ch_ != end_ and *ch_ == '}')
+        ++ch_;
+    else {
+        for (;;) {
+            Member member;
+            if (unlikely(ch_ == end_ or *ch_ != '"'))
+                return error("expected a double-quoted object key!");
+            if (unlikely(not parseString(&member.key_)))
+                return false;
+            skipWhite();
+            if (unlikely(ch_ == end_ or *ch_ != ':'))
+                return error("expected a colon after the key \"" + member.key_.toString() + "\"!");
+            ++ch_;
+            skipWhite();
+            if (unlikely(not parseValue(&member.value_)))
+                return false;
+            member_stack_.emplace_back(member);
+
+            skipWhite();
+            if (unlikely(ch_ == end_))
+                return error("unexpected end of input in an object!");
+            if (*ch_ == '}') {
+                ++ch_;
+                break;
+            }
+            if (unlikely(*ch_ != ','))
+                return error("expected a comma or a closing brace in an object!");
+            ++ch_;
+            skipWhite();
+        }
+    }
+
+    const size_t member_count(member_stack_.size() - first_member);
+    Member * const members(member_count == 0 ? nullptr
+                                             : reinterpret_cast<Member *>(arena_.allocate(member_count * sizeof(Member))));
+    std::uninitialized_copy(member_stack_.begin() + first_member, member_stack_.end(), members);
+    member_stack_.resize(first_member);
+    if (member_count > LINEAR_SEARCH_LIMIT)
+        std::stable_sort(members, members + member_count,
+                         [](const Member &lhs, const Member &rhs) { return lhs.key_ < rhs.key_; });
+
+    value->type_ = OBJECT_TYPE;
+    value->size_ = member_count;
+    value->members_ = members;
+    --depth_;
+    return true;
+}
+
+
+bool Document::parseArray(Value * const value) {
+    if (unlikely(++depth_ > MAX_NESTING_DEPTH))
+        return error("maximum nesting depth exceeded!");
+    ++ch_; // Skip over the opening bracket.
+
+    const size_t first_element(element_stack_.size());
+    skipWhite();
+    if (ch_ != end_ and *ch_ == ']')
+        ++ch_;
+    else {
+        for (;;) {
+            Value element;
+            if (unlikely(not parseValue(&element)))
+                return false;
+            element_stack_.emplace_back(element);
+
+            skipWhite();
+            if (unlikely(ch_ == end_))
+                return error("unexpected end of input in an array!");
+            if (*ch_ == ']') {
+                ++ch_;
+                break;
+            }
+            if (unlikely(*ch_ != ','))
+                return error("expected a comma or a closing bracket in an array!");
+            ++ch_;
+            skipWhite();
+        }
+    }
+
+    const size_t element_count(element_stack_.size() - first_element);
+    Value * const elements(element_count == 0 ? nullptr
+                                              : reinterpret_cast<Value *>(arena_.allocate(element_count * sizeof(Value))));
+    std::uninitialized_copy(element_stack_.begin() + first_element, element_stack_.end(), elements);
+    element_stack_.resize(first_element);
+
+    value->type_ = ARRAY_TYPE;
+    value->size_ = element_count;
+    value->elements_ = elements;
+    --depth_;
+    return true;
+}
+
+
+bool Document::parseUTF16Escape(std::string * const utf8) {
+    uint16_t u[2];
+    for (unsigned i(0); i < 2; ++i) {
+        if (i == 1) {
+            if (unlikely(end_ - ch_ < 2 or ch_[0] != '\\' or ch_[1] != 'u'))
+                return error("missing the 2nd half of a UTF-16 surrogate pair!");
+            ch_ += 2;
+        }
+
+        if (unlikely(end_ - ch_ < 4))
+            return error("unexpected end of input in a \\unnnn escape!");
+        const std::string hex_codes(ch_, 4);
+        ch_ += 4;
+        if (unlikely(not StringUtil::ToUnsignedShort(hex_codes, &u[i], 16)))
+            return error("invalid hex sequence \\u" + hex_codes + "!");
+
+        if (i == 0) {
+            if (TextUtil::IsValidSingleUTF16Char(u[0])) {
+                *utf8 = TextUtil::UTF32ToUTF8(TextUtil::UTF16ToUTF32(u[0]));
+                return true;
+            }
+            if (unlikely(not TextUtil::IsFirstHalfOfSurrogatePair(u[0])))
+                return error("\\u" + hex_codes + " is neither a standalone character nor the first half of a surrogate pair!");
+        } else if (unlikely(not TextUtil::IsSecondHalfOfSurrogatePair(u[1])))
+            return error("invalid 2nd half of a surrogate pair: \\u" + hex_codes + "!");
+    }
+
+    *utf8 = TextUtil::UTF32ToUTF8(TextUtil::UTF16ToUTF32(u[0], u[1]));
+    return true;
+}
+
+
+// Strings w/o escapes are returned as views into the input, all others are unescaped into the arena.
+bool Document::parseString(StringView * const s) {
+    const char * const start(++ch_); // Skip over the opening double quote.
+    while (ch_ != end_ and *ch_ != '"' and *ch_ != '\\') {
+        if (*ch_ == '\n')
+            ++line_no_;
+        ++ch_;
+    }
+    if (unlikely(ch_ == end_))
+        return error("unterminated string!");
+    if (likely(*ch_ == '"')) {
+        *s = StringView(start, ch_ - start);
+        ++ch_;
+        return true;
+    }
+
+    std::string unescaped_string(start, ch_ - start);
+    for (;;) {
+        if (unlikely(ch_ == end_))
+            return error("unterminated string!");
+        const char ch(*ch_++);
+        if (ch == '"')
+            break;
+        if (ch != '\\') {
+            if (ch == '\n')
+                ++line_no_;
+            unescaped_string += ch;
+            continue;
+        }
+
+        if (unlikely(ch_ == end_))
+            return error("unterminated string!");
+        switch (*ch_++) {
+        case '"':
+            unescaped_string += '"';
+            break;
+        case '\\':
+            unescaped_string += '\\';
+            break;
+        case '/':
+            unescaped_string += '/';
+            break;
+        case 'b':
+            unescaped_string += '\b';
+            break;
+        case 'f':
+            unescaped_string += '\f';
+            break;
+        case 'n':
+            unescaped_string += '\n';
+            break;
+        case 'r':
+            unescaped_string += '\r';
+            break;
+        case 't':
+            unescaped_string += '\t';
+            break;
+        case 'u': {
+            std::string utf8;
+            if (unlikely(not parseUTF16Escape(&utf8)))
+                return false;
+            unescaped_string += utf8;
+            break;
+        }
+        default:
+            return error("unknown escape sequence \\" + std::string(1, ch_[-1]) + " in a string!");
+        }
+    }
+
+    char * const copy(reinterpret_cast<char *>(arena_.allocate(unescaped_string.size())));
+    std::memcpy(copy, unescaped_string.data(), unescaped_string.size());
+    *s = StringView(copy, unescaped_string.size());
+    return true;
+}
+
+
+bool Document::parseNumber(Value * const value) {
+    const char * const start(ch_);
+    bool is_integer(true);
+    while (ch_ != end_ and (StringUtil::IsDigit(*ch_) or *ch_ == '+' or *ch_ == '-' or *ch_ == '.' or *ch_ == 'e' or *ch_ == 'E')) {
+        if (*ch_ == '.' or *ch_ == 'e' or *ch_ == 'E')
+            is_integer = false;
+        ++ch_;
+    }
+
+    if (is_integer) {
+        // Avoid the conversion to a std::string for the common case.
+        const char *digit(start);
+        const bool negative(*digit == '-');
+        if (*digit == '-' or *digit == '+')
+            ++digit;
+        uint64_t magnitude(0);
+        bool overflow(digit == ch_);
+        for (; digit != ch_ and not overflow; ++digit) {
+            if (unlikely(not StringUtil::IsDigit(*digit)))
+                return error("failed to convert \"" + std::string(start, ch_ - start) + "\" to a number!");
+            const unsigned digit_value(*digit - '0');
+            if (magnitude > (UINT64_MAX - digit_value) / 10u)
+                overflow = true;
+            else
+                magnitude = magnitude * 10u + digit_value;
+        }
+        const uint64_t limit(negative ? static_cast<uint64_t>(INT64_MAX) + 1u : static_cast<uint64_t>(INT64_MAX));
+        if (likely(not overflow and magnitude <= limit)) {
+            value->type_ = INTEGER_TYPE;
+            value->integer_ = negative ? static_cast<int64_t>(0u - magnitude) : static_cast<int64_t>(magnitude);
+            return true;
+        }
+        // Integers that don't fit into 64 bits are returned as doubles, like JSON::Scanner does.
+    }
+
+    const std::string number_as_string(start, ch_ - start);
+    if (unlikely(not StringUtil::ToDouble(number_as_string, &value->double_)))
+        return error("failed to convert \"" + number_as_string + "\" to a number!");
+    value->type_ = DOUBLE_TYPE;
+    return true;
+}
+
+
+bool Document::parseLiteral(const char * const literal, const size_t literal_length) {
+    if (unlikely(static_cast<size_t>(end_ - ch_) < literal_length or std::memcmp(ch_, literal, literal_length) != 0))
+        return error("expected \"" + std::string(literal) + "\"!");
+    ch_ += literal_length;
+    return true;
+}
+
+
+Writer::Writer(std::string * const output, const Style style)
+    : output_(output), output_file_(nullptr), style_(style), after_key_(false)
+{
+}
+
+
+Writer::Writer(File * const output, const Style style)
+    : output_(&file_buffer_), output_file_(output), style_(style), after_key_(false)
+{
+    file_buffer_.reserve(FILE_BUFFER_SIZE);
+}
+
+
+void Writer::flush() {
+    if (output_file_ == nullptr or file_buffer_.empty())
+        return;
+
+    if (unlikely(not output_file_->write(file_buffer_)))
+        LOG_ERROR("failed to write to \"" + output_file_->getPath() + "\"!");
+    file_buffer_.clear();
+}
+
+
+void Writer::newLineAndIndent() {
+    *output_ += '\n';
+    output_->append(4 * containers_.size(), ' ');
+}
+
+
+void Writer::beginValue() {
+    if (containers_.empty())
+        return;
+
+    if (containers_.back().is_object_) {
+        if (unlikely(not after_key_))
+            LOG_ERROR("missing key for a value inside of an object!");
+        after_key_ = false;
+        return;
+    }
+
+    if (containers_.back().entry_count_++ > 0)
+        *output_ += ',';
+    if (style_ == PRETTY)
+        newLineAndIndent();
+}
+
+
+Writer &Writer::beginObject() {
+    beginValue();
+    *output_ += '{';
+    containers_.emplace_back(/* is_object = */true);
+    return *this;
+}
+
+
+Writer &Writer::endObject() {
+    if (unlikely(containers_.empty() or not containers_.back().is_object_ or after_key_))
+        LOG_ERROR("unexpected end of an object!");
+
+    const size_t member_count(containers_.back().entry_count_);
+    containers_.pop_back();
+    if (style_ == PRETTY and member_count > 0)
+        newLineAndIndent();
+    *output_ += '}';
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::beginArray() {
+    beginValue();
+    *output_ += '[';
+    containers_.emplace_back(/* is_object = */false);
+    return *this;
+}
+
+
+Writer &Writer::endArray() {
+    if (unlikely(containers_.empty() or containers_.back().is_object_))
+        LOG_ERROR("unexpected end of an array!");
+
+    const size_t element_count(containers_.back().entry_count_);
+    containers_.pop_back();
+    if (style_ == PRETTY and element_count > 0)
+        newLineAndIndent();
+    *output_ += ']';
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::key(const StringView &key) {
+    if (unlikely(containers_.empty() or not containers_.back().is_object_ or after_key_))
+        LOG_ERROR("unexpected key \"" + key.toString() + "\"!");
+
+    if (containers_.back().entry_count_++ > 0)
+        *output_ += ',';
+    if (style_ == PRETTY)
+        newLineAndIndent();
+    *output_ += '"';
+    AppendEscapedString(key, output_);
+    output_->append(style_ == PRETTY ? "\": " : "\":");
+    after_key_ = true;
+    return *this;
+}
+
+
+Writer &Writer::stringValue(const StringView &value) {
+    beginValue();
+    *output_ += '"';
+    AppendEscapedString(value, output_);
+    *output_ += '"';
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::integerValue(const int64_t value) {
+    beginValue();
+    char as_string[24];
+    output_->append(as_string, std::snprintf(as_string, sizeof as_string, "%" PRId64, value));
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::doubleValue(const double value) {
+    if (unlikely(not std::isfinite(value)))
+        LOG_ERROR("JSON can't represent " + std::to_string(value) + "!");
+
+    beginValue();
+    // Use the shortest of the two representations that survives a round trip:
+    char as_string[32];
+    int length(std::snprintf(as_string, sizeof as_string, "%.15G", value));
+    if (std::strtod(as_string, nullptr) != value)
+        length = std::snprintf(as_string, sizeof as_string, "%.17G", value);
+    output_->append(as_string, length);
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::booleanValue(const bool value) {
+    beginValue();
+    output_->append(value ? "true" : "false");
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::nullValue() {
+    beginValue();
+    output_->append("null");
+    flushIfFull();
+    return *this;
+}
+
+
+Writer &Writer::nodeValue(const JSONNode &node) {
+    switch (node.getType()) {
+    case JSONNode::BOOLEAN_NODE:
+        return booleanValue(reinterpret_cast<const BooleanNode &>(node).getValue());
+    case JSONNode::NULL_NODE:
+        return nullValue();
+    case JSONNode::STRING_NODE:
+        return stringValue(reinterpret_cast<const StringNode &>(node).getValue());
+    case JSONNode::INT64_NODE:
+        return integerValue(reinterpret_cast<const IntegerNode &>(node).getValue());
+    case JSONNode::DOUBLE_NODE:
+        return doubleValue(reinterpret_cast<const DoubleNode &>(node).getValue());
+    case JSONNode::OBJECT_NODE:
+        beginObject();
+        for (const auto &key_and_node : reinterpret_cast<const ObjectNode &>(node)) {
+            key(key_and_node.first);
+            nodeValue(*key_and_node.second);
+        }
+        return endObject();
+    case JSONNode::ARRAY_NODE:
+        beginArray();
+        for (const auto &element : reinterpret_cast<const ArrayNode &>(node))
+            nodeValue(*element);
+        return endArray();
+    }
+
+    __builtin_unreachable();
+}
+
+
+Writer &Writer::rawValue(const StringView &json) {
+    beginValue();
+    output_->append(json.data(), json.size());
+    flushIfFull();
+    return *this;
+}
+
+
+void AppendEscapedString(const StringView &unescaped_string, std::string * const escaped_string) {
+    // Copy runs of characters that need no escaping in one go:
+    const char *run_start(unescaped_string.begin());
+    for (const char *ch(unescaped_string.begin()); ch != unescaped_string.end(); ++ch) {
+        if (likely(static_cast<unsigned char>(*ch) > 0x1Fu and *ch != '"' and *ch != '\\' and *ch != '/'))
+            continue;
+
+        escaped_string->append(run_start, ch - run_start);
+        run_start = ch + 1;
+        switch (*ch) {
+        case '\\':
+            escaped_string->append("\\\\");
+            break;
+        case '"':
+            escaped_string->append("\\\"");
+            break;
+        case '/':
+            escaped_string->append("\\/");
+            break;
+        case '\b':
+            escaped_string->append("\\b");
+            break;
+        case '\f':
+            escaped_string->append("\\f");
             break;
         case '\n':
-            escaped_string += "\\n";
+            escaped_string->append("\\n");
             break;
         case '\r':
-            escaped_string += "\\r";
+            escaped_string->append("\\r");
             break;
         case '\t':
-            escaped_string += "\\t";
+            escaped_string->append("\\t");
             break;
-        default:
-            if (static_cast<unsigned char>(ch) > 0x1Fu)
-                escaped_string += ch;
-            else { // Escape control characters.
-                escaped_string += "\\u00";
-                escaped_string += StringUtil::ToHex(static_cast<unsigned char>(ch) >> 4u);
-                escaped_string += StringUtil::ToHex(static_cast<unsigned char>(ch) & 0xFu);
-            }
+        default: // Escape control characters.
+            escaped_string->append("\\u00");
+            *escaped_string += StringUtil::ToHex(static_cast<unsigned char>(*ch) >> 4u);
+            *escaped_string += StringUtil::ToHex(static_cast<unsigned char>(*ch) & 0xFu);
         }
     }
+    escaped_string->append(run_start, unescaped_string.end() - run_start);
+}
+
 
+std::string EscapeString(const std::string &unescaped_string) {
+    std::string escaped_string;
+    escaped_string.reserve(unescaped_string.size());
+    AppendEscapedString(unescaped_string, &escaped_string);
     return escaped_string;
 }
 
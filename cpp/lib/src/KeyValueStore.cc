@@ -0,0 +1,351 @@
+/** \file   KeyValueStore.cc
+ *  \brief  Implementation of the KeyValueStore class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "KeyValueStore.h"
+#include <memory>
+#include <unistd.h>
+#include <kchashdb.h>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+inline MDB_val ToMDBVal(const std::string &s) {
+    MDB_val val;
+    val.mv_size = s.size();
+    val.mv_data = const_cast<char *>(s.data());
+    return val;
+}
+
+
+inline StringView ToStringView(const MDB_val &val) {
+    return StringView(reinterpret_cast<const char *>(val.mv_data), val.mv_size);
+}
+
+
+inline std::string ErrorMessage(const int return_code) {
+    return ::mdb_strerror(return_code);
+}
+
+
+// Imported entries are committed in batches of this size.
+constexpr size_t IMPORT_BATCH_SIZE(10000);
+
+
+} // unnamed namespace
+
+
+KeyValueStore::Transaction::Transaction(const KeyValueStore &store, const bool read_only): store_(store), txn_(nullptr) {
+    const int return_code(::mdb_txn_begin(store_.env_, nullptr, read_only ? MDB_RDONLY : 0, &txn_));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to begin a transaction on \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+KeyValueStore::Transaction::~Transaction() {
+    if (txn_ != nullptr)
+        ::mdb_txn_abort(txn_);
+}
+
+
+bool KeyValueStore::Transaction::get(const std::string &key, StringView * const value) const {
+    MDB_val mdb_key(ToMDBVal(key)), mdb_value;
+    const int return_code(::mdb_get(txn_, store_.dbi_, &mdb_key, &mdb_value));
+    if (return_code == MDB_NOTFOUND)
+        return false;
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("lookup in \"" + store_.path_ + "\" failed! (" + ErrorMessage(return_code) + ")");
+
+    *value = ToStringView(mdb_value);
+    return true;
+}
+
+
+bool KeyValueStore::Transaction::get(const std::string &key, std::string * const value) const {
+    StringView value_view;
+    if (not get(key, &value_view))
+        return false;
+
+    value->assign(value_view.data(), value_view.size());
+    return true;
+}
+
+
+bool KeyValueStore::Transaction::contains(const std::string &key) const {
+    StringView value;
+    return get(key, &value);
+}
+
+
+KeyValueStore::WriteTransaction::WriteTransaction(KeyValueStore * const store): Transaction(*store, /* read_only = */false) {
+    if (unlikely(store->isReadOnly()))
+        LOG_ERROR("can't write to \"" + store->path_ + "\" which has been opened read-only!");
+}
+
+
+void KeyValueStore::WriteTransaction::put(const std::string &key, const std::string &value) {
+    MDB_val mdb_key(ToMDBVal(key)), mdb_value(ToMDBVal(value));
+    const int return_code(::mdb_put(txn_, store_.dbi_, &mdb_key, &mdb_value, 0));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to store a value in \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+bool KeyValueStore::WriteTransaction::add(const std::string &key, const std::string &value) {
+    MDB_val mdb_key(ToMDBVal(key)), mdb_value(ToMDBVal(value));
+    const int return_code(::mdb_put(txn_, store_.dbi_, &mdb_key, &mdb_value, MDB_NOOVERWRITE));
+    if (return_code == MDB_KEYEXIST)
+        return false;
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to add a value to \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+
+    return true;
+}
+
+
+bool KeyValueStore::WriteTransaction::remove(const std::string &key) {
+    MDB_val mdb_key(ToMDBVal(key));
+    const int return_code(::mdb_del(txn_, store_.dbi_, &mdb_key, nullptr));
+    if (return_code == MDB_NOTFOUND)
+        return false;
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to delete an entry from \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+
+    return true;
+}
+
+
+void KeyValueStore::WriteTransaction::clear() {
+    const int return_code(::mdb_drop(txn_, store_.dbi_, /* del = */0));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to clear \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+void KeyValueStore::WriteTransaction::commit() {
+    if (unlikely(txn_ == nullptr))
+        LOG_ERROR("transaction on \"" + store_.path_ + "\" has already been committed!");
+
+    const int return_code(::mdb_txn_commit(txn_));
+    txn_ = nullptr; // mdb_txn_commit() frees the transaction even if it fails.
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to commit a transaction on \"" + store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+KeyValueStore::Cursor::Cursor(const Transaction &transaction): cursor_(nullptr), next_op_(MDB_FIRST), at_end_(false) {
+    const int return_code(::mdb_cursor_open(transaction.txn_, transaction.store_.dbi_, &cursor_));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("failed to open a cursor on \"" + transaction.store_.path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+KeyValueStore::Cursor::~Cursor() {
+    ::mdb_cursor_close(cursor_);
+}
+
+
+bool KeyValueStore::Cursor::seek(const std::string &key) {
+    MDB_val mdb_key(ToMDBVal(key)), mdb_value;
+    const int return_code(::mdb_cursor_get(cursor_, &mdb_key, &mdb_value, MDB_SET_RANGE));
+    if (return_code == MDB_NOTFOUND) {
+        at_end_ = true;
+        return false;
+    }
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("cursor positioning failed! (" + ErrorMessage(return_code) + ")");
+
+    at_end_ = false;
+    next_op_ = MDB_GET_CURRENT;
+    return true;
+}
+
+
+bool KeyValueStore::Cursor::next(StringView * const key, StringView * const value) {
+    if (at_end_)
+        return false;
+
+    MDB_val mdb_key, mdb_value;
+    const int return_code(::mdb_cursor_get(cursor_, &mdb_key, &mdb_value, next_op_));
+    if (return_code == MDB_NOTFOUND) {
+        at_end_ = true;
+        return false;
+    }
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("cursor iteration failed! (" + ErrorMessage(return_code) + ")");
+
+    next_op_ = MDB_NEXT;
+    *key = ToStringView(mdb_key);
+    *value = ToStringView(mdb_value);
+    return true;
+}
+
+
+KeyValueStore::KeyValueStore(const std::string &path, const OpenMode open_mode, const size_t map_size)
+    : path_(path), open_mode_(open_mode), env_(nullptr), dbi_(0)
+{
+    if (open_mode_ != CREATE and not FileUtil::Exists(path_))
+        LOG_ERROR("\"" + path_ + "\" does not exist!");
+
+    int return_code(::mdb_env_create(&env_));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("mdb_env_create() failed! (" + ErrorMessage(return_code) + ")");
+    if (unlikely((return_code = ::mdb_env_set_mapsize(env_, map_size)) != MDB_SUCCESS))
+        LOG_ERROR("failed to set the map size for \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+
+    // MDB_NOSUBDIR: the store is a single file and not a directory.
+    // MDB_NOTLS: read transactions are not tied to the thread that started them.
+    unsigned flags(MDB_NOSUBDIR | MDB_NOTLS);
+    if (open_mode_ == READ_ONLY)
+        flags |= MDB_RDONLY | MDB_NORDAHEAD;
+    if ((return_code = ::mdb_env_open(env_, path_.c_str(), flags, 0664)) != MDB_SUCCESS) {
+        ::mdb_env_close(env_);
+        LOG_ERROR("failed to open \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+    }
+
+    // Release the reader slots of processes that died w/o cleaning up after themselves:
+    int dead_reader_count;
+    ::mdb_reader_check(env_, &dead_reader_count);
+
+    MDB_txn *txn;
+    if (unlikely((return_code = ::mdb_txn_begin(env_, nullptr, isReadOnly() ? MDB_RDONLY : 0, &txn)) != MDB_SUCCESS))
+        LOG_ERROR("failed to begin a transaction on \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+    if (unlikely((return_code = ::mdb_dbi_open(txn, nullptr, 0, &dbi_)) != MDB_SUCCESS))
+        LOG_ERROR("failed to open the database in \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+    if (unlikely((return_code = ::mdb_txn_commit(txn)) != MDB_SUCCESS))
+        LOG_ERROR("failed to commit a transaction on \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+}
+
+
+KeyValueStore::~KeyValueStore() {
+    ::mdb_env_close(env_);
+}
+
+
+bool KeyValueStore::get(const std::string &key, std::string * const value) const {
+    const ReadTransaction transaction(*this);
+    return transaction.get(key, value);
+}
+
+
+bool KeyValueStore::contains(const std::string &key) const {
+    const ReadTransaction transaction(*this);
+    return transaction.contains(key);
+}
+
+
+void KeyValueStore::put(const std::string &key, const std::string &value) {
+    WriteTransaction transaction(this);
+    transaction.put(key, value);
+    transaction.commit();
+}
+
+
+bool KeyValueStore::add(const std::string &key, const std::string &value) {
+    WriteTransaction transaction(this);
+    if (not transaction.add(key, value))
+        return false;
+    transaction.commit();
+    return true;
+}
+
+
+bool KeyValueStore::remove(const std::string &key) {
+    WriteTransaction transaction(this);
+    if (not transaction.remove(key))
+        return false;
+    transaction.commit();
+    return true;
+}
+
+
+size_t KeyValueStore::size() const {
+    return getStats().entry_count_;
+}
+
+
+KeyValueStore::Stats KeyValueStore::getStats() const {
+    const ReadTransaction transaction(*this);
+    MDB_stat mdb_stat;
+    int return_code(::mdb_stat(transaction.txn_, dbi_, &mdb_stat));
+    if (unlikely(return_code != MDB_SUCCESS))
+        LOG_ERROR("mdb_stat() failed on \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+
+    MDB_envinfo mdb_envinfo;
+    if (unlikely((return_code = ::mdb_env_info(env_, &mdb_envinfo)) != MDB_SUCCESS))
+        LOG_ERROR("mdb_env_info() failed on \"" + path_ + "\"! (" + ErrorMessage(return_code) + ")");
+
+    Stats stats;
+    stats.entry_count_      = mdb_stat.ms_entries;
+    stats.page_size_        = mdb_stat.ms_psize;
+    stats.depth_            = mdb_stat.ms_depth;
+    stats.used_page_count_  = mdb_envinfo.me_last_pgno + 1;
+    stats.map_size_         = mdb_envinfo.me_mapsize;
+    stats.max_reader_count_ = mdb_envinfo.me_maxreaders;
+    stats.reader_count_     = mdb_envinfo.me_numreaders;
+
+    return stats;
+}
+
+
+size_t KeyValueStore::ImportKyotoCabinetDB(const std::string &kcdb_path, KeyValueStore * const store) {
+    kyotocabinet::HashDB kcdb;
+    if (unlikely(not kcdb.open(kcdb_path, kyotocabinet::HashDB::OREADER)))
+        LOG_ERROR("failed to open \"" + kcdb_path + "\" for reading! (" + std::string(kcdb.error().message()) + ")");
+
+    std::unique_ptr<WriteTransaction> transaction(new WriteTransaction(store));
+    std::unique_ptr<kyotocabinet::DB::Cursor> cursor(kcdb.cursor());
+    cursor->jump();
+    size_t entry_count(0);
+    std::string key, value;
+    while (cursor->get(&key, &value, /* step = */true)) {
+        transaction->put(key, value);
+        if (++entry_count % IMPORT_BATCH_SIZE == 0) {
+            transaction->commit();
+            transaction.reset(new WriteTransaction(store));
+        }
+    }
+    transaction->commit();
+
+    return entry_count;
+}
+
+
+bool KeyValueStore::MigrateFromKyotoCabinetDB(const std::string &kcdb_path, const std::string &path) {
+    if (FileUtil::Exists(path) or not FileUtil::Exists(kcdb_path))
+        return false;
+
+    // We build the store under a temporary name so that an interrupted migration will be redone on the next attempt:
+    const std::string temp_path(path + ".migrating");
+    ::unlink(temp_path.c_str());
+    ::unlink((temp_path + "-lock").c_str());
+    size_t entry_count;
+    {
+        KeyValueStore store(temp_path, CREATE);
+        entry_count = ImportKyotoCabinetDB(kcdb_path, &store);
+    }
+    FileUtil::RenameFileOrDie(temp_path, path);
+    ::unlink((temp_path + "-lock").c_str());
+
+    LOG_INFO("migrated " + std::to_string(entry_count) + " entries from \"" + kcdb_path + "\" to \"" + path + "\".");
+    return true;
+}
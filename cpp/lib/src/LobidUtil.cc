@@ -15,9 +15,17 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "LobidUtil.h"
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <ctime>
+#include "DbConnection.h"
+#include "DownloadBatch.h"
 #include "Downloader.h"
+#include "GzStream.h"
 #include "JSON.h"
+#include "TextUtil.h"
+#include "UBTools.h"
 #include "UrlUtil.h"
 #include "util.h"
 
@@ -25,7 +33,88 @@
 namespace LobidUtil {
 
 
-std::unordered_map<std::string, const std::shared_ptr<const JSON::ObjectNode>> url_to_lookup_result_cache;
+namespace {
+
+
+// Maps query URL's to the parsed responses.  The responses are also stored, gzip-compressed, in an SQLite database
+// so that they survive the current process.
+class LookupResultCache {
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const JSON::ObjectNode>> url_to_lookup_result_map_;
+    std::unique_ptr<DbConnection> db_connection_;
+public:
+    LookupResultCache();
+
+    /** \return True if we had a result for "url", o/w false. */
+    bool lookup(const std::string &url, std::shared_ptr<const JSON::ObjectNode> * const root_object);
+
+    void insert(const std::string &url, const std::string &json_text,
+                const std::shared_ptr<const JSON::ObjectNode> &root_object);
+};
+
+
+LookupResultCache::LookupResultCache()
+    : db_connection_(new DbConnection(UBTools::GetTuelibPath() + "lobid_cache.sq3", DbConnection::CREATE,
+                                      DbConnection::SP_READ_MOSTLY))
+{
+    db_connection_->queryOrDie("CREATE TABLE IF NOT EXISTS lookup_results (url TEXT PRIMARY KEY, "
+                               "expiration_time INTEGER NOT NULL, compressed_json TEXT NOT NULL)");
+    db_connection_->queryOrDie("DELETE FROM lookup_results WHERE expiration_time < "
+                               + std::to_string(std::time(nullptr)));
+}
+
+
+bool LookupResultCache::lookup(const std::string &url, std::shared_ptr<const JSON::ObjectNode> * const root_object) {
+    std::lock_guard<std::mutex> lock_guard(mutex_);
+
+    const auto url_and_lookup_result(url_to_lookup_result_map_.find(url));
+    if (url_and_lookup_result != url_to_lookup_result_map_.end()) {
+        *root_object = url_and_lookup_result->second;
+        return true;
+    }
+
+    db_connection_->queryOrDie("SELECT compressed_json FROM lookup_results WHERE url="
+                               + db_connection_->escapeAndQuoteString(url) + " AND expiration_time >= "
+                               + std::to_string(std::time(nullptr)));
+    DbResultSet result_set(db_connection_->getLastResultSet());
+    if (result_set.empty())
+        return false;
+
+    // We use Base64 because DbConnection::escapeString() can't cope w/ binary data for SQLite.
+    const std::string json_text(GzStream::DecompressString(TextUtil::Base64Decode(result_set.getNextRow()["compressed_json"])));
+    JSON::Parser json_parser(json_text);
+    std::shared_ptr<JSON::JSONNode> root_node;
+    if (not json_parser.parse(&root_node) or root_node->getType() != JSON::JSONNode::OBJECT_NODE) {
+        LOG_WARNING("ignoring bad cached result for \"" + url + "\"!");
+        return false;
+    }
+
+    *root_object = JSON::JSONNode::CastToObjectNodeOrDie("root", root_node);
+    url_to_lookup_result_map_.emplace(url, *root_object);
+    return true;
+}
+
+
+void LookupResultCache::insert(const std::string &url, const std::string &json_text,
+                               const std::shared_ptr<const JSON::ObjectNode> &root_object)
+{
+    std::lock_guard<std::mutex> lock_guard(mutex_);
+
+    url_to_lookup_result_map_.emplace(url, root_object);
+    db_connection_->queryOrDie("INSERT OR REPLACE INTO lookup_results (url, expiration_time, compressed_json) VALUES("
+                               + db_connection_->escapeAndQuoteString(url) + ","
+                               + std::to_string(std::time(nullptr) + CACHE_TTL) + ",'"
+                               + TextUtil::Base64Encode(GzStream::CompressString(json_text)) + "')");
+}
+
+
+LookupResultCache &GetLookupResultCache() {
+    static LookupResultCache lookup_result_cache;
+    return lookup_result_cache;
+}
+
+
+} // unnamed namespace
 
 
 static std::string BASE_URL_GND = "http://lobid.org/gnd/search?format=json";
@@ -59,27 +148,28 @@ const std::string BuildUrl(const std::string &base_url, const std::unordered_map
 }
 
 
-const std::shared_ptr<const JSON::ObjectNode> Query(const std::string &url, const bool allow_multiple_results) {
-    const auto url_and_lookup_result(url_to_lookup_result_cache.find(url));
-    if (url_and_lookup_result != url_to_lookup_result_cache.end())
-        return url_and_lookup_result->second;
-
-    Downloader downloader(url);
-    if (downloader.anErrorOccurred()) {
-        LOG_WARNING("failed to lookup using Lobid API. downloader error: " + downloader.getLastErrorMessage());
-        return nullptr;
-    }
-
-    JSON::Parser json_parser(downloader.getMessageBody());
+// \return The root object of "json_text" or nullptr if it could not be parsed.
+std::shared_ptr<const JSON::ObjectNode> ParseAndCacheLookupResult(const std::string &url, const std::string &json_text) {
+    JSON::Parser json_parser(json_text);
     std::shared_ptr<JSON::JSONNode> root_node;
     if (not (json_parser.parse(&root_node))) {
         LOG_WARNING("failed to parse returned JSON: " + json_parser.getErrorMessage() + "(input was: "
-                  + downloader.getMessageBody() + ")");
+                  + json_text + ")");
         return nullptr;
     }
 
     const std::shared_ptr<const JSON::ObjectNode> root_object(JSON::JSONNode::CastToObjectNodeOrDie("root", root_node));
-    url_to_lookup_result_cache.emplace(url, root_object);
+    GetLookupResultCache().insert(url, json_text, root_object);
+    return root_object;
+}
+
+
+// \return "root_object" if it holds an acceptable number of hits, o/w nullptr.
+std::shared_ptr<const JSON::ObjectNode> CheckTotalItems(const std::string &url, const std::shared_ptr<const JSON::ObjectNode> &root_object,
+                                                        const bool allow_multiple_results)
+{
+    if (root_object == nullptr)
+        return nullptr;
 
     const unsigned total_items(root_object->getIntegerValue("totalItems"));
     if (total_items == 0)
@@ -93,6 +183,57 @@ const std::shared_ptr<const JSON::ObjectNode> Query(const std::string &url, cons
 }
 
 
+const std::shared_ptr<const JSON::ObjectNode> Query(const std::string &url, const bool allow_multiple_results) {
+    std::shared_ptr<const JSON::ObjectNode> root_object;
+    if (GetLookupResultCache().lookup(url, &root_object))
+        return CheckTotalItems(url, root_object, allow_multiple_results);
+
+    Downloader downloader(url);
+    if (downloader.anErrorOccurred()) {
+        LOG_WARNING("failed to lookup using Lobid API. downloader error: " + downloader.getLastErrorMessage());
+        return nullptr;
+    }
+
+    return CheckTotalItems(url, ParseAndCacheLookupResult(url, downloader.getMessageBody()), allow_multiple_results);
+}
+
+
+// \return A map from the URL's in "urls" to the query results. URL's w/ unacceptable results are not in the map.
+std::unordered_map<std::string, std::shared_ptr<const JSON::ObjectNode>> QueryMany(const std::vector<std::string> &urls,
+                                                                                   const bool allow_multiple_results)
+{
+    std::unordered_map<std::string, std::shared_ptr<const JSON::ObjectNode>> urls_to_root_objects;
+    DownloadBatch download_batch;
+    for (const auto &url : urls) {
+        std::shared_ptr<const JSON::ObjectNode> root_object;
+        if (GetLookupResultCache().lookup(url, &root_object)) {
+            root_object = CheckTotalItems(url, root_object, allow_multiple_results);
+            if (root_object != nullptr)
+                urls_to_root_objects[url] = root_object;
+            continue;
+        }
+
+        download_batch.addUrl(url, Downloader::Params(), Downloader::DEFAULT_TIME_LIMIT,
+                              [&urls_to_root_objects, allow_multiple_results](const DownloadBatch::Result &result) {
+                                  if (result.anErrorOccurred()) {
+                                      LOG_WARNING("failed to lookup using Lobid API. downloader error: "
+                                                  + result.error_message_);
+                                      return;
+                                  }
+
+                                  const auto lookup_root(CheckTotalItems(result.url_,
+                                                                         ParseAndCacheLookupResult(result.url_, result.message_body_),
+                                                                         allow_multiple_results));
+                                  if (lookup_root != nullptr)
+                                      urls_to_root_objects[result.url_] = lookup_root;
+                              });
+    }
+    download_batch.run();
+
+    return urls_to_root_objects;
+}
+
+
 const std::string QueryAndLookupString(const std::string &url, const std::string &path, const bool allow_multiple_results) {
     const auto root_object(Query(url, allow_multiple_results));
     if (root_object == nullptr)
@@ -111,9 +252,39 @@ const std::vector<std::string> QueryAndLookupStrings(const std::string &url, con
 }
 
 
+inline std::string BuildAuthorGNDNumberUrl(const std::string &author, const std::string &additional_query_params) {
+    return BuildUrl(BASE_URL_GND, { { "preferredName", author } }, { { "type", "DifferentiatedPerson" } }, additional_query_params);
+}
+
+
 std::string GetAuthorGNDNumber(const std::string &author, const std::string &additional_query_params) {
-    return QueryAndLookupString(BuildUrl(BASE_URL_GND, { { "preferredName", author } }, { { "type", "DifferentiatedPerson" } }, additional_query_params),
-                                "/member/0/gndIdentifier", /* allow_multiple_results */ false);
+    return QueryAndLookupString(BuildAuthorGNDNumberUrl(author, additional_query_params), "/member/0/gndIdentifier",
+                                /* allow_multiple_results */ false);
+}
+
+
+std::unordered_map<std::string, std::string> GetAuthorGNDNumbers(const std::vector<std::string> &authors,
+                                                                 const std::string &additional_query_params)
+{
+    std::vector<std::string> urls;
+    urls.reserve(authors.size());
+    for (const auto &author : authors)
+        urls.emplace_back(BuildAuthorGNDNumberUrl(author, additional_query_params));
+
+    const auto urls_to_root_objects(QueryMany(urls, /* allow_multiple_results */ false));
+
+    std::unordered_map<std::string, std::string> authors_to_gnd_numbers;
+    for (size_t i(0); i < authors.size(); ++i) {
+        const auto url_and_root_object(urls_to_root_objects.find(urls[i]));
+        if (url_and_root_object == urls_to_root_objects.cend())
+            continue;
+
+        const std::string gnd_number(JSON::LookupString("/member/0/gndIdentifier", url_and_root_object->second, ""));
+        if (not gnd_number.empty())
+            authors_to_gnd_numbers[authors[i]] = gnd_number;
+    }
+
+    return authors_to_gnd_numbers;
 }
 
 
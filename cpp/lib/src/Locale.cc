@@ -27,6 +27,7 @@
 #include "Locale.h"
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 
 
 Locale::Locale(const std::string &new_locale, const int category, const bool restore)
@@ -56,3 +57,25 @@ std::string Locale::GetLocaleName(const int category) {
 
     return locale;
 }
+
+
+Collator::Collator(const std::string &locale_name)
+    : locale_(::newlocale(LC_COLLATE_MASK, locale_name.c_str(), static_cast<locale_t>(0)))
+{
+    if (locale_ == static_cast<locale_t>(0))
+        throw std::runtime_error("in Collator::Collator: can't load the \"" + locale_name + "\" locale!");
+}
+
+
+std::string Collator::getSortKey(const std::string &s) const {
+    // Sort keys are typically a few times as long as their strings, so we rarely need a second attempt:
+    std::string sort_key(3 * s.size() + 1, '\0');
+    size_t sort_key_length(::strxfrm_l(&sort_key[0], s.c_str(), sort_key.size(), locale_));
+    if (sort_key_length >= sort_key.size()) {
+        sort_key.resize(sort_key_length + 1);
+        sort_key_length = ::strxfrm_l(&sort_key[0], s.c_str(), sort_key.size(), locale_);
+    }
+    sort_key.resize(sort_key_length);
+
+    return sort_key;
+}
@@ -20,14 +20,18 @@
 #include "MARC.h"
 #include <set>
 #include <unordered_map>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "FileLocker.h"
 #include "FileUtil.h"
+#include "MarcControlNumberSet.h"
 #include "MiscUtil.h"
 #include "RegexMatcher.h"
+#include "ScanUtil.h"
+#include "ShmRing.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "UBTools.h"
@@ -103,24 +107,11 @@ Tag &Tag::swap(Tag &other) {
 
 
 Subfields::Subfields(const std::string &field_contents) {
-    if (unlikely(field_contents.length() < 5)) // We need more than: 2 indicators + delimiter + subfield code
+    if (unlikely(field_contents.length() < 4)) // We need at least: 2 indicators + delimiter + subfield code
         return;
 
-    std::string value;
-    char subfield_code(field_contents[3]);
-    for (auto ch(field_contents.cbegin() + 4 /* 2 indicators + delimiter + subfield code */);
-         ch != field_contents.cend(); ++ch)
-    {
-        if (unlikely(*ch == '\x1F')) {
-            subfields_.emplace_back(subfield_code, value);
-            value.clear();
-            ++ch; // Skip over the delimiter.
-            subfield_code = *ch;
-        } else
-            value += *ch;
-    }
-
-    subfields_.emplace_back(subfield_code, value);
+    for (const auto &code_and_value : SubfieldRange(field_contents))
+        subfields_.emplace_back(code_and_value.first, code_and_value.second.toString());
 }
 
 
@@ -220,40 +211,47 @@ Tag Record::Field::getLocalTag() const {
 
 
 std::string Record::Field::getFirstSubfieldWithCode(const char subfield_code) const {
-    if (unlikely(contents_.length() < 5)) // We need more than: 2 indicators + delimiter + subfield code
-        return "";
-
-    const char delimiter_and_code[]{ '\x1F', subfield_code, '\0' };
-    const size_t subfield_start_pos(contents_.find(delimiter_and_code, 2 /*skip indicators*/, 2));
-    if (subfield_start_pos == std::string::npos)
-        return "";
-
-    std::string subfield_value;
-    for (auto ch(contents_.cbegin() + subfield_start_pos + 2); ch != contents_.cend(); ++ch) {
-        if (*ch == '\x1F')
-            break;
-        subfield_value += *ch;
+    for (const auto &code_and_value : getSubfieldRange()) {
+        if (code_and_value.first == subfield_code)
+            return code_and_value.second.toString();
     }
 
-    return subfield_value;
+    return "";
 }
 
 
 bool Record::Field::hasSubfield(const char subfield_code) const {
-    bool subfield_delimiter_seen(false);
-    for (const char ch : contents_) {
-        if (subfield_delimiter_seen) {
-            if (ch == subfield_code)
-                return true;
-            subfield_delimiter_seen = false;
-        } else if (ch == '\x1F')
-            subfield_delimiter_seen = true;
+    for (const auto &code_and_value : getSubfieldRange()) {
+        if (code_and_value.first == subfield_code)
+            return true;
     }
 
     return false;
 }
 
 
+std::vector<std::string> Record::Field::extractSubfields(const std::string &subfield_codes) const {
+    std::vector<std::string> extracted_values;
+    for (const auto &code_and_value : getSubfieldRange()) {
+        if (subfield_codes.find(code_and_value.first) != std::string::npos)
+            extracted_values.emplace_back(code_and_value.second.toString());
+    }
+
+    return extracted_values;
+}
+
+
+std::vector<std::string> Record::Field::extractSubfields(const char subfield_code) const {
+    std::vector<std::string> extracted_values;
+    for (const auto &code_and_value : getSubfieldRange()) {
+        if (code_and_value.first == subfield_code)
+            extracted_values.emplace_back(code_and_value.second.toString());
+    }
+
+    return extracted_values;
+}
+
+
 bool Record::Field::hasSubfieldWithValue(const char subfield_code, const std::string &value) const {
     bool subfield_delimiter_seen(false);
     for (auto ch(contents_.cbegin()); ch != contents_.cend(); ++ch) {
@@ -365,26 +363,44 @@ Record::Record(const std::string &leader): leader_(leader) {
 }
 
 
-Record::Record(const size_t record_size, const char * const record_start)
-    : record_size_(record_size), leader_(record_start, LEADER_LENGTH)
-{
+Record::Record(const size_t record_size, const char * const record_start): record_size_(record_size) {
+    assign(record_size, record_start);
+}
+
+
+void Record::assign(const size_t record_size, const char * const record_start, const std::vector<Tag> * const projected_tags) {
+    record_size_ = record_size;
+    leader_.assign(record_start, LEADER_LENGTH);
     const char * const base_address_of_data(record_start + ToUnsigned(record_start + 12, 5));
 
-    // Process directory:
+    // Process directory.  Existing fields are overwritten in place so that we can reuse their string buffers:
+    size_t field_count(0);
     const char *directory_entry(record_start + LEADER_LENGTH);
     while (directory_entry != base_address_of_data - 1) {
         if (unlikely(directory_entry > base_address_of_data))
             LOG_ERROR("directory_entry > base_address_of_data!");
-        std::string tag;
-        tag += directory_entry[0];
-        tag += directory_entry[1];
-        tag += directory_entry[2];
+        const Tag tag(std::string(directory_entry, TAG_LENGTH));
+        if (projected_tags != nullptr and not std::binary_search(projected_tags->cbegin(), projected_tags->cend(), tag)) {
+            directory_entry += DIRECTORY_ENTRY_LENGTH;
+            continue;
+        }
         const unsigned field_length(ToUnsigned(directory_entry + 3, 4));
         const unsigned field_offset(ToUnsigned(directory_entry + 7, 5));
-        const std::string field_contents(base_address_of_data + field_offset, field_length - 1);
-        fields_.emplace_back(tag, field_contents);
+        if (field_count < fields_.size()) {
+            fields_[field_count].tag_ = tag;
+            fields_[field_count].contents_.assign(base_address_of_data + field_offset, field_length - 1);
+        } else
+            fields_.emplace_back(tag, std::string(base_address_of_data + field_offset, field_length - 1));
+        ++field_count;
         directory_entry += 3 /* tag */ + 4 /* field length */ + 5 /* field offset */;
     }
+    fields_.erase(fields_.begin() + field_count, fields_.end());
+
+    // Our tag lookups rely on the fields being sorted by tag.  Since this should be true for almost all input data we
+    // check first as that is a lot cheaper than sorting.
+    if (unlikely(not std::is_sorted(fields_.cbegin(), fields_.cend(),
+                                    [](const Field &lhs, const Field &rhs){ return lhs.tag_ < rhs.tag_; })))
+        sortFieldTags(fields_.begin(), fields_.end());
 }
 
 
@@ -577,10 +593,15 @@ inline static bool MatchAny(const Tag &tag, const std::vector<Tag> &tags) {
 
 
 Record::ConstantRange Record::getTagRange(const std::vector<Tag> &tags) const {
-    const auto begin(std::find_if(fields_.begin(), fields_.end(),
-                                  [&tags](const Field &field) -> bool { return MatchAny(field.getTag(), tags); }));
-    if (begin == fields_.end())
-        return ConstantRange(fields_.end(), fields_.end());
+    // Since our fields are sorted by tag, the range starts at the first field w/ the numerically smallest of the tags:
+    auto begin(fields_.cend());
+    for (const auto &tag : tags) {
+        const auto first_field_with_tag(findTag(tag));
+        if (first_field_with_tag < begin)
+            begin = first_field_with_tag;
+    }
+    if (begin == fields_.cend())
+        return ConstantRange(fields_.cend(), fields_.cend());
 
     auto end(begin);
     while (end != fields_.end() and MatchAny(end->getTag(), tags))
@@ -591,16 +612,8 @@ Record::ConstantRange Record::getTagRange(const std::vector<Tag> &tags) const {
 
 
 Record::Range Record::getTagRange(const Tag &tag) {
-    auto begin(std::find_if(fields_.begin(), fields_.end(),
-                            [&tag](const Field &field) -> bool { return field.getTag() == tag; }));
-    if (begin == fields_.end())
-        return Range(fields_.end(), fields_.end());
-
-    auto end(begin);
-    while (end != fields_.end() and end->getTag() == tag)
-        ++end;
-
-    return Range(begin, end);
+    const auto range(std::equal_range(fields_.begin(), fields_.end(), tag, FieldAndTagCompare()));
+    return Range(range.first, range.second);
 }
 
 
@@ -1093,6 +1106,14 @@ void Record::appendField(const Tag &new_field_tag, const Subfields &subfields, c
 }
 
 
+void Record::swapFields(std::vector<Field> * const fields) {
+    fields_.swap(*fields);
+    record_size_ = LEADER_LENGTH + 1 /* end-of-directory */ + 1 /* end-of-record */;
+    for (const auto &field : fields_)
+        record_size_ += DIRECTORY_ENTRY_LENGTH + field.getContents().length() + 1 /* field separator */;
+}
+
+
 void Record::appendField(const Field &field) {
     if (unlikely(not fields_.empty() and fields_.back().getTag() > field.getTag()))
         LOG_ERROR("attempt to append a \"" + field.getTag().toString() + "\" field after a \"" + fields_.back().getTag().toString()
@@ -1126,8 +1147,7 @@ void Record::replaceField(const Tag &field_tag, const std::string &field_content
 
 
 bool Record::addSubfield(const Tag &field_tag, const char subfield_code, const std::string &subfield_value) {
-    const auto field(std::find_if(fields_.begin(), fields_.end(),
-                                  [&field_tag](const Field &field1) -> bool { return field1.getTag() == field_tag; }));
+    const auto field(findTag(field_tag));
     if (field == fields_.end())
         return false;
 
@@ -1354,6 +1374,24 @@ std::vector<Record::iterator> Record::getMatchedFields(const std::string &field_
 }
 
 
+RecordView::FieldView RecordView::const_iterator::operator*() const {
+    const unsigned field_length(ToUnsigned(directory_entry_ + 3, 4));
+    const unsigned field_offset(ToUnsigned(directory_entry_ + 7, 5));
+    return FieldView(std::string(directory_entry_, Record::TAG_LENGTH),
+                     StringView(base_address_of_data_ + field_offset, field_length - 1 /* field terminator */));
+}
+
+
+RecordView::RecordView(const size_t record_size, const char * const record_start)
+    : record_start_(record_start), record_size_(record_size),
+      base_address_of_data_(record_start + ToUnsigned(record_start + 12, 5))
+{
+    if (unlikely(base_address_of_data_ < record_start_ + Record::LEADER_LENGTH + 1
+                 or (base_address_of_data_ - 1 - (record_start_ + Record::LEADER_LENGTH)) % Record::DIRECTORY_ENTRY_LENGTH != 0))
+        LOG_ERROR("bad base address of data in record leader!");
+}
+
+
 enum class MediaType { XML, MARC21, OTHER };
 
 
@@ -1402,13 +1440,115 @@ std::string FileTypeToString(const FileType file_type) {
         return "BINARY";
     case FileType::XML:
         return "XML";
+    case FileType::INDEXED:
+        return "INDEXED";
     default:
         LOG_ERROR("unknown file type " + std::to_string(static_cast<int>(file_type)) + "!");
     }
 }
 
 
+namespace {
+
+
+inline bool IsGzipCompressed(const std::string &filename) {
+    return StringUtil::EndsWith(filename, ".gz", /* ignore_case = */true);
+}
+
+
+const char INDEXED_FILE_MAGIC[8]{ 'U', 'B', 'M', 'A', 'R', 'C', 'I', 'F' };
+
+
+// The last bytes of a FileType::INDEXED file.  All members are 8 bytes wide so that there is no padding.
+struct IndexedFileTrailer {
+    uint64_t footer_offset_; // Where the record offset table starts, which is also the size of the record data.
+    uint64_t record_count_;
+    uint64_t key_count_;
+    uint64_t key_width_;
+    char magic_[sizeof INDEXED_FILE_MAGIC];
+public:
+    inline bool hasValidMagic() const { return std::memcmp(magic_, INDEXED_FILE_MAGIC, sizeof INDEXED_FILE_MAGIC) == 0; }
+
+    // Each key table entry consists of a NUL-padded control number of "key_width_" bytes followed by a 64 bit record number.
+    inline size_t getKeyEntrySize() const { return key_width_ + sizeof(uint64_t); }
+    inline size_t getFooterSize() const
+        { return record_count_ * sizeof(uint64_t) + key_count_ * getKeyEntrySize() + sizeof(IndexedFileTrailer); }
+
+    // The trailer comes from a possibly corrupt or hostile file, so we bound each member by "file_size" before doing
+    // any arithmetic on it.  After that none of the sums and products in getFooterSize() can overflow.
+    inline bool isConsistentWith(const uint64_t file_size) const {
+        return key_width_ <= file_size and record_count_ <= file_size / sizeof(uint64_t)
+               and key_count_ <= file_size / getKeyEntrySize() and footer_offset_ <= file_size
+               and footer_offset_ + getFooterSize() == file_size;
+    }
+};
+
+
+bool HasIndexedFileTrailer(const std::string &filename) {
+    File input(filename, "r");
+    if (input.fail() or input.size() < static_cast<off_t>(sizeof(IndexedFileTrailer))
+        or not input.seek(-static_cast<off_t>(sizeof(IndexedFileTrailer)), SEEK_END))
+        return false;
+
+    IndexedFileTrailer trailer;
+    return input.read(&trailer, sizeof trailer) == sizeof trailer and trailer.hasValidMagic();
+}
+
+
+// Pipes default to 64 KiB, i.e. a context switch every few records; best effort as we can't exceed /proc/sys/fs/pipe-max-size.
+void EnlargePipeBuffer(const int fd) {
+    struct stat stat_buf;
+    if (::fstat(fd, &stat_buf) != 0 or not S_ISFIFO(stat_buf.st_mode))
+        return;
+    if (::fcntl(fd, F_SETPIPE_SZ, static_cast<int>(File::BULK_BUFFER_SIZE)) == -1)
+        LOG_DEBUG("failed to enlarge the pipe buffer: " + std::string(std::strerror(errno)));
+}
+
+
+// io_uring is opt-in as it locks memory, which is limited by RLIMIT_MEMLOCK, and because some container runtimes
+// forbid its system calls altogether.
+bool AsynchronousIOIsEnabled() {
+    static const bool enabled(MiscUtil::SafeGetEnv("MARC_ASYNC_IO") == "true");
+    return enabled;
+}
+
+
+// MARC files are typically streamed through from start to end, hence the large buffer and the read-ahead hint.
+std::unique_ptr<File> OpenFileOrDie(const std::string &filename, const std::string &mode) {
+    std::unique_ptr<File> file;
+    if (not IsGzipCompressed(filename)) {
+        if (mode == "r")
+            file = FileUtil::OpenInputFileOrDie(filename);
+        else
+            file = (mode == "w") ? FileUtil::OpenOutputFileOrDie(filename) : FileUtil::OpenForAppendingOrDie(filename);
+        EnlargePipeBuffer(file->getFileDescriptor());
+    } else {
+        file.reset(new File(filename, mode + (mode == "r" ? "u" : "c")));
+        if (file->fail())
+            LOG_ERROR("can't open gzip-compressed \"" + filename + "\" w/ mode \"" + mode + "\"!");
+    }
+
+    file->setBufferSize(File::BULK_BUFFER_SIZE);
+    file->setAccessPattern(File::SEQUENTIAL_ACCESS);
+    if (AsynchronousIOIsEnabled())
+        file->enableAsynchronousIO(); // Lets record decoding and encoding overlap w/ disk and FIFO I/O if the kernel allows.
+
+    return file;
+}
+
+
+} // unnamed namespace
+
+
 FileType GuessFileType(const std::string &filename, const GuessFileTypeBehaviour guess_file_type_behaviour) {
+    std::string ring_name;
+    if (ShmRing::ParsePath(filename, &ring_name))
+        return FileType::BINARY;
+
+    if (IsGzipCompressed(filename))
+        return GuessFileType(filename.substr(0, filename.length() - __builtin_strlen(".gz")),
+                             GuessFileTypeBehaviour::USE_THE_FILENAME_ONLY);
+
     if (guess_file_type_behaviour == GuessFileTypeBehaviour::ATTEMPT_A_READ and FileUtil::Exists(filename)
         and not FileUtil::IsPipeOrFIFO(filename))
     {
@@ -1416,12 +1556,15 @@ FileType GuessFileType(const std::string &filename, const GuessFileTypeBehaviour
         case MediaType::XML:
             return FileType::XML;
         case MediaType::MARC21:
-            return FileType::BINARY;
+            return HasIndexedFileTrailer(filename) ? FileType::INDEXED : FileType::BINARY;
         default:
             LOG_ERROR("\"" + filename + "\" contains neither MARC-21 nor MARC-XML data!");
         }
     }
 
+    if (StringUtil::EndsWith(filename, ".mrci", /* ignore_case = */true))
+        return FileType::INDEXED;
+
     if (StringUtil::EndsWith(filename, ".mrc", /* ignore_case = */true)
         or StringUtil::EndsWith(filename, ".marc", /* ignore_case = */true)
         or StringUtil::EndsWith(filename, ".raw", /* ignore_case = */true))
@@ -1433,33 +1576,78 @@ FileType GuessFileType(const std::string &filename, const GuessFileTypeBehaviour
 }
 
 
-std::unique_ptr<Reader> Reader::Factory(const std::string &input_filename, FileType reader_type) {
+void Reader::setProjection(const std::vector<Tag> &projected_tags) {
+    projected_tags_ = projected_tags;
+    if (projected_tags_.empty())
+        return;
+
+    projected_tags_.emplace_back("001");
+    std::sort(projected_tags_.begin(), projected_tags_.end());
+    projected_tags_.erase(std::unique(projected_tags_.begin(), projected_tags_.end()), projected_tags_.end());
+}
+
+
+std::unique_ptr<Reader> Reader::Factory(const std::string &input_filename, FileType reader_type,
+                                        const std::vector<Tag> &projected_tags)
+{
     if (reader_type == FileType::AUTO)
         reader_type = GuessFileType(input_filename);
 
-    std::unique_ptr<File> input(FileUtil::OpenInputFileOrDie(input_filename));
-    return (reader_type == FileType::XML) ? std::unique_ptr<Reader>(new XmlReader(input.release()))
-                                          : std::unique_ptr<Reader>(new BinaryReader(input.release()));
+    if (unlikely(reader_type == FileType::INDEXED and IsGzipCompressed(input_filename)))
+        LOG_ERROR("indexed MARC files can't be compressed! (\"" + input_filename + "\")");
+
+    std::unique_ptr<Reader> reader;
+    std::string ring_name;
+    if (ShmRing::ParsePath(input_filename, &ring_name)) {
+        if (unlikely(reader_type != FileType::BINARY))
+            LOG_ERROR("shared memory rings can only carry binary MARC! (\"" + input_filename + "\")");
+        std::unique_ptr<ShmRing> ring(new ShmRing(ring_name, ShmRing::READER));
+        File * const input(new File(::dup(ring->getFileDescriptor()), "r"));
+        reader.reset(new BinaryReader(input, ring.release()));
+        reader->setProjection(projected_tags);
+        if (IOStatistics::IsEnabled())
+            reader->io_statistics_.reset(new IOStatistics("reader for \"" + input_filename + "\""));
+        return reader;
+    }
+
+    std::unique_ptr<File> input(OpenFileOrDie(input_filename, "r"));
+    if (reader_type == FileType::XML)
+        reader.reset(new XmlReader(input.release()));
+    else if (reader_type == FileType::INDEXED)
+        reader.reset(new IndexedReader(input.release()));
+    else
+        reader.reset(new BinaryReader(input.release()));
+    reader->setProjection(projected_tags);
+    if (IOStatistics::IsEnabled())
+        reader->io_statistics_.reset(new IOStatistics("reader for \"" + input_filename + "\""));
+    return reader;
 }
 
 
 BinaryReader::BinaryReader(File * const input)
-    : Reader(input), next_record_start_(0)
+    : Reader(input), last_record_is_valid_(false), next_record_start_(0), ring_view_size_(0)
 {
     struct stat stat_buf;
-    if (::fstat(input->getFileDescriptor(), &stat_buf) != 0)
+    if (input->isCompressed()) // We can't memory-map the decompressed data.
+        mmap_ = nullptr;
+    else if (::fstat(input->getFileDescriptor(), &stat_buf) != 0)
         LOG_ERROR("stat(2) on \"" + input->getPath() + "\" failed!");
-    if (S_ISFIFO(stat_buf.st_mode))
+    else if (S_ISFIFO(stat_buf.st_mode))
         mmap_ = nullptr;
     else {
         mmap_ = reinterpret_cast<char *>(::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, input->getFileDescriptor(), 0));
         if (mmap_ == MAP_FAILED or mmap_ == nullptr)
             LOG_ERROR("Failed to mmap \"" + input->getPath() + "\"!");
-        input_file_size_ = stat_buf.st_size;
+        input_file_size_ = data_size_ = stat_buf.st_size;
         offset_ = 0;
     }
+}
 
-    last_record_ = actualRead();
+
+BinaryReader::BinaryReader(File * const input, ShmRing * const ring)
+    : Reader(input), last_record_is_valid_(false), next_record_start_(0), mmap_(nullptr), offset_(0), input_file_size_(0),
+      data_size_(0), ring_(ring), ring_view_size_(0)
+{
 }
 
 
@@ -1470,12 +1658,18 @@ BinaryReader::~BinaryReader() {
 
 
 Record BinaryReader::read() {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::READ);
+    if (unlikely(not last_record_is_valid_)) {
+        last_record_ = actualRead();
+        last_record_is_valid_ = true;
+    }
+
     if (unlikely(not last_record_))
         return last_record_;
 
     Record new_record;
     do {
-        next_record_start_ = (mmap_ == nullptr) ? input_->tell() : offset_;
+        next_record_start_ = getCurrentOffset();
         new_record = actualRead();
         if (unlikely(new_record.getControlNumber() == last_record_.getControlNumber()))
             last_record_.merge(new_record);
@@ -1486,92 +1680,340 @@ Record BinaryReader::read() {
     // This should not be necessary unless we got bad data!
     new_record.sortFieldTags(new_record.begin(), new_record.end());
 
+    probe.complete(new_record.size());
     return new_record;
 }
 
 
+inline off_t BinaryReader::getCurrentOffset() const {
+    if (ring_ != nullptr)
+        return ring_->tell();
+    return (mmap_ == nullptr) ? input_->tell() : offset_;
+}
+
+
+size_t BinaryReader::waitForRingRecord() {
+    // Whatever readView() returned last time is no longer needed:
+    ring_->consume(ring_view_size_);
+    ring_view_size_ = 0;
+
+    const size_t available(ring_->waitForData(Record::RECORD_LENGTH_FIELD_LENGTH));
+    if (available == 0)
+        return 0;
+    if (unlikely(available < Record::RECORD_LENGTH_FIELD_LENGTH))
+        LOG_ERROR("truncated record length in \"" + std::string(ShmRing::PATH_PREFIX) + ring_->getName() + "\"!");
+
+    unsigned record_length;
+    if (unlikely(not StringUtil::FixedWidthToUnsigned(ring_->getReadPointer(), Record::RECORD_LENGTH_FIELD_LENGTH, &record_length)
+                 or record_length <= Record::RECORD_LENGTH_FIELD_LENGTH))
+        LOG_ERROR("invalid record length in \"" + std::string(ShmRing::PATH_PREFIX) + ring_->getName() + "\"!");
+    if (unlikely(ring_->waitForData(record_length) < record_length))
+        LOG_ERROR("truncated record in \"" + std::string(ShmRing::PATH_PREFIX) + ring_->getName() + "\"!");
+
+    return record_length;
+}
+
+
 Record BinaryReader::actualRead() {
-    if (mmap_ == nullptr) {
+    Record record;
+    actualRead(&record);
+    return record;
+}
+
+
+void BinaryReader::actualRead(Record * const record) {
+    if (ring_ != nullptr) {
+        const size_t record_length(waitForRingRecord());
+        if (record_length == 0)
+            record->clear();
+        else {
+            // The ring's double mapping guarantees that the record is contiguous, so we decode it in place:
+            record->assign(record_length, ring_->getReadPointer(), projected_tags_.empty() ? nullptr : &projected_tags_);
+            ring_->consume(record_length);
+        }
+    } else if (mmap_ == nullptr) {
         char buf[Record::MAX_RECORD_LENGTH];
         size_t bytes_read;
-        if (unlikely((bytes_read = input_->read(buf, Record::RECORD_LENGTH_FIELD_LENGTH)) == 0))
-            return Record();
+        if (unlikely((bytes_read = input_->read(buf, Record::RECORD_LENGTH_FIELD_LENGTH)) == 0)) {
+            record->clear();
+            return;
+        }
 
         if (unlikely(bytes_read != Record::RECORD_LENGTH_FIELD_LENGTH))
             LOG_ERROR("failed to read record length!");
-        const unsigned record_length(ToUnsigned(buf, Record::RECORD_LENGTH_FIELD_LENGTH));
+        unsigned record_length;
+        if (unlikely(not StringUtil::FixedWidthToUnsigned(buf, Record::RECORD_LENGTH_FIELD_LENGTH, &record_length)))
+            LOG_ERROR("invalid record length in \"" + input_->getPath() + "\"!");
 
         bytes_read = input_->read(buf + Record::RECORD_LENGTH_FIELD_LENGTH, record_length - Record::RECORD_LENGTH_FIELD_LENGTH);
         if (unlikely(bytes_read != record_length - Record::RECORD_LENGTH_FIELD_LENGTH))
             LOG_ERROR("failed to read a record from \"" + input_->getPath() + "\"!");
 
-        return Record(record_length, buf);
+        record->assign(record_length, buf, projected_tags_.empty() ? nullptr : &projected_tags_);
     } else { // Use memory-mapped I/O.
-        if (unlikely(offset_ == input_file_size_))
-            return Record();
+        if (unlikely(offset_ == data_size_)) {
+            record->clear();
+            return;
+        }
 
-        if (unlikely(offset_ + Record::RECORD_LENGTH_FIELD_LENGTH >= input_file_size_))
-            LOG_ERROR("not enough remaining room for a record length in the memory mapping! (input_file_size_ = "
-                      + std::to_string(input_file_size_) + ", offset_ = " + std::to_string(offset_) + ")");
-        const unsigned record_length(ToUnsigned(mmap_ + offset_, Record::RECORD_LENGTH_FIELD_LENGTH));
+        if (unlikely(offset_ + Record::RECORD_LENGTH_FIELD_LENGTH >= data_size_))
+            LOG_ERROR("not enough remaining room for a record length in the memory mapping! (data_size_ = "
+                      + std::to_string(data_size_) + ", offset_ = " + std::to_string(offset_) + ")");
+        unsigned record_length;
+        if (unlikely(not StringUtil::FixedWidthToUnsigned(mmap_ + offset_, Record::RECORD_LENGTH_FIELD_LENGTH, &record_length)))
+            LOG_ERROR("invalid record length at offset " + std::to_string(offset_) + " in the memory mapping!");
 
-        if (unlikely(offset_ + record_length > input_file_size_))
+        if (unlikely(offset_ + record_length > data_size_))
             LOG_ERROR("not enough remaining room for the rest if the record in the memory mapping!");
         offset_ += record_length;
 
-        return Record(record_length, mmap_ + offset_ - record_length);
+        record->assign(record_length, mmap_ + offset_ - record_length, projected_tags_.empty() ? nullptr : &projected_tags_);
     }
 }
 
 
 void BinaryReader::rewind() {
+    if (unlikely(ring_ != nullptr))
+        LOG_ERROR("can't rewind a shared memory ring!");
+
     if (mmap_ == nullptr)
         input_->rewind();
     else
         offset_ = 0;
     next_record_start_ = 0;
-    last_record_ = actualRead();
+    last_record_is_valid_ = false;
+}
+
+
+bool BinaryReader::read(Record * const record) {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::READ);
+    if (unlikely(not last_record_is_valid_)) {
+        actualRead(&last_record_);
+        last_record_is_valid_ = true;
+    }
+
+    if (unlikely(not last_record_)) {
+        record->clear();
+        return false;
+    }
+
+    do {
+        next_record_start_ = getCurrentOffset();
+        actualRead(&spare_record_);
+        if (unlikely(spare_record_.getControlNumber() == last_record_.getControlNumber()))
+            last_record_.merge(spare_record_);
+    } while (spare_record_.getControlNumber() == last_record_.getControlNumber());
+
+    // Hand out the completed record, make the look-ahead record the new "last_record_" and keep the caller's old record
+    // around so that we can reuse its storage the next time around:
+    record->swap(last_record_);
+    last_record_.swap(spare_record_);
+
+    // This should not be necessary unless we got bad data!
+    record->sortFieldTags(record->begin(), record->end());
+
+    probe.complete(record->size());
+    return true;
+}
+
+
+RecordView BinaryReader::readView() {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::READ);
+    if (ring_ != nullptr) {
+        if (unlikely(last_record_is_valid_))
+            LOG_ERROR("can't mix calls to read() and readView() on a shared memory ring!");
+
+        const size_t record_length(waitForRingRecord());
+        if (record_length == 0)
+            return RecordView();
+
+        // We only hand the record back to the writer on the next call, so that the view stays valid until then:
+        ring_view_size_ = record_length;
+        next_record_start_ = ring_->tell() + record_length;
+
+        probe.complete(record_length);
+        return RecordView(record_length, ring_->getReadPointer());
+    }
+
+    if (mmap_ == nullptr) {
+        if (unlikely(last_record_is_valid_))
+            LOG_ERROR("can't mix calls to read() and readView() on non-memory-mapped input \"" + input_->getPath() + "\"!");
+
+        char record_length_buf[Record::RECORD_LENGTH_FIELD_LENGTH];
+        size_t bytes_read;
+        if (unlikely((bytes_read = input_->read(record_length_buf, Record::RECORD_LENGTH_FIELD_LENGTH)) == 0))
+            return RecordView();
+        if (unlikely(bytes_read != Record::RECORD_LENGTH_FIELD_LENGTH))
+            LOG_ERROR("failed to read record length!");
+        unsigned record_length;
+        if (unlikely(not StringUtil::FixedWidthToUnsigned(record_length_buf, Record::RECORD_LENGTH_FIELD_LENGTH, &record_length)))
+            LOG_ERROR("invalid record length in \"" + input_->getPath() + "\"!");
+
+        view_buffer_.resize(record_length);
+        std::memcpy(&view_buffer_[0], record_length_buf, Record::RECORD_LENGTH_FIELD_LENGTH);
+        bytes_read = input_->read(&view_buffer_[0] + Record::RECORD_LENGTH_FIELD_LENGTH,
+                                  record_length - Record::RECORD_LENGTH_FIELD_LENGTH);
+        if (unlikely(bytes_read != record_length - Record::RECORD_LENGTH_FIELD_LENGTH))
+            LOG_ERROR("failed to read a record from \"" + input_->getPath() + "\"!");
+        next_record_start_ = input_->tell();
+
+        probe.complete(record_length);
+        return RecordView(record_length, view_buffer_.data());
+    }
+
+    // If read() already decoded a look-ahead record we back up to its start.  "next_record_start_" always points there.
+    if (last_record_is_valid_) {
+        offset_ = next_record_start_;
+        last_record_is_valid_ = false;
+    }
+
+    if (unlikely(offset_ == data_size_))
+        return RecordView();
+
+    if (unlikely(offset_ + Record::RECORD_LENGTH_FIELD_LENGTH >= data_size_))
+        LOG_ERROR("not enough remaining room for a record length in the memory mapping! (data_size_ = "
+                  + std::to_string(data_size_) + ", offset_ = " + std::to_string(offset_) + ")");
+    unsigned record_length;
+    if (unlikely(not StringUtil::FixedWidthToUnsigned(mmap_ + offset_, Record::RECORD_LENGTH_FIELD_LENGTH, &record_length)))
+        LOG_ERROR("invalid record length at offset " + std::to_string(offset_) + " in the memory mapping!");
+
+    if (unlikely(offset_ + record_length > data_size_))
+        LOG_ERROR("not enough remaining room for the rest if the record in the memory mapping!");
+    const char * const record_start(mmap_ + offset_);
+    offset_ += record_length;
+    next_record_start_ = offset_;
+
+    probe.complete(record_length);
+    return RecordView(record_length, record_start);
 }
 
 
 bool BinaryReader::seek(const off_t offset, const int whence) {
+    if (ring_ != nullptr)
+        return false;
+
     if (mmap_ == nullptr) {
         if (input_->seek(offset, whence)) {
             next_record_start_ = input_->tell();
-            last_record_ = actualRead();
+            last_record_is_valid_ = false;
             return true;
         } else
             return false;
     } else { // Use memory-mapped I/O.
         switch (whence) {
         case SEEK_SET:
-            if (offset < 0 or static_cast<size_t>(offset) >= input_file_size_)
+            if (offset < 0 or static_cast<size_t>(offset) >= data_size_)
                 return false;
             offset_ = offset;
             break;
         case SEEK_CUR:
             if (static_cast<ssize_t>(offset_) + offset < 0
-                or static_cast<ssize_t>(offset_) + offset >= static_cast<ssize_t>(input_file_size_))
+                or static_cast<ssize_t>(offset_) + offset >= static_cast<ssize_t>(data_size_))
                 return false;
             offset_ += offset;
             break;
         case SEEK_END:
-            if (offset < 0 or static_cast<size_t>(offset) >= input_file_size_)
+            if (offset < 0 or static_cast<size_t>(offset) >= data_size_)
                 return false;
-            offset_ = input_file_size_ - offset;
+            offset_ = data_size_ - offset;
             break;
         default:
             LOG_ERROR("bad value for \"whence\": " + std::to_string(whence) + "!");
         }
         next_record_start_ = offset_;
-        last_record_ = actualRead();
+        last_record_is_valid_ = false;
 
         return true;
     }
 }
 
 
+IndexedReader::IndexedReader(File * const input)
+    : BinaryReader(input), record_offsets_(nullptr), keys_(nullptr), record_count_(0), key_count_(0), key_width_(0)
+{
+    if (unlikely(mmap_ == nullptr))
+        LOG_ERROR("indexed MARC file \"" + input->getPath() + "\" is not memory-mappable!");
+    if (unlikely(input_file_size_ < sizeof(IndexedFileTrailer)))
+        LOG_ERROR("\"" + input->getPath() + "\" is too small to be an indexed MARC file!");
+
+    IndexedFileTrailer trailer;
+    std::memcpy(&trailer, mmap_ + input_file_size_ - sizeof(IndexedFileTrailer), sizeof trailer);
+    if (unlikely(not trailer.hasValidMagic() or not trailer.isConsistentWith(input_file_size_)))
+        LOG_ERROR("\"" + input->getPath() + "\" is not a valid indexed MARC file!");
+
+    data_size_      = trailer.footer_offset_;
+    record_count_   = trailer.record_count_;
+    key_count_      = trailer.key_count_;
+    key_width_      = trailer.key_width_;
+    record_offsets_ = mmap_ + trailer.footer_offset_;
+    keys_           = record_offsets_ + record_count_ * sizeof(uint64_t);
+}
+
+
+off_t IndexedReader::getRecordOffset(const size_t record_no) const {
+    if (unlikely(record_no >= record_count_))
+        LOG_ERROR("record number " + std::to_string(record_no) + " is out of range for \"" + input_->getPath() + "\"!");
+
+    uint64_t offset;
+    std::memcpy(&offset, record_offsets_ + record_no * sizeof(uint64_t), sizeof offset);
+    return static_cast<off_t>(offset);
+}
+
+
+bool IndexedReader::seekToRecord(const size_t record_no) {
+    if (record_no >= record_count_)
+        return false;
+    return seek(getRecordOffset(record_no));
+}
+
+
+bool IndexedReader::findControlNumber(const std::string &control_number, size_t * const record_no) const {
+    if (unlikely(control_number.length() > key_width_))
+        return false;
+
+    std::string padded_key(control_number);
+    padded_key.resize(key_width_, '\0');
+
+    const size_t entry_size(key_width_ + sizeof(uint64_t));
+    size_t low(0), high(key_count_);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const char * const entry(keys_ + middle * entry_size);
+        const int cmp(std::memcmp(entry, padded_key.data(), key_width_));
+        if (cmp < 0)
+            low = middle + 1;
+        else if (cmp > 0)
+            high = middle;
+        else {
+            uint64_t raw_record_no;
+            std::memcpy(&raw_record_no, entry + key_width_, sizeof raw_record_no);
+            *record_no = static_cast<size_t>(raw_record_no);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool IndexedReader::seekToControlNumber(const std::string &control_number) {
+    size_t record_no;
+    return findControlNumber(control_number, &record_no) and seekToRecord(record_no);
+}
+
+
+void IndexedReader::forEachControlNumber(const std::function<void(const std::string &control_number, const off_t offset)> &callback) const {
+    const size_t entry_size(key_width_ + sizeof(uint64_t));
+    for (const char *entry(keys_); entry < keys_ + key_count_ * entry_size; entry += entry_size) {
+        uint64_t record_no;
+        std::memcpy(&record_no, entry + key_width_, sizeof record_no);
+        callback(std::string(entry, ::strnlen(entry, key_width_)), getRecordOffset(record_no));
+    }
+}
+
+
 Record XmlReader::read() {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::READ);
     Record new_record;
 
     XMLSubsetParser<File>::Type type;
@@ -1619,7 +2061,16 @@ Record XmlReader::read() {
                 throw std::runtime_error("in MARC::MarcUtil::Record::XmlFactory: closing </record> tag expected "
                                          "while parsing \"" + input_->getPath() + "\" on line "
                                          + std::to_string(xml_parser_->getLineNo()) + "!");
+            if (not projected_tags_.empty())
+                new_record.fields_.erase(std::remove_if(new_record.fields_.begin(), new_record.fields_.end(),
+                                                        [this](const Record::Field &field) {
+                                                            return not std::binary_search(projected_tags_.cbegin(),
+                                                                                          projected_tags_.cend(),
+                                                                                          field.getTag());
+                                                        }),
+                                         new_record.fields_.end());
             new_record.sortFieldTags(new_record.begin(), new_record.end());
+            probe.complete(new_record.size());
             return new_record;
         }
 
@@ -1957,16 +2408,70 @@ std::unique_ptr<Writer> Writer::Factory(const std::string &output_filename, File
     if (writer_type == FileType::AUTO)
         writer_type = GuessFileType(output_filename, GuessFileTypeBehaviour::USE_THE_FILENAME_ONLY);
 
-    std::unique_ptr<File> output(writer_mode == WriterMode::OVERWRITE
-                                 ? FileUtil::OpenOutputFileOrDie(output_filename)
-                                 : FileUtil::OpenForAppendingOrDie(output_filename));
+    std::unique_ptr<Writer> writer;
+    std::string ring_name;
+    if (ShmRing::ParsePath(output_filename, &ring_name)) {
+        if (unlikely(writer_type != FileType::BINARY))
+            LOG_ERROR("shared memory rings can only carry binary MARC! (\"" + output_filename + "\")");
+        if (unlikely(writer_mode == WriterMode::APPEND))
+            LOG_ERROR("can't append to shared memory ring \"" + output_filename + "\"!");
+        std::unique_ptr<ShmRing> ring(new ShmRing(ring_name, ShmRing::WRITER));
+        File * const output(new File(::dup(ring->getFileDescriptor()), "r"));
+        writer.reset(new BinaryWriter(output, ring.release()));
+        if (IOStatistics::IsEnabled())
+            writer->io_statistics_.reset(new IOStatistics("writer for \"" + output_filename + "\""));
+        return writer;
+    }
+
+    if (writer_type == FileType::INDEXED) {
+        if (unlikely(writer_mode == WriterMode::APPEND))
+            LOG_ERROR("can't append to indexed MARC file \"" + output_filename + "\"!");
+        if (unlikely(IsGzipCompressed(output_filename)))
+            LOG_ERROR("indexed MARC files can't be compressed! (\"" + output_filename + "\")");
+    }
+
+    std::unique_ptr<File> output(OpenFileOrDie(output_filename, writer_mode == WriterMode::OVERWRITE ? "w" : "a"));
 
-    return (writer_type == FileType::XML) ? std::unique_ptr<Writer>(new XmlWriter(output.release()))
-                                          : std::unique_ptr<Writer>(new BinaryWriter(output.release()));
+    switch (writer_type) {
+    case FileType::XML:
+        writer.reset(new XmlWriter(output.release()));
+        break;
+    case FileType::INDEXED:
+        writer.reset(new IndexedWriter(output.release()));
+        break;
+    default:
+        writer.reset(new BinaryWriter(output.release()));
+    }
+    if (IOStatistics::IsEnabled())
+        writer->io_statistics_.reset(new IOStatistics("writer for \"" + output_filename + "\""));
+    return writer;
+}
+
+
+BinaryWriter::BinaryWriter(File * const output, ShmRing * const ring)
+    : output_(output), flush_threshold_(DEFAULT_FLUSH_THRESHOLD), bytes_written_(0), ring_(ring)
+{
+}
+
+
+BinaryWriter::~BinaryWriter() {
+    writeBuffer();
+    delete output_;
 }
 
 
 void BinaryWriter::write(const Record &record) {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::WRITE);
+    const size_t initial_buffer_size(output_buffer_.size());
+    AppendRecord(record, &output_buffer_);
+    const size_t record_size(output_buffer_.size() - initial_buffer_size);
+    if (output_buffer_.size() >= flush_threshold_)
+        writeBuffer();
+    probe.complete(record_size);
+}
+
+
+void BinaryWriter::AppendRecord(const Record &record, std::string * const raw_records) {
     std::string error_message;
     if (not record.isValid(&error_message))
         LOG_ERROR("trying to write an invalid record: " + error_message + " (Control number: " + record.getControlNumber() + ")");
@@ -1985,8 +2490,7 @@ void BinaryWriter::write(const Record &record) {
             ++end;
         }
 
-        std::string raw_record;
-        raw_record.reserve(record_size);
+        std::string &raw_record(*raw_records);
         const unsigned no_of_fields(end - start);
         AppendToStringWithLeadingZeros(raw_record, record_size, /* width = */ 5);
         StringUtil::AppendSubstring(raw_record, record.leader_, 5, 12 - 5);
@@ -2025,54 +2529,241 @@ void BinaryWriter::write(const Record &record) {
         }
         raw_record += '\x1D'; // end-of-record
 
-        output_->write(raw_record);
-
         start = end;
     } while (start != record.end());
 }
 
 
+void BinaryWriter::write(const RecordView &record_view) {
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::WRITE);
+    output_buffer_.append(record_view.data(), record_view.size());
+    if (output_buffer_.size() >= flush_threshold_)
+        writeBuffer();
+    probe.complete(record_view.size());
+}
+
+
+void BinaryWriter::writeBuffer() {
+    if (output_buffer_.empty())
+        return;
+
+    if (ring_ != nullptr)
+        ring_->write(output_buffer_.data(), output_buffer_.size());
+    else if (unlikely(output_->write(output_buffer_.data(), output_buffer_.size()) != output_buffer_.size()))
+        LOG_ERROR("failed to write " + std::to_string(output_buffer_.size()) + " bytes to \"" + output_->getPath() + "\"!");
+    bytes_written_ += output_buffer_.size();
+    output_buffer_.clear(); // Keeps the capacity, so we don't have to reallocate.
+}
+
+
+IndexedWriter::~IndexedWriter() {
+    // If a control number occurs more than once, we keep the last occurrence:
+    std::stable_sort(control_numbers_and_record_numbers_.begin(), control_numbers_and_record_numbers_.end(),
+                     [](const std::pair<std::string, uint64_t> &lhs, const std::pair<std::string, uint64_t> &rhs)
+                         { return lhs.first < rhs.first; });
+    std::vector<std::pair<std::string, uint64_t>> unique_keys;
+    for (auto &control_number_and_record_number : control_numbers_and_record_numbers_) {
+        if (not unique_keys.empty() and unique_keys.back().first == control_number_and_record_number.first)
+            unique_keys.back().second = control_number_and_record_number.second;
+        else
+            unique_keys.emplace_back(std::move(control_number_and_record_number));
+    }
+
+    IndexedFileTrailer trailer;
+    trailer.footer_offset_ = getOutputSize();
+    trailer.record_count_  = record_offsets_.size();
+    trailer.key_count_     = unique_keys.size();
+    trailer.key_width_     = 0;
+    for (const auto &key : unique_keys) {
+        if (key.first.length() > trailer.key_width_)
+            trailer.key_width_ = key.first.length();
+    }
+    std::memcpy(trailer.magic_, INDEXED_FILE_MAGIC, sizeof INDEXED_FILE_MAGIC);
+
+    output_buffer_.append(reinterpret_cast<const char *>(record_offsets_.data()), record_offsets_.size() * sizeof(uint64_t));
+    for (const auto &key : unique_keys) {
+        output_buffer_ += key.first;
+        output_buffer_.append(trailer.key_width_ - key.first.length(), '\0');
+        output_buffer_.append(reinterpret_cast<const char *>(&key.second), sizeof key.second);
+    }
+    output_buffer_.append(reinterpret_cast<const char *>(&trailer), sizeof trailer);
+}
+
+
+void IndexedWriter::write(const Record &record) {
+    addToIndex(record.getControlNumber());
+    BinaryWriter::write(record);
+}
+
+
+void IndexedWriter::write(const RecordView &record_view) {
+    addToIndex(record_view.getControlNumber().toString());
+    BinaryWriter::write(record_view);
+}
+
+
+// Adjacent records w/ the same control number will be merged by our readers and therefore only get one offset.
+void IndexedWriter::addToIndex(const std::string &control_number) {
+    if (not record_offsets_.empty() and control_number == last_control_number_)
+        return;
+
+    control_numbers_and_record_numbers_.emplace_back(control_number, record_offsets_.size());
+    record_offsets_.emplace_back(getOutputSize());
+    last_control_number_ = control_number;
+}
+
+
 XmlWriter::XmlWriter(File * const output_file, const unsigned indent_amount,
                      const MarcXmlWriter::TextConversionType text_conversion_type)
+    : xml_writer_(new MarcXmlWriter(output_file, indent_amount, text_conversion_type)), text_conversion_type_(text_conversion_type)
 {
-    xml_writer_ = new MarcXmlWriter(output_file, indent_amount, text_conversion_type);
+    init();
 }
 
 
 XmlWriter::XmlWriter(std::string * const output_string, const unsigned indent_amount,
                      const MarcXmlWriter::TextConversionType text_conversion_type)
+    : xml_writer_(new MarcXmlWriter(output_string, indent_amount, text_conversion_type)), text_conversion_type_(text_conversion_type)
 {
-    xml_writer_ = new MarcXmlWriter(output_string, indent_amount, text_conversion_type);
+    init();
+}
+
+
+namespace {
+
+
+const char TEXT_SPECIAL_CHARS[] = "<>&\"'";
+const char ATTRIBUTE_SPECIAL_CHARS[] = "\"&";
+
+
+// Appends "text" to "buffer" while escaping the characters in "special_chars" like ::XmlWriter does.  Runs of characters
+// that need no escaping are copied in bulk.
+void AppendEscaped(const char *text, const size_t length, const StringView &special_chars,
+                   const MarcXmlWriter::TextConversionType text_conversion_type, std::string * const buffer)
+{
+    const size_t start_size(buffer->size());
+    const char * const end(text + length);
+    for (;;) {
+        const char * const special_char(ScanUtil::FindFirstOf(text, end, special_chars));
+        buffer->append(text, special_char);
+        if (special_char == end)
+            break;
+
+        switch (*special_char) {
+        case '<':
+            *buffer += "&lt;";
+            break;
+        case '>':
+            *buffer += "&gt;";
+            break;
+        case '&':
+            *buffer += "&amp;";
+            break;
+        case '"':
+            *buffer += "&quot;";
+            break;
+        case '\'':
+            *buffer += "&apos;";
+            break;
+        }
+        text = special_char + 1;
+    }
+
+    // The escapes are ASCII, so we can convert what we just appended after the fact, which is only necessary if it isn't
+    // plain ASCII anyway:
+    if (text_conversion_type == MarcXmlWriter::ConvertFromIso8859_15
+        and ScanUtil::FindFirstNonASCII(buffer->data() + start_size, buffer->data() + buffer->size())
+            != buffer->data() + buffer->size())
+    {
+        const std::string converted(StringUtil::ISO8859_15ToUTF8(buffer->substr(start_size)));
+        buffer->replace(start_size, std::string::npos, converted);
+    }
+}
+
+
+inline void AppendEscapedText(const std::string &text, const MarcXmlWriter::TextConversionType text_conversion_type,
+                              std::string * const buffer)
+{
+    AppendEscaped(text.data(), text.size(), TEXT_SPECIAL_CHARS, text_conversion_type, buffer);
+}
+
+
+inline void AppendEscapedAttributeValue(const char * const value, const size_t length,
+                                        const MarcXmlWriter::TextConversionType text_conversion_type,
+                                        std::string * const buffer)
+{
+    AppendEscaped(value, length, ATTRIBUTE_SPECIAL_CHARS, text_conversion_type, buffer);
+}
+
+
+} // unnamed namespace
+
+
+// Precomputes everything that does not depend on the contents of the records.
+void XmlWriter::init() {
+    const unsigned indent_amount(xml_writer_->getIndentAmount());
+    const unsigned record_nesting_level(xml_writer_->getNestingLevel()); // Inside of "collection".
+    for (unsigned level(0); level < 3; ++level)
+        indents_[level].assign(indent_amount * (record_nesting_level + level), ' ');
+
+    subfield_start_tags_.resize(256);
+    for (unsigned code(0); code < 256; ++code) {
+        const char subfield_code(static_cast<char>(code));
+        auto &start_tag(subfield_start_tags_[code]);
+        start_tag = indents_[2] + "<subfield code=\"";
+        AppendEscapedAttributeValue(&subfield_code, 1, text_conversion_type_, &start_tag);
+        start_tag += "\">";
+    }
 }
 
 
 void XmlWriter::write(const Record &record) {
-    xml_writer_->openTag("record");
+    IOStatistics::Probe probe(io_statistics_.get(), IOStatistics::WRITE);
 
-    xml_writer_->writeTagsWithData("leader", record.leader_, /* suppress_newline = */ true);
+    record_buffer_.clear();
+    record_buffer_ += indents_[0];
+    record_buffer_ += "<record>\n";
+
+    record_buffer_ += indents_[1];
+    record_buffer_ += "<leader>";
+    AppendEscapedText(record.leader_, text_conversion_type_, &record_buffer_);
+    record_buffer_ += "</leader>\n";
 
     for (const auto &field : record) {
-        if (field.isControlField())
-            xml_writer_->writeTagsWithData("controlfield", { std::make_pair("tag", field.getTag().toString()) },
-                                           field.getContents(),
-                    /* suppress_newline = */ true);
-        else { // We have a data field.
-            xml_writer_->openTag("datafield",
-                                 { std::make_pair("tag", field.getTag().toString()),
-                                   std::make_pair("ind1", std::string(1, field.getIndicator1())),
-                                   std::make_pair("ind2", std::string(1, field.getIndicator2()))
-                                 });
-
-            const Subfields subfields(field.getSubfields());
-            for (const auto &subfield : subfields)
-                xml_writer_->writeTagsWithData("subfield", { std::make_pair("code", std::string(1, subfield.code_)) },
-                                               subfield.value_, /* suppress_newline = */ true);
-
-            xml_writer_->closeTag(); // Close "datafield".
+        record_buffer_ += indents_[1];
+        const Tag &tag(field.getTag());
+        if (field.isControlField()) {
+            record_buffer_ += "<controlfield tag=\"";
+            AppendEscapedAttributeValue(tag.c_str(), Record::TAG_LENGTH, text_conversion_type_, &record_buffer_);
+            record_buffer_ += "\">";
+            AppendEscapedText(field.getContents(), text_conversion_type_, &record_buffer_);
+            record_buffer_ += "</controlfield>\n";
+        } else { // We have a data field.
+            record_buffer_ += "<datafield tag=\"";
+            AppendEscapedAttributeValue(tag.c_str(), Record::TAG_LENGTH, text_conversion_type_, &record_buffer_);
+            const char indicator1(field.getIndicator1()), indicator2(field.getIndicator2());
+            record_buffer_ += "\" ind1=\"";
+            AppendEscapedAttributeValue(&indicator1, 1, text_conversion_type_, &record_buffer_);
+            record_buffer_ += "\" ind2=\"";
+            AppendEscapedAttributeValue(&indicator2, 1, text_conversion_type_, &record_buffer_);
+            record_buffer_ += "\">\n";
+
+            for (const auto &subfield : field.getSubfields()) {
+                record_buffer_ += subfield_start_tags_[static_cast<unsigned char>(subfield.code_)];
+                AppendEscapedText(subfield.value_, text_conversion_type_, &record_buffer_);
+                record_buffer_ += "</subfield>\n";
+            }
+
+            record_buffer_ += indents_[1];
+            record_buffer_ += "</datafield>\n";
         }
     }
 
-    xml_writer_->closeTag(); // Close "record".
+    record_buffer_ += indents_[0];
+    record_buffer_ += "</record>\n";
+
+    xml_writer_->writeRaw(record_buffer_.data(), record_buffer_.size());
+    probe.complete(record.size());
 }
 
 
@@ -2094,14 +2785,12 @@ unsigned RemoveDuplicateControlNumberRecords(const std::string &marc_filename) {
         std::unique_ptr<Reader> marc_reader(Reader::Factory(marc_filename));
         temp_filename = "/tmp/" + std::string(::basename(::progname)) + std::to_string(::getpid())
                         + (marc_reader->getReaderType() == FileType::XML ? ".xml" : ".mrc");
-        std::unique_ptr<Writer> marc_writer(Writer::Factory(temp_filename));
-        std::unordered_set<std::string> already_seen_control_numbers;
+        std::unique_ptr<Writer> marc_writer(Writer::Factory(temp_filename, marc_reader->getReaderType()));
+        ControlNumberSet already_seen_control_numbers;
         while (const Record record = marc_reader->read()) {
-            const std::string control_number(record.getControlNumber());
-            if (already_seen_control_numbers.find(control_number) == already_seen_control_numbers.end()) {
+            if (already_seen_control_numbers.insert(record.getControlNumber()))
                 marc_writer->write(record);
-                already_seen_control_numbers.emplace(control_number);
-            } else
+            else
                 ++dropped_count;
         }
     }
@@ -2206,6 +2895,84 @@ std::string CalcChecksum(const Record &record, const std::set<Tag> &excluded_fie
 }
 
 
+uint64_t CalcFastChecksum(const Record &record, const std::set<Tag> &excluded_fields, const bool suppress_local_fields) {
+    std::vector<const Record::Field *> field_refs;
+    field_refs.reserve(record.fields_.size());
+
+    // Like CalcChecksum() we sort the fields so that equivalent records get the same checksum.
+    for (const auto &field : record.fields_) {
+        if (excluded_fields.find(field.getTag()) == excluded_fields.cend() and (not suppress_local_fields or not field.getTag().isLocal()))
+            field_refs.emplace_back(&field);
+    }
+    std::sort(field_refs.begin(), field_refs.end(), CompareField);
+
+    StringUtil::XXHash64 hash;
+    if (likely(record.leader_.length() == Record::LEADER_LENGTH)) {
+        hash.update(record.leader_.data() + 5, 12 - 5);
+        hash.update(record.leader_.data() + 17, Record::LEADER_LENGTH - 17);
+    } else
+        hash.update(record.leader_);
+
+    for (const auto &field_ref : field_refs) {
+        hash.update(field_ref->getTag().c_str(), Record::TAG_LENGTH);
+        hash.update(field_ref->getContents());
+        hash.update('\x1E'); // Field contents never contain field terminators, so this makes the input unambiguous.
+    }
+
+    return hash.digest();
+}
+
+
+namespace {
+
+
+// \return "excluded_fields" w/ "checksum_tag" added.
+inline std::set<Tag> AddChecksumTag(const std::set<Tag> &excluded_fields, const Tag &checksum_tag) {
+    std::set<Tag> excluded_fields_and_checksum_tag(excluded_fields);
+    excluded_fields_and_checksum_tag.emplace(checksum_tag);
+    return excluded_fields_and_checksum_tag;
+}
+
+
+} // unnamed namespace
+
+
+uint64_t StoreFastChecksum(Record * const record, const Tag &checksum_tag, const std::set<Tag> &excluded_fields,
+                           const bool suppress_local_fields)
+{
+    const uint64_t checksum(CalcFastChecksum(*record, AddChecksumTag(excluded_fields, checksum_tag), suppress_local_fields));
+    char hex_checksum[16 + 1];
+    std::snprintf(hex_checksum, sizeof hex_checksum, "%016" PRIx64, checksum);
+    record->replaceField(checksum_tag, Subfields({ { 'a', hex_checksum } }));
+
+    return checksum;
+}
+
+
+bool GetStoredFastChecksum(const Record &record, uint64_t * const checksum, const Tag &checksum_tag) {
+    const auto checksum_field(record.findTag(checksum_tag));
+    if (checksum_field == record.end())
+        return false;
+
+    const std::string hex_checksum(checksum_field->getFirstSubfieldWithCode('a'));
+    if (unlikely(hex_checksum.length() != 16))
+        return false;
+
+    char *end;
+    *checksum = std::strtoull(hex_checksum.c_str(), &end, 16);
+    return *end == '\0';
+}
+
+
+bool StoredFastChecksumMatches(const Record &record, const Tag &checksum_tag, const std::set<Tag> &excluded_fields,
+                               const bool suppress_local_fields)
+{
+    uint64_t stored_checksum;
+    return GetStoredFastChecksum(record, &stored_checksum, checksum_tag)
+           and stored_checksum == CalcFastChecksum(record, AddChecksumTag(excluded_fields, checksum_tag), suppress_local_fields);
+}
+
+
 bool UBTueIsAquisitionRecord(const Record &marc_record) {
     for (const auto &field : marc_record.getTagRange("LOK")) {
         const Subfields subfields(field.getSubfields());
@@ -2545,6 +3312,13 @@ bool IsOpenAccess(const Record &marc_record) {
 
 
 size_t CollectRecordOffsets(MARC::Reader * const marc_reader, std::unordered_map<std::string, off_t> * const control_number_to_offset_map) {
+    if (marc_reader->getReaderType() == FileType::INDEXED) { // No need to read the records.
+        static_cast<const IndexedReader *>(marc_reader)->forEachControlNumber(
+            [control_number_to_offset_map](const std::string &control_number, const off_t offset)
+                { (*control_number_to_offset_map)[control_number] = offset; });
+        return control_number_to_offset_map->size();
+    }
+
     off_t last_offset(marc_reader->tell());
     while (const MARC::Record record = marc_reader->read()) {
         (*control_number_to_offset_map)[record.getControlNumber()] = last_offset;
@@ -2564,6 +3338,8 @@ FileType GetOptionalReaderType(int * const argc, char *** const argv, const int
             return_value = FileType::BINARY;
         else if (format == "marc-xml")
             return_value = FileType::XML;
+        else if (format == "marc-21-indexed")
+            return_value = FileType::INDEXED;
         else
             LOG_ERROR("bad MARC input format: \"" + format + "\"!");
 
@@ -2583,6 +3359,8 @@ FileType GetOptionalWriterType(int * const argc, char *** const argv, const int
             return_value = FileType::BINARY;
         else if (format == "marc-xml")
             return_value = FileType::XML;
+        else if (format == "marc-21-indexed")
+            return_value = FileType::INDEXED;
         else
             LOG_ERROR("bad MARC output format: \"" + format + "\"!");
 
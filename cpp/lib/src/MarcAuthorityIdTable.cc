@@ -0,0 +1,92 @@
+/** \brief Implementation of the MARC::AuthorityIdTable class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcAuthorityIdTable.h"
+#include "Compiler.h"
+#include "MARC.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+const StringView GND_PREFIX("(DE-588)");
+const StringView K10PLUS_PREFIX("(DE-627)");
+
+
+inline uint32_t LookUp(const ControlNumberSet &keys_to_ids, const std::string &key) {
+    uint64_t id;
+    return keys_to_ids.find(key, &id) ? static_cast<uint32_t>(id) : AuthorityIdTable::NO_ID;
+}
+
+
+} // unnamed namespace
+
+
+constexpr uint32_t AuthorityIdTable::NO_ID;
+
+
+uint32_t AuthorityIdTable::add(const std::string &ppn, const std::string &gnd_number) {
+    if (unlikely(size_ == NO_ID))
+        LOG_ERROR("too many authority records!");
+
+    if (not ppn.empty())
+        ppns_to_ids_.insert(ppn, size_);
+    if (not gnd_number.empty())
+        gnd_numbers_to_ids_.insert(gnd_number, size_);
+
+    return size_++;
+}
+
+
+uint32_t AuthorityIdTable::getIdForPPN(const std::string &ppn) const {
+    return LookUp(ppns_to_ids_, ppn);
+}
+
+
+uint32_t AuthorityIdTable::getIdForGNDNumber(const std::string &gnd_number) const {
+    return LookUp(gnd_numbers_to_ids_, gnd_number);
+}
+
+
+uint32_t AuthorityIdTable::getIdForReference(const StringView &reference) const {
+    if (reference.size() > GND_PREFIX.size() and reference.substr(0, GND_PREFIX.size()) == GND_PREFIX)
+        return LookUp(gnd_numbers_to_ids_, reference.substr(GND_PREFIX.size()).toString());
+    if (reference.size() > K10PLUS_PREFIX.size() and reference.substr(0, K10PLUS_PREFIX.size()) == K10PLUS_PREFIX)
+        return LookUp(ppns_to_ids_, reference.substr(K10PLUS_PREFIX.size()).toString());
+
+    return NO_ID;
+}
+
+
+void AuthorityIdTable::getReferencedIds(const StringView &field_contents, std::vector<uint32_t> * const ids) const {
+    for (const auto &code_and_value : SubfieldRange(field_contents)) {
+        if (code_and_value.first != '0')
+            continue;
+
+        const uint32_t id(getIdForReference(code_and_value.second));
+        if (id != NO_ID)
+            ids->emplace_back(id);
+    }
+}
+
+
+} // namespace MARC
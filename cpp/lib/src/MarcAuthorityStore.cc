@@ -0,0 +1,577 @@
+/** \brief Implementation of the MARC::AuthorityStore class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcAuthorityStore.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+// Offsets are relative to the start of the string pool.
+struct AuthorityStore::StringRef {
+    uint32_t offset_, length_;
+};
+
+
+// The DDC ids of a record are stored consecutively in the DDC id table.
+struct AuthorityStore::PPNEntry {
+    StringRef ppn_;
+    uint64_t record_offset_;
+    uint32_t first_ddc_id_, ddc_id_count_;
+public:
+    inline const StringRef &getKey() const { return ppn_; }
+};
+
+
+struct AuthorityStore::GNDEntry {
+    StringRef gnd_number_, ppn_;
+public:
+    inline const StringRef &getKey() const { return gnd_number_; }
+};
+
+
+// The synonyms of a name are stored consecutively in the synonym table.
+struct AuthorityStore::NameEntry {
+    StringRef name_, ppn_;
+    uint32_t first_synonym_, synonym_count_;
+public:
+    inline const StringRef &getKey() const { return name_; }
+};
+
+
+namespace {
+
+
+const char STORE_MAGIC[8]{ 'U', 'B', 'A', 'U', 'T', 'H', 'S', 'T' };
+const uint64_t STORE_VERSION(2);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the PPN, GND, name, synonym, DDC
+// and DDC id tables and finally the string pool.  All table entries are multiples of 8 bytes wide as well, except for
+// the 4 byte DDC ids, which is why we pad the DDC id table to an even number of ids.
+struct StoreHeader {
+    char magic_[sizeof STORE_MAGIC];
+    uint64_t version_;
+    uint64_t authority_file_size_;
+    int64_t authority_mtime_seconds_;
+    int64_t authority_mtime_nanoseconds_;
+    uint64_t ppn_entry_count_;
+    uint64_t gnd_entry_count_;
+    uint64_t name_entry_count_;
+    uint64_t synonym_count_;
+    uint64_t ddc_count_;
+    uint64_t ddc_id_count_;
+    uint64_t string_pool_size_;
+};
+
+
+void StatOrDie(const std::string &path, struct stat * const stat_buf) {
+    if (unlikely(::stat(path.c_str(), stat_buf) != 0))
+        LOG_ERROR("stat(2) on \"" + path + "\" failed!");
+}
+
+
+inline bool HeaderMatchesFile(const StoreHeader &header, const struct stat &stat_buf) {
+    return std::memcmp(header.magic_, STORE_MAGIC, sizeof STORE_MAGIC) == 0 and header.version_ == STORE_VERSION
+           and header.authority_file_size_ == static_cast<uint64_t>(stat_buf.st_size)
+           and header.authority_mtime_seconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_sec)
+           and header.authority_mtime_nanoseconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_nsec);
+}
+
+
+// Uses the same ordering as std::string, i.e. bytes compare as unsigned chars.
+inline int Compare(const StringView &lhs, const std::string &rhs) {
+    const int cmp(std::memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size())));
+    if (cmp != 0)
+        return cmp;
+    return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+
+template<typename EntryType> inline size_t GetTableSize(const uint64_t entry_count) {
+    return entry_count * sizeof(EntryType);
+}
+
+
+inline uint64_t GetPaddedDDCIdCount(const uint64_t ddc_id_count) {
+    return (ddc_id_count + 1) & ~UINT64_C(1);
+}
+
+
+struct NameData {
+    std::string ppn_;
+    std::vector<std::string> synonyms_;
+public:
+    NameData(const std::string &ppn, std::vector<std::string> &&synonyms): ppn_(ppn), synonyms_(std::move(synonyms)) { }
+};
+
+
+// Interns strings so that each distinct string is only stored once.
+class StringPool {
+    std::string pool_;
+    std::unordered_map<std::string, uint32_t> strings_to_offsets_map_;
+public:
+    /** \return The offset of "s" in our pool. */
+    uint32_t intern(const std::string &s) {
+        const auto string_and_offset(strings_to_offsets_map_.find(s));
+        if (string_and_offset != strings_to_offsets_map_.cend())
+            return string_and_offset->second;
+
+        if (unlikely(pool_.size() + s.length() > std::numeric_limits<uint32_t>::max()))
+            LOG_ERROR("string pool overflow!");
+        const uint32_t offset(pool_.size());
+        pool_ += s;
+        strings_to_offsets_map_.emplace(s, offset);
+        return offset;
+    }
+
+    inline const std::string &getPool() const { return pool_; }
+};
+
+
+template<typename EntryType> void AppendTable(const std::vector<EntryType> &entries, std::string * const store) {
+    store->append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(EntryType));
+}
+
+
+// Writes the store to a temporary file first so that concurrent readers never see a partially written store.
+bool WriteStore(const std::string &store_path, const std::string &store) {
+    const std::string temp_path(store_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(store) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, store_path, /* remove_target = */true);
+}
+
+
+} // unnamed namespace
+
+
+std::string AuthorityStore::Generate(Reader * const authority_reader) {
+    struct stat stat_buf;
+    StatOrDie(authority_reader->getPath(), &stat_buf);
+
+    std::unordered_map<std::string, off_t> ppns_to_offsets_map;
+    std::unordered_map<std::string, std::vector<std::string>> ppns_to_ddcs_map;
+    std::unordered_map<std::string, std::string> gnd_numbers_to_ppns_map;
+    std::unordered_map<std::string, NameData> names_to_name_data_map;
+
+    authority_reader->rewind();
+    off_t record_offset(authority_reader->tell());
+    while (const Record record = authority_reader->read()) {
+        const std::string &ppn(record.getControlNumber());
+        ppns_to_offsets_map[ppn] = record_offset;
+        record_offset = authority_reader->tell();
+
+        std::vector<std::string> ddcs;
+        ExtractDDCs(record, "083", &ddcs);
+        ExtractDDCs(record, "089", &ddcs);
+        if (not ddcs.empty())
+            ppns_to_ddcs_map[ppn] = std::move(ddcs);
+        else
+            ppns_to_ddcs_map.erase(ppn);
+
+        std::string gnd_number;
+        if (GetGNDCode(record, &gnd_number))
+            gnd_numbers_to_ppns_map[gnd_number] = ppn;
+
+        const auto primary_name_field(record.findTag("100"));
+        if (primary_name_field == record.end())
+            continue;
+        const std::string primary_name(AuthorityStore::GetPersonalName(*primary_name_field));
+        if (primary_name.empty() or names_to_name_data_map.find(primary_name) != names_to_name_data_map.end())
+            continue;
+
+        std::vector<std::string> synonyms;
+        for (const auto &synonym_field : record.getTagRange("400")) {
+            const std::string synonym(AuthorityStore::GetPersonalName(synonym_field));
+            if (not synonym.empty() and std::find(synonyms.cbegin(), synonyms.cend(), synonym) == synonyms.cend())
+                synonyms.emplace_back(synonym);
+        }
+        names_to_name_data_map.emplace(primary_name, NameData(ppn, std::move(synonyms)));
+    }
+    authority_reader->rewind();
+
+    StringPool string_pool;
+    const auto intern([&string_pool](const std::string &s) {
+        return StringRef{ string_pool.intern(s), static_cast<uint32_t>(s.length()) };
+    });
+
+    // DDC ids are the positions of the DDC's in the sorted list of all distinct DDC's:
+    std::vector<std::string> sorted_ddcs;
+    for (const auto &ppn_and_ddcs : ppns_to_ddcs_map)
+        sorted_ddcs.insert(sorted_ddcs.end(), ppn_and_ddcs.second.cbegin(), ppn_and_ddcs.second.cend());
+    std::sort(sorted_ddcs.begin(), sorted_ddcs.end());
+    sorted_ddcs.erase(std::unique(sorted_ddcs.begin(), sorted_ddcs.end()), sorted_ddcs.end());
+    std::vector<StringRef> ddcs;
+    ddcs.reserve(sorted_ddcs.size());
+    for (const auto &ddc : sorted_ddcs)
+        ddcs.emplace_back(intern(ddc));
+
+    std::vector<std::pair<std::string, off_t>> sorted_ppns(ppns_to_offsets_map.cbegin(), ppns_to_offsets_map.cend());
+    std::sort(sorted_ppns.begin(), sorted_ppns.end());
+    std::vector<PPNEntry> ppn_entries;
+    ppn_entries.reserve(sorted_ppns.size());
+    std::vector<uint32_t> ddc_ids;
+    for (const auto &ppn_and_offset : sorted_ppns) {
+        const uint32_t first_ddc_id(ddc_ids.size());
+        const auto ppn_and_ddcs(ppns_to_ddcs_map.find(ppn_and_offset.first));
+        if (ppn_and_ddcs != ppns_to_ddcs_map.cend()) {
+            for (const auto &ddc : ppn_and_ddcs->second) {
+                const auto sorted_ddc(std::lower_bound(sorted_ddcs.cbegin(), sorted_ddcs.cend(), ddc));
+                ddc_ids.emplace_back(sorted_ddc - sorted_ddcs.cbegin());
+            }
+            std::sort(ddc_ids.begin() + first_ddc_id, ddc_ids.end());
+            ddc_ids.erase(std::unique(ddc_ids.begin() + first_ddc_id, ddc_ids.end()), ddc_ids.end());
+        }
+        ppn_entries.emplace_back(PPNEntry{ intern(ppn_and_offset.first), static_cast<uint64_t>(ppn_and_offset.second),
+                                           first_ddc_id, static_cast<uint32_t>(ddc_ids.size() - first_ddc_id) });
+    }
+    const size_t ddc_id_count(ddc_ids.size());
+    ddc_ids.resize(GetPaddedDDCIdCount(ddc_id_count));
+
+    std::vector<std::pair<std::string, std::string>> sorted_gnd_numbers(gnd_numbers_to_ppns_map.cbegin(),
+                                                                        gnd_numbers_to_ppns_map.cend());
+    std::sort(sorted_gnd_numbers.begin(), sorted_gnd_numbers.end());
+    std::vector<GNDEntry> gnd_entries;
+    gnd_entries.reserve(sorted_gnd_numbers.size());
+    for (const auto &gnd_number_and_ppn : sorted_gnd_numbers)
+        gnd_entries.emplace_back(GNDEntry{ intern(gnd_number_and_ppn.first),
+                                               intern(gnd_number_and_ppn.second) });
+
+    std::vector<const std::pair<const std::string, NameData> *> sorted_names;
+    sorted_names.reserve(names_to_name_data_map.size());
+    for (const auto &name_and_name_data : names_to_name_data_map)
+        sorted_names.emplace_back(&name_and_name_data);
+    std::sort(sorted_names.begin(), sorted_names.end(),
+              [](const std::pair<const std::string, NameData> * const lhs,
+                 const std::pair<const std::string, NameData> * const rhs) { return lhs->first < rhs->first; });
+    std::vector<NameEntry> name_entries;
+    name_entries.reserve(sorted_names.size());
+    std::vector<StringRef> synonyms;
+    for (const auto name_and_name_data : sorted_names) {
+        name_entries.emplace_back(NameEntry{ intern(name_and_name_data->first),
+                                                 intern(name_and_name_data->second.ppn_),
+                                                 static_cast<uint32_t>(synonyms.size()),
+                                                 static_cast<uint32_t>(name_and_name_data->second.synonyms_.size()) });
+        for (const auto &synonym : name_and_name_data->second.synonyms_)
+            synonyms.emplace_back(intern(synonym));
+    }
+
+    StoreHeader header;
+    std::memcpy(header.magic_, STORE_MAGIC, sizeof STORE_MAGIC);
+    header.version_                     = STORE_VERSION;
+    header.authority_file_size_         = stat_buf.st_size;
+    header.authority_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.authority_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.ppn_entry_count_             = ppn_entries.size();
+    header.gnd_entry_count_             = gnd_entries.size();
+    header.name_entry_count_            = name_entries.size();
+    header.synonym_count_               = synonyms.size();
+    header.ddc_count_                   = ddcs.size();
+    header.ddc_id_count_                = ddc_id_count;
+    header.string_pool_size_            = string_pool.getPool().size();
+
+    std::string store(reinterpret_cast<const char *>(&header), sizeof header);
+    AppendTable(ppn_entries, &store);
+    AppendTable(gnd_entries, &store);
+    AppendTable(name_entries, &store);
+    AppendTable(synonyms, &store);
+    AppendTable(ddcs, &store);
+    AppendTable(ddc_ids, &store);
+    store += string_pool.getPool();
+
+    return store;
+}
+
+
+AuthorityStore::AuthorityStore(Reader * const authority_reader)
+    : store_path_(GetStorePath(authority_reader->getPath())), mmap_(nullptr), mmap_size_(0), ppn_entries_(nullptr),
+      ppn_entry_count_(0), gnd_entries_(nullptr), gnd_entry_count_(0), name_entries_(nullptr), name_entry_count_(0),
+      synonyms_(nullptr), ddcs_(nullptr), ddc_count_(0), ddc_ids_(nullptr), string_pool_(nullptr)
+{
+    if (mapStore(authority_reader->getPath()))
+        return;
+
+    in_memory_store_ = Generate(authority_reader);
+    if (not WriteStore(store_path_, in_memory_store_))
+        LOG_WARNING("failed to write \"" + store_path_ + "\", keeping the authority store in memory!");
+    else if (mapStore(authority_reader->getPath())) {
+        in_memory_store_.clear();
+        in_memory_store_.shrink_to_fit();
+        return;
+    }
+
+    setTables(in_memory_store_.data());
+}
+
+
+AuthorityStore::~AuthorityStore() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + store_path_ + "\" failed!");
+}
+
+
+bool AuthorityStore::findRecordOffset(const std::string &ppn, off_t * const offset) const {
+    const PPNEntry * const entry(findEntry(ppn_entries_, ppn_entry_count_, ppn));
+    if (entry == nullptr)
+        return false;
+
+    *offset = static_cast<off_t>(entry->record_offset_);
+    return true;
+}
+
+
+bool AuthorityStore::getRecord(const std::string &ppn, Reader * const authority_reader, Record * const authority_record) const {
+    off_t offset;
+    if (not findRecordOffset(ppn, &offset))
+        return false;
+
+    if (unlikely(not authority_reader->seek(offset)))
+        LOG_ERROR("failed to seek to the record w/ PPN " + ppn + " in \"" + authority_reader->getPath() + "\"!");
+    *authority_record = authority_reader->read();
+    if (unlikely(authority_record->getControlNumber() != ppn))
+        LOG_ERROR("expected PPN " + ppn + " but found " + authority_record->getControlNumber() + " in \""
+                  + authority_reader->getPath() + "\"! (Is \"" + store_path_ + "\" stale?)");
+
+    return true;
+}
+
+
+bool AuthorityStore::findPPNForGNDNumber(const std::string &gnd_number, std::string * const ppn) const {
+    const GNDEntry * const entry(findEntry(gnd_entries_, gnd_entry_count_, gnd_number));
+    if (entry == nullptr)
+        return false;
+
+    *ppn = getString(entry->ppn_).toString();
+    return true;
+}
+
+
+bool AuthorityStore::findPPNForPersonalName(const std::string &personal_name, std::string * const ppn) const {
+    const NameEntry * const entry(findEntry(name_entries_, name_entry_count_, personal_name));
+    if (entry == nullptr)
+        return false;
+
+    *ppn = getString(entry->ppn_).toString();
+    return true;
+}
+
+
+bool AuthorityStore::getSynonyms(const std::string &personal_name, std::vector<StringView> * const synonyms) const {
+    synonyms->clear();
+    const NameEntry * const entry(findEntry(name_entries_, name_entry_count_, personal_name));
+    if (entry == nullptr)
+        return false;
+
+    synonyms->reserve(entry->synonym_count_);
+    for (const StringRef *synonym(synonyms_ + entry->first_synonym_);
+         synonym != synonyms_ + entry->first_synonym_ + entry->synonym_count_; ++synonym)
+        synonyms->emplace_back(getString(*synonym));
+
+    return true;
+}
+
+
+size_t AuthorityStore::appendDDCIds(const std::string &ppn, std::vector<uint32_t> * const ddc_ids) const {
+    const PPNEntry * const entry(findEntry(ppn_entries_, ppn_entry_count_, ppn));
+    if (entry == nullptr)
+        return 0;
+
+    ddc_ids->insert(ddc_ids->end(), ddc_ids_ + entry->first_ddc_id_, ddc_ids_ + entry->first_ddc_id_ + entry->ddc_id_count_);
+    return entry->ddc_id_count_;
+}
+
+
+StringView AuthorityStore::getDDC(const uint32_t ddc_id) const {
+    return getString(ddcs_[ddc_id]);
+}
+
+
+bool AuthorityStore::IsUpToDate(const std::string &authority_path) {
+    File store(GetStorePath(authority_path), "r");
+    if (store.fail())
+        return false;
+
+    StoreHeader header;
+    if (store.read(&header, sizeof header) != sizeof header)
+        return false;
+
+    struct stat stat_buf;
+    StatOrDie(authority_path, &stat_buf);
+    return HeaderMatchesFile(header, stat_buf);
+}
+
+
+size_t AuthorityStore::Create(Reader * const authority_reader) {
+    const std::string store(Generate(authority_reader));
+    const std::string store_path(GetStorePath(authority_reader->getPath()));
+    if (unlikely(not WriteStore(store_path, store)))
+        LOG_ERROR("failed to write \"" + store_path + "\"!");
+
+    return reinterpret_cast<const StoreHeader *>(store.data())->ppn_entry_count_;
+}
+
+
+std::string AuthorityStore::GetPersonalName(const Record::Field &field) {
+    std::string name;
+    for (const auto &subfield : field.getSubfieldRange()) {
+        if (subfield.first < 'a' or subfield.first > 'd')
+            continue;
+        if (not name.empty())
+            name += ' ';
+        name.append(subfield.second.data(), subfield.second.size());
+    }
+
+    return name;
+}
+
+
+void AuthorityStore::ExtractDDCs(const Record &record, const Tag &tag, std::vector<std::string> * const ddcs) {
+    for (const auto &field : record.getTagRange(tag)) {
+        const size_t old_size(ddcs->size());
+        for (const auto &code_and_value : field.getSubfieldRange()) {
+            if (code_and_value.first == 'z') { // Auxiliary table number => not a regular DDC in $a!
+                ddcs->resize(old_size);
+                break;
+            }
+
+            const StringView &value(code_and_value.second);
+            if (code_and_value.first == 'a' and value.size() >= 3 and std::isdigit(static_cast<unsigned char>(value.data()[0]))
+                and std::isdigit(static_cast<unsigned char>(value.data()[1]))
+                and std::isdigit(static_cast<unsigned char>(value.data()[2])))
+                ddcs->emplace_back(value.toString());
+        }
+    }
+}
+
+
+bool AuthorityStore::mapStore(const std::string &authority_path) {
+    const int fd(::open(store_path_.c_str(), O_RDONLY));
+    if (fd == -1)
+        return false;
+
+    struct stat store_stat_buf;
+    if (unlikely(::fstat(fd, &store_stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + store_path_ + "\" failed!");
+    if (static_cast<size_t>(store_stat_buf.st_size) < sizeof(StoreHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * const mapping(::mmap(nullptr, store_stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + store_path_ + "\"!");
+
+    struct stat authority_stat_buf;
+    StatOrDie(authority_path, &authority_stat_buf);
+    const StoreHeader * const header(reinterpret_cast<const StoreHeader *>(mapping));
+    if (not HeaderMatchesFile(*header, authority_stat_buf)
+        or static_cast<size_t>(store_stat_buf.st_size)
+           != sizeof(StoreHeader) + GetTableSize<PPNEntry>(header->ppn_entry_count_)
+              + GetTableSize<GNDEntry>(header->gnd_entry_count_) + GetTableSize<NameEntry>(header->name_entry_count_)
+              + GetTableSize<StringRef>(header->synonym_count_) + GetTableSize<StringRef>(header->ddc_count_)
+              + GetTableSize<uint32_t>(GetPaddedDDCIdCount(header->ddc_id_count_)) + header->string_pool_size_)
+    {
+        ::munmap(mapping, store_stat_buf.st_size);
+        return false;
+    }
+
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = store_stat_buf.st_size;
+    setTables(mmap_);
+
+    return true;
+}
+
+
+void AuthorityStore::setTables(const char * const store_start) {
+    const StoreHeader * const header(reinterpret_cast<const StoreHeader *>(store_start));
+    const char *table_start(store_start + sizeof(StoreHeader));
+
+    ppn_entries_      = reinterpret_cast<const PPNEntry *>(table_start);
+    ppn_entry_count_  = header->ppn_entry_count_;
+    table_start      += GetTableSize<PPNEntry>(ppn_entry_count_);
+
+    gnd_entries_      = reinterpret_cast<const GNDEntry *>(table_start);
+    gnd_entry_count_  = header->gnd_entry_count_;
+    table_start      += GetTableSize<GNDEntry>(gnd_entry_count_);
+
+    name_entries_     = reinterpret_cast<const NameEntry *>(table_start);
+    name_entry_count_ = header->name_entry_count_;
+    table_start      += GetTableSize<NameEntry>(name_entry_count_);
+
+    synonyms_         = reinterpret_cast<const StringRef *>(table_start);
+    table_start      += GetTableSize<StringRef>(header->synonym_count_);
+
+    ddcs_             = reinterpret_cast<const StringRef *>(table_start);
+    ddc_count_        = header->ddc_count_;
+    table_start      += GetTableSize<StringRef>(ddc_count_);
+
+    ddc_ids_          = reinterpret_cast<const uint32_t *>(table_start);
+    table_start      += GetTableSize<uint32_t>(GetPaddedDDCIdCount(header->ddc_id_count_));
+
+    string_pool_      = table_start;
+}
+
+
+inline StringView AuthorityStore::getString(const StringRef &string_ref) const {
+    return StringView(string_pool_ + string_ref.offset_, string_ref.length_);
+}
+
+
+template<typename EntryType> const EntryType *AuthorityStore::findEntry(const EntryType * const entries,
+                                                                        const size_t entry_count,
+                                                                        const std::string &key) const
+{
+    size_t low(0), high(entry_count);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const int cmp(Compare(getString(entries[middle].getKey()), key));
+        if (cmp < 0)
+            low = middle + 1;
+        else if (cmp > 0)
+            high = middle;
+        else
+            return entries + middle;
+    }
+
+    return nullptr;
+}
+
+
+} // namespace MARC
@@ -0,0 +1,256 @@
+/** \brief A simple chunked, columnar file format for extracts of MARC records, e.g. PPN's, titles and authors.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcColumnFile.h"
+#include <algorithm>
+#include <cstring>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+const char COLUMN_FILE_MAGIC[8]{ 'U', 'B', 'M', 'A', 'R', 'C', 'C', 'F' };
+const uint64_t COLUMN_FILE_VERSION(1);
+
+
+// Like the other sidecar files we use the native byte order as column files are never moved between machines.
+template<typename Integer> void AppendInteger(const Integer value, std::string * const buffer) {
+    buffer->append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+
+void WriteOrDie(File * const output, const std::string &data) {
+    if (unlikely(output->write(data.data(), data.size()) != data.size()))
+        LOG_ERROR("failed to write " + std::to_string(data.size()) + " bytes to \"" + output->getPath() + "\"!");
+}
+
+
+} // unnamed namespace
+
+
+std::vector<std::string> ColumnFile::SplitValues(const std::string &column_value) {
+    std::vector<std::string> values;
+    if (column_value.empty())
+        return values;
+
+    size_t start(0);
+    for (;;) {
+        const size_t separator_pos(column_value.find(VALUE_SEPARATOR, start));
+        if (separator_pos == std::string::npos) {
+            values.emplace_back(column_value.substr(start));
+            return values;
+        }
+        values.emplace_back(column_value.substr(start, separator_pos - start));
+        start = separator_pos + 1;
+    }
+}
+
+
+constexpr size_t ColumnFileWriter::DEFAULT_CHUNK_SIZE;
+
+
+ColumnFileWriter::ColumnFileWriter(const std::string &path, const std::vector<std::string> &column_names,
+                                   const size_t chunk_size)
+    : path_(path), output_(FileUtil::OpenOutputFileOrDie(path + ".tmp")), chunk_size_(chunk_size),
+      column_count_(column_names.size()), rows_in_chunk_(0), column_blocks_(column_names.size())
+{
+    if (unlikely(column_names.empty()))
+        LOG_ERROR("we need at least one column!");
+    if (unlikely(chunk_size == 0))
+        LOG_ERROR("the chunk size must not be zero!");
+
+    std::string header(COLUMN_FILE_MAGIC, sizeof COLUMN_FILE_MAGIC);
+    AppendInteger(COLUMN_FILE_VERSION, &header);
+    AppendInteger(static_cast<uint64_t>(column_count_), &header);
+    for (const auto &column_name : column_names) {
+        AppendInteger(static_cast<uint64_t>(column_name.length()), &header);
+        header += column_name;
+    }
+    WriteOrDie(output_.get(), header);
+}
+
+
+void ColumnFileWriter::addRow(const std::vector<std::string> &column_values) {
+    if (unlikely(output_ == nullptr))
+        LOG_ERROR("can't add a row to \"" + path_ + "\" after it has been closed!");
+    if (unlikely(column_values.size() != column_count_))
+        LOG_ERROR("expected " + std::to_string(column_count_) + " column values, got " + std::to_string(column_values.size())
+                  + "!");
+
+    for (size_t column_index(0); column_index < column_count_; ++column_index) {
+        AppendInteger(static_cast<uint32_t>(column_values[column_index].length()), &column_blocks_[column_index]);
+        column_blocks_[column_index] += column_values[column_index];
+    }
+
+    if (++rows_in_chunk_ == chunk_size_)
+        flushChunk();
+}
+
+
+void ColumnFileWriter::close() {
+    if (output_ == nullptr)
+        return;
+
+    flushChunk();
+    if (unlikely(not output_->close()))
+        LOG_ERROR("failed to close \"" + output_->getPath() + "\"!");
+    output_.reset();
+    FileUtil::RenameFileOrDie(path_ + ".tmp", path_, /* remove_target = */true);
+}
+
+
+// A chunk consists of the row count, the byte sizes of the column blocks and the column blocks themselves.
+void ColumnFileWriter::flushChunk() {
+    if (rows_in_chunk_ == 0)
+        return;
+
+    std::string chunk_header;
+    AppendInteger(static_cast<uint64_t>(rows_in_chunk_), &chunk_header);
+    for (const auto &column_block : column_blocks_)
+        AppendInteger(static_cast<uint64_t>(column_block.size()), &chunk_header);
+    WriteOrDie(output_.get(), chunk_header);
+
+    for (auto &column_block : column_blocks_) {
+        WriteOrDie(output_.get(), column_block);
+        column_block.clear();
+    }
+    rows_in_chunk_ = 0;
+}
+
+
+ColumnFileReader::ColumnFileReader(const std::string &path, const std::vector<std::string> &selected_column_names)
+    : path_(path), input_(path, "r"), rows_left_in_chunk_(0)
+{
+    if (unlikely(input_.fail()))
+        LOG_ERROR("can't open \"" + path + "\" for reading!");
+
+    char magic[sizeof COLUMN_FILE_MAGIC];
+    readOrDie(magic, sizeof magic);
+    if (unlikely(std::memcmp(magic, COLUMN_FILE_MAGIC, sizeof magic) != 0))
+        LOG_ERROR("\"" + path + "\" is not a column file!");
+    uint64_t version;
+    readOrDie(&version, sizeof version);
+    if (unlikely(version != COLUMN_FILE_VERSION))
+        LOG_ERROR("\"" + path + "\" has unsupported version " + std::to_string(version) + "!");
+
+    uint64_t column_count;
+    readOrDie(&column_count, sizeof column_count);
+    for (uint64_t column_no(0); column_no < column_count; ++column_no) {
+        uint64_t name_length;
+        readOrDie(&name_length, sizeof name_length);
+        std::string column_name(name_length, '\0');
+        readOrDie(&column_name[0], name_length);
+        column_names_.emplace_back(column_name);
+    }
+
+    if (selected_column_names.empty()) {
+        for (size_t column_index(0); column_index < column_names_.size(); ++column_index)
+            selected_column_indices_.emplace_back(column_index);
+    } else {
+        for (const auto &selected_column_name : selected_column_names) {
+            const auto column_name(std::find(column_names_.cbegin(), column_names_.cend(), selected_column_name));
+            if (unlikely(column_name == column_names_.cend()))
+                LOG_ERROR("\"" + path + "\" has no column \"" + selected_column_name + "\"!");
+            selected_column_indices_.emplace_back(column_name - column_names_.cbegin());
+        }
+    }
+    selected_column_blocks_.resize(selected_column_indices_.size());
+    selected_column_block_offsets_.resize(selected_column_indices_.size());
+}
+
+
+bool ColumnFileReader::readRow(std::vector<std::string> * const column_values) {
+    if (rows_left_in_chunk_ == 0 and not readChunk())
+        return false;
+
+    column_values->resize(selected_column_indices_.size());
+    for (size_t selection_index(0); selection_index < selected_column_indices_.size(); ++selection_index) {
+        const std::string &column_block(selected_column_blocks_[selection_index]);
+        size_t &offset(selected_column_block_offsets_[selection_index]);
+        uint32_t value_length;
+        if (unlikely(offset + sizeof value_length > column_block.size()))
+            LOG_ERROR("corrupt column block in \"" + path_ + "\"!");
+        std::memcpy(&value_length, column_block.data() + offset, sizeof value_length);
+        offset += sizeof value_length;
+        if (unlikely(offset + value_length > column_block.size()))
+            LOG_ERROR("corrupt column block in \"" + path_ + "\"!");
+        (*column_values)[selection_index].assign(column_block, offset, value_length);
+        offset += value_length;
+    }
+
+    --rows_left_in_chunk_;
+    return true;
+}
+
+
+bool ColumnFileReader::IsColumnFile(const std::string &path) {
+    File input(path, "r");
+    char magic[sizeof COLUMN_FILE_MAGIC];
+    return not input.fail() and input.read(magic, sizeof magic) == sizeof magic
+           and std::memcmp(magic, COLUMN_FILE_MAGIC, sizeof magic) == 0;
+}
+
+
+// Only reads the blocks of the selected columns, the other blocks are skipped w/ a seek.
+bool ColumnFileReader::readChunk() {
+    uint64_t row_count;
+    if (input_.read(&row_count, sizeof row_count) != sizeof row_count)
+        return false;
+    if (unlikely(row_count == 0))
+        LOG_ERROR("empty chunk in \"" + path_ + "\"!");
+
+    std::vector<uint64_t> block_sizes(column_names_.size());
+    readOrDie(block_sizes.data(), block_sizes.size() * sizeof(uint64_t));
+
+    std::vector<off_t> block_offsets(column_names_.size());
+    off_t block_offset(input_.tell());
+    for (size_t column_index(0); column_index < column_names_.size(); ++column_index) {
+        block_offsets[column_index] = block_offset;
+        block_offset += block_sizes[column_index];
+    }
+
+    for (size_t selection_index(0); selection_index < selected_column_indices_.size(); ++selection_index) {
+        const size_t column_index(selected_column_indices_[selection_index]);
+        if (unlikely(not input_.seek(block_offsets[column_index])))
+            LOG_ERROR("failed to seek in \"" + path_ + "\"!");
+        std::string &column_block(selected_column_blocks_[selection_index]);
+        column_block.resize(block_sizes[column_index]);
+        readOrDie(&column_block[0], column_block.size());
+        selected_column_block_offsets_[selection_index] = 0;
+    }
+
+    if (unlikely(not input_.seek(block_offset)))
+        LOG_ERROR("failed to seek in \"" + path_ + "\"!");
+    rows_left_in_chunk_ = row_count;
+    return true;
+}
+
+
+void ColumnFileReader::readOrDie(void * const buf, const size_t size) {
+    if (unlikely(input_.read(buf, size) != size))
+        LOG_ERROR("unexpected end of \"" + path_ + "\"!");
+}
+
+
+} // namespace MARC
@@ -0,0 +1,149 @@
+/** \brief Implementation of the MARC::ControlNumberSet class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcControlNumberSet.h"
+#include "Compiler.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+// The finaliser of SplitMix64.  Packed PPN's are anything but random, so we need to mix the bits well.
+inline uint64_t Hash(uint64_t key) {
+    key = (key ^ (key >> 30u)) * UINT64_C(0xBF58476D1CE4E5B9);
+    key = (key ^ (key >> 27u)) * UINT64_C(0x94D049BB133111EB);
+    return key ^ (key >> 31u);
+}
+
+
+} // unnamed namespace
+
+
+constexpr uint64_t ControlNumberSet::EMPTY_SLOT;
+
+
+ControlNumberSet::ControlNumberSet(const bool store_values)
+    : store_values_(store_values), keys_(INITIAL_CAPACITY, EMPTY_SLOT), packed_count_(0)
+{
+    if (store_values_)
+        values_.resize(INITIAL_CAPACITY);
+}
+
+
+bool ControlNumberSet::insert(const std::string &control_number, const uint64_t value) {
+    uint64_t key;
+    if (unlikely(not Pack(control_number, &key)))
+        return unpackable_control_numbers_and_values_.emplace(control_number, store_values_ ? value : 0).second;
+
+    // We keep the load factor at or below 3/4:
+    if (4 * (packed_count_ + 1) > 3 * keys_.size())
+        grow();
+
+    const size_t slot(findSlot(key));
+    if (keys_[slot] == key)
+        return false;
+
+    keys_[slot] = key;
+    if (store_values_)
+        values_[slot] = value;
+    ++packed_count_;
+
+    return true;
+}
+
+
+bool ControlNumberSet::find(const std::string &control_number, uint64_t * const value) const {
+    uint64_t key;
+    if (unlikely(not Pack(control_number, &key))) {
+        const auto control_number_and_value(unpackable_control_numbers_and_values_.find(control_number));
+        if (control_number_and_value == unpackable_control_numbers_and_values_.cend())
+            return false;
+        if (value != nullptr)
+            *value = control_number_and_value->second;
+        return true;
+    }
+
+    const size_t slot(findSlot(key));
+    if (keys_[slot] != key)
+        return false;
+    if (value != nullptr)
+        *value = store_values_ ? values_[slot] : 0;
+
+    return true;
+}
+
+
+// We use base 13 w/ the digits 1 to 12.  As there is no zero digit, different control numbers, including those that
+// only differ in the number of leading zeroes, are mapped to different non-zero keys.  13^17 < 2^64.
+bool ControlNumberSet::Pack(const std::string &control_number, uint64_t * const key) {
+    if (control_number.empty() or control_number.length() > 17)
+        return false;
+
+    *key = 0;
+    for (const char ch : control_number) {
+        uint64_t digit;
+        if (ch >= '0' and ch <= '9')
+            digit = ch - '0' + 1;
+        else if (ch == 'X')
+            digit = 11;
+        else if (ch == '-') // Older GND numbers have a hyphen before the check digit.
+            digit = 12;
+        else
+            return false;
+        *key = *key * 13 + digit;
+    }
+
+    return true;
+}
+
+
+// \return The slot that contains "key" or the empty slot where "key" would have to be inserted.
+size_t ControlNumberSet::findSlot(const uint64_t key) const {
+    const size_t mask(keys_.size() - 1);
+    size_t slot(Hash(key) & mask);
+    while (keys_[slot] != EMPTY_SLOT and keys_[slot] != key)
+        slot = (slot + 1) & mask; // Linear probing.
+
+    return slot;
+}
+
+
+void ControlNumberSet::grow() {
+    std::vector<uint64_t> old_keys(keys_.size() * 2, EMPTY_SLOT);
+    old_keys.swap(keys_);
+    std::vector<uint64_t> old_values;
+    if (store_values_) {
+        old_values.resize(keys_.size());
+        old_values.swap(values_);
+    }
+
+    for (size_t old_slot(0); old_slot < old_keys.size(); ++old_slot) {
+        if (old_keys[old_slot] == EMPTY_SLOT)
+            continue;
+        const size_t new_slot(findSlot(old_keys[old_slot]));
+        keys_[new_slot] = old_keys[old_slot];
+        if (store_values_)
+            values_[new_slot] = old_values[old_slot];
+    }
+}
+
+
+} // namespace MARC
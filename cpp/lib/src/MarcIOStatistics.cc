@@ -0,0 +1,198 @@
+/** \brief Implementation of the MARC::IOStatistics class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcIOStatistics.h"
+#include <mutex>
+#include <set>
+#include <csignal>
+#include <cstdio>
+#include "Metrics.h"
+#include "MiscUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+constexpr unsigned IOStatistics::HISTOGRAM_BUCKET_COUNT;
+
+
+namespace {
+
+
+std::mutex live_instances_mutex;
+std::set<const IOStatistics *> live_instances;
+std::atomic<bool> report_requested(false);
+
+
+// Only sets a flag as logging is not async-signal-safe.  The report will be generated by the next call to add().
+void SigUsr1Handler(int /* signal_no */) {
+    report_requested.store(true, std::memory_order_relaxed);
+}
+
+
+// We don't want to replace a handler that the application installed itself.
+void InstallSigUsr1HandlerIfUnused() {
+    struct sigaction old_action;
+    if (unlikely(::sigaction(SIGUSR1, nullptr, &old_action) != 0))
+        LOG_ERROR("sigaction(2) failed!");
+    if (old_action.sa_handler != SIG_DFL or (old_action.sa_flags & SA_SIGINFO) != 0)
+        return;
+
+    struct sigaction new_action;
+    new_action.sa_handler = SigUsr1Handler;
+    sigemptyset(&new_action.sa_mask);
+    new_action.sa_flags = SA_RESTART; // We must not make the I/O of our readers and writers fail w/ EINTR.
+    if (unlikely(::sigaction(SIGUSR1, &new_action, nullptr) != 0))
+        LOG_ERROR("sigaction(2) failed!");
+}
+
+
+inline unsigned GetBucketIndex(const uint64_t nanoseconds) {
+    if (nanoseconds == 0)
+        return 0;
+    const unsigned index(63 - __builtin_clzll(nanoseconds));
+    return (index < IOStatistics::HISTOGRAM_BUCKET_COUNT) ? index : IOStatistics::HISTOGRAM_BUCKET_COUNT - 1;
+}
+
+
+std::string FormatFixed(const double n, const int decimals) {
+    char buf[64];
+    std::snprintf(buf, sizeof buf, "%.*f", decimals, n);
+    return buf;
+}
+
+
+std::string FormatNanoseconds(const uint64_t nanoseconds) {
+    if (nanoseconds < 1000)
+        return std::to_string(nanoseconds) + " ns";
+    if (nanoseconds < 1000000)
+        return FormatFixed(nanoseconds / 1.0e3, 2) + " µs";
+    if (nanoseconds < 1000000000)
+        return FormatFixed(nanoseconds / 1.0e6, 2) + " ms";
+    return FormatFixed(nanoseconds / 1.0e9, 2) + " s";
+}
+
+
+} // unnamed namespace
+
+
+IOStatistics::IOStatistics(const std::string &description)
+    : description_(description), creation_time_(std::chrono::steady_clock::now()), record_count_(0), byte_count_(0),
+      total_nanoseconds_(0)
+{
+    for (auto &bucket : histogram_)
+        bucket.store(0, std::memory_order_relaxed);
+
+    static std::once_flag handler_installed;
+    std::call_once(handler_installed, InstallSigUsr1HandlerIfUnused);
+
+    std::lock_guard<std::mutex> live_instances_lock(live_instances_mutex);
+    live_instances.emplace(this);
+}
+
+
+IOStatistics::~IOStatistics() {
+    {
+        std::lock_guard<std::mutex> live_instances_lock(live_instances_mutex);
+        live_instances.erase(this);
+    }
+    report();
+}
+
+
+void IOStatistics::add(const size_t byte_count, const std::chrono::steady_clock::duration elapsed_time) {
+    const uint64_t nanoseconds(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed_time).count());
+    Increment(&record_count_, 1);
+    Increment(&byte_count_, byte_count);
+    Increment(&total_nanoseconds_, nanoseconds);
+    Increment(&histogram_[GetBucketIndex(nanoseconds)], 1);
+
+    if (unlikely(report_requested.load(std::memory_order_relaxed)) and report_requested.exchange(false))
+        ReportAll();
+}
+
+
+void IOStatistics::report() const {
+    const uint64_t record_count(record_count_.load(std::memory_order_relaxed));
+    const uint64_t byte_count(byte_count_.load(std::memory_order_relaxed));
+    const double elapsed_seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - creation_time_).count());
+    const double mebibytes(byte_count / (1024.0 * 1024.0));
+
+    std::string message(description_ + ": " + std::to_string(record_count) + " record(s), "
+                        + FormatFixed(mebibytes, 2) + " MiB in " + FormatFixed(elapsed_seconds, 2)
+                        + " s");
+    if (elapsed_seconds > 0.0)
+        message += " (" + FormatFixed(mebibytes / elapsed_seconds, 2) + " MiB/s, "
+                   + FormatFixed(record_count / elapsed_seconds, 0) + " records/s)";
+    if (record_count > 0) {
+        const uint64_t total_nanoseconds(total_nanoseconds_.load(std::memory_order_relaxed));
+        message += ", time per record: mean " + FormatNanoseconds(total_nanoseconds / record_count)
+                   + ", p50 < " + FormatNanoseconds(getPercentile(50, record_count))
+                   + ", p90 < " + FormatNanoseconds(getPercentile(90, record_count))
+                   + ", p99 < " + FormatNanoseconds(getPercentile(99, record_count))
+                   + ", busy " + FormatNanoseconds(total_nanoseconds);
+    }
+
+    LOG_INFO(message);
+}
+
+
+bool IOStatistics::IsEnabled() {
+    static const bool enabled(MiscUtil::SafeGetEnv("MARC_IO_STATISTICS") == "true");
+    return enabled;
+}
+
+
+void IOStatistics::ReportAll() {
+    std::lock_guard<std::mutex> live_instances_lock(live_instances_mutex);
+    for (const auto live_instance : live_instances)
+        live_instance->report();
+}
+
+
+void IOStatistics::UpdateMetrics(const Direction direction, const size_t byte_count) {
+    static Metrics::Counter &records_read(Metrics::GetCounter("marc_records_read_total", "MARC records read"));
+    static Metrics::Counter &bytes_read(Metrics::GetCounter("marc_bytes_read_total", "Bytes of MARC records read"));
+    static Metrics::Counter &records_written(Metrics::GetCounter("marc_records_written_total", "MARC records written"));
+    static Metrics::Counter &bytes_written(Metrics::GetCounter("marc_bytes_written_total", "Bytes of MARC records written"));
+    if (direction == READ) {
+        records_read.increment();
+        bytes_read.increment(byte_count);
+    } else {
+        records_written.increment();
+        bytes_written.increment(byte_count);
+    }
+}
+
+
+// \return The upper bound of the histogram bucket that contains the "percentage"th percentile.
+uint64_t IOStatistics::getPercentile(const unsigned percentage, const uint64_t record_count) const {
+    const uint64_t threshold((record_count * percentage + 99) / 100);
+    uint64_t cumulative_count(0);
+    for (unsigned bucket_index(0); bucket_index < HISTOGRAM_BUCKET_COUNT; ++bucket_index) {
+        cumulative_count += histogram_[bucket_index].load(std::memory_order_relaxed);
+        if (cumulative_count >= threshold)
+            return uint64_t(1) << (bucket_index + 1);
+    }
+
+    return uint64_t(1) << HISTOGRAM_BUCKET_COUNT;
+}
+
+
+} // namespace MARC
@@ -0,0 +1,273 @@
+/** \brief Implementation of the MARC::OffsetIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcOffsetIndex.h"
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+const char INDEX_MAGIC[8]{ 'U', 'B', 'M', 'A', 'R', 'C', 'I', 'X' };
+const uint64_t INDEX_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.
+struct IndexHeader {
+    char magic_[sizeof INDEX_MAGIC];
+    uint64_t version_;
+    uint64_t marc_file_size_;
+    int64_t marc_mtime_seconds_;
+    int64_t marc_mtime_nanoseconds_;
+    uint64_t entry_count_;
+    uint64_t key_width_;
+public:
+    /** \note Each entry consists of a NUL-padded control number of "key_width_" bytes followed by a 64 bit offset. */
+    inline size_t getEntrySize() const { return key_width_ + sizeof(uint64_t); }
+};
+
+
+void StatOrDie(const std::string &path, struct stat * const stat_buf) {
+    if (unlikely(::stat(path.c_str(), stat_buf) != 0))
+        LOG_ERROR("stat(2) on \"" + path + "\" failed!");
+}
+
+
+inline bool HeaderMatchesFile(const IndexHeader &header, const struct stat &stat_buf) {
+    return std::memcmp(header.magic_, INDEX_MAGIC, sizeof INDEX_MAGIC) == 0 and header.version_ == INDEX_VERSION
+           and header.marc_file_size_ == static_cast<uint64_t>(stat_buf.st_size)
+           and header.marc_mtime_seconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_sec)
+           and header.marc_mtime_nanoseconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_nsec);
+}
+
+
+// \return the serialised index, header included.
+std::string GenerateIndex(Reader * const marc_reader) {
+    struct stat stat_buf;
+    StatOrDie(marc_reader->getPath(), &stat_buf);
+
+    marc_reader->rewind();
+    std::unordered_map<std::string, off_t> control_number_to_offset_map;
+    CollectRecordOffsets(marc_reader, &control_number_to_offset_map);
+    marc_reader->rewind();
+
+    std::vector<std::pair<std::string, off_t>> sorted_entries(control_number_to_offset_map.cbegin(),
+                                                              control_number_to_offset_map.cend());
+    std::sort(sorted_entries.begin(), sorted_entries.end());
+
+    IndexHeader header;
+    std::memcpy(header.magic_, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    header.version_                = INDEX_VERSION;
+    header.marc_file_size_         = stat_buf.st_size;
+    header.marc_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.marc_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.entry_count_            = sorted_entries.size();
+    header.key_width_              = 0;
+    for (const auto &entry : sorted_entries) {
+        if (entry.first.length() > header.key_width_)
+            header.key_width_ = entry.first.length();
+    }
+
+    std::string index(sizeof(IndexHeader) + header.entry_count_ * header.getEntrySize(), '\0');
+    std::memcpy(&index[0], &header, sizeof(IndexHeader));
+    char *entry(&index[0] + sizeof(IndexHeader));
+    for (const auto &control_number_and_offset : sorted_entries) {
+        std::memcpy(entry, control_number_and_offset.first.data(), control_number_and_offset.first.length());
+        const uint64_t offset(control_number_and_offset.second);
+        std::memcpy(entry + header.key_width_, &offset, sizeof offset);
+        entry += header.getEntrySize();
+    }
+
+    return index;
+}
+
+
+// Writes the index to a temporary file first so that concurrent readers never see a partially written index.
+bool WriteIndex(const std::string &index_path, const std::string &index) {
+    const std::string temp_path(index_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(index) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, index_path, /* remove_target = */true);
+}
+
+
+} // unnamed namespace
+
+
+OffsetIndex::OffsetIndex(Reader * const marc_reader)
+    : index_path_(GetIndexPath(marc_reader->getPath())), mmap_(nullptr), mmap_size_(0), entries_(nullptr),
+      entry_count_(0), key_width_(0)
+{
+    if (mapIndex(marc_reader->getPath()))
+        return;
+
+    in_memory_index_ = GenerateIndex(marc_reader);
+    if (not WriteIndex(index_path_, in_memory_index_))
+        LOG_WARNING("failed to write \"" + index_path_ + "\", keeping the index in memory!");
+    else if (mapIndex(marc_reader->getPath())) {
+        in_memory_index_.clear();
+        in_memory_index_.shrink_to_fit();
+        return;
+    }
+
+    setEntries(in_memory_index_.data());
+}
+
+
+OffsetIndex::~OffsetIndex() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + index_path_ + "\" failed!");
+}
+
+
+bool OffsetIndex::find(const std::string &control_number, off_t * const offset) const {
+    const char * const entry(findEntry(control_number));
+    if (entry == nullptr)
+        return false;
+
+    uint64_t raw_offset;
+    std::memcpy(&raw_offset, entry + key_width_, sizeof raw_offset);
+    *offset = static_cast<off_t>(raw_offset);
+    return true;
+}
+
+
+bool OffsetIndex::findOrdinal(const std::string &control_number, size_t * const ordinal) const {
+    const char * const entry(findEntry(control_number));
+    if (entry == nullptr)
+        return false;
+
+    *ordinal = (entry - entries_) / (key_width_ + sizeof(uint64_t));
+    return true;
+}
+
+
+bool OffsetIndex::IsUpToDate(const std::string &marc_path) {
+    File index(GetIndexPath(marc_path), "r");
+    if (index.fail())
+        return false;
+
+    IndexHeader header;
+    if (index.read(&header, sizeof header) != sizeof header)
+        return false;
+
+    struct stat stat_buf;
+    StatOrDie(marc_path, &stat_buf);
+    return HeaderMatchesFile(header, stat_buf);
+}
+
+
+size_t OffsetIndex::Create(Reader * const marc_reader) {
+    const std::string index(GenerateIndex(marc_reader));
+    const std::string index_path(GetIndexPath(marc_reader->getPath()));
+    if (unlikely(not WriteIndex(index_path, index)))
+        LOG_ERROR("failed to write \"" + index_path + "\"!");
+
+    return reinterpret_cast<const IndexHeader *>(index.data())->entry_count_;
+}
+
+
+bool OffsetIndex::mapIndex(const std::string &marc_path) {
+    const int fd(::open(index_path_.c_str(), O_RDONLY));
+    if (fd == -1)
+        return false;
+
+    struct stat index_stat_buf;
+    if (unlikely(::fstat(fd, &index_stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + index_path_ + "\" failed!");
+    if (static_cast<size_t>(index_stat_buf.st_size) < sizeof(IndexHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * const mapping(::mmap(nullptr, index_stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + index_path_ + "\"!");
+
+    struct stat marc_stat_buf;
+    StatOrDie(marc_path, &marc_stat_buf);
+    const IndexHeader * const header(reinterpret_cast<const IndexHeader *>(mapping));
+    if (not HeaderMatchesFile(*header, marc_stat_buf)
+        or static_cast<size_t>(index_stat_buf.st_size) != sizeof(IndexHeader) + header->entry_count_ * header->getEntrySize())
+    {
+        ::munmap(mapping, index_stat_buf.st_size);
+        return false;
+    }
+
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = index_stat_buf.st_size;
+    setEntries(mmap_);
+
+    return true;
+}
+
+
+const char *OffsetIndex::findEntry(const std::string &control_number) const {
+    if (unlikely(control_number.length() > key_width_))
+        return nullptr;
+
+    std::string padded_key(control_number);
+    padded_key.resize(key_width_, '\0');
+
+    const size_t entry_size(key_width_ + sizeof(uint64_t));
+    size_t low(0), high(entry_count_);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const char * const entry(entries_ + middle * entry_size);
+        const int cmp(std::memcmp(entry, padded_key.data(), key_width_));
+        if (cmp < 0)
+            low = middle + 1;
+        else if (cmp > 0)
+            high = middle;
+        else
+            return entry;
+    }
+
+    return nullptr;
+}
+
+
+void OffsetIndex::setEntries(const char * const index_start) {
+    const IndexHeader * const header(reinterpret_cast<const IndexHeader *>(index_start));
+    entry_count_ = header->entry_count_;
+    key_width_   = header->key_width_;
+    entries_     = index_start + sizeof(IndexHeader);
+}
+
+
+} // namespace MARC
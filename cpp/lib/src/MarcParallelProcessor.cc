@@ -0,0 +1,225 @@
+/** \brief Implementation of the MARC::ParallelProcessor class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcParallelProcessor.h"
+#include <thread>
+#include <vector>
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+thread_local size_t current_sequence_no;
+
+
+} // unnamed namespace
+
+
+ParallelProcessor::ParallelProcessor(Reader * const reader, Writer * const writer, const unsigned worker_count,
+                                     const size_t max_records_in_flight)
+    : reader_(reader), writer_(writer),
+      worker_count_(worker_count != 0 ? worker_count : std::max(1u, std::thread::hardware_concurrency())),
+      max_records_in_flight_(max_records_in_flight != 0 ? max_records_in_flight : 64 * worker_count_),
+      records_in_flight_(0), read_count_(0), input_exhausted_(false), aborted_(false)
+{
+}
+
+
+void ParallelProcessor::readerThread() {
+    try {
+        for (;;) {
+            Record record(reader_->read());
+
+            bool stop(false);
+            if (record and record_selector_ and not record_selector_(record, &stop) and not stop)
+                continue;
+
+            std::unique_lock<std::mutex> mutex_locker(mutex_);
+            if (not record or stop) {
+                input_exhausted_ = true;
+                mutex_locker.unlock();
+                work_available_.notify_all();
+                result_available_.notify_all();
+                return;
+            }
+
+            room_available_.wait(mutex_locker, [this]{ return records_in_flight_ < max_records_in_flight_ or aborted_; });
+            if (aborted_)
+                return;
+            work_queue_.emplace_back(read_count_++, std::move(record));
+            ++records_in_flight_;
+            mutex_locker.unlock();
+            work_available_.notify_one();
+        }
+    } catch (...) {
+        // We treat the failure like the end of our input so that the records that we already read will still be
+        // processed.  process() will then rethrow the exception.
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        if (not worker_exception_)
+            worker_exception_ = std::current_exception();
+        input_exhausted_ = true;
+        mutex_locker.unlock();
+        work_available_.notify_all();
+        result_available_.notify_all();
+    }
+}
+
+
+void ParallelProcessor::workerThread(const RecordProcessor &record_processor) {
+    for (;;) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        work_available_.wait(mutex_locker, [this]{ return not work_queue_.empty() or input_exhausted_ or aborted_; });
+        if (work_queue_.empty() or aborted_)
+            return;
+
+        const size_t sequence_no(work_queue_.front().first);
+        Record record(std::move(work_queue_.front().second));
+        work_queue_.pop_front();
+        mutex_locker.unlock();
+
+        bool keep(false);
+        try {
+            current_sequence_no = sequence_no;
+            keep = record_processor(&record);
+        } catch (...) {
+            mutex_locker.lock();
+            if (not worker_exception_)
+                worker_exception_ = std::current_exception();
+            mutex_locker.unlock();
+        }
+
+        mutex_locker.lock();
+        results_.emplace(std::piecewise_construct, std::forward_as_tuple(sequence_no),
+                         std::forward_as_tuple(keep, std::move(record)));
+        mutex_locker.unlock();
+        result_available_.notify_one();
+    }
+}
+
+
+size_t ParallelProcessor::process(const RecordProcessor &record_processor) {
+    return process(record_processor, [this](const Record &record) {
+        if (writer_ != nullptr)
+            writer_->write(record);
+    });
+}
+
+
+size_t ParallelProcessor::process(const RecordProcessor &record_processor, const RecordConsumer &record_consumer) {
+    records_in_flight_ = read_count_ = 0;
+    input_exhausted_ = aborted_ = false;
+    worker_exception_ = nullptr;
+    work_queue_.clear();
+    results_.clear();
+
+    // Destroying joinable threads would terminate us, so if the record consumer or our writer throws, we have to stop and
+    // join all threads before we let the exception propagate.
+    class ThreadJoiner {
+        ParallelProcessor * const processor_;
+        std::thread * const reader_thread_;
+        std::vector<std::thread> * const worker_threads_;
+    public:
+        ThreadJoiner(ParallelProcessor * const processor, std::thread * const reader_thread,
+                     std::vector<std::thread> * const worker_threads)
+            : processor_(processor), reader_thread_(reader_thread), worker_threads_(worker_threads) { }
+        ~ThreadJoiner() {
+            std::unique_lock<std::mutex> mutex_locker(processor_->mutex_);
+            processor_->aborted_ = true;
+            mutex_locker.unlock();
+            processor_->work_available_.notify_all();
+            processor_->room_available_.notify_all();
+
+            if (reader_thread_->joinable())
+                reader_thread_->join();
+            for (auto &worker_thread : *worker_threads_) {
+                if (worker_thread.joinable())
+                    worker_thread.join();
+            }
+        }
+    };
+
+    // Verbose record processors would otherwise serialise our workers on the logger's mutex and write(2) calls.  This has
+    // to outlive "thread_joiner" so that the workers' last messages get flushed.
+    class AsynchronousLogging {
+        const bool enabled_by_us_;
+    public:
+        AsynchronousLogging(): enabled_by_us_(not logger->isAsynchronous()) {
+            if (enabled_by_us_)
+                logger->enableAsynchronousMode();
+        }
+        ~AsynchronousLogging() {
+            if (enabled_by_us_)
+                logger->disableAsynchronousMode();
+        }
+    } asynchronous_logging;
+
+    std::thread reader_thread;
+    std::vector<std::thread> worker_threads;
+    ThreadJoiner thread_joiner(this, &reader_thread, &worker_threads);
+    reader_thread = std::thread(&ParallelProcessor::readerThread, this);
+    worker_threads.reserve(worker_count_);
+    for (unsigned i(0); i < worker_count_; ++i)
+        worker_threads.emplace_back(&ParallelProcessor::workerThread, this, std::cref(record_processor));
+
+    // We act as the writer and emit the processed records in their original order:
+    size_t next_sequence_no(0);
+    for (;;) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        result_available_.wait(mutex_locker, [this, next_sequence_no]{
+            return results_.find(next_sequence_no) != results_.end() or (input_exhausted_ and next_sequence_no == read_count_);
+        });
+
+        const auto sequence_no_and_result(results_.find(next_sequence_no));
+        if (sequence_no_and_result == results_.end())
+            break; // We're done!
+
+        const bool keep(sequence_no_and_result->second.first);
+        Record record(std::move(sequence_no_and_result->second.second));
+        results_.erase(sequence_no_and_result);
+        --records_in_flight_;
+        mutex_locker.unlock();
+        room_available_.notify_one();
+
+        if (keep) {
+            current_sequence_no = next_sequence_no;
+            record_consumer(record);
+        }
+        ++next_sequence_no;
+    }
+
+    reader_thread.join();
+    for (auto &worker_thread : worker_threads)
+        worker_thread.join();
+
+    if (worker_exception_)
+        std::rethrow_exception(worker_exception_);
+
+    return read_count_;
+}
+
+
+size_t ParallelProcessor::GetCurrentSequenceNo() {
+    return current_sequence_no;
+}
+
+
+} // namespace MARC
@@ -0,0 +1,160 @@
+/** \brief Implementation of the MARC::Pipeline class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcPipeline.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+// Connects two pipeline threads.  Once closed, consumers drain the remaining records.  Once aborted, which happens if
+// any of the threads failed, both ends give up immediately.
+class RecordQueue {
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+    std::deque<Record> records_;
+    bool closed_, aborted_;
+public:
+    explicit RecordQueue(const size_t capacity): capacity_(capacity), closed_(false), aborted_(false) { }
+
+    // \return False if the queue has been aborted.
+    bool push(Record &&record) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        not_full_.wait(mutex_locker, [this]{ return records_.size() < capacity_ or aborted_; });
+        if (aborted_)
+            return false;
+        records_.emplace_back(std::move(record));
+        mutex_locker.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // \return False if the queue has been closed and drained or if it has been aborted.
+    bool pop(Record * const record) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        not_empty_.wait(mutex_locker, [this]{ return not records_.empty() or closed_ or aborted_; });
+        if (records_.empty() or aborted_)
+            return false;
+        *record = std::move(records_.front());
+        records_.pop_front();
+        mutex_locker.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        closed_ = true;
+        mutex_locker.unlock();
+        not_empty_.notify_all();
+    }
+
+    void abort() {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        aborted_ = true;
+        mutex_locker.unlock();
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+};
+
+
+} // unnamed namespace
+
+
+size_t Pipeline::run(Reader * const reader, Writer * const writer) {
+    // queues[i] feeds stages_[i] and the last queue feeds our writer.
+    std::vector<std::unique_ptr<RecordQueue>> queues;
+    for (size_t i(0); i <= stages_.size(); ++i)
+        queues.emplace_back(new RecordQueue(queue_capacity_));
+
+    std::mutex exception_mutex;
+    std::exception_ptr first_exception;
+    const auto abort_all([&queues, &exception_mutex, &first_exception]() {
+        std::lock_guard<std::mutex> mutex_locker(exception_mutex);
+        if (not first_exception)
+            first_exception = std::current_exception();
+        for (auto &queue : queues)
+            queue->abort();
+    });
+
+    size_t read_count(0);
+    std::vector<std::thread> threads;
+    threads.emplace_back([reader, &queues, &read_count, &abort_all]() {
+        try {
+            while (Record record = reader->read()) {
+                ++read_count;
+                if (not queues.front()->push(std::move(record)))
+                    return;
+            }
+            queues.front()->close();
+        } catch (...) {
+            abort_all();
+        }
+    });
+
+    for (size_t stage_no(0); stage_no < stages_.size(); ++stage_no) {
+        threads.emplace_back([this, stage_no, &queues, &abort_all]() {
+            try {
+                PipelineStage * const stage(stages_[stage_no].get());
+                RecordQueue * const input_queue(queues[stage_no].get()), * const output_queue(queues[stage_no + 1].get());
+                Record record(std::string(Record::LEADER_LENGTH, ' '));
+                while (input_queue->pop(&record)) {
+                    if (stage->processRecord(&record) and not output_queue->push(std::move(record)))
+                        return;
+                }
+                stage->finish();
+                output_queue->close();
+            } catch (...) {
+                abort_all();
+            }
+        });
+    }
+
+    // We act as the writer:
+    try {
+        Record record(std::string(Record::LEADER_LENGTH, ' '));
+        while (queues.back()->pop(&record)) {
+            if (writer != nullptr)
+                writer->write(record);
+        }
+    } catch (...) {
+        abort_all();
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    if (first_exception)
+        std::rethrow_exception(first_exception);
+
+    return read_count;
+}
+
+
+} // namespace MARC
@@ -0,0 +1,908 @@
+/** \brief The record processing stages that can be chained w/ MARC::Pipeline.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcPipeline.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <cctype>
+#include "IniFile.h"
+#include "MarcAuthorityStore.h"
+#include "MarcColumnFile.h"
+#include "PerfectHash.h"
+#include "StringUtil.h"
+#include "StringView.h"
+#include "TextUtil.h"
+#include "UBTools.h"
+#include "UrlUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+// The per-record logic of flag_electronic_and_open_access_records.
+class FlagElectronicAndOpenAccessRecordsStage final : public PipelineStage {
+    unsigned record_count_, flagged_as_electronic_count_, flagged_as_open_access_count_;
+public:
+    explicit FlagElectronicAndOpenAccessRecordsStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+};
+
+
+FlagElectronicAndOpenAccessRecordsStage::FlagElectronicAndOpenAccessRecordsStage(const std::vector<std::string> &arguments)
+    : PipelineStage("flag_electronic_and_open_access_records"), record_count_(0), flagged_as_electronic_count_(0),
+      flagged_as_open_access_count_(0)
+{
+    if (not arguments.empty())
+        LOG_ERROR("the " + getName() + " stage takes no arguments!");
+}
+
+
+bool FlagElectronicAndOpenAccessRecordsStage::processRecord(Record * const record) {
+    ++record_count_;
+
+    if (record->getFirstField("ELC") == record->end()) {
+        Subfields subfields;
+        if (record->isElectronicResource())
+            subfields.appendSubfield('a', "1");
+        if (record->isPrintResource())
+            subfields.appendSubfield('b', "1");
+        if (not subfields.empty()) {
+            ++flagged_as_electronic_count_;
+            record->insertField("ELC", subfields);
+        }
+    }
+
+    if (record->getFirstField("OAS") == record->end()) {
+        Subfields subfields;
+        if (IsOpenAccess(*record)) {
+            subfields.appendSubfield('a', "1");
+            ++flagged_as_open_access_count_;
+            record->insertField("OAS", subfields);
+        }
+    }
+
+    return true;
+}
+
+
+void FlagElectronicAndOpenAccessRecordsStage::finish() {
+    LOG_INFO("Processed " + std::to_string(record_count_) + " MARC record(s).");
+    LOG_INFO("Flagged " + std::to_string(flagged_as_electronic_count_) + " record(s) as electronic resource(s).");
+    LOG_INFO("Flagged " + std::to_string(flagged_as_open_access_count_) + " record(s) as open-access resource(s).");
+}
+
+
+inline bool IsHttpOrHttpsURL(const std::string &url_candidate) {
+    return StringUtil::StartsWith(url_candidate, "http://") or StringUtil::StartsWith(url_candidate, "https://");
+}
+
+
+inline StringView StripSchema(const std::string &url) {
+    const auto colon_and_double_slash_start(url.find("://"));
+    return (colon_and_double_slash_start == std::string::npos) ? StringView(url)
+                                                               : StringView(url).substr(colon_and_double_slash_start + 3);
+}
+
+
+// Keeps track of the links of a single record.  All links are expected to have been normalised w/
+// UrlUtil::NormaliseUrlPrefix().  We keep the links' schema-stripped forms around so that we don't have to recompute them
+// for each comparison.  The stripped forms reference the strings in "links_" which is safe as rehashing an unordered set
+// never moves its elements.
+class SeenLinks {
+    std::unordered_set<std::string> links_;
+    std::vector<std::pair<bool, StringView>> is_http_or_https_and_stripped_links_;
+public:
+    inline bool contains(const std::string &link) const { return links_.find(link) != links_.cend(); }
+    void insert(const std::string &link);
+
+    // Returns true if "test_string" is the suffix of any of the links after stripping off the schema or vice versa.  For
+    // each pair compared, at least one of the two has to be an HTTP or HTTPS URL.
+    bool isSuffixOfAnyLink(const std::string &test_string) const;
+};
+
+
+void SeenLinks::insert(const std::string &link) {
+    const auto link_and_inserted(links_.emplace(link));
+    if (link_and_inserted.second)
+        is_http_or_https_and_stripped_links_.emplace_back(IsHttpOrHttpsURL(*link_and_inserted.first),
+                                                          StripSchema(*link_and_inserted.first));
+}
+
+
+bool SeenLinks::isSuffixOfAnyLink(const std::string &test_string) const {
+    const bool test_string_is_http_or_https(IsHttpOrHttpsURL(test_string));
+    const StringView stripped_test_string(StripSchema(test_string));
+    for (const auto &is_http_or_https_and_stripped_link : is_http_or_https_and_stripped_links_) {
+        if (not is_http_or_https_and_stripped_link.first and not test_string_is_http_or_https)
+            continue;
+        const StringView &stripped_link(is_http_or_https_and_stripped_link.second);
+        if (stripped_link.endsWith(stripped_test_string) or stripped_test_string.endsWith(stripped_link))
+            return true;
+    }
+
+    return false;
+}
+
+
+bool CreateUrlsFrom024(Record * const record) {
+    std::vector<std::string> _024_dois;
+    for (const auto &_024_field : record->getTagRange("024")) {
+        if (_024_field.getFirstSubfieldWithCode('2') == "doi") {
+            const std::string doi(_024_field.getFirstSubfieldWithCode('a'));
+            if (not doi.empty())
+                _024_dois.emplace_back(doi);
+        }
+    }
+
+    for (const auto &_024_doi : _024_dois)
+        record->insertFieldAtEnd("856", { { 'u', "https://doi.org/" + _024_doi }, { 'x', "doi" } });
+
+    return not _024_dois.empty();
+}
+
+
+// The per-record logic of normalise_urls.
+class NormaliseURLsStage final : public PipelineStage {
+    bool verbose_;
+    unsigned count_, modified_count_, duplicate_skip_count_;
+public:
+    explicit NormaliseURLsStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+};
+
+
+NormaliseURLsStage::NormaliseURLsStage(const std::vector<std::string> &arguments)
+    : PipelineStage("normalise_urls"), verbose_(false), count_(0), modified_count_(0), duplicate_skip_count_(0)
+{
+    if (arguments.size() == 1 and (arguments[0] == "-v" or arguments[0] == "--verbose"))
+        verbose_ = true;
+    else if (not arguments.empty())
+        LOG_ERROR("the only argument that the " + getName() + " stage accepts is --verbose!");
+}
+
+
+bool NormaliseURLsStage::processRecord(Record * const record) {
+    ++count_;
+
+    bool modified_record(false);
+    if (CreateUrlsFrom024(record))
+        modified_record = true;
+
+    SeenLinks already_seen_links;
+
+    auto _856_field(record->findTag("856"));
+    while (_856_field != record->end() and _856_field->getTag() == "856") {
+        Subfields _856_subfields(_856_field->getSubfields());
+        bool duplicate_link(false);
+        if (_856_subfields.hasSubfield('u')) {
+            const std::string u_subfield(StringUtil::Trim(_856_subfields.getFirstSubfieldWithCode('u')));
+            const std::string normalised_link(UrlUtil::NormaliseUrlPrefix(u_subfield));
+            if (already_seen_links.contains(normalised_link)) {
+                if (verbose_)
+                    std::cout << "Found duplicate URL \"" << u_subfield << "\".\n";
+                duplicate_link = true;
+            } else if (already_seen_links.isSuffixOfAnyLink(normalised_link)) {
+                if (verbose_)
+                    std::cout << "Dropped field w/ duplicate URL suffix. (" << u_subfield << ")\n";
+                duplicate_link = true;
+                already_seen_links.insert(normalised_link);
+            } else if (IsHttpOrHttpsURL(normalised_link))
+                already_seen_links.insert(normalised_link);
+            else {
+                std::string new_http_replacement_link;
+                if (StringUtil::StartsWith(u_subfield, "urn:"))
+                    new_http_replacement_link = "https://nbn-resolving.org/" + u_subfield;
+                else if (StringUtil::StartsWith(u_subfield, "10900/"))
+                    new_http_replacement_link = "https://publikationen.uni-tuebingen.de/xmlui/handle/" + u_subfield;
+                else
+                    new_http_replacement_link = "http://" + u_subfield;
+                const std::string normalised_replacement_link(UrlUtil::NormaliseUrlPrefix(new_http_replacement_link));
+                if (not already_seen_links.contains(normalised_replacement_link)) {
+                    _856_subfields.replaceFirstSubfield('u', new_http_replacement_link);
+                    if (verbose_)
+                        std::cout << "Replaced \"" << u_subfield << "\" with \"" << new_http_replacement_link
+                                  << "\". (PPN: " << record->getControlNumber() << ")\n";
+                    already_seen_links.insert(normalised_replacement_link);
+                    modified_record = true;
+                } else
+                    duplicate_link = true;
+            }
+        }
+
+        if (not duplicate_link)
+            ++_856_field;
+        else {
+            ++duplicate_skip_count_;
+            if (verbose_)
+                std::cout << "Skipping duplicate, control numbers is " << record->getControlNumber() << ".\n";
+            _856_field = record->erase(_856_field);
+            modified_record = true;
+        }
+    }
+
+    if (modified_record)
+        ++modified_count_;
+
+    return true;
+}
+
+
+void NormaliseURLsStage::finish() {
+    LOG_INFO("Read " + std::to_string(count_) + " records.");
+    LOG_INFO("Modified " + std::to_string(modified_count_) + " record(s).");
+    LOG_INFO("Skipped " + std::to_string(duplicate_skip_count_) + " duplicate links.");
+}
+
+
+inline StringView TrimSpaces(StringView s) {
+    while (not s.empty() and s.front() == ' ')
+        s = s.substr(1);
+    while (not s.empty() and s.back() == ' ')
+        s = s.substr(0, s.size() - 1);
+    return s;
+}
+
+
+const size_t LANGUAGE_CODE_LENGTH(3);
+
+
+// Canonical language codes are mapped to themselves and variants to their canonical codes.
+PerfectHash::StringMap<std::string> LoadLanguageCodeMap() {
+    const IniFile config(UBTools::GetTuelibPath() + "normalise_and_deduplicate_language.conf");
+
+    std::vector<std::string> canonical_codes;
+    StringUtil::Split(config.getString("", "canonical_language_codes"), ',', &canonical_codes);
+    if (canonical_codes.empty())
+        LOG_ERROR("couldn't read canonical language codes from \"" + config.getFilename() + "\"!");
+
+    std::unordered_map<std::string, std::string> codes_to_canonical_codes_map;
+    for (const auto &canonical_code : canonical_codes) {
+        if (unlikely(canonical_code.length() != LANGUAGE_CODE_LENGTH))
+            LOG_ERROR("invalid length for language code \"" + canonical_code + "\"!");
+        if (not codes_to_canonical_codes_map.emplace(canonical_code, canonical_code).second)
+            LOG_WARNING("duplicate canonical language code \"" + canonical_code + "\"!");
+    }
+
+    const std::string OVERRIDES_SECTION("Overrides");
+    for (const auto &variant : config.getSectionEntryNames(OVERRIDES_SECTION)) {
+        const std::string canonical_code(config.getString(OVERRIDES_SECTION, variant));
+        if (unlikely(variant.length() != LANGUAGE_CODE_LENGTH))
+            LOG_ERROR("invalid length for language code \"" + variant + "\"!");
+        const auto code_and_canonical_code(codes_to_canonical_codes_map.find(canonical_code));
+        if (unlikely(code_and_canonical_code == codes_to_canonical_codes_map.cend()
+                     or code_and_canonical_code->second != canonical_code))
+            LOG_ERROR("unknown canonical language code \"" + canonical_code + "\" for variant \"" + variant + "\"!");
+
+        // Canonical codes take precedence over variants w/ the same name.
+        codes_to_canonical_codes_map.emplace(variant, canonical_code);
+    }
+
+    return PerfectHash::StringMap<std::string>(std::vector<std::pair<std::string, std::string>>(
+        codes_to_canonical_codes_map.cbegin(), codes_to_canonical_codes_map.cend()));
+}
+
+
+// The per-record logic of normalise_and_deduplicate_language.  Normalises the language codes in 008/35-37 and in the
+// first 041 field and removes duplicate codes from the latter.  If there is no 041 field, it is created from 008.
+class NormaliseAndDeduplicateLanguageStage final : public PipelineStage {
+    const PerfectHash::StringMap<std::string> codes_to_canonical_codes_map_;
+    unsigned count_, modified_count_;
+
+    // These are only members so that we can reuse their memory across records:
+    std::string new_contents_;
+    std::vector<StringView> kept_codes_;
+public:
+    explicit NormaliseAndDeduplicateLanguageStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+private:
+    // \return True if we modified "_041_field", else false.
+    bool normaliseAndDeduplicate041(const Record &record, Record::Field * const _041_field);
+};
+
+
+NormaliseAndDeduplicateLanguageStage::NormaliseAndDeduplicateLanguageStage(const std::vector<std::string> &arguments)
+    : PipelineStage("normalise_and_deduplicate_language"), codes_to_canonical_codes_map_(LoadLanguageCodeMap()), count_(0),
+      modified_count_(0)
+{
+    if (not arguments.empty())
+        LOG_ERROR("the " + getName() + " stage takes no arguments!");
+}
+
+
+bool NormaliseAndDeduplicateLanguageStage::processRecord(Record * const record) {
+    ++count_;
+    bool modified_record(false);
+
+    std::string language_code_008;
+    const auto _008_field(record->findTag("008"));
+    if (_008_field != record->end()) {
+        const std::string &_008_contents(static_cast<const Record::Field &>(*_008_field).getContents());
+        const StringView language_code(_008_contents.length() > 35 ? TrimSpaces(StringView(_008_contents).substr(35, 3))
+                                                                   : StringView());
+        if (not language_code.empty() and language_code != "|||") {
+            const std::string * const canonical_code(codes_to_canonical_codes_map_.find(language_code));
+            if (canonical_code == nullptr) {
+                LOG_WARNING("Record '" + record->getControlNumber() + "': unknown language code variant '"
+                            + language_code.toString() + "' in control field 008");
+                language_code_008 = language_code.toString();
+            } else if (language_code != *canonical_code) {
+                LOG_INFO("Record '" + record->getControlNumber() + "': normalised control field 008 language code: '"
+                         + language_code.toString() + "' => '" + *canonical_code + "'");
+                new_contents_ = _008_contents;
+                new_contents_.replace(35, 3, *canonical_code);
+                _008_field->setContents(new_contents_);
+                language_code_008 = *canonical_code;
+                modified_record = true;
+            } else
+                language_code_008 = *canonical_code;
+        }
+    }
+
+    const auto _041_field(record->findTag("041"));
+    if (_041_field != record->end()) {
+        if (normaliseAndDeduplicate041(*record, &*_041_field))
+            modified_record = true;
+    } else if (not language_code_008.empty()) {
+        LOG_INFO("Record '" + record->getControlNumber() + "': copying language code '" + language_code_008
+                 + "' from 008 => 041");
+        record->insertField("041", { { 'a', language_code_008 } });
+        modified_record = true;
+    }
+
+    if (modified_record)
+        ++modified_count_;
+
+    return true;
+}
+
+
+// Codes are compared after normalisation, so that a variant and its canonical code count as duplicates.  As there are
+// only a handful of codes per field, a linear search through the codes that we kept beats any set.
+bool NormaliseAndDeduplicateLanguageStage::normaliseAndDeduplicate041(const Record &record, Record::Field * const _041_field) {
+    const std::string &contents(static_cast<const Record::Field &>(*_041_field).getContents());
+    new_contents_.assign(contents, 0, 2 /* indicators */);
+    kept_codes_.clear();
+
+    bool modified_field(false);
+    for (const auto code_and_value : SubfieldRange(contents)) {
+        StringView language_code(code_and_value.second);
+        const std::string * const canonical_code(codes_to_canonical_codes_map_.find(language_code));
+        if (canonical_code == nullptr)
+            LOG_WARNING("Record '" + record.getControlNumber() + "': unknown language code variant '"
+                        + language_code.toString() + "' in subfield 041$" + std::string(1, code_and_value.first));
+        else if (language_code != *canonical_code) {
+            LOG_INFO("Record '" + record.getControlNumber() + "': normalised subfield 041$" + std::string(1, code_and_value.first)
+                     + " language code: '" + language_code.toString() + "' => '" + *canonical_code + "'");
+            language_code = *canonical_code;
+            modified_field = true;
+        }
+
+        if (std::find(kept_codes_.cbegin(), kept_codes_.cend(), language_code) != kept_codes_.cend()) {
+            LOG_INFO("Record '" + record.getControlNumber() + "': removing duplicate subfield entry 041$"
+                     + std::string(1, code_and_value.first) + " '" + language_code.toString() + "'");
+            modified_field = true;
+            continue;
+        }
+
+        kept_codes_.emplace_back(language_code);
+        new_contents_ += '\x1F';
+        new_contents_ += code_and_value.first;
+        new_contents_.append(language_code.data(), language_code.size());
+    }
+
+    if (modified_field)
+        _041_field->setContents(new_contents_);
+    return modified_field;
+}
+
+
+void NormaliseAndDeduplicateLanguageStage::finish() {
+    LOG_INFO("Processed " + std::to_string(count_) + " record(s) and modified " + std::to_string(modified_count_)
+             + " record(s).");
+}
+
+
+// Appends "subfield_contents" in lowercase and w/ collapsed and trimmed whitespace to "s".  This is equivalent to
+// TextUtil::UTF8ToLower() followed by TextUtil::CollapseAndTrimWhitespace() but avoids all temporary strings for the
+// common case of pure ASCII contents.
+void AppendNormalisedSubfieldContents(const StringView &subfield_contents, std::string * const s) {
+    if (unlikely(not std::all_of(subfield_contents.begin(), subfield_contents.end(), TextUtil::IsASCIIChar))) {
+        std::string normalised_contents(subfield_contents.toString());
+        TextUtil::UTF8ToLower(&normalised_contents);
+        s->append(TextUtil::CollapseAndTrimWhitespace(&normalised_contents));
+        return;
+    }
+
+    const size_t initial_size(s->size());
+    bool last_char_was_whitespace(true);
+    for (const char ch : subfield_contents) {
+        if (std::isspace(ch)) {
+            if (not last_char_was_whitespace) {
+                last_char_was_whitespace = true;
+                *s += ' ';
+            }
+        } else {
+            last_char_was_whitespace = false;
+            *s += static_cast<char>(std::tolower(ch));
+        }
+    }
+
+    if (s->size() > initial_size and s->back() == ' ')
+        s->resize(s->size() - 1);
+}
+
+
+typedef std::pair<Tag, char> TagAndSubfieldCode;
+
+
+// The structure of the config file is as follows:
+// In the gobal section at the top there must be one or more string entries which have values that consist of colon-separated
+// subfield references, e.g.
+//              authors    = "100a:700a:710a"
+//              publishers = "400d:422d"
+//
+// The named sections have the following structure:
+//   The name of the section itself is the canonical name, i.e. what we want to use to replace the variants.
+//   There must be one entry named "subfields" whose value is one of the entries in the global section.
+//   All other entries must have names starting with "variant".  These variants will be replaced with the
+//   canonical name if found in a relevent subfield.  An example might look like
+//
+//   [Fred & Johnson]
+//   subfields = "publishers"
+//   variant1 = "Fred and Johnson"
+//   variant2 = "F. & J."
+//
+// The keys of the returned map are a subfield reference followed by a normalised variant, e.g. "400dfred and johnson".
+PerfectHash::StringMap<std::string> LoadMarcContentsConfig(std::vector<TagAndSubfieldCode> * const tags_and_subfield_codes) {
+    const IniFile ini_file(UBTools::GetTuelibPath() + "normalise_marc_contents.conf");
+
+    const auto global_section(ini_file.getSection(""));
+    if (unlikely(global_section == ini_file.end()))
+        LOG_ERROR("missing gobal section!");
+
+    std::map<std::string, std::vector<std::string>> subfields_name_to_subfields_map;
+    for (const auto &entry : *global_section) {
+        if (unlikely(subfields_name_to_subfields_map.find(entry.name_) != subfields_name_to_subfields_map.cend()))
+            LOG_ERROR("duplicate subfields name \"" + entry.name_ + "\"!");
+        if (unlikely(entry.value_.empty()))
+            LOG_ERROR("missing subfields spec for \"" + entry.name_ + "\"!");
+
+        std::vector<std::string> subfield_specs;
+        StringUtil::Split(entry.value_, ':', &subfield_specs, /* suppress_empty_components */true);
+        for (const auto &subfield_spec : subfield_specs) {
+            if (unlikely(subfield_spec.length() != Record::TAG_LENGTH + 1))
+                LOG_ERROR("bad subfields spec for \"" + entry.name_ + "\"!");
+        }
+
+        subfields_name_to_subfields_map[entry.name_] = subfield_specs;
+    }
+
+    std::unordered_map<std::string, std::string> keys_to_canonical_names_map;
+    for (const auto &section : ini_file) {
+        if (section.getSectionName().empty())
+            continue;
+
+        const std::vector<std::string> *subfield_specs(nullptr);
+        std::vector<std::string> variants;
+        for (const auto &entry : section) {
+            if (entry.name_ == "subfields") {
+                const auto subfields_name_and_specs(subfields_name_to_subfields_map.find(entry.value_));
+                if (unlikely(subfields_name_and_specs == subfields_name_to_subfields_map.cend()))
+                    LOG_ERROR("unknown \"subfields\": \"" + entry.value_ + "\"!");
+                subfield_specs = &(subfields_name_and_specs->second);
+            } else {
+                if (unlikely(not StringUtil::StartsWith(entry.name_, "variant")))
+                    LOG_ERROR("unknown entry \"" + entry.name_ + "\" entry in section \"" + section.getSectionName() + "\"!");
+                variants.emplace_back(entry.value_);
+            }
+        }
+
+        if (unlikely(variants.empty()))
+            LOG_ERROR("missing variants entries in the \"" + section.getSectionName() + "\" section!");
+        if (unlikely(subfield_specs == nullptr))
+            LOG_ERROR("missing \"subfields\" entry for the \"" + section.getSectionName() + "\" section!");
+
+        for (const auto &subfield_spec : *subfield_specs) {
+            const TagAndSubfieldCode tag_and_subfield_code(subfield_spec.substr(0, Record::TAG_LENGTH),
+                                                           subfield_spec[Record::TAG_LENGTH]);
+            if (std::find(tags_and_subfield_codes->cbegin(), tags_and_subfield_codes->cend(), tag_and_subfield_code)
+                == tags_and_subfield_codes->cend())
+                tags_and_subfield_codes->emplace_back(tag_and_subfield_code);
+
+            // If a variant occurs in more than one section, the first section wins.
+            for (const auto &variant : variants) {
+                std::string key(subfield_spec);
+                AppendNormalisedSubfieldContents(variant, &key);
+                keys_to_canonical_names_map.emplace(key, section.getSectionName());
+            }
+        }
+    }
+
+    LOG_INFO("loaded " + std::to_string(keys_to_canonical_names_map.size()) + " variant(s) for "
+             + std::to_string(tags_and_subfield_codes->size()) + " subfield(s).");
+
+    return PerfectHash::StringMap<std::string>(std::vector<std::pair<std::string, std::string>>(
+        keys_to_canonical_names_map.cbegin(), keys_to_canonical_names_map.cend()));
+}
+
+
+// The per-record logic of normalise_marc_contents.  Replaces variants in configured subfields, e.g. of publisher names,
+// w/ a standardised form.
+class NormaliseMarcContentsStage final : public PipelineStage {
+    std::vector<TagAndSubfieldCode> tags_and_subfield_codes_; // The subfields for which we have variants.
+    const PerfectHash::StringMap<std::string> keys_to_canonical_names_map_;
+    unsigned count_, modified_count_;
+
+    // These are only members so that we can reuse their memory across fields and records:
+    std::string key_, new_contents_;
+public:
+    explicit NormaliseMarcContentsStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+private:
+    inline bool hasVariants(const Tag &tag, const char subfield_code) const {
+        return std::find(tags_and_subfield_codes_.cbegin(), tags_and_subfield_codes_.cend(),
+                         TagAndSubfieldCode(tag, subfield_code)) != tags_and_subfield_codes_.cend();
+    }
+
+    inline bool hasVariants(const Tag &tag) const {
+        return std::find_if(tags_and_subfield_codes_.cbegin(), tags_and_subfield_codes_.cend(),
+                            [&tag](const TagAndSubfieldCode &tag_and_subfield_code)
+                                { return tag_and_subfield_code.first == tag; }) != tags_and_subfield_codes_.cend();
+    }
+
+    // \return True if we modified "field", else false.
+    bool normaliseField(Record::Field * const field);
+};
+
+
+NormaliseMarcContentsStage::NormaliseMarcContentsStage(const std::vector<std::string> &arguments)
+    : PipelineStage("normalise_marc_contents"), keys_to_canonical_names_map_(LoadMarcContentsConfig(&tags_and_subfield_codes_)),
+      count_(0), modified_count_(0)
+{
+    if (not arguments.empty())
+        LOG_ERROR("the " + getName() + " stage takes no arguments!");
+}
+
+
+bool NormaliseMarcContentsStage::processRecord(Record * const record) {
+    ++count_;
+
+    bool modified_record(false);
+    for (auto &field : *record) {
+        if (hasVariants(field.getTag()) and normaliseField(&field))
+            modified_record = true;
+    }
+
+    if (modified_record)
+        ++modified_count_;
+
+    return true;
+}
+
+
+// The subfields are copied to "new_contents_" as we go, so that we never have to decompose the field into Subfields.
+bool NormaliseMarcContentsStage::normaliseField(Record::Field * const field) {
+    const Tag &tag(field->getTag());
+    const std::string &contents(static_cast<const Record::Field &>(*field).getContents());
+    new_contents_.assign(contents, 0, 2 /* indicators */);
+
+    bool modified_field(false);
+    for (const auto code_and_value : SubfieldRange(contents)) {
+        const std::string *canonical_name(nullptr);
+        if (hasVariants(tag, code_and_value.first)) {
+            key_.assign(tag.c_str(), Record::TAG_LENGTH);
+            key_ += code_and_value.first;
+            AppendNormalisedSubfieldContents(code_and_value.second, &key_);
+            canonical_name = keys_to_canonical_names_map_.find(key_);
+        }
+
+        new_contents_ += '\x1F';
+        new_contents_ += code_and_value.first;
+        if (canonical_name != nullptr and code_and_value.second != *canonical_name) {
+            new_contents_ += *canonical_name;
+            modified_field = true;
+        } else
+            new_contents_.append(code_and_value.second.data(), code_and_value.second.size());
+    }
+
+    if (modified_field)
+        field->setContents(new_contents_);
+    return modified_field;
+}
+
+
+void NormaliseMarcContentsStage::finish() {
+    LOG_INFO("Processed " + std::to_string(count_) + " records and modified " + std::to_string(modified_count_)
+             + " record(s).");
+}
+
+
+// The per-record logic of delete_unused_local_data.  Removes local data blocks, i.e. blocks of LOK fields, that don't
+// belong to one of our libraries.  Blocks are recognised and removed in a single pass w/o decomposing any field into
+// subfields, so records w/o LOK fields cost next to nothing.
+class DeleteUnusedLocalDataStage final : public PipelineStage {
+    unsigned count_, block_count_, deleted_block_count_;
+public:
+    explicit DeleteUnusedLocalDataStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+};
+
+
+DeleteUnusedLocalDataStage::DeleteUnusedLocalDataStage(const std::vector<std::string> &arguments)
+    : PipelineStage("delete_unused_local_data"), count_(0), block_count_(0), deleted_block_count_(0)
+{
+    if (not arguments.empty())
+        LOG_ERROR("the " + getName() + " stage takes no arguments!");
+}
+
+
+// Every local field starts w/ two blank indicators followed by a subfield 0 containing the local tag.
+inline StringView GetLocalTag(const std::string &local_field_contents) {
+    return (local_field_contents.size() < 4 + Record::TAG_LENGTH) ? StringView()
+                                                                   : StringView(local_field_contents.data() + 4,
+                                                                                Record::TAG_LENGTH);
+}
+
+
+// \return True if the local 852 field "contents" belongs to one of our libraries.
+inline bool IsOurHoldingField(const std::string &contents) {
+    return contents.find("aTü 135") != std::string::npos or contents.find("aDE-21") != std::string::npos;
+}
+
+
+bool DeleteUnusedLocalDataStage::processRecord(Record * const record) {
+    ++count_;
+
+    const auto local_fields_start(record->findTag("LOK"));
+    if (local_fields_start == record->end())
+        return true;
+    auto local_fields_end(local_fields_start);
+    while (local_fields_end != record->end() and local_fields_end->getTag() == "LOK")
+        ++local_fields_end;
+
+    // Blocks that we keep are moved down over the ones that we drop and the left-over fields are erased at the end:
+    auto kept_fields_end(local_fields_start), block_start(local_fields_start);
+    while (block_start != local_fields_end) {
+        auto block_end(block_start);
+        StringView last_local_tag;
+        bool keep_block(false);
+        do {
+            const std::string &contents(static_cast<const Record::Field &>(*block_end).getContents());
+            const StringView local_tag(GetLocalTag(contents));
+            if (local_tag < last_local_tag) // A new block starts w/ a smaller local tag, typically "001".
+                break;
+            if (local_tag == "852" and IsOurHoldingField(contents))
+                keep_block = true;
+            last_local_tag = local_tag;
+            ++block_end;
+        } while (block_end != local_fields_end);
+
+        ++block_count_;
+        if (keep_block) {
+            if (kept_fields_end != block_start)
+                std::move(block_start, block_end, kept_fields_end);
+            kept_fields_end += block_end - block_start;
+        } else
+            ++deleted_block_count_;
+        block_start = block_end;
+    }
+
+    if (kept_fields_end != local_fields_end)
+        record->erase(kept_fields_end, local_fields_end);
+
+    return true;
+}
+
+
+void DeleteUnusedLocalDataStage::finish() {
+    LOG_INFO("Processed " + std::to_string(count_) + " records and deleted " + std::to_string(deleted_block_count_) + " of "
+             + std::to_string(block_count_) + " local data blocks.");
+}
+
+
+// The per-record logic of enrich_ddcs.  Adds the DDC's of the authority records that a title record references in its
+// subject fields as 082 fields.  The DDC's are looked up in the authority store of the authority data and handled as
+// integer ids until they're inserted.
+// \note processRecord() is thread-safe, so enrich_ddcs can run this stage on a ParallelProcessor.
+class EnrichDDCsStage final : public PipelineStage {
+    std::unique_ptr<AuthorityStore> authority_store_;
+    std::atomic<unsigned> count_, already_had_ddcs_count_, augmented_count_, never_had_ddcs_and_now_have_ddcs_count_;
+public:
+    explicit EnrichDDCsStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+};
+
+
+EnrichDDCsStage::EnrichDDCsStage(const std::vector<std::string> &arguments)
+    : PipelineStage("enrich_ddcs"), count_(0), already_had_ddcs_count_(0), augmented_count_(0),
+      never_had_ddcs_and_now_have_ddcs_count_(0)
+{
+    if (arguments.size() != 1)
+        LOG_ERROR("the " + getName() + " stage requires exactly one argument, the path of the authority data!");
+
+    const auto authority_reader(Reader::Factory(arguments[0]));
+    authority_store_.reset(new AuthorityStore(authority_reader.get()));
+    LOG_INFO("Using " + std::to_string(authority_store_->getDDCCount()) + " distinct DDC's from \""
+             + authority_store_->getStorePath() + "\".");
+}
+
+
+bool EnrichDDCsStage::processRecord(Record * const record) {
+    ++count_;
+
+    std::vector<std::string> existing_ddcs;
+    AuthorityStore::ExtractDDCs(*record, "082", &existing_ddcs);
+    AuthorityStore::ExtractDDCs(*record, "083", &existing_ddcs);
+    if (not existing_ddcs.empty())
+        ++already_had_ddcs_count_;
+
+    static const std::vector<Tag> TOPIC_TAGS{ "600", "610", "611", "630", "650", "653", "656", "689" };
+    static const StringView K10PLUS_PREFIX("(DE-627)");
+    std::vector<uint32_t> ddc_ids;
+    std::string topic_ppn;
+    for (const auto &topic_tag : TOPIC_TAGS) {
+        for (const auto &field : record->getTagRange(topic_tag)) {
+            for (const auto &code_and_value : field.getSubfieldRange()) {
+                if (code_and_value.first == '0' and code_and_value.second.startsWith(K10PLUS_PREFIX)) {
+                    const StringView ppn(code_and_value.second.substr(K10PLUS_PREFIX.size()));
+                    topic_ppn.assign(ppn.data(), ppn.size());
+                    authority_store_->appendDDCIds(topic_ppn, &ddc_ids);
+                }
+            }
+        }
+    }
+    if (ddc_ids.empty())
+        return true;
+
+    std::sort(ddc_ids.begin(), ddc_ids.end());
+    ddc_ids.erase(std::unique(ddc_ids.begin(), ddc_ids.end()), ddc_ids.end());
+    for (const uint32_t ddc_id : ddc_ids)
+        record->insertField("082", "0 ""\x1F""a" + authority_store_->getDDC(ddc_id).toString() + "\x1F""cfrom_topic_norm_data");
+    ++augmented_count_;
+    if (existing_ddcs.empty())
+        ++never_had_ddcs_and_now_have_ddcs_count_;
+
+    return true;
+}
+
+
+void EnrichDDCsStage::finish() {
+    LOG_INFO("Read " + std::to_string(count_) + " title data records.");
+    LOG_INFO(std::to_string(already_had_ddcs_count_) + " already had DDCs.");
+    LOG_INFO("Augmented " + std::to_string(augmented_count_) + " records.");
+    LOG_INFO(std::to_string(never_had_ddcs_and_now_have_ddcs_count_) + " now have DDCs but didn't before.");
+}
+
+
+// Writes a column file w/ the columns ppn, title, authors, issns, subsystems and year for consumers that only need a
+// few fields and shouldn't have to decode the entire MARC output.  "subsystems" contains the subsystem tags, e.g. "REL",
+// of a record.  Records are passed on unmodified, so this stage should normally come last.
+class WriteColumnsStage final : public PipelineStage {
+    std::unique_ptr<ColumnFileWriter> column_file_writer_;
+    unsigned count_;
+public:
+    explicit WriteColumnsStage(const std::vector<std::string> &arguments);
+    bool processRecord(Record * const record) override;
+    void finish() override;
+};
+
+
+WriteColumnsStage::WriteColumnsStage(const std::vector<std::string> &arguments)
+    : PipelineStage("write_columns"), count_(0)
+{
+    if (arguments.size() != 1)
+        LOG_ERROR("the " + getName() + " stage requires exactly one argument, the path of the column file!");
+    column_file_writer_.reset(new ColumnFileWriter(arguments[0],
+                                                   { "ppn", "title", "authors", "issns", "subsystems", "year" }));
+}
+
+
+bool WriteColumnsStage::processRecord(Record * const record) {
+    ++count_;
+
+    static const std::vector<std::string> SUBSYSTEM_TAGS{ "BIB", "CAN", "REL" };
+    std::vector<std::string> subsystem_tags;
+    for (const auto &subsystem_tag : SUBSYSTEM_TAGS) {
+        if (record->hasTag(subsystem_tag))
+            subsystem_tags.emplace_back(subsystem_tag);
+    }
+
+    std::string year;
+    const auto _008_field(record->findTag("008"));
+    if (_008_field != record->end() and _008_field->getContents().length() >= 11)
+        year = _008_field->getContents().substr(7, 4);
+
+    column_file_writer_->addRow({ record->getControlNumber(), record->getMainTitle(),
+                                  ColumnFile::JoinValues(record->getAllAuthors()),
+                                  ColumnFile::JoinValues(record->getAllISSNs()), ColumnFile::JoinValues(subsystem_tags),
+                                  year });
+    return true;
+}
+
+
+void WriteColumnsStage::finish() {
+    column_file_writer_->close();
+    LOG_INFO("Wrote " + std::to_string(count_) + " row(s).");
+}
+
+
+template<typename Stage> std::unique_ptr<PipelineStage> CreateStage(const std::vector<std::string> &arguments) {
+    return std::unique_ptr<PipelineStage>(new Stage(arguments));
+}
+
+
+typedef std::function<std::unique_ptr<PipelineStage>(const std::vector<std::string> &arguments)> StageFactory;
+
+
+// In order to add a new stage, move the per-record logic of the corresponding pipeline program into a PipelineStage
+// subclass in this file and register it here.
+const std::map<std::string, StageFactory> &GetStageFactories() {
+    static const std::map<std::string, StageFactory> stage_names_to_factories_map{
+        { "delete_unused_local_data",                CreateStage<DeleteUnusedLocalDataStage>              },
+        { "enrich_ddcs",                             CreateStage<EnrichDDCsStage>                         },
+        { "flag_electronic_and_open_access_records", CreateStage<FlagElectronicAndOpenAccessRecordsStage> },
+        { "normalise_and_deduplicate_language",      CreateStage<NormaliseAndDeduplicateLanguageStage>    },
+        { "normalise_marc_contents",                 CreateStage<NormaliseMarcContentsStage>              },
+        { "normalise_urls",                          CreateStage<NormaliseURLsStage>                      },
+        { "write_columns",                           CreateStage<WriteColumnsStage>                       },
+    };
+
+    return stage_names_to_factories_map;
+}
+
+
+} // unnamed namespace
+
+
+std::unique_ptr<PipelineStage> PipelineStage::Factory(const std::string &stage_name,
+                                                      const std::vector<std::string> &arguments)
+{
+    const auto &stage_factories(GetStageFactories());
+    const auto stage_name_and_factory(stage_factories.find(stage_name));
+    if (unlikely(stage_name_and_factory == stage_factories.cend()))
+        LOG_ERROR("unknown pipeline stage \"" + stage_name + "\"!");
+
+    return stage_name_and_factory->second(arguments);
+}
+
+
+std::vector<std::string> PipelineStage::GetStageNames() {
+    std::vector<std::string> stage_names;
+    for (const auto &stage_name_and_factory : GetStageFactories())
+        stage_names.emplace_back(stage_name_and_factory.first);
+
+    return stage_names;
+}
+
+
+} // namespace MARC
@@ -0,0 +1,137 @@
+/** \brief A bitmap that flags records of a MARC-21 file by their OffsetIndex ordinals.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcRecordBitmap.h"
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+const char BITMAP_MAGIC[8]{ 'U', 'B', 'M', 'A', 'R', 'C', 'B', 'M' };
+const uint64_t BITMAP_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the 64 bit words of the bitmap.
+struct BitmapHeader {
+    char magic_[sizeof BITMAP_MAGIC];
+    uint64_t version_;
+    uint64_t marc_file_size_;
+    int64_t marc_mtime_seconds_;
+    int64_t marc_mtime_nanoseconds_;
+    uint64_t bit_count_;
+};
+
+
+bool InitHeader(const std::string &marc_path, const size_t bit_count, BitmapHeader * const header) {
+    struct stat stat_buf;
+    if (unlikely(::stat(marc_path.c_str(), &stat_buf) != 0))
+        return false;
+
+    std::memcpy(header->magic_, BITMAP_MAGIC, sizeof BITMAP_MAGIC);
+    header->version_                = BITMAP_VERSION;
+    header->marc_file_size_         = stat_buf.st_size;
+    header->marc_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header->marc_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header->bit_count_              = bit_count;
+    return true;
+}
+
+
+} // unnamed namespace
+
+
+bool RecordBitmap::set(const std::string &control_number) {
+    size_t ordinal;
+    if (not offset_index_.findOrdinal(control_number, &ordinal))
+        return false;
+
+    set(ordinal);
+    return true;
+}
+
+
+bool RecordBitmap::test(const std::string &control_number) const {
+    size_t ordinal;
+    return offset_index_.findOrdinal(control_number, &ordinal) and test(ordinal);
+}
+
+
+size_t RecordBitmap::count() const {
+    size_t count(0);
+    for (const auto word : words_)
+        count += __builtin_popcountll(word);
+
+    return count;
+}
+
+
+bool RecordBitmap::load(const std::string &marc_path, const std::string &name) {
+    BitmapHeader expected_header;
+    if (not InitHeader(marc_path, offset_index_.size(), &expected_header))
+        return false;
+
+    File input(GetBitmapPath(marc_path, name), "r");
+    if (input.fail())
+        return false;
+
+    BitmapHeader header;
+    if (input.read(&header, sizeof header) != sizeof header
+        or std::memcmp(&header, &expected_header, sizeof header) != 0)
+        return false;
+
+    std::vector<uint64_t> words(words_.size());
+    const size_t byte_count(words.size() * sizeof(uint64_t));
+    if (input.read(words.data(), byte_count) != byte_count)
+        return false;
+
+    words_.swap(words);
+    return true;
+}
+
+
+// Writes the bitmap to a temporary file first so that concurrent readers never see a partially written bitmap.
+bool RecordBitmap::save(const std::string &marc_path, const std::string &name) const {
+    BitmapHeader header;
+    if (not InitHeader(marc_path, offset_index_.size(), &header))
+        return false;
+
+    const std::string bitmap_path(GetBitmapPath(marc_path, name)), temp_path(bitmap_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or output.write(&header, sizeof header) != sizeof header
+        or output.write(words_.data(), words_.size() * sizeof(uint64_t)) != words_.size() * sizeof(uint64_t)
+        or not output.close())
+    {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, bitmap_path, /* remove_target = */true);
+}
+
+
+} // namespace MARC
@@ -0,0 +1,123 @@
+/** \brief Implementation of the MARC::SubjectHeadingIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcSubjectHeadingIndex.h"
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "MARC.h"
+#include "StringUtil.h"
+#include "TextUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+constexpr SubjectHeadingIndex::HeadingId SubjectHeadingIndex::NO_HEADING;
+
+
+SubjectHeadingIndex::SubjectHeadingIndex(const std::string &headings_path): node_headings_(1, NO_HEADING) {
+    const auto input(FileUtil::OpenInputFileOrDie(headings_path));
+    std::string line;
+    while (not input->eof()) {
+        input->getline(&line);
+        StringUtil::TrimWhite(&line);
+        if (not line.empty())
+            add(line);
+    }
+
+    LOG_INFO("Loaded " + std::to_string(size()) + " distinct subject heading(s) from \"" + headings_path + "\".");
+}
+
+
+std::string SubjectHeadingIndex::NormaliseComponent(const StringView &component) {
+    std::string normalised_component(component.toString());
+    StringUtil::RightTrim(" .", &normalised_component);
+    StringUtil::TrimWhite(&normalised_component);
+    return TextUtil::UTF8ToLower(&normalised_component);
+}
+
+
+SubjectHeadingIndex::HeadingId SubjectHeadingIndex::add(const std::string &heading) {
+    std::vector<std::string> components;
+    StringUtil::Split(heading, std::string("--"), &components);
+
+    uint32_t node(0);
+    std::string key;
+    for (const auto &component : components) {
+        const std::string normalised_component(NormaliseComponent(component));
+        if (unlikely(normalised_component.empty()))
+            LOG_ERROR("empty component in subject heading \"" + heading + "\"!");
+
+        MakeEdgeKey(node, normalised_component, &key);
+        const auto edge_and_node(edges_to_nodes_.emplace(key, static_cast<uint32_t>(node_headings_.size())));
+        if (edge_and_node.second)
+            node_headings_.emplace_back(NO_HEADING);
+        node = edge_and_node.first->second;
+    }
+
+    if (unlikely(node == 0))
+        LOG_ERROR("empty subject heading!");
+    if (node_headings_[node] == NO_HEADING) {
+        node_headings_[node] = static_cast<HeadingId>(headings_.size());
+        headings_.emplace_back(heading);
+    }
+
+    return node_headings_[node];
+}
+
+
+SubjectHeadingIndex::HeadingId SubjectHeadingIndex::lookup(const StringView &field_contents) const {
+    // Find the main heading first, as it need not be the first subfield:
+    StringView main_heading;
+    for (const auto &code_and_value : SubfieldRange(field_contents)) {
+        if (code_and_value.first == 'a') {
+            main_heading = code_and_value.second;
+            break;
+        }
+    }
+    if (main_heading.empty())
+        return NO_HEADING;
+
+    std::string key;
+    MakeEdgeKey(0, NormaliseComponent(main_heading), &key);
+    auto edge_and_node(edges_to_nodes_.find(key));
+    if (edge_and_node == edges_to_nodes_.cend())
+        return NO_HEADING;
+
+    uint32_t node(edge_and_node->second);
+    HeadingId most_specific_heading(node_headings_[node]);
+    for (const auto &code_and_value : SubfieldRange(field_contents)) {
+        if (code_and_value.first != 'v' and code_and_value.first != 'x' and code_and_value.first != 'y'
+            and code_and_value.first != 'z')
+            continue;
+
+        MakeEdgeKey(node, NormaliseComponent(code_and_value.second), &key);
+        edge_and_node = edges_to_nodes_.find(key);
+        if (edge_and_node == edges_to_nodes_.cend())
+            break;
+        node = edge_and_node->second;
+        if (node_headings_[node] != NO_HEADING)
+            most_specific_heading = node_headings_[node];
+    }
+
+    return most_specific_heading;
+}
+
+
+} // namespace MARC
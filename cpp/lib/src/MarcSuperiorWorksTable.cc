@@ -0,0 +1,232 @@
+/** \brief A memory-mapped table of the titles, ISBN's, ISSN's and open-access status of superior works.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarcSuperiorWorksTable.h"
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "PPN.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace MARC {
+
+
+namespace {
+
+
+const char TABLE_MAGIC[8]{ 'U', 'B', 'S', 'U', 'P', 'W', 'R', 'K' };
+const uint64_t TABLE_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the entry table and finally the
+// string pool.
+struct TableHeader {
+    char magic_[sizeof TABLE_MAGIC];
+    uint64_t version_;
+    uint64_t entry_count_;
+    uint64_t string_pool_size_;
+};
+
+
+// Mirrors what augment_773a has always used as the title of a superior work.
+std::string GetTitle(const Record &record) {
+    std::string last_title;
+    for (const auto &_245_field : record.getTagRange("245")) {
+        std::string title(_245_field.getFirstSubfieldWithCode('a'));
+        if (_245_field.hasSubfield('b'))
+            title += " " + _245_field.getFirstSubfieldWithCode('b');
+        StringUtil::RightTrim(" \t/", &title);
+        if (likely(not title.empty()))
+            last_title = title;
+    }
+
+    return last_title;
+}
+
+
+inline void PadPPN(const std::string &ppn, char (&padded_ppn)[SuperiorWorksTable::MAX_PPN_LENGTH]) {
+    std::memset(padded_ppn, '\0', sizeof padded_ppn);
+    std::memcpy(padded_ppn, ppn.data(), std::min(ppn.length(), sizeof padded_ppn));
+}
+
+
+// Writes the table to a temporary file first so that concurrent readers never see a partially written table.
+bool WriteTable(const std::string &table_path, const std::string &table) {
+    const std::string temp_path(table_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(table) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, table_path, /* remove_target = */true);
+}
+
+
+} // unnamed namespace
+
+
+bool SuperiorWorksTable::Builder::addRecord(const Record &record) {
+    PPN ppn;
+    if (unlikely(not PPN::Parse(record.getControlNumber(), &ppn)))
+        return false;
+
+    RawEntry raw_entry{ record.getControlNumber(), GetTitle(record), "", "", false };
+    if (record.isSerial() or record.isMonograph()) {
+        const auto isbns(record.getISBNs());
+        if (not isbns.empty())
+            raw_entry.isbn_ = *isbns.rbegin();
+        const auto issns(record.getISSNs());
+        if (not issns.empty())
+            raw_entry.issn_ = *issns.rbegin();
+        if (not raw_entry.isbn_.empty() or not raw_entry.issn_.empty())
+            raw_entry.is_open_access_ = IsOpenAccess(record);
+    }
+
+    if (raw_entry.title_.empty() and raw_entry.isbn_.empty() and raw_entry.issn_.empty())
+        return false;
+
+    raw_entries_.emplace_back(raw_entry);
+    return true;
+}
+
+
+size_t SuperiorWorksTable::Builder::write(const std::string &table_path) {
+    std::stable_sort(raw_entries_.begin(), raw_entries_.end(),
+                     [](const RawEntry &lhs, const RawEntry &rhs) { return lhs.ppn_ < rhs.ppn_; });
+
+    std::string string_pool;
+    const auto append([&string_pool](const std::string &s) {
+        if (unlikely(string_pool.size() + s.length() > std::numeric_limits<uint32_t>::max()))
+            LOG_ERROR("string pool overflow!");
+        const StringRef string_ref{ static_cast<uint32_t>(string_pool.size()), static_cast<uint32_t>(s.length()) };
+        string_pool += s;
+        return string_ref;
+    });
+
+    std::vector<Entry> entries;
+    entries.reserve(raw_entries_.size());
+    for (auto raw_entry(raw_entries_.cbegin()); raw_entry != raw_entries_.cend(); ++raw_entry) {
+        if (raw_entry + 1 != raw_entries_.cend() and (raw_entry + 1)->ppn_ == raw_entry->ppn_)
+            continue; // The last occurrence wins.
+
+        Entry entry;
+        std::memset(&entry, '\0', sizeof entry);
+        PadPPN(raw_entry->ppn_, entry.ppn_);
+        entry.is_open_access_ = raw_entry->is_open_access_;
+        entry.title_ = append(raw_entry->title_);
+        entry.isbn_  = append(raw_entry->isbn_);
+        entry.issn_  = append(raw_entry->issn_);
+        entries.emplace_back(entry);
+    }
+    raw_entries_.clear();
+    raw_entries_.shrink_to_fit();
+
+    TableHeader header;
+    std::memcpy(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC);
+    header.version_          = TABLE_VERSION;
+    header.entry_count_      = entries.size();
+    header.string_pool_size_ = string_pool.size();
+
+    std::string table(reinterpret_cast<const char *>(&header), sizeof header);
+    table.append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    table += string_pool;
+    if (unlikely(not WriteTable(table_path, table)))
+        LOG_ERROR("failed to write \"" + table_path + "\"!");
+
+    return entries.size();
+}
+
+
+SuperiorWorksTable::SuperiorWorksTable(const std::string &table_path)
+    : table_path_(table_path), mmap_(nullptr), mmap_size_(0), entries_(nullptr), entry_count_(0), string_pool_(nullptr)
+{
+    const int fd(::open(table_path_.c_str(), O_RDONLY));
+    if (unlikely(fd == -1))
+        LOG_ERROR("failed to open \"" + table_path_ + "\" for reading!");
+
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd, &stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + table_path_ + "\" failed!");
+    if (unlikely(static_cast<size_t>(stat_buf.st_size) < sizeof(TableHeader)))
+        LOG_ERROR("\"" + table_path_ + "\" is too short to be a superior works table!");
+
+    void * const mapping(::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + table_path_ + "\"!");
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = stat_buf.st_size;
+
+    const TableHeader * const header(reinterpret_cast<const TableHeader *>(mmap_));
+    if (unlikely(std::memcmp(header->magic_, TABLE_MAGIC, sizeof TABLE_MAGIC) != 0 or header->version_ != TABLE_VERSION
+                 or mmap_size_ != sizeof(TableHeader) + header->entry_count_ * sizeof(Entry) + header->string_pool_size_))
+        LOG_ERROR("\"" + table_path_ + "\" is not a valid superior works table!");
+
+    entries_     = reinterpret_cast<const Entry *>(mmap_ + sizeof(TableHeader));
+    entry_count_ = header->entry_count_;
+    string_pool_ = mmap_ + sizeof(TableHeader) + entry_count_ * sizeof(Entry);
+}
+
+
+SuperiorWorksTable::~SuperiorWorksTable() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + table_path_ + "\" failed!");
+}
+
+
+bool SuperiorWorksTable::lookup(const std::string &ppn, Info * const info) const {
+    if (ppn.length() > MAX_PPN_LENGTH)
+        return false;
+
+    char padded_ppn[MAX_PPN_LENGTH];
+    PadPPN(ppn, padded_ppn);
+    const Entry * const entries_end(entries_ + entry_count_);
+    const Entry * const entry(std::lower_bound(entries_, entries_end, padded_ppn,
+                                               [](const Entry &lhs, const char * const rhs)
+                                                   { return std::memcmp(lhs.ppn_, rhs, MAX_PPN_LENGTH) < 0; }));
+    if (entry == entries_end or std::memcmp(entry->ppn_, padded_ppn, MAX_PPN_LENGTH) != 0)
+        return false;
+
+    info->title_          = getString(entry->title_);
+    info->isbn_           = getString(entry->isbn_);
+    info->issn_           = getString(entry->issn_);
+    info->is_open_access_ = entry->is_open_access_ != 0;
+    return true;
+}
+
+
+size_t SuperiorWorksTable::Create(Reader * const marc_reader, const std::string &table_path) {
+    Builder builder;
+    while (const Record record = marc_reader->read())
+        builder.addRecord(record);
+
+    return builder.write(table_path);
+}
+
+
+} // namespace MARC
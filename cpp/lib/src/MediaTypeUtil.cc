@@ -27,11 +27,12 @@
  */
 
 #include "MediaTypeUtil.h"
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <unordered_set>
 #include <cctype>
-#include <alloca.h>
+#include <cstring>
 #include <magic.h>
 #include "File.h"
 #include "FileUtil.h"
@@ -62,58 +63,169 @@ std::string GetHtmlMediaType(const std::string &document) {
 }
 
 
-static const std::string LZ4_MAGIC("\000\042\115\030", 4);
-static const std::string KYOTOCABINET_MAGIC("KC\n");
+namespace {
 
 
-// GetMediaType -- Get the media type of a document.
-//
-std::string GetMediaType(const std::string &document, const bool auto_simplify) {
-    if (document.empty())
-        return "";
+// Loading the magic database takes milliseconds, so each thread keeps its own cookie, libmagic cookies not being
+// thread-safe.
+class MagicCookie {
+    magic_t cookie_;
+public:
+    MagicCookie(): cookie_(::magic_open(MAGIC_MIME)) {
+        if (unlikely(cookie_ == nullptr))
+            throw std::runtime_error("in MediaTypeUtil::MagicCookie::MagicCookie: could not open libmagic!");
 
-    // 1. See if we have (X)HTML:
-    std::string media_type(GetHtmlMediaType(document));
-    if (not media_type.empty())
-        return media_type;
+        // Load the default "magic" definitions file:
+        if (unlikely(::magic_load(cookie_, nullptr /* use default magic file */) != 0)) {
+            const std::string error_message(::magic_error(cookie_));
+            ::magic_close(cookie_);
+            throw std::runtime_error("in MediaTypeUtil::MagicCookie::MagicCookie: could not load libmagic (" + error_message
+                                     + ").");
+        }
+    }
+    ~MagicCookie() { ::magic_close(cookie_); }
 
-    // 2. Check for LZ4 compression:
-    if (document.substr(0, LZ4_MAGIC.length()) == LZ4_MAGIC)
-        return "application/lz4";
+    // \return The media type or the empty string if an error occurred, in which case "error_message" will be set.
+    inline std::string getBufferMediaType(const std::string &buffer, std::string * const error_message)
+        { return toMediaType(::magic_buffer(cookie_, buffer.c_str(), buffer.length()), error_message); }
+    std::string getFileMediaType(const std::string &path, std::string * const error_message);
+private:
+    MagicCookie(const MagicCookie &) = delete;
+    MagicCookie &operator=(const MagicCookie &) = delete;
 
-    // 3. Check for a kyotocabinet database:
-    if (document.substr(0, KYOTOCABINET_MAGIC.length()) == KYOTOCABINET_MAGIC)
-        return "application/kyotocabinet";
+    std::string toMediaType(const char *magic_mime_type, std::string * const error_message);
+};
 
-    // 4. Next try libmagic:
-    const magic_t cookie = ::magic_open(MAGIC_MIME);
-    if (unlikely(cookie == nullptr))
-        throw std::runtime_error("in MediaTypeUtil::GetMediaType: could not open libmagic!");
-
-    // Load the default "magic" definitions file:
-    if (unlikely(::magic_load(cookie, nullptr /* use default magic file */) != 0)) {
-        ::magic_close(cookie);
-        throw std::runtime_error("in MediaTypeUtil::GetMediaType: could not load libmagic ("
-                                 + std::string(::magic_error(cookie)) + ").");
-    }
 
-    // Use magic to get the mime type of the buffer:
-    const char *magic_mime_type = ::magic_buffer(cookie, document.c_str(), document.length());
+std::string MagicCookie::getFileMediaType(const std::string &path, std::string * const error_message) {
+    ::magic_setflags(cookie_, MAGIC_MIME | MAGIC_SYMLINK);
+    const char * const magic_mime_type(::magic_file(cookie_, path.c_str()));
+    const std::string media_type(toMediaType(magic_mime_type, error_message));
+    ::magic_setflags(cookie_, MAGIC_MIME);
+    return media_type;
+}
+
+
+std::string MagicCookie::toMediaType(const char *magic_mime_type, std::string * const error_message) {
     if (unlikely(magic_mime_type == nullptr)) {
-        ::magic_close(cookie);
-        throw std::runtime_error("in MediaTypeUtil::GetMediaType: error in libmagic ("
-                                 + std::string(::magic_error(cookie)) + ").");
+        *error_message = ::magic_error(cookie_);
+        return "";
     }
 
     // Attempt to remove possible leading junk (no idea why libmagic behaves in this manner every now and then):
     if (std::strncmp(magic_mime_type, "\\012- ", 6) == 0)
         magic_mime_type += 6;
+    return magic_mime_type;
+}
+
+
+MagicCookie &GetMagicCookie() {
+    static thread_local std::unique_ptr<MagicCookie> magic_cookie;
+    if (unlikely(magic_cookie == nullptr))
+        magic_cookie.reset(new MagicCookie());
+    return *magic_cookie;
+}
+
+
+const std::string LZ4_MAGIC("\000\042\115\030", 4);
+const std::string KYOTOCABINET_MAGIC("KC\n");
+
+
+struct Signature {
+    const char *magic_;
+    size_t magic_length_;
+    const char *media_type_;
+};
+
+
+// Binary formats that we encounter often and that can be recognised by their first few bytes alone.  The media types are
+// the ones that libmagic reports for them.
+const Signature BINARY_SIGNATURES[] = {
+    { "%PDF-",                         5, "application/pdf"          },
+    { "\x1F\x8B",                      2, "application/gzip"         },
+    { "\000\042\115\030",              4, "application/lz4"          },
+    { "KC\n",                          3, "application/kyotocabinet" },
+    { "PK\003\004",                    4, "application/zip"          },
+    { "\x89PNG\r\n\x1A\n",             8, "image/png"                },
+    { "\xFF\xD8\xFF",                  3, "image/jpeg"               },
+};
+
+
+// \return The simplified media type of a binary document or the empty string if "data" starts w/ none of the signatures.
+const char *SniffBinaryMediaType(const char * const data, const size_t size) {
+    for (const auto &signature : BINARY_SIGNATURES) {
+        if (size >= signature.magic_length_ and std::memcmp(data, signature.magic_, signature.magic_length_) == 0)
+            return signature.media_type_;
+    }
+    return "";
+}
+
+
+// \return "text/xml", "application/json" or the empty string.
+// \note   We can't know the charset of text documents w/o looking at all of their contents, so this should only be used if
+//         the result will be simplified.
+std::string SniffTextMediaType(const std::string &document) {
+    size_t start(0);
+    if (StringUtil::StartsWith(document, "\xEF\xBB\xBF")) // UTF-8 BOM
+        start = 3;
+    while (start < document.size() and std::isspace(static_cast<unsigned char>(document[start])))
+        ++start;
+
+    if (document.compare(start, 5, "<?xml") == 0)
+        return "text/xml";
+
+    // Only objects, as a leading bracket could also be the start of many non-JSON text formats:
+    if (start < document.size() and document[start] == '{') {
+        ++start;
+        while (start < document.size() and std::isspace(static_cast<unsigned char>(document[start])))
+            ++start;
+        if (start < document.size() and (document[start] == '"' or document[start] == '}'))
+            return "application/json";
+    }
+
+    return "";
+}
+
+
+// Appends the parameter that libmagic adds for binary types if the caller asked for an unsimplified media type.
+inline std::string BinaryMediaType(const char * const simplified_media_type, const bool auto_simplify) {
+    return auto_simplify ? std::string(simplified_media_type) : std::string(simplified_media_type) + "; charset=binary";
+}
+
+
+} // unnamed namespace
+
+
+// GetMediaType -- Get the media type of a document.
+//
+std::string GetMediaType(const std::string &document, const bool auto_simplify) {
+    if (document.empty())
+        return "";
+
+    // 1. Check for common binary formats, which also saves us from running the HTML regex over megabytes of PDF:
+    const char * const binary_media_type(SniffBinaryMediaType(document.data(), document.size()));
+    if (*binary_media_type != '\0')
+        return BinaryMediaType(binary_media_type, auto_simplify);
 
-    // Close the library:
-    media_type = magic_mime_type;
-    ::magic_close(cookie);
+    // 2. See if we have (X)HTML:
+    std::string media_type(GetHtmlMediaType(document));
+    if (not media_type.empty())
+        return media_type;
 
-    // 4. If the libmagic could not determine the document's MIME type, test for XML:
+    // 3. Recognise XML and JSON w/o libmagic if we don't need to report the charset:
+    if (auto_simplify) {
+        media_type = SniffTextMediaType(document);
+        if (not media_type.empty())
+            return media_type;
+    }
+
+    // 4. Next try libmagic:
+    std::string error_message;
+    media_type = GetMagicCookie().getBufferMediaType(document, &error_message);
+    if (unlikely(not error_message.empty()))
+        throw std::runtime_error("in MediaTypeUtil::GetMediaType: error in libmagic (" + error_message + ").");
+
+    // 5. If the libmagic could not determine the document's MIME type, test for XML:
     if (media_type.empty() and document.size() > 5)
         return std::strncmp(document.c_str(), "<?xml", 5) == 0 ? "text/xml" : "";
 
@@ -144,43 +256,23 @@ std::string GetMediaType(const std::string &document, std::string * const subtyp
 
 
 std::string GetFileMediaType(const std::string &filename, const bool auto_simplify) {
-    const magic_t cookie(::magic_open(MAGIC_MIME | MAGIC_SYMLINK));
-    if (unlikely(cookie == nullptr))
-        LOG_ERROR("could not open libmagic!");
-
-    // Load the default "magic" definitions file:
-    if (unlikely(::magic_load(cookie, nullptr /* use default magic file */) != 0)) {
-        ::magic_close(cookie);
-        LOG_ERROR("could not load libmagic (" + std::string(::magic_error(cookie)) + ").");
+    // Only the first few bytes are needed to recognise the common binary formats:
+    File input(filename, "r");
+    if (not input.fail()) {
+        char buf[16];
+        const char * const binary_media_type(SniffBinaryMediaType(buf, input.read(buf, sizeof(buf))));
+        if (*binary_media_type != '\0')
+            return BinaryMediaType(binary_media_type, auto_simplify);
     }
 
-    // Use magic to get the mime type of the buffer:
-    const char *magic_mime_type(::magic_file(cookie, filename.c_str()));
-    if (unlikely(magic_mime_type == nullptr)) {
-        ::magic_close(cookie);
-        LOG_ERROR("error in libmagic (" + std::string(::magic_error(cookie)) + ").");
-    }
-
-    // Attempt to remove possible leading junk (no idea why libmagic behaves in this manner every now and then):
-    if (std::strncmp(magic_mime_type, "\\012- ", 6) == 0)
-        magic_mime_type += 6;
-
-    // Close the library:
-    std::string media_type(magic_mime_type);
-    ::magic_close(cookie);
+    std::string error_message;
+    std::string media_type(GetMagicCookie().getFileMediaType(filename, &error_message));
+    if (unlikely(not error_message.empty()))
+        LOG_ERROR("error in libmagic (" + error_message + ").");
 
     if (auto_simplify)
         SimplifyMediaType(&media_type);
 
-    if (StringUtil::StartsWith(media_type, "application/octet-stream")) {
-        const auto input(FileUtil::OpenInputFileOrDie(filename));
-        char * const buf(reinterpret_cast<char *>(::alloca(LZ4_MAGIC.size())));
-        if ((input->read(buf, LZ4_MAGIC.size()) == LZ4_MAGIC.size()) and std::strncmp(LZ4_MAGIC.c_str(), buf, LZ4_MAGIC.size()) == 0)
-            return "application/lz4";
-        if (LZ4_MAGIC.size() >= KYOTOCABINET_MAGIC.size() and std::strncmp(KYOTOCABINET_MAGIC.c_str(), buf, KYOTOCABINET_MAGIC.size()) == 0)
-            return "application/kyotocabinet";
-    }
-
     return media_type;
 }
 
@@ -0,0 +1,363 @@
+/** \brief Implementation of the Metrics registry and its exporters.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Metrics.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <cctype>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "MiscUtil.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace Metrics {
+
+
+constexpr unsigned Histogram::SUB_BUCKET_BITS;
+constexpr unsigned Histogram::SUB_BUCKET_COUNT;
+constexpr unsigned Histogram::BUCKET_COUNT;
+
+
+namespace {
+
+
+const double EXPORTED_PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9 };
+
+
+template<typename MetricType> using MetricMap = std::map<std::string, std::pair<std::string, std::unique_ptr<MetricType>>>;
+
+
+struct Registry {
+    std::mutex mutex_;
+    MetricMap<Counter> counters_;
+    MetricMap<Gauge> gauges_;
+    MetricMap<Histogram> histograms_;
+    const std::string json_file_, prometheus_file_;
+
+    Registry();
+};
+
+
+std::atomic<bool> export_requested(false);
+struct sigaction previous_sigusr1_action;
+
+
+// Only sets a flag as exporting is not async-signal-safe.  We chain to any previously installed handler so that we
+// don't take SIGUSR1 away from the application or from, e.g., MARC::IOStatistics.
+void SigUsr1Handler(int signal_no, siginfo_t *info, void *context) {
+    export_requested.store(true, std::memory_order_relaxed);
+    if ((previous_sigusr1_action.sa_flags & SA_SIGINFO) != 0) {
+        if (previous_sigusr1_action.sa_sigaction != nullptr)
+            previous_sigusr1_action.sa_sigaction(signal_no, info, context);
+    } else if (previous_sigusr1_action.sa_handler != SIG_DFL and previous_sigusr1_action.sa_handler != SIG_IGN)
+        previous_sigusr1_action.sa_handler(signal_no);
+}
+
+
+void ExportOnRequest() {
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        if (export_requested.exchange(false))
+            Export();
+    }
+}
+
+
+Registry::Registry()
+    : json_file_(MiscUtil::SafeGetEnv("METRICS_JSON_FILE")), prometheus_file_(MiscUtil::SafeGetEnv("METRICS_PROMETHEUS_FILE"))
+{
+    if (json_file_.empty() and prometheus_file_.empty())
+        return;
+
+    std::atexit(Export);
+
+    struct sigaction new_action;
+    new_action.sa_sigaction = SigUsr1Handler;
+    sigemptyset(&new_action.sa_mask);
+    new_action.sa_flags = SA_RESTART | SA_SIGINFO;
+    if (unlikely(::sigaction(SIGUSR1, &new_action, &previous_sigusr1_action) != 0))
+        LOG_ERROR("sigaction(2) failed!");
+
+    std::thread(ExportOnRequest).detach();
+}
+
+
+// Intentionally never destroyed, as metrics may still be updated by other threads or exit handlers during exit.
+Registry &GetRegistry() {
+    static Registry * const registry(new Registry);
+    return *registry;
+}
+
+
+bool IsValidName(const std::string &name) {
+    if (name.empty() or not (std::isalpha(name[0]) or name[0] == '_' or name[0] == ':'))
+        return false;
+    for (const char ch : name) {
+        if (not (std::isalnum(ch) or ch == '_' or ch == ':'))
+            return false;
+    }
+    return true;
+}
+
+
+template<typename MetricType> MetricType &GetMetric(Registry * const registry, MetricMap<MetricType> * const metrics,
+                                                     const std::string &name, const std::string &description)
+{
+    std::lock_guard<std::mutex> registry_mutex_locker(registry->mutex_);
+    const auto name_and_metric(metrics->find(name));
+    if (name_and_metric != metrics->end())
+        return *name_and_metric->second.second;
+
+    if (unlikely(not IsValidName(name)))
+        LOG_ERROR("\"" + name + "\" is not a valid metric name!");
+    if (unlikely(registry->counters_.find(name) != registry->counters_.end()
+                 or registry->gauges_.find(name) != registry->gauges_.end()
+                 or registry->histograms_.find(name) != registry->histograms_.end()))
+        LOG_ERROR("\"" + name + "\" is already in use for a metric of a different kind!");
+
+    MetricType * const new_metric(new MetricType);
+    metrics->emplace(name, std::make_pair(description, std::unique_ptr<MetricType>(new_metric)));
+    return *new_metric;
+}
+
+
+std::string GetProgramName() {
+    return (::progname == nullptr) ? "unknown" : FileUtil::GetLastPathComponent(::progname);
+}
+
+
+std::string EscapeString(const std::string &s) {
+    std::string escaped;
+    for (const char ch : s) {
+        if (ch == '"' or ch == '\\')
+            escaped += '\\';
+        escaped += ch;
+    }
+    return escaped;
+}
+
+
+std::string FormatPercentile(const double percentile) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%g", percentile);
+    return buf;
+}
+
+
+void WriteAtomically(const std::string &path, const std::string &contents) {
+    const std::string temp_path(path + ".tmp." + std::to_string(::getpid()));
+    if (unlikely(not FileUtil::WriteString(temp_path, contents) or ::rename(temp_path.c_str(), path.c_str()) != 0)) {
+        LOG_WARNING("failed to write metrics to \"" + path + "\"!");
+        ::unlink(temp_path.c_str());
+    }
+}
+
+
+} // unnamed namespace
+
+
+Counter::Counter() {
+    for (auto &shard : shards_)
+        shard.value_.store(0, std::memory_order_relaxed);
+}
+
+
+uint64_t Counter::get() const {
+    uint64_t total(0);
+    for (const auto &shard : shards_)
+        total += shard.value_.load(std::memory_order_relaxed);
+    return total;
+}
+
+
+Histogram::Histogram() {
+    for (auto &shard : shards_) {
+        shard.count_.store(0, std::memory_order_relaxed);
+        shard.sum_.store(0, std::memory_order_relaxed);
+        for (auto &bucket : shard.buckets_)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+uint64_t Histogram::getCount() const {
+    uint64_t total(0);
+    for (const auto &shard : shards_)
+        total += shard.count_.load(std::memory_order_relaxed);
+    return total;
+}
+
+
+uint64_t Histogram::getSum() const {
+    uint64_t total(0);
+    for (const auto &shard : shards_)
+        total += shard.sum_.load(std::memory_order_relaxed);
+    return total;
+}
+
+
+uint64_t Histogram::getPercentile(const double percentile) const {
+    uint64_t merged_buckets[BUCKET_COUNT] = { 0 };
+    uint64_t count(0);
+    for (const auto &shard : shards_) {
+        for (unsigned bucket_index(0); bucket_index < BUCKET_COUNT; ++bucket_index) {
+            const uint64_t bucket_count(shard.buckets_[bucket_index].load(std::memory_order_relaxed));
+            merged_buckets[bucket_index] += bucket_count;
+            count += bucket_count;
+        }
+    }
+    if (count == 0)
+        return 0;
+
+    const uint64_t threshold(std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(count * percentile / 100.0))));
+    uint64_t cumulative_count(0);
+    for (unsigned bucket_index(0); bucket_index < BUCKET_COUNT; ++bucket_index) {
+        cumulative_count += merged_buckets[bucket_index];
+        if (cumulative_count >= threshold)
+            return GetBucketUpperBound(bucket_index);
+    }
+
+    return GetBucketUpperBound(BUCKET_COUNT - 1);
+}
+
+
+uint64_t Histogram::GetBucketUpperBound(const unsigned bucket_index) {
+    if (bucket_index < 2 * SUB_BUCKET_COUNT)
+        return bucket_index;
+    const unsigned shift(bucket_index / SUB_BUCKET_COUNT - 1);
+    const uint64_t sub_bucket(bucket_index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT);
+    return ((sub_bucket + 1) << shift) - 1; // Wraps around to the maximum for the last bucket, which is what we want.
+}
+
+
+Counter &GetCounter(const std::string &name, const std::string &description) {
+    Registry &registry(GetRegistry());
+    return GetMetric(&registry, &registry.counters_, name, description);
+}
+
+
+Gauge &GetGauge(const std::string &name, const std::string &description) {
+    Registry &registry(GetRegistry());
+    return GetMetric(&registry, &registry.gauges_, name, description);
+}
+
+
+Histogram &GetHistogram(const std::string &name, const std::string &description) {
+    Registry &registry(GetRegistry());
+    return GetMetric(&registry, &registry.histograms_, name, description);
+}
+
+
+std::string ToJSON() {
+    Registry &registry(GetRegistry());
+    std::lock_guard<std::mutex> registry_mutex_locker(registry.mutex_);
+
+    std::string json("{\n  \"program\": \"" + EscapeString(GetProgramName()) + "\",\n  \"counters\": {");
+    bool first(true);
+    for (const auto &name_and_counter : registry.counters_) {
+        json += (first ? "\n    \"" : ",\n    \"") + name_and_counter.first + "\": "
+                + std::to_string(name_and_counter.second.second->get());
+        first = false;
+    }
+
+    json += "\n  },\n  \"gauges\": {";
+    first = true;
+    for (const auto &name_and_gauge : registry.gauges_) {
+        json += (first ? "\n    \"" : ",\n    \"") + name_and_gauge.first + "\": " + std::to_string(name_and_gauge.second.second->get());
+        first = false;
+    }
+
+    json += "\n  },\n  \"histograms\": {";
+    first = true;
+    for (const auto &name_and_histogram : registry.histograms_) {
+        const Histogram &histogram(*name_and_histogram.second.second);
+        json += (first ? "\n    \"" : ",\n    \"") + name_and_histogram.first + "\": { \"count\": "
+                + std::to_string(histogram.getCount()) + ", \"sum\": " + std::to_string(histogram.getSum());
+        for (const double percentile : EXPORTED_PERCENTILES)
+            json += ", \"p" + StringUtil::Map(FormatPercentile(percentile), '.', '_') + "\": "
+                    + std::to_string(histogram.getPercentile(percentile));
+        json += " }";
+        first = false;
+    }
+    json += "\n  }\n}\n";
+
+    return json;
+}
+
+
+std::string ToPrometheusText() {
+    Registry &registry(GetRegistry());
+    std::lock_guard<std::mutex> registry_mutex_locker(registry.mutex_);
+
+    const std::string program_label("program=\"" + EscapeString(GetProgramName()) + "\"");
+    std::string text;
+    const auto append_header([&text](const std::string &name, const std::string &description, const std::string &type) {
+        if (not description.empty())
+            text += "# HELP " + name + " " + description + "\n";
+        text += "# TYPE " + name + " " + type + "\n";
+    });
+
+    for (const auto &name_and_counter : registry.counters_) {
+        append_header(name_and_counter.first, name_and_counter.second.first, "counter");
+        text += name_and_counter.first + "{" + program_label + "} " + std::to_string(name_and_counter.second.second->get()) + "\n";
+    }
+
+    for (const auto &name_and_gauge : registry.gauges_) {
+        append_header(name_and_gauge.first, name_and_gauge.second.first, "gauge");
+        text += name_and_gauge.first + "{" + program_label + "} " + std::to_string(name_and_gauge.second.second->get()) + "\n";
+    }
+
+    for (const auto &name_and_histogram : registry.histograms_) {
+        const std::string &name(name_and_histogram.first);
+        const Histogram &histogram(*name_and_histogram.second.second);
+        append_header(name, name_and_histogram.second.first, "summary");
+        for (const double percentile : EXPORTED_PERCENTILES)
+            text += name + "{" + program_label + ",quantile=\"" + FormatPercentile(percentile / 100.0) + "\"} "
+                    + std::to_string(histogram.getPercentile(percentile)) + "\n";
+        text += name + "_sum{" + program_label + "} " + std::to_string(histogram.getSum()) + "\n";
+        text += name + "_count{" + program_label + "} " + std::to_string(histogram.getCount()) + "\n";
+    }
+
+    return text;
+}
+
+
+void Export() {
+    static std::mutex export_mutex; // Exit handlers and the SIGUSR1 thread may want to export at the same time.
+    std::lock_guard<std::mutex> export_mutex_locker(export_mutex);
+
+    const Registry &registry(GetRegistry());
+    if (not registry.json_file_.empty())
+        WriteAtomically(registry.json_file_, ToJSON());
+    if (not registry.prometheus_file_.empty())
+        WriteAtomically(registry.prometheus_file_, ToPrometheusText());
+}
+
+
+} // namespace Metrics
@@ -0,0 +1,205 @@
+/** \brief Implementation of the microbenchmark harness.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MicroBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include "JSON.h"
+#include "RegexMatcher.h"
+#include "StringUtil.h"
+#include "TimeUtil.h"
+#include "util.h"
+
+
+namespace MicroBenchmark {
+
+
+namespace {
+
+
+struct Benchmark {
+    std::string name_;
+    BenchmarkFunc func_;
+public:
+    Benchmark(const std::string &name, const BenchmarkFunc func): name_(name), func_(func) { }
+};
+
+
+// A function-local static, because BENCHMARK registers during static initialisation.
+std::vector<Benchmark> &GetBenchmarks() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+
+struct Result {
+    std::string name_;
+    uint64_t iterations_;
+    double nanoseconds_per_iteration_;  // The median of all repetitions.
+    double min_nanoseconds_per_iteration_;
+    double bytes_per_second_, items_per_second_;
+};
+
+
+// \return The elapsed time in seconds.
+double RunOnce(const BenchmarkFunc func, State * const state) {
+    const auto start(std::chrono::steady_clock::now());
+    func(state);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+Result RunBenchmark(const Benchmark &benchmark, const double min_time, const unsigned repetitions) {
+    static constexpr uint64_t MAX_ITERATIONS(1000ull * 1000 * 1000);
+
+    // Grow the iteration count until a single run takes at least "min_time" seconds:
+    uint64_t iterations(1);
+    for (;;) {
+        State state(iterations);
+        const double elapsed(RunOnce(benchmark.func_, &state));
+        if (elapsed >= min_time or iterations >= MAX_ITERATIONS)
+            break;
+
+        // Aim a little higher than necessary but never grow by more than a factor of 10 based on a single run:
+        const double factor(elapsed <= 0.0 ? 10.0 : std::min(10.0, std::max(2.0, 1.4 * min_time / elapsed)));
+        iterations = std::min(MAX_ITERATIONS, static_cast<uint64_t>(iterations * factor));
+    }
+
+    std::vector<double> nanoseconds_per_iteration;
+    double bytes_per_second(0.0), items_per_second(0.0);
+    for (unsigned repetition(0); repetition < repetitions; ++repetition) {
+        State state(iterations);
+        const double elapsed(RunOnce(benchmark.func_, &state));
+        nanoseconds_per_iteration.emplace_back(elapsed * 1e9 / iterations);
+        bytes_per_second = std::max(bytes_per_second, state.getBytesProcessed() / elapsed);
+        items_per_second = std::max(items_per_second, state.getItemsProcessed() / elapsed);
+    }
+    std::sort(nanoseconds_per_iteration.begin(), nanoseconds_per_iteration.end());
+
+    return Result{ benchmark.name_, iterations, nanoseconds_per_iteration[nanoseconds_per_iteration.size() / 2],
+                   nanoseconds_per_iteration.front(), bytes_per_second, items_per_second };
+}
+
+
+std::string FormatDouble(const double value, const int precision) {
+    std::ostringstream output;
+    output << std::fixed << std::setprecision(precision) << value;
+    return output.str();
+}
+
+
+void ReportAsText(const Result &result) {
+    std::cout << std::left << std::setw(40) << result.name_ << std::right << std::setw(14)
+              << FormatDouble(result.nanoseconds_per_iteration_, 1) << " ns" << std::setw(12) << result.iterations_;
+    if (result.bytes_per_second_ > 0.0)
+        std::cout << std::setw(12) << FormatDouble(result.bytes_per_second_ / (1024.0 * 1024.0), 1) << " MiB/s";
+    if (result.items_per_second_ > 0.0)
+        std::cout << std::setw(14) << FormatDouble(result.items_per_second_, 0) << " items/s";
+    std::cout << '\n' << std::flush;
+}
+
+
+std::string ResultsToJSON(const std::string &suite_name, const std::vector<Result> &results) {
+    std::string json("{\n  \"suite\": \"" + JSON::EscapeString(suite_name) + "\",\n  \"date\": \""
+                     + TimeUtil::GetCurrentDateAndTime(TimeUtil::ISO_8601_FORMAT, TimeUtil::UTC) + "Z\",\n  \"benchmarks\": [");
+    bool first(true);
+    for (const auto &result : results) {
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "    { \"name\": \"" + JSON::EscapeString(result.name_) + "\", \"iterations\": "
+                + std::to_string(result.iterations_) + ", \"ns_per_iteration\": "
+                + FormatDouble(result.nanoseconds_per_iteration_, 3) + ", \"min_ns_per_iteration\": "
+                + FormatDouble(result.min_nanoseconds_per_iteration_, 3) + ", \"bytes_per_second\": "
+                + FormatDouble(result.bytes_per_second_, 0) + ", \"items_per_second\": "
+                + FormatDouble(result.items_per_second_, 0) + " }";
+    }
+    json += "\n  ]\n}\n";
+
+    return json;
+}
+
+
+[[noreturn]] void Usage() {
+    ::Usage("[--filter=regex] [--min-time=seconds] [--repetitions=n] [--json] [--list]\n"
+            "       --filter       only runs the benchmarks whose names match \"regex\"\n"
+            "       --min-time     the minimum duration of a single run, defaults to 0.5\n"
+            "       --repetitions  how often each benchmark is run after calibration, defaults to 3\n"
+            "       --json         writes the results as JSON to stdout instead of a table\n"
+            "       --list         lists the names of the benchmarks and exits");
+}
+
+
+} // unnamed namespace
+
+
+int Register(const std::string &name, const BenchmarkFunc benchmark_func) {
+    GetBenchmarks().emplace_back(name, benchmark_func);
+    return 0;
+}
+
+
+int RunAll(const std::string &suite_name, int argc, char *argv[]) {
+    std::unique_ptr<RegexMatcher> filter;
+    double min_time(0.5);
+    unsigned repetitions(3);
+    bool json_output(false), list_only(false);
+    for (--argc, ++argv; argc > 0; --argc, ++argv) {
+        if (StringUtil::StartsWith(argv[0], "--filter="))
+            filter.reset(RegexMatcher::RegexMatcherFactoryOrDie(argv[0] + std::strlen("--filter=")));
+        else if (StringUtil::StartsWith(argv[0], "--min-time=")) {
+            if (not StringUtil::ToDouble(argv[0] + std::strlen("--min-time="), &min_time) or min_time <= 0.0)
+                LOG_ERROR("bad minimum time \"" + std::string(argv[0] + std::strlen("--min-time=")) + "\"!");
+        } else if (StringUtil::StartsWith(argv[0], "--repetitions=")) {
+            if (not StringUtil::ToUnsigned(argv[0] + std::strlen("--repetitions="), &repetitions) or repetitions == 0)
+                LOG_ERROR("bad repetition count \"" + std::string(argv[0] + std::strlen("--repetitions=")) + "\"!");
+        } else if (std::strcmp(argv[0], "--json") == 0)
+            json_output = true;
+        else if (std::strcmp(argv[0], "--list") == 0)
+            list_only = true;
+        else
+            Usage();
+    }
+
+    std::vector<Result> results;
+    for (const auto &benchmark : GetBenchmarks()) {
+        if (filter != nullptr and not filter->matched(benchmark.name_))
+            continue;
+        if (list_only) {
+            std::cout << benchmark.name_ << '\n';
+            continue;
+        }
+
+        results.emplace_back(RunBenchmark(benchmark, min_time, repetitions));
+        if (not json_output)
+            ReportAsText(results.back());
+    }
+
+    if (json_output)
+        std::cout << ResultsToJSON(suite_name, results);
+
+    return EXIT_SUCCESS;
+}
+
+
+} // namespace MicroBenchmark
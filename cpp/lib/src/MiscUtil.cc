@@ -28,9 +28,7 @@
 
 #include "MiscUtil.h"
 #include <map>
-#include <queue>
 #include <set>
-#include <stack>
 #include <stdexcept>
 #include <unordered_set>
 #include <cctype>
@@ -39,6 +37,7 @@
 #include <unistd.h>
 #include "BSZUtil.h"
 #include "Compiler.h"
+#include "DirectedGraph.h"
 #include "FileUtil.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
@@ -444,76 +443,6 @@ static bool NodeNumberingIsCorrect(const std::vector<std::pair<unsigned, unsigne
 }
 
 
-static void ConstructShortestPath(const std::vector<int> &parents, unsigned s, std::vector<unsigned> * const cycle) {
-    while (parents[s] != -1)  {
-        cycle->emplace_back(s);
-        s = parents[s];
-    }
-
-    cycle->emplace_back(s);
-    std::reverse(cycle->begin(), cycle->end());
-}
-
-
-bool FindACycleInGraph(const std::vector<std::pair<unsigned, unsigned>> &edges, std::vector<unsigned> * const cycle) {
-    cycle->clear();
-    if (edges.empty())
-        return false;
-
-    std::unordered_set<unsigned> nodes;
-    if (not NodeNumberingIsCorrect(edges, &nodes))
-        LOG_ERROR("we don't have the required 0..N-1 labelling of nodes!");
-
-    std::vector<std::vector<unsigned>> neighbours(nodes.size());
-    for (const auto &edge : edges)
-        neighbours[edge.first].emplace_back(edge.second);
-
-    std::vector<bool> visited(nodes.size(), false);
-
-    // Iterative DFS (https://en.wikipedia.org/wiki/Depth-first_search#Pseudocode):
-    unsigned v(0); // NB., "0" is a valid vertex!
-    std::stack<unsigned> stack;
-    stack.push(v);
-    while (not stack.empty()) {
-        v = stack.top();
-        stack.pop();
-        if (visited[v])
-            goto found_a_cycle;
-        visited[v] = true;
-        for (const auto neighbour : neighbours[v])
-            stack.push(neighbour);
-    }
-    return false; // No cycle was found.
-
-found_a_cycle:
-    // Use BFS (https://www.geeksforgeeks.org/shortest-path-weighted-graph-weight-edge-1-2/) to find the nodes in the cycle:
-    visited = std::vector<bool>(nodes.size(), false); // Reset to all false entries.
-    std::vector<int> parents(nodes.size(), -1);
-    std::queue<unsigned> queue;
-    for (unsigned n : neighbours[v])
-        queue.push(n);
-    while (not queue.empty()) {
-        unsigned s(queue.front());
-        if (s == v) {
-            ConstructShortestPath(parents, s, cycle);
-            return true;
-        }
-
-        for (const auto neighbour : neighbours[s]) {
-            if (not visited[neighbour]) {
-                visited[neighbour] = true;
-                queue.push(neighbour);
-                parents[neighbour] = static_cast<int>(s);
-            }
-        }
-
-        queue.pop();
-    }
-
-    return true;
-}
-
-
 bool TopologicalSort(const std::vector<std::pair<unsigned, unsigned>> &edges, std::vector<unsigned> * const node_order,
                      std::vector<unsigned> * const cycle)
 {
@@ -521,42 +450,19 @@ bool TopologicalSort(const std::vector<std::pair<unsigned, unsigned>> &edges, st
     if (not NodeNumberingIsCorrect(edges, &nodes))
         LOG_ERROR("we don't have the required 0..N-1 labelling of nodes!");
 
-    std::vector<std::vector<unsigned>> neighbours(nodes.size());
-    std::vector<unsigned> indegrees(nodes.size());
-    for (const auto &edge : edges) {
-        neighbours[edge.first].emplace_back(edge.second);
-        ++indegrees[edge.second];
-    }
-
-    // Enqueue all nodes with no incident edges:
-    std::queue<unsigned> queue;
-    for (unsigned node(0); node < nodes.size(); ++node) {
-        if (indegrees[node] == 0)
-            queue.push(node);
-    }
-
-    unsigned visited_node_count(0);
-    while (not queue.empty()) {
-        const unsigned current_node(queue.front());
-        node_order->emplace_back(current_node);
-        queue.pop();
-
-        for (auto neighbour : neighbours[current_node]) {
-            if (--indegrees[neighbour] == 0)
-                queue.push(neighbour);
-        }
-
-        ++visited_node_count;
-    }
-
-    if (visited_node_count == nodes.size())
-        return true;
+    std::vector<DirectedGraph::Edge> graph_edges;
+    graph_edges.reserve(edges.size());
+    for (const auto &edge : edges)
+        graph_edges.emplace_back(edge.first, edge.second);
+    const DirectedGraph graph(nodes.size(), graph_edges);
 
-    // If we get here we have at least one cycle!
+    std::vector<DirectedGraph::NodeId> graph_node_order, graph_cycle;
+    const bool is_acyclic(graph.topologicalSort(&graph_node_order, cycle == nullptr ? nullptr : &graph_cycle));
+    node_order->assign(graph_node_order.cbegin(), graph_node_order.cend());
     if (cycle != nullptr)
-        FindACycleInGraph(edges, cycle);
+        cycle->assign(graph_cycle.cbegin(), graph_cycle.cend());
 
-    return false;
+    return is_acyclic;
 }
 
 
@@ -0,0 +1,123 @@
+/** \brief An Aho-Corasick automaton that finds occurrences of many fixed strings in a single pass over a text.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MultiPatternMatcher.h"
+#include <algorithm>
+#include <queue>
+#include <cstring>
+
+
+MultiPatternMatcher::MultiPatternMatcher(const std::vector<std::string> &patterns) {
+    // We only need distinct transitions for bytes that occur in at least one pattern:
+    std::memset(byte_to_class_, 0, sizeof byte_to_class_);
+    class_count_ = 1;
+    for (const auto &pattern : patterns) {
+        for (const char ch : pattern) {
+            if (byte_to_class_[static_cast<uint8_t>(ch)] == 0)
+                byte_to_class_[static_cast<uint8_t>(ch)] = class_count_++;
+        }
+    }
+
+    // Build the trie.  A transition to state 0 means that there is no edge as the start state is nobody's child:
+    transitions_.resize(class_count_);
+    pattern_indices_plus_one_.resize(1);
+    for (size_t pattern_index(0); pattern_index < patterns.size(); ++pattern_index) {
+        const std::string &pattern(patterns[pattern_index]);
+        pattern_lengths_.emplace_back(pattern.length());
+        if (pattern.empty())
+            continue;
+
+        uint32_t state(0);
+        for (const char ch : pattern) {
+            const size_t transition_index(state * class_count_ + byte_to_class_[static_cast<uint8_t>(ch)]);
+            if (transitions_[transition_index] == 0) {
+                transitions_[transition_index] = pattern_indices_plus_one_.size();
+                transitions_.resize(transitions_.size() + class_count_);
+                pattern_indices_plus_one_.emplace_back(0);
+            }
+            state = transitions_[transition_index];
+        }
+        if (pattern_indices_plus_one_[state] == 0)
+            pattern_indices_plus_one_[state] = pattern_index + 1;
+    }
+
+    // Compute the failure links in breadth-first order and turn the trie into a complete automaton:
+    const size_t state_count(pattern_indices_plus_one_.size());
+    std::vector<uint32_t> failure_links(state_count, 0);
+    dictionary_links_.resize(state_count, 0);
+    std::queue<uint32_t> queue;
+    for (unsigned char_class(0); char_class < class_count_; ++char_class) {
+        if (transitions_[char_class] != 0)
+            queue.push(transitions_[char_class]);
+    }
+    while (not queue.empty()) {
+        const uint32_t state(queue.front());
+        queue.pop();
+
+        const uint32_t failure_state(failure_links[state]);
+        for (unsigned char_class(0); char_class < class_count_; ++char_class) {
+            uint32_t &transition(transitions_[state * class_count_ + char_class]);
+            const uint32_t failure_transition(transitions_[failure_state * class_count_ + char_class]);
+            if (transition == 0) {
+                transition = failure_transition;
+                continue;
+            }
+
+            const uint32_t child(transition);
+            failure_links[child] = failure_transition;
+            dictionary_links_[child] = (pattern_indices_plus_one_[failure_transition] != 0) ? failure_transition
+                                                                                             : dictionary_links_[failure_transition];
+            queue.push(child);
+        }
+    }
+}
+
+
+void MultiPatternMatcher::findAll(const std::string &text, std::vector<Match> * const matches) const {
+    matches->clear();
+
+    uint32_t state(0);
+    for (size_t pos(0); pos < text.length(); ++pos) {
+        state = transitions_[state * class_count_ + byte_to_class_[static_cast<uint8_t>(text[pos])]];
+        for (uint32_t output_state(pattern_indices_plus_one_[state] != 0 ? state : dictionary_links_[state]);
+             output_state != 0; output_state = dictionary_links_[output_state])
+        {
+            const size_t pattern_index(pattern_indices_plus_one_[output_state] - 1);
+            const size_t length(pattern_lengths_[pattern_index]);
+            matches->emplace_back(pattern_index, pos + 1 - length, length);
+        }
+    }
+}
+
+
+void MultiPatternMatcher::findLeftmostLongest(const std::string &text, std::vector<Match> * const matches) const {
+    std::vector<Match> all_matches;
+    findAll(text, &all_matches);
+    std::sort(all_matches.begin(), all_matches.end(), [](const Match &lhs, const Match &rhs) {
+        return lhs.start_ < rhs.start_ or (lhs.start_ == rhs.start_ and lhs.length_ > rhs.length_);
+    });
+
+    matches->clear();
+    size_t next_free_pos(0);
+    for (const auto &match : all_matches) {
+        if (match.start_ >= next_free_pos) {
+            matches->emplace_back(match);
+            next_free_pos = match.start_ + match.length_;
+        }
+    }
+}
@@ -27,14 +27,19 @@
 #include "NGram.h"
 #include <algorithm>
 #include <fstream>
+#include <mutex>
 #include <numeric>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <climits>
+#include <cstring>
 #include <cmath>
 #include "BinaryIO.h"
 #include "FileUtil.h"
+#include "StringUtil.h"
 #include "TextUtil.h"
+#include "ThreadPool.h"
 #include "UBTools.h"
 #include "util.h"
 
@@ -64,6 +69,26 @@ void Split(const std::wstring &s, std::vector<std::wstring> * const words) {
 }
 
 
+constexpr uint64_t FNV_OFFSET_BASIS(14695981039346656037ull);
+constexpr uint64_t FNV_PRIME(1099511628211ull);
+
+
+inline uint64_t ExtendHash(const uint64_t state, const wchar_t ch) {
+    return (state ^ static_cast<uint32_t>(ch)) * FNV_PRIME;
+}
+
+
+// FNV-1a on its own spreads n-grams that only differ in their last character badly, so we add MurmurHash3's finaliser.
+inline uint64_t FinaliseHash(uint64_t state) {
+    state ^= state >> 33u;
+    state *= 0xFF51AFD7ED558CCDull;
+    state ^= state >> 33u;
+    state *= 0xC4CEB9FE1A85EC53ull;
+    state ^= state >> 33u;
+    return state;
+}
+
+
 static std::string GetLoadLanguageModelDirectory(const std::string &override_language_models_directory) {
     return override_language_models_directory.empty() ? UBTools::GetTuelibPath() + "/language_models"
                                                       : override_language_models_directory;
@@ -153,6 +178,123 @@ double UnitVector::dotProduct(const UnitVector &rhs) const {
 }
 
 
+uint64_t HashNGram(const wchar_t * const ngram, const size_t length) {
+    uint64_t state(FNV_OFFSET_BASIS);
+    for (size_t i(0); i < length; ++i)
+        state = ExtendHash(state, ngram[i]);
+    return FinaliseHash(state);
+}
+
+
+HashedUnitVector::HashedUnitVector(const UnitVector &unit_vector) {
+    std::vector<std::pair<uint64_t, double>> ngram_ids_and_weights;
+    ngram_ids_and_weights.reserve(unit_vector.size());
+    for (const auto &ngram_and_weight : unit_vector)
+        ngram_ids_and_weights.emplace_back(HashNGram(ngram_and_weight.first.data(), ngram_and_weight.first.size()),
+                                           ngram_and_weight.second);
+    assign(&ngram_ids_and_weights);
+}
+
+
+HashedUnitVector::HashedUnitVector(std::vector<std::pair<uint64_t, double>> ngram_ids_and_weights) {
+    double norm_squared(0.0);
+    for (const auto &ngram_id_and_weight : ngram_ids_and_weights)
+        norm_squared += ngram_id_and_weight.second * ngram_id_and_weight.second;
+
+    if (norm_squared != 0.0) {
+        const double norm(std::sqrt(norm_squared));
+        for (auto &ngram_id_and_weight : ngram_ids_and_weights)
+            ngram_id_and_weight.second /= norm;
+    }
+
+    assign(&ngram_ids_and_weights);
+}
+
+
+void HashedUnitVector::assign(std::vector<std::pair<uint64_t, double>> * const ngram_ids_and_weights) {
+    std::sort(ngram_ids_and_weights->begin(), ngram_ids_and_weights->end());
+
+    ngram_ids_.clear();
+    ngram_ids_.reserve(ngram_ids_and_weights->size());
+    weights_.clear();
+    weights_.reserve(ngram_ids_and_weights->size());
+    for (const auto &ngram_id_and_weight : *ngram_ids_and_weights) {
+        ngram_ids_.emplace_back(ngram_id_and_weight.first);
+        weights_.emplace_back(ngram_id_and_weight.second);
+    }
+}
+
+
+double HashedUnitVector::dotProduct(const HashedUnitVector &rhs) const {
+    // The outcomes of the comparisons are essentially random, so we merge w/o branches that would mostly be mispredicted:
+    const size_t lhs_size(ngram_ids_.size()), rhs_size(rhs.ngram_ids_.size());
+    size_t lhs_index(0), rhs_index(0);
+    double dot_product(0.0);
+    while (lhs_index < lhs_size and rhs_index < rhs_size) {
+        const uint64_t lhs_id(ngram_ids_[lhs_index]), rhs_id(rhs.ngram_ids_[rhs_index]);
+        dot_product += (lhs_id == rhs_id) ? weights_[lhs_index] * rhs.weights_[rhs_index] : 0.0;
+        lhs_index += lhs_id <= rhs_id;
+        rhs_index += rhs_id <= lhs_id;
+    }
+
+    return dot_product;
+}
+
+
+HashedUnitVectorIndex::HashedUnitVectorIndex(const std::vector<const HashedUnitVector *> &vectors)
+    : vector_count_(vectors.size())
+{
+    struct Posting {
+        uint64_t ngram_id_;
+        uint32_t vector_index_;
+        float weight_;
+    public:
+        Posting(const uint64_t ngram_id, const uint32_t vector_index, const float weight)
+            : ngram_id_(ngram_id), vector_index_(vector_index), weight_(weight) { }
+        inline bool operator<(const Posting &rhs) const
+            { return ngram_id_ < rhs.ngram_id_ or (ngram_id_ == rhs.ngram_id_ and vector_index_ < rhs.vector_index_); }
+    };
+
+    std::vector<Posting> postings;
+    for (uint32_t vector_index(0); vector_index < vectors.size(); ++vector_index) {
+        const HashedUnitVector &vector(*vectors[vector_index]);
+        for (size_t i(0); i < vector.ngram_ids_.size(); ++i)
+            postings.emplace_back(vector.ngram_ids_[i], vector_index, static_cast<float>(vector.weights_[i]));
+    }
+    std::sort(postings.begin(), postings.end());
+
+    vector_indices_.reserve(postings.size());
+    weights_.reserve(postings.size());
+    for (const auto &posting : postings) {
+        if (ngram_ids_.empty() or ngram_ids_.back() != posting.ngram_id_) {
+            ngram_ids_.emplace_back(posting.ngram_id_);
+            postings_starts_.emplace_back(vector_indices_.size());
+        }
+        vector_indices_.emplace_back(posting.vector_index_);
+        weights_.emplace_back(posting.weight_);
+    }
+    postings_starts_.emplace_back(vector_indices_.size());
+}
+
+
+void HashedUnitVectorIndex::dotProducts(const HashedUnitVector &query, std::vector<double> * const dot_products) const {
+    dot_products->assign(vector_count_, 0.0);
+
+    // Both, the query's n-gram IDs and ours, are sorted, so each search can start where the previous one ended:
+    auto search_start(ngram_ids_.cbegin());
+    for (size_t i(0); i < query.ngram_ids_.size() and search_start != ngram_ids_.cend(); ++i) {
+        search_start = std::lower_bound(search_start, ngram_ids_.cend(), query.ngram_ids_[i]);
+        if (search_start == ngram_ids_.cend() or *search_start != query.ngram_ids_[i])
+            continue;
+
+        const size_t ngram_index(search_start - ngram_ids_.cbegin());
+        const double query_weight(query.weights_[i]);
+        for (uint32_t posting(postings_starts_[ngram_index]); posting < postings_starts_[ngram_index + 1]; ++posting)
+            (*dot_products)[vector_indices_[posting]] += query_weight * weights_[posting];
+    }
+}
+
+
 void UnitVector::prettyPrint(std::ostream &output) const {
     output << "#entries = " << size() << '\n';
     for (const auto &ngram_and_core : *this)
@@ -186,6 +328,8 @@ void LanguageModel::deserialise(File &input) {
 
         emplace_back(ngram, score);
     }
+
+    hashed_unit_vector_ = HashedUnitVector(*this);
 }
 
 
@@ -203,43 +347,120 @@ void LoadLanguageModel(const std::string &language, LanguageModel * const langua
 }
 
 
+typedef std::unordered_map<std::wstring, double> NGramCountsMap;
+
+
 static inline void ExtractAndCountNGram(const std::wstring &word, const size_t offset, const size_t prefix_length,
-                                        std::unordered_map<std::wstring, double> * const ngram_counts_map)
+                                        NGramCountsMap * const ngram_counts_map)
 {
-    const std::wstring ngram(word.substr(offset, prefix_length));
-    auto ngram_count(ngram_counts_map->find(ngram));
-    if (ngram_count == ngram_counts_map->end())
-        (*ngram_counts_map)[ngram] = 1.0;
-    else
-        ++(*ngram_counts_map)[ngram];
+    ++(*ngram_counts_map)[word.substr(offset, prefix_length)];
 }
 
 
-void CreateLanguageModel(std::istream &input, LanguageModel * const language_model, const unsigned ngram_number_threshold,
-                         const unsigned topmost_use_count)
-{
-    const std::string file_contents(std::istreambuf_iterator<char>(input), {});
-    const std::wstring filtered_text(PreprocessText(file_contents));
-
+static void CountNGrams(const std::string &text, NGramCountsMap * const ngram_counts_map) {
     std::vector<std::wstring> words;
-    Split(filtered_text, &words);
+    Split(PreprocessText(text), &words);
 
-    std::unordered_map<std::wstring, double> ngram_counts_map;
     for (const auto &word : words) {
         const std::wstring funny_word(L"_" + word + L"_");
         const std::wstring::size_type funny_word_length(funny_word.length());
         std::wstring::size_type length(funny_word_length);
         for (unsigned i(0); i < funny_word_length; ++i, --length) {
             if (length > 4)
-                ExtractAndCountNGram(funny_word, i, 5, &ngram_counts_map);
+                ExtractAndCountNGram(funny_word, i, 5, ngram_counts_map);
             if (length > 3)
-                ExtractAndCountNGram(funny_word, i, 4, &ngram_counts_map);
+                ExtractAndCountNGram(funny_word, i, 4, ngram_counts_map);
             if (length > 2)
-                ExtractAndCountNGram(funny_word, i, 3, &ngram_counts_map);
+                ExtractAndCountNGram(funny_word, i, 3, ngram_counts_map);
             if (length > 1)
-                ExtractAndCountNGram(funny_word, i, 2, &ngram_counts_map);
+                ExtractAndCountNGram(funny_word, i, 2, ngram_counts_map);
             if (funny_word[i] != '_') // Ignore single spaces!
-                ExtractAndCountNGram(funny_word, i, 1, &ngram_counts_map);
+                ExtractAndCountNGram(funny_word, i, 1, ngram_counts_map);
+        }
+    }
+}
+
+
+// Splits "text" into "chunk_count" pieces of roughly equal size at ASCII whitespace, which never occurs inside of a
+// multibyte UTF-8 sequence and always separates words, so that counting the pieces yields the same counts as counting "text".
+static std::vector<std::string> SplitAtWhitespace(const std::string &text, const size_t chunk_count) {
+    std::vector<std::string> chunks;
+    const size_t target_chunk_size(text.size() / std::max(chunk_count, size_t(1)) + 1);
+    size_t chunk_start(0);
+    while (chunk_start < text.size()) {
+        size_t chunk_end(std::min(chunk_start + target_chunk_size, text.size()));
+        while (chunk_end < text.size() and std::strchr(" \t\n\v\f\r", text[chunk_end]) == nullptr)
+            ++chunk_end;
+        chunks.emplace_back(text, chunk_start, chunk_end - chunk_start);
+        chunk_start = chunk_end;
+    }
+
+    return chunks;
+}
+
+
+void CreateLanguageModel(std::istream &input, LanguageModel * const language_model, const unsigned ngram_number_threshold,
+                         const unsigned topmost_use_count)
+{
+    const std::string file_contents(std::istreambuf_iterator<char>(input), {});
+    CreateLanguageModel(std::vector<std::string>{ file_contents }, language_model, ngram_number_threshold, topmost_use_count);
+}
+
+
+void CreateLanguageModel(const std::vector<std::string> &texts, LanguageModel * const language_model,
+                         const unsigned ngram_number_threshold, const unsigned topmost_use_count, unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    // A few large texts, e.g. a single language blob, would leave most threads idle:
+    if (texts.size() < thread_count and thread_count > 1) {
+        std::vector<std::string> chunks;
+        for (const auto &text : texts) {
+            for (auto &chunk : SplitAtWhitespace(text, thread_count))
+                chunks.emplace_back(std::move(chunk));
+        }
+        if (chunks.size() > texts.size()) {
+            CreateLanguageModel(chunks, language_model, ngram_number_threshold, topmost_use_count, thread_count);
+            return;
+        }
+    }
+
+    // Each shard is a contiguous range of "texts" w/ about the same number of bytes and gets its own counts map, so
+    // that the threads never have to synchronise while counting:
+    size_t total_size(0);
+    for (const auto &text : texts)
+        total_size += text.size();
+    const size_t shard_count(std::max(size_t(1), std::min(size_t(thread_count), texts.size())));
+    std::vector<size_t> shard_starts{ 0 };
+    size_t accumulated_size(0);
+    for (size_t text_index(0); text_index < texts.size() and shard_starts.size() < shard_count; ++text_index) {
+        accumulated_size += texts[text_index].size();
+        if (accumulated_size >= total_size * shard_starts.size() / shard_count)
+            shard_starts.emplace_back(text_index + 1);
+    }
+    shard_starts.emplace_back(texts.size());
+
+    std::vector<NGramCountsMap> shard_counts_maps(shard_starts.size() - 1);
+    {
+        // The calling thread helps out in parallelFor(), hence one worker less:
+        ThreadPool thread_pool(thread_count > 1 ? thread_count - 1 : 1);
+        thread_pool.parallelFor(0, shard_counts_maps.size(), [&](const size_t shard_index) {
+            for (size_t text_index(shard_starts[shard_index]); text_index < shard_starts[shard_index + 1]; ++text_index)
+                CountNGrams(texts[text_index], &shard_counts_maps[shard_index]);
+        }, /* chunk_size = */1);
+    }
+
+    // Merge everything into the largest map:
+    NGramCountsMap ngram_counts_map;
+    if (not shard_counts_maps.empty()) {
+        auto largest_map(std::max_element(shard_counts_maps.begin(), shard_counts_maps.end(),
+                                          [](const NGramCountsMap &lhs, const NGramCountsMap &rhs) { return lhs.size() < rhs.size(); }));
+        ngram_counts_map.swap(*largest_map);
+        for (auto &shard_counts_map : shard_counts_maps) {
+            for (const auto &ngram_and_count : shard_counts_map)
+                ngram_counts_map[ngram_and_count.first] += ngram_and_count.second;
+            NGramCountsMap().swap(shard_counts_map);
         }
     }
 
@@ -250,11 +471,13 @@ void CreateLanguageModel(std::istream &input, LanguageModel * const language_mod
             ngram_counts_vector.emplace_back(ngram_and_count);
     }
 
+    // Ties are broken by the n-grams themselves so that the model does not depend on the sharding or the hash map order:
     std::sort(ngram_counts_vector.begin(), ngram_counts_vector.end(),
-              [](const std::pair<std::wstring, double> &a, const std::pair<std::wstring, double> &b){ return a.second > b.second; });
+              [](const std::pair<std::wstring, double> &a, const std::pair<std::wstring, double> &b)
+                  { return a.second > b.second or (a.second == b.second and a.first < b.first); });
 
-    if (unlikely(ngram_counts_map.size() < topmost_use_count))
-        LOG_DEBUG("generated too few ngrams (" + std::to_string(ngram_counts_map.size()) + " < " + std::to_string(topmost_use_count)
+    if (unlikely(ngram_counts_vector.size() < topmost_use_count))
+        LOG_DEBUG("generated too few ngrams (" + std::to_string(ngram_counts_vector.size()) + " < " + std::to_string(topmost_use_count)
                     + ")!");
     else
         ngram_counts_vector.resize(topmost_use_count);
@@ -263,37 +486,113 @@ void CreateLanguageModel(std::istream &input, LanguageModel * const language_mod
 }
 
 
-void ClassifyLanguage(std::istream &input, std::vector<std::string> * const top_languages, const std::set<std::string> &considered_languages,
-                      const double alternative_cutoff_factor, const std::string &override_language_models_directory)
-{
-    LanguageModel unknown_language_model;
-    CreateLanguageModel(input, &unknown_language_model);
+HashedUnitVector CreateHashedUnitVector(const std::string &text, const unsigned topmost_use_count) {
+    std::vector<std::wstring> words;
+    Split(PreprocessText(text), &words);
+
+    // Hash the same n-grams as CreateLanguageModel() extracts, extending the hash of the shorter n-grams at each offset:
+    std::vector<uint64_t> ngram_ids;
+    std::wstring funny_word;
+    for (const auto &word : words) {
+        funny_word.assign(1, L'_');
+        funny_word += word;
+        funny_word += L'_';
+        for (size_t offset(0); offset < funny_word.length(); ++offset) {
+            const size_t max_ngram_length(std::min<size_t>(5, funny_word.length() - offset));
+            uint64_t state(FNV_OFFSET_BASIS);
+            for (size_t ngram_length(1); ngram_length <= max_ngram_length; ++ngram_length) {
+                state = ExtendHash(state, funny_word[offset + ngram_length - 1]);
+                if (ngram_length > 1 or funny_word[offset] != L'_') // Ignore single spaces!
+                    ngram_ids.emplace_back(FinaliseHash(state));
+            }
+        }
+    }
+
+    // Counting sorted IDs is a lot cheaper than a hash table:
+    std::sort(ngram_ids.begin(), ngram_ids.end());
+    std::vector<std::pair<uint64_t, double>> ngram_ids_and_counts;
+    for (auto run_start(ngram_ids.cbegin()); run_start != ngram_ids.cend(); /* Intentionally empty! */) {
+        auto run_end(run_start + 1);
+        while (run_end != ngram_ids.cend() and *run_end == *run_start)
+            ++run_end;
+        ngram_ids_and_counts.emplace_back(*run_start, run_end - run_start);
+        run_start = run_end;
+    }
 
-    static std::vector<LanguageModel> language_models;
-    if (language_models.empty()) {
-        if (not LoadLanguageModels(&language_models, override_language_models_directory))
+    if (ngram_ids_and_counts.size() > topmost_use_count) {
+        std::nth_element(ngram_ids_and_counts.begin(), ngram_ids_and_counts.begin() + topmost_use_count, ngram_ids_and_counts.end(),
+                         [](const std::pair<uint64_t, double> &a, const std::pair<uint64_t, double> &b)
+                             { return a.second > b.second or (a.second == b.second and a.first < b.first); });
+        ngram_ids_and_counts.resize(topmost_use_count);
+    }
+
+    return HashedUnitVector(std::move(ngram_ids_and_counts));
+}
+
+
+namespace {
+
+
+std::mutex language_models_mutex;
+
+
+struct LanguageModels {
+    std::vector<LanguageModel> models_;
+    HashedUnitVectorIndex index_; // Over the hashed unit vectors of "models_", in the same order.
+};
+
+
+// The models are loaded once and never modified afterwards, so any number of threads may use them concurrently.
+const LanguageModels &GetLanguageModels(const std::string &override_language_models_directory) {
+    static LanguageModels language_models;
+
+    std::lock_guard<std::mutex> language_models_locker(language_models_mutex);
+    if (language_models.models_.empty()) {
+        if (not LoadLanguageModels(&language_models.models_, override_language_models_directory))
             LOG_ERROR("no language models available in \"" + GetLoadLanguageModelDirectory(override_language_models_directory) + "\"!");
-        LOG_DEBUG("loaded " + std::to_string(language_models.size()) + " language models.");
+        LOG_DEBUG("loaded " + std::to_string(language_models.models_.size()) + " language models.");
+
+        std::vector<const HashedUnitVector *> hashed_unit_vectors;
+        for (const auto &language_model : language_models.models_)
+            hashed_unit_vectors.emplace_back(&language_model.getHashedUnitVector());
+        language_models.index_ = HashedUnitVectorIndex(hashed_unit_vectors);
     }
 
-    // Verify that we do have models for all requested languages:
-    if (not considered_languages.empty()) {
-        std::unordered_set<std::string> all_languages;
-        for (const auto &language_model : language_models)
-            all_languages.emplace(language_model.getLanguage());
+    return language_models;
+}
 
-        for (const auto &requested_language : considered_languages) {
-            if (unlikely(all_languages.find(requested_language) == all_languages.cend()))
-                LOG_ERROR("considered language \"" + requested_language + "\" is not supported!");
-        }
+
+// Verify that we do have models for all requested languages:
+void VerifyConsideredLanguages(const std::vector<LanguageModel> &language_models, const std::set<std::string> &considered_languages) {
+    if (considered_languages.empty())
+        return;
+
+    std::unordered_set<std::string> all_languages;
+    for (const auto &language_model : language_models)
+        all_languages.emplace(language_model.getLanguage());
+
+    for (const auto &requested_language : considered_languages) {
+        if (unlikely(all_languages.find(requested_language) == all_languages.cend()))
+            LOG_ERROR("considered language \"" + requested_language + "\" is not supported!");
     }
+}
+
+
+void RankLanguages(const LanguageModels &language_models, const HashedUnitVector &unknown_unit_vector,
+                   const std::set<std::string> &considered_languages, const double alternative_cutoff_factor,
+                   std::vector<std::string> * const top_languages)
+{
+    // Score against all models at once, even the ones we don't consider, as that is cheaper than merging per model:
+    std::vector<double> similarities;
+    language_models.index_.dotProducts(unknown_unit_vector, &similarities);
 
     std::vector<std::pair<std::string, double>> languages_and_scores;
-    for (const auto &language_model : language_models) {
+    for (size_t model_index(0); model_index < language_models.models_.size(); ++model_index) {
+        const LanguageModel &language_model(language_models.models_[model_index]);
         if (not considered_languages.empty() and considered_languages.find(language_model.getLanguage()) == considered_languages.cend())
             continue;
 
-        const double similarity(language_model.similarity(unknown_language_model));
+        const double similarity(similarities[model_index]);
         languages_and_scores.emplace_back(language_model.getLanguage(), similarity);
         LOG_DEBUG(language_model.getLanguage() + " scored :" + std::to_string(similarity));
     }
@@ -308,6 +607,64 @@ void ClassifyLanguage(std::istream &input, std::vector<std::string> * const top_
 }
 
 
+// A cheap test that avoids building n-gram vectors for things like page numbers, years and initials.  Non-ASCII
+// characters are optimistically counted as letters.
+bool HasEnoughLetters(const std::string &text) {
+    unsigned letter_count(0);
+    for (const char ch : text) {
+        if (StringUtil::IsAsciiLetter(ch) or static_cast<unsigned char>(ch) >= 0xC0u /* UTF-8 lead byte */) {
+            if (++letter_count == MIN_BATCH_LETTER_COUNT)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+} // unnamed namespace
+
+
+void ClassifyLanguage(std::istream &input, std::vector<std::string> * const top_languages, const std::set<std::string> &considered_languages,
+                      const double alternative_cutoff_factor, const std::string &override_language_models_directory)
+{
+    const HashedUnitVector unknown_unit_vector(CreateHashedUnitVector(std::string(std::istreambuf_iterator<char>(input), {})));
+
+    const auto &language_models(GetLanguageModels(override_language_models_directory));
+    VerifyConsideredLanguages(language_models.models_, considered_languages);
+    RankLanguages(language_models, unknown_unit_vector, considered_languages, alternative_cutoff_factor, top_languages);
+}
+
+
+std::vector<std::vector<std::string>> ClassifyBatch(const std::vector<std::string> &texts, const std::set<std::string> &considered_languages,
+                                                    const double alternative_cutoff_factor,
+                                                    const std::string &override_language_models_directory, unsigned thread_count)
+{
+    const auto &language_models(GetLanguageModels(override_language_models_directory));
+    VerifyConsideredLanguages(language_models.models_, considered_languages);
+
+    std::vector<std::vector<std::string>> top_languages_per_text(texts.size());
+
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    // The calling thread helps out in parallelFor(), hence one worker less:
+    ThreadPool thread_pool(thread_count > 1 ? thread_count - 1 : 1);
+    thread_pool.parallelFor(0, texts.size(), [&](const size_t text_index) {
+        if (not HasEnoughLetters(texts[text_index]))
+            return;
+
+        const HashedUnitVector unknown_unit_vector(CreateHashedUnitVector(texts[text_index]));
+        if (unknown_unit_vector.size() == 0)
+            return;
+        RankLanguages(language_models, unknown_unit_vector, considered_languages, alternative_cutoff_factor,
+                      &top_languages_per_text[text_index]);
+    });
+
+    return top_languages_per_text;
+}
+
+
 void CreateAndWriteLanguageModel(std::istream &input, const std::string &output_path, const unsigned ngram_number_threshold,
                                  const unsigned topmost_use_count)
 {
@@ -319,4 +676,15 @@ void CreateAndWriteLanguageModel(std::istream &input, const std::string &output_
 }
 
 
+void CreateAndWriteLanguageModel(const std::vector<std::string> &texts, const std::string &output_path,
+                                 const unsigned ngram_number_threshold, const unsigned topmost_use_count, const unsigned thread_count)
+{
+    LanguageModel language_model;
+    CreateLanguageModel(texts, &language_model, ngram_number_threshold, topmost_use_count, thread_count);
+
+    const auto output(FileUtil::OpenOutputFileOrDie(output_path));
+    language_model.serialise(*output);
+}
+
+
 } // namespace NGram
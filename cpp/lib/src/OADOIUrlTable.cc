@@ -0,0 +1,328 @@
+/** \brief A persistent, memory-mapped table that maps DOI's to the open access URL's found by oaDOI/Unpaywall.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "OADOIUrlTable.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "File.h"
+#include "FileUtil.h"
+#include "JSON.h"
+#include "util.h"
+
+
+// Offsets are relative to the start of the string pool.
+struct OADOIUrlTable::StringRef {
+    uint32_t offset_, length_;
+};
+
+
+struct OADOIUrlTable::Entry {
+    StringRef doi_, url_, evidence_, host_type_;
+};
+
+
+namespace {
+
+
+const char TABLE_MAGIC[8]{ 'U', 'B', 'O', 'A', 'D', 'O', 'I', 'T' };
+const uint64_t TABLE_VERSION(1);
+
+
+// All members are 8 bytes wide so that there is no padding.  The header is followed by the entry table and finally the
+// string pool.
+struct TableHeader {
+    char magic_[sizeof TABLE_MAGIC];
+    uint64_t version_;
+    uint64_t json_file_size_;
+    int64_t json_mtime_seconds_;
+    int64_t json_mtime_nanoseconds_;
+    uint64_t entry_count_;
+    uint64_t string_pool_size_;
+};
+
+
+void StatOrDie(const std::string &path, struct stat * const stat_buf) {
+    if (unlikely(::stat(path.c_str(), stat_buf) != 0))
+        LOG_ERROR("stat(2) on \"" + path + "\" failed!");
+}
+
+
+inline bool HeaderMatchesFile(const TableHeader &header, const struct stat &stat_buf) {
+    return std::memcmp(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC) == 0 and header.version_ == TABLE_VERSION
+           and header.json_file_size_ == static_cast<uint64_t>(stat_buf.st_size)
+           and header.json_mtime_seconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_sec)
+           and header.json_mtime_nanoseconds_ == static_cast<int64_t>(stat_buf.st_mtim.tv_nsec);
+}
+
+
+// Uses the same ordering as std::string, i.e. bytes compare as unsigned chars.
+inline int Compare(const StringView &lhs, const std::string &rhs) {
+    const int cmp(std::memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size())));
+    if (cmp != 0)
+        return cmp;
+    return (lhs.size() < rhs.size()) ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+
+struct RawEntry {
+    std::string doi_, url_, evidence_, host_type_;
+public:
+    RawEntry(const std::string &doi, const std::string &url, const std::string &evidence, const std::string &host_type)
+        : doi_(doi), url_(url), evidence_(evidence), host_type_(host_type) { }
+};
+
+
+// Only evidences and host types are worth interning, DOI's are unique and URL's hardly ever repeat.
+class StringPool {
+    std::string pool_;
+    std::unordered_map<std::string, uint32_t> strings_to_offsets_map_;
+public:
+    /** \return The offset of "s" in our pool. */
+    uint32_t append(const std::string &s) {
+        if (unlikely(pool_.size() + s.length() > std::numeric_limits<uint32_t>::max()))
+            LOG_ERROR("string pool overflow!");
+        const uint32_t offset(pool_.size());
+        pool_ += s;
+        return offset;
+    }
+
+    /** \return The offset of "s" in our pool. */
+    uint32_t intern(const std::string &s) {
+        const auto string_and_offset(strings_to_offsets_map_.find(s));
+        if (string_and_offset != strings_to_offsets_map_.cend())
+            return string_and_offset->second;
+
+        const uint32_t offset(append(s));
+        strings_to_offsets_map_.emplace(s, offset);
+        return offset;
+    }
+
+    inline const std::string &getPool() const { return pool_; }
+};
+
+
+// Writes the table to a temporary file first so that concurrent readers never see a partially written table.
+bool WriteTable(const std::string &table_path, const std::string &table) {
+    const std::string temp_path(table_path + ".tmp");
+    File output(temp_path, "w");
+    if (output.fail() or not output.write(table) or not output.close()) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return FileUtil::RenameFile(temp_path, table_path, /* remove_target = */true);
+}
+
+
+} // unnamed namespace
+
+
+std::string OADOIUrlTable::Generate(const std::string &json_path) {
+    struct stat stat_buf;
+    StatOrDie(json_path, &stat_buf);
+
+    std::vector<RawEntry> raw_entries;
+    // The entries are either the elements of a top-level array or a sequence of top-level objects, i.e. JSON Lines:
+    const auto reader(JSON::PullReader::FromFile(json_path));
+    JSON::PullReader::EventType event;
+    while ((event = reader->next()) != JSON::PullReader::END_OF_INPUT) {
+        if (event == JSON::PullReader::START_ARRAY and reader->getDepth() == 1)
+            continue;
+        if (event == JSON::PullReader::END_ARRAY and reader->getDepth() == 0)
+            continue;
+
+        std::shared_ptr<JSON::JSONNode> entry;
+        if (unlikely(event != JSON::PullReader::START_OBJECT or not reader->readValue(&entry)))
+            LOG_ERROR("Could not properly parse \"" + json_path + "\": "
+                      + (event == JSON::PullReader::ERROR or reader->getLastEvent() == JSON::PullReader::ERROR
+                         ? reader->getErrorMessage() : "expected an object on line " + std::to_string(reader->getLineNumber())));
+
+        const std::string doi(LookupString("/doi", entry));
+        const std::string url(LookupString("/best_oa_location/url", entry));
+        if (doi.empty() or url.empty())
+            LOG_ERROR("Either doi or url missing");
+        raw_entries.emplace_back(doi, url, LookupString("/best_oa_location/evidence", entry),
+                                 LookupString("/best_oa_location/host_type", entry));
+    }
+
+    std::stable_sort(raw_entries.begin(), raw_entries.end(),
+                     [](const RawEntry &lhs, const RawEntry &rhs) { return lhs.doi_ < rhs.doi_; });
+
+    StringPool string_pool;
+    const auto append([&string_pool](const std::string &s) {
+        return StringRef{ string_pool.append(s), static_cast<uint32_t>(s.length()) };
+    });
+    const auto intern([&string_pool](const std::string &s) {
+        return StringRef{ string_pool.intern(s), static_cast<uint32_t>(s.length()) };
+    });
+
+    std::vector<Entry> entries;
+    entries.reserve(raw_entries.size());
+    for (auto raw_entry(raw_entries.cbegin()); raw_entry != raw_entries.cend(); ++raw_entry) {
+        if (raw_entry != raw_entries.cbegin() and raw_entry->doi_ == (raw_entry - 1)->doi_)
+            continue; // The first occurrence wins.
+        entries.emplace_back(Entry{ append(raw_entry->doi_), append(raw_entry->url_), intern(raw_entry->evidence_),
+                                    intern(raw_entry->host_type_) });
+    }
+
+    TableHeader header;
+    std::memcpy(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC);
+    header.version_                = TABLE_VERSION;
+    header.json_file_size_         = stat_buf.st_size;
+    header.json_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.json_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.entry_count_            = entries.size();
+    header.string_pool_size_       = string_pool.getPool().size();
+
+    std::string table(reinterpret_cast<const char *>(&header), sizeof header);
+    table.append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    table += string_pool.getPool();
+
+    return table;
+}
+
+
+OADOIUrlTable::OADOIUrlTable(const std::string &json_path)
+    : table_path_(GetTablePath(json_path)), mmap_(nullptr), mmap_size_(0), entries_(nullptr), entry_count_(0),
+      string_pool_(nullptr)
+{
+    if (mapTable(json_path))
+        return;
+
+    in_memory_table_ = Generate(json_path);
+    if (not WriteTable(table_path_, in_memory_table_))
+        LOG_WARNING("failed to write \"" + table_path_ + "\", keeping the DOI table in memory!");
+    else if (mapTable(json_path)) {
+        in_memory_table_.clear();
+        in_memory_table_.shrink_to_fit();
+        return;
+    }
+
+    setTables(in_memory_table_.data());
+}
+
+
+OADOIUrlTable::~OADOIUrlTable() {
+    if (mmap_ != nullptr and ::munmap(const_cast<char *>(mmap_), mmap_size_) != 0)
+        LOG_ERROR("munmap(2) on \"" + table_path_ + "\" failed!");
+}
+
+
+bool OADOIUrlTable::lookup(const std::string &doi, OAInfo * const oa_info) const {
+    size_t low(0), high(entry_count_);
+    while (low < high) {
+        const size_t middle(low + (high - low) / 2);
+        const int cmp(Compare(getString(entries_[middle].doi_), doi));
+        if (cmp < 0)
+            low = middle + 1;
+        else if (cmp > 0)
+            high = middle;
+        else {
+            oa_info->url_       = getString(entries_[middle].url_);
+            oa_info->evidence_  = getString(entries_[middle].evidence_);
+            oa_info->host_type_ = getString(entries_[middle].host_type_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool OADOIUrlTable::IsUpToDate(const std::string &json_path) {
+    File table(GetTablePath(json_path), "r");
+    if (table.fail())
+        return false;
+
+    TableHeader header;
+    if (table.read(&header, sizeof header) != sizeof header)
+        return false;
+
+    struct stat stat_buf;
+    StatOrDie(json_path, &stat_buf);
+    return HeaderMatchesFile(header, stat_buf);
+}
+
+
+size_t OADOIUrlTable::Create(const std::string &json_path) {
+    const std::string table(Generate(json_path));
+    const std::string table_path(GetTablePath(json_path));
+    if (unlikely(not WriteTable(table_path, table)))
+        LOG_ERROR("failed to write \"" + table_path + "\"!");
+
+    return reinterpret_cast<const TableHeader *>(table.data())->entry_count_;
+}
+
+
+bool OADOIUrlTable::mapTable(const std::string &json_path) {
+    const int fd(::open(table_path_.c_str(), O_RDONLY));
+    if (fd == -1)
+        return false;
+
+    struct stat table_stat_buf;
+    if (unlikely(::fstat(fd, &table_stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + table_path_ + "\" failed!");
+    if (static_cast<size_t>(table_stat_buf.st_size) < sizeof(TableHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * const mapping(::mmap(nullptr, table_stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap \"" + table_path_ + "\"!");
+
+    struct stat json_stat_buf;
+    StatOrDie(json_path, &json_stat_buf);
+    const TableHeader * const header(reinterpret_cast<const TableHeader *>(mapping));
+    if (not HeaderMatchesFile(*header, json_stat_buf)
+        or static_cast<size_t>(table_stat_buf.st_size)
+           != sizeof(TableHeader) + header->entry_count_ * sizeof(Entry) + header->string_pool_size_)
+    {
+        ::munmap(mapping, table_stat_buf.st_size);
+        return false;
+    }
+
+    mmap_ = reinterpret_cast<const char *>(mapping);
+    mmap_size_ = table_stat_buf.st_size;
+    setTables(mmap_);
+
+    return true;
+}
+
+
+void OADOIUrlTable::setTables(const char * const table_start) {
+    const TableHeader * const header(reinterpret_cast<const TableHeader *>(table_start));
+    entries_      = reinterpret_cast<const Entry *>(table_start + sizeof(TableHeader));
+    entry_count_  = header->entry_count_;
+    string_pool_  = table_start + sizeof(TableHeader) + entry_count_ * sizeof(Entry);
+}
+
+
+inline StringView OADOIUrlTable::getString(const StringRef &string_ref) const {
+    return StringView(string_pool_ + string_ref.offset_, string_ref.length_);
+}
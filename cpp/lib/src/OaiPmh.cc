@@ -33,6 +33,7 @@
 #include "HtmlUtil.h"
 #include "IniFile.h"
 #include "StringUtil.h"
+#include "XMLParser.h"
 
 
 namespace OaiPmh {
@@ -51,6 +52,36 @@ HarvestMode StringToHarvestMode(const std::string &harvest_mode_str) {
 }
 
 
+std::string ExtractResumptionToken(const std::string &xml_document, std::string * const cursor,
+                                   std::string * const complete_list_size)
+{
+    if (cursor != NULL)
+        cursor->clear();
+    if (complete_list_size != NULL)
+        complete_list_size->clear();
+
+    XMLParser xml_parser(xml_document, XMLParser::XML_STRING);
+    XMLParser::XMLPart xml_part;
+    if (not xml_parser.skipTo(XMLParser::XMLPart::OPENING_TAG, "resumptionToken", &xml_part))
+        return "";
+
+    // Extract the "cursor" and "completeListSize" attributes:
+    const auto cursor_name_and_value(xml_part.attributes_.find("cursor"));
+    if (cursor != NULL and cursor_name_and_value != xml_part.attributes_.end())
+        *cursor = cursor_name_and_value->second;
+    const auto complete_list_size_name_and_value(xml_part.attributes_.find("completeListSize"));
+    if (complete_list_size != NULL and complete_list_size_name_and_value != xml_part.attributes_.end())
+        *complete_list_size = complete_list_size_name_and_value->second;
+
+    if (not xml_parser.getNext(&xml_part) or xml_part.type_ == XMLParser::XMLPart::CLOSING_TAG)
+        return "";
+    if (unlikely(xml_part.type_ != XMLParser::XMLPart::CHARACTERS))
+        throw std::runtime_error("in OaiPmh::ExtractResumptionToken: strange resumption token XML structure!");
+
+    return StringUtil::TrimWhite(xml_part.data_);
+}
+
+
 // Field::Field -- Construct an unqulaified OAI-PMH metadata element.
 //
 Field::Field(const std::string &field_name, const std::string &value, const std::string &attribute)
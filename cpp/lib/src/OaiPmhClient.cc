@@ -27,13 +27,16 @@
  */
 
 #include "OaiPmhClient.h"
+#include <functional>
 #include <map>
 #include <stdexcept>
+#include <thread>
 #include "FileUtil.h"
 #include "HtmlUtil.h"
 #include "IniFile.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
+#include "ThreadUtil.h"
 #include "Url.h"
 #include "UrlUtil.h"
 #include "util.h"
@@ -62,16 +65,17 @@ class ListRecordsParser {
     std::string datestamp_;          //< Will hold the value of the "datestamp" element.
     std::list<OaiPmh::Field> metadata_fields_; //< The list of metadata fields for the current record.
 
-    /** The records received. */
-    std::list<OaiPmh::Record> records_;
+    /** Gets each record as soon as we have parsed it. */
+    const std::function<void(const OaiPmh::Record &record)> record_handler_;
     /** The number of records received. */
     unsigned received_record_count_;
 
-    /** Update the database with a complete received record. */
+    /** Hand a complete received record to our record handler. */
     bool importReceivedRecord();
 public:
     /** Construct a ListRecords parser. */
-    ListRecordsParser(): detected_error_(false), received_record_count_(0) { }
+    explicit ListRecordsParser(const std::function<void(const OaiPmh::Record &record)> &record_handler)
+        : detected_error_(false), record_handler_(record_handler), received_record_count_(0) { }
     void parse(const std::string &xml_document, const unsigned verbosity);
 
     /** Return true if an error was detected. */
@@ -86,9 +90,6 @@ public:
     /** Get the responseDate (if any) extracted from the XML file. */
     std::string getResponseDate() const { return response_date_; }
 
-    /** Get the metadata records extracted from the XML file. */
-    const std::list<OaiPmh::Record> &getRecords() const { return records_; }
-
     /** Get the number of records extracted from the XML file.*/
     unsigned getRecordCount() const { return received_record_count_; }
 };
@@ -107,9 +108,10 @@ bool ListRecordsParser::importReceivedRecord() {
         logger->info("Parser creating record: " + identifier_);
 
     // Create a result:
-    records_.push_back(OaiPmh::Record(identifier_, datestamp_));
+    OaiPmh::Record record(identifier_, datestamp_);
     for (const auto &field : metadata_fields_)
-        records_.back().addField(field);
+        record.addField(field);
+    record_handler_(record);
 
     // All done:
     ++received_record_count_;
@@ -195,11 +197,9 @@ void ListRecordsParser::parse(const std::string &xml_document, const unsigned ve
                     HtmlUtil::HtmlEscape(&current_tag_value);
                 metadata_fields_.push_back(OaiPmh::Field(current_tag_name, current_tag_value, current_tag_attrib));
                 current_tag_name.clear();
-            } else if (xml_part.data_ == "record") {
+            } else if (xml_part.data_ == "record")
                 // The end of the record, save to database:
                 importReceivedRecord();
-                return;
-            }
 
             // Make sure that when we open simple tags, we immediately close them (i.e. they are not nested).
             if (unlikely(response_date_tag_open))
@@ -307,12 +307,53 @@ bool GetListRecordsResponse(const std::string &server_url, const std::string &fr
 }
 
 
+/** One ListRecords response as handed from the download thread to the harvesting thread. */
+struct ListRecordsPage {
+    std::string xml_document_;
+    std::string resumption_token_; //< The token that was used to request this page, empty for the first page.
+    std::string error_message_;    //< If non-empty, the download failed and this is the last page.
+};
+
+
+// Downloads ListRecords pages and queues them until there are no more resumption tokens.  The token for the next
+// request is extracted w/ a cheap scan so that the next download runs concurrently w/ the parsing of the current page.
+void FetchListRecordsPages(const std::string &server_url, const std::string &from, const std::string &until,
+                           const std::string &set_spec, const std::string &metadata_prefix, const unsigned verbosity,
+                           Logger * const logger, ThreadUtil::BoundedQueue<ListRecordsPage> * const page_queue)
+{
+    std::string resumption_token;
+    do {
+        ListRecordsPage page;
+        page.resumption_token_ = resumption_token;
+        try {
+            if (not GetListRecordsResponse(server_url, from, until, set_spec, metadata_prefix, resumption_token,
+                                           verbosity, logger, &page.xml_document_))
+                page.error_message_ = "An error occurred while talking to the OAI-PMH server!";
+            else
+                resumption_token = OaiPmh::ExtractResumptionToken(page.xml_document_);
+        } catch (const std::exception &x) {
+            page.error_message_ = x.what();
+        }
+
+        if (not page.error_message_.empty())
+            resumption_token.clear();
+        if (not page_queue->push(std::move(page)))
+            break; // The harvesting thread has given up.
+    } while (not resumption_token.empty());
+
+    page_queue->close();
+}
+
+
 } // unnamed namespace
 
 
 namespace OaiPmh {
 
 
+const unsigned DEFAULT_MAX_PREFETCHED_PAGES(2);
+
+
 std::string Client::MetadataFormatDescriptor::toString() const {
     std::string as_string;
     as_string += "metadataPrefix: " + metadata_prefix_;
@@ -339,6 +380,11 @@ Client::Client(const IniFile &ini_file, const std::string &section_name) {
     // The harvest mode:
     harvest_mode_ = StringToHarvestMode(ini_file.getString(section_name, "harvest_mode"));
 
+    // How many ListRecords responses may be downloaded ahead of the one that is being processed:
+    max_prefetched_pages_ = ini_file.getUnsigned(section_name, "max_prefetched_pages", DEFAULT_MAX_PREFETCHED_PAGES);
+    if (unlikely(max_prefetched_pages_ == 0))
+        throw std::runtime_error("in OaiPmh::Client::Client: max_prefetched_pages must be positive!");
+
     // Initialise the response date, which will later be saved in the progress file.
     first_response_date_.clear();
 
@@ -482,62 +528,60 @@ void Client::harvestSet(const std::string &set_spec, const std::string &from, co
     unsigned received_record_count(0);
     unsigned record_processed_count(0);
 
-    std::string response_date, resumption_token;
-    do {
-        std::string xml_document;
-        if (not GetListRecordsResponse(base_url_, from, until, set_spec, metadata_prefix_, resumption_token,
-                                       verbosity, logger, &xml_document))
-            throw std::runtime_error("An error occurred while talking to the OAI-PMH server!");
-        ++received_xml_page_count;
-
-        // Parse the XML document:
-        ListRecordsParser list_records_parser;
-        try {
-            list_records_parser.parse(xml_document, verbosity);
-        } catch (const std::runtime_error &exc) {
-            std::string error_message("An error occurred while parsing the data returned by the OAI-PMH server! (" + std::string(exc.what()) + ")");
-            if (not resumption_token.empty())
-                error_message += " Resumption token was \"" + resumption_token + "\". ";
-            throw std::runtime_error(error_message);
-        }
+    const auto record_handler([this, verbosity, logger, &record_processed_count](const OaiPmh::Record &record) {
+        if (processRecord(record, verbosity, logger))
+            ++record_processed_count;
+    });
 
-        // Check for OAI-PMH error conditions in the XML:
-        if (list_records_parser.detectedError()) {
-            std::string error_message;
-            std::string error_code(list_records_parser.getErrorCode(&error_message));
-
-            if (verbosity >= 4)
-                logger->info("Client::harvestSet: import error, code: " + error_code +", message: " + error_message);
-
-            if (error_code == "noRecordsMatch")
-                // There were no records available for us to return.
-                resumption_token.clear();
-            else {
-                // A genuine error occurred.  Report it.
-                if (not resumption_token.empty())
-                    error_message = "OAI-PMH error: resumption token: \"" + resumption_token + "\", error code: \""
-                                    + error_code +"\", error message: \"" + error_message + "\".";
+    ThreadUtil::BoundedQueue<ListRecordsPage> page_queue(max_prefetched_pages_);
+    std::thread download_thread(FetchListRecordsPages, std::cref(base_url_), std::cref(from), std::cref(until),
+                                std::cref(set_spec), std::cref(metadata_prefix_), verbosity, logger, &page_queue);
+    try {
+        ListRecordsPage page;
+        while (page_queue.pop(&page)) {
+            if (not page.error_message_.empty())
+                throw std::runtime_error(page.error_message_);
+            ++received_xml_page_count;
+
+            // Parse the XML document, handing the records to processRecord() as they are encountered:
+            ListRecordsParser list_records_parser(record_handler);
+            try {
+                list_records_parser.parse(page.xml_document_, verbosity);
+            } catch (const std::runtime_error &exc) {
+                std::string error_message("An error occurred while parsing the data returned by the OAI-PMH server! (" + std::string(exc.what()) + ")");
+                if (not page.resumption_token_.empty())
+                    error_message += " Resumption token was \"" + page.resumption_token_ + "\". ";
                 throw std::runtime_error(error_message);
             }
-        }
+            received_record_count += list_records_parser.getRecordCount();
+
+            // Check for OAI-PMH error conditions in the XML:
+            if (list_records_parser.detectedError()) {
+                std::string error_message;
+                std::string error_code(list_records_parser.getErrorCode(&error_message));
+
+                if (verbosity >= 4)
+                    logger->info("Client::harvestSet: import error, code: " + error_code +", message: " + error_message);
+
+                if (error_code != "noRecordsMatch") {
+                    // A genuine error occurred.  Report it.
+                    if (not page.resumption_token_.empty())
+                        error_message = "OAI-PMH error: resumption token: \"" + page.resumption_token_ + "\", error code: \""
+                                        + error_code +"\", error message: \"" + error_message + "\".";
+                    throw std::runtime_error(error_message);
+                }
+            }
 
-        // Store the first response date:
-        if (first_response_date_.empty())
-            first_response_date_ = list_records_parser.getResponseDate();
-
-        // Handle the parsed records:
-        received_record_count += list_records_parser.getRecordCount();
-        const std::list<OaiPmh::Record> &records(list_records_parser.getRecords());
-        for (std::list<OaiPmh::Record>::const_iterator record(records.begin()); record != records.end();
-             ++record)
-        {
-            if (processRecord(*record, verbosity, logger))
-                ++record_processed_count;
+            // Store the first response date:
+            if (first_response_date_.empty())
+                first_response_date_ = list_records_parser.getResponseDate();
         }
-
-        // Grab the new resumption token:
-        resumption_token = list_records_parser.getResumptionToken();
-    } while (not resumption_token.empty());
+    } catch (...) {
+        page_queue.close();
+        download_thread.join();
+        throw;
+    }
+    download_thread.join();
 
     if (verbosity >= 2) {
         logger->info("Finished harvesting repository '" + repository_name_ + "',"
@@ -0,0 +1,155 @@
+/** \brief A compact representation of BSZ/K10plus PPN's and sets and maps keyed by them.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "PPN.h"
+#include <algorithm>
+#include "BSZUtil.h"
+
+
+namespace {
+
+
+// The finaliser of SplitMix64.  Packed PPN's are anything but random, so we need to mix the bits well.
+inline uint64_t Hash(uint64_t key) {
+    key = (key ^ (key >> 30u)) * UINT64_C(0xBF58476D1CE4E5B9);
+    key = (key ^ (key >> 27u)) * UINT64_C(0x94D049BB133111EB);
+    return key ^ (key >> 31u);
+}
+
+
+} // unnamed namespace
+
+
+// We use base 12 w/ the digits 1 to 11, like MARC::ControlNumberSet does.  As there is no zero digit, the packed
+// representation of a valid PPN is never zero and PPN's that only differ in the number of leading zeroes are kept apart.
+bool PPN::Parse(const std::string &ppn_candidate, PPN * const ppn) {
+    if (ppn_candidate.length() != BSZUtil::PPN_LENGTH_OLD and ppn_candidate.length() != BSZUtil::PPN_LENGTH_NEW)
+        return false;
+
+    uint64_t packed(0);
+    for (auto ch(ppn_candidate.cbegin()); ch != ppn_candidate.cend(); ++ch) {
+        uint64_t digit;
+        if (*ch >= '0' and *ch <= '9')
+            digit = *ch - '0' + 1;
+        else if (*ch == 'X' and ch + 1 == ppn_candidate.cend())
+            digit = 11;
+        else
+            return false;
+        packed = packed * 12 + digit;
+    }
+
+    ppn->packed_ = packed;
+    return true;
+}
+
+
+PPN PPN::ParseOrDie(const std::string &ppn_candidate) {
+    PPN ppn;
+    if (unlikely(not Parse(ppn_candidate, &ppn)))
+        LOG_ERROR("\"" + ppn_candidate + "\" is not a valid PPN!");
+    return ppn;
+}
+
+
+std::string PPN::toString() const {
+    std::string ppn;
+    for (uint64_t packed(packed_); packed != 0; packed /= 12) {
+        const unsigned digit(packed % 12);
+        ppn += (digit == 11) ? 'X' : static_cast<char>('0' + digit - 1);
+    }
+    std::reverse(ppn.begin(), ppn.end());
+
+    return ppn;
+}
+
+
+constexpr uint64_t PPNTable::EMPTY_SLOT;
+constexpr size_t PPNTable::INITIAL_CAPACITY;
+
+
+size_t PPNTable::findSlot(const uint64_t key) const {
+    const size_t mask(keys_.size() - 1);
+    size_t slot(Hash(key) & mask);
+    while (keys_[slot] != EMPTY_SLOT and keys_[slot] != key)
+        slot = (slot + 1) & mask; // Linear probing.
+
+    return slot;
+}
+
+
+std::vector<std::pair<size_t, size_t>> PPNTable::grow() {
+    std::vector<uint64_t> old_keys(keys_.size() * 2, EMPTY_SLOT);
+    old_keys.swap(keys_);
+
+    std::vector<std::pair<size_t, size_t>> old_and_new_slots;
+    old_and_new_slots.reserve(size_);
+    for (size_t old_slot(0); old_slot < old_keys.size(); ++old_slot) {
+        if (old_keys[old_slot] == EMPTY_SLOT)
+            continue;
+        const size_t new_slot(findSlot(old_keys[old_slot]));
+        keys_[new_slot] = old_keys[old_slot];
+        old_and_new_slots.emplace_back(old_slot, new_slot);
+    }
+
+    return old_and_new_slots;
+}
+
+
+bool PPNSet::insert(const PPN &ppn) {
+    if (unlikely(ppn.empty()))
+        LOG_ERROR("can't insert an empty PPN!");
+
+    const uint64_t key(GetKey(ppn));
+    size_t slot(findSlot(key));
+    if (keys_[slot] == key)
+        return false;
+
+    if (isFull()) {
+        grow();
+        slot = findSlot(key);
+    }
+
+    keys_[slot] = key;
+    ++size_;
+    return true;
+}
+
+
+bool PPNSet::insert(const std::string &ppn_candidate) {
+    PPN ppn;
+    return PPN::Parse(ppn_candidate, &ppn) and insert(ppn);
+}
+
+
+bool PPNSet::contains(const std::string &ppn_candidate) const {
+    PPN ppn;
+    return PPN::Parse(ppn_candidate, &ppn) and contains(ppn);
+}
+
+
+std::vector<PPN> PPNSet::getSortedPPNs() const {
+    std::vector<PPN> ppns;
+    ppns.reserve(size_);
+    for (const auto key : keys_) {
+        if (key != EMPTY_SLOT)
+            ppns.emplace_back(GetPPN(key));
+    }
+    std::sort(ppns.begin(), ppns.end());
+
+    return ppns;
+}
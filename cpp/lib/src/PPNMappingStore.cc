@@ -0,0 +1,250 @@
+/** \brief A persistent store of PPN replacements and deletions, e.g. from K10+ PPN swaps and LÖPPN deletion lists.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "PPNMappingStore.h"
+#include <algorithm>
+#include <cstring>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "PPN.h"
+#include "StringUtil.h"
+#include "UBTools.h"
+#include "util.h"
+
+
+namespace {
+
+
+const char TABLE_MAGIC[8]{ 'U', 'B', 'P', 'P', 'N', 'M', 'A', 'P' };
+const uint64_t TABLE_VERSION(1);
+
+
+struct TableHeader {
+    char magic_[sizeof TABLE_MAGIC];
+    uint64_t version_;
+    uint64_t entry_count_;
+};
+
+
+// A crude guard against cycles in corrupt data.
+const unsigned MAX_CHAIN_LENGTH(100);
+
+
+void CopyPPN(const std::string &ppn, char * const dest) {
+    std::memset(dest, '\0', PPNMappingStore::MAX_PPN_LENGTH);
+    std::memcpy(dest, ppn.data(), ppn.length());
+}
+
+
+inline std::string GetPPN(const char * const padded_ppn) {
+    return std::string(padded_ppn, ::strnlen(padded_ppn, PPNMappingStore::MAX_PPN_LENGTH));
+}
+
+
+inline bool EntryLess(const PPNMappingStore::Entry &lhs, const PPNMappingStore::Entry &rhs) {
+    return std::memcmp(lhs.ppn_, rhs.ppn_, PPNMappingStore::MAX_PPN_LENGTH) < 0;
+}
+
+
+void CheckPPN(const std::string &ppn_candidate) {
+    PPN ppn;
+    if (unlikely(not PPN::Parse(ppn_candidate, &ppn) or ppn_candidate.length() > PPNMappingStore::MAX_PPN_LENGTH))
+        LOG_ERROR("\"" + ppn_candidate + "\" is not a valid PPN!");
+}
+
+
+} // unnamed namespace
+
+
+constexpr size_t PPNMappingStore::MAX_PPN_LENGTH;
+
+
+PPNMappingStore::PPNMappingStore(const std::string &path): log_path_(path + ".log"), table_path_(path + ".table") {
+    if (FileUtil::Exists(table_path_)) {
+        File table(table_path_, "r");
+        TableHeader header;
+        if (unlikely(table.fail() or table.read(&header, sizeof header) != sizeof header
+                     or std::memcmp(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC) != 0 or header.version_ != TABLE_VERSION))
+            LOG_ERROR("\"" + table_path_ + "\" is missing a valid header!");
+        table_.resize(header.entry_count_);
+        const size_t byte_count(table_.size() * sizeof(Entry));
+        if (unlikely(table.read(table_.data(), byte_count) != byte_count))
+            LOG_ERROR("\"" + table_path_ + "\" is truncated!");
+    }
+
+    if (FileUtil::Exists(log_path_)) {
+        unsigned line_no(0);
+        for (const auto &line : FileUtil::ReadLines(log_path_)) {
+            ++line_no;
+            std::vector<std::string> parts;
+            StringUtil::Split(line, ' ', &parts, /* suppress_empty_components = */true);
+            if (parts.size() == 3 and parts[0] == "M")
+                log_ppns_to_new_ppns_[parts[1]] = parts[2];
+            else if (parts.size() == 2 and parts[0] == "D")
+                log_ppns_to_new_ppns_[parts[1]].clear();
+            else if (not parts.empty())
+                LOG_ERROR("bad entry on line " + std::to_string(line_no) + " in \"" + log_path_ + "\"!");
+        }
+    }
+}
+
+
+PPNMappingStore::~PPNMappingStore() {
+    if (log_ != nullptr and unlikely(not log_->close()))
+        LOG_WARNING("failed to close \"" + log_path_ + "\"!");
+}
+
+
+size_t PPNMappingStore::size() const {
+    size_t size(table_.size());
+    for (const auto &ppn_and_new_ppn : log_ppns_to_new_ppns_) {
+        Entry key;
+        CopyPPN(ppn_and_new_ppn.first, key.ppn_);
+        if (not std::binary_search(table_.cbegin(), table_.cend(), key, EntryLess))
+            ++size;
+    }
+
+    return size;
+}
+
+
+bool PPNMappingStore::getCurrentPPN(const std::string &ppn, std::string * const current_ppn) const {
+    std::string new_ppn, next_ppn(ppn);
+    for (unsigned chain_length(0); chain_length < MAX_CHAIN_LENGTH; ++chain_length) {
+        if (not lookup(next_ppn, &new_ppn) or new_ppn.empty()) {
+            if (chain_length == 0)
+                return false;
+            *current_ppn = next_ppn;
+            return true;
+        }
+        next_ppn.swap(new_ppn);
+    }
+
+    LOG_ERROR("PPN replacement cycle involving \"" + ppn + "\"!");
+}
+
+
+std::string PPNMappingStore::getNewPPN(const std::string &ppn) const {
+    std::string new_ppn;
+    return lookup(ppn, &new_ppn) ? new_ppn : "";
+}
+
+
+bool PPNMappingStore::isDeleted(const std::string &ppn) const {
+    std::string new_ppn;
+    return lookup(ppn, &new_ppn) and new_ppn.empty();
+}
+
+
+void PPNMappingStore::addMapping(const std::string &old_ppn, const std::string &new_ppn) {
+    CheckPPN(old_ppn);
+    CheckPPN(new_ppn);
+    if (unlikely(old_ppn == new_ppn))
+        LOG_ERROR("can't map \"" + old_ppn + "\" to itself!");
+    appendToLog("M " + old_ppn + " " + new_ppn + "\n", old_ppn, new_ppn);
+}
+
+
+void PPNMappingStore::addDeletion(const std::string &ppn) {
+    CheckPPN(ppn);
+    appendToLog("D " + ppn + "\n", ppn, "");
+}
+
+
+// Writes the new table to a temporary file first so that readers never see a partially written table.
+void PPNMappingStore::compact() {
+    if (log_ppns_to_new_ppns_.empty())
+        return;
+
+    std::vector<Entry> log_entries;
+    log_entries.reserve(log_ppns_to_new_ppns_.size());
+    for (const auto &ppn_and_new_ppn : log_ppns_to_new_ppns_) {
+        log_entries.emplace_back();
+        CopyPPN(ppn_and_new_ppn.first, log_entries.back().ppn_);
+        CopyPPN(ppn_and_new_ppn.second, log_entries.back().new_ppn_);
+    }
+    std::sort(log_entries.begin(), log_entries.end(), EntryLess);
+
+    // Merge, the log entries take precedence:
+    std::vector<Entry> new_table;
+    new_table.reserve(table_.size() + log_entries.size());
+    auto table_entry(table_.cbegin());
+    for (const auto &log_entry : log_entries) {
+        while (table_entry != table_.cend() and EntryLess(*table_entry, log_entry))
+            new_table.emplace_back(*table_entry++);
+        if (table_entry != table_.cend() and not EntryLess(log_entry, *table_entry))
+            ++table_entry; // Same PPN.
+        new_table.emplace_back(log_entry);
+    }
+    new_table.insert(new_table.end(), table_entry, table_.cend());
+
+    TableHeader header;
+    std::memcpy(header.magic_, TABLE_MAGIC, sizeof TABLE_MAGIC);
+    header.version_     = TABLE_VERSION;
+    header.entry_count_ = new_table.size();
+    const std::string temp_path(table_path_ + ".tmp");
+    const auto table(FileUtil::OpenOutputFileOrDie(temp_path));
+    if (unlikely(table->write(&header, sizeof header) != sizeof header
+                 or table->write(new_table.data(), new_table.size() * sizeof(Entry)) != new_table.size() * sizeof(Entry)
+                 or not table->close()))
+        LOG_ERROR("failed to write \"" + temp_path + "\"!");
+    FileUtil::RenameFileOrDie(temp_path, table_path_, /* remove_target = */true);
+
+    if (log_ != nullptr) {
+        log_->close();
+        log_.reset();
+    }
+    FileUtil::WriteStringOrDie(log_path_, "");
+
+    table_.swap(new_table);
+    log_ppns_to_new_ppns_.clear();
+}
+
+
+std::string PPNMappingStore::GetDefaultPath() {
+    return UBTools::GetTuelibPath() + "ppn_mapping_store";
+}
+
+
+bool PPNMappingStore::lookup(const std::string &ppn, std::string * const new_ppn) const {
+    const auto ppn_and_new_ppn(log_ppns_to_new_ppns_.find(ppn));
+    if (ppn_and_new_ppn != log_ppns_to_new_ppns_.cend()) {
+        *new_ppn = ppn_and_new_ppn->second;
+        return true;
+    }
+
+    if (ppn.length() > MAX_PPN_LENGTH)
+        return false;
+    Entry key;
+    CopyPPN(ppn, key.ppn_);
+    const auto entry(std::lower_bound(table_.cbegin(), table_.cend(), key, EntryLess));
+    if (entry == table_.cend() or EntryLess(key, *entry))
+        return false;
+
+    *new_ppn = GetPPN(entry->new_ppn_);
+    return true;
+}
+
+
+void PPNMappingStore::appendToLog(const std::string &line, const std::string &ppn, const std::string &new_ppn) {
+    if (log_ == nullptr)
+        log_ = FileUtil::OpenForAppendingOrDie(log_path_);
+    if (unlikely(log_->write(line.data(), line.length()) != line.length()))
+        LOG_ERROR("failed to append to \"" + log_path_ + "\"!");
+    log_ppns_to_new_ppns_[ppn] = new_ppn;
+}
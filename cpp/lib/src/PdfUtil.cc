@@ -18,40 +18,182 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "PdfUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <leptonica/allheaders.h>
 #include <tesseract/baseapi.h>
+#ifdef HAS_POPPLER_CPP
+#   include <poppler/cpp/poppler-document.h>
+#   include <poppler/cpp/poppler-page.h>
+#endif
 #include "ExecUtil.h"
 #include "FileUtil.h"
 #include "MediaTypeUtil.h"
 #include "StringUtil.h"
+#include "TimeLimit.h"
 #include "util.h"
 
 namespace PdfUtil {
 
 
+namespace {
+
+
+#ifdef HAS_POPPLER_CPP
+// \note poppler-cpp does not copy raw data, so "pdf_document" must outlive the returned document.
+std::unique_ptr<poppler::document> LoadDocument(const std::string &pdf_document) {
+    std::unique_ptr<poppler::document> document(poppler::document::load_from_raw_data(pdf_document.data(),
+                                                                                      static_cast<int>(pdf_document.size())));
+    if (document == nullptr or document->is_locked())
+        return nullptr;
+    return document;
+}
+
+
+std::unique_ptr<poppler::document> LoadDocumentFromFile(const std::string &path) {
+    std::unique_ptr<poppler::document> document(poppler::document::load_from_file(path));
+    if (document == nullptr or document->is_locked())
+        return nullptr;
+    return document;
+}
+
+
+bool ForEachPageText(poppler::document * const document, const PageTextHandler &page_text_handler, const unsigned first_page,
+                     unsigned last_page, const unsigned timeout)
+{
+    const TimeLimit time_limit(timeout * 1000);
+    const unsigned page_count(document->pages());
+    if (last_page == 0 or last_page > page_count)
+        last_page = page_count;
+
+    for (unsigned page_no(first_page); page_no <= last_page; ++page_no) {
+        if (timeout > 0 and time_limit.limitExceeded()) {
+            LOG_WARNING("PDF text extraction timed out after page " + std::to_string(page_no - 1) + "!");
+            return false;
+        }
+
+        const std::unique_ptr<poppler::page> page(document->create_page(static_cast<int>(page_no - 1)));
+        if (unlikely(page == nullptr))
+            continue;
+        const poppler::byte_array utf8_text(page->text().to_utf8());
+        if (not page_text_handler(page_no, std::string(utf8_text.begin(), utf8_text.end())))
+            break;
+    }
+
+    return true;
+}
+
+
+unsigned PageNumberOrDefault(const std::string &page, const unsigned default_page_no) {
+    unsigned page_no;
+    return (page.empty() or not StringUtil::ToUnsigned(page, &page_no)) ? default_page_no : page_no;
+}
+#endif
+
+
+// Collects the pages' texts like "pdftotext -nopgbrk" does.
+bool ExtractTextInProcess(const std::string &pdf_document_or_path, const bool is_path, std::string * const extracted_text,
+                          const std::string &start_page, const std::string &end_page, const unsigned timeout)
+{
+#ifndef HAS_POPPLER_CPP
+    (void)pdf_document_or_path, (void)is_path, (void)extracted_text, (void)start_page, (void)end_page, (void)timeout;
+    return false;
+#else
+    const auto document(is_path ? LoadDocumentFromFile(pdf_document_or_path) : LoadDocument(pdf_document_or_path));
+    if (document == nullptr)
+        return false;
+
+    extracted_text->clear();
+    return ForEachPageText(document.get(),
+                           [extracted_text](const unsigned /*page_no*/, const std::string &page_text) {
+                               *extracted_text += page_text;
+                               *extracted_text += '\n';
+                               return true;
+                           },
+                           PageNumberOrDefault(start_page, 1), PageNumberOrDefault(end_page, 0), timeout);
+#endif
+}
+
+
+// \return 1 if the document has no fonts, 0 if it has fonts and -1 if we could not check in-process.
+int ContainsNoFontsInProcess(const std::string &pdf_document_or_path, const bool is_path) {
+#ifndef HAS_POPPLER_CPP
+    (void)pdf_document_or_path, (void)is_path;
+    return -1;
+#else
+    const auto document(is_path ? LoadDocumentFromFile(pdf_document_or_path) : LoadDocument(pdf_document_or_path));
+    if (document == nullptr)
+        return -1;
+    return document->fonts().empty() ? 1 : 0;
+#endif
+}
+
+
+} // unnamed namespace
+
+
+bool HaveInProcessExtraction() {
+#ifdef HAS_POPPLER_CPP
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool ForEachPageText(const std::string &pdf_document, const PageTextHandler &page_text_handler, const unsigned first_page,
+                     const unsigned last_page, const unsigned timeout)
+{
+#ifndef HAS_POPPLER_CPP
+    (void)pdf_document, (void)page_text_handler, (void)first_page, (void)last_page, (void)timeout;
+    return false;
+#else
+    const auto document(LoadDocument(pdf_document));
+    if (document == nullptr)
+        return false;
+    return ForEachPageText(document.get(), page_text_handler, first_page, last_page, timeout);
+#endif
+}
+
+
 bool ExtractText(const std::string &pdf_document, std::string * const extracted_text,
                  const std::string &start_page, const std::string &end_page)
 {
-    static std::string pdftotext_path;
-    if (pdftotext_path.empty())
-        pdftotext_path = ExecUtil::LocateOrDie("pdftotext");
+    if (ExtractTextInProcess(pdf_document, /* is_path = */false, extracted_text, start_page, end_page, /* timeout = */0))
+        return not extracted_text->empty();
 
-    const FileUtil::AutoTempFile auto_temp_file1;
-    const std::string &input_filename(auto_temp_file1.getFilePath());
+    const FileUtil::AutoTempFile auto_temp_file;
+    const std::string &input_filename(auto_temp_file.getFilePath());
     if (not FileUtil::WriteString(input_filename, pdf_document)) {
         LOG_WARNING("can't write document to \"" + input_filename + "\"!");
         return false;
     }
 
-    const FileUtil::AutoTempFile auto_temp_file2;
-    const std::string &output_filename(auto_temp_file2.getFilePath());
+    return ExtractTextFromFile(input_filename, extracted_text, start_page, end_page);
+}
+
+
+bool ExtractTextFromFile(const std::string &input_filename, std::string * const extracted_text,
+                         const std::string &start_page, const std::string &end_page, const unsigned timeout)
+{
+    if (ExtractTextInProcess(input_filename, /* is_path = */true, extracted_text, start_page, end_page, timeout))
+        return not extracted_text->empty();
+
+    static const std::string pdftotext_path(ExecUtil::LocateOrDie("pdftotext"));
+
+    const FileUtil::AutoTempFile auto_temp_file;
+    const std::string &output_filename(auto_temp_file.getFilePath());
     std::vector<std::string> pdftotext_params { "-enc", "UTF-8", "-nopgbrk" };
     if (not start_page.empty())
         pdftotext_params.insert(pdftotext_params.end(), { "-f", start_page });
     if (not end_page.empty())
         pdftotext_params.insert(pdftotext_params.end(), { "-l", end_page });
     pdftotext_params.insert(pdftotext_params.end(), { input_filename, output_filename });
-    const int retval(ExecUtil::Exec(pdftotext_path, pdftotext_params));
+    const int retval(ExecUtil::Exec(pdftotext_path, pdftotext_params, "", "", "", timeout));
     if (retval != 0) {
         LOG_WARNING("failed to execute \"" + pdftotext_path + "\"!");
         return false;
@@ -67,9 +209,11 @@ bool ExtractText(const std::string &pdf_document, std::string * const extracted_
 
 
 bool PdfFileContainsNoText(const std::string &path) {
-    static std::string pdffonts_path;
-    if (pdffonts_path.empty())
-        pdffonts_path = ExecUtil::LocateOrDie("pdffonts");
+    const int contains_no_fonts(ContainsNoFontsInProcess(path, /* is_path = */true));
+    if (contains_no_fonts != -1)
+        return contains_no_fonts == 1;
+
+    static const std::string pdffonts_path(ExecUtil::LocateOrDie("pdffonts"));
 
     const FileUtil::AutoTempFile auto_temp_file;
     const std::string &output_filename(auto_temp_file.getFilePath());
@@ -86,6 +230,10 @@ bool PdfFileContainsNoText(const std::string &path) {
 
 
 bool PdfDocContainsNoText(const std::string &document) {
+    const int contains_no_fonts(ContainsNoFontsInProcess(document, /* is_path = */false));
+    if (contains_no_fonts != -1)
+        return contains_no_fonts == 1;
+
     const FileUtil::AutoTempFile auto_temp_file;
     const std::string &output_filename(auto_temp_file.getFilePath());
     if (not FileUtil::WriteString(output_filename, document))
@@ -94,11 +242,135 @@ bool PdfDocContainsNoText(const std::string &document) {
 }
 
 
+namespace {
+
+
+// Tesseract instances are expensive to initialise, so we keep idle ones around for reuse, keyed by their language codes.
+class TesseractPool {
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<tesseract::TessBaseAPI *>> language_codes_to_idle_instances_map_;
+public:
+    ~TesseractPool();
+
+    /** \return nullptr if tesseract could not be initialised for "language_codes". */
+    tesseract::TessBaseAPI *checkOut(const std::string &language_codes);
+
+    void checkIn(const std::string &language_codes, tesseract::TessBaseAPI * const api);
+} tesseract_pool;
+
+
+TesseractPool::~TesseractPool() {
+    for (auto &language_codes_and_idle_instances : language_codes_to_idle_instances_map_) {
+        for (auto api : language_codes_and_idle_instances.second) {
+            api->End();
+            delete api;
+        }
+    }
+}
+
+
+tesseract::TessBaseAPI *TesseractPool::checkOut(const std::string &language_codes) {
+    {
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        auto &idle_instances(language_codes_to_idle_instances_map_[language_codes]);
+        if (not idle_instances.empty()) {
+            tesseract::TessBaseAPI * const api(idle_instances.back());
+            idle_instances.pop_back();
+            return api;
+        }
+    }
+
+    tesseract::TessBaseAPI * const api(new tesseract::TessBaseAPI());
+    if (api->Init(nullptr, language_codes.c_str()) != 0) {
+        delete api;
+        return nullptr;
+    }
+    return api;
+}
+
+
+void TesseractPool::checkIn(const std::string &language_codes, tesseract::TessBaseAPI * const api) {
+    api->Clear();
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    auto &idle_instances(language_codes_to_idle_instances_map_[language_codes]);
+    if (idle_instances.size() < std::max(1u, std::thread::hardware_concurrency()))
+        idle_instances.emplace_back(api);
+    else {
+        api->End();
+        delete api;
+    }
+}
+
+
+class PooledTesseract {
+    const std::string language_codes_;
+    tesseract::TessBaseAPI * const api_;
+public:
+    explicit PooledTesseract(const std::string &language_codes)
+        : language_codes_(language_codes), api_(tesseract_pool.checkOut(language_codes)) { }
+    ~PooledTesseract() { if (api_ != nullptr) tesseract_pool.checkIn(language_codes_, api_); }
+
+    inline tesseract::TessBaseAPI *operator->() const { return api_; }
+    inline bool isValid() const { return api_ != nullptr; }
+};
+
+
+// OCRs "image_paths" concurrently, one image per thread at a time, and concatenates their texts in order.
+// \param timeout  If non-zero, we give up once this many seconds have passed.  This is checked between images.
+bool GetTextFromImagesInParallel(const std::vector<std::string> &image_paths, const std::string &tesseract_language_code,
+                                 const unsigned timeout, std::string * const extracted_text)
+{
+    const TimeLimit time_limit(timeout * 1000);
+    std::vector<std::string> image_texts(image_paths.size());
+    std::unique_ptr<bool[]> successes(new bool[image_paths.size()]());
+    std::atomic<size_t> next_image_index(0);
+    std::atomic<bool> timed_out(false);
+
+    const size_t thread_count(std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), image_paths.size()));
+    std::vector<std::thread> ocr_threads;
+    for (size_t thread_no(0); thread_no < thread_count; ++thread_no)
+        ocr_threads.emplace_back([&] {
+            for (;;) {
+                const size_t image_index(next_image_index++);
+                if (image_index >= image_paths.size())
+                    return;
+                if (timeout > 0 and time_limit.limitExceeded()) {
+                    timed_out = true;
+                    return;
+                }
+                successes[image_index] = GetTextFromImage(image_paths[image_index], tesseract_language_code,
+                                                          &image_texts[image_index]);
+            }
+        });
+    for (auto &ocr_thread : ocr_threads)
+        ocr_thread.join();
+
+    if (timed_out) {
+        LOG_WARNING("OCR ran out of time after " + std::to_string(timeout) + " seconds!");
+        return false;
+    }
+
+    for (size_t image_index(0); image_index < image_paths.size(); ++image_index) {
+        if (not successes[image_index]) {
+            LOG_WARNING("failed to extract text from image " + image_paths[image_index]);
+            return false;
+        }
+        *extracted_text += " " + image_texts[image_index];
+    }
+
+    return true;
+}
+
+
+} // unnamed namespace
+
+
 bool GetTextFromImage(const std::string &img_path, const std::string &tesseract_language_code,
                       std::string * const extracted_text)
 {
-    tesseract::TessBaseAPI * const api(new tesseract::TessBaseAPI());
-    if (api->Init(nullptr, tesseract_language_code.c_str())) {
+    PooledTesseract api(tesseract_language_code);
+    if (not api.isValid()) {
         LOG_WARNING("Could not initialize Tesseract API!");
         return false;
     }
@@ -106,8 +378,8 @@ bool GetTextFromImage(const std::string &img_path, const std::string &tesseract_
     const std::string filetype(MediaTypeUtil::GetFileMediaType(img_path));
 
     // Special Handling for tiff multipages
+    extracted_text->clear();
     if (filetype == "image/tiff") {
-        extracted_text->clear();
         Pixa *multipage_image(pixaReadMultipageTiff(img_path.c_str()));
         for (l_int32 offset(0); offset < multipage_image->n; ++offset) {
              LOG_INFO("Extracting page " + std::to_string(offset + 1));
@@ -116,29 +388,50 @@ bool GetTextFromImage(const std::string &img_path, const std::string &tesseract_
              extracted_text->append(utf8_page);
              delete[] utf8_page;
         }
-        api->End();
-        delete api;
         pixaDestroy(&multipage_image);
-        delete multipage_image;
-
     } else {
         Pix *image(pixRead(img_path.c_str()));
         api->SetImage(image);
         char *utf8_text(api->GetUTF8Text());
         *extracted_text = utf8_text;
         delete[] utf8_text;
-        api->End();
-        delete api;
         pixDestroy(&image);
-        delete image;
-
     }
+
     return not extracted_text->empty();
 }
 
 
 bool GetTextFromImagePDF(const std::string &pdf_document, const std::string &tesseract_language_code,
                          std::string * const extracted_text, unsigned timeout)
+{
+    const FileUtil::AutoTempFile auto_temp_file;
+    const std::string &input_filename(auto_temp_file.getFilePath());
+    if (not FileUtil::WriteString(input_filename, pdf_document)) {
+        extracted_text->clear();
+        LOG_WARNING("failed to write the PDF to a temp file!");
+        return false;
+    }
+
+    return GetTextFromImagePDFFile(input_filename, tesseract_language_code, extracted_text, timeout);
+}
+
+
+// \return The sorted paths of the files in "directory_path" whose names match "filename_regex".
+static std::vector<std::string> GetSortedPaths(const std::string &directory_path, const std::string &filename_regex) {
+    std::vector<std::string> filenames;
+    FileUtil::GetFileNameList(filename_regex, &filenames, directory_path);
+    std::sort(filenames.begin(), filenames.end());
+
+    std::vector<std::string> paths;
+    for (const auto &filename : filenames)
+        paths.emplace_back(directory_path + "/" + filename);
+    return paths;
+}
+
+
+bool GetTextFromImagePDFFile(const std::string &input_filename, const std::string &tesseract_language_code,
+                             std::string * const extracted_text, unsigned timeout)
 {
     extracted_text->clear();
 
@@ -146,31 +439,20 @@ bool GetTextFromImagePDF(const std::string &pdf_document, const std::string &tes
 
     const FileUtil::AutoTempDirectory auto_temp_dir;
     const std::string &output_dirname(auto_temp_dir.getDirectoryPath());
-    const std::string input_filename(output_dirname + "/in.pdf");
-    if (not FileUtil::WriteString(input_filename, pdf_document)) {
-        LOG_WARNING("failed to write the PDF to a temp file!");
-        return false;
-    }
-
     if (ExecUtil::Exec(pdf_images_script_path, { input_filename, output_dirname + "/out" }, "", "", "", timeout) != 0) {
         LOG_WARNING("failed to extract images from PDF file!");
         return false;
     }
 
-    std::vector<std::string> pdf_image_filenames;
-    if (FileUtil::GetFileNameList("out.*", &pdf_image_filenames, output_dirname) == 0) {
+    // pdfimages numbers its output files w/ a fixed width, so sorting them gives us the document order:
+    const std::vector<std::string> pdf_image_paths(GetSortedPaths(output_dirname, "out.*"));
+    if (pdf_image_paths.empty()) {
         LOG_WARNING("PDF did not contain any images!");
         return false;
     }
 
-    for (const std::string &pdf_image_filename : pdf_image_filenames) {
-        std::string image_text;
-        if (not GetTextFromImage(output_dirname + "/" + pdf_image_filename, tesseract_language_code, &image_text)) {
-            LOG_WARNING("failed to extract text from image " + pdf_image_filename);
-            return false;
-        }
-         *extracted_text += " " + image_text;
-    }
+    if (not GetTextFromImagesInParallel(pdf_image_paths, tesseract_language_code, timeout, extracted_text))
+        return false;
 
     *extracted_text = StringUtil::TrimWhite(*extracted_text);
     return not extracted_text->empty();
@@ -183,14 +465,17 @@ bool GetOCRedTextFromPDF(const std::string &pdf_document_path, const std::string
     static std::string pdf_to_image_command(ExecUtil::LocateOrDie("convert"));
     const FileUtil::AutoTempDirectory auto_temp_dir;
     const std::string &image_dirname(auto_temp_dir.getDirectoryPath());
-    const std::string temp_image_location = image_dirname + "/img.tiff";
+
+    // One image per page so that we can OCR the pages in parallel:
+    const std::string temp_image_location = image_dirname + "/page-%05d.tiff";
     if (ExecUtil::Exec(pdf_to_image_command, { "-density", "300", pdf_document_path, "-depth", "8", "-strip",
                                                "-background", "white", "-alpha", "off", temp_image_location
                                              }, "", "", "", timeout) != 0) {
         LOG_WARNING("failed to convert PDF to image!");
         return false;
     }
-    if (not GetTextFromImage(temp_image_location, tesseract_language_code, extracted_text))
+    if (not GetTextFromImagesInParallel(GetSortedPaths(image_dirname, "page-.*\\.tiff"), tesseract_language_code, timeout,
+                                        extracted_text))
         LOG_WARNING("failed to extract OCRed text");
 
     *extracted_text = StringUtil::TrimWhite(*extracted_text);
@@ -199,9 +484,7 @@ bool GetOCRedTextFromPDF(const std::string &pdf_document_path, const std::string
 
 
 bool ExtractPDFInfo(const std::string &pdf_document, std::string * const pdf_output) {
-    static std::string pdfinfo_path;
-    if (pdfinfo_path.empty())
-        pdfinfo_path = ExecUtil::LocateOrDie("pdfinfo");
+    static const std::string pdfinfo_path(ExecUtil::LocateOrDie("pdfinfo"));
     const FileUtil::AutoTempFile auto_temp_file1;
     const std::string &input_filename(auto_temp_file1.getFilePath());
     if (not FileUtil::WriteString(input_filename, pdf_document)) {
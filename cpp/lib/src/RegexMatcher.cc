@@ -18,14 +18,33 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "RegexMatcher.h"
+#include <algorithm>
+#include <mutex>
 #include <unordered_map>
+#include <cstring>
 #include "Compiler.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
 bool RegexMatcher::utf8_configured_;
 
 
+namespace {
+
+
+constexpr int JIT_STACK_START_SIZE(32 * 1024);
+constexpr int JIT_STACK_MAX_SIZE(4 * 1024 * 1024);
+
+
+// A JIT stack must not be used by more than one thread at a time, so every thread gets its own.
+pcre_jit_stack *GetThreadJITStack(void * /*unused*/) {
+    static thread_local std::unique_ptr<pcre_jit_stack, void (*)(pcre_jit_stack *)> jit_stack(
+        ::pcre_jit_stack_alloc(JIT_STACK_START_SIZE, JIT_STACK_MAX_SIZE), ::pcre_jit_stack_free);
+    return jit_stack.get(); // If this is nullptr, PCRE falls back to a small stack of its own.
+}
+
+
 bool CompileRegex(const std::string &pattern, const unsigned options, ::pcre **pcre_arg,
                   ::pcre_extra **pcre_extra_arg, std::string * const err_msg)
 {
@@ -52,20 +71,77 @@ bool CompileRegex(const std::string &pattern, const unsigned options, ::pcre **p
         return false;
     }
 
-    // Can't use PCRE_STUDY_JIT_COMPILE because it's not thread safe.
-    *pcre_extra_arg = ::pcre_study(*pcre_arg, 0, &errptr);
-    if (*pcre_extra_arg == nullptr and errptr != nullptr) {
+    // JIT compiled code can be executed by any number of threads concurrently as long as each of them uses its own JIT stack.
+    // PCRE_STUDY_EXTRA_NEEDED guarantees that we get a pcre_extra even if there is nothing to study.
+    *pcre_extra_arg = ::pcre_study(*pcre_arg, PCRE_STUDY_JIT_COMPILE | PCRE_STUDY_EXTRA_NEEDED, &errptr);
+    if (*pcre_extra_arg == nullptr) {
         ::pcre_free(*pcre_arg);
         *pcre_arg = nullptr;
         if (err_msg != nullptr)
-            *err_msg = "failed to \"study\" the compiled pattern \"" + pattern + "\"! (" + std::string(errptr) + ")";
+            *err_msg = "failed to \"study\" the compiled pattern \"" + pattern + "\"! ("
+                       + std::string(errptr == nullptr ? "unknown error" : errptr) + ")";
         return false;
     }
+    ::pcre_assign_jit_stack(*pcre_extra_arg, GetThreadJITStack, nullptr);
 
     return true;
 }
 
 
+} // unnamed namespace
+
+
+RegexMatcher::CompiledPattern::~CompiledPattern() {
+    ::pcre_free_study(pcre_extra_);
+    ::pcre_free(pcre_);
+}
+
+
+std::shared_ptr<const RegexMatcher::CompiledPattern> RegexMatcher::GetCompiledPattern(const std::string &pattern,
+                                                                                     const unsigned options,
+                                                                                     std::string * const err_msg)
+{
+    // We only hold weak references so that patterns that are not in use anymore get freed.
+    static std::unordered_map<std::string, std::weak_ptr<const CompiledPattern>> pattern_cache;
+    static std::mutex pattern_cache_mutex;
+    static const size_t MIN_SWEEP_SIZE(64);
+    static size_t next_sweep_size(MIN_SWEEP_SIZE);
+
+    const std::string cache_key(std::to_string(options) + ":" + pattern);
+    std::lock_guard<std::mutex> pattern_cache_locker(pattern_cache_mutex);
+    auto &cache_entry(pattern_cache[cache_key]);
+    auto compiled_pattern(cache_entry.lock());
+    if (compiled_pattern != nullptr) {
+        if (err_msg != nullptr)
+            err_msg->clear();
+        return compiled_pattern;
+    }
+
+    ::pcre *pcre_ptr;
+    ::pcre_extra *pcre_extra_ptr;
+    if (not CompileRegex(pattern, options, &pcre_ptr, &pcre_extra_ptr, err_msg)) {
+        pattern_cache.erase(cache_key);
+        return nullptr;
+    }
+
+    compiled_pattern = std::make_shared<const CompiledPattern>(pcre_ptr, pcre_extra_ptr);
+    cache_entry = compiled_pattern;
+
+    // Otherwise programs that build many different patterns, e.g. from data, would accumulate expired entries forever:
+    if (pattern_cache.size() >= next_sweep_size) {
+        for (auto entry(pattern_cache.begin()); entry != pattern_cache.end(); /* Intentionally empty! */) {
+            if (entry->second.expired())
+                entry = pattern_cache.erase(entry);
+            else
+                ++entry;
+        }
+        next_sweep_size = std::max(MIN_SWEEP_SIZE, 2 * pattern_cache.size()); // Keeps the amortised cost constant.
+    }
+
+    return compiled_pattern;
+}
+
+
 RegexMatcher *RegexMatcher::RegexMatcherFactory(const std::string &pattern, std::string * const err_msg,
                                                 const unsigned options)
 {
@@ -87,15 +163,14 @@ RegexMatcher *RegexMatcher::RegexMatcherFactory(const std::string &pattern, std:
         RegexMatcher::utf8_configured_ = true;
     }
 
-    ::pcre *pcre_ptr;
-    ::pcre_extra *pcre_extra_ptr;
-    if (not CompileRegex(pattern, options, &pcre_ptr, &pcre_extra_ptr, err_msg)) {
+    const auto compiled_pattern(GetCompiledPattern(pattern, options, err_msg));
+    if (compiled_pattern == nullptr) {
         if (err_msg != nullptr and err_msg->empty())
             *err_msg = "failed to compile pattern: \"" + pattern + "\"";
         return nullptr;
     }
 
-    return new RegexMatcher(pattern, options, pcre_ptr, pcre_extra_ptr);
+    return new RegexMatcher(pattern, options, compiled_pattern);
 }
 
 
@@ -109,41 +184,51 @@ RegexMatcher *RegexMatcher::RegexMatcherFactoryOrDie(const std::string &regex, c
 }
 
 
-RegexMatcher::RegexMatcher(const RegexMatcher &that): pattern_(that.pattern_) {
-    if (this == &that)
-        return;
-
-    if (that.pcre_ == nullptr) {
-        pcre_ = nullptr;
-        pcre_extra_ = nullptr;
-    } else {
-        std::string err_msg;
-        if (not CompileRegex(pattern_, that.options_, &pcre_, &pcre_extra_, &err_msg))
-            logger->error("In RegexMatcher copy constructor: unexpected error: " + err_msg);
-        substr_vector_    = that.substr_vector_;
-        last_match_count_ = that.last_match_count_;
-    }
+RegexMatcher::RegexMatcher(const RegexMatcher &that)
+    : pattern_(that.pattern_), options_(that.options_), compiled_pattern_(that.compiled_pattern_),
+      substr_vector_(that.substr_vector_), last_match_count_(that.last_match_count_)
+{
+    copyLastSubject(that);
 }
 
 
 RegexMatcher::RegexMatcher(RegexMatcher &&that)
-    : pattern_(std::move(that.pattern_)), options_(that.options_), pcre_(that.pcre_),
-      pcre_extra_(that.pcre_extra_), last_subject_(std::move(that.last_subject_)),
+    : pattern_(std::move(that.pattern_)), options_(that.options_), compiled_pattern_(std::move(that.compiled_pattern_)),
       substr_vector_(std::move(that.substr_vector_)), last_match_count_(that.last_match_count_)
 {
-    that.pcre_       = nullptr;
-    that.pcre_extra_ = nullptr;
+    copyLastSubject(that);
+}
+
+
+// "last_subject_view_" must not end up referring to the other matcher's "last_subject_".
+void RegexMatcher::copyLastSubject(const RegexMatcher &that) {
+    if (that.last_subject_view_.data() == that.last_subject_.data()) {
+        last_subject_ = that.last_subject_;
+        last_subject_view_ = last_subject_;
+    } else
+        last_subject_view_ = that.last_subject_view_;
 }
 
 
 bool RegexMatcher::matched(const std::string &subject, const size_t subject_start_offset, std::string * const err_msg,
                            size_t * const start_pos, size_t * const end_pos)
+{
+    if (not matched(StringView(subject), subject_start_offset, err_msg, start_pos, end_pos))
+        return false;
+
+    last_subject_ = subject;
+    last_subject_view_ = last_subject_;
+    return true;
+}
+
+
+bool RegexMatcher::matched(const StringView &subject, const size_t subject_start_offset, std::string * const err_msg,
+                           size_t * const start_pos, size_t * const end_pos)
 {
     if (err_msg != nullptr)
         err_msg->clear();
 
-    const int retcode(::pcre_exec(pcre_, pcre_extra_, subject.data(), subject.length(), subject_start_offset, 0,
-                                    &substr_vector_[0], substr_vector_.size()));
+    const int retcode(Execute(*compiled_pattern_, subject, subject_start_offset, &substr_vector_[0], substr_vector_.size()));
 
     if (retcode == 0) {
         if (err_msg != nullptr)
@@ -153,8 +238,8 @@ bool RegexMatcher::matched(const std::string &subject, const size_t subject_star
     }
 
     if (retcode > 0) {
-        last_match_count_ = retcode;
-        last_subject_     = subject;
+        last_match_count_  = retcode;
+        last_subject_view_ = subject;
         if (start_pos != nullptr)
             *start_pos = substr_vector_[0];
         if (end_pos != nullptr)
@@ -174,6 +259,22 @@ bool RegexMatcher::matched(const std::string &subject, const size_t subject_star
 }
 
 
+int RegexMatcher::Execute(const CompiledPattern &compiled_pattern, const StringView &subject, const size_t subject_start_offset,
+                          int * const ovector, const size_t ovector_size)
+{
+    const int retcode(::pcre_exec(compiled_pattern.pcre_, compiled_pattern.pcre_extra_, subject.data(), subject.size(),
+                                  subject_start_offset, 0, ovector, ovector_size));
+    if (likely(retcode != PCRE_ERROR_JIT_STACKLIMIT))
+        return retcode;
+
+    // Patterns that backtrack a lot can exhaust even the largest JIT stack, in which case we let the interpreter have a go:
+    pcre_extra interpreter_extra(*compiled_pattern.pcre_extra_);
+    interpreter_extra.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+    return ::pcre_exec(compiled_pattern.pcre_, &interpreter_extra, subject.data(), subject.size(), subject_start_offset, 0,
+                       ovector, ovector_size);
+}
+
+
 std::string RegexMatcher::replaceAll(const std::string &subject, const std::string &replacement) {
     if (not matched(subject))
         return subject;
@@ -204,16 +305,18 @@ std::string RegexMatcher::replaceAll(const std::string &subject, const std::stri
 bool RegexMatcher::Matched(const std::string &regex, const std::string &subject, const unsigned options,
                            std::string * const err_msg, size_t * const start_pos, size_t * const end_pos)
 {
-    static std::unordered_map<std::string, RegexMatcher *> regex_to_matcher_map;
+    // Matchers are not thread safe but the compiled patterns they refer to are shared across threads anyway.
+    static thread_local std::unordered_map<std::string, std::unique_ptr<RegexMatcher>> regex_to_matcher_map;
     const std::string KEY(regex + ":" + std::to_string(options));
     const auto regex_and_matcher(regex_to_matcher_map.find(KEY));
     if (regex_and_matcher != regex_to_matcher_map.cend())
         return regex_and_matcher->second->matched(subject, err_msg, start_pos, end_pos);
 
-    RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory(regex, err_msg, options));
+    std::string compile_err_msg;
+    RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory(regex, &compile_err_msg, options));
     if (matcher == nullptr)
-        LOG_ERROR("Failed to compile pattern \"" + regex + "\": " + *err_msg);
-    regex_to_matcher_map[KEY] = matcher;
+        LOG_ERROR("Failed to compile pattern \"" + regex + "\": " + compile_err_msg);
+    regex_to_matcher_map[KEY].reset(matcher);
 
     return matcher->matched(subject, err_msg, start_pos, end_pos);
 }
@@ -226,5 +329,134 @@ std::string RegexMatcher::operator[](const unsigned group) const {
 
     const unsigned first_index(group * 2);
     const unsigned substring_length(substr_vector_[first_index + 1] - substr_vector_[first_index]);
-    return (substring_length == 0) ? "" : last_subject_.substr(substr_vector_[first_index], substring_length);
+    return (substring_length == 0) ? "" : last_subject_view_.substr(substr_vector_[first_index], substring_length).toString();
+}
+
+
+RegexSet::RegexSet(const std::vector<std::string> &patterns, const unsigned options): options_(options) {
+    patterns_.reserve(patterns.size());
+    compiled_patterns_.reserve(patterns.size());
+    for (const auto &pattern : patterns)
+        addPattern(pattern);
+}
+
+
+void RegexSet::addPattern(const std::string &pattern) {
+    std::string err_msg;
+    const auto compiled_pattern(RegexMatcher::GetCompiledPattern(pattern, options_, &err_msg));
+    if (unlikely(compiled_pattern == nullptr))
+        LOG_ERROR("failed to compile regex \"" + pattern + "\": " + err_msg);
+
+    patterns_.emplace_back(pattern);
+    compiled_patterns_.emplace_back(compiled_pattern);
+    combineWithLastGroup(patterns_.size() - 1);
+}
+
+
+// Adds the pattern w/ index "pattern_index" to the last group if possible o/w starts a new group.
+void RegexSet::combineWithLastGroup(const size_t pattern_index) {
+    const bool combinable(IsCombinable(patterns_[pattern_index]));
+    if (groups_.empty() or not combinable or not groups_.back().combinable_
+        or groups_.back().end_pattern_ - groups_.back().first_pattern_ == MAX_GROUP_SIZE)
+    {
+        groups_.emplace_back(pattern_index, combinable);
+        return;
+    }
+
+    Group &last_group(groups_.back());
+    std::string combined_pattern;
+    for (size_t index(last_group.first_pattern_); index <= pattern_index; ++index) {
+        if (not combined_pattern.empty())
+            combined_pattern += '|';
+        combined_pattern += "(?:" + patterns_[index] + ")";
+    }
+
+    // PCRE may refuse to compile an alternation that has grown too large:
+    std::string err_msg;
+    const auto compiled_combined_pattern(RegexMatcher::GetCompiledPattern(combined_pattern, options_, &err_msg));
+    if (compiled_combined_pattern == nullptr) {
+        groups_.emplace_back(pattern_index, combinable);
+        return;
+    }
+
+    last_group.combined_pattern_ = compiled_combined_pattern;
+    last_group.end_pattern_ = pattern_index + 1;
+}
+
+
+bool RegexSet::Matched(const RegexMatcher::CompiledPattern &compiled_pattern, const StringView &subject) {
+    int ovector[3];
+    return RegexMatcher::Execute(compiled_pattern, subject, 0, ovector, sizeof(ovector) / sizeof(ovector[0])) >= 0;
+}
+
+
+bool RegexSet::matchedAny(const StringView &subject) const {
+    // A combined pattern matches iff one of its constituents does, so we never have to look at individual patterns here.
+    for (const auto &group : groups_) {
+        if (Matched(group.combined_pattern_ != nullptr ? *group.combined_pattern_ : *compiled_patterns_[group.first_pattern_],
+                    subject))
+            return true;
+    }
+
+    return false;
+}
+
+
+bool RegexSet::matchedFirst(const StringView &subject, size_t * const pattern_index) const {
+    for (const auto &group : groups_) {
+        if (group.combined_pattern_ != nullptr and not Matched(*group.combined_pattern_, subject))
+            continue;
+
+        for (size_t index(group.first_pattern_); index < group.end_pattern_; ++index) {
+            if (Matched(*compiled_patterns_[index], subject)) {
+                *pattern_index = index;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+std::vector<size_t> RegexSet::getMatchingPatterns(const StringView &subject) const {
+    std::vector<size_t> matching_pattern_indices;
+    for (const auto &group : groups_) {
+        if (group.combined_pattern_ != nullptr and not Matched(*group.combined_pattern_, subject))
+            continue;
+
+        for (size_t index(group.first_pattern_); index < group.end_pattern_; ++index) {
+            if (Matched(*compiled_patterns_[index], subject))
+                matching_pattern_indices.emplace_back(index);
+        }
+    }
+
+    return matching_pattern_indices;
+}
+
+
+bool RegexSet::IsCombinable(const std::string &pattern) {
+    if (StringUtil::StartsWith(pattern, "(*"))
+        return false;
+
+    for (size_t i(0); i + 1 < pattern.length(); ++i) {
+        if (pattern[i] == '\\') {
+            const char escaped_char(pattern[++i]);
+            if (StringUtil::IsDigit(escaped_char) or std::strchr("gkQE", escaped_char) != nullptr)
+                return false;
+        } else if (pattern[i] == '(' and pattern[i + 1] == '?') {
+            // We accept non-capturing groups, lookarounds and option settings w/o "x":
+            size_t k(i + 2);
+            if (k < pattern.length() and std::strchr(":=!", pattern[k]) != nullptr)
+                continue;
+            if (k + 1 < pattern.length() and pattern[k] == '<' and (pattern[k + 1] == '=' or pattern[k + 1] == '!'))
+                continue;
+            while (k < pattern.length() and std::strchr("imsU-", pattern[k]) != nullptr)
+                ++k;
+            if (k == i + 2 or k == pattern.length() or (pattern[k] != ')' and pattern[k] != ':'))
+                return false;
+        }
+    }
+
+    return true;
 }
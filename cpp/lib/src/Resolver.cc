@@ -786,51 +786,107 @@ unsigned Resolver::GetServersFromResolvDotConf(std::vector<in_addr_t> * const se
 }
 
 
-bool ThreadSafeDnsCache::lookup(const std::string &hostname, std::set<in_addr_t> * const ip_addresses) {
+ThreadSafeDnsCache::LookupResult ThreadSafeDnsCache::lookup(const std::string &hostname, std::set<in_addr_t> * const ip_addresses,
+                                                            bool * const needs_prefetch)
+{
+    if (needs_prefetch != nullptr)
+        *needs_prefetch = false;
+
+    Shard &shard(getShard(hostname));
+
     // Synchronize access to the internal cache data structures:
-    std::lock_guard<std::mutex> mutex_locker(cache_access_mutex_);
+    std::lock_guard<std::mutex> mutex_locker(shard.cache_access_mutex_);
 
-    std::unordered_map<std::string, ThreadSafeDnsCacheEntry>::iterator entry(resolved_hostnames_cache_.find(hostname));
-    if (entry != resolved_hostnames_cache_.end()) {
-        const time_t now(std::time(nullptr));
-        if (entry->second.expire_time_ > now) {
-            *ip_addresses = entry->second.ip_addresses_;
-            return true;
-        }
+    const auto entry(shard.resolved_hostnames_cache_.find(hostname));
+    if (entry == shard.resolved_hostnames_cache_.end())
+        return NOT_CACHED;
 
+    const time_t now(std::time(nullptr));
+    if (entry->second.expire_time_ <= now) {
         // Entry has expired => remove it from the cache:
-        resolved_hostnames_cache_.erase(entry);
+        shard.resolved_hostnames_cache_.erase(entry);
+        return NOT_CACHED;
     }
 
-    return false;
+    ++entry->second.hit_count_;
+    if (needs_prefetch != nullptr and entry->second.prefetch_time_ <= now and entry->second.hit_count_ >= HOT_HIT_COUNT
+        and not entry->second.prefetch_pending_)
+    {
+        entry->second.prefetch_pending_ = true;
+        *needs_prefetch = true;
+    }
+
+    *ip_addresses = entry->second.ip_addresses_;
+    return ip_addresses->empty() ? UNRESOLVABLE : RESOLVED;
 }
 
 
 void ThreadSafeDnsCache::insert(const std::string &hostname, const std::set<in_addr_t> &ip_addresses, const uint32_t ttl) {
+    if (ttl < MIN_TTL)
+        insertEntry(hostname, ip_addresses, MIN_TTL);
+    else if (ttl > MAX_TTL)
+        insertEntry(hostname, ip_addresses, MAX_TTL);
+    else
+        insertEntry(hostname, ip_addresses, ttl);
+}
+
+
+void ThreadSafeDnsCache::insertUnresolvable(const std::string &hostname) {
+    insertEntry(hostname, std::set<in_addr_t>(), negative_ttl_);
+}
+
+
+bool ThreadSafeDnsCache::contains(const std::string &hostname) {
+    Shard &shard(getShard(hostname));
+    std::lock_guard<std::mutex> mutex_locker(shard.cache_access_mutex_);
+
+    const auto entry(shard.resolved_hostnames_cache_.find(hostname));
+    return entry != shard.resolved_hostnames_cache_.end() and entry->second.expire_time_ > std::time(nullptr);
+}
+
+
+void ThreadSafeDnsCache::cancelPrefetch(const std::string &hostname) {
+    Shard &shard(getShard(hostname));
+    std::lock_guard<std::mutex> mutex_locker(shard.cache_access_mutex_);
+
+    const auto entry(shard.resolved_hostnames_cache_.find(hostname));
+    if (entry != shard.resolved_hostnames_cache_.end())
+        entry->second.prefetch_pending_ = false;
+}
+
+
+void ThreadSafeDnsCache::insertEntry(const std::string &hostname, const std::set<in_addr_t> &ip_addresses, const uint32_t ttl) {
+    Shard &shard(getShard(hostname));
+
     // Synchronize access to the internal cache data structures:
-    std::lock_guard<std::mutex> mutex_locker(cache_access_mutex_);
+    std::lock_guard<std::mutex> mutex_locker(shard.cache_access_mutex_);
 
-    // Flush the cache if it contains more than 100,000 entries:
-    if (resolved_hostnames_cache_.size() > 100000)
-        resolved_hostnames_cache_.clear();
-    else {
-        // Check to see whether we already have information about this "hostname":
-        std::unordered_map<std::string, ThreadSafeDnsCacheEntry>::iterator cache_entry(resolved_hostnames_cache_.find(hostname));
-        if (unlikely(cache_entry != resolved_hostnames_cache_.end())) {
-            for (const auto &ip_address : ip_addresses)
-                cache_entry->second.ip_addresses_.insert(ip_address);
-            return;
-        }
+    ThreadSafeDnsCacheEntry new_cache_entry(std::time(nullptr), ttl, ip_addresses);
+
+    // Replace an existing entry but keep its hit count so that a refreshed hot entry stays hot:
+    const auto cache_entry(shard.resolved_hostnames_cache_.find(hostname));
+    if (cache_entry != shard.resolved_hostnames_cache_.end()) {
+        new_cache_entry.hit_count_ = cache_entry->second.hit_count_;
+        cache_entry->second = new_cache_entry;
+        return;
     }
 
-    // Create a new cache entry:
-    const time_t now(std::time(nullptr));
-    const ThreadSafeDnsCache::ThreadSafeDnsCacheEntry new_cache_entry(now + ttl, ip_addresses);
-    resolved_hostnames_cache_.insert(std::make_pair(hostname, new_cache_entry));
+    // Flush the shard if it has grown too large:
+    if (shard.resolved_hostnames_cache_.size() >= MAX_SHARD_SIZE)
+        shard.resolved_hostnames_cache_.clear();
+
+    shard.resolved_hostnames_cache_.insert(std::make_pair(hostname, new_cache_entry));
 }
 
 
-SimpleResolver::SimpleResolver(const std::vector<std::string> &dns_servers) {
+SimpleResolver::SimpleResolver(const std::vector<std::string> &dns_servers, const unsigned max_in_flight_queries,
+                               const uint32_t negative_ttl)
+    : dns_cache_(negative_ttl), next_request_id_(0), max_in_flight_queries_(max_in_flight_queries),
+      available_query_slots_(max_in_flight_queries)
+{
+    if (unlikely(max_in_flight_queries_ == 0))
+        throw std::runtime_error("in SimpleResolver::SimpleResolver: max_in_flight_queries must be positive!");
+
     // Get the resolver IP addresses from the "dns_server" parameter:
     if (not dns_servers.empty()) {
         for (std::vector<std::string>::const_iterator dns_server(dns_servers.begin());
@@ -897,6 +953,8 @@ SimpleResolver::SimpleResolver(const std::vector<std::string> &dns_servers) {
 }
 
 
+
+
 bool SimpleResolver::resolve(const std::string &hostname, const TimeLimit &time_limit, std::set<in_addr_t> * const ip_addresses) {
     ip_addresses->clear();
 
@@ -908,54 +966,184 @@ bool SimpleResolver::resolve(const std::string &hostname, const TimeLimit &time_
     }
 
     // See if we already know the answer to our query:
-    if (dns_cache_.lookup(hostname, ip_addresses))
+    bool needs_prefetch;
+    switch (dns_cache_.lookup(hostname, ip_addresses, &needs_prefetch)) {
+    case ThreadSafeDnsCache::UNRESOLVABLE:
+        return false;
+    case ThreadSafeDnsCache::RESOLVED:
+        if (needs_prefetch) {
+            // We're the only one refreshing this hot entry.  If that fails, we fall back to the still valid cached
+            // addresses and let somebody else try again:
+            std::set<in_addr_t> refreshed_ip_addresses;
+            if (lookUp(hostname, time_limit, &refreshed_ip_addresses))
+                ip_addresses->swap(refreshed_ip_addresses);
+            else
+                dns_cache_.cancelPrefetch(hostname);
+        }
         return true;
+    case ThreadSafeDnsCache::NOT_CACHED:
+        break;
+    }
+
+    return lookUp(hostname, time_limit, ip_addresses);
+}
+
+
+unsigned SimpleResolver::prefetch(const std::vector<std::string> &hostnames, const TimeLimit &time_limit) {
+    unsigned cached_count(0);
+    std::vector<std::string> hostnames_to_resolve;
+    std::set<std::string> already_seen_hostnames;
+    for (const auto &hostname : hostnames) {
+        if (not already_seen_hostnames.insert(hostname).second)
+            continue;
+
+        in_addr hostname_as_address;
+        if (::inet_aton(hostname.c_str(), &hostname_as_address))
+            continue;
+
+        if (dns_cache_.contains(hostname))
+            ++cached_count;
+        else
+            hostnames_to_resolve.emplace_back(hostname);
+    }
+    if (hostnames_to_resolve.empty())
+        return cached_count;
+
+    const unsigned query_slot_count(acquireQuerySlots(static_cast<unsigned>(hostnames_to_resolve.size())));
+
+    const FileDescriptor udp_fd(::socket(PF_INET, SOCK_DGRAM, 0));
+    if (unlikely(udp_fd == -1)) {
+        releaseQuerySlots(query_slot_count);
+        throw std::runtime_error("in SimpleResolver::prefetch: socket(2) failed (" + std::to_string(errno)+ ")!");
+    }
+    FileUtil::SetNonblocking(udp_fd);
+
+    const in_addr_t resolver_address(getLeastBusyDnsServerAndIncUsageCount());
+
+    uint32_t reply_packet_buffer[(MAX_UDP_REPLY_PACKET_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+    unsigned char * const reply_packet(reinterpret_cast<unsigned char *>(reply_packet_buffer));
+
+    std::unordered_map<uint16_t, std::string> request_ids_to_hostnames_map;
+    auto next_hostname(hostnames_to_resolve.cbegin());
+    try {
+        while (not time_limit.limitExceeded()) {
+            // Keep up to "query_slot_count" requests outstanding:
+            while (next_hostname != hostnames_to_resolve.cend() and request_ids_to_hostnames_map.size() < query_slot_count) {
+                const uint16_t request_id(getNextRequestId());
+                sendRequest(udp_fd, *next_hostname, resolver_address, request_id);
+                request_ids_to_hostnames_map.emplace(request_id, *next_hostname);
+                ++next_hostname;
+            }
+            if (request_ids_to_hostnames_map.empty())
+                break;
+
+            const ssize_t actual_reply_packet_size(SocketUtil::TimedRead(udp_fd, time_limit, reply_packet, MAX_UDP_REPLY_PACKET_SIZE));
+            if (actual_reply_packet_size <= 0) {
+                if (likely(errno == ETIMEDOUT))
+                    break;
+                throw std::runtime_error("in SimpleResolver::prefetch: SocketUtil::TimedRead() failed (" + std::to_string(errno)+ ")!");
+            }
+            if (unlikely(static_cast<size_t>(actual_reply_packet_size) < sizeof(HEADER)))
+                continue;
+
+            // Find out to which of our outstanding requests, if any, this is the reply:
+            const auto request_id_and_hostname(
+                request_ids_to_hostnames_map.find(ntohs(reinterpret_cast<const HEADER *>(reply_packet)->id)));
+            if (request_id_and_hostname == request_ids_to_hostnames_map.end())
+                continue;
+
+            std::set<in_addr_t> ip_addresses;
+            const ReplyType reply_type(processServerReply(reply_packet, actual_reply_packet_size, request_id_and_hostname->first,
+                                                          request_id_and_hostname->second, &ip_addresses));
+            if (reply_type == GARBLED_REPLY)
+                continue;
+            if (reply_type != FAILED_REPLY)
+                ++cached_count;
+            request_ids_to_hostnames_map.erase(request_id_and_hostname);
+        }
+    } catch (...) {
+        decDnsServerUsageCount(resolver_address);
+        releaseQuerySlots(query_slot_count);
+        throw;
+    }
+
+    decDnsServerUsageCount(resolver_address);
+    releaseQuerySlots(query_slot_count);
+
+    return cached_count;
+}
+
+
+SimpleResolver &SimpleResolver::GetDefaultInstance() {
+    static SimpleResolver default_instance;
+    return default_instance;
+}
+
+
+bool SimpleResolver::lookUp(const std::string &hostname, const TimeLimit &time_limit, std::set<in_addr_t> * const ip_addresses) {
+    ip_addresses->clear();
 
     const FileDescriptor udp_fd(::socket(PF_INET, SOCK_DGRAM, 0));
     if (unlikely(udp_fd == -1))
-        throw std::runtime_error("in SimpleResolver::resolve: socket(2) failed (" + std::to_string(errno)+ ")!");
+        throw std::runtime_error("in SimpleResolver::lookUp: socket(2) failed (" + std::to_string(errno)+ ")!");
 
     // Turn off blocking because we are going to use select(2) which on Linux doesn't reliably work with
     // blocking file descriptors:
     FileUtil::SetNonblocking(udp_fd);
 
+    acquireQuerySlots(1);
+
     // Decide which resolver we should use and get the next request ID in a threadsafe manner:
     const in_addr_t resolver_address(getLeastBusyDnsServerAndIncUsageCount());
-
-    //
-    // Send the DNS request...
-    //
-
     const uint16_t request_id(getNextRequestId());
-    unsigned char packet[512];
-    const ptrdiff_t packet_size(Resolver::GenerateRequestPacket(hostname, request_id, packet));
-    if (unlikely(not SocketUtil::SendUdpRequest(udp_fd, resolver_address, 53 /* DNS service port */, packet, static_cast<unsigned>(packet_size))))
-        throw std::runtime_error("in SimpleResolver::resolve: sending a UDP request failed (" + std::to_string(errno)+ ")!");
-
-    //
-    // ...and now wait for a reply:
-    //
 
     // Allocate a buffer on the stack to hold UDP DNS server replies and make sure that it is 4-byte aligned:
-    const size_t MAX_UDP_REPLY_PACKET_SIZE(512);
     uint32_t reply_packet_buffer[(MAX_UDP_REPLY_PACKET_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
     unsigned char * const reply_packet(reinterpret_cast<unsigned char *>(reply_packet_buffer));
-    const size_t max_reply_packet_size(MAX_UDP_REPLY_PACKET_SIZE);
 
-    for (;;) {
-        const ssize_t actual_reply_packet_size(SocketUtil::TimedRead(udp_fd, time_limit, reply_packet, max_reply_packet_size));
-        if (actual_reply_packet_size <= 0) {
-            if (likely(errno == ETIMEDOUT))
-                return false;
-            throw std::runtime_error("in SimpleResolver::resolve: SocketUtil::TimedRead() failed (" + std::to_string(errno)+ ")!");
+    ReplyType reply_type(GARBLED_REPLY);
+    try {
+        sendRequest(udp_fd, hostname, resolver_address, request_id);
+
+        // Wait for a reply:
+        while (reply_type == GARBLED_REPLY) {
+            const ssize_t actual_reply_packet_size(SocketUtil::TimedRead(udp_fd, time_limit, reply_packet, MAX_UDP_REPLY_PACKET_SIZE));
+            if (actual_reply_packet_size <= 0) {
+                if (likely(errno == ETIMEDOUT))
+                    break;
+                throw std::runtime_error("in SimpleResolver::lookUp: SocketUtil::TimedRead() failed (" + std::to_string(errno)+ ")!");
+            }
+            reply_type = processServerReply(reply_packet, actual_reply_packet_size, request_id, hostname, ip_addresses);
         }
-        else if (processServerReply(reply_packet, actual_reply_packet_size, request_id, ip_addresses))
-            break;
+    } catch (...) {
+        decDnsServerUsageCount(resolver_address);
+        releaseQuerySlots(1);
+        throw;
     }
 
     decDnsServerUsageCount(resolver_address);
+    releaseQuerySlots(1);
+
+    return reply_type == RESOLVED_REPLY;
+}
+
 
-    return not ip_addresses->empty();
+unsigned SimpleResolver::acquireQuerySlots(const unsigned max_count) {
+    std::unique_lock<std::mutex> mutex_locker(query_slots_mutex_);
+    query_slots_condition_.wait(mutex_locker, [this]{ return available_query_slots_ > 0; });
+
+    const unsigned acquired_count(max_count < available_query_slots_ ? max_count : available_query_slots_);
+    available_query_slots_ -= acquired_count;
+    return acquired_count;
+}
+
+
+void SimpleResolver::releaseQuerySlots(const unsigned count) {
+    {
+        std::lock_guard<std::mutex> mutex_locker(query_slots_mutex_);
+        available_query_slots_ += count;
+    }
+    query_slots_condition_.notify_all();
 }
 
 
@@ -1007,25 +1195,54 @@ uint16_t SimpleResolver::getNextRequestId() {
 }
 
 
-bool SimpleResolver::processServerReply(const unsigned char * const reply_packet, const size_t reply_packet_size,
-                                        const uint16_t expected_reply_id, std::set<in_addr_t> * const ip_addresses)
+
+void SimpleResolver::sendRequest(const int udp_fd, const std::string &hostname, const in_addr_t resolver_address,
+                                 const uint16_t request_id)
+{
+    unsigned char packet[512];
+    const ptrdiff_t packet_size(Resolver::GenerateRequestPacket(hostname, request_id, packet));
+    if (unlikely(not SocketUtil::SendUdpRequest(udp_fd, resolver_address, 53 /* DNS service port */, packet, static_cast<unsigned>(packet_size))))
+        throw std::runtime_error("in SimpleResolver::sendRequest: sending a UDP request failed (" + std::to_string(errno)+ ")!");
+}
+
+
+SimpleResolver::ReplyType SimpleResolver::processServerReply(const unsigned char * const reply_packet, const size_t reply_packet_size,
+                                                             const uint16_t expected_reply_id, const std::string &hostname,
+                                                             std::set<in_addr_t> * const ip_addresses)
 {
+    if (unlikely(reply_packet_size < sizeof(HEADER)))
+        return GARBLED_REPLY;
+
+    const HEADER * const dns_header(reinterpret_cast<const HEADER *>(reply_packet));
+    if (unlikely(ntohs(dns_header->id) != expected_reply_id)) // We most likely received a reply to an earlier request
+        return GARBLED_REPLY;                                   // and will ignore it!
+
+    // The server authoritatively told us that "hostname" does not exist:
+    if (dns_header->rcode == 3 /* NXDOMAIN */) {
+        dns_cache_.insertUnresolvable(hostname);
+        return UNRESOLVABLE_REPLY;
+    }
+
     std::set<std::string> hostnames;
     uint32_t ttl(0);
     uint16_t reply_id;
     bool truncated;
     if (not Resolver::DecodeReply(reply_packet, reply_packet_size, &hostnames, ip_addresses, &ttl,
                                   &reply_id, &truncated)) // We received a garbled reply packet and will ignore it!
-        return false;
-    else if (unlikely(reply_id != expected_reply_id))     // We most likely received a reply to an earlier request
-        return false;                                 // and will ignore it!
-    else { // We're in luck.
-        if (not ip_addresses->empty()) {
-            // Update the DNS cache:
-            for (const auto &hostname : hostnames)
-                dns_cache_.insert(hostname, *ip_addresses, ttl);
-        }
-
-        return true;
+        return GARBLED_REPLY;
+    if (unlikely(truncated))
+        return FAILED_REPLY;
+
+    // The name exists but has no A records:
+    if (ip_addresses->empty()) {
+        dns_cache_.insertUnresolvable(hostname);
+        return UNRESOLVABLE_REPLY;
     }
+
+    // Update the DNS cache:
+    hostnames.insert(hostname);
+    for (const auto &domainname : hostnames)
+        dns_cache_.insert(domainname, *ip_addresses, ttl);
+
+    return RESOLVED_REPLY;
 }
@@ -28,11 +28,12 @@
 #include "RobotsDotTxt.h"
 #include <mutex>
 #include <sstream>
-#include <unordered_set>
 #include <cstring>
+#include "BinaryIO.h"
 #include "Compiler.h"
 #include "DbConnection.h"
 #include "DbRow.h"
+#include "FileUtil.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 
@@ -405,42 +406,38 @@ void RobotsMetaTagExtractor::notify(const Chunk &chunk) {
 
 
 std::mutex RobotsDotTxtCache::mutex_;
-RobotsDotTxtCache *RobotsDotTxtCache::the_singleton_(nullptr);
 
 
 void RobotsDotTxtCache::clear() {
     std::lock_guard<std::mutex> mutex_locker(mutex_);
-    nonThreadSafeClear();
+    std::atomic_store(&key_to_entry_map_, std::make_shared<const KeyToEntryMap>());
 }
 
 
-void RobotsDotTxtCache::insert(const std::string &new_hostname, const std::string &new_robots_dot_txt) {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-
-    if (unlikely(hostname_to_robots_dot_txt_map_.size() == max_cache_size_))
-        nonThreadSafeClear();
-
-    hostname_to_robots_dot_txt_map_.insert(std::make_pair<std::string, RobotsDotTxt *>(TextUtil::UTF8ToLower(new_hostname),
-                                                                                       new RobotsDotTxt(new_robots_dot_txt)));
-}
-
+std::shared_ptr<const RobotsDotTxt> RobotsDotTxtCache::insert(const std::string &robots_dot_txt_url,
+                                                              const std::string &robots_dot_txt_contents)
+{
+    // Parse outside of the critical section:
+    const auto new_entry(std::make_shared<const Entry>(robots_dot_txt_contents, std::time(nullptr) + time_to_live_));
 
-void RobotsDotTxtCache::addAlias(const std::string &original_hostname, const std::string &new_hostname) {
-    std::lock_guard<std::mutex>mutex_locker(mutex_);
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    nonThreadSafeInsert({ { TextUtil::UTF8ToLower(robots_dot_txt_url), new_entry } });
 
-    std::unordered_map<std::string, RobotsDotTxt *>::const_iterator entry(
-        hostname_to_robots_dot_txt_map_.find(TextUtil::UTF8ToLower(original_hostname)));
-    if (unlikely(entry == hostname_to_robots_dot_txt_map_.end()))
-        throw std::runtime_error("in RobotsDotTxtCache::addAlias: can't add an additional hostname reference for a "
-                                 "non-existent entry!");
-    hostname_to_robots_dot_txt_map_.insert(std::make_pair(TextUtil::UTF8ToLower(new_hostname), entry->second));
+    return std::shared_ptr<const RobotsDotTxt>(new_entry, &new_entry->robots_dot_txt_);
 }
 
 
-bool RobotsDotTxtCache::hasHostname(const std::string &hostname) const {
+void RobotsDotTxtCache::addAlias(const std::string &original_robots_dot_txt_url,
+                                 const std::string &new_robots_dot_txt_url)
+{
     std::lock_guard<std::mutex> mutex_locker(mutex_);
 
-    return hostname_to_robots_dot_txt_map_.find(hostname) != hostname_to_robots_dot_txt_map_.end();
+    const auto key_to_entry_map(std::atomic_load(&key_to_entry_map_));
+    const auto key_and_entry(key_to_entry_map->find(TextUtil::UTF8ToLower(original_robots_dot_txt_url)));
+    if (unlikely(key_and_entry == key_to_entry_map->cend()))
+        throw std::runtime_error("in RobotsDotTxtCache::addAlias: can't add an additional URL reference for a "
+                                 "non-existent entry!");
+    nonThreadSafeInsert({ { TextUtil::UTF8ToLower(new_robots_dot_txt_url), key_and_entry->second } });
 }
 
 
@@ -451,39 +448,93 @@ void RobotsDotTxtCache::setMaxCacheSize(const unsigned new_max_cache_size) {
     std::lock_guard<std::mutex> mutex_locker(mutex_);
 
     max_cache_size_ = new_max_cache_size;
-    if (hostname_to_robots_dot_txt_map_.size() > new_max_cache_size)
-        nonThreadSafeClear();
+    if (std::atomic_load(&key_to_entry_map_)->size() > new_max_cache_size)
+        std::atomic_store(&key_to_entry_map_, std::make_shared<const KeyToEntryMap>());
 }
 
 
-const RobotsDotTxt *RobotsDotTxtCache::getRobotsDotTxt(const std::string &hostname) const {
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
+std::shared_ptr<const RobotsDotTxt> RobotsDotTxtCache::getRobotsDotTxt(const std::string &robots_dot_txt_url) const {
+    const auto key_to_entry_map(std::atomic_load(&key_to_entry_map_));
+    const auto key_and_entry(key_to_entry_map->find(TextUtil::UTF8ToLower(robots_dot_txt_url)));
+    if (key_and_entry == key_to_entry_map->cend() or key_and_entry->second->expiration_time_ <= std::time(nullptr))
+        return nullptr;
 
-    std::unordered_map<std::string, RobotsDotTxt *>::const_iterator entry(
-        hostname_to_robots_dot_txt_map_.find(TextUtil::UTF8ToLower(hostname)));
-    return entry == hostname_to_robots_dot_txt_map_.end() ? nullptr : entry->second;
+    return std::shared_ptr<const RobotsDotTxt>(key_and_entry->second, &key_and_entry->second->robots_dot_txt_);
 }
 
 
-RobotsDotTxtCache &RobotsDotTxtCache::GetInstance() {
+void RobotsDotTxtCache::saveSnapshot(const std::string &snapshot_filename) const {
+    const auto key_to_entry_map(std::atomic_load(&key_to_entry_map_));
+    const time_t now(std::time(nullptr));
+
+    KeyToEntryMap unexpired_entries;
+    for (const auto &key_and_entry : *key_to_entry_map) {
+        if (key_and_entry.second->expiration_time_ > now)
+            unexpired_entries.emplace(key_and_entry);
+    }
+
+    const auto snapshot(FileUtil::OpenOutputFileOrDie(snapshot_filename));
+    BinaryIO::WriteOrDie(*snapshot, static_cast<uint64_t>(unexpired_entries.size()));
+    for (const auto &key_and_entry : unexpired_entries) {
+        BinaryIO::WriteOrDie(*snapshot, key_and_entry.first);
+        BinaryIO::WriteOrDie(*snapshot, key_and_entry.second->robots_dot_txt_contents_);
+        BinaryIO::WriteOrDie(*snapshot, static_cast<int64_t>(key_and_entry.second->expiration_time_));
+    }
+}
+
+
+unsigned RobotsDotTxtCache::loadSnapshot(const std::string &snapshot_filename) {
+    const auto snapshot(FileUtil::OpenInputFileOrDie(snapshot_filename));
+    const time_t now(std::time(nullptr));
+
+    uint64_t entry_count;
+    BinaryIO::ReadOrDie(*snapshot, &entry_count);
+
+    KeyToEntryMap new_entries;
+    for (uint64_t i(0); i < entry_count; ++i) {
+        std::string key;
+        BinaryIO::ReadOrDie(*snapshot, &key);
+
+        std::string robots_dot_txt_contents;
+        BinaryIO::ReadOrDie(*snapshot, &robots_dot_txt_contents);
+
+        int64_t expiration_time;
+        BinaryIO::ReadOrDie(*snapshot, &expiration_time);
+
+        if (expiration_time > now)
+            new_entries.emplace(key, std::make_shared<const Entry>(robots_dot_txt_contents, expiration_time));
+    }
+
     std::lock_guard<std::mutex> mutex_locker(mutex_);
+    nonThreadSafeInsert(new_entries);
+
+    return new_entries.size();
+}
 
-    if (the_singleton_ == nullptr)
-        the_singleton_ = new RobotsDotTxtCache;
 
-    return *the_singleton_;
+RobotsDotTxtCache &RobotsDotTxtCache::GetInstance() {
+    static RobotsDotTxtCache the_singleton; // Initialisation is threadsafe.
+    return the_singleton;
 }
 
 
-void RobotsDotTxtCache::nonThreadSafeClear() {
-    std::unordered_set<RobotsDotTxt *> already_deleted;
-    for (const auto &entry : hostname_to_robots_dot_txt_map_) {
-        // Have we deleted the current RobotsDotTxt object yet?
-        if (already_deleted.find(entry.second) == already_deleted.end()) {
-            already_deleted.insert(entry.second); // Never again!
-            delete entry.second;
-        }
+void RobotsDotTxtCache::nonThreadSafeInsert(const KeyToEntryMap &new_entries) {
+    const auto old_key_to_entry_map(std::atomic_load(&key_to_entry_map_));
+    const time_t now(std::time(nullptr));
+
+    auto new_key_to_entry_map(std::make_shared<KeyToEntryMap>());
+    new_key_to_entry_map->reserve(old_key_to_entry_map->size() + new_entries.size());
+    for (const auto &key_and_entry : *old_key_to_entry_map) {
+        if (key_and_entry.second->expiration_time_ > now)
+            new_key_to_entry_map->emplace(key_and_entry);
     }
 
-    hostname_to_robots_dot_txt_map_.clear();
+    // Like before we start over if the cache is full, even after dropping the expired entries:
+    if (unlikely(new_key_to_entry_map->size() + new_entries.size() > max_cache_size_))
+        new_key_to_entry_map->clear();
+
+    for (const auto &key_and_entry : new_entries)
+        (*new_key_to_entry_map)[key_and_entry.first] = key_and_entry.second;
+
+    std::atomic_store(&key_to_entry_map_, std::shared_ptr<const KeyToEntryMap>(new_key_to_entry_map));
 }
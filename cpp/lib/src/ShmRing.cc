@@ -0,0 +1,323 @@
+/** \brief Implementation of class ShmRing.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ShmRing.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "util.h"
+
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 and ATOMIC_INT_LOCK_FREE == 2,
+              "we need lock-free, and thus address-free, atomics in shared memory!");
+
+
+constexpr size_t ShmRing::DEFAULT_CAPACITY;
+constexpr const char *ShmRing::PATH_PREFIX;
+
+
+// Lives in the first page of the shared memory object.  ftruncate(2) zero-fills it, which is our initial state.
+struct ShmRing::Header {
+    static constexpr uint64_t MAGIC = 0x00676E69526D6853ull; // "ShmRing" as a little-endian string.
+
+    std::atomic<uint64_t> magic_; // Set last by the writer, so that readers won't see a partially initialised header.
+    uint64_t capacity_;
+    std::atomic<int32_t> writer_pid_, reader_pid_;
+
+    // Written by the writer:
+    alignas(64) std::atomic<uint64_t> write_position_;
+    std::atomic<uint32_t> data_sequence_; // Incremented whenever "write_position_" or "writer_closed_" changes.
+    std::atomic<uint32_t> writer_closed_;
+    std::atomic<uint64_t> writer_wants_;  // If not 0, the read position that the writer is waiting for.
+
+    // Written by the reader:
+    alignas(64) std::atomic<uint64_t> read_position_;
+    std::atomic<uint32_t> space_sequence_; // Incremented whenever "read_position_" or "reader_detached_" changes.
+    std::atomic<uint32_t> reader_detached_;
+    std::atomic<uint64_t> reader_wants_;   // If not 0, the write position that the reader is waiting for.
+};
+
+
+constexpr uint64_t ShmRing::Header::MAGIC;
+
+
+namespace {
+
+
+const unsigned PEER_CHECK_INTERVAL(1000); // ms
+
+
+// Waits until "*word" != "expected", we get woken up or "timeout" milliseconds have passed.  No FUTEX_PRIVATE_FLAG as
+// the word lives in memory that is shared between processes.
+void FutexWait(std::atomic<uint32_t> * const word, const uint32_t expected, const unsigned timeout) {
+    const timespec timeout_spec{ timeout / 1000, static_cast<long>(timeout % 1000) * 1000000L };
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, &timeout_spec, nullptr, 0);
+}
+
+
+void FutexWake(std::atomic<uint32_t> * const word) {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+inline bool ProcessExists(const pid_t pid) {
+    return ::kill(pid, 0) == 0 or errno != ESRCH;
+}
+
+
+} // unnamed namespace
+
+
+ShmRing::ShmRing(const std::string &name, const Role role, const size_t capacity)
+    : name_(name), role_(role), fd_(-1), header_(nullptr), data_(nullptr), capacity_(0), mapping_size_(0), position_(0),
+      closed_(false)
+{
+    if (unlikely(name.empty() or name.find('/') != std::string::npos))
+        LOG_ERROR("invalid shared memory ring name \"" + name + "\"!");
+
+    if (role == WRITER)
+        createRing(capacity);
+    else
+        attachToRing();
+}
+
+
+ShmRing::~ShmRing() {
+    if (role_ == WRITER) {
+        close();
+        waitForReader();
+    } else {
+        header_->reader_detached_.store(1);
+        header_->space_sequence_.fetch_add(1);
+        FutexWake(&header_->space_sequence_);
+    }
+
+    ::munmap(reinterpret_cast<void *>(header_), mapping_size_);
+    ::close(fd_);
+}
+
+
+void ShmRing::createRing(const size_t capacity) {
+    const size_t page_size(::sysconf(_SC_PAGESIZE));
+    const size_t rounded_capacity((std::max(capacity, page_size) + page_size - 1) / page_size * page_size);
+
+    // A leftover object of the same name, e.g. from a crashed pipeline, is useless to anybody:
+    const std::string shm_name("/" + name_);
+    ::shm_unlink(shm_name.c_str());
+    fd_ = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (unlikely(fd_ == -1))
+        LOG_ERROR("failed to create the shared memory object \"" + shm_name + "\"!");
+    if (unlikely(::ftruncate(fd_, page_size + rounded_capacity) != 0))
+        LOG_ERROR("failed to set the size of the shared memory object \"" + shm_name + "\"!");
+
+    mapRing(rounded_capacity);
+    header_->capacity_ = rounded_capacity;
+    header_->writer_pid_.store(::getpid());
+    header_->magic_.store(Header::MAGIC);
+}
+
+
+void ShmRing::attachToRing() {
+    const std::string shm_name("/" + name_);
+    const timespec POLL_INTERVAL{ 0, 10 * 1000000L };
+    for (;;) {
+        fd_ = ::shm_open(shm_name.c_str(), O_RDWR, 0);
+        if (fd_ == -1) {
+            if (unlikely(errno != ENOENT))
+                LOG_ERROR("failed to open the shared memory object \"" + shm_name + "\"!");
+            ::nanosleep(&POLL_INTERVAL, nullptr);
+            continue;
+        }
+
+        // Wait for the writer to finish its initialisation:
+        struct stat stat_buf;
+        const size_t page_size(::sysconf(_SC_PAGESIZE));
+        if (::fstat(fd_, &stat_buf) == 0 and static_cast<size_t>(stat_buf.st_size) > page_size) {
+            void * const header_page(::mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fd_, 0));
+            if (unlikely(header_page == MAP_FAILED))
+                LOG_ERROR("failed to map the header of the shared memory object \"" + shm_name + "\"!");
+            const Header * const header(reinterpret_cast<const Header *>(header_page));
+            const bool initialised(header->magic_.load() == Header::MAGIC);
+            const size_t capacity(header->capacity_);
+            const pid_t writer_pid(header->writer_pid_.load());
+            const bool claimed(header->reader_pid_.load() != 0);
+            ::munmap(header_page, page_size);
+
+            // Writers don't exit before a reader has attached, see waitForReader().  A dead writer therefore means that
+            // we found a stale ring, e.g. from a crashed pipeline, whose data we must not replay.  We don't unlink it
+            // either, as it may already have been replaced by the new writer, which will replace it in any case.
+            if (initialised and not claimed and ProcessExists(writer_pid)) {
+                mapRing(capacity);
+                int32_t no_reader(0);
+                if (unlikely(not header_->reader_pid_.compare_exchange_strong(no_reader, ::getpid())))
+                    LOG_ERROR("the shared memory ring \"" + name_ + "\" already has a reader!");
+                ::shm_unlink(shm_name.c_str()); // Our mapping stays valid and nobody else should attach.
+                header_->space_sequence_.fetch_add(1);
+                FutexWake(&header_->space_sequence_);
+                return;
+            }
+        }
+
+        ::close(fd_);
+        ::nanosleep(&POLL_INTERVAL, nullptr);
+    }
+}
+
+
+// Maps the header page followed by the data area, and then the data area once more, right behind the first mapping.
+void ShmRing::mapRing(const size_t capacity) {
+    const size_t page_size(::sysconf(_SC_PAGESIZE));
+    capacity_     = capacity;
+    mapping_size_ = page_size + 2 * capacity;
+
+    char * const reservation(reinterpret_cast<char *>(::mmap(nullptr, mapping_size_, PROT_NONE,
+                                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)));
+    if (unlikely(reservation == MAP_FAILED))
+        LOG_ERROR("failed to reserve " + std::to_string(mapping_size_) + " bytes of address space for \"" + name_ + "\"!");
+    if (unlikely(::mmap(reservation, page_size + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_, 0)
+                 == MAP_FAILED
+                 or ::mmap(reservation + page_size + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_,
+                           page_size) == MAP_FAILED))
+        LOG_ERROR("failed to map the shared memory ring \"" + name_ + "\"!");
+
+    header_ = reinterpret_cast<Header *>(reservation);
+    data_   = reservation + page_size;
+}
+
+
+void ShmRing::waitForReader() {
+    for (;;) {
+        const uint32_t sequence(header_->space_sequence_.load());
+        if (header_->reader_pid_.load() != 0)
+            return;
+        FutexWait(&header_->space_sequence_, sequence, PEER_CHECK_INTERVAL);
+    }
+}
+
+
+void ShmRing::checkPeer(const pid_t peer_pid) const {
+    if (unlikely(peer_pid != 0 and not ProcessExists(peer_pid)))
+        LOG_ERROR("the " + std::string(role_ == WRITER ? "reader" : "writer") + " of the shared memory ring \"" + name_
+                  + "\" has died!");
+}
+
+
+char *ShmRing::reserve(const size_t size) {
+    if (unlikely(size > capacity_))
+        LOG_ERROR("can't reserve " + std::to_string(size) + " bytes in the shared memory ring \"" + name_ + "\"!");
+
+    const uint64_t needed_read_position(position_ + size - capacity_);
+    for (;;) {
+        const uint32_t sequence(header_->space_sequence_.load());
+        if (unlikely(header_->reader_detached_.load()))
+            LOG_ERROR("the reader of the shared memory ring \"" + name_ + "\" has gone away!");
+        if (position_ + size <= capacity_ or header_->read_position_.load() >= needed_read_position)
+            return data_ + position_ % capacity_;
+
+        header_->writer_wants_.store(needed_read_position);
+        FutexWait(&header_->space_sequence_, sequence, PEER_CHECK_INTERVAL);
+        header_->writer_wants_.store(0);
+        checkPeer(header_->reader_pid_.load());
+    }
+}
+
+
+void ShmRing::commit(const size_t size) {
+    position_ += size;
+    header_->write_position_.store(position_);
+    header_->data_sequence_.fetch_add(1);
+
+    const uint64_t reader_wants(header_->reader_wants_.load());
+    if (reader_wants != 0 and position_ >= reader_wants)
+        FutexWake(&header_->data_sequence_);
+}
+
+
+void ShmRing::write(const char *data, size_t size) {
+    // Smaller chunks let the reader start before we have filled the entire ring:
+    const size_t max_chunk_size(std::max(capacity_ / 4, size_t(1)));
+    while (size > 0) {
+        const size_t chunk_size(std::min(size, max_chunk_size));
+        std::memcpy(reserve(chunk_size), data, chunk_size);
+        commit(chunk_size);
+        data += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+
+void ShmRing::close() {
+    if (closed_)
+        return;
+
+    header_->writer_closed_.store(1);
+    header_->data_sequence_.fetch_add(1);
+    FutexWake(&header_->data_sequence_);
+    closed_ = true;
+}
+
+
+size_t ShmRing::waitForData(const size_t size) {
+    for (;;) {
+        const uint32_t sequence(header_->data_sequence_.load());
+        const bool writer_closed(header_->writer_closed_.load() != 0); // Must be loaded before the write position!
+        const size_t available(header_->write_position_.load() - position_);
+        if (available >= size or writer_closed)
+            return available;
+
+        header_->reader_wants_.store(position_ + size);
+        FutexWait(&header_->data_sequence_, sequence, PEER_CHECK_INTERVAL);
+        header_->reader_wants_.store(0);
+        checkPeer(header_->writer_pid_.load());
+    }
+}
+
+
+void ShmRing::consume(const size_t size) {
+    if (size == 0)
+        return;
+
+    position_ += size;
+    header_->read_position_.store(position_);
+    header_->space_sequence_.fetch_add(1);
+
+    const uint64_t writer_wants(header_->writer_wants_.load());
+    if (writer_wants != 0 and position_ >= writer_wants)
+        FutexWake(&header_->space_sequence_);
+}
+
+
+bool ShmRing::ParsePath(const std::string &path, std::string * const name) {
+    const size_t prefix_length(std::strlen(PATH_PREFIX));
+    if (path.compare(0, prefix_length, PATH_PREFIX) != 0)
+        return false;
+
+    *name = path.substr(prefix_length);
+    return true;
+}
@@ -19,7 +19,15 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "SimpleCrawler.h"
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "Resolver.h"
+#include "RobotsDotTxt.h"
 #include "StringUtil.h"
+#include "Url.h"
 #include "WebUtil.h"
 
 
@@ -28,13 +36,13 @@ SimpleCrawler::Params::Params(const std::string &acceptable_languages, const uns
                               const bool print_last_http_header, const bool ignore_robots_dot_txt,
                               const bool print_redirects, const std::string &user_agent,
                               const std::string &url_ignore_pattern, const bool ignore_ssl_certificates,
-                              const std::string &proxy_host_and_port)
+                              const std::string &proxy_host_and_port, const unsigned max_concurrent_hosts)
     : acceptable_languages_(acceptable_languages), timeout_(timeout),
       min_url_processing_time_(min_url_processing_time), print_all_http_headers_(print_all_http_headers),
       print_last_http_header_(print_last_http_header), ignore_robots_dot_txt_(ignore_robots_dot_txt),
       print_redirects_(print_redirects), user_agent_(user_agent),
       url_ignore_pattern_(url_ignore_pattern), ignore_ssl_certificates_(ignore_ssl_certificates),
-      proxy_host_and_port_(proxy_host_and_port) {}
+      proxy_host_and_port_(proxy_host_and_port), max_concurrent_hosts_(max_concurrent_hosts) {}
 
 
 void SimpleCrawler::extractLocationUrls(const std::string &header_blob, std::list<std::string> * const location_urls) {
@@ -96,6 +104,7 @@ SimpleCrawler::SimpleCrawler(const SiteDesc &site_desc, const Params &params)
 {
     std::queue<std::string> url_queue_start;
     url_queue_start.push(site_desc.start_url_);
+    seen_url_hashes_.emplace(StringUtil::CalcXXHash64(site_desc.start_url_));
     url_queue_current_depth_.swap(url_queue_start);
     std::queue<std::string> url_queue_empty;
     url_queue_next_depth_.swap(url_queue_empty);
@@ -110,6 +119,45 @@ SimpleCrawler::SimpleCrawler(const SiteDesc &site_desc, const Params &params)
     downloader_.params_.honour_robots_dot_txt_   = not params.ignore_robots_dot_txt_;
     downloader_.params_.ignore_ssl_certificates_ = params.ignore_ssl_certificates_;
     downloader_.params_.proxy_host_and_port_     = params.proxy_host_and_port_;
+    downloader_.params_.use_simple_resolver_     = true;
+
+    if (not params.ignore_robots_dot_txt_)
+        applyCrawlDelay(site_desc.start_url_);
+}
+
+
+void SimpleCrawler::enqueueUrl(const std::string &url) {
+    if (seen_url_hashes_.emplace(StringUtil::CalcXXHash64(url)).second) {
+        url_queue_next_depth_.push(url);
+        next_depth_hostnames_.emplace(Url(url).getAuthority());
+    }
+}
+
+
+void SimpleCrawler::prefetchNextDepthHostnames() {
+    if (params_.proxy_host_and_port_.empty() and not next_depth_hostnames_.empty()) {
+        try {
+            SimpleResolver::GetDefaultInstance().prefetch(
+                std::vector<std::string>(next_depth_hostnames_.cbegin(), next_depth_hostnames_.cend()), params_.timeout_);
+        } catch (const std::exception &x) {
+            LOG_WARNING("DNS prefetch failed: " + std::string(x.what()));
+        }
+    }
+    next_depth_hostnames_.clear();
+}
+
+
+void SimpleCrawler::applyCrawlDelay(const std::string &start_url) {
+    // Also primes the RobotsDotTxtCache for our downloader's subsequent access checks:
+    const auto robots_dot_txt(downloader_.getRobotsDotTxt(Url(start_url), params_.timeout_));
+    if (robots_dot_txt == nullptr)
+        return;
+
+    const unsigned crawl_delay(robots_dot_txt->getCrawlDelay(params_.user_agent_) * 1000); // s => ms
+    if (crawl_delay > params_.min_url_processing_time_) {
+        LOG_INFO("using a crawl delay of " + std::to_string(crawl_delay) + " ms for \"" + start_url + "\".");
+        min_url_processing_time_ = crawl_delay;
+    }
 }
 
 
@@ -128,6 +176,7 @@ bool SimpleCrawler::continueCrawling() {
             return false;
         else {
             --remaining_crawl_depth_;
+            prefetchNextDepthHostnames();
             url_queue_current_depth_.swap(url_queue_next_depth_);
             url_queue_next_depth_ = std::queue<std::string>();
         }
@@ -187,7 +236,7 @@ bool SimpleCrawler::getNextPage(PageDetails * const page_details) {
         for (const auto &url_and_anchor_texts : urls_and_anchor_texts) {
             const std::string extracted_url(url_and_anchor_texts.getUrl());
             if (not url_regex_matcher_ or url_regex_matcher_->matched(extracted_url))
-                url_queue_next_depth_.push(extracted_url);
+                enqueueUrl(extracted_url);
         }
     }
 
@@ -207,6 +256,58 @@ void SimpleCrawler::ProcessSite(const SiteDesc &site_desc, const Params &params,
 void SimpleCrawler::ProcessSites(const std::string &config_path, const SimpleCrawler::Params &params, std::vector<std::string> * const extracted_urls) {
     std::vector<SimpleCrawler::SiteDesc> site_descs;
     SimpleCrawler::ParseConfigFile(config_path, &site_descs);
-    for (const auto &site_desc : site_descs)
-        SimpleCrawler::ProcessSite(site_desc, params, extracted_urls);
+
+    // Our crawl frontier: one queue of sites per host, each of which will be processed by a single worker.
+    std::vector<std::vector<size_t>> host_queues;
+    std::unordered_map<std::string, size_t> hosts_to_queue_indices_map;
+    for (size_t site_index(0); site_index < site_descs.size(); ++site_index) {
+        const std::string host(StringUtil::ASCIIToLower(Url(site_descs[site_index].start_url_).getAuthority()));
+        const auto host_and_queue_index(hosts_to_queue_indices_map.find(host));
+        if (host_and_queue_index != hosts_to_queue_indices_map.end())
+            host_queues[host_and_queue_index->second].emplace_back(site_index);
+        else {
+            hosts_to_queue_indices_map.emplace(host, host_queues.size());
+            host_queues.emplace_back(std::vector<size_t>{ site_index });
+        }
+    }
+
+    std::vector<std::vector<std::string>> site_indices_to_extracted_urls(site_descs.size());
+    size_t next_host_queue(0);
+    std::exception_ptr exception;
+    std::mutex mutex;
+    const auto worker([&]() {
+        for (;;) {
+            size_t host_queue_index;
+            {
+                std::lock_guard<std::mutex> mutex_locker(mutex);
+                if (next_host_queue == host_queues.size() or exception != nullptr)
+                    return;
+                host_queue_index = next_host_queue++;
+            }
+
+            try {
+                for (const size_t site_index : host_queues[host_queue_index])
+                    SimpleCrawler::ProcessSite(site_descs[site_index], params,
+                                               &site_indices_to_extracted_urls[site_index]);
+            } catch (...) {
+                std::lock_guard<std::mutex> mutex_locker(mutex);
+                if (exception == nullptr)
+                    exception = std::current_exception();
+            }
+        }
+    });
+
+    const size_t worker_count(std::max<size_t>(1, std::min<size_t>(params.max_concurrent_hosts_, host_queues.size())));
+    std::vector<std::thread> workers;
+    for (size_t worker_no(1); worker_no < worker_count; ++worker_no)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &worker_thread : workers)
+        worker_thread.join();
+
+    if (exception != nullptr)
+        std::rethrow_exception(exception);
+
+    for (const auto &site_extracted_urls : site_indices_to_extracted_urls)
+        extracted_urls->insert(extracted_urls->end(), site_extracted_urls.cbegin(), site_extracted_urls.cend());
 }
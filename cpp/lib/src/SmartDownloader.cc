@@ -95,7 +95,7 @@ bool DSpaceDownloader::downloadDocImpl(const std::string &url, const TimeLimit &
     if (not DownloadHelper(url, time_limit, document, http_header_charset, error_message))
         return false;
 
-    static RegexMatcher *matcher;
+    static thread_local RegexMatcher *matcher;
     if (matcher == nullptr) {
         std::string err_msg;
         matcher = RegexMatcher::RegexMatcherFactory("meta content=\"http(.*)pdf\"", &err_msg);
@@ -160,7 +160,7 @@ bool DigiToolSmartDownloader::downloadDocImpl(const std::string &url, const Time
                                               std::string * const document, std::string * const http_header_charset,
                                               std::string * const error_message)
 {
-    static RegexMatcher * const matcher(
+    static thread_local RegexMatcher * const matcher(
         RegexMatcher::RegexMatcherFactory("http://digitool.hbz-nrw.de:1801/webclient/DeliveryManager\\?pid=\\d+"));
 
     std::string err_msg;
@@ -332,7 +332,8 @@ bool SmartDownload(const std::string &url, const TimeLimit &time_limit, std::str
 {
     document->clear();
 
-    static std::vector<SmartDownloader *> smart_downloaders{
+    // Our downloaders and their regex matchers keep state between calls, so each thread gets its own set:
+    static thread_local std::vector<SmartDownloader *> smart_downloaders{
         new DSpaceDownloader(trace),
         new SimpleSuffixDownloader({ ".pdf", ".jpg", ".jpeg", ".txt" }, trace),
         new SimplePrefixDownloader({ "http://www.bsz-bw.de/cgi-bin/ekz.cgi?" }, trace),
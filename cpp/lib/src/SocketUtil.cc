@@ -210,6 +210,49 @@ int TcpConnect(const std::string &address, const unsigned short port, const Time
 }
 
 
+int NonblockingTcpConnect(const in_addr_t address, const unsigned short port, std::string * const error_message,
+                          const NagleOptionType nagle_option)
+{
+    error_message->clear();
+
+    FileDescriptor socket_fd(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (unlikely(not socket_fd.isValid())) {
+        *error_message = "socket(2) failed (" + std::to_string(errno) + ")!";
+        return -1;
+    }
+
+    if (nagle_option == DISABLE_NAGLE) {
+        const int no_delay_flag = 1;
+        if (::setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay_flag, sizeof(no_delay_flag)) != 0) {
+            *error_message = "setsockopt(2) failed for TCP_NODELAY (" + std::to_string(errno) + ")!";
+            return -1;
+        }
+    }
+
+    struct sockaddr_in server_address;
+    std::memset(&server_address, '\0', sizeof server_address);
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    server_address.sin_addr.s_addr = address;
+
+    if (::connect(socket_fd, (struct sockaddr *)&server_address, sizeof(server_address)) != 0 and errno != EINPROGRESS) {
+        *error_message = "connect(2) failed (" + std::to_string(errno) + ")!";
+        return -1;
+    }
+
+    return socket_fd.release();
+}
+
+
+int GetPendingError(const int socket_fd) {
+    int error;
+    socklen_t error_size(sizeof(error));
+    if (::getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &error_size) != 0)
+        return errno;
+    return error;
+}
+
+
 ssize_t TimedRead(int socket_fd, const TimeLimit &time_limit, void * const data, size_t data_size,
                   SslConnection * const ssl_connection)
 {
@@ -20,10 +20,15 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Solr.h"
+#include <algorithm>
+#include <limits>
+#include "Compiler.h"
 #include "Downloader.h"
 #include "HttpHeader.h"
 #include "JSON.h"
+#include "Metrics.h"
 #include "UrlUtil.h"
+#include "util.h"
 
 
 namespace Solr {
@@ -53,28 +58,276 @@ std::string XMLError(const std::string &xml_response) {
 
 bool Query(const std::string &query, const std::string &fields, std::string * const xml_or_json_result,
            std::string * const err_msg, const std::string &host_and_port, const unsigned timeout,
-           const QueryResultFormat query_result_format, const unsigned max_no_of_rows)
+           const QueryResultFormat query_result_format, const unsigned max_no_of_rows, const std::string &filter_query)
+{
+    Client client(host_and_port, timeout);
+    return client.query(query, fields, xml_or_json_result, err_msg, query_result_format, max_no_of_rows, filter_query);
+}
+
+
+namespace {
+
+
+bool IsSuccessfulResponse(const Downloader &downloader) {
+    const HttpHeader &header(downloader.getHttpHeader());
+    return header.getStatusCode() >= 200 and header.getStatusCode() <= 299;
+}
+
+
+// Incrementally extracts the elements of the "docs" array from a JSON response that arrives in arbitrary chunks and
+// parses each of them as soon as it is complete.  Only the text of the current document is ever buffered.
+class DocumentStreamParser {
+    const Client::DocumentHandler &document_handler_;
+    std::vector<char> container_stack_; // '{' or '[' for objects and arrays, 'D' for the "docs" array
+    bool in_string_, escaped_;
+    std::string last_string_, current_string_, current_document_;
+    std::string response_prefix_; // For error messages.
+    std::string error_message_;
+    bool aborted_;
+public:
+    explicit DocumentStreamParser(const Client::DocumentHandler &document_handler)
+        : document_handler_(document_handler), in_string_(false), escaped_(false), aborted_(false) { }
+
+    bool processChunk(const char * const data, const size_t size);
+    const std::string &getResponsePrefix() const { return response_prefix_; }
+    const std::string &getErrorMessage() const { return error_message_; }
+    bool aborted() const { return aborted_; }
+private:
+    bool processDocument();
+};
+
+
+bool DocumentStreamParser::processChunk(const char * const data, const size_t size) {
+    static const size_t MAX_RESPONSE_PREFIX_SIZE(4096);
+    if (response_prefix_.size() < MAX_RESPONSE_PREFIX_SIZE)
+        response_prefix_.append(data, std::min(size, MAX_RESPONSE_PREFIX_SIZE - response_prefix_.size()));
+
+    for (const char *ch(data); ch != data + size; ++ch) {
+        const bool in_document(not container_stack_.empty() and container_stack_.back() != 'D'
+                               and std::find(container_stack_.cbegin(), container_stack_.cend(), 'D') != container_stack_.cend());
+        if (in_document)
+            current_document_ += *ch;
+
+        if (in_string_) {
+            if (escaped_)
+                escaped_ = false;
+            else if (*ch == '\\')
+                escaped_ = true;
+            else if (*ch == '"') {
+                in_string_ = false;
+                last_string_.swap(current_string_);
+            } else if (not in_document)
+                current_string_ += *ch;
+            continue;
+        }
+
+        switch (*ch) {
+        case '"':
+            in_string_ = true;
+            current_string_.clear();
+            break;
+        case '{':
+            if (not container_stack_.empty() and container_stack_.back() == 'D')
+                current_document_ = "{";
+            container_stack_.push_back('{');
+            break;
+        case '[':
+            container_stack_.push_back((not in_document and last_string_ == "docs") ? 'D' : '[');
+            break;
+        case '}':
+        case ']':
+            if (unlikely(container_stack_.empty())) {
+                error_message_ = "unbalanced JSON response!";
+                return false;
+            }
+            container_stack_.pop_back();
+            if (*ch == '}' and not container_stack_.empty() and container_stack_.back() == 'D' and not processDocument())
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool DocumentStreamParser::processDocument() {
+    std::string document_text;
+    document_text.swap(current_document_);
+    JSON::Parser parser(document_text);
+    std::shared_ptr<JSON::JSONNode> document;
+    if (unlikely(not parser.parse(&document) or document->getType() != JSON::JSONNode::OBJECT_NODE)) {
+        error_message_ = "failed to parse a document: " + parser.getErrorMessage();
+        return false;
+    }
+
+    const auto document_object(JSON::JSONNode::CastToObjectNodeOrDie("document", document));
+    // Errors that occur after "/export" has started to stream are reported as a pseudo document:
+    if (unlikely(document_object->hasNode("EXCEPTION"))) {
+        error_message_ = document_object->getOptionalStringValue("EXCEPTION");
+        return false;
+    }
+
+    if (not document_handler_(document_object)) {
+        aborted_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+
+} // unnamed namespace
+
+
+Client::Client(const std::string &host_and_port, const unsigned timeout, const std::string &core)
+    : host_and_port_(host_and_port), core_(core), timeout_(timeout), downloader_(new Downloader()) { }
+
+
+Client::~Client() { }
+
+
+std::string Client::getBaseUrl(const std::string &request_handler) const {
+    return "http://" + host_and_port_ + "/solr/" + core_ + "/" + request_handler;
+}
+
+
+bool Client::query(const std::string &query, const std::string &fields, std::string * const xml_or_json_result,
+                   std::string * const err_msg, const QueryResultFormat query_result_format, const unsigned max_no_of_rows,
+                   const std::string &filter_query)
 {
     err_msg->clear();
-    const std::string url("http://" + host_and_port + "/solr/biblio/select?q=" + UrlUtil::UrlEncode(query)
+    const std::string url(getBaseUrl("select") + "?q=" + UrlUtil::UrlEncode(query)
                           + "&wt=" + std::string(query_result_format == XML ? "xml" : "json")
-                          + (fields.empty() ? "" : "&fl=" + fields) + "&rows=" + std::to_string(max_no_of_rows));
+                          + (fields.empty() ? "" : "&fl=" + fields) + "&rows=" + std::to_string(max_no_of_rows)
+                          + (filter_query.empty() ? "" : "&fq=" + UrlUtil::UrlEncode(filter_query)));
 
-    Downloader downloader(url, Downloader::Params(), timeout * 1000);
-    if (downloader.anErrorOccurred()) {
-        *err_msg = downloader.getLastErrorMessage();
+    return download(url, query_result_format, xml_or_json_result, err_msg);
+}
+
+
+bool Client::jsonRequest(const std::string &request_handler, const std::string &url_parameters, std::string * const json_result,
+                         std::string * const err_msg)
+{
+    err_msg->clear();
+    return download(getBaseUrl(request_handler) + "?wt=json&" + url_parameters, JSON, json_result, err_msg);
+}
+
+
+bool Client::download(const std::string &url, const QueryResultFormat result_format, std::string * const xml_or_json_result,
+                      std::string * const err_msg)
+{
+    static Metrics::Histogram &request_durations(Metrics::GetHistogram("solr_request_duration_ns", "Time spent per Solr request"));
+    static Metrics::Counter &failed_requests(Metrics::GetCounter("solr_failed_requests_total", "Solr requests that failed"));
+    Metrics::ScopedTimer timer(&request_durations);
+
+    if (not downloader_->newUrl(url, timeout_ * 1000)) {
+        *err_msg = downloader_->getLastErrorMessage();
+        failed_requests.increment();
         return false;
     }
-    *xml_or_json_result = downloader.getMessageBody();
+    *xml_or_json_result = downloader_->getMessageBody();
 
-    const HttpHeader header(downloader.getMessageHeader());
-    if (header.getStatusCode() >= 200 and header.getStatusCode() <= 299)
-        return  true;
+    if (IsSuccessfulResponse(*downloader_))
+        return true;
 
     if (not xml_or_json_result->empty())
-        *err_msg = (query_result_format == JSON) ? JSONError(*xml_or_json_result) : XMLError(*xml_or_json_result);
+        *err_msg = (result_format == JSON) ? JSONError(*xml_or_json_result) : XMLError(*xml_or_json_result);
+    if (err_msg->empty())
+        *err_msg = "Solr returned HTTP status " + std::to_string(downloader_->getHttpHeader().getStatusCode()) + "!";
+    failed_requests.increment();
     return false;
 }
 
 
+bool Client::queryAll(const std::string &query, const std::string &fields, const DocumentHandler &document_handler,
+                      std::string * const err_msg, const std::string &filter_query, const std::string &sort,
+                      const unsigned rows_per_page)
+{
+    err_msg->clear();
+    const std::string url_prefix(getBaseUrl("select") + "?q=" + UrlUtil::UrlEncode(query) + "&wt=json"
+                                 + (fields.empty() ? "" : "&fl=" + fields) + "&rows=" + std::to_string(rows_per_page)
+                                 + "&sort=" + UrlUtil::UrlEncode(sort)
+                                 + (filter_query.empty() ? "" : "&fq=" + UrlUtil::UrlEncode(filter_query)));
+
+    std::string cursor_mark("*");
+    for (;;) {
+        if (not downloader_->newUrl(url_prefix + "&cursorMark=" + UrlUtil::UrlEncode(cursor_mark), timeout_ * 1000)) {
+            *err_msg = downloader_->getLastErrorMessage();
+            return false;
+        }
+        const std::string &json_result(downloader_->getMessageBody());
+        if (not IsSuccessfulResponse(*downloader_)) {
+            *err_msg = JSONError(json_result);
+            if (err_msg->empty())
+                *err_msg = "Solr returned an error for \"" + query + "\"!";
+            return false;
+        }
+
+        // We hand the documents on while parsing so that we never hold the trees of a whole page:
+        bool aborted(false);
+        JSON::Parser parser(json_result);
+        std::shared_ptr<JSON::JSONNode> tree_root;
+        if (not parser.parse(&tree_root, "/response/docs",
+                             [&document_handler, &aborted](const std::shared_ptr<JSON::JSONNode> &document) {
+                                 if (unlikely(document->getType() != JSON::JSONNode::OBJECT_NODE))
+                                     return false;
+                                 aborted = not document_handler(JSON::JSONNode::CastToObjectNodeOrDie("document", document));
+                                 return not aborted;
+                             }))
+        {
+            if (not aborted)
+                *err_msg = "failed to parse a Solr response: " + parser.getErrorMessage();
+            return false;
+        }
+
+        const std::string next_cursor_mark(JSON::LookupString("/nextCursorMark", tree_root, ""));
+        if (unlikely(next_cursor_mark.empty())) {
+            *err_msg = "Solr response w/o a \"nextCursorMark\"!";
+            return false;
+        }
+        if (next_cursor_mark == cursor_mark) // Solr signals the end of the result set by returning the same mark.
+            return true;
+        cursor_mark = next_cursor_mark;
+    }
+}
+
+
+bool Client::exportAll(const std::string &query, const std::string &fields, const std::string &sort,
+                       const DocumentHandler &document_handler, std::string * const err_msg, const std::string &filter_query)
+{
+    err_msg->clear();
+    const std::string url(getBaseUrl("export") + "?q=" + UrlUtil::UrlEncode(query) + "&fl=" + fields
+                          + "&sort=" + UrlUtil::UrlEncode(sort)
+                          + (filter_query.empty() ? "" : "&fq=" + UrlUtil::UrlEncode(filter_query)));
+
+    DocumentStreamParser document_stream_parser(document_handler);
+    Downloader::Params params;
+    params.body_chunk_callback_ = [&document_stream_parser](const char * const data, const size_t size) {
+        return document_stream_parser.processChunk(data, size);
+    };
+
+    // Exporting a huge result set may take a lot longer than any regular request, so we don't use our timeout here.
+    Downloader downloader(params);
+    const bool success(downloader.newUrl(url, std::numeric_limits<unsigned>::max()));
+    if (document_stream_parser.aborted())
+        return false;
+    if (not document_stream_parser.getErrorMessage().empty()) {
+        *err_msg = document_stream_parser.getErrorMessage();
+        return false;
+    }
+    if (not success) {
+        *err_msg = downloader.getLastErrorMessage();
+        return false;
+    }
+    if (not IsSuccessfulResponse(downloader)) {
+        *err_msg = JSONError(document_stream_parser.getResponsePrefix());
+        if (err_msg->empty())
+            *err_msg = document_stream_parser.getResponsePrefix();
+        return false;
+    }
+
+    return true;
+}
+
+
 } // namespace Solr
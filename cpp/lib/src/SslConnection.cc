@@ -40,7 +40,7 @@ std::list<SslConnection::ContextInfo> SslConnection::context_infos_;
 
 
 SslConnection::SslConnection(const int fd, const Method method, const ClientServerMode client_server_mode,
-                             const ThreadingSupportMode threading_support_mode)
+                             const ThreadingSupportMode threading_support_mode, const HandshakeMode handshake_mode)
         : threading_support_mode_(threading_support_mode), ssl_connection_(nullptr), last_ret_val_(0)
 {
     std::unique_ptr<std::lock_guard<std::mutex>> mutex_locker;
@@ -56,6 +56,12 @@ SslConnection::SslConnection(const int fd, const Method method, const ClientServ
     if (unlikely(not ::SSL_set_fd(ssl_connection_, fd)))
         throw std::runtime_error("in SslConnection::SslConnection: ::SSL_set_fd() failed!");
 
+    if (handshake_mode == NONBLOCKING_HANDSHAKE) {
+        // On non-blocking sockets callers have to retry writes and may have appended more data to their buffers by then:
+        ::SSL_set_mode(ssl_connection_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        return;
+    }
+
     const unsigned NO_OF_TRIES(10);
     for (unsigned try_no(0); try_no < NO_OF_TRIES; ++try_no) {
         const int ret_val(::SSL_connect(ssl_connection_));
@@ -106,6 +112,20 @@ ssize_t SslConnection::write(const void * const data, size_t data_size) {
 }
 
 
+int SslConnection::handshake() {
+    std::unique_ptr<std::lock_guard<std::mutex>> mutex_locker;
+    if (threading_support_mode_ == SUPPORT_MULTITHREADING)
+        mutex_locker.reset(new std::lock_guard<std::mutex>(SslConnection::mutex_));
+
+    last_ret_val_ = ::SSL_connect(ssl_connection_);
+    if (last_ret_val_ == 1)
+        return 1;
+
+    const int error_code(::SSL_get_error(ssl_connection_, last_ret_val_));
+    return (error_code == SSL_ERROR_WANT_READ or error_code == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+}
+
+
 int SslConnection::getLastErrorCode() const {
     std::unique_ptr<std::lock_guard<std::mutex>> mutex_locker;
     if (threading_support_mode_ == SUPPORT_MULTITHREADING)
@@ -1,4 +1,9 @@
 #include "Stemmer.h"
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -32,3 +37,105 @@ const Stemmer *Stemmer::StemmerFactory(const std::string &language_name_or_code)
 
     return new_stemmer;
 }
+
+
+constexpr size_t CachingStemmer::DEFAULT_MAX_CACHE_SIZE;
+
+
+namespace {
+
+
+std::atomic<uint64_t> next_caching_stemmer_id(0);
+
+
+// A libstemmer instance and the LRU cache of one thread for one CachingStemmer.
+class PerThreadStemmer {
+    sb_stemmer *stemmer_;
+    const size_t max_cache_size_;
+    std::list<std::pair<std::string, std::string>> words_and_stems_; // Most recently used first.
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> words_to_list_entries_map_;
+public:
+    PerThreadStemmer(const std::string &language_name_or_code, const size_t max_cache_size);
+    ~PerThreadStemmer() { ::sb_stemmer_delete(stemmer_); }
+
+    const std::string &stem(const std::string &word);
+};
+
+
+PerThreadStemmer::PerThreadStemmer(const std::string &language_name_or_code, const size_t max_cache_size)
+    : stemmer_(::sb_stemmer_new(language_name_or_code.c_str(), "UTF_8")), max_cache_size_(max_cache_size)
+{
+    if (stemmer_ == nullptr)
+        throw std::runtime_error("in PerThreadStemmer::PerThreadStemmer: unsuported language or language code \""
+                                 + language_name_or_code + "\"!");
+}
+
+
+const std::string &PerThreadStemmer::stem(const std::string &word) {
+    const auto word_and_list_entry(words_to_list_entries_map_.find(word));
+    if (word_and_list_entry != words_to_list_entries_map_.end()) {
+        words_and_stems_.splice(words_and_stems_.begin(), words_and_stems_, word_and_list_entry->second);
+        return word_and_list_entry->second->second;
+    }
+
+    if (words_to_list_entries_map_.size() >= max_cache_size_) {
+        words_to_list_entries_map_.erase(words_and_stems_.back().first);
+        words_and_stems_.pop_back();
+    }
+
+    const std::string stem(reinterpret_cast<const char *>(
+        ::sb_stemmer_stem(stemmer_, reinterpret_cast<const sb_symbol *>(word.c_str()), word.size())));
+    words_and_stems_.emplace_front(word, stem);
+    words_to_list_entries_map_.emplace(word, words_and_stems_.begin());
+
+    return words_and_stems_.front().second;
+}
+
+
+} // unnamed namespace
+
+
+CachingStemmer::CachingStemmer(const std::string &language_name_or_code, const size_t max_cache_size)
+    : language_name_or_code_(language_name_or_code), max_cache_size_(std::max<size_t>(max_cache_size, 1)),
+      id_(next_caching_stemmer_id++)
+{
+    // Fail early rather than in the first call to stem():
+    sb_stemmer * const stemmer(::sb_stemmer_new(language_name_or_code.c_str(), "UTF_8"));
+    if (stemmer == nullptr)
+        throw std::runtime_error("in CachingStemmer::CachingStemmer: unsuported language or language code \""
+                                 + language_name_or_code + "\"!");
+    ::sb_stemmer_delete(stemmer);
+}
+
+
+std::string CachingStemmer::stem(const std::string &word) const {
+    // The IDs are never reused, so the state of destroyed CachingStemmers will never be picked up by new ones:
+    thread_local std::unordered_map<uint64_t, std::unique_ptr<PerThreadStemmer>> ids_to_per_thread_stemmers_map;
+
+    auto id_and_per_thread_stemmer(ids_to_per_thread_stemmers_map.find(id_));
+    if (id_and_per_thread_stemmer == ids_to_per_thread_stemmers_map.end())
+        id_and_per_thread_stemmer = ids_to_per_thread_stemmers_map.emplace(
+            id_, std::unique_ptr<PerThreadStemmer>(new PerThreadStemmer(language_name_or_code_, max_cache_size_))).first;
+
+    return id_and_per_thread_stemmer->second->stem(word);
+}
+
+
+const CachingStemmer *CachingStemmer::CachingStemmerFactory(const std::string &language_name_or_code) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, const CachingStemmer *> code_to_stemmer_map;
+
+    std::lock_guard<std::mutex> mutex_locker(mutex);
+    const auto code_and_stemmer_iter(code_to_stemmer_map.find(language_name_or_code));
+    if (code_and_stemmer_iter != code_to_stemmer_map.end())
+        return code_and_stemmer_iter->second;
+
+    CachingStemmer *new_stemmer(nullptr);
+    try {
+        new_stemmer = new CachingStemmer(language_name_or_code);
+    } catch (const std::exception &x) {
+    }
+    code_to_stemmer_map[language_name_or_code] = new_stemmer;
+
+    return new_stemmer;
+}
@@ -23,6 +23,7 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "StringDataSource.h"
+#include <algorithm>
 #include <stdexcept>
 #include <cstdio>
 #include "Compiler.h"
@@ -52,6 +53,25 @@ void StringDataSource::putback(const char ch) {
 }
 
 
+size_t StringDataSource::appendUntil(std::string * const s, const char terminator) {
+    size_t appended_count(0);
+    if (pushed_back_) {
+        if (pushed_back_char_ == terminator)
+            return 0;
+        *s += pushed_back_char_;
+        pushed_back_ = false;
+        ++appended_count;
+    }
+
+    const auto terminator_pos(std::find(ch_, s_.cend(), terminator));
+    s->append(ch_, terminator_pos);
+    appended_count += terminator_pos - ch_;
+    ch_ = terminator_pos;
+
+    return appended_count;
+}
+
+
 int StringDataSource::peek() {
     if (unlikely(pushed_back_))
         return pushed_back_char_;
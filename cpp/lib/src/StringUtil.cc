@@ -40,6 +40,8 @@
 #include <cstdio>
 #include <alloca.h>
 #include <iomanip>
+#include <limits>
+#include <locale.h>
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #include <stdarg.h>
@@ -376,6 +378,48 @@ std::string Trim(const std::string &s, const std::string &trim_set) {
 }
 
 
+StringView TrimView(const StringView &s, const std::string &trim_set) {
+    const char *start(s.begin()), *end(s.end());
+    while (start != end and trim_set.find(*start) != std::string::npos)
+        ++start;
+    while (end != start and trim_set.find(*(end - 1)) != std::string::npos)
+        --end;
+    return StringView(start, end - start);
+}
+
+
+Splitter::Splitter(const StringView &source, const StringView &delimiters, const bool suppress_empty_fields)
+    : next_(source.empty() ? nullptr : source.begin()), end_(source.end()), delimiters_(delimiters.data(), delimiters.size()),
+      suppress_empty_fields_(suppress_empty_fields)
+{
+    if (unlikely(delimiters_.empty()))
+        throw std::runtime_error("in StringUtil::Splitter::Splitter: no delimiters!");
+}
+
+
+bool Splitter::next(StringView * const field) {
+    while (next_ != nullptr) {
+        const char *delimiter;
+        if (delimiters_.size() == 1) {
+            delimiter = reinterpret_cast<const char *>(std::memchr(next_, delimiters_[0], end_ - next_));
+            if (delimiter == nullptr)
+                delimiter = end_;
+        } else {
+            delimiter = next_;
+            while (delimiter != end_ and delimiters_.find(*delimiter) == std::string::npos)
+                ++delimiter;
+        }
+
+        *field = StringView(next_, delimiter - next_);
+        next_ = (delimiter == end_ or delimiter + 1 == end_) ? nullptr : delimiter + 1;
+        if (not field->empty() or not suppress_empty_fields_)
+            return true;
+    }
+
+    return false;
+}
+
+
 std::string ToString(const double n, const unsigned precision) {
     std::stringstream stream;
     if (precision > 1) // Only show decimal point if we have more than one digit of precision:
@@ -489,279 +533,273 @@ std::string FromHexString(const std::string &hex_string) {
 }
 
 
-// ToNumber -- convert a string into a number.
-//
-bool ToNumber(const std::string &s, int * const n, const unsigned base) {
-    if (unlikely(s.empty()))
+namespace {
+
+
+// Parses an integer like strtoull(3) in the "C" locale does, i.e. we allow leading whitespace, an optional sign and, for
+// bases 0 and 16, a "0x" or "0X" prefix.  Unlike strtoull(3) we neither need a terminating NUL nor touch errno and we
+// require all of "s" to be consumed.  "magnitude" receives the absolute value of the parsed number.
+bool ParseInteger(const StringView &s, unsigned base, const bool allow_minus_sign, unsigned long long * const magnitude,
+                  bool * const is_negative)
+{
+    if (unlikely(base == 1 or base > 36))
         return false;
 
-    char *end_ptr;
-    errno = 0;
-    const long l = std::strtol(s.c_str(), &end_ptr, base);
-    *n = l;
+    const char *cp(s.begin());
+    const char * const end(s.end());
+    while (cp != end and (*cp == ' ' or (*cp >= '\t' and *cp <= '\r')))
+        ++cp;
+
+    *is_negative = false;
+    if (cp != end and (*cp == '+' or *cp == '-')) {
+        *is_negative = *cp == '-';
+        if (*is_negative and not allow_minus_sign)
+            return false;
+        ++cp;
+    }
+
+    if ((base == 0 or base == 16) and end - cp >= 3 and cp[0] == '0' and (cp[1] == 'x' or cp[1] == 'X')
+        and std::isxdigit(static_cast<unsigned char>(cp[2])))
+    {
+        cp += 2;
+        base = 16;
+    } else if (base == 0)
+        base = (cp != end and *cp == '0') ? 8 : 10;
 
-    return (l <= INT_MAX and l >= INT_MIN) and (*end_ptr == '\0') and (errno == 0);
+    if (unlikely(cp == end))
+        return false;
+
+    unsigned long long value(0);
+    if (base == 10) { // The common case.
+        for (/* Intentionally empty! */; cp != end; ++cp) {
+            const unsigned digit(static_cast<unsigned char>(*cp) - '0');
+            if (unlikely(digit > 9))
+                return false;
+            if (unlikely(__builtin_mul_overflow(value, 10ull, &value) or __builtin_add_overflow(value, digit, &value)))
+                return false;
+        }
+    } else {
+        for (/* Intentionally empty! */; cp != end; ++cp) {
+            unsigned digit;
+            if (*cp >= '0' and *cp <= '9')
+                digit = *cp - '0';
+            else if (*cp >= 'a' and *cp <= 'z')
+                digit = *cp - 'a' + 10;
+            else if (*cp >= 'A' and *cp <= 'Z')
+                digit = *cp - 'A' + 10;
+            else
+                return false;
+            if (unlikely(digit >= base))
+                return false;
+            if (unlikely(__builtin_mul_overflow(value, static_cast<unsigned long long>(base), &value)
+                         or __builtin_add_overflow(value, digit, &value)))
+                return false;
+        }
+    }
+
+    *magnitude = value;
+    return true;
 }
 
 
-// ToNumber -- convert a string into a number.
-//
-bool ToNumber(const std::string &s, long * const n, const unsigned base) {
-    if (unlikely(s.empty()))
+template<typename UnsignedType> bool ParseUnsigned(const StringView &s, UnsignedType * const n, const unsigned base) {
+    unsigned long long magnitude;
+    bool is_negative;
+    if (not ParseInteger(s, base, /* allow_minus_sign = */false, &magnitude, &is_negative)
+        or magnitude > std::numeric_limits<UnsignedType>::max())
         return false;
 
-    char *end_ptr;
-    errno = 0;
-    *n = std::strtol(s.c_str(), &end_ptr, base);
+    *n = static_cast<UnsignedType>(magnitude);
+    return true;
+}
+
 
-    return (*end_ptr == '\0') and (errno == 0);
+template<typename SignedType> bool ParseSigned(const StringView &s, SignedType * const n, const unsigned base) {
+    unsigned long long magnitude;
+    bool is_negative;
+    if (not ParseInteger(s, base, /* allow_minus_sign = */true, &magnitude, &is_negative))
+        return false;
+
+    const unsigned long long max_magnitude(static_cast<unsigned long long>(std::numeric_limits<SignedType>::max())
+                                           + (is_negative ? 1u : 0u));
+    if (magnitude > max_magnitude)
+        return false;
+
+    *n = is_negative ? static_cast<SignedType>(-static_cast<SignedType>(magnitude - 1) - 1) : static_cast<SignedType>(magnitude);
+    return true;
 }
 
 
-// ToNumber -- convert a string into an unsigned number.
-//
-bool ToNumber(const std::string &s, unsigned * const n, const unsigned base) {
+// We always parse floating point numbers in the "C" locale so that e.g. a German LC_NUMERIC does not break "1.5".
+locale_t GetCLocale() {
+    static const locale_t c_locale(::newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0)));
+    if (unlikely(c_locale == static_cast<locale_t>(0)))
+        throw std::runtime_error("in StringUtil::GetCLocale: newlocale(3) failed!");
+    return c_locale;
+}
+
+
+template<typename FloatType> bool ParseFloatingPoint(const StringView &s, FloatType * const n,
+                                                     FloatType (*strtox_l)(const char *, char **, locale_t))
+{
     if (unlikely(s.empty()))
         return false;
 
+    // strtod_l(3) and friends need a NUL-terminated string.
+    char short_buffer[64];
+    std::string long_buffer;
+    const char *cstring;
+    if (s.size() < sizeof(short_buffer)) {
+        std::memcpy(short_buffer, s.data(), s.size());
+        short_buffer[s.size()] = '\0';
+        cstring = short_buffer;
+    } else {
+        long_buffer.assign(s.data(), s.size());
+        cstring = long_buffer.c_str();
+    }
+
     char *end_ptr;
     errno = 0;
-    *n = std::strtoul(s.c_str(), &end_ptr, base);
+    *n = strtox_l(cstring, &end_ptr, GetCLocale());
 
-    return (*end_ptr == '\0') and (errno == 0);
+    return end_ptr == cstring + s.size() and errno == 0;
 }
 
 
-// ToNumber -- convert a string into a number.
-//
-long ToNumber(const std::string &s, const unsigned base) {
+} // unnamed namespace
+
+
+bool ToNumber(const StringView &s, int * const n, const unsigned base) {
+    return ParseSigned(s, n, base);
+}
+
+
+bool ToNumber(const StringView &s, long * const n, const unsigned base) {
+    return ParseSigned(s, n, base);
+}
+
+
+bool ToNumber(const StringView &s, unsigned * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
+}
+
+
+long ToNumber(const StringView &s, const unsigned base) {
     long n;
     if (unlikely(not ToNumber(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToNumber: can't convert \"" + s + "\" to a long!");
+        throw std::runtime_error("in StringUtil::ToNumber: can't convert \"" + s.toString() + "\" to a long!");
 
     return n;
 }
 
 
-unsigned short ToUnsignedShort(const std::string &s, const unsigned base) {
+unsigned short ToUnsignedShort(const StringView &s, const unsigned base) {
     unsigned short n;
     if (unlikely(not ToUnsignedShort(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToUnsignedShort: can't convert \"" + s + "\" to an unsigned!");
+        throw std::runtime_error("in StringUtil::ToUnsignedShort: can't convert \"" + s.toString() + "\" to an unsigned!");
 
     return n;
 }
 
 
-// ToUnsignedShort -- convert a string to an unsigned number.
-//
-bool ToUnsignedShort(const std::string &s, unsigned short * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end() or *ch == '-'))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    const unsigned long ul = std::strtoul(s.c_str(), &end_ptr, base);
-    *n = static_cast<unsigned>(ul);
-
-    return (*end_ptr == '\0') and (errno == 0) and (ul <= USHRT_MAX);
+bool ToUnsignedShort(const StringView &s, unsigned short * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
 }
 
 
-unsigned ToUnsigned(const std::string &s, const unsigned base) {
+unsigned ToUnsigned(const StringView &s, const unsigned base) {
     unsigned n;
     if (unlikely(not ToUnsigned(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToUnsigned: can't convert \"" + s + "\" to an unsigned!");
+        throw std::runtime_error("in StringUtil::ToUnsigned: can't convert \"" + s.toString() + "\" to an unsigned!");
 
     return n;
 }
 
 
-// ToUnsigned -- convert a string to an unsigned number.
-//
-bool ToUnsigned(const std::string &s, unsigned * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end() or *ch == '-'))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    const unsigned long ul = std::strtoul(s.c_str(), &end_ptr, base);
-    *n = static_cast<unsigned>(ul);
-
-    return (*end_ptr == '\0') and (errno == 0) and (ul <= UINT_MAX);
+bool ToUnsigned(const StringView &s, unsigned * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
 }
 
 
-// ToUnsignedLong -- convert a string to an unsigned long number.
-//
-unsigned long ToUnsignedLong(const std::string &s, const unsigned base) {
+unsigned long ToUnsignedLong(const StringView &s, const unsigned base) {
     unsigned long n;
     if (unlikely(not ToUnsignedLong(s,  &n, base)))
-        throw std::runtime_error("in StringUtil::ToUnsignedLong: can't convert " + s);
+        throw std::runtime_error("in StringUtil::ToUnsignedLong: can't convert " + s.toString());
 
     return n;
 }
 
 
-// ToUnsignedLong -- convert a string to an unsigned long number.
-//
-bool ToUnsignedLong(const std::string &s, unsigned long * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end() or *ch == '-'))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    *n = std::strtoul(s.c_str(), &end_ptr, base);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToUnsignedLong(const StringView &s, unsigned long * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
 }
 
 
-// ToUnsignedLongLong -- convert a string to an unsigned long long number.
-//
-unsigned long long ToUnsignedLongLong(const std::string &s, const unsigned base) {
+unsigned long long ToUnsignedLongLong(const StringView &s, const unsigned base) {
     unsigned long long n;
     if (unlikely(not ToUnsignedLongLong(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToUnsignedLongLong: can't convert " + s);
+        throw std::runtime_error("in StringUtil::ToUnsignedLongLong: can't convert " + s.toString());
 
     return n;
 }
 
 
-// ToUnsignedLongLong -- convert a string to an unsigned long long number.
-//
-bool ToUnsignedLongLong(const std::string &s, unsigned long long * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end() or *ch == '-'))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    *n = std::strtoull(s.c_str(), &end_ptr, base);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToUnsignedLongLong(const StringView &s, unsigned long long * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
 }
 
 
-// ToUInt64T -- convert a string to a uint64_t number
-//
-bool ToUInt64T(const std::string &s, uint64_t * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end() or *ch == '-'))
-        return false;
-
-    char *end_ptr;
-    unsigned long long temp;
-    errno = 0;
-    temp = std::strtoull(s.c_str(), &end_ptr, base);
-
-    // Make sure the number fits in a uint64_t:
-    if (temp > UINT64_MAX)
-        return false;
-    else
-        *n = static_cast<uint64_t>(temp);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToUInt64T(const StringView &s, uint64_t * const n, const unsigned base) {
+    return ParseUnsigned(s, n, base);
 }
 
 
-uint64_t ToUInt64T(const std::string &s, const unsigned base) {
+uint64_t ToUInt64T(const StringView &s, const unsigned base) {
     uint64_t n;
     if (unlikely(not ToUInt64T(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToUInt64T: can't convert \"" + s + "\"!");
+        throw std::runtime_error("in StringUtil::ToUInt64T: can't convert \"" + s.toString() + "\"!");
 
     return n;
 }
 
 
-// ToInt64T -- convert a string to an int64_t number
-//
-bool ToInt64T(const std::string &s, int64_t * const n, const unsigned base) {
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end() and isspace(*ch))
-        ++ch;
-    if (unlikely(ch == s.end()))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    const long long temp(std::strtoll(s.c_str(), &end_ptr, base));
-
-    // Make sure the number fits in a int64_t:
-    if (temp > INT64_MAX)
-        return false;
-    *n = static_cast<int64_t>(temp);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToInt64T(const StringView &s, int64_t * const n, const unsigned base) {
+    return ParseSigned(s, n, base);
 }
 
 
-int64_t ToInt64T(const std::string &s, const unsigned base) {
+int64_t ToInt64T(const StringView &s, const unsigned base) {
     int64_t n;
     if (unlikely(not ToInt64T(s, &n, base)))
-        throw std::runtime_error("in StringUtil::ToInt64T: can't convert " + s);
+        throw std::runtime_error("in StringUtil::ToInt64T: can't convert " + s.toString());
 
     return n;
 }
 
 
-// ToDouble -- convert a string to a double-precision number.
-//
-bool ToDouble(const std::string &s, double * const n) {
-    if (unlikely(s.empty()))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    *n = std::strtod(s.c_str(), &end_ptr);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToDouble(const StringView &s, double * const n) {
+    return ParseFloatingPoint(s, n, ::strtod_l);
 }
 
 
-// ToDouble -- convert a string to a double-precision number.
-//
-double ToDouble(const std::string &s) {
+double ToDouble(const StringView &s) {
     double n;
     if (unlikely(not ToDouble(s, &n)))
-        throw std::runtime_error("in StringUtil::ToDouble: can't convert \"" + s + "\"!");
+        throw std::runtime_error("in StringUtil::ToDouble: can't convert \"" + s.toString() + "\"!");
 
     return n;
 }
 
 
-// ToFloat -- convert a string to a float-precision number.
-//
-bool ToFloat(const std::string &s, float * const n) {
-    if (unlikely(s.empty()))
-        return false;
-
-    char *end_ptr;
-    errno = 0;
-    *n = std::strtof(s.c_str(), &end_ptr);
-
-    return (*end_ptr == '\0') and (errno == 0);
+bool ToFloat(const StringView &s, float * const n) {
+    return ParseFloatingPoint(s, n, ::strtof_l);
 }
 
 
-// ToFloat -- convert a string to a float-precision number.
-//
-float ToFloat(const std::string &s) {
+float ToFloat(const StringView &s) {
     float n;
     if (unlikely(not ToFloat(s, &n)))
-        throw std::runtime_error("in StringUtil::ToFloat: can't convert \"" + s + "\"!");
+        throw std::runtime_error("in StringUtil::ToFloat: can't convert \"" + s.toString() + "\"!");
 
     return n;
 }
@@ -1999,6 +2037,122 @@ uint32_t Adler32(const char * const s, const size_t s_length) {
 }
 
 
+namespace {
+
+
+constexpr uint64_t XXH64_PRIME1(11400714785074694791ull);
+constexpr uint64_t XXH64_PRIME2(14029467366897019727ull);
+constexpr uint64_t XXH64_PRIME3(1609587929392839161ull);
+constexpr uint64_t XXH64_PRIME4(9650029242287828579ull);
+constexpr uint64_t XXH64_PRIME5(2870177450012600261ull);
+
+
+inline uint64_t RotateLeft64(const uint64_t x, const unsigned r) { return (x << r) | (x >> (64 - r)); }
+
+
+inline uint64_t Read64(const char * const p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof value);
+    return value; // xxHash is defined in terms of little-endian reads, which is what we have on x86.
+}
+
+
+inline uint32_t Read32(const char * const p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof value);
+    return value;
+}
+
+
+inline uint64_t XXH64Round(uint64_t accumulator, const uint64_t input) {
+    accumulator += input * XXH64_PRIME2;
+    accumulator = RotateLeft64(accumulator, 31);
+    return accumulator * XXH64_PRIME1;
+}
+
+
+inline uint64_t XXH64MergeRound(uint64_t accumulator, const uint64_t value) {
+    accumulator ^= XXH64Round(0, value);
+    return accumulator * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+
+} // unnamed namespace
+
+
+XXHash64::XXHash64(const uint64_t seed): seed_(seed), buffer_size_(0), total_length_(0) {
+    accumulators_[0] = seed + XXH64_PRIME1 + XXH64_PRIME2;
+    accumulators_[1] = seed + XXH64_PRIME2;
+    accumulators_[2] = seed;
+    accumulators_[3] = seed - XXH64_PRIME1;
+}
+
+
+void XXHash64::update(const char *data, size_t length) {
+    total_length_ += length;
+
+    if (buffer_size_ + length < sizeof buffer_) {
+        std::memcpy(buffer_ + buffer_size_, data, length);
+        buffer_size_ += length;
+        return;
+    }
+
+    if (buffer_size_ > 0) { // Complete the partial stripe first.
+        const size_t fill_size(sizeof(buffer_) - buffer_size_);
+        std::memcpy(buffer_ + buffer_size_, data, fill_size);
+        for (unsigned i(0); i < 4; ++i)
+            accumulators_[i] = XXH64Round(accumulators_[i], Read64(buffer_ + i * sizeof(uint64_t)));
+        data += fill_size, length -= fill_size;
+        buffer_size_ = 0;
+    }
+
+    for (/* Intentionally empty! */; length >= sizeof buffer_; data += sizeof buffer_, length -= sizeof buffer_) {
+        for (unsigned i(0); i < 4; ++i)
+            accumulators_[i] = XXH64Round(accumulators_[i], Read64(data + i * sizeof(uint64_t)));
+    }
+
+    std::memcpy(buffer_, data, length);
+    buffer_size_ = length;
+}
+
+
+uint64_t XXHash64::digest() const {
+    uint64_t hash;
+    if (total_length_ >= sizeof buffer_) {
+        hash = RotateLeft64(accumulators_[0], 1) + RotateLeft64(accumulators_[1], 7) + RotateLeft64(accumulators_[2], 12)
+               + RotateLeft64(accumulators_[3], 18);
+        for (unsigned i(0); i < 4; ++i)
+            hash = XXH64MergeRound(hash, accumulators_[i]);
+    } else
+        hash = seed_ + XXH64_PRIME5;
+    hash += total_length_;
+
+    const char *p(buffer_);
+    const char * const end(buffer_ + buffer_size_);
+    for (/* Intentionally empty! */; p + sizeof(uint64_t) <= end; p += sizeof(uint64_t)) {
+        hash ^= XXH64Round(0, Read64(p));
+        hash = RotateLeft64(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+    if (p + sizeof(uint32_t) <= end) {
+        hash ^= static_cast<uint64_t>(Read32(p)) * XXH64_PRIME1;
+        hash = RotateLeft64(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        p += sizeof(uint32_t);
+    }
+    for (/* Intentionally empty! */; p < end; ++p) {
+        hash ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * XXH64_PRIME5;
+        hash = RotateLeft64(hash, 11) * XXH64_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
 std::string &Escape(const char escape_char, const char * const chars_to_escape, std::string * const s) {
     if (unlikely(s->empty()))
         return *s;
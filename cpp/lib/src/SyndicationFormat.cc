@@ -20,15 +20,129 @@
 #include "SyndicationFormat.h"
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <unordered_set>
+#include <cstring>
 #include "Compiler.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
+#include "ThreadUtil.h"
 #include "TimeUtil.h"
 #include "util.h"
 
 
+// Downloads a feed in a background thread and hands out its body piecemeal as it arrives.
+class SyndicationFormat::FeedStream {
+    ThreadUtil::BoundedQueue<std::string> chunks_;
+    std::string buffer_; // The received data that has not been read yet starts at "buffer_offset_".
+    size_t buffer_offset_;
+    std::string error_message_; // Only valid after we've seen the end of the stream.
+    std::thread download_thread_;
+public:
+    static const size_t MAX_QUEUED_CHUNKS = 64;
+public:
+    FeedStream(const std::string &feed_url, const Downloader::Params &downloader_params, const TimeLimit &time_limit)
+        : chunks_(MAX_QUEUED_CHUNKS), buffer_offset_(0),
+          download_thread_(&FeedStream::download, this, feed_url, downloader_params, time_limit) { }
+
+    /** \brief Aborts the download if it is still in progress. */
+    ~FeedStream() { chunks_.close(); download_thread_.join(); }
+
+    /** \return The number of bytes copied to "buffer" or zero at the end of the stream. */
+    size_t read(char * const buffer, const size_t buffer_size);
+
+    /** \brief Waits until at least "min_size" unread bytes have been received or the stream has ended.
+     *  \return All received but unread bytes, which will still be returned by subsequent calls to read().
+     */
+    const std::string &peek(const size_t min_size);
+
+    /** \return An empty string if the download succeeded as far as we have read the stream. */
+    const std::string &getErrorMessage() const { return error_message_; }
+private:
+    void download(const std::string &feed_url, Downloader::Params downloader_params, const TimeLimit &time_limit);
+};
+
+
+size_t SyndicationFormat::FeedStream::read(char * const buffer, const size_t buffer_size) {
+    if (buffer_offset_ == buffer_.size()) {
+        buffer_offset_ = 0;
+        if (not chunks_.pop(&buffer_)) {
+            buffer_.clear();
+            return 0;
+        }
+    }
+
+    const size_t byte_count(std::min(buffer_size, buffer_.size() - buffer_offset_));
+    std::memcpy(buffer, buffer_.data() + buffer_offset_, byte_count);
+    buffer_offset_ += byte_count;
+
+    return byte_count;
+}
+
+
+const std::string &SyndicationFormat::FeedStream::peek(const size_t min_size) {
+    buffer_.erase(0, buffer_offset_);
+    buffer_offset_ = 0;
+
+    std::string chunk;
+    while (buffer_.size() < min_size and chunks_.pop(&chunk))
+        buffer_ += chunk;
+
+    return buffer_;
+}
+
+
+void SyndicationFormat::FeedStream::download(const std::string &feed_url, Downloader::Params downloader_params,
+                                             const TimeLimit &time_limit)
+{
+    Downloader *downloader(nullptr);
+    bool response_code_checked(false);
+    const auto check_response_code([&downloader, &response_code_checked, this]() {
+        response_code_checked = true;
+        const unsigned response_code(downloader->getResponseCode());
+        if (response_code < 200 or response_code > 299)
+            error_message_ = "the server returned a status code of " + std::to_string(response_code) + "!";
+        return error_message_.empty();
+    });
+
+    // We want to find out about error responses before we hand their bodies to the XML parser:
+    downloader_params.body_chunk_callback_ = [&response_code_checked, &check_response_code, this]
+                                             (const char * const data, const size_t size)
+    {
+        if (not response_code_checked and not check_response_code())
+            return false;
+        return chunks_.push(std::string(data, size));
+    };
+
+    try {
+        Downloader actual_downloader(downloader_params);
+        downloader = &actual_downloader;
+        if (not actual_downloader.newUrl(feed_url, time_limit)) {
+            if (error_message_.empty())
+                error_message_ = actual_downloader.getLastErrorMessage();
+        } else if (not response_code_checked)
+            check_response_code();
+    } catch (const std::exception &x) {
+        error_message_ = x.what();
+    }
+
+    chunks_.close();
+}
+
+
+SyndicationFormat::SyndicationFormat(std::unique_ptr<FeedStream> &&feed_stream, const AugmentParams &augment_params)
+    : feed_stream_(std::move(feed_stream)),
+      xml_parser_([this](char * const buffer, const size_t buffer_size) { return feed_stream_->read(buffer, buffer_size); }),
+      last_build_date_(TimeUtil::BAD_TIME_T), augment_params_(augment_params)
+{
+}
+
+
+SyndicationFormat::~SyndicationFormat() {
+}
+
+
 void SyndicationFormat::const_iterator::operator++() {
     item_ = syndication_format_->getNextItem();
 }
@@ -154,7 +268,45 @@ std::unique_ptr<SyndicationFormat> SyndicationFormat::Factory(const std::string
 }
 
 
-RSS20::RSS20(const std::string &xml_document, const AugmentParams &augment_params): SyndicationFormat(xml_document, augment_params) {
+std::unique_ptr<SyndicationFormat> SyndicationFormat::StreamingFactory(const std::string &feed_url,
+                                                                       const Downloader::Params &downloader_params,
+                                                                       const TimeLimit &time_limit,
+                                                                       const AugmentParams &augment_params, std::string * const err_msg)
+{
+    std::unique_ptr<FeedStream> feed_stream(new FeedStream(feed_url, downloader_params, time_limit));
+
+    // The root element, which tells us the format, should be near the start of the document:
+    const size_t FORMAT_DETECTION_PREFIX_SIZE(16384);
+    const std::string &document_start(feed_stream->peek(FORMAT_DETECTION_PREFIX_SIZE));
+    if (document_start.empty()) {
+        *err_msg = feed_stream->getErrorMessage().empty() ? "empty feed!" : feed_stream->getErrorMessage();
+        return nullptr;
+    }
+
+    try {
+        switch (GetFormatType(document_start)) {
+        case TYPE_UNKNOWN:
+            *err_msg = "can't determine syndication format!";
+            return nullptr;
+        case TYPE_RSS20:
+            return std::unique_ptr<SyndicationFormat>(new RSS20(std::move(feed_stream), augment_params));
+        case TYPE_RSS091:
+            return std::unique_ptr<SyndicationFormat>(new RSS091(std::move(feed_stream), augment_params));
+        case TYPE_ATOM:
+            return std::unique_ptr<SyndicationFormat>(new Atom(std::move(feed_stream), augment_params));
+        case TYPE_RDF:
+            return std::unique_ptr<SyndicationFormat>(new RDF(std::move(feed_stream), augment_params));
+        }
+    } catch (const std::runtime_error &x) {
+        *err_msg = "Error while parsing syndication format: " + std::string(x.what());
+        return nullptr;
+    }
+
+    __builtin_unreachable();
+}
+
+
+void RSS20::parseChannel() {
     XMLParser::XMLPart part;
     while (xml_parser_.getNext(&part)) {
         if (part.type_ == XMLParser::XMLPart::OPENING_TAG and part.data_ == "item")
@@ -218,7 +370,7 @@ std::unique_ptr<SyndicationFormat::Item> RSS20::getNextItem() {
 }
 
 
-RSS091::RSS091(const std::string &xml_document, const AugmentParams &augment_params): SyndicationFormat(xml_document, augment_params) {
+void RSS091::parseChannel() {
     XMLParser::XMLPart part;
     while (xml_parser_.getNext(&part)) {
         if (part.type_ == XMLParser::XMLPart::OPENING_TAG and part.data_ == "item")
@@ -266,7 +418,7 @@ std::unique_ptr<SyndicationFormat::Item> RSS091::getNextItem() {
 }
 
 
-Atom::Atom(const std::string &xml_document, const AugmentParams &augment_params): SyndicationFormat(xml_document, augment_params) {
+void Atom::parseChannel() {
     XMLParser::XMLPart part;
     while (xml_parser_.getNext(&part)) {
         if (part.type_ == XMLParser::XMLPart::OPENING_TAG and (part.data_ == "item" or part.data_ == "entry")) {
@@ -343,11 +495,8 @@ static void ExtractNamespaces(XMLParser &parser, std::string * const rss_namespa
                               std::string * const dc_namespace, std::string * const prism_namespace)
 {
     XMLParser::XMLPart part;
-    if (not parser.skipTo(XMLParser::XMLPart::OPENING_TAG, "rdf:RDF", &part)) {
-        parser.rewind();
-        if (not parser.skipTo(XMLParser::XMLPart::OPENING_TAG, "RDF", &part))
-            throw std::runtime_error("in ExtractRSSNamespace(SyndicationFormat.cc): missing rdf:RDF opening tag!");
-    }
+    if (not parser.skipTo(XMLParser::XMLPart::OPENING_TAG, std::set<std::string>{ "rdf:RDF", "RDF" }, &part))
+        throw std::runtime_error("in ExtractRSSNamespace(SyndicationFormat.cc): missing rdf:RDF opening tag!");
 
     for (const auto &key_and_value : part.attributes_) {
         if (key_and_value.second == "http://purl.org/rss/1.0/")
@@ -360,7 +509,7 @@ static void ExtractNamespaces(XMLParser &parser, std::string * const rss_namespa
 }
 
 
-RDF::RDF(const std::string &xml_document, const AugmentParams &augment_params): SyndicationFormat(xml_document, augment_params) {
+void RDF::parseChannel() {
     ExtractNamespaces(xml_parser_, &rss_namespace_, &dc_namespace_, &prism_namespace_);
 
     XMLParser::XMLPart part;
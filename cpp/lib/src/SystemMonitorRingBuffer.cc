@@ -0,0 +1,225 @@
+/** \brief Implementation of the SystemMonitorRingBuffer class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "SystemMonitorRingBuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "util.h"
+
+
+namespace {
+
+
+const char MAGIC[8] = { 'U', 'B', 'S', 'Y', 'S', 'M', 'O', 'N' };
+const uint32_t VERSION(1);
+
+
+size_t GetRecordSize(const SystemMonitorRingBuffer::RecordType record_type) {
+    return (record_type == SystemMonitorRingBuffer::RecordType::SAMPLES) ? sizeof(SystemMonitorRingBuffer::Sample)
+                                                                          : sizeof(SystemMonitorRingBuffer::Summary);
+}
+
+
+} // unnamed namespace
+
+
+SystemMonitorRingBuffer::SystemMonitorRingBuffer(const std::string &path, const uint64_t capacity, const RecordType record_type)
+    : path_(path), record_size_(GetRecordSize(record_type)), mapped_header_(nullptr), mapped_records_(nullptr), mapping_size_(0)
+{
+    if (unlikely(capacity == 0))
+        LOG_ERROR("the capacity of \"" + path + "\" must be positive!");
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (unlikely(fd_ == -1))
+        LOG_ERROR("failed to open \"" + path + "\" for reading and writing!");
+
+    const ssize_t header_size(::pread(fd_, &header_, sizeof header_, 0));
+    if (header_size == sizeof(header_) and std::memcmp(header_.magic_, MAGIC, sizeof MAGIC) == 0) {
+        if (unlikely(header_.version_ != VERSION or header_.sample_size_ != record_size_))
+            LOG_ERROR("\"" + path + "\" has an unsupported version or record type!");
+        if (header_.capacity_ != capacity)
+            LOG_WARNING("keeping the existing capacity of " + std::to_string(header_.capacity_) + " records for \"" + path
+                        + "\"!");
+        return;
+    }
+    if (unlikely(header_size != 0))
+        LOG_ERROR("\"" + path + "\" exists but is not a ring buffer!");
+
+    std::memset(&header_, 0, sizeof header_);
+    std::memcpy(header_.magic_, MAGIC, sizeof MAGIC);
+    header_.version_     = VERSION;
+    header_.sample_size_ = record_size_;
+    header_.capacity_    = capacity;
+    if (unlikely(::ftruncate(fd_, sizeof(Header) + capacity * record_size_) != 0))
+        LOG_ERROR("failed to allocate the records of \"" + path + "\"!");
+    writeOrDie(&header_, sizeof header_, 0);
+}
+
+
+SystemMonitorRingBuffer::SystemMonitorRingBuffer(const std::string &path, const RecordType record_type)
+    : path_(path), record_size_(GetRecordSize(record_type))
+{
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (unlikely(fd_ == -1))
+        LOG_ERROR("failed to open \"" + path + "\" for reading!");
+
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd_, &stat_buf) != 0))
+        LOG_ERROR("failed to fstat(2) \"" + path + "\"!");
+    mapping_size_ = stat_buf.st_size;
+    if (unlikely(mapping_size_ < sizeof(Header)))
+        LOG_ERROR("\"" + path + "\" is too small to be a ring buffer!");
+
+    void * const mapping(::mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd_, 0));
+    if (unlikely(mapping == MAP_FAILED))
+        LOG_ERROR("failed to mmap(2) \"" + path + "\"!");
+    mapped_header_ = reinterpret_cast<const Header *>(mapping);
+    mapped_records_ = reinterpret_cast<const char *>(mapping) + sizeof(Header);
+
+    if (unlikely(std::memcmp(mapped_header_->magic_, MAGIC, sizeof MAGIC) != 0 or mapped_header_->version_ != VERSION
+                 or mapped_header_->sample_size_ != record_size_
+                 or sizeof(Header) + mapped_header_->capacity_ * record_size_ > mapping_size_))
+        LOG_ERROR("\"" + path + "\" is not a ring buffer or has an unsupported version or record type!");
+
+    // The viewer looks at time windows, which may be anywhere in the file:
+    ::madvise(mapping, mapping_size_, MADV_RANDOM);
+}
+
+
+SystemMonitorRingBuffer::~SystemMonitorRingBuffer() {
+    if (mapped_header_ != nullptr)
+        ::munmap(const_cast<Header *>(mapped_header_), mapping_size_);
+    ::close(fd_);
+}
+
+
+void SystemMonitorRingBuffer::append(const std::vector<Sample> &samples) {
+    appendRecords(samples.data(), samples.size(), sizeof(Sample));
+}
+
+
+void SystemMonitorRingBuffer::append(const std::vector<Summary> &summaries) {
+    appendRecords(summaries.data(), summaries.size(), sizeof(Summary));
+}
+
+
+uint64_t SystemMonitorRingBuffer::getCapacity() const {
+    return (mapped_header_ == nullptr) ? header_.capacity_ : mapped_header_->capacity_;
+}
+
+
+uint64_t SystemMonitorRingBuffer::size() const {
+    return std::min(getWriteCount(), getCapacity());
+}
+
+
+const SystemMonitorRingBuffer::Sample &SystemMonitorRingBuffer::operator[](const uint64_t index) const {
+    return *reinterpret_cast<const Sample *>(getRecord(index, sizeof(Sample)));
+}
+
+
+const SystemMonitorRingBuffer::Summary &SystemMonitorRingBuffer::getSummary(const uint64_t index) const {
+    return *reinterpret_cast<const Summary *>(getRecord(index, sizeof(Summary)));
+}
+
+
+uint64_t SystemMonitorRingBuffer::lowerBound(const uint32_t timestamp) const {
+    uint64_t low(0), high(size());
+    while (low < high) {
+        const uint64_t middle(low + (high - low) / 2);
+        // Both record types start w/ the timestamp:
+        if (*reinterpret_cast<const uint32_t *>(getRecord(middle, record_size_)) < timestamp)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+
+bool SystemMonitorRingBuffer::IsRingBuffer(const std::string &path) {
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1)
+        return false;
+    char magic[sizeof MAGIC];
+    const bool is_ring_buffer(::pread(fd, magic, sizeof magic, 0) == sizeof(magic) and std::memcmp(magic, MAGIC, sizeof MAGIC) == 0);
+    ::close(fd);
+
+    return is_ring_buffer;
+}
+
+
+void SystemMonitorRingBuffer::appendRecords(const void * const records, const uint64_t record_count, const size_t record_size) {
+    if (unlikely(mapped_header_ != nullptr))
+        LOG_ERROR("\"" + path_ + "\" has been opened for reading only!");
+    if (unlikely(record_size != record_size_))
+        LOG_ERROR("attempted to append records of the wrong type to \"" + path_ + "\"!");
+    if (record_count == 0)
+        return;
+
+    // Only the most recent "capacity" records would survive anyway:
+    const uint64_t skipped_count(record_count > header_.capacity_ ? record_count - header_.capacity_ : 0);
+    const char * const first_record(reinterpret_cast<const char *>(records) + skipped_count * record_size_);
+    const uint64_t remaining_count(record_count - skipped_count);
+
+    // We may have to wrap around once:
+    const uint64_t start_slot((header_.write_count_ + skipped_count) % header_.capacity_);
+    const uint64_t first_chunk_count(std::min(remaining_count, header_.capacity_ - start_slot));
+    writeOrDie(first_record, first_chunk_count * record_size_, sizeof(Header) + start_slot * record_size_);
+    if (first_chunk_count < remaining_count)
+        writeOrDie(first_record + first_chunk_count * record_size_, (remaining_count - first_chunk_count) * record_size_,
+                   sizeof(Header));
+
+    // Publishing the new count last means that readers never see slots that have not been written yet.
+    header_.write_count_ += record_count;
+    writeOrDie(&header_.write_count_, sizeof header_.write_count_, offsetof(Header, write_count_));
+}
+
+
+const char *SystemMonitorRingBuffer::getRecord(const uint64_t index, const size_t record_size) const {
+    if (unlikely(record_size != record_size_))
+        LOG_ERROR("attempted to read records of the wrong type from \"" + path_ + "\"!");
+
+    const uint64_t write_count(getWriteCount());
+    const uint64_t capacity(getCapacity());
+    const uint64_t oldest_slot(write_count <= capacity ? 0 : write_count % capacity);
+    return mapped_records_ + ((oldest_slot + index) % capacity) * record_size_;
+}
+
+
+void SystemMonitorRingBuffer::writeOrDie(const void * const data, const size_t size, const off_t offset) {
+    size_t total_written(0);
+    while (total_written < size) {
+        const ssize_t written(::pwrite(fd_, reinterpret_cast<const char *>(data) + total_written, size - total_written,
+                                       offset + total_written));
+        if (unlikely(written == -1)) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("failed to write to \"" + path_ + "\"!");
+        }
+        total_written += written;
+    }
+}
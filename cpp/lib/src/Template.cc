@@ -23,12 +23,15 @@
  *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "Template.h"
+#include <algorithm>
+#include <iterator>
 #include <map>
-#include <set>
+#include <mutex>
 #include <stdexcept>
 #include <sstream>
-#include <stack>
+#include <sys/stat.h>
 #include "Compiler.h"
+#include "FileUtil.h"
 #include "UrlUtil.h"
 #include "util.h"
 
@@ -109,14 +112,9 @@ public:
 
     inline unsigned getLineNo() const { return line_no_; }
 
-    /** \brief Repositions the input stream and sets the appropriate line number for that position. */
-    void seek(const std::istream::streampos stream_position, const unsigned line_no);
-
     /** Skips over blank characters in the input stream w/o emitting anything to the output stream. */
     void skipWhitespace();
 
-    inline std::istream::streampos getInputStreamPos() const { return input_.tellg(); }
-
     /** \return A string representation of "token". */
     static std::string TokenTypeToString(const TokenType token);
 private:
@@ -218,14 +216,6 @@ std::string TemplateScanner::extractKeywordOrFunctionNameCandidate() {
 }
 
 
-void TemplateScanner::seek(const std::istream::streampos stream_position, const unsigned line_no) {
-    input_.seekg(stream_position);
-    if (unlikely(not input_))
-        LOG_ERROR("this should never happen!");
-    line_no_ = line_no;
-}
-
-
 void TemplateScanner::skipWhitespace() {
     for (int ch(input_.get()); ch != EOF and isspace(ch); ch = input_.get())
         /* Intentionally empty! */;
@@ -339,150 +329,138 @@ TemplateScanner::TokenType TemplateScanner::MapStringToKeywordToken(const std::s
 }
 
 
-class Scope {
+// A LOOP that is currently being expanded.
+struct ActiveLoop {
+    const std::vector<std::string> &loop_vars_;
+    unsigned iteration_count_;
 public:
-    enum Type { TOP_LEVEL, IF, LOOP };
-private:
-    Type type_;
-    unsigned start_line_number_, iteration_count_, loop_count_;
-    std::istream::streampos start_stream_pos_;
-    std::set<std::string> loop_vars_;
-public:
-    Type getType() const { return type_; }
-
-    /** \return where an IF or a LOOP started. */
-    unsigned getStartLineNumber() const { return start_line_number_; }
-
-    bool isLoopVariable(const std::string &variable_name) const;
-    unsigned getCurrentIterationCount() const;
-    unsigned getLoopCount() const;
-    void incIterationCount();
-    std::istream::streampos getStartStreamPos() const;
-
-    static Scope MakeTopLevelScope() { return Scope(TOP_LEVEL); }
-    static Scope MakeIfScope(const unsigned start_line_number) { return Scope(IF, start_line_number); }
-    static Scope MakeLoopScope(const unsigned start_line_number, const std::istream::streampos start_stream_pos,
-                               const std::set<std::string> &loop_vars, const unsigned loop_count)
-        { return Scope(LOOP, start_line_number, start_stream_pos, loop_vars, loop_count); }
-private:
-    explicit Scope(const Type type): type_(type) { }
-    explicit Scope(const Type type, const unsigned start_line_number)
-        : type_(type), start_line_number_(start_line_number) { }
-    explicit Scope(const Type type, const unsigned start_line_number, const std::istream::streampos start_stream_pos,
-                   const std::set<std::string> &loop_vars, const unsigned loop_count)
-        : type_(type), start_line_number_(start_line_number), iteration_count_(0), loop_count_(loop_count),
-          start_stream_pos_(start_stream_pos), loop_vars_(loop_vars) { }
-    static std::string TypeToString(const Type type);
+    explicit ActiveLoop(const std::vector<std::string> &loop_vars): loop_vars_(loop_vars), iteration_count_(0) { }
+    inline bool isLoopVariable(const std::string &variable_name) const
+        { return std::find(loop_vars_.cbegin(), loop_vars_.cend(), variable_name) != loop_vars_.cend(); }
 };
 
 
-bool Scope::isLoopVariable(const std::string &variable_name) const {
-    if (unlikely(type_ != LOOP))
-        LOG_ERROR("this should never happen! (type is " + TypeToString(type_) + ", variable is \"" + variable_name + "\")");
+const Value *GetArrayValue(const std::vector<ActiveLoop> &active_loops, const std::string &variable_name, const Value *value) {
+    for (const auto &active_loop : active_loops) {
+        if (active_loop.isLoopVariable(variable_name)) {
+            const ArrayValue * const array(dynamic_cast<const ArrayValue *>(value));
+            if (array == nullptr)
+                return nullptr;
+            value = array->getValueAt(active_loop.iteration_count_);
+        }
+    }
 
-    return loop_vars_.find(variable_name) != loop_vars_.cend();
+    return value;
 }
 
 
-unsigned Scope::getCurrentIterationCount() const {
-    if (unlikely(type_ != LOOP))
-        LOG_ERROR("this should never happen! (type is " + TypeToString(type_) + ")");
+// Returns NULL if "variable_name" does not exists or the value as seen within the active loops.
+const Value *GetScopedValue(const std::string &variable_name, const Map &names_to_values_map,
+                            const std::vector<ActiveLoop> &active_loops)
+{
+    const auto &name_and_values(names_to_values_map.find(variable_name));
+    if (name_and_values == names_to_values_map.end())
+        return nullptr;
 
-    return iteration_count_;
-}
+    // If we have a scalar we have no problem:
+    if (ScalarValue *scalar = dynamic_cast<ScalarValue *>(name_and_values->second.get()))
+        return scalar;
 
+    // Now deal w/ multivalued variables:
+    return GetArrayValue(active_loops, variable_name, name_and_values->second.get());
+}
 
-unsigned Scope::getLoopCount() const {
-    if (unlikely(type_ != LOOP))
-        LOG_ERROR("this should never happen!");
 
-    return loop_count_;
+// Returns NULL, if "variable_name" does not exist or can't be accessed as a scalar based on the active loops.
+const std::string *GetScalarValue(const std::string &variable_name, const Map &names_to_values_map,
+                                  const std::vector<ActiveLoop> &active_loops)
+{
+    const ScalarValue * const scalar(dynamic_cast<const ScalarValue *>(GetScopedValue(variable_name, names_to_values_map,
+                                                                                      active_loops)));
+    return scalar == nullptr ? nullptr : &scalar->getValue();
 }
 
 
-void Scope::incIterationCount() {
-    if (unlikely(type_ != LOOP))
-        LOG_ERROR("this should never happen!");
-
-    ++iteration_count_;
+void ProcessEndOfSyntax(const std::string &name_of_syntactic_construct, TemplateScanner * const scanner) {
+    const TemplateScanner::TokenType token(scanner->getToken(/* emit_output = */false));
+    if (unlikely(token != TemplateScanner::END_OF_SYNTAX))
+        throw std::runtime_error("in Template::ProcessEndOfSyntax: error on line "
+                                 + std::to_string(scanner->getLineNo()) + " expected '}' after "
+                                 + name_of_syntactic_construct + " but found "
+                                 + TemplateScanner::TokenTypeToString(token) + "!");
 }
 
 
-std::istream::streampos Scope::getStartStreamPos() const {
-    if (unlikely(type_ != LOOP))
-        LOG_ERROR("this should never happen!");
+class LengthFunc : public Function {
+public:
+    explicit LengthFunc()
+        : Function("Length", { Function::ArgDesc("vector-valued variable name") }) { }
+    virtual std::string call(const std::vector<const Value *> &arguments) const final;
+};
+
+
+std::string LengthFunc::call(const std::vector<const Value *> &arguments) const {
+    if (arguments.size() != 1)
+        throw std::invalid_argument(name_ + " must be called w/ precisely one argument!");
 
-    return start_stream_pos_;
+    return std::to_string(arguments[0]->size());
 }
 
 
-std::string Scope::TypeToString(const Type type) {
-    switch (type) {
-    case TOP_LEVEL:
-        return "TOP_LEVEL";
-    case IF:
-        return "IF";
-    case LOOP:
-        return "LOOP";
-    }
+class UrlEncodeFunc : public Function {
+public:
+    explicit UrlEncodeFunc()
+        : Function("UrlEncode", { Function::ArgDesc("scalar-valued variable name") }) { }
+    virtual std::string call(const std::vector<const Value *> &arguments) const final;
+};
 
-    LOG_ERROR("we should *never* get here!");
-}
 
+std::string UrlEncodeFunc::call(const std::vector<const Value *> &arguments) const {
+    if (arguments.size() != 1)
+        throw std::invalid_argument(name_ + " must be called w/ precisely one argument!");
 
-const Value *GetArrayValue(const std::vector<Scope> &active_scopes, const std::string &variable_name, const Value *value) {
-    for (const auto &scope : active_scopes) {
-        if (scope.getType() == Scope::LOOP and scope.isLoopVariable(variable_name)) {
-            const ArrayValue * const array(dynamic_cast<const ArrayValue *>(value));
-            if (array == nullptr)
-                return nullptr;
-            value = array->getValueAt(scope.getCurrentIterationCount());
-        }
-    }
+    const ScalarValue *scalar_value(dynamic_cast<const ScalarValue *>(arguments[0]));
+    if (scalar_value == nullptr)
+        throw std::invalid_argument("argument to " + name_ + " must be a scalar!");
 
-    return value;
+    return UrlUtil::UrlEncode(scalar_value->getValue());
 }
 
 
-// Returns NULL if "variable_name" does not exists or the value as seen within the active scope.
-const Value *GetScopedValue(const std::string &variable_name, const Map &names_to_values_map,
-                            const std::vector<Scope> &active_scopes)
-{
-    const auto &name_and_values(names_to_values_map.find(variable_name));
-    if (name_and_values == names_to_values_map.end())
-        return nullptr;
+} // unnamed namespace
 
-    // If we have a scalar we have no problem:
-    if (ScalarValue *scalar = dynamic_cast<ScalarValue *>(name_and_values->second.get()))
-        return scalar;
 
-    // Now deal w/ multivalued variables:
-    return GetArrayValue(active_scopes, variable_name, name_and_values->second.get());
-}
+struct CompiledTemplate::Node {
+    enum Type { TEXT, VARIABLE, FUNCTION_CALL, IF, LOOP };
 
+    struct Condition {
+        enum Type { DEFINED, EQUALS, NOT_EQUALS };
+        Type type_;
+        std::string lhs_variable_name_, rhs_; // "rhs_" is either a variable name or a string constant.
+        bool rhs_is_constant_;
+    };
 
-// Returns true, if "variable_name" exists and can be accessed as a scalar based on the current scope.
-bool GetScalarValue(const std::string &variable_name, const Map &names_to_values_map,
-                    const std::vector<Scope> &active_scopes, std::string * const value)
-{
-    const Value *scoped_value(GetScopedValue(variable_name, names_to_values_map, active_scopes));
-    if (scoped_value == nullptr)
-        return false;
+    Type type_;
+    unsigned line_no_;
+    std::string text_;                          // The text for TEXT and the variable name for VARIABLE nodes.
+    const Function *function_;                  // Only used by FUNCTION_CALL nodes.
+    std::vector<std::string> variable_names_;   // Arguments for FUNCTION_CALL and loop variables for LOOP nodes.
+    std::vector<Condition> conditions_;         // One or two, only used by IF nodes.
+    bool conditions_are_anded_;
+    std::vector<std::unique_ptr<Node>> children_, else_children_;
+    bool seen_else_;
+public:
+    Node(const Type type, const unsigned line_no)
+        : type_(type), line_no_(line_no), function_(nullptr), conditions_are_anded_(false), seen_else_(false) { }
+};
 
-    // If we have a scalar we have no problem:
-    if (const ScalarValue *scalar = dynamic_cast<const ScalarValue *>(scoped_value)) {
-        *value = scalar->getValue();
-        return true;
-    }
 
-    // If we get here, "value" is array-valued.
-    return false;
-}
+namespace {
 
 
-bool ParseIfCondition(TemplateScanner * const scanner, const Map &names_to_values_map,
-                      const std::vector<Scope> &active_scopes, const bool parse_only = false)
-{
+CompiledTemplate::Node::Condition ParseIfCondition(TemplateScanner * const scanner) {
+    CompiledTemplate::Node::Condition condition;
+
     scanner->skipWhitespace();
     TemplateScanner::TokenType token(scanner->getToken(/* emit_output = */false));
     if (unlikely(token != TemplateScanner::DEFINED and token != TemplateScanner::VARIABLE_NAME))
@@ -491,8 +469,8 @@ bool ParseIfCondition(TemplateScanner * const scanner, const Map &names_to_value
                                  + " DEFINED or variable name expected but found "
                                  + TemplateScanner::TokenTypeToString(token) + " instead!");
 
-    bool expression_value;
     if (token == TemplateScanner::DEFINED) {
+        condition.type_ = CompiledTemplate::Node::Condition::DEFINED;
         token = scanner->getToken(/* emit_output = */false);
         if (unlikely(token != TemplateScanner::OPEN_PAREN))
             throw std::runtime_error("in Template::ParseIfCondition: error on line "
@@ -504,7 +482,7 @@ bool ParseIfCondition(TemplateScanner * const scanner, const Map &names_to_value
             throw std::runtime_error("in Template::ParseIfCondition: error on line "
                                      + std::to_string(scanner->getLineNo()) + " variable name expected but found "
                                      + TemplateScanner::TokenTypeToString(token) + " instead!");
-        expression_value = names_to_values_map.find(scanner->getLastVariableName()) != names_to_values_map.end();
+        condition.lhs_variable_name_ = scanner->getLastVariableName();
 
         token = scanner->getToken(/* emit_output = */false);
         if (unlikely(token != TemplateScanner::CLOSE_PAREN))
@@ -512,18 +490,15 @@ bool ParseIfCondition(TemplateScanner * const scanner, const Map &names_to_value
                                      + std::to_string(scanner->getLineNo()) + " '(' expected but found "
                                      + TemplateScanner::TokenTypeToString(token) + " instead!");
     } else { // Comparison.
-        std::string variable_name(scanner->getLastVariableName());
-        std::string lhs;
-        if (not parse_only and unlikely(not GetScalarValue(variable_name, names_to_values_map, active_scopes, &lhs)))
-            throw std::runtime_error("in Template::ParseIfCondition: error on line "
-                                     + std::to_string(scanner->getLineNo())
-                                     + " unknown or non-scalar variable name \"" + variable_name + "\"!");
+        condition.lhs_variable_name_ = scanner->getLastVariableName();
         scanner->skipWhitespace();
         const TemplateScanner::TokenType operator_token(scanner->getToken(/* emit_output = */false));
         if (unlikely(operator_token != TemplateScanner::EQUALS and operator_token != TemplateScanner::NOT_EQUALS))
             throw std::runtime_error("in Template::ParseIfCondition: error on line "
                                      + std::to_string(scanner->getLineNo())
                                      + " \"==\" or \"!=\" expected after variable name!");
+        condition.type_ = (operator_token == TemplateScanner::EQUALS) ? CompiledTemplate::Node::Condition::EQUALS
+                                                                      : CompiledTemplate::Node::Condition::NOT_EQUALS;
 
         scanner->skipWhitespace();
         token = scanner->getToken(/* emit_output = */false);
@@ -532,86 +507,44 @@ bool ParseIfCondition(TemplateScanner * const scanner, const Map &names_to_value
                                      + std::to_string(scanner->getLineNo())
                                      + " variable name or string constant expected after comparison operator! ("
                                      "Found " + TemplateScanner::TokenTypeToString(token) + " instead.)");
-        std::string rhs;
-        if (token == TemplateScanner::STRING_CONSTANT)
-            rhs = scanner->getLastStringConstant();
-        else {
-            variable_name = scanner->getLastVariableName();
-            if (unlikely(not GetScalarValue(variable_name, names_to_values_map, active_scopes, &rhs)))
-                throw std::runtime_error("in Template::ParseIfCondition: error on line "
-                                         + std::to_string(scanner->getLineNo())
-                                         + " unknown or non-scalar variable name \"" + variable_name + "\"!");
-        }
-
-        expression_value = (rhs == lhs);
-        if (operator_token == TemplateScanner::NOT_EQUALS)
-            expression_value = !expression_value;
+        condition.rhs_is_constant_ = token == TemplateScanner::STRING_CONSTANT;
+        condition.rhs_ = condition.rhs_is_constant_ ? scanner->getLastStringConstant() : scanner->getLastVariableName();
     }
 
-    return expression_value;
+    return condition;
 }
 
 
-// \return The value of the conditional expression.
-bool ParseIf(TemplateScanner * const scanner, const Map &names_to_values_map, const std::vector<Scope> &active_scopes) {
-    const bool condition1(ParseIfCondition(scanner, names_to_values_map, active_scopes));
+void ParseIf(TemplateScanner * const scanner, CompiledTemplate::Node * const if_node) {
+    if_node->conditions_.emplace_back(ParseIfCondition(scanner));
 
     scanner->skipWhitespace();
     const TemplateScanner::TokenType token(scanner->getToken(/* emit_output = */false));
     if (unlikely(token == TemplateScanner::END_OF_SYNTAX))
-        return condition1;
+        return;
 
     if (unlikely(token != TemplateScanner::AND and token != TemplateScanner::OR))
         throw std::runtime_error("in Template::ParseIf: error on line " + std::to_string(scanner->getLineNo())
                                  + " '}' expected but found " + TemplateScanner::TokenTypeToString(token)
                                  + " instead!");
 
-    // Syntax check only:
-    const auto start_of_condition(scanner->getInputStreamPos());
-    const unsigned start_of_condition_lineno(scanner->getLineNo());
-    ParseIfCondition(scanner, names_to_values_map, active_scopes, /*parse_only =*/true);
-
-    if (token == TemplateScanner::AND) {
-        if (not condition1)
-            return false;
-    } else { // token == TemplateScanner::OR
-        if (condition1)
-            return true;
-    }
-    scanner->seek(start_of_condition, start_of_condition_lineno);
-    return ParseIfCondition(scanner, names_to_values_map, active_scopes);
+    if_node->conditions_are_anded_ = token == TemplateScanner::AND;
+    if_node->conditions_.emplace_back(ParseIfCondition(scanner));
 }
 
 
-void ParseLoop(TemplateScanner * const scanner, std::set<std::string> * const loop_vars, size_t * const loop_count,
-               const Map &names_to_values_map, const std::vector<Scope> &active_scopes)
-{
+void ParseLoop(TemplateScanner * const scanner, std::vector<std::string> * const loop_vars) {
     scanner->skipWhitespace();
 
     TemplateScanner::TokenType token;
-    *loop_count = 0;
     do {
         token = scanner->getToken(/* emit_output = */false);
         if (unlikely(token != TemplateScanner::VARIABLE_NAME))
             throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
                                      + ": variable name expected after comma or LOOP, found " + TemplateScanner::TokenTypeToString(token)
                                      + " instead!");
-        const std::string variable_name_candidate(scanner->getLastVariableName());
-        const auto name_and_values(names_to_values_map.find(variable_name_candidate));
-        if (unlikely(name_and_values == names_to_values_map.end()))
-            throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo()) + ": undefined loop variable \""
-                                     + variable_name_candidate + "\"!");
-        const Value *value(GetArrayValue(active_scopes, variable_name_candidate, name_and_values->second.get()));
-        const ArrayValue * const array_value(dynamic_cast<const ArrayValue * const>(value));
-        if (unlikely(array_value == nullptr))
-            throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo()) + ": loop variable \""
-                                     + variable_name_candidate + "\" is scalar in this context!");
-        if (*loop_count == 0)
-            *loop_count = array_value->size();
-        else if (*loop_count != array_value->size())
-            throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
-                                     + ": all loop variables must have the same cardinality!");
-        loop_vars->emplace(variable_name_candidate);
+        if (std::find(loop_vars->cbegin(), loop_vars->cend(), scanner->getLastVariableName()) == loop_vars->cend())
+            loop_vars->emplace_back(scanner->getLastVariableName());
     } while ((token = scanner->getToken(/* emit_output = */false)) == TemplateScanner::COMMA);
 
     if (unlikely(token != TemplateScanner::END_OF_SYNTAX))
@@ -621,214 +554,293 @@ void ParseLoop(TemplateScanner * const scanner, std::set<std::string> * const lo
 }
 
 
-void ParseFunctionCall(TemplateScanner * const scanner, const Map &names_to_values_map, const std::vector<Scope> &active_scopes,
-                       const Function * const function, std::ostream &output, const bool emit_output)
-{
+void ParseFunctionCall(TemplateScanner * const scanner, std::vector<std::string> * const argument_variable_names) {
     scanner->skipWhitespace();
-    TemplateScanner::TokenType token(scanner->getToken(emit_output));
-    if (token == TemplateScanner::OPEN_PAREN)
-        std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
-                           + ": expected opening parenthesis after function name!");
+    TemplateScanner::TokenType token(scanner->getToken(/* emit_output = */false));
+    if (token != TemplateScanner::OPEN_PAREN)
+        throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
+                                 + ": expected opening parenthesis after function name!");
 
-    // Collect the function arguments:
-    std::vector<const Value *> args;
+    // Collect the names of the function arguments:
     for (;;) {
-        token = scanner->getToken(emit_output);
+        token = scanner->getToken(/* emit_output = */false);
         if (token == TemplateScanner::CLOSE_PAREN) {
-            if (args.empty())
+            if (argument_variable_names->empty())
                 break;
             throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
                                      + ": unexpected closing parenthesis in function call!");
-        } else if (token == TemplateScanner::VARIABLE_NAME) {
-            const std::string &variable_name(scanner->getLastVariableName());
-            const Value *value(GetScopedValue(variable_name, names_to_values_map, active_scopes));
-            if (value == nullptr)
-                throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
-                                         + ": function argument variable \"" + variable_name
-                                         + " is not a known variable!");
-            args.emplace_back(value);
-        } else
+        } else if (token == TemplateScanner::VARIABLE_NAME)
+            argument_variable_names->emplace_back(scanner->getLastVariableName());
+        else
             throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
                                      + ": unexpected junk in function call! (1)");
 
-        token = scanner->getToken(emit_output);
+        token = scanner->getToken(/* emit_output = */false);
         if (token == TemplateScanner::CLOSE_PAREN)
             break; // End of argument list.
         if (token != TemplateScanner::COMMA)
             throw std::runtime_error("error on line " + std::to_string(scanner->getLineNo())
                                      + ": unexpected junk in function call! (2)");
     }
-
-    if (emit_output)
-        output << function->call(args);
 }
 
 
-void ProcessEndOfSyntax(const std::string &name_of_syntactic_construct, TemplateScanner * const scanner) {
-    const TemplateScanner::TokenType token(scanner->getToken(/* emit_output = */false));
-    if (unlikely(token != TemplateScanner::END_OF_SYNTAX))
-        throw std::runtime_error("in Template::ProcessEndOfSyntax: error on line "
-                                 + std::to_string(scanner->getLineNo()) + " expected '}' after "
-                                 + name_of_syntactic_construct + " but found "
-                                 + TemplateScanner::TokenTypeToString(token) + "!");
-}
-
+bool EvaluateCondition(const CompiledTemplate::Node::Condition &condition, const unsigned line_no, const Map &names_to_values_map,
+                       const std::vector<ActiveLoop> &active_loops)
+{
+    if (condition.type_ == CompiledTemplate::Node::Condition::DEFINED)
+        return names_to_values_map.find(condition.lhs_variable_name_) != names_to_values_map.end();
+
+    const std::string * const lhs(GetScalarValue(condition.lhs_variable_name_, names_to_values_map, active_loops));
+    if (unlikely(lhs == nullptr))
+        throw std::runtime_error("in Template::EvaluateCondition: error on line " + std::to_string(line_no)
+                                 + " unknown or non-scalar variable name \"" + condition.lhs_variable_name_ + "\"!");
+
+    const std::string *rhs(&condition.rhs_);
+    if (not condition.rhs_is_constant_) {
+        rhs = GetScalarValue(condition.rhs_, names_to_values_map, active_loops);
+        if (unlikely(rhs == nullptr))
+            throw std::runtime_error("in Template::EvaluateCondition: error on line " + std::to_string(line_no)
+                                     + " unknown or non-scalar variable name \"" + condition.rhs_ + "\"!");
+    }
 
-void SkipToToken(TemplateScanner * const scanner, TemplateScanner::TokenType target_token) {
-    TemplateScanner::TokenType token;
-    while ((token = scanner->getToken(false)) != target_token and token != TemplateScanner::END_OF_INPUT)
-        /* do nothing */;
-    if (token == TemplateScanner::END_OF_INPUT)
-        throw std::runtime_error("in Template::SkipToToken: error on line "
-                                 + std::to_string(scanner->getLineNo())
-                                 + " expected '" + TemplateScanner::TokenTypeToString(token)
-                                 + "' but none was found.");
+    return (*lhs == *rhs) == (condition.type_ == CompiledTemplate::Node::Condition::EQUALS);
 }
 
 
-class LengthFunc : public Function {
-public:
-    explicit LengthFunc()
-        : Function("Length", { Function::ArgDesc("vector-valued variable name") }) { }
-    virtual std::string call(const std::vector<const Value *> &arguments) const final;
-};
-
-
-std::string LengthFunc::call(const std::vector<const Value *> &arguments) const {
-    if (arguments.size() != 1)
-        throw std::invalid_argument(name_ + " must be called w/ precisely one argument!");
+// \return The number of iterations.
+size_t GetLoopCount(const CompiledTemplate::Node &loop_node, const Map &names_to_values_map,
+                    const std::vector<ActiveLoop> &active_loops)
+{
+    size_t loop_count(0);
+    for (const auto &loop_var : loop_node.variable_names_) {
+        const auto name_and_values(names_to_values_map.find(loop_var));
+        if (unlikely(name_and_values == names_to_values_map.end()))
+            throw std::runtime_error("in Template::ExpandTemplate: error on line " + std::to_string(loop_node.line_no_)
+                                     + ": undefined loop variable \"" + loop_var + "\"!");
+        const Value * const value(GetArrayValue(active_loops, loop_var, name_and_values->second.get()));
+        const ArrayValue * const array_value(dynamic_cast<const ArrayValue *>(value));
+        if (unlikely(array_value == nullptr))
+            throw std::runtime_error("in Template::ExpandTemplate: error on line " + std::to_string(loop_node.line_no_)
+                                     + ": loop variable \"" + loop_var + "\" is scalar in this context!");
+        if (loop_count == 0)
+            loop_count = array_value->size();
+        else if (loop_count != array_value->size())
+            throw std::runtime_error("in Template::ExpandTemplate: error on line " + std::to_string(loop_node.line_no_)
+                                     + ": all loop variables must have the same cardinality!");
+    }
 
-    return std::to_string(arguments[0]->size());
+    return loop_count;
 }
 
 
-class UrlEncodeFunc : public Function {
-public:
-    explicit UrlEncodeFunc()
-        : Function("UrlEncode", { Function::ArgDesc("scalar-valued variable name") }) { }
-    virtual std::string call(const std::vector<const Value *> &arguments) const final;
-};
-
-
-std::string UrlEncodeFunc::call(const std::vector<const Value *> &arguments) const {
-    if (arguments.size() != 1)
-        throw std::invalid_argument(name_ + " must be called w/ precisely one argument!");
+void ExpandNodes(const std::vector<std::unique_ptr<CompiledTemplate::Node>> &nodes, const Map &names_to_values_map,
+                 std::vector<ActiveLoop> * const active_loops, std::string * const output)
+{
+    for (const auto &node : nodes) {
+        switch (node->type_) {
+        case CompiledTemplate::Node::TEXT:
+            output->append(node->text_);
+            break;
+        case CompiledTemplate::Node::VARIABLE: {
+            const std::string * const value(GetScalarValue(node->text_, names_to_values_map, *active_loops));
+            if (unlikely(value == nullptr))
+                throw std::runtime_error("in Template::ExpandTemplate: error on line " + std::to_string(node->line_no_)
+                                         + ": found unexpected variable \"" + node->text_ + "\"!");
+            output->append(*value);
+            break;
+        } case CompiledTemplate::Node::FUNCTION_CALL: {
+            std::vector<const Value *> args;
+            args.reserve(node->variable_names_.size());
+            for (const auto &variable_name : node->variable_names_) {
+                const Value * const value(GetScopedValue(variable_name, names_to_values_map, *active_loops));
+                if (value == nullptr)
+                    throw std::runtime_error("error on line " + std::to_string(node->line_no_) + ": function argument variable \""
+                                             + variable_name + " is not a known variable!");
+                args.emplace_back(value);
+            }
+            output->append(node->function_->call(args));
+            break;
+        } case CompiledTemplate::Node::IF: {
+            bool condition(EvaluateCondition(node->conditions_[0], node->line_no_, names_to_values_map, *active_loops));
+            if (node->conditions_.size() == 2 and condition != not node->conditions_are_anded_)
+                condition = EvaluateCondition(node->conditions_[1], node->line_no_, names_to_values_map, *active_loops);
+            ExpandNodes(condition ? node->children_ : node->else_children_, names_to_values_map, active_loops, output);
+            break;
+        } case CompiledTemplate::Node::LOOP: {
+            const size_t loop_count(GetLoopCount(*node, names_to_values_map, *active_loops));
+            if (loop_count == 0)
+                break;
+            active_loops->emplace_back(node->variable_names_);
+            for (/* Intentionally empty! */; active_loops->back().iteration_count_ < loop_count; ++active_loops->back().iteration_count_)
+                ExpandNodes(node->children_, names_to_values_map, active_loops, output);
+            active_loops->pop_back();
+            break;
+        }
+        }
+    }
+}
 
-    const ScalarValue *scalar_value(dynamic_cast<const ScalarValue *>(arguments[0]));
-    if (scalar_value == nullptr)
-        throw std::invalid_argument("argument to " + name_ + " must be a scalar!");
 
-    return UrlUtil::UrlEncode(scalar_value->getValue());
-}
+LengthFunc length_func;
+UrlEncodeFunc url_encode_func;
 
 
 } // unnamed namespace
 
 
-void ExpandTemplate(std::istream &input, std::ostream &output, const Map &names_to_values_map, const std::vector<Function *> &functions) {
-    if (unlikely(not input))
-        LOG_ERROR("input is bad!");
-    if (unlikely(not output))
-        LOG_ERROR("input is bad!");
+CompiledTemplate::CompiledTemplate(const std::string &template_string, const std::vector<Function *> &functions) {
     std::vector<Function *> all_functions(functions);
-    all_functions.emplace_back(new LengthFunc());
-    all_functions.emplace_back(new UrlEncodeFunc());
+    all_functions.emplace_back(&length_func);
+    all_functions.emplace_back(&url_encode_func);
 
-    TemplateScanner scanner(input, output, all_functions);
-    std::vector<Scope> scopes;
-    scopes.push_back(Scope::MakeTopLevelScope());
+    std::istringstream input(template_string);
+    std::ostringstream text;
+    TemplateScanner scanner(input, text, all_functions);
+
+    // The innermost open IF or LOOP is at the back:
+    std::vector<Node *> open_nodes;
+    const auto current_nodes([&]() -> std::vector<std::unique_ptr<Node>> & {
+        if (open_nodes.empty())
+            return nodes_;
+        Node * const open_node(open_nodes.back());
+        return open_node->seen_else_ ? open_node->else_children_ : open_node->children_;
+    });
 
-    std::stack<bool> skipping;
     TemplateScanner::TokenType token;
-    while ((token = scanner.getToken(skipping.empty() or not skipping.top())) != TemplateScanner::END_OF_INPUT) {
+    do {
+        token = scanner.getToken(/* emit_output = */true);
+        if (text.tellp() > 0) {
+            std::unique_ptr<Node> text_node(new Node(Node::TEXT, scanner.getLineNo()));
+            text_node->text_ = text.str();
+            current_nodes().emplace_back(std::move(text_node));
+            text.str("");
+        }
+
         if (unlikely(token == TemplateScanner::ERROR))
-            throw std::runtime_error("in Template::ExpandTemplate: error on line "
+            throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: error on line "
                                      + std::to_string(scanner.getLineNo()) + ": " + scanner.getLastErrorMessage());
         if (token == TemplateScanner::IF) {
-            const unsigned start_line_no(scanner.getLineNo());
-            skipping.push(not ParseIf(&scanner, names_to_values_map, scopes));
-            scopes.push_back(Scope::MakeIfScope(start_line_no));
+            std::unique_ptr<Node> if_node(new Node(Node::IF, scanner.getLineNo()));
+            ParseIf(&scanner, if_node.get());
+            Node * const new_open_node(if_node.get());
+            current_nodes().emplace_back(std::move(if_node));
+            open_nodes.emplace_back(new_open_node);
         } else if (token == TemplateScanner::ELSE) {
-            if (unlikely(scopes.back().getType() != Scope::IF))
-                throw std::runtime_error("in Template::ExpandTemplate: error on line "
+            if (unlikely(open_nodes.empty() or open_nodes.back()->type_ != Node::IF or open_nodes.back()->seen_else_))
+                throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: error on line "
                                          + std::to_string(scanner.getLineNo())
                                          + ": ELSE found w/o corresponding earlier IF!");
-            skipping.top() = not skipping.top();
+            open_nodes.back()->seen_else_ = true;
             ProcessEndOfSyntax("ELSE", &scanner);
         } else if (token == TemplateScanner::ENDIF) {
-            if (unlikely(scopes.back().getType() != Scope::IF))
-                throw std::runtime_error("in Template::ExpandTemplate: error on line "
+            if (unlikely(open_nodes.empty() or open_nodes.back()->type_ != Node::IF))
+                throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: error on line "
                                          + std::to_string(scanner.getLineNo())
                                          + ": ENDIF found w/o corresponding earlier IF!");
-            scopes.pop_back();
-            skipping.pop();
+            open_nodes.pop_back();
             ProcessEndOfSyntax("ENDIF", &scanner);
         } else if (token == TemplateScanner::LOOP) {
-            std::set<std::string> loop_vars;
-            size_t loop_count;
+            std::unique_ptr<Node> loop_node(new Node(Node::LOOP, scanner.getLineNo()));
             try {
-                ParseLoop(&scanner, &loop_vars, &loop_count, names_to_values_map, scopes);
+                ParseLoop(&scanner, &loop_node->variable_names_);
             } catch (const std::exception &x) {
-                throw std::runtime_error("in Template::ExpandTemplate: " + std::string(x.what()));
+                throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: " + std::string(x.what()));
             }
-            const unsigned start_line_no(scanner.getLineNo());
-            if (likely(loop_count > 0))
-                scopes.push_back(Scope::MakeLoopScope(start_line_no, scanner.getInputStreamPos(), loop_vars,
-                                                      loop_count));
-            else
-                SkipToToken(&scanner, TemplateScanner::ENDLOOP);
+            Node * const new_open_node(loop_node.get());
+            current_nodes().emplace_back(std::move(loop_node));
+            open_nodes.emplace_back(new_open_node);
         } else if (token == TemplateScanner::ENDLOOP) {
-            Scope &current_scope(scopes.back());
-            if (unlikely(current_scope.getType() != Scope::LOOP))
-                throw std::runtime_error("in Template::ExpandTemplate: error on line "
+            if (unlikely(open_nodes.empty() or open_nodes.back()->type_ != Node::LOOP))
+                throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: error on line "
                                          + std::to_string(scanner.getLineNo())
                                          + ": ENDLOOP found w/o corresponding earlier LOOP!");
+            open_nodes.pop_back();
             ProcessEndOfSyntax("ENDLOOP", &scanner);
-
-            current_scope.incIterationCount();
-            if (current_scope.getCurrentIterationCount() >= current_scope.getLoopCount())
-                scopes.pop_back();
-            else
-                scanner.seek(current_scope.getStartStreamPos(), current_scope.getStartLineNumber());
         } else if (token == TemplateScanner::VARIABLE_NAME) {
-            const std::string &last_variable_name(scanner.getLastVariableName());
-            if (skipping.empty() or not skipping.top()) {
-                std::string variable_value;
-                if (not GetScalarValue(last_variable_name, names_to_values_map, scopes, &variable_value))
-                    throw std::runtime_error("in Template::ExpandTemplate: error on line "
-                                             + std::to_string(scanner.getLineNo()) + ": found unexpected variable \""
-                                             + last_variable_name + "\"!");
-                output << variable_value;
-            }
+            std::unique_ptr<Node> variable_node(new Node(Node::VARIABLE, scanner.getLineNo()));
+            variable_node->text_ = scanner.getLastVariableName();
+            current_nodes().emplace_back(std::move(variable_node));
             ProcessEndOfSyntax("variable expansion", &scanner);
         } else if (token == TemplateScanner::FUNCTION_NAME) {
-            ParseFunctionCall(&scanner, names_to_values_map, scopes, scanner.getLastFunction(), output,
-                              /* emit_output = */ skipping.empty() or not skipping.top());
+            std::unique_ptr<Node> function_call_node(new Node(Node::FUNCTION_CALL, scanner.getLineNo()));
+            function_call_node->function_ = scanner.getLastFunction();
+            ParseFunctionCall(&scanner, &function_call_node->variable_names_);
+            current_nodes().emplace_back(std::move(function_call_node));
             ProcessEndOfSyntax("function call", &scanner);
         }
-    }
+    } while (token != TemplateScanner::END_OF_INPUT);
 
-    const Scope &scope(scopes.back());
-    switch (scope.getType()) {
-    case Scope::TOP_LEVEL:
-        return;
-    case Scope::IF:
-        throw std::runtime_error("in Template::ExpandTemplate: error on line "
-                                 + std::to_string(scanner.getLineNo()) + ": IF started on line "
-                                 + std::to_string(scope.getStartLineNumber()) + " was never closed!");
-    case Scope::LOOP:
-        throw std::runtime_error("in Template::ExpandTemplate: error on line "
-                                 + std::to_string(scanner.getLineNo()) + ": LOOP started on line "
-                                 + std::to_string(scope.getStartLineNumber()) + " was never closed!");
-    }
+    if (not open_nodes.empty())
+        throw std::runtime_error("in Template::CompiledTemplate::CompiledTemplate: error on line "
+                                 + std::to_string(scanner.getLineNo()) + ": "
+                                 + (open_nodes.back()->type_ == Node::IF ? "IF" : "LOOP") + " started on line "
+                                 + std::to_string(open_nodes.back()->line_no_) + " was never closed!");
+}
+
+
+CompiledTemplate::~CompiledTemplate() {
+}
+
+
+void CompiledTemplate::expand(const Map &names_to_values_map, std::string * const output) const {
+    std::vector<ActiveLoop> active_loops;
+    ExpandNodes(nodes_, names_to_values_map, &active_loops, output);
+}
+
+
+void CompiledTemplate::expand(const Map &names_to_values_map, std::ostream &output) const {
+    std::string expanded_template;
+    expand(names_to_values_map, &expanded_template);
+    output.write(expanded_template.data(), expanded_template.size());
+}
+
+
+std::shared_ptr<const CompiledTemplate> CompiledTemplate::Load(const std::string &path, const std::vector<Function *> &functions) {
+    struct CacheEntry {
+        timespec mtime_;
+        std::vector<Function *> functions_;
+        std::shared_ptr<const CompiledTemplate> compiled_template_;
+    };
+    static std::unordered_map<std::string, CacheEntry> path_to_cache_entry_map;
+    static std::mutex cache_mutex;
+
+    struct stat stat_buf;
+    if (unlikely(::stat(path.c_str(), &stat_buf) != 0))
+        throw std::runtime_error("in Template::CompiledTemplate::Load: can't stat \"" + path + "\"!");
+
+    std::lock_guard<std::mutex> cache_locker(cache_mutex);
+    auto &cache_entry(path_to_cache_entry_map[path]);
+    if (cache_entry.compiled_template_ != nullptr and cache_entry.mtime_.tv_sec == stat_buf.st_mtim.tv_sec
+        and cache_entry.mtime_.tv_nsec == stat_buf.st_mtim.tv_nsec and cache_entry.functions_ == functions)
+        return cache_entry.compiled_template_;
+
+    std::string template_string;
+    if (unlikely(not FileUtil::ReadString(path, &template_string)))
+        throw std::runtime_error("in Template::CompiledTemplate::Load: can't read \"" + path + "\"!");
+
+    cache_entry.compiled_template_ = std::make_shared<const CompiledTemplate>(template_string, functions);
+    cache_entry.mtime_ = stat_buf.st_mtim;
+    cache_entry.functions_ = functions;
+    return cache_entry.compiled_template_;
+}
+
+
+void ExpandTemplate(std::istream &input, std::ostream &output, const Map &names_to_values_map, const std::vector<Function *> &functions) {
+    if (unlikely(not input))
+        LOG_ERROR("input is bad!");
+    if (unlikely(not output))
+        LOG_ERROR("input is bad!");
+
+    const std::string template_string(std::istreambuf_iterator<char>(input), {});
+    CompiledTemplate(template_string, functions).expand(names_to_values_map, output);
 }
 
 
 std::string ExpandTemplate(const std::string &template_string, const Map &names_to_values_map, const std::vector<Function *> &functions) {
-    std::istringstream input(template_string);
-    std::ostringstream expanded_template;
-    ExpandTemplate(input, expanded_template, names_to_values_map, functions);
-    return expanded_template.str();
+    std::string expanded_template;
+    CompiledTemplate(template_string, functions).expand(names_to_values_map, &expanded_template);
+    return expanded_template;
 }
 
 
@@ -30,14 +30,21 @@
 #include <exception>
 #include <locale>
 #include <memory>
+#include <cctype>
 #include <cstdio>
 #include <cstring>
 #include <cwctype>
+#if defined(__SSSE3__)
+#   include <tmmintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
 #include "Compiler.h"
 #include "FileUtil.h"
 #include "HtmlParser.h"
 #include "MiscUtil.h"
 #include "RegexMatcher.h"
+#include "ScanUtil.h"
 #include "StringUtil.h"
 #include "XMLParser.h"
 #include "util.h"
@@ -46,46 +53,42 @@
 namespace {
 
 
-class TextExtractor: public HtmlParser {
-    std::string &extracted_text_;
-    std::string charset_;
-public:
-    TextExtractor(const std::string &html, const std::string &initial_charset, std::string * const extracted_text)
-        : HtmlParser(html, initial_charset, HtmlParser::TEXT | HtmlParser::OPENING_TAG | HtmlParser::END_OF_STREAM),
-          extracted_text_(*extracted_text) { }
-    virtual void notify(const HtmlParser::Chunk &chunk);
-};
+// Unlike isspace(3) this is safe to use w/ the bytes of multibyte sequences.
+inline bool IsASCIIWhitespace(const char ch) {
+    return ch == ' ' or ch == '\t' or ch == '\n' or ch == '\r' or ch == '\f';
+}
 
 
-void TextExtractor::notify(const HtmlParser::Chunk &chunk) {
-    if (chunk.type_ == HtmlParser::TEXT) {
-        if (not StringUtil::EndsWith(chunk.text_, " ") and not StringUtil::EndsWith(chunk.text_, "\n"))
-            extracted_text_ += " ";
-        extracted_text_ += chunk.text_;
-    } else if (charset_.empty() and chunk.type_ == HtmlParser::OPENING_TAG
-             and StringUtil::ASCIIToLower(chunk.text_) == "meta") {
-
-        auto key_and_value(chunk.attribute_map_->find("charset"));
-        if (key_and_value != chunk.attribute_map_->end()) {
-            charset_ = key_and_value->second;
-        } else if (((key_and_value = chunk.attribute_map_->find("http-equiv")) != chunk.attribute_map_->end())
-                     and (StringUtil::ASCIIToLower(key_and_value->second) == "content-type")
-                     and ((key_and_value = chunk.attribute_map_->find("content")) != chunk.attribute_map_->end()))
-        {
-            static RegexMatcher *matcher(nullptr);
-            if (unlikely(matcher == nullptr)) {
-                const std::string pattern("charset=([^ ;]+)");
-                std::string err_msg;
-                matcher = RegexMatcher::RegexMatcherFactory(pattern, &err_msg);
-                if (unlikely(matcher == nullptr))
-                    throw std::runtime_error("Failed to construct a RegexMatcher for \"" + pattern
-                                             + "\" in TextExtractor::notify: " + err_msg);
-            }
+// \return The value of the "charset" attribute, or of the "charset=" parameter of the "content" attribute, of the first
+//         <meta> tag in "html_start" that has one, or an empty string if there is no such tag.
+std::string SniffMetaCharset(const std::string &html_start) {
+    const std::string lowercase_html(StringUtil::ASCIIToLower(html_start));
+    size_t meta_pos(0);
+    while ((meta_pos = lowercase_html.find("<meta", meta_pos)) != std::string::npos) {
+        const size_t tag_end(lowercase_html.find('>', meta_pos));
+        const std::string tag(lowercase_html.substr(meta_pos, tag_end == std::string::npos ? std::string::npos : tag_end - meta_pos));
+        meta_pos += __builtin_strlen("<meta");
 
-            if (matcher->matched(key_and_value->second))
-                charset_ = (*matcher)[1];
-        }
+        const size_t charset_pos(tag.find("charset"));
+        if (charset_pos == std::string::npos)
+            continue;
+        auto ch(tag.cbegin() + charset_pos + __builtin_strlen("charset"));
+        while (ch != tag.cend() and IsASCIIWhitespace(*ch))
+            ++ch;
+        if (ch == tag.cend() or *ch != '=')
+            continue;
+        ++ch;
+        while (ch != tag.cend() and (IsASCIIWhitespace(*ch) or *ch == '"' or *ch == '\''))
+            ++ch;
+
+        std::string charset;
+        while (ch != tag.cend() and (StringUtil::IsAlphanumeric(*ch) or *ch == '-' or *ch == '_' or *ch == '.' or *ch == ':'))
+            charset += *ch++;
+        if (not charset.empty())
+            return charset;
     }
+
+    return "";
 }
 
 
@@ -152,11 +155,221 @@ EncodingConverter::~EncodingConverter() {
 }
 
 
-std::string ExtractTextFromHtml(const std::string &html, const std::string &initial_charset) {
-    std::string extracted_text;
-    TextExtractor extractor(html, initial_charset, &extracted_text);
-    extractor.parse();
-    return StringUtil::TrimWhite(extracted_text);
+bool HtmlTextStreamExtractor::feed(const char * const data, const size_t size) {
+    if (size_limit_exceeded_)
+        return false;
+
+    if (not charset_determined_ or ascii_incompatible_) {
+        sniffing_buffer_.append(data, size);
+        if (charset_determined_ or sniffing_buffer_.size() < CHARSET_SNIFFING_SIZE)
+            return true;
+
+        determineCharset();
+        if (ascii_incompatible_)
+            return true;
+
+        std::string buffered_data;
+        buffered_data.swap(sniffing_buffer_);
+        process(buffered_data.data(), buffered_data.size());
+    } else
+        process(data, size);
+
+    return not size_limit_exceeded_;
+}
+
+
+std::string HtmlTextStreamExtractor::finish() {
+    if (not charset_determined_)
+        determineCharset();
+
+    std::string buffered_data;
+    buffered_data.swap(sniffing_buffer_);
+    if (ascii_incompatible_) { // We had to wait for the complete document.
+        std::string utf8_data;
+        encoding_converter_->convert(buffered_data, &utf8_data);
+        encoding_converter_ = IdentityConverter::Factory();
+        ascii_incompatible_ = false;
+        buffered_data.swap(utf8_data);
+    }
+    process(buffered_data.data(), buffered_data.size());
+    if (state_ == TAG_START)
+        pending_text_ += '<';
+    if (state_ == TEXT or state_ == TAG_START)
+        flushPendingText();
+    state_ = TEXT;
+
+    return StringUtil::TrimWhite(extracted_text_);
+}
+
+
+// See https://html.spec.whatwg.org/multipage/parsing.html#determining-the-character-encoding for the order of precedence.
+void HtmlTextStreamExtractor::determineCharset() {
+    charset_determined_ = true;
+
+    if (StringUtil::StartsWith(sniffing_buffer_, "\xEF\xBB\xBF")) {
+        charset_ = "UTF-8";
+        sniffing_buffer_.erase(0, 3);
+    } else if (StringUtil::StartsWith(sniffing_buffer_, "\xFE\xFF") or StringUtil::StartsWith(sniffing_buffer_, "\xFF\xFE")) {
+        charset_ = (sniffing_buffer_[0] == '\xFE') ? "UTF-16BE" : "UTF-16LE";
+        sniffing_buffer_.erase(0, 2);
+        ascii_incompatible_ = true;
+    } else if (not http_header_charset_.empty())
+        charset_ = http_header_charset_;
+    else {
+        charset_ = SniffMetaCharset(sniffing_buffer_);
+        if (charset_.empty()) {
+            // HTML 4 defaulted to Latin-1 and browsers actually use MS-ANSI, a superset thereof:
+            charset_ = (StringUtil::ASCIIToLower(sniffing_buffer_).find("<!doctype html public \"-//w3c//dtd html 4")
+                        != std::string::npos) ? "MS-ANSI" : "UTF-8";
+        }
+    }
+
+    if (CanonizeCharset(charset_) == CanonizeCharset(EncodingConverter::CANONICAL_UTF8_NAME))
+        encoding_converter_ = IdentityConverter::Factory();
+    else {
+        std::string error_message;
+        encoding_converter_ = EncodingConverter::Factory(charset_, EncodingConverter::CANONICAL_UTF8_NAME + "//TRANSLIT",
+                                                         &error_message);
+        if (encoding_converter_ == nullptr) {
+            LOG_WARNING(error_message);
+            encoding_converter_ = IdentityConverter::Factory();
+        }
+    }
+}
+
+
+void HtmlTextStreamExtractor::process(const char *data, const size_t size) {
+    static constexpr size_t MAX_PENDING_TEXT_SIZE(64 * 1024);
+    static constexpr size_t MAX_TAG_PREFIX_LENGTH(16); // Enough to identify comments, scripts and style sheets.
+
+    for (const char * const end(data + size); data != end and not size_limit_exceeded_; ++data) {
+        const char ch(*data);
+        switch (state_) {
+        case TEXT:
+            if (ch == '<')
+                state_ = TAG_START;
+            else {
+                pending_text_ += ch;
+
+                // ASCII whitespace is never part of a multibyte sequence or an entity, so it is safe to convert up to here:
+                if (pending_text_.size() >= MAX_PENDING_TEXT_SIZE and IsASCIIWhitespace(ch))
+                    flushPendingText();
+            }
+            break;
+        case TAG_START:
+            if (StringUtil::IsAsciiLetter(ch) or ch == '/' or ch == '!' or ch == '?') {
+                flushPendingText();
+                appendSeparator();
+                tag_.assign(1, ch);
+                quote_ = '\0';
+                state_ = TAG;
+            } else { // A literal '<'.
+                pending_text_ += '<';
+                if (ch != '<') {
+                    pending_text_ += ch;
+                    state_ = TEXT;
+                }
+            }
+            break;
+        case TAG:
+            if (quote_ != '\0') {
+                if (ch == quote_)
+                    quote_ = '\0';
+            } else if (ch == '>')
+                processTag();
+            else {
+                if ((ch == '"' or ch == '\'') and tag_[0] != '!')
+                    quote_ = ch;
+                if (tag_.length() < MAX_TAG_PREFIX_LENGTH) {
+                    tag_ += ch;
+                    if (tag_ == "!--") {
+                        tag_.clear();
+                        state_ = COMMENT;
+                    }
+                }
+            }
+            break;
+        case COMMENT:
+            if (ch == '>' and tag_ == "--")
+                state_ = TEXT;
+            else {
+                tag_ += ch;
+                if (tag_.length() > 2)
+                    tag_.erase(0, 1);
+            }
+            break;
+        case SCRIPT_OR_STYLE:
+            if (std::tolower(static_cast<unsigned char>(ch)) == end_tag_[end_tag_match_length_]) {
+                if (++end_tag_match_length_ == end_tag_.length()) {
+                    tag_ = end_tag_.substr(1);
+                    quote_ = '\0';
+                    state_ = TAG;
+                }
+            } else
+                end_tag_match_length_ = (ch == '<') ? 1 : 0;
+            break;
+        }
+    }
+}
+
+
+void HtmlTextStreamExtractor::processTag() {
+    state_ = TEXT;
+
+    size_t tag_name_length(0);
+    while (tag_name_length < tag_.length() and StringUtil::IsAlphanumeric(tag_[tag_name_length]))
+        ++tag_name_length;
+    const std::string tag_name(StringUtil::ASCIIToLower(tag_.substr(0, tag_name_length)));
+    if (tag_name == "script" or tag_name == "style") {
+        end_tag_ = "</" + tag_name;
+        end_tag_match_length_ = 0;
+        state_ = SCRIPT_OR_STYLE;
+    }
+}
+
+
+void HtmlTextStreamExtractor::flushPendingText() {
+    if (pending_text_.empty())
+        return;
+
+    std::string utf8_text;
+    encoding_converter_->convert(pending_text_, &utf8_text);
+    pending_text_.clear();
+
+    static constexpr size_t MAX_ENTITY_LENGTH(10);
+    size_t start(0), ampersand_pos;
+    while ((ampersand_pos = utf8_text.find('&', start)) != std::string::npos) {
+        extracted_text_.append(utf8_text, start, ampersand_pos - start);
+
+        const size_t semicolon_pos(utf8_text.find(';', ampersand_pos + 1));
+        std::string decoded_entity;
+        if (semicolon_pos != std::string::npos and semicolon_pos - ampersand_pos - 1 <= MAX_ENTITY_LENGTH
+            and HtmlParser::DecodeEntity(utf8_text.substr(ampersand_pos + 1, semicolon_pos - ampersand_pos - 1), &decoded_entity))
+        {
+            extracted_text_ += decoded_entity;
+            start = semicolon_pos + 1;
+        } else {
+            extracted_text_ += '&';
+            start = ampersand_pos + 1;
+        }
+    }
+    extracted_text_.append(utf8_text, start, std::string::npos);
+
+    if (max_text_size_ != 0 and extracted_text_.size() >= max_text_size_)
+        size_limit_exceeded_ = true;
+}
+
+
+void HtmlTextStreamExtractor::appendSeparator() {
+    if (not extracted_text_.empty() and extracted_text_.back() != ' ' and extracted_text_.back() != '\n')
+        extracted_text_ += ' ';
+}
+
+
+std::string ExtractTextFromHtml(const std::string &html, const std::string &initial_charset, const size_t max_text_size) {
+    HtmlTextStreamExtractor extractor(initial_charset, max_text_size);
+    extractor.feed(html);
+    return extractor.finish();
 }
 
 
@@ -255,7 +468,8 @@ bool UTF8ToWCharString(const std::string &utf8_string, std::wstring * wchar_stri
 
 
 bool WCharToUTF8String(const std::wstring &wchar_string, std::string * utf8_string) {
-    static iconv_t iconv_handle((iconv_t)-1);
+    // iconv(3) keeps conversion state in the handle, so each thread needs its own:
+    static thread_local iconv_t iconv_handle((iconv_t)-1);
     if (unlikely(iconv_handle == (iconv_t)-1)) {
         iconv_handle = ::iconv_open("UTF-8", "WCHAR_T");
         if (unlikely(iconv_handle == (iconv_t)-1))
@@ -306,21 +520,70 @@ bool WCharToUTF8String(const wchar_t wchar, std::string * utf8_string) {
 static std::locale DEFAULT_LOCALE("");
 
 
-bool UTF8ToLower(const std::string &utf8_string, std::string * const lowercase_utf8_string) {
+namespace {
+
+
+// Maps the case of a run of non-ASCII characters via the wide character functions and appends the result to "*output".
+bool MapNonASCIICase(const std::string &utf8_run, const bool to_lower, std::string * const output) {
     std::wstring wchar_string;
-    if (not UTF8ToWCharString(utf8_string, &wchar_string))
+    if (not UTF8ToWCharString(utf8_run, &wchar_string))
         return false;
 
-    // Lowercase the wide character string:
-    std::wstring lowercase_wide_string;
-    for (const auto wide_ch : wchar_string) {
-        if (std::iswupper(wide_ch))
-            lowercase_wide_string += std::tolower(wide_ch, DEFAULT_LOCALE);
-        else
-            lowercase_wide_string += wide_ch;
+    for (auto &wide_ch : wchar_string) {
+        if (to_lower) {
+            if (std::iswupper(wide_ch))
+                wide_ch = std::tolower(wide_ch, DEFAULT_LOCALE);
+        } else if (std::iswlower(static_cast<wint_t>(wide_ch)))
+            wide_ch = std::towupper(static_cast<wint_t>(wide_ch));
+    }
+
+    std::string converted_run;
+    if (not WCharToUTF8String(wchar_string, &converted_run))
+        return false;
+    *output += converted_run;
+    return true;
+}
+
+
+// Handles runs of ASCII characters w/ ScanUtil and only decodes the characters in between.  This works because bytes
+// belonging to multibyte UTF-8 sequences always have their high bit set.
+bool MapUTF8Case(const std::string &utf8_string, const bool to_lower, std::string * const output) {
+    output->clear();
+    output->reserve(utf8_string.size());
+
+    const char *ch(utf8_string.data());
+    const char * const end(utf8_string.data() + utf8_string.size());
+    while (ch != end) {
+        const char * const non_ascii(ScanUtil::FindFirstNonASCII(ch, end));
+        if (non_ascii != ch) {
+            const size_t old_size(output->size());
+            output->resize(old_size + (non_ascii - ch));
+            if (to_lower)
+                ScanUtil::ASCIIToLower(ch, non_ascii, &(*output)[old_size]);
+            else
+                ScanUtil::ASCIIToUpper(ch, non_ascii, &(*output)[old_size]);
+            ch = non_ascii;
+            if (ch == end)
+                break;
+        }
+
+        const char *ascii(ch);
+        while (ascii != end and (static_cast<unsigned char>(*ascii) & 0x80u))
+            ++ascii;
+        if (not MapNonASCIICase(std::string(ch, ascii), to_lower, output))
+            return false;
+        ch = ascii;
     }
 
-    return WCharToUTF8String(lowercase_wide_string, lowercase_utf8_string);
+    return true;
+}
+
+
+} // unnamed namespace
+
+
+bool UTF8ToLower(const std::string &utf8_string, std::string * const lowercase_utf8_string) {
+    return MapUTF8Case(utf8_string, /* to_lower = */true, lowercase_utf8_string);
 }
 
 
@@ -336,20 +599,7 @@ std::string UTF8ToLower(std::string * const utf8_string) {
 
 
 bool UTF8ToUpper(const std::string &utf8_string, std::string * const uppercase_utf8_string) {
-    std::wstring wchar_string;
-    if (not UTF8ToWCharString(utf8_string, &wchar_string))
-        return false;
-
-    // Uppercase the wide character string:
-    std::wstring uppercase_wide_string;
-    for (const auto wide_ch : wchar_string) {
-        if (std::iswlower(static_cast<wint_t>(wide_ch)))
-            uppercase_wide_string += std::towupper(static_cast<wint_t>(wide_ch));
-        else
-            uppercase_wide_string += wide_ch;
-    }
-
-    return WCharToUTF8String(uppercase_wide_string, uppercase_utf8_string);
+    return MapUTF8Case(utf8_string, /* to_lower = */false, uppercase_utf8_string);
 }
 
 
@@ -423,12 +673,23 @@ std::string UTF32ToUTF8(const uint32_t code_point) {
 
 bool UTF8ToUTF32(const std::string &utf8_string, std::vector<uint32_t> * utf32_chars) {
     utf32_chars->clear();
+    utf32_chars->reserve(utf8_string.size());
 
     UTF8ToUTF32Decoder decoder;
     try {
         bool last_addByte_retval(false);
-        for (const char ch : utf8_string) {
-            if (not (last_addByte_retval = decoder.addByte(ch)))
+        const char *ch(utf8_string.data());
+        const char * const end(utf8_string.data() + utf8_string.size());
+        while (ch != end) {
+            if (not last_addByte_retval) { // We're not in the middle of a multibyte sequence => copy ASCII runs directly.
+                const char * const non_ascii(ScanUtil::FindFirstNonASCII(ch, end));
+                utf32_chars->insert(utf32_chars->end(), reinterpret_cast<const unsigned char *>(ch),
+                                    reinterpret_cast<const unsigned char *>(non_ascii));
+                if ((ch = non_ascii) == end)
+                    break;
+            }
+
+            if (not (last_addByte_retval = decoder.addByte(*ch++)))
                 utf32_chars->emplace_back(decoder.getUTF32Char());
         }
 
@@ -461,68 +722,116 @@ uint32_t UTF32ToUpper(const uint32_t code_point) {
 namespace {
 
 
-/** \return True if "number_candidate" is non-empty and consists only of characters belonging
- *          to the wide-character class "digit"
- */
-bool IsNumber(const std::wstring &number_candidate) {
-    if (number_candidate.empty())
+// Decodes a single code point and advances "*ch" past it.
+inline bool DecodeUTF8(const char **ch, const char * const end, uint32_t * const code_point) {
+    const unsigned char lead(static_cast<unsigned char>(**ch));
+    ++*ch;
+    if (lead < 0x80u) {
+        *code_point = lead;
+        return true;
+    }
+
+    unsigned continuation_count;
+    uint32_t min_code_point;
+    if ((lead & 0b11100000u) == 0b11000000u)
+        continuation_count = 1, min_code_point = 0x80u, *code_point = lead & 0b00011111u;
+    else if ((lead & 0b11110000u) == 0b11100000u)
+        continuation_count = 2, min_code_point = 0x800u, *code_point = lead & 0b00001111u;
+    else if ((lead & 0b11111000u) == 0b11110000u)
+        continuation_count = 3, min_code_point = 0x10000u, *code_point = lead & 0b00000111u;
+    else
         return false;
 
-    for (const wchar_t ch : number_candidate) {
-        if (not std::iswdigit(ch))
+    for (unsigned i(0); i < continuation_count; ++i, ++*ch) {
+        if (unlikely(*ch == end or (static_cast<unsigned char>(**ch) & 0b11000000u) != 0b10000000u))
             return false;
+        *code_point = (*code_point << 6u) | (static_cast<unsigned char>(**ch) & 0b00111111u);
     }
 
-    return true;
+    // Reject overlong encodings, surrogates and values beyond the Unicode range like mbrtowc(3) does:
+    return *code_point >= min_code_point and *code_point <= 0x10FFFFu and (*code_point < 0xD800u or *code_point > 0xDFFFu);
 }
 
 
-template<typename ContainerType> bool ChopIntoWords(const std::string &text, ContainerType * const words, const unsigned min_word_length) {
-    words->clear();
+} // unnamed namespace
 
-    std::wstring wide_text;
-    if (unlikely(not UTF8ToWCharString(text, &wide_text)))
-        return false;
 
-    std::wstring word;
-    std::string utf8_word;
-    bool leading(true);
-    for (const wchar_t ch : wide_text) {
-        if (leading and (ch == L'-' or ch == L'\''))
-            ; // Do nothing!
-        else if (iswalnum(ch) or ch == L'-' or ch == L'\'') {
-            word += ch;
-            leading = false;
-        } else if (ch == L'.' and IsNumber(word)) {
-            word += ch;
-            if (word.length() >= min_word_length) {
-                if (unlikely(not WCharToUTF8String(word, &utf8_word)))
-                    return false;
-                words->insert(words->end(), utf8_word);
-            }
-            word.clear();
-            leading = true;
-        } else {
-            // Remove trailing and leading hyphens and quotes:
-            while (word.length() > 0 and (word[word.length() - 1] == L'-' or word[word.length() - 1] == L'\''))
-                word.resize(word.length() - 1);
-            if (word.length() >= min_word_length) {
-                if (unlikely(not WCharToUTF8String(word, &utf8_word)))
-                    return false;
-                words->insert(words->end(), utf8_word);
-            }
-            word.clear();
-            leading = true;
-        }
+bool WordTokenizer::finishWord(const bool trim_quotes, StringView * const word) {
+    // Remove trailing hyphens and, optionally, quotes:
+    while (word_length_ > 0 and (word_end_[-1] == '-' or (trim_quotes and word_end_[-1] == '\''))) {
+        --word_end_;
+        --word_length_;
     }
 
-    // Remove trailing and leading hyphens and quotes:
-    while (word.length() > 0 and word[word.length() - 1] == '-')
-        word.resize(word.length() - 1);
-    if (word.length() >= min_word_length) {
-        if (unlikely(not WCharToUTF8String(word, &utf8_word)))
+    const bool accept(word_length_ >= min_word_length_);
+    if (accept)
+        *word = StringView(word_start_, word_end_ - word_start_);
+    word_length_ = 0;
+    leading_ = true;
+    word_is_number_ = false;
+    return accept;
+}
+
+
+bool WordTokenizer::next(StringView * const word) {
+    while (ch_ != end_) {
+        const char * const char_start(ch_);
+        uint32_t code_point;
+        if (unlikely(not DecodeUTF8(&ch_, end_, &code_point))) {
+            error_ = done_ = true;
+            ch_ = end_;
             return false;
-        words->insert(words->end(), utf8_word);
+        }
+
+        const bool is_hyphen_or_quote(code_point == '-' or code_point == '\'');
+        if (leading_ and is_hyphen_or_quote)
+            continue;
+
+        if (is_hyphen_or_quote or std::iswalnum(static_cast<wint_t>(code_point))) {
+            const bool is_digit(std::iswdigit(static_cast<wint_t>(code_point)));
+            if (leading_) {
+                word_start_ = char_start;
+                leading_ = false;
+                word_is_number_ = is_digit;
+            } else
+                word_is_number_ = word_is_number_ and is_digit;
+            word_end_ = ch_;
+            ++word_length_;
+            continue;
+        }
+
+        if (leading_) // Empty word.
+            word_start_ = word_end_ = char_start;
+        if (code_point == '.' and word_is_number_) { // Keep the period of ordinal numbers.
+            word_end_ = ch_;
+            ++word_length_;
+        }
+        if (finishWord(/* trim_quotes = */true, word))
+            return true;
+    }
+
+    if (done_)
+        return false;
+    done_ = true;
+    if (leading_)
+        word_start_ = word_end_ = end_;
+    return finishWord(/* trim_quotes = */false, word);
+}
+
+
+namespace {
+
+
+template<typename ContainerType> bool ChopIntoWords(const std::string &text, ContainerType * const words, const unsigned min_word_length) {
+    words->clear();
+
+    WordTokenizer tokenizer(text, min_word_length);
+    StringView word;
+    while (tokenizer.next(&word))
+        words->insert(words->end(), word.toString());
+    if (unlikely(tokenizer.hasError())) {
+        words->clear();
+        return false;
     }
 
     return true;
@@ -544,12 +853,13 @@ bool ChopIntoWords(const std::string &text, std::vector<std::string> * const wor
 
 // See https://en.wikipedia.org/wiki/UTF-8 in order to understand the implementation.
 bool IsValidUTF8(const std::string &utf8_candidate) {
-    for (std::string::const_iterator ch(utf8_candidate.begin()); ch != utf8_candidate.end(); ++ch) {
+    const char * const end(utf8_candidate.data() + utf8_candidate.size());
+    for (const char *ch(ScanUtil::FindFirstNonASCII(utf8_candidate.data(), end)); ch != end;
+         ch = ScanUtil::FindFirstNonASCII(ch + 1, end))
+    {
         const unsigned char uch(static_cast<unsigned char>(*ch));
         unsigned sequence_length;
-        if ((uch & 0b10000000) == 0b00000000)
-            sequence_length = 0;
-        else if ((uch & 0b11100000) == 0b11000000)
+        if ((uch & 0b11100000) == 0b11000000)
             sequence_length = 1;
         else if ((uch & 0b11110000) == 0b11100000)
             sequence_length = 2;
@@ -562,7 +872,7 @@ bool IsValidUTF8(const std::string &utf8_candidate) {
 
         for (unsigned i(0); i < sequence_length; ++i) {
             ++ch;
-            if (unlikely(ch == utf8_candidate.end())) {
+            if (unlikely(ch == end)) {
                 LOG_DEBUG("premature string end in the middle of a UTF8 byte sequence!");
                 return false;
             }
@@ -608,101 +918,169 @@ std::vector<std::string>::const_iterator FindSubstring(const std::vector<std::st
 }
 
 
-static char base64_symbols[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789\0\0";
+namespace {
 
 
-std::string Base64Encode(const std::string &s, const char symbol63, const char symbol64, const bool use_output_padding) {
-    base64_symbols[62] = symbol63;
-    base64_symbols[63] = symbol64;
+const char BASE64_SYMBOLS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
 
-    std::string encoded_chars;
-    std::string::const_iterator ch(s.begin());
-    while (ch != s.end()) {
-        // Collect groups of 3 characters:
-        unsigned buf(static_cast<unsigned char>(*ch));
-        buf <<= 8u;
-        ++ch;
-        unsigned ignore_count(0);
-        if (ch != s.end()) {
-            buf |= static_cast<unsigned char>(*ch);
-            ++ch;
-        } else
-            ++ignore_count;
-        buf <<= 8u;
-        if (ch != s.end()) {
-            buf |= static_cast<unsigned char>(*ch);
-            ++ch;
-        }
-        else
-            ++ignore_count;
 
-        // Now grab 6 bits at a time and encode them starting with the 4th character:
-        char next4[4];
-        for (unsigned char_no(0); char_no < 4; ++char_no) {
-            next4[4 - 1 - char_no] = base64_symbols[buf & 0x3Fu];
-            buf >>= 6u;
-        }
+inline void GetBase64Alphabet(const char symbol63, const char symbol64, char alphabet[64]) {
+    std::memcpy(alphabet, BASE64_SYMBOLS, 62);
+    alphabet[62] = symbol63;
+    alphabet[63] = symbol64;
+}
+
+
+#if defined(__SSSE3__)
+// Encodes 12 input bytes into 16 characters.  Reads 16 bytes from "input" and writes 16 characters to "output".
+// (See http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html)
+inline void Base64EncodeBlock(const char * const input, char * const output, const __m128i shift_lut) {
+    __m128i block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input)));
+    block = _mm_shuffle_epi8(block, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    // Move each group of 6 bits into a byte of its own:
+    const __m128i high_sextets(_mm_mulhi_epu16(_mm_and_si128(block, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040)));
+    const __m128i low_sextets(_mm_mullo_epi16(_mm_and_si128(block, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010)));
+    const __m128i sextets(_mm_or_si128(high_sextets, low_sextets));
+
+    // Map 0..25 to 13, 26..51 to 0, 52..61 to 1..10, 62 to 11 and 63 to 12 and use that to look up the offset that
+    // turns a sextet into its symbol:
+    __m128i lut_indices(_mm_subs_epu8(sextets, _mm_set1_epi8(51)));
+    lut_indices = _mm_or_si128(lut_indices, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), sextets), _mm_set1_epi8(13)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_add_epi8(_mm_shuffle_epi8(shift_lut, lut_indices), sextets));
+}
+
+
+// Decodes 16 characters into 12 bytes.  Writes 16 bytes to "output".
+// \return False if any of the 16 characters is not part of the alphabet, in which case nothing will have been written.
+inline bool Base64DecodeBlock(const char * const input, char * const output, const __m128i symbol63, const __m128i symbol64) {
+    const __m128i block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input)));
 
-        for (unsigned char_no(0); char_no < 4 - ignore_count; ++char_no)
-            encoded_chars += next4[char_no];
+    const __m128i is_upper(_mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), block)));
+    const __m128i is_lower(_mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), block)));
+    const __m128i is_digit(_mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), block)));
+    const __m128i is_symbol63(_mm_cmpeq_epi8(block, symbol63));
+    const __m128i is_symbol64(_mm_cmpeq_epi8(block, symbol64));
+    const __m128i is_valid(_mm_or_si128(_mm_or_si128(_mm_or_si128(is_upper, is_lower), _mm_or_si128(is_digit, is_symbol63)),
+                                        is_symbol64));
+    if (_mm_movemask_epi8(is_valid) != 0xFFFF)
+        return false;
+
+    __m128i deltas(_mm_and_si128(is_upper, _mm_set1_epi8(-'A')));
+    deltas = _mm_or_si128(deltas, _mm_and_si128(is_lower, _mm_set1_epi8(26 - 'a')));
+    deltas = _mm_or_si128(deltas, _mm_and_si128(is_digit, _mm_set1_epi8(52 - '0')));
+    deltas = _mm_or_si128(deltas, _mm_and_si128(is_symbol63, _mm_sub_epi8(_mm_set1_epi8(62), symbol63)));
+    deltas = _mm_or_si128(deltas, _mm_and_si128(is_symbol64, _mm_sub_epi8(_mm_set1_epi8(63), symbol64)));
+    const __m128i sextets(_mm_add_epi8(block, deltas));
+
+    // Merge pairs of sextets into 12 bits, then pairs of those into 24 bits and finally compact the 3-byte groups:
+    const __m128i twelve_bit_groups(_mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140)));
+    const __m128i twenty_four_bit_groups(_mm_madd_epi16(twelve_bit_groups, _mm_set1_epi32(0x00011000)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output),
+                     _mm_shuffle_epi8(twenty_four_bit_groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    return true;
+}
+#endif
+
+
+} // unnamed namespace
+
+
+std::string Base64Encode(const std::string &s, const char symbol63, const char symbol64, const bool use_output_padding) {
+    char alphabet[64];
+    GetBase64Alphabet(symbol63, symbol64, alphabet);
+
+    std::string encoded_chars;
+    encoded_chars.resize((s.size() + 2) / 3 * 4);
+    const unsigned char *input(reinterpret_cast<const unsigned char *>(s.data()));
+    const unsigned char * const input_end(input + s.size());
+    char *output(&encoded_chars[0]);
+
+#if defined(__SSSE3__)
+    const __m128i shift_lut(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, symbol63 - 62, symbol64 - 63, 'A', 0, 0));
+    while (input_end - input >= 16) {
+        Base64EncodeBlock(reinterpret_cast<const char *>(input), output, shift_lut);
+        input += 12, output += 16;
     }
+#endif
 
-    if (not use_output_padding)
-        return encoded_chars;
+    // Groups of 3 bytes turn into 4 symbols:
+    for (/* Intentionally empty! */; input_end - input >= 3; input += 3, output += 4) {
+        const unsigned buf((unsigned(input[0]) << 16u) | (unsigned(input[1]) << 8u) | input[2]);
+        output[0] = alphabet[buf >> 18u];
+        output[1] = alphabet[(buf >> 12u) & 0x3Fu];
+        output[2] = alphabet[(buf >> 6u) & 0x3Fu];
+        output[3] = alphabet[buf & 0x3Fu];
+    }
 
-    switch (encoded_chars.size() % 3) {
-    case 1:
-        return encoded_chars + "==";
-    case 2:
-        return encoded_chars + "=";
-    default:
-        return encoded_chars;
+    // A trailing group of 1 or 2 bytes turns into 2 or 3 symbols:
+    if (input != input_end) {
+        const unsigned buf((unsigned(input[0]) << 16u) | (input + 1 != input_end ? unsigned(input[1]) << 8u : 0u));
+        *output++ = alphabet[buf >> 18u];
+        *output++ = alphabet[(buf >> 12u) & 0x3Fu];
+        if (input + 1 != input_end)
+            *output++ = alphabet[(buf >> 6u) & 0x3Fu];
+        if (use_output_padding) {
+            while (output != encoded_chars.data() + encoded_chars.size())
+                *output++ = '=';
+        } else
+            encoded_chars.resize(output - encoded_chars.data());
     }
+
+    return encoded_chars;
 }
 
 
+// Whitespace is skipped and decoding stops at the first padding character.
 std::string Base64Decode(const std::string &s, const char symbol63, const char symbol64) {
-    static unsigned char char_to_bits_map[128];
-    static bool initialised(false);
-    if (not initialised) {
-        unsigned char mask(0);
-        for (const char *cp(base64_symbols); *cp != '\0'; ++cp)
-            char_to_bits_map[static_cast<unsigned char>(*cp)] = mask++;
-        initialised = true;
-    }
-    char_to_bits_map[static_cast<unsigned char>(symbol63)] = 62;
-    char_to_bits_map[static_cast<unsigned char>(symbol64)] = 63;
+    char alphabet[64];
+    GetBase64Alphabet(symbol63, symbol64, alphabet);
+    signed char char_to_bits_map[256];
+    std::memset(char_to_bits_map, -1, sizeof(char_to_bits_map));
+    for (unsigned char bits(0); bits < 64; ++bits)
+        char_to_bits_map[static_cast<unsigned char>(alphabet[bits])] = bits;
 
     std::string decoded_chars;
-    unsigned state(1);
-    unsigned char decoded_ch;
-    for (const char encoded_ch : s) {
-        const unsigned char ch(char_to_bits_map[static_cast<unsigned char>(encoded_ch)]);
-        switch (state) {
-        case 1:
-            decoded_ch = ch << 2u;
-            state = 2;
-            break;
-        case 2:
-            decoded_ch |= ch >> 4u;
-            decoded_chars += static_cast<char>(decoded_ch);
-            decoded_ch = (ch & 0b001111u) << 4u;
-            state = 3;
-            break;
-        case 3:
-            decoded_ch |= ch >> 2u;
-            decoded_chars += static_cast<char>(decoded_ch);
-            decoded_ch = ch << 6u;
-            state = 4;
-            break;
-        case 4:
-            decoded_ch |= ch;
-            decoded_chars += static_cast<char>(decoded_ch);
-            state = 1;
-            break;
+    decoded_chars.resize(s.size() / 4 * 3 + 16);
+    const char *input(s.data());
+    const char * const input_end(input + s.size());
+    char *output(&decoded_chars[0]);
+
+#if defined(__SSSE3__)
+    const __m128i wide_symbol63(_mm_set1_epi8(symbol63)), wide_symbol64(_mm_set1_epi8(symbol64));
+#endif
+
+    unsigned buf(0), bit_count(0);
+    for (/* Intentionally empty! */; input != input_end; ++input) {
+#if defined(__SSSE3__)
+        // Between groups of 4 symbols, e.g. after a line break, we try to switch back to decoding whole blocks:
+        if (bit_count == 0) {
+            while (input_end - input >= 16 and Base64DecodeBlock(input, output, wide_symbol63, wide_symbol64))
+                input += 16, output += 12;
+            if (input == input_end)
+                break;
+        }
+#endif
+        const signed char bits(char_to_bits_map[static_cast<unsigned char>(*input)]);
+        if (unlikely(bits < 0)) {
+            if (*input == '=')
+                break;
+            if (*input == ' ' or *input == '\t' or *input == '\r' or *input == '\n')
+                continue;
+            throw std::runtime_error("TextUtil::Base64Decode: invalid character '" + std::string(1, *input) + "'!");
+        }
+
+        buf = (buf << 6u) | static_cast<unsigned>(bits);
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            *output++ = static_cast<char>(buf >> bit_count);
+            buf &= (1u << bit_count) - 1;
         }
     }
 
+    decoded_chars.resize(output - decoded_chars.data());
     return decoded_chars;
 }
 
@@ -1072,25 +1450,59 @@ bool UTF8ToUTF32Decoder::addByte(const char ch) {
 }
 
 
+namespace {
+
+
+// \return A pointer to the first character in [start, end) that can't be used literally in quoted-printable text, or "end".
+inline const char *FindFirstCharacterThatNeedsQuoting(const char *start, const char * const end) {
+#if defined(__SSE2__)
+    // Printable ASCII characters are 33 to 126.  Tabs and spaces are fine, too, but the equal sign needs to be quoted.
+    while (end - start >= 16) {
+        const __m128i block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(start)));
+        const __m128i is_printable(_mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(32)), _mm_cmpgt_epi8(_mm_set1_epi8(127), block)));
+        const __m128i is_literal(_mm_andnot_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('=')),
+                                                  _mm_or_si128(is_printable, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                                                                                          _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))))));
+        const unsigned mask(static_cast<unsigned>(_mm_movemask_epi8(is_literal)) ^ 0xFFFFu);
+        if (mask != 0)
+            return start + __builtin_ctz(mask);
+        start += 16;
+    }
+#endif
+    for (/* Intentionally empty! */; start < end; ++start) {
+        const unsigned char uch(static_cast<unsigned char>(*start));
+        if (not ((uch >= 33 and uch <= 126) or uch == 9 or uch == 32) or uch == '=')
+            return start;
+    }
+
+    return end;
+}
+
+
+} // unnamed namespace
+
+
 // In order to understand this implementation, it may help to read https://en.wikipedia.org/wiki/Quoted-printable
 std::string EncodeQuotedPrintable(const std::string &s) {
     if (unlikely(s.empty()))
         return s;
 
     std::string encoded_string;
+    encoded_string.reserve(s.size() + s.size() / 8);
+
+    const char *start(s.data());
+    const char * const end(start + s.size());
+    while (start != end) {
+        const char * const special(FindFirstCharacterThatNeedsQuoting(start, end));
+        encoded_string.append(start, special);
+        if (special == end)
+            break;
 
-    for (const char ch : s) {
-        const unsigned char uch(static_cast<unsigned char>(ch));
-        if ((uch >= 33 and uch <= 126) or uch == 9 or uch == 32) {
-            if (unlikely(ch == '='))
-                encoded_string += "=3D";
-            else
-                encoded_string += ch;
-        } else {
-            encoded_string += '=';
-            encoded_string += StringUtil::ToHex(uch >> 4u);
-            encoded_string += StringUtil::ToHex(uch & 0xFu);
-        }
+        const unsigned char uch(static_cast<unsigned char>(*special));
+        encoded_string += '=';
+        encoded_string += StringUtil::ToHex(uch >> 4u);
+        encoded_string += StringUtil::ToHex(uch & 0xFu);
+        start = special + 1;
     }
 
     // Tab and space at the end of the string must be encoded:
@@ -1106,37 +1518,41 @@ std::string EncodeQuotedPrintable(const std::string &s) {
 }
 
 
-static char HEX_CHARS[] = "0123456789ABCDEF";
+static inline int UppercaseHexDigitToNibble(const char ch) {
+    if (ch >= '0' and ch <= '9')
+        return ch - '0';
+    if (ch >= 'A' and ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
 
 
 // In order to understand this implementation, it may help to read https://en.wikipedia.org/wiki/Quoted-printable
 std::string DecodeQuotedPrintable(const std::string &s) {
     std::string decoded_string;
+    decoded_string.reserve(s.size());
+
+    const char *start(s.data());
+    const char * const end(start + s.size());
+    while (start != end) {
+        const char * const equal_sign(ScanUtil::FindChar(start, end, '='));
+        decoded_string.append(start, equal_sign);
+        if (equal_sign == end)
+            break;
 
-    for (auto ch(s.cbegin()); ch != s.cend(); ++ch) {
-        if (unlikely(*ch == '=')) {
-            // First nibble:
-            ++ch;
-            if (unlikely(ch == s.cend()))
-                throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (1)");
-            char *cp(std::strchr(HEX_CHARS, *ch));
-            if (unlikely(cp == nullptr))
-                throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (2)");
-            unsigned char uch(cp - HEX_CHARS);
-            uch <<= 4u;
-
-            // Second nibble:
-            ++ch;
-            if (unlikely(ch == s.cend()))
-                throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (3)");
-            cp = std::strchr(HEX_CHARS, *ch);
-            if (unlikely(cp == nullptr))
-                throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (4)");
-            uch |= cp - HEX_CHARS;
-
-            decoded_string += static_cast<char>(uch);
-        } else
-            decoded_string += *ch;
+        if (unlikely(end - equal_sign < 2))
+            throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (1)");
+        const int high_nibble(UppercaseHexDigitToNibble(equal_sign[1]));
+        if (unlikely(high_nibble < 0))
+            throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (2)");
+        if (unlikely(end - equal_sign < 3))
+            throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (3)");
+        const int low_nibble(UppercaseHexDigitToNibble(equal_sign[2]));
+        if (unlikely(low_nibble < 0))
+            throw std::runtime_error("TextUtil::DecodeQuotedPrintable: bad character sequence! (4)");
+
+        decoded_string += static_cast<char>((high_nibble << 4u) | low_nibble);
+        start = equal_sign + 3;
     }
 
     return decoded_string;
@@ -0,0 +1,230 @@
+/** \brief Implementation of the ThreadPool class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include "Compiler.h"
+#include "util.h"
+
+
+namespace {
+
+
+// Identifies the pool, if any, that the current thread is a worker of and the worker's index in that pool.
+thread_local const ThreadPool *current_pool(nullptr);
+thread_local size_t current_worker_index;
+
+
+std::vector<int> GetUsableCPUs() {
+    std::vector<int> cpus;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (unlikely(::sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0)) {
+        LOG_WARNING("sched_getaffinity(2) failed: " + std::string(std::strerror(errno)));
+        return cpus;
+    }
+
+    for (int cpu(0); cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpu_set))
+            cpus.emplace_back(cpu);
+    }
+
+    return cpus;
+}
+
+
+} // unnamed namespace
+
+
+ThreadPool::ThreadPool(const unsigned thread_count, const bool pin_threads_to_cpus)
+    : queued_task_count_(0), next_worker_index_(0), cancelled_(false), stopping_(false)
+{
+    const unsigned worker_count(thread_count != 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency()));
+    const std::vector<int> cpus(pin_threads_to_cpus ? GetUsableCPUs() : std::vector<int>());
+
+    // All deques have to exist before the first worker starts stealing.
+    for (unsigned worker_index(0); worker_index < worker_count; ++worker_index)
+        workers_.emplace_back(new Worker);
+    for (unsigned worker_index(0); worker_index < worker_count; ++worker_index)
+        workers_[worker_index]->thread_ = std::thread(&ThreadPool::workerLoop, this, worker_index,
+                                                      cpus.empty() ? -1 : cpus[worker_index % cpus.size()]);
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> sleep_mutex_locker(sleep_mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+
+    for (auto &worker : workers_)
+        worker->thread_.join();
+}
+
+
+void ThreadPool::cancel() {
+    cancelled_ = true;
+}
+
+
+void ThreadPool::enqueue(Task &&task) {
+    const size_t worker_index(current_pool == this ? current_worker_index : next_worker_index_++ % workers_.size());
+    {
+        std::lock_guard<std::mutex> worker_mutex_locker(workers_[worker_index]->mutex_);
+        workers_[worker_index]->tasks_.emplace_back(std::move(task));
+    }
+
+    // Incrementing the count before taking "sleep_mutex_" guarantees that a worker that is about to go to sleep either
+    // sees the new count or gets our notification.
+    ++queued_task_count_;
+    std::lock_guard<std::mutex> sleep_mutex_locker(sleep_mutex_);
+    work_available_.notify_one();
+}
+
+
+bool ThreadPool::runPendingTask(const size_t worker_index) {
+    if (queued_task_count_ == 0)
+        return false;
+
+    Task task;
+    if (worker_index < workers_.size()) {
+        Worker &own_worker(*workers_[worker_index]);
+        std::lock_guard<std::mutex> worker_mutex_locker(own_worker.mutex_);
+        if (not own_worker.tasks_.empty()) {
+            task = std::move(own_worker.tasks_.back());
+            own_worker.tasks_.pop_back();
+        }
+    }
+
+    // Steal from the other workers, starting w/ our right neighbour so that thieves spread out:
+    for (size_t offset(1); not task and offset <= workers_.size(); ++offset) {
+        Worker &victim(*workers_[(worker_index + offset) % workers_.size()]);
+        std::lock_guard<std::mutex> worker_mutex_locker(victim.mutex_);
+        if (not victim.tasks_.empty()) {
+            task = std::move(victim.tasks_.front());
+            victim.tasks_.pop_front();
+        }
+    }
+
+    if (not task)
+        return false;
+
+    --queued_task_count_;
+    if (not isCancelled())
+        task();
+
+    return true;
+}
+
+
+void ThreadPool::workerLoop(const size_t worker_index, const int cpu) {
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    if (cpu != -1) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        const int error_code(::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set));
+        if (unlikely(error_code != 0))
+            LOG_WARNING("failed to pin worker " + std::to_string(worker_index) + " to CPU " + std::to_string(cpu) + ": "
+                        + std::string(std::strerror(error_code)));
+    }
+
+    for (;;) {
+        if (runPendingTask(worker_index))
+            continue;
+
+        std::unique_lock<std::mutex> sleep_mutex_locker(sleep_mutex_);
+        if (stopping_ and queued_task_count_ == 0)
+            return;
+        work_available_.wait(sleep_mutex_locker, [this]{ return stopping_ or queued_task_count_ > 0; });
+    }
+}
+
+
+void ThreadPool::parallelForChunks(const size_t begin, const size_t end, const std::function<void(size_t, size_t)> &chunk_body,
+                                   size_t chunk_size)
+{
+    if (begin >= end)
+        return;
+
+    const size_t index_count(end - begin);
+    if (chunk_size == 0)
+        chunk_size = std::max<size_t>(1, index_count / (8 * workers_.size()));
+    const size_t chunk_count((index_count + chunk_size - 1) / chunk_size);
+
+    std::atomic<size_t> remaining_chunk_count(chunk_count);
+    std::atomic<bool> failed(false);
+    std::exception_ptr first_exception;
+    std::mutex completion_mutex;
+    std::condition_variable all_chunks_completed;
+
+    for (size_t chunk_begin(begin); chunk_begin < end; chunk_begin += chunk_size) {
+        const size_t chunk_end(std::min(chunk_begin + chunk_size, end));
+
+        // Discarded chunks, e.g. after a cancellation, still have to be counted, hence the RAII helper:
+        class ChunkCompletion {
+            std::atomic<size_t> &remaining_chunk_count_;
+            std::mutex &completion_mutex_;
+            std::condition_variable &all_chunks_completed_;
+        public:
+            ChunkCompletion(std::atomic<size_t> * const remaining_chunk_count, std::mutex * const completion_mutex,
+                            std::condition_variable * const all_chunks_completed)
+                : remaining_chunk_count_(*remaining_chunk_count), completion_mutex_(*completion_mutex),
+                  all_chunks_completed_(*all_chunks_completed) { }
+            ~ChunkCompletion() {
+                // We have to hold the mutex while decrementing as the waiter's stack frame, and thus the mutex and the
+                // condition variable, may vanish as soon as it sees a zero count.
+                std::lock_guard<std::mutex> completion_mutex_locker(completion_mutex_);
+                if (--remaining_chunk_count_ == 0)
+                    all_chunks_completed_.notify_all();
+            }
+        };
+        const auto completion(std::make_shared<ChunkCompletion>(&remaining_chunk_count, &completion_mutex, &all_chunks_completed));
+
+        enqueue([&, chunk_begin, chunk_end, completion]{
+            if (failed or isCancelled())
+                return;
+            try {
+                chunk_body(chunk_begin, chunk_end);
+            } catch (...) {
+                std::lock_guard<std::mutex> completion_mutex_locker(completion_mutex);
+                if (not failed.exchange(true))
+                    first_exception = std::current_exception();
+            }
+        });
+    }
+
+    // Help out until there is nothing left to steal, then wait for the chunks that are still running elsewhere:
+    const size_t our_worker_index(current_pool == this ? current_worker_index : workers_.size());
+    while (remaining_chunk_count > 0 and runPendingTask(our_worker_index))
+        /* Intentionally empty! */;
+    {
+        std::unique_lock<std::mutex> completion_mutex_locker(completion_mutex);
+        all_chunks_completed.wait(completion_mutex_locker, [&remaining_chunk_count]{ return remaining_chunk_count == 0; });
+    }
+
+    if (first_exception)
+        std::rethrow_exception(first_exception);
+}
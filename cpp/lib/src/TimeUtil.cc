@@ -156,27 +156,180 @@ std::string TimeTToString(const time_t &the_time, const std::string &format, con
 }
 
 
+// Returns the number of days since 1970-01-01 in the proleptic Gregorian calendar.
+// (See http://howardhinnant.github.io/date_algorithms.html#days_from_civil)
+static long long DaysFromCivil(long long year, const unsigned month, const unsigned day) {
+    year -= month <= 2;
+    const long long era((year >= 0 ? year : year - 399) / 400);
+    const unsigned year_of_era(static_cast<unsigned>(year - era * 400));
+    const unsigned day_of_year((153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1);
+    const unsigned day_of_era(year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year);
+    return era * 146097 + static_cast<long long>(day_of_era) - 719468;
+}
+
+
+// Unlike mktime(3) this never consults the time zone data, which makes it cheap and thread-safe.
 time_t TimeGm(const struct tm &tm) {
-    const char * const saved_time_zone(::getenv("TZ"));
+    // Normalise the month the same way mktime(3) does.  All other fields can simply be added up.
+    long long year(1900LL + tm.tm_year + tm.tm_mon / 12);
+    int month(tm.tm_mon % 12);
+    if (month < 0) {
+        month += 12;
+        --year;
+    }
 
-    // Set the time zone to UTC:
-    ::setenv("TZ", "UTC", /* overwrite = */true);
-    ::tzset();
+    const long long days(DaysFromCivil(year, static_cast<unsigned>(month) + 1, 1) + tm.tm_mday - 1);
+    return static_cast<time_t>(days * 86400LL + tm.tm_hour * 3600LL + tm.tm_min * 60LL + tm.tm_sec);
+}
 
-    struct tm temp_tm(tm);
-    errno = 0;
-    time_t ret_val(::mktime(&temp_tm));
-    if (unlikely(errno != 0))
-        ret_val = BAD_TIME_T;
 
-    // Restore the original time zone:
-    if (saved_time_zone != nullptr)
-        ::setenv("TZ", saved_time_zone, 1);
-    else
-        ::unsetenv("TZ");
-    ::tzset();
+// Sets tm_wday and tm_yday based on tm_year, tm_mon and tm_mday like strptime(3) does.
+static void SetDayOfTheWeekAndYear(struct tm * const tm) {
+    const long long year(1900LL + tm->tm_year);
+    const long long days(DaysFromCivil(year, static_cast<unsigned>(tm->tm_mon) + 1, 1) + tm->tm_mday - 1);
+    tm->tm_wday = static_cast<int>(((days + 4) % 7 + 7) % 7); // 1970-01-01 was a Thursday.
+    tm->tm_yday = static_cast<int>(days - DaysFromCivil(year, 1, 1));
+}
 
-    return ret_val;
+
+// Parses exactly "width" decimal digits.
+static inline bool ParseFixedWidthNumber(const char *cp, const unsigned width, unsigned * const number) {
+    *number = 0;
+    for (const char * const end(cp + width); cp != end; ++cp) {
+        if (unlikely(not StringUtil::IsDigit(*cp)))
+            return false;
+        *number = *number * 10 + (*cp - '0');
+    }
+
+    return true;
+}
+
+
+// Behaves exactly like the get_number() macro in glibc's strptime(3): skips leading whitespace and then reads at most
+// "max_width" digits, stopping early if another digit would exceed "max".
+static bool GetNumber(const char **cp, const unsigned min, const unsigned max, unsigned max_width, unsigned * const number) {
+    while (isspace(**cp))
+        ++*cp;
+    if (not StringUtil::IsDigit(**cp))
+        return false;
+
+    *number = 0;
+    do
+        *number = *number * 10 + (*(*cp)++ - '0');
+    while (--max_width > 0 and *number * 10 <= max and StringUtil::IsDigit(**cp));
+
+    return *number >= min and *number <= max;
+}
+
+
+enum FastParseResult { FAST_PARSE_MATCHED, FAST_PARSE_FAILED, FAST_PARSE_UNSUPPORTED };
+
+
+// Handles formats that only contain the numeric conversions %Y, %y, %m, %d, %e, %H, %M, %S, %T, %F and %% w/o going
+// through strptime(3) and the locale machinery.  The results are identical to those of glibc's strptime(3).
+// "*tm" must have been zeroed by the caller.
+static FastParseResult FastParse(const char **cp, const char *format, struct tm * const tm, bool * const want_xday) {
+    unsigned number;
+    for (/* Intentionally empty! */; *format != '\0'; ++format) {
+        if (isspace(*format)) {
+            while (isspace(**cp))
+                ++*cp;
+            continue;
+        }
+
+        if (*format != '%') {
+            if (**cp != *format)
+                return FAST_PARSE_FAILED;
+            ++*cp;
+            continue;
+        }
+
+        FastParseResult result;
+        switch (*++format) {
+        case '%':
+            if (**cp != '%')
+                return FAST_PARSE_FAILED;
+            ++*cp;
+            break;
+        case 'Y':
+            if (not GetNumber(cp, 0, 9999, 4, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_year = static_cast<int>(number) - 1900;
+            *want_xday = true;
+            break;
+        case 'y':
+            if (not GetNumber(cp, 0, 99, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_year = (number >= 69) ? number : number + 100;
+            *want_xday = true;
+            break;
+        case 'm':
+            if (not GetNumber(cp, 1, 12, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_mon = static_cast<int>(number) - 1;
+            *want_xday = true;
+            break;
+        case 'd':
+        case 'e':
+            if (not GetNumber(cp, 1, 31, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_mday = static_cast<int>(number);
+            *want_xday = true;
+            break;
+        case 'H':
+            if (not GetNumber(cp, 0, 23, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_hour = static_cast<int>(number);
+            break;
+        case 'M':
+            if (not GetNumber(cp, 0, 59, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_min = static_cast<int>(number);
+            break;
+        case 'S':
+            if (not GetNumber(cp, 0, 61, 2, &number))
+                return FAST_PARSE_FAILED;
+            tm->tm_sec = static_cast<int>(number);
+            break;
+        case 'T':
+            if ((result = FastParse(cp, "%H:%M:%S", tm, want_xday)) != FAST_PARSE_MATCHED)
+                return result;
+            break;
+        case 'F':
+            if ((result = FastParse(cp, "%Y-%m-%d", tm, want_xday)) != FAST_PARSE_MATCHED)
+                return result;
+            break;
+        default:
+            return FAST_PARSE_UNSUPPORTED;
+        }
+    }
+
+    return FAST_PARSE_MATCHED;
+}
+
+
+// Parses "date_str" according to "format" which must consume all of "date_str".  Falls back to strptime(3) for the
+// formats that FastParse() can't handle.
+static bool ParseDateAndTime(const std::string &date_str, const std::string &format, struct tm * const tm) {
+    std::memset(tm, 0, sizeof(*tm));
+    const char *cp(date_str.c_str());
+    bool want_xday(false);
+    switch (FastParse(&cp, format.c_str(), tm, &want_xday)) {
+    case FAST_PARSE_MATCHED:
+        if (*cp != '\0')
+            return false;
+        if (want_xday)
+            SetDayOfTheWeekAndYear(tm);
+        return true;
+    case FAST_PARSE_FAILED:
+        return false;
+    case FAST_PARSE_UNSUPPORTED:
+        break;
+    }
+
+    std::memset(tm, 0, sizeof(*tm));
+    const char * const last_char(::strptime(date_str.c_str(), format.c_str(), tm));
+    return last_char != nullptr and *last_char == '\0';
 }
 
 
@@ -290,7 +443,8 @@ static bool StringToStructTmHelper(std::string date_str, std::string optional_st
             optional_strptime_format = optional_strptime_format.substr(closing_paren_pos + 1);
         }
 
-        NormalizeTimeZoneOffset(&date_str);
+        if (optional_strptime_format.find("%z") != std::string::npos)
+            NormalizeTimeZoneOffset(&date_str);
 
         std::unordered_set<std::string> format_string_splits;
         // try available format strings until a matching one is found
@@ -299,9 +453,7 @@ static bool StringToStructTmHelper(std::string date_str, std::string optional_st
                 std::string time_zone_name;
                 ExtractOptionalTimeZoneName(&date_str, &format_string, &time_zone_name);
 
-                std::memset(tm, 0, sizeof(*tm));
-                const char * const last_char(::strptime(date_str.c_str(), format_string.c_str(), tm));
-                if (last_char == nullptr or *last_char != '\0')
+                if (not ParseDateAndTime(date_str, format_string, tm))
                     unix_time = TimeUtil::BAD_TIME_T;
                 else {
                     if (not time_zone_name.empty())
@@ -346,23 +498,50 @@ unsigned StringToBrokenDownTime(const std::string &possible_date, unsigned * con
                                 bool * const is_definitely_zulu_time)
 {
     *hour_offset = *minute_offset = 0;
-    char plus_or_minus[1 + 1];
-    char space_or_t[1 + 1];
 
-    // First check for a simple time and date (can be local or UTC):
-    if (possible_date.length() == 19
-        and std::sscanf(possible_date.c_str(), "%4u-%2u-%2u%[T ]%2u:%2u:%2u",
-                        year, month, day, space_or_t, hour, minute, second) == 7)
-    {
+    // All supported formats start w/ "YYYY-MM-DD":
+    const char * const cp(possible_date.c_str());
+    if (possible_date.length() < 10 or not ParseFixedWidthNumber(cp, 4, year) or cp[4] != '-'
+        or not ParseFixedWidthNumber(cp + 5, 2, month) or cp[7] != '-' or not ParseFixedWidthNumber(cp + 8, 2, day))
+        return 0;
+
+    // Check a simple date:
+    if (possible_date.length() == 10) {
+        *hour = *minute = *second = 0;
+        *is_definitely_zulu_time = false;
+        return 3;
+    }
+
+    // All other formats continue w/ "THH:MM:SS" or " HH:MM:SS":
+    if (possible_date.length() < 19 or (cp[10] != 'T' and cp[10] != ' ') or not ParseFixedWidthNumber(cp + 11, 2, hour)
+        or cp[13] != ':' or not ParseFixedWidthNumber(cp + 14, 2, minute) or cp[16] != ':'
+        or not ParseFixedWidthNumber(cp + 17, 2, second))
+        return 0;
+
+    // A simple time and date (can be local or UTC):
+    if (possible_date.length() == 19) {
         *is_definitely_zulu_time = false;
         return 7;
     }
-    // Check for ISO 8601 w/ offset:
-    else if (possible_date.length() == 25
-             and std::sscanf(possible_date.c_str(), "%4u-%2u-%2uT%2u:%2u:%2u%[+-]%2d:%2d",
-                             year, month, day, hour, minute, second, plus_or_minus, hour_offset, minute_offset) == 9)
+
+    if (cp[10] != 'T')
+        return 0;
+
+    // Zulu time format (must be UTC):
+    if (possible_date.length() == 20 and cp[19] == 'Z') {
+        *is_definitely_zulu_time = true;
+        return 6;
+    }
+
+    // ISO 8601 w/ offset:
+    unsigned unsigned_hour_offset, unsigned_minute_offset;
+    if (possible_date.length() == 25 and (cp[19] == '+' or cp[19] == '-')
+        and ParseFixedWidthNumber(cp + 20, 2, &unsigned_hour_offset) and cp[22] == ':'
+        and ParseFixedWidthNumber(cp + 23, 2, &unsigned_minute_offset))
     {
-        if (plus_or_minus[0] == '-') {
+        *hour_offset   = static_cast<int>(unsigned_hour_offset);
+        *minute_offset = static_cast<int>(unsigned_minute_offset);
+        if (cp[19] == '-') {
             *hour_offset   = -*hour_offset;
             *minute_offset = -*minute_offset;
         }
@@ -370,23 +549,8 @@ unsigned StringToBrokenDownTime(const std::string &possible_date, unsigned * con
         *is_definitely_zulu_time = true;
         return 9;
     }
-    // Check for Zulu time format (must be UTC)
-    else if (possible_date.length() == 20
-             and std::sscanf(possible_date.c_str(), "%4u-%2u-%2uT%2u:%2u:%2uZ",
-                             year, month, day, hour, minute, second) == 6)
-    {
-        *is_definitely_zulu_time = true;
-        return 6;
-    }
-    // Next check a simple date
-    else if (possible_date.length() == 10
-             and std::sscanf(possible_date.c_str(), "%4u-%2u-%2u", year, month, day) == 3)
-    {
-        *hour = *minute = *second = 0;
-        *is_definitely_zulu_time = false;
-        return 3;
-    } else
-        return 0;
+
+    return 0;
 }
 
 
@@ -736,69 +900,107 @@ static bool ZoneAdjustment(const std::string &rfc822_zone, time_t * const adjust
 }
 
 
-// In order to understand this insanity, have a look at section 5.1 of RFC822.  Please note that we also support 4-digit
-// years as specified by RFC1123.
-bool ParseRFC1123DateTime(const std::string &date_time_candidate, time_t * const date_time) {
-    const auto first_comma_pos(date_time_candidate.find(','));
-    const std::string::size_type start_pos(first_comma_pos == std::string::npos ? 0 : first_comma_pos + 1);
-    std::string simplified_candidate(StringUtil::TrimWhite(date_time_candidate.substr(start_pos)));
+// Matches the abbreviated English month names case-insensitively, like strptime(3)'s %b in the C locale.
+static bool ParseMonthAbbreviation(const char * const cp, int * const month) {
+    static const char * const MONTH_ABBREVIATIONS[12] = {
+        "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+    };
 
-    static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory(
-        "^(\\d{1,2}) (...) (\\d{2}|\\d{4}) (\\d{2}:\\d{2}(:\\d{2})?)"));
-    if (not matcher->matched(simplified_candidate)) {
-        *date_time = BAD_TIME_T;
-        return false;
+    const char lowercase_abbreviation[3] = {
+        static_cast<char>(tolower(cp[0])), static_cast<char>(tolower(cp[1])), static_cast<char>(tolower(cp[2]))
+    };
+    for (int month_no(0); month_no < 12; ++month_no) {
+        if (std::memcmp(lowercase_abbreviation, MONTH_ABBREVIATIONS[month_no], 3) == 0) {
+            *month = month_no;
+            return true;
+        }
     }
 
-    const bool double_digit_year((*matcher)[3].length() == 2);
-    const bool has_seconds((*matcher)[4].length() == 8);
-
-    std::string format(double_digit_year ? "%d %b %y %H:%M" : "%d %b %Y %H:%M");
-    if (has_seconds)
-        format += ":%S";
-
-    static RegexMatcher * const local_differential_matcher(RegexMatcher::RegexMatcherFactory("[+-]?\\d{4}$"));
-    time_t local_differential_offset(0);
-    if (local_differential_matcher->matched(simplified_candidate)) {
-        std::string local_differential_time((*local_differential_matcher)[0]);
-
-        // Trim the local differential time offset off the end of our date and time string:
-        auto cp(simplified_candidate.begin() + simplified_candidate.length() - local_differential_time.length() - 1);
-        while (*cp == ' ')
-            --cp;
-        simplified_candidate.resize(cp - simplified_candidate.begin() + 1);
-
-        bool is_negative(false);
-        if (local_differential_time[0] == '+')
-            local_differential_time = local_differential_time.substr(1);
-        else if (local_differential_time[0] == '-') {
-            is_negative = true;
-            local_differential_time = local_differential_time.substr(1);
-        }
+    return false;
+}
 
-        local_differential_offset = (local_differential_time[0] - '0') * 600 + (local_differential_time[1] - '0') * 60
-                                    + (local_differential_time[2] - '0') * 10 + (local_differential_time[3] - '0');
-        local_differential_offset *= 60; // convert minutes to seconds
 
-        if (is_negative)
-            local_differential_offset = -local_differential_offset;
-    } else {
-        const auto last_space_pos(simplified_candidate.rfind(' '));
-        if (unlikely(last_space_pos == std::string::npos
-                     or not ZoneAdjustment(simplified_candidate.substr(last_space_pos + 1), &local_differential_offset)))
+// Parses "HH:MM" and "HH:MM:SS".  On success "*cp" will point past the parsed time.
+static bool ParseTimeOfDay(const char **cp, const char * const end, struct tm * const tm) {
+    unsigned hour, minute, second(0);
+    if (end - *cp < 5 or not ParseFixedWidthNumber(*cp, 2, &hour) or (*cp)[2] != ':'
+        or not ParseFixedWidthNumber(*cp + 3, 2, &minute) or hour > 23 or minute > 59)
+        return false;
+    *cp += 5;
+
+    if (end - *cp >= 3 and **cp == ':' and StringUtil::IsDigit((*cp)[1]) and StringUtil::IsDigit((*cp)[2])) {
+        ParseFixedWidthNumber(*cp + 1, 2, &second);
+        if (second > 61)
             return false;
-        simplified_candidate.resize(last_space_pos);
+        *cp += 3;
     }
 
+    tm->tm_hour = static_cast<int>(hour);
+    tm->tm_min  = static_cast<int>(minute);
+    tm->tm_sec  = static_cast<int>(second);
+    return true;
+}
+
+
+// In order to understand this insanity, have a look at section 5.1 of RFC822.  Please note that we also support 4-digit
+// years as specified by RFC1123.
+bool ParseRFC1123DateTime(const std::string &date_time_candidate, time_t * const date_time) {
+    *date_time = BAD_TIME_T;
+
+    // Skip over the optional day of the week and trim the remainder:
+    const auto first_comma_pos(date_time_candidate.find(','));
+    const char *cp(date_time_candidate.c_str() + (first_comma_pos == std::string::npos ? 0 : first_comma_pos + 1));
+    const char *end(date_time_candidate.c_str() + date_time_candidate.length());
+    while (cp != end and isspace(*cp))
+        ++cp;
+    while (end != cp and isspace(end[-1]))
+        --end;
+
     struct tm tm;
     std::memset(&tm, 0, sizeof tm);
-    const char * const first_not_processed(::strptime(simplified_candidate.c_str(), format.c_str(), &tm));
-    if (first_not_processed == nullptr or *first_not_processed != '\0') {
-        *date_time = BAD_TIME_T;
+
+    // The day of the month has one or two digits:
+    if (cp == end or not StringUtil::IsDigit(*cp))
+        return false;
+    tm.tm_mday = *cp++ - '0';
+    if (cp != end and StringUtil::IsDigit(*cp))
+        tm.tm_mday = tm.tm_mday * 10 + (*cp++ - '0');
+    if (tm.tm_mday < 1 or tm.tm_mday > 31)
+        return false;
+
+    if (end - cp < 5 or *cp != ' ' or not ParseMonthAbbreviation(cp + 1, &tm.tm_mon) or cp[4] != ' ')
+        return false;
+    cp += 5;
+
+    // Two-digit years are interpreted like strptime(3) does, i.e. 69-99 are 1969-1999 and 00-68 are 2000-2068:
+    unsigned year;
+    if (end - cp >= 5 and ParseFixedWidthNumber(cp, 4, &year) and cp[4] == ' ') {
+        tm.tm_year = static_cast<int>(year) - 1900;
+        cp += 5;
+    } else if (end - cp >= 3 and ParseFixedWidthNumber(cp, 2, &year) and cp[2] == ' ') {
+        tm.tm_year = (year >= 69) ? year : year + 100;
+        cp += 3;
+    } else
+        return false;
+
+    if (not ParseTimeOfDay(&cp, end, &tm))
+        return false;
+
+    // What remains is the zone, either a local differential, e.g. "+0200" or "-0130", or a symbolic name after a single space:
+    time_t local_differential_offset;
+    const char *zone(cp);
+    while (zone != end and *zone == ' ')
+        ++zone;
+    const size_t zone_length(end - zone);
+    const char * const differential_digits(zone_length == 5 and (*zone == '+' or *zone == '-') ? zone + 1 : zone);
+    unsigned local_differential_time;
+    if ((zone_length == 4 or differential_digits != zone) and ParseFixedWidthNumber(differential_digits, 4, &local_differential_time)) {
+        local_differential_offset = (local_differential_time / 100 * 60 + local_differential_time % 100) * 60;
+        if (*zone == '-')
+            local_differential_offset = -local_differential_offset;
+    } else if (zone != cp + 1 or not ZoneAdjustment(std::string(zone, zone_length), &local_differential_offset))
         return false;
-    }
 
-    tm.tm_gmtoff = 0;
     *date_time = TimeGm(tm) + local_differential_offset;
 
     return true;
@@ -806,41 +1008,49 @@ bool ParseRFC1123DateTime(const std::string &date_time_candidate, time_t * const
 
 
 bool ParseRFC3339DateTime(const std::string &date_time_candidate, time_t * const date_time) {
-    // Convert possible lowercase t and z to uppercase:
-    const std::string normalised_date_time_candidate(StringUtil::ToUpper(date_time_candidate));
+    *date_time = BAD_TIME_T;
+
+    // We expect "YYYY-MM-DDTHH:MM:SS" where the "T" may also be lowercase:
+    const char *cp(date_time_candidate.c_str());
+    unsigned year, month, day, hour, minute, second;
+    if (date_time_candidate.length() < 20 or not ParseFixedWidthNumber(cp, 4, &year) or cp[4] != '-'
+        or not ParseFixedWidthNumber(cp + 5, 2, &month) or cp[7] != '-' or not ParseFixedWidthNumber(cp + 8, 2, &day)
+        or (cp[10] != 'T' and cp[10] != 't') or not ParseFixedWidthNumber(cp + 11, 2, &hour) or cp[13] != ':'
+        or not ParseFixedWidthNumber(cp + 14, 2, &minute) or cp[16] != ':' or not ParseFixedWidthNumber(cp + 17, 2, &second)
+        or month < 1 or month > 12 or day < 1 or day > 31 or hour > 23 or minute > 59 or second > 61)
+        return false;
+    cp += 19;
 
     struct tm tm;
     std::memset(&tm, '\0', sizeof tm);
+    tm.tm_year = static_cast<int>(year) - 1900;
+    tm.tm_mon  = static_cast<int>(month) - 1;
+    tm.tm_mday = static_cast<int>(day);
+    tm.tm_hour = static_cast<int>(hour);
+    tm.tm_min  = static_cast<int>(minute);
+    tm.tm_sec  = static_cast<int>(second);
+
     time_t rounded_second_offset;
-    const char *cp(::strptime(normalised_date_time_candidate.c_str(), "%Y-%m-%dT%H:%M:%S", &tm));
-    if (cp == nullptr) {
-        *date_time = BAD_TIME_T;
-        return false;
-    }
     if (*cp != '.')
         rounded_second_offset = 0;
     else { // Handle optional single-digit fractional second.
         ++cp;
-        if (not StringUtil::IsDigit(*cp)) {
-            *date_time = BAD_TIME_T;
+        if (not StringUtil::IsDigit(*cp))
             return false;
-        }
         rounded_second_offset = (*cp >= '5') ? 1 : 0;
         while (StringUtil::IsDigit(*cp))
             ++cp;
     }
 
     // If the input format is correct cp now either points to the final Z or the sign of the optional time offset.
-    if (*cp == 'Z') {
+    if (*cp == 'Z' or *cp == 'z') {
         *date_time = TimeGm(tm) + rounded_second_offset;
         return true;
     } else if (*cp == '+' or *cp == '-') {
         *date_time = TimeGm(tm) + rounded_second_offset;
         return AdjustForTimeOffset(date_time, cp);
-    } else {
-        *date_time = BAD_TIME_T;
+    } else
         return false;
-    }
 }
 
 
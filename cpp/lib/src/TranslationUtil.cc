@@ -18,8 +18,12 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "TranslationUtil.h"
+#include <algorithm>
 #include <map>
+#include <tuple>
 #include "Compiler.h"
+#include "DbResultSet.h"
+#include "DbRow.h"
 #include "File.h"
 #include "StringUtil.h"
 #include "util.h"
@@ -53,6 +57,150 @@ std::string GetId(DbConnection * const connection, const std::string &german_tex
     }
 }
 
+// Keeps the size of the generated queries reasonable.
+static const size_t MAX_KEYS_PER_QUERY(1000);
+
+
+void TranslationCache::prefetch(const std::set<std::string> &keys) {
+    std::vector<std::string> missing_keys;
+    for (const auto &key : keys) {
+        if (key_to_languages_and_translations_.find(key) == key_to_languages_and_translations_.end()) {
+            // Also ensures that we remember keys for which there are no translations at all:
+            key_to_languages_and_translations_[key];
+            missing_keys.emplace_back(db_connection_->escapeAndQuoteString(key));
+        }
+    }
+
+    for (size_t batch_start(0); batch_start < missing_keys.size(); batch_start += MAX_KEYS_PER_QUERY) {
+        const auto batch_end(missing_keys.begin() + std::min(batch_start + MAX_KEYS_PER_QUERY, missing_keys.size()));
+        db_connection_->queryOrDie("SELECT " + key_column_ + ",language_code,translation FROM " + table_name_ + " WHERE "
+                                   + key_column_ + " IN (" + StringUtil::Join(missing_keys.begin() + batch_start, batch_end, ",")
+                                   + ")" + (condition_.empty() ? "" : " AND (" + condition_ + ")"));
+        DbResultSet result_set(db_connection_->getLastResultSet());
+        while (const DbRow row = result_set.getNextRow())
+            key_to_languages_and_translations_[row[key_column_]].emplace_back(row["language_code"], row["translation"]);
+    }
+}
+
+
+const std::vector<std::pair<LanguageCode, std::string>> &TranslationCache::getEntries(const std::string &key) {
+    auto key_and_entries(key_to_languages_and_translations_.find(key));
+    if (key_and_entries == key_to_languages_and_translations_.end()) {
+        prefetch({ key });
+        key_and_entries = key_to_languages_and_translations_.find(key);
+    }
+
+    return key_and_entries->second;
+}
+
+
+std::vector<std::string> TranslationCache::lookup(const std::string &key, const LanguageCode &language_code) {
+    std::vector<std::string> translations;
+    for (const auto &language_code_and_translation : getEntries(key)) {
+        if (language_code_and_translation.first == language_code)
+            translations.emplace_back(language_code_and_translation.second);
+    }
+
+    return translations;
+}
+
+
+std::vector<std::string> TranslationCache::lookup(const std::string &key) {
+    std::vector<std::string> translations;
+    for (const auto &language_code_and_translation : getEntries(key))
+        translations.emplace_back(language_code_and_translation.second);
+
+    return translations;
+}
+
+
+static unsigned GetCount(DbConnection * const db_connection, const std::string &query) {
+    db_connection->queryOrDie(query);
+    DbResultSet result_set(db_connection->getLastResultSet());
+    return result_set.empty() ? 0 : StringUtil::ToUnsigned(result_set.getNextRow()["count"]);
+}
+
+
+void RebuildTranslationStats(DbConnection * const db_connection, const std::string &table_name, const std::string &key_column) {
+    const unsigned key_count(GetCount(db_connection, "SELECT COUNT(DISTINCT " + key_column + ") AS count FROM " + table_name));
+    std::vector<std::string> values{ "(" + db_connection->escapeAndQuoteString(table_name) + ",'',0," + std::to_string(key_count)
+                                     + ")" };
+
+    // A single pass over the table instead of one anti-join per language:
+    db_connection->queryOrDie("SELECT language_code,COUNT(*) AS translated_count,COUNT(DISTINCT " + key_column
+                              + ") AS key_count FROM " + table_name + " GROUP BY language_code");
+    DbResultSet result_set(db_connection->getLastResultSet());
+    while (const DbRow row = result_set.getNextRow())
+        values.emplace_back("(" + db_connection->escapeAndQuoteString(table_name) + ","
+                            + db_connection->escapeAndQuoteString(row["language_code"]) + "," + row["translated_count"] + ","
+                            + row["key_count"] + ")");
+
+    db_connection->queryOrDie("START TRANSACTION");
+    db_connection->queryOrDie("DELETE FROM translation_stats WHERE table_name=" + db_connection->escapeAndQuoteString(table_name));
+    db_connection->queryOrDie("INSERT INTO translation_stats (table_name,language_code,translated_count,key_count) VALUES "
+                              + StringUtil::Join(values, ","));
+    db_connection->queryOrDie("COMMIT");
+}
+
+
+void UpdateTranslationStatsAfterInsert(DbConnection * const db_connection, const std::string &table_name,
+                                       const std::string &key_column, const std::string &key, const LanguageCode &language_code)
+{
+    const std::string quoted_table_name(db_connection->escapeAndQuoteString(table_name));
+    db_connection->queryOrDie("SELECT key_count FROM translation_stats WHERE table_name=" + quoted_table_name
+                              + " AND language_code=''");
+    if (db_connection->getLastResultSet().empty())
+        return; // The statistics will be created from scratch when they're needed for the first time.
+
+    // Both counts include the row that has just been inserted, so 1 means that the key is new:
+    const std::string key_condition(key_column + "=" + db_connection->escapeAndQuoteString(key));
+    const bool new_key(GetCount(db_connection, "SELECT COUNT(*) AS count FROM " + table_name + " WHERE " + key_condition) == 1);
+    const bool new_key_for_language(GetCount(db_connection, "SELECT COUNT(*) AS count FROM " + table_name + " WHERE "
+                                             + key_condition + " AND language_code="
+                                             + db_connection->escapeAndQuoteString(language_code)) == 1);
+
+    db_connection->queryOrDie("INSERT INTO translation_stats (table_name,language_code,translated_count,key_count) VALUES ("
+                              + quoted_table_name + "," + db_connection->escapeAndQuoteString(language_code) + ",1,"
+                              + (new_key_for_language ? "1" : "0") + ") ON DUPLICATE KEY UPDATE "
+                              "translated_count=translated_count+1,key_count=key_count+VALUES(key_count)");
+    if (new_key)
+        db_connection->queryOrDie("UPDATE translation_stats SET key_count=key_count+1 WHERE table_name=" + quoted_table_name
+                                  + " AND language_code=''");
+}
+
+
+std::vector<TranslationStats> GetTranslationStats(DbConnection * const db_connection, const std::string &table_name,
+                                                  const std::string &key_column)
+{
+    const std::string quoted_table_name(db_connection->escapeAndQuoteString(table_name));
+    if (GetCount(db_connection, "SELECT COUNT(*) AS count FROM translation_stats WHERE table_name=" + quoted_table_name) == 0)
+        RebuildTranslationStats(db_connection, table_name, key_column);
+
+    db_connection->queryOrDie("SELECT language_code,translated_count,key_count FROM translation_stats WHERE table_name="
+                              + quoted_table_name + " ORDER BY language_code");
+    DbResultSet result_set(db_connection->getLastResultSet());
+
+    unsigned total_key_count(0);
+    std::vector<std::tuple<LanguageCode, unsigned, unsigned>> languages_and_counts;
+    while (const DbRow row = result_set.getNextRow()) {
+        if (row["language_code"].empty())
+            total_key_count = StringUtil::ToUnsigned(row["key_count"]);
+        else
+            languages_and_counts.emplace_back(row["language_code"], StringUtil::ToUnsigned(row["translated_count"]),
+                                              StringUtil::ToUnsigned(row["key_count"]));
+    }
+
+    std::vector<TranslationStats> stats;
+    for (const auto &language_and_counts : languages_and_counts) {
+        const unsigned untranslated_count(total_key_count - std::min(total_key_count, std::get<2>(language_and_counts)));
+        stats.emplace_back(std::get<0>(language_and_counts), std::get<1>(language_and_counts),
+                           std::get<1>(language_and_counts) + untranslated_count);
+    }
+
+    return stats;
+}
+
+
 static std::map<std::string, std::string> international_2letter_code_to_german_3or4letter_code{
     { "de", "deu" },
     { "en", "eng" },
@@ -29,7 +29,10 @@
 #include "Url.h"
 #include <set>
 #include <fstream>
+#include <list>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #include <climits>
 #include <cstddef>
@@ -37,6 +40,7 @@
 #include "DnsUtil.h"
 #include "Downloader.h"
 #include "HttpHeader.h"
+#include "PerlCompatRegExp.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "UrlUtil.h"
@@ -47,6 +51,66 @@
 
 
 std::string Url::default_user_agent_;
+size_t Url::construction_cache_size_(Url::DEFAULT_CONSTRUCTION_CACHE_SIZE);
+
+
+namespace {
+
+
+/** \class  ConstructionCache
+ *  \brief  A thread-safe LRU cache of Url's keyed by their creation parameters.
+ */
+class ConstructionCache {
+    std::list<std::pair<std::string, Url>> entries_; // Most recently used first.
+    std::unordered_map<std::string, std::list<std::pair<std::string, Url>>::iterator> keys_to_entries_map_;
+    std::mutex mutex_;
+public:
+    /** \brief  Inserts "url" under "key" unless we already have an entry for "key".
+     *  \note   Evicts the least recently used entries in order to not exceed "max_size" entries.
+     */
+    void insert(const std::string &key, const Url &url, const size_t max_size);
+
+    /** \return True if we have an entry for "key", else false. */
+    bool lookup(const std::string &key, Url * const url);
+};
+
+
+void ConstructionCache::insert(const std::string &key, const Url &url, const size_t max_size) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    if (keys_to_entries_map_.find(key) != keys_to_entries_map_.end())
+        return; // Another thread beat us to it.
+
+    while (not entries_.empty() and entries_.size() >= max_size) {
+        keys_to_entries_map_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+
+    entries_.emplace_front(key, url);
+    keys_to_entries_map_[key] = entries_.begin();
+}
+
+
+bool ConstructionCache::lookup(const std::string &key, Url * const url) {
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+    const auto key_and_entry(keys_to_entries_map_.find(key));
+    if (key_and_entry == keys_to_entries_map_.end())
+        return false;
+
+    entries_.splice(entries_.begin(), entries_, key_and_entry->second);
+    *url = entries_.front().second;
+    return true;
+}
+
+
+ConstructionCache &GetConstructionCache() {
+    static ConstructionCache construction_cache;
+    return construction_cache;
+}
+
+
+} // unnamed namespace
 
 
 Url::Url(const std::string &url, const std::string &default_base_url, const unsigned creation_flags,
@@ -61,18 +125,7 @@ Url::Url(const std::string &url, const std::string &default_base_url, const unsi
             url_ = url_.substr(0, first_hash_pos);
     }
 
-    if ((creation_flags & FORCE_ABSOLUTE_HTTP_URL) and not isAbsolute() and not forceAbsoluteHttp())
-        return;
-    if ((creation_flags & AUTO_MAKE_ABSOLUTE) and not makeAbsolute())
-        return;
-
-    if ((creation_flags & AUTO_CANONIZE) and not makeCanonical())
-        return;
-    else if ((creation_flags & AUTO_CLEAN_UP) and not cleanUp())
-        return;
-
-    if ((creation_flags & AUTO_MAKE_VALID) and not isValid() and not makeValid())
-        error("can't make invalid URL \"" + url_ + "\" valid!");
+    initialise(creation_flags);
 }
 
 
@@ -87,19 +140,10 @@ Url::Url(const std::string &url, const unsigned creation_flags, const RobotsDotT
         : url_(url), robots_dot_txt_option_(robots_dot_txt_option), timeout_(timeout), user_agent_(user_agent),
           state_(UNINITIALISED), throw_exceptions_(creation_flags & THROW_EXCEPTIONS)
 {
-    if ((creation_flags & FORCE_ABSOLUTE_HTTP_URL) and not isAbsolute() and not forceAbsoluteHttp())
-        return;
-
     if (creation_flags & AUTO_MAKE_ABSOLUTE)
         throw std::runtime_error("in Url::Url: constructor flag AUTO_MAKE_ABSOLUTE used with no base URL!");
 
-    if ((creation_flags & AUTO_CANONIZE) and not makeCanonical())
-        return;
-    else if ((creation_flags & AUTO_CLEAN_UP) and not cleanUp())
-        return;
-
-    if ((creation_flags & AUTO_MAKE_VALID) and not isValid() and not makeValid())
-        error("can't make invalid URL \"" + url_ + "\" valid!");
+    initialise(creation_flags);
 }
 
 
@@ -131,6 +175,59 @@ Url::Url(const std::string &scheme, const std::string &username_password, const
 }
 
 
+void Url::initialise(const unsigned creation_flags) {
+    // Canonisation requires downloads and its outcome may change over time, so we only cache the other operations:
+    const bool use_construction_cache(construction_cache_size_ > 0 and not (creation_flags & AUTO_CANONIZE));
+    if (not use_construction_cache) {
+        applyCreationFlags(creation_flags);
+        return;
+    }
+
+    // N.B., URL's can't contain NUL characters:
+    const std::string key(std::to_string(creation_flags) + '\0' + default_base_url_ + '\0' + url_);
+    Url cached_url;
+    if (GetConstructionCache().lookup(key, &cached_url)) {
+        copyConstructionState(cached_url);
+        return;
+    }
+
+    applyCreationFlags(creation_flags);
+    GetConstructionCache().insert(key, *this, construction_cache_size_);
+}
+
+
+void Url::applyCreationFlags(const unsigned creation_flags) {
+    if ((creation_flags & FORCE_ABSOLUTE_HTTP_URL) and not isAbsolute() and not forceAbsoluteHttp())
+        return;
+    if ((creation_flags & AUTO_MAKE_ABSOLUTE) and not makeAbsolute())
+        return;
+
+    if ((creation_flags & AUTO_CANONIZE) and not makeCanonical())
+        return;
+    else if ((creation_flags & AUTO_CLEAN_UP) and not cleanUp())
+        return;
+
+    if ((creation_flags & AUTO_MAKE_VALID) and not isValid() and not makeValid())
+        error("can't make invalid URL \"" + url_ + "\" valid!");
+}
+
+
+void Url::copyConstructionState(const Url &other) {
+    url_               = other.url_;
+    scheme_            = other.scheme_;
+    username_password_ = other.username_password_;
+    authority_         = other.authority_;
+    port_              = other.port_;
+    path_              = other.path_;
+    params_            = other.params_;
+    query_             = other.query_;
+    fragment_          = other.fragment_;
+    relative_url_      = other.relative_url_;
+    state_             = other.state_;
+    error_message_     = other.error_message_;
+}
+
+
 namespace {
 
 
@@ -1345,7 +1442,7 @@ bool IsVeriSignSiteFinderUrl(const std::string &url, Downloader * const download
     if (downloader->anErrorOccurred())
         return false;
 
-    HttpHeader http_header(downloader->getMessageHeader());
+    const HttpHeader &http_header(downloader->getHttpHeader());
     if (http_header.getStatusCode() < 200 or http_header.getStatusCode() > 299)
         return false;
 
@@ -1368,7 +1465,7 @@ bool IsCentralNicUrl(const std::string &url, Downloader * const downloader, cons
     if (downloader->anErrorOccurred())
         return false;
 
-    HttpHeader http_header(downloader->getMessageHeader());
+    const HttpHeader &http_header(downloader->getHttpHeader());
     if (http_header.getStatusCode() < 200 or http_header.getStatusCode() > 299)
         return false;
 
@@ -1420,7 +1517,7 @@ bool TestNewURL(const std::string &original_url, const HttpHeader &original_http
     if (downloader->anErrorOccurred())
         return false;
 
-    HttpHeader new_http_header(downloader->getMessageHeader());
+    const HttpHeader &new_http_header(downloader->getHttpHeader());
     if (new_http_header.getStatusCode() < 200 or new_http_header.getStatusCode() > 299)
         return false;
 
@@ -1478,7 +1575,7 @@ bool Url::makeCanonical(const unsigned override_timeout) {
 
         // Retrieve the "original" URL
         Downloader downloader(*this, downloader_params, time_limit);
-        const HttpHeader original_http_header(downloader.getMessageHeader());
+        const HttpHeader original_http_header(downloader.getHttpHeader());
         const std::string original_content_hash(StringUtil::Sha1(downloader.getMessageBody()));
 
         // Work through the possible candidates until we find
@@ -26,7 +26,10 @@
 
 #include "UrlUtil.h"
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <cassert>
 #include "Compiler.h"
 #include "IniFile.h"
@@ -561,4 +564,102 @@ bool IsRobotsDotTxtUrl(const Url &test_url) {
 }
 
 
+namespace {
+
+
+inline char ToLowerASCII(const char ch) {
+    return (ch >= 'A' and ch <= 'Z') ? ch - 'A' + 'a' : ch;
+}
+
+
+// "prefix" must consist of a scheme, "://" and an authority w/ optional user info and port.
+std::string NormalisePrefix(const std::string &prefix, const size_t colon_and_double_slash_pos) {
+    std::string normalised_prefix;
+    normalised_prefix.reserve(prefix.length());
+    for (size_t pos(0); pos < colon_and_double_slash_pos; ++pos)
+        normalised_prefix += ToLowerASCII(prefix[pos]);
+    normalised_prefix += "://";
+
+    // User info is case sensitive:
+    size_t host_start(colon_and_double_slash_pos + 3);
+    const size_t at_sign_pos(prefix.rfind('@'));
+    if (at_sign_pos != std::string::npos and at_sign_pos >= host_start) {
+        normalised_prefix.append(prefix, host_start, at_sign_pos + 1 - host_start);
+        host_start = at_sign_pos + 1;
+    }
+
+    // Take care not to mistake the colons of IPv6 addresses for a port separator:
+    size_t host_end(prefix.rfind(':'));
+    if (host_end == std::string::npos or host_end < host_start or prefix.find(']', host_end) != std::string::npos)
+        host_end = prefix.length();
+    for (size_t pos(host_start); pos < host_end; ++pos)
+        normalised_prefix += ToLowerASCII(prefix[pos]);
+
+    if (host_end < prefix.length()) {
+        const std::string port(prefix.substr(host_end + 1));
+        const bool is_default_port((port == "80" and StringUtil::StartsWith(normalised_prefix, "http:"))
+                                   or (port == "443" and StringUtil::StartsWith(normalised_prefix, "https:")));
+        if (not is_default_port and not port.empty())
+            normalised_prefix += ":" + port;
+    }
+
+    return normalised_prefix;
+}
+
+
+// We use several independently locked shards so that threads normalising URL's concurrently rarely have to wait.
+class PrefixCache {
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t MAX_SHARD_SIZE = 1u << 16u;
+    struct Shard {
+        std::mutex mutex_;
+        std::unordered_map<std::string, std::string> prefixes_to_normalised_prefixes_;
+    } shards_[SHARD_COUNT];
+public:
+    std::string getNormalisedPrefix(const std::string &prefix, const size_t colon_and_double_slash_pos);
+};
+
+
+std::string PrefixCache::getNormalisedPrefix(const std::string &prefix, const size_t colon_and_double_slash_pos) {
+    Shard &shard(shards_[std::hash<std::string>()(prefix) % SHARD_COUNT]);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        const auto prefix_and_normalised_prefix(shard.prefixes_to_normalised_prefixes_.find(prefix));
+        if (prefix_and_normalised_prefix != shard.prefixes_to_normalised_prefixes_.cend())
+            return prefix_and_normalised_prefix->second;
+    }
+
+    // We don't hold the lock while normalising.  Should another thread beat us to it, it will have computed the same value.
+    const std::string normalised_prefix(NormalisePrefix(prefix, colon_and_double_slash_pos));
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    if (unlikely(shard.prefixes_to_normalised_prefixes_.size() >= MAX_SHARD_SIZE))
+        shard.prefixes_to_normalised_prefixes_.clear(); // Crude but we only need to bound our memory usage.
+    shard.prefixes_to_normalised_prefixes_.emplace(prefix, normalised_prefix);
+
+    return normalised_prefix;
+}
+
+
+constexpr size_t PrefixCache::SHARD_COUNT;
+constexpr size_t PrefixCache::MAX_SHARD_SIZE;
+
+
+} // unnamed namespace
+
+
+std::string NormaliseUrlPrefix(const std::string &url) {
+    const size_t colon_and_double_slash_pos(url.find("://"));
+    if (colon_and_double_slash_pos == std::string::npos or colon_and_double_slash_pos == 0)
+        return url;
+
+    size_t authority_end(url.find_first_of("/?#", colon_and_double_slash_pos + 3));
+    if (authority_end == std::string::npos)
+        authority_end = url.length();
+
+    static PrefixCache prefix_cache;
+    const std::string prefix(url.substr(0, authority_end));
+    return prefix_cache.getNormalisedPrefix(prefix, colon_and_double_slash_pos) + url.substr(authority_end);
+}
+
+
 } // namespace UrlUtil
@@ -30,6 +30,9 @@
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "Compiler.h"
 #include "Downloader.h"
 #include "FileDescriptor.h"
@@ -614,15 +617,28 @@ void GetMultiPartArgs(std::multimap<std::string, std::string> * const post_args,
 }
 
 
+namespace {
+
+
+// Set while ProcessCgiRequests() is handling a FastCGI request.  std::cin then reads the request body from memory.
+bool fastcgi_request_in_progress(false);
+
+
+} // unnamed namespace
+
+
 void GetAllCgiArgs(std::multimap<std::string, std::string> * const cgi_args, int argc, char *argv[]) {
     // We check argv[1] because in GET method argv[1] is set to a blank line.
     if (argc > 1 and std::strlen(argv[1]) >= 2)
         GetArgvArgs(argc, argv, cgi_args);
     else {
         GetGetArgs(cgi_args);
+        if (not cgi_args->empty())
+            return;
 
         // Do not also attempt to get POST arguments if there is nothing to read on stdin within 1 second:
-        if (not cgi_args->empty() or not FileUtil::DescriptorIsReadyForReading(STDIN_FILENO, 1000 /* ms */))
+        if (fastcgi_request_in_progress ? std::cin.rdbuf()->in_avail() <= 0
+                                        : not FileUtil::DescriptorIsReadyForReading(STDIN_FILENO, 1000 /* ms */))
             return;
 
         // Check whether this is a 'POST' or 'multipart' form.  Since variables don't begin with '-' in POST we
@@ -635,6 +651,304 @@ void GetAllCgiArgs(std::multimap<std::string, std::string> * const cgi_args, int
 }
 
 
+namespace {
+
+
+// See https://fastcgi-archives.github.io/FastCGI_Specification.html for the protocol.
+enum FastCgiRecordType : uint8_t {
+    FCGI_BEGIN_REQUEST = 1, FCGI_ABORT_REQUEST = 2, FCGI_END_REQUEST = 3, FCGI_PARAMS = 4, FCGI_STDIN = 5, FCGI_STDOUT = 6,
+    FCGI_STDERR = 7, FCGI_DATA = 8, FCGI_GET_VALUES = 9, FCGI_GET_VALUES_RESULT = 10, FCGI_UNKNOWN_TYPE = 11
+};
+enum FastCgiProtocolStatus : uint8_t { FCGI_REQUEST_COMPLETE = 0, FCGI_CANT_MPX_CONN = 1, FCGI_UNKNOWN_ROLE = 3 };
+const uint8_t FCGI_VERSION_1(1);
+const uint16_t FCGI_RESPONDER(1);
+const uint8_t FCGI_KEEP_CONN(1);
+const size_t FCGI_HEADER_LEN(8);
+const size_t FCGI_MAX_CONTENT_LENGTH(65535);
+
+
+class FastCgiConnection {
+    const int fd_;
+public:
+    explicit FastCgiConnection(const int fd): fd_(fd) { }
+    ~FastCgiConnection() { ::close(fd_); }
+
+    // \return False if the web server closed the connection, o/w true.
+    bool readRecord(FastCgiRecordType * const type, uint16_t * const request_id, std::string * const content);
+
+    void writeRecord(const FastCgiRecordType type, const uint16_t request_id, const char *content, size_t content_length);
+    void writeStream(const FastCgiRecordType type, const uint16_t request_id, const std::string &data);
+    void writeEndRequest(const uint16_t request_id, const FastCgiProtocolStatus protocol_status);
+private:
+    bool readExactly(char *buffer, size_t count);
+};
+
+
+bool FastCgiConnection::readRecord(FastCgiRecordType * const type, uint16_t * const request_id, std::string * const content) {
+    unsigned char header[FCGI_HEADER_LEN];
+    if (not readExactly(reinterpret_cast<char *>(header), sizeof header))
+        return false;
+    if (unlikely(header[0] != FCGI_VERSION_1))
+        LOG_ERROR("unsupported FastCGI protocol version " + std::to_string(header[0]) + "!");
+
+    *type       = static_cast<FastCgiRecordType>(header[1]);
+    *request_id = (header[2] << 8u) | header[3];
+    const size_t content_length((header[4] << 8u) | header[5]), padding_length(header[6]);
+    content->resize(content_length + padding_length);
+    if (not readExactly(&(*content)[0], content->size()))
+        return false;
+    content->resize(content_length);
+
+    return true;
+}
+
+
+void FastCgiConnection::writeRecord(const FastCgiRecordType type, const uint16_t request_id, const char *content,
+                                    size_t content_length)
+{
+    const size_t padding_length((8 - content_length % 8) % 8);
+    std::string record;
+    record.reserve(FCGI_HEADER_LEN + content_length + padding_length);
+    record += static_cast<char>(FCGI_VERSION_1);
+    record += static_cast<char>(type);
+    record += static_cast<char>(request_id >> 8u);
+    record += static_cast<char>(request_id & 0xFFu);
+    record += static_cast<char>(content_length >> 8u);
+    record += static_cast<char>(content_length & 0xFFu);
+    record += static_cast<char>(padding_length);
+    record += '\0'; // reserved
+    record.append(content, content_length);
+    record.append(padding_length, '\0');
+
+    const char *data(record.data());
+    size_t remaining(record.size());
+    while (remaining > 0) {
+        const ssize_t written(::write(fd_, data, remaining));
+        if (unlikely(written == -1)) {
+            if (errno == EINTR)
+                continue;
+            LOG_WARNING("failed to write a FastCGI record!");
+            return; // The web server has probably given up on the request.
+        }
+        data += written, remaining -= written;
+    }
+}
+
+
+// Splits "data" into as many records as necessary and terminates the stream w/ an empty record.
+void FastCgiConnection::writeStream(const FastCgiRecordType type, const uint16_t request_id, const std::string &data) {
+    for (size_t offset(0); offset < data.size(); offset += FCGI_MAX_CONTENT_LENGTH)
+        writeRecord(type, request_id, data.data() + offset, std::min(FCGI_MAX_CONTENT_LENGTH, data.size() - offset));
+    writeRecord(type, request_id, nullptr, 0);
+}
+
+
+void FastCgiConnection::writeEndRequest(const uint16_t request_id, const FastCgiProtocolStatus protocol_status) {
+    const char body[8] = { 0, 0, 0, 0 /* application status */, static_cast<char>(protocol_status), 0, 0, 0 };
+    writeRecord(FCGI_END_REQUEST, request_id, body, sizeof body);
+}
+
+
+bool FastCgiConnection::readExactly(char *buffer, size_t count) {
+    while (count > 0) {
+        const ssize_t read_count(::read(fd_, buffer, count));
+        if (read_count == -1 and errno == EINTR)
+            continue;
+        if (read_count <= 0)
+            return false;
+        buffer += read_count, count -= read_count;
+    }
+
+    return true;
+}
+
+
+// Decodes the name-value pairs of FCGI_PARAMS and FCGI_GET_VALUES records.
+void DecodeFastCgiNameValuePairs(const std::string &encoded_pairs, std::vector<std::pair<std::string, std::string>> * const pairs) {
+    size_t offset(0);
+    const auto decode_length([&encoded_pairs, &offset](size_t * const length) {
+        if (offset >= encoded_pairs.size())
+            return false;
+        const unsigned char first_byte(encoded_pairs[offset]);
+        if (first_byte < 0x80u) {
+            *length = first_byte;
+            ++offset;
+            return true;
+        }
+        if (offset + 4 > encoded_pairs.size())
+            return false;
+        *length = ((first_byte & 0x7Fu) << 24u) | (static_cast<unsigned char>(encoded_pairs[offset + 1]) << 16u)
+                  | (static_cast<unsigned char>(encoded_pairs[offset + 2]) << 8u) | static_cast<unsigned char>(encoded_pairs[offset + 3]);
+        offset += 4;
+        return true;
+    });
+
+    while (offset < encoded_pairs.size()) {
+        size_t name_length, value_length;
+        if (unlikely(not decode_length(&name_length) or not decode_length(&value_length)
+                     or offset + name_length + value_length > encoded_pairs.size()))
+            LOG_ERROR("garbled FastCGI name-value pairs!");
+        pairs->emplace_back(encoded_pairs.substr(offset, name_length), encoded_pairs.substr(offset + name_length, value_length));
+        offset += name_length + value_length;
+    }
+}
+
+
+void EncodeFastCgiNameValuePair(const std::string &name, const std::string &value, std::string * const encoded_pairs) {
+    // We only use this for short names and values, hence no need for the 4-byte length encoding.
+    *encoded_pairs += static_cast<char>(name.length());
+    *encoded_pairs += static_cast<char>(value.length());
+    *encoded_pairs += name + value;
+}
+
+
+// Replaces the previous request's parameters in our environment w/ "params".
+void SetRequestEnvironment(const std::vector<std::pair<std::string, std::string>> &params) {
+    static std::vector<std::string> previous_param_names;
+    for (const auto &previous_param_name : previous_param_names)
+        ::unsetenv(previous_param_name.c_str());
+    previous_param_names.clear();
+
+    for (const auto &name_and_value : params) {
+        if (::setenv(name_and_value.first.c_str(), name_and_value.second.c_str(), /* overwrite = */1) == 0)
+            previous_param_names.emplace_back(name_and_value.first);
+    }
+}
+
+
+void RunRequestHandler(const std::function<void()> &request_handler, const std::string &request_body, std::string * const response) {
+    std::istringstream request_body_stream(request_body);
+    std::ostringstream response_stream;
+    std::streambuf * const original_cin_buffer(std::cin.rdbuf(request_body_stream.rdbuf()));
+    std::streambuf * const original_cout_buffer(std::cout.rdbuf(response_stream.rdbuf()));
+    fastcgi_request_in_progress = true;
+
+    try {
+        request_handler();
+    } catch (const std::exception &x) {
+        LOG_WARNING("request handler threw an exception: " + std::string(x.what()));
+        if (response_stream.tellp() == 0)
+            response_stream << "Status: 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nInternal Server Error\n";
+    }
+
+    fastcgi_request_in_progress = false;
+    std::cout.rdbuf(original_cout_buffer);
+    std::cin.rdbuf(original_cin_buffer);
+    *response = response_stream.str();
+}
+
+
+/** \brief Serves one request, i.e. the records from FCGI_BEGIN_REQUEST to the end of the FCGI_STDIN stream.
+ *  \return True if the web server wants to reuse the connection, o/w false.
+ *  \note   We announce that we can't multiplex connections, so we only ever deal w/ a single request at a time.
+ */
+bool ServeFastCgiRequest(FastCgiConnection * const connection, const std::function<void()> &request_handler) {
+    FastCgiRecordType type;
+    uint16_t request_id, current_request_id(0);
+    std::string content, encoded_params, request_body;
+    bool keep_connection(false), params_complete(false);
+    uint16_t role(0);
+    for (;;) {
+        if (not connection->readRecord(&type, &request_id, &content))
+            return false;
+
+        if (request_id == 0) { // A management record.
+            if (type == FCGI_GET_VALUES) {
+                std::vector<std::pair<std::string, std::string>> names_and_values;
+                DecodeFastCgiNameValuePairs(content, &names_and_values);
+                std::string reply;
+                for (const auto &name_and_value : names_and_values) {
+                    if (name_and_value.first == "FCGI_MAX_CONNS" or name_and_value.first == "FCGI_MAX_REQS")
+                        EncodeFastCgiNameValuePair(name_and_value.first, "1", &reply);
+                    else if (name_and_value.first == "FCGI_MPXS_CONNS")
+                        EncodeFastCgiNameValuePair(name_and_value.first, "0", &reply);
+                }
+                connection->writeRecord(FCGI_GET_VALUES_RESULT, 0, reply.data(), reply.size());
+            } else {
+                const char body[8] = { static_cast<char>(type), 0, 0, 0, 0, 0, 0, 0 };
+                connection->writeRecord(FCGI_UNKNOWN_TYPE, 0, body, sizeof body);
+            }
+            continue;
+        }
+
+        if (type == FCGI_BEGIN_REQUEST) {
+            if (current_request_id != 0) {
+                connection->writeEndRequest(request_id, FCGI_CANT_MPX_CONN);
+                continue;
+            }
+            if (unlikely(content.size() < 3))
+                LOG_ERROR("short FCGI_BEGIN_REQUEST record!");
+            current_request_id = request_id;
+            role = (static_cast<unsigned char>(content[0]) << 8u) | static_cast<unsigned char>(content[1]);
+            keep_connection = (content[2] & FCGI_KEEP_CONN) != 0;
+        } else if (request_id != current_request_id)
+            continue; // Most likely left-overs of an aborted request.
+        else if (type == FCGI_ABORT_REQUEST) {
+            connection->writeEndRequest(current_request_id, FCGI_REQUEST_COMPLETE);
+            return keep_connection;
+        } else if (type == FCGI_PARAMS) {
+            if (content.empty())
+                params_complete = true;
+            else
+                encoded_params += content;
+        } else if (type == FCGI_STDIN) {
+            if (not content.empty())
+                request_body += content;
+            else if (params_complete)
+                break; // We have the entire request.
+        }
+    }
+
+    if (role != FCGI_RESPONDER) {
+        connection->writeEndRequest(current_request_id, FCGI_UNKNOWN_ROLE);
+        return keep_connection;
+    }
+
+    std::vector<std::pair<std::string, std::string>> params;
+    DecodeFastCgiNameValuePairs(encoded_params, &params);
+    SetRequestEnvironment(params);
+
+    std::string response;
+    RunRequestHandler(request_handler, request_body, &response);
+    connection->writeStream(FCGI_STDOUT, current_request_id, response);
+    connection->writeEndRequest(current_request_id, FCGI_REQUEST_COMPLETE);
+
+    return keep_connection;
+}
+
+
+} // unnamed namespace
+
+
+bool IsFastCgiProcess() {
+    // According to the FastCGI specification, the web server passes us a listening socket as our stdin:
+    sockaddr_storage address;
+    socklen_t address_length(sizeof address);
+    return ::getpeername(STDIN_FILENO, reinterpret_cast<sockaddr *>(&address), &address_length) == -1 and errno == ENOTCONN;
+}
+
+
+void ProcessCgiRequests(const std::function<void()> &request_handler) {
+    if (not IsFastCgiProcess()) {
+        request_handler();
+        return;
+    }
+
+    for (;;) {
+        const int connection_fd(::accept(STDIN_FILENO, nullptr, nullptr));
+        if (unlikely(connection_fd == -1)) {
+            if (errno == EINTR or errno == ECONNABORTED)
+                continue;
+            LOG_ERROR("accept(2) on the FastCGI listening socket failed!");
+        }
+
+        FastCgiConnection connection(connection_fd);
+        while (ServeFastCgiRequest(&connection, request_handler))
+            /* Intentionally empty! */;
+    }
+}
+
+
 enum RequestType { POST, GET };
 
 
@@ -1174,7 +1488,7 @@ void ExtractURLs(const std::string &document_source, std::string default_base_ur
 
                 Downloader downloader(url_and_anchor_texts->getUrl());
                 if (not downloader.anErrorOccurred()) {
-                    const HttpHeader http_header(downloader.getMessageHeader());
+                    const HttpHeader &http_header(downloader.getHttpHeader());
                     if (http_header.isValid() and http_header.getStatusCode() == 200)
                         filtered_urls_and_anchor_texts.push_back(*url_and_anchor_texts);
                 }
@@ -19,6 +19,8 @@
  */
 #include "XMLParser.h"
 #include <xercesc/framework/MemBufInputSource.hpp>
+#include <xercesc/sax/InputSource.hpp>
+#include <xercesc/util/BinInputStream.hpp>
 #include <cassert>
 #include "FileUtil.h"
 #include "StringUtil.h"
@@ -132,9 +134,57 @@ void XMLParser::Handler::setDocumentLocator(const xercesc::Locator * const locat
 }
 
 
+namespace {
+
+
+// Hands the bytes that we get from an XMLParser::ReadFunction to Xerces.
+class ReadFunctionInputStream : public xercesc::BinInputStream {
+    const XMLParser::ReadFunction read_function_;
+    off_t * const offset_;
+public:
+    ReadFunctionInputStream(const XMLParser::ReadFunction &read_function, off_t * const offset)
+        : read_function_(read_function), offset_(offset) { }
+    virtual XMLFilePos curPos() const override { return static_cast<XMLFilePos>(*offset_); }
+    virtual XMLSize_t readBytes(XMLByte * const to_fill, const XMLSize_t max_to_read) override {
+        const size_t byte_count(read_function_(reinterpret_cast<char *>(to_fill), max_to_read));
+        *offset_ += byte_count;
+        return byte_count;
+    }
+    virtual const XMLCh *getContentType() const override { return nullptr; }
+};
+
+
+class ReadFunctionInputSource : public xercesc::InputSource {
+    const XMLParser::ReadFunction &read_function_;
+    off_t * const offset_;
+public:
+    ReadFunctionInputSource(const XMLParser::ReadFunction &read_function, off_t * const offset)
+        : xercesc::InputSource("xml_stream"), read_function_(read_function), offset_(offset) { }
+    virtual xercesc::BinInputStream *makeStream() const override
+        { return new ReadFunctionInputStream(read_function_, offset_); }
+};
+
+
+} // unnamed namespace
+
+
 XMLParser::XMLParser(const std::string &xml_filename_or_string, const Type type, const Options &options)
-    : xml_filename_or_string_(xml_filename_or_string), type_(type), options_(options)
+    : xml_filename_or_string_(xml_filename_or_string), type_(type), options_(options), stream_offset_(0)
+{
+    if (unlikely(type_ == XML_STREAM))
+        throw XMLParser::Error("in XMLParser::XMLParser: use the ReadFunction constructor for streams!");
+    init();
+}
+
+
+XMLParser::XMLParser(const ReadFunction &read_function, const Options &options)
+    : type_(XML_STREAM), options_(options), read_function_(read_function), stream_offset_(0)
 {
+    init();
+}
+
+
+void XMLParser::init() {
     xercesc::XMLPlatformUtils::Initialize();
     parser_  = new xercesc::SAXParser();
 
@@ -156,6 +206,9 @@ XMLParser::XMLParser(const std::string &xml_filename_or_string, const Type type,
 
 
 void XMLParser::reset(const std::string &xml_filename_or_string, const Type type, const Options &options) {
+    if (unlikely(type_ == XML_STREAM or type == XML_STREAM))
+        throw XMLParser::Error("in XMLParser::reset: streams can't be reset!");
+
     xml_filename_or_string_ = xml_filename_or_string;
     type_ = type;
     options_ = options;
@@ -214,6 +267,8 @@ off_t XMLParser::getMaxOffset() {
         return FileUtil::GetFileSize(xml_filename_or_string_);
     case XMLParser::XML_STRING:
         return xml_filename_or_string_.length();
+    case XMLParser::XML_STREAM:
+        return stream_offset_;
     default:
         LOG_ERROR("we should *never* get here!");
     }
@@ -234,6 +289,11 @@ bool XMLParser::getNext(XMLPart * const next, const bool combine_consecutive_cha
                 body_has_more_contents_ = parser_->parseFirst(input_buffer, token_);
                 if (not body_has_more_contents_)
                     throw XMLParser::Error("error parsing document header: " + xml_filename_or_string_);
+            } else if (type_ == XML_STREAM) {
+                const ReadFunctionInputSource input_source(read_function_, &stream_offset_);
+                body_has_more_contents_ = parser_->parseFirst(input_source, token_);
+                if (not body_has_more_contents_)
+                    throw XMLParser::Error("error parsing document header of a stream!");
             } else
                 throw XMLParser::Error("Undefined XMLParser::Type!");
 
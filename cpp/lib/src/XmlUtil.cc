@@ -19,6 +19,7 @@
  */
 #include "XmlUtil.h"
 #include "Compiler.h"
+#include "ScanUtil.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "util.h"
@@ -102,11 +103,21 @@ bool DecodeEntities(std::string * const data) {
 
 
 void XmlEscape(std::string * const data) {
+    const char *run_start(data->data());
+    const char * const end(data->data() + data->size());
+    const char *special_char(ScanUtil::FindFirstOf(run_start, end, "\"'<>&"));
+    if (special_char == end) // Nothing to do, which is the common case.
+        return;
+
     std::string escaped_data;
     escaped_data.reserve(data->length() * 2);
 
-    for (const char ch : *data) {
-        switch (ch) {
+    for (;;) {
+        escaped_data.append(run_start, special_char);
+        if (special_char == end)
+            break;
+
+        switch (*special_char) {
         case '"':
             escaped_data += "&quot;";
             break;
@@ -122,9 +133,9 @@ void XmlEscape(std::string * const data) {
         case '&':
             escaped_data += "&amp;";
             break;
-        default:
-            escaped_data += ch;
         }
+        run_start = special_char + 1;
+        special_char = ScanUtil::FindFirstOf(run_start, end, "\"'<>&");
     }
 
     escaped_data.swap(*data);
@@ -28,6 +28,7 @@
 #include "XmlWriter.h"
 #include <stdexcept>
 #include "Compiler.h"
+#include "ScanUtil.h"
 #include "StringUtil.h"
 
 
@@ -58,13 +59,17 @@ namespace {
 
 std::string EscapeAttribValue(const std::string &value, const XmlWriter::TextConversionType text_conversion_type) {
     std::string quote_escaped_string;
-    for (std::string::const_iterator ch(value.begin()); ch != value.end(); ++ch) {
-        if (*ch == '"')
-            quote_escaped_string += "&quot;";
-        else if (*ch == '&')
-            quote_escaped_string += "&amp;";
-        else
-            quote_escaped_string += *ch;
+    quote_escaped_string.reserve(value.size());
+
+    const char *run_start(value.data());
+    const char * const end(value.data() + value.size());
+    for (;;) {
+        const char * const special_char(ScanUtil::FindFirstOf(run_start, end, "\"&"));
+        quote_escaped_string.append(run_start, special_char);
+        if (special_char == end)
+            break;
+        quote_escaped_string += (*special_char == '"') ? "&quot;" : "&amp;";
+        run_start = special_char + 1;
     }
 
     if (text_conversion_type == XmlWriter::ConvertFromIso8859_15)
@@ -202,6 +207,14 @@ void XmlWriter::indent() {
 }
 
 
+void XmlWriter::writeRaw(const char * const text, const size_t length) {
+    if (output_file_ == nullptr)
+        output_string_->append(text, length);
+    else if (unlikely(output_file_->write(text, length) != length))
+        throw std::runtime_error("in XmlWriter::writeRaw: failed to write to \"" + output_file_->getPath() + "\"!");
+}
+
+
 XmlWriter &XmlWriter::operator<<(const std::string &s) {
     if (output_file_ != nullptr)
         *output_file_ << XmlWriter::XmlEscape(s, text_conversion_type_);
@@ -296,25 +309,38 @@ std::string XmlWriter::XmlEscape(const std::string &s, const TextConversionType
                                  const std::string &additional_escapes)
 {
     std::string escaped_string;
-
-    // for performance, set this here so empty() doesn't have to be checked all the time:
-    const bool additional(not additional_escapes.empty());
-
-    for (const auto ch : s) {
-        if (ch == '<')
+    escaped_string.reserve(s.size());
+
+    // We copy runs of characters that don't need escaping w/o looking at them individually:
+    const std::string special_chars("<>&\"'" + additional_escapes);
+    const char *run_start(s.data());
+    const char * const end(s.data() + s.size());
+    for (;;) {
+        const char * const special_char(ScanUtil::FindFirstOf(run_start, end, special_chars));
+        escaped_string.append(run_start, special_char);
+        if (special_char == end)
+            break;
+
+        switch (*special_char) {
+        case '<':
             escaped_string += "&lt;";
-        else if (ch == '>')
+            break;
+        case '>':
             escaped_string += "&gt;";
-        else if (ch == '&')
+            break;
+        case '&':
             escaped_string += "&amp;";
-        else if (ch == '"')
+            break;
+        case '"':
             escaped_string += "&quot;";
-        else if (ch == '\'')
+            break;
+        case '\'':
             escaped_string += "&apos;";
-        else if (additional and additional_escapes.find(ch) != std::string::npos)
-            escaped_string += StringUtil::Format("&#%04d;", ch);
-        else
-            escaped_string += ch;
+            break;
+        default:
+            escaped_string += StringUtil::Format("&#%04d;", *special_char);
+        }
+        run_start = special_char + 1;
     }
 
     if (text_conversion_type == XmlWriter::ConvertFromIso8859_15)
@@ -18,9 +18,14 @@
 */
 #include "Zeder.h"
 #include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Downloader.h"
 #include "FileUtil.h"
+#include "HttpHeader.h"
 #include "StringUtil.h"
+#include "UBTools.h"
 
 
 namespace Zeder {
@@ -165,14 +170,34 @@ void EntryCollection::addEntry(const Entry &new_entry, const bool sort_after_add
     const iterator match(find(new_entry.getId()));
     if (unlikely(match != end()))
         LOG_ERROR("Duplicate ID " + std::to_string(new_entry.getId()) + "!");
-    else
+    else {
         entries_.emplace_back(new_entry);
+        ids_to_indices_map_[new_entry.getId()] = entries_.size() - 1;
+    }
 
     if (sort_after_add)
         sortEntries();
 }
 
 
+EntryCollection::iterator EntryCollection::erase(iterator entry) {
+    const size_t index(entry - entries_.begin());
+    ids_to_indices_map_.erase(entry->getId());
+    entries_.erase(entry);
+    reindex(index);
+
+    return entries_.begin() + index;
+}
+
+
+void EntryCollection::reindex(const size_t first_index) {
+    if (first_index == 0)
+        ids_to_indices_map_.clear();
+    for (size_t index(first_index); index < entries_.size(); ++index)
+        ids_to_indices_map_[entries_[index].getId()] = index;
+}
+
+
 FileType GetFileTypeFromPath(const std::string &path, bool check_if_file_exists) {
     if (check_if_file_exists and not FileUtil::Exists(path))
         LOG_ERROR("file '" + path + "' not found");
@@ -439,27 +464,11 @@ FullDumpDownloader::Params::Params(const std::string &endpoint_path, const std::
 
 
 bool FullDumpDownloader::downloadData(const std::string &endpoint_url, std::shared_ptr<JSON::JSONNode> * const json_data) {
-    Downloader::Params downloader_params;
-    downloader_params.user_agent_ = "ub_tools/zeder_importer";
-
-    const TimeLimit time_limit(10000U);
-    Downloader downloader(endpoint_url, downloader_params, time_limit);
-
-    if (downloader.anErrorOccurred()) {
-        LOG_WARNING("Couldn't download full from endpoint '" + endpoint_url + "'! Error: " + downloader.getLastErrorMessage());
+    std::string json_blob;
+    if (not GetFullDump(endpoint_url, &json_blob))
         return false;
-    }
-
-    const int response_code_category(downloader.getResponseCode() / 100);
-    switch (response_code_category) {
-    case 4:
-    case 5:
-    case 9:
-        LOG_WARNING("Couldn't download full from endpoint '" + endpoint_url + "'! Error Code: " + std::to_string(downloader.getResponseCode()));
-        return false;
-    }
 
-    JSON::Parser json_parser(downloader.getMessageBody());
+    JSON::Parser json_parser(json_blob);
     if (not json_parser.parse(json_data))
         LOG_ERROR("Couldn't parse JSON response from endpoint '" + endpoint_url + "'! Error: " + json_parser.getErrorMessage());
 
@@ -612,6 +621,95 @@ std::string GetFullDumpEndpointPath(Flavour zeder_flavour) {
 }
 
 
+namespace {
+
+
+const std::string SNAPSHOT_DIRECTORY(UBTools::GetTuelibPath() + "zeder_snapshots/");
+
+
+// \return The ETag of the snapshot at "snapshot_path" or an empty string if we have no ETag or no snapshot.
+std::string ReadSnapshotETag(const std::string &snapshot_path) {
+    std::string etag;
+    if (FileUtil::Exists(snapshot_path + ".etag") and not FileUtil::ReadString(snapshot_path + ".etag", &etag))
+        etag.clear();
+    return etag;
+}
+
+
+void WriteSnapshot(const std::string &snapshot_path, const std::string &json_blob, const std::string &etag) {
+    if (not FileUtil::Exists(SNAPSHOT_DIRECTORY) and not FileUtil::MakeDirectory(SNAPSHOT_DIRECTORY, /* recursive = */true)) {
+        LOG_WARNING("failed to create \"" + SNAPSHOT_DIRECTORY + "\"!");
+        return;
+    }
+
+    // Readers must never see a partially written snapshot, therefore we write to a temporary file and rename it:
+    const std::string temp_path(snapshot_path + ".new");
+    if (not FileUtil::WriteString(temp_path, json_blob) or not FileUtil::RenameFile(temp_path, snapshot_path, /* remove_target = */true)) {
+        LOG_WARNING("failed to write the Zeder snapshot \"" + snapshot_path + "\"!");
+        return;
+    }
+    if (etag.empty())
+        ::unlink((snapshot_path + ".etag").c_str());
+    else if (not FileUtil::WriteString(snapshot_path + ".etag", etag))
+        LOG_WARNING("failed to write the ETag of the Zeder snapshot \"" + snapshot_path + "\"!");
+}
+
+
+void TouchSnapshot(const std::string &snapshot_path) {
+    if (::utimensat(AT_FDCWD, snapshot_path.c_str(), nullptr, 0) != 0)
+        LOG_WARNING("failed to update the modification time of \"" + snapshot_path + "\"!");
+}
+
+
+} // unnamed namespace
+
+
+bool GetFullDump(const std::string &endpoint_url, std::string * const json_blob, const unsigned max_snapshot_age) {
+    const std::string snapshot_path(SNAPSHOT_DIRECTORY + StringUtil::ToHexString(StringUtil::Sha1(endpoint_url)) + ".json");
+
+    struct stat snapshot_stat;
+    const bool have_snapshot(::stat(snapshot_path.c_str(), &snapshot_stat) == 0);
+    if (have_snapshot and snapshot_stat.st_mtime + static_cast<time_t>(max_snapshot_age) > std::time(nullptr)
+        and FileUtil::ReadString(snapshot_path, json_blob))
+        return true;
+
+    Downloader::Params downloader_params;
+    downloader_params.user_agent_ = "ub_tools/zeder_importer";
+    if (have_snapshot)
+        downloader_params.if_none_match_ = ReadSnapshotETag(snapshot_path);
+
+    const TimeLimit time_limit(10000U);
+    Downloader downloader(endpoint_url, downloader_params, time_limit);
+
+    std::string error_message;
+    if (downloader.anErrorOccurred())
+        error_message = downloader.getLastErrorMessage();
+    else if (downloader.getResponseCode() == 304) { // Not Modified
+        TouchSnapshot(snapshot_path);
+        return FileUtil::ReadString(snapshot_path, json_blob);
+    } else {
+        const int response_code_category(downloader.getResponseCode() / 100);
+        if (response_code_category == 4 or response_code_category == 5 or response_code_category == 9)
+            error_message = "Error Code: " + std::to_string(downloader.getResponseCode());
+    }
+
+    if (not error_message.empty()) {
+        if (have_snapshot and FileUtil::ReadString(snapshot_path, json_blob)) {
+            LOG_WARNING("Couldn't download full dump from endpoint '" + endpoint_url + "', using the snapshot from "
+                        + TimeUtil::TimeTToLocalTimeString(snapshot_stat.st_mtime) + "! Error: " + error_message);
+            return true;
+        }
+
+        LOG_WARNING("Couldn't download full dump from endpoint '" + endpoint_url + "'! Error: " + error_message);
+        return false;
+    }
+
+    *json_blob = downloader.getMessageBody();
+    WriteSnapshot(snapshot_path, *json_blob, downloader.getHttpHeader().getETag());
+    return true;
+}
+
+
 Flavour ParseFlavour(const std::string &flavour, const bool case_sensitive) {
     std::string flavour_str(flavour);
     std::string ixtheo_str(FLAVOUR_TO_STRING_MAP.at(IXTHEO));
@@ -20,7 +20,10 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Zotero.h"
+#include <algorithm>
 #include <chrono>
+#include <limits>
+#include <mutex>
 #include <ctime>
 #include <uuid/uuid.h>
 #include "DbConnection.h"
@@ -32,6 +35,7 @@
 #include "SqlUtil.h"
 #include "StringUtil.h"
 #include "SyndicationFormat.h"
+#include "ThreadUtil.h"
 #include "TimeUtil.h"
 #include "util.h"
 #include "UBTools.h"
@@ -82,38 +86,68 @@ bool ResponseCodeIndicatesSuccess(unsigned response_code, const std::string &res
 }
 
 
-bool Export(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Params downloader_params,
-            const std::string &format, const std::string &json, std::string * const response_body, std::string * const error_message)
+namespace {
+
+
+// Round-trip times in milliseconds per endpoint, for GetLatencyReport().
+std::mutex latency_mutex;
+std::map<std::string, std::vector<unsigned>> endpoints_to_latencies_map;
+
+
+// Posts "post_data" to "endpoint" of the translation server.  We don't need to manage any connections of our own here,
+// as the Downloader class hands its easy handles, and thus the open connections, on to later instances for the same host.
+bool Post(const Url &zts_server_url, const std::string &endpoint, const std::string &query, const TimeLimit &time_limit,
+          Downloader::Params downloader_params, const std::string &post_data, std::string * const response_body,
+          unsigned * const response_code, std::string * const error_message)
 {
-    const std::string endpoint_url(Url(zts_server_url.toString() + "/export?format=" + format));
-    downloader_params.additional_headers_ = { "Content-Type: application/json" };
-    downloader_params.post_data_ = json;
+    const std::string endpoint_url(Url(zts_server_url.toString() + "/" + endpoint + (query.empty() ? "" : "?" + query)));
+    downloader_params.post_data_ = post_data;
 
+    const auto start_time(std::chrono::steady_clock::now());
     Downloader downloader(endpoint_url, downloader_params, time_limit);
+    const auto latency(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time));
+    {
+        std::lock_guard<std::mutex> latency_locker(latency_mutex);
+        endpoints_to_latencies_map[endpoint].emplace_back(latency.count());
+    }
+
     if (downloader.anErrorOccurred()) {
         *error_message = downloader.getLastErrorMessage();
         return false;
     } else {
+        *response_code = downloader.getResponseCode();
         *response_body = downloader.getMessageBody();
-        return ResponseCodeIndicatesSuccess(downloader.getResponseCode(), *response_body, error_message);
+        return ResponseCodeIndicatesSuccess(*response_code, *response_body, error_message);
     }
 }
 
 
+// Nearest-rank method, "sorted_values" must not be empty.
+unsigned GetPercentile(const std::vector<unsigned> &sorted_values, const unsigned percentile) {
+    const size_t rank((percentile * sorted_values.size() + 99) / 100);
+    return sorted_values[rank == 0 ? 0 : rank - 1];
+}
+
+
+} // unnamed namespace
+
+
+bool Export(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Params downloader_params,
+            const std::string &format, const std::string &json, std::string * const response_body, std::string * const error_message)
+{
+    downloader_params.additional_headers_ = { "Content-Type: application/json" };
+    unsigned response_code;
+    return Post(zts_server_url, "export", "format=" + format, time_limit, downloader_params, json, response_body, &response_code,
+                error_message);
+}
+
+
 bool Import(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Params downloader_params,
             const std::string &input_content, std::string * const output_json, std::string * const error_message)
 {
-    const std::string endpoint_url(Url(zts_server_url.toString() + "/import"));
-    downloader_params.post_data_ = input_content;
-
-    Downloader downloader(endpoint_url, downloader_params, time_limit);
-    if (downloader.anErrorOccurred()) {
-        *error_message = downloader.getLastErrorMessage();
-        return false;
-    } else {
-        *output_json = downloader.getMessageBody();
-        return ResponseCodeIndicatesSuccess(downloader.getResponseCode(), *output_json, error_message);
-    }
+    unsigned response_code;
+    return Post(zts_server_url, "import", "", time_limit, downloader_params, input_content, output_json, &response_code,
+                error_message);
 }
 
 
@@ -121,19 +155,9 @@ bool Web(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Par
          const Url &harvest_url, std::string * const response_body, unsigned * response_code,
          std::string * const error_message)
 {
-    const std::string endpoint_url(Url(zts_server_url.toString() + "/web"));
     downloader_params.additional_headers_ = { "Accept: application/json", "Content-Type: text/plain" };
-    downloader_params.post_data_ = harvest_url;
-
-    Downloader downloader(endpoint_url, downloader_params, time_limit);
-    if (downloader.anErrorOccurred()) {
-        *error_message = downloader.getLastErrorMessage();
-        return false;
-    } else {
-        *response_code = downloader.getResponseCode();
-        *response_body = downloader.getMessageBody();
-        return ResponseCodeIndicatesSuccess(*response_code, *response_body, error_message);
-    }
+    return Post(zts_server_url, "web", "", time_limit, downloader_params, harvest_url, response_body, response_code,
+                error_message);
 }
 
 
@@ -141,19 +165,27 @@ bool Web(const Url &zts_server_url, const TimeLimit &time_limit, Downloader::Par
          const std::string &request_body, std::string * const response_body, unsigned * response_code,
          std::string * const error_message)
 {
-    const std::string endpoint_url(Url(zts_server_url.toString() + "/web"));
     downloader_params.additional_headers_ = { "Accept: application/json", "Content-Type: application/json" };
-    downloader_params.post_data_ = request_body;
+    return Post(zts_server_url, "web", "", time_limit, downloader_params, request_body, response_body, response_code,
+                error_message);
+}
 
-    Downloader downloader(endpoint_url, downloader_params, time_limit);
-    if (downloader.anErrorOccurred()) {
-        *error_message = downloader.getLastErrorMessage();
-        return false;
-    } else {
-        *response_code = downloader.getResponseCode();
-        *response_body = downloader.getMessageBody();
-        return ResponseCodeIndicatesSuccess(*response_code, *response_body, error_message);
+
+std::string GetLatencyReport() {
+    std::lock_guard<std::mutex> latency_locker(latency_mutex);
+
+    std::string report;
+    for (const auto &endpoint_and_latencies : endpoints_to_latencies_map) {
+        std::vector<unsigned> sorted_latencies(endpoint_and_latencies.second);
+        std::sort(sorted_latencies.begin(), sorted_latencies.end());
+        report += "/" + endpoint_and_latencies.first + ": " + std::to_string(sorted_latencies.size()) + " request(s), "
+                  + "50%: " + std::to_string(GetPercentile(sorted_latencies, 50)) + " ms, "
+                  + "90%: " + std::to_string(GetPercentile(sorted_latencies, 90)) + " ms, "
+                  + "99%: " + std::to_string(GetPercentile(sorted_latencies, 99)) + " ms, "
+                  + "max: " + std::to_string(sorted_latencies.back()) + " ms\n";
     }
+
+    return report;
 }
 
 
@@ -194,38 +226,36 @@ std::unique_ptr<FormatHandler> FormatHandler::Factory(DbConnection * const db_co
 
 JsonFormatHandler::JsonFormatHandler(DbConnection * const db_connection, const std::string &output_format,
                                      const std::string &output_file, const std::shared_ptr<const HarvestParams> &harvest_params)
-    : FormatHandler(db_connection, output_format, output_file, harvest_params), record_count_(0),
-      output_file_object_(new File(output_file_, "w"))
+    : FormatHandler(db_connection, output_format, output_file, harvest_params),
+      output_file_object_(new File(output_file_, "w")), json_writer_(output_file_object_)
 {
-    output_file_object_->write("[");
+    json_writer_.beginArray();
 }
 
 
 JsonFormatHandler::~JsonFormatHandler() {
-    output_file_object_->write("]");
+    json_writer_.endArray();
+    json_writer_.flush();
     delete output_file_object_;
 }
 
 
 std::pair<unsigned, unsigned> JsonFormatHandler::processRecord(const std::shared_ptr<const JSON::ObjectNode> &object_node) {
-    if (record_count_ > 0)
-        output_file_object_->write(",");
-    output_file_object_->write(object_node->toString());
-    ++record_count_;
+    json_writer_.nodeValue(*object_node);
     return std::make_pair(1, 0);
 }
 
 
 ZoteroFormatHandler::ZoteroFormatHandler(DbConnection * const db_connection, const std::string &output_format,
                                          const std::string &output_file, const std::shared_ptr<const HarvestParams> &harvest_params)
-    : FormatHandler(db_connection, output_format, output_file, harvest_params), record_count_(0),
-      json_buffer_("[")
+    : FormatHandler(db_connection, output_format, output_file, harvest_params), json_writer_(&json_buffer_)
 {
+    json_writer_.beginArray();
 }
 
 
 ZoteroFormatHandler::~ZoteroFormatHandler() {
-    json_buffer_ += "]";
+    json_writer_.endArray();
 
     Downloader::Params downloader_params;
     std::string response_body;
@@ -239,10 +269,7 @@ ZoteroFormatHandler::~ZoteroFormatHandler() {
 
 
 std::pair<unsigned, unsigned> ZoteroFormatHandler::processRecord(const std::shared_ptr<const JSON::ObjectNode> &object_node) {
-    if (record_count_ > 0)
-        json_buffer_ += ",";
-    json_buffer_ += object_node->toString();
-    ++record_count_;
+    json_writer_.nodeValue(*object_node);
     return std::make_pair(1, 0);
 }
 
@@ -442,62 +469,76 @@ static const size_t MIN_CONTROl_FIELD_LENGTH(1);
 static const size_t MIN_DATA_FIELD_LENGTH(2 /*indicators*/ + 1 /*subfield separator*/ + 1 /*subfield code*/ + 1 /*subfield value*/);
 
 
-static bool InsertAdditionalField(MARC::Record * const record, const std::string &additional_field) {
+static bool ParseAdditionalField(const std::string &additional_field, std::pair<MARC::Tag, std::string> * const tag_and_contents) {
     if (unlikely(additional_field.length() < MARC::Record::TAG_LENGTH))
         return false;
     const MARC::Tag tag(additional_field.substr(0, MARC::Record::TAG_LENGTH));
     if ((tag.isTagOfControlField() and additional_field.length() < MARC::Record::TAG_LENGTH + MIN_CONTROl_FIELD_LENGTH)
         or (not tag.isTagOfControlField() and additional_field.length() < MARC::Record::TAG_LENGTH + MIN_DATA_FIELD_LENGTH))
         return false;
-    record->insertField(tag, additional_field.substr(MARC::Record::TAG_LENGTH));
+    *tag_and_contents = std::make_pair(tag, additional_field.substr(MARC::Record::TAG_LENGTH));
 
     return true;
 }
 
 
-static void InsertAdditionalFields(const std::string &parameter_source, MARC::Record * const record,
-                                   const std::vector<std::string> &additional_fields)
+static void ParseAdditionalFields(const std::string &parameter_source, const std::vector<std::string> &additional_fields,
+                                  std::vector<std::pair<MARC::Tag, std::string>> * const tags_and_contents)
 {
     for (const auto &additional_field : additional_fields) {
-        if (not InsertAdditionalField(record, additional_field))
+        std::pair<MARC::Tag, std::string> tag_and_contents;
+        if (not ParseAdditionalField(additional_field, &tag_and_contents))
             LOG_ERROR("bad additional field \"" + StringUtil::CStyleEscape(additional_field) +"\" in \"" + parameter_source + "\"!");
+        tags_and_contents->emplace_back(tag_and_contents);
     }
 }
 
 
-static void ProcessNonStandardMetadata(MARC::Record * const record, const std::map<std::string, std::string> &notes_key_value_pairs,
-                                       const std::vector<std::string> &non_standard_metadata_fields)
-{
-    static auto placeholder_matcher(RegexMatcher::RegexMatcherFactoryOrDie("%(.+)%"));
+MarcFormatHandler::SitePlan::SitePlan(const SiteParams &site_params) {
+    ParseAdditionalFields("site params (" + site_params.journal_name_ + ")", site_params.additional_fields_, &additional_fields_);
+    ParseAdditionalFields("group params (" + site_params.group_params_->name_ + ")", site_params.group_params_->additional_fields_,
+                          &additional_fields_);
 
-    for (auto non_standard_metadata_field : non_standard_metadata_fields) {
+    static auto placeholder_matcher(RegexMatcher::RegexMatcherFactoryOrDie("%(.+)%"));
+    for (const auto &non_standard_metadata_field : site_params.non_standard_metadata_fields_) {
         if (not placeholder_matcher->matched(non_standard_metadata_field))
             LOG_WARNING("non-standard metadata field '" + non_standard_metadata_field + "' has no placeholders");
-        else {
-            std::string first_missing_placeholder;
-            for (unsigned i(1); i < placeholder_matcher->getLastMatchCount(); ++i) {
-                const auto placeholder((*placeholder_matcher)[i]);
-                const auto note_match(notes_key_value_pairs.find(placeholder));
-                if (note_match == notes_key_value_pairs.end()) {
-                    first_missing_placeholder = placeholder;
-                    break;
-                }
+        else
+            non_standard_metadata_fields_.emplace_back(NonStandardMetadataField{ non_standard_metadata_field, (*placeholder_matcher)[1],
+                                                                                 (*placeholder_matcher)[0] });
+    }
+}
 
-                non_standard_metadata_field = StringUtil::ReplaceString((*placeholder_matcher)[0], note_match->second,
-                                                                        non_standard_metadata_field);
-            }
 
-            if (not first_missing_placeholder.empty()) {
-                LOG_DEBUG("non-standard metadata field '" + non_standard_metadata_field + "' has missing placeholder(s) '" +
-                            first_missing_placeholder + "'");
-                break;
-            }
+const MarcFormatHandler::SitePlan &MarcFormatHandler::getSitePlan() {
+    auto site_params_and_plan(site_params_to_plan_map_.find(site_params_));
+    if (site_params_and_plan == site_params_to_plan_map_.end())
+        site_params_and_plan = site_params_to_plan_map_.emplace(site_params_,
+                                                                std::unique_ptr<const SitePlan>(new SitePlan(*site_params_))).first;
+    return *site_params_and_plan->second;
+}
 
-            if (InsertAdditionalField(record, non_standard_metadata_field))
-                LOG_DEBUG("inserted non-standard metadata field '" + non_standard_metadata_field + "'");
-            else
-                LOG_ERROR("failed to add non-standard metadata field! (Content was \"" + non_standard_metadata_field + "\")");
+
+void MarcFormatHandler::InsertNonStandardMetadata(MARC::Record * const record,
+                                                  const std::map<std::string, std::string> &notes_key_value_pairs,
+                                                  const std::vector<SitePlan::NonStandardMetadataField> &non_standard_metadata_fields)
+{
+    for (const auto &non_standard_metadata_field : non_standard_metadata_fields) {
+        const auto note_match(notes_key_value_pairs.find(non_standard_metadata_field.placeholder_));
+        if (note_match == notes_key_value_pairs.end()) {
+            LOG_DEBUG("non-standard metadata field '" + non_standard_metadata_field.field_template_ + "' has missing placeholder(s) '"
+                      + non_standard_metadata_field.placeholder_ + "'");
+            break;
         }
+
+        const std::string field(StringUtil::ReplaceString(non_standard_metadata_field.placeholder_and_delimiters_, note_match->second,
+                                                          non_standard_metadata_field.field_template_));
+        std::pair<MARC::Tag, std::string> tag_and_contents;
+        if (ParseAdditionalField(field, &tag_and_contents)) {
+            record->insertField(tag_and_contents.first, tag_and_contents.second);
+            LOG_DEBUG("inserted non-standard metadata field '" + field + "'");
+        } else
+            LOG_ERROR("failed to add non-standard metadata field! (Content was \"" + field + "\")");
     }
 }
 
@@ -525,8 +566,10 @@ void SelectIssnAndPpn(const std::string &issn_zotero, const std::string &issn_on
 }
 
 
-void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const struct ItemParameters &node_parameters) {
-    const std::string item_type(node_parameters.item_type_);
+void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const struct ItemParameters &node_parameters,
+                                           const SitePlan &site_plan)
+{
+    const std::string &item_type(node_parameters.item_type_);
     *record = MARC::Record(MARC::Record::TypeOfRecord::LANGUAGE_MATERIAL, Transformation::MapBiblioLevel(item_type));
 
     // Control Fields
@@ -534,7 +577,7 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
     // Handle 001 only at the end since we need a proper hash value
     // -> c.f. last line of this function
 
-    const std::string isil(node_parameters.isil_);
+    const std::string &isil(node_parameters.isil_);
     record->insertField("003", isil);
 
     // ISSN and physical description
@@ -593,17 +636,17 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
         year = TimeUtil::GetCurrentYear();
     record->insertField("264", { { 'c', year } });
 
-    const std::string date(node_parameters.date_);
+    const std::string &date(node_parameters.date_);
     if (not date.empty() and item_type != "journalArticle" and item_type != "review")
         record->insertField("362", { { 'a', date } });
 
     // URL
-    const std::string url(node_parameters.url_);
+    const std::string &url(node_parameters.url_);
     if (not url.empty())
         record->insertField("856", { { 'u', url } }, /* indicator1 = */'4', /* indicator2 = */'0');
 
     // DOI
-    const std::string doi(node_parameters.doi_);
+    const std::string &doi(node_parameters.doi_);
     if (not doi.empty()) {
         record->insertField("024", { { 'a', doi }, { '2', "doi" } }, '7');
         const std::string doi_url("https://doi.org/" + doi);
@@ -616,7 +659,7 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
         record->insertField("655", { { 'a', "!106186019!" }, { '0', "(DE-588)" } }, /* indicator1 = */' ', /* indicator2 = */'7');
 
     // License data
-    const std::string license(node_parameters.license_);
+    const std::string &license(node_parameters.license_);
     if (license == "l")
         record->insertField("856", { { 'z', "Kostenfrei" } }, /* indicator1 = */'4', /* indicator2 = */'0');
     else if (license == "kw")
@@ -624,8 +667,8 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
 
     // Differentiating information about source (see BSZ Konkordanz MARC 936)
     MARC::Subfields _936_subfields;
-    const std::string volume(node_parameters.volume_);
-    const std::string issue(node_parameters.issue_);
+    const std::string &volume(node_parameters.volume_);
+    const std::string &issue(node_parameters.issue_);
     if (not volume.empty()) {
         _936_subfields.appendSubfield('d', volume);
         if (not issue.empty())
@@ -633,7 +676,7 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
     } else if (not issue.empty())
         _936_subfields.appendSubfield('d', issue);
 
-    const std::string pages(node_parameters.pages_);
+    const std::string &pages(node_parameters.pages_);
     if (not pages.empty())
         _936_subfields.appendSubfield('h', pages);
 
@@ -643,7 +686,7 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
 
     // Information about superior work (See BSZ Konkordanz MARC 773)
     MARC::Subfields _773_subfields;
-    const std::string publication_title(node_parameters.publication_title_);
+    const std::string &publication_title(node_parameters.publication_title_);
     if (not publication_title.empty()) {
         _773_subfields.appendSubfield('i', "In: ");
         _773_subfields.appendSubfield('t', publication_title);
@@ -679,10 +722,10 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
         record->insertField(MARC::GetIndexField(TextUtil::CollapseAndTrimWhitespace(keyword)));
 
     // SSG numbers
-    const auto ssg_numbers(node_parameters.ssg_numbers_);
+    const auto &ssg_numbers(node_parameters.ssg_numbers_);
     if (not ssg_numbers.empty()) {
         MARC::Subfields _084_subfields;
-        for (const auto ssg_number : ssg_numbers)
+        for (const auto &ssg_number : ssg_numbers)
             _084_subfields.appendSubfield('a', ssg_number);
         _084_subfields.appendSubfield('0', "ssgn");
     }
@@ -690,11 +733,10 @@ void MarcFormatHandler::generateMarcRecord(MARC::Record * const record, const st
     record->insertField("001", site_params_->group_params_->name_ + "#" + TimeUtil::GetCurrentDateAndTime("%Y-%m-%d")
                         + "#" + StringUtil::ToHexString(MARC::CalcChecksum(*record)));
 
-    InsertAdditionalFields("site params (" + site_params_->journal_name_ + ")", record, site_params_->additional_fields_);
-    InsertAdditionalFields("group params (" + site_params_->group_params_->name_ + ")", record,
-                           site_params_->group_params_->additional_fields_);
+    for (const auto &tag_and_contents : site_plan.additional_fields_)
+        record->insertField(tag_and_contents.first, tag_and_contents.second);
 
-    ProcessNonStandardMetadata(record, node_parameters.notes_key_value_pairs_, site_params_->non_standard_metadata_fields_);
+    InsertNonStandardMetadata(record, node_parameters.notes_key_value_pairs_, site_plan.non_standard_metadata_fields_);
 
     if (not site_params_->zeder_id_.empty())
         record->insertField("ZID", { { 'a', site_params_->zeder_id_ } });
@@ -816,7 +858,7 @@ std::pair<unsigned, unsigned> MarcFormatHandler::processRecord(const std::shared
     mergeCustomParametersToItemParameters(&item_parameters, custom_node_params);
 
     MARC::Record new_record(std::string(MARC::Record::LEADER_LENGTH, ' ') /*empty dummy leader*/);
-    generateMarcRecord(&new_record, item_parameters);
+    generateMarcRecord(&new_record, item_parameters, getSitePlan());
 
     std::string exclusion_string;
     if (recordMatchesExclusionFilters(new_record, &exclusion_string)) {
@@ -852,6 +894,8 @@ inline std::string OptionalMap(const std::string &key, const std::unordered_map<
 void AugmentJsonCreators(const std::shared_ptr<JSON::ArrayNode> creators_array, const SiteParams &site_params,
                          std::vector<std::string> * const comments)
 {
+    std::vector<std::string> names;
+    std::vector<std::shared_ptr<JSON::ObjectNode>> named_creator_objects;
     for (size_t i(0); i < creators_array->size(); ++i) {
         const std::shared_ptr<JSON::ObjectNode> creator_object(creators_array->getObjectNode(i));
 
@@ -871,17 +915,8 @@ void AugmentJsonCreators(const std::shared_ptr<JSON::ArrayNode> creators_array,
             if (not first_name.empty())
                 name += ", " + first_name;
 
-            const std::string PPN(BSZTransform::DownloadAuthorPPN(name, site_params.group_params_->author_ppn_lookup_url_));
-            if (not PPN.empty()) {
-                comments->emplace_back("Added author PPN " + PPN + " for author " + name);
-                creator_object->insert("ppn", std::make_shared<JSON::StringNode>(PPN));
-            }
-
-            const std::string gnd_number(LobidUtil::GetAuthorGNDNumber(name, site_params.group_params_->author_gnd_lookup_query_params_));
-            if (not gnd_number.empty()) {
-                comments->emplace_back("Added author GND number " + gnd_number + " for author " + name);
-                creator_object->insert("gnd_number", std::make_shared<JSON::StringNode>(gnd_number));
-            }
+            names.emplace_back(name);
+            named_creator_objects.emplace_back(creator_object);
         }
 
         if (first_name_node != nullptr)
@@ -889,6 +924,26 @@ void AugmentJsonCreators(const std::shared_ptr<JSON::ArrayNode> creators_array,
         if (last_name_node != nullptr)
             JSON::JSONNode::CastToStringNodeOrDie("lastName", last_name_node)->setValue(last_name);
     }
+
+    // Look up the PPN's of all creators at once so that uncached lookups can run concurrently:
+    const auto names_to_ppns(BSZTransform::DownloadAuthorPPNs(names, site_params.group_params_->author_ppn_lookup_url_));
+    for (size_t i(0); i < names.size(); ++i) {
+        const auto name_and_ppn(names_to_ppns.find(names[i]));
+        if (name_and_ppn != names_to_ppns.cend()) {
+            comments->emplace_back("Added author PPN " + name_and_ppn->second + " for author " + names[i]);
+            named_creator_objects[i]->insert("ppn", std::make_shared<JSON::StringNode>(name_and_ppn->second));
+        }
+    }
+
+    // Look up the GND numbers of all creators at once so that the Lobid queries can run concurrently:
+    const auto names_to_gnd_numbers(LobidUtil::GetAuthorGNDNumbers(names, site_params.group_params_->author_gnd_lookup_query_params_));
+    for (size_t i(0); i < names.size(); ++i) {
+        const auto name_and_gnd_number(names_to_gnd_numbers.find(names[i]));
+        if (name_and_gnd_number != names_to_gnd_numbers.cend()) {
+            comments->emplace_back("Added author GND number " + name_and_gnd_number->second + " for author " + names[i]);
+            named_creator_objects[i]->insert("gnd_number", std::make_shared<JSON::StringNode>(name_and_gnd_number->second));
+        }
+    }
 }
 
 
@@ -1122,54 +1177,122 @@ bool ValidateAugmentedJSON(const std::shared_ptr<JSON::ObjectNode> &entry, const
 }
 
 
+namespace {
+
+
+// When harvesting concurrently, a thread has to hold harvester_mutex for everything but waiting on the network.
+bool concurrent_harvesting_enabled(false);
+std::mutex harvester_mutex;
+thread_local bool holds_harvester_mutex(false);
+std::unique_ptr<ThreadUtil::Semaphore> zts_request_semaphore;
+
+
+// Acquires harvester_mutex for the lifetime of an instance unless the current thread already holds it.
+class HarvesterLocker {
+    bool locked_;
+public:
+    HarvesterLocker(): locked_(concurrent_harvesting_enabled and not holds_harvester_mutex) {
+        if (locked_) {
+            harvester_mutex.lock();
+            holds_harvester_mutex = true;
+        }
+    }
+    ~HarvesterLocker() {
+        if (locked_) {
+            holds_harvester_mutex = false;
+            harvester_mutex.unlock();
+        }
+    }
+};
+
+
+// Releases harvester_mutex, if the current thread holds it, for the lifetime of an instance.
+class NetworkWait {
+    bool unlocked_;
+public:
+    NetworkWait(): unlocked_(holds_harvester_mutex) {
+        if (unlocked_) {
+            holds_harvester_mutex = false;
+            harvester_mutex.unlock();
+        }
+    }
+    ~NetworkWait() {
+        if (unlocked_) {
+            harvester_mutex.lock();
+            holds_harvester_mutex = true;
+        }
+    }
+};
+
+
+// Occupies one of the translation server request slots for the lifetime of an instance.
+class TranslationServerSlot {
+public:
+    TranslationServerSlot() {
+        if (zts_request_semaphore != nullptr)
+            zts_request_semaphore->wait();
+    }
+    ~TranslationServerSlot() {
+        if (zts_request_semaphore != nullptr)
+            zts_request_semaphore->post();
+    }
+};
+
+
+} // unnamed namespace
+
+
+void EnableConcurrentHarvesting(const unsigned max_concurrent_zts_requests) {
+    if (unlikely(max_concurrent_zts_requests == 0))
+        LOG_ERROR("max_concurrent_zts_requests must be greater than zero!");
+
+    zts_request_semaphore.reset(new ThreadUtil::Semaphore(max_concurrent_zts_requests));
+    concurrent_harvesting_enabled = true;
+}
+
+
 void ApplyCrawlDelay(const std::string &harvest_url, const std::shared_ptr<HarvestParams> &harvest_params) {
     struct CrawlDelayParams {
-        RobotsDotTxt robots_dot_txt_;
-        TimeLimit crawl_timeout_;
+        std::mutex mutex_; // Serialises the waits for a single domain.
+        unsigned crawl_delay_; // in ms
     public:
-        CrawlDelayParams(const std::shared_ptr<HarvestParams> &harvest_parameters, const std::string &robots_dot_txt)
-         : robots_dot_txt_(robots_dot_txt), crawl_timeout_(robots_dot_txt_.getCrawlDelay("*") * 1000)
-        {
-            if (crawl_timeout_.getLimit() < harvest_parameters->default_crawl_delay_time_)
-                crawl_timeout_ = harvest_parameters->default_crawl_delay_time_;
-        }
-        CrawlDelayParams(const std::shared_ptr<HarvestParams> &harvest_parameters, const TimeLimit &crawl_timeout)
-         : crawl_timeout_(crawl_timeout)
-        {
-            if (crawl_timeout_.getLimit() < harvest_parameters->default_crawl_delay_time_)
-                crawl_timeout_ = harvest_parameters->default_crawl_delay_time_;
-        }
+        explicit CrawlDelayParams(const unsigned crawl_delay): crawl_delay_(crawl_delay) { }
     };
 
-    static std::unordered_map<std::string, CrawlDelayParams> HOSTNAME_TO_DELAY_PARAMS_MAP;
+    static std::unordered_map<std::string, std::unique_ptr<CrawlDelayParams>> HOSTNAME_TO_DELAY_PARAMS_MAP;
 
     const Url parsed_url(harvest_url);
     const auto hostname(parsed_url.getAuthority());
-    auto delay_params(HOSTNAME_TO_DELAY_PARAMS_MAP.find(hostname));
+    auto hostname_and_delay_params(HOSTNAME_TO_DELAY_PARAMS_MAP.find(hostname));
 
-    if (delay_params == HOSTNAME_TO_DELAY_PARAMS_MAP.end()) {
-        Downloader robots_txt_downloader(parsed_url.getRobotsDotTxtUrl());
-        if (robots_txt_downloader.anErrorOccurred()) {
-            CrawlDelayParams default_delay_params(harvest_params, harvest_params->default_crawl_delay_time_);
-            HOSTNAME_TO_DELAY_PARAMS_MAP.insert(std::make_pair(hostname, default_delay_params));
-
-            LOG_DEBUG("couldn't retrieve robots.txt for domain '" + hostname + "'");
-            return;
+    if (hostname_and_delay_params == HOSTNAME_TO_DELAY_PARAMS_MAP.end()) {
+        std::shared_ptr<const RobotsDotTxt> robots_dot_txt;
+        {
+            const NetworkWait network_wait;
+            Downloader robots_dot_txt_downloader;
+            robots_dot_txt = robots_dot_txt_downloader.getRobotsDotTxt(parsed_url);
         }
 
-        CrawlDelayParams new_delay_params(harvest_params, robots_txt_downloader.getMessageBody());
-        HOSTNAME_TO_DELAY_PARAMS_MAP.insert(std::make_pair(hostname, new_delay_params));
-        delay_params = HOSTNAME_TO_DELAY_PARAMS_MAP.find(hostname);
+        unsigned crawl_delay(harvest_params->default_crawl_delay_time_);
+        if (robots_dot_txt != nullptr and robots_dot_txt->getCrawlDelay("*") * 1000 > crawl_delay)
+            crawl_delay = robots_dot_txt->getCrawlDelay("*") * 1000;
+
+        // Another thread may have beaten us to it while we were waiting for the robots.txt, in which case we use its entry:
+        hostname_and_delay_params = HOSTNAME_TO_DELAY_PARAMS_MAP.emplace(
+            hostname, std::unique_ptr<CrawlDelayParams>(new CrawlDelayParams(crawl_delay))).first;
 
-        LOG_INFO("set crawl-delay for domain '" + hostname + "' to " +
-                 std::to_string(new_delay_params.crawl_timeout_.getLimit()) + " ms");
+        LOG_INFO("set crawl-delay for domain '" + hostname + "' to "
+                 + std::to_string(hostname_and_delay_params->second->crawl_delay_) + " ms");
     }
 
-    auto &current_delay_params(delay_params->second);
+    // Entries are never removed, so we can safely hold on to this after releasing the harvester mutex:
+    CrawlDelayParams &delay_params(*hostname_and_delay_params->second);
 
-    LOG_DEBUG("sleeping for " + std::to_string(current_delay_params.crawl_timeout_.getLimit()) + " ms...");
-    current_delay_params.crawl_timeout_.restart();
-    current_delay_params.crawl_timeout_.sleepUntilExpired();
+    const NetworkWait network_wait;
+    std::lock_guard<std::mutex> domain_locker(delay_params.mutex_);
+    LOG_DEBUG("sleeping for " + std::to_string(delay_params.crawl_delay_) + " ms...");
+    TimeLimit crawl_timeout(delay_params.crawl_delay_);
+    crawl_timeout.sleepUntilExpired();
 }
 
 
@@ -1179,6 +1302,7 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
     if (harvest_url.empty())
         LOG_ERROR("empty URL passed to Zotero::Harvest");
 
+    const HarvesterLocker harvester_locker;
     std::pair<unsigned, unsigned> record_count_and_previously_downloaded_count;
     static std::unordered_set<std::string> already_harvested_urls;
 
@@ -1209,8 +1333,8 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
         }
     }
 
-    ApplyCrawlDelay(harvest_url, harvest_params);
     already_harvested_urls.emplace(harvest_url);
+    ApplyCrawlDelay(harvest_url, harvest_params);
     auto error_logger_context(error_logger->newContext(site_params.journal_name_, harvest_url));
 
     LOG_INFO("\nHarvesting URL: " + harvest_url);
@@ -1222,9 +1346,14 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
     if (site_params.banned_url_regex_ != nullptr)
         downloader_params.banned_reg_exps_.addPattern(site_params.banned_url_regex_->getPattern());
 
-    bool download_succeeded(TranslationServer::Web(harvest_params->zts_server_url_, /* time_limit = */ DEFAULT_TIMEOUT,
-                                                   downloader_params, Url(harvest_url), &response_body, &response_code,
-                                                   &error_message));
+    bool download_succeeded;
+    {
+        const NetworkWait network_wait;
+        const TranslationServerSlot translation_server_slot;
+        download_succeeded = TranslationServer::Web(harvest_params->zts_server_url_, /* time_limit = */ DEFAULT_TIMEOUT,
+                                                    downloader_params, Url(harvest_url), &response_body, &response_code,
+                                                    &error_message);
+    }
 
     if (not download_succeeded) {
         error_logger_context.log(HarvesterErrorLogger::ZTS_CONVERSION_FAILED, error_message);
@@ -1234,8 +1363,13 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
     // 300 => multiple matches found, try to harvest children (send the response_body right back to the server, to get all of them)
     if (response_code == 300) {
         LOG_DEBUG("multiple articles found => trying to harvest children");
-        download_succeeded = TranslationServer::Web(harvest_params->zts_server_url_, /* time_limit = */ DEFAULT_TIMEOUT,
-                                                    downloader_params, response_body, &response_body, &response_code, &error_message);
+        {
+            const NetworkWait network_wait;
+            const TranslationServerSlot translation_server_slot;
+            download_succeeded = TranslationServer::Web(harvest_params->zts_server_url_, /* time_limit = */ DEFAULT_TIMEOUT,
+                                                        downloader_params, response_body, &response_body, &response_code,
+                                                        &error_message);
+        }
         if (not download_succeeded) {
             error_logger_context.log(HarvesterErrorLogger::DOWNLOAD_MULTIPLE_FAILED, error_message);
             return record_count_and_previously_downloaded_count;
@@ -1253,6 +1387,9 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
     auto json_array(JSON::JSONNode::CastToArrayNodeOrDie("tree_root", tree_root));
     PreprocessHarvesterResponse(&json_array);
 
+    // Other threads may have used the format handler for other sites in the meantime:
+    harvest_params->format_handler_->setAugmentParams(&site_params);
+
     int processed_json_entries(0);
     for (const auto entry : *json_array) {
         const std::shared_ptr<JSON::ObjectNode> json_object(JSON::JSONNode::CastToObjectNodeOrDie("entry", entry));
@@ -1284,20 +1421,32 @@ std::pair<unsigned, unsigned> Harvest(const std::string &harvest_url, const std:
 }
 
 
+// Crawling mostly means waiting for downloads, so we let other harvesting threads proceed in the meantime.
+static bool GetNextPage(SimpleCrawler * const crawler, SimpleCrawler::PageDetails * const page_details) {
+    const NetworkWait network_wait;
+    return crawler->getNextPage(page_details);
+}
+
+
 UnsignedPair HarvestSite(const SimpleCrawler::SiteDesc &site_desc, SimpleCrawler::Params crawler_params,
                          const std::shared_ptr<RegexMatcher> &supported_urls_regex,
                          const std::shared_ptr<HarvestParams> &harvest_params, const SiteParams &site_params,
                          HarvesterErrorLogger * const error_logger, File * const progress_file)
 {
+    const HarvesterLocker harvester_locker;
     UnsignedPair total_record_count_and_previously_downloaded_record_count;
     LOG_DEBUG("\n\nStarting crawl at base URL: " +  site_desc.start_url_);
     crawler_params.proxy_host_and_port_ = GetProxyHostAndPort();
     if (not crawler_params.proxy_host_and_port_.empty())
         crawler_params.ignore_ssl_certificates_ = true;
-    SimpleCrawler crawler(site_desc, crawler_params);
+    std::unique_ptr<SimpleCrawler> crawler;
+    {
+        const NetworkWait network_wait; // The constructor downloads the robots.txt.
+        crawler.reset(new SimpleCrawler(site_desc, crawler_params));
+    }
     SimpleCrawler::PageDetails page_details;
     unsigned processed_url_count(0);
-    while (crawler.getNextPage(&page_details)) {
+    while (GetNextPage(crawler.get(), &page_details)) {
         if (not supported_urls_regex->matched(page_details.url_))
             LOG_DEBUG("Skipping unsupported URL: " + page_details.url_);
         else if (page_details.error_message_.empty()) {
@@ -1308,7 +1457,7 @@ UnsignedPair HarvestSite(const SimpleCrawler::SiteDesc &site_desc, SimpleCrawler
             if (progress_file != nullptr) {
                 progress_file->rewind();
                 if (unlikely(not progress_file->write(
-                    std::to_string(processed_url_count) + ";" + std::to_string(crawler.getRemainingCallDepth()) + ";" + page_details.url_)))
+                    std::to_string(processed_url_count) + ";" + std::to_string(crawler->getRemainingCallDepth()) + ";" + page_details.url_)))
                     LOG_ERROR("failed to write progress to \"" + progress_file->getPath());
             }
         }
@@ -1325,16 +1474,16 @@ UnsignedPair HarvestURL(const std::string &url, const std::shared_ptr<HarvestPar
 }
 
 
-bool FeedNeedsToBeHarvested(const std::string &feed_contents, const std::shared_ptr<HarvestParams> &harvest_params,
-                            const SiteParams &site_params, const SyndicationFormat::AugmentParams &syndication_format_site_params)
-{
+// \return BAD_TIME_T if all items of the feed have to be harvested, o/w the feed only has to be harvested if it has
+//         items that were added or updated after the returned time.
+time_t GetFeedHarvestThreshold(const std::shared_ptr<HarvestParams> &harvest_params, const SiteParams &site_params) {
     if (harvest_params->force_downloads_)
-        return true;
+        return TimeUtil::BAD_TIME_T;
 
     const auto last_harvest_timestamp(harvest_params->format_handler_->getDeliveryTracker().getLastDeliveryTime(site_params.journal_name_));
     if (last_harvest_timestamp == TimeUtil::BAD_TIME_T) {
         LOG_DEBUG("feed will be harvested for the first time");
-        return true;
+        return TimeUtil::BAD_TIME_T;
     } else {
         const auto diff((time(nullptr) - last_harvest_timestamp) / 86400);
         if (unlikely(diff < 0))
@@ -1347,25 +1496,26 @@ bool FeedNeedsToBeHarvested(const std::string &feed_contents, const std::shared_
         if (diff >= harvest_threshold) {
             LOG_DEBUG("feed older than " + std::to_string(harvest_threshold) +
                       " days. flagging for mandatory harvesting");
-            return true;
+            return TimeUtil::BAD_TIME_T;
         }
     }
 
-    // needs to be parsed again as iterating over a SyndicationFormat instance will consume its items
-    std::string err_msg;
-    const auto syndication_format(SyndicationFormat::Factory(feed_contents, syndication_format_site_params, &err_msg));
-    for (const auto &item : *syndication_format) {
-        const auto pub_date(item.getPubDate());
-        if (harvest_params->force_process_feeds_with_no_pub_dates_ and pub_date == TimeUtil::BAD_TIME_T) {
-            LOG_DEBUG("URL '" + item.getLink() + "' has no publication timestamp. flagging for harvesting");
-            return true;
-        } else if (pub_date != TimeUtil::BAD_TIME_T and std::difftime(item.getPubDate(), last_harvest_timestamp) > 0) {
-            LOG_DEBUG("URL '" + item.getLink() + "' was added/updated since the last harvest of this RSS feed. flagging for harvesting");
-            return true;
-        }
+    return last_harvest_timestamp;
+}
+
+
+bool ItemNeedsToBeHarvested(const SyndicationFormat::Item &item, const std::shared_ptr<HarvestParams> &harvest_params,
+                            const time_t last_harvest_timestamp)
+{
+    const auto pub_date(item.getPubDate());
+    if (harvest_params->force_process_feeds_with_no_pub_dates_ and pub_date == TimeUtil::BAD_TIME_T) {
+        LOG_DEBUG("URL '" + item.getLink() + "' has no publication timestamp. flagging for harvesting");
+        return true;
+    } else if (pub_date != TimeUtil::BAD_TIME_T and std::difftime(pub_date, last_harvest_timestamp) > 0) {
+        LOG_DEBUG("URL '" + item.getLink() + "' was added/updated since the last harvest of this RSS feed. flagging for harvesting");
+        return true;
     }
 
-    LOG_INFO("no new, harvestable entries in feed. skipping...");
     return false;
 }
 
@@ -1373,6 +1523,7 @@ bool FeedNeedsToBeHarvested(const std::string &feed_contents, const std::shared_
 UnsignedPair HarvestSyndicationURL(const std::string &feed_url, const std::shared_ptr<HarvestParams> &harvest_params,
                                    const SiteParams &site_params, HarvesterErrorLogger * const error_logger)
 {
+    const HarvesterLocker harvester_locker;
     UnsignedPair total_record_count_and_previously_downloaded_record_count;
     auto error_logger_context(error_logger->newContext(site_params.journal_name_, feed_url));
 
@@ -1383,25 +1534,21 @@ UnsignedPair HarvestSyndicationURL(const std::string &feed_url, const std::share
     if (not downloader_params.proxy_host_and_port_.empty())
         downloader_params.ignore_ssl_certificates_ = true;
     downloader_params.user_agent_ = harvest_params->user_agent_;
-    Downloader downloader(feed_url, downloader_params);
-    if (downloader.anErrorOccurred()) {
-        error_logger_context.autoLog("Download problem for \"" + feed_url + "\": " + downloader.getLastErrorMessage());
-        return total_record_count_and_previously_downloaded_record_count;
-    }
 
     SyndicationFormat::AugmentParams syndication_format_site_params;
     syndication_format_site_params.strptime_format_ = site_params.strptime_format_;
     std::string err_msg;
-    std::unique_ptr<SyndicationFormat> syndication_format(
-        SyndicationFormat::Factory(downloader.getMessageBody(), syndication_format_site_params, &err_msg));
+    std::unique_ptr<SyndicationFormat> syndication_format;
+    {
+        const NetworkWait network_wait;
+        syndication_format = SyndicationFormat::StreamingFactory(feed_url, downloader_params, Downloader::DEFAULT_TIME_LIMIT,
+                                                                 syndication_format_site_params, &err_msg);
+    }
     if (syndication_format == nullptr) {
-        error_logger_context.autoLog("Problem parsing XML document for \"" + feed_url + "\": " + err_msg);
+        error_logger_context.autoLog("Problem downloading or parsing XML document for \"" + feed_url + "\": " + err_msg);
         return total_record_count_and_previously_downloaded_record_count;
     }
 
-    if (not FeedNeedsToBeHarvested(downloader.getMessageBody(), harvest_params, site_params, syndication_format_site_params))
-        return total_record_count_and_previously_downloaded_record_count;
-
     const time_t last_build_date(syndication_format->getLastBuildDate());
     LOG_DEBUG(feed_url + " (" + syndication_format->getFormatName() + "):");
     LOG_DEBUG("\tTitle: " + syndication_format->getTitle());
@@ -1410,16 +1557,59 @@ UnsignedPair HarvestSyndicationURL(const std::string &feed_url, const std::share
     LOG_DEBUG("\tLink: " + syndication_format->getLink());
     LOG_DEBUG("\tDescription: " + syndication_format->getDescription());
 
-    for (const auto &item : *syndication_format) {
-        const auto item_id(item.getId());
+    const auto harvest_item([&](const SyndicationFormat::Item &item) {
         const std::string title(item.getTitle());
         if (not title.empty())
             LOG_DEBUG("\n\nFeed Item: " + title);
 
         const auto record_count_and_previously_downloaded_count(Harvest(item.getLink(), harvest_params, site_params, error_logger));
         total_record_count_and_previously_downloaded_record_count += record_count_and_previously_downloaded_count;
+    });
+
+    // We harvest either all items of a feed or none.  Until we know which, we hold on to the items that we've seen.
+    const time_t last_harvest_timestamp(GetFeedHarvestThreshold(harvest_params, site_params));
+    bool harvest_feed(last_harvest_timestamp == TimeUtil::BAD_TIME_T);
+    std::vector<SyndicationFormat::Item> undecided_items;
+
+    // Most feeds list their newest items first.  Once we have seen enough items to be confident of that, we can stop
+    // reading the feed at the first item that predates our last harvest, which also aborts the rest of the download.
+    const unsigned MIN_ORDERED_ITEM_COUNT(3);
+    bool newest_items_first(not harvest_params->force_process_feeds_with_no_pub_dates_);
+    time_t previous_pub_date(std::numeric_limits<time_t>::max());
+
+    try {
+        auto item(syndication_format->begin());
+        while (item != syndication_format->end()) {
+            if (harvest_feed)
+                harvest_item(*item);
+            else if (ItemNeedsToBeHarvested(*item, harvest_params, last_harvest_timestamp)) {
+                harvest_feed = true;
+                for (const auto &undecided_item : undecided_items)
+                    harvest_item(undecided_item);
+                undecided_items.clear();
+                harvest_item(*item);
+            } else {
+                const time_t pub_date((*item).getPubDate());
+                if (pub_date == TimeUtil::BAD_TIME_T or pub_date > previous_pub_date)
+                    newest_items_first = false;
+                previous_pub_date = pub_date;
+                undecided_items.emplace_back(*item);
+                if (newest_items_first and undecided_items.size() >= MIN_ORDERED_ITEM_COUNT) {
+                    LOG_DEBUG("the feed's items predate the last harvest, skipping the rest of the feed");
+                    break;
+                }
+            }
+
+            const NetworkWait network_wait; // We may have to wait for more of the feed to arrive.
+            ++item;
+        }
+    } catch (const std::exception &x) {
+        error_logger_context.autoLog("Problem downloading or parsing XML document for \"" + feed_url + "\": " + x.what());
     }
 
+    if (not harvest_feed)
+        LOG_INFO("no new, harvestable entries in feed. skipping...");
+
     return total_record_count_and_previously_downloaded_record_count;
 }
 
@@ -15,7 +15,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "ZoteroTransformation.h"
-#include "RegexMatcher.h"
+#include <unordered_set>
 #include "StringUtil.h"
 #include "TimeUtil.h"
 
@@ -110,10 +110,9 @@ std::string NormalizeDate(const std::string date_raw, const std::string strptime
 }
 
 bool TestForUnknownZoteroKey(const std::shared_ptr<const JSON::ObjectNode> &object_node) {
-    const std::string known_keys("^" + StringUtil::Join(known_zotero_keys, "|") + "$");
-    static RegexMatcher * const known_keys_matcher(RegexMatcher::RegexMatcherFactory(known_keys));
+    static const std::unordered_set<std::string> known_keys(known_zotero_keys.cbegin(), known_zotero_keys.cend());
     for (const auto &property : *object_node) {
-        if (not known_keys_matcher->matched(property.first)) {
+        if (known_keys.find(property.first) == known_keys.cend()) {
             LOG_ERROR("Unknown Zotero key \"" + property.first + "\"");
             return true;
         }
@@ -20,9 +20,14 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "util.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <cctype>
 #include <cstdlib>
 #include <execinfo.h>
@@ -40,9 +45,185 @@
 char *progname; // Must be set in main() with "progname = argv[0];";
 
 
+namespace {
+
+
+void WriteOrDie(const int fd, const std::string &data) {
+    size_t total_written(0);
+    while (total_written < data.size()) {
+        const ssize_t written(::write(fd, reinterpret_cast<const void *>(data.data() + total_written), data.size() - total_written));
+        if (unlikely(written == -1)) {
+            if (errno == EINTR)
+                continue;
+            const std::string error_message("in Logger::writeString(util.cc): write to file descriptor " + std::to_string(fd)
+                                            + " failed! (errno = " + std::to_string(errno) + ")");
+            #pragma GCC diagnostic ignored "-Wunused-result"
+            ::write(STDERR_FILENO, error_message.data(), error_message.size());
+            #pragma GCC diagnostic warning "-Wunused-result"
+            _exit(EXIT_FAILURE);
+        }
+        total_written += written;
+    }
+}
+
+
+} // unnamed namespace
+
+
+// Each thread appends to its own buffer so that logging threads only ever contend w/ the background writer, which
+// periodically swaps out the contents of all buffers and writes them w/ a single system call.
+class Logger::AsynchronousWriter {
+    struct ThreadBuffer {
+        std::mutex mutex_;
+        std::string contents_;
+    };
+
+    const int &fd_;
+    const size_t max_buffered_size_;
+    const OverflowPolicy overflow_policy_;
+    std::atomic<size_t> buffered_size_, dropped_message_count_;
+    std::atomic<bool> stopped_;
+    std::mutex mutex_; // Protects "thread_buffers_" and is used w/ our condition variables.
+    std::condition_variable work_available_, space_available_;
+    std::vector<std::shared_ptr<ThreadBuffer>> thread_buffers_;
+    std::mutex write_mutex_; // Serialises the writes of the background thread and of flush() and writeSynchronously().
+    std::string batch_;
+    std::thread thread_;
+public:
+    AsynchronousWriter(const int &fd, const size_t max_buffered_size, const OverflowPolicy overflow_policy)
+        : fd_(fd), max_buffered_size_(max_buffered_size), overflow_policy_(overflow_policy), buffered_size_(0),
+          dropped_message_count_(0), stopped_(false), thread_(&AsynchronousWriter::writerLoop, this) { }
+
+    void append(const std::string &formatted_message);
+    void writeSynchronously(const std::string &formatted_message);
+    void flush() { drainBuffers(); }
+
+    //* Writes all buffered messages and terminates the background thread.  Later calls to append() write synchronously.
+    void stop();
+private:
+    ThreadBuffer &getThreadBuffer();
+    void writerLoop();
+
+    //* \note The caller must hold "write_mutex_".
+    void drainBuffersLocked();
+    void drainBuffers() { std::lock_guard<std::mutex> write_mutex_locker(write_mutex_); drainBuffersLocked(); }
+};
+
+
+void Logger::AsynchronousWriter::append(const std::string &formatted_message) {
+    if (buffered_size_ + formatted_message.size() > max_buffered_size_ and buffered_size_ > 0) {
+        if (overflow_policy_ == DROP_ON_OVERFLOW) {
+            ++dropped_message_count_;
+            work_available_.notify_one();
+            return;
+        }
+
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        work_available_.notify_one();
+        space_available_.wait(mutex_locker, [this, &formatted_message] {
+            return stopped_ or buffered_size_ == 0 or buffered_size_ + formatted_message.size() <= max_buffered_size_;
+        });
+    }
+
+    ThreadBuffer &thread_buffer(getThreadBuffer());
+    {
+        std::lock_guard<std::mutex> thread_buffer_mutex_locker(thread_buffer.mutex_);
+        thread_buffer.contents_ += formatted_message;
+        buffered_size_ += formatted_message.size();
+    }
+
+    // stop() sets "stopped_" before its final drain, so either that drain or our own sees our message.
+    if (unlikely(stopped_))
+        drainBuffers();
+    else if (buffered_size_ > max_buffered_size_ / 2)
+        work_available_.notify_one();
+}
+
+
+void Logger::AsynchronousWriter::writeSynchronously(const std::string &formatted_message) {
+    std::lock_guard<std::mutex> write_mutex_locker(write_mutex_);
+    drainBuffersLocked();
+    WriteOrDie(fd_, formatted_message);
+}
+
+
+void Logger::AsynchronousWriter::stop() {
+    {
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        stopped_ = true;
+    }
+    work_available_.notify_one();
+    space_available_.notify_all();
+    thread_.join();
+    drainBuffers();
+}
+
+
+Logger::AsynchronousWriter::ThreadBuffer &Logger::AsynchronousWriter::getThreadBuffer() {
+    // We only ever have a single writer as there is only a single Logger instance.
+    thread_local std::shared_ptr<ThreadBuffer> thread_buffer;
+    if (unlikely(thread_buffer == nullptr)) {
+        thread_buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        thread_buffers_.emplace_back(thread_buffer);
+    }
+
+    return *thread_buffer;
+}
+
+
+void Logger::AsynchronousWriter::writerLoop() {
+    const auto MAX_WRITE_DELAY(std::chrono::milliseconds(100));
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    while (not stopped_) {
+        work_available_.wait_for(mutex_locker, MAX_WRITE_DELAY);
+        mutex_locker.unlock();
+        drainBuffers();
+        mutex_locker.lock();
+    }
+}
+
+
+void Logger::AsynchronousWriter::drainBuffersLocked() {
+    std::vector<std::shared_ptr<ThreadBuffer>> thread_buffers;
+    {
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+
+        // Drop the buffers of threads that have exited and whose messages have already been written:
+        thread_buffers_.erase(std::remove_if(thread_buffers_.begin(), thread_buffers_.end(),
+                                             [](const std::shared_ptr<ThreadBuffer> &thread_buffer) {
+                                                 std::lock_guard<std::mutex> thread_buffer_mutex_locker(thread_buffer->mutex_);
+                                                 return thread_buffer.use_count() == 1 and thread_buffer->contents_.empty();
+                                             }), thread_buffers_.end());
+        thread_buffers = thread_buffers_;
+    }
+
+    batch_.clear();
+    for (const auto &thread_buffer : thread_buffers) {
+        std::lock_guard<std::mutex> thread_buffer_mutex_locker(thread_buffer->mutex_);
+        batch_ += thread_buffer->contents_;
+        thread_buffer->contents_.clear();
+    }
+    const size_t drained_size(batch_.size());
+
+    const size_t dropped_message_count(dropped_message_count_.exchange(0));
+    if (unlikely(dropped_message_count > 0))
+        batch_ += "Logger: dropped " + std::to_string(dropped_message_count) + " message(s) because the log buffer was full!\n";
+
+    if (not batch_.empty())
+        WriteOrDie(fd_, batch_);
+
+    if (drained_size > 0) {
+        std::lock_guard<std::mutex> mutex_locker(mutex_);
+        buffered_size_ -= drained_size;
+        space_available_.notify_all();
+    }
+}
+
+
 Logger::Logger()
     : fd_(STDERR_FILENO), log_process_pids_(false), log_no_decorations_(false), log_strip_call_site_(false),
-      min_log_level_(LL_INFO)
+      asynchronous_writer_(nullptr), min_log_level_(LL_INFO)
 {
     const char * const min_log_level(::getenv("MIN_LOG_LEVEL"));
     if (min_log_level != nullptr)
@@ -59,6 +240,42 @@ Logger::Logger()
 }
 
 
+// Not "Logger::mutex_" because error() holds that one while calling exit(3), which ends up in disableAsynchronousMode().
+static std::mutex asynchronous_mode_mutex;
+
+
+void Logger::enableAsynchronousMode(const size_t max_buffered_size, const OverflowPolicy overflow_policy) {
+    std::lock_guard<std::mutex> asynchronous_mode_mutex_locker(asynchronous_mode_mutex);
+    if (asynchronous_writer_.load() != nullptr)
+        return;
+
+    static bool registered_exit_handler(false);
+    if (not registered_exit_handler) {
+        std::atexit([]{ ::logger->disableAsynchronousMode(); });
+        registered_exit_handler = true;
+    }
+
+    asynchronous_writer_ = new AsynchronousWriter(fd_, max_buffered_size, overflow_policy);
+}
+
+
+void Logger::disableAsynchronousMode() {
+    std::lock_guard<std::mutex> asynchronous_mode_mutex_locker(asynchronous_mode_mutex);
+    AsynchronousWriter * const asynchronous_writer(asynchronous_writer_.exchange(nullptr));
+
+    // We intentionally never delete the writer as other threads may still be in the middle of handing it a message.
+    if (asynchronous_writer != nullptr)
+        asynchronous_writer->stop();
+}
+
+
+void Logger::flush() {
+    AsynchronousWriter * const asynchronous_writer(asynchronous_writer_.load());
+    if (asynchronous_writer != nullptr)
+        asynchronous_writer->flush();
+}
+
+
 void Logger::error(const std::string &msg) {
     std::lock_guard<std::mutex> mutex_locker(mutex_);
 
@@ -68,12 +285,9 @@ void Logger::error(const std::string &msg) {
 
     writeString("SEVERE", msg + error_message_string);
     if (::getenv("BACKTRACE") != nullptr) {
-        const bool saved_log_no_decorations(log_no_decorations_);
-        log_no_decorations_ = true;
-        writeString("", "Backtrace:");
+        writeString("", "Backtrace:", /* decorate = */false);
         for (const auto &stack_entry : MiscUtil::GetCallStack())
-            writeString("", "  " + stack_entry);
-        log_no_decorations_ = saved_log_no_decorations;
+            writeString("", "  " + stack_entry, /* decorate = */false);
     }
 
     std::exit(EXIT_FAILURE);
@@ -84,8 +298,7 @@ void Logger::warning(const std::string &msg) {
     if (min_log_level_ < LL_WARNING)
         return;
 
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    writeString("WARN", msg);
+    log("WARN", msg);
 }
 
 
@@ -93,8 +306,7 @@ void Logger::info(const std::string &msg) {
     if (min_log_level_ < LL_INFO)
         return;
 
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    writeString("INFO", msg);
+    log("INFO", msg);
 }
 
 
@@ -102,8 +314,7 @@ void Logger::debug(const std::string &msg) {
     if ((min_log_level_ < LL_DEBUG) and (MiscUtil::SafeGetEnv("UTIL_LOG_DEBUG") != "true"))
         return;
 
-    std::lock_guard<std::mutex> mutex_locker(mutex_);
-    writeString("DEBUG", msg);
+    log("DEBUG", msg);
 }
 
 
@@ -141,10 +352,22 @@ std::string Logger::LogLevelToString(const LogLevel log_level) {
 }
 
 
-void Logger::writeString(const std::string &level, std::string msg) {
+void Logger::log(const std::string &level, const std::string &msg) {
+    AsynchronousWriter * const asynchronous_writer(asynchronous_writer_.load());
+    if (asynchronous_writer != nullptr and likely(::progname != nullptr)) {
+        asynchronous_writer->append(formatMessage(level, msg, /* decorate = */true));
+        return;
+    }
+
+    std::lock_guard<std::mutex> mutex_locker(mutex_);
+    writeString(level, msg);
+}
+
+
+std::string Logger::formatMessage(const std::string &level, std::string msg, const bool decorate) const {
     if (unlikely(::progname == nullptr))
         msg = "You must set \"progname\" in main() with \"::progname = argv[0];\" in oder to use the Logger API!";
-    else if (not log_no_decorations_) {
+    else if (decorate and not log_no_decorations_) {
         msg = TimeUtil::GetCurrentDateAndTime(TimeUtil::ISO_8601_FORMAT) + " " + level + " " + std::string(::progname) + ": "
               + msg;
         if (log_process_pids_)
@@ -158,15 +381,19 @@ void Logger::writeString(const std::string &level, std::string msg) {
     }
 
     msg += '\n';
+    return msg;
+}
 
-    if (unlikely(::write(fd_, reinterpret_cast<const void *>(msg.data()), msg.size()) == -1)) {
-        const std::string error_message("in Logger::writeString(util.cc): write to file descriptor " + std::to_string(fd_)
-                                        + " failed! (errno = " + std::to_string(errno) + ")");
-        #pragma GCC diagnostic ignored "-Wunused-result"
-        ::write(STDERR_FILENO, error_message.data(), error_message.size());
-        #pragma GCC diagnostic warning "-Wunused-result"
-        _exit(EXIT_FAILURE);
-    }
+
+void Logger::writeString(const std::string &level, const std::string &msg, const bool decorate) {
+    const std::string formatted_message(formatMessage(level, msg, decorate));
+
+    // In asynchronous mode we have to write via the writer so that we don't overtake or interleave w/ buffered messages.
+    AsynchronousWriter * const asynchronous_writer(asynchronous_writer_.load());
+    if (asynchronous_writer != nullptr)
+        asynchronous_writer->writeSynchronously(formatted_message);
+    else
+        WriteOrDie(fd_, formatted_message);
 
     if (unlikely(::progname == nullptr))
         _exit(EXIT_FAILURE);
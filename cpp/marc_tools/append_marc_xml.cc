@@ -2,7 +2,7 @@
  *  \brief Appends one MARC-XML file to another.
  *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
  *
- *  \copyright 2016,2017 Universitätsbibliothek Tübingen.  All rights reserved.
+ *  \copyright 2016-2019 Universitätsbibliothek Tübingen.  All rights reserved.
  *
  *  This program is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU Affero General Public License as
@@ -18,90 +18,291 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
-#include <string.h>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Compiler.h"
-#include "FileUtil.h"
+#include "ScanUtil.h"
+#include "StringView.h"
 #include "util.h"
 
 
-void Usage() {
-    std::cerr << "usage: " << progname << " source_marc_xml target_marc_xml\n";
-    std::cerr << "       Appends \"source_marc_xml\" to \"target_marc_xml\".\n\n";
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "usage: " << ::progname << " [--validate] source_marc_xml target_marc_xml\n"
+              << "       Appends the records of \"source_marc_xml\" to \"target_marc_xml\".  Only the end of the target\n"
+              << "       is read and rewritten, so the time this takes only depends on the size of the source.  If\n"
+              << "       \"--validate\" has been specified, we abort w/o modifying the target if a source record is not\n"
+              << "       well-formed.\n\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-const off_t TAIL_OFFSET(20);
+// The closing collection tag must be followed by nothing but whitespace which should fit in here.
+const size_t MAX_TAIL_SIZE(4096);
+
+
+/** \brief Scans "target_fd" backwards for the closing collection tag.
+ *  \param namespace_prefix  Will be set to the namespace prefix of the tag, e.g. "marc:" for "</marc:collection>".
+ *  \param tail              Will be set to everything from the start of the tag to the end of the file.
+ *  \return The offset of the closing collection tag.
+ */
+off_t FindClosingCollectionTag(const int target_fd, const std::string &target_path, std::string * const namespace_prefix,
+                               std::string * const tail)
+{
+    struct stat stat_buf;
+    if (unlikely(::fstat(target_fd, &stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + target_path + "\" failed!");
+
+    const off_t tail_start(stat_buf.st_size > static_cast<off_t>(MAX_TAIL_SIZE) ? stat_buf.st_size - MAX_TAIL_SIZE : 0);
+    std::string tail_block(stat_buf.st_size - tail_start, '\0');
+    if (unlikely(::pread(target_fd, &tail_block[0], tail_block.size(), tail_start) != static_cast<ssize_t>(tail_block.size())))
+        LOG_ERROR("failed to read the end of \"" + target_path + "\"!");
+
+    size_t tag_end(tail_block.size());
+    while (tag_end > 0 and std::isspace(static_cast<unsigned char>(tail_block[tag_end - 1])))
+        --tag_end;
+    const size_t tag_start(tail_block.rfind("</", tag_end));
+    static const std::string COLLECTION_TAG_SUFFIX("collection>");
+    if (unlikely(tag_start == std::string::npos or tag_end - tag_start < 2 + COLLECTION_TAG_SUFFIX.length()
+                 or tail_block.compare(tag_end - COLLECTION_TAG_SUFFIX.length(), COLLECTION_TAG_SUFFIX.length(),
+                                       COLLECTION_TAG_SUFFIX) != 0))
+        LOG_ERROR("\"" + target_path + "\" does not end w/ a closing collection tag!");
+
+    *namespace_prefix = tail_block.substr(tag_start + 2, tag_end - COLLECTION_TAG_SUFFIX.length() - (tag_start + 2));
+    if (unlikely(not namespace_prefix->empty() and namespace_prefix->back() != ':'))
+        LOG_ERROR("\"" + target_path + "\" ends w/ an unexpected closing tag!");
+    *tail = tail_block.substr(tag_start);
+
+    return tail_start + tag_start;
+}
+
+
+// \return The namespace prefix of the first record element in [start, end) or false if there is no such element.
+bool FindRecordNamespacePrefix(const char *start, const char * const end, std::string * const namespace_prefix) {
+    while ((start = ScanUtil::FindChar(start, end, '<')) != end) {
+        const char * const name_start(++start);
+        const char * const name_end(ScanUtil::FindFirstOf(name_start, end, " \t\r\n/>"));
+        const StringView name(name_start, name_end - name_start);
+        if (name == "record" or name.endsWith(":record")) {
+            namespace_prefix->assign(name_start, name.size() - __builtin_strlen("record"));
+            return true;
+        }
+    }
 
+    return false;
+}
 
-void PositionFileBeforeClosingCollectionTag(File * const file) {
-    if (unlikely(file->size() < TAIL_OFFSET))
-        logger->error("\"" + file->getPath() + "\" is too small to look for the </marc:collection> tag!");
 
-    if (unlikely(not file->seek(-TAIL_OFFSET, SEEK_END)))
-        logger->error("seek failed on \"" + file->getPath() + "\"! (" + std::string(::strerror(errno)) + ")");
+// A minimal well-formedness check: start and end tags must be balanced and properly nested.
+bool IsWellFormed(const char *start, const char * const end) {
+    std::vector<StringView> open_elements;
+    while ((start = ScanUtil::FindChar(start, end, '<')) != end) {
+        const StringView rest(start, end - start);
+        if (rest.startsWith("<!--") or rest.startsWith("<?") or rest.startsWith("<![CDATA[")) {
+            const StringView terminator(rest.startsWith("<!--") ? "-->" : (rest.startsWith("<?") ? "?>" : "]]>"));
+            const char * const terminator_start(reinterpret_cast<const char *>(::memmem(start + 2, end - (start + 2),
+                                                                                        terminator.data(), terminator.size())));
+            if (terminator_start == nullptr)
+                return false;
+            start = terminator_start + terminator.size();
+            continue;
+        }
 
-    std::string tail(TAIL_OFFSET, '\0');
-    if (unlikely(file->read((void *)tail.data(), TAIL_OFFSET) != TAIL_OFFSET))
-        logger->error("this should never happen!");
+        const char * const tag_end(ScanUtil::FindChar(start, end, '>'));
+        if (tag_end == end)
+            return false;
+        const bool is_end_tag(start[1] == '/');
+        const char * const name_start(start + (is_end_tag ? 2 : 1));
+        const char * const name_end(ScanUtil::FindFirstOf(name_start, tag_end, " \t\r\n/"));
+        const StringView name(name_start, name_end - name_start);
+        if (name.empty())
+            return false;
 
-    const std::string::size_type COLLECTION_CLOSING_TAG_START(tail.find("</marc:collection>"));
-    if (unlikely(COLLECTION_CLOSING_TAG_START == std::string::npos))
-        logger->error("could not find </marc:collection> in the last " + std::to_string(TAIL_OFFSET) + " bytes of \""
-                      + file->getPath() + "\"!");
+        if (is_end_tag) {
+            if (open_elements.empty() or open_elements.back() != name)
+                return false;
+            open_elements.pop_back();
+        } else if (tag_end[-1] != '/')
+            open_elements.emplace_back(name);
+        start = tag_end + 1;
+    }
 
-    if (unlikely(not file->seek(-TAIL_OFFSET + COLLECTION_CLOSING_TAG_START - 1, SEEK_END)))
-        logger->error("seek to byte immediately before </marc:collection> failed on \"" + file->getPath() + "\"! ("
-                      + std::string(::strerror(errno)) + ")");
+    return open_elements.empty();
 }
 
 
-const off_t MIN_SOURCE_SIZE(350);
+// Writes everything at consecutive offsets of a file that has been opened for writing.
+class PositionalWriter {
+    const int fd_;
+    off_t offset_;
+    std::string buffer_;
+public:
+    static constexpr size_t FLUSH_SIZE = 1u << 20;
+public:
+    PositionalWriter(const int fd, const off_t offset): fd_(fd), offset_(offset) { }
+
+    inline bool append(const char * const data, const size_t size) {
+        buffer_.append(data, size);
+        return buffer_.size() < FLUSH_SIZE or flush();
+    }
+    inline bool append(const std::string &data) { return append(data.data(), data.size()); }
+
+    bool flush();
+    inline off_t getOffset() const { return offset_ + buffer_.size(); }
+};
+
+
+bool PositionalWriter::flush() {
+    const char *data(buffer_.data());
+    size_t remaining(buffer_.size());
+    while (remaining > 0) {
+        const ssize_t written(::pwrite(fd_, data, remaining, offset_));
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written, remaining -= written, offset_ += written;
+    }
+    buffer_.clear();
 
+    return true;
+}
 
-off_t PositionFileAtFirstRecordStart(File * const file) {
-    if (unlikely(file->size() < MIN_SOURCE_SIZE))
-        logger->error("\"" + file->getPath() + "\" is too small to look for the first <marc:record> tag!");
 
-    std::string head(MIN_SOURCE_SIZE, '\0');
-    if (unlikely(file->read((void *)head.data(), MIN_SOURCE_SIZE) != MIN_SOURCE_SIZE))
-        logger->error("this should never happen (2)!");
+class ReadOnlyMapping {
+    const char *data_;
+    size_t size_;
+public:
+    explicit ReadOnlyMapping(const std::string &path);
+    ~ReadOnlyMapping() { if (size_ > 0) ::munmap(const_cast<char *>(data_), size_); }
+    inline const char *begin() const { return data_; }
+    inline const char *end() const { return data_ + size_; }
+};
 
-    const std::string::size_type RECORD_TAG_START(head.find("<marc:record>"));
-    if (unlikely(RECORD_TAG_START == std::string::npos))
-        logger->error("could not find <marc:record> in the first " + std::to_string(MIN_SOURCE_SIZE) + " bytes of \""
-                      + file->getPath() + "\"!");
 
-    if (unlikely(not file->seek(RECORD_TAG_START)))
-        logger->error("seek failed on \"" + file->getPath() + "\"! (" + std::string(::strerror(errno)) + ")");
+ReadOnlyMapping::ReadOnlyMapping(const std::string &path): data_(nullptr), size_(0) {
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (unlikely(fd == -1))
+        LOG_ERROR("can't open \"" + path + "\" for reading!");
 
-    return RECORD_TAG_START;
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd, &stat_buf) != 0))
+        LOG_ERROR("fstat(2) on \"" + path + "\" failed!");
+    if (stat_buf.st_size > 0) {
+        void * const mapping(::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (unlikely(mapping == MAP_FAILED))
+            LOG_ERROR("failed to mmap \"" + path + "\"!");
+        ::madvise(mapping, stat_buf.st_size, MADV_SEQUENTIAL);
+        data_ = reinterpret_cast<const char *>(mapping);
+        size_ = stat_buf.st_size;
+    }
+    ::close(fd);
 }
 
 
-/** \brief Appends "source" to "target". */
-void Append(File * const source, File * const target) {
-    PositionFileBeforeClosingCollectionTag(target);
-    const off_t record_tag_start(PositionFileAtFirstRecordStart(source));
-    if (unlikely(not FileUtil::Copy(source, target, source->size() - record_tag_start)))
-        logger->error("copying failed: " + std::string(::strerror(errno)));
+// Copies all record elements of "source" to "target_fd", overwriting the closing collection tag, which will be written
+// anew after the last record.  If anything goes wrong the target will be restored to its original state.
+void Append(const std::string &source_path, const std::string &target_path, const int target_fd, const bool validate) {
+    std::string namespace_prefix, original_tail;
+    const off_t closing_tag_offset(FindClosingCollectionTag(target_fd, target_path, &namespace_prefix, &original_tail));
+
+    const ReadOnlyMapping source(source_path);
+    std::string source_namespace_prefix;
+    if (not FindRecordNamespacePrefix(source.begin(), source.end(), &source_namespace_prefix)) {
+        LOG_WARNING("\"" + source_path + "\" contains no records!");
+        return;
+    }
+    if (unlikely(source_namespace_prefix != namespace_prefix))
+        LOG_ERROR("the records in \"" + source_path + "\" use the namespace prefix \"" + source_namespace_prefix
+                  + "\" but \"" + target_path + "\" uses \"" + namespace_prefix + "\"!");
+
+    const std::string record_start_tag("<" + namespace_prefix + "record"), record_end_tag("</" + namespace_prefix + "record>");
+    PositionalWriter target_writer(target_fd, closing_tag_offset);
+    std::string error_message;
+    unsigned record_count(0);
+    const char *record_start(source.begin());
+    while ((record_start = reinterpret_cast<const char *>(::memmem(record_start, source.end() - record_start,
+                                                                   record_start_tag.data(), record_start_tag.size())))
+           != nullptr)
+    {
+        const char * const after_name(record_start + record_start_tag.size());
+        if (after_name == source.end() or (*after_name != '>' and not std::isspace(static_cast<unsigned char>(*after_name)))) {
+            record_start = after_name; // Some other element whose name starts w/ "record".
+            continue;
+        }
+
+        const char * const end_tag(reinterpret_cast<const char *>(::memmem(after_name, source.end() - after_name,
+                                                                           record_end_tag.data(), record_end_tag.size())));
+        if (unlikely(end_tag == nullptr)) {
+            error_message = "record #" + std::to_string(record_count + 1) + " in \"" + source_path + "\" is not terminated";
+            break;
+        }
+        const char * const record_end(end_tag + record_end_tag.size());
+        if (validate and unlikely(not IsWellFormed(record_start, record_end))) {
+            error_message = "record #" + std::to_string(record_count + 1) + " at offset "
+                            + std::to_string(record_start - source.begin()) + " in \"" + source_path + "\" is malformed";
+            break;
+        }
+
+        if (unlikely(not target_writer.append(record_start, record_end - record_start) or not target_writer.append("\n", 1))) {
+            error_message = std::strerror(errno);
+            break;
+        }
+        ++record_count;
+        record_start = record_end;
+    }
+
+    if (error_message.empty()
+        and (not target_writer.append("</" + namespace_prefix + "collection>\n") or not target_writer.flush()
+             or ::ftruncate(target_fd, target_writer.getOffset()) != 0))
+        error_message = std::strerror(errno);
+
+    if (not error_message.empty()) {
+        if (::pwrite(target_fd, original_tail.data(), original_tail.size(), closing_tag_offset)
+            != static_cast<ssize_t>(original_tail.size())
+            or ::ftruncate(target_fd, closing_tag_offset + original_tail.size()) != 0)
+            LOG_ERROR("failed to append to \"" + target_path + "\" (" + error_message + ") and to restore it!");
+        LOG_ERROR("failed to append to \"" + target_path + "\" (" + error_message + ")!");
+    }
+
+    LOG_INFO("Appended " + std::to_string(record_count) + " record(s) to \"" + target_path + "\".");
 }
 
 
-int main(int argc, char *argv[]) {
-    ::progname = argv[0];
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 3)
+        Usage();
+
+    bool validate(false);
+    if (std::strcmp(argv[1], "--validate") == 0) {
+        validate = true;
+        --argc, ++argv;
+    }
 
     if (argc != 3)
         Usage();
 
-    const std::unique_ptr<File> source(FileUtil::OpenInputFileOrDie(argv[1]));
-    std::unique_ptr<File> target(new File(argv[2], "r+"));
-    if (not target->fail())
-        logger->error("can't open \"" + std::string(argv[2]) + "\" for reading and writing!");
+    const std::string source_path(argv[1]), target_path(argv[2]);
+    const int target_fd(::open(target_path.c_str(), O_RDWR));
+    if (unlikely(target_fd == -1))
+        LOG_ERROR("can't open \"" + target_path + "\" for reading and writing!");
 
-    try {
-        Append(source.get(), target.get());
-    } catch (const std::exception &x) {
-        logger->error("caught exception: " + std::string(x.what()));
-    }
+    Append(source_path, target_path, target_fd, validate);
+    if (unlikely(::close(target_fd) != 0))
+        LOG_ERROR("failed to close \"" + target_path + "\"!");
+
+    return EXIT_SUCCESS;
 }
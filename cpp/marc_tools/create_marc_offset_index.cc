@@ -0,0 +1,64 @@
+/** \brief Utility for writing the sidecar control number to offset index of a MARC-21 collection.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "MARC.h"
+#include "MarcOffsetIndex.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--only-if-stale] marc21_data\n"
+              << "       Writes marc21_data.idx which can then be used by MARC::OffsetIndex w/o having to read marc21_data.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    bool only_if_stale(false);
+    if (std::strcmp(argv[1], "--only-if-stale") == 0) {
+        only_if_stale = true;
+        --argc, ++argv;
+    }
+
+    if (argc != 2)
+        Usage();
+
+    const std::string marc_filename(argv[1]);
+    if (only_if_stale and MARC::OffsetIndex::IsUpToDate(marc_filename)) {
+        LOG_INFO("\"" + MARC::OffsetIndex::GetIndexPath(marc_filename) + "\" is up to date.");
+        return EXIT_SUCCESS;
+    }
+
+    auto marc_reader(MARC::Reader::Factory(marc_filename, MARC::FileType::BINARY));
+    LOG_INFO("Indexed " + std::to_string(MARC::OffsetIndex::Create(marc_reader.get())) + " record(s).");
+
+    return EXIT_SUCCESS;
+}
@@ -17,15 +17,12 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <iostream>
-#include <unordered_set>
-#include <cstdio>
 #include <cstdlib>
-#include <cstring>
-#include "FileUtil.h"
 #include "MARC.h"
-#include "StringUtil.h"
-#include "TextUtil.h"
+#include "MarcParallelProcessor.h"
+#include "MarcSubjectHeadingIndex.h"
 #include "util.h"
 
 
@@ -34,29 +31,16 @@ namespace {
 
 [[noreturn]] void Usage() {
     std::cerr << "usage: " << ::progname << " marc_input marc_output subject_list\n\n"
-              << "       where \"subject_list\" must contain LCSH's, one per line.\n";
+              << "       where \"subject_list\" must contain LCSH's, one per line.  Subdivisions may be appended w/ \"--\",\n"
+              << "       e.g. \"Church history -- 20th century\".  Case and trailing periods are ignored.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-void LoadSubjectHeadings(File * const input, std::unordered_set<std::string> * const loc_subject_headings) {
-    while (not input->eof()) {
-        std::string line;
-        input->getline(&line);
-        StringUtil::Trim(&line);
-        if (not line.empty())
-            loc_subject_headings->emplace(line);
-    }
-}
-
-
-/** Returns true if we have at least one match in 650$a. */
-bool Matched(const MARC::Record &record, const std::unordered_set<std::string> &loc_subject_headings) {
+/** Returns true if we have at least one match in 650. */
+bool Matched(const MARC::Record &record, const MARC::SubjectHeadingIndex &subject_heading_index) {
     for (const auto &field : record.getTagRange("650")) {
-        const auto subfields(field.getSubfields());
-        std::string subfield_a(TextUtil::UTF8ToLower(subfields.getFirstSubfieldWithCode('a')));
-        StringUtil::RightTrim(" .", &subfield_a);
-        if (loc_subject_headings.find(subfield_a) != loc_subject_headings.cend())
+        if (subject_heading_index.lookup(field.getContents()) != MARC::SubjectHeadingIndex::NO_HEADING)
             return true;
     }
 
@@ -65,16 +49,16 @@ bool Matched(const MARC::Record &record, const std::unordered_set<std::string> &
 
 
 void Filter(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-            const std::unordered_set<std::string> &loc_subject_headings)
+            const MARC::SubjectHeadingIndex &subject_heading_index)
 {
-    unsigned total_count(0), matched_count(0);
-    while (const MARC::Record record = marc_reader->read()) {
-        ++total_count;
-        if (Matched(record, loc_subject_headings)) {
-            ++matched_count;
-            marc_writer->write(record);
-        }
-    }
+    std::atomic<unsigned> matched_count(0);
+    MARC::ParallelProcessor processor(marc_reader, marc_writer);
+    const size_t total_count(processor.process([&](MARC::Record * const record) {
+        if (not Matched(*record, subject_heading_index))
+            return false;
+        ++matched_count;
+        return true;
+    }));
 
     std::cerr << "Processed a total of " << total_count << " record(s).\n";
     std::cerr << "Matched and therefore copied " << matched_count << " record(s).\n";
@@ -90,12 +74,9 @@ int Main(int argc, char **argv) {
 
     auto marc_reader(MARC::Reader::Factory(argv[1]));
     auto marc_writer(MARC::Writer::Factory(argv[2]));
-    auto subject_headings_file(FileUtil::OpenInputFileOrDie(argv[3]));
-
-    std::unordered_set<std::string> loc_subject_headings;
-    LoadSubjectHeadings(subject_headings_file.get(), &loc_subject_headings);
+    const MARC::SubjectHeadingIndex subject_heading_index(argv[3]);
 
-    Filter(marc_reader.get(), marc_writer.get(), loc_subject_headings);
+    Filter(marc_reader.get(), marc_writer.get(), subject_heading_index);
 
     return EXIT_SUCCESS;
 }
@@ -17,6 +17,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <unordered_map>
@@ -61,6 +62,7 @@ void Usage() {
               << "               Any field with a matching tag will have a new subfield inserted if the regex matched.\n"
               << "           --config-path filename\n"
               << "               If --config-path has been specified, no other operation may be used.\n"
+              << "       All conditions are evaluated against a record as it was before any operations were applied to it.\n"
               << "       Field or subfield data may contain any of the following escapes:\n"
               << "         \\n, \\t, \\b, \\r, \\f, \\v, \\a, \\\\, \\uNNNN and \\UNNNNNNNN as well as \\o, \\oo and \\ooo\n"
               << "         octal escape sequences.\n"
@@ -192,124 +194,189 @@ private:
 };
 
 
-// Returns true, if we modified the record, else false.
-bool InsertField(MARC::Record * const record, const MARC::Tag &tag, const char subfield_code, const std::string &insertion_text,
-                 std::string * const error_message, CompiledPattern * const condition = nullptr)
-{
-    error_message->clear();
-    if (condition != nullptr) {
-        if (not condition->matched(*record))
-            return false;
+// Returns the offset of the first subfield delimiter w/ a subfield code that is not less than "subfield_code" or, if there
+// is no such subfield, std::string::npos.  This mirrors MARC::Subfields::addSubfield() and replaceFirstSubfield() but
+// works directly on the field contents.
+size_t FindSubfieldPosition(const std::string &field_contents, const char subfield_code) {
+    auto delimiter_pos(field_contents.find('\x1F', 2 /* indicators */));
+    while (delimiter_pos != std::string::npos and delimiter_pos + 1 < field_contents.length()) {
+        if (field_contents[delimiter_pos + 1] >= subfield_code)
+            return delimiter_pos;
+        delimiter_pos = field_contents.find('\x1F', delimiter_pos + 2);
     }
 
-    if (subfield_code == CompiledPattern::NO_SUBFIELD_CODE) {
-        if (not record->insertField(tag, insertion_text)) {
-            *error_message = "failed to insert " + tag.toString() + " field! (Probably due to a duplicate non-repeatable field.)";
-            return false;
-        }
-    } else {
-        if (not record->insertField(tag, { { subfield_code, insertion_text } })) {
-            *error_message = "failed to insert " + tag.toString() + std::string(1, subfield_code)
-                             + " subfield! (Probably due to a duplicate non-repeatable field.)";
-            return false;
+    return std::string::npos;
+}
+
+
+// An augmentation spec compiled into per-tag groups of edits so that all edits for a record can be applied in a single
+// pass over its fields.  Edits for the same tag are applied in the order in which they were specified.
+class EditProgram {
+    enum class EditType { INSERT_FIELD, REPLACE_FIELD, ADD_SUBFIELD };
+
+    struct Edit {
+        EditType type_;
+        MARC::Tag tag_;
+        char subfield_code_;
+        std::string new_contents_; // Complete field contents, a subfield value or a complete subfield, see EditProgram().
+        CompiledPattern *condition_;
+    };
+
+    struct TagEdits {
+        MARC::Tag tag_;
+        bool repeatable_;
+        std::vector<size_t> edit_indices_;
+    };
+
+    std::vector<Edit> edits_;
+    std::vector<TagEdits> tag_edits_; // Sorted by tag.
+    std::vector<bool> active_edits_;
+    std::vector<MARC::Record::Field> new_fields_;
+public:
+    explicit EditProgram(std::vector<AugmentorDescriptor> &augmentors);
+
+    /** \return True if we modified "record", else false.
+     *  \note   All conditions are evaluated against "record" as it was before applying any edits.
+     */
+    bool apply(MARC::Record * const record);
+private:
+    bool applyEdit(const Edit &edit, const bool repeatable, const size_t group_start);
+};
+
+
+EditProgram::EditProgram(std::vector<AugmentorDescriptor> &augmentors) {
+    for (auto &augmentor : augmentors) {
+        Edit edit;
+        edit.tag_ = augmentor.getTag();
+        edit.subfield_code_ = augmentor.getSubfieldCode();
+        edit.condition_ = augmentor.getCompiledPattern();
+        switch (augmentor.getAugmentorType()) {
+        case AugmentorType::INSERT_FIELD:
+        case AugmentorType::INSERT_FIELD_IF:
+            edit.type_ = EditType::INSERT_FIELD;
+            edit.new_contents_ = (edit.subfield_code_ == CompiledPattern::NO_SUBFIELD_CODE)
+                                 ? augmentor.getInsertionText()
+                                 : "  \x1F" + std::string(1, edit.subfield_code_) + augmentor.getInsertionText();
+            break;
+        case AugmentorType::REPLACE_FIELD:
+        case AugmentorType::REPLACE_FIELD_IF:
+            edit.type_ = EditType::REPLACE_FIELD;
+            edit.new_contents_ = augmentor.getInsertionText();
+            break;
+        case AugmentorType::ADD_SUBFIELD:
+        case AugmentorType::ADD_SUBFIELD_IF:
+            edit.type_ = EditType::ADD_SUBFIELD;
+            edit.new_contents_ = "\x1F" + std::string(1, edit.subfield_code_) + augmentor.getInsertionText();
+            break;
+        default:
+            LOG_ERROR("unhandled Augmentor type!");
         }
+        edits_.emplace_back(edit);
+    }
+
+    for (size_t edit_index(0); edit_index < edits_.size(); ++edit_index) {
+        const MARC::Tag &tag(edits_[edit_index].tag_);
+        auto tag_edits(std::lower_bound(tag_edits_.begin(), tag_edits_.end(), tag,
+                                        [](const TagEdits &lhs, const MARC::Tag &rhs) { return lhs.tag_ < rhs; }));
+        if (tag_edits == tag_edits_.end() or tag_edits->tag_ != tag)
+            tag_edits = tag_edits_.insert(tag_edits, TagEdits{ tag, /* repeatable_ = */true, { } });
+        tag_edits->edit_indices_.emplace_back(edit_index);
+
+        // Only insertions care about repeatability and we don't want to abort on unknown tags otherwise:
+        if (edits_[edit_index].type_ == EditType::INSERT_FIELD)
+            tag_edits->repeatable_ = MARC::IsRepeatableField(tag);
     }
 
-    return true;
+    active_edits_.resize(edits_.size());
 }
 
 
-// Returns true, if we modified the record, else false.
-bool ReplaceField(MARC::Record * const record, const MARC::Tag &tag, const char subfield_code,
-                  const std::string &replacement_text, CompiledPattern * const condition = nullptr)
-{
-    if (condition != nullptr) {
-        if (not condition->matched(*record))
-            return false;
+bool EditProgram::apply(MARC::Record * const record) {
+    bool have_active_edits(false);
+    for (size_t edit_index(0); edit_index < edits_.size(); ++edit_index) {
+        CompiledPattern * const condition(edits_[edit_index].condition_);
+        active_edits_[edit_index] = condition == nullptr or condition->matched(*record);
+        have_active_edits = have_active_edits or active_edits_[edit_index];
     }
-
-    bool replaced_at_least_one(false);
-    for (auto &field : *record) {
-        if (field.getTag() != tag)
-            continue;
-
-        if (subfield_code == CompiledPattern::NO_SUBFIELD_CODE) {
-            field.setContents(replacement_text);
-            replaced_at_least_one = true;
-        } else {
-            MARC::Subfields subfields(field.getContents());
-            if (subfields.replaceFirstSubfield(subfield_code, replacement_text)) {
-                field.setSubfields(subfields);
-                replaced_at_least_one = true;
-            }
+    if (not have_active_edits)
+        return false;
+
+    // Merge the existing fields w/ the edit groups.  The fields of each edited tag end up at the end of "new_fields_"
+    // where the edits can be applied to them w/o touching any other fields:
+    new_fields_.clear();
+    new_fields_.reserve(record->getNumberOfFields() + edits_.size());
+    bool modified(false);
+    auto field(record->begin());
+    for (const auto &tag_edits : tag_edits_) {
+        while (field != record->end() and field->getTag() < tag_edits.tag_)
+            new_fields_.emplace_back(std::move(*field++));
+        const size_t group_start(new_fields_.size());
+        while (field != record->end() and field->getTag() == tag_edits.tag_)
+            new_fields_.emplace_back(std::move(*field++));
+
+        for (const auto edit_index : tag_edits.edit_indices_) {
+            if (active_edits_[edit_index] and applyEdit(edits_[edit_index], tag_edits.repeatable_, group_start))
+                modified = true;
         }
     }
+    while (field != record->end())
+        new_fields_.emplace_back(std::move(*field++));
 
-    return replaced_at_least_one;
+    record->swapFields(&new_fields_);
+    return modified;
 }
 
 
-// Returns true, if we modified the record, else false.
-bool AddSubfield(MARC::Record * const record, const MARC::Tag &tag, const char subfield_code, const std::string &insertion_text,
-                 CompiledPattern * const condition = nullptr)
-{
-    if (condition != nullptr) {
-        if (not condition->matched(*record))
+bool EditProgram::applyEdit(const Edit &edit, const bool repeatable, const size_t group_start) {
+    if (edit.type_ == EditType::INSERT_FIELD) {
+        if (new_fields_.size() > group_start and not repeatable) {
+            if (edit.subfield_code_ == CompiledPattern::NO_SUBFIELD_CODE)
+                LOG_WARNING("failed to insert " + edit.tag_.toString() + " field! (Probably due to a duplicate non-repeatable field.)");
+            else
+                LOG_WARNING("failed to insert " + edit.tag_.toString() + std::string(1, edit.subfield_code_)
+                            + " subfield! (Probably due to a duplicate non-repeatable field.)");
             return false;
+        }
+        new_fields_.emplace(new_fields_.begin() + group_start, edit.tag_, edit.new_contents_);
+        return true;
     }
 
-    bool modified_at_least_one(false);
-    for (auto &field : *record) {
-        if (field.getTag() == tag) {
-            MARC::Subfields subfields(field.getSubfields());
-            subfields.addSubfield(subfield_code, insertion_text);
-            field.setSubfields(subfields);
-            modified_at_least_one = true;
+    bool modified(false);
+    for (auto field(new_fields_.begin() + group_start); field != new_fields_.end(); ++field) {
+        if (edit.type_ == EditType::REPLACE_FIELD and edit.subfield_code_ == CompiledPattern::NO_SUBFIELD_CODE) {
+            field->setContents(edit.new_contents_);
+            modified = true;
+            continue;
+        }
+
+        std::string contents(field->getContents());
+        const size_t subfield_pos(FindSubfieldPosition(contents, edit.subfield_code_));
+        if (edit.type_ == EditType::ADD_SUBFIELD)
+            contents.insert((subfield_pos == std::string::npos) ? contents.length() : subfield_pos, edit.new_contents_);
+        else { // Replace the value of the first matching subfield.
+            if (subfield_pos == std::string::npos or contents[subfield_pos + 1] != edit.subfield_code_)
+                continue;
+            const size_t value_start(subfield_pos + 2);
+            auto value_end(contents.find('\x1F', value_start));
+            if (value_end == std::string::npos)
+                value_end = contents.length();
+            contents.replace(value_start, value_end - value_start, edit.new_contents_);
         }
+        field->setContents(contents);
+        modified = true;
     }
 
-    return modified_at_least_one;
+    return modified;
 }
 
 
 void Augment(std::vector<AugmentorDescriptor> &augmentors, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer) {
+    EditProgram edit_program(augmentors);
+
     unsigned total_count(0), modified_count(0);
-    std::string error_message;
     while (MARC::Record record = marc_reader->read()) {
         ++total_count;
-        bool modified_record(false);
-        for (auto &augmentor : augmentors) {
-            if (augmentor.getAugmentorType() == AugmentorType::INSERT_FIELD) {
-                if (InsertField(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText(),
-                                &error_message))
-                    modified_record = true;
-                else if (not error_message.empty())
-                    LOG_WARNING(error_message);
-            } else if (augmentor.getAugmentorType() == AugmentorType::INSERT_FIELD_IF) {
-                if (InsertField(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText(),
-                                &error_message, augmentor.getCompiledPattern()))
-                    modified_record = true;
-                else if (not error_message.empty())
-                    LOG_WARNING(error_message);
-            } else if (augmentor.getAugmentorType() == AugmentorType::REPLACE_FIELD) {
-                if (ReplaceField(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText()))
-                    modified_record = true;
-            } else if (augmentor.getAugmentorType() == AugmentorType::REPLACE_FIELD_IF) {
-                if (ReplaceField(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText(),
-                                 augmentor.getCompiledPattern()))
-                    modified_record = true;
-            } else if (augmentor.getAugmentorType() == AugmentorType::ADD_SUBFIELD) {
-                if (AddSubfield(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText()))
-                    modified_record = true;
-            } else if (augmentor.getAugmentorType() == AugmentorType::ADD_SUBFIELD_IF) {
-                if (AddSubfield(&record, augmentor.getTag(), augmentor.getSubfieldCode(), augmentor.getInsertionText(),
-                                augmentor.getCompiledPattern()))
-                    modified_record = true;
-            } else
-                LOG_ERROR("unhandled Augmentor type!");
-        }
-
-        if (modified_record)
+        if (edit_program.apply(&record))
             ++modified_count;
         marc_writer->write(record);
     }
@@ -350,7 +417,7 @@ void ExtractCommandArgs(char ***argvp, MARC::Tag * const tag, char * const subfi
     if (first_colon_pos != MARC::Record::TAG_LENGTH and first_colon_pos != MARC::Record::TAG_LENGTH + 1)
         LOG_ERROR("invalid tag and optional subfield code after \"" + command + "\"!");
     *tag = MARC::Tag(tag_and_optional_subfield_code.substr(0, MARC::Record::TAG_LENGTH));
-    *subfield_code = (tag_and_optional_subfield_code.length() > MARC::Record::TAG_LENGTH)
+    *subfield_code = (first_colon_pos > MARC::Record::TAG_LENGTH)
                      ? tag_and_optional_subfield_code[MARC::Record::TAG_LENGTH] : CompiledPattern::NO_SUBFIELD_CODE;
 
     *field_or_subfield_contents = tag_and_optional_subfield_code.substr(first_colon_pos + 1);
@@ -456,8 +523,8 @@ int Main(int argc, char **argv) {
     auto marc_writer(MARC::Writer::Factory(output_filename));
 
     std::vector<AugmentorDescriptor> augmentors;
-    if (*(argv + 1) != nullptr and std::strcmp(*(argv + 1), "--config-path") == 0) {
-        argv += 2;
+    if (std::strcmp(*argv, "--config-path") == 0) {
+        ++argv;
         if (*argv == nullptr)
             LOG_ERROR("missing config filename after \"--config-path\"!");
         const std::string config_filename(*argv);
@@ -20,13 +20,17 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include "FileUtil.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "util.h"
@@ -45,33 +49,41 @@ namespace {
 
 
 class Rule {
+    unsigned rule_no_; // The position in the rules file.  Violations are reported in this order.
 public:
+    explicit Rule(const unsigned rule_no): rule_no_(rule_no) { }
     virtual ~Rule() { }
 
-    virtual bool hasBeenViolated(const MARC::Record &record, std::string * const err_msg) const = 0;
+    inline unsigned getRuleNo() const { return rule_no_; }
+
+    // As RegexMatcher's are not thread-safe, each worker thread needs its own copy.
+    virtual Rule *clone() const = 0;
+
+    /** \brief Checks one field w/ the tag that the rule has been registered for.
+     *  \note  Only the first violation of a rule per record gets reported.
+     */
+    virtual bool hasBeenViolated(const MARC::Record::Field &field, std::string * const err_msg) const = 0;
 };
 
 
 class SubfieldMatches final: public Rule {
-    MARC::Tag tag_;
     char subfield_code_;
-    std::shared_ptr<RegexMatcher> matcher_;
+    std::unique_ptr<RegexMatcher> matcher_;
 public:
-    SubfieldMatches(const MARC::Tag &tag, const char subfield_code, RegexMatcher * const matcher)
-        : tag_(tag), subfield_code_(subfield_code), matcher_(matcher) { }
+    SubfieldMatches(const unsigned rule_no, const char subfield_code, RegexMatcher * const matcher)
+        : Rule(rule_no), subfield_code_(subfield_code), matcher_(matcher) { }
     virtual ~SubfieldMatches() = default;
 
-    virtual bool hasBeenViolated(const MARC::Record &record, std::string * const err_msg) const final;
+    virtual Rule *clone() const final { return new SubfieldMatches(getRuleNo(), subfield_code_, new RegexMatcher(*matcher_)); }
+    virtual bool hasBeenViolated(const MARC::Record::Field &field, std::string * const err_msg) const final;
 };
 
 
-bool SubfieldMatches::hasBeenViolated(const MARC::Record &record, std::string * const err_msg) const {
-    for (const auto &field : record.getTagRange(tag_)) {
-        for (const auto &subfield : field.getSubfields()) {
-            if (subfield.code_ == subfield_code_ and not matcher_->matched(subfield.value_)) {
-                *err_msg = "\"" + subfield.value_ +"\" does not match \"" + matcher_->getPattern() + "\"";
-                return true;
-            }
+bool SubfieldMatches::hasBeenViolated(const MARC::Record::Field &field, std::string * const err_msg) const {
+    for (const auto &subfield : field.getSubfields()) {
+        if (subfield.code_ == subfield_code_ and not matcher_->matched(subfield.value_)) {
+            *err_msg = "\"" + subfield.value_ +"\" does not match \"" + matcher_->getPattern() + "\"";
+            return true;
         }
     }
 
@@ -80,26 +92,25 @@ bool SubfieldMatches::hasBeenViolated(const MARC::Record &record, std::string *
 
 
 class FirstSubfieldMatches final: public Rule {
-    MARC::Tag tag_;
     char subfield_code_;
-    std::shared_ptr<RegexMatcher> matcher_;
+    std::unique_ptr<RegexMatcher> matcher_;
 public:
-    FirstSubfieldMatches(const MARC::Tag &tag, const char subfield_code, RegexMatcher * const matcher)
-        : tag_(tag), subfield_code_(subfield_code), matcher_(matcher) { }
+    FirstSubfieldMatches(const unsigned rule_no, const char subfield_code, RegexMatcher * const matcher)
+        : Rule(rule_no), subfield_code_(subfield_code), matcher_(matcher) { }
     virtual ~FirstSubfieldMatches() = default;
 
-    virtual bool hasBeenViolated(const MARC::Record &record, std::string * const err_msg) const final;
+    virtual Rule *clone() const final { return new FirstSubfieldMatches(getRuleNo(), subfield_code_, new RegexMatcher(*matcher_)); }
+    virtual bool hasBeenViolated(const MARC::Record::Field &field, std::string * const err_msg) const final;
 };
 
 
-bool FirstSubfieldMatches::hasBeenViolated(const MARC::Record &record, std::string * const err_msg) const {
-    for (const auto &field : record.getTagRange(tag_)) {
-        for (const auto &subfield : field.getSubfields()) {
-            if (subfield.code_ == subfield_code_ and not matcher_->matched(subfield.value_)) {
-                *err_msg = "\"" + subfield.value_ +"\" does not match \"" + matcher_->getPattern() + "\"";
-                return true;
-            } else if (subfield.code_ == subfield_code_ and matcher_->matched(subfield.value_))
-                break;
+bool FirstSubfieldMatches::hasBeenViolated(const MARC::Record::Field &field, std::string * const err_msg) const {
+    for (const auto &subfield : field.getSubfields()) {
+        if (subfield.code_ == subfield_code_) {
+            if (matcher_->matched(subfield.value_))
+                return false;
+            *err_msg = "\"" + subfield.value_ +"\" does not match \"" + matcher_->getPattern() + "\"";
+            return true;
         }
     }
 
@@ -107,6 +118,73 @@ bool FirstSubfieldMatches::hasBeenViolated(const MARC::Record &record, std::stri
 }
 
 
+/** \class RuleSet
+ *  \brief The rules grouped by tag, so that a record only has to be searched once for each distinct tag that has rules.
+ *  \note  The regexes are compiled once, when the rules are loaded.  Copies share the compiled patterns via the
+ *         RegexMatcher pattern cache.
+ */
+class RuleSet {
+    std::map<MARC::Tag, std::vector<std::unique_ptr<Rule>>> tags_and_rules_;
+public:
+    RuleSet() = default;
+    RuleSet(const RuleSet &other);
+
+    inline bool empty() const { return tags_and_rules_.empty(); }
+    void addRule(const MARC::Tag &tag, Rule * const rule);
+
+    // \return The error messages of all violated rules in rule order.
+    std::vector<std::string> getViolations(const MARC::Record &record) const;
+private:
+    RuleSet &operator=(const RuleSet &) = delete;
+};
+
+
+RuleSet::RuleSet(const RuleSet &other) {
+    for (const auto &tag_and_rules : other.tags_and_rules_) {
+        auto &rules(tags_and_rules_[tag_and_rules.first]);
+        for (const auto &rule : tag_and_rules.second)
+            rules.emplace_back(rule->clone());
+    }
+}
+
+
+void RuleSet::addRule(const MARC::Tag &tag, Rule * const rule) {
+    tags_and_rules_[tag].emplace_back(rule);
+}
+
+
+std::vector<std::string> RuleSet::getViolations(const MARC::Record &record) const {
+    std::vector<std::pair<unsigned, std::string>> rule_nos_and_err_msgs;
+    for (const auto &tag_and_rules : tags_and_rules_) {
+        const auto fields(record.getTagRange(tag_and_rules.first));
+        if (fields.empty())
+            continue;
+
+        for (const auto &rule : tag_and_rules.second) {
+            for (const auto &field : fields) {
+                std::string err_msg;
+                if (rule->hasBeenViolated(field, &err_msg)) {
+                    rule_nos_and_err_msgs.emplace_back(rule->getRuleNo(), err_msg);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::sort(rule_nos_and_err_msgs.begin(), rule_nos_and_err_msgs.end(),
+              [](const std::pair<unsigned, std::string> &rule_no_and_err_msg1,
+                 const std::pair<unsigned, std::string> &rule_no_and_err_msg2)
+                  { return rule_no_and_err_msg1.first < rule_no_and_err_msg2.first; });
+
+    std::vector<std::string> err_msgs;
+    err_msgs.reserve(rule_nos_and_err_msgs.size());
+    for (auto &rule_no_and_err_msg : rule_nos_and_err_msgs)
+        err_msgs.emplace_back(std::move(rule_no_and_err_msg.second));
+
+    return err_msgs;
+}
+
+
 // Parse a line with "words" separated by spaces.  Backslash escapes are supported.
 bool ParseLine(const std::string &line, std::vector<std::string> * const parts) {
     parts->clear();
@@ -133,7 +211,7 @@ bool ParseLine(const std::string &line, std::vector<std::string> * const parts)
 }
 
 
-void LoadRules(const std::string &rules_filename, std::vector<Rule *> * const rules) {
+void LoadRules(const std::string &rules_filename, RuleSet * const rules) {
     unsigned line_no(0);
     for (const auto line : FileUtil::ReadLines(rules_filename, FileUtil::ReadLines::DO_NOT_TRIM)) {
         ++line_no;
@@ -159,12 +237,11 @@ void LoadRules(const std::string &rules_filename, std::vector<Rule *> * const ru
                 LOG_ERROR("bad " + parts[0] + " rule in \"" + rules_filename + "\" on line #" + std::to_string(line_no)
                           + "! (Bad regex: " + err_msg + ".)");
 
+            const MARC::Tag tag(parts[1].substr(0, MARC::Record::TAG_LENGTH));
             if (parts[0] == "subfield_match")
-                rules->emplace_back(new SubfieldMatches(parts[1].substr(0, MARC::Record::TAG_LENGTH),
-                                                        parts[1][MARC::Record::TAG_LENGTH], matcher));
+                rules->addRule(tag, new SubfieldMatches(line_no, parts[1][MARC::Record::TAG_LENGTH], matcher));
             else
-                rules->emplace_back(new FirstSubfieldMatches(parts[1].substr(0, MARC::Record::TAG_LENGTH),
-                                                             parts[1][MARC::Record::TAG_LENGTH], matcher));
+                rules->addRule(tag, new FirstSubfieldMatches(line_no, parts[1][MARC::Record::TAG_LENGTH], matcher));
         } else
             LOG_ERROR("unknown rule \"" + parts[0] + "\" in \"" + rules_filename + "\" on line #" + std::to_string(line_no) + "!");
     }
@@ -262,56 +339,95 @@ void CheckLocalBlockConsistency(const MARC::Record &record) {
 }
 
 
-void ProcessRecords(const bool do_not_abort_on_empty_subfields, const bool do_not_abort_on_invalid_repeated_fields,
-                    const bool check_rule_violations_only, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                    const std::vector<Rule *> &rules, File * const rule_violation_list)
+void CheckRecordStructure(const bool do_not_abort_on_empty_subfields, const bool do_not_abort_on_invalid_repeated_fields,
+                          const MARC::Record &record, const std::string &control_number)
 {
-    unsigned record_count(0), control_number_duplicate_count(0), rule_violation_count(0);
-    std::unordered_set<std::string> already_seen_control_numbers;
-
-    while (const MARC::Record record = marc_reader->read()) {
-        ++record_count;
+    CheckFieldOrder(do_not_abort_on_invalid_repeated_fields, record);
 
-        const std::string CONTROL_NUMBER(record.getControlNumber());
-        if (unlikely(CONTROL_NUMBER.empty()))
-            LOG_ERROR("Record #" + std::to_string(record_count) + " is missing a control number!");
+    MARC::Tag last_tag(std::string(MARC::Record::TAG_LENGTH, ' '));
+    for (const auto &field : record) {
+        if (not field.getTag().isTagOfControlField())
+            CheckDataField(do_not_abort_on_empty_subfields, field, control_number);
 
-        if (not check_rule_violations_only) {
-            if (already_seen_control_numbers.find(CONTROL_NUMBER) == already_seen_control_numbers.end())
-                already_seen_control_numbers.emplace(CONTROL_NUMBER);
-            else {
-                ++control_number_duplicate_count;
-                LOG_WARNING("found duplicate control number \"" + CONTROL_NUMBER + "\"!");
-            }
+        if (unlikely(field.getTag() < last_tag))
+            LOG_ERROR("Incorrect non-alphanumeric field order in record w/ control number \"" + control_number + "\"!");
+        last_tag = field.getTag();
+    }
 
-            CheckFieldOrder(do_not_abort_on_invalid_repeated_fields, record);
+    CheckLocalBlockConsistency(record);
+}
 
-            MARC::Tag last_tag(std::string(MARC::Record::TAG_LENGTH, ' '));
-            for (const auto &field : record) {
-                if (not field.getTag().isTagOfControlField())
-                    CheckDataField(do_not_abort_on_empty_subfields, field, CONTROL_NUMBER);
 
-                if (unlikely(field.getTag() < last_tag))
-                    LOG_ERROR("Incorrect non-alphanumeric field order in record w/ control number \"" + CONTROL_NUMBER + "\"!");
-                last_tag = field.getTag();
+// The structural checks and the rule checks run on worker threads, each record being decoded only once.  The checks
+// that depend on the record order or on previously seen records, as well as all output, happen in input order on the
+// calling thread.
+void ProcessRecords(const bool do_not_abort_on_empty_subfields, const bool do_not_abort_on_invalid_repeated_fields,
+                    const bool check_rule_violations_only, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
+                    const RuleSet &rules, File * const rule_violation_list)
+{
+    const bool check_rules(rule_violation_list != nullptr and not rules.empty());
+
+    // Violations are handed from the workers to the consumer by sequence number:
+    std::mutex sequence_nos_and_violations_mutex;
+    std::unordered_map<size_t, std::vector<std::string>> sequence_nos_and_violations;
+
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+    const auto record_processor([&](MARC::Record * const record) {
+        const std::string control_number(record->getControlNumber());
+        if (unlikely(control_number.empty()))
+            LOG_ERROR("Record #" + std::to_string(MARC::ParallelProcessor::GetCurrentSequenceNo() + 1)
+                      + " is missing a control number!");
+
+        if (not check_rule_violations_only)
+            CheckRecordStructure(do_not_abort_on_empty_subfields, do_not_abort_on_invalid_repeated_fields, *record,
+                                 control_number);
+
+        if (check_rules) {
+            // "rules" is only ever copied and never used for matching, so no thread copies a RegexMatcher that is in use.
+            thread_local std::unique_ptr<RuleSet> worker_rules;
+            if (worker_rules == nullptr)
+                worker_rules.reset(new RuleSet(rules));
+
+            std::vector<std::string> violations(worker_rules->getViolations(*record));
+            if (not violations.empty()) {
+                std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_violations_mutex);
+                sequence_nos_and_violations.emplace(MARC::ParallelProcessor::GetCurrentSequenceNo(), std::move(violations));
             }
+        }
+
+        return true;
+    });
 
-            CheckLocalBlockConsistency(record);
+    unsigned control_number_duplicate_count(0), rule_violation_count(0);
+    std::unordered_set<std::string> already_seen_control_numbers;
+    const size_t record_count(processor.process(record_processor, [&](const MARC::Record &record) {
+        const std::string control_number(record.getControlNumber());
+        if (not check_rule_violations_only and not already_seen_control_numbers.emplace(control_number).second) {
+            ++control_number_duplicate_count;
+            LOG_WARNING("found duplicate control number \"" + control_number + "\"!");
         }
 
-        if (rule_violation_list != nullptr and not rules.empty()) {
-            for (const auto rule : rules) {
-                std::string err_msg;
-                if (rule->hasBeenViolated(record, &err_msg)) {
-                    ++rule_violation_count;
-                    (*rule_violation_list) << record.getControlNumber() << ": " << err_msg << '\n';
+        if (check_rules) {
+            std::vector<std::string> violations;
+            {
+                std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_violations_mutex);
+                const auto sequence_no_and_violations(
+                    sequence_nos_and_violations.find(MARC::ParallelProcessor::GetCurrentSequenceNo()));
+                if (sequence_no_and_violations != sequence_nos_and_violations.end()) {
+                    violations.swap(sequence_no_and_violations->second);
+                    sequence_nos_and_violations.erase(sequence_no_and_violations);
                 }
             }
+
+            for (const auto &violation : violations) {
+                ++rule_violation_count;
+                (*rule_violation_list) << control_number << ": " << violation << '\n';
+            }
         }
 
         if (marc_writer != nullptr)
             marc_writer->write(record);
-    }
+    }));
 
     if (control_number_duplicate_count > 0)
         LOG_ERROR("Found " + std::to_string(control_number_duplicate_count) + " duplicate control numbers!");
@@ -364,7 +480,7 @@ int Main(int argc, char *argv[]) {
     if (argc != 2 and argc != 4)
         Usage();
 
-    std::vector<Rule *> rules;
+    RuleSet rules;
     std::unique_ptr<File> rule_violation_list;
     if (argc == 4) {
         LoadRules(argv[2], &rules);
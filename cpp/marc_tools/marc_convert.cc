@@ -17,12 +17,17 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
+#include "File.h"
 #include "FileUtil.h"
 #include "MARC.h"
 #include "StringUtil.h"
@@ -33,10 +38,14 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " [--quiet] [--limit max_no_of_records] [--output-individual-files] marc_input marc_output [CTLN_1 CTLN_2 .. CTLN_N]\n"
+    std::cerr << "Usage: " << ::progname << " [--quiet] [--limit max_no_of_records] [--threads thread_count] [--output-individual-files] marc_input marc_output [CTLN_1 CTLN_2 .. CTLN_N]\n"
               << "       Autoconverts the MARC format of \"marc_input\" to \"marc_output\".\n"
-              << "       Supported extensions are \"xml\", \"mrc\", \"marc\" and \"raw\".\n"
+              << "       Supported extensions are \"xml\", \"mrc\", \"marc\" and \"raw\", optionally followed by \".gz\"\n"
+              << "       for gzip-compressed files.\n"
               << "       All extensions except for \"xml\" are assumed to imply MARC-21.\n"
+              << "       The input is split into chunks that are converted on \"thread_count\" threads, the default being\n"
+              << "       one per core.  --limit, --output-individual-files, indexed output and compressed XML input are\n"
+              << "       always processed on a single thread.\n"
               << "       If a control number list has been specified only those records will\n"
               << "       be extracted or converted.\n"
               << "       If --output-individual-files is specified marc_output must be a writable directory\n"
@@ -82,6 +91,234 @@ void ProcessRecords(const bool quiet, const bool output_individual_files, const
 }
 
 
+// Input chunks are about this large.  Smaller chunks would increase the overhead and larger ones the memory usage.
+const size_t CHUNK_SIZE(8 * 1024 * 1024);
+
+
+struct ConvertedChunk {
+    std::string output_;
+    unsigned record_count_, extracted_count_;
+    ConvertedChunk(): record_count_(0), extracted_count_(0) { }
+};
+
+
+// Serialises the selected records of a chunk in the output format.
+class ChunkConverter {
+    const std::set<std::string> &control_numbers_;
+    std::string xml_document_;
+    std::unique_ptr<MARC::XmlWriter> xml_writer_;
+    size_t xml_prologue_size_;
+    ConvertedChunk converted_chunk_;
+public:
+    ChunkConverter(const MARC::FileType output_type, const std::set<std::string> &control_numbers);
+
+    void convert(const MARC::Record &record);
+
+    // \note Must only be called once.
+    ConvertedChunk finish();
+};
+
+
+ChunkConverter::ChunkConverter(const MARC::FileType output_type, const std::set<std::string> &control_numbers)
+    : control_numbers_(control_numbers)
+{
+    // The XML declaration and the opening <collection> tag are written by the writer of the actual output file:
+    if (output_type == MARC::FileType::XML)
+        xml_writer_.reset(new MARC::XmlWriter(&xml_document_));
+    xml_prologue_size_ = xml_document_.size();
+}
+
+
+void ChunkConverter::convert(const MARC::Record &record) {
+    ++converted_chunk_.record_count_;
+    if (not control_numbers_.empty() and control_numbers_.find(record.getControlNumber()) == control_numbers_.end())
+        return;
+
+    ++converted_chunk_.extracted_count_;
+    if (xml_writer_ != nullptr)
+        xml_writer_->write(record);
+    else
+        MARC::BinaryWriter::AppendRecord(record, &converted_chunk_.output_);
+}
+
+
+ConvertedChunk ChunkConverter::finish() {
+    if (xml_writer_ != nullptr)
+        converted_chunk_.output_.assign(xml_document_, xml_prologue_size_, std::string::npos);
+    return std::move(converted_chunk_);
+}
+
+
+struct BinaryChunk {
+    std::string raw_records_;
+    std::vector<size_t> record_sizes_;
+};
+
+
+ConvertedChunk ConvertBinaryChunk(const BinaryChunk &binary_chunk, const MARC::FileType output_type,
+                                  const std::set<std::string> &control_numbers)
+{
+    ChunkConverter chunk_converter(output_type, control_numbers);
+    const char *record_start(binary_chunk.raw_records_.data());
+    for (const auto record_size : binary_chunk.record_sizes_) {
+        chunk_converter.convert(MARC::Record(record_size, record_start));
+        record_start += record_size;
+    }
+
+    return chunk_converter.finish();
+}
+
+
+// Converts the records that end in (chunk_start, chunk_end].  Each chunk gets its own reader.
+ConvertedChunk ConvertXmlChunk(const std::string &input_filename, const off_t chunk_start, const off_t chunk_end,
+                               const MARC::FileType output_type, const std::set<std::string> &control_numbers)
+{
+    const auto marc_reader(MARC::Reader::Factory(input_filename, MARC::FileType::XML));
+    if (chunk_start > 0 and unlikely(not marc_reader->seek(chunk_start)))
+        LOG_ERROR("failed to seek to offset " + std::to_string(chunk_start) + " in \"" + input_filename + "\"!");
+
+    ChunkConverter chunk_converter(output_type, control_numbers);
+    while (marc_reader->tell() < chunk_end) {
+        const MARC::Record record(marc_reader->read());
+        if (not record)
+            break;
+        chunk_converter.convert(record);
+    }
+
+    return chunk_converter.finish();
+}
+
+
+// \return True if "s[0, length)" consists of an optional namespace prefix followed by a colon, e.g. "marc:", and nothing else.
+bool IsNamespacePrefix(const char * const s, const size_t length) {
+    if (length == 0)
+        return true;
+    if (s[length - 1] != ':')
+        return false;
+    for (size_t i(0); i < length - 1; ++i) {
+        if (not StringUtil::IsAsciiLetter(s[i]) and not StringUtil::IsDigit(s[i]) and s[i] != '_' and s[i] != '-' and s[i] != '.')
+            return false;
+    }
+    return true;
+}
+
+
+// A fast pre-scan that doesn't parse any XML.  Character data can't contain a literal '<', so any "</record>" or
+// "</prefix:record>" that we find is the end of a record.
+// \return The offset just past the first closing record tag at or after "offset" or the size of the input if there is none.
+off_t FindEndOfRecord(File * const input, const off_t offset) {
+    const size_t BLOCK_SIZE(1024 * 1024), MAX_TAG_PREFIX_LENGTH(64);
+    const std::string RECORD_SUFFIX("record>");
+    std::string block(BLOCK_SIZE, '\0');
+    for (off_t block_start(offset); /* Intentionally empty! */; block_start += BLOCK_SIZE - MAX_TAG_PREFIX_LENGTH) {
+        if (unlikely(not input->seek(block_start)))
+            LOG_ERROR("failed to seek to offset " + std::to_string(block_start) + " in \"" + input->getPath() + "\"!");
+        const size_t block_length(input->read(&block[0], BLOCK_SIZE));
+
+        for (size_t suffix_pos(block.find(RECORD_SUFFIX)); suffix_pos < block_length;
+             suffix_pos = block.find(RECORD_SUFFIX, suffix_pos + 1))
+        {
+            if (suffix_pos + RECORD_SUFFIX.length() > block_length)
+                break;
+            const size_t tag_start(block.rfind("</", suffix_pos));
+            if (tag_start != std::string::npos and suffix_pos - tag_start <= MAX_TAG_PREFIX_LENGTH
+                and IsNamespacePrefix(block.data() + tag_start + 2, suffix_pos - tag_start - 2))
+                return block_start + suffix_pos + RECORD_SUFFIX.length();
+        }
+
+        if (block_length < BLOCK_SIZE)
+            return block_start + block_length;
+    }
+}
+
+
+struct ParallelConversionStats {
+    unsigned record_count_, extracted_count_;
+    ParallelConversionStats(): record_count_(0), extracted_count_(0) { }
+};
+
+
+// Keeps at most 2 chunks per thread in flight and writes the converted chunks in input order.
+class OrderedChunkWriter {
+    File * const output_;
+    const unsigned thread_count_;
+    std::deque<std::future<ConvertedChunk>> pending_chunks_;
+    ParallelConversionStats * const stats_;
+public:
+    OrderedChunkWriter(File * const output, const unsigned thread_count, ParallelConversionStats * const stats)
+        : output_(output), thread_count_(thread_count), stats_(stats) { }
+    ~OrderedChunkWriter() { while (not pending_chunks_.empty()) writeOldestChunk(); }
+
+    void add(std::future<ConvertedChunk> &&pending_chunk);
+private:
+    void writeOldestChunk();
+};
+
+
+void OrderedChunkWriter::add(std::future<ConvertedChunk> &&pending_chunk) {
+    if (pending_chunks_.size() >= 2 * thread_count_)
+        writeOldestChunk();
+    pending_chunks_.emplace_back(std::move(pending_chunk));
+}
+
+
+void OrderedChunkWriter::writeOldestChunk() {
+    const ConvertedChunk converted_chunk(pending_chunks_.front().get());
+    pending_chunks_.pop_front();
+    if (unlikely(output_->write(converted_chunk.output_.data(), converted_chunk.output_.size()) != converted_chunk.output_.size()))
+        LOG_ERROR("failed to write to \"" + output_->getPath() + "\"!");
+    stats_->record_count_ += converted_chunk.record_count_;
+    stats_->extracted_count_ += converted_chunk.extracted_count_;
+}
+
+
+// Splits the input into chunks at record boundaries, converts the chunks concurrently and concatenates the results.
+void ProcessRecordsInParallel(const bool quiet, const unsigned thread_count, MARC::Reader * const marc_reader,
+                              const std::string &output_filename, const std::set<std::string> &control_numbers)
+{
+    const auto marc_writer(MARC::Writer::Factory(output_filename));
+    const MARC::FileType output_type(MARC::GuessFileType(output_filename, MARC::GuessFileTypeBehaviour::USE_THE_FILENAME_ONLY));
+    ParallelConversionStats stats;
+    {
+        // We bypass the writer, which we only need for the start and the end of the document, and write straight to its file:
+        OrderedChunkWriter ordered_chunk_writer(&marc_writer->getFile(), thread_count, &stats);
+        if (marc_reader->getReaderType() == MARC::FileType::XML) {
+            const auto input(FileUtil::OpenInputFileOrDie(marc_reader->getPath()));
+            const off_t input_size(input->size());
+            for (off_t chunk_start(0); chunk_start < input_size; /* Intentionally empty! */) {
+                const off_t chunk_end(FindEndOfRecord(input.get(), chunk_start + CHUNK_SIZE));
+                ordered_chunk_writer.add(std::async(std::launch::async, ConvertXmlChunk, marc_reader->getPath(), chunk_start,
+                                                   chunk_end, output_type, std::cref(control_numbers)));
+                chunk_start = chunk_end;
+            }
+        } else {
+            // Reading binary records is cheap, so we do it on this thread and only parse them on the others:
+            auto binary_reader(static_cast<MARC::BinaryReader *>(marc_reader));
+            BinaryChunk binary_chunk;
+            const auto add_chunk([&]() {
+                ordered_chunk_writer.add(std::async(std::launch::async, ConvertBinaryChunk, std::move(binary_chunk), output_type,
+                                                    std::cref(control_numbers)));
+                binary_chunk = BinaryChunk();
+            });
+            while (const MARC::RecordView record_view = binary_reader->readView()) {
+                binary_chunk.raw_records_.append(record_view.data(), record_view.size());
+                binary_chunk.record_sizes_.emplace_back(record_view.size());
+                if (binary_chunk.raw_records_.size() >= CHUNK_SIZE)
+                    add_chunk();
+            }
+            if (not binary_chunk.record_sizes_.empty())
+                add_chunk();
+        }
+    }
+
+    if (not quiet) {
+        logger->info("Processed " + std::to_string(stats.record_count_) + " MARC record(s) on " + std::to_string(thread_count)
+                     + " thread(s).");
+        logger->info("Extracted or converted " + std::to_string(stats.extracted_count_) + " record(s).");
+    }
+}
+
+
 } // unnamed namespace
 
 
@@ -108,6 +345,14 @@ int main(int argc, char *argv[]) {
         argv += 2;
     }
 
+    unsigned thread_count(std::max(std::thread::hardware_concurrency(), 1u));
+    if (std::strcmp(argv[1], "--threads") == 0) {
+        if (not StringUtil::ToUnsigned(argv[2], &thread_count) or thread_count == 0)
+            Usage();
+        argc -= 2;
+        argv += 2;
+    }
+
     bool output_individual_files(false);
     if (std::strcmp(argv[1], "--output-individual-files") == 0) {
         output_individual_files = true;
@@ -127,7 +372,14 @@ int main(int argc, char *argv[]) {
         for (int arg_no(3); arg_no < argc; ++arg_no)
             control_numbers.emplace(argv[arg_no]);
 
-        ProcessRecords(quiet, output_individual_files, max_no_of_records, marc_reader.get(), output_file_or_directory, control_numbers);
+        if (thread_count == 1 or max_no_of_records != UINT_MAX or output_individual_files
+            or MARC::GuessFileType(output_file_or_directory, MARC::GuessFileTypeBehaviour::USE_THE_FILENAME_ONLY)
+               == MARC::FileType::INDEXED
+            or (marc_reader->getReaderType() == MARC::FileType::XML and StringUtil::EndsWith(input_filename, ".gz")))
+            ProcessRecords(quiet, output_individual_files, max_no_of_records, marc_reader.get(), output_file_or_directory,
+                           control_numbers);
+        else
+            ProcessRecordsInParallel(quiet, thread_count, marc_reader.get(), output_file_or_directory, control_numbers);
     } catch (const std::exception &e) {
         LOG_ERROR("Caught exception: " + std::string(e.what()));
     }
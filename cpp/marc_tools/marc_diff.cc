@@ -20,21 +20,36 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <queue>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include "File.h"
+#include "FileUtil.h"
 #include "MARC.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
 namespace {
 
 
+const unsigned DEFAULT_SORT_MERGE_MEMORY_LIMIT(1024); // in MiB
+
+
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " [--verbose] marc_collection1 marc_collection2\n";
+    std::cerr << "Usage: " << ::progname << " [--verbose] [--sort-merge[=memory_limit]] marc_collection1 marc_collection2\n"
+              << "       --sort-merge sorts both collections by control number using temporary files and then compares\n"
+              << "       them in a single streaming pass.  Use it for collections whose control numbers don't fit into\n"
+              << "       memory.  \"memory_limit\" is the approximate number of MiB of records that may be held in memory\n"
+              << "       while sorting and defaults to " << DEFAULT_SORT_MERGE_MEMORY_LIMIT << ".\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -200,6 +215,214 @@ void EmitStandardReport(const bool verbose, const std::string &collection1_name,
 }
 
 
+/** \class SortedRecordStream
+ *  \brief Reads a MARC collection in control number order w/o holding more than about "memory_limit" bytes of records
+ *         in memory.
+ *  \note  We write sorted runs to temporary files and merge them as we go.
+ *  \note  Like CollectRecordOffsets(), if a control number occurs more than once, the last occurrence wins.
+ */
+class SortedRecordStream {
+    std::vector<std::unique_ptr<FileUtil::AutoTempFile>> run_files_;
+    std::vector<std::unique_ptr<MARC::Reader>> run_readers_;
+    std::vector<MARC::Record> run_heads_; // The next record of each run.
+
+    // Control numbers and run numbers of the run heads.  The lowest control number is on top.
+    std::priority_queue<std::pair<std::string, size_t>, std::vector<std::pair<std::string, size_t>>,
+                        std::greater<std::pair<std::string, size_t>>> heads_queue_;
+    unsigned record_count_;
+public:
+    SortedRecordStream(MARC::Reader * const reader, const size_t memory_limit);
+
+    /** \return The record w/ the next higher control number or a null record if there are none left. */
+    MARC::Record read();
+
+    /** \return The number of records returned by read() so far. */
+    inline unsigned getRecordCount() const { return record_count_; }
+private:
+    void writeRun(std::vector<MARC::Record> * const records);
+    void advance(const size_t run_no);
+};
+
+
+SortedRecordStream::SortedRecordStream(MARC::Reader * const reader, const size_t memory_limit): record_count_(0) {
+    std::vector<MARC::Record> records;
+    size_t buffered_size(0);
+    while (MARC::Record record = reader->read()) {
+        buffered_size += record.size();
+        records.emplace_back(std::move(record));
+        if (buffered_size >= memory_limit) {
+            writeRun(&records);
+            buffered_size = 0;
+        }
+    }
+    if (not records.empty())
+        writeRun(&records);
+
+    for (size_t run_no(0); run_no < run_files_.size(); ++run_no) {
+        run_readers_.emplace_back(MARC::Reader::Factory(run_files_[run_no]->getFilePath(), MARC::FileType::BINARY));
+        run_heads_.emplace_back(std::string(MARC::Record::LEADER_LENGTH, ' '));
+        advance(run_no);
+    }
+}
+
+
+MARC::Record SortedRecordStream::read() {
+    if (heads_queue_.empty())
+        return MARC::Record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+
+    const std::string control_number(heads_queue_.top().first);
+    size_t run_no(heads_queue_.top().second);
+    heads_queue_.pop();
+    MARC::Record record(std::move(run_heads_[run_no]));
+    advance(run_no);
+
+    // Later runs contain later records, so we keep the record from the highest run number:
+    while (not heads_queue_.empty() and heads_queue_.top().first == control_number) {
+        run_no = heads_queue_.top().second;
+        heads_queue_.pop();
+        record = std::move(run_heads_[run_no]);
+        advance(run_no);
+    }
+
+    ++record_count_;
+    return record;
+}
+
+
+void SortedRecordStream::writeRun(std::vector<MARC::Record> * const records) {
+    // Sorting pairs of control numbers and positions keeps records w/ identical control numbers in input order:
+    std::vector<std::pair<std::string, size_t>> control_numbers_and_indices;
+    control_numbers_and_indices.reserve(records->size());
+    for (size_t index(0); index < records->size(); ++index)
+        control_numbers_and_indices.emplace_back((*records)[index].getControlNumber(), index);
+    std::sort(control_numbers_and_indices.begin(), control_numbers_and_indices.end());
+
+    run_files_.emplace_back(new FileUtil::AutoTempFile("/tmp/marc_diff_run"));
+    const auto run_writer(MARC::Writer::Factory(run_files_.back()->getFilePath(), MARC::FileType::BINARY));
+    for (auto control_number_and_index(control_numbers_and_indices.cbegin());
+         control_number_and_index != control_numbers_and_indices.cend(); ++control_number_and_index)
+    {
+        const auto next(control_number_and_index + 1);
+        if (next == control_numbers_and_indices.cend() or next->first != control_number_and_index->first)
+            run_writer->write((*records)[control_number_and_index->second]);
+    }
+
+    records->clear();
+}
+
+
+void SortedRecordStream::advance(const size_t run_no) {
+    run_heads_[run_no] = run_readers_[run_no]->read();
+    if (run_heads_[run_no])
+        heads_queue_.emplace(run_heads_[run_no].getControlNumber(), run_no);
+}
+
+
+// Pairs of records w/ identical control numbers but differing checksums.
+const size_t DIFF_BATCH_SIZE(4096);
+
+
+// Runs RecordsDiffer() on all pairs in "batch" in parallel and reports the differences in the original order.
+void ReportBatchDifferences(const bool verbose, std::vector<std::pair<MARC::Record, MARC::Record>> * const batch,
+                            unsigned * const differ_count)
+{
+    std::vector<char> differs(batch->size(), false);
+    std::vector<std::string> differences(batch->size());
+    const size_t thread_count(std::min(batch->size(), static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))));
+    std::vector<std::thread> threads;
+    for (size_t thread_no(0); thread_no < thread_count; ++thread_no)
+        threads.emplace_back([&, thread_no]() {
+            for (size_t pair_no(thread_no); pair_no < batch->size(); pair_no += thread_count)
+                differs[pair_no] = RecordsDiffer((*batch)[pair_no].first, (*batch)[pair_no].second,
+                                                 &differences[pair_no]);
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t pair_no(0); pair_no < batch->size(); ++pair_no) {
+        if (differs[pair_no]) {
+            ++*differ_count;
+            if (verbose)
+                std::cout << '\t' << (*batch)[pair_no].first.getControlNumber() << " (fields: " << differences[pair_no]
+                          << ")\n";
+        }
+    }
+
+    batch->clear();
+}
+
+
+void ListControlNumbers(const std::string &path) {
+    File input(path, "r");
+    std::string control_number;
+    while (input.getline(&control_number) > 0)
+        std::cout << '\t' << control_number << '\n';
+}
+
+
+// Produces the same reports as EmitDifferenceReport() followed by EmitStandardReport() w/o random access to the
+// collections and w/o having to keep all control numbers in memory.  The control numbers that are only in one of the
+// collections are buffered in temporary files.
+void SortMergeDiff(const bool verbose, const size_t memory_limit, const std::string &collection1_name,
+                   const std::string &collection2_name, MARC::Reader * const reader1, MARC::Reader * const reader2)
+{
+    SortedRecordStream sorted_records1(reader1, memory_limit);
+    SortedRecordStream sorted_records2(reader2, memory_limit);
+
+    const FileUtil::AutoTempFile only_in_1_list("/tmp/marc_diff_only1"), only_in_2_list("/tmp/marc_diff_only2");
+    File only_in_1(only_in_1_list.getFilePath(), "w"), only_in_2(only_in_2_list.getFilePath(), "w");
+    unsigned in_map1_only_count(0), in_map2_only_count(0), differ_count(0);
+
+    if (verbose)
+        std::cout << "Records w/ identical control numbers but differing contents:\n";
+
+    std::vector<std::pair<MARC::Record, MARC::Record>> batch;
+    MARC::Record record1(sorted_records1.read()), record2(sorted_records2.read());
+    while (record1 or record2) {
+        const std::string control_number1(record1 ? record1.getControlNumber() : "");
+        const std::string control_number2(record2 ? record2.getControlNumber() : "");
+        if (record1 and record2 and control_number1 == control_number2) {
+            // Identical checksums let us skip the much more expensive field-by-field comparison:
+            if (MARC::CalcFastChecksum(record1, {}, false) != MARC::CalcFastChecksum(record2, {}, false)) {
+                batch.emplace_back(std::move(record1), std::move(record2));
+                if (batch.size() == DIFF_BATCH_SIZE)
+                    ReportBatchDifferences(verbose, &batch, &differ_count);
+            }
+            record1 = sorted_records1.read();
+            record2 = sorted_records2.read();
+        } else if (not record2 or (record1 and control_number1 < control_number2)) {
+            ++in_map1_only_count;
+            if (verbose)
+                only_in_1.write(control_number1 + "\n");
+            record1 = sorted_records1.read();
+        } else {
+            ++in_map2_only_count;
+            if (verbose)
+                only_in_2.write(control_number2 + "\n");
+            record2 = sorted_records2.read();
+        }
+    }
+    ReportBatchDifferences(verbose, &batch, &differ_count);
+    only_in_1.close();
+    only_in_2.close();
+
+    std::cout << differ_count << " record(s) have identical control numbers but different contents.\n";
+
+    const unsigned collection1_size(sorted_records1.getRecordCount());
+    std::cout << '"' << collection1_name << "\" contains " << collection1_size << " record(s).\n";
+    std::cout << '"' << collection2_name << "\" contains " << sorted_records2.getRecordCount() << " record(s).\n";
+    std::cout << in_map1_only_count << " control number(s) are only in \"" << collection1_name << "\" but not in \""
+              << collection2_name << "\".\n";
+    if (verbose)
+        ListControlNumbers(only_in_1_list.getFilePath());
+    std::cout << in_map2_only_count << " control number(s) are only in \"" << collection2_name << "\" but not in \""
+              << collection1_name << "\".\n";
+    if (verbose)
+        ListControlNumbers(only_in_2_list.getFilePath());
+    std::cout << (collection1_size - in_map1_only_count) << " are in both collections.\n";
+}
+
+
 } // unnamed namespace
 
 
@@ -213,6 +436,19 @@ int Main(int argc, char *argv[]) {
     if (verbose)
         --argc, ++argv;
 
+    bool sort_merge(false);
+    unsigned memory_limit(DEFAULT_SORT_MERGE_MEMORY_LIMIT);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--sort-merge")) {
+        sort_merge = true;
+        if (StringUtil::StartsWith(argv[1], "--sort-merge=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--sort-merge="), &memory_limit)
+                or memory_limit == 0)
+                LOG_ERROR("bad memory limit in \"" + std::string(argv[1]) + "\"!");
+        } else if (std::strcmp(argv[1], "--sort-merge") != 0)
+            Usage();
+        --argc, ++argv;
+    }
+
     if (argc != 3)
         Usage();
 
@@ -221,6 +457,13 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Reader> marc_reader1(MARC::Reader::Factory(collection1_name));
     std::unique_ptr<MARC::Reader> marc_reader2(MARC::Reader::Factory(collection2_name));
 
+    if (sort_merge) {
+        // Both collections are sorted one after the other, so each of them may use the entire memory limit:
+        SortMergeDiff(verbose, static_cast<size_t>(memory_limit) * 1024 * 1024, collection1_name, collection2_name,
+                      marc_reader1.get(), marc_reader2.get());
+        return EXIT_SUCCESS;
+    }
+
     std::unordered_map<std::string, off_t> control_number_to_offset_map1;
     const size_t collection1_size(MARC::CollectRecordOffsets(marc_reader1.get(), &control_number_to_offset_map1));
 
@@ -19,7 +19,6 @@
 
 #include <iostream>
 #include <memory>
-#include <unordered_map>
 #include <unordered_set>
 #include <cstdio>
 #include <cstdlib>
@@ -73,6 +72,7 @@ void Usage() {
               << "           --replace subfield_specs map_file\n"
               << "             every \"map_file\" must either start with a hash character in which case it is\n"
               << "             ignored or lines that look like \"regex->replacement\" followed by a newline.\n"
+              << "             Each subfield will be replaced using the first entry, in file order, whose regex matches it.\n"
               << "       --filter-chars and --translate character sets may contain any of the following escapes:\n"
               << "         \\n, \\t, \\b, \\r, \\f, \\v, \\a, \\\\, \\uNNNN and \\UNNNNNNNN\n"
               << "       If you don't specify an output format it will be the same as the input format.\n\n";
@@ -327,6 +327,9 @@ public:
 };
 
 
+class ReplacementMap;
+
+
 class FilterDescriptor {
 private:
     FilterType filter_type_;
@@ -337,8 +340,7 @@ private:
     mutable unsigned count_;
     unsigned max_count_;
     TranslateMap *translate_map_;
-    RegexMatcher *regex_matcher_;
-    std::vector<StringFragmentOrBackreference> string_fragments_and_back_references_;
+    ReplacementMap *replacement_map_;
 public:
     inline FilterType getFilterType() const { return filter_type_; }
     inline const std::string &getBiblioLevels() const { return biblio_levels_; }
@@ -357,12 +359,7 @@ public:
     inline const TranslateMap &getTranslateMap() const { return *translate_map_; }
 
     /** \note Only call this if the filter type is REPLACE! */
-    inline RegexMatcher &getRegexMatcher() const { return *regex_matcher_; }
-
-    /** \note Only call this if the filter type is REPLACE! */
-    inline const std::vector<StringFragmentOrBackreference> &getStringFragmentsAndBackreferences() const {
-        return string_fragments_and_back_references_;
-    }
+    inline const ReplacementMap &getReplacementMap() const { return *replacement_map_; }
 
     inline static FilterDescriptor MakeDropFilter(const std::vector<CompiledPattern *> &compiled_patterns) {
         return FilterDescriptor(FilterType::DROP, compiled_patterns);
@@ -404,28 +401,30 @@ public:
         return FilterDescriptor(subfield_specs, translate_map);
     }
 
+    /** \note We take ownership of "replacement_map" which must have been allocated on the heap. */
     inline static FilterDescriptor MakeReplacementFilter(const std::vector<std::string> &subfield_specs,
-                                                         const std::string &regex, const std::string &replacement)
+                                                         ReplacementMap * const replacement_map)
     {
-        return FilterDescriptor(subfield_specs, regex, replacement);
+        return FilterDescriptor(subfield_specs, replacement_map);
     }
 private:
     FilterDescriptor(const FilterType filter_type, const std::vector<CompiledPattern *> &compiled_patterns)
         : filter_type_(filter_type), compiled_patterns_(compiled_patterns), translate_map_(nullptr),
-          regex_matcher_(nullptr) { }
+          replacement_map_(nullptr) { }
     FilterDescriptor(const std::vector<std::string> &subfield_specs, const std::string &chars_to_delete)
         : filter_type_(FilterType::FILTER_CHARS), subfield_specs_(subfield_specs),
-          chars_to_delete_(chars_to_delete), translate_map_(nullptr), regex_matcher_(nullptr) { }
+          chars_to_delete_(chars_to_delete), translate_map_(nullptr), replacement_map_(nullptr) { }
     FilterDescriptor(const FilterType filter_type, const std::string &biblio_levels)
-        : filter_type_(filter_type), biblio_levels_(biblio_levels), regex_matcher_(nullptr) { }
+        : filter_type_(filter_type), biblio_levels_(biblio_levels), replacement_map_(nullptr) { }
     FilterDescriptor(const unsigned max_count)
         : filter_type_(FilterType::MAX_COUNT), count_(0), max_count_(max_count), translate_map_(nullptr),
-          regex_matcher_(nullptr) { }
+          replacement_map_(nullptr) { }
     FilterDescriptor(const std::vector<std::string> &subfield_specs, const TranslateMap &translate_map)
         : filter_type_(FilterType::TRANSLATE), subfield_specs_(subfield_specs),
-          translate_map_(translate_map.clone()), regex_matcher_(nullptr) { }
-    FilterDescriptor(const std::vector<std::string> &subfield_specs, const std::string &regex,
-                     const std::string &replacement);
+          translate_map_(translate_map.clone()), replacement_map_(nullptr) { }
+    FilterDescriptor(const std::vector<std::string> &subfield_specs, ReplacementMap * const replacement_map)
+        : filter_type_(FilterType::REPLACE), subfield_specs_(subfield_specs), translate_map_(nullptr),
+          replacement_map_(replacement_map) { }
 };
 
 
@@ -464,14 +463,171 @@ void ParseReplacementString(const std::string &replacement,
 }
 
 
-FilterDescriptor::FilterDescriptor(const std::vector<std::string> &subfield_specs, const std::string &regex,
-                                   const std::string &replacement)
-    : filter_type_(FilterType::REPLACE), subfield_specs_(subfield_specs), translate_map_(nullptr)
-{
+/** \brief The regexes and replacements of one --replace operation.
+ *  \note  Each subfield will be replaced using the first entry whose regex matches it.
+ *  \note  Map files can contain thousands of entries, most of which won't match a given subfield.  We therefore combine
+ *         runs of entries into alternations.  A single failed match against such an alternation rules out all of its
+ *         entries and we only have to try the individual regexes of an alternation that matched.
+ */
+class ReplacementMap {
+    struct Entry {
+        RegexMatcher *matcher_;
+        std::vector<StringFragmentOrBackreference> string_fragments_and_back_references_;
+    };
+
+    struct Group {
+        RegexMatcher *combined_matcher_; // nullptr if the entries have to be tried one at a time.
+        size_t first_entry_, end_entry_;
+    public:
+        Group(RegexMatcher * const combined_matcher, const size_t first_entry, const size_t end_entry)
+            : combined_matcher_(combined_matcher), first_entry_(first_entry), end_entry_(end_entry) { }
+    };
+
+    static constexpr size_t MAX_GROUP_SIZE = 256;
+    std::vector<Entry> entries_;
+    std::vector<Group> groups_;
+public:
+    ReplacementMap(const std::string &regex, const std::string &replacement);
+
+    /** \brief Loads a map file w/ lines that look like "regex->replacement".  Empty lines and lines starting w/ a hash
+     *         character are ignored.
+     */
+    explicit ReplacementMap(const std::string &map_filename);
+
+    /** \return True if one of our regexes matched "*subfield_value", which will then have been replaced. */
+    bool replace(std::string * const subfield_value) const;
+private:
+    void addEntry(const std::string &regex, const std::string &replacement);
+    void groupEntries();
+    void addCombinedGroups(const size_t first_entry, const size_t end_entry);
+    static std::string GenerateReplacement(const Entry &entry);
+};
+
+
+ReplacementMap::ReplacementMap(const std::string &regex, const std::string &replacement) {
+    addEntry(regex, replacement);
+    groupEntries();
+}
+
+
+ReplacementMap::ReplacementMap(const std::string &map_filename) {
+    std::unique_ptr<File> input(FileUtil::OpenInputFileOrDie(map_filename));
+    unsigned line_no(0);
+    while (not input->eof()) {
+        ++line_no;
+
+        std::string line;
+        input->getline(&line);
+        if (line.empty() or line[0] == '#')
+            continue;
+
+        const size_t arrow_start(line.find("->"));
+        if (unlikely(arrow_start == std::string::npos))
+            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing \"->\"!");
+        if (unlikely(arrow_start == 0))
+            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing regex before \"->\"!");
+        if (unlikely(arrow_start + 1 == line.length()))
+            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing replacement text after \"->\"!");
+        addEntry(line.substr(0, arrow_start), line.substr(arrow_start + 2));
+    }
+
+    groupEntries();
+}
+
+
+bool ReplacementMap::replace(std::string * const subfield_value) const {
+    for (const auto &group : groups_) {
+        if (group.combined_matcher_ != nullptr) {
+            // An error, e.g. too many captured substrings, means that we have to look at the individual entries.
+            std::string err_msg;
+            if (not group.combined_matcher_->matched(*subfield_value, &err_msg) and err_msg.empty())
+                continue;
+        }
+
+        for (size_t entry_no(group.first_entry_); entry_no < group.end_entry_; ++entry_no) {
+            const Entry &entry(entries_[entry_no]);
+            if (entry.matcher_->matched(*subfield_value)) {
+                *subfield_value = GenerateReplacement(entry);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+void ReplacementMap::addEntry(const std::string &regex, const std::string &replacement) {
+    Entry new_entry;
     std::string err_msg;
-    if ((regex_matcher_ = RegexMatcher::RegexMatcherFactory(regex, &err_msg)) == nullptr)
+    if ((new_entry.matcher_ = RegexMatcher::RegexMatcherFactory(regex, &err_msg)) == nullptr)
         LOG_ERROR("failed to compile regex \"" + regex + "\"! (" + err_msg + ")");
-    ParseReplacementString(replacement, &string_fragments_and_back_references_);
+    ParseReplacementString(replacement, &new_entry.string_fragments_and_back_references_);
+    entries_.emplace_back(new_entry);
+}
+
+
+void ReplacementMap::groupEntries() {
+    size_t first_entry(0);
+    while (first_entry < entries_.size()) {
+        size_t end_entry(first_entry);
+        while (end_entry < entries_.size() and end_entry - first_entry < MAX_GROUP_SIZE
+               and RegexSet::IsCombinable(entries_[end_entry].matcher_->getPattern()))
+            ++end_entry;
+
+        if (end_entry == first_entry) { // Not combinable.
+            groups_.emplace_back(nullptr, first_entry, first_entry + 1);
+            ++first_entry;
+        } else {
+            addCombinedGroups(first_entry, end_entry);
+            first_entry = end_entry;
+        }
+    }
+}
+
+
+// Splits [first_entry, end_entry) until PCRE is able to compile the alternations, which may be too large otherwise.
+void ReplacementMap::addCombinedGroups(const size_t first_entry, const size_t end_entry) {
+    if (end_entry - first_entry == 1) {
+        groups_.emplace_back(nullptr, first_entry, end_entry);
+        return;
+    }
+
+    std::string combined_regex;
+    for (size_t entry_no(first_entry); entry_no < end_entry; ++entry_no) {
+        if (not combined_regex.empty())
+            combined_regex += '|';
+        combined_regex += "(?:" + entries_[entry_no].matcher_->getPattern() + ")";
+    }
+
+    RegexMatcher * const combined_matcher(RegexMatcher::RegexMatcherFactory(combined_regex));
+    if (combined_matcher != nullptr) {
+        groups_.emplace_back(combined_matcher, first_entry, end_entry);
+        return;
+    }
+
+    const size_t middle(first_entry + (end_entry - first_entry) / 2);
+    addCombinedGroups(first_entry, middle);
+    addCombinedGroups(middle, end_entry);
+}
+
+
+// \note Must be called immediately after entry.matcher_ matched.
+std::string ReplacementMap::GenerateReplacement(const Entry &entry) {
+    const unsigned no_of_match_groups(entry.matcher_->getNoOfGroups());
+    std::string replacement;
+    for (const auto &string_fragment_or_back_reference : entry.string_fragments_and_back_references_) {
+        if (string_fragment_or_back_reference.type_ == StringFragmentOrBackreference::STRING_FRAGMENT)
+            replacement += string_fragment_or_back_reference.string_fragment_;
+        else { // We're dealing w/ a back-reference.
+            if (unlikely(string_fragment_or_back_reference.back_reference_ > no_of_match_groups))
+                LOG_ERROR("can't satisfy back-reference \\"
+                          + std::to_string(string_fragment_or_back_reference.back_reference_) + "!");
+            replacement += (*entry.matcher_)[string_fragment_or_back_reference.back_reference_];
+        }
+    }
+
+    return replacement;
 }
 
 
@@ -552,8 +708,7 @@ bool TranslateCharacters(const std::vector<std::string> &subfield_specs, const T
 }
 
 
-bool ReplaceSubfields(const std::vector<std::string> &subfield_specs, RegexMatcher &matcher,
-                      const std::vector<StringFragmentOrBackreference> &string_fragments_and_back_references,
+bool ReplaceSubfields(const std::vector<std::string> &subfield_specs, const ReplacementMap &replacement_map,
                       MARC::Record * const record)
 {
     bool modified_at_least_one_field(false);
@@ -568,22 +723,8 @@ bool ReplaceSubfields(const std::vector<std::string> &subfield_specs, RegexMatch
             if (subfield_codes.find(subfield.code_) == std::string::npos)
                 continue;
 
-            if (matcher.matched(subfield.value_)) {
-                const unsigned no_of_match_groups(matcher.getNoOfGroups());
-                std::string replacement;
-                for (const auto &string_fragment_or_back_reference : string_fragments_and_back_references) {
-                    if (string_fragment_or_back_reference.type_ == StringFragmentOrBackreference::STRING_FRAGMENT)
-                        replacement += string_fragment_or_back_reference.string_fragment_;
-                    else { // We're dealing w/ a back-reference.
-                        if (unlikely(string_fragment_or_back_reference.back_reference_ > no_of_match_groups))
-                            LOG_ERROR("can't satisfy back-reference \\"
-                                  + std::to_string(string_fragment_or_back_reference.back_reference_) + "!");
-                        replacement += matcher[string_fragment_or_back_reference.back_reference_];
-                    }
-                }
-                subfield.value_ = replacement;
+            if (replacement_map.replace(&subfield.value_))
                 modified_at_least_one_subfield = true;
-            }
         }
 
         if (modified_at_least_one_subfield) {
@@ -601,7 +742,8 @@ void Filter(const std::vector<FilterDescriptor> &filters, MARC::Reader * const m
             MARC::Writer * const marc_writer)
 {
     unsigned total_count(0), deleted_count(0), modified_count(0);
-    while (MARC::Record record = marc_reader->read()) {
+    MARC::Record record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+    while (marc_reader->read(&record)) {
         ++total_count;
         bool deleted_record(false), modified_record(false);
         for (const auto &filter : filters) {
@@ -648,8 +790,7 @@ void Filter(const std::vector<FilterDescriptor> &filters, MARC::Reader * const m
                     continue;
                 }
             } else if (filter.getFilterType() == FilterType::REPLACE) {
-                if (ReplaceSubfields(filter.getSubfieldSpecs(), filter.getRegexMatcher(),
-                                     filter.getStringFragmentsAndBackreferences(), &record)) {
+                if (ReplaceSubfields(filter.getSubfieldSpecs(), filter.getReplacementMap(), &record)) {
                     modified_record = true;
                     continue;
                 }
@@ -757,31 +898,6 @@ void ExtractSubfieldSpecs(const std::string &command, char ***argvp, std::vector
 }
 
 
-void LoadReplaceMapFile(const std::string &map_filename,
-                        std::unordered_map<std::string, std::string> * const regexes_to_replacements_map)
-{
-    std::unique_ptr<File> input(FileUtil::OpenInputFileOrDie(map_filename));
-    unsigned line_no(0);
-    while (not input->eof()) {
-        ++line_no;
-
-        std::string line;
-        input->getline(&line);
-        if (line.empty() or line[0] == '#')
-            continue;
-
-        const size_t arrow_start(line.find("->"));
-        if (unlikely(arrow_start == std::string::npos))
-            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing \"->\"!");
-        if (unlikely(arrow_start == 0))
-            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing regex before \"->\"!");
-        if (unlikely(arrow_start + 1 == line.length()))
-            LOG_ERROR("bad line #" + std::to_string(line_no) + ": missing replacement text after \"->\"!");
-        regexes_to_replacements_map->emplace(std::make_pair(line.substr(0, arrow_start), line.substr(arrow_start + 2)));
-    }
-}
-
-
 void ProcessReplaceCommand(char ***argvp, std::vector<FilterDescriptor> * const filters) {
     std::vector<std::string> subfield_specs;
     ExtractSubfieldSpecs("--replace", argvp, &subfield_specs);
@@ -789,15 +905,14 @@ void ProcessReplaceCommand(char ***argvp, std::vector<FilterDescriptor> * const
         LOG_ERROR("missing regex or map-filename arg after --replace!");
     const std::string regex_or_map_filename(**argvp);
     ++*argvp;
-    if (**argvp == nullptr or StringUtil::StartsWith(**argvp, "--")) {
-        std::unordered_map<std::string, std::string> regexes_to_replacements_map;
-        LoadReplaceMapFile(regex_or_map_filename, &regexes_to_replacements_map);
-        for (const auto &regex_and_replacement : regexes_to_replacements_map)
-            filters->emplace_back(FilterDescriptor::MakeReplacementFilter(subfield_specs, regex_and_replacement.first,
-                                                                          regex_and_replacement.second));
-    } else {
+    if (**argvp == nullptr or StringUtil::StartsWith(**argvp, "--"))
+        filters->emplace_back(FilterDescriptor::MakeReplacementFilter(subfield_specs,
+                                                                      new ReplacementMap(regex_or_map_filename)));
+    else {
         const std::string replacement(**argvp);
-        filters->emplace_back(FilterDescriptor::MakeReplacementFilter(subfield_specs, regex_or_map_filename, replacement));
+        filters->emplace_back(FilterDescriptor::MakeReplacementFilter(subfield_specs,
+                                                                      new ReplacementMap(regex_or_map_filename,
+                                                                                         replacement)));
         ++*argvp;
     }
 }
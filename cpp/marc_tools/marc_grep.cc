@@ -25,7 +25,6 @@
 #include <memory>
 #include <queue>
 #include <stdexcept>
-#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -34,6 +33,7 @@
 #include <unistd.h>
 #include "Compiler.h"
 #include "FileUtil.h"
+#include "MarcParallelProcessor.h"
 #include "MarcQueryParser.h"
 #include "MARC.h"
 #include "StringUtil.h"
@@ -206,17 +206,19 @@ void Emit(const std::string &control_number, const OutputLabel output_format,
 }
 
 
-bool EnqueueSubfields(const std::string &tag, const char subfield_code, const std::string &contents,
+// \return True if "field" has at least one subfield w/ code "subfield_code".
+// \note  If "tags_and_contents" is nullptr, we only test for the existence of a matching subfield.
+bool EnqueueSubfields(const MARC::Record::Field &field, const char subfield_code,
                       std::priority_queue<TagAndContents> * const tags_and_contents)
 {
-    std::string tag_plus_subfield_code(tag);
-    tag_plus_subfield_code += subfield_code;
-    const MARC::Subfields subfields(contents);
     bool enqueue_at_least_one(false);
-    for (const auto &subfield : subfields) {
-        if (subfield.code_ == subfield_code) {
-            tags_and_contents->push(TagAndContents(tag_plus_subfield_code, subfield.value_));
+    for (const auto &code_and_value : field.getSubfieldRange()) {
+        if (code_and_value.first == subfield_code) {
             enqueue_at_least_one = true;
+            if (tags_and_contents == nullptr)
+                break;
+            tags_and_contents->push(TagAndContents(field.getTag().toString() + subfield_code,
+                                                   code_and_value.second.toString()));
         }
     }
 
@@ -224,105 +226,202 @@ bool EnqueueSubfields(const std::string &tag, const char subfield_code, const st
 }
 
 
-bool ProcessEqualityComp(const ConditionDescriptor &cond_desc,
-                         const std::unordered_multimap<std::string, const std::string> &field_to_content_map)
-{
-    const FieldOrSubfieldDescriptor comp_field_or_subfield(cond_desc.getFieldOrSubfieldReference());
-    const auto begin_end(field_to_content_map.equal_range(comp_field_or_subfield.getTag()));
-    const std::string subfield_codes(comp_field_or_subfield.getSubfieldCodes());
-    const ConditionDescriptor::CompType comp_type(cond_desc.getCompType());
+bool Matches(RegexMatcher * const data_matcher, const std::string &subject) {
     std::string err_msg;
+    if (data_matcher->matched(subject, &err_msg))
+        return true;
+    if (unlikely(not err_msg.empty()))
+        LOG_ERROR("match failed (" + err_msg + ")!");
+    return false;
+}
+
+
+/** \brief A QueryDescriptor w/ all field and subfield references resolved to tags and subfield codes.
+ *  \note  Evaluation works directly on the fields of a record, so, unlike in the past, we don't have to copy all of a
+ *         record's fields into a multimap before we can test anything.
+ *  \note  As RegexMatcher's aren't thread-safe, each copy of a CompiledQuery has its own copies of the regexes and
+ *         each thread must use its own CompiledQuery.
+ */
+class CompiledQuery {
+    struct Condition {
+        ConditionDescriptor::CompType comp_type_;
+        MARC::Tag test_tag_;
+        char test_subfield_code_; // '\0' if we test entire fields.
+        std::unique_ptr<RegexMatcher> data_matcher_;
+        bool extract_all_fields_;
+        MARC::Tag extraction_tag_;
+        std::string extraction_subfield_codes_;
+    public:
+        Condition(const ConditionDescriptor &cond_desc, const FieldOrSubfieldDescriptor &field_or_subfield_desc);
+        Condition(const Condition &other);
+    };
+
+    bool has_leader_condition_;
+    size_t leader_start_offset_, leader_match_length_;
+    std::string leader_match_;
+    std::vector<Condition> conditions_;
+public:
+    explicit CompiledQuery(const QueryDescriptor &query_desc);
+
+    /** \return True if "record" matches at least one of our conditions.
+     *  \note   If "tags_and_contents" is not nullptr, we collect all extracted fields and subfields.  Otherwise we
+     *          return as soon as we know that we have a match.
+     */
+    bool evaluate(const MARC::Record &record,
+                  std::priority_queue<TagAndContents> * const tags_and_contents = nullptr) const;
+private:
+    static bool EqualityTestSucceeded(const Condition &condition, const MARC::Record &record);
+    static bool ExistenceTestSucceeded(const Condition &condition, const MARC::Record &record);
+    static bool Extract(const Condition &condition, const MARC::Record &record,
+                        std::priority_queue<TagAndContents> * const tags_and_contents);
+    static bool ExtractAllFields(const MARC::Record &record,
+                                 std::priority_queue<TagAndContents> * const tags_and_contents);
+    static bool ExtractSingleFieldMatches(const Condition &condition, const MARC::Record &record,
+                                          std::priority_queue<TagAndContents> * const tags_and_contents);
+};
+
+
+CompiledQuery::Condition::Condition(const ConditionDescriptor &cond_desc,
+                                    const FieldOrSubfieldDescriptor &field_or_subfield_desc)
+    : comp_type_(cond_desc.getCompType()), test_subfield_code_('\0'),
+      extract_all_fields_(field_or_subfield_desc.isStar())
+{
+    if (comp_type_ != ConditionDescriptor::NO_COMPARISION) {
+        const FieldOrSubfieldDescriptor test_field_or_subfield(cond_desc.getFieldOrSubfieldReference());
+        test_tag_ = test_field_or_subfield.getTag();
+        const std::string test_subfield_codes(test_field_or_subfield.getSubfieldCodes());
+        if (not test_subfield_codes.empty())
+            test_subfield_code_ = test_subfield_codes[0];
+    }
+
+    if (comp_type_ != ConditionDescriptor::NO_COMPARISION and comp_type_ != ConditionDescriptor::EXISTS
+        and comp_type_ != ConditionDescriptor::IS_MISSING)
+        data_matcher_.reset(new RegexMatcher(cond_desc.getDataMatcher()));
+
+    if (not extract_all_fields_) {
+        extraction_tag_ = field_or_subfield_desc.getTag();
+        extraction_subfield_codes_ = field_or_subfield_desc.getSubfieldCodes();
+    }
+}
+
+
+CompiledQuery::Condition::Condition(const Condition &other)
+    : comp_type_(other.comp_type_), test_tag_(other.test_tag_), test_subfield_code_(other.test_subfield_code_),
+      data_matcher_(other.data_matcher_ == nullptr ? nullptr : new RegexMatcher(*other.data_matcher_)),
+      extract_all_fields_(other.extract_all_fields_), extraction_tag_(other.extraction_tag_),
+      extraction_subfield_codes_(other.extraction_subfield_codes_)
+{
+}
+
+
+CompiledQuery::CompiledQuery(const QueryDescriptor &query_desc)
+    : has_leader_condition_(query_desc.hasLeaderCondition()), leader_start_offset_(0), leader_match_length_(0)
+{
+    if (has_leader_condition_) {
+        const LeaderCondition &leader_cond(query_desc.getLeaderCondition());
+        leader_start_offset_ = leader_cond.getStartOffset();
+        leader_match_length_ = leader_cond.getEndOffset() - leader_cond.getStartOffset() + 1;
+        leader_match_        = leader_cond.getMatch();
+    }
+
+    for (const auto &cond_and_field_or_subfield : query_desc.getCondsAndFieldOrSubfieldDescs())
+        conditions_.emplace_back(cond_and_field_or_subfield.first, cond_and_field_or_subfield.second);
+}
+
+
+bool CompiledQuery::evaluate(const MARC::Record &record,
+                             std::priority_queue<TagAndContents> * const tags_and_contents) const
+{
+    if (has_leader_condition_
+        and record.getLeader().compare(leader_start_offset_, leader_match_length_, leader_match_) != 0)
+        return false;
+
+    bool matched(false);
+    for (const auto &condition : conditions_) {
+        if (Extract(condition, record, tags_and_contents)) {
+            if (tags_and_contents == nullptr)
+                return true;
+            matched = true;
+        }
+    }
+
+    return matched;
+}
+
+
+bool CompiledQuery::EqualityTestSucceeded(const Condition &condition, const MARC::Record &record) {
     bool matched_at_least_one(false);
-    for (auto field(begin_end.first); field != begin_end.second; ++field) {
-        const std::string &contents(field->second);
-        if (subfield_codes.empty()) { // Compare against the entire field. (Does this even make sense?)
-            if (cond_desc.getDataMatcher().matched(contents, &err_msg)) {
+    for (const auto &field : record.getTagRange(condition.test_tag_)) {
+        if (condition.test_subfield_code_ == '\0') { // Compare against the entire field. (Does this even make sense?)
+            if (Matches(condition.data_matcher_.get(), field.getContents())) {
                 matched_at_least_one = true;
                 break;
             }
-            if (unlikely(not err_msg.empty()))
-                logger->error("ProcessEqualityComp: match failed (" + err_msg + ")! (1)");
-        } else  { // We need to match against a subfield's content.
-            const MARC::Subfields subfields(contents);
-            for (const auto &subfield : subfields) {
-                if (subfield.code_ == subfield_codes[0]) {
-                    if (cond_desc.getDataMatcher().matched(subfield.value_, &err_msg)) {
-                        matched_at_least_one = true;
-                        break;
-                    } else if (unlikely(not err_msg.empty()))
-                        logger->error("ProcessEqualityComp: match failed (" + err_msg + ")! (1)");
+        } else { // We need to match against a subfield's content.
+            for (const auto &code_and_value : field.getSubfieldRange()) {
+                if (code_and_value.first == condition.test_subfield_code_
+                    and Matches(condition.data_matcher_.get(), code_and_value.second.toString()))
+                {
+                    matched_at_least_one = true;
+                    break;
                 }
             }
         }
     }
 
-    return (comp_type == ConditionDescriptor::EQUAL_EQUAL) ? matched_at_least_one : not matched_at_least_one;
+    return (condition.comp_type_ == ConditionDescriptor::EQUAL_EQUAL) ? matched_at_least_one : not matched_at_least_one;
 }
 
 
-bool ProcessExistenceTest(const ConditionDescriptor &cond_desc,
-                          const std::unordered_multimap<std::string, const std::string> &field_to_content_map)
-{
-    const FieldOrSubfieldDescriptor test_field_or_subfield(cond_desc.getFieldOrSubfieldReference());
-    const ConditionDescriptor::CompType comp_type(cond_desc.getCompType());
-    const auto begin_end(field_to_content_map.equal_range(test_field_or_subfield.getTag()));
-    if (begin_end.first == begin_end.second)
-        return comp_type == ConditionDescriptor::IS_MISSING;
-    const std::string subfield_codes(test_field_or_subfield.getSubfieldCodes());
-    if (subfield_codes.empty())
-        return comp_type == ConditionDescriptor::EXISTS;
+bool CompiledQuery::ExistenceTestSucceeded(const Condition &condition, const MARC::Record &record) {
+    const auto fields(record.getTagRange(condition.test_tag_));
+    if (fields.empty())
+        return condition.comp_type_ == ConditionDescriptor::IS_MISSING;
+    if (condition.test_subfield_code_ == '\0')
+        return condition.comp_type_ == ConditionDescriptor::EXISTS;
 
     bool found_at_least_one(false);
-    for (auto field(begin_end.first); field != begin_end.second; ++field) {
-        const std::string &contents(field->second);
-        const MARC::Subfields subfields(contents);
-        if (subfields.hasSubfield(subfield_codes[0])) {
+    for (const auto &field : fields) {
+        if (field.hasSubfield(condition.test_subfield_code_)) {
             found_at_least_one = true;
             break;
         }
     }
 
-    return (comp_type == ConditionDescriptor::EXISTS) ? found_at_least_one : not found_at_least_one;
+    return (condition.comp_type_ == ConditionDescriptor::EXISTS) ? found_at_least_one : not found_at_least_one;
 }
 
 
-bool ProcessConditions(const ConditionDescriptor &cond_desc,
-                       const FieldOrSubfieldDescriptor &field_or_subfield_desc,
-                       const std::unordered_multimap<std::string, const std::string> &field_to_content_map,
-                       std::priority_queue<TagAndContents> * const tags_and_contents)
+bool CompiledQuery::Extract(const Condition &condition, const MARC::Record &record,
+                            std::priority_queue<TagAndContents> * const tags_and_contents)
 {
-    const std::string extraction_tag(field_or_subfield_desc.getTag());
-    const auto begin_end(field_to_content_map.equal_range(extraction_tag));
-    const bool extraction_tag_found(begin_end.first != begin_end.second or field_or_subfield_desc.isStar());
-    if (not extraction_tag_found)
+    if (not condition.extract_all_fields_ and not record.hasTag(condition.extraction_tag_))
         return false;
 
-    const ConditionDescriptor::CompType comp_type(cond_desc.getCompType());
+    const ConditionDescriptor::CompType comp_type(condition.comp_type_);
     if (comp_type == ConditionDescriptor::NO_COMPARISION
         or ((comp_type == ConditionDescriptor::EQUAL_EQUAL or comp_type == ConditionDescriptor::NOT_EQUAL)
-            and ProcessEqualityComp(cond_desc, field_to_content_map))
+            and EqualityTestSucceeded(condition, record))
         or ((comp_type == ConditionDescriptor::EXISTS or comp_type == ConditionDescriptor::IS_MISSING)
-            and ProcessExistenceTest(cond_desc, field_to_content_map)))
+            and ExistenceTestSucceeded(condition, record)))
     {
-        if (field_or_subfield_desc.isStar()) {
-            for (const auto &tag_and_content : field_to_content_map)
-                tags_and_contents->push(TagAndContents(tag_and_content.first, tag_and_content.second));
-            return true;
-        }
+        if (condition.extract_all_fields_)
+            return ExtractAllFields(record, tags_and_contents);
 
-        const std::string subfield_codes(field_or_subfield_desc.getSubfieldCodes());
         bool emitted_at_least_one(false);
-        for (auto tag_and_field_contents(begin_end.first); tag_and_field_contents != begin_end.second;
-             ++tag_and_field_contents)
-        {
-            if (subfield_codes.empty()) {
-                tags_and_contents->push(TagAndContents(extraction_tag, tag_and_field_contents->second));
+        for (const auto &field : record.getTagRange(condition.extraction_tag_)) {
+            if (condition.extraction_subfield_codes_.empty()) {
+                if (tags_and_contents == nullptr)
+                    return true;
+                tags_and_contents->push(TagAndContents(field.getTag().toString(), field.getContents()));
                 emitted_at_least_one = true;
             } else { // Looking for one or more subfields:
-                for (const auto &subfield_code : subfield_codes) {
-                    if (EnqueueSubfields(extraction_tag, subfield_code, tag_and_field_contents->second,
-                                         tags_and_contents))
+                for (const char subfield_code : condition.extraction_subfield_codes_) {
+                    if (EnqueueSubfields(field, subfield_code, tags_and_contents)) {
+                        if (tags_and_contents == nullptr)
+                            return true;
                         emitted_at_least_one = true;
+                    }
                 }
             }
         }
@@ -331,58 +430,67 @@ bool ProcessConditions(const ConditionDescriptor &cond_desc,
     } else if (comp_type == ConditionDescriptor::SINGLE_FIELD_EQUAL
                or comp_type == ConditionDescriptor::SINGLE_FIELD_NOT_EQUAL)
     {
-        if (field_or_subfield_desc.isStar()) {
-            for (const auto &tag_and_content : field_to_content_map)
-                tags_and_contents->push(TagAndContents(tag_and_content.first, tag_and_content.second));
-            return true;
-        }
+        if (condition.extract_all_fields_)
+            return ExtractAllFields(record, tags_and_contents);
+        return ExtractSingleFieldMatches(condition, record, tags_and_contents);
+    } else
+        return false;
+}
 
-        bool emitted_at_least_one(false);
-        const char test_subfield_code(cond_desc.getFieldOrSubfieldReference()[MARC::Record::TAG_LENGTH]);
-        const char extract_subfield_code(field_or_subfield_desc.getSubfieldCodes()[0]);
-        for (auto tag_and_field_contents(begin_end.first); tag_and_field_contents != begin_end.second;
-             ++tag_and_field_contents)
-        {
-            const MARC::Subfields subfields(tag_and_field_contents->second);
-            if (not subfields.hasSubfield(extract_subfield_code))
-                continue;
-
-            if (not subfields.hasSubfield(test_subfield_code)) {
-                if (comp_type == ConditionDescriptor::SINGLE_FIELD_NOT_EQUAL) {
-                    if (EnqueueSubfields(extraction_tag, extract_subfield_code, tag_and_field_contents->second,
-                                         tags_and_contents))
-                        emitted_at_least_one = true;
-                } else
-                    return false;
-            } else {
-                bool matched_at_least_one(false);
-                for (const auto &subfield : subfields) {
-                    if (subfield.code_ == test_subfield_code) {
-                        std::string err_msg;
-                        if (cond_desc.getDataMatcher().matched(subfield.value_, &err_msg)) {
-                            matched_at_least_one = true;
-                            break;
-                        } else if (unlikely(not err_msg.empty()))
-                            logger->error("Unexpected: Match failed in ProcessConditions!");
-                    }
-                }
 
-                if ((matched_at_least_one and comp_type == ConditionDescriptor::SINGLE_FIELD_EQUAL)
-                    or (not matched_at_least_one and comp_type == ConditionDescriptor::SINGLE_FIELD_NOT_EQUAL))
+bool CompiledQuery::ExtractAllFields(const MARC::Record &record,
+                                     std::priority_queue<TagAndContents> * const tags_and_contents)
+{
+    if (tags_and_contents != nullptr) {
+        for (const auto &field : record)
+            tags_and_contents->push(TagAndContents(field.getTag().toString(), field.getContents()));
+    }
+
+    return true;
+}
+
+
+// Unlike the "==" and "!=" tests, "===" and "!==" compare subfields of the extracted fields themselves.
+bool CompiledQuery::ExtractSingleFieldMatches(const Condition &condition, const MARC::Record &record,
+                                              std::priority_queue<TagAndContents> * const tags_and_contents)
+{
+    const ConditionDescriptor::CompType comp_type(condition.comp_type_);
+    const char extract_subfield_code(condition.extraction_subfield_codes_.empty()
+                                     ? '\0' : condition.extraction_subfield_codes_[0]);
+    bool emitted_at_least_one(false);
+    for (const auto &field : record.getTagRange(condition.extraction_tag_)) {
+        if (not field.hasSubfield(extract_subfield_code))
+            continue;
+
+        bool matched_at_least_one(false);
+        if (not field.hasSubfield(condition.test_subfield_code_)) {
+            if (comp_type == ConditionDescriptor::SINGLE_FIELD_EQUAL)
+                return false;
+        } else {
+            for (const auto &code_and_value : field.getSubfieldRange()) {
+                if (code_and_value.first == condition.test_subfield_code_
+                    and Matches(condition.data_matcher_.get(), code_and_value.second.toString()))
                 {
-                    if (EnqueueSubfields(extraction_tag, extract_subfield_code, tag_and_field_contents->second,
-                                         tags_and_contents))
-                        emitted_at_least_one = true;
+                    matched_at_least_one = true;
+                    break;
                 }
             }
         }
 
-        return emitted_at_least_one;
-    } else
-        return false;
+        if (matched_at_least_one == (comp_type == ConditionDescriptor::SINGLE_FIELD_EQUAL)
+            and EnqueueSubfields(field, extract_subfield_code, tags_and_contents))
+        {
+            if (tags_and_contents == nullptr)
+                return true;
+            emitted_at_least_one = true;
+        }
+    }
+
+    return emitted_at_least_one;
 }
 
 
+// Records are decoded on one thread, matched against the query on all cores and emitted in their original order.
 void FieldGrep(const unsigned max_records, const unsigned sampling_rate,
                const std::unordered_set<std::string> &control_numbers, MARC::Reader * const marc_reader,
                const QueryDescriptor &query_desc, const OutputLabel output_format)
@@ -393,64 +501,61 @@ void FieldGrep(const unsigned max_records, const unsigned sampling_rate,
                           "/proc/self/fd/1",
                           (output_format == MARC_XML) ? MARC::FileType::XML : MARC::FileType::BINARY);
 
-    std::string err_msg;
-    unsigned count(0), matched_count(0), rate_counter(0);
-    while (const MARC::Record record = marc_reader->read()) {
+    // We only ever copy "prototype_query" and never use it for matching.  This way no thread will copy a RegexMatcher
+    // while another thread is using it.
+    const CompiledQuery prototype_query(query_desc);
+    const CompiledQuery emit_query(prototype_query);
+
+    // We don't use BinaryReader::readView() as views only stay valid on the reader thread and the queries operate on
+    // records anyway:
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+
+    // The filtering by control number, the record limit and the sampling depend on the order of the records and
+    // therefore happen on the reader thread:
+    unsigned count(0), rate_counter(0);
+    processor.setRecordSelector([&](const MARC::Record &record, bool * const stop) {
         // If we use a control number filter, only process a record if it is in our list:
         if (not control_numbers.empty()
             and control_numbers.find(record.getControlNumber()) == control_numbers.cend())
-            continue;
+            return false;
 
         ++count, ++rate_counter;
-        if (count > max_records)
-            break;
-        if (rate_counter == sampling_rate)
-            rate_counter = 0;
-        else
-            continue;
-
-        if (query_desc.hasLeaderCondition()) {
-            const LeaderCondition &leader_cond(query_desc.getLeaderCondition());
-            const std::string &leader(record.getLeader());
-            if (leader.substr(leader_cond.getStartOffset(),
-                              leader_cond.getEndOffset() - leader_cond.getStartOffset() + 1)
-                != leader_cond.getMatch())
-                continue;
-        }
-
-        std::unordered_multimap<std::string, const std::string> field_to_content_map;
-        for (const auto &field : record)
-            field_to_content_map.insert(std::make_pair(field.getTag().toString(), field.getContents()));
-
-        bool matched(false);
-        std::priority_queue<TagAndContents> tags_and_contents;
-
-        // Extract fields and subfields:
-        for (const auto &cond_and_field_or_subfield : query_desc.getCondsAndFieldOrSubfieldDescs()) {
-            if (ProcessConditions(cond_and_field_or_subfield.first, cond_and_field_or_subfield.second,
-                                  field_to_content_map, &tags_and_contents))
-                matched = true;
+        if (count > max_records) {
+            --count;
+            *stop = true;
+            return false;
         }
-
-        if (matched) {
+        if (rate_counter != sampling_rate)
+            return false;
+        rate_counter = 0;
+        return true;
+    });
+
+    unsigned matched_count(0);
+    processor.process(
+        [&prototype_query](MARC::Record * const record) {
+            thread_local std::unique_ptr<CompiledQuery> worker_query;
+            if (worker_query == nullptr)
+                worker_query.reset(new CompiledQuery(prototype_query));
+            return worker_query->evaluate(*record);
+        },
+        [&](const MARC::Record &record) {
             ++matched_count;
 
             if (output_format == MARC_BINARY or output_format == MARC_XML)
                 marc_writer->write(record);
             else {
-                // Determine the control number:
-                const auto &control_number_iter(field_to_content_map.find("001"));
-                if (unlikely(control_number_iter == field_to_content_map.end()))
-                    logger->error("In FieldGrep: record has no control number!");
-                const std::string control_number(control_number_iter->second);
+                const std::string control_number(record.getControlNumber());
+                if (unlikely(control_number.empty()))
+                    LOG_ERROR("record has no control number!");
 
+                // Only matching records get here, so the somewhat more expensive extraction is rare:
+                std::priority_queue<TagAndContents> tags_and_contents;
+                emit_query.evaluate(record, &tags_and_contents);
                 Emit(control_number, output_format, &tags_and_contents);
             }
-        }
-    }
+        });
 
-    if (not err_msg.empty())
-        logger->error(err_msg);
     std::cerr << "Matched " << matched_count << (matched_count == 1 ? " record of " :  " records of ") << count
               << " overall records.\n";
 }
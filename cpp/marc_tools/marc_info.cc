@@ -47,6 +47,7 @@ void ProcessRecords(const bool verbose, const bool summarize_tags, MARC::Reader
     std::map<MARC::Record::RecordType, unsigned> record_types_and_counts;
     std::map<std::string, std::set<char>> tag_to_subfield_codes_map;
 
+    // Unlike BinaryReader::readView(), read() merges oversized records which we need for the record statistics:
     while (const MARC::Record record = marc_reader->read()) {
         ++record_count;
         cumulative_field_count += record.getNumberOfFields();
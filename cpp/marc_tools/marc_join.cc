@@ -0,0 +1,270 @@
+/** \file    marc_join.cc
+ *  \brief   Partitions MARC records by whether they share an ISSN, PPN or ZDB number w/ the records or keys of another input.
+ *  \author  Dr. Johannes Ruscheinski
+ */
+
+/*
+    Copyright (C) 2019, Library of the University of Tübingen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdlib>
+#include <cstring>
+#include "FileUtil.h"
+#include "MarcParallelProcessor.h"
+#include "MARC.h"
+#include "MiscUtil.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--key=(issn|ppn|zdb)] [--key-list] [--unmatched=unmatched_output]\n"
+              << "       build_input probe_input matched_output\n"
+              << "  Writes those records of \"probe_input\" that share a key w/ \"build_input\" to \"matched_output\" and,\n"
+              << "  if requested, all others to \"unmatched_output\".  The keys of the records in \"build_input\", which\n"
+              << "  should be the smaller of the two inputs, are their own ISSN's, PPN's or ZDB numbers.  The keys of the\n"
+              << "  records in \"probe_input\" additionally include those of their superior works, so that e.g. articles\n"
+              << "  match the journals that they have been published in.  The default key is \"issn\".\n"
+              << "  If \"--key-list\" has been specified, \"build_input\" is a plain text file w/ one key per line.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+enum class KeyType { ISSN, PPN, ZDB };
+
+
+const std::string ZDB_PREFIX_035("(DE-599)ZDB");
+const std::string ZDB_PREFIX_773("(DE-600)");
+
+
+// ISSN's are normalised to the XXXX-YYYY form.  All other keys are used as is.
+inline bool NormaliseKey(const KeyType key_type, const std::string &key_candidate, std::string * const key) {
+    if (key_type == KeyType::ISSN)
+        return MiscUtil::NormaliseISSN(StringUtil::ToUpper(StringUtil::TrimWhite(key_candidate)), key);
+
+    *key = StringUtil::TrimWhite(key_candidate);
+    return not key->empty();
+}
+
+
+std::string GetZDBNumber(const MARC::Record &record) {
+    for (const auto &field : record.getTagRange("016")) {
+        const MARC::Subfields subfields(field.getSubfields());
+        if (subfields.hasSubfieldWithValue('2', "DE-600"))
+            return subfields.getFirstSubfieldWithCode('a');
+    }
+
+    for (const auto &field : record.getTagRange("035")) {
+        const std::string subfield_a(field.getFirstSubfieldWithCode('a'));
+        if (StringUtil::StartsWith(subfield_a, ZDB_PREFIX_035))
+            return subfield_a.substr(ZDB_PREFIX_035.length());
+    }
+
+    return "";
+}
+
+
+// \param include_superior_works  If true, we also extract the keys of any superior works that "record" refers to.
+void ExtractKeys(const KeyType key_type, const MARC::Record &record, const bool include_superior_works,
+                 std::vector<std::string> * const keys)
+{
+    keys->clear();
+
+    std::vector<std::string> key_candidates;
+    switch (key_type) {
+    case KeyType::ISSN: {
+        const auto issns(include_superior_works ? record.getAllISSNs() : record.getISSNs());
+        key_candidates.assign(issns.cbegin(), issns.cend());
+        break;
+    }
+    case KeyType::PPN:
+        key_candidates.emplace_back(record.getControlNumber());
+        if (include_superior_works)
+            key_candidates.emplace_back(record.getSuperiorControlNumber());
+        break;
+    case KeyType::ZDB:
+        key_candidates.emplace_back(GetZDBNumber(record));
+        if (include_superior_works) {
+            for (const auto &field : record.getTagRange("773")) {
+                for (const auto &subfield : field.getSubfields()) {
+                    if (subfield.code_ == 'w' and StringUtil::StartsWith(subfield.value_, ZDB_PREFIX_773))
+                        key_candidates.emplace_back(subfield.value_.substr(ZDB_PREFIX_773.length()));
+                }
+            }
+        }
+        break;
+    }
+
+    std::string key;
+    for (const auto &key_candidate : key_candidates) {
+        if (NormaliseKey(key_type, key_candidate, &key))
+            keys->emplace_back(key);
+    }
+}
+
+
+// All of our keys are short enough for the small string optimisation, so the build side needs no allocations beyond
+// those of the hash table itself.
+void LoadKeysFromRecords(const KeyType key_type, MARC::Reader * const marc_reader, std::unordered_set<std::string> * const keys) {
+    unsigned record_count(0);
+    std::vector<std::string> record_keys;
+    while (const MARC::Record record = marc_reader->read()) {
+        ++record_count;
+        ExtractKeys(key_type, record, /* include_superior_works = */false, &record_keys);
+        keys->insert(record_keys.cbegin(), record_keys.cend());
+    }
+
+    LOG_INFO("Extracted " + std::to_string(keys->size()) + " distinct key(s) from " + std::to_string(record_count)
+             + " record(s) in \"" + marc_reader->getPath() + "\".");
+}
+
+
+void LoadKeysFromList(const KeyType key_type, const std::string &key_list_filename, std::unordered_set<std::string> * const keys) {
+    const auto input(FileUtil::OpenInputFileOrDie(key_list_filename));
+    unsigned line_no(0);
+    std::string line, key;
+    while (not input->eof()) {
+        input->getline(&line);
+        ++line_no;
+        StringUtil::TrimWhite(&line);
+        if (line.empty())
+            continue;
+        if (NormaliseKey(key_type, line, &key))
+            keys->emplace(key);
+        else
+            LOG_WARNING("ignoring bad key \"" + line + "\" on line " + std::to_string(line_no) + " of \"" + key_list_filename
+                        + "\"!");
+    }
+
+    LOG_INFO("Loaded " + std::to_string(keys->size()) + " distinct key(s) from \"" + key_list_filename + "\".");
+}
+
+
+void Join(const KeyType key_type, const std::unordered_set<std::string> &build_keys, MARC::Reader * const probe_reader,
+          MARC::Writer * const matched_writer, MARC::Writer * const unmatched_writer)
+{
+    // The workers pass their verdicts on to the consumer which writes the records in input order:
+    std::mutex sequence_nos_to_matched_flags_mutex;
+    std::unordered_map<size_t, bool> sequence_nos_to_matched_flags;
+
+    MARC::ParallelProcessor processor(probe_reader, /* writer = */nullptr);
+    unsigned matched_count(0), unmatched_count(0);
+    const size_t record_count(processor.process(
+        [&](MARC::Record * const record) {
+            thread_local std::vector<std::string> probe_keys;
+            ExtractKeys(key_type, *record, /* include_superior_works = */true, &probe_keys);
+
+            bool matched(false);
+            for (const auto &probe_key : probe_keys) {
+                if (build_keys.find(probe_key) != build_keys.cend()) {
+                    matched = true;
+                    break;
+                }
+            }
+
+            // Unmatched records are only of interest if we are going to write them:
+            if (not matched and unmatched_writer == nullptr)
+                return false;
+
+            std::lock_guard<std::mutex> sequence_nos_to_matched_flags_locker(sequence_nos_to_matched_flags_mutex);
+            sequence_nos_to_matched_flags[MARC::ParallelProcessor::GetCurrentSequenceNo()] = matched;
+            return true;
+        },
+        [&](const MARC::Record &record) {
+            bool matched;
+            {
+                std::lock_guard<std::mutex> sequence_nos_to_matched_flags_locker(sequence_nos_to_matched_flags_mutex);
+                const auto sequence_no_and_matched_flag(
+                    sequence_nos_to_matched_flags.find(MARC::ParallelProcessor::GetCurrentSequenceNo()));
+                matched = sequence_no_and_matched_flag->second;
+                sequence_nos_to_matched_flags.erase(sequence_no_and_matched_flag);
+            }
+
+            if (matched) {
+                ++matched_count;
+                matched_writer->write(record);
+            } else {
+                ++unmatched_count;
+                unmatched_writer->write(record);
+            }
+        }));
+
+    LOG_INFO("Processed " + std::to_string(record_count) + " record(s) from \"" + probe_reader->getPath() + "\".");
+    LOG_INFO(std::to_string(matched_count) + " record(s) matched.");
+    if (unmatched_writer != nullptr)
+        LOG_INFO("Wrote " + std::to_string(unmatched_count) + " unmatched record(s).");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    KeyType key_type(KeyType::ISSN);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--key=")) {
+        const std::string key_type_name(argv[1] + __builtin_strlen("--key="));
+        if (key_type_name == "issn")
+            key_type = KeyType::ISSN;
+        else if (key_type_name == "ppn")
+            key_type = KeyType::PPN;
+        else if (key_type_name == "zdb")
+            key_type = KeyType::ZDB;
+        else
+            LOG_ERROR("unknown key type \"" + key_type_name + "\"!");
+        --argc, ++argv;
+    }
+
+    bool build_input_is_key_list(false);
+    if (argc > 1 and std::strcmp(argv[1], "--key-list") == 0) {
+        build_input_is_key_list = true;
+        --argc, ++argv;
+    }
+
+    std::string unmatched_output_filename;
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--unmatched=")) {
+        unmatched_output_filename = argv[1] + __builtin_strlen("--unmatched=");
+        --argc, ++argv;
+    }
+
+    if (argc != 4)
+        Usage();
+
+    std::unordered_set<std::string> build_keys;
+    if (build_input_is_key_list)
+        LoadKeysFromList(key_type, argv[1], &build_keys);
+    else {
+        const auto build_reader(MARC::Reader::Factory(argv[1]));
+        LoadKeysFromRecords(key_type, build_reader.get(), &build_keys);
+    }
+
+    const auto probe_reader(MARC::Reader::Factory(argv[2]));
+    const auto matched_writer(MARC::Writer::Factory(argv[3]));
+    std::unique_ptr<MARC::Writer> unmatched_writer;
+    if (not unmatched_output_filename.empty())
+        unmatched_writer = MARC::Writer::Factory(unmatched_output_filename);
+
+    Join(key_type, build_keys, probe_reader.get(), matched_writer.get(), unmatched_writer.get());
+
+    return EXIT_SUCCESS;
+}
@@ -61,12 +61,43 @@ void GenerateModels(const bool verbose, const unsigned limit_count, const unsign
 #endif
 
 
+// Records are classified in batches of this size so that the classification can run on all cores.
+constexpr size_t BATCH_SIZE(10000);
+
+
+void ProcessBatch(const bool verbose, const std::vector<std::string> &language_codes, const std::vector<std::string> &texts,
+                  const std::set<std::string> &considered_languages, unsigned * const agreed_count,
+                  std::unordered_map<std::string, unsigned> * const mismatched_assignments_to_counts_map)
+{
+    const auto top_languages_per_text(NGram::ClassifyBatch(texts, considered_languages));
+    for (size_t text_index(0); text_index < texts.size(); ++text_index) {
+        const auto &top_languages(top_languages_per_text[text_index]);
+        if (top_languages.empty())
+            continue;
+
+        if (top_languages.front() == language_codes[text_index])
+            ++*agreed_count;
+        else {
+            const std::string key(language_codes[text_index] + ":" + top_languages.front());
+            if (verbose)
+                std::cout << key << "  " << texts[text_index] << '\n';
+            const auto mismatched_assignment_and_count(mismatched_assignments_to_counts_map->find(key));
+            if (mismatched_assignment_and_count == mismatched_assignments_to_counts_map->end())
+                mismatched_assignments_to_counts_map->emplace(key, 1u);
+            else
+                ++mismatched_assignment_and_count->second;
+        }
+    }
+}
+
+
 void ProcessRecords(const bool verbose, const unsigned limit_count, const unsigned /*cross_validation_chunk_count*/,
                     MARC::Reader * const marc_reader, const std::set<std::string> &considered_languages,
                     std::unordered_map<std::string, unsigned> * const mismatched_assignments_to_counts_map)
 {
     unsigned record_count(0), untagged_count(0), agreed_count(0);
 
+    std::vector<std::string> language_codes, texts;
     while (const MARC::Record record = marc_reader->read()) {
         if (record_count > limit_count)
             break;
@@ -78,25 +109,15 @@ void ProcessRecords(const bool verbose, const unsigned limit_count, const unsign
             continue;
         }
 
-        const std::string text(record.getCompleteTitle() + " " + record.getSummary());
-        std::vector<std::string> top_languages;
-        NGram::ClassifyLanguage(text, &top_languages, considered_languages);
-        if (top_languages.empty())
-            continue;
-
-        if (top_languages.front() == language_code)
-            ++agreed_count;
-        else {
-            const std::string key(language_code + ":" + top_languages.front());
-            if (verbose)
-                std::cout << key << "  " << text << '\n';
-            const auto mismatched_assignment_and_count(mismatched_assignments_to_counts_map->find(key));
-            if (mismatched_assignment_and_count == mismatched_assignments_to_counts_map->end())
-                mismatched_assignments_to_counts_map->emplace(key, 1u);
-            else
-                ++mismatched_assignment_and_count->second;
+        language_codes.emplace_back(language_code);
+        texts.emplace_back(record.getCompleteTitle() + " " + record.getSummary());
+        if (texts.size() == BATCH_SIZE) {
+            ProcessBatch(verbose, language_codes, texts, considered_languages, &agreed_count, mismatched_assignments_to_counts_map);
+            language_codes.clear();
+            texts.clear();
         }
     }
+    ProcessBatch(verbose, language_codes, texts, considered_languages, &agreed_count, mismatched_assignments_to_counts_map);
 
     std::cout << "Used " << record_count << " MARC record(s) of which " << untagged_count << " had no language and "
               << (agreed_count * 100.0) / (record_count - untagged_count) << "% of which had matching languages.\n";
@@ -0,0 +1,96 @@
+/** \brief Utility for running a chain of pipeline stages in a single process.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "File.h"
+#include "FileUtil.h"
+#include "MarcPipeline.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--queue-capacity=N] stage_config marc_input marc_output\n"
+              << "       " << ::progname << " --list-stages\n"
+              << "       Each non-empty line of stage_config that does not start with a hash mark names a stage,\n"
+              << "       optionally followed by whitespace-separated stage arguments.  The records are passed through\n"
+              << "       the stages in the order in which they are listed w/o being serialised in between.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+void LoadStages(const std::string &config_filename, MARC::Pipeline * const pipeline) {
+    const auto config(FileUtil::OpenInputFileOrDie(config_filename));
+    unsigned line_no(0);
+    while (not config->eof()) {
+        std::string line;
+        config->getline(&line);
+        ++line_no;
+        StringUtil::TrimWhite(&line);
+        if (line.empty() or line[0] == '#')
+            continue;
+
+        std::vector<std::string> stage_name_and_arguments;
+        StringUtil::WhiteSpaceSplit(line, &stage_name_and_arguments, /* suppress_empty_components = */true);
+        const std::string stage_name(stage_name_and_arguments.front());
+        stage_name_and_arguments.erase(stage_name_and_arguments.begin());
+        LOG_INFO("Adding stage \"" + stage_name + "\" from line #" + std::to_string(line_no) + ".");
+        pipeline->addStage(MARC::PipelineStage::Factory(stage_name, stage_name_and_arguments));
+    }
+
+    if (pipeline->getStageCount() == 0)
+        LOG_ERROR("no stages found in \"" + config_filename + "\"!");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc == 2 and std::strcmp(argv[1], "--list-stages") == 0) {
+        for (const auto &stage_name : MARC::PipelineStage::GetStageNames())
+            std::cout << stage_name << '\n';
+        return EXIT_SUCCESS;
+    }
+
+    unsigned queue_capacity(MARC::Pipeline::DEFAULT_QUEUE_CAPACITY);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--queue-capacity=")) {
+        if (not StringUtil::ToNumber(argv[1] + std::strlen("--queue-capacity="), &queue_capacity)
+            or queue_capacity == 0)
+            LOG_ERROR("bad queue capacity!");
+        --argc, ++argv;
+    }
+
+    if (argc != 4)
+        Usage();
+
+    MARC::Pipeline pipeline(queue_capacity);
+    LoadStages(argv[1], &pipeline);
+
+    auto marc_reader(MARC::Reader::Factory(argv[2]));
+    auto marc_writer(MARC::Writer::Factory(argv[3]));
+    LOG_INFO("Processed " + std::to_string(pipeline.run(marc_reader.get(), marc_writer.get())) + " record(s).");
+
+    return EXIT_SUCCESS;
+}
@@ -18,6 +18,7 @@
 */
 
 #include <algorithm>
+#include <memory>
 #include <stdexcept>
 #include <unordered_map>
 #include <cstdlib>
@@ -26,8 +27,10 @@
 #include "FileUtil.h"
 #include "JSON.h"
 #include "MARC.h"
+#include "PPNMappingStore.h"
 #include "Solr.h"
 #include "StringUtil.h"
+#include "StringView.h"
 #include "util.h"
 
 
@@ -35,9 +38,10 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    ::Usage("old_ppns_to_new_ppns_map_directory marc_input marc_output field_and_subfield_code1 "
+    ::Usage("(old_ppns_to_new_ppns_map_directory|--ppn-mapping-store) marc_input marc_output field_and_subfield_code1 "
             "[field_and_subfield_code2 .. field_and_subfield_codeN]\n"
-            "For field_and_subfield_code an example would be 773w.");
+            "For field_and_subfield_code an example would be 773w.\n"
+            "--ppn-mapping-store uses the mappings that patch_ppns_in_databases maintains instead of the .db files.");
 }
 
 
@@ -52,49 +56,111 @@ void OpenAllDBs(const std::string &old_ppns_to_new_ppns_map_directory, std::vect
 }
 
 
+// Either "dbs" or "ppn_mapping_store" must be empty.
+class PPNMapper {
+    const std::vector<kyotocabinet::HashDB *> &dbs_;
+    const PPNMappingStore * const ppn_mapping_store_;
+public:
+    PPNMapper(const std::vector<kyotocabinet::HashDB *> &dbs, const PPNMappingStore * const ppn_mapping_store)
+        : dbs_(dbs), ppn_mapping_store_(ppn_mapping_store) { }
+
+    /** \param old_ppn_candidate  A PPN, optionally w/ a "(DE-627)" prefix. */
+    bool getNewPPN(const StringView &old_ppn_candidate, std::string * const new_ppn) const;
+};
+
+
+bool PPNMapper::getNewPPN(const StringView &old_ppn_candidate, std::string * const new_ppn) const {
+    static const StringView K10PLUS_PREFIX("(DE-627)");
+    const std::string old_ppn(old_ppn_candidate.startsWith(K10PLUS_PREFIX)
+                              ? old_ppn_candidate.substr(K10PLUS_PREFIX.size()).toString() : old_ppn_candidate.toString());
+
+    for (const auto &db : dbs_) {
+        if (db->get(old_ppn, new_ppn))
+            return true;
+    }
+
+    return ppn_mapping_store_ != nullptr and ppn_mapping_store_->getCurrentPPN(old_ppn, new_ppn);
+}
+
+
+// \return True if any of the selected subfields of "record_view" contains a PPN that has to be replaced.
+bool NeedsPatching(const MARC::RecordView &record_view, const std::vector<std::string> &tags_and_subfield_codes,
+                   const PPNMapper &ppn_mapper)
+{
+    std::string new_ppn;
+    for (auto field(record_view.begin()); field != record_view.end(); ++field) {
+        for (const auto &tag_and_subfield_code : tags_and_subfield_codes) {
+            if (not field.hasTag(tag_and_subfield_code.substr(0, MARC::Record::TAG_LENGTH)))
+                continue;
+
+            const char SUBFIELD_CODE(tag_and_subfield_code[MARC::Record::TAG_LENGTH]);
+            for (const auto &code_and_value : (*field).getSubfieldRange()) {
+                if (code_and_value.first == SUBFIELD_CODE and ppn_mapper.getNewPPN(code_and_value.second, &new_ppn))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+// \return True if "record" was modified, else false.
+bool PatchRecord(MARC::Record * const record, const std::vector<std::string> &tags_and_subfield_codes,
+                 const PPNMapper &ppn_mapper)
+{
+    bool patched_record(false);
+    for (const auto &tag_and_subfield_code : tags_and_subfield_codes) {
+        for (auto &field : record->getTagRange(tag_and_subfield_code.substr(0, MARC::Record::TAG_LENGTH))) {
+            const char SUBFIELD_CODE(tag_and_subfield_code[MARC::Record::TAG_LENGTH]);
+            MARC::Subfields subfields(field.getSubfields());
+            bool patched_field(false);
+            for (auto &subfield : subfields) {
+                std::string new_ppn;
+                if (subfield.code_ == SUBFIELD_CODE and ppn_mapper.getNewPPN(subfield.value_, &new_ppn)) {
+                    subfield.value_ = new_ppn;
+                    patched_field = true;
+                }
+            }
+
+            if (patched_field) {
+                field.setContents(subfields, field.getIndicator1(), field.getIndicator2());
+                patched_record = true;
+            }
+        }
+    }
+
+    return patched_record;
+}
+
+
+// Binary records that contain no PPN that has to be replaced are copied w/o being decoded.
 void ProcessRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                    const std::vector<std::string> &tags_and_subfield_codes, const std::vector<kyotocabinet::HashDB *> &dbs)
+                    const std::vector<std::string> &tags_and_subfield_codes, const PPNMapper &ppn_mapper)
 {
     unsigned total_record_count(0), patched_record_count(0);
-    while (MARC::Record record = marc_reader->read()) {
+    if (marc_reader->getReaderType() == MARC::FileType::BINARY or marc_reader->getReaderType() == MARC::FileType::INDEXED) {
+        auto const binary_reader(static_cast<MARC::BinaryReader *>(marc_reader));
+        while (const MARC::RecordView record_view = binary_reader->readView()) {
             ++total_record_count;
 
-            bool patched_record(false);
-            for (const auto tag_and_subfield_code : tags_and_subfield_codes) {
-                for (auto field : record.getTagRange(tag_and_subfield_code.substr(0, MARC::Record::TAG_LENGTH))) {
-                    const char SUBFIELD_CODE(tag_and_subfield_code[MARC::Record::TAG_LENGTH]);
-                    MARC::Subfields subfields(field.getSubfields());
-                    bool patched_field(false);
-                    for (auto &subfield : subfields) {
-                        if (subfield.code_ != SUBFIELD_CODE)
-                            continue;
-
-                        std::string old_ppn_candidate;
-                        if (StringUtil::StartsWith(subfield.value_, "(DE-627)"))
-                            old_ppn_candidate = subfield.value_.substr(__builtin_strlen("(DE-627)"));
-                        else
-                            old_ppn_candidate = subfield.value_;
-
-                        for (const auto &db : dbs) {
-                            std::string new_ppn;
-                            if (db->get(old_ppn_candidate, &new_ppn)) {
-                                subfield.value_ = new_ppn;
-                                patched_field = true;
-                                break;
-                            }
-                        }
-                    }
-
-                    if (patched_field) {
-                        field.setContents(subfields, field.getIndicator1(), field.getIndicator2());
-                        patched_record = true;
-                    }
-                }
+            if (not NeedsPatching(record_view, tags_and_subfield_codes, ppn_mapper)) {
+                marc_writer->write(record_view);
+                continue;
             }
-            if (patched_record)
-                ++patched_record_count;
 
+            MARC::Record record(record_view.toRecord());
+            if (PatchRecord(&record, tags_and_subfield_codes, ppn_mapper))
+                ++patched_record_count;
+            marc_writer->write(record);
+        }
+    } else {
+        while (MARC::Record record = marc_reader->read()) {
+            ++total_record_count;
+            if (PatchRecord(&record, tags_and_subfield_codes, ppn_mapper))
+                ++patched_record_count;
             marc_writer->write(record);
+        }
     }
 
     LOG_INFO("Processed " + std::to_string(total_record_count) + " records and patched " + std::to_string(patched_record_count)
@@ -106,23 +172,27 @@ void ProcessRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_
 
 
 int Main(int argc, char *argv[]) {
-    if (argc < 4)
+    if (argc < 5)
         Usage();
 
     std::vector<kyotocabinet::HashDB *> dbs;
-    OpenAllDBs(argv[1], &dbs);
+    std::unique_ptr<PPNMappingStore> ppn_mapping_store;
+    if (std::strcmp(argv[1], "--ppn-mapping-store") == 0)
+        ppn_mapping_store.reset(new PPNMappingStore());
+    else
+        OpenAllDBs(argv[1], &dbs);
 
     std::vector<std::string> tags_and_subfield_codes;
-    for (int arg_no(3); arg_no < argc; ++arg_no) {
+    for (int arg_no(4); arg_no < argc; ++arg_no) {
         if (std::strlen(argv[arg_no]) != MARC::Record::TAG_LENGTH + 1)
             LOG_ERROR("bad tag + subfield code: \"" + std::string(argv[arg_no]) + "\"!");
         tags_and_subfield_codes.emplace_back(argv[arg_no]);
     }
     std::sort(tags_and_subfield_codes.begin(), tags_and_subfield_codes.end());
 
-    const auto marc_reader(MARC::Reader::Factory(argv[1]));
-    const auto marc_writer(MARC::Writer::Factory(argv[2]));
-    ProcessRecords(marc_reader.get(), marc_writer.get(), tags_and_subfield_codes, dbs);
+    const auto marc_reader(MARC::Reader::Factory(argv[2]));
+    const auto marc_writer(MARC::Writer::Factory(argv[3]));
+    ProcessRecords(marc_reader.get(), marc_writer.get(), tags_and_subfield_codes, PPNMapper(dbs, ppn_mapping_store.get()));
 
     return EXIT_SUCCESS;
 }
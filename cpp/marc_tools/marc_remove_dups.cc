@@ -21,10 +21,10 @@
 */
 
 #include <iostream>
-#include <unordered_set>
 #include <cstring>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcControlNumberSet.h"
 #include "util.h"
 
 
@@ -39,65 +39,27 @@ namespace {
 }
 
 
-struct ChecksumAndControlNumber {
-    std::string checksum_, control_number_;
-public:
-    ChecksumAndControlNumber(const std::string &checksum, const std::string &control_number)
-        : checksum_(checksum), control_number_(control_number) { }
-    ChecksumAndControlNumber() = default;
-    ChecksumAndControlNumber(const ChecksumAndControlNumber &rhs) = default;
-
-    inline bool operator==(const ChecksumAndControlNumber &rhs) const { return control_number_ == rhs.control_number_; }
-    inline bool operator<(const ChecksumAndControlNumber &rhs) const { return control_number_ < rhs.control_number_; }
-};
-
-
-} // unnamed namespace
-
-
-namespace std {
-
-
-template <> struct hash<ChecksumAndControlNumber> {
-    inline size_t operator()(const ChecksumAndControlNumber &checksum_and_control_number) const {
-        return hash<std::string>()(checksum_and_control_number.control_number_);
-    }
-};
-
-
-} // namespace std
-
-
-namespace {
-
-
 void DropDups(const bool use_checksums, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-              std::unordered_set<ChecksumAndControlNumber> * const previously_seen)
+              MARC::ControlNumberSet * const previously_seen)
 {
     unsigned total_count(0), dropped_count(0);
 
     while (const MARC::Record record = marc_reader->read()) {
         ++total_count;
 
-        const std::string checksum(
-            use_checksums ? CalcChecksum(record, /* excluded_fields = */{ "001" }, /* suppress_local_fields = */false) : "");
-
-        ChecksumAndControlNumber new_checksum_and_control_number(checksum, record.getControlNumber());
-        const auto iter(previously_seen->find(new_checksum_and_control_number));
-        previously_seen->emplace(new_checksum_and_control_number);
-        if (iter != previously_seen->end()) {
-            if (use_checksums) {
-                if (iter->checksum_ == new_checksum_and_control_number.checksum_) {
-                    ++dropped_count;
-                    continue;
-                }
-            } else {
+        const uint64_t checksum(
+            use_checksums ? CalcFastChecksum(record, /* excluded_fields = */{ "001" }, /* suppress_local_fields = */false) : 0);
+
+        const std::string control_number(record.getControlNumber());
+        uint64_t previous_checksum;
+        if (previously_seen->find(control_number, &previous_checksum)) {
+            if (not use_checksums or previous_checksum == checksum) {
                 ++dropped_count;
                 continue;
             }
-        }
+        } else
+            previously_seen->insert(control_number, checksum);
 
-        previously_seen->emplace(new_checksum_and_control_number);
         marc_writer->write(record);
     }
 
@@ -123,7 +85,7 @@ int Main(int argc, char **argv) {
 
     auto marc_writer(MARC::Writer::Factory(argv[argc - 1]));
 
-    std::unordered_set<ChecksumAndControlNumber> previously_seen;
+    MARC::ControlNumberSet previously_seen(/* store_values = */use_checksums);
     for (int arg_no(1); arg_no < argc - 1; ++arg_no) {
         auto marc_reader(MARC::Reader::Factory(argv[arg_no]));
         DropDups(use_checksums, marc_reader.get(), marc_writer.get(), &previously_seen);
@@ -47,7 +47,7 @@ int Main(int argc, char *argv[]) {
     if (argc != 2)
         Usage();
 
-    auto marc_reader(MARC::Reader::Factory(argv[1]));
+    auto marc_reader(MARC::Reader::Factory(argv[1], MARC::FileType::AUTO, { "001" }));
     CountRecords(marc_reader.get());
     return EXIT_SUCCESS;
 }
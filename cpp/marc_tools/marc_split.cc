@@ -1,5 +1,5 @@
 /** \file marc_split.cc
- *  \brief Splits a MARC 21 file in equally sized files.
+ *  \brief Splits a MARC 21 file into a number of shards.
  *
  *  \author Oliver Obenland (oliver.obenland@uni-tuebingen.de)
  *
@@ -19,8 +19,14 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include "MARC.h"
 #include "StringUtil.h"
@@ -31,18 +37,204 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "usage: " << ::progname << " marc_input marc_output_name split_count\n";
+    std::cerr << "usage: " << ::progname << " [--partition=(round-robin|hash|size)] marc_input marc_output_name split_count\n"
+              << "       round-robin, the default, assigns the records to the shards in turn, hash assigns a record based\n"
+              << "       on a hash of its control number, so that a given record always ends up in the same shard, and\n"
+              << "       size assigns each record to the shard w/ the fewest bytes so far.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-void Split(MARC::Reader * const marc_reader, std::vector<std::unique_ptr<MARC::Writer>> &marc_writers) {
-    unsigned index(0);
+/** \brief Decides which shard a record goes to. */
+class Partitioner {
+protected:
+    const unsigned shard_count_;
+public:
+    explicit Partitioner(const unsigned shard_count): shard_count_(shard_count) { }
+    virtual ~Partitioner() = default;
+
+    virtual unsigned getShard(const std::string &control_number, const size_t record_size) = 0;
+
+    /** \return nullptr if "partition_type" is unknown. */
+    static Partitioner *Factory(const std::string &partition_type, const unsigned shard_count);
+};
+
+
+class RoundRobinPartitioner final : public Partitioner {
+    unsigned next_shard_;
+public:
+    explicit RoundRobinPartitioner(const unsigned shard_count): Partitioner(shard_count), next_shard_(0) { }
+
+    virtual unsigned getShard(const std::string &/*control_number*/, const size_t /*record_size*/) override {
+        const unsigned shard(next_shard_);
+        next_shard_ = (next_shard_ + 1) % shard_count_;
+        return shard;
+    }
+};
+
+
+// We use xxHash rather than std::hash because the shards have to be the same on all machines and for all builds.
+class HashPartitioner final : public Partitioner {
+public:
+    explicit HashPartitioner(const unsigned shard_count): Partitioner(shard_count) { }
+
+    virtual unsigned getShard(const std::string &control_number, const size_t /*record_size*/) override {
+        return StringUtil::CalcXXHash64(control_number) % shard_count_;
+    }
+};
+
+
+class SizePartitioner final : public Partitioner {
+    std::vector<size_t> shard_sizes_;
+public:
+    explicit SizePartitioner(const unsigned shard_count): Partitioner(shard_count), shard_sizes_(shard_count) { }
+
+    virtual unsigned getShard(const std::string &/*control_number*/, const size_t record_size) override {
+        unsigned smallest_shard(0);
+        for (unsigned shard(1); shard < shard_count_; ++shard) {
+            if (shard_sizes_[shard] < shard_sizes_[smallest_shard])
+                smallest_shard = shard;
+        }
+        shard_sizes_[smallest_shard] += record_size;
+        return smallest_shard;
+    }
+};
+
+
+Partitioner *Partitioner::Factory(const std::string &partition_type, const unsigned shard_count) {
+    if (partition_type == "round-robin")
+        return new RoundRobinPartitioner(shard_count);
+    if (partition_type == "hash")
+        return new HashPartitioner(shard_count);
+    if (partition_type == "size")
+        return new SizePartitioner(shard_count);
+    return nullptr;
+}
+
+
+/** \brief Writes the raw records of one shard on a thread of its own. */
+class ShardWriter {
+    static constexpr size_t MAX_QUEUE_SIZE = 1000;
+
+    std::unique_ptr<MARC::Writer> marc_writer_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+    std::deque<std::string> raw_records_;
+    bool closed_;
+    std::exception_ptr exception_;
+    std::thread thread_;
+public:
+    explicit ShardWriter(const std::string &output_filename)
+        : marc_writer_(MARC::Writer::Factory(output_filename, MARC::FileType::BINARY)), closed_(false),
+          thread_(&ShardWriter::writeRecords, this) { }
+    ~ShardWriter() { stopThread(); }
+
+    void write(std::string &&raw_record);
+
+    /** \brief Waits until all records have been written.
+     *  \note  Rethrows any exception that was thrown on our writer thread.
+     */
+    void close();
+private:
+    void stopThread();
+    void writeRecords();
+};
+
+
+void ShardWriter::write(std::string &&raw_record) {
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    not_full_.wait(mutex_locker, [this]{ return raw_records_.size() < MAX_QUEUE_SIZE or exception_; });
+    if (exception_) {
+        mutex_locker.unlock();
+        close(); // Rethrows the exception.
+    }
+    raw_records_.emplace_back(std::move(raw_record));
+    mutex_locker.unlock();
+    not_empty_.notify_one();
+}
+
+
+void ShardWriter::close() {
+    stopThread();
+    if (exception_)
+        std::rethrow_exception(exception_);
+    marc_writer_.reset();
+}
+
+
+void ShardWriter::stopThread() {
+    if (not thread_.joinable())
+        return;
+
+    std::unique_lock<std::mutex> mutex_locker(mutex_);
+    closed_ = true;
+    mutex_locker.unlock();
+    not_empty_.notify_one();
+    thread_.join();
+}
+
+
+void ShardWriter::writeRecords() {
+    try {
+        for (;;) {
+            std::unique_lock<std::mutex> mutex_locker(mutex_);
+            not_empty_.wait(mutex_locker, [this]{ return not raw_records_.empty() or closed_; });
+            if (raw_records_.empty())
+                return;
+            const std::string raw_record(std::move(raw_records_.front()));
+            raw_records_.pop_front();
+            mutex_locker.unlock();
+            not_full_.notify_one();
+
+            // No re-encoding, we just copy the bytes:
+            marc_writer_->write(MARC::RecordView(raw_record.size(), raw_record.data()));
+        }
+    } catch (...) {
+        std::unique_lock<std::mutex> mutex_locker(mutex_);
+        exception_ = std::current_exception();
+        mutex_locker.unlock();
+        not_full_.notify_one();
+    }
+}
+
+
+// Hands the undecoded records over to one writer thread per shard.
+unsigned SplitRawRecords(MARC::BinaryReader * const marc_reader, Partitioner * const partitioner,
+                         std::vector<std::unique_ptr<ShardWriter>> * const shard_writers)
+{
+    unsigned record_count(0), shard(0);
+    std::string last_control_number;
+    while (const MARC::RecordView record_view = marc_reader->readView()) {
+        // Oversized records are split into several physical records w/ the same control number.  Those have to end up
+        // in the same shard:
+        std::string control_number(record_view.getControlNumber().toString());
+        if (control_number.empty() or control_number != last_control_number) {
+            shard = partitioner->getShard(control_number, record_view.size());
+            ++record_count;
+        }
+        last_control_number.swap(control_number);
+
+        (*shard_writers)[shard]->write(std::string(record_view.data(), record_view.size()));
+    }
+
+    for (auto &shard_writer : *shard_writers)
+        shard_writer->close();
+
+    return record_count;
+}
+
+
+// For non-MARC-21 input we have to encode the records anyway, so we do that on the main thread.
+unsigned SplitRecords(MARC::Reader * const marc_reader, Partitioner * const partitioner,
+                      std::vector<std::unique_ptr<MARC::Writer>> * const marc_writers)
+{
+    unsigned record_count(0);
     while (const MARC::Record record = marc_reader->read()) {
-        marc_writers[index % marc_writers.size()]->write(record);
-        ++index ;
+        (*marc_writers)[partitioner->getShard(record.getControlNumber(), record.size())]->write(record);
+        ++record_count;
     }
-    std::cout << "~" << (index / marc_writers.size()) << " records per file.\n";
+
+    return record_count;
 }
 
 
@@ -50,23 +242,44 @@ void Split(MARC::Reader * const marc_reader, std::vector<std::unique_ptr<MARC::W
 
 
 int Main(int argc, char* argv[]) {
+    std::string partition_type("round-robin");
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--partition=")) {
+        partition_type = argv[1] + __builtin_strlen("--partition=");
+        --argc, ++argv;
+    }
+
     if (argc != 4)
         Usage();
 
     std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[1]));
 
     unsigned split_count;
-    if (not StringUtil::ToUnsigned(argv[3], &split_count))
+    if (not StringUtil::ToUnsigned(argv[3], &split_count) or split_count == 0)
         LOG_ERROR("bad split count: \"" + std::string(argv[3]) + "\"!");
 
+    std::unique_ptr<Partitioner> partitioner(Partitioner::Factory(partition_type, split_count));
+    if (partitioner == nullptr)
+        LOG_ERROR("unknown partition type \"" + partition_type + "\"!");
+
     const std::string output_prefix(argv[2]);
+    std::vector<std::string> output_filenames;
+    for (size_t i(0); i < split_count; ++i)
+        output_filenames.emplace_back(output_prefix + "_" + std::to_string(i) + ".mrc");
 
-    std::vector<std::unique_ptr<MARC::Writer>> marc_writers;
-    for (size_t i(0); i < split_count; ++i) {
-        const std::string output_filename(output_prefix + "_" + std::to_string(i) + ".mrc");
-        marc_writers.emplace_back(MARC::Writer::Factory(output_filename, MARC::FileType::BINARY));
+    unsigned record_count;
+    if (marc_reader->getReaderType() == MARC::FileType::XML) {
+        std::vector<std::unique_ptr<MARC::Writer>> marc_writers;
+        for (const auto &output_filename : output_filenames)
+            marc_writers.emplace_back(MARC::Writer::Factory(output_filename, MARC::FileType::BINARY));
+        record_count = SplitRecords(marc_reader.get(), partitioner.get(), &marc_writers);
+    } else {
+        std::vector<std::unique_ptr<ShardWriter>> shard_writers;
+        for (const auto &output_filename : output_filenames)
+            shard_writers.emplace_back(new ShardWriter(output_filename));
+        record_count = SplitRawRecords(static_cast<MARC::BinaryReader *>(marc_reader.get()), partitioner.get(),
+                                       &shard_writers);
     }
-    Split(marc_reader.get(), marc_writers);
+    std::cout << "~" << (record_count / split_count) << " records per file.\n";
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,436 @@
+/** \file    marc_stats.cc
+ *  \brief   Collects various statistics about a MARC collection in a single, multi-threaded pass and reports them as JSON.
+ *  \author  Dr. Johannes Ruscheinski
+ */
+
+/*
+    Copyright (C) 2019, Library of the University of Tübingen
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include "JSON.h"
+#include "MarcParallelProcessor.h"
+#include "MARC.h"
+#include "StringUtil.h"
+#include "ThreadUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--thread-count=N] [--skip-duplicate-check] marc_data\n"
+              << "  Writes record counts by record type and bibliographic level, a tag histogram w/ the subfield codes used\n"
+              << "  by each tag, the non-standard tags, the distribution of record sizes, the languages of the bibliographic\n"
+              << "  records and the number of duplicate control numbers as JSON to stdout.\n"
+              << "  The duplicate check needs memory proportional to the number of records and can be skipped.\n"
+              << "  The default thread count is the number of cores.\n"
+              << "  Consecutive records w/ the same control number are counted as a single, merged record.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+inline std::string ToString(const std::string &s) { return s; }
+inline std::string ToString(const StringView &s) { return s.toString(); }
+
+
+// Mirrors MARC::Record::getRecordType() which we can't use for record views.
+MARC::Record::RecordType GetRecordType(const char leader_type_of_record) {
+    if (leader_type_of_record == 'z')
+        return MARC::Record::RecordType::AUTHORITY;
+    if (leader_type_of_record == 'w')
+        return MARC::Record::RecordType::CLASSIFICATION;
+    return (leader_type_of_record == '\0' or __builtin_strchr("acdefgijkmoprt", leader_type_of_record) == nullptr)
+           ? MARC::Record::RecordType::UNKNOWN : MARC::Record::RecordType::BIBLIOGRAPHIC;
+}
+
+
+std::string RecordTypeToString(const MARC::Record::RecordType record_type) {
+    switch (record_type) {
+    case MARC::Record::RecordType::AUTHORITY:
+        return "authority";
+    case MARC::Record::RecordType::BIBLIOGRAPHIC:
+        return "bibliographic";
+    case MARC::Record::RecordType::CLASSIFICATION:
+        return "classification";
+    case MARC::Record::RecordType::UNKNOWN:
+        return "unknown";
+    }
+
+    LOG_ERROR("unknown record type " + std::to_string(static_cast<int>(record_type)) + "!");
+}
+
+
+const size_t RECORD_TYPE_COUNT(4);
+const size_t SIZE_BUCKET_COUNT(sizeof(size_t) * CHAR_BIT);
+
+
+// Each thread accumulates into its own instance.  All instances are merged at the end.
+class Statistics {
+    struct TagStatistics {
+        uint64_t field_count_, record_count_;
+        uint64_t last_record_no_; // Lets us count each record only once, even for repeated fields.
+        std::bitset<256> subfield_codes_;
+    public:
+        TagStatistics(): field_count_(0), record_count_(0), last_record_no_(0) { }
+    };
+
+    const bool check_duplicates_;
+    uint64_t record_count_, field_count_, total_record_size_, oversized_record_count_, duplicate_control_number_count_;
+    size_t min_record_size_, max_record_size_, max_field_count_, max_subfield_count_;
+    std::array<uint64_t, RECORD_TYPE_COUNT> record_type_counts_;
+    std::array<uint64_t, 256> bibliographic_level_counts_;
+    std::array<uint64_t, SIZE_BUCKET_COUNT> size_bucket_counts_; // Bucket n holds sizes in [2^n,2^(n+1)).
+    std::unordered_map<MARC::Tag, TagStatistics> tags_to_statistics_map_;
+    std::unordered_map<std::string, uint64_t> languages_to_counts_map_;
+    std::unordered_set<std::string> control_numbers_;
+public:
+    explicit Statistics(const bool check_duplicates)
+        : check_duplicates_(check_duplicates), record_count_(0), field_count_(0), total_record_size_(0),
+          oversized_record_count_(0), duplicate_control_number_count_(0), min_record_size_(SIZE_MAX), max_record_size_(0),
+          max_field_count_(0), max_subfield_count_(0), record_type_counts_(), bibliographic_level_counts_(), size_bucket_counts_()
+        { }
+
+    /** \brief Adds a logical record that has been split into "part_count" physical records, as if they had been
+     *         combined w/ MARC::Record::merge().
+     *  \note  "RecordType" is either MARC::Record or MARC::RecordView.
+     */
+    template<typename RecordType> void add(const RecordType * const parts, const size_t part_count);
+
+    void merge(Statistics * const other);
+    void write(const std::string &input_filename, JSON::Writer * const writer) const;
+private:
+    template<typename FieldType> void addField(const FieldType &field, const MARC::Record::RecordType record_type,
+                                               TagStatistics * const tag_statistics);
+};
+
+
+template<typename RecordType> void Statistics::add(const RecordType * const parts, const size_t part_count) {
+    ++record_count_;
+
+    const auto &leader(parts[0].getLeader());
+    const MARC::Record::RecordType record_type(GetRecordType(leader[6]));
+    ++record_type_counts_[static_cast<size_t>(record_type)];
+    ++bibliographic_level_counts_[static_cast<unsigned char>(leader[7])];
+
+    size_t record_size(parts[0].size()), field_count(0);
+    for (size_t part_no(0); part_no < part_count; ++part_no) {
+        for (const auto &field : parts[part_no]) {
+            TagStatistics &tag_statistics(tags_to_statistics_map_[field.getTag()]);
+            if (part_no > 0) // Mirrors what MARC::Record::merge() adds to the size.
+                record_size += MARC::Record::DIRECTORY_ENTRY_LENGTH + field.getContents().size() + 1 /* field separator */;
+            addField(field, record_type, &tag_statistics);
+            ++field_count;
+        }
+    }
+
+    total_record_size_ += record_size;
+    min_record_size_ = std::min(min_record_size_, record_size);
+    max_record_size_ = std::max(max_record_size_, record_size);
+    if (record_size > MARC::Record::MAX_RECORD_LENGTH)
+        ++oversized_record_count_;
+    if (likely(record_size > 0))
+        ++size_bucket_counts_[SIZE_BUCKET_COUNT - 1 - __builtin_clzl(record_size)];
+
+    field_count_ += field_count;
+    max_field_count_ = std::max(max_field_count_, field_count);
+
+    if (check_duplicates_ and not control_numbers_.emplace(ToString(parts[0].getControlNumber())).second)
+        ++duplicate_control_number_count_;
+}
+
+
+template<typename FieldType> void Statistics::addField(const FieldType &field, const MARC::Record::RecordType record_type,
+                                                       TagStatistics * const tag_statistics)
+{
+    ++tag_statistics->field_count_;
+    if (tag_statistics->last_record_no_ != record_count_) {
+        tag_statistics->last_record_no_ = record_count_;
+        ++tag_statistics->record_count_;
+    }
+
+    if (field.isControlField()) {
+        if (field.getTag() == "008" and record_type == MARC::Record::RecordType::BIBLIOGRAPHIC) {
+            const StringView _008_contents(field.getContents());
+            if (_008_contents.size() >= 38)
+                ++languages_to_counts_map_[_008_contents.substr(35, 3).toString()];
+        }
+        return;
+    }
+
+    size_t subfield_count(0);
+    for (const auto &code_and_value : MARC::SubfieldRange(StringView(field.getContents()))) {
+        ++subfield_count;
+        tag_statistics->subfield_codes_.set(static_cast<unsigned char>(code_and_value.first));
+    }
+    max_subfield_count_ = std::max(max_subfield_count_, subfield_count);
+}
+
+
+void Statistics::merge(Statistics * const other) {
+    record_count_                   += other->record_count_;
+    field_count_                    += other->field_count_;
+    total_record_size_              += other->total_record_size_;
+    oversized_record_count_         += other->oversized_record_count_;
+    duplicate_control_number_count_ += other->duplicate_control_number_count_;
+    min_record_size_    = std::min(min_record_size_, other->min_record_size_);
+    max_record_size_    = std::max(max_record_size_, other->max_record_size_);
+    max_field_count_    = std::max(max_field_count_, other->max_field_count_);
+    max_subfield_count_ = std::max(max_subfield_count_, other->max_subfield_count_);
+
+    for (size_t i(0); i < record_type_counts_.size(); ++i)
+        record_type_counts_[i] += other->record_type_counts_[i];
+    for (size_t i(0); i < bibliographic_level_counts_.size(); ++i)
+        bibliographic_level_counts_[i] += other->bibliographic_level_counts_[i];
+    for (size_t i(0); i < size_bucket_counts_.size(); ++i)
+        size_bucket_counts_[i] += other->size_bucket_counts_[i];
+
+    for (const auto &tag_and_statistics : other->tags_to_statistics_map_) {
+        TagStatistics &tag_statistics(tags_to_statistics_map_[tag_and_statistics.first]);
+        tag_statistics.field_count_    += tag_and_statistics.second.field_count_;
+        tag_statistics.record_count_   += tag_and_statistics.second.record_count_;
+        tag_statistics.subfield_codes_ |= tag_and_statistics.second.subfield_codes_;
+    }
+
+    for (const auto &language_and_count : other->languages_to_counts_map_)
+        languages_to_counts_map_[language_and_count.first] += language_and_count.second;
+
+    // We always insert the smaller set into the larger one:
+    if (control_numbers_.size() < other->control_numbers_.size())
+        control_numbers_.swap(other->control_numbers_);
+    for (const auto &control_number : other->control_numbers_) {
+        if (not control_numbers_.emplace(control_number).second)
+            ++duplicate_control_number_count_;
+    }
+    other->control_numbers_.clear();
+}
+
+
+void Statistics::write(const std::string &input_filename, JSON::Writer * const writer) const {
+    writer->beginObject();
+    writer->stringMember("input", input_filename);
+    writer->key("record_count").integerValue(record_count_);
+    if (check_duplicates_)
+        writer->key("duplicate_control_number_count").integerValue(duplicate_control_number_count_);
+
+    writer->key("record_types").beginObject();
+    for (size_t i(0); i < record_type_counts_.size(); ++i)
+        writer->key(RecordTypeToString(static_cast<MARC::Record::RecordType>(i))).integerValue(record_type_counts_[i]);
+    writer->endObject();
+
+    writer->key("bibliographic_levels").beginObject();
+    for (size_t i(0); i < bibliographic_level_counts_.size(); ++i) {
+        if (bibliographic_level_counts_[i] > 0)
+            writer->key(std::string(1, static_cast<char>(i))).integerValue(bibliographic_level_counts_[i]);
+    }
+    writer->endObject();
+
+    writer->key("record_sizes").beginObject();
+    writer->key("min").integerValue(record_count_ == 0 ? 0 : min_record_size_);
+    writer->key("max").integerValue(max_record_size_);
+    writer->key("average").doubleValue(record_count_ == 0 ? 0.0 : static_cast<double>(total_record_size_) / record_count_);
+    writer->key("oversized_count").integerValue(oversized_record_count_);
+    writer->key("histogram").beginArray();
+    for (size_t i(0); i < size_bucket_counts_.size(); ++i) {
+        if (size_bucket_counts_[i] == 0)
+            continue;
+        writer->beginObject();
+        writer->key("from").integerValue(int64_t(1) << i);
+        writer->key("to").integerValue((int64_t(1) << (i + 1)) - 1);
+        writer->key("count").integerValue(size_bucket_counts_[i]);
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->endObject();
+
+    writer->key("fields").beginObject();
+    writer->key("total").integerValue(field_count_);
+    writer->key("average_per_record").doubleValue(record_count_ == 0 ? 0.0 : static_cast<double>(field_count_) / record_count_);
+    writer->key("max_per_record").integerValue(max_field_count_);
+    writer->key("max_subfields_per_field").integerValue(max_subfield_count_);
+    writer->endObject();
+
+    const std::map<MARC::Tag, TagStatistics> sorted_tags_to_statistics_map(tags_to_statistics_map_.cbegin(),
+                                                                           tags_to_statistics_map_.cend());
+    writer->key("tags").beginObject();
+    for (const auto &tag_and_statistics : sorted_tags_to_statistics_map) {
+        writer->key(tag_and_statistics.first.toString()).beginObject();
+        writer->key("field_count").integerValue(tag_and_statistics.second.field_count_);
+        writer->key("record_count").integerValue(tag_and_statistics.second.record_count_);
+        std::string subfield_codes;
+        for (unsigned code(0); code < tag_and_statistics.second.subfield_codes_.size(); ++code) {
+            if (tag_and_statistics.second.subfield_codes_.test(code))
+                subfield_codes += static_cast<char>(code);
+        }
+        writer->stringMember("subfield_codes", subfield_codes);
+        writer->endObject();
+    }
+    writer->endObject();
+
+    writer->key("non_standard_tags").beginArray();
+    for (const auto &tag_and_statistics : sorted_tags_to_statistics_map) {
+        if (not MARC::IsStandardTag(tag_and_statistics.first))
+            writer->stringValue(tag_and_statistics.first.toString());
+    }
+    writer->endArray();
+
+    const std::map<std::string, uint64_t> sorted_languages_to_counts_map(languages_to_counts_map_.cbegin(),
+                                                                         languages_to_counts_map_.cend());
+    writer->key("languages").beginObject();
+    for (const auto &language_and_count : sorted_languages_to_counts_map)
+        writer->key(language_and_count.first).integerValue(language_and_count.second);
+    writer->endObject();
+
+    writer->endObject();
+}
+
+
+// Raw MARC-21 records that are decoded in place by a worker thread.
+struct Batch {
+    std::string data_;
+    std::vector<size_t> record_sizes_;
+    std::vector<size_t> part_counts_; // The number of physical records that make up each logical record.
+};
+
+
+const size_t MAX_BATCH_SIZE(4 * 1024 * 1024); // In bytes.
+
+
+// The reader thread only finds the record boundaries and copies the raw records.  All decoding happens on the workers
+// which look at the records through MARC::RecordView's and never build any MARC::Record's.
+void ProcessBinaryRecords(MARC::BinaryReader * const binary_reader, std::vector<std::unique_ptr<Statistics>> * const statistics) {
+    ThreadUtil::BoundedQueue<Batch> batches(4 * statistics->size());
+
+    std::vector<std::thread> workers;
+    for (auto &worker_statistics : *statistics) {
+        Statistics * const worker_statistics_ptr(worker_statistics.get());
+        workers.emplace_back([&batches, worker_statistics_ptr]() {
+            Batch batch;
+            std::vector<MARC::RecordView> parts;
+            while (batches.pop(&batch)) {
+                const char *record_start(batch.data_.data());
+                auto record_size(batch.record_sizes_.cbegin());
+                for (const size_t part_count : batch.part_counts_) {
+                    parts.clear();
+                    for (size_t part_no(0); part_no < part_count; ++part_no, ++record_size) {
+                        parts.emplace_back(*record_size, record_start);
+                        record_start += *record_size;
+                    }
+                    worker_statistics_ptr->add(parts.data(), parts.size());
+                }
+            }
+        });
+    }
+
+    // Physical records that belong to the same logical record have to end up in the same batch:
+    Batch batch;
+    std::string last_control_number;
+    while (const MARC::RecordView record_view = binary_reader->readView()) {
+        const StringView control_number(record_view.getControlNumber());
+        if (batch.part_counts_.empty() or control_number != last_control_number) {
+            if (batch.data_.size() >= MAX_BATCH_SIZE) {
+                batches.push(std::move(batch));
+                batch = Batch();
+            }
+            batch.part_counts_.emplace_back(0);
+            last_control_number = control_number.toString();
+        }
+        ++batch.part_counts_.back();
+        batch.data_.append(record_view.data(), record_view.size());
+        batch.record_sizes_.emplace_back(record_view.size());
+    }
+    if (not batch.record_sizes_.empty())
+        batches.push(std::move(batch));
+    batches.close();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+
+// MARC-XML has to be decoded into MARC::Record's anyway, so we leave the parsing to the reader thread of the parallel engine.
+void ProcessRecords(MARC::Reader * const marc_reader, std::vector<std::unique_ptr<Statistics>> * const statistics) {
+    std::mutex next_statistics_mutex;
+    size_t next_statistics(0);
+
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr, statistics->size());
+    processor.process([&](MARC::Record * const record) {
+        thread_local Statistics *worker_statistics(nullptr);
+        if (unlikely(worker_statistics == nullptr)) {
+            std::lock_guard<std::mutex> next_statistics_locker(next_statistics_mutex);
+            worker_statistics = (*statistics)[next_statistics++].get();
+        }
+        worker_statistics->add(record, 1); // The reader has already merged any split records.
+        return false;
+    });
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    unsigned thread_count(std::max(1u, std::thread::hardware_concurrency()));
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--thread-count=")) {
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--thread-count="), &thread_count) or thread_count == 0)
+            LOG_ERROR("bad thread count \"" + std::string(argv[1] + __builtin_strlen("--thread-count=")) + "\"!");
+        --argc, ++argv;
+    }
+
+    bool check_duplicates(true);
+    if (argc > 1 and std::strcmp(argv[1], "--skip-duplicate-check") == 0) {
+        check_duplicates = false;
+        --argc, ++argv;
+    }
+
+    if (argc != 2)
+        Usage();
+
+    const auto marc_reader(MARC::Reader::Factory(argv[1]));
+
+    std::vector<std::unique_ptr<Statistics>> statistics;
+    for (unsigned i(0); i < thread_count; ++i)
+        statistics.emplace_back(new Statistics(check_duplicates));
+
+    if (marc_reader->getReaderType() == MARC::FileType::BINARY or marc_reader->getReaderType() == MARC::FileType::INDEXED)
+        ProcessBinaryRecords(static_cast<MARC::BinaryReader *>(marc_reader.get()), &statistics);
+    else
+        ProcessRecords(marc_reader.get(), &statistics);
+
+    for (auto worker_statistics(statistics.begin() + 1); worker_statistics != statistics.end(); ++worker_statistics)
+        statistics.front()->merge(worker_statistics->get());
+
+    std::string json;
+    JSON::Writer writer(&json, JSON::Writer::PRETTY);
+    statistics.front()->write(marc_reader->getPath(), &writer);
+    std::cout << json << '\n';
+
+    return EXIT_SUCCESS;
+}
@@ -17,14 +17,13 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <algorithm>
 #include <iostream>
-#include <stdexcept>
-#include <unordered_map>
-#include <cstdio>
+#include <memory>
+#include <string>
 #include <cstdlib>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcOffsetIndex.h"
 #include "util.h"
 
 
@@ -36,32 +35,68 @@ namespace {
               << "       Replaces all records in \"source_records\" that have an identical control number\n"
               << "       as a record in \"reference_records\" with the corresponding record in\n"
               << "       \"reference_records\".  The file with the replacements as well as any records\n"
-              << "       that could not be replaced is the output file \"target_records\".\n\n";
+              << "       that could not be replaced is the output file \"target_records\".\n"
+              << "       The records in \"reference_records\" are located via its offset index which will be\n"
+              << "       created if it is missing or stale.\n\n";
     std::exit(EXIT_FAILURE);
 }
 
 
+inline bool IsBinaryReader(MARC::Reader * const marc_reader) {
+    return marc_reader->getReaderType() == MARC::FileType::BINARY or marc_reader->getReaderType() == MARC::FileType::INDEXED;
+}
+
+
+// Binary reference records are copied w/o being decoded.
+void WriteReferenceRecord(const std::string &control_number, const off_t offset, MARC::Reader * const marc_reference_reader,
+                          MARC::Writer * const marc_writer)
+{
+    if (unlikely(not marc_reference_reader->seek(offset)))
+        LOG_ERROR("failed to seek in reference records! (offset: " + std::to_string(offset) + ")");
+
+    if (IsBinaryReader(marc_reference_reader)) {
+        const MARC::RecordView reference_record_view(static_cast<MARC::BinaryReader *>(marc_reference_reader)->readView());
+        if (unlikely(not reference_record_view or reference_record_view.getControlNumber() != control_number))
+            LOG_ERROR("no reference record w/ control number " + control_number + " at offset " + std::to_string(offset)
+                      + "!");
+        marc_writer->write(reference_record_view);
+    } else
+        marc_writer->write(marc_reference_reader->read());
+}
+
+
+// Source records w/o a replacement are copied as raw bytes if the source records are in the binary format.
 void ProcessSourceRecords(MARC::Reader * const marc_source_reader, MARC::Reader * const marc_reference_reader,
-                          MARC::Writer * const marc_writer,
-                          const std::unordered_map<std::string, off_t> &control_number_to_offset_map)
+                          MARC::Writer * const marc_writer, const MARC::OffsetIndex &reference_offset_index)
 {
     unsigned source_record_count(0), replacement_count(0);
-    while (const MARC::Record source_record = marc_source_reader->read()) {
-        ++source_record_count;
-
-        const auto control_number_and_offset(control_number_to_offset_map.find(source_record.getControlNumber()));
-        if (control_number_and_offset == control_number_to_offset_map.cend()) { // No replacement found.
-            marc_writer->write(source_record);
-            continue;
+    std::string control_number;
+    off_t offset;
+    if (IsBinaryReader(marc_source_reader)) {
+        auto const binary_source_reader(static_cast<MARC::BinaryReader *>(marc_source_reader));
+        while (const MARC::RecordView source_record_view = binary_source_reader->readView()) {
+            ++source_record_count;
+
+            control_number = source_record_view.getControlNumber().toString();
+            if (not reference_offset_index.find(control_number, &offset)) // No replacement found.
+                marc_writer->write(source_record_view);
+            else {
+                WriteReferenceRecord(control_number, offset, marc_reference_reader, marc_writer);
+                ++replacement_count;
+            }
+        }
+    } else {
+        while (const MARC::Record source_record = marc_source_reader->read()) {
+            ++source_record_count;
+
+            control_number = source_record.getControlNumber();
+            if (not reference_offset_index.find(control_number, &offset)) // No replacement found.
+                marc_writer->write(source_record);
+            else {
+                WriteReferenceRecord(control_number, offset, marc_reference_reader, marc_writer);
+                ++replacement_count;
+            }
         }
-
-        if (unlikely(not marc_reference_reader->seek(control_number_and_offset->second)))
-            logger->error("failed to seek in reference records! (offset: "
-                          + std::to_string(control_number_and_offset->second));
-
-        const MARC::Record reference_record(marc_reference_reader->read());
-        marc_writer->write(reference_record);
-        ++replacement_count;
     }
 
     std::cout << "Read " << source_record_count << " source records.\n";
@@ -82,13 +117,12 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Reader> marc_source_reader(MARC::Reader::Factory(argv[2]));
     std::unique_ptr<MARC::Writer> marc_target_writer(MARC::Writer::Factory(argv[3]));
 
-    std::unordered_map<std::string, off_t> control_number_to_offset_map;
-    std::cout << "Read "
-              << MARC::CollectRecordOffsets(marc_reference_reader.get(), &control_number_to_offset_map)
-              << " reference records.\n";
+    const MARC::OffsetIndex reference_offset_index(marc_reference_reader.get());
+    std::cout << "Found " << reference_offset_index.size() << " reference records in \""
+              << reference_offset_index.getIndexPath() << "\".\n";
 
     ProcessSourceRecords(marc_source_reader.get(), marc_reference_reader.get(), marc_target_writer.get(),
-                         control_number_to_offset_map);
+                         reference_offset_index);
 
     return EXIT_SUCCESS;
 }
@@ -20,20 +20,22 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
-#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
-#include <kchashdb.h>
 #include "Compiler.h"
 #include "DbConnection.h"
 #include "EmailSender.h"
-#include "FileUtil.h"
 #include "HtmlUtil.h"
 #include "IniFile.h"
 #include "JSON.h"
+#include "KeyValueStore.h"
 #include "Solr.h"
 #include "StringUtil.h"
 #include "Template.h"
@@ -184,40 +186,45 @@ std::vector<std::string> GetAuthors(const std::shared_ptr<const JSON::ObjectNode
 }
 
 
-/** \return True if new issues were found, false o/w. */
-bool ExtractNewIssueInfos(const std::unique_ptr<kyotocabinet::HashDB> &notified_db,
-                          std::unordered_set<std::string> * const new_notification_ids,
-                          const std::string &json_document, std::vector<NewIssueInfo> * const new_issue_infos,
-                          std::string * const max_last_modification_time)
+// Assigns the issues in "json_document" to those of their superior works that are in "serial_control_numbers".
+void ExtractIssueInfo(const std::shared_ptr<const JSON::ObjectNode> &doc_obj,
+                      const std::unordered_set<std::string> &serial_control_numbers,
+                      std::unordered_map<std::string, std::vector<NewIssueInfo>> * const serial_control_numbers_to_issue_infos)
 {
-    bool found_at_least_one_new_issue(false);
+    const std::string id(GetIssueId(doc_obj));
+    NewIssueInfo issue_info(id, GetSeriesTitle(doc_obj), GetIssueTitle(id, doc_obj), GetAuthors(doc_obj));
+    issue_info.last_modification_time_ = GetLastModificationTime(doc_obj);
 
-    JSON::Parser parser(json_document);
-    std::shared_ptr<JSON::JSONNode> tree;
-    if (not parser.parse(&tree))
-        LOG_ERROR("JSON parser failed: " + parser.getErrorMessage());
+    for (const auto &superior_ppn : JSON::LookupStrings("/superior_ppn/*", doc_obj)) {
+        if (serial_control_numbers.find(superior_ppn) != serial_control_numbers.cend())
+            (*serial_control_numbers_to_issue_infos)[superior_ppn].emplace_back(issue_info);
+    }
+}
 
-    const std::shared_ptr<const JSON::ObjectNode> tree_obj(JSON::JSONNode::CastToObjectNodeOrDie("top level JSON entity", tree));
-    const std::shared_ptr<const JSON::ObjectNode> response(tree_obj->getObjectNode("response"));
-    const std::shared_ptr<const JSON::ArrayNode> docs(response->getArrayNode("docs"));
 
-    for (const auto &doc : *docs) {
-        const std::shared_ptr<const JSON::ObjectNode> doc_obj(JSON::JSONNode::CastToObjectNodeOrDie("document object", doc));
+/** \return True if new issues were found, false o/w. */
+bool ExtractNewIssueInfos(const std::unordered_map<std::string, std::vector<NewIssueInfo>> &serial_control_numbers_to_issue_infos,
+                          const std::unordered_set<std::string> &notified_ids,
+                          std::unordered_set<std::string> * const new_notification_ids, const std::string &serial_control_number,
+                          const std::string &last_modification_time, std::vector<NewIssueInfo> * const new_issue_infos,
+                          std::string * const max_last_modification_time)
+{
+    const auto serial_control_number_and_issue_infos(serial_control_numbers_to_issue_infos.find(serial_control_number));
+    if (serial_control_number_and_issue_infos == serial_control_numbers_to_issue_infos.cend())
+        return false;
 
-        const std::string id(GetIssueId(doc_obj));
-        if (notified_db->check(id) > 0)
+    bool found_at_least_one_new_issue(false);
+    for (const auto &issue_info : serial_control_number_and_issue_infos->second) {
+        if (issue_info.last_modification_time_ <= last_modification_time)
+            continue; // Our serial has been queried for another subscriber who has seen fewer issues.
+        if (notified_ids.find(issue_info.control_number_) != notified_ids.cend())
             continue; // We already sent a notification for this issue.
-        new_notification_ids->insert(id);
+        new_notification_ids->insert(issue_info.control_number_);
 
-        const std::string issue_title(GetIssueTitle(id, doc_obj));
-        const std::string series_title(GetSeriesTitle(doc_obj));
-        const std::vector<std::string> authors(GetAuthors(doc_obj));
+        new_issue_infos->emplace_back(issue_info);
 
-        new_issue_infos->emplace_back(id, series_title, issue_title, authors);
-
-        const std::string last_modification_time(GetLastModificationTime(doc_obj));
-        if (last_modification_time > *max_last_modification_time) {
-            *max_last_modification_time = last_modification_time;
+        if (issue_info.last_modification_time_ > *max_last_modification_time) {
+            *max_last_modification_time = issue_info.last_modification_time_;
             found_at_least_one_new_issue = true;
         }
     }
@@ -226,44 +233,103 @@ bool ExtractNewIssueInfos(const std::unique_ptr<kyotocabinet::HashDB> &notified_
 }
 
 
-std::string GetEmailTemplate(const std::string user_type) {
-    std::string result;
-    const std::string EMAIL_TEMPLATE_PATH(UBTools::GetTuelibPath() + "subscriptions_email." + user_type + ".template");
-
-    if (unlikely(not FileUtil::ReadString(EMAIL_TEMPLATE_PATH, &result)))
-        LOG_ERROR("can't load email template \"" + EMAIL_TEMPLATE_PATH + "\"!");
+const size_t MAX_SERIALS_PER_QUERY(100);
+const unsigned MAX_CONCURRENT_QUERIES(4);
 
-    return result;
-}
 
-
-bool GetNewIssues(const std::unique_ptr<kyotocabinet::HashDB> &notified_db,
-                  std::unordered_set<std::string> * const new_notification_ids, const std::string &solr_host_and_port,
-                  const std::string &serial_control_number, std::string last_modification_time,
-                  std::vector<NewIssueInfo> * const new_issue_infos, std::string * const max_last_modification_time)
+// Queries the issues of all serials that have been modified after the serials' last modification times.  Instead of one
+// query per serial we send one query per batch of up to MAX_SERIALS_PER_QUERY serials, and up to MAX_CONCURRENT_QUERIES of
+// those at a time.
+void GetIssues(const std::string &solr_host_and_port,
+               const std::unordered_map<std::string, std::string> &serial_control_numbers_to_last_modification_times,
+               std::unordered_map<std::string, std::vector<NewIssueInfo>> * const serial_control_numbers_to_issue_infos)
 {
+    // Sorting by the last modification times keeps the lower bound of each batch, which is the time of its first serial,
+    // close to those of the other serials in the batch:
+    std::vector<std::pair<std::string, std::string>> serial_control_numbers_and_last_modification_times(
+        serial_control_numbers_to_last_modification_times.cbegin(), serial_control_numbers_to_last_modification_times.cend());
+    std::sort(serial_control_numbers_and_last_modification_times.begin(), serial_control_numbers_and_last_modification_times.end(),
+              [](const std::pair<std::string, std::string> &lhs, const std::pair<std::string, std::string> &rhs)
+                  { return lhs.second < rhs.second; });
+
     const unsigned year_current(StringUtil::ToUnsigned(TimeUtil::GetCurrentYear()));
     const unsigned year_min(year_current - 2);
-    const std::string QUERY("superior_ppn:" + serial_control_number
-                            + " AND last_modification_time:{" + last_modification_time + " TO *}"
-                            + " AND year:[" + std::to_string(year_min) + " TO " + std::to_string(year_current) + "]"
-    );
 
-    std::string json_result, err_msg;
-    if (unlikely(not Solr::Query(QUERY, "id,title,author,last_modification_time,container_ids_and_titles", &json_result, &err_msg,
-                                 solr_host_and_port, /* timeout = */ 5, Solr::JSON)))
-        LOG_ERROR("Solr query failed or timed-out: \"" + QUERY + "\". (" + err_msg + ")");
+    const size_t batch_count((serial_control_numbers_and_last_modification_times.size() + MAX_SERIALS_PER_QUERY - 1)
+                             / MAX_SERIALS_PER_QUERY);
+    std::vector<std::string> queries(batch_count), filter_queries(batch_count);
+    std::vector<std::unordered_set<std::string>> batches(batch_count);
+    for (size_t batch_no(0); batch_no < batch_count; ++batch_no) {
+        const size_t first(batch_no * MAX_SERIALS_PER_QUERY);
+        const size_t last(std::min(first + MAX_SERIALS_PER_QUERY, serial_control_numbers_and_last_modification_times.size()));
+        queries[batch_no] = "last_modification_time:{" + serial_control_numbers_and_last_modification_times[first].second
+                            + " TO *} AND year:[" + std::to_string(year_min) + " TO " + std::to_string(year_current) + "]";
+        std::vector<std::string> serial_control_numbers;
+        for (size_t i(first); i < last; ++i) {
+            serial_control_numbers.emplace_back(serial_control_numbers_and_last_modification_times[i].first);
+            batches[batch_no].emplace(serial_control_numbers_and_last_modification_times[i].first);
+        }
+        filter_queries[batch_no] = "{!terms f=superior_ppn}" + StringUtil::Join(serial_control_numbers, ',');
+    }
 
-    return ExtractNewIssueInfos(notified_db, new_notification_ids, json_result, new_issue_infos, max_last_modification_time);
+    std::vector<std::string> error_messages(batch_count);
+    std::vector<std::unordered_map<std::string, std::vector<NewIssueInfo>>> batch_issue_infos(batch_count);
+    std::unique_ptr<bool[]> successes(new bool[batch_count]); // Not a std::vector<bool> because our threads write concurrently.
+    const size_t thread_count(std::min(batch_count, static_cast<size_t>(MAX_CONCURRENT_QUERIES)));
+    std::vector<std::thread> threads;
+    for (size_t thread_no(0); thread_no < thread_count; ++thread_no)
+        threads.emplace_back([&, thread_no]() {
+            // One client per thread so that all of the thread's queries share a connection:
+            Solr::Client solr_client(solr_host_and_port, /* timeout = */20);
+            for (size_t batch_no(thread_no); batch_no < batch_count; batch_no += thread_count)
+                successes[batch_no] = solr_client.queryAll(
+                    queries[batch_no], "id,title,author,last_modification_time,container_ids_and_titles,superior_ppn",
+                    [&, batch_no](const std::shared_ptr<const JSON::ObjectNode> &doc_obj) {
+                        ExtractIssueInfo(doc_obj, batches[batch_no], &batch_issue_infos[batch_no]);
+                        return true;
+                    },
+                    &error_messages[batch_no], filter_queries[batch_no]);
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t batch_no(0); batch_no < batch_count; ++batch_no) {
+        if (unlikely(not successes[batch_no]))
+            LOG_ERROR("Solr query failed or timed-out: \"" + queries[batch_no] + "\" w/ filter query \"" + filter_queries[batch_no]
+                      + "\". (" + error_messages[batch_no] + ")");
+        for (auto &serial_control_number_and_issue_infos : batch_issue_infos[batch_no]) {
+            auto &issue_infos((*serial_control_numbers_to_issue_infos)[serial_control_number_and_issue_infos.first]);
+            issue_infos.insert(issue_infos.end(), serial_control_number_and_issue_infos.second.cbegin(),
+                               serial_control_number_and_issue_infos.second.cend());
+        }
+    }
 }
 
 
-void SendNotificationEmail(const bool debug, const std::string &firstname, const std::string &lastname, const std::string &recipient_email,
-                           const std::string &vufind_host, const std::string &sender_email, const std::string &email_subject,
-                           const std::vector<NewIssueInfo> &new_issue_infos, const std::string &user_type)
+// \return The ID's of those issues in "serial_control_numbers_to_issue_infos" for which we already sent notifications.
+std::unordered_set<std::string> GetNotifiedIds(
+    const std::unique_ptr<KeyValueStore> &notified_db,
+    const std::unordered_map<std::string, std::vector<NewIssueInfo>> &serial_control_numbers_to_issue_infos)
 {
-    std::string email_template = GetEmailTemplate(user_type);
+    // A single read transaction for all lookups:
+    const KeyValueStore::ReadTransaction transaction(*notified_db);
+    std::unordered_set<std::string> notified_ids;
+    for (const auto &serial_control_number_and_issue_infos : serial_control_numbers_to_issue_infos) {
+        for (const auto &issue_info : serial_control_number_and_issue_infos.second) {
+            if (transaction.contains(issue_info.control_number_))
+                notified_ids.emplace(issue_info.control_number_);
+        }
+    }
+
+    return notified_ids;
+}
 
+
+void SendNotificationEmail(const bool debug, EmailSender::Batch * const email_batch, const std::string &firstname,
+                           const std::string &lastname, const std::string &recipient_email, const std::string &vufind_host,
+                           const std::string &sender_email, const std::string &email_subject,
+                           const std::vector<NewIssueInfo> &new_issue_infos, const std::string &user_type)
+{
     // Process the email template:
     Template::Map names_to_values_map;
     names_to_values_map.insertScalar("firstname", firstname);
@@ -283,14 +349,18 @@ void SendNotificationEmail(const bool debug, const std::string &firstname, const
     names_to_values_map.insertArray("series_title", series_titles);
     names_to_values_map.insertArray("issue_title", issue_titles);
     names_to_values_map.insertArray("authors", authors);
-    std::istringstream input(email_template);
-    std::ostringstream email_contents;
-    Template::ExpandTemplate(input, email_contents, names_to_values_map);
+    std::string email_contents;
+    const std::string email_template_path(UBTools::GetTuelibPath() + "subscriptions_email." + user_type + ".template");
+    try {
+        Template::CompiledTemplate::Load(email_template_path)->expand(names_to_values_map, &email_contents);
+    } catch (const std::exception &x) {
+        LOG_ERROR("can't expand email template \"" + email_template_path + "\"! (" + std::string(x.what()) + ")");
+    }
 
     if (debug)
-        std::cerr << "Debug mode, email address is " << sender_email << ", template expanded to:\n" << email_contents.str() << '\n';
+        std::cerr << "Debug mode, email address is " << sender_email << ", template expanded to:\n" << email_contents << '\n';
     else {
-        const unsigned short response_code(EmailSender::SendEmail(sender_email, recipient_email, email_subject, email_contents.str(),
+        const unsigned short response_code(email_batch->sendEmail(sender_email, recipient_email, email_subject, email_contents,
                                                                   EmailSender::DO_NOT_SET_PRIORITY, EmailSender::HTML));
 
         if (response_code >= 300) {
@@ -322,9 +392,10 @@ void LoadBundleControlNumbers(const IniFile &bundles_config, const std::string &
 
 
 void ProcessSingleUser(
-    const bool debug, DbConnection * const db_connection, const std::unique_ptr<kyotocabinet::HashDB> &notified_db,
-    const IniFile &bundles_config, std::unordered_set<std::string> * const new_notification_ids,
-    const std::string &user_id, const std::string &solr_host_and_port, const std::string &hostname,
+    const bool debug, EmailSender::Batch * const email_batch, DbConnection * const db_connection, const IniFile &bundles_config,
+    const std::unordered_map<std::string, std::vector<NewIssueInfo>> &serial_control_numbers_to_issue_infos,
+    const std::unordered_set<std::string> &notified_ids, std::unordered_set<std::string> * const new_notification_ids,
+    const std::string &user_id, const std::string &hostname,
     const std::string &sender_email, const std::string &email_subject,
     std::vector<SerialControlNumberAndMaxLastModificationTime> &control_numbers_or_bundle_names_and_last_modification_times)
 {
@@ -350,23 +421,18 @@ void ProcessSingleUser(
     // Collect the dates for new issues.
     std::vector<NewIssueInfo> new_issue_infos;
     for (auto &control_number_or_bundle_name_and_last_modification_time : control_numbers_or_bundle_names_and_last_modification_times) {
-        std::string max_last_modification_time(control_number_or_bundle_name_and_last_modification_time.last_modification_time_);
-        if (StringUtil::StartsWith(control_number_or_bundle_name_and_last_modification_time.serial_control_number_, "bundle:")) {
-            const std::string bundle_name(
-                control_number_or_bundle_name_and_last_modification_time.serial_control_number_);
-            std::vector<std::string> bundle_control_numbers;
-            LoadBundleControlNumbers(bundles_config, bundle_name, &bundle_control_numbers);
-            for (const auto &bundle_control_number : bundle_control_numbers) {
-                if (GetNewIssues(notified_db, new_notification_ids, solr_host_and_port, bundle_control_number,
-                                 control_number_or_bundle_name_and_last_modification_time.last_modification_time_, &new_issue_infos,
-                                 &max_last_modification_time))
-                    control_number_or_bundle_name_and_last_modification_time.setMaxLastModificationTime(max_last_modification_time);
-            }
-        } else {
-            if (GetNewIssues(notified_db, new_notification_ids, solr_host_and_port,
-                             control_number_or_bundle_name_and_last_modification_time.serial_control_number_,
-                             control_number_or_bundle_name_and_last_modification_time.last_modification_time_, &new_issue_infos,
-                             &max_last_modification_time))
+        const std::string last_modification_time(control_number_or_bundle_name_and_last_modification_time.last_modification_time_);
+        std::string max_last_modification_time(last_modification_time);
+        std::vector<std::string> serial_control_numbers;
+        if (StringUtil::StartsWith(control_number_or_bundle_name_and_last_modification_time.serial_control_number_, "bundle:"))
+            LoadBundleControlNumbers(bundles_config, control_number_or_bundle_name_and_last_modification_time.serial_control_number_,
+                                     &serial_control_numbers);
+        else
+            serial_control_numbers.emplace_back(control_number_or_bundle_name_and_last_modification_time.serial_control_number_);
+
+        for (const auto &serial_control_number : serial_control_numbers) {
+            if (ExtractNewIssueInfos(serial_control_numbers_to_issue_infos, notified_ids, new_notification_ids, serial_control_number,
+                                     last_modification_time, &new_issue_infos, &max_last_modification_time))
                 control_number_or_bundle_name_and_last_modification_time.setMaxLastModificationTime(max_last_modification_time);
         }
     }
@@ -374,7 +440,7 @@ void ProcessSingleUser(
     LOG_INFO("Found " + std::to_string(new_issue_infos.size()) + " new issues for " + "\"" + username + "\".");
 
     if (not new_issue_infos.empty())
-        SendNotificationEmail(debug, firstname, lastname, email, hostname, sender_email, email_subject, new_issue_infos, user_type);
+        SendNotificationEmail(debug, email_batch, firstname, lastname, email, hostname, sender_email, email_subject, new_issue_infos, user_type);
 
     // Update the database with the new last issue dates
     // skip in DEBUG mode
@@ -395,7 +461,7 @@ void ProcessSingleUser(
 }
 
 
-void ProcessSubscriptions(const bool debug, DbConnection * const db_connection, const std::unique_ptr<kyotocabinet::HashDB> &notified_db,
+void ProcessSubscriptions(const bool debug, DbConnection * const db_connection, const std::unique_ptr<KeyValueStore> &notified_db,
                           const IniFile &bundles_config, std::unordered_set<std::string> * const new_notification_ids,
                           const std::string &solr_host_and_port, const std::string &user_type, const std::string &hostname,
                           const std::string &sender_email, const std::string &email_subject)
@@ -406,6 +472,7 @@ void ProcessSubscriptions(const bool debug, DbConnection * const db_connection,
     unsigned subscription_count(0);
     DbResultSet id_result_set(db_connection->getLastResultSet());
     const unsigned user_count(id_result_set.size());
+    std::vector<std::pair<std::string, std::vector<SerialControlNumberAndMaxLastModificationTime>>> user_ids_and_subscriptions;
     while (const DbRow id_row = id_result_set.getNextRow()) {
         const std::string user_id(id_row["user_id"]);
 
@@ -418,33 +485,61 @@ void ProcessSubscriptions(const bool debug, DbConnection * const db_connection,
                 row["journal_control_number_or_bundle_name"], ConvertDateToZuluDate(row["max_last_modification_time"])));
             ++subscription_count;
         }
-        ProcessSingleUser(debug, db_connection, notified_db, bundles_config, new_notification_ids, user_id, solr_host_and_port,
-                          hostname, sender_email, email_subject, control_numbers_or_bundle_names_and_last_modification_times);
+        user_ids_and_subscriptions.emplace_back(user_id, control_numbers_or_bundle_names_and_last_modification_times);
+    }
+
+    // Each serial only needs to be queried once, for the oldest last modification time of any of its subscribers:
+    std::unordered_map<std::string, std::string> serial_control_numbers_to_last_modification_times;
+    for (const auto &user_id_and_subscriptions : user_ids_and_subscriptions) {
+        for (const auto &subscription : user_id_and_subscriptions.second) {
+            std::vector<std::string> serial_control_numbers;
+            if (StringUtil::StartsWith(subscription.serial_control_number_, "bundle:"))
+                LoadBundleControlNumbers(bundles_config, subscription.serial_control_number_, &serial_control_numbers);
+            else
+                serial_control_numbers.emplace_back(subscription.serial_control_number_);
+
+            for (const auto &serial_control_number : serial_control_numbers) {
+                const auto serial_control_number_and_last_modification_time(
+                    serial_control_numbers_to_last_modification_times.find(serial_control_number));
+                if (serial_control_number_and_last_modification_time == serial_control_numbers_to_last_modification_times.end())
+                    serial_control_numbers_to_last_modification_times.emplace(serial_control_number, subscription.last_modification_time_);
+                else if (subscription.last_modification_time_ < serial_control_number_and_last_modification_time->second)
+                    serial_control_number_and_last_modification_time->second = subscription.last_modification_time_;
+            }
+        }
     }
 
+    std::unordered_map<std::string, std::vector<NewIssueInfo>> serial_control_numbers_to_issue_infos;
+    GetIssues(solr_host_and_port, serial_control_numbers_to_last_modification_times, &serial_control_numbers_to_issue_infos);
+    const std::unordered_set<std::string> notified_ids(GetNotifiedIds(notified_db, serial_control_numbers_to_issue_infos));
+
+    EmailSender::Batch email_batch;
+    for (auto &user_id_and_subscriptions : user_ids_and_subscriptions)
+        ProcessSingleUser(debug, &email_batch, db_connection, bundles_config, serial_control_numbers_to_issue_infos, notified_ids,
+                          new_notification_ids, user_id_and_subscriptions.first, hostname, sender_email, email_subject,
+                          user_id_and_subscriptions.second);
+
     LOG_INFO("Processed " + std::to_string(user_count) + " users and " + std::to_string(subscription_count) + " subscriptions.\n");
 }
 
 
-void RecordNewlyNotifiedIds(const std::unique_ptr<kyotocabinet::HashDB> &notified_db,
+void RecordNewlyNotifiedIds(const std::unique_ptr<KeyValueStore> &notified_db,
                             const std::unordered_set<std::string> &new_notification_ids)
 {
     const std::string now(TimeUtil::GetCurrentDateAndTime());
+    KeyValueStore::WriteTransaction transaction(notified_db.get());
     for (const auto &id : new_notification_ids) {
-        if (not notified_db->add(id, now))
-            LOG_ERROR("Failed to add key/value pair to database \"" + notified_db->path() + "\" ("
-                      + std::string(notified_db->error().message()) + ")!");
+        if (not transaction.add(id, now))
+            LOG_ERROR("ID \"" + id + "\" is already in \"" + notified_db->getPath() + "\"!");
     }
+    transaction.commit();
 }
 
 
-std::unique_ptr<kyotocabinet::HashDB> CreateOrOpenKeyValueDB(const std::string &user_type) {
-    const std::string DB_FILENAME(UBTools::GetTuelibPath() + user_type + "_notified.db");
-    std::unique_ptr<kyotocabinet::HashDB> db(new kyotocabinet::HashDB());
-    if (not (db->open(DB_FILENAME,
-                      kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OREADER | kyotocabinet::HashDB::OCREATE)))
-        LOG_ERROR("failed to open or create \"" + DB_FILENAME + "\"!");
-    return db;
+std::unique_ptr<KeyValueStore> CreateOrOpenKeyValueDB(const std::string &user_type) {
+    const std::string DB_FILENAME(UBTools::GetTuelibPath() + user_type + "_notified.lmdb");
+    KeyValueStore::MigrateFromKyotoCabinetDB(UBTools::GetTuelibPath() + user_type + "_notified.db", DB_FILENAME);
+    return std::unique_ptr<KeyValueStore>(new KeyValueStore(DB_FILENAME, KeyValueStore::CREATE));
 }
 
 
@@ -452,7 +547,7 @@ std::unique_ptr<kyotocabinet::HashDB> CreateOrOpenKeyValueDB(const std::string &
 
 
 // gets user subscriptions for superior works from mysql
-// uses kyotocabinet HashDB (file) to prevent entries from being sent multiple times to same user
+// uses a KeyValueStore (file) to prevent entries from being sent multiple times to same user
 int Main(int argc, char **argv) {
     if (argc < 5)
         Usage();
@@ -482,7 +577,7 @@ int Main(int argc, char **argv) {
     const std::string sender_email(argv[3]);
     const std::string email_subject(argv[4]);
 
-    std::unique_ptr<kyotocabinet::HashDB> notified_db(CreateOrOpenKeyValueDB(user_type));
+    std::unique_ptr<KeyValueStore> notified_db(CreateOrOpenKeyValueDB(user_type));
 
     std::shared_ptr<DbConnection> db_connection(VuFind::GetDbConnection());
 
@@ -23,22 +23,34 @@ A typical config file for this program looks like this:
 user     = "root"
 passwd   = "???"
 database = "vufind"
+
+The following entries are optional.  Notification emails are only sent if "email_template" has been specified:
+
+thread_count   = 8
+sender_email   = "notifications@ixtheo.de"
+email_subject  = "New search results"
+email_template = "/usr/local/var/lib/tuelib/notify_users_email.template"
 */
 
 #include <algorithm>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <cstdlib>
 #include <cstdint>
+#include "Compiler.h"
 #include "DbConnection.h"
 #include "DbResultSet.h"
 #include "DbRow.h"
 #include "Downloader.h"
+#include "EmailSender.h"
 #include "GzStream.h"
 #include "IniFile.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
+#include "Template.h"
+#include "ThreadPool.h"
 #include "UrlUtil.h"
 #include "XMLParser.h"
 #include "util.h"
@@ -91,7 +103,8 @@ bool ExtractQueryParams(const std::string &php_query_array,
         return false;
     }
 
-    static RegexMatcher * const param_name_matcher(RegexMatcher::RegexMatcherFactory("\\[([[:lower:]]+)\\]"));
+    // Not static because we get called concurrently and matchers store their captures:
+    const std::unique_ptr<RegexMatcher> param_name_matcher(RegexMatcher::RegexMatcherFactory("\\[([[:lower:]]+)\\]"));
     ParseState parse_state(ParseState::ARRAY_EXPECTED);
     std::string last_parem_name;
     for (std::string line : lines) {
@@ -297,83 +310,171 @@ void DeserialiseIds(const std::string &serialized_ids, std::vector<std::string>
         colon_pos = decompressed_string.find(':', id_start_pos);
     }
 
-    deserialised_ids->emplace_back(decompressed_string.c_str() + colon_pos + 1);
+    deserialised_ids->emplace_back(decompressed_string.substr(id_start_pos));
 }
 
 
-void InsertIdsIntoTheIxtheoIdResultSetsTable(const std::string &query_id, const std::vector<std::string> &ids,
-                                             DbConnection * const connection)
-{
-    std::string serialized_ids;
-    SerialiseIds(ids, &serialized_ids);
-    connection->queryOrDie("REPLACE INTO ixtheo_id_result_sets (id,ids) VALUES(" + query_id + ",\""
-                           + connection->escapeString(serialized_ids) + "\")");
-}
+struct SavedSearch {
+    std::string query_id_, user_id_, email_address_, search_object_;
+    bool has_old_ids_;
+    std::string old_serialised_ids_;
 
+    // Set by ProcessSearch():
+    bool failed_;
+    std::string new_serialised_ids_; // Empty if the stored result set doesn't have to be replaced.
+    std::vector<std::string> additional_ids_;
+};
 
-/** \return true = we need to notify the user that something has changed that they would like to know about */
-bool ProcessUser(const std::string &user_id, const std::string &/*email_address*/, DbConnection * const connection) {
-    connection->queryOrDie("SELECT id,search_object FROM search WHERE user_id=" + user_id);
 
+// Fetches all searches, their users' email addresses and the result sets of the last run w/ a single query, ordered
+// by user so that the searches of a user are adjacent.
+void LoadSavedSearches(DbConnection * const connection, std::vector<SavedSearch> * const saved_searches) {
+    connection->queryOrDie("SELECT search.id,search.user_id,user.email,search.search_object,ixtheo_id_result_sets.ids FROM search "
+                           "JOIN user ON user.id=search.user_id LEFT JOIN ixtheo_id_result_sets ON ixtheo_id_result_sets.id=search.id "
+                           "ORDER BY search.user_id,search.id");
+    DbResultSet result_set(connection->getLastResultSet(DbConnection::RSM_STREAM));
+    while (const DbRow row = result_set.getNextRow()) {
+        SavedSearch saved_search;
+        saved_search.query_id_           = row[0];
+        saved_search.user_id_            = row[1];
+        saved_search.email_address_      = row[2];
+        saved_search.search_object_      = row[3];
+        saved_search.has_old_ids_        = not row.isNull(4);
+        saved_search.old_serialised_ids_ = row[4];
+        saved_search.failed_             = false;
+        saved_searches->emplace_back(std::move(saved_search));
+    }
+}
+
+
+// Runs the query of "saved_search" and compares the result w/ the one from the last run.  Safe to be called concurrently.
+void ProcessSearch(SavedSearch * const saved_search) {
     constexpr unsigned SOLR_QUERY_TIMEOUT(20000); // ms
-    DbResultSet search_object_result_set(connection->getLastResultSet());
-    while (const DbRow row = search_object_result_set.getNextRow()) {
-        const std::string query_id(row[0]);
-        const std::string serialised_search_object(row[1]);
-
-        std::map<std::string, std::string> params_to_values_map;
-        GetQueryParams(serialised_search_object, &params_to_values_map);
-        const std::string solr_query_url(GenerateSolrQuery(params_to_values_map));
-
-        std::string xml_document;
-        if (Download(solr_query_url, SOLR_QUERY_TIMEOUT, &xml_document) != 0) {
-            logger->warning("SOLR query failed! (" + solr_query_url + ")");
-            return false;
-        }
 
-        IdExtractor id_extractor;
-        try {
-            id_extractor.parse(xml_document);
-        } catch (std::runtime_error &exc) {
-            logger->warning("Failed to parse XML document! (" + std::string(exc.what()) + ")");
-            return false;
-        }
+    std::map<std::string, std::string> params_to_values_map;
+    try {
+        GetQueryParams(saved_search->search_object_, &params_to_values_map);
+    } catch (const std::runtime_error &exc) {
+        LOG_WARNING("failed to get the query parameters for search " + saved_search->query_id_ + "! (" + exc.what() + ")");
+        saved_search->failed_ = true;
+        return;
+    }
+    const std::string solr_query_url(GenerateSolrQuery(params_to_values_map));
 
-        std::vector<std::string> ids;
-        id_extractor.getExtractedIds(&ids);
-        std::sort(ids.begin(), ids.end());
-
-        connection->queryOrDie("SELECT ids FROM ixtheo_id_result_sets WHERE id=" + query_id);
-        DbResultSet ids_result_set(connection->getLastResultSet());
-
-        if (ids_result_set.empty()) // We have nothing to compare against this time.
-            InsertIdsIntoTheIxtheoIdResultSetsTable(query_id, ids, connection);
-        else { // We need to compare against the previously stored list of ID's.
-            const DbRow serialised_ids_row(ids_result_set.getNextRow());
-            const std::string serialised_ids(serialised_ids_row[0]);
-            std::vector<std::string> old_ids;
-            DeserialiseIds(serialised_ids, &old_ids);
-
-            std::vector<std::string> additional_ids;
-            FindNewIds(old_ids, ids, &additional_ids);
-            if (not additional_ids.empty()) {
-                InsertIdsIntoTheIxtheoIdResultSetsTable(query_id, ids, connection);
-            }
+    std::string xml_document;
+    if (not Download(solr_query_url, SOLR_QUERY_TIMEOUT, &xml_document)) {
+        LOG_WARNING("SOLR query failed! (" + solr_query_url + ")");
+        saved_search->failed_ = true;
+        return;
+    }
+
+    IdExtractor id_extractor;
+    try {
+        id_extractor.parse(xml_document);
+    } catch (const std::runtime_error &exc) {
+        LOG_WARNING("Failed to parse XML document! (" + std::string(exc.what()) + ")");
+        saved_search->failed_ = true;
+        return;
+    }
+
+    std::vector<std::string> ids;
+    id_extractor.getExtractedIds(&ids);
+    std::sort(ids.begin(), ids.end());
+
+    if (not saved_search->has_old_ids_) { // We have nothing to compare against this time.
+        SerialiseIds(ids, &saved_search->new_serialised_ids_);
+        return;
+    }
+
+    // We need to compare against the previously stored list of ID's.
+    std::vector<std::string> old_ids;
+    DeserialiseIds(saved_search->old_serialised_ids_, &old_ids);
+    FindNewIds(old_ids, ids, &saved_search->additional_ids_);
+    if (not saved_search->additional_ids_.empty())
+        SerialiseIds(ids, &saved_search->new_serialised_ids_);
+}
+
+
+void StoreNewResultSets(DbConnection * const connection, const std::vector<SavedSearch> &saved_searches) {
+    const size_t MAX_BATCH_SIZE(100);
+
+    std::string values;
+    size_t batch_size(0), stored_count(0);
+    for (const auto &saved_search : saved_searches) {
+        if (saved_search.new_serialised_ids_.empty())
+            continue;
+
+        if (not values.empty())
+            values += ',';
+        values += "(" + saved_search.query_id_ + "," + connection->escapeAndQuoteString(saved_search.new_serialised_ids_) + ")";
+        ++stored_count;
+        if (++batch_size == MAX_BATCH_SIZE) {
+            connection->queryOrDie("REPLACE INTO ixtheo_id_result_sets (id,ids) VALUES " + values);
+            values.clear();
+            batch_size = 0;
         }
     }
+    if (not values.empty())
+        connection->queryOrDie("REPLACE INTO ixtheo_id_result_sets (id,ids) VALUES " + values);
 
-    return true;
+    LOG_INFO("stored " + std::to_string(stored_count) + " new result set(s).");
 }
 
 
-struct UserIdAndEmail {
-    const std::string user_id_;
-    const std::string email_;
-public:
-    UserIdAndEmail(const std::string &user_id, const std::string &email): user_id_(user_id), email_(email) { }
+struct Notification {
+    std::string email_address_, message_body_;
 };
 
 
+// Renders the notification for the searches in [first_search, last_search), which all belong to the same user.
+void RenderNotification(const Template::CompiledTemplate &email_template, const std::vector<SavedSearch>::const_iterator first_search,
+                        const std::vector<SavedSearch>::const_iterator last_search, Notification * const notification)
+{
+    std::vector<std::string> query_ids, new_record_counts;
+    std::vector<std::shared_ptr<Template::Value>> new_record_ids;
+    for (auto saved_search(first_search); saved_search != last_search; ++saved_search) {
+        if (saved_search->additional_ids_.empty())
+            continue;
+        query_ids.emplace_back(saved_search->query_id_);
+        new_record_counts.emplace_back(std::to_string(saved_search->additional_ids_.size()));
+        new_record_ids.emplace_back(new Template::ArrayValue("new_record_ids", saved_search->additional_ids_));
+    }
+    if (query_ids.empty())
+        return;
+
+    Template::Map names_to_values_map;
+    names_to_values_map.insertScalar("user_id", first_search->user_id_);
+    names_to_values_map.insertArray("query_id", query_ids);
+    names_to_values_map.insertArray("new_record_count", new_record_counts);
+    names_to_values_map.insertArray("new_record_ids", new_record_ids);
+
+    notification->email_address_ = first_search->email_address_;
+    email_template.expand(names_to_values_map, &notification->message_body_);
+}
+
+
+void SendNotifications(const std::vector<Notification> &notifications, const std::string &sender_email,
+                       const std::string &email_subject)
+{
+    EmailSender::Batch email_batch;
+    unsigned sent_count(0);
+    for (const auto &notification : notifications) {
+        if (notification.email_address_.empty())
+            continue;
+
+        const unsigned short response_code(email_batch.sendEmail(sender_email, notification.email_address_, email_subject,
+                                                                 notification.message_body_));
+        if (response_code >= 300)
+            LOG_WARNING("failed to send a notification email to \"" + notification.email_address_ + "\"! (response code was: "
+                        + std::to_string(response_code) + ")");
+        else
+            ++sent_count;
+    }
+
+    LOG_INFO("sent " + std::to_string(sent_count) + " notification email(s).");
+}
+
+
 } // unnamed namespace
 
 
@@ -388,16 +489,49 @@ int Main(int argc, char *argv[]) {
     const std::string passwd(ini_file.getString("", "passwd"));
     const std::string db(ini_file.getString("", "database"));
 
+    const unsigned thread_count(ini_file.getUnsigned("", "thread_count", 8));
+    const std::string email_template_path(ini_file.getString("", "email_template", ""));
+
     DbConnection connection(db, user, passwd);
-    connection.queryOrDie("SELECT id,email FROM user");
-    DbResultSet result_set(connection.getLastResultSet());
-    DbRow row;
-    while ((row = result_set.getNextRow())) {
-        const std::string id(row[0]);
-        const std::string email_address(row[1]);
-        if (not ProcessUser(id, email_address, &connection))
-            logger->error("Failed to process user w/ ID: " + id);
+    std::vector<SavedSearch> saved_searches;
+    LoadSavedSearches(&connection, &saved_searches);
+
+    // Most of the time is spent waiting for VuFind and SOLR, hence the thread pool:
+    ThreadPool thread_pool(thread_count);
+    thread_pool.parallelFor(0, saved_searches.size(), [&saved_searches](const size_t search_index) {
+        ProcessSearch(&saved_searches[search_index]);
+    }, /* chunk_size = */1);
+
+    StoreNewResultSets(&connection, saved_searches);
+
+    // The searches of a user are adjacent, see LoadSavedSearches():
+    std::vector<std::pair<size_t, size_t>> user_search_ranges;
+    std::vector<std::string> failed_user_ids;
+    for (size_t range_start(0), range_end; range_start < saved_searches.size(); range_start = range_end) {
+        range_end = range_start + 1;
+        while (range_end < saved_searches.size() and saved_searches[range_end].user_id_ == saved_searches[range_start].user_id_)
+            ++range_end;
+        user_search_ranges.emplace_back(range_start, range_end);
+        if (std::any_of(saved_searches.cbegin() + range_start, saved_searches.cbegin() + range_end,
+                        [](const SavedSearch &saved_search) { return saved_search.failed_; }))
+            failed_user_ids.emplace_back(saved_searches[range_start].user_id_);
     }
 
+    if (not email_template_path.empty()) {
+        const auto email_template(Template::CompiledTemplate::Load(email_template_path));
+        std::vector<Notification> notifications(user_search_ranges.size());
+        thread_pool.parallelFor(0, user_search_ranges.size(), [&](const size_t user_index) {
+            RenderNotification(*email_template, saved_searches.cbegin() + user_search_ranges[user_index].first,
+                               saved_searches.cbegin() + user_search_ranges[user_index].second, &notifications[user_index]);
+        });
+        SendNotifications(notifications, ini_file.getString("", "sender_email"),
+                          ini_file.getString("", "email_subject", "New search results"));
+    }
+
+    LOG_INFO("processed " + std::to_string(saved_searches.size()) + " search(es) of " + std::to_string(user_search_ranges.size())
+             + " user(s).");
+    if (not failed_user_ids.empty())
+        LOG_ERROR("Failed to process user(s) w/ ID(s): " + StringUtil::Join(failed_user_ids, ", "));
+
     return EXIT_SUCCESS;
 }
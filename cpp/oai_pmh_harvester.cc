@@ -17,6 +17,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <thread>
 #include <cctype>
 #include <kchashdb.h>
 #include "Compiler.h"
@@ -24,7 +25,9 @@
 #include "FileUtil.h"
 #include "HttpHeader.h"
 #include "MARC.h"
+#include "OaiPmh.h"
 #include "StringUtil.h"
+#include "ThreadUtil.h"
 #include "UrlUtil.h"
 #include "XMLParser.h"
 #include "UBTools.h"
@@ -48,36 +51,6 @@ namespace {
 }
 
 
-std::string ExtractResumptionToken(const std::string &xml_document, std::string * const cursor,
-                                   std::string * const complete_list_size)
-{
-    cursor->clear();
-    complete_list_size->clear();
-
-    XMLParser xml_parser(xml_document, XMLParser::XML_STRING);
-    if (not xml_parser.skipTo(XMLParser::XMLPart::OPENING_TAG, "resumptionToken"))
-        return "";
-
-    XMLParser::XMLPart xml_part;
-    if (not xml_parser.getNext(&xml_part) or xml_part.type_ == XMLParser::XMLPart::CLOSING_TAG)
-        return "";
-    if (xml_part.type_ != XMLParser::XMLPart::CHARACTERS)
-        LOG_ERROR("strange resumption token XML structure!");
-
-    // Extract the "cursor" attribute:
-    auto name_and_value(xml_part.attributes_.find("cursor"));
-    if (name_and_value != xml_part.attributes_.end())
-        *cursor = name_and_value->second;
-
-    // Extract the "completeListSize" attribute:
-    name_and_value = xml_part.attributes_.find("completeListSize");
-    if (name_and_value != xml_part.attributes_.end())
-        *complete_list_size = name_and_value->second;
-
-    return xml_part.data_;
-}
-
-
 // Helper for ExtractEncapsulatedRecordData.  Removes the trailing whitespace and </metadata>.
 bool StripOffTrailingGarbage(std::string * const extracted_records) {
     // 1. back skip over the "</metadata>":
@@ -114,43 +87,84 @@ unsigned ExtractEncapsulatedRecordData(XMLParser * const xml_parser, std::string
 }
 
 
-bool ListRecords(const std::string &url, const unsigned time_limit_in_seconds_per_request, const bool ignore_ssl_certificates,
-                 File * const output, std::string * const resumption_token, std::string * const cursor,
-                 std::string * const complete_list_size, unsigned * total_record_count)
+std::string MakeRequestURL(const std::string &base_url, const std::string &metadata_prefix, const std::string &harvest_set,
+                           const std::string &resumption_token)
+{
+    std::string request_url;
+    if (not resumption_token.empty())
+        request_url = base_url + "?verb=ListRecords&resumptionToken=" + UrlUtil::UrlEncode(resumption_token);
+    else if (harvest_set.empty())
+        request_url = base_url + "?verb=ListRecords&metadataPrefix=" + metadata_prefix;
+    else
+        request_url = base_url + "?verb=ListRecords&metadataPrefix=" + metadata_prefix + "&set=" + harvest_set;
+    LOG_INFO("Request URL = " + request_url);
+
+    return request_url;
+}
+
+
+struct ListRecordsPage {
+    std::string request_url_;
+    std::string message_body_;
+    std::string resumption_token_, cursor_, complete_list_size_; // For the next page.
+};
+
+
+// Downloads one page after the other into "page_queue" while our caller converts the earlier pages.  Only the
+// resumption token is extracted before we request the next page.
+void DownloadPages(const std::string &base_url, const std::string &metadata_prefix, const std::string &harvest_set,
+                   const unsigned time_limit_in_seconds_per_request, const bool ignore_ssl_certificates,
+                   ThreadUtil::BoundedQueue<ListRecordsPage> * const page_queue)
 {
-    const TimeLimit time_limit(time_limit_in_seconds_per_request * 1000);
-    Downloader::Params params(Downloader::DEFAULT_USER_AGENT_STRING,
-                              Downloader::DEFAULT_ACCEPTABLE_LANGUAGES,
-                              Downloader::DEFAULT_MAX_REDIRECTS,
-                              Downloader::DEFAULT_DNS_CACHE_TIMEOUT,
-                              false, /*honour_robots_dot_txt*/
-                              Downloader::TRANSPARENT,
-                              PerlCompatRegExps(),
-                              false, /*debugging*/
-                              true,/*follow_redirects*/
-                              Downloader::DEFAULT_META_REDIRECT_THRESHOLD,
-                              ignore_ssl_certificates, /*ignore SSL certificates*/
-                              "", /*proxy_host_and_port*/
-                              {}, /*additional headers*/
-                              "" /*post_data*/);
-    Downloader downloader(url, params, time_limit);
-    if (downloader.anErrorOccurred())
-        LOG_ERROR("harvest failed: " + downloader.getLastErrorMessage());
-
-    const HttpHeader http_header(downloader.getMessageHeader());
-    const unsigned status_code(http_header.getStatusCode());
-    if (status_code < 200 or status_code > 299)
-        LOG_ERROR("server returned a status code of " + std::to_string(status_code) + "!");
-
-    const std::string message_body(downloader.getMessageBody());
+    const Downloader::Params params(Downloader::DEFAULT_USER_AGENT_STRING,
+                                    Downloader::DEFAULT_ACCEPTABLE_LANGUAGES,
+                                    Downloader::DEFAULT_MAX_REDIRECTS,
+                                    Downloader::DEFAULT_DNS_CACHE_TIMEOUT,
+                                    false, /*honour_robots_dot_txt*/
+                                    Downloader::TRANSPARENT,
+                                    RegexSet(),
+                                    false, /*debugging*/
+                                    true,/*follow_redirects*/
+                                    Downloader::DEFAULT_META_REDIRECT_THRESHOLD,
+                                    ignore_ssl_certificates, /*ignore SSL certificates*/
+                                    "", /*proxy_host_and_port*/
+                                    {}, /*additional headers*/
+                                    "" /*post_data*/);
+    Downloader downloader(params);
+
+    std::string resumption_token;
+    do {
+        ListRecordsPage page;
+        page.request_url_ = MakeRequestURL(base_url, metadata_prefix, harvest_set, resumption_token);
+        if (not downloader.newUrl(page.request_url_, time_limit_in_seconds_per_request * 1000))
+            LOG_ERROR("harvest failed: " + downloader.getLastErrorMessage());
+
+        const HttpHeader http_header(downloader.getMessageHeader());
+        const unsigned status_code(http_header.getStatusCode());
+        if (status_code < 200 or status_code > 299)
+            LOG_ERROR("server returned a status code of " + std::to_string(status_code) + "!");
+
+        page.message_body_ = downloader.getMessageBody();
+        page.resumption_token_ = OaiPmh::ExtractResumptionToken(page.message_body_, &page.cursor_, &page.complete_list_size_);
+        resumption_token = page.resumption_token_;
+        if (not page_queue->push(std::move(page)))
+            break; // Our consumer is not interested in any more pages.
+    } while (not resumption_token.empty());
+
+    page_queue->close();
+}
+
+
+// \return False if "page" contained no records, o/w true.
+bool ProcessPage(const ListRecordsPage &page, File * const output, unsigned * const total_record_count) {
     std::string extracted_records;
-    XMLParser xml_parser(message_body, XMLParser::XML_STRING);
+    XMLParser xml_parser(page.message_body_, XMLParser::XML_STRING);
     const unsigned record_count(ExtractEncapsulatedRecordData(&xml_parser, &extracted_records));
     if (record_count == 0) {
         xml_parser.rewind();
         XMLParser::XMLPart xml_part;
         if (not xml_parser.skipTo(XMLParser::XMLPart::OPENING_TAG, "error", &xml_part))
-            return 0;
+            return false;
         const auto key_and_value(xml_part.attributes_.find("code"));
         std::string error_msg;
         if (key_and_value != xml_part.attributes_.cend())
@@ -158,31 +172,14 @@ bool ListRecords(const std::string &url, const unsigned time_limit_in_seconds_pe
 
         if (xml_parser.getNext(&xml_part) and xml_part.type_ == XMLParser::XMLPart::CHARACTERS)
             error_msg += xml_part.data_;
-        LOG_ERROR("OAI-PMH server returned an error: " + error_msg + " (We sent \"" + url + "\")");
-    } else { // record_count > 0
-        *total_record_count += record_count;
-        if (not output->write(extracted_records))
-            LOG_ERROR("failed to write to \"" + output->getPath() + "\"! (Disc full?)");
+        LOG_ERROR("OAI-PMH server returned an error: " + error_msg + " (We sent \"" + page.request_url_ + "\")");
     }
 
-    *resumption_token = ExtractResumptionToken(message_body, cursor, complete_list_size);
-    return not resumption_token->empty();
-}
-
-
-std::string MakeRequestURL(const std::string &base_url, const std::string &metadata_prefix, const std::string &harvest_set,
-                           const std::string &resumption_token)
-{
-    std::string request_url;
-    if (not resumption_token.empty())
-        request_url = base_url + "?verb=ListRecords&resumptionToken=" + UrlUtil::UrlEncode(resumption_token);
-    else if (harvest_set.empty())
-        request_url = base_url + "?verb=ListRecords&metadataPrefix=" + metadata_prefix;
-    else
-        request_url = base_url + "?verb=ListRecords&metadataPrefix=" + metadata_prefix + "&set=" + harvest_set;
-    LOG_INFO("Request URL = " + request_url);
+    *total_record_count += record_count;
+    if (not output->write(extracted_records))
+        LOG_ERROR("failed to write to \"" + output->getPath() + "\"! (Disc full?)");
 
-    return request_url;
+    return true;
 }
 
 
@@ -266,13 +263,24 @@ int Main(int argc, char **argv) {
                                       "xsi:schemaLocation=\"http://www.loc.gov/standards/marcxml/schema/MARC21slim.xsd\">");
     temp_output->writeln("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" + COLLECTION_OPEN);
 
-    std::string resumption_token, cursor, complete_list_size;
+    // While we convert one page, the next MAX_PREFETCHED_PAGES pages will already be requested:
+    const size_t MAX_PREFETCHED_PAGES(3);
+    ThreadUtil::BoundedQueue<ListRecordsPage> page_queue(MAX_PREFETCHED_PAGES);
+    std::thread downloader_thread(DownloadPages, std::cref(base_url), std::cref(metadata_prefix), std::cref(harvest_set),
+                                  time_limit_per_request_in_seconds, ignore_ssl_certificates, &page_queue);
+
     unsigned total_record_count(0);
-    while (ListRecords(MakeRequestURL(base_url, metadata_prefix, harvest_set, resumption_token),
-                       time_limit_per_request_in_seconds, ignore_ssl_certificates, temp_output.get(),
-                       &resumption_token, &cursor, &complete_list_size, &total_record_count))
-        LOG_INFO("Continuing download, resumption token was: \"" + resumption_token + "\" (cursor=" + cursor
-                 + ", completeListSize=" + complete_list_size + ").");
+    ListRecordsPage page;
+    while (page_queue.pop(&page)) {
+        if (not ProcessPage(page, temp_output.get(), &total_record_count)) {
+            page_queue.close();
+            break;
+        }
+        if (not page.resumption_token_.empty())
+            LOG_INFO("Continuing download, resumption token was: \"" + page.resumption_token_ + "\" (cursor=" + page.cursor_
+                     + ", completeListSize=" + page.complete_list_size_ + ").");
+    }
+    downloader_thread.join();
 
     const std::string COLLECTION_CLOSE("</collection>");
     temp_output->writeln(COLLECTION_CLOSE);
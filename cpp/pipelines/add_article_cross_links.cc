@@ -17,18 +17,26 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include "Compiler.h"
 #include "ControlNumberGuesser.h"
 #include "FileUtil.h"
 #include "MARC.h"
-#include "MiscUtil.h"
-#include "StringUtil.h"
+#include "MarcControlNumberSet.h"
+#include "MarcParallelProcessor.h"
+#include "StringView.h"
 #include "util.h"
 
 
@@ -41,129 +49,295 @@ namespace {
 }
 
 
-struct RecordInfo {
-    std::set<std::string> dois_, isbns_, issns_;
-    enum Type { MONOGRAPH, SERIAL, ARTICLE, OTHER } type_;
-    std::string year_, volume_, issue_;
-    bool may_be_a_review_, is_electronic_;
+const uint32_t NOT_FOUND(UINT32_MAX);
+
+
+// Hands out consecutive ID's for distinct strings.
+class StringInterner {
+    std::unordered_map<std::string, uint32_t> strings_to_ids_map_;
+public:
+    inline uint32_t intern(const std::string &s)
+        { return strings_to_ids_map_.emplace(s, static_cast<uint32_t>(strings_to_ids_map_.size())).first->second; }
+    inline size_t size() const { return strings_to_ids_map_.size(); }
+
+    /** \return A mapping from our ID's to ID's that are ordered like the corresponding strings. */
+    std::vector<uint32_t> getSortedIDs() const {
+        std::vector<const std::pair<const std::string, uint32_t> *> strings_and_ids;
+        strings_and_ids.reserve(strings_to_ids_map_.size());
+        for (const auto &string_and_id : strings_to_ids_map_)
+            strings_and_ids.emplace_back(&string_and_id);
+        std::sort(strings_and_ids.begin(), strings_and_ids.end(),
+                  [](const std::pair<const std::string, uint32_t> * const lhs,
+                     const std::pair<const std::string, uint32_t> * const rhs) { return lhs->first < rhs->first; });
+
+        std::vector<uint32_t> ids_to_sorted_ids(strings_and_ids.size());
+        for (uint32_t sorted_id(0); sorted_id < strings_and_ids.size(); ++sorted_id)
+            ids_to_sorted_ids[strings_and_ids[sorted_id]->second] = sorted_id;
+        return ids_to_sorted_ids;
+    }
 };
 
 
 const std::string YEAR_WILDCARD("????"), VOLUME_WILDCARD("?"), ISSUE_WILDCARD("?");
 
 
-void ExtractYearVolumeIssue(const MARC::Record &record, RecordInfo * const record_info) {
-    record_info->year_   = YEAR_WILDCARD;
-    record_info->volume_ = VOLUME_WILDCARD;
-    record_info->issue_  = ISSUE_WILDCARD;
+// \return The year, volume and issue from the 936 fields, separated by unit separators.
+std::string ExtractYearVolumeIssue(const MARC::Record &record) {
+    std::string year(YEAR_WILDCARD), volume(VOLUME_WILDCARD), issue(ISSUE_WILDCARD);
 
     for (const auto &field : record.getTagRange("936")) {
         const MARC::Subfields subfields(field.getSubfields());
 
-        const auto year(subfields.getFirstSubfieldWithCode('j'));
-        if (not year.empty())
-            record_info->year_ = year;
+        const auto subfield_j(subfields.getFirstSubfieldWithCode('j'));
+        if (not subfield_j.empty())
+            year = subfield_j;
 
-        const auto volume(subfields.getFirstSubfieldWithCode('d'));
-        if (not volume.empty())
-            record_info->volume_ = volume;
+        const auto subfield_d(subfields.getFirstSubfieldWithCode('d'));
+        if (not subfield_d.empty())
+            volume = subfield_d;
 
-        const auto issue(subfields.getFirstSubfieldWithCode('e'));
-        if (not issue.empty())
-            record_info->issue_ = issue;
+        const auto subfield_e(subfields.getFirstSubfieldWithCode('e'));
+        if (not subfield_e.empty())
+            issue = subfield_e;
     }
+
+    return year + '\x1F' + volume + '\x1F' + issue;
 }
 
 
-void CollectInfos(MARC::Reader * const marc_reader, std::unordered_map<std::string, RecordInfo> * const ppns_to_infos_map) {
-    while (const auto record = marc_reader->read()) {
+/** \class RecordInfoIndex
+ *  \brief What we need to know about all records in order to find and link duplicates, w/o any per-record strings.
+ *  \note  Records are identified by their index in the sorted list of all PPN's, so that comparing indices is
+ *         equivalent to comparing PPN's.  DOI's and year/volume/issue triples are replaced by interned ID's.
+ */
+class RecordInfoIndex {
+public:
+    struct RecordInfo {
+        uint32_t first_doi_, end_doi_; // Range of sorted DOI ID's in "doi_ids_".
+        uint32_t year_volume_issue_id_;
+        enum Type : uint8_t { MONOGRAPH, SERIAL, ARTICLE, OTHER } type_;
+        bool may_be_a_review_, is_electronic_;
+    };
+private:
+    std::string ppn_pool_;
+    std::vector<uint32_t> ppn_offsets_; // One more than the number of records.
+    MARC::ControlNumberSet ppns_to_indices_;
+    std::vector<RecordInfo> infos_;
+    std::vector<uint32_t> doi_ids_;
+public:
+    /** \brief Extracts the infos on the worker threads of a MARC::ParallelProcessor. */
+    explicit RecordInfoIndex(MARC::Reader * const marc_reader);
+
+    inline uint32_t size() const { return static_cast<uint32_t>(infos_.size()); }
+
+    inline uint32_t getIndex(const std::string &ppn) const {
+        uint64_t index;
+        return ppns_to_indices_.find(ppn, &index) ? static_cast<uint32_t>(index) : NOT_FOUND;
+    }
+
+    inline std::string getPPN(const uint32_t index) const
+        { return ppn_pool_.substr(ppn_offsets_[index], ppn_offsets_[index + 1] - ppn_offsets_[index]); }
+    inline const RecordInfo &getInfo(const uint32_t index) const { return infos_[index]; }
+
+    bool haveAtLeastOneCommonDOI(const std::vector<uint32_t> &indices) const;
+};
+
+
+RecordInfoIndex::RecordInfoIndex(MARC::Reader * const marc_reader): ppns_to_indices_(/* store_values = */true) {
+    // Records arrive in an arbitrary order, so we first collect everything in the order of arrival:
+    std::mutex mutex;
+    StringInterner doi_interner, year_volume_issue_interner;
+    std::string unsorted_ppn_pool;
+    std::vector<uint32_t> unsorted_ppn_offsets{ 0 }, unsorted_doi_ids;
+    std::vector<RecordInfo> unsorted_infos;
+
+    MARC::ParallelProcessor parallel_processor(marc_reader, /* writer = */nullptr);
+    parallel_processor.process([&](MARC::Record * const record) {
         RecordInfo new_info;
-        new_info.dois_ = record.getDOIs();
-        new_info.isbns_ = record.getISBNs();
-        new_info.issns_ = record.getISSNs();
-        if (record.isMonograph())
+        if (record->isMonograph())
             new_info.type_ = RecordInfo::MONOGRAPH;
-        else if (record.isSerial())
+        else if (record->isSerial())
             new_info.type_ = RecordInfo::SERIAL;
-        else if (record.isArticle())
+        else if (record->isArticle())
             new_info.type_ = RecordInfo::ARTICLE;
         else
             new_info.type_ = RecordInfo::OTHER;
-        ExtractYearVolumeIssue(record, &new_info);
-        new_info.may_be_a_review_ = MARC::PossiblyAReviewArticle(record);
-        new_info.is_electronic_ = record.isElectronicResource();
+        new_info.may_be_a_review_ = MARC::PossiblyAReviewArticle(*record);
+        new_info.is_electronic_ = record->isElectronicResource();
+        const std::set<std::string> dois(record->getDOIs());
+        const std::string year_volume_issue(ExtractYearVolumeIssue(*record));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        unsorted_ppn_pool += record->getControlNumber();
+        unsorted_ppn_offsets.emplace_back(static_cast<uint32_t>(unsorted_ppn_pool.size()));
+        new_info.first_doi_ = static_cast<uint32_t>(unsorted_doi_ids.size());
+        for (const auto &doi : dois)
+            unsorted_doi_ids.emplace_back(doi_interner.intern(doi));
+        new_info.end_doi_ = static_cast<uint32_t>(unsorted_doi_ids.size());
+        std::sort(unsorted_doi_ids.begin() + new_info.first_doi_, unsorted_doi_ids.end());
+        new_info.year_volume_issue_id_ = year_volume_issue_interner.intern(year_volume_issue);
+        unsorted_infos.emplace_back(new_info);
+        return false;
+    });
+
+    // ...and then sort by PPN:
+    const auto get_unsorted_ppn([&unsorted_ppn_pool, &unsorted_ppn_offsets](const uint32_t index) {
+        return StringView(unsorted_ppn_pool.data() + unsorted_ppn_offsets[index],
+                          unsorted_ppn_offsets[index + 1] - unsorted_ppn_offsets[index]);
+    });
+    std::vector<uint32_t> order(unsorted_infos.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&get_unsorted_ppn](const uint32_t lhs, const uint32_t rhs) { return get_unsorted_ppn(lhs) < get_unsorted_ppn(rhs); });
+
+    ppn_pool_.reserve(unsorted_ppn_pool.size());
+    ppn_offsets_.reserve(order.size() + 1);
+    ppn_offsets_.emplace_back(0);
+    infos_.reserve(order.size());
+    doi_ids_.reserve(unsorted_doi_ids.size());
+    for (const uint32_t unsorted_index : order) {
+        const StringView ppn(get_unsorted_ppn(unsorted_index));
+        if (unlikely(not ppns_to_indices_.insert(ppn.toString(), infos_.size()))) {
+            LOG_WARNING("PPN " + ppn.toString() + " occurs more than once!");
+            continue;
+        }
 
-        (*ppns_to_infos_map)[record.getControlNumber()] = new_info;
+        ppn_pool_.append(ppn.data(), ppn.size());
+        ppn_offsets_.emplace_back(static_cast<uint32_t>(ppn_pool_.size()));
+        RecordInfo info(unsorted_infos[unsorted_index]);
+        const uint32_t first_doi(static_cast<uint32_t>(doi_ids_.size()));
+        doi_ids_.insert(doi_ids_.end(), unsorted_doi_ids.cbegin() + info.first_doi_, unsorted_doi_ids.cbegin() + info.end_doi_);
+        info.first_doi_ = first_doi;
+        info.end_doi_ = static_cast<uint32_t>(doi_ids_.size());
+        infos_.emplace_back(info);
     }
+
+    LOG_INFO("collected infos for " + std::to_string(infos_.size()) + " records w/ " + std::to_string(doi_interner.size())
+             + " distinct DOIs.");
 }
 
 
-bool SetContainsOnlyArticlePPNs(const std::set<std::string> &ppns, const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map) {
-    for (const auto &ppn : ppns) {
-        const auto ppn_and_record_info(ppns_to_infos_map.find(ppn));
-        if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-            LOG_WARNING("PPN "+ ppn + " is missing in ppns_to_infos_map! (1)");
-        if (ppn_and_record_info->second.type_ != RecordInfo::ARTICLE)
-            return false;
+bool RecordInfoIndex::haveAtLeastOneCommonDOI(const std::vector<uint32_t> &indices) const {
+    if (unlikely(indices.empty()))
+        return false;
+
+    auto index(indices.cbegin());
+    std::vector<uint32_t> shared_dois(doi_ids_.cbegin() + infos_[*index].first_doi_,
+                                      doi_ids_.cbegin() + infos_[*index].end_doi_);
+    for (++index; index != indices.cend() and not shared_dois.empty(); ++index) {
+        const auto shared_dois_end(std::set_intersection(shared_dois.cbegin(), shared_dois.cend(),
+                                                         doi_ids_.cbegin() + infos_[*index].first_doi_,
+                                                         doi_ids_.cbegin() + infos_[*index].end_doi_, shared_dois.begin()));
+        shared_dois.erase(shared_dois_end, shared_dois.end());
     }
 
-    return true;
+    return not shared_dois.empty();
 }
 
 
-bool ContainsAtLeastOnePossibleReview(const std::set<std::string> &ppns,
-                                      const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map)
-{
-    for (const auto &ppn : ppns) {
-        const auto ppn_and_record_info(ppns_to_infos_map.find(ppn));
-        if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-            LOG_ERROR("PPN "+ ppn + " is missing in ppns_to_infos_map! (2)");
-        if (ppn_and_record_info->second.may_be_a_review_)
-            return true;
+/** \class AuthorIndex
+ *  \brief Maps record indices to the ID's of their authors.  Author ID's are ordered like the author names.
+ */
+class AuthorIndex {
+    std::vector<std::pair<uint32_t, uint32_t>> record_indices_and_author_ids_; // Sorted.
+public:
+    AuthorIndex(const ControlNumberGuesser &control_number_guesser, const RecordInfoIndex &record_info_index);
+
+    inline std::pair<std::vector<std::pair<uint32_t, uint32_t>>::const_iterator,
+                     std::vector<std::pair<uint32_t, uint32_t>>::const_iterator>
+        getAuthorIDs(const uint32_t record_index) const
+    {
+        return std::equal_range(record_indices_and_author_ids_.cbegin(), record_indices_and_author_ids_.cend(),
+                                std::make_pair(record_index, uint32_t(0)),
+                                [](const std::pair<uint32_t, uint32_t> &lhs, const std::pair<uint32_t, uint32_t> &rhs)
+                                { return lhs.first < rhs.first; });
     }
+};
 
-    return false;
+
+AuthorIndex::AuthorIndex(const ControlNumberGuesser &control_number_guesser, const RecordInfoIndex &record_info_index) {
+    StringInterner author_interner;
+    std::string author;
+    std::set<std::string> control_numbers;
+    while (control_number_guesser.getNextAuthor(&author, &control_numbers)) {
+        for (const auto &control_number : control_numbers) {
+            const uint32_t record_index(record_info_index.getIndex(control_number));
+            if (record_index != NOT_FOUND)
+                record_indices_and_author_ids_.emplace_back(record_index, author_interner.intern(author));
+        }
+    }
+
+    const auto ids_to_sorted_ids(author_interner.getSortedIDs());
+    for (auto &record_index_and_author_id : record_indices_and_author_ids_)
+        record_index_and_author_id.second = ids_to_sorted_ids[record_index_and_author_id.second];
+    std::sort(record_indices_and_author_ids_.begin(), record_indices_and_author_ids_.end());
+    record_indices_and_author_ids_.erase(std::unique(record_indices_and_author_ids_.begin(),
+                                                     record_indices_and_author_ids_.end()),
+                                         record_indices_and_author_ids_.end());
+    record_indices_and_author_ids_.shrink_to_fit();
+
+    LOG_INFO("loaded " + std::to_string(record_indices_and_author_ids_.size()) + " mappings from control numbers to "
+             + std::to_string(author_interner.size()) + " authors.");
 }
 
 
-bool HasAtLeastOneCommonDOI(const std::set<std::string> &ppns, const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map) {
-    if (unlikely(ppns.empty()))
-        return false;
+/** \class DupSets
+ *  \brief Sets of record indices that should be cross linked.  Each record belongs to at most one set, the last one
+ *         that it was added with.
+ */
+class DupSets {
+    std::vector<uint32_t> members_, offsets_;
+    std::vector<uint32_t> record_indices_to_set_indices_;
+public:
+    explicit DupSets(const uint32_t record_count): offsets_{ 0 }, record_indices_to_set_indices_(record_count, NOT_FOUND) { }
+
+    void insert(const std::vector<uint32_t> &record_indices) {
+        const uint32_t set_index(static_cast<uint32_t>(offsets_.size() - 1));
+        members_.insert(members_.end(), record_indices.cbegin(), record_indices.cend());
+        offsets_.emplace_back(static_cast<uint32_t>(members_.size()));
+        for (const auto record_index : record_indices)
+            record_indices_to_set_indices_[record_index] = set_index;
+    }
 
-    auto ppn(ppns.cbegin());
-    auto ppn_and_record_info(ppns_to_infos_map.find(*ppn));
-    if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-        LOG_ERROR("PPN "+ *ppn + " is missing in ppns_to_infos_map! (3)");
-    std::set<std::string> shared_dois(ppn_and_record_info->second.dois_);
-
-    for (++ppn; ppn != ppns.cend(); ++ppn) {
-        ppn_and_record_info = ppns_to_infos_map.find(*ppn);
-        if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-            LOG_ERROR("PPN "+ *ppn + " is missing in ppns_to_infos_map! (4)");
-        shared_dois = MiscUtil::Intersect(shared_dois, ppn_and_record_info->second.dois_);
+    /** \return False if "record_index" is not a member of any set. */
+    inline bool getSet(const uint32_t record_index, const uint32_t **begin, const uint32_t **end) const {
+        const uint32_t set_index(record_indices_to_set_indices_[record_index]);
+        if (set_index == NOT_FOUND)
+            return false;
+        *begin = members_.data() + offsets_[set_index];
+        *end = members_.data() + offsets_[set_index + 1];
+        return true;
     }
+};
 
-    return not shared_dois.empty();
+
+bool ContainsOnlyArticles(const std::vector<uint32_t> &record_indices, const RecordInfoIndex &record_info_index) {
+    for (const auto record_index : record_indices) {
+        if (record_info_index.getInfo(record_index).type_ != RecordInfoIndex::RecordInfo::ARTICLE)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool ContainsAtLeastOnePossibleReview(const std::vector<uint32_t> &record_indices, const RecordInfoIndex &record_info_index) {
+    for (const auto record_index : record_indices) {
+        if (record_info_index.getInfo(record_index).may_be_a_review_)
+            return true;
+    }
+
+    return false;
 }
 
 
-bool IsConsistentSet(const std::set<std::string> &ppns, const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map) {
-    if (unlikely(ppns.empty()))
+bool IsConsistentSet(const std::vector<uint32_t> &record_indices, const RecordInfoIndex &record_info_index) {
+    if (unlikely(record_indices.empty()))
         return false;
 
-    auto ppn(ppns.cbegin());
-    auto ppn_and_record_info(ppns_to_infos_map.find(*ppn));
-    if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-        LOG_ERROR("PPN "+ *ppn + " is missing in ppns_to_infos_map! (5)");
-    std::string year(ppn_and_record_info->second.year_), volume(ppn_and_record_info->second.volume_),
-                issue(ppn_and_record_info->second.issue_);
-
-    for (++ppn; ppn != ppns.cend(); ++ppn) {
-        ppn_and_record_info = ppns_to_infos_map.find(*ppn);
-        if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-            LOG_ERROR("PPN "+ *ppn + " is missing in ppns_to_infos_map! (6)");
-        if (ppn_and_record_info->second.year_ != year or ppn_and_record_info->second.volume_ != volume
-            or ppn_and_record_info->second.issue_ != issue)
+    const uint32_t year_volume_issue_id(record_info_index.getInfo(record_indices.front()).year_volume_issue_id_);
+    for (const auto record_index : record_indices) {
+        if (record_info_index.getInfo(record_index).year_volume_issue_id_ != year_volume_issue_id)
             return false;
     }
 
@@ -174,72 +348,75 @@ bool IsConsistentSet(const std::set<std::string> &ppns, const std::unordered_map
 const std::string IXTHEO_PREFIX("https://ixtheo.de/Record/");
 
 
-void InsertSingleSet(const std::set<std::string> &dups,
-                     std::unordered_map<std::string, std::set<std::string> *> * const control_number_to_dups_set_map)
+void InsertSingleSet(const std::vector<uint32_t> &record_indices, const RecordInfoIndex &record_info_index,
+                     File * const matches_list_output, DupSets * const dup_sets)
 {
-    auto dups_set(new std::set<std::string>(dups));
-    for (const auto &control_number : dups)
-        (*control_number_to_dups_set_map)[control_number] = dups_set;
+    dup_sets->insert(record_indices);
+    for (const auto record_index : record_indices)
+        (*matches_list_output) << IXTHEO_PREFIX << record_info_index.getPPN(record_index) << ' ';
+    (*matches_list_output) << "\r\n";
 }
 
 
-void FindDups(File * const matches_list_output,
-              const std::unordered_map<std::string, std::set<std::string>> &title_to_control_numbers_map,
-              const std::unordered_map<std::string, std::set<std::string>> &control_number_to_authors_map,
-              const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map,
-              std::unordered_map<std::string, std::set<std::string> *> * const control_number_to_dups_set_map)
+// Titles are streamed from "control_number_guesser" as we only need to look at each of them once.
+void FindDups(File * const matches_list_output, const ControlNumberGuesser &control_number_guesser,
+              const AuthorIndex &author_index, const RecordInfoIndex &record_info_index, DupSets * const dup_sets)
 {
-    unsigned doi_match_count(0), non_doi_match_count(0);
-    for (const auto &title_and_control_numbers : title_to_control_numbers_map) {
-        if (title_and_control_numbers.second.size() < 2
-            or not SetContainsOnlyArticlePPNs(title_and_control_numbers.second, ppns_to_infos_map)
-            or ContainsAtLeastOnePossibleReview(title_and_control_numbers.second, ppns_to_infos_map))
+    unsigned title_count(0), doi_match_count(0), non_doi_match_count(0);
+    std::string title;
+    std::set<std::string> control_numbers;
+    std::vector<uint32_t> record_indices;
+    while (control_number_guesser.getNextTitle(&title, &control_numbers)) {
+        ++title_count;
+        if (control_numbers.size() < 2)
+            continue;
+
+        // Since "control_numbers" is sorted, so are the indices:
+        record_indices.clear();
+        for (const auto &control_number : control_numbers) {
+            const uint32_t record_index(record_info_index.getIndex(control_number));
+            if (unlikely(record_index == NOT_FOUND)) {
+                LOG_WARNING("PPN " + control_number + " is missing in our record infos!");
+                break;
+            }
+            record_indices.emplace_back(record_index);
+        }
+        if (record_indices.size() != control_numbers.size()
+            or not ContainsOnlyArticles(record_indices, record_info_index)
+            or ContainsAtLeastOnePossibleReview(record_indices, record_info_index))
             continue;
 
-        if (HasAtLeastOneCommonDOI(title_and_control_numbers.second, ppns_to_infos_map)) {
-            InsertSingleSet(title_and_control_numbers.second, control_number_to_dups_set_map);
-            for (const auto &control_number : title_and_control_numbers.second)
-                (*matches_list_output) << IXTHEO_PREFIX << control_number << ' ';
-            (*matches_list_output) << "\r\n";
+        if (record_info_index.haveAtLeastOneCommonDOI(record_indices)) {
+            InsertSingleSet(record_indices, record_info_index, matches_list_output, dup_sets);
             ++doi_match_count;
             continue;
         }
 
-        if (not IsConsistentSet(title_and_control_numbers.second, ppns_to_infos_map))
+        if (not IsConsistentSet(record_indices, record_info_index))
             continue;
 
-        // Collect all control numbers for all authors of the current title:
-        std::map<std::string, std::set<std::string>> author_to_control_numbers_map;
-        for (const auto &control_number : title_and_control_numbers.second) {
-            const auto control_number_and_authors(control_number_to_authors_map.find(control_number));
-            if (control_number_and_authors == control_number_to_authors_map.cend())
-                continue;
-
-            for (const auto &author : control_number_and_authors->second) {
-                auto author_and_control_numbers(author_to_control_numbers_map.find(author));
-                if (author_and_control_numbers == author_to_control_numbers_map.end())
-                    author_to_control_numbers_map[author] = std::set<std::string>{ control_number };
-                else
-                    author_and_control_numbers->second.emplace(control_number);
-            }
+        // Collect all records for all authors of the current title:
+        std::map<uint32_t, std::vector<uint32_t>> author_ids_to_record_indices_map;
+        for (const auto record_index : record_indices) {
+            const auto author_ids(author_index.getAuthorIDs(record_index));
+            for (auto record_index_and_author_id(author_ids.first); record_index_and_author_id != author_ids.second;
+                 ++record_index_and_author_id)
+                author_ids_to_record_indices_map[record_index_and_author_id->second].emplace_back(record_index);
         }
 
-        // Output those cases where we found multiple control numbers for the same author for a single title:
-        std::unordered_set<std::string> already_processed_control_numbers;
-        for (const auto &author_and_control_numbers : author_to_control_numbers_map) {
-            if (author_and_control_numbers.second.size() >= 2) {
+        // Output those cases where we found multiple records for the same author for a single title:
+        std::unordered_set<uint32_t> already_processed_record_indices;
+        for (const auto &author_id_and_record_indices : author_ids_to_record_indices_map) {
+            if (author_id_and_record_indices.second.size() >= 2) {
                 // We may have multiple authors for the same work but only wish to report each duplicate work once:
-                for (const auto &control_number : author_and_control_numbers.second) {
-                    if (already_processed_control_numbers.find(control_number) != already_processed_control_numbers.cend())
+                for (const auto record_index : author_id_and_record_indices.second) {
+                    if (already_processed_record_indices.find(record_index) != already_processed_record_indices.cend())
                         goto skip_author;
                 }
 
-                InsertSingleSet(author_and_control_numbers.second, control_number_to_dups_set_map);
-                for (const auto &control_number : author_and_control_numbers.second) {
-                    already_processed_control_numbers.emplace(control_number);
-                    (*matches_list_output) << IXTHEO_PREFIX << control_number << ' ';
-                }
-                (*matches_list_output) << "\r\n";
+                InsertSingleSet(author_id_and_record_indices.second, record_info_index, matches_list_output, dup_sets);
+                already_processed_record_indices.insert(author_id_and_record_indices.second.cbegin(),
+                                                        author_id_and_record_indices.second.cend());
                 ++non_doi_match_count;
 skip_author:
                 /* Intentionally empty! */;
@@ -247,24 +424,24 @@ skip_author:
         }
     }
 
-    LOG_INFO("found " + std::to_string(doi_match_count) + " DOI matches and " + std::to_string(non_doi_match_count) + " non-DOI matches.");
+    LOG_INFO("processed " + std::to_string(title_count) + " titles and found " + std::to_string(doi_match_count)
+             + " DOI matches and " + std::to_string(non_doi_match_count) + " non-DOI matches.");
 }
 
 
-bool AugmentRecord(MARC::Record * const record, const std::set<std::string> &dups_set,
-                   const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map)
+bool AugmentRecord(MARC::Record * const record, const uint32_t record_index, const uint32_t * const dups_begin,
+                   const uint32_t * const dups_end, const RecordInfoIndex &record_info_index)
 {
     const auto existing_cross_references(MARC::ExtractCrossReferencePPNs(*record));
 
     bool added_at_least_one_new_cross_link(false);
-    for (const auto &cross_link_ppn : dups_set) {
-        if (cross_link_ppn != record->getControlNumber()
-            and existing_cross_references.find(cross_link_ppn) == existing_cross_references.cend())
-        {
-            const auto ppn_and_record_info(ppns_to_infos_map.find(cross_link_ppn));
-            if (unlikely(ppn_and_record_info == ppns_to_infos_map.cend()))
-                LOG_ERROR("did not find a record info record for PPN \"" + cross_link_ppn + "\"!");
-            const bool is_electronic(ppn_and_record_info->second.is_electronic_);
+    for (auto dup(dups_begin); dup != dups_end; ++dup) {
+        if (*dup == record_index)
+            continue;
+
+        const std::string cross_link_ppn(record_info_index.getPPN(*dup));
+        if (existing_cross_references.find(cross_link_ppn) == existing_cross_references.cend()) {
+            const bool is_electronic(record_info_index.getInfo(*dup).is_electronic_);
             record->insertField("776",
                                 { { 'i', "Erscheint auch als" }, { 'n', (is_electronic ? "elektronische Ausgabe" : "Druckausgabe") },
                                   { 'w', "(DE-627)" + cross_link_ppn } });
@@ -276,18 +453,19 @@ bool AugmentRecord(MARC::Record * const record, const std::set<std::string> &dup
 }
 
 
-void AddCrossLinks(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                   const std::unordered_map<std::string, std::set<std::string> *> &control_number_to_dups_set_map,
-                   const std::unordered_map<std::string, RecordInfo> &ppns_to_infos_map)
+void AddCrossLinks(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer, const DupSets &dup_sets,
+                   const RecordInfoIndex &record_info_index)
 {
-    unsigned augmentation_count(0);
-    while (auto record = marc_reader->read()) {
-        const auto control_number_and_dups_set(control_number_to_dups_set_map.find(record.getControlNumber()));
-        if (control_number_and_dups_set != control_number_to_dups_set_map.cend()
-            and AugmentRecord(&record, *control_number_and_dups_set->second, ppns_to_infos_map))
+    std::atomic<unsigned> augmentation_count(0);
+    MARC::ParallelProcessor parallel_processor(marc_reader, marc_writer);
+    parallel_processor.process([&](MARC::Record * const record) {
+        const uint32_t record_index(record_info_index.getIndex(record->getControlNumber()));
+        const uint32_t *dups_begin, *dups_end;
+        if (record_index != NOT_FOUND and dup_sets.getSet(record_index, &dups_begin, &dups_end)
+            and AugmentRecord(record, record_index, dups_begin, dups_end, record_info_index))
             ++augmentation_count;
-        marc_writer->write(record);
-    }
+        return true;
+    });
 
     LOG_INFO("Added cross links to " + std::to_string(augmentation_count) + " record(s).");
 }
@@ -303,38 +481,17 @@ int Main(int argc, char *argv[]) {
     auto marc_reader(MARC::Reader::Factory(argv[1]));
     auto marc_writer(MARC::Writer::Factory(argv[2]));
 
-    std::unordered_map<std::string, RecordInfo> ppns_to_infos_map;
-    CollectInfos(marc_reader.get(), &ppns_to_infos_map);
+    const RecordInfoIndex record_info_index(marc_reader.get());
 
     ControlNumberGuesser control_number_guesser;
-
-    std::unordered_map<std::string, std::set<std::string>> title_to_control_numbers_map;
-    std::string title;
-    std::set<std::string> control_numbers;
-    while (control_number_guesser.getNextTitle(&title, &control_numbers))
-        title_to_control_numbers_map.emplace(title, control_numbers);
-    LOG_INFO("loaded " + std::to_string(title_to_control_numbers_map.size()) + " mappings from titles to control numbers.");
-
-    std::unordered_map<std::string, std::set<std::string>> control_number_to_authors_map;
-    std::string author;
-    while (control_number_guesser.getNextAuthor(&author, &control_numbers)) {
-        for (const auto &control_number : control_numbers) {
-            auto control_number_and_authors(control_number_to_authors_map.find(control_number));
-            if (control_number_and_authors == control_number_to_authors_map.end())
-                control_number_to_authors_map[control_number] = std::set<std::string>{ author };
-            else
-                control_number_and_authors->second.emplace(author);
-        }
-    }
-    LOG_INFO("loaded " + std::to_string(control_number_to_authors_map.size()) + " mappings from control numbers to authors.");
+    const AuthorIndex author_index(control_number_guesser, record_info_index);
 
     auto matches_list_output(FileUtil::OpenOutputFileOrDie(argv[3]));
-    std::unordered_map<std::string, std::set<std::string> *> control_number_to_dups_set_map;
-    FindDups(matches_list_output.get(), title_to_control_numbers_map, control_number_to_authors_map, ppns_to_infos_map,
-             &control_number_to_dups_set_map);
+    DupSets dup_sets(record_info_index.size());
+    FindDups(matches_list_output.get(), control_number_guesser, author_index, record_info_index, &dup_sets);
 
     marc_reader->rewind();
-    AddCrossLinks(marc_reader.get(), marc_writer.get(), control_number_to_dups_set_map, ppns_to_infos_map);
+    AddCrossLinks(marc_reader.get(), marc_writer.get(), dup_sets, record_info_index);
 
     return EXIT_SUCCESS;
 }
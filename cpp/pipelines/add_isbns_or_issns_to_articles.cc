@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include <cstring>
 #include "MARC.h"
+#include "MarcSuperiorWorksTable.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
 #include "util.h"
@@ -37,10 +38,13 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << progname << " master_marc_input marc_output\n";
+    std::cerr << "Usage: " << progname << " [--superior-works-table=path] master_marc_input marc_output\n";
     std::cerr << "  Adds host/parent/journal ISBNs and ISSNs to article entries found in the\n";
     std::cerr << "  master_marc_input and writes this augmented file as marc_output.  The ISBNs and ISSNs are\n";
     std::cerr << "  extracted from superior entries found in master_marc_input.\n";
+    std::cerr << "  If --superior-works-table was specified, the titles, ISBNs and ISSNs collected from\n";
+    std::cerr << "  master_marc_input will also be written to a table that later phases, e.g. augment_773a,\n";
+    std::cerr << "  can use instead of making their own pass over the title data.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -52,7 +56,8 @@ struct RecordInfo {
 
 
 void PopulateParentIdToISBNAndISSNMap(MARC::Reader * const marc_reader,
-                                      std::unordered_map<std::string, RecordInfo> * const parent_id_to_isbn_issn_and_open_access_status_map)
+                                      std::unordered_map<std::string, RecordInfo> * const parent_id_to_isbn_issn_and_open_access_status_map,
+                                      MARC::SuperiorWorksTable::Builder * const superior_works_table_builder)
 {
     LOG_INFO("Starting extraction of ISBN's and ISSN's.");
 
@@ -61,6 +66,9 @@ void PopulateParentIdToISBNAndISSNMap(MARC::Reader * const marc_reader,
     while (const MARC::Record record = marc_reader->read()) {
         ++count;
 
+        if (superior_works_table_builder != nullptr)
+            superior_works_table_builder->addRecord(record);
+
         if (not record.isSerial() and not record.isMonograph())
             continue;
 
@@ -167,6 +175,15 @@ int Main(int argc, char **argv) {
     if (argc < 3)
         Usage();
 
+    std::string superior_works_table_path;
+    if (StringUtil::StartsWith(argv[1], "--superior-works-table=")) {
+        superior_works_table_path = argv[1] + __builtin_strlen("--superior-works-table=");
+        --argc, ++argv;
+    }
+
+    if (argc != 3)
+        Usage();
+
     const std::string marc_input_filename(argv[1]);
     const std::string marc_output_filename(argv[2]);
     if (unlikely(marc_input_filename == marc_output_filename))
@@ -176,7 +193,13 @@ int Main(int argc, char **argv) {
     auto marc_writer(MARC::Writer::Factory(marc_output_filename));
 
     std::unordered_map<std::string, RecordInfo> parent_id_to_isbn_issn_and_open_access_status_map;
-    PopulateParentIdToISBNAndISSNMap(marc_reader.get(), &parent_id_to_isbn_issn_and_open_access_status_map);
+    MARC::SuperiorWorksTable::Builder superior_works_table_builder;
+    PopulateParentIdToISBNAndISSNMap(marc_reader.get(), &parent_id_to_isbn_issn_and_open_access_status_map,
+                                     superior_works_table_path.empty() ? nullptr : &superior_works_table_builder);
+    if (not superior_works_table_path.empty()) {
+        const size_t entry_count(superior_works_table_builder.write(superior_works_table_path));
+        LOG_INFO("Wrote " + std::to_string(entry_count) + " superior works to \"" + superior_works_table_path + "\".");
+    }
     marc_reader->rewind();
 
     AddMissingISBNsOrISSNsToArticleEntries(marc_reader.get(), marc_writer.get(), parent_id_to_isbn_issn_and_open_access_status_map);
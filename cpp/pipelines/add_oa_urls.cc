@@ -22,81 +22,50 @@
 
 #include <iostream>
 #include <memory>
-#include <unordered_map>
 #include "Compiler.h"
-#include "FileUtil.h"
-#include "JSON.h"
 #include "MARC.h"
+#include "OADOIUrlTable.h"
+#include "UrlUtil.h"
 #include "util.h"
 
 
 namespace {
 
 
-struct oadoi_info {
-    std::string url_;
-    std::string evidence_;
-    std::string host_type_;
-public:
-    oadoi_info(const std::string url, const std::string evidence, const std::string host_type) :
-               url_(url), evidence_(evidence), host_type_(host_type) { }
-};
-
-
 [[noreturn]] void Usage() {
     std::cerr << "Usage: " << ::progname \
-              << " doi_to_url_map.json marc_input marc_output\n";
+              << " doi_to_url_map.json marc_input marc_output\n"
+              << "       Uses doi_to_url_map.json.table, see create_oadoi_url_table, and creates it first if necessary.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-void CreateDoiToUrlMap(const std::string &map_filename, std::unordered_map<std::string, oadoi_info> * const doi_to_oainfo) {
-    std::string json_document;
-    if (not FileUtil::ReadString(map_filename, &json_document))
-        LOG_ERROR("Could not read in " + map_filename);
-
-    JSON::Parser json_parser(json_document);
-    std::shared_ptr<JSON::JSONNode> entries;
-    if (not json_parser.parse(&entries))
-        LOG_ERROR("Could not properly parse \"" + map_filename + ": " + json_parser.getErrorMessage());
-
-    std::shared_ptr<JSON::ArrayNode> entry_array(JSON::JSONNode::CastToArrayNodeOrDie("", entries));
-    for (const auto &entry : *entry_array) {
-        const std::string doi(LookupString("/doi", entry));
-        const std::string url(LookupString("/best_oa_location/url", entry));
-        const std::string evidence(LookupString("/best_oa_location/evidence", entry));
-        const std::string host_type(LookupString("/best_oa_location/host_type", entry));
-        if (not (doi.empty() or url.empty()))
-            doi_to_oainfo->emplace(doi, oadoi_info(url, evidence, host_type));
-        else
-            LOG_ERROR("Either doi or url missing");
-    }
-}
-
-
+// URL's that only differ in the case of their scheme or host name or in an explicit default port are considered identical.
 bool AlreadyHasIdenticalUrl(const MARC::Record &record, const std::string &url) {
+    const std::string normalised_url(UrlUtil::NormaliseUrlPrefix(url));
     for (const auto &field : record.getTagRange("856")) {
-        if (field.hasSubfieldWithValue('u', url))
-            return true;
+        for (const auto &subfield : field.getSubfields()) {
+            if (subfield.code_ == 'u' and UrlUtil::NormaliseUrlPrefix(subfield.value_) == normalised_url)
+                return true;
+        }
     }
     return false;
 }
 
 
 void Augment856(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                const std::unordered_map<std::string, oadoi_info> &doi_to_oainfo)
+                const OADOIUrlTable &doi_to_oainfo)
 {
     while (MARC::Record record = marc_reader->read()) {
         bool flag_as_open_access_resource(false);
         for (const auto &field : record.getTagRange("024")) {
             if (field.hasSubfieldWithValue('2', "doi")) {
                 const std::string doi(field.getFirstSubfieldWithCode('a'));
-                const auto doi_and_info(doi_to_oainfo.find(doi));
-                if (doi_and_info != doi_to_oainfo.cend()) {
-                    const auto oainfo(doi_and_info->second);
-                    const std::string url(oainfo.url_);
-                    const std::string evidence(oainfo.evidence_);
-                    const std::string host_type(oainfo.host_type_);
+                OADOIUrlTable::OAInfo oainfo;
+                if (doi_to_oainfo.lookup(doi, &oainfo)) {
+                    const std::string url(oainfo.url_.toString());
+                    const std::string evidence(oainfo.evidence_.toString());
+                    const std::string host_type(oainfo.host_type_.toString());
                     if (not AlreadyHasIdenticalUrl(record, url))
                         record.insertField("856", { { 'u', url }, { 'x', "unpaywall" }, { 'z', "Vermutlich kostenfreier Zugang" },
                                                     { 'h', host_type + " [" + evidence + "]" } });
@@ -119,8 +88,7 @@ int Main(int argc, char *argv[]) {
    if (argc != 4)
        Usage();
 
-   std::unordered_map<std::string, oadoi_info> doi_to_oainfo;
-   CreateDoiToUrlMap(argv[1], &doi_to_oainfo);
+   const OADOIUrlTable doi_to_oainfo(argv[1]);
    std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[2]));
    std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[3]));
    Augment856(marc_reader.get(), marc_writer.get(), doi_to_oainfo);
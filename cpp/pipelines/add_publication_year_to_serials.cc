@@ -28,12 +28,12 @@
 */
 
 #include <iostream>
-#include <map>
 #include <vector>
 #include <cstdlib>
 #include "Compiler.h"
 #include "FileUtil.h"
 #include "MARC.h"
+#include "PPN.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -41,7 +41,7 @@
 namespace {
 
 
-typedef std::map<std::string, std::string> SortList;
+typedef PPNMap<std::string> SortList;
 
 
 [[noreturn]] void Usage() {
@@ -58,9 +58,13 @@ void SetupPublicationYearMap(File * const sort_year_list, SortList * const sort_
            LOG_WARNING("Invalid line: " + line);
            continue;
        }
-       const std::string ppn(ppns_and_sort_year[0]);
+       PPN ppn;
+       if (unlikely(not PPN::Parse(ppns_and_sort_year[0], &ppn))) {
+           LOG_WARNING("Invalid PPN in line: " + line);
+           continue;
+       }
        const std::string sort_year(ppns_and_sort_year[1]);
-       sort_year_map->insert(std::make_pair(ppn, sort_year));
+       sort_year_map->insert(ppn, sort_year);
     }
 }
 
@@ -69,11 +73,11 @@ static unsigned modified_count(0);
 
 
 void ProcessRecord(MARC::Record * const record, const SortList &sort_year_map) {
-    SortList::const_iterator iter(sort_year_map.find(record->getControlNumber()));
-    if (iter == sort_year_map.cend())
+    const std::string * const sort_year_ptr(sort_year_map.find(record->getControlNumber()));
+    if (sort_year_ptr == nullptr)
        return;
 
-    std::string sort_year(iter->second);
+    std::string sort_year(*sort_year_ptr);
 
     // We insert in 190j
     // Case 1: If there is no 190 tag yet, insert subfield j and we are done
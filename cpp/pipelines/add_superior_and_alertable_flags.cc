@@ -25,12 +25,11 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <unordered_map>
-#include <unordered_set>
 #include <cstdlib>
 #include <cstring>
 #include "Compiler.h"
 #include "MARC.h"
+#include "PPN.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "util.h"
@@ -59,7 +58,7 @@ bool HasNonSuperior776SubfieldI(const MARC::Record::Field &field) {
 }
 
 
-void LoadSuperiorPPNs(MARC::Reader * const marc_reader, std::unordered_set<std::string> * const superior_ppns) {
+void LoadSuperiorPPNs(MARC::Reader * const marc_reader, PPNSet * const superior_ppns) {
     const std::vector<std::string> TAGS{ "800", "810", "830", "773", "776"};
     while (const MARC::Record record = marc_reader->read()) {
         for (const auto &tag : TAGS) {
@@ -68,7 +67,7 @@ void LoadSuperiorPPNs(MARC::Reader * const marc_reader, std::unordered_set<std::
                 const std::string subfield_w_contents(subfields.getFirstSubfieldWithCode('w'));
                 if (StringUtil::StartsWith(subfield_w_contents, "(DE-627)")) {
                     if (not HasNonSuperior776SubfieldI(field))
-                        superior_ppns->emplace(subfield_w_contents.substr(__builtin_strlen("(DE-627)")));
+                        superior_ppns->insert(subfield_w_contents.substr(__builtin_strlen("(DE-627)")));
                 }
             }
         }
@@ -87,7 +86,7 @@ bool SeriesHasNotBeenCompleted(const MARC::Record &record) {
 }
 
 
-void ProcessRecord(MARC::Writer * const marc_writer, const std::unordered_set<std::string> &superior_ppns,
+void ProcessRecord(MARC::Writer * const marc_writer, const PPNSet &superior_ppns,
                    MARC::Record * const record, unsigned * const modified_count)
 {
     // Don't add the flag twice:
@@ -99,8 +98,7 @@ void ProcessRecord(MARC::Writer * const marc_writer, const std::unordered_set<st
     MARC::Subfields superior_subfields;
 
     // Set the we are a "superior" record, if appropriate:
-    const auto iter(superior_ppns.find(record->getControlNumber()));
-    if (iter != superior_ppns.end())
+    if (superior_ppns.contains(record->getControlNumber()))
         superior_subfields.addSubfield('a', "1"); // Could be anything but we can't have an empty field.
 
     // Set the, you-can-subscribe-to-this flag, if appropriate:
@@ -117,7 +115,7 @@ void ProcessRecord(MARC::Writer * const marc_writer, const std::unordered_set<st
 
 
 void AddSuperiorFlag(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                     const std::unordered_set<std::string> &superior_ppns)
+                     const PPNSet &superior_ppns)
 {
     unsigned modified_count(0);
     while (MARC::Record record = marc_reader->read())
@@ -140,7 +138,7 @@ int main(int argc, char **argv) {
     const std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[2]));
 
     try {
-        std::unordered_set<std::string> superior_ppns;
+        PPNSet superior_ppns;
         LoadSuperiorPPNs(marc_reader.get(), &superior_ppns);
         marc_reader->rewind();
         AddSuperiorFlag(marc_reader.get(), marc_writer.get(), superior_ppns);
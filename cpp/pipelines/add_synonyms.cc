@@ -26,6 +26,7 @@
     a list of unused fields in the title data where the synonyms can be stored
 */
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -33,13 +34,14 @@
 #include <cstdlib>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "util.h"
 
 
-static unsigned modified_count(0);
-static unsigned record_count(0);
+static std::atomic<unsigned> modified_count(0);
+static std::atomic<unsigned> record_count(0);
 const unsigned FIELD_MIN_NON_DATA_SIZE(4); // Indicator 1 + 2, unit separator and subfield code
 const unsigned int NUMBER_OF_LANGUAGES(9);
 const std::vector<std::string> languages_to_translate{ "en", "fr", "es", "it", "hans", "hant", "pt", "ru", "el" };
@@ -311,17 +313,18 @@ void InsertSynonyms(MARC::Reader * const marc_reader, MARC::Writer * const marc_
                     const std::vector<std::map<std::string, std::vector<std::string>>> &translation_maps,
                     const std::vector<std::string> &translated_tags_and_subfield_codes)
 {
-    while (MARC::Record record = marc_reader->read()) {
+    MARC::ParallelProcessor parallel_processor(marc_reader, marc_writer);
+    parallel_processor.process([&](MARC::Record * const record) {
         bool modified_record(false);
-        ProcessRecordGermanSynonyms(&record, synonym_maps, primary_tags_and_subfield_codes, output_tags_and_subfield_codes,
+        ProcessRecordGermanSynonyms(record, synonym_maps, primary_tags_and_subfield_codes, output_tags_and_subfield_codes,
                                     &modified_record);
-        ProcessRecordTranslatedSynonyms(&record, primary_tags_and_subfield_codes, translated_tags_and_subfield_codes, translation_maps,
+        ProcessRecordTranslatedSynonyms(record, primary_tags_and_subfield_codes, translated_tags_and_subfield_codes, translation_maps,
                                         &modified_record);
-        marc_writer->write(record);
         if (modified_record)
             ++modified_count;
         ++record_count;
-    }
+        return true;
+    });
 
     std::cerr << "Modified " << modified_count << " of " << record_count << " record(s).\n";
 }
@@ -22,11 +22,13 @@
 */
 
 #include <iostream>
-#include <unordered_map>
+#include <memory>
 #include <vector>
 #include <cstdlib>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcSuperiorWorksTable.h"
+#include "PPN.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -35,26 +37,32 @@ namespace {
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " [--verbose] marc_input marc_output\n"
+    std::cerr << "Usage: " << ::progname << " [--verbose] [--superior-works-table=path] marc_input marc_output\n"
               << "       \"marc_input\" is the file that will be augmented and converted.\n"
               << "       \"marc_input\" will be scoured for titles that\n"
               << "       may be filled into 773$a fields where appropriate.\n"
-              << "       Populates 773$a where it and 773$t are both missing and uplinks exist in 773$w.\n";
+              << "       Populates 773$a where it and 773$t are both missing and uplinks exist in 773$w.\n"
+              << "       If a superior works table, as written by add_isbns_or_issns_to_articles, has been specified,\n"
+              << "       the titles will be taken from it and \"marc_input\" will only be read once.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-static std::unordered_map<std::string, std::string> control_numbers_to_titles_map;
+static PPNMap<std::string> control_numbers_to_titles_map;
 
 
 bool RecordControlNumberToTitleMapping(MARC::Record * const record) {
+    PPN ppn;
+    if (unlikely(not PPN::Parse(record->getControlNumber(), &ppn)))
+        return false; // Can't be referenced by a (DE-627) uplink.
+
     for (auto &_245_field : record->getTagRange("245")) {
         std::string title(_245_field.getFirstSubfieldWithCode('a'));
         if (_245_field.hasSubfield('b'))
             title += " " + _245_field.getFirstSubfieldWithCode('b');
         StringUtil::RightTrim(" \t/", &title);
         if (likely(not title.empty()))
-            control_numbers_to_titles_map[record->getControlNumber()] = title;
+            control_numbers_to_titles_map[ppn] = title;
     }
 
     return true;
@@ -76,16 +84,38 @@ void CollectControlNumberToTitleMappings(const bool verbose, MARC::Reader * cons
 static unsigned patch_count;
 
 
+// Uses "superior_works_table" if it is not null and our own mappings o/w.
+bool LookupTitle(const MARC::SuperiorWorksTable * const superior_works_table, const std::string &parent_control_number,
+                 std::string * const title)
+{
+    if (superior_works_table == nullptr) {
+        const auto title_ptr(control_numbers_to_titles_map.find(parent_control_number));
+        if (title_ptr == nullptr)
+            return false;
+        *title = *title_ptr;
+        return true;
+    }
+
+    MARC::SuperiorWorksTable::Info info;
+    if (not superior_works_table->lookup(parent_control_number, &info) or info.title_.empty())
+        return false;
+    *title = info.title_.toString();
+    return true;
+}
+
+
 // Looks for the existence of a 773 field.  Iff such a field exists and 773$t and 773$a is missing, we try to add it.
-bool PatchUpOne773a(MARC::Record * const record, MARC::Writer * const marc_writer) {
+bool PatchUpOne773a(MARC::Record * const record, MARC::Writer * const marc_writer,
+                    const MARC::SuperiorWorksTable * const superior_works_table)
+{
     for (auto &_773_field : record->getTagRange("773")) {
         if ((not _773_field.hasSubfield('a') and not _773_field.hasSubfield('t')) and _773_field.hasSubfield('w')) {
             const std::string w_subfield(_773_field.getFirstSubfieldWithCode('w'));
             if (StringUtil::StartsWith(w_subfield, "(DE-627)")) {
                 const std::string parent_control_number(w_subfield.substr(8));
-                const auto control_number_and_title(control_numbers_to_titles_map.find(parent_control_number));
-                if (control_number_and_title != control_numbers_to_titles_map.end()) {
-                    _773_field.insertOrReplaceSubfield('a', control_number_and_title->second);
+                std::string title;
+                if (LookupTitle(superior_works_table, parent_control_number, &title)) {
+                    _773_field.insertOrReplaceSubfield('a', title);
                     ++patch_count;
                 }
             }
@@ -99,9 +129,11 @@ bool PatchUpOne773a(MARC::Record * const record, MARC::Writer * const marc_write
 
 
 // Iterates over all records in a collection and attempts to insert 773$a subfields were they and the 773$t subfields are missing.
-void PatchUp773aSubfields(const bool verbose, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer) {
+void PatchUp773aSubfields(const bool verbose, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
+                          const MARC::SuperiorWorksTable * const superior_works_table)
+{
     while (auto record = marc_reader->read())
-        PatchUpOne773a(&record, marc_writer);
+        PatchUpOne773a(&record, marc_writer, superior_works_table);
 
     if (verbose)
         std::cout << "Added 773$a subfields to " << patch_count << " records.\n";
@@ -124,15 +156,27 @@ int Main(int argc, char **argv) {
         ++argv;
     }
 
+    std::unique_ptr<MARC::SuperiorWorksTable> superior_works_table;
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--superior-works-table=")) {
+        superior_works_table.reset(new MARC::SuperiorWorksTable(argv[1] + __builtin_strlen("--superior-works-table=")));
+        if (verbose)
+            std::cout << "Using " << superior_works_table->size() << " superior works from \""
+                      << superior_works_table->getTablePath() << "\".\n";
+        --argc;
+        ++argv;
+    }
+
     if (argc != 3)
         Usage();
 
     auto marc_reader(MARC::Reader::Factory(argv[1]));
     auto marc_writer(MARC::Writer::Factory(argv[2]));
 
-    CollectControlNumberToTitleMappings(verbose, marc_reader.get());
-    marc_reader->rewind();
-    PatchUp773aSubfields(verbose, marc_reader.get(), marc_writer.get());
+    if (superior_works_table == nullptr) {
+        CollectControlNumberToTitleMappings(verbose, marc_reader.get());
+        marc_reader->rewind();
+    }
+    PatchUp773aSubfields(verbose, marc_reader.get(), marc_writer.get(), superior_works_table.get());
 
     return EXIT_SUCCESS;
 }
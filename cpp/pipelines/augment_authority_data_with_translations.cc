@@ -20,10 +20,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
-#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <cstdlib>
@@ -33,6 +34,7 @@
 #include "DbRow.h"
 #include "IniFile.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "UBTools.h"
@@ -42,12 +44,19 @@
 namespace {
 
 
-// Save language code, translation, origin, status
-typedef std::tuple<std::string, std::string, std::string, std::string> Translation;
+// The language codes, origins and statuses are interned as there are only a handful of distinct values.
+struct Translation {
+    std::string term_;
+    const std::string *language_code_, *origin_, *status_;
+public:
+    Translation(const std::string &term, const std::string * const language_code, const std::string * const origin,
+                const std::string * const status)
+        : term_(term), language_code_(language_code), origin_(origin), status_(status) { }
+};
 
 
-static unsigned record_count(0);
-static unsigned modified_count(0);
+static std::atomic<unsigned> record_count(0);
+static std::atomic<unsigned> modified_count(0);
 
 
 [[noreturn]] void Usage() {
@@ -66,45 +75,54 @@ std::string ReplaceAngleBracketsWithParentheses(const std::string &value) {
 }
 
 
-void ExtractTranslations(DbConnection * const db_connection, std::map<std::string, std::vector<Translation>> * const all_translations) {
-    db_connection->queryOrDie("SELECT DISTINCT ppn FROM keyword_translations");
-    DbResultSet ppn_result_set(db_connection->getLastResultSet());
-    while (const DbRow ppn_row = ppn_result_set.getNextRow()) {
-        std::string ppn = ppn_row["ppn"];
-        db_connection->queryOrDie("SELECT ppn, language_code, translation, origin, status FROM keyword_translations "
-                                  "WHERE ppn='" + ppn + "'");
-        DbResultSet result_set(db_connection->getLastResultSet());
-        std::vector<Translation> translations;
-        while (const DbRow row = result_set.getNextRow()) {
-            // We are not interested in synonym fields as we will directly derive synonyms from the translation field
-            // Furthermore we insert keywords where the german translation is the reference and needs no further
-            // inserting
-            if (not IsReliableSynonym(row["status"]) and row["language_code"] != "ger") {
-                std::string translation(row["translation"]);
-                // Handle '#'-separated synonyms appropriately
-                if (translation.find('#') == std::string::npos and not translation.empty())
-                    translations.emplace_back(
-                        ReplaceAngleBracketsWithParentheses(TextUtil::CollapseAndTrimWhitespace(translation)),
-                        row["language_code"], row["origin"], row["status"]);
-                else {
-                    std::vector<std::string> primary_and_synonyms;
-                    StringUtil::SplitThenTrim(translation, "#", " \t\n\r", &primary_and_synonyms);
-		    // Use the first translation as non-synonmym
-                    if (primary_and_synonyms.size() > 0) {
-                        translations.emplace_back(TextUtil::CollapseAndTrimWhitespace(primary_and_synonyms[0]),
-                                                  row["language_code"], row["origin"], row["status"]);
-                        // Add further synonyms as derived synonyms
-                        for (auto synonyms(std::next(primary_and_synonyms.cbegin()));
-                            synonyms != primary_and_synonyms.cend(); ++synonyms) {
-                                const std::string synonym(TextUtil::CollapseAndTrimWhitespace(*synonyms));
-                                translations.emplace_back(ReplaceAngleBracketsWithParentheses(synonym),
-                                                          row["language_code"], row["origin"], "derived_synonym");
-                        }
-                    }
+// The returned pointers stay valid as long as "interned_strings" exists.
+inline const std::string *Intern(std::unordered_set<std::string> * const interned_strings, const std::string &s) {
+    return &*interned_strings->emplace(s).first;
+}
+
+
+// We use a single query instead of one per PPN, which used to take more time than everything else together.
+void ExtractTranslations(DbConnection * const db_connection, std::unordered_set<std::string> * const interned_strings,
+                         std::unordered_map<std::string, std::vector<Translation>> * const all_translations)
+{
+    db_connection->queryOrDie("SELECT ppn, language_code, translation, origin, status FROM keyword_translations");
+    DbResultSet result_set(db_connection->getLastResultSet());
+    while (const DbRow row = result_set.getNextRow()) {
+        // Every PPN gets an entry, even if we skip all of its translations:
+        std::vector<Translation> &translations((*all_translations)[row["ppn"]]);
+
+        // We are not interested in synonym fields as we will directly derive synonyms from the translation field
+        // Furthermore we insert keywords where the german translation is the reference and needs no further
+        // inserting
+        const std::string status(row["status"]), language_code(row["language_code"]);
+        if (IsReliableSynonym(status) or language_code == "ger")
+            continue;
+
+        const std::string * const interned_language_code(Intern(interned_strings, language_code));
+        const std::string * const interned_origin(Intern(interned_strings, row["origin"]));
+        const std::string * const interned_status(Intern(interned_strings, status));
+        const std::string translation(row["translation"]);
+        // Handle '#'-separated synonyms appropriately
+        if (translation.find('#') == std::string::npos and not translation.empty())
+            translations.emplace_back(ReplaceAngleBracketsWithParentheses(TextUtil::CollapseAndTrimWhitespace(translation)),
+                                      interned_language_code, interned_origin, interned_status);
+        else {
+            std::vector<std::string> primary_and_synonyms;
+            StringUtil::SplitThenTrim(translation, "#", " \t\n\r", &primary_and_synonyms);
+            // Use the first translation as non-synonmym
+            if (primary_and_synonyms.size() > 0) {
+                translations.emplace_back(TextUtil::CollapseAndTrimWhitespace(primary_and_synonyms[0]),
+                                          interned_language_code, interned_origin, interned_status);
+                // Add further synonyms as derived synonyms
+                const std::string * const derived_synonym_status(Intern(interned_strings, "derived_synonym"));
+                for (auto synonyms(std::next(primary_and_synonyms.cbegin()));
+                    synonyms != primary_and_synonyms.cend(); ++synonyms) {
+                        const std::string synonym(TextUtil::CollapseAndTrimWhitespace(*synonyms));
+                        translations.emplace_back(ReplaceAngleBracketsWithParentheses(synonym), interned_language_code,
+                                                  interned_origin, derived_synonym_status);
                 }
             }
         }
-        all_translations->insert(std::make_pair(ppn, translations));
     }
 }
 
@@ -138,7 +156,7 @@ bool HasExistingTranslation(const MARC::Record &record, const std::string &langu
 
 
 void ProcessRecord(MARC::Record * const record,
-                   const std::map<std::string, std::vector<Translation> > &all_translations)
+                   const std::unordered_map<std::string, std::vector<Translation>> &all_translations)
 {
     const std::string ppn(record->getControlNumber());
     auto one_translation(all_translations.find(ppn));
@@ -146,10 +164,9 @@ void ProcessRecord(MARC::Record * const record,
     if (one_translation != all_translations.cend()) {
         // We only insert/replace IxTheo-Translations
         for (const auto &one_lang_translation : one_translation->second) {
-            std::string term(std::get<0>(one_lang_translation));
-            std::string language_code(std::get<1>(one_lang_translation));
-            std::string origin(std::get<2>(one_lang_translation));
-            std::string status(std::get<3>(one_lang_translation));
+            const std::string &term(one_lang_translation.term_);
+            const std::string &language_code(*one_lang_translation.language_code_);
+            const std::string &status(*one_lang_translation.status_);
 
             // Skip non-derived synonyms, german terms and unreliable translations
             if ((status != "derived_synonym" and StringUtil::EndsWith(status, "synonym")) or status == "unreliable"
@@ -165,15 +182,16 @@ void ProcessRecord(MARC::Record * const record,
 }
 
 
-void AugmentNormdata(MARC::Reader * const marc_reader, MARC::Writer *marc_writer, const std::map<std::string,
-                     std::vector<Translation> > &all_translations)
+// The records are processed concurrently but written in their original order.
+void AugmentNormdata(MARC::Reader * const marc_reader, MARC::Writer *marc_writer,
+                     const std::unordered_map<std::string, std::vector<Translation>> &all_translations)
 {
-    // Read in all PPNs from authority data
-    while (MARC::Record record = marc_reader->read()) {
-        ProcessRecord(&record, all_translations);
-        marc_writer->write(record);
+    MARC::ParallelProcessor parallel_processor(marc_reader, marc_writer);
+    parallel_processor.process([&](MARC::Record * const record) {
+        ProcessRecord(record, all_translations);
         ++record_count;
-    }
+        return true;
+    });
 
     std::cerr << "Modified " << modified_count << " of " << record_count << " entries.\n";
 }
@@ -206,8 +224,9 @@ int Main(int argc, char **argv) {
     const std::string sql_password(ini_file.getString("Database", "sql_password"));
     DbConnection db_connection(sql_database, sql_username, sql_password);
 
-    std::map<std::string, std::vector<Translation> > all_translations;
-    ExtractTranslations(&db_connection, &all_translations);
+    std::unordered_set<std::string> interned_strings;
+    std::unordered_map<std::string, std::vector<Translation>> all_translations;
+    ExtractTranslations(&db_connection, &interned_strings, &all_translations);
 
     AugmentNormdata(marc_reader.get(), marc_writer.get(), all_translations);
 
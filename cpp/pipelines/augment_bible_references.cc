@@ -21,10 +21,12 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -34,6 +36,7 @@
 #include "BibleUtil.h"
 #include "MapUtil.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "UBTools.h"
@@ -45,7 +48,11 @@ namespace {
 
 [[noreturn]] void Usage() {
     std::cerr << "Usage: " << ::progname
-              << " ix_theo_titles ix_theo_norm augmented_ix_theo_titles\n";
+              << " ix_theo_titles ix_theo_norm augmented_ix_theo_titles [bible_ranges_index [bible_ref_suggestions_index]]\n"
+              << "       If \"bible_ranges_index\" has been specified, a BibleUtil::RangeIndex over all generated ranges will be\n"
+              << "       written to it.  If \"bible_ref_suggestions_index\" has been specified, a BibleUtil::SuggestionIndex\n"
+              << "       for the autocompletion of bible references, ranked by the number of referring records, will be\n"
+              << "       written to it.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -410,40 +417,50 @@ bool FindGndCodes(const std::string &tags, const MARC::Record &record,
 /* Augments MARC title records that contain bible references by pointing at bible reference norm data records
    by adding a new MARC field with tag BIB_REF_RANGE_TAG.  This field is filled in with bible ranges. */
 void AugmentBibleRefs(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                      const std::unordered_map<std::string, std::set<std::pair<std::string, std::string>>> &gnd_codes_to_bible_ref_codes_map)
+                      const std::unordered_map<std::string, std::set<std::pair<std::string, std::string>>> &gnd_codes_to_bible_ref_codes_map,
+                      std::vector<BibleUtil::RangeIndex::PPNAndRange> * const ppns_and_ranges)
 {
     LOG_INFO("Starting augmentation of title records.");
 
-    unsigned total_count(0), augment_count(0);
-    while (MARC::Record record = marc_reader->read()) {
+    std::atomic<unsigned> augment_count(0);
+    std::mutex ppns_and_ranges_mutex;
+    MARC::ParallelProcessor parallel_processor(marc_reader, marc_writer);
+    const size_t total_count(parallel_processor.process([&](MARC::Record * const record) {
         try {
-            ++total_count;
-
             // Make sure that we don't use a bible reference tag that is already in use for another
             // purpose:
-            auto bible_reference_tag_field(record.findTag(BibleUtil::BIB_REF_RANGE_TAG));
-            if (bible_reference_tag_field != record.end())
+            auto bible_reference_tag_field(record->findTag(BibleUtil::BIB_REF_RANGE_TAG));
+            if (bible_reference_tag_field != record->end())
                 LOG_ERROR("We need another bible reference tag than \"" + BibleUtil::BIB_REF_RANGE_TAG + "\"!");
 
             std::set<std::string> ranges;
-            if (FindGndCodes("600:610:611:630:648:651:655:689", record, gnd_codes_to_bible_ref_codes_map, &ranges)) {
+            if (FindGndCodes("600:610:611:630:648:651:655:689", *record, gnd_codes_to_bible_ref_codes_map, &ranges)) {
                 ++augment_count;
                 std::string range_string;
+                std::vector<BibleUtil::RangeIndex::PPNAndRange> record_ppns_and_ranges;
                 for (auto &range : ranges) {
                     if (not range_string.empty())
                         range_string += ',';
                     range_string += StringUtil::Map(range, ':', '_');
+
+                    uint32_t start, end;
+                    if (unlikely(not BibleUtil::RangeIndex::ParseRange(range, &start, &end)))
+                        LOG_ERROR("bad range \"" + range + "\"!");
+                    record_ppns_and_ranges.emplace_back(record->getControlNumber(), start, end);
                 }
 
+                std::lock_guard<std::mutex> ppns_and_ranges_locker(ppns_and_ranges_mutex);
+                ppns_and_ranges->insert(ppns_and_ranges->end(), record_ppns_and_ranges.cbegin(), record_ppns_and_ranges.cend());
+
                 // Put the data into the $a subfield:
-                record.insertField(BibleUtil::BIB_REF_RANGE_TAG, { { 'a', range_string }, { 'b', "biblesearch" } });
+                record->insertField(BibleUtil::BIB_REF_RANGE_TAG, { { 'a', range_string }, { 'b', "biblesearch" } });
             }
-
-            marc_writer->write(record);
         } catch (const std::exception &x) {
-            LOG_ERROR("caught exception for title record w/ PPN " + record.getControlNumber() + ": " + std::string(x.what()));
+            LOG_ERROR("caught exception for title record w/ PPN " + record->getControlNumber() + ": " + std::string(x.what()));
         }
-    }
+
+        return true;
+    }));
 
     LOG_INFO("Augmented the " + BibleUtil::BIB_REF_RANGE_TAG + "$a field of " + std::to_string(augment_count)
              + " records of a total of " + std::to_string(total_count) + " records.");
@@ -454,7 +471,7 @@ void AugmentBibleRefs(MARC::Reader * const marc_reader, MARC::Writer * const mar
 
 
 int Main(int argc, char **argv) {
-    if (argc < 3)
+    if (argc < 4 or argc > 6)
         Usage();
 
     const std::string title_input_filename(argv[1]);
@@ -480,7 +497,23 @@ int Main(int argc, char **argv) {
     std::unordered_map<std::string, std::set<std::pair<std::string, std::string>>> gnd_codes_to_bible_ref_codes_map;
     LoadNormData(books_of_the_bible_to_code_map, authority_reader.get(),
                  &gnd_codes_to_bible_ref_codes_map);
-    AugmentBibleRefs(title_reader.get(), title_writer.get(), gnd_codes_to_bible_ref_codes_map);
+    std::vector<BibleUtil::RangeIndex::PPNAndRange> ppns_and_ranges;
+    AugmentBibleRefs(title_reader.get(), title_writer.get(), gnd_codes_to_bible_ref_codes_map, &ppns_and_ranges);
+
+    if (argc == 5) {
+        const BibleUtil::RangeIndex range_index(ppns_and_ranges);
+        range_index.write(argv[4]);
+        LOG_INFO("Wrote an index of " + std::to_string(range_index.size()) + " bible ranges to \"" + std::string(argv[4]) + "\".");
+    }
+
+    if (argc == 6) {
+        const BibleUtil::SuggestionIndex suggestion_index(ppns_and_ranges,
+                                                          UBTools::GetTuelibPath() + "bibleRef/books_of_the_bible_to_canonical_form.map",
+                                                          books_of_the_bible_to_code_map_filename);
+        suggestion_index.write(argv[5]);
+        LOG_INFO("Wrote " + std::to_string(suggestion_index.size()) + " bible reference suggestions to \"" + std::string(argv[5])
+                 + "\".");
+    }
 
     return EXIT_SUCCESS;
 }
@@ -20,16 +20,15 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <unordered_map>
 #include <cstdlib>
-#include <strings.h>
-#include "BibleUtil.h"
+#include "CanonLawUtil.h"
 #include "Compiler.h"
 #include "MARC.h"
-#include "MiscUtil.h"
-#include "RegexMatcher.h"
+#include "MarcParallelProcessor.h"
 #include "StringUtil.h"
 #include "UBTools.h"
 #include "util.h"
@@ -38,71 +37,6 @@
 namespace {
 
 
-// To understand this code read https://github.com/ubtue/tuefind/wiki/Codices
-std::string FieldToCanonLawCode(const std::string &ppn, const std::string &subfield_codex, const std::string &subfield_year,
-                                const std::string &subfield_part)
-{
-    enum Codex { CIC1917, CIC1983, CCEO } codex;
-    if (::strcasecmp(subfield_codex.c_str(), "Codex canonum ecclesiarum orientalium") == 0)
-        codex = CCEO;
-    else {
-        if (unlikely(subfield_year.empty()))
-            LOG_ERROR("missing year for Codex Iuris Canonici! (PPN: " + ppn + ")");
-        if (subfield_year == "1917")
-            codex = CIC1917;
-        else if (subfield_year == "1983")
-            codex = CIC1983;
-        else
-            LOG_ERROR("bad year for Codex Iuris Canonici \"" + subfield_year + "\"! (PPN: " + ppn + ")");
-    }
-
-    unsigned range_start, range_end;
-    if (subfield_part.empty()) {
-        range_start = 0;
-        range_end = 99999999;
-    } else if (not MiscUtil::ParseCanonLawRanges(subfield_part, &range_start, &range_end))
-        LOG_ERROR("don't know how to parse codex parts \"" + subfield_part + "\"! (PPN: " + ppn + ")");
-
-    switch (codex) {
-    case CIC1917:
-        return StringUtil::ToString(100000000 + range_start) + "_" + StringUtil::ToString(100000000 + range_end);
-    case CIC1983:
-        return StringUtil::ToString(200000000 + range_start) + "_" + StringUtil::ToString(200000000 + range_end);
-    case CCEO:
-        return StringUtil::ToString(300000000 + range_start) + "_" + StringUtil::ToString(300000000 + range_end);
-    default:
-        LOG_ERROR("unknown codex: " + std::to_string(codex));
-    }
-}
-
-
-void LoadAuthorityData(MARC::Reader * const reader,
-                       std::unordered_map<std::string, std::string> * const authority_ppns_to_canon_law_codes_map)
-{
-    unsigned total_count(0);
-    while (auto record = reader->read()) {
-        ++total_count;
-
-        const auto _110_field(record.findTag("110"));
-        if (_110_field == record.end() or ::strcasecmp(_110_field->getFirstSubfieldWithCode('a').c_str(), "Katholische Kirche") != 0)
-            continue;
-
-        const std::string t_subfield(_110_field->getFirstSubfieldWithCode('t'));
-        if (::strcasecmp(t_subfield.c_str(),"Codex Iuris Canonici") != 0
-            and ::strcasecmp(t_subfield.c_str(), "Codex canonum ecclesiarum orientalium") != 0)
-            continue;
-
-        (*authority_ppns_to_canon_law_codes_map)[record.getControlNumber()] = FieldToCanonLawCode(record.getControlNumber(),
-                                                                                                  t_subfield,
-                                                                                                  _110_field->getFirstSubfieldWithCode('f'),
-                                                                                                  _110_field->getFirstSubfieldWithCode('p'));
-    }
-
-    LOG_INFO("found " + std::to_string(authority_ppns_to_canon_law_codes_map->size()) + " canon law records among "
-             + std::to_string(total_count) + " authority records.");
-}
-
-
 void CollectAuthorityPPNs(const MARC::Record &record, const MARC::Tag &linking_field, std::vector<std::string> * const authority_ppns) {
     for (const auto &field : record.getTagRange(linking_field)) {
         const MARC::Subfields subfields(field.getSubfields());
@@ -114,29 +48,30 @@ void CollectAuthorityPPNs(const MARC::Record &record, const MARC::Tag &linking_f
 }
 
 
+// The records are processed concurrently but written in their original order.
 void ProcessRecords(MARC::Reader * const reader, MARC::Writer * const writer,
                     const std::unordered_map<std::string, std::string> &authority_ppns_to_canon_law_codes_map)
 {
     static const std::vector<std::string> CANONES_GND_LINKING_TAGS{ "689", "655" };
 
-    unsigned total_count(0), augmented_count(0);
-    std::map<std::string, unsigned> reference_counts;
-
-    while (auto record = reader->read()) {
+    std::atomic<unsigned> total_count(0), augmented_count(0), _689_reference_count(0), _655_reference_count(0),
+                          direct_689_reference_count(0);
+    MARC::ParallelProcessor parallel_processor(reader, writer);
+    parallel_processor.process([&](MARC::Record * const record) {
         ++total_count;
 
         bool augmented_record(false);
         for (const auto &linking_tag : CANONES_GND_LINKING_TAGS) {
             std::vector<std::string> authority_ppns;
-            CollectAuthorityPPNs(record, linking_tag, &authority_ppns);
+            CollectAuthorityPPNs(*record, linking_tag, &authority_ppns);
 
             if (not authority_ppns.empty()) {
                 for (const auto &authority_ppn : authority_ppns) {
                     const auto ppn_and_canon_law_code(authority_ppns_to_canon_law_codes_map.find(authority_ppn));
                     if (ppn_and_canon_law_code != authority_ppns_to_canon_law_codes_map.cend()) {
-                        record.insertField("CAL", { { 'a', ppn_and_canon_law_code->second } });
+                        record->insertField("CAL", { { 'a', ppn_and_canon_law_code->second } });
                         augmented_record = true;
-                        ++reference_counts[linking_tag];
+                        ++(linking_tag == "689" ? _689_reference_count : _655_reference_count);
                     }
                 }
             }
@@ -146,7 +81,7 @@ void ProcessRecords(MARC::Reader * const reader, MARC::Writer * const writer,
             // check if the codex data is embedded directly in the 689 field
             // apparently, 689$t is repeatable and the first instance (always?) appears to be 'Katholische Kirche'
             std::vector<std::string> ranges_to_insert;
-            for (const auto &_689_field : record.getTagRange("689")) {
+            for (const auto &_689_field : record->getTagRange("689")) {
                 if (_689_field.getFirstSubfieldWithCode('a') != "Katholische Kirche")
                     continue;
 
@@ -161,27 +96,27 @@ void ProcessRecords(MARC::Reader * const reader, MARC::Writer * const writer,
                 }
 
                 if (not subfield_codex.empty() and not subfield_year.empty() and not subfield_part.empty()) {
-                    ranges_to_insert.emplace_back(FieldToCanonLawCode(record.getControlNumber(), subfield_codex, subfield_year,
-                                                                      subfield_part));
+                    ranges_to_insert.emplace_back(CanonLawUtil::FieldToCanonLawCode(record->getControlNumber(), subfield_codex,
+                                                                                    subfield_year, subfield_part));
                     augmented_record = true;
-                    ++reference_counts["689*"];
+                    ++direct_689_reference_count;
                 }
             }
 
             for (const auto &range : ranges_to_insert)
-                record.insertField("CAL", { { 'a', range } });
+                record->insertField("CAL", { { 'a', range } });
         }
 
         if (augmented_record)
             ++augmented_count;
 
-        writer->write(record);
-    }
+        return true;
+    });
 
     LOG_INFO("augmented " + std::to_string(augmented_count) + " of " + std::to_string(total_count) + " records.");
-    LOG_INFO("found " + std::to_string(reference_counts["689"]) + " references in field 689");
-    LOG_INFO("found " + std::to_string(reference_counts["689*"]) + " direct references in field 689");
-    LOG_INFO("found " + std::to_string(reference_counts["655"]) + " references in field 655");
+    LOG_INFO("found " + std::to_string(_689_reference_count) + " references in field 689");
+    LOG_INFO("found " + std::to_string(direct_689_reference_count) + " direct references in field 689");
+    LOG_INFO("found " + std::to_string(_655_reference_count) + " references in field 655");
 }
 
 
@@ -202,9 +137,8 @@ int Main(int argc, char **argv) {
     if (unlikely(title_output_filename == authority_filename))
         LOG_ERROR("Title output file name equals authority file name!");
 
-    auto authority_reader(MARC::Reader::Factory(authority_filename));
     std::unordered_map<std::string, std::string> authority_ppns_to_canon_law_codes_map;
-    LoadAuthorityData(authority_reader.get(), &authority_ppns_to_canon_law_codes_map);
+    CanonLawUtil::LoadAuthorityPPNsToCanonLawCodes(authority_filename, &authority_ppns_to_canon_law_codes_map);
 
     auto title_reader(MARC::Reader::Factory(title_input_filename));
     auto title_writer(MARC::Writer::Factory(title_output_filename));
@@ -0,0 +1,216 @@
+/** \brief Compares the phase statistics of a pipeline run against a baseline run.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+const unsigned DEFAULT_WALL_TIME_TOLERANCE(15); // in percent
+const unsigned DEFAULT_CPU_TIME_TOLERANCE(15);  // in percent
+const unsigned DEFAULT_RSS_TOLERANCE(10);       // in percent
+const double DEFAULT_MIN_WALL_TIME(2.0);        // in seconds
+
+
+[[noreturn]] void Usage() {
+    ::Usage("[--wall-time-tolerance=percent] [--cpu-time-tolerance=percent] [--rss-tolerance=percent]\n"
+            "       [--min-wall-time=seconds] [--record-count=count] current_history baseline_history\n"
+            "Both histories are in the format written by phase_monitor.  Compares the wall-clock time, the CPU time and the\n"
+            "maximum RSS of each successful phase of \"current_history\" to the same phase of \"baseline_history\".\n"
+            "If a phase ran more than once, e.g. the same tool at the beginning and the end of a pipeline, the n-th run\n"
+            "in one history is compared to the n-th run in the other.  Phases that took less than --min-wall-time seconds\n"
+            "in the baseline, " + std::to_string(DEFAULT_MIN_WALL_TIME) + " by default, are reported but never considered\n"
+            "to be regressions as their timings are dominated by noise.  The default tolerances are "
+            + std::to_string(DEFAULT_WALL_TIME_TOLERANCE) + "%, " + std::to_string(DEFAULT_CPU_TIME_TOLERANCE) + "% and "
+            + std::to_string(DEFAULT_RSS_TOLERANCE) + "%.\n"
+            "If --record-count has been specified, the throughput of each phase in records/s is reported as well.\n"
+            "The exit code is 0 if there were no regressions and 1 o/w.");
+}
+
+
+// History columns: timestamp, phase name, wall time, user CPU time, system CPU time, max. RSS in KiB, bytes read,
+// bytes written and exit code.  (See phase_monitor.)
+enum HistoryColumn { TIMESTAMP, PHASE_NAME, WALL_TIME, USER_CPU_TIME, SYSTEM_CPU_TIME, MAX_RSS_KB, READ_BYTES, WRITE_BYTES,
+                     EXIT_CODE, COLUMN_COUNT };
+
+
+// Negative values mean unknown, e.g. for phases that were recorded w/ phase_monitor's --wall-time.
+struct PhaseStats {
+    std::string phase_key_;
+    double wall_time_, cpu_time_;
+    long max_rss_kb_;
+};
+
+
+double ToDoubleOrUnknown(const std::string &column) {
+    double value;
+    return StringUtil::ToDouble(column, &value) ? value : -1.0;
+}
+
+
+// \return The successful runs in "history_path" in chronological order.  The n-th run (n > 1) of a phase gets " #n"
+//         appended to its name so that phases that run more than once can be matched up.
+std::vector<PhaseStats> LoadHistory(const std::string &history_path) {
+    std::vector<PhaseStats> history;
+    std::map<std::string, unsigned> phase_names_to_run_counts;
+    for (const auto &line : FileUtil::ReadLines(history_path, FileUtil::ReadLines::DO_NOT_TRIM)) {
+        if (line.empty() or line[0] == '#')
+            continue;
+
+        std::vector<std::string> columns;
+        StringUtil::Split(line, '\t', &columns, /* suppress_empty_components = */false);
+        if (columns.size() != COLUMN_COUNT)
+            LOG_ERROR("bad line in \"" + history_path + "\": " + line);
+        if (columns[EXIT_CODE] != "0")
+            continue;
+
+        const unsigned run_count(++phase_names_to_run_counts[columns[PHASE_NAME]]);
+        PhaseStats phase_stats;
+        phase_stats.phase_key_ = columns[PHASE_NAME] + (run_count == 1 ? "" : " #" + std::to_string(run_count));
+        phase_stats.wall_time_ = ToDoubleOrUnknown(columns[WALL_TIME]);
+        const double user_cpu_time(ToDoubleOrUnknown(columns[USER_CPU_TIME]));
+        const double system_cpu_time(ToDoubleOrUnknown(columns[SYSTEM_CPU_TIME]));
+        phase_stats.cpu_time_ = (user_cpu_time < 0.0 or system_cpu_time < 0.0) ? -1.0 : user_cpu_time + system_cpu_time;
+        phase_stats.max_rss_kb_ = static_cast<long>(ToDoubleOrUnknown(columns[MAX_RSS_KB]));
+        history.emplace_back(phase_stats);
+    }
+
+    return history;
+}
+
+
+std::string FormatValue(const double value, const int precision) {
+    if (value < 0.0)
+        return "-";
+    std::ostringstream output;
+    output << std::fixed << std::setprecision(precision) << value;
+    return output.str();
+}
+
+
+// \return The change from "baseline" to "current" in percent, e.g. "+12%", or "-" if either is unknown.
+std::string FormatChange(const double current, const double baseline) {
+    if (current < 0.0 or baseline <= 0.0)
+        return "-";
+    const int change(static_cast<int>((current / baseline - 1.0) * 100.0 + (current >= baseline ? 0.5 : -0.5)));
+    return (change >= 0 ? "+" : "") + std::to_string(change) + "%";
+}
+
+
+inline bool IsRegression(const double current, const double baseline, const unsigned tolerance) {
+    return current >= 0.0 and baseline > 0.0 and current > baseline * (1.0 + tolerance / 100.0);
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    unsigned wall_time_tolerance(DEFAULT_WALL_TIME_TOLERANCE), cpu_time_tolerance(DEFAULT_CPU_TIME_TOLERANCE),
+             rss_tolerance(DEFAULT_RSS_TOLERANCE), record_count(0);
+    double min_wall_time(DEFAULT_MIN_WALL_TIME);
+    for (;;) {
+        if (argc > 1 and StringUtil::StartsWith(argv[1], "--wall-time-tolerance=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--wall-time-tolerance="), &wall_time_tolerance))
+                LOG_ERROR("bad wall-clock time tolerance!");
+        } else if (argc > 1 and StringUtil::StartsWith(argv[1], "--cpu-time-tolerance=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--cpu-time-tolerance="), &cpu_time_tolerance))
+                LOG_ERROR("bad CPU time tolerance!");
+        } else if (argc > 1 and StringUtil::StartsWith(argv[1], "--rss-tolerance=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--rss-tolerance="), &rss_tolerance))
+                LOG_ERROR("bad RSS tolerance!");
+        } else if (argc > 1 and StringUtil::StartsWith(argv[1], "--min-wall-time=")) {
+            if (not StringUtil::ToDouble(argv[1] + __builtin_strlen("--min-wall-time="), &min_wall_time) or min_wall_time < 0.0)
+                LOG_ERROR("bad minimum wall-clock time!");
+        } else if (argc > 1 and StringUtil::StartsWith(argv[1], "--record-count=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--record-count="), &record_count))
+                LOG_ERROR("bad record count!");
+        } else
+            break;
+        --argc, ++argv;
+    }
+
+    if (argc != 3)
+        Usage();
+
+    const auto current_history(LoadHistory(argv[1]));
+    std::map<std::string, PhaseStats> baseline_phase_keys_to_stats;
+    for (const auto &phase_stats : LoadHistory(argv[2]))
+        baseline_phase_keys_to_stats.emplace(phase_stats.phase_key_, phase_stats);
+
+    std::cout << std::left << std::setw(60) << "phase" << std::right << std::setw(10) << "wall (s)" << std::setw(8) << "diff"
+              << std::setw(10) << "CPU (s)" << std::setw(8) << "diff" << std::setw(12) << "RSS (KiB)" << std::setw(8) << "diff";
+    if (record_count > 0)
+        std::cout << std::setw(12) << "records/s";
+    std::cout << '\n';
+
+    unsigned regression_count(0);
+    for (const auto &current : current_history) {
+        const auto baseline_phase_key_and_stats(baseline_phase_keys_to_stats.find(current.phase_key_));
+        if (baseline_phase_key_and_stats == baseline_phase_keys_to_stats.end()) {
+            LOG_WARNING("phase \"" + current.phase_key_ + "\" is missing from the baseline!");
+            continue;
+        }
+        const PhaseStats &baseline(baseline_phase_key_and_stats->second);
+
+        std::vector<std::string> regressions;
+        if (baseline.wall_time_ >= min_wall_time) {
+            if (IsRegression(current.wall_time_, baseline.wall_time_, wall_time_tolerance))
+                regressions.emplace_back("wall-clock time");
+            if (IsRegression(current.cpu_time_, baseline.cpu_time_, cpu_time_tolerance))
+                regressions.emplace_back("CPU time");
+            if (IsRegression(current.max_rss_kb_, baseline.max_rss_kb_, rss_tolerance))
+                regressions.emplace_back("RSS");
+        }
+
+        std::cout << std::left << std::setw(60) << current.phase_key_.substr(0, 59) << std::right
+                  << std::setw(10) << FormatValue(current.wall_time_, 2)
+                  << std::setw(8) << FormatChange(current.wall_time_, baseline.wall_time_)
+                  << std::setw(10) << FormatValue(current.cpu_time_, 2)
+                  << std::setw(8) << FormatChange(current.cpu_time_, baseline.cpu_time_)
+                  << std::setw(12) << FormatValue(current.max_rss_kb_, 0)
+                  << std::setw(8) << FormatChange(current.max_rss_kb_, baseline.max_rss_kb_);
+        if (record_count > 0)
+            std::cout << std::setw(12) << (current.wall_time_ > 0.0 ? FormatValue(record_count / current.wall_time_, 0) : "-");
+        if (not regressions.empty()) {
+            std::cout << "  REGRESSION (" << StringUtil::Join(regressions, ", ") << ')';
+            ++regression_count;
+        }
+        std::cout << '\n';
+        baseline_phase_keys_to_stats.erase(baseline_phase_key_and_stats);
+    }
+
+    for (const auto &phase_key_and_stats : baseline_phase_keys_to_stats)
+        LOG_WARNING("baseline phase \"" + phase_key_and_stats.first + "\" is missing from the current run!");
+
+    if (regression_count > 0) {
+        std::cout << regression_count << " phase(s) exceeded their tolerances.\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
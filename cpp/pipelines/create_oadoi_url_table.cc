@@ -0,0 +1,62 @@
+/** \brief Creates the memory-mappable DOI to open access URL table that add_oa_urls uses.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "OADOIUrlTable.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--only-if-stale] doi_to_url_map.json\n"
+              << "       Writes doi_to_url_map.json.table which can then be used by add_oa_urls w/o having to parse\n"
+              << "       doi_to_url_map.json.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    bool only_if_stale(false);
+    if (std::strcmp(argv[1], "--only-if-stale") == 0) {
+        only_if_stale = true;
+        --argc, ++argv;
+    }
+
+    if (argc != 2)
+        Usage();
+
+    const std::string json_filename(argv[1]);
+    if (only_if_stale and OADOIUrlTable::IsUpToDate(json_filename)) {
+        LOG_INFO("\"" + OADOIUrlTable::GetTablePath(json_filename) + "\" is up to date.");
+        return EXIT_SUCCESS;
+    }
+
+    LOG_INFO("Stored " + std::to_string(OADOIUrlTable::Create(json_filename)) + " DOI(s).");
+
+    return EXIT_SUCCESS;
+}
@@ -81,25 +81,21 @@ void FilterOutStopwords(const std::unordered_set<std::string> &stopwords,
 }
 
 
-std::string VectorToString(const std::vector<std::string> &v) {
-    std::string vector_as_string;
-    for (std::vector<std::string>::const_iterator entry(v.cbegin()); entry != v.cend(); ++entry) {
-        vector_as_string += *entry;
-        if ((entry + 1) != v.cend())
-            vector_as_string += ' ';
-    }
-    return vector_as_string;
-}
-
-
 auto constexpr MIN_WORD_LENGTH(3); // At least this many characters have to be in a word for to consider it
                                    // to be "interesting".
 
 
 inline std::string FilterOutNonwordChars(const std::string &phrase) {
-    std::vector<std::string> phrase_as_vector;
-    TextUtil::ChopIntoWords(phrase, &phrase_as_vector, MIN_WORD_LENGTH);
-    return VectorToString(phrase_as_vector);
+    std::string filtered_phrase;
+    filtered_phrase.reserve(phrase.size());
+    TextUtil::WordTokenizer tokenizer(phrase, MIN_WORD_LENGTH);
+    StringView word;
+    while (tokenizer.next(&word)) {
+        if (not filtered_phrase.empty())
+            filtered_phrase += ' ';
+        filtered_phrase.append(word.data(), word.size());
+    }
+    return tokenizer.hasError() ? std::string() : filtered_phrase;
 }
 
 
@@ -108,7 +104,7 @@ inline std::string FilterOutNonwordChars(const std::string &phrase) {
 // The former maps from each individual stemmed word to the entire cleaned up and stemmed key phrase and the
 // latter maps from the cleaned up and stemmed key phrase to the original key phrase.
 void ProcessKeywordPhrase(
-    const std::string &keyword_phrase, const Stemmer * const stemmer,
+    const std::string &keyword_phrase, const CachingStemmer * const stemmer,
     std::unordered_map<std::string, std::set<std::string>> * const stemmed_keyword_to_stemmed_keyphrases_map,
     std::unordered_map<std::string, std::string> * const stemmed_keyphrases_to_unstemmed_keyphrases_map)
 {
@@ -157,7 +153,7 @@ std::string CanonizeCentury(const std::string &century_candidate) {
 
 size_t ExtractKeywordsFromKeywordChainFields(
     const MARC::Record &record,
-    const Stemmer * const stemmer,
+    const CachingStemmer * const stemmer,
     std::unordered_map<std::string, std::set<std::string>> * const stemmed_keyword_to_stemmed_keyphrases_map,
     std::unordered_map<std::string, std::string> * const stemmed_keyphrases_to_unstemmed_keyphrases_map)
 {
@@ -187,7 +183,8 @@ size_t ExtractAllKeywords(
     std::unordered_map<std::string, std::string> * const stemmed_keyphrases_to_unstemmed_keyphrases_map)
 {
     const std::string language_code(MARC::GetLanguageCode(record));
-    const Stemmer * const stemmer(language_code.empty() ? nullptr : Stemmer::StemmerFactory(language_code));
+    const CachingStemmer * const stemmer(language_code.empty() ? nullptr
+                                                               : CachingStemmer::CachingStemmerFactory(language_code));
 
     size_t extracted_count(ExtractKeywordsFromKeywordChainFields(record, stemmer,
                                                                  stemmed_keyword_to_stemmed_keyphrases_map,
@@ -297,7 +294,8 @@ void AugmentRecordsWithTitleKeywords(
         }
 
         // If we have an appropriate stemmer, replace the title words w/ stemmed title words:
-        const Stemmer * const stemmer(language_code.empty() ? nullptr : Stemmer::StemmerFactory(language_code));
+        const CachingStemmer * const stemmer(language_code.empty() ? nullptr
+                                                               : CachingStemmer::CachingStemmerFactory(language_code));
         if (stemmer != nullptr) {
             std::vector<std::string> stemmed_title_words;
             for (const auto &title_word : title_words)
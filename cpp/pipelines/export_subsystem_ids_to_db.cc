@@ -20,15 +20,19 @@
     You should have received a copy of the GNU Affero General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include "Compiler.h"
+#include "DbBulkInserter.h"
 #include "DbConnection.h"
 #include "MARC.h"
+#include "MarcColumnFile.h"
 #include "util.h"
 #include "VuFind.h"
 
@@ -41,19 +45,14 @@ const std::vector<Subsystem> SUBSYSTEMS{ RELBIB, BIBSTUDIES };
 
 
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << ::progname << " marc_input\n";
+    std::cerr << "Usage: " << ::progname << " [--load-data-local-infile] (marc_input|column_file)\n"
+              << "       --load-data-local-infile requires local_infile to be enabled on the MySQL server.\n"
+              << "       A column file, as written by the write_columns pipeline stage, is much faster to read than the\n"
+              << "       MARC data.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-void InsertToDatabase(DbConnection * const db_connection, std::string * const insert_statement) {
-    // Remove trailing comma and space:
-    insert_statement->resize(insert_statement->size() - 2);
-    *insert_statement += ';';
-    db_connection->queryOrDie(*insert_statement);
-}
-
-
 std::string GetSubsystemTag(const Subsystem subsystem) {
     const std::string RELBIB_TAG("REL");
     const std::string BIBSTUDIES_TAG("BIB");
@@ -78,29 +77,18 @@ std::string GetSubsystemName(const Subsystem subsystem) {
 }
 
 
-void InsertIntoSql(DbConnection * const db_connection, const Subsystem subsystem, const std::set<std::string> &subsystem_record_ids) {
+void InsertIntoSql(DbConnection * const db_connection, const Subsystem subsystem, const std::set<std::string> &subsystem_record_ids,
+                   const DbBulkInserter::Method bulk_insert_method)
+{
     if (subsystem_record_ids.empty())
         return;
 
     const std::string subsystem_id_table(GetSubsystemName(subsystem) + "_ids");
     db_connection->queryOrDie("TRUNCATE " + subsystem_id_table);
 
-    const std::string INSERT_STATEMENT_START("INSERT INTO " + subsystem_id_table + "(record_id) VALUES");
-    std::string insert_statement(INSERT_STATEMENT_START);
-    size_t row_counter(0);
-    const size_t MAX_ROW_COUNT(10000);
-
-
-    for (const auto &record_id : subsystem_record_ids) {
-        insert_statement += "('" + record_id + "'), ";
-        if (++row_counter > MAX_ROW_COUNT) {
-            InsertToDatabase(db_connection, &insert_statement);
-            insert_statement = INSERT_STATEMENT_START;
-            row_counter = 0;
-        }
-
-    }
-    InsertToDatabase(db_connection, &insert_statement);
+    DbBulkInserter bulk_inserter(db_connection, subsystem_id_table, { "record_id" }, DbConnection::DKB_FAIL, bulk_insert_method);
+    for (const auto &record_id : subsystem_record_ids)
+        bulk_inserter.insert({ record_id });
 }
 
 
@@ -114,6 +102,20 @@ void ExtractIDsForSubsystems(MARC::Reader * const marc_reader, std::vector<std::
 }
 
 
+void ExtractIDsForSubsystems(MARC::ColumnFileReader * const column_file_reader,
+                             std::vector<std::set<std::string>> * const subsystem_ids)
+{
+    std::vector<std::string> ppn_and_subsystem_tags;
+    while (column_file_reader->readRow(&ppn_and_subsystem_tags)) {
+        const std::vector<std::string> subsystem_tags(MARC::ColumnFile::SplitValues(ppn_and_subsystem_tags[1]));
+        for (const Subsystem subsystem : SUBSYSTEMS) {
+            if (std::find(subsystem_tags.cbegin(), subsystem_tags.cend(), GetSubsystemTag(subsystem)) != subsystem_tags.cend())
+                ((*subsystem_ids)[subsystem]).emplace(ppn_and_subsystem_tags[0]);
+        }
+    }
+}
+
+
 void InitSubsystemsIDsVector(std::vector<std::set<std::string>> * const subsystems_ids) {
     for (unsigned i = 0; i < SUBSYSTEMS.size(); ++i) {
         std::set<std::string> init_set;
@@ -126,19 +128,32 @@ void InitSubsystemsIDsVector(std::vector<std::set<std::string>> * const subsyste
 
 
 int Main(int argc, char **argv) {
+    if (argc < 2)
+        Usage();
+
+    DbBulkInserter::Method bulk_insert_method(DbBulkInserter::MULTI_ROW_INSERT);
+    if (std::strcmp(argv[1], "--load-data-local-infile") == 0) {
+        bulk_insert_method = DbBulkInserter::LOAD_DATA_LOCAL_INFILE;
+        --argc, ++argv;
+    }
     if (argc != 2)
         Usage();
 
-    const std::string marc_input_filename(argv[1]);
+    const std::string input_filename(argv[1]);
     unsigned imported_count(0);
     std::shared_ptr<DbConnection> db_connection(VuFind::GetDbConnection());
 
-    std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(marc_input_filename));
     std::vector<std::set<std::string>> subsystems_ids;
     InitSubsystemsIDsVector(&subsystems_ids);
-    ExtractIDsForSubsystems(marc_reader.get(), &subsystems_ids);
+    if (MARC::ColumnFileReader::IsColumnFile(input_filename)) {
+        MARC::ColumnFileReader column_file_reader(input_filename, { "ppn", "subsystems" });
+        ExtractIDsForSubsystems(&column_file_reader, &subsystems_ids);
+    } else {
+        std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(input_filename));
+        ExtractIDsForSubsystems(marc_reader.get(), &subsystems_ids);
+    }
     for (const auto subsystem : SUBSYSTEMS) {
-        InsertIntoSql(db_connection.get(), subsystem, subsystems_ids[subsystem]);
+        InsertIntoSql(db_connection.get(), subsystem, subsystems_ids[subsystem], bulk_insert_method);
         imported_count += subsystems_ids[subsystem].size();
     }
 
@@ -25,12 +25,16 @@
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdlib>
+#include <cstring>
 #include "Compiler.h"
+#include "DbBulkInserter.h"
 #include "DbConnection.h"
 #include "DbResultSet.h"
 #include "DbRow.h"
 #include "IniFile.h"
+#include "KeyValueStore.h"
 #include "StringUtil.h"
 #include "TranslationUtil.h"
 #include "UBTools.h"
@@ -40,42 +44,66 @@
 namespace {
 
 
+const std::string DEFAULT_INDEX_PATH(UBTools::GetTuelibPath() + "vufind_translations.index");
+
+
 [[noreturn]] void Usage() {
-    std::cerr << "Usage: " << progname << " translation.ini...\n";
+    std::cerr << "Usage: " << progname << " [--full-extraction] [--index=seen_translation_index] translation.ini...\n"
+              << "  Only translations that differ from what \"seen_translation_index\" recorded during earlier runs are\n"
+              << "  written to the translation database.  \"--full-extraction\" discards the index first.\n"
+              << "  The default index is \"" << DEFAULT_INDEX_PATH << "\".\n";
     std::exit(EXIT_FAILURE);
 }
 
 
+inline std::string CalcChecksum(const std::string &translation) {
+    const uint64_t digest(StringUtil::CalcXXHash64(translation));
+    return std::string(reinterpret_cast<const char *>(&digest), sizeof(digest));
+}
+
+
+// \param seen_translation_index  Maps language codes and tokens to the checksums of the translations that we inserted.
 void InsertTranslations(
     DbConnection * const connection, const std::string &language_code,
-    const std::unordered_map<std::string, std::pair<unsigned, std::string>> &keys_to_line_no_and_translation_map)
+    const std::unordered_map<std::string, std::pair<unsigned, std::string>> &keys_to_line_no_and_translation_map,
+    KeyValueStore::WriteTransaction * const seen_translation_index)
 {
+    const std::string fake_3letter_code(
+        TranslationUtil::MapGermanLanguageCodesToFake3LetterEnglishLanguagesCodes(language_code));
+
+    // Skip inserting translations if we have a translator, i.e. the web translation tool was used
+    // to insert the translations into the database.  We fetch all of these tokens w/ a single query:
+    connection->queryOrDie("SELECT token FROM vufind_translations WHERE language_code="
+                           + connection->escapeAndQuoteString(fake_3letter_code)
+                           + " AND translator IS NOT NULL AND translator<>''");
+    DbResultSet result(connection->getLastResultSet());
+    std::unordered_set<std::string> tokens_with_translators;
+    while (const DbRow row = result.getNextRow())
+        tokens_with_translators.emplace(row[0]);
+
+    DbBulkInserter bulk_inserter(connection, "vufind_translations", { "language_code", "token", "translation" },
+                                 DbConnection::DKB_REPLACE);
+    unsigned unchanged_count(0);
+    std::string previous_checksum;
     for (const auto &keys_to_line_no_and_translation : keys_to_line_no_and_translation_map) {
-        const std::string key = connection->escapeString(keys_to_line_no_and_translation.first);
-        const std::string translation = connection->escapeString(keys_to_line_no_and_translation.second.second);
-
-        // Skip inserting translations if we have a translator, i.e. the web translation tool was used
-        // to insert the translations into the database
-        const std::string GET_TRANSLATOR("SELECT translator FROM vufind_translations WHERE language_code=\""
-           + TranslationUtil::MapGermanLanguageCodesToFake3LetterEnglishLanguagesCodes(language_code)
-           + "\" AND token=\"" + key + "\"");
-        connection->queryOrDie(GET_TRANSLATOR);
-        DbResultSet result(connection->getLastResultSet());
-        if (not result.empty()) {
-            const DbRow row(result.getNextRow());
-            if (not row.isNull("translator")) {
-                const std::string translator(row["translator"]);
-                if (not translator.empty())
-                    continue;
-            }
+        if (tokens_with_translators.find(keys_to_line_no_and_translation.first) != tokens_with_translators.cend())
+            continue;
+
+        const std::string &translation(keys_to_line_no_and_translation.second.second);
+        const std::string index_key(fake_3letter_code + ':' + keys_to_line_no_and_translation.first);
+        const std::string checksum(CalcChecksum(translation));
+        if (seen_translation_index->get(index_key, &previous_checksum) and previous_checksum == checksum) {
+            ++unchanged_count;
+            continue;
         }
 
-        const std::string INSERT_OTHER(
-           "REPLACE INTO vufind_translations SET language_code=\""
-	   + TranslationUtil::MapGermanLanguageCodesToFake3LetterEnglishLanguagesCodes(language_code)
-	   + "\", token=\"" + key + "\", translation=\"" + translation + "\"");
-        connection->queryOrDie(INSERT_OTHER);
+        bulk_inserter.insert({ fake_3letter_code, keys_to_line_no_and_translation.first, translation });
+        seen_translation_index->put(index_key, checksum);
     }
+
+    bulk_inserter.flush();
+    std::cout << "Inserted " << bulk_inserter.getRowCount() << " and skipped " << unchanged_count
+              << " unchanged translation(s).\n";
 }
 
 
@@ -88,6 +116,18 @@ const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "translations.conf")
 int Main(int argc, char **argv) {
     ::progname = argv[0];
 
+    bool full_extraction(false);
+    if (argc > 1 and std::strcmp(argv[1], "--full-extraction") == 0) {
+        full_extraction = true;
+        --argc, ++argv;
+    }
+
+    std::string index_path(DEFAULT_INDEX_PATH);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--index=")) {
+        index_path = argv[1] + std::strlen("--index=");
+        --argc, ++argv;
+    }
+
     if (argc < 2)
         Usage();
 
@@ -97,6 +137,11 @@ int Main(int argc, char **argv) {
     const std::string sql_password(ini_file.getString("Database", "sql_password"));
     DbConnection db_connection(sql_database, sql_username, sql_password);
 
+    KeyValueStore seen_translation_index(index_path, KeyValueStore::CREATE);
+    KeyValueStore::WriteTransaction seen_translation_index_transaction(&seen_translation_index);
+    if (full_extraction)
+        seen_translation_index_transaction.clear();
+
     for (int arg_no(1); arg_no < argc; ++arg_no) {
         // Get the 2-letter language code from the filename.  We expect filenames of the form "xx.ini" or
         // "some_path/xx.ini":
@@ -122,8 +167,14 @@ int Main(int argc, char **argv) {
         std::cout << "Read " << keys_to_line_no_and_translation_map.size()
                   << " mappings from English to another language from \"" << ini_filename << "\".\n";
 
-        InsertTranslations(&db_connection, german_3letter_code, keys_to_line_no_and_translation_map);
+        InsertTranslations(&db_connection, german_3letter_code, keys_to_line_no_and_translation_map,
+                           &seen_translation_index_transaction);
     }
 
+    // Only now that all rows have been written may we remember the translations:
+    seen_translation_index_transaction.commit();
+
+    TranslationUtil::RebuildTranslationStats(&db_connection, "vufind_translations", "token");
+
     return EXIT_SUCCESS;
 }
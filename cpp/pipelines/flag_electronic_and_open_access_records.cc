@@ -21,7 +21,7 @@
 #include <stdexcept>
 #include <cstdio>
 #include <cstdlib>
-#include "MARC.h"
+#include "MarcPipeline.h"
 #include "util.h"
 
 
@@ -34,42 +34,6 @@ namespace {
 }
 
 
-void ProcessRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer) {
-    unsigned record_count(0), flagged_as_electronic_count(0), flagged_as_open_access_count(0);
-
-    while (MARC::Record record = marc_reader->read()) {
-        ++record_count;
-
-        if (record.getFirstField("ELC") == record.end()) {
-            MARC::Subfields subfields;
-            if (record.isElectronicResource())
-                subfields.appendSubfield('a', "1");
-            if (record.isPrintResource())
-                subfields.appendSubfield('b', "1");
-            if (not subfields.empty()) {
-                ++flagged_as_electronic_count;
-                record.insertField("ELC", subfields);
-            }
-        }
-
-        if (record.getFirstField("OAS") == record.end()) {
-            MARC::Subfields subfields;
-            if (MARC::IsOpenAccess(record)) {
-                subfields.appendSubfield('a', "1");
-                ++flagged_as_open_access_count;
-                record.insertField("OAS", subfields);
-            }
-        }
-
-        marc_writer->write(record);
-    }
-
-    LOG_INFO("Processed " + std::to_string(record_count) + " MARC record(s).");
-    LOG_INFO("Flagged " + std::to_string(flagged_as_electronic_count) + " record(s) as electronic resource(s).");
-    LOG_INFO("Flagged " + std::to_string(flagged_as_open_access_count) + " record(s) as open-access resource(s).");
-}
-
-
 } // unnamed namespace
 
 
@@ -80,7 +44,9 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[1]));
     std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[2]));
 
-    ProcessRecords(marc_reader.get(), marc_writer.get());
+    MARC::Pipeline pipeline;
+    pipeline.addStage(MARC::PipelineStage::Factory("flag_electronic_and_open_access_records", {}));
+    pipeline.run(marc_reader.get(), marc_writer.get());
 
     return EXIT_SUCCESS;
 }
@@ -28,6 +28,8 @@
 #include <cstring>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcOffsetIndex.h"
+#include "MarcRecordBitmap.h"
 #include "RegexMatcher.h"
 #include "util.h"
 
@@ -43,8 +45,12 @@ namespace {
 }
 
 
+// The name of the sidecar bitmap of the input file, see MARC::RecordBitmap.
+const std::string DE21_SUPERIORS_BITMAP_NAME("de21_superiors");
+
+
 void ProcessSuperiorRecord(const MARC::Record &record, RegexMatcher * const tue_sigil_matcher,
-                           std::unordered_set<std::string> * const de21_superior_ppns, unsigned * const extracted_count)
+                           MARC::RecordBitmap * const de21_superiors)
 {
     // We are done if this is not a superior work
     if (not record.hasFieldWithTag("SPR"))
@@ -55,22 +61,31 @@ void ProcessSuperiorRecord(const MARC::Record &record, RegexMatcher * const tue_
     for (const auto &local_block_start : local_block_starts) {
         for (const auto &_852_field : record.findFieldsInLocalBlock("852", local_block_start)) {
             std::string sigil;
-            if (_852_field.extractSubfieldWithPattern('a', *tue_sigil_matcher, &sigil)) {
-                de21_superior_ppns->insert(record.getControlNumber());
-                ++*extracted_count;
-            }
+            if (_852_field.extractSubfieldWithPattern('a', *tue_sigil_matcher, &sigil))
+                de21_superiors->set(record.getControlNumber());
         }
     }
 }
 
 
-void LoadDE21PPNs(MARC::Reader * const marc_reader, RegexMatcher * const tue_sigil_matcher, std::unordered_set<std::string> * const de21_superior_ppns,
-                  unsigned * const extracted_count)
+// Skips the pass over "marc_reader" if a previous run left an up-to-date bitmap next to the input file.
+void LoadDE21PPNs(MARC::Reader * const marc_reader, RegexMatcher * const tue_sigil_matcher,
+                  MARC::RecordBitmap * const de21_superiors)
 {
+    if (de21_superiors->load(marc_reader->getPath(), DE21_SUPERIORS_BITMAP_NAME)) {
+        LOG_DEBUG("Loaded " + std::to_string(de21_superiors->count()) + " superior records from \""
+                  + MARC::RecordBitmap::GetBitmapPath(marc_reader->getPath(), DE21_SUPERIORS_BITMAP_NAME) + "\"");
+        return;
+    }
+
+    marc_reader->rewind();
     while (const MARC::Record record = marc_reader->read())
-         ProcessSuperiorRecord(record, tue_sigil_matcher, de21_superior_ppns, extracted_count);
+         ProcessSuperiorRecord(record, tue_sigil_matcher, de21_superiors);
 
-    LOG_DEBUG("Finished extracting " + std::to_string(*extracted_count) + " superior records");
+    if (not de21_superiors->save(marc_reader->getPath(), DE21_SUPERIORS_BITMAP_NAME))
+        LOG_WARNING("failed to save \"" + MARC::RecordBitmap::GetBitmapPath(marc_reader->getPath(), DE21_SUPERIORS_BITMAP_NAME)
+                    + "\"!");
+    LOG_DEBUG("Finished extracting " + std::to_string(de21_superiors->count()) + " superior records");
 }
 
 
@@ -119,7 +134,7 @@ bool AlreadyHasLOK852DE21(const MARC::Record &record, RegexMatcher * const tue_s
 
 
 void ProcessRecord(MARC::Record * const record, MARC::Writer * const marc_writer, RegexMatcher * const tue_sigil_matcher,
-                   std::unordered_set<std::string> * const de21_superior_ppns, unsigned * const modified_count) {
+                   const MARC::RecordBitmap &de21_superiors, unsigned * const modified_count) {
     if (AlreadyHasLOK852DE21(*record, tue_sigil_matcher)) {
         FlagRecordAsInTuebingenAvailable(record, modified_count);
         marc_writer->write(*record);
@@ -135,7 +150,7 @@ void ProcessRecord(MARC::Record * const record, MARC::Writer * const marc_writer
     CollectSuperiorPPNs(*record, &superior_ppn_set);
     // Do we have superior PPN that has DE-21
     for (const auto &superior_ppn : superior_ppn_set) {
-        if (de21_superior_ppns->find(superior_ppn) != de21_superior_ppns->end()) {
+        if (de21_superiors.test(superior_ppn)) {
             FlagRecordAsInTuebingenAvailable(record, modified_count);
             marc_writer->write(*record);
             return;
@@ -146,12 +161,12 @@ void ProcessRecord(MARC::Record * const record, MARC::Writer * const marc_writer
 
 
 void AugmentRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                    RegexMatcher * const tue_sigil_matcher, std::unordered_set<std::string> * const de21_superior_ppn,
-                    unsigned * const extracted_count, unsigned * const modified_count) {
+                    RegexMatcher * const tue_sigil_matcher, const MARC::RecordBitmap &de21_superiors,
+                    unsigned * const modified_count) {
     marc_reader->rewind();
     while (MARC::Record record = marc_reader->read())
-        ProcessRecord(&record, marc_writer, tue_sigil_matcher, de21_superior_ppn, modified_count);
-    LOG_INFO("Extracted " + std::to_string(*extracted_count) + " superior PPNs with DE-21 and modified "
+        ProcessRecord(&record, marc_writer, tue_sigil_matcher, de21_superiors, modified_count);
+    LOG_INFO("Extracted " + std::to_string(de21_superiors.count()) + " superior PPNs with DE-21 and modified "
              + std::to_string(*modified_count) + " records");
 }
 
@@ -169,12 +184,13 @@ int Main(int argc, char **argv) {
     const std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(marc_input_filename));
     const std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(marc_output_filename));
 
-    unsigned extracted_count(0), modified_count(0);
+    unsigned modified_count(0);
     const std::unique_ptr<RegexMatcher> tue_sigil_matcher(RegexMatcher::RegexMatcherFactory("^DE-21.*"));
-    std::unordered_set<std::string> de21_superior_ppns;
+    const MARC::OffsetIndex offset_index(marc_reader.get());
+    MARC::RecordBitmap de21_superiors(offset_index);
 
-    LoadDE21PPNs(marc_reader.get(), tue_sigil_matcher.get(), &de21_superior_ppns, &extracted_count);
-    AugmentRecords(marc_reader.get(), marc_writer.get(), tue_sigil_matcher.get(), &de21_superior_ppns, &extracted_count, &modified_count);
+    LoadDE21PPNs(marc_reader.get(), tue_sigil_matcher.get(), &de21_superiors);
+    AugmentRecords(marc_reader.get(), marc_writer.get(), tue_sigil_matcher.get(), de21_superiors, &modified_count);
 
     return EXIT_SUCCESS;
 }
@@ -23,10 +23,15 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
+#include <cerrno>
 #include <cstring>
+#include <unistd.h>
 #include "File.h"
 #include "FileUtil.h"
 #include "TranslationUtil.h"
@@ -54,79 +59,118 @@ std::string NormalizeBrackets(const std::string string_to_normalize) {
 }
 
 
+// Reads all translations w/ a single query.  Maps the fake 3-letter English language codes to (token,translation) pairs.
+void LoadTranslations(const bool verbose, DbConnection * const db_connection,
+                      std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> * const
+                          language_codes_to_tokens_and_translations)
+{
+    db_connection->queryOrDie("SELECT language_code,token,translation FROM vufind_translations");
+    DbResultSet result_set(db_connection->getLastResultSet());
+    if (unlikely(result_set.empty()))
+        LOG_ERROR("no translations found, expected many!");
+
+    while (const DbRow row = result_set.getNextRow())
+        (*language_codes_to_tokens_and_translations)[row[0]].emplace_back(row[1], row[2]);
+
+    if (verbose)
+        std::cerr << "Found " << result_set.size() << " (token,translation) pairs for "
+                  << language_codes_to_tokens_and_translations->size() << " language codes.\n";
+}
+
+
 // Generates a XX.ini output file with entries like the original file.  The XX is a 2-letter language code.
+// As we run in a worker thread, we report problems via "error_message" instead of aborting.  The new file is written
+// next to the old one and then renamed so that VuFind never sees a partially written file.
 void ProcessLanguage(const bool verbose, const std::string &output_file_path, const std::string &_3letter_code,
-                     DbConnection * const db_connection)
+                     const std::vector<std::pair<std::string, std::string>> &tokens_and_translations,
+                     std::string * const log_messages, std::string * const error_message)
 {
     if (verbose)
-        std::cerr << "Processing language code: " << _3letter_code << '\n';
+        *log_messages += "Processing language code: " + _3letter_code + "\n\tFound "
+                         + std::to_string(tokens_and_translations.size()) + " (token,translation) pairs.\n";
 
     std::unordered_map<std::string, std::pair<unsigned, std::string>> token_to_line_no_and_other_map;
-    if (::access(output_file_path.c_str(), R_OK) != 0)
-        logger->warning("\"" + output_file_path + "\" is not readable, maybe it doesn't exist?");
+    const bool have_old_file(::access(output_file_path.c_str(), R_OK) == 0);
+    if (not have_old_file)
+        *log_messages += "\"" + output_file_path + "\" is not readable, maybe it doesn't exist?\n";
     else {
-        TranslationUtil::ReadIniFile(output_file_path, &token_to_line_no_and_other_map);
-
-        if (unlikely(not FileUtil::RenameFile(output_file_path, output_file_path + ".bak", /* remove_target = */true)))
-            logger->error("failed to rename \"" + output_file_path + "\" to \"" + output_file_path + ".bak\"! ("
-                          + std::string(::strerror(errno)) + ")");
+        try {
+            TranslationUtil::ReadIniFile(output_file_path, &token_to_line_no_and_other_map);
+        } catch (const std::exception &x) {
+            *error_message = x.what();
+            return;
+        }
     }
 
-    File output(output_file_path, "w");
-    if (unlikely(output.fail()))
-        logger->error("failed to open \"" + output_file_path + "\" for writing!");
-
-    db_connection->queryOrDie("SELECT token,translation FROM vufind_translations WHERE language_code='"
-                              + _3letter_code + "'");
-    DbResultSet result_set(db_connection->getLastResultSet());
-    if (unlikely(result_set.empty()))
-        logger->error("found no translations for language code \"" + _3letter_code + "\"!");
-    if (verbose)
-        std::cerr << "\tFound " << result_set.size() << " (token,translation) pairs.\n";
-
     std::vector<std::tuple<unsigned, std::string, std::string>> line_nos_tokens_and_translations;
-    while (const DbRow row = result_set.getNextRow()) {
-        const auto &token_to_line_no_and_other(token_to_line_no_and_other_map.find(row[0]));
+    for (const auto &token_and_translation : tokens_and_translations) {
+        const auto &token_to_line_no_and_other(token_to_line_no_and_other_map.find(token_and_translation.first));
         if (token_to_line_no_and_other != token_to_line_no_and_other_map.cend())
-            line_nos_tokens_and_translations.emplace_back(token_to_line_no_and_other->second.first, row[0], row[1]);
+            line_nos_tokens_and_translations.emplace_back(token_to_line_no_and_other->second.first,
+                                                          token_and_translation.first, token_and_translation.second);
         else
-            line_nos_tokens_and_translations.emplace_back(token_to_line_no_and_other_map.size() + 1, row[0], row[1]);
+            line_nos_tokens_and_translations.emplace_back(token_to_line_no_and_other_map.size() + 1,
+                                                          token_and_translation.first, token_and_translation.second);
+    }
+
+    std::stable_sort(line_nos_tokens_and_translations.begin(), line_nos_tokens_and_translations.end(),
+                     [](const std::tuple<unsigned, std::string,std::string> &left,
+                        const std::tuple<unsigned, std::string,std::string> &right)
+                     { return std::get<0>(left) < std::get<0>(right); });
+
+    const std::string new_file_path(output_file_path + ".new");
+    {
+        File output(new_file_path, "w");
+        if (unlikely(output.fail())) {
+            *error_message = "failed to open \"" + new_file_path + "\" for writing!";
+            return;
+        }
+
+        for (const auto &line_no_token_and_translation : line_nos_tokens_and_translations) {
+            const std::string &token(std::get<1>(line_no_token_and_translation));
+            const std::string &translation(std::get<2>(line_no_token_and_translation));
+            if (not translation.empty())
+                output << token << " = \"" << StringUtil::TrimWhite(NormalizeBrackets(translation)) << "\"\n";
+        }
+
+        if (unlikely(not output.close())) {
+            *error_message = "failed to write \"" + new_file_path + "\"!";
+            return;
+        }
     }
 
-    std::sort(line_nos_tokens_and_translations.begin(), line_nos_tokens_and_translations.end(),
-              [](const std::tuple<unsigned, std::string,std::string> &left,
-                 const std::tuple<unsigned, std::string,std::string> &right)
-              { return std::get<0>(left) < std::get<0>(right); });
+    if (have_old_file and unlikely(not FileUtil::Copy(output_file_path, output_file_path + ".bak"))) {
+        *error_message = "failed to copy \"" + output_file_path + "\" to \"" + output_file_path + ".bak\"! ("
+                         + std::string(::strerror(errno)) + ")";
+        return;
+    }
 
-    for (const auto &line_no_token_and_translation : line_nos_tokens_and_translations) {
-        const std::string token(std::get<1>(line_no_token_and_translation));
-        const std::string translation(std::get<2>(line_no_token_and_translation));
-        if (not translation.empty())
-            output << token << " = \"" << StringUtil::TrimWhite(NormalizeBrackets(translation)) << "\"\n";
+    if (unlikely(::rename(new_file_path.c_str(), output_file_path.c_str()) != 0)) {
+        *error_message = "failed to rename \"" + new_file_path + "\" to \"" + output_file_path + "\"! ("
+                         + std::string(::strerror(errno)) + ")";
+        return;
     }
 
     if (verbose)
-        std::cerr << "Wrote " << line_nos_tokens_and_translations.size() << " language mappings to \""
-                  << output_file_path << "\"\n";
+        *log_messages += "Wrote " + std::to_string(line_nos_tokens_and_translations.size()) + " language mappings to \""
+                         + output_file_path + "\"\n";
 }
 
 
-void GetLanguageCodes(const bool verbose, DbConnection * const db_connection,
+void GetLanguageCodes(const bool verbose,
+                      const std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>>
+                          &language_codes_to_tokens_and_translations,
                       std::map<std::string, std::string> * language_codes)
 {
-    db_connection->queryOrDie("SELECT DISTINCT language_code FROM vufind_translations");
-    DbResultSet language_codes_result_set(db_connection->getLastResultSet());
-    if (unlikely(language_codes_result_set.empty()))
-        logger->error("no language codes found, expected multiple!");
-
-    while (const DbRow row = language_codes_result_set.getNextRow()) {
+    for (const auto &language_code_and_tokens_and_translations : language_codes_to_tokens_and_translations) {
         const std::string german_language_code(
-            TranslationUtil::MapFake3LetterEnglishLanguagesCodesToGermanLanguageCodes(row[0]));
+            TranslationUtil::MapFake3LetterEnglishLanguagesCodesToGermanLanguageCodes(
+                language_code_and_tokens_and_translations.first));
         if (german_language_code == "???")
             continue;
         const std::string international_language_code(
             TranslationUtil::MapGerman3Or4LetterCodeToInternational2LetterCode(german_language_code));
-        language_codes->emplace(international_language_code, row[0]);
+        language_codes->emplace(international_language_code, language_code_and_tokens_and_translations.first);
     }
     if (verbose)
         std::cerr << "Found " << language_codes->size()
@@ -134,6 +178,36 @@ void GetLanguageCodes(const bool verbose, DbConnection * const db_connection,
 }
 
 
+// Generates all language files in parallel on up to "std::thread::hardware_concurrency()" threads.
+void ProcessLanguages(const bool verbose, const std::string &output_directory,
+                      const std::map<std::string, std::string> &_2letter_and_3letter_codes,
+                      const std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>>
+                          &language_codes_to_tokens_and_translations)
+{
+    const std::vector<std::pair<std::string, std::string>> codes(_2letter_and_3letter_codes.cbegin(),
+                                                                 _2letter_and_3letter_codes.cend());
+    std::vector<std::string> log_messages(codes.size()), error_messages(codes.size());
+    const size_t thread_count(std::min(codes.size(), static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))));
+    std::vector<std::thread> threads;
+    for (size_t thread_no(0); thread_no < thread_count; ++thread_no)
+        threads.emplace_back([&, thread_no]() {
+            for (size_t code_no(thread_no); code_no < codes.size(); code_no += thread_count)
+                ProcessLanguage(verbose, output_directory + "/" + codes[code_no].first + ".ini", codes[code_no].second,
+                                language_codes_to_tokens_and_translations.at(codes[code_no].second), &log_messages[code_no],
+                                &error_messages[code_no]);
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    // Report in the same order as we used to when we processed one language after another:
+    for (size_t code_no(0); code_no < codes.size(); ++code_no) {
+        std::cerr << log_messages[code_no];
+        if (unlikely(not error_messages[code_no].empty()))
+            LOG_ERROR(error_messages[code_no]);
+    }
+}
+
+
 const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "translations.conf");
 
 
@@ -163,11 +237,12 @@ int Main(int argc, char **argv) {
     const std::string sql_password(ini_file.getString("Database", "sql_password"));
     DbConnection db_connection(sql_database, sql_username, sql_password);
 
+    std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> language_codes_to_tokens_and_translations;
+    LoadTranslations(verbose, &db_connection, &language_codes_to_tokens_and_translations);
+
     std::map<std::string, std::string> _2letter_and_3letter_codes;
-    GetLanguageCodes(verbose, &db_connection, &_2letter_and_3letter_codes);
-    for (const auto &_2letter_intl_code_and_fake_3letter_english_code : _2letter_and_3letter_codes)
-        ProcessLanguage(verbose, output_directory + "/" + _2letter_intl_code_and_fake_3letter_english_code.first + ".ini",
-                        _2letter_intl_code_and_fake_3letter_english_code.second, &db_connection);
+    GetLanguageCodes(verbose, language_codes_to_tokens_and_translations, &_2letter_and_3letter_codes);
+    ProcessLanguages(verbose, output_directory, _2letter_and_3letter_codes, language_codes_to_tokens_and_translations);
 
     return EXIT_SUCCESS;
 }
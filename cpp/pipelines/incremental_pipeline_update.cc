@@ -0,0 +1,351 @@
+/** \brief Lets us run the MARC pipeline on the records that changed since the last run instead of on all records.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "Compiler.h"
+#include "DirectedGraph.h"
+#include "FileUtil.h"
+#include "MARC.h"
+#include "MarcControlNumberSet.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " checksums full_input input_checksums\n"
+              << "       " << ::progname << " select [--link-depth=N] full_input previous_input_checksums previous_output\n"
+              << "           selected_input new_input_checksums replaced_ppns\n"
+              << "       " << ::progname << " splice previous_output processed_selected_input replaced_ppns new_output\n\n"
+              << "       \"checksums\" records the checksums of the pipeline input \"full_input\" after a full pipeline run.\n"
+              << "       \"select\" compares \"full_input\", usually the result of apply_differential_update, against the\n"
+              << "       checksums of the previous pipeline input and writes the new and changed records, as well as the\n"
+              << "       records that are linked to or from new, changed or deleted records, to \"selected_input\".  Links\n"
+              << "       are those that add_superior_and_alertable_flags and add_article_cross_links use and are taken\n"
+              << "       from the new input and from \"previous_output\", the output of the last pipeline run.  Linked\n"
+              << "       records are followed for up to --link-depth hops, which defaults to 2 so that a superior work\n"
+              << "       gets to see all of its children again.  The PPN's of the selected and of the deleted records are\n"
+              << "       written to \"replaced_ppns\" and the checksums of \"full_input\" to \"new_input_checksums\".\n"
+              << "       After \"selected_input\" has been run through the pipeline, \"splice\" replaces the records listed\n"
+              << "       in \"replaced_ppns\" in \"previous_output\" w/ their processed versions, drops those that have no\n"
+              << "       processed version and appends the remaining processed records.\n"
+              << "       Phases that aggregate over the entire collection, e.g. the title matching of\n"
+              << "       add_article_cross_links, only see the selected records and changes in the authority data are not\n"
+              << "       taken into account, so a full run should still be done from time to time.\n\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+inline uint64_t CalcInputChecksum(const MARC::Record &record) {
+    // Our pipeline phases use the local fields, so they have to be part of the checksum.
+    return MARC::CalcFastChecksum(record, { "001" }, /* suppress_local_fields = */false);
+}
+
+
+// Each line of a checksums file consists of a PPN, a space and the decimal checksum of the corresponding record.
+void ForEachChecksum(const std::string &checksums_path,
+                     const std::function<void(const std::string &ppn, const uint64_t checksum)> &callback)
+{
+    const auto input(FileUtil::OpenInputFileOrDie(checksums_path));
+    unsigned line_no(0);
+    std::string line;
+    while (not input->eof()) {
+        ++line_no;
+        if (input->getline(&line) == 0)
+            continue;
+
+        const auto space_pos(line.find(' '));
+        unsigned long long checksum;
+        if (unlikely(space_pos == std::string::npos
+                     or not StringUtil::ToUnsignedLongLong(line.substr(space_pos + 1), &checksum)))
+            LOG_ERROR("bad entry on line " + std::to_string(line_no) + " in \"" + checksums_path + "\"!");
+        callback(line.substr(0, space_pos), checksum);
+    }
+}
+
+
+void LoadPPNs(const std::string &ppns_path, MARC::ControlNumberSet * const ppns) {
+    const auto input(FileUtil::OpenInputFileOrDie(ppns_path));
+    std::string line;
+    while (not input->eof()) {
+        if (input->getline(&line) > 0)
+            ppns->insert(line);
+    }
+
+    LOG_INFO("Loaded " + std::to_string(ppns->size()) + " PPN(s) from \"" + ppns_path + "\".");
+}
+
+
+// Same tags as in add_superior_and_alertable_flags.
+const std::vector<std::string> SUPERIOR_LINK_TAGS{ "773", "776", "800", "810", "830" };
+
+
+// \return The PPN's of the superior works of "record" and of the records that are cross-linked to it.
+std::vector<std::string> GetLinkedPPNs(const MARC::Record &record) {
+    std::vector<std::string> linked_ppns;
+    for (const auto &tag : SUPERIOR_LINK_TAGS) {
+        for (const auto &field : record.getTagRange(tag)) {
+            const std::string subfield_w_contents(field.getFirstSubfieldWithCode('w'));
+            if (StringUtil::StartsWith(subfield_w_contents, "(DE-627)"))
+                linked_ppns.emplace_back(subfield_w_contents.substr(__builtin_strlen("(DE-627)")));
+        }
+    }
+
+    for (const auto &partner_ppn : MARC::ExtractCrossReferencePPNs(record))
+        linked_ppns.emplace_back(partner_ppn);
+
+    return linked_ppns;
+}
+
+
+void WriteChecksums(MARC::Reader * const full_input_reader, const std::string &checksums_path) {
+    const auto checksums_output(FileUtil::OpenOutputFileOrDie(checksums_path));
+    unsigned record_count(0);
+    while (const auto record = full_input_reader->read()) {
+        *checksums_output << record.getControlNumber() << ' ' << std::to_string(CalcInputChecksum(record)) << '\n';
+        ++record_count;
+    }
+
+    LOG_INFO("Wrote the checksums of " + std::to_string(record_count) + " record(s) to \"" + checksums_path + "\".");
+}
+
+
+// Assigns consecutive node ID's to PPN's so that we can use them w/ DirectedGraph.
+class PPNsToNodeIDs {
+    MARC::ControlNumberSet ppns_to_node_ids_;
+public:
+    PPNsToNodeIDs(): ppns_to_node_ids_(/* store_values = */true) { }
+
+    DirectedGraph::NodeId getOrAddId(const std::string &ppn) {
+        const uint64_t next_id(ppns_to_node_ids_.size());
+        if (ppns_to_node_ids_.insert(ppn, next_id))
+            return static_cast<DirectedGraph::NodeId>(next_id);
+
+        uint64_t id;
+        ppns_to_node_ids_.find(ppn, &id);
+        return static_cast<DirectedGraph::NodeId>(id);
+    }
+
+    // \return False if "ppn" has no ID.
+    inline bool getId(const std::string &ppn, DirectedGraph::NodeId * const id) const {
+        uint64_t id64;
+        if (not ppns_to_node_ids_.find(ppn, &id64))
+            return false;
+        *id = static_cast<DirectedGraph::NodeId>(id64);
+        return true;
+    }
+
+    inline size_t size() const { return ppns_to_node_ids_.size(); }
+};
+
+
+inline void AddLinkEdges(const MARC::Record &record, PPNsToNodeIDs * const ppns_to_node_ids,
+                         std::vector<DirectedGraph::Edge> * const edges)
+{
+    const DirectedGraph::NodeId node_id(ppns_to_node_ids->getOrAddId(record.getControlNumber()));
+    for (const auto &linked_ppn : GetLinkedPPNs(record))
+        edges->emplace_back(node_id, ppns_to_node_ids->getOrAddId(linked_ppn));
+}
+
+
+void Select(MARC::Reader * const full_input_reader, const std::string &previous_input_checksums_path,
+            MARC::Reader * const previous_output_reader, MARC::Writer * const selected_input_writer,
+            const std::string &new_input_checksums_path, const std::string &replaced_ppns_path, const unsigned link_depth)
+{
+    MARC::ControlNumberSet previous_ppns_and_checksums(/* store_values = */true);
+    ForEachChecksum(previous_input_checksums_path,
+                    [&previous_ppns_and_checksums](const std::string &ppn, const uint64_t checksum)
+                    { previous_ppns_and_checksums.insert(ppn, checksum); });
+
+    // Find the new and changed records and write the new checksums.  We also collect the links of the new and changed
+    // records, as the previous output doesn't know about them:
+    MARC::ControlNumberSet full_input_ppns;
+    PPNsToNodeIDs ppns_to_node_ids;
+    std::vector<DirectedGraph::Edge> link_edges;
+    std::vector<DirectedGraph::NodeId> changed_node_ids;
+    unsigned new_count(0), changed_count(0);
+    {
+        const auto new_input_checksums(FileUtil::OpenOutputFileOrDie(new_input_checksums_path));
+        while (const auto record = full_input_reader->read()) {
+            const std::string ppn(record.getControlNumber());
+            full_input_ppns.insert(ppn);
+            const uint64_t checksum(CalcInputChecksum(record));
+            *new_input_checksums << ppn << ' ' << std::to_string(checksum) << '\n';
+
+            uint64_t previous_checksum;
+            if (not previous_ppns_and_checksums.find(ppn, &previous_checksum))
+                ++new_count;
+            else if (checksum != previous_checksum)
+                ++changed_count;
+            else
+                continue;
+
+            changed_node_ids.emplace_back(ppns_to_node_ids.getOrAddId(ppn));
+            AddLinkEdges(record, &ppns_to_node_ids, &link_edges);
+        }
+    }
+
+    std::vector<std::string> deleted_ppns;
+    ForEachChecksum(previous_input_checksums_path,
+                    [&full_input_ppns, &ppns_to_node_ids, &changed_node_ids, &deleted_ppns](const std::string &ppn,
+                                                                                            const uint64_t /* checksum */)
+                    {
+                        if (not full_input_ppns.contains(ppn)) {
+                            changed_node_ids.emplace_back(ppns_to_node_ids.getOrAddId(ppn));
+                            deleted_ppns.emplace_back(ppn);
+                        }
+                    });
+    LOG_INFO("Found " + std::to_string(new_count) + " new, " + std::to_string(changed_count) + " changed and "
+             + std::to_string(deleted_ppns.size()) + " deleted record(s).");
+
+    // The previous output contains the cross links that were added by the last pipeline run and the links of all
+    // records that did not change.  We read it only once and then follow the links in memory:
+    if (link_depth > 0) {
+        while (const auto record = previous_output_reader->read())
+            AddLinkEdges(record, &ppns_to_node_ids, &link_edges);
+    }
+
+    // Links count in both directions, a superior work has to see its new children and vice versa:
+    const DirectedGraph link_graph(ppns_to_node_ids.size(), link_edges, /* add_reverse_edges = */true);
+    std::vector<DirectedGraph::Edge>().swap(link_edges);
+    LOG_INFO("Built a link graph w/ " + std::to_string(link_graph.getNodeCount()) + " node(s) and "
+             + std::to_string(link_graph.getEdgeCount()) + " edge(s).");
+
+    std::vector<size_t> level_sizes;
+    std::vector<bool> affected(link_graph.getNodeCount(), false);
+    for (const auto node_id : link_graph.breadthFirstSearch(changed_node_ids, link_depth, &level_sizes))
+        affected[node_id] = true;
+    for (unsigned hop(1); hop < level_sizes.size(); ++hop)
+        LOG_INFO("Link hop #" + std::to_string(hop) + " added " + std::to_string(level_sizes[hop]) + " record(s).");
+
+    const auto replaced_ppns(FileUtil::OpenOutputFileOrDie(replaced_ppns_path));
+    full_input_reader->rewind();
+    unsigned selected_count(0);
+    while (const auto record = full_input_reader->read()) {
+        DirectedGraph::NodeId node_id;
+        if (ppns_to_node_ids.getId(record.getControlNumber(), &node_id) and affected[node_id]) {
+            selected_input_writer->write(record);
+            *replaced_ppns << record.getControlNumber() << '\n';
+            ++selected_count;
+        }
+    }
+    for (const auto &deleted_ppn : deleted_ppns)
+        *replaced_ppns << deleted_ppn << '\n';
+
+    LOG_INFO("Selected " + std::to_string(selected_count) + " record(s) for processing.");
+}
+
+
+void Splice(MARC::Reader * const previous_output_reader, MARC::Reader * const processed_reader,
+            const std::string &replaced_ppns_path, MARC::Writer * const new_output_writer)
+{
+    MARC::ControlNumberSet replaced_ppns;
+    LoadPPNs(replaced_ppns_path, &replaced_ppns);
+
+    std::unordered_map<std::string, off_t> processed_ppns_to_offsets_map;
+    MARC::CollectRecordOffsets(processed_reader, &processed_ppns_to_offsets_map);
+
+    // Keep the order of the previous output so that unchanged records stay where they were:
+    MARC::ControlNumberSet written_processed_ppns;
+    unsigned kept_count(0), replaced_count(0), dropped_count(0);
+    while (const auto record = previous_output_reader->read()) {
+        const std::string ppn(record.getControlNumber());
+        if (not replaced_ppns.contains(ppn)) {
+            new_output_writer->write(record);
+            ++kept_count;
+            continue;
+        }
+
+        const auto ppn_and_offset(processed_ppns_to_offsets_map.find(ppn));
+        if (ppn_and_offset == processed_ppns_to_offsets_map.cend()) { // Deleted or dropped by the pipeline.
+            ++dropped_count;
+            continue;
+        }
+
+        if (unlikely(not processed_reader->seek(ppn_and_offset->second)))
+            LOG_ERROR("failed to seek to the processed record w/ PPN " + ppn + "!");
+        new_output_writer->write(processed_reader->read());
+        written_processed_ppns.insert(ppn);
+        ++replaced_count;
+    }
+
+    processed_reader->rewind();
+    unsigned added_count(0);
+    while (const auto record = processed_reader->read()) {
+        if (written_processed_ppns.insert(record.getControlNumber())) {
+            new_output_writer->write(record);
+            ++added_count;
+        }
+    }
+
+    LOG_INFO("Kept " + std::to_string(kept_count) + ", replaced " + std::to_string(replaced_count) + ", dropped "
+             + std::to_string(dropped_count) + " and added " + std::to_string(added_count) + " record(s).");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    const std::string command(argv[1]);
+    --argc, ++argv;
+
+    if (command == "checksums") {
+        if (argc != 3)
+            Usage();
+        const auto full_input_reader(MARC::Reader::Factory(argv[1]));
+        WriteChecksums(full_input_reader.get(), argv[2]);
+    } else if (command == "select") {
+        unsigned link_depth(2);
+        if (argc > 1 and StringUtil::StartsWith(argv[1], "--link-depth=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + std::strlen("--link-depth="), &link_depth))
+                LOG_ERROR("bad link depth \"" + std::string(argv[1]) + "\"!");
+            --argc, ++argv;
+        }
+        if (argc != 7)
+            Usage();
+
+        const auto full_input_reader(MARC::Reader::Factory(argv[1]));
+        const auto previous_output_reader(MARC::Reader::Factory(argv[3]));
+        const auto selected_input_writer(MARC::Writer::Factory(argv[4]));
+        Select(full_input_reader.get(), argv[2], previous_output_reader.get(), selected_input_writer.get(), argv[5],
+               argv[6], link_depth);
+    } else if (command == "splice") {
+        if (argc != 5)
+            Usage();
+
+        const auto previous_output_reader(MARC::Reader::Factory(argv[1]));
+        const auto processed_reader(MARC::Reader::Factory(argv[2], MARC::FileType::BINARY));
+        const auto new_output_writer(MARC::Writer::Factory(argv[4]));
+        Splice(previous_output_reader.get(), processed_reader.get(), argv[3], new_output_writer.get());
+    } else
+        Usage();
+
+    return EXIT_SUCCESS;
+}
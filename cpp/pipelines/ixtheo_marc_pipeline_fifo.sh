@@ -37,6 +37,7 @@ function StartPhase {
         ((++PHASE))
     fi
     START=$(date +%s.%N)
+    PHASE_TITLE="$1"
     echo -e "*** Phase $PHASE: $1 - $(date) ***" | tee --append "${log}"
 }
 
@@ -54,6 +55,8 @@ function CalculateTimeDifference {
 function EndPhase {
     PHASE_DURATION=$(CalculateTimeDifference $START $(date +%s.%N))
     echo "Phase ${PHASE}: Done after ${PHASE_DURATION} minutes." | tee --append "${log}"
+    # Records the duration in the phase history and warns if the phase has become a lot slower than usual:
+    phase_monitor "ixtheo: ${PHASE_TITLE}" --wall-time=$(echo "$(date +%s.%N) - $START" | bc --mathlib) >> "${log}" 2>&1 || true
 }
 
 
@@ -63,7 +66,7 @@ function CleanUp {
 
 
 # Sets up the log file:
-logdir=/usr/local/var/log/tuefind
+logdir=${PIPELINE_LOG_DIR:-/usr/local/var/log/tuefind} # Overridden by pipeline_benchmark.sh.
 log="${logdir}/ixtheo_marc_pipeline_fifo.log"
 rm -f "${log}"
 
@@ -187,7 +190,8 @@ wait
 
 
 StartPhase "Adding of ISBN's and ISSN's to Component Parts"
-(add_isbns_or_issns_to_articles GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
+(add_isbns_or_issns_to_articles --superior-works-table=SuperiorWorks-"${date}".table \
+                                GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
                                 GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc >> "${log}" 2>&1 && \
 EndPhase || Abort) &
 wait
@@ -212,8 +216,9 @@ StartPhase "Augment Bible References"
 mkfifo GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc
 (augment_bible_references GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
                          Normdaten-"${date}".mrc \
-                         GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc >> "${log}" 2>&1 && \
-cp pericopes_to_codes.map /usr/local/var/lib/tuelib/bibleRef/ && \
+                         GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc \
+                         bible_ranges.index bible_ref_suggestions.index >> "${log}" 2>&1 && \
+cp pericopes_to_codes.map bible_ranges.index bible_ref_suggestions.index /usr/local/var/lib/tuelib/bibleRef/ && \
 EndPhase || Abort) &
 
 
@@ -262,7 +267,8 @@ wait
 
 StartPhase "Fill in missing 773\$a Subfields"
 mkfifo GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc
-(augment_773a --verbose GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
+(augment_773a --verbose --superior-works-table=SuperiorWorks-"${date}".table \
+    GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
     GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc >> "${log}" 2>&1 && \
 EndPhase || Abort) &
 
@@ -361,7 +367,7 @@ StartPhase "Cleanup of Intermediate Files"
 for p in $(seq 0 "$((PHASE-1))"); do
     rm -f GesamtTiteldaten-post-phase"$p"-??????.mrc
 done
-rm -f child_refs child_titles parent_refs
+rm -f child_refs child_titles parent_refs SuperiorWorks-"${date}".table
 EndPhase
 
 echo -e "\n\nPipeline done after $(CalculateTimeDifference $OVERALL_START $(date +%s.%N)) minutes." | tee --append "${log}"
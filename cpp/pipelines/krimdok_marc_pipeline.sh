@@ -41,6 +41,7 @@ function StartPhase {
         ((++PHASE))
     fi
     START=$(date +%s.%N)
+    PHASE_TITLE="$1"
     echo "*** Phase $PHASE: $1 - $(date) ***" | tee --append "${log}"
 }
 
@@ -58,6 +59,8 @@ function CalculateTimeDifference {
 function EndPhase {
     PHASE_DURATION=$(CalculateTimeDifference $START $(date +%s.%N))
     echo -e "Done after ${PHASE_DURATION} minutes.\n" | tee --append "${log}"
+    # Records the duration in the phase history and warns if the phase has become a lot slower than usual:
+    phase_monitor "krimdok: ${PHASE_TITLE}" --wall-time=$(echo "$(date +%s.%N) - $START" | bc --mathlib) >> "${log}" 2>&1 || true
 }
 
 
@@ -67,7 +70,7 @@ function CleanUp {
 
 
 # Set up the log file:
-logdir=/usr/local/var/log/tuefind
+logdir=${PIPELINE_LOG_DIR:-/usr/local/var/log/tuefind} # Overridden by pipeline_benchmark.sh.
 log="${logdir}/krimdok_marc_pipeline.log"
 rm -f "${log}"
 
@@ -119,7 +122,8 @@ EndPhase
 
 
 StartPhase "Add ISBN's or ISSN's to Articles"
-add_isbns_or_issns_to_articles GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
+add_isbns_or_issns_to_articles --superior-works-table=SuperiorWorks-"${date}".table \
+                               GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
                                GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc >> "${log}" 2>&1
 EndPhase
 
@@ -141,7 +145,8 @@ EndPhase
 
 
 StartPhase "Fill in missing 773\$a Subfields"
-augment_773a --verbose GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
+augment_773a --verbose --superior-works-table=SuperiorWorks-"${date}".table \
+                       GesamtTiteldaten-post-phase"$((PHASE-1))"-"${date}".mrc \
                        GesamtTiteldaten-post-phase"$PHASE"-"${date}".mrc >> "${log}" 2>&1
 EndPhase
 
@@ -181,7 +186,7 @@ StartPhase "Cleanup of Intermediate Files"
 for p in $(seq "$((PHASE-1))"); do
     rm -f GesamtTiteldaten-post-phase"$p"-??????.mrc
 done
-rm -f full_text.db
+rm -f full_text.db SuperiorWorks-"${date}".table
 EndPhase
 
 
@@ -50,6 +50,8 @@ class IxTheoMapper {
 public:
     explicit IxTheoMapper(const std::vector<std::string> &map_file_line);
 
+    inline const std::string &getFromHierarchy() const { return from_hierarchy_; }
+
     /** \brief Returns an IxTheo notation if we can match "hierarchy_classification".  O/w we return the empty string. */
     std::string map(const std::string &hierarchy_classification) const;
 };
@@ -77,17 +79,71 @@ std::string IxTheoMapper::map(const std::string &hierarchy_classification) const
 }
 
 
-void LoadCSVFile(const std::string &filename, std::vector<IxTheoMapper> * const mappers) {
-    DSVReader csv_reader(filename);
+/** \class IxTheoMapperIndex
+ *  \brief Finds the mappers whose DDC hierarchies are prefixes of a classification w/o trying all mappers.
+ *  \note  We look up all prefixes of a classification, so the cost of a lookup only depends on the length of the
+ *         classification and the number of matching mappers.
+ */
+class IxTheoMapperIndex {
+    std::vector<IxTheoMapper> mappers_;
+    std::unordered_map<std::string, std::vector<size_t>> from_hierarchies_to_mapper_indices_map_;
+    size_t max_from_hierarchy_length_;
+public:
+    explicit IxTheoMapperIndex(const std::string &csv_filename);
+
+    /** \brief Maps all of "classifications" at once.
+     *  \return The mapped notations in the order that we'd get if we tried each mapper, in the order in which they
+     *          were listed in the CSV file, on each of the classifications.
+     */
+    std::vector<std::string> map(const std::set<std::string> &classifications) const;
+};
+
+
+IxTheoMapperIndex::IxTheoMapperIndex(const std::string &csv_filename): max_from_hierarchy_length_(0) {
+    DSVReader csv_reader(csv_filename);
     std::vector<std::string> csv_values;
-    while (csv_reader.readLine(&csv_values))
-        mappers->emplace_back(csv_values);
+    while (csv_reader.readLine(&csv_values)) {
+        mappers_.emplace_back(csv_values);
+        const std::string &from_hierarchy(mappers_.back().getFromHierarchy());
+        from_hierarchies_to_mapper_indices_map_[from_hierarchy].emplace_back(mappers_.size() - 1);
+        max_from_hierarchy_length_ = std::max(max_from_hierarchy_length_, from_hierarchy.length());
+    }
 
-    LOG_INFO("Read " + std::to_string(mappers->size()) + " mappings from '" + filename + "'.");
+    LOG_INFO("Read " + std::to_string(mappers_.size()) + " mappings from '" + csv_filename + "'.");
 }
 
 
-void UpdateIxTheoNotations(const std::vector<IxTheoMapper> &mappers, const std::set<std::string> &orig_values,
+std::vector<std::string> IxTheoMapperIndex::map(const std::set<std::string> &classifications) const {
+    // Pairs of mapper indices and classification indices that we then sort into the order of our contract:
+    std::vector<std::pair<size_t, size_t>> mapper_and_classification_indices;
+    std::vector<const std::string *> classifications_vector;
+    for (const auto &classification : classifications) {
+        classifications_vector.emplace_back(&classification);
+        const size_t max_prefix_length(std::min(classification.length(), max_from_hierarchy_length_));
+        for (size_t prefix_length(0); prefix_length <= max_prefix_length; ++prefix_length) {
+            const auto from_hierarchy_and_mapper_indices(
+                from_hierarchies_to_mapper_indices_map_.find(classification.substr(0, prefix_length)));
+            if (from_hierarchy_and_mapper_indices == from_hierarchies_to_mapper_indices_map_.cend())
+                continue;
+            for (const auto mapper_index : from_hierarchy_and_mapper_indices->second)
+                mapper_and_classification_indices.emplace_back(mapper_index, classifications_vector.size() - 1);
+        }
+    }
+    std::sort(mapper_and_classification_indices.begin(), mapper_and_classification_indices.end());
+
+    std::vector<std::string> notations;
+    for (const auto &mapper_and_classification_index : mapper_and_classification_indices) {
+        const std::string notation(mappers_[mapper_and_classification_index.first].map(
+            *classifications_vector[mapper_and_classification_index.second]));
+        if (not notation.empty())
+            notations.emplace_back(notation);
+    }
+
+    return notations;
+}
+
+
+void UpdateIxTheoNotations(const IxTheoMapperIndex &mapper_index, const std::set<std::string> &orig_values,
                            std::string * const ixtheo_notations_list)
 {
     std::vector<std::string> ixtheo_notations_vector;
@@ -95,24 +151,19 @@ void UpdateIxTheoNotations(const std::vector<IxTheoMapper> &mappers, const std::
     std::set<std::string> previously_assigned_notations(std::make_move_iterator(ixtheo_notations_vector.begin()),
                                                         std::make_move_iterator(ixtheo_notations_vector.end()));
 
-    for (const auto &mapper : mappers) {
-        for (const auto &orig_value : orig_values) {
-            const std::string mapped_value(mapper.map(orig_value));
-            if (not mapped_value.empty()
-                and previously_assigned_notations.find(mapped_value) == previously_assigned_notations.end())
-            {
-                if (not ixtheo_notations_list->empty())
-                    *ixtheo_notations_list += ':';
-                *ixtheo_notations_list += mapped_value;
-                previously_assigned_notations.insert(mapped_value);
-            }
+    for (const auto &mapped_value : mapper_index.map(orig_values)) {
+        if (previously_assigned_notations.find(mapped_value) == previously_assigned_notations.end()) {
+            if (not ixtheo_notations_list->empty())
+                *ixtheo_notations_list += ':';
+            *ixtheo_notations_list += mapped_value;
+            previously_assigned_notations.insert(mapped_value);
         }
     }
 }
 
 
 void ProcessRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                    const std::vector<IxTheoMapper> &ddc_to_ixtheo_notation_mappers)
+                    const IxTheoMapperIndex &ddc_to_ixtheo_notation_mapper_index)
 {
     unsigned count(0), records_with_ixtheo_notations(0), records_with_new_notations(0), skipped_group_count(0);
     while (MARC::Record record = marc_reader->read()) {
@@ -141,7 +192,7 @@ void ProcessRecords(MARC::Reader * const marc_reader, MARC::Writer * const marc_
             continue;
         }
 
-        UpdateIxTheoNotations(ddc_to_ixtheo_notation_mappers, ddc_values, &ixtheo_notations_list);
+        UpdateIxTheoNotations(ddc_to_ixtheo_notation_mapper_index, ddc_values, &ixtheo_notations_list);
         if (not ixtheo_notations_list.empty())
             LOG_DEBUG(record.getControlNumber() + ": " + StringUtil::Join(ddc_values, ',') + " -> " + ixtheo_notations_list);
 
@@ -170,9 +221,7 @@ int Main(int argc, char **argv) {
     auto marc_reader(MARC::Reader::Factory(argv[1]));
     auto marc_writer(MARC::Writer::Factory(argv[2]));
 
-    std::vector<IxTheoMapper> ddc_to_ixtheo_notation_mappers;
-    LoadCSVFile(argv[3], &ddc_to_ixtheo_notation_mappers);
-
-    ProcessRecords(marc_reader.get(), marc_writer.get(), ddc_to_ixtheo_notation_mappers);
+    const IxTheoMapperIndex ddc_to_ixtheo_notation_mapper_index(argv[3]);
+    ProcessRecords(marc_reader.get(), marc_writer.get(), ddc_to_ixtheo_notation_mapper_index);
     return EXIT_SUCCESS;
 }
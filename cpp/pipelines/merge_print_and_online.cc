@@ -17,13 +17,17 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <queue>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include "DbConnection.h"
 #include "DbResultSet.h"
 #include "FileUtil.h"
@@ -37,12 +41,18 @@
 namespace {
 
 
+const unsigned DEFAULT_MEMORY_LIMIT(1024); // in MiB
+
+
 [[noreturn]] void Usage() {
     std::cerr << "Usage: " << ::progname
-              << " [--min-log-level=min_log_level] [--debug] marc_input marc_output missing_ppn_partners_list\n"
+              << " [--min-log-level=min_log_level] [--debug] [--memory-limit=MiB] marc_input marc_output\n"
+              << "       missing_ppn_partners_list\n"
               << "       missing_ppn_partners_list will be generated by this program and will contain the PPN's\n"
               << "       of superior works with cross links between print and online edition with one of\n"
-              << "       the partners missing.  N.B. the input MARC file *must* be in the MARC-21 format!\n\n";
+              << "       the partners missing.  N.B. the input MARC file *must* be in the MARC-21 format!\n"
+              << "       The PPN's and offsets of all records are sorted externally w/o holding more than about\n"
+              << "       \"memory_limit\" MiB of them in memory.  The default is " << DEFAULT_MEMORY_LIMIT << ".\n\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -90,8 +100,124 @@ void SerializeMultimap(const std::string &output_filename, const std::unordered_
 }
 
 
+/** \class PPNOffsetSorter
+ *  \brief Sorts (PPN, offset) pairs w/o holding more than about "memory_limit" bytes of them in memory.
+ *  \note  Like marc_diff's SortedRecordStream, we write sorted runs to temporary files and merge them as we go.  If all
+ *         pairs fit into memory, no runs will be written.
+ */
+class PPNOffsetSorter {
+    const size_t memory_limit_;
+    std::vector<std::pair<std::string, off_t>> buffer_;
+    size_t buffered_size_, buffer_read_pos_;
+    std::vector<std::unique_ptr<FileUtil::AutoTempFile>> run_files_;
+    std::vector<std::unique_ptr<File>> run_inputs_;
+    std::vector<std::pair<std::string, off_t>> run_heads_; // The next pair of each run.
+
+    // PPN's and run numbers of the run heads.  The lowest PPN is on top.
+    std::priority_queue<std::pair<std::string, size_t>, std::vector<std::pair<std::string, size_t>>,
+                        std::greater<std::pair<std::string, size_t>>> heads_queue_;
+public:
+    explicit PPNOffsetSorter(const size_t memory_limit)
+        : memory_limit_(memory_limit), buffered_size_(0), buffer_read_pos_(0) { }
+
+    void add(const std::string &ppn, const off_t offset);
+
+    /** \brief Must be called after the last call to add() and before the first call to getNext(). */
+    void finishInput();
+
+    /** \return False if there are no pairs left, else true.
+     *  \note   PPN's that were added more than once will be returned more than once.
+     */
+    bool getNext(std::string * const ppn, off_t * const offset);
+
+    inline size_t getRunCount() const { return run_files_.size(); }
+private:
+    void writeRun();
+    void advance(const size_t run_no);
+};
+
+
+void PPNOffsetSorter::add(const std::string &ppn, const off_t offset) {
+    buffer_.emplace_back(ppn, offset);
+    buffered_size_ += sizeof(buffer_.back()) + ppn.size();
+    if (buffered_size_ >= memory_limit_)
+        writeRun();
+}
+
+
+void PPNOffsetSorter::finishInput() {
+    if (run_files_.empty()) { // Everything fits into memory.
+        std::sort(buffer_.begin(), buffer_.end());
+        return;
+    }
+
+    if (not buffer_.empty())
+        writeRun();
+    buffer_.shrink_to_fit();
+
+    for (size_t run_no(0); run_no < run_files_.size(); ++run_no) {
+        run_inputs_.emplace_back(FileUtil::OpenInputFileOrDie(run_files_[run_no]->getFilePath()));
+        run_heads_.emplace_back();
+        advance(run_no);
+    }
+}
+
+
+bool PPNOffsetSorter::getNext(std::string * const ppn, off_t * const offset) {
+    if (run_files_.empty()) {
+        if (buffer_read_pos_ == buffer_.size())
+            return false;
+        *ppn = buffer_[buffer_read_pos_].first;
+        *offset = buffer_[buffer_read_pos_].second;
+        ++buffer_read_pos_;
+        return true;
+    }
+
+    if (heads_queue_.empty())
+        return false;
+
+    const size_t run_no(heads_queue_.top().second);
+    heads_queue_.pop();
+    *ppn = run_heads_[run_no].first;
+    *offset = run_heads_[run_no].second;
+    advance(run_no);
+    return true;
+}
+
+
+void PPNOffsetSorter::writeRun() {
+    std::sort(buffer_.begin(), buffer_.end());
+
+    run_files_.emplace_back(new FileUtil::AutoTempFile("/tmp/merge_print_and_online_run"));
+    const auto run_output(FileUtil::OpenOutputFileOrDie(run_files_.back()->getFilePath()));
+    for (const auto &ppn_and_offset : buffer_)
+        *run_output << ppn_and_offset.first << ' ' << std::to_string(ppn_and_offset.second) << '\n';
+
+    buffer_.clear();
+    buffered_size_ = 0;
+}
+
+
+void PPNOffsetSorter::advance(const size_t run_no) {
+    std::string line;
+    if (run_inputs_[run_no]->getline(&line) == 0)
+        return;
+
+    const auto space_pos(line.find(' '));
+    unsigned long long offset;
+    if (unlikely(space_pos == std::string::npos
+                 or not StringUtil::ToUnsignedLongLong(line.substr(space_pos + 1), &offset)))
+        LOG_ERROR("bad line \"" + line + "\" in \"" + run_files_[run_no]->getFilePath() + "\"!");
+    run_heads_[run_no].first = line.substr(0, space_pos);
+    run_heads_[run_no].second = static_cast<off_t>(offset);
+    heads_queue_.emplace(run_heads_[run_no].first, run_no);
+}
+
+
+// The offsets of all records go to "ppn_offset_sorter" as we don't want to keep them in memory and only need those of the
+// records that will be merged.
 void CollectRecordOffsetsAndCrosslinks(const bool debug,
-    MARC::Reader * const marc_reader, std::unordered_map<std::string, off_t> * const ppn_to_offset_map,
+    MARC::Reader * const marc_reader, PPNOffsetSorter * const ppn_offset_sorter,
     std::unordered_map<std::string, std::string> * const ppn_to_canonical_ppn_map,
     std::unordered_multimap<std::string, std::string> * const canonical_ppn_to_ppn_map)
 {
@@ -100,10 +226,7 @@ void CollectRecordOffsetsAndCrosslinks(const bool debug,
     while (const auto record = marc_reader->read()) {
         ++record_count;
 
-        if (unlikely(ppn_to_offset_map->find(record.getControlNumber()) != ppn_to_offset_map->end()))
-            LOG_ERROR("duplicate PPN \"" + record.getControlNumber() + "\" in input file \"" + marc_reader->getPath() + "\"!");
-
-        (*ppn_to_offset_map)[record.getControlNumber()] = last_offset;
+        ppn_offset_sorter->add(record.getControlNumber(), last_offset);
 
         last_offset = marc_reader->tell();
 
@@ -156,14 +279,46 @@ void CollectRecordOffsetsAndCrosslinks(const bool debug,
         map_filename = "canonical_ppn_to_ppn.map";
         SerializeMultimap(map_filename, *canonical_ppn_to_ppn_map);
         std::cerr << "Wrote the mapping from canonical PPN's to non-canonical PPN's to \"" + map_filename + "\"!";
-
-        map_filename = "ppn_to_offset.map";
-        SerializeMap(map_filename, *ppn_to_offset_map);
-        std::cerr << "Wrote the mapping from canonical PPN's to non-canonical PPN's to \"" + map_filename + "\"!";
     }
 
+    ppn_offset_sorter->finishInput();
+
     LOG_INFO("Found " + std::to_string(record_count) + " record(s).");
     LOG_INFO("Found " + std::to_string(ppn_to_canonical_ppn_map->size()) + " cross link(s).");
+    LOG_INFO("Sorted the record offsets in " + std::to_string(ppn_offset_sorter->getRunCount()) + " run(s).");
+}
+
+
+// Streams the sorted PPN's and offsets of all records in order to detect duplicate PPN's and to find the offsets of the
+// records that participate in merges.  PPN's that don't end up in "ppn_to_offset_map" are missing in our data.
+void LookUpGroupOffsets(const bool debug, const std::string &marc_input_path, PPNOffsetSorter * const ppn_offset_sorter,
+                        const std::unordered_map<std::string, std::string> &ppn_to_canonical_ppn_map,
+                        std::unordered_map<std::string, off_t> * const ppn_to_offset_map)
+{
+    std::unordered_set<std::string> group_ppns;
+    for (const auto &ppn_and_canonical_ppn : ppn_to_canonical_ppn_map) {
+        group_ppns.emplace(ppn_and_canonical_ppn.first);
+        group_ppns.emplace(ppn_and_canonical_ppn.second);
+    }
+
+    std::unique_ptr<File> map_file;
+    if (debug)
+        map_file = FileUtil::OpenOutputFileOrDie("ppn_to_offset.map");
+
+    std::string ppn, last_ppn;
+    off_t offset;
+    while (ppn_offset_sorter->getNext(&ppn, &offset)) {
+        if (unlikely(ppn == last_ppn))
+            LOG_ERROR("duplicate PPN \"" + ppn + "\" in input file \"" + marc_input_path + "\"!");
+        if (group_ppns.find(ppn) != group_ppns.cend())
+            ppn_to_offset_map->emplace(ppn, offset);
+        if (debug)
+            *map_file << ppn << " -> " << std::to_string(offset) << '\n';
+        last_ppn.swap(ppn);
+    }
+
+    if (debug)
+        std::cerr << "Wrote the mapping from PPN's to offsets to \"ppn_to_offset.map\"!";
 }
 
 
@@ -518,17 +673,14 @@ MARC::Record MergeRecordPair(MARC::Record &record1, MARC::Record &record2) {
 }
 
 
-MARC::Record ReadRecordFromOffsetOrDie(MARC::Reader * const marc_reader, const off_t offset) {
-    const auto saved_offset(marc_reader->tell());
-    if (unlikely(not marc_reader->seek(offset)))
+// "partner_reader" is only used for random access so that we don't disturb the buffering of the sequential reader.
+MARC::Record ReadRecordFromOffsetOrDie(MARC::Reader * const partner_reader, const off_t offset) {
+    if (unlikely(not partner_reader->seek(offset)))
         LOG_ERROR("can't seek to offset " + std::to_string(offset) + "!");
-    MARC::Record record(marc_reader->read());
+    MARC::Record record(partner_reader->read());
     if (unlikely(not record))
         LOG_ERROR("failed to read a record from offset " + std::to_string(offset) + "!");
 
-    if (unlikely(not marc_reader->seek(saved_offset)))
-        LOG_ERROR("failed to seek to previous position " + std::to_string(saved_offset) + "!");
-
     return record;
 }
 
@@ -559,7 +711,8 @@ void DeleteCrossLinkFields(MARC::Record * const record) {
 // Merges the records in ppn_to_canonical_ppn_map in such a way that for each entry, "second" will be merged into "first".
 // "second" will then be collected in "skip_ppns" for a future copy phase where it will be dropped.  Uplinks that referenced
 // "second" will be replaced with "first".
-void MergeRecordsAndPatchUplinks(const bool /*debug*/, MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
+void MergeRecordsAndPatchUplinks(const bool /*debug*/, MARC::Reader * const marc_reader, MARC::Reader * const partner_reader,
+                                 MARC::Writer * const marc_writer,
                                  const std::unordered_map<std::string, off_t> &ppn_to_offset_map,
                                  const std::unordered_map<std::string, std::string> &ppn_to_canonical_ppn_map,
                                  const std::unordered_multimap<std::string, std::string> &canonical_ppn_to_ppn_map)
@@ -583,7 +736,7 @@ void MergeRecordsAndPatchUplinks(const bool /*debug*/, MARC::Reader * const marc
                 const auto record2_ppn_and_offset(ppn_to_offset_map.find(canonical_ppn_and_ppn->second));
                 if (unlikely(record2_ppn_and_offset == ppn_to_offset_map.cend()))
                     LOG_ERROR("this should *never* happen! missing PPN in ppn_to_offset_map: " + canonical_ppn_and_ppn->second);
-                MARC::Record record2(ReadRecordFromOffsetOrDie(marc_reader, record2_ppn_and_offset->second));
+                MARC::Record record2(ReadRecordFromOffsetOrDie(partner_reader, record2_ppn_and_offset->second));
                 merged_ppns.emplace(record2.getControlNumber());
                 record = MergeRecordPair(Patch246i(&record), Patch246i(&record2));
                 ++merged_count;
@@ -683,11 +836,17 @@ int Main(int argc, char *argv[]) {
         Usage();
 
     bool debug(false);
-    if (std::strcmp(argv[1], "--debug") == 0) {
-        debug = true;
-        --argc, ++argv;
-        if (argc < 4)
+    unsigned memory_limit(DEFAULT_MEMORY_LIMIT);
+    while (argc > 1 and StringUtil::StartsWith(argv[1], "--")) {
+        if (std::strcmp(argv[1], "--debug") == 0)
+            debug = true;
+        else if (StringUtil::StartsWith(argv[1], "--memory-limit=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--memory-limit="), &memory_limit)
+                or memory_limit == 0)
+                LOG_ERROR("bad memory limit in \"" + std::string(argv[1]) + "\"!");
+        } else
             Usage();
+        --argc, ++argv;
     }
 
     if (argc != 4)
@@ -697,17 +856,23 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(argv[2]));
     std::unique_ptr<File> missing_partners(FileUtil::OpenOutputFileOrDie(argv[3]));
 
+    // Only contains the offsets of the records that participate in merges:
     std::unordered_map<std::string, off_t> ppn_to_offset_map;
     std::unordered_map<std::string, std::string> ppn_to_canonical_ppn_map;
     std::unordered_multimap<std::string, std::string> canonical_ppn_to_ppn_map;
-    CollectRecordOffsetsAndCrosslinks(debug, marc_reader.get(), &ppn_to_offset_map,
-                                      &ppn_to_canonical_ppn_map, &canonical_ppn_to_ppn_map);
+    {
+        PPNOffsetSorter ppn_offset_sorter(static_cast<size_t>(memory_limit) * 1024 * 1024);
+        CollectRecordOffsetsAndCrosslinks(debug, marc_reader.get(), &ppn_offset_sorter,
+                                          &ppn_to_canonical_ppn_map, &canonical_ppn_to_ppn_map);
+        LookUpGroupOffsets(debug, marc_reader->getPath(), &ppn_offset_sorter, ppn_to_canonical_ppn_map, &ppn_to_offset_map);
+    }
 
     EliminateDanglingOrUnreferencedCrossLinks(debug, ppn_to_offset_map, &ppn_to_canonical_ppn_map, &canonical_ppn_to_ppn_map);
 
     marc_reader->rewind();
-    MergeRecordsAndPatchUplinks(debug, marc_reader.get(), marc_writer.get(), ppn_to_offset_map, ppn_to_canonical_ppn_map,
-                                canonical_ppn_to_ppn_map);
+    std::unique_ptr<MARC::Reader> partner_reader(MARC::Reader::Factory(argv[1], MARC::FileType::BINARY));
+    MergeRecordsAndPatchUplinks(debug, marc_reader.get(), partner_reader.get(), marc_writer.get(), ppn_to_offset_map,
+                                ppn_to_canonical_ppn_map, canonical_ppn_to_ppn_map);
 
     if (not debug) {
         std::shared_ptr<DbConnection> db_connection(VuFind::GetDbConnection());
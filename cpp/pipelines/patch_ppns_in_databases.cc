@@ -26,14 +26,17 @@
 #include <vector>
 #include <cstdlib>
 #include <cstring>
-#include <kchashdb.h>
 #include "Compiler.h"
+#include "DbBulkInserter.h"
 #include "DbConnection.h"
 #include "DbResultSet.h"
 #include "DbRow.h"
 #include "FileUtil.h"
+#include "KeyValueStore.h"
 #include "MapUtil.h"
 #include "MARC.h"
+#include "PPN.h"
+#include "PPNMappingStore.h"
 #include "RegexMatcher.h"
 #include "StringUtil.h"
 #include "UBTools.h"
@@ -61,9 +64,12 @@ public:
 };
 
 
+// Mappings that the legacy map file knows about but "ppn_mapping_store" doesn't end up in
+// "legacy_old_ppns_sigils_and_new_ppns" so that they can be migrated w/o being processed again.
 void LoadMapping(MARC::Reader * const marc_reader,
-                 const std::unordered_multimap<std::string, std::string> &already_processed_ppns_and_sigils,
-                 std::vector<PPNsAndSigil> * const old_ppns_sigils_and_new_ppns)
+                 const std::unordered_multimap<std::string, std::string> &legacy_processed_ppns_and_sigils,
+                 const PPNMappingStore &ppn_mapping_store, std::vector<PPNsAndSigil> * const old_ppns_sigils_and_new_ppns,
+                 std::vector<PPNsAndSigil> * const legacy_old_ppns_sigils_and_new_ppns)
 {
     auto matcher(RegexMatcher::RegexMatcherFactoryOrDie("^\\((DE-627)\\)(.+)"));
     while (const auto record = marc_reader->read()) {
@@ -72,7 +78,11 @@ void LoadMapping(MARC::Reader * const marc_reader,
             if (matcher->matched(subfield_a)) {
                 const std::string old_sigil((*matcher)[1]);
                 const std::string old_ppn((*matcher)[2]);
-                if (old_ppn != record.getControlNumber() and not MapUtil::Contains(already_processed_ppns_and_sigils, old_ppn, old_sigil))
+                if (old_ppn == record.getControlNumber() or ppn_mapping_store.getNewPPN(old_ppn) == record.getControlNumber())
+                    continue;
+                if (MapUtil::Contains(legacy_processed_ppns_and_sigils, old_ppn, old_sigil))
+                    legacy_old_ppns_sigils_and_new_ppns->emplace_back(old_ppn, old_sigil, record.getControlNumber());
+                else
                     old_ppns_sigils_and_new_ppns->emplace_back(old_ppn, old_sigil, record.getControlNumber());
             }
         }
@@ -83,94 +93,104 @@ void LoadMapping(MARC::Reader * const marc_reader,
 }
 
 
+// Temporary tables are private to our connection and vanish when it is closed.
+const std::string PPN_MAPPING_TABLE("vufind.patch_ppns_mapping");
+const std::string DELETION_PPNS_TABLE("vufind.patch_ppns_deletions");
+
+
+// Loads the mappings w/ a few multi-row INSERT's so that each table can then be patched w/ a single UPDATE.
+void LoadMappingTable(DbConnection * const db_connection, const std::vector<PPNsAndSigil> &old_ppns_sigils_and_new_ppns) {
+    db_connection->queryOrDie("DROP TEMPORARY TABLE IF EXISTS " + PPN_MAPPING_TABLE);
+    db_connection->queryOrDie("CREATE TEMPORARY TABLE " + PPN_MAPPING_TABLE
+                              + " (old_ppn VARCHAR(255) NOT NULL PRIMARY KEY, new_ppn VARCHAR(255) NOT NULL)");
+
+    // If an old PPN has been mapped more than once, the first mapping wins as the original one-UPDATE-per-mapping loop did:
+    DbBulkInserter bulk_inserter(db_connection, PPN_MAPPING_TABLE, { "old_ppn", "new_ppn" }, DbConnection::DKB_IGNORE);
+    for (const auto &old_ppn_sigil_and_new_ppn : old_ppns_sigils_and_new_ppns)
+        bulk_inserter.insert({ old_ppn_sigil_and_new_ppn.old_ppn_, old_ppn_sigil_and_new_ppn.new_ppn_ });
+}
+
+
+void LoadDeletionTable(DbConnection * const db_connection, const std::unordered_set<std::string> &deletion_ppns) {
+    db_connection->queryOrDie("DROP TEMPORARY TABLE IF EXISTS " + DELETION_PPNS_TABLE);
+    db_connection->queryOrDie("CREATE TEMPORARY TABLE " + DELETION_PPNS_TABLE + " (ppn VARCHAR(255) NOT NULL PRIMARY KEY)");
+
+    DbBulkInserter bulk_inserter(db_connection, DELETION_PPNS_TABLE, { "ppn" }, DbConnection::DKB_IGNORE);
+    for (const auto &deletion_ppn : deletion_ppns)
+        bulk_inserter.insert({ deletion_ppn });
+}
+
+
 void PatchTable(DbConnection * const db_connection, const std::string &table, const std::string &column,
-                const std::vector<PPNsAndSigil> &old_ppns_sigils_and_new_ppns)
+                const std::vector<PPNsAndSigil> &/*old_ppns_sigils_and_new_ppns*/)
 {
-    const unsigned MAX_BATCH_SIZE(100);
-
-    db_connection->queryOrDie("BEGIN");
-
-    unsigned replacement_count(0), batch_size(0);
-    for (const auto &old_ppn_sigil_and_new_ppn : old_ppns_sigils_and_new_ppns) {
-        ++batch_size;
-        db_connection->queryOrDie("UPDATE IGNORE " + table + " SET " + column + "='" + old_ppn_sigil_and_new_ppn.new_ppn_
-                                  + "' WHERE " + column + "='" + old_ppn_sigil_and_new_ppn.old_ppn_ + "'");
-        replacement_count += db_connection->getNoOfAffectedRows();
-        if (batch_size >= MAX_BATCH_SIZE) {
-            db_connection->queryOrDie("COMMIT");
-            db_connection->queryOrDie("BEGIN");
-        }
-    }
-
-    db_connection->queryOrDie("COMMIT");
+    db_connection->queryOrDie("UPDATE IGNORE " + table + " JOIN " + PPN_MAPPING_TABLE + " ON " + table + "." + column + "="
+                              + PPN_MAPPING_TABLE + ".old_ppn SET " + table + "." + column + "=" + PPN_MAPPING_TABLE + ".new_ppn");
+    const unsigned replacement_count(db_connection->getNoOfAffectedRows());
 
     LOG_INFO("Replaced " + std::to_string(replacement_count) + " rows in " + table + ".");
 }
 
 
 void DeleteFromTable(DbConnection * const db_connection, const std::string &table, const std::string &column,
-                     const std::unordered_set<std::string> &deletion_ppns)
+                     const std::unordered_set<std::string> &/*deletion_ppns*/)
 {
-    const unsigned MAX_BATCH_SIZE(100);
+    db_connection->queryOrDie("DELETE " + table + " FROM " + table + " JOIN " + DELETION_PPNS_TABLE + " ON " + table + "."
+                              + column + "=" + DELETION_PPNS_TABLE + ".ppn");
+    const unsigned deletion_count(db_connection->getNoOfAffectedRows());
+
+    LOG_INFO("Deleted " + std::to_string(deletion_count) + " rows from " + table + ".");
+}
 
-    db_connection->queryOrDie("BEGIN");
 
-    unsigned deletion_count(0), batch_size(0);
-    for (const auto &deletion_ppn : deletion_ppns) {
-        ++batch_size;
-        db_connection->queryOrDie("DELETE FROM '" + table + "' WHERE " + column + "='" + deletion_ppn + "'");
-        deletion_count += db_connection->getNoOfAffectedRows();
-        if (batch_size >= MAX_BATCH_SIZE) {
-            db_connection->queryOrDie("COMMIT");
-            db_connection->queryOrDie("BEGIN");
-        }
+// \return Null if there is no notified DB for "user_type".
+std::unique_ptr<KeyValueStore> OpenNotifiedDB(const std::string &user_type) {
+    const std::string DB_FILENAME(UBTools::GetTuelibPath() + user_type + "_notified.lmdb");
+    KeyValueStore::MigrateFromKyotoCabinetDB(UBTools::GetTuelibPath() + user_type + "_notified.db", DB_FILENAME);
+    if (not FileUtil::Exists(DB_FILENAME)) {
+        LOG_INFO("\"" + DB_FILENAME + "\" not found!");
+        return nullptr;
     }
 
-    db_connection->queryOrDie("COMMIT");
-
-    LOG_INFO("Deleted " + std::to_string(deletion_count) + " rows from " + table + ".");
+    return std::unique_ptr<KeyValueStore>(new KeyValueStore(DB_FILENAME, KeyValueStore::READ_WRITE));
 }
 
 
 void PatchNotifiedDB(const std::string &user_type, const std::vector<PPNsAndSigil> &old_ppns_sigils_and_new_ppns) {
-    const std::string DB_FILENAME(UBTools::GetTuelibPath() + user_type + "_notified.db");
-    std::unique_ptr<kyotocabinet::HashDB> db(new kyotocabinet::HashDB());
-    if (not (db->open(DB_FILENAME, kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OREADER))) {
-        LOG_INFO("\"" + DB_FILENAME + "\" not found!");
+    const std::unique_ptr<KeyValueStore> db(OpenNotifiedDB(user_type));
+    if (db == nullptr)
         return;
-    }
 
     unsigned updated_count(0);
+    KeyValueStore::WriteTransaction transaction(db.get());
     for (const auto &ppns_and_sigil : old_ppns_sigils_and_new_ppns) {
         std::string value;
-        if (db->get(ppns_and_sigil.old_ppn_, &value)) {
-            if (unlikely(not db->remove(ppns_and_sigil.old_ppn_)))
-                LOG_ERROR("failed to remove key \"" + ppns_and_sigil.old_ppn_ + "\" from \"" + DB_FILENAME + "\"!");
-            if (unlikely(not db->add(ppns_and_sigil.old_ppn_, value)))
-                LOG_ERROR("failed to add key \"" + ppns_and_sigil.old_ppn_ + "\" from \"" + DB_FILENAME + "\"!");
+        if (transaction.get(ppns_and_sigil.old_ppn_, &value)) {
+            transaction.remove(ppns_and_sigil.old_ppn_);
+            transaction.put(ppns_and_sigil.new_ppn_, value);
             ++updated_count;
         }
     }
+    transaction.commit();
 
-    LOG_INFO("Updated " + std::to_string(updated_count) + " entries in \"" + DB_FILENAME + "\".");
+    LOG_INFO("Updated " + std::to_string(updated_count) + " entries in \"" + db->getPath() + "\".");
 }
 
 
 void DeleteFromNotifiedDB(const std::string &user_type, const std::unordered_set<std::string> &deletion_ppns) {
-    const std::string DB_FILENAME(UBTools::GetTuelibPath() + user_type + "_notified.db");
-    std::unique_ptr<kyotocabinet::HashDB> db(new kyotocabinet::HashDB());
-    if (not (db->open(DB_FILENAME, kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OREADER))) {
-        LOG_INFO("\"" + DB_FILENAME + "\" not found!");
+    const std::unique_ptr<KeyValueStore> db(OpenNotifiedDB(user_type));
+    if (db == nullptr)
         return;
-    }
 
     unsigned deletion_count(0);
+    KeyValueStore::WriteTransaction transaction(db.get());
     for (const auto &deletion_ppn : deletion_ppns) {
-        if (db->remove(deletion_ppn))
+        if (transaction.remove(deletion_ppn))
             ++deletion_count;
     }
+    transaction.commit();
 
-    LOG_INFO("Deleted " + std::to_string(deletion_count) + " entries from \"" + DB_FILENAME + "\".");
+    LOG_INFO("Deleted " + std::to_string(deletion_count) + " entries from \"" + db->getPath() + "\".");
 }
 
 
@@ -203,11 +223,9 @@ void CheckMySQLPermissions(DbConnection * const db_connection) {
 }
 
 
-void AddPPNsAndSigilsToMultiMap(const std::vector<PPNsAndSigil> &old_ppns_sigils_and_new_ppns,
-                                std::unordered_multimap<std::string, std::string> * const already_processed_ppns_and_sigils)
-{
+void AddMappingsToStore(const std::vector<PPNsAndSigil> &old_ppns_sigils_and_new_ppns, PPNMappingStore * const ppn_mapping_store) {
     for (const auto &old_ppn_sigil_and_new_ppn : old_ppns_sigils_and_new_ppns)
-        already_processed_ppns_and_sigils->emplace(std::make_pair(old_ppn_sigil_and_new_ppn.old_ppn_, old_ppn_sigil_and_new_ppn.old_sigil_));
+        ppn_mapping_store->addMapping(old_ppn_sigil_and_new_ppn.old_ppn_, old_ppn_sigil_and_new_ppn.new_ppn_);
 }
 
 
@@ -233,7 +251,8 @@ void ProcessAllDatabases(DbConnection * const db_connection, const SetOrMap &set
 } // unnamed namespace
 
 
-static const std::string ALREADY_SWAPPED_PPNS_MAP_FILE(UBTools::GetTuelibPath() + "k10+_ppn_map.map");
+// Only read, so that mappings that were processed before we had the PPN mapping store won't be processed again.
+static const std::string LEGACY_ALREADY_SWAPPED_PPNS_MAP_FILE(UBTools::GetTuelibPath() + "k10+_ppn_map.map");
 
 
 int Main(int argc, char **argv) {
@@ -257,13 +276,12 @@ int Main(int argc, char **argv) {
 
     CheckMySQLPermissions(&db_connection);
 
-    std::unordered_multimap<std::string, std::string> already_processed_ppns_and_sigils;
-    if (not FileUtil::Exists(ALREADY_SWAPPED_PPNS_MAP_FILE))
-        FileUtil::WriteStringOrDie(ALREADY_SWAPPED_PPNS_MAP_FILE, "");
-    if (not store_only)
-        MapUtil::DeserialiseMap(ALREADY_SWAPPED_PPNS_MAP_FILE, &already_processed_ppns_and_sigils);
+    std::unordered_multimap<std::string, std::string> legacy_processed_ppns_and_sigils;
+    if (not store_only and FileUtil::Exists(LEGACY_ALREADY_SWAPPED_PPNS_MAP_FILE))
+        MapUtil::DeserialiseMap(LEGACY_ALREADY_SWAPPED_PPNS_MAP_FILE, &legacy_processed_ppns_and_sigils);
+    PPNMappingStore ppn_mapping_store;
 
-    std::vector<PPNsAndSigil> old_ppns_sigils_and_new_ppns;
+    std::vector<PPNsAndSigil> old_ppns_sigils_and_new_ppns, legacy_old_ppns_sigils_and_new_ppns;
     int arg_no(1);
     for (/* Intentionally empty! */; arg_no < argc; ++arg_no) {
         if (__builtin_strcmp(argv[arg_no], "--") == 0) {
@@ -271,7 +289,8 @@ int Main(int argc, char **argv) {
             break;
         }
         const auto marc_reader(MARC::Reader::Factory(argv[arg_no]));
-        LoadMapping(marc_reader.get(), already_processed_ppns_and_sigils, &old_ppns_sigils_and_new_ppns);
+        LoadMapping(marc_reader.get(), legacy_processed_ppns_and_sigils, ppn_mapping_store, &old_ppns_sigils_and_new_ppns,
+                    &legacy_old_ppns_sigils_and_new_ppns);
     }
 
     std::unordered_set <std::string> deletion_ppns;
@@ -283,6 +302,9 @@ int Main(int argc, char **argv) {
     if (arg_no != argc)
         Usage();
 
+    if (not report_only)
+        AddMappingsToStore(legacy_old_ppns_sigils_and_new_ppns, &ppn_mapping_store);
+
     if (old_ppns_sigils_and_new_ppns.empty() and deletion_ppns.empty()) {
         LOG_INFO("nothing to do!");
         return EXIT_SUCCESS;
@@ -308,19 +330,31 @@ int Main(int argc, char **argv) {
         goto clean_up_deleted_ppns;
 
     if (store_only) {
-        AddPPNsAndSigilsToMultiMap(old_ppns_sigils_and_new_ppns, &already_processed_ppns_and_sigils);
-        MapUtil::SerialiseMap(ALREADY_SWAPPED_PPNS_MAP_FILE, already_processed_ppns_and_sigils);
+        AddMappingsToStore(old_ppns_sigils_and_new_ppns, &ppn_mapping_store);
         if (not deletion_ppns.empty())
             goto clean_up_deleted_ppns;
-        return EXIT_SUCCESS;
+        goto compact_store;
     }
 
+    LoadMappingTable(&db_connection, old_ppns_sigils_and_new_ppns);
     ProcessAllDatabases(&db_connection, old_ppns_sigils_and_new_ppns, PatchNotifiedDB, PatchTable);
-    AddPPNsAndSigilsToMultiMap(old_ppns_sigils_and_new_ppns, &already_processed_ppns_and_sigils);
-    MapUtil::SerialiseMap(ALREADY_SWAPPED_PPNS_MAP_FILE, already_processed_ppns_and_sigils);
+    AddMappingsToStore(old_ppns_sigils_and_new_ppns, &ppn_mapping_store);
 
 clean_up_deleted_ppns:
-    ProcessAllDatabases(&db_connection, deletion_ppns, DeleteFromNotifiedDB, DeleteFromTable);
+    if (not deletion_ppns.empty()) {
+        LoadDeletionTable(&db_connection, deletion_ppns);
+        ProcessAllDatabases(&db_connection, deletion_ppns, DeleteFromNotifiedDB, DeleteFromTable);
+        for (const auto &deletion_ppn : deletion_ppns) {
+            PPN ppn;
+            if (PPN::Parse(deletion_ppn, &ppn)) // Deletion lists may contain other ID's, too.
+                ppn_mapping_store.addDeletion(deletion_ppn);
+        }
+    }
+
+compact_store:
+    // The log is cheap to replay, so we only compact once it has grown considerably.
+    if (ppn_mapping_store.getUncompactedCount() > ppn_mapping_store.size() / 4)
+        ppn_mapping_store.compact();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,247 @@
+/** \brief Runs a pipeline phase, records its resource usage and warns about phases that have become slower.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "TimeUtil.h"
+#include "UBTools.h"
+#include "util.h"
+
+
+namespace {
+
+
+const unsigned DEFAULT_THRESHOLD(25); // in percent
+const unsigned DEFAULT_WINDOW(10);
+const unsigned MIN_HISTORY_SIZE(3);
+
+
+[[noreturn]] void Usage() {
+    ::Usage("[--history-file=path] [--threshold=percent] [--window=count] phase_name (--wall-time=seconds|-- command [args])\n"
+            "Runs \"command\" and appends its wall-clock time, CPU times, maximum RSS and the number of bytes that it read\n"
+            "from and wrote to storage to the history file, a TSV file that defaults to $PHASE_HISTORY_FILE, if set, or\n"
+            "\"" + UBTools::GetTuelibPath() + "phase_history.tsv\".  Alternatively --wall-time records an externally\n"
+            "measured wall-clock time w/o any other resource usage.\n"
+            "Warns if the wall-clock time exceeds the average of the last \"count\" successful runs of the same phase\n"
+            "by more than \"percent\" percent.  The defaults are " + std::to_string(DEFAULT_THRESHOLD) + "% and "
+            + std::to_string(DEFAULT_WINDOW) + " runs.  At least " + std::to_string(MIN_HISTORY_SIZE) + " earlier runs\n"
+            "are required for a comparison.  Our exit code is that of \"command\".");
+}
+
+
+// Unknown values are empty strings.
+struct PhaseStats {
+    std::string wall_time_, user_cpu_time_, system_cpu_time_, max_rss_kb_, read_bytes_, write_bytes_;
+    int exit_code_;
+public:
+    PhaseStats(): exit_code_(0) { }
+};
+
+
+std::string SecondsToString(const double seconds) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%.2f", seconds);
+    return buf;
+}
+
+
+inline double TimevalToSeconds(const struct timeval &tv) {
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+// Must be called for a child that has terminated but has not yet been reaped.  As the kernel adds the counts of reaped
+// children to those of their parents, this includes the I/O of the command's own children, e.g. for "bash -c".
+void ReadIOCounts(const pid_t pid, PhaseStats * const phase_stats) {
+    std::string proc_io;
+    if (not FileUtil::ReadStringFromPseudoFile("/proc/" + std::to_string(pid) + "/io", &proc_io)) {
+        LOG_WARNING("can't read the I/O counts of process " + std::to_string(pid) + "!");
+        return;
+    }
+
+    std::vector<std::string> lines;
+    StringUtil::Split(proc_io, '\n', &lines, /* suppress_empty_components = */true);
+    for (const auto &line : lines) {
+        if (StringUtil::StartsWith(line, "read_bytes: "))
+            phase_stats->read_bytes_ = line.substr(__builtin_strlen("read_bytes: "));
+        else if (StringUtil::StartsWith(line, "write_bytes: "))
+            phase_stats->write_bytes_ = line.substr(__builtin_strlen("write_bytes: "));
+    }
+}
+
+
+void RunCommand(char **command_and_args, PhaseStats * const phase_stats) {
+    const auto start(std::chrono::steady_clock::now());
+    const pid_t pid(::fork());
+    if (unlikely(pid == -1))
+        LOG_ERROR("fork(2) failed!");
+    if (pid == 0) {
+        ::execvp(command_and_args[0], command_and_args);
+        std::cerr << ::progname << ": failed to execute \"" << command_and_args[0] << "\": " << std::strerror(errno) << '\n';
+        ::_exit(127);
+    }
+
+    // Wait w/o reaping the child so that its /proc entry still exists:
+    siginfo_t siginfo;
+    while (::waitid(P_PID, pid, &siginfo, WEXITED | WNOWAIT) == -1) {
+        if (unlikely(errno != EINTR))
+            LOG_ERROR("waitid(2) failed!");
+    }
+    ReadIOCounts(pid, phase_stats);
+
+    int status;
+    struct rusage rusage;
+    while (::wait4(pid, &status, 0, &rusage) == -1) {
+        if (unlikely(errno != EINTR))
+            LOG_ERROR("wait4(2) failed!");
+    }
+    const std::chrono::duration<double> wall_time(std::chrono::steady_clock::now() - start);
+
+    phase_stats->wall_time_       = SecondsToString(wall_time.count());
+    phase_stats->user_cpu_time_   = SecondsToString(TimevalToSeconds(rusage.ru_utime));
+    phase_stats->system_cpu_time_ = SecondsToString(TimevalToSeconds(rusage.ru_stime));
+    phase_stats->max_rss_kb_      = std::to_string(rusage.ru_maxrss);
+    phase_stats->exit_code_       = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+
+// History columns: timestamp, phase name, wall time, user CPU time, system CPU time, max. RSS in KiB, bytes read,
+// bytes written and exit code.
+enum HistoryColumn { TIMESTAMP, PHASE_NAME, WALL_TIME, USER_CPU_TIME, SYSTEM_CPU_TIME, MAX_RSS_KB, READ_BYTES, WRITE_BYTES,
+                     EXIT_CODE, COLUMN_COUNT };
+
+
+// \return The wall-clock times of the most recent, at most "window", successful runs of "phase_name".
+std::vector<double> GetRecentWallTimes(const std::string &history_path, const std::string &phase_name, const unsigned window) {
+    std::vector<double> wall_times;
+    if (not FileUtil::Exists(history_path))
+        return wall_times;
+
+    for (const auto &line : FileUtil::ReadLines(history_path, FileUtil::ReadLines::DO_NOT_TRIM)) {
+        if (line.empty() or line[0] == '#')
+            continue;
+
+        std::vector<std::string> columns;
+        StringUtil::Split(line, '\t', &columns, /* suppress_empty_components = */false);
+        double wall_time;
+        if (columns.size() == COLUMN_COUNT and columns[PHASE_NAME] == phase_name and columns[EXIT_CODE] == "0"
+            and StringUtil::ToDouble(columns[WALL_TIME], &wall_time))
+            wall_times.emplace_back(wall_time);
+    }
+
+    if (wall_times.size() > window)
+        wall_times.erase(wall_times.begin(), wall_times.end() - window);
+    return wall_times;
+}
+
+
+// Several phases may finish at the same time, so we append each line w/ a single write(2) to a file opened w/ O_APPEND.
+void AppendToHistory(const std::string &history_path, const std::string &phase_name, const PhaseStats &phase_stats) {
+    const bool new_history(not FileUtil::Exists(history_path));
+    const int fd(::open(history_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644));
+    if (unlikely(fd == -1))
+        LOG_ERROR("can't open \"" + history_path + "\" for appending!");
+
+    std::string lines;
+    if (new_history)
+        lines += "# timestamp\tphase\twall_time\tuser_cpu_time\tsystem_cpu_time\tmax_rss_kb\tread_bytes\twrite_bytes\texit_code\n";
+    lines += TimeUtil::GetCurrentDateAndTime() + '\t' + phase_name + '\t' + phase_stats.wall_time_ + '\t'
+             + phase_stats.user_cpu_time_ + '\t' + phase_stats.system_cpu_time_ + '\t' + phase_stats.max_rss_kb_ + '\t'
+             + phase_stats.read_bytes_ + '\t' + phase_stats.write_bytes_ + '\t' + std::to_string(phase_stats.exit_code_)
+             + '\n';
+    if (unlikely(::write(fd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size())))
+        LOG_ERROR("failed to append to \"" + history_path + "\"!");
+    ::close(fd);
+}
+
+
+void CheckForRegression(const std::string &phase_name, const double wall_time, const std::vector<double> &recent_wall_times,
+                        const unsigned threshold)
+{
+    if (recent_wall_times.size() < MIN_HISTORY_SIZE)
+        return;
+
+    const double average(std::accumulate(recent_wall_times.cbegin(), recent_wall_times.cend(), 0.0) / recent_wall_times.size());
+    if (wall_time > average * (1.0 + threshold / 100.0))
+        LOG_WARNING("phase \"" + phase_name + "\" took " + SecondsToString(wall_time) + "s which is "
+                    + std::to_string(static_cast<int>((wall_time / average - 1.0) * 100.0 + 0.5))
+                    + "% more than the average of " + SecondsToString(average) + "s of its last "
+                    + std::to_string(recent_wall_times.size()) + " runs!");
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    // The environment variable lets benchmark runs of entire pipelines keep their phases out of the production history.
+    const char * const history_file_env(std::getenv("PHASE_HISTORY_FILE"));
+    std::string history_path((history_file_env != nullptr and *history_file_env != '\0') ? history_file_env
+                                                                                          : UBTools::GetTuelibPath() + "phase_history.tsv");
+    unsigned threshold(DEFAULT_THRESHOLD), window(DEFAULT_WINDOW);
+    for (;;) {
+        if (argc > 1 and StringUtil::StartsWith(argv[1], "--history-file="))
+            history_path = argv[1] + __builtin_strlen("--history-file=");
+        else if (argc > 1 and StringUtil::StartsWith(argv[1], "--threshold=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--threshold="), &threshold))
+                LOG_ERROR("bad threshold!");
+        } else if (argc > 1 and StringUtil::StartsWith(argv[1], "--window=")) {
+            if (not StringUtil::ToNumber(argv[1] + __builtin_strlen("--window="), &window) or window == 0)
+                LOG_ERROR("bad window!");
+        } else
+            break;
+        --argc, ++argv;
+    }
+
+    if (argc < 3)
+        Usage();
+
+    std::string phase_name(argv[1]);
+    StringUtil::Map(&phase_name, "\t\n", "  ");
+
+    PhaseStats phase_stats;
+    if (argc == 3 and StringUtil::StartsWith(argv[2], "--wall-time=")) {
+        double wall_time;
+        if (not StringUtil::ToDouble(argv[2] + __builtin_strlen("--wall-time="), &wall_time) or wall_time < 0.0)
+            LOG_ERROR("bad wall time!");
+        phase_stats.wall_time_ = SecondsToString(wall_time);
+    } else if (std::strcmp(argv[2], "--") == 0 and argc > 3)
+        RunCommand(argv + 3, &phase_stats);
+    else
+        Usage();
+
+    const std::vector<double> recent_wall_times(GetRecentWallTimes(history_path, phase_name, window));
+    AppendToHistory(history_path, phase_name, phase_stats);
+    if (phase_stats.exit_code_ == 0)
+        CheckForRegression(phase_name, StringUtil::ToDouble(phase_stats.wall_time_), recent_wall_times, threshold);
+
+    return phase_stats.exit_code_;
+}
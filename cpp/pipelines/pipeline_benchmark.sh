@@ -0,0 +1,99 @@
+#!/bin/bash
+# Runs one of the MARC pipelines on a fixed sample of scrambled data and compares the resource usage of each of its
+# phases to that of a baseline run.
+set -o errexit -o nounset
+
+
+function Usage {
+    echo "usage: $0 [--update-baseline] [compare_phase_stats_options] (ixtheo|krimdok) sample_directory"
+    echo "       \"sample_directory\" has to contain all input files of the pipeline, e.g. GesamtTiteldaten-YYMMDD.mrc and"
+    echo "       Normdaten-YYMMDD.mrc, ideally a subset of real data that has been scrambled w/ marc21_scramble."
+    echo "       The baseline is kept in the sample directory as baseline-<pipeline>.tsv.  If it doesn't exist yet or if"
+    echo "       --update-baseline has been specified, the results of this run become the new baseline."
+    echo "       Any other options are passed on to compare_phase_stats, e.g. --wall-time-tolerance=10."
+    echo "       The pipeline runs in a scratch copy of the sample directory but still needs the usual databases and"
+    echo "       configuration files, so this should only be run on a development machine."
+    exit 1
+}
+
+
+update_baseline=false
+compare_options=()
+while [[ $# -gt 0 && "$1" == --* ]]; do
+    if [[ "$1" == "--update-baseline" ]]; then
+        update_baseline=true
+    else
+        compare_options+=("$1")
+    fi
+    shift
+done
+if [ $# != 2 ]; then
+    Usage
+fi
+
+case "$1" in
+    ixtheo)
+        pipeline_script=ixtheo_marc_pipeline_fifo.sh;;
+    krimdok)
+        pipeline_script=krimdok_marc_pipeline.sh;;
+    *)
+        Usage;;
+esac
+pipeline_path=$(command -v "${pipeline_script}")
+sample_directory=$(readlink --canonicalize "$2")
+baseline="${sample_directory}/baseline-$1.tsv"
+
+title_data=""
+for candidate in "${sample_directory}"/GesamtTiteldaten-[0-9][0-9][0-9][0-9][0-9][0-9].mrc; do
+    if [ -e "${candidate}" ]; then
+        title_data=$(basename "${candidate}")
+    fi
+done
+if [ -z "${title_data}" ]; then
+    echo "no GesamtTiteldaten-YYMMDD.mrc in \"${sample_directory}\"!"
+    exit 1
+fi
+
+
+working_directory=$(mktemp --directory /tmp/pipeline_benchmark.XXXXXX)
+echo "Working directory: ${working_directory}"
+cp --recursive "${sample_directory}"/. "${working_directory}"
+rm -f "${working_directory}"/baseline-*.tsv
+
+
+# The pipeline records the wall-clock time of each phase w/ phase_monitor anyway.  In addition, we run every tool that
+# starts a phase under phase_monitor so that we also get its CPU time, maximum RSS and I/O.
+shim_directory="${working_directory}/.shims"
+mkdir "${shim_directory}"
+# The tool is the first command after StartPhase, possibly preceded by the opening parenthesis of a subshell.
+for tool in $(awk '/^StartPhase/ { in_phase = 1; next } in_phase && !/^(mkfifo|#|[[:space:]])/ { sub(/^\(/, ""); print $1; in_phase = 0 }' \
+                  "${pipeline_path}" | sort --unique); do
+    tool_path=$(type -P "${tool}" || true) # Empty for shell keywords like "for".
+    if [ -z "${tool_path}" ]; then
+        continue
+    fi
+    printf '#!/bin/bash\nexec phase_monitor "%s tool: %s" -- "%s" "$@"\n' "$1" "${tool}" "${tool_path}" > "${shim_directory}/${tool}"
+    chmod +x "${shim_directory}/${tool}"
+done
+
+
+export PHASE_HISTORY_FILE="${working_directory}/phase_history.tsv"
+export PIPELINE_LOG_DIR="${working_directory}"
+record_count=$(marc_size "${working_directory}/${title_data}")
+start=$(date +%s.%N)
+(cd "${working_directory}" && PATH="${shim_directory}:${PATH}" "${pipeline_path}" "${title_data}")
+phase_monitor "$1: Entire Pipeline" --wall-time=$(echo "$(date +%s.%N) - ${start}" | bc --mathlib)
+
+
+if [[ ${update_baseline} == true || ! -e "${baseline}" ]]; then
+    cp "${PHASE_HISTORY_FILE}" "${baseline}"
+    echo "Stored the results as the new baseline in \"${baseline}\"."
+    status=0
+else
+    status=0
+    compare_phase_stats ${compare_options[@]+"${compare_options[@]}"} --record-count="${record_count}" \
+                        "${PHASE_HISTORY_FILE}" "${baseline}" || status=$?
+fi
+
+rm -rf "${working_directory}"
+exit ${status}
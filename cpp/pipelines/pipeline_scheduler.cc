@@ -0,0 +1,723 @@
+/** \brief Runs the phases of a processing pipeline in parallel, honouring the dependencies between them.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "FileUtil.h"
+#include "IniFile.h"
+#include "JSON.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--cores=N] [--max-retries=N] [--log-directory=path] [--timing-report=path]\n"
+              << "       [--previous-report=path] [--dry-run] phase_graph\n"
+              << "       Each section of the INI file \"phase_graph\" describes a phase.  The section name is the name of the\n"
+              << "       phase and the following entries are recognised:\n"
+              << "           command            A shell command.  Mandatory.\n"
+              << "           description        Used for logging instead of the phase name.\n"
+              << "           inputs, outputs    Whitespace-separated lists of files.  A phase that reads the output of\n"
+              << "                              another phase runs after it.\n"
+              << "           depends_on         A whitespace-separated list of phases that have to finish first even\n"
+              << "                              though we don't read any of their outputs.\n"
+              << "           type               \"barrier\" (the default) or \"streaming\".  The outputs of streaming phases\n"
+              << "                              are named pipes that will be created by us and their consumers will be\n"
+              << "                              started at the same time.\n"
+              << "           cores              How many of our cores the phase occupies.  The default is 1.\n"
+              << "           max_retries        How often a failed phase will be restarted.  The default is the value of\n"
+              << "                              --max-retries, which defaults to 1.\n"
+              << "           expected_duration  In seconds.  Used to prioritise the phases on the critical path.\n"
+              << "       --cores defaults to the number of available cores.  The output of each phase goes to a file named\n"
+              << "       after the phase in the log directory, which defaults to the current working directory.\n"
+              << "       --timing-report writes a JSON report of the start times, durations and exit codes of all phases.\n"
+              << "       Durations from such a report can be fed back via --previous-report and override the\n"
+              << "       expected_duration entries.  --dry-run only shows the order in which the phases would be started.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+const double DEFAULT_EXPECTED_DURATION(60.0); // in seconds
+
+
+enum class PhaseType { BARRIER, STREAMING };
+
+
+enum class PhaseStatus { NOT_RUN, SUCCEEDED, FAILED };
+
+
+struct Phase {
+    std::string name_, description_, command_, log_path_;
+    std::vector<std::string> inputs_, outputs_, depends_on_;
+    PhaseType type_;
+    unsigned cores_, max_retries_;
+    double expected_duration_; // in seconds
+    unsigned group_; // Index of our StreamingGroup.
+    pid_t pid_; // -1 if we're not running.
+    unsigned attempts_;
+    int exit_code_;
+    PhaseStatus status_;
+    Clock::time_point start_time_, end_time_; // Of the last attempt.
+    double total_runtime_; // Summed over all attempts, in seconds.
+public:
+    Phase(): type_(PhaseType::BARRIER), cores_(1), max_retries_(0), expected_duration_(DEFAULT_EXPECTED_DURATION),
+             group_(0), pid_(-1), attempts_(0), exit_code_(-1), status_(PhaseStatus::NOT_RUN), total_runtime_(0.0) { }
+};
+
+
+// A streaming phase and the phases that read its named pipes have to run at the same time.  We therefore schedule and,
+// if necessary, restart such groups as a whole.  Barrier phases that don't participate in any streaming get a group of
+// their own.
+struct StreamingGroup {
+    enum State { WAITING, READY, RUNNING, DONE, FAILED };
+    std::vector<unsigned> members_;
+    std::set<unsigned> successors_;
+    unsigned unfinished_predecessor_count_;
+    unsigned cores_, max_retries_, attempts_, running_member_count_;
+    double expected_duration_; // The maximum of the expected durations of our members.
+    double priority_; // The expected duration of the longest path from the start of this group to the end of the graph.
+    bool attempt_failed_;
+    State state_;
+public:
+    StreamingGroup(): unfinished_predecessor_count_(0), cores_(0), max_retries_(0), attempts_(0), running_member_count_(0),
+                      expected_duration_(0.0), priority_(0.0), attempt_failed_(false), state_(WAITING) { }
+};
+
+
+// Unlike StringUtil::ToString(), never uses exponential notation.
+std::string FormatFixed(const double n, const int decimals) {
+    char buf[64];
+    std::snprintf(buf, sizeof buf, "%.*f", decimals, n);
+    return buf;
+}
+
+
+std::vector<std::string> SplitList(const std::string &list) {
+    std::vector<std::string> items;
+    StringUtil::WhiteSpaceSplit(list, &items, /* suppress_empty_components = */true);
+    return items;
+}
+
+
+std::string MakeLogPath(const std::string &log_directory, const std::string &phase_name) {
+    std::string log_filename;
+    for (const char ch : phase_name)
+        log_filename += StringUtil::IsAlphanumeric(ch) ? ch : '_';
+    return log_directory + "/" + log_filename + ".log";
+}
+
+
+// \return A map from phase names to the durations of their successful runs.
+std::unordered_map<std::string, double> LoadPreviousDurations(const std::string &report_path) {
+    std::string json_document;
+    FileUtil::ReadStringOrDie(report_path, &json_document);
+    JSON::Parser parser(json_document);
+    std::shared_ptr<JSON::JSONNode> tree_root;
+    if (not parser.parse(&tree_root))
+        LOG_ERROR("failed to parse \"" + report_path + "\": " + parser.getErrorMessage());
+
+    std::unordered_map<std::string, double> phase_names_to_durations_map;
+    const auto root_node(JSON::JSONNode::CastToObjectNodeOrDie("tree_root", tree_root));
+    for (const auto &phase_node : *root_node->getArrayNode("phases")) {
+        const auto phase_object(JSON::JSONNode::CastToObjectNodeOrDie("phase", phase_node));
+        if (phase_object->getStringValue("status") == "succeeded")
+            phase_names_to_durations_map[phase_object->getStringValue("name")] = phase_object->getDoubleValue("duration");
+    }
+
+    return phase_names_to_durations_map;
+}
+
+
+void LoadPhases(const std::string &phase_graph_filename, const unsigned default_max_retries,
+                const std::string &log_directory,
+                const std::unordered_map<std::string, double> &phase_names_to_previous_durations_map,
+                std::vector<Phase> * const phases)
+{
+    const IniFile ini_file(phase_graph_filename);
+    for (const auto &section : ini_file) {
+        if (section.getSectionName().empty()) // Entries before the first section.
+            continue;
+
+        Phase phase;
+        phase.name_        = section.getSectionName();
+        phase.description_ = section.getString("description", phase.name_);
+        phase.command_     = section.getString("command");
+        phase.log_path_    = MakeLogPath(log_directory, phase.name_);
+        phase.inputs_      = SplitList(section.getString("inputs", ""));
+        phase.outputs_     = SplitList(section.getString("outputs", ""));
+        phase.depends_on_  = SplitList(section.getString("depends_on", ""));
+        phase.cores_       = section.getUnsigned("cores", 1);
+        phase.max_retries_ = section.getUnsigned("max_retries", default_max_retries);
+
+        const std::string type(section.getString("type", "barrier"));
+        if (type == "streaming")
+            phase.type_ = PhaseType::STREAMING;
+        else if (unlikely(type != "barrier"))
+            LOG_ERROR("unknown type \"" + type + "\" for phase \"" + phase.name_ + "\"!");
+
+        const auto name_and_previous_duration(phase_names_to_previous_durations_map.find(phase.name_));
+        if (name_and_previous_duration != phase_names_to_previous_durations_map.cend())
+            phase.expected_duration_ = name_and_previous_duration->second;
+        else
+            phase.expected_duration_ = section.getDouble("expected_duration", DEFAULT_EXPECTED_DURATION);
+
+        if (unlikely(phase.cores_ == 0))
+            LOG_ERROR("phase \"" + phase.name_ + "\" needs at least one core!");
+        if (unlikely(phase.type_ == PhaseType::STREAMING and phase.outputs_.empty()))
+            LOG_ERROR("streaming phase \"" + phase.name_ + "\" has no outputs!");
+
+        phases->emplace_back(phase);
+    }
+
+    if (phases->empty())
+        LOG_ERROR("no phases found in \"" + phase_graph_filename + "\"!");
+}
+
+
+// Simple union-find w/ path halving.
+unsigned FindRoot(std::vector<unsigned> * const parents, unsigned phase_index) {
+    while ((*parents)[phase_index] != phase_index) {
+        (*parents)[phase_index] = (*parents)[(*parents)[phase_index]];
+        phase_index = (*parents)[phase_index];
+    }
+    return phase_index;
+}
+
+
+void BuildStreamingGroups(const unsigned core_budget, std::vector<Phase> * const phases,
+                          std::vector<StreamingGroup> * const groups)
+{
+    std::unordered_map<std::string, unsigned> phase_names_to_indices_map, outputs_to_producers_map;
+    for (unsigned phase_index(0); phase_index < phases->size(); ++phase_index) {
+        const Phase &phase((*phases)[phase_index]);
+        if (unlikely(not phase_names_to_indices_map.emplace(phase.name_, phase_index).second))
+            LOG_ERROR("duplicate phase \"" + phase.name_ + "\"!");
+        for (const auto &output : phase.outputs_) {
+            if (unlikely(not outputs_to_producers_map.emplace(output, phase_index).second))
+                LOG_ERROR("\"" + output + "\" is an output of more than one phase!");
+        }
+    }
+
+    // Collect the edges and merge phases that are connected by named pipes:
+    std::vector<std::pair<unsigned, unsigned>> barrier_edges; // (predecessor, successor)
+    std::vector<unsigned> parents(phases->size());
+    std::iota(parents.begin(), parents.end(), 0);
+    std::set<std::string> consumed_streams;
+    for (unsigned phase_index(0); phase_index < phases->size(); ++phase_index) {
+        const Phase &phase((*phases)[phase_index]);
+        for (const auto &input : phase.inputs_) {
+            const auto input_and_producer(outputs_to_producers_map.find(input));
+            if (input_and_producer == outputs_to_producers_map.cend())
+                continue; // Must have been there before we started.
+            const unsigned producer_index(input_and_producer->second);
+            if (unlikely(producer_index == phase_index))
+                LOG_ERROR("phase \"" + phase.name_ + "\" reads its own output \"" + input + "\"!");
+            if ((*phases)[producer_index].type_ == PhaseType::STREAMING) {
+                parents[FindRoot(&parents, producer_index)] = FindRoot(&parents, phase_index);
+                consumed_streams.emplace(input);
+            } else
+                barrier_edges.emplace_back(producer_index, phase_index);
+        }
+
+        for (const auto &predecessor_name : phase.depends_on_) {
+            const auto name_and_index(phase_names_to_indices_map.find(predecessor_name));
+            if (unlikely(name_and_index == phase_names_to_indices_map.cend()))
+                LOG_ERROR("phase \"" + phase.name_ + "\" depends on an unknown phase \"" + predecessor_name + "\"!");
+            barrier_edges.emplace_back(name_and_index->second, phase_index);
+        }
+    }
+
+    // A named pipe w/o a reader would block its writer forever:
+    for (const auto &phase : *phases) {
+        if (phase.type_ != PhaseType::STREAMING)
+            continue;
+        for (const auto &output : phase.outputs_) {
+            if (unlikely(consumed_streams.find(output) == consumed_streams.cend()))
+                LOG_ERROR("the named pipe \"" + output + "\" of streaming phase \"" + phase.name_ + "\" has no reader!");
+        }
+    }
+
+    std::unordered_map<unsigned, unsigned> roots_to_groups_map;
+    for (unsigned phase_index(0); phase_index < phases->size(); ++phase_index) {
+        const unsigned root(FindRoot(&parents, phase_index));
+        auto root_and_group(roots_to_groups_map.find(root));
+        if (root_and_group == roots_to_groups_map.end()) {
+            root_and_group = roots_to_groups_map.emplace(root, groups->size()).first;
+            groups->emplace_back();
+            groups->back().max_retries_ = (*phases)[phase_index].max_retries_;
+        }
+
+        Phase &phase((*phases)[phase_index]);
+        StreamingGroup &group((*groups)[root_and_group->second]);
+        phase.group_ = root_and_group->second;
+        group.members_.emplace_back(phase_index);
+        group.cores_ += phase.cores_;
+        group.max_retries_ = std::min(group.max_retries_, phase.max_retries_);
+        group.expected_duration_ = std::max(group.expected_duration_, phase.expected_duration_);
+    }
+
+    for (const auto &group : *groups) {
+        if (unlikely(group.cores_ > core_budget))
+            LOG_ERROR("phase \"" + (*phases)[group.members_.front()].name_ + "\" and the phases it streams to or from "
+                      "need " + std::to_string(group.cores_) + " cores but we only have " + std::to_string(core_budget)
+                      + "!");
+    }
+
+    for (const auto &edge : barrier_edges) {
+        const unsigned predecessor_group((*phases)[edge.first].group_), successor_group((*phases)[edge.second].group_);
+        if (unlikely(predecessor_group == successor_group))
+            LOG_ERROR("phase \"" + (*phases)[edge.second].name_ + "\" has to wait for phase \""
+                      + (*phases)[edge.first].name_ + "\" which it streams to or from!");
+        if ((*groups)[predecessor_group].successors_.emplace(successor_group).second)
+            ++(*groups)[successor_group].unfinished_predecessor_count_;
+    }
+}
+
+
+// Calculates the length of the critical path starting at each group.  This also detects cycles.
+void ComputePriorities(const std::vector<Phase> &phases, std::vector<StreamingGroup> * const groups) {
+    std::vector<unsigned> predecessor_counts(groups->size()), topological_order;
+    for (unsigned group_index(0); group_index < groups->size(); ++group_index) {
+        predecessor_counts[group_index] = (*groups)[group_index].unfinished_predecessor_count_;
+        if (predecessor_counts[group_index] == 0)
+            topological_order.emplace_back(group_index);
+    }
+    for (unsigned i(0); i < topological_order.size(); ++i) {
+        for (const unsigned successor : (*groups)[topological_order[i]].successors_) {
+            if (--predecessor_counts[successor] == 0)
+                topological_order.emplace_back(successor);
+        }
+    }
+
+    if (unlikely(topological_order.size() != groups->size())) {
+        std::string phases_on_cycles;
+        for (unsigned group_index(0); group_index < groups->size(); ++group_index) {
+            if (predecessor_counts[group_index] > 0) {
+                for (const unsigned member : (*groups)[group_index].members_)
+                    phases_on_cycles += " \"" + phases[member].name_ + "\"";
+            }
+        }
+        LOG_ERROR("the phase graph contains cycles involving" + phases_on_cycles + "!");
+    }
+
+    for (auto group_index(topological_order.rbegin()); group_index != topological_order.rend(); ++group_index) {
+        StreamingGroup &group((*groups)[*group_index]);
+        double longest_successor_path(0.0);
+        for (const unsigned successor : group.successors_)
+            longest_successor_path = std::max(longest_successor_path, (*groups)[successor].priority_);
+        group.priority_ = group.expected_duration_ + longest_successor_path;
+    }
+}
+
+
+std::string GetGroupDescription(const std::vector<Phase> &phases, const StreamingGroup &group) {
+    std::string description;
+    for (const unsigned member : group.members_) {
+        if (not description.empty())
+            description += " | ";
+        description += "\"" + phases[member].description_ + "\"";
+    }
+    return description;
+}
+
+
+void ShowSchedule(const std::vector<Phase> &phases, std::vector<StreamingGroup> groups, const unsigned core_budget) {
+    // Simulates the scheduler w/ the expected durations:
+    std::multimap<double, unsigned> end_times_to_running_groups_map;
+    double now(0.0);
+    unsigned free_cores(core_budget);
+    std::vector<unsigned> ready_groups;
+    for (unsigned group_index(0); group_index < groups.size(); ++group_index) {
+        if (groups[group_index].unfinished_predecessor_count_ == 0)
+            ready_groups.emplace_back(group_index);
+    }
+
+    for (;;) {
+        std::sort(ready_groups.begin(), ready_groups.end(),
+                  [&groups](const unsigned lhs, const unsigned rhs) { return groups[lhs].priority_ > groups[rhs].priority_; });
+        for (auto ready_group(ready_groups.begin()); ready_group != ready_groups.end(); /* Intentionally empty! */) {
+            StreamingGroup &group(groups[*ready_group]);
+            if (group.cores_ > free_cores) {
+                ++ready_group;
+                continue;
+            }
+            std::cout << FormatFixed(now, 1) << "s: " << GetGroupDescription(phases, group) << " (cores: "
+                      << group.cores_ << ", critical path: " << FormatFixed(group.priority_, 1) << "s)\n";
+            free_cores -= group.cores_;
+            end_times_to_running_groups_map.emplace(now + group.expected_duration_, *ready_group);
+            ready_group = ready_groups.erase(ready_group);
+        }
+
+        if (end_times_to_running_groups_map.empty())
+            break;
+        const auto end_time_and_group(end_times_to_running_groups_map.begin());
+        now = end_time_and_group->first;
+        free_cores += groups[end_time_and_group->second].cores_;
+        for (const unsigned successor : groups[end_time_and_group->second].successors_) {
+            if (--groups[successor].unfinished_predecessor_count_ == 0)
+                ready_groups.emplace_back(successor);
+        }
+        end_times_to_running_groups_map.erase(end_time_and_group);
+    }
+
+    std::cout << "Expected total duration: " << FormatFixed(now, 1) << "s\n";
+}
+
+
+// The child gets its own process group so that we can kill the whole shell pipeline that implements a phase.
+pid_t StartProcess(const std::string &command, const std::string &log_path, const bool truncate_log) {
+    const pid_t pid(::fork());
+    if (unlikely(pid == -1))
+        LOG_ERROR("fork(2) failed!");
+
+    if (pid == 0) {
+        ::setpgid(0, 0);
+        const int log_fd(::open(log_path.c_str(), O_WRONLY | O_CREAT | (truncate_log ? O_TRUNC : O_APPEND), 0644));
+        if (log_fd == -1 or ::dup2(log_fd, STDOUT_FILENO) == -1 or ::dup2(log_fd, STDERR_FILENO) == -1)
+            ::_exit(EXIT_FAILURE);
+        ::close(log_fd);
+        ::execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+        ::_exit(127); // Like the shell, if the command could not be executed.
+    }
+
+    ::setpgid(pid, pid); // Also done in the child, whichever comes first.
+    return pid;
+}
+
+
+inline double SecondsBetween(const Clock::time_point &start, const Clock::time_point &end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+
+class Scheduler {
+    std::vector<Phase> &phases_;
+    std::vector<StreamingGroup> &groups_;
+    unsigned free_cores_;
+    std::vector<unsigned> ready_groups_;
+    std::unordered_map<pid_t, unsigned> pids_to_phases_map_;
+    bool aborting_;
+public:
+    Scheduler(std::vector<Phase> * const phases, std::vector<StreamingGroup> * const groups, const unsigned core_budget);
+
+    /** \return True if all phases succeeded, o/w false. */
+    bool run();
+private:
+    void startReadyGroups();
+    void startGroup(const unsigned group_index);
+    void waitForPhase();
+    void finishGroup(const unsigned group_index);
+    void killGroup(const StreamingGroup &group);
+    void removeNamedPipes(const StreamingGroup &group);
+};
+
+
+Scheduler::Scheduler(std::vector<Phase> * const phases, std::vector<StreamingGroup> * const groups,
+                     const unsigned core_budget)
+    : phases_(*phases), groups_(*groups), free_cores_(core_budget), aborting_(false)
+{
+    for (unsigned group_index(0); group_index < groups_.size(); ++group_index) {
+        if (groups_[group_index].unfinished_predecessor_count_ == 0) {
+            groups_[group_index].state_ = StreamingGroup::READY;
+            ready_groups_.emplace_back(group_index);
+        }
+    }
+}
+
+
+bool Scheduler::run() {
+    for (;;) {
+        if (not aborting_)
+            startReadyGroups();
+        if (pids_to_phases_map_.empty())
+            break;
+        waitForPhase();
+    }
+
+    return std::all_of(groups_.cbegin(), groups_.cend(),
+                       [](const StreamingGroup &group) { return group.state_ == StreamingGroup::DONE; });
+}
+
+
+// Greedy list scheduling: we start the ready groups w/ the longest critical paths first.  Groups that need more cores
+// than are currently available don't block groups behind them that fit.
+void Scheduler::startReadyGroups() {
+    std::sort(ready_groups_.begin(), ready_groups_.end(),
+              [this](const unsigned lhs, const unsigned rhs) { return groups_[lhs].priority_ > groups_[rhs].priority_; });
+    for (auto ready_group(ready_groups_.begin()); ready_group != ready_groups_.end(); /* Intentionally empty! */) {
+        if (groups_[*ready_group].cores_ > free_cores_)
+            ++ready_group;
+        else {
+            startGroup(*ready_group);
+            ready_group = ready_groups_.erase(ready_group);
+        }
+    }
+}
+
+
+void Scheduler::startGroup(const unsigned group_index) {
+    StreamingGroup &group(groups_[group_index]);
+    for (const unsigned member : group.members_) {
+        const Phase &phase(phases_[member]);
+        if (phase.type_ != PhaseType::STREAMING)
+            continue;
+        for (const auto &output : phase.outputs_) {
+            ::unlink(output.c_str());
+            if (unlikely(::mkfifo(output.c_str(), 0600) != 0))
+                LOG_ERROR("failed to create the named pipe \"" + output + "\" for phase \"" + phase.name_ + "\"!");
+        }
+    }
+
+    free_cores_ -= group.cores_;
+    ++group.attempts_;
+    group.attempt_failed_ = false;
+    group.state_ = StreamingGroup::RUNNING;
+    for (const unsigned member : group.members_) {
+        Phase &phase(phases_[member]);
+        LOG_INFO("Starting phase \"" + phase.description_ + "\""
+                 + (group.attempts_ > 1 ? " (attempt #" + std::to_string(group.attempts_) + ")" : std::string()) + ".");
+        phase.start_time_ = Clock::now();
+        phase.pid_ = StartProcess(phase.command_, phase.log_path_, /* truncate_log = */phase.attempts_ == 0);
+        ++phase.attempts_;
+        pids_to_phases_map_[phase.pid_] = member;
+        ++group.running_member_count_;
+    }
+}
+
+
+void Scheduler::waitForPhase() {
+    int wait_status;
+    pid_t pid;
+    while ((pid = ::wait(&wait_status)) == -1) {
+        if (unlikely(errno != EINTR))
+            LOG_ERROR("wait(2) failed!");
+    }
+
+    const auto pid_and_phase(pids_to_phases_map_.find(pid));
+    if (unlikely(pid_and_phase == pids_to_phases_map_.end()))
+        return; // Not one of ours.
+    Phase &phase(phases_[pid_and_phase->second]);
+    pids_to_phases_map_.erase(pid_and_phase);
+
+    phase.pid_ = -1;
+    phase.end_time_ = Clock::now();
+    phase.total_runtime_ += SecondsBetween(phase.start_time_, phase.end_time_);
+    if (WIFEXITED(wait_status))
+        phase.exit_code_ = WEXITSTATUS(wait_status);
+    else
+        phase.exit_code_ = 128 + WTERMSIG(wait_status); // Like the shell.
+
+    StreamingGroup &group(groups_[phase.group_]);
+    if (phase.exit_code_ == 0) {
+        phase.status_ = PhaseStatus::SUCCEEDED;
+        LOG_INFO("Phase \"" + phase.description_ + "\": Done after "
+                 + FormatFixed(SecondsBetween(phase.start_time_, phase.end_time_) / 60.0, 2) + " minutes.");
+    } else {
+        phase.status_ = PhaseStatus::FAILED;
+        LOG_WARNING("phase \"" + phase.description_ + "\" failed with exit code " + std::to_string(phase.exit_code_)
+                    + "! (See \"" + phase.log_path_ + "\".)");
+        if (not group.attempt_failed_) {
+            group.attempt_failed_ = true;
+            killGroup(group);
+        }
+    }
+
+    if (--group.running_member_count_ == 0)
+        finishGroup(phase.group_);
+}
+
+
+void Scheduler::finishGroup(const unsigned group_index) {
+    StreamingGroup &group(groups_[group_index]);
+    free_cores_ += group.cores_;
+    removeNamedPipes(group);
+
+    if (not group.attempt_failed_) {
+        group.state_ = StreamingGroup::DONE;
+        for (const unsigned successor : group.successors_) {
+            if (--groups_[successor].unfinished_predecessor_count_ == 0) {
+                groups_[successor].state_ = StreamingGroup::READY;
+                ready_groups_.emplace_back(successor);
+            }
+        }
+        return;
+    }
+
+    if (not aborting_ and group.attempts_ <= group.max_retries_) {
+        LOG_WARNING("restarting " + GetGroupDescription(phases_, group) + "!");
+        group.state_ = StreamingGroup::READY;
+        ready_groups_.emplace_back(group_index);
+        return;
+    }
+
+    group.state_ = StreamingGroup::FAILED;
+    if (not aborting_) {
+        LOG_WARNING("giving up on " + GetGroupDescription(phases_, group) + " and aborting the pipeline!");
+        aborting_ = true;
+        for (const auto &other_group : groups_) {
+            if (other_group.state_ == StreamingGroup::RUNNING)
+                killGroup(other_group);
+        }
+    }
+}
+
+
+void Scheduler::killGroup(const StreamingGroup &group) {
+    for (const unsigned member : group.members_) {
+        if (phases_[member].pid_ != -1)
+            ::kill(-phases_[member].pid_, SIGTERM);
+    }
+}
+
+
+void Scheduler::removeNamedPipes(const StreamingGroup &group) {
+    for (const unsigned member : group.members_) {
+        if (phases_[member].type_ == PhaseType::STREAMING) {
+            for (const auto &output : phases_[member].outputs_)
+                ::unlink(output.c_str());
+        }
+    }
+}
+
+
+std::string PhaseStatusToString(const PhaseStatus status) {
+    switch (status) {
+    case PhaseStatus::NOT_RUN:
+        return "not run";
+    case PhaseStatus::SUCCEEDED:
+        return "succeeded";
+    case PhaseStatus::FAILED:
+        return "failed";
+    }
+
+    __builtin_unreachable();
+}
+
+
+void WriteTimingReport(const std::string &report_path, const std::vector<Phase> &phases,
+                       const Clock::time_point &scheduler_start_time, const unsigned core_budget)
+{
+    std::string report("{\n");
+    report += "    \"cores\": " + std::to_string(core_budget) + ",\n";
+    report += "    \"wall_clock_seconds\": " + FormatFixed(SecondsBetween(scheduler_start_time, Clock::now()), 6)
+              + ",\n";
+    report += "    \"phases\": [\n";
+    for (auto phase(phases.cbegin()); phase != phases.cend(); ++phase) {
+        report += "        {\n";
+        report += "            \"name\": \"" + JSON::EscapeString(phase->name_) + "\",\n";
+        report += "            \"description\": \"" + JSON::EscapeString(phase->description_) + "\",\n";
+        report += std::string("            \"type\": \"") + (phase->type_ == PhaseType::STREAMING ? "streaming" : "barrier")
+                  + "\",\n";
+        report += "            \"cores\": " + std::to_string(phase->cores_) + ",\n";
+        report += "            \"status\": \"" + PhaseStatusToString(phase->status_) + "\",\n";
+        report += "            \"attempts\": " + std::to_string(phase->attempts_) + ",\n";
+        report += "            \"exit_code\": " + std::to_string(phase->exit_code_);
+        if (phase->attempts_ > 0) {
+            // Start and end are relative to our own start and refer to the last attempt:
+            report += ",\n            \"start\": " + FormatFixed(SecondsBetween(scheduler_start_time, phase->start_time_), 6)
+                      + ",\n            \"end\": " + FormatFixed(SecondsBetween(scheduler_start_time, phase->end_time_), 6)
+                      + ",\n            \"duration\": " + FormatFixed(SecondsBetween(phase->start_time_, phase->end_time_), 6)
+                      + ",\n            \"total_runtime\": " + FormatFixed(phase->total_runtime_, 6);
+        }
+        report += std::string("\n        }") + (phase + 1 == phases.cend() ? "" : ",") + "\n";
+    }
+    report += "    ]\n}\n";
+
+    FileUtil::WriteStringOrDie(report_path, report);
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    unsigned core_budget(std::max(std::thread::hardware_concurrency(), 1u)), default_max_retries(1);
+    std::string log_directory("."), timing_report_path, previous_report_path;
+    bool dry_run(false);
+    while (argc > 1 and StringUtil::StartsWith(argv[1], "--")) {
+        if (StringUtil::StartsWith(argv[1], "--cores=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + std::strlen("--cores="), &core_budget) or core_budget == 0)
+                LOG_ERROR("bad core count \"" + std::string(argv[1]) + "\"!");
+        } else if (StringUtil::StartsWith(argv[1], "--max-retries=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + std::strlen("--max-retries="), &default_max_retries))
+                LOG_ERROR("bad retry count \"" + std::string(argv[1]) + "\"!");
+        } else if (StringUtil::StartsWith(argv[1], "--log-directory="))
+            log_directory = argv[1] + std::strlen("--log-directory=");
+        else if (StringUtil::StartsWith(argv[1], "--timing-report="))
+            timing_report_path = argv[1] + std::strlen("--timing-report=");
+        else if (StringUtil::StartsWith(argv[1], "--previous-report="))
+            previous_report_path = argv[1] + std::strlen("--previous-report=");
+        else if (std::strcmp(argv[1], "--dry-run") == 0)
+            dry_run = true;
+        else
+            Usage();
+        --argc, ++argv;
+    }
+    if (argc != 2)
+        Usage();
+
+    std::unordered_map<std::string, double> phase_names_to_previous_durations_map;
+    if (not previous_report_path.empty())
+        phase_names_to_previous_durations_map = LoadPreviousDurations(previous_report_path);
+
+    std::vector<Phase> phases;
+    LoadPhases(argv[1], default_max_retries, log_directory, phase_names_to_previous_durations_map, &phases);
+    std::vector<StreamingGroup> groups;
+    BuildStreamingGroups(core_budget, &phases, &groups);
+    ComputePriorities(phases, &groups);
+
+    if (dry_run) {
+        ShowSchedule(phases, groups, core_budget);
+        return EXIT_SUCCESS;
+    }
+
+    const Clock::time_point scheduler_start_time(Clock::now());
+    Scheduler scheduler(&phases, &groups, core_budget);
+    const bool succeeded(scheduler.run());
+    LOG_INFO("Pipeline " + std::string(succeeded ? "done" : "aborted") + " after "
+             + FormatFixed(SecondsBetween(scheduler_start_time, Clock::now()) / 60.0, 2) + " minutes.");
+
+    if (not timing_report_path.empty())
+        WriteTimingReport(timing_report_path, phases, scheduler_start_time, core_budget);
+
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
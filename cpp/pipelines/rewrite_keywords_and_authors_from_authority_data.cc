@@ -23,11 +23,11 @@
 
 #include <fstream>
 #include <iostream>
-#include <unordered_map>
 #include <vector>
 #include <cstdlib>
 #include "Compiler.h"
 #include "MARC.h"
+#include "MarcAuthorityStore.h"
 #include "RegexMatcher.h"
 #include "util.h"
 
@@ -56,12 +56,11 @@ MARC::Record::const_iterator GetFirstPrimaryField(const MARC::Record &authority_
 
 
 bool GetAuthorityRecordFromPPN(const std::string &bsz_authority_ppn, MARC::Record * const authority_record,
-                               MARC::Reader * const authority_reader, const std::unordered_map<std::string, off_t> &authority_offsets,
+                               MARC::Reader * const authority_reader, const MARC::AuthorityStore &authority_store,
                                const MARC::Record &record)
 {
-    auto authority_offset(authority_offsets.find(bsz_authority_ppn));
-    if (authority_offset != authority_offsets.end()) {
-        off_t authority_record_offset(authority_offset->second);
+    off_t authority_record_offset;
+    if (authority_store.findRecordOffset(bsz_authority_ppn, &authority_record_offset)) {
         if (authority_reader->seek(authority_record_offset)) {
             *authority_record = authority_reader->read();
             if (authority_record->getControlNumber() != bsz_authority_ppn)
@@ -87,7 +86,7 @@ bool IsWorkTitleField(const MARC::Subfields &subfields) {
 }
 
 
-bool UpdateTitleDataField(MARC::Record::Field * const field, const MARC::Record authority_record) {
+bool UpdateTitleDataField(MARC::Record::Field * const field, const MARC::Record &authority_record) {
     auto authority_primary_field(GetFirstPrimaryField(authority_record));
     if (authority_primary_field == authority_record.end()) {
         LOG_WARNING("Could not find appropriate Tag for authority PPN " + authority_record.getControlNumber());
@@ -98,17 +97,18 @@ bool UpdateTitleDataField(MARC::Record::Field * const field, const MARC::Record
     // so delete the subfields to be replaced first
     // Moreover there is a special case with "Werktitel". These are in $a
     // in the authority data but must be mapped to $t in the title data
-    for (const auto &authority_subfield : authority_primary_field->getSubfields()) {
-        if (IsWorkTitleField(subfields) and authority_subfield.code_ == 'a')
+    const MARC::SubfieldRange authority_subfields(authority_primary_field->getSubfieldRange());
+    for (const auto &authority_subfield : authority_subfields) {
+        if (IsWorkTitleField(subfields) and authority_subfield.first == 'a')
             subfields.deleteAllSubfieldsWithCode('t');
         else
-            subfields.deleteAllSubfieldsWithCode(authority_subfield.code_);
+            subfields.deleteAllSubfieldsWithCode(authority_subfield.first);
     }
-    for (const auto &authority_subfield : authority_primary_field->getSubfields()) {
-        if (IsWorkTitleField(subfields) and authority_subfield.code_ == 'a')
-            subfields.appendSubfield('t', authority_subfield.value_);
+    for (const auto &authority_subfield : authority_subfields) {
+        if (IsWorkTitleField(subfields) and authority_subfield.first == 'a')
+            subfields.appendSubfield('t', authority_subfield.second.toString());
         else
-            subfields.appendSubfield(authority_subfield.code_, authority_subfield.value_);
+            subfields.appendSubfield(authority_subfield.first, authority_subfield.second.toString());
     }
     field->setSubfields(subfields);
     return true;
@@ -116,7 +116,7 @@ bool UpdateTitleDataField(MARC::Record::Field * const field, const MARC::Record
 
 
 void AugmentAuthors(MARC::Record * const record, MARC::Reader * const authority_reader,
-                    const std::unordered_map<std::string, off_t> &authority_offsets,
+                    const MARC::AuthorityStore &authority_store,
                     RegexMatcher * const matcher, bool * const modified_record)
 {
     static std::vector<std::string> tags_to_check{ "100", "110", "111", "700", "710", "711" };
@@ -125,7 +125,7 @@ void AugmentAuthors(MARC::Record * const record, MARC::Reader * const authority_
             std::string _author_content(field.getContents());
             if (matcher->matched(_author_content)) {
                 MARC::Record authority_record(std::string(MARC::Record::LEADER_LENGTH, ' '));
-                if (GetAuthorityRecordFromPPN((*matcher)[1], &authority_record, authority_reader, authority_offsets, *record)) {
+                if (GetAuthorityRecordFromPPN((*matcher)[1], &authority_record, authority_reader, authority_store, *record)) {
                     if (UpdateTitleDataField(&field, authority_record))
                         *modified_record = true;
                 }
@@ -136,14 +136,14 @@ void AugmentAuthors(MARC::Record * const record, MARC::Reader * const authority_
 
 
 void AugmentKeywords(MARC::Record * const record, MARC::Reader * const authority_reader,
-                     const std::unordered_map<std::string, off_t> &authority_offsets,
+                     const MARC::AuthorityStore &authority_store,
                      RegexMatcher * const matcher, bool * const modified_record)
 {
     for (auto &field : record->getTagRange("689")) {
         std::string _689_content(field.getContents());
         if (matcher->matched(_689_content)) {
              MARC::Record authority_record(std::string(MARC::Record::LEADER_LENGTH, ' '));
-             if (GetAuthorityRecordFromPPN((*matcher)[1], &authority_record, authority_reader, authority_offsets, *record)) {
+             if (GetAuthorityRecordFromPPN((*matcher)[1], &authority_record, authority_reader, authority_store, *record)) {
                  UpdateTitleDataField(&field, authority_record);
                  *modified_record = true;
              }
@@ -153,7 +153,7 @@ void AugmentKeywords(MARC::Record * const record, MARC::Reader * const authority
 
 
 void AugmentKeywordsAndAuthors(MARC::Reader * const marc_reader, MARC::Reader * const authority_reader, MARC::Writer * const marc_writer,
-                               const std::unordered_map<std::string, off_t>& authority_offsets)
+                               const MARC::AuthorityStore &authority_store)
 {
     std::string err_msg;
     RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("\x1F""0\\(DE-627\\)([^\x1F]+).*\x1F?", &err_msg));
@@ -166,8 +166,8 @@ void AugmentKeywordsAndAuthors(MARC::Reader * const marc_reader, MARC::Reader *
     while (MARC::Record record = marc_reader->read()) {
        ++record_count;
        bool modified_record(false);
-       AugmentAuthors(&record, authority_reader, authority_offsets, matcher, &modified_record);
-       AugmentKeywords(&record, authority_reader, authority_offsets, matcher, &modified_record);
+       AugmentAuthors(&record, authority_reader, authority_store, matcher, &modified_record);
+       AugmentKeywords(&record, authority_reader, authority_store, matcher, &modified_record);
        if (modified_record)
            ++modified_count;
        marc_writer->write(record);
@@ -196,10 +196,8 @@ int Main(int argc, char **argv) {
     std::unique_ptr<MARC::Reader> authority_reader(MARC::Reader::Factory(authority_data_marc_input_filename,
                                                                          MARC::FileType::BINARY));
     std::unique_ptr<MARC::Writer> marc_writer(MARC::Writer::Factory(marc_output_filename));
-    std::unordered_map<std::string, off_t> authority_offsets;
-
-    MARC::CollectRecordOffsets(authority_reader.get(), &authority_offsets);
-    AugmentKeywordsAndAuthors(marc_reader.get(), authority_reader.get(), marc_writer.get(), authority_offsets);
+    const MARC::AuthorityStore authority_store(authority_reader.get());
+    AugmentKeywordsAndAuthors(marc_reader.get(), authority_reader.get(), marc_writer.get(), authority_store);
 
     return EXIT_SUCCESS;
 }
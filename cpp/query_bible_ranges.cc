@@ -0,0 +1,73 @@
+/** \brief Lists the PPNs of all records w/ bible references that overlap the given ranges.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdlib>
+#include "BibleUtil.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    ::Usage("bible_ranges_index [range1 range2 ... rangeN]\n"
+            "Ranges look like \"start:end\" or \"start_end\", as generated by bib_ref_to_codes_tool.  If no ranges have been\n"
+            "specified on the command-line, they will be read from stdin, separated by whitespace.");
+}
+
+
+void AddRange(const std::string &range, std::vector<std::pair<uint32_t, uint32_t>> * const ranges) {
+    uint32_t start, end;
+    if (unlikely(not BibleUtil::RangeIndex::ParseRange(range, &start, &end)))
+        LOG_ERROR("bad range \"" + range + "\"!");
+    ranges->emplace_back(start, end);
+}
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    if (argc > 2) {
+        for (int arg_no(2); arg_no < argc; ++arg_no)
+            AddRange(argv[arg_no], &ranges);
+    } else {
+        std::string range;
+        while (std::cin >> range)
+            AddRange(range, &ranges);
+    }
+
+    const BibleUtil::RangeIndex range_index(argv[1]);
+    std::set<std::string> ppns;
+    for (const auto &range : ranges)
+        range_index.findOverlapping(range.first, range.second, &ppns);
+
+    for (const auto &ppn : ppns)
+        std::cout << ppn << '\n';
+
+    return EXIT_SUCCESS;
+}
@@ -18,15 +18,16 @@
 */
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
-#include <unordered_set>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include "FileUtil.h"
 #include "MARC.h"
-#include "RegexMatcher.h"
-#include "StringUtil.h"
+#include "MarcAuthorityIdTable.h"
+#include "MarcParallelProcessor.h"
 #include "util.h"
 
 
@@ -39,37 +40,71 @@ namespace {
 }
 
 
-void CollectGNDReferences(MARC::Reader * const marc_reader, std::unordered_set<std::string> * const gnd_numbers) {
-    std::string err_msg;
-    RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("\x1F""0\\(DE-588\\)([^\x1F]+).*\x1F""2gnd",
-                                                                   &err_msg));
-    if (matcher == nullptr)
-        logger->error("failed to compile a regex in CollectGNDReferences: " + err_msg);
+// One bit per authority id.
+typedef std::vector<uint64_t> Bitmap;
 
-    unsigned record_count(0);
-    while (const MARC::Record record = marc_reader->read()) {
-        ++record_count;
 
-        for (const auto &field : record) {
-            if (matcher->matched(field.getContents()))
-                gnd_numbers->emplace((*matcher)[1]);
-        }
+inline void SetBit(const uint32_t id, Bitmap * const bitmap) {
+    (*bitmap)[id / 64] |= UINT64_C(1) << (id % 64);
+}
+
+
+inline bool TestBit(const uint32_t id, const Bitmap &bitmap) {
+    return (bitmap[id / 64] & (UINT64_C(1) << (id % 64))) != 0;
+}
+
+
+// Ids are assigned in file order, so the n-th authority record gets id n-1.
+void LoadAuthorityIds(const std::string &authority_filename, MARC::AuthorityIdTable * const authority_id_table) {
+    const auto authority_reader(MARC::Reader::Factory(authority_filename, MARC::FileType::AUTO, { "035" }));
+    std::string gnd_number;
+    while (const MARC::Record record = authority_reader->read()) {
+        MARC::GetGNDCode(record, &gnd_number);
+        authority_id_table->add(record.getControlNumber(), gnd_number);
     }
 
-    std::cout << "Extracted " << gnd_numbers->size() << " GND number(s) from " <<  record_count
-              << " title record(s).\n";
+    std::cout << "Assigned ids to " << authority_id_table->size() << " authority record(s).\n";
 }
 
 
-std::string GetGNDNumber(const MARC::Record &record) {
-    for (const auto &_035_field : record.getTagRange("035")) {
-        const MARC::Subfields _035_subfields(_035_field.getSubfields());
-        const std::string _035a_contents(_035_subfields.getFirstSubfieldWithCode('a'));
-        if (StringUtil::StartsWith(_035a_contents, "(DE-588)"))
-            return _035a_contents.substr(__builtin_strlen("(DE-588)"));
+// Marks all authority records that are referenced via $0 subfields w/ GND numbers or K10plus PPN's.
+void MarkReferencedAuthorityRecords(MARC::Reader * const marc_reader, const MARC::AuthorityIdTable &authority_id_table,
+                                    Bitmap * const referenced_authority_records)
+{
+    referenced_authority_records->assign((authority_id_table.size() + 63) / 64, 0);
+
+    // Each worker thread has its own bitmap so that no locking is needed while we process the records:
+    std::mutex worker_bitmaps_mutex;
+    std::vector<std::unique_ptr<Bitmap>> worker_bitmaps;
+
+    MARC::ParallelProcessor processor(marc_reader, /* writer = */nullptr);
+    const size_t record_count(processor.process([&](MARC::Record * const record) {
+        thread_local Bitmap *worker_bitmap(nullptr);
+        if (unlikely(worker_bitmap == nullptr)) {
+            std::lock_guard<std::mutex> worker_bitmaps_locker(worker_bitmaps_mutex);
+            worker_bitmaps.emplace_back(new Bitmap(referenced_authority_records->size(), 0));
+            worker_bitmap = worker_bitmaps.back().get();
+        }
+
+        thread_local std::vector<uint32_t> ids;
+        for (const auto &field : *record) {
+            if (field.isControlField())
+                continue;
+            ids.clear();
+            authority_id_table.getReferencedIds(field.getContents(), &ids);
+            for (const uint32_t id : ids)
+                SetBit(id, worker_bitmap);
+        }
+
+        return false;
+    }));
+
+    for (const auto &worker_bitmap : worker_bitmaps) {
+        for (size_t i(0); i < referenced_authority_records->size(); ++i)
+            (*referenced_authority_records)[i] |= (*worker_bitmap)[i];
     }
 
-    return "";
+    std::cout << "Collected authority references from " << record_count << " title record(s).\n";
 }
 
 
@@ -77,15 +112,16 @@ const std::string DROPPED_GND_LIST_FILE("/usr/local/var/log/tuefind/dropped_gnd_
 
 
 void FilterAuthorityData(MARC::Reader * const marc_reader, MARC::Writer * const marc_writer,
-                         const std::unordered_set<std::string> &gnd_numbers)
+                         const Bitmap &referenced_authority_records)
 {
     std::unique_ptr<File> gnd_list_file(FileUtil::OpenOutputFileOrDie(DROPPED_GND_LIST_FILE));
     unsigned record_count(0), dropped_count(0), authority_records_without_gnd_numbers_count(0);
+    std::string gnd_number;
     while (const MARC::Record record = marc_reader->read()) {
-        ++record_count;
+        const uint32_t id(record_count++);
 
-        const std::string gnd_number(GetGNDNumber(record));
-        if (not gnd_number.empty() and gnd_numbers.find(gnd_number) == gnd_numbers.cend()) {
+        MARC::GetGNDCode(record, &gnd_number);
+        if (not gnd_number.empty() and not TestBit(id, referenced_authority_records)) {
             gnd_list_file->writeln(gnd_number);
             ++dropped_count;
             continue;
@@ -115,9 +151,12 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Reader> marc_authority_reader(MARC::Reader::Factory(argv[2]));
     std::unique_ptr<MARC::Writer> marc_authority_writer(MARC::Writer::Factory(argv[3]));
 
-    std::unordered_set<std::string> gnd_numbers;
-    CollectGNDReferences(marc_title_reader.get(), &gnd_numbers);
-    FilterAuthorityData(marc_authority_reader.get(), marc_authority_writer.get(), gnd_numbers);
+    MARC::AuthorityIdTable authority_id_table;
+    LoadAuthorityIds(argv[2], &authority_id_table);
+
+    Bitmap referenced_authority_records;
+    MarkReferencedAuthorityRecords(marc_title_reader.get(), authority_id_table, &referenced_authority_records);
+    FilterAuthorityData(marc_authority_reader.get(), marc_authority_writer.get(), referenced_authority_records);
 
     return EXIT_SUCCESS;
 }
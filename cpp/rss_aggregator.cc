@@ -19,8 +19,9 @@
  */
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <set>
 #include <unordered_map>
-#include <unordered_set>
 #include <cinttypes>
 #include <csignal>
 #include <cstring>
@@ -28,14 +29,17 @@
 #include "Compiler.h"
 #include "DbConnection.h"
 #include "DbResultSet.h"
+#include "DownloadBatch.h"
 #include "Downloader.h"
 #include "FileUtil.h"
+#include "HttpHeader.h"
 #include "IniFile.h"
 #include "RegexMatcher.h"
 #include "SignalUtil.h"
 #include "SqlUtil.h"
 #include "StringUtil.h"
 #include "SyndicationFormat.h"
+#include "TimeUtil.h"
 #include "UBTools.h"
 #include "util.h"
 #include "XmlWriter.h"
@@ -167,81 +171,253 @@ void CheckForSigHupAndReloadIniFileIfSeen(IniFile * const ini_file) {
 }
 
 
-std::unordered_map<std::string, uint64_t> section_name_to_ticks_map;
+// The validators of the last successfully downloaded version of each feed, used for conditional requests.
+struct FeedValidators {
+    std::string etag_;
+    time_t last_modified_;
+};
+std::unordered_map<std::string, FeedValidators> feed_url_to_validators_map;
+
+
+enum PollOutcome { FEED_CHANGED, FEED_UNCHANGED, POLL_FAILED };
+
+
+// Keeps track of when each feed is due next.  A feed's poll interval starts out as its configured "poll_interval" and
+// then adapts to how often the feed actually changes: it shrinks when a poll produced new items and grows when it
+// didn't, within a factor of POLL_INTERVAL_ADAPTATION_FACTOR of the configured interval.
+class FeedScheduler {
+    struct Feed {
+        unsigned configured_poll_interval_; // in seconds
+        unsigned current_poll_interval_;    // in seconds
+        time_t next_due_time_;
+    };
+    std::unordered_map<std::string, Feed> section_names_to_feeds_;
+    std::set<std::pair<time_t, std::string>> due_times_and_section_names_;
+public:
+    static const unsigned POLL_INTERVAL_ADAPTATION_FACTOR = 4;
+    static const unsigned MIN_POLL_INTERVAL = 5 * 60; // in seconds
+public:
+    /** \brief Adds new feeds, which are due right away, drops feeds that are no longer configured and picks up
+     *         changed poll intervals.
+     */
+    void synchronise(const std::unordered_map<std::string, unsigned> &section_names_to_poll_intervals, const time_t now);
+
+    /** \brief Removes all feeds that are due at "now" from the schedule until they are rescheduled. */
+    void getDueFeeds(const time_t now, std::vector<std::string> * const section_names);
+
+    void reschedule(const std::string &section_name, const PollOutcome poll_outcome, const time_t now);
+
+    /** \return The time when the next feed will be due or the largest possible time_t if there is none. */
+    time_t getNextDueTime() const {
+        return due_times_and_section_names_.empty() ? std::numeric_limits<time_t>::max()
+                                                    : due_times_and_section_names_.cbegin()->first;
+    }
+};
 
 
-// \return the number of new items.
-unsigned ProcessSection(const bool one_shot, const IniFile::Section &section,
-                        Downloader * const downloader, DbConnection * const db_connection, const unsigned default_downloader_time_limit,
-                        const unsigned default_poll_interval, const uint64_t now)
+void FeedScheduler::synchronise(const std::unordered_map<std::string, unsigned> &section_names_to_poll_intervals,
+                                const time_t now)
 {
-    SyndicationFormat::AugmentParams augment_params;
+    for (auto section_name_and_feed(section_names_to_feeds_.begin()); section_name_and_feed != section_names_to_feeds_.end();) {
+        if (section_names_to_poll_intervals.find(section_name_and_feed->first) == section_names_to_poll_intervals.cend()) {
+            due_times_and_section_names_.erase(std::make_pair(section_name_and_feed->second.next_due_time_,
+                                                              section_name_and_feed->first));
+            section_name_and_feed = section_names_to_feeds_.erase(section_name_and_feed);
+        } else
+            ++section_name_and_feed;
+    }
 
-    const std::string feed_url(section.getString("feed_url"));
-    const unsigned poll_interval(section.getUnsigned("poll_interval", default_poll_interval));
-    const unsigned downloader_time_limit(section.getUnsigned("downloader_time_limit", default_downloader_time_limit) * 1000);
-    augment_params.strptime_format_ = section.getString("strptime_format", "");
+    for (const auto &section_name_and_poll_interval : section_names_to_poll_intervals) {
+        const auto section_name_and_feed(section_names_to_feeds_.find(section_name_and_poll_interval.first));
+        if (section_name_and_feed == section_names_to_feeds_.end()) {
+            section_names_to_feeds_.emplace(section_name_and_poll_interval.first,
+                                            Feed{ section_name_and_poll_interval.second, section_name_and_poll_interval.second, now });
+            due_times_and_section_names_.emplace(now, section_name_and_poll_interval.first);
+        } else if (section_name_and_feed->second.configured_poll_interval_ != section_name_and_poll_interval.second) {
+            section_name_and_feed->second.configured_poll_interval_ = section_name_and_poll_interval.second;
+            section_name_and_feed->second.current_poll_interval_    = section_name_and_poll_interval.second;
+        }
+    }
+}
+
+
+void FeedScheduler::getDueFeeds(const time_t now, std::vector<std::string> * const section_names) {
+    section_names->clear();
+    while (not due_times_and_section_names_.empty() and due_times_and_section_names_.cbegin()->first <= now) {
+        section_names->emplace_back(due_times_and_section_names_.cbegin()->second);
+        due_times_and_section_names_.erase(due_times_and_section_names_.cbegin());
+    }
+}
+
+
+void FeedScheduler::reschedule(const std::string &section_name, const PollOutcome poll_outcome, const time_t now) {
+    const auto section_name_and_feed(section_names_to_feeds_.find(section_name));
+    if (unlikely(section_name_and_feed == section_names_to_feeds_.end()))
+        LOG_ERROR("unknown feed \"" + section_name + "\"!");
+    Feed &feed(section_name_and_feed->second);
+
+    if (poll_outcome == FEED_CHANGED)
+        feed.current_poll_interval_ = std::max(feed.configured_poll_interval_ / POLL_INTERVAL_ADAPTATION_FACTOR,
+                                               std::max(feed.current_poll_interval_ / 2, +MIN_POLL_INTERVAL));
+    else if (poll_outcome == FEED_UNCHANGED)
+        feed.current_poll_interval_ = std::min(feed.configured_poll_interval_ * POLL_INTERVAL_ADAPTATION_FACTOR,
+                                               feed.current_poll_interval_ + feed.current_poll_interval_ / 2);
+
+    due_times_and_section_names_.erase(std::make_pair(feed.next_due_time_, section_name));
+    feed.next_due_time_ = now + feed.current_poll_interval_;
+    due_times_and_section_names_.emplace(feed.next_due_time_, section_name);
+}
+
+
+bool IsFeedSection(const std::string &section_name) {
+    return not section_name.empty() and section_name != "CGI Params" and section_name != "Database" and section_name != "Channel";
+}
+
+
+// \return A map from the feed section names to their poll intervals in seconds.
+std::unordered_map<std::string, unsigned> GetFeedPollIntervals(const IniFile &ini_file, const unsigned default_poll_interval) {
+    std::unordered_map<std::string, unsigned> section_names_to_poll_intervals;
+    for (const auto &section : ini_file) {
+        const std::string &section_name(section.getSectionName());
+        if (not IsFeedSection(section_name))
+            continue;
+
+        if (unlikely(section_names_to_poll_intervals.find(section_name) != section_names_to_poll_intervals.end()))
+            LOG_ERROR("duplicate section: \"" + section_name + "\"!");
+        section_names_to_poll_intervals[section_name] = section.getUnsigned("poll_interval", default_poll_interval) * 3600;
+    }
+
+    return section_names_to_poll_intervals;
+}
+
+
+// \return The number of new items in the feed.
+unsigned ProcessFeedDownload(const bool one_shot, const IniFile::Section &section, const DownloadBatch::Result &result,
+                             DbConnection * const db_connection, PollOutcome * const poll_outcome)
+{
     const std::string &section_name(section.getSectionName());
+    const std::string &feed_url(result.url_);
+
+    *poll_outcome = POLL_FAILED;
+    if (result.anErrorOccurred()) {
+        LOG_WARNING(section_name + ": failed to download the feed: " + result.error_message_);
+        return 0;
+    }
+    if (result.response_code_ == 304) {
+        LOG_DEBUG(section_name + ": the feed has not been modified since we last downloaded it.");
+        *poll_outcome = FEED_UNCHANGED;
+        return 0;
+    }
+    if (result.response_code_ < 200 or result.response_code_ > 299) {
+        LOG_WARNING(section_name + ": the server returned a status code of " + std::to_string(result.response_code_) + "!");
+        return 0;
+    }
+
+    const HttpHeader http_header(result.message_header_);
+    if (not http_header.getETag().empty() or http_header.lastModifiedIsValid()) {
+        const time_t last_modified(http_header.lastModifiedIsValid() ? http_header.getLastModified() : 0);
+        feed_url_to_validators_map[feed_url] = FeedValidators{ http_header.getETag(), last_modified };
+    }
+
+    SyndicationFormat::AugmentParams augment_params;
+    augment_params.strptime_format_ = section.getString("strptime_format", "");
 
     const std::string title_suppression_regex_str(section.getString("title_suppression_regex", ""));
     const auto title_suppression_regex(
         title_suppression_regex_str.empty() ? nullptr : RegexMatcher::RegexMatcherFactoryOrDie(title_suppression_regex_str));
 
-    if (one_shot) {
-        std::cout << "Processing section \"" << section_name << "\":\n"
-                  << "\tfeed_url: " << feed_url << '\n'
-                  << "\tpoll_interval: " << poll_interval << " (ignored)\n"
-                  << "\tdownloader_time_limit: " << downloader_time_limit
-                  << (augment_params.strptime_format_.empty() ? "" : augment_params.strptime_format_ + "\n")
-                  << (title_suppression_regex_str.empty() ? "" : title_suppression_regex_str + "\n")
-                  << "\n\n";
+    std::string error_message;
+    std::unique_ptr<SyndicationFormat> syndication_format(
+        SyndicationFormat::Factory(result.message_body_, augment_params, &error_message));
+    if (unlikely(syndication_format == nullptr)) {
+        LOG_WARNING("failed to parse feed: " + error_message);
+        return 0;
     }
 
-    const auto section_name_and_ticks(section_name_to_ticks_map.find(section_name));
-    if (section_name_and_ticks != section_name_to_ticks_map.end()) {
-        if (section_name_and_ticks->second + poll_interval < now) {
-            LOG_DEBUG(section_name + ": not yet time to do work, last work was done at " + std::to_string(section_name_and_ticks->second)
-                      + ".");
-            return 0;
-        }
-    }
+    // Most feeds list their newest items first.  Once we have seen enough items to be confident of that, we can stop
+    // at the first item that we already know as all following items will be known too.
+    const unsigned MIN_ORDERED_ITEM_COUNT(3);
+    bool newest_items_first(true);
+    unsigned seen_item_count(0);
+    time_t previous_pub_date(std::numeric_limits<time_t>::max());
 
     unsigned new_item_count(0);
-    SignalUtil::SignalBlocker sigterm_blocker(SIGTERM);
-    if (not downloader->newUrl(feed_url, downloader_time_limit))
-        LOG_WARNING(section_name + ": failed to download the feed: " + downloader->getLastErrorMessage());
-    else {
-        sigterm_blocker.unblock();
+    for (const auto &item : *syndication_format) {
         if (not one_shot)
             CheckForSigTermAndExitIfSeen();
+        SignalUtil::SignalBlocker sigterm_blocker(SIGTERM);
 
-        std::string error_message;
-        std::unique_ptr<SyndicationFormat> syndication_format(
-            SyndicationFormat::Factory(downloader->getMessageBody(), augment_params, &error_message));
-        if (unlikely(syndication_format == nullptr))
-            LOG_WARNING("failed to parse feed: " + error_message);
-        else {
-            for (const auto &item : *syndication_format) {
-                if (not one_shot)
-                    CheckForSigTermAndExitIfSeen();
-                SignalUtil::SignalBlocker sigterm_blocker2(SIGTERM);
-
-                if (title_suppression_regex != nullptr and title_suppression_regex->matched(item.getTitle())) {
-                    LOG_INFO("Suppressed item because of title: \"" + StringUtil::ShortenText(item.getTitle(), 40) + "\".");
-                    continue; // Skip suppressed item.
-                }
-
-                if (ProcessRSSItem(item, section_name, feed_url, db_connection))
-                    ++new_item_count;
-            }
+        const time_t pub_date(item.getPubDate());
+        if (pub_date == TimeUtil::BAD_TIME_T or pub_date > previous_pub_date)
+            newest_items_first = false;
+        previous_pub_date = pub_date;
+        ++seen_item_count;
+
+        if (title_suppression_regex != nullptr and title_suppression_regex->matched(item.getTitle())) {
+            LOG_INFO("Suppressed item because of title: \"" + StringUtil::ShortenText(item.getTitle(), 40) + "\".");
+            continue; // Skip suppressed item.
+        }
+
+        if (ProcessRSSItem(item, section_name, feed_url, db_connection))
+            ++new_item_count;
+        else if (newest_items_first and seen_item_count >= MIN_ORDERED_ITEM_COUNT and not item.getLink().empty()) {
+            LOG_DEBUG(section_name + ": reached an already known item, skipping the rest of the feed.");
+            break;
         }
     }
 
-    section_name_to_ticks_map[section_name] = now;
+    *poll_outcome = new_item_count > 0 ? FEED_CHANGED : FEED_UNCHANGED;
     return new_item_count;
 }
 
 
+// Downloads all due feeds concurrently and reschedules them according to what we found.
+// \return The total number of new items.
+unsigned ProcessDueFeeds(const bool one_shot, const IniFile &ini_file, const std::vector<std::string> &due_section_names,
+                         DbConnection * const db_connection, const unsigned default_downloader_time_limit,
+                         FeedScheduler * const feed_scheduler)
+{
+    unsigned total_new_item_count(0);
+    DownloadBatch download_batch;
+    for (const auto &section_name : due_section_names) {
+        const IniFile::Section &section(*ini_file.getSection(section_name));
+        const std::string feed_url(section.getString("feed_url"));
+        const unsigned downloader_time_limit(section.getUnsigned("downloader_time_limit", default_downloader_time_limit) * 1000);
+
+        if (one_shot) {
+            std::cout << "Processing section \"" << section_name << "\":\n"
+                      << "\tfeed_url: " << feed_url << '\n'
+                      << "\tdownloader_time_limit: " << downloader_time_limit << '\n'
+                      << "\n\n";
+        }
+        LOG_INFO("Processing section \"" + section_name + "\".");
+
+        Downloader::Params downloader_params;
+        const auto feed_url_and_validators(feed_url_to_validators_map.find(feed_url));
+        if (feed_url_and_validators != feed_url_to_validators_map.end()) {
+            downloader_params.if_none_match_     = feed_url_and_validators->second.etag_;
+            downloader_params.if_modified_since_ = feed_url_and_validators->second.last_modified_;
+        }
+
+        download_batch.addUrl(feed_url, downloader_params, downloader_time_limit,
+                              [one_shot, &section, db_connection, feed_scheduler, &total_new_item_count]
+                              (const DownloadBatch::Result &result)
+                              {
+                                  PollOutcome poll_outcome;
+                                  const unsigned new_item_count(ProcessFeedDownload(one_shot, section, result, db_connection,
+                                                                                    &poll_outcome));
+                                  LOG_INFO(section.getSectionName() + ": downloaded " + std::to_string(new_item_count)
+                                           + " new items.");
+                                  total_new_item_count += new_item_count;
+                                  feed_scheduler->reschedule(section.getSectionName(), poll_outcome, std::time(nullptr));
+                              });
+    }
+    download_batch.run();
+
+    return total_new_item_count;
+}
+
+
 const unsigned HARVEST_TIME_WINDOW(60); // days
 
 
@@ -302,68 +478,55 @@ int Main(int argc, char *argv[]) {
 
     const std::string xml_output_filename(argv[1]);
 
-    uint64_t ticks(0);
-    Downloader downloader;
+    FeedScheduler feed_scheduler;
+    time_t next_output_time(0);
     for (;;) {
-        LOG_DEBUG("now we're at " + std::to_string(ticks) + ".");
-
         CheckForSigHupAndReloadIniFileIfSeen(&ini_file);
 
-        const time_t before(std::time(nullptr));
-
-        std::unordered_set<std::string> already_seen_sections;
-        for (const auto &section : ini_file) {
-            if (sigterm_seen) {
-                LOG_INFO("caught SIGTERM, shutting down...");
-                return EXIT_SUCCESS;
-            }
+        const time_t now(std::time(nullptr));
+        feed_scheduler.synchronise(GetFeedPollIntervals(ini_file, DEFAULT_POLL_INTERVAL), now);
 
+        unsigned new_item_count(0);
+        std::vector<std::string> due_section_names;
+        feed_scheduler.getDueFeeds(now, &due_section_names);
+        if (not due_section_names.empty()) {
             SignalUtil::SignalBlocker sighup_blocker(SIGHUP);
+            new_item_count = ProcessDueFeeds(one_shot, ini_file, due_section_names, &db_connection,
+                                             DEFAULT_DOWNLOADER_TIME_LIMIT, &feed_scheduler);
+        }
 
-            const std::string &section_name(section.getSectionName());
-            if (not section_name.empty() and section_name != "CGI Params" and section_name != "Database" and section_name != "Channel") {
-                if (unlikely(already_seen_sections.find(section_name) != already_seen_sections.end()))
-                    LOG_ERROR("duplicate section: \"" + section_name + "\"!");
-                already_seen_sections.emplace(section_name);
-
-                LOG_INFO("Processing section \"" + section_name + "\".");
-                const unsigned new_item_count(ProcessSection(one_shot, section, &downloader, &db_connection,
-                                                             DEFAULT_DOWNLOADER_TIME_LIMIT, DEFAULT_POLL_INTERVAL, ticks));
-                LOG_INFO("Downloaded " + std::to_string(new_item_count) + " new items.");
-            }
+        if (sigterm_seen) {
+            LOG_INFO("caught SIGTERM, shutting down...");
+            return EXIT_SUCCESS;
         }
 
-        std::vector<HarvestedRSSItem> harvested_items;
-        const auto feed_item_count(SelectItems(&db_connection, &harvested_items));
+        // We also regenerate our feed regularly when nothing new came in, as old items drop out of HARVEST_TIME_WINDOW.
+        if (new_item_count > 0 or now >= next_output_time) {
+            std::vector<HarvestedRSSItem> harvested_items;
+            const auto feed_item_count(SelectItems(&db_connection, &harvested_items));
 
-        // scoped here so that we flush and close the output file right away
-        {
-            XmlWriter xml_writer(FileUtil::OpenOutputFileOrDie(xml_output_filename).release(),
-                                 XmlWriter::WriteTheXmlDeclaration, DEFAULT_XML_INDENT_AMOUNT);
-            WriteRSSFeedXMLOutput(ini_file, &harvested_items, &xml_writer);
+            // scoped here so that we flush and close the output file right away
+            {
+                XmlWriter xml_writer(FileUtil::OpenOutputFileOrDie(xml_output_filename).release(),
+                                     XmlWriter::WriteTheXmlDeclaration, DEFAULT_XML_INDENT_AMOUNT);
+                WriteRSSFeedXMLOutput(ini_file, &harvested_items, &xml_writer);
+            }
+            LOG_INFO("Created our feed with " + std::to_string(feed_item_count) + " items from the last " + std::to_string(HARVEST_TIME_WINDOW)
+                     + " days.");
+            next_output_time = now + UPDATE_INTERVAL * 60;
         }
-        LOG_INFO("Created our feed with " + std::to_string(feed_item_count) + " items from the last " + std::to_string(HARVEST_TIME_WINDOW)
-                 + " days.");
 
         if (one_shot) // -> only run through our loop once
             return EXIT_SUCCESS;
 
-        const time_t after(std::time(nullptr));
-
-        uint64_t sleep_interval;
-        if (after - before > UPDATE_INTERVAL * 60)
-            sleep_interval = 0;
-        else
-            sleep_interval = (UPDATE_INTERVAL * 60 - (after - before));
-
-        unsigned total_time_slept(0);
-        do {
-            const unsigned actual_time_slept(::sleep(static_cast<unsigned>(sleep_interval - total_time_slept)));
+        // Sleep until the next feed is due or we have to regenerate our feed.  A SIGHUP wakes us up right away.
+        const time_t wake_up_time(std::min(feed_scheduler.getNextDueTime(), next_output_time));
+        LOG_DEBUG("sleeping until " + TimeUtil::TimeTToString(wake_up_time) + ".");
+        for (time_t current_time(std::time(nullptr)); current_time < wake_up_time and not sighup_seen;
+             current_time = std::time(nullptr))
+        {
+            ::sleep(static_cast<unsigned>(wake_up_time - current_time));
             CheckForSigTermAndExitIfSeen();
-            CheckForSigHupAndReloadIniFileIfSeen(&ini_file);
-
-            total_time_slept += actual_time_slept;
-        } while (total_time_slept < sleep_interval);
-        ticks += UPDATE_INTERVAL;
+        }
     }
 }
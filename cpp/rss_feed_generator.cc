@@ -18,7 +18,10 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <vector>
+#include <cstdlib>
 #include <cstring>
+#include <unistd.h>
 #include "Compiler.h"
 #include "DbConnection.h"
 #include "DbResultSet.h"
@@ -27,6 +30,7 @@
 #include "IniFile.h"
 #include "SqlUtil.h"
 #include "StringUtil.h"
+#include "TimeUtil.h"
 #include "UBTools.h"
 #include "util.h"
 
@@ -38,12 +42,115 @@ namespace {
     std::cerr << "Usage: " << ::progname << " [--min-log-level=min_verbosity] time_window [xml_output_path]\n"
               << "       \"time_window\", which is in hours, specifies how far back we go in secting items from the database.\n"
               << "       If \"xml_output_path\" has not been specified an HTTP header will be written and the\n"
-              << "       generated XML will be written to stdout using CR\\LF line ends.\n\n";
+              << "       generated XML will be written to stdout using CR\\LF line ends.  In that case conditional\n"
+              << "       requests w/ If-None-Match or If-Modified-Since headers will be answered w/ 304 if possible.\n\n";
     std::exit(EXIT_FAILURE);
 }
 
 
 const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "rss_aggregator.conf");
+const std::string CACHE_DIRECTORY(UBTools::GetTuelibPath() + "rss_feed_generator_cache/");
+
+
+// Items are always inserted w/ the current time and only leave the feed when they drop out of the time window.  Either
+// changes the newest or oldest insertion time in the time window or the number of items, all of which we can determine
+// w/ a single query that only touches the insertion_time index.  Changes to the channel header, i.e. to our config
+// file, are covered by the hash of the header.
+struct FeedVersion {
+    time_t newest_insertion_time_; // 0 if there are no items.
+    std::string etag_;
+};
+
+
+FeedVersion GetFeedVersion(DbConnection * const db_connection, const time_t cutoff, const std::string &channel_header) {
+    db_connection->queryOrDie("SELECT MAX(insertion_time) AS newest,MIN(insertion_time) AS oldest,COUNT(*) AS item_count "
+                              "FROM rss_aggregator WHERE insertion_time >= '" + SqlUtil::TimeTToDatetime(cutoff) + "'");
+    DbResultSet result_set(db_connection->getLastResultSet());
+    const DbRow db_row(result_set.getNextRow());
+
+    FeedVersion feed_version;
+    time_t oldest_insertion_time(0);
+    if (db_row.isNull("newest"))
+        feed_version.newest_insertion_time_ = 0;
+    else {
+        feed_version.newest_insertion_time_ = SqlUtil::DatetimeToTimeT(db_row["newest"]);
+        oldest_insertion_time               = SqlUtil::DatetimeToTimeT(db_row["oldest"]);
+    }
+    feed_version.etag_ = "\"" + std::to_string(feed_version.newest_insertion_time_) + "-"
+                         + std::to_string(oldest_insertion_time) + "-" + db_row["item_count"] + "-"
+                         + StringUtil::ToHexString(StringUtil::Md5(channel_header)).substr(0, 16) + "\"";
+
+    return feed_version;
+}
+
+
+// \return True if a client that sent the current CGI request already has "feed_version".
+bool ClientHasCurrentVersion(const FeedVersion &feed_version) {
+    // If-None-Match takes precedence over If-Modified-Since, see RFC 7232.
+    const char * const if_none_match(std::getenv("HTTP_IF_NONE_MATCH"));
+    if (if_none_match != nullptr) {
+        std::vector<std::string> etags;
+        StringUtil::SplitThenTrimWhite(if_none_match, ',', &etags);
+        for (const auto &etag : etags) {
+            if (etag == "*" or etag == feed_version.etag_ or etag == "W/" + feed_version.etag_)
+                return true;
+        }
+        return false;
+    }
+
+    const char * const if_modified_since(std::getenv("HTTP_IF_MODIFIED_SINCE"));
+    time_t last_seen_modification;
+    return if_modified_since != nullptr and feed_version.newest_insertion_time_ != 0
+           and TimeUtil::ParseRFC1123DateTime(if_modified_since, &last_seen_modification)
+           and feed_version.newest_insertion_time_ <= last_seen_modification;
+}
+
+
+std::string GetCachePath(const unsigned time_window, const bool cgi_mode) {
+    return CACHE_DIRECTORY + std::to_string(time_window) + (cgi_mode ? ".crlf" : ".lf");
+}
+
+
+// The first line of a cache file contains the ETag of the feed that makes up the rest of the file.
+bool ReadCachedFeed(const std::string &cache_path, const FeedVersion &feed_version, std::string * const feed) {
+    std::string cache_contents;
+    if (not FileUtil::ReadString(cache_path, &cache_contents)
+        or not StringUtil::StartsWith(cache_contents, feed_version.etag_ + "\n"))
+        return false;
+
+    *feed = cache_contents.substr(feed_version.etag_.length() + 1);
+    return true;
+}
+
+
+// Writes a temporary file first so that concurrent CGI invocations never see a partially written cache file.
+void WriteCachedFeed(const std::string &cache_path, const FeedVersion &feed_version, const std::string &feed) {
+    const std::string temp_path(cache_path + "." + std::to_string(::getpid()));
+    if (not FileUtil::MakeDirectory(CACHE_DIRECTORY, /* recursive = */true)
+        or not FileUtil::WriteString(temp_path, feed_version.etag_ + "\n" + feed)
+        or not FileUtil::RenameFile(temp_path, cache_path, /* remove_target = */true))
+    {
+        ::unlink(temp_path.c_str());
+        LOG_WARNING("failed to write the feed cache \"" + cache_path + "\"!");
+    }
+}
+
+
+std::string RenderItems(DbConnection * const db_connection, const time_t cutoff, const std::string &line_end) {
+    db_connection->queryOrDie("SELECT * FROM rss_aggregator WHERE insertion_time >= '" + SqlUtil::TimeTToDatetime(cutoff) + "'");
+    DbResultSet result_set(db_connection->getLastResultSet());
+
+    std::string items;
+    while (const DbRow db_row = result_set.getNextRow()) {
+        items += "  <item>" + line_end;
+        items += "    <title>" + db_row["serial_name"] + "</title>" + line_end;
+        items += "    <link>" + db_row["item_url"] + "</link>" + line_end;
+        items += "    <description>" + db_row["title_and_or_description"] + "</description>" + line_end;
+        items += "  </item>" + line_end;
+    }
+
+    return items;
+}
 
 
 } // unnamed namespace
@@ -72,34 +179,45 @@ int Main(int argc, char *argv[]) {
     IniFile ini_file(CONF_FILE_PATH);
     DbConnection db_connection(ini_file);
 
-    std::unique_ptr<File> output(FileUtil::OpenOutputFileOrDie(output_filename));
-
-    if (cgi_mode)
-        (*output) << "Content-Type: text/html; charset=utf-8\r\n\r\n";
     const std::string LINE_END(cgi_mode ? "\r\n" :  "\n");
+    std::string channel_header;
+    channel_header += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>" + LINE_END;
+    channel_header += "<rss version=\"2.0\">" + LINE_END;
+    channel_header += "<channel>" + LINE_END;
+    channel_header += "  <title>" + ini_file.getString("CGI Params", "feed_title") + "</title>" + LINE_END;
+    channel_header += "  <link>" + ini_file.getString("CGI Params", "feed_link") + "</link>" + LINE_END;
+    channel_header += "  <description>" + ini_file.getString("CGI Params", "feed_description") + "</description>" + LINE_END;
 
     const time_t now(std::time(nullptr));
     const time_t cutoff(now - time_window * 3600);
-    db_connection.queryOrDie("SELECT * FROM rss_aggregator WHERE insertion_time >= '" + SqlUtil::TimeTToDatetime(cutoff) + "'");
-    DbResultSet result_set(db_connection.getLastResultSet());
+    const FeedVersion feed_version(GetFeedVersion(&db_connection, cutoff, channel_header));
 
-    (*output) << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>" << LINE_END;
-    (*output) << "<rss version=\"2.0\">" << LINE_END;
-    (*output) << "<channel>" << LINE_END;
-    (*output) << "  <title>" << ini_file.getString("CGI Params", "feed_title") << "</title>" << LINE_END;
-    (*output) << "  <link>" << ini_file.getString("CGI Params", "feed_link") << "</link>" << LINE_END;
-    (*output) << "  <description>" << ini_file.getString("CGI Params", "feed_description") << "</description>" << LINE_END;
-
-    while (const DbRow db_row = result_set.getNextRow()) {
-        (*output) << "  <item>" << LINE_END;
-        (*output) << "    <title>" << db_row["serial_name"] << "</title>" << LINE_END;
-        (*output) << "    <link>" << db_row["item_url"] << "</link>" << LINE_END;
-        (*output) << "    <description>" << db_row["title_and_or_description"] << "</description>" << LINE_END;
-        (*output) << "  </item>" << LINE_END;
+    std::unique_ptr<File> output(FileUtil::OpenOutputFileOrDie(output_filename));
+    if (cgi_mode) {
+        if (ClientHasCurrentVersion(feed_version)) {
+            (*output) << "Status: 304 Not Modified\r\n";
+            (*output) << "ETag: " << feed_version.etag_ << "\r\n\r\n";
+            return EXIT_SUCCESS;
+        }
+
+        (*output) << "Content-Type: text/html; charset=utf-8\r\n";
+        (*output) << "ETag: " << feed_version.etag_ << "\r\n";
+        if (feed_version.newest_insertion_time_ != 0)
+            (*output) << "Last-Modified: "
+                      << TimeUtil::TimeTToString(feed_version.newest_insertion_time_, "%a, %d %b %Y %H:%M:%S GMT", TimeUtil::UTC)
+                      << "\r\n";
+        (*output) << "\r\n";
     }
 
-    (*output) << "</channel>" << LINE_END;
-    (*output) << "</rss>" << LINE_END;
+    const std::string cache_path(GetCachePath(time_window, cgi_mode));
+    std::string feed;
+    if (not ReadCachedFeed(cache_path, feed_version, &feed)) {
+        feed = channel_header + RenderItems(&db_connection, cutoff, LINE_END);
+        feed += "</channel>" + LINE_END;
+        feed += "</rss>" + LINE_END;
+        WriteCachedFeed(cache_path, feed_version, feed);
+    }
+    (*output) << feed;
 
     return EXIT_SUCCESS;
 }
@@ -46,6 +46,8 @@ void Usage() {
               << "                                                            to download a page (default " + std::to_string(SimpleCrawler::DEFAULT_TIMEOUT) + ").\n"
               << "\t[ (--min-url-processing-time | -m) milliseconds ]         Min time between downloading 2 URL's\n"
               << "                                                            to prevent accidental DOS attacks (default " + std::to_string(SimpleCrawler::DEFAULT_MIN_URL_PROCESSING_TIME) + ").\n"
+              << "\t[ (--max-concurrent-hosts | -c) count ]                  Max. number of hosts that will be crawled\n"
+              << "                                                            concurrently (default " + std::to_string(SimpleCrawler::DEFAULT_MAX_CONCURRENT_HOSTS) + ").\n"
               << "\n"
               << "The config file consists of lines specifying one site per line.\n"
               << "Each line must have a start URL, a maximum crawl depth and a PCRE URL pattern, that each sub-url must match.\n"
@@ -65,6 +67,7 @@ static struct option options[] = {
     { "ignore-robots-dot-txt",   no_argument,              nullptr, 'i'  },
     { "print-redirects",         no_argument,              nullptr, 'p'  },
     { "acceptable-languages",    required_argument,        nullptr, 'A'  },
+    { "max-concurrent-hosts",    required_argument,        nullptr, 'c'  },
     { nullptr,                   no_argument,              nullptr, '\0' }
 };
 
@@ -75,11 +78,12 @@ void ProcessArgs(int argc, char *argv[], Logger::LogLevel * const min_log_level,
     *min_log_level = Logger::LL_DEBUG;
     unsigned min_url_processing_time;
     unsigned timeout;
+    unsigned max_concurrent_hosts;
 
     for (;;) {
         char *endptr;
         int option_index = 0;
-        int option = ::getopt_long(argc, argv, "ahlqt:ipA:", options, &option_index);
+        int option = ::getopt_long(argc, argv, "ahlqt:ipA:c:", options, &option_index);
         if (option == -1)
             break;
         switch (option) {
@@ -119,6 +123,15 @@ void ProcessArgs(int argc, char *argv[], Logger::LogLevel * const min_log_level,
         case 'A':
             params->acceptable_languages_ = optarg;
             break;
+        case 'c':
+            errno = 0;
+            max_concurrent_hosts = std::strtoul(optarg, &endptr, 10);
+            if (errno != 0 or *endptr != '\0' or max_concurrent_hosts == 0) {
+                std::cerr << ::progname << " invalid max_concurrent_hosts \"" << optarg << "\"!\n";
+                Usage();
+            }
+            params->max_concurrent_hosts_ = max_concurrent_hosts;
+            break;
         default:
             Usage();
         }
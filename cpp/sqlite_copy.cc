@@ -18,27 +18,90 @@
 */
 
 #include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "DbConnection.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
 #include "util.h"
 
 
 namespace {
 
 
+[[noreturn]] void Usage() {
+    ::Usage("[--pages-per-step=count] [--sleep-interval=milliseconds] [--incremental] sqlite_database sqlite_database_copy\n"
+            "The database is copied in steps of \"count\" pages w/ pauses of \"milliseconds\" between steps so that writers can\n"
+            "make progress.  If --incremental has been specified, nothing will be copied if the database has not been modified\n"
+            "since the last backup.");
+}
+
+
+// Describes the state of the database file and its write-ahead log, if any.  Any write to the database changes it.
+std::string GetDatabaseFingerprint(const std::string &database_path) {
+    std::string fingerprint;
+    for (const auto &path : { database_path, database_path + "-wal" }) {
+        struct stat stat_buf;
+        if (::stat(path.c_str(), &stat_buf) != 0)
+            fingerprint += "missing;";
+        else
+            fingerprint += std::to_string(stat_buf.st_size) + "," + std::to_string(stat_buf.st_mtim.tv_sec) + "."
+                           + std::to_string(stat_buf.st_mtim.tv_nsec) + ";";
+    }
+
+    return fingerprint;
+}
+
+
 } // unnamed namespace
 
 
 int Main(int argc, char *argv[]) {
+    int pages_per_step(500);
+    unsigned sleep_interval(100), pages_per_step_arg;
+    bool incremental(false);
+    for (; argc > 1 and StringUtil::StartsWith(argv[1], "--"); --argc, ++argv) {
+        if (StringUtil::StartsWith(argv[1], "--pages-per-step=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--pages-per-step="), &pages_per_step_arg)
+                or pages_per_step_arg == 0)
+                LOG_ERROR("bad page count!");
+            pages_per_step = static_cast<int>(pages_per_step_arg);
+        } else if (StringUtil::StartsWith(argv[1], "--sleep-interval=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--sleep-interval="), &sleep_interval))
+                LOG_ERROR("bad sleep interval!");
+        } else if (std::strcmp(argv[1], "--incremental") == 0)
+            incremental = true;
+        else
+            Usage();
+    }
     if (argc != 3)
-        ::Usage("sqlite_database sqlite_database_copy");
+        Usage();
 
     const std::string original_database(argv[1]);
     const std::string copy_of_database(argv[2]);
     if (original_database == copy_of_database)
         LOG_ERROR("won't overwrite original database!");
 
+    // We record the state of the original as of the start of the backup.  A write that happens during the backup may or may
+    // not be included in the copy, but it will change the state and will therefore trigger the next incremental backup.
+    const std::string fingerprint_path(copy_of_database + ".fingerprint");
+    const std::string fingerprint(GetDatabaseFingerprint(original_database));
+    std::string last_fingerprint;
+    if (incremental and FileUtil::Exists(copy_of_database) and FileUtil::ReadString(fingerprint_path, &last_fingerprint)
+        and last_fingerprint == fingerprint)
+    {
+        LOG_INFO("\"" + original_database + "\" has not been modified since the last backup.");
+        return EXIT_SUCCESS;
+    }
+
+    // Back up to a temporary file so that the previous copy stays intact until we have a complete new one:
+    const std::string temp_copy(copy_of_database + ".tmp");
+    ::unlink(temp_copy.c_str());
     DbConnection db_connection(original_database, DbConnection::READONLY);
-    db_connection.backupOrDie(copy_of_database);
+    db_connection.backupOrDie(temp_copy, pages_per_step, sleep_interval);
+    FileUtil::RenameFileOrDie(temp_copy, copy_of_database, /* remove_target = */true);
+    FileUtil::WriteStringOrDie(fingerprint_path, fingerprint);
 
     return EXIT_SUCCESS;
 }
@@ -22,10 +22,11 @@
 #include <unordered_map>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include "BibleUtil.h"
 #include "FileUtil.h"
 #include "MARC.h"
-#include "RegexMatcher.h"
+#include "MultiPatternMatcher.h"
 #include "StringUtil.h"
 #include "TextUtil.h"
 #include "UBTools.h"
@@ -75,49 +76,68 @@ std::string NormaliseTitle(std::string title) {
 }
 
 
-std::string GetPericope(const std::string &normalised_title,
-                        const std::unordered_map<std::string, std::string> &pericopes_to_codes_map)
+// \return The leftmost and, among those, the longest pericope in "normalised_title" or the empty string if none was found.
+std::string GetPericope(const std::string &normalised_title, const std::vector<std::string> &pericopes,
+                        const MultiPatternMatcher &pericope_matcher)
 {
-    for (const auto &pericope_and_codes : pericopes_to_codes_map) {
-        if (normalised_title.find(pericope_and_codes.first) != std::string::npos)
-            return pericope_and_codes.first;
-    }
+    std::vector<MultiPatternMatcher::Match> matches;
+    pericope_matcher.findLeftmostLongest(normalised_title, &matches);
+    return matches.empty() ? "" : pericopes[matches.front().pattern_index_];
+}
 
-    return "";
+
+// \return The length of the prefix of "s" that consists of characters that may occur in chapter and verse references.
+size_t GetChaptersAndVersesLength(const std::string &s) {
+    size_t length(0);
+    while (length < s.length() and (StringUtil::IsDigit(s[length]) or std::strchr(" \t,.:-", s[length]) != nullptr
+                                    or (StringUtil::IsAsciiLetter(s[length]) and length > 0
+                                        and StringUtil::IsDigit(s[length - 1]))))
+        ++length;
+
+    // Trailing separators can't be part of a reference:
+    while (length > 0 and std::strchr(" \t,.:-", s[length - 1]) != nullptr)
+        --length;
+
+    return length;
 }
 
 
-std::string GetPossibleBibleReference(const std::string &normalised_title,
-                                      const BibleUtil::BibleBookCanoniser &bible_book_canoniser,
-                                      const BibleUtil::BibleBookToCodeMapper &bible_book_to_code_mapper)
-{
-    // Regex taken from https://stackoverflow.com/questions/22254746/bible-verse-regex
-    static RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory(
-        "(\\d*)\\s*([a-z]+)\\s*(\\d+)(:(\\d+))?(\\s*-\\s*(\\d+)(\\s*([a-z]+)\\s*(\\d+))?(:(\\d+))?)?"));
-    if (not matcher->matched(normalised_title))
-        return "";
-
-    const std::string bible_reference_candidate((*matcher)[0]);
-    std::vector<std::string> book_candidates, chapters_and_verses_candidates;
-    BibleUtil::SplitIntoBooksAndChaptersAndVerses(bible_reference_candidate, &book_candidates, &chapters_and_verses_candidates);
-    if (book_candidates.empty())
-        return "";
-
-    std::string book_candidate(bible_book_canoniser.canonise(book_candidates.front(), /* verbose = */false));
-    const std::string book_code(bible_book_to_code_mapper.mapToCode(book_candidate, /* verbose = */false));
-    if (book_code.empty())
-        return "";
-
-    std::set<std::pair<std::string, std::string>> start_end;
-    return BibleUtil::ParseBibleReference(chapters_and_verses_candidates.front(), book_code, &start_end) ? bible_reference_candidate : "";
+// Only the text that immediately follows a mention of a book of the bible is handed to the reference parser.
+std::string GetPossibleBibleReference(const std::string &normalised_title, const BibleUtil::BibleBookMatcher &bible_book_matcher) {
+    std::vector<BibleUtil::BibleBookMatcher::Mention> mentions;
+    bible_book_matcher.findMentions(normalised_title, &mentions);
+    for (const auto &mention : mentions) {
+        const size_t mention_end(mention.start_ + mention.length_);
+        size_t chapters_and_verses_start(mention_end);
+        while (chapters_and_verses_start < normalised_title.length()
+               and StringUtil::IsWhitespace(normalised_title[chapters_and_verses_start]))
+            ++chapters_and_verses_start;
+        if (chapters_and_verses_start == normalised_title.length()
+            or not StringUtil::IsDigit(normalised_title[chapters_and_verses_start]))
+            continue;
+
+        const std::string chapters_and_verses_candidate(
+            normalised_title.substr(chapters_and_verses_start,
+                                    GetChaptersAndVersesLength(normalised_title.substr(chapters_and_verses_start))));
+        std::set<std::pair<std::string, std::string>> start_end;
+        if (BibleUtil::ParseBibleReference(chapters_and_verses_candidate, mention.book_code_, &start_end))
+            return normalised_title.substr(mention.start_, chapters_and_verses_start + chapters_and_verses_candidate.length()
+                                                           - mention.start_);
+    }
+
+    return "";
 }
 
 
 void ProcessRecords(const bool verbose, MARC::Reader * const marc_reader, File * const ppn_candidate_list,
                     const std::unordered_map<std::string, std::string> &pericopes_to_codes_map,
-                    const BibleUtil::BibleBookCanoniser &bible_book_canoniser,
-                    const BibleUtil::BibleBookToCodeMapper &bible_book_to_code_mapper)
+                    const BibleUtil::BibleBookMatcher &bible_book_matcher)
 {
+    std::vector<std::string> pericopes;
+    for (const auto &pericope_and_codes : pericopes_to_codes_map)
+        pericopes.emplace_back(pericope_and_codes.first);
+    const MultiPatternMatcher pericope_matcher(pericopes);
+
     unsigned record_count(0), ppn_candidate_count(0);
     while (const MARC::Record record = marc_reader->read()) {
         ++record_count;
@@ -138,9 +158,9 @@ void ProcessRecords(const bool verbose, MARC::Reader * const marc_reader, File *
         }
 
         const std::string normalised_title(NormaliseTitle(title));
-        std::string bib_ref_candidate(GetPericope(normalised_title, pericopes_to_codes_map));
+        std::string bib_ref_candidate(GetPericope(normalised_title, pericopes, pericope_matcher));
         if (bib_ref_candidate.empty())
-            bib_ref_candidate = GetPossibleBibleReference(normalised_title, bible_book_canoniser, bible_book_to_code_mapper);
+            bib_ref_candidate = GetPossibleBibleReference(normalised_title, bible_book_matcher);
         StringUtil::TrimWhite(&bib_ref_candidate);
         if (not bib_ref_candidate.empty()) {
             ++ppn_candidate_count;
@@ -176,14 +196,13 @@ int Main(int argc, char *argv[]) {
     std::unique_ptr<MARC::Reader> marc_reader(MARC::Reader::Factory(argv[1]));
     std::unique_ptr<File> ppn_candidate_list(FileUtil::OpenOutputFileOrDie(argv[2]));
 
-    const BibleUtil::BibleBookCanoniser bible_book_canoniser(UBTools::GetTuelibPath() + "bibleRef/books_of_the_bible_to_canonical_form.map");
-    const BibleUtil::BibleBookToCodeMapper bible_book_to_code_mapper(UBTools::GetTuelibPath() + "bibleRef/books_of_the_bible_to_code.map");
+    const BibleUtil::BibleBookMatcher bible_book_matcher(UBTools::GetTuelibPath() + "bibleRef/books_of_the_bible_to_canonical_form.map",
+                                                         UBTools::GetTuelibPath() + "bibleRef/books_of_the_bible_to_code.map");
 
     std::unordered_map<std::string, std::string> pericopes_to_codes_map;
     LoadPericopes(&pericopes_to_codes_map);
 
-    ProcessRecords(verbose, marc_reader.get(), ppn_candidate_list.get(), pericopes_to_codes_map, bible_book_canoniser,
-                   bible_book_to_code_mapper);
+    ProcessRecords(verbose, marc_reader.get(), ppn_candidate_list.get(), pericopes_to_codes_map, bible_book_matcher);
 
     return EXIT_SUCCESS;
 }
@@ -29,17 +29,26 @@
 #include <iostream>
 #include <unordered_map>
 #include <vector>
+#include <cctype>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 #include "Compiler.h"
 #include "FileUtil.h"
-#include "RegexMatcher.h"
 #include "SqlUtil.h"
 #include "StringUtil.h"
+#include "ThreadPool.h"
 #include "util.h"
 
 
 void Usage() {
-    std::cerr << "Usage: " << ::progname << " log_file_input summary_output\n";
+    std::cerr << "Usage: " << ::progname << " [--thread-count=n] log_file_input summary_output\n"
+              << "       Gzip-compressed log files, e.g. rotated ones, are recognised by their \".gz\" extension.\n"
+              << "       If no thread count has been specified, we use one thread per core.\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -81,42 +90,195 @@ bool LineAndFrequencyCompare(const std::pair<std::string, unsigned> &line_and_fr
 }
 
 
-void SummarizeLog(File * const log_file, File * const summary_file) {
-    std::string err_msg;
-    RegexMatcher * const matcher(RegexMatcher::RegexMatcherFactory("((?:DEBUG|INFO|WARN|SEVERE).*$)", &err_msg));
-    if (matcher == nullptr)
-        logger->error("in SummarizeLog: failed to compile regex: " + err_msg);
-    RegexMatcher * const datetime_matcher(RegexMatcher::RegexMatcherFactory(
-        "^\\d{4}-\\d{2}-\\d{2} \\d{2}:\\d{2}:\\d{]2}", &err_msg));
-    if (matcher == nullptr)
-        logger->error("in SummarizeLog: failed to compile datetime regex: " + err_msg);
+// Either a read-only mapping of a plain log file or the decompressed contents of a gzipped one.
+class LogContents {
+    void *mapping_;
+    size_t mapping_size_;
+    std::string decompressed_contents_;
+public:
+    explicit LogContents(const std::string &path);
+    ~LogContents() { if (mapping_ != nullptr) ::munmap(mapping_, mapping_size_); }
 
-    std::unordered_map<std::string, unsigned> lines_and_frequencies;
-    std::string max_datetime(SqlUtil::DATETIME_RANGE_MIN), min_datetime(SqlUtil::DATETIME_RANGE_MAX);   // intentionally swapped
-    while (not log_file->eof()) {
-        std::string line;
-        if (unlikely(log_file->getline(&line) == 0))
+    inline const char *begin() const
+        { return (mapping_ != nullptr) ? reinterpret_cast<const char *>(mapping_) : decompressed_contents_.data(); }
+    inline const char *end() const { return begin() + size(); }
+    inline size_t size() const { return (mapping_ != nullptr) ? mapping_size_ : decompressed_contents_.size(); }
+private:
+    LogContents(const LogContents &) = delete;
+    LogContents &operator=(const LogContents &) = delete;
+};
+
+
+LogContents::LogContents(const std::string &path): mapping_(nullptr), mapping_size_(0) {
+    if (StringUtil::EndsWith(path, ".gz")) {
+        const gzFile gz_file(::gzopen(path.c_str(), "rb"));
+        if (unlikely(gz_file == nullptr))
+            logger->error("in LogContents::LogContents: failed to open \"" + path + "\" for reading!");
+        ::gzbuffer(gz_file, 128 * 1024);
+
+        char buffer[128 * 1024];
+        int count;
+        while ((count = ::gzread(gz_file, buffer, sizeof buffer)) > 0)
+            decompressed_contents_.append(buffer, count);
+        if (unlikely(count < 0)) {
+            int error_code;
+            const std::string error_message(::gzerror(gz_file, &error_code));
+            logger->error("in LogContents::LogContents: failed to decompress \"" + path + "\": " + error_message);
+        }
+        ::gzclose(gz_file);
+        return;
+    }
+
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (unlikely(fd == -1))
+        logger->error("in LogContents::LogContents: failed to open \"" + path + "\" for reading!");
+    struct stat stat_buf;
+    if (unlikely(::fstat(fd, &stat_buf) != 0))
+        logger->error("in LogContents::LogContents: failed to fstat(2) \"" + path + "\"!");
+
+    if (stat_buf.st_size > 0) { // mmap(2) fails for empty files.
+        mapping_ = ::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (unlikely(mapping_ == MAP_FAILED))
+            logger->error("in LogContents::LogContents: failed to mmap(2) \"" + path + "\"!");
+        mapping_size_ = stat_buf.st_size;
+        ::madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+}
+
+
+// The aggregates of a range of complete lines.
+struct ChunkSummary {
+    std::unordered_map<std::string, unsigned> lines_and_frequencies_;
+    std::string min_datetime_, max_datetime_;
+    std::vector<std::string> unmatched_lines_;
+public:
+    ChunkSummary(): min_datetime_(SqlUtil::DATETIME_RANGE_MAX), max_datetime_(SqlUtil::DATETIME_RANGE_MIN) { } // intentionally swapped
+};
+
+
+// \return The start of the leftmost logging level keyword in [line_start, line_end) or nullptr if there is none.
+// \note   We only compare the remaining characters if the first one could start a keyword.
+const char *FindLoggingLevel(const char *line_start, const char * const line_end) {
+    for (/* Intentionally empty! */; line_start < line_end; ++line_start) {
+        const size_t remaining(line_end - line_start);
+        switch (*line_start) {
+        case 'D':
+            if (remaining >= __builtin_strlen("DEBUG") and std::memcmp(line_start, "DEBUG", __builtin_strlen("DEBUG")) == 0)
+                return line_start;
+            break;
+        case 'I':
+            if (remaining >= __builtin_strlen("INFO") and std::memcmp(line_start, "INFO", __builtin_strlen("INFO")) == 0)
+                return line_start;
+            break;
+        case 'W':
+            if (remaining >= __builtin_strlen("WARN") and std::memcmp(line_start, "WARN", __builtin_strlen("WARN")) == 0)
+                return line_start;
+            break;
+        case 'S':
+            if (remaining >= __builtin_strlen("SEVERE") and std::memcmp(line_start, "SEVERE", __builtin_strlen("SEVERE")) == 0)
+                return line_start;
+            break;
+        }
+    }
+
+    return nullptr;
+}
+
+
+// \return True if the line starts w/ "YYYY-MM-DD hh:mm:ss".
+bool StartsWithDatetime(const char * const line_start, const char * const line_end) {
+    static const char PATTERN[] = "dddd-dd-dd dd:dd:dd";
+    if (line_end - line_start < static_cast<ptrdiff_t>(sizeof(PATTERN) - 1))
+        return false;
+
+    for (size_t i(0); i < sizeof(PATTERN) - 1; ++i) {
+        if (PATTERN[i] == 'd' ? not std::isdigit(static_cast<unsigned char>(line_start[i])) : line_start[i] != PATTERN[i])
+            return false;
+    }
+
+    return true;
+}
+
+
+void SummarizeChunk(const char *chunk_start, const char * const chunk_end, ChunkSummary * const chunk_summary) {
+    while (chunk_start < chunk_end) {
+        const char *line_end(reinterpret_cast<const char *>(std::memchr(chunk_start, '\n', chunk_end - chunk_start)));
+        if (line_end == nullptr)
+            line_end = chunk_end;
+        const char * const line_start(chunk_start);
+        chunk_start = line_end + 1;
+        if (unlikely(line_start == line_end))
             continue;
 
-        if (not matcher->matched(line)) {
-            logger->warning("in SummarizeLog: failed to match line: " + line);
+        const char * const logging_level(FindLoggingLevel(line_start, line_end));
+        if (logging_level == nullptr) {
+            chunk_summary->unmatched_lines_.emplace_back(line_start, line_end);
             continue;
         }
 
-        if (datetime_matcher->matched(line)) {
-            const std::string datetime(line.substr(0, 16));
-            if (datetime > max_datetime)
-                max_datetime = datetime;
-            if (datetime < min_datetime)
-                min_datetime = datetime;
+        if (StartsWithDatetime(line_start, line_end)) {
+            const std::string datetime(line_start, 16);
+            if (datetime > chunk_summary->max_datetime_)
+                chunk_summary->max_datetime_ = datetime;
+            if (datetime < chunk_summary->min_datetime_)
+                chunk_summary->min_datetime_ = datetime;
         }
 
-        const std::string summary((*matcher)[1]);
-        auto line_and_count(lines_and_frequencies.find(summary));
-        if (line_and_count == lines_and_frequencies.end())
-            lines_and_frequencies[summary] = 1;
-        else
-            ++lines_and_frequencies[summary];
+        ++chunk_summary->lines_and_frequencies_[std::string(logging_level, line_end)];
+    }
+}
+
+
+// Splits the log into about 4 chunks per thread.  All chunks, except maybe the last one, end at a newline.
+std::vector<std::pair<const char *, const char *>> SplitAtLineBoundaries(const LogContents &log_contents,
+                                                                        const unsigned thread_count)
+{
+    std::vector<std::pair<const char *, const char *>> chunks;
+    const size_t target_chunk_size(std::max(log_contents.size() / (4 * thread_count), static_cast<size_t>(1024 * 1024)));
+    const char *chunk_start(log_contents.begin());
+    while (chunk_start < log_contents.end()) {
+        const char *chunk_end(chunk_start + std::min(target_chunk_size, static_cast<size_t>(log_contents.end() - chunk_start)));
+        const char * const newline(reinterpret_cast<const char *>(std::memchr(chunk_end - 1, '\n', log_contents.end() - chunk_end + 1)));
+        chunk_end = (newline == nullptr) ? log_contents.end() : newline + 1;
+        chunks.emplace_back(chunk_start, chunk_end);
+        chunk_start = chunk_end;
+    }
+
+    return chunks;
+}
+
+
+void SummarizeLog(const std::string &log_path, File * const summary_file, const unsigned thread_count) {
+    const LogContents log_contents(log_path);
+
+    ThreadPool thread_pool(thread_count);
+    const auto chunks(SplitAtLineBoundaries(log_contents, thread_pool.size()));
+    std::vector<ChunkSummary> chunk_summaries(chunks.size());
+    thread_pool.parallelFor(0, chunks.size(), [&chunks, &chunk_summaries](const size_t chunk_index) {
+                                SummarizeChunk(chunks[chunk_index].first, chunks[chunk_index].second,
+                                               &chunk_summaries[chunk_index]);
+                            }, /* chunk_size = */ 1);
+
+    // Merge the per-chunk aggregates in log order:
+    std::unordered_map<std::string, unsigned> lines_and_frequencies;
+    std::string max_datetime(SqlUtil::DATETIME_RANGE_MIN), min_datetime(SqlUtil::DATETIME_RANGE_MAX);   // intentionally swapped
+    for (auto &chunk_summary : chunk_summaries) {
+        for (const auto &unmatched_line : chunk_summary.unmatched_lines_)
+            logger->warning("in SummarizeLog: failed to match line: " + unmatched_line);
+
+        if (chunk_summary.max_datetime_ > max_datetime)
+            max_datetime = chunk_summary.max_datetime_;
+        if (chunk_summary.min_datetime_ < min_datetime)
+            min_datetime = chunk_summary.min_datetime_;
+
+        if (lines_and_frequencies.empty())
+            lines_and_frequencies.swap(chunk_summary.lines_and_frequencies_);
+        else {
+            for (const auto &line_and_frequency : chunk_summary.lines_and_frequencies_)
+                lines_and_frequencies[line_and_frequency.first] += line_and_frequency.second;
+        }
+        chunk_summary.lines_and_frequencies_.clear();
     }
 
     std::vector<std::pair<std::string, unsigned>> lines_and_frequencies_as_vector;
@@ -128,7 +290,7 @@ void SummarizeLog(File * const log_file, File * const summary_file) {
     std::sort(lines_and_frequencies_as_vector.begin(), lines_and_frequencies_as_vector.end(),
               LineAndFrequencyCompare);
 
-    *summary_file << "Summary of " << log_file->getPath();
+    *summary_file << "Summary of " << log_path;
     if (max_datetime != SqlUtil::DATETIME_RANGE_MIN or min_datetime != SqlUtil::DATETIME_RANGE_MAX)     // intentionally swapped
         *summary_file << " between " << min_datetime << " and " << max_datetime;
     *summary_file << ":\n";
@@ -142,14 +304,20 @@ void SummarizeLog(File * const log_file, File * const summary_file) {
 int main(int argc, char **argv) {
     ::progname = argv[0];
 
+    unsigned thread_count(0);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--thread-count=")) {
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--thread-count="), &thread_count) or thread_count == 0)
+            logger->error("bad thread count: " + std::string(argv[1]));
+        --argc, ++argv;
+    }
+
     if (argc != 3)
         Usage();
 
-    std::unique_ptr<File> log_file(FileUtil::OpenInputFileOrDie(argv[1]));
     std::unique_ptr<File> summary_file(FileUtil::OpenOutputFileOrDie(argv[2]));
 
     try {
-        SummarizeLog(log_file.get(), summary_file.get());
+        SummarizeLog(argv[1], summary_file.get(), thread_count);
     } catch (const std::exception &x) {
         logger->error("caught exception: " + std::string(x.what()));
     }
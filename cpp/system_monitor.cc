@@ -17,16 +17,21 @@
  *  You should have received a copy of the GNU Affero General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <functional>
 #include <iostream>
+#include <map>
+#include <unordered_map>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
-#include <unordered_map>
-#include "BinaryIO.h"
 #include "FileUtil.h"
 #include "IniFile.h"
 #include "SignalUtil.h"
 #include "StringUtil.h"
+#include "SystemMonitorRingBuffer.h"
 #include "TimeUtil.h"
 #include "UBTools.h"
 #include "util.h"
@@ -58,84 +63,412 @@ void CheckForSigTermAndExitIfSeen() {
 }
 
 
-// Logs entries are written in the following binary format:
-// <timestamp:4 bytes><ordinal:1 byte><value:4 bytes>
-void WriteLogEntryToFile(const time_t timestamp, const uint8_t ordinal, const uint32_t value, File * const output_file) {
-    // the timestamp is truncated to a 32-bit value before serialisation, will break in 2038
-    const int32_t truncated_timestamp(static_cast<int32_t>(timestamp));
-    BinaryIO::WriteOrDie(*output_file, truncated_timestamp);
-    BinaryIO::WriteOrDie(*output_file, ordinal);
-    BinaryIO::WriteOrDie(*output_file, value);
+typedef std::vector<SystemMonitorRingBuffer::Sample> Samples;
+
+
+int OpenProcFileOrDie(const std::string &path) {
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (unlikely(fd == -1))
+        LOG_ERROR("failed to open \"" + path + "\"!");
+    return fd;
 }
 
 
-void CollectCPUStats(File * const log, const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map) {
-    static auto proc_meminfo(FileUtil::OpenInputFileOrDie("/proc/stat"));
-    const auto current_time(std::time(nullptr));
+// Reads the current contents of a /proc or /sys file w/o reopening or rewinding it.
+// \return The NUL-terminated contents or nullptr if the file has vanished, e.g. because a process has exited.
+const char *ReadProcFile(const int fd, char * const buffer, const size_t buffer_size) {
+    const ssize_t size(::pread(fd, buffer, buffer_size - 1, 0));
+    if (size == -1)
+        return nullptr;
+    buffer[size] = '\0';
+    return buffer;
+}
+
+
+const char *ReadProcFileOrDie(const int fd, char * const buffer, const size_t buffer_size, const std::string &path) {
+    const char * const contents(ReadProcFile(fd, buffer, buffer_size));
+    if (unlikely(contents == nullptr))
+        LOG_ERROR("failed to read \"" + path + "\"!");
+    return contents;
+}
+
+
+// Skips any whitespace and then parses an unsigned decimal number, advancing "cp" past it.
+inline uint64_t ParseUnsigned(const char **cp) {
+    char *end;
+    const uint64_t number(std::strtoull(*cp, &end, 10));
+    *cp = end;
+    return number;
+}
+
+
+void CollectCPUStats(const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map, Samples * const samples) {
+    static const int proc_stat(OpenProcFileOrDie("/proc/stat"));
     static uint64_t last_total, last_idle;
-    std::string line;
-    while (proc_meminfo->getline(&line) > 0) {
-        if (StringUtil::StartsWith(line, "cpu ")) {
-            std::vector<std::string> parts;
-            StringUtil::Split(line, ' ', &parts, /* suppress_empty_components = */true);
-            uint64_t total(0), idle(StringUtil::ToUInt64T(parts[4]));
-            for (unsigned i(1); i < parts.size(); ++i)
-                total += StringUtil::ToUInt64T(parts[i]);
-            const uint64_t diff_idle(idle - last_idle);
-            const uint64_t diff_total(total - last_total);
-            const uint64_t diff_usage((1000ull * (diff_total - diff_idle) / diff_total + 5) / 10ull);
-            WriteLogEntryToFile(current_time, label_to_ordinal_map.at("CPU"), diff_usage, log);
-            log->flush();
-            last_total = total;
-            last_idle = idle;
-            return;
-        }
+
+    // We only need the first line, which is the sum over all CPUs, so a small buffer suffices even on large machines.
+    char buffer[1024];
+    const char *cp(ReadProcFileOrDie(proc_stat, buffer, sizeof buffer, "/proc/stat"));
+    if (unlikely(std::strncmp(cp, "cpu ", 4) != 0))
+        LOG_ERROR("unexpected contents of /proc/stat!");
+    cp += 4;
+
+    uint64_t total(0), idle(0);
+    for (unsigned column(1); *cp != '\n' and *cp != '\0'; ++column) {
+        const uint64_t ticks(ParseUnsigned(&cp));
+        total += ticks;
+        if (column == 4)
+            idle = ticks;
+    }
+
+    const uint64_t diff_idle(idle - last_idle);
+    const uint64_t diff_total(total - last_total);
+    if (diff_total > 0) {
+        const uint64_t diff_usage((1000ull * (diff_total - diff_idle) / diff_total + 5) / 10ull);
+        samples->emplace_back(std::time(nullptr), label_to_ordinal_map.at("CPU"), diff_usage);
+    }
+    last_total = total;
+    last_idle = idle;
+}
+
+
+void CollectMemoryStats(const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map, Samples * const samples) {
+    static const int proc_meminfo(OpenProcFileOrDie("/proc/meminfo"));
+
+    const auto current_time(std::time(nullptr));
+    char buffer[16384];
+    const char *line(ReadProcFileOrDie(proc_meminfo, buffer, sizeof buffer, "/proc/meminfo"));
+    while (*line != '\0') {
+        const char * const colon(std::strchr(line, ':'));
+        if (unlikely(colon == nullptr))
+            LOG_ERROR("missing colon in /proc/meminfo!");
+        const auto label_and_ordinal(label_to_ordinal_map.find(std::string(line, colon - line)));
+        const char *cp(colon + 1);
+        const uint64_t value(ParseUnsigned(&cp));
+        if (label_and_ordinal != label_to_ordinal_map.cend())
+            samples->emplace_back(current_time, label_and_ordinal->second, value);
+
+        const char * const newline(std::strchr(cp, '\n'));
+        if (newline == nullptr)
+            break;
+        line = newline + 1;
     }
 }
 
 
-void CollectMemoryStats(File * const log, const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map) {
-    static const auto proc_meminfo(FileUtil::OpenInputFileOrDie("/proc/meminfo"));
+void CollectDiscStats(const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map, Samples * const samples) {
+    // We open the size files of the block devices only once.  Devices that appear later are only picked up after a restart.
+    static std::vector<std::pair<uint8_t, int>> ordinals_and_fds;
+    static bool initialised(false);
+    if (not initialised) {
+        FileUtil::Directory directory("/sys/block", "sd?");
+        for (const auto &entry : directory) {
+            if (label_to_ordinal_map.find(entry.getName()) == label_to_ordinal_map.end())
+                LOG_ERROR("hard disk partition '" + entry.getName() + "' does not have an ordinal");
+            ordinals_and_fds.emplace_back(label_to_ordinal_map.at(entry.getName()),
+                                          OpenProcFileOrDie("/sys/block/" + entry.getName() + "/size"));
+        }
+        initialised = true;
+    }
 
     const auto current_time(std::time(nullptr));
-    std::string line;
-    while (proc_meminfo->getline(&line) > 0) {
-        const auto first_colon_pos(line.find(':'));
-        if (unlikely(first_colon_pos == std::string::npos))
-            LOG_ERROR("missing colon in \"" + line + "\"!");
-        const auto label(line.substr(0, first_colon_pos));
-        if (label_to_ordinal_map.find(label) == label_to_ordinal_map.cend())
+    for (const auto &ordinal_and_fd : ordinals_and_fds) {
+        char buffer[64];
+        const char *cp(ReadProcFile(ordinal_and_fd.second, buffer, sizeof buffer));
+        if (unlikely(cp == nullptr))
             continue;
+        const auto free_space(ParseUnsigned(&cp) * 512 / 1024); // in kilobytes
+        samples->emplace_back(current_time, ordinal_and_fd.first, free_space);
+    }
+}
 
-        auto rest(StringUtil::LeftTrim(line.substr(first_colon_pos + 1)));
-        const auto first_space_pos(rest.find(' '));
-        if (first_space_pos != std::string::npos)
-            rest = rest.substr(0, first_space_pos);
 
-        WriteLogEntryToFile(current_time, label_to_ordinal_map.at(label), StringUtil::ToUnsigned(rest), log);
+/** \class ProcessSampler
+ *  \brief Samples the resident set size, the CPU usage and the I/O throughput of all instances of a set of programs.
+ *  \note  For each program four consecutive ordinals starting w/ the configured one are used: the summed RSS in kB,
+ *         the summed CPU usage in percent of a single CPU and the summed read and write throughputs in kB/s.
+ */
+class ProcessSampler {
+    struct Program {
+        std::string name_; // Truncated to the length of what the kernel reports in /proc/<pid>/comm.
+        uint8_t base_ordinal_;
+        uint64_t rss_in_kb_, cpu_ticks_, read_bytes_, write_bytes_;
+    };
+
+    struct Process {
+        int program_index_; // -1 if this process is not an instance of one of our programs.
+        int stat_fd_, io_fd_;
+        uint64_t cpu_ticks_, read_bytes_, write_bytes_;
+        bool seen_;
+    };
+
+    std::vector<Program> programs_;
+    std::unordered_map<pid_t, Process> pids_to_processes_;
+    const long ticks_per_second_, page_size_in_kb_;
+    time_t last_sample_time_;
+public:
+    explicit ProcessSampler(const IniFile::Section &monitored_processes);
+    ~ProcessSampler();
+
+    void sample(Samples * const samples);
+private:
+    void addProcess(const pid_t pid);
+
+    /** \param is_new_process  If true, we only record the process' current CPU and I/O totals so that only what
+     *                         happens from now on will be attributed to later intervals.
+     */
+    void sampleProcess(Process * const process, const bool is_new_process);
+    void removeProcess(const std::unordered_map<pid_t, Process>::iterator pid_and_process);
+};
+
+
+ProcessSampler::ProcessSampler(const IniFile::Section &monitored_processes)
+    : ticks_per_second_(::sysconf(_SC_CLK_TCK)), page_size_in_kb_(::sysconf(_SC_PAGESIZE) / 1024), last_sample_time_(0)
+{
+    static constexpr size_t MAX_COMM_LENGTH(15);
+    for (const auto &entry : monitored_processes) {
+        if (entry.name_.empty())
+            continue;
+        const unsigned base_ordinal(StringUtil::ToUnsigned(entry.value_));
+        if (unlikely(base_ordinal > 255 - 3))
+            LOG_ERROR("the ordinal of monitored process \"" + entry.name_ + "\" must not exceed 252!");
+        programs_.emplace_back(Program{ entry.name_.substr(0, MAX_COMM_LENGTH), static_cast<uint8_t>(base_ordinal), 0, 0, 0, 0 });
     }
-    log->flush();
+}
+
 
-    proc_meminfo->rewind();
+ProcessSampler::~ProcessSampler() {
+    while (not pids_to_processes_.empty())
+        removeProcess(pids_to_processes_.begin());
 }
 
 
-void CollectDiscStats(File * const log, const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map) {
-    const auto current_time(std::time(nullptr));
-    FileUtil::Directory directory("/sys/block", "sd?");
-    for (const auto &entry : directory) {
-        if (label_to_ordinal_map.find(entry.getName()) == label_to_ordinal_map.end())
-            LOG_ERROR("hard disk partition '" + entry.getName() + "' does not have an ordinal");
+void ProcessSampler::sample(Samples * const samples) {
+    if (programs_.empty())
+        return;
+
+    for (auto &pid_and_process : pids_to_processes_)
+        pid_and_process.second.seen_ = false;
+    for (auto &program : programs_)
+        program.rss_in_kb_ = program.cpu_ticks_ = program.read_bytes_ = program.write_bytes_ = 0;
 
-        const auto block_device_path("/sys/block/" + entry.getName() + "/size");
-        const auto proc_entry(FileUtil::OpenInputFileOrDie(block_device_path));
-        std::string line;
-        proc_entry->getline(&line);
-        const auto free_space(StringUtil::ToUnsignedLong(line) * 512 / 1024);   // in kilobytes
+    DIR * const proc_dir(::opendir("/proc"));
+    if (unlikely(proc_dir == nullptr))
+        LOG_ERROR("failed to open /proc!");
+    struct dirent *entry;
+    while ((entry = ::readdir(proc_dir)) != nullptr) {
+        if (not StringUtil::IsDigit(entry->d_name[0]))
+            continue;
+        const pid_t pid(std::atoi(entry->d_name));
+        auto pid_and_process(pids_to_processes_.find(pid));
+        bool is_new_process(false);
+        if (pid_and_process == pids_to_processes_.end()) {
+            addProcess(pid);
+            pid_and_process = pids_to_processes_.find(pid);
+            if (pid_and_process == pids_to_processes_.end())
+                continue; // The process has already exited.
+            is_new_process = true;
+        }
 
-        WriteLogEntryToFile(current_time, label_to_ordinal_map.at(entry.getName()), free_space, log);
+        pid_and_process->second.seen_ = true;
+        if (pid_and_process->second.program_index_ != -1)
+            sampleProcess(&pid_and_process->second, is_new_process);
+    }
+    ::closedir(proc_dir);
+
+    for (auto pid_and_process(pids_to_processes_.begin()); pid_and_process != pids_to_processes_.end();) {
+        const auto next(std::next(pid_and_process));
+        if (not pid_and_process->second.seen_)
+            removeProcess(pid_and_process);
+        pid_and_process = next;
+    }
+
+    const time_t current_time(std::time(nullptr));
+    const double elapsed_seconds(last_sample_time_ == 0 ? 0.0 : static_cast<double>(current_time - last_sample_time_));
+    last_sample_time_ = current_time;
+    if (elapsed_seconds <= 0.0)
+        return; // We need two samples to calculate rates.
+
+    for (const auto &program : programs_) {
+        samples->emplace_back(current_time, program.base_ordinal_, program.rss_in_kb_);
+        samples->emplace_back(current_time, program.base_ordinal_ + 1,
+                              static_cast<uint32_t>(100.0 * program.cpu_ticks_ / ticks_per_second_ / elapsed_seconds + 0.5));
+        samples->emplace_back(current_time, program.base_ordinal_ + 2, static_cast<uint32_t>(program.read_bytes_ / 1024.0 / elapsed_seconds));
+        samples->emplace_back(current_time, program.base_ordinal_ + 3, static_cast<uint32_t>(program.write_bytes_ / 1024.0 / elapsed_seconds));
+    }
+}
+
+
+void ProcessSampler::addProcess(const pid_t pid) {
+    const std::string proc_dir("/proc/" + std::to_string(pid) + "/");
+    std::string comm;
+    if (not FileUtil::ReadString(proc_dir + "comm", &comm))
+        return;
+    StringUtil::RightTrim(&comm, '\n');
+
+    Process process{ -1, -1, -1, 0, 0, 0, true };
+    for (unsigned program_index(0); program_index < programs_.size(); ++program_index) {
+        if (programs_[program_index].name_ == comm) {
+            process.program_index_ = program_index;
+            break;
+        }
+    }
+
+    if (process.program_index_ != -1) {
+        process.stat_fd_ = ::open((proc_dir + "stat").c_str(), O_RDONLY | O_CLOEXEC);
+        process.io_fd_ = ::open((proc_dir + "io").c_str(), O_RDONLY | O_CLOEXEC);
+        if (process.stat_fd_ == -1) {
+            if (process.io_fd_ != -1)
+                ::close(process.io_fd_);
+            return;
+        }
+    }
+
+    pids_to_processes_.emplace(pid, process);
+}
+
+
+void ProcessSampler::sampleProcess(Process * const process, const bool is_new_process) {
+    Program &program(programs_[process->program_index_]);
+
+    char buffer[4096];
+    const char *cp(ReadProcFile(process->stat_fd_, buffer, sizeof buffer));
+    if (cp == nullptr)
+        return;
+
+    // The second field is the parenthesised command name which may contain spaces, so we start after it:
+    cp = std::strrchr(cp, ')');
+    if (unlikely(cp == nullptr))
+        return;
+    ++cp;
+    uint64_t cpu_ticks(0), rss_in_pages(0);
+    for (unsigned field_no(3); field_no <= 24 and *cp != '\0'; ++field_no) {
+        while (*cp == ' ')
+            ++cp;
+        if (field_no == 14 or field_no == 15) // utime and stime
+            cpu_ticks += ParseUnsigned(&cp);
+        else if (field_no == 24)
+            rss_in_pages = ParseUnsigned(&cp);
+        else {
+            while (*cp != ' ' and *cp != '\0')
+                ++cp;
+        }
+    }
+    program.rss_in_kb_ += rss_in_pages * page_size_in_kb_;
+    if (not is_new_process)
+        program.cpu_ticks_ += cpu_ticks - process->cpu_ticks_;
+    process->cpu_ticks_ = cpu_ticks;
+
+    if (process->io_fd_ == -1 or (cp = ReadProcFile(process->io_fd_, buffer, sizeof buffer)) == nullptr)
+        return;
+    const char *read_bytes(std::strstr(cp, "\nread_bytes:")), *write_bytes(std::strstr(cp, "\nwrite_bytes:"));
+    if (read_bytes != nullptr) {
+        read_bytes += std::strlen("\nread_bytes:");
+        const uint64_t bytes(ParseUnsigned(&read_bytes));
+        if (not is_new_process)
+            program.read_bytes_ += bytes - process->read_bytes_;
+        process->read_bytes_ = bytes;
+    }
+    if (write_bytes != nullptr) {
+        write_bytes += std::strlen("\nwrite_bytes:");
+        const uint64_t bytes(ParseUnsigned(&write_bytes));
+        if (not is_new_process)
+            program.write_bytes_ += bytes - process->write_bytes_;
+        process->write_bytes_ = bytes;
+    }
+}
+
+
+void ProcessSampler::removeProcess(const std::unordered_map<pid_t, Process>::iterator pid_and_process) {
+    if (pid_and_process->second.stat_fd_ != -1)
+        ::close(pid_and_process->second.stat_fd_);
+    if (pid_and_process->second.io_fd_ != -1)
+        ::close(pid_and_process->second.io_fd_);
+    pids_to_processes_.erase(pid_and_process);
+}
+
+
+/** \class Summariser
+ *  \brief Maintains a ring buffer w/ the minimum, maximum and average of each metric over fixed intervals so that
+ *         system_monitor_viewer can render long time ranges w/o having to read all samples.
+ */
+class Summariser {
+    struct Accumulator {
+        uint32_t minimum_, maximum_;
+        uint64_t sum_;
+        uint32_t count_;
+    public:
+        explicit Accumulator(const uint32_t value): minimum_(value), maximum_(value), sum_(value), count_(1) { }
+    };
+
+    const unsigned interval_; // in seconds
+    SystemMonitorRingBuffer summaries_;
+    uint32_t current_interval_start_;
+    std::map<uint8_t, Accumulator> ordinals_to_accumulators_;
+    std::vector<SystemMonitorRingBuffer::Summary> completed_summaries_;
+public:
+    /** \note Samples in "log_path" that are newer than the last existing summary get summarised right away.  This takes
+     *        care of samples that were collected before we were restarted or before summaries were introduced.
+     */
+    Summariser(const std::string &log_path, const std::string &summaries_path, const unsigned interval, const uint64_t capacity);
+    ~Summariser() = default;
+
+    void add(const Samples &samples);
+private:
+    void addSample(const SystemMonitorRingBuffer::Sample &sample);
+};
+
+
+Summariser::Summariser(const std::string &log_path, const std::string &summaries_path, const unsigned interval,
+                       const uint64_t capacity)
+    : interval_(interval), summaries_(summaries_path, capacity, SystemMonitorRingBuffer::RecordType::SUMMARIES),
+      current_interval_start_(0)
+{
+    uint32_t first_unsummarised_timestamp(0);
+    if (summaries_.size() > 0) {
+        const SystemMonitorRingBuffer existing_summaries(summaries_path, SystemMonitorRingBuffer::RecordType::SUMMARIES);
+        first_unsummarised_timestamp = existing_summaries.getSummary(existing_summaries.size() - 1).timestamp_ + interval_;
+    }
+
+    const SystemMonitorRingBuffer log(log_path);
+    for (uint64_t index(log.lowerBound(first_unsummarised_timestamp)); index < log.size(); ++index)
+        addSample(log[index]);
+    summaries_.append(completed_summaries_);
+    completed_summaries_.clear();
+}
+
+
+void Summariser::add(const Samples &samples) {
+    for (const auto &sample : samples)
+        addSample(sample);
+    summaries_.append(completed_summaries_);
+    completed_summaries_.clear();
+}
+
+
+void Summariser::addSample(const SystemMonitorRingBuffer::Sample &sample) {
+    const uint32_t interval_start(sample.timestamp_ - sample.timestamp_ % interval_);
+    if (interval_start != current_interval_start_) {
+        for (const auto &ordinal_and_accumulator : ordinals_to_accumulators_) {
+            const Accumulator &accumulator(ordinal_and_accumulator.second);
+            completed_summaries_.emplace_back(current_interval_start_, ordinal_and_accumulator.first, accumulator.minimum_,
+                                              accumulator.maximum_,
+                                              static_cast<uint32_t>((accumulator.sum_ + accumulator.count_ / 2) / accumulator.count_));
+        }
+        ordinals_to_accumulators_.clear();
+        current_interval_start_ = interval_start;
+    }
+
+    const auto ordinal_and_accumulator(ordinals_to_accumulators_.find(sample.ordinal_));
+    if (ordinal_and_accumulator == ordinals_to_accumulators_.end())
+        ordinals_to_accumulators_.emplace(sample.ordinal_, Accumulator(sample.value_));
+    else {
+        Accumulator &accumulator(ordinal_and_accumulator->second);
+        accumulator.minimum_ = std::min(accumulator.minimum_, sample.value_);
+        accumulator.maximum_ = std::max(accumulator.maximum_, sample.value_);
+        accumulator.sum_ += sample.value_;
+        ++accumulator.count_;
     }
-    log->flush();
 }
 
 
@@ -155,13 +488,12 @@ bool IsAlreadyRunning(std::string * const pid_as_string) {
 }
 
 
-void CheckStats(const uint64_t ticks, const unsigned stats_interval,
-                void (*stats_func)(File * const, const std::unordered_map<std::string, uint8_t> &),
-                File * const log, const std::unordered_map<std::string, uint8_t> &label_to_ordinal_map)
+void CheckStats(const uint64_t ticks, const unsigned stats_interval, const std::function<void(Samples * const)> &stats_func,
+                Samples * const samples)
 {
     if ((ticks % stats_interval) == 0) {
         SignalUtil::SignalBlocker sighup_blocker(SIGHUP);
-        stats_func(log, label_to_ordinal_map);
+        stats_func(samples);
     }
     CheckForSigTermAndExitIfSeen();
 }
@@ -193,6 +525,10 @@ int Main(int argc, char *argv[]) {
     const unsigned memory_stats_interval(ini_file.getUnsigned("", "memory_stats_interval"));
     const unsigned disc_stats_interval(ini_file.getUnsigned("", "disc_stats_interval"));
     const unsigned cpu_stats_interval(ini_file.getUnsigned("", "cpu_stats_interval"));
+    const unsigned process_stats_interval(ini_file.getUnsigned("", "process_stats_interval", 5));
+    const uint64_t ring_buffer_capacity(ini_file.getUint64T("", "ring_buffer_capacity", 10 * 1000 * 1000));
+    const uint64_t minute_summaries_capacity(ini_file.getUint64T("", "minute_summaries_capacity", 5 * 1000 * 1000));
+    const uint64_t hour_summaries_capacity(ini_file.getUint64T("", "hour_summaries_capacity", 1000 * 1000));
 
     std::unordered_map<std::string, uint8_t> label_to_ordinal_map;
     for (const auto &entry : *ini_file.getSection("Label Ordinals")) {
@@ -204,6 +540,9 @@ int Main(int argc, char *argv[]) {
         label_to_ordinal_map[entry.name_] = StringUtil::ToUnsigned(entry.value_);
     }
 
+    const auto monitored_processes(ini_file.getSection("Monitored Processes"));
+    ProcessSampler process_sampler(monitored_processes == ini_file.end() ? IniFile::Section("") : *monitored_processes);
+
     if (not foreground) {
         SignalUtil::InstallHandler(SIGTERM, SigTermHandler);
 
@@ -213,13 +552,35 @@ int Main(int argc, char *argv[]) {
     if (not FileUtil::WriteString(PID_FILE, StringUtil::ToString(::getpid())))
         LOG_ERROR("failed to write our PID to " + PID_FILE + "!");
 
-    const auto log(FileUtil::OpenForAppendingOrDie(argv[1]));
+    // Logs in the old, unbounded format are moved out of the way.  system_monitor_viewer can still read them.
+    const std::string log_path(argv[1]);
+    if (FileUtil::Exists(log_path) and FileUtil::GetFileSize(log_path) > 0 and not SystemMonitorRingBuffer::IsRingBuffer(log_path)) {
+        LOG_WARNING("renaming \"" + log_path + "\" which uses the old log format to \"" + log_path + ".old\"");
+        FileUtil::RenameFileOrDie(log_path, log_path + ".old", /* remove_target = */true);
+    }
+    SystemMonitorRingBuffer log(log_path, ring_buffer_capacity);
+    Summariser minute_summariser(log_path, log_path + ".minutes", 60, minute_summaries_capacity);
+    Summariser hour_summariser(log_path, log_path + ".hours", 3600, hour_summaries_capacity);
 
+    Samples samples;
     uint64_t ticks(0);
     for (;;) {
-        CheckStats(ticks, memory_stats_interval, CollectMemoryStats, log.get(), label_to_ordinal_map);
-        CheckStats(ticks, disc_stats_interval, CollectDiscStats, log.get(), label_to_ordinal_map);
-        CheckStats(ticks, cpu_stats_interval, CollectCPUStats, log.get(), label_to_ordinal_map);
+        CheckStats(ticks, memory_stats_interval,
+                   [&label_to_ordinal_map](Samples * const new_samples) { CollectMemoryStats(label_to_ordinal_map, new_samples); },
+                   &samples);
+        CheckStats(ticks, disc_stats_interval,
+                   [&label_to_ordinal_map](Samples * const new_samples) { CollectDiscStats(label_to_ordinal_map, new_samples); },
+                   &samples);
+        CheckStats(ticks, cpu_stats_interval,
+                   [&label_to_ordinal_map](Samples * const new_samples) { CollectCPUStats(label_to_ordinal_map, new_samples); },
+                   &samples);
+        CheckStats(ticks, process_stats_interval,
+                   [&process_sampler](Samples * const new_samples) { process_sampler.sample(new_samples); }, &samples);
+
+        log.append(samples);
+        minute_summariser.add(samples);
+        hour_summariser.add(samples);
+        samples.clear();
 
         ::sleep(1);
         ++ticks;
@@ -26,6 +26,7 @@
 #include "IniFile.h"
 #include "MiscUtil.h"
 #include "StringUtil.h"
+#include "SystemMonitorRingBuffer.h"
 #include "TextUtil.h"
 #include "TimeUtil.h"
 #include "UBTools.h"
@@ -124,13 +125,79 @@ public:
 };
 
 
-void LoadSystemMonitorLog(const std::string &log_path, const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map,
-                          std::vector<Datapoint> * const data)
+const std::string &GetLabelOrDie(const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map, const uint8_t ordinal,
+                                 const uint64_t entry_num)
 {
-    static constexpr size_t DATA_INITIAL_SIZE(1000 * 1000);
+    const auto ordinal_and_label(ordinal_to_label_map.find(ordinal));
+    if (unlikely(ordinal_and_label == ordinal_to_label_map.end()))
+        LOG_ERROR("unknown ordinal " + std::to_string(ordinal) + " in log entry " + std::to_string(entry_num));
+    return ordinal_and_label->second;
+}
 
-    if (not FileUtil::Exists(log_path))
-        LOG_ERROR("log file '" + log_path + "' does not exist");
+
+// Only loads the samples that are in the time window [time_start, time_end].  If "time_end" is TimeUtil::BAD_TIME_T
+// we only load the samples for the first timestamp that is not before "time_start".
+void LoadSystemMonitorRingBuffer(const std::string &log_path, const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map,
+                                 const time_t time_start, const time_t time_end, std::vector<Datapoint> * const data)
+{
+    const SystemMonitorRingBuffer ring_buffer(log_path);
+    const uint64_t size(ring_buffer.size());
+    uint64_t index(ring_buffer.lowerBound(static_cast<uint32_t>(std::max<time_t>(time_start, 0))));
+    if (index == size)
+        return;
+
+    const time_t last_timestamp(time_end == TimeUtil::BAD_TIME_T ? ring_buffer[index].timestamp_ : time_end);
+    for (; index < size and ring_buffer[index].timestamp_ <= last_timestamp; ++index) {
+        const auto &sample(ring_buffer[index]);
+        data->emplace_back(GetLabelOrDie(ordinal_to_label_map, sample.ordinal_, index), static_cast<time_t>(sample.timestamp_),
+                           std::to_string(sample.value_));
+    }
+}
+
+
+// Loads the summaries that start in the time window [time_start, time_end].  The average gets the metric's label and the
+// extremes get the label w/ " min" and " max" appended.
+void LoadSystemMonitorSummaries(const std::string &summaries_path, const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map,
+                                const time_t time_start, const time_t time_end, std::vector<Datapoint> * const data)
+{
+    const SystemMonitorRingBuffer summaries(summaries_path, SystemMonitorRingBuffer::RecordType::SUMMARIES);
+    const uint64_t size(summaries.size());
+    for (uint64_t index(summaries.lowerBound(static_cast<uint32_t>(std::max<time_t>(time_start, 0))));
+         index < size and summaries.getSummary(index).timestamp_ <= time_end; ++index)
+    {
+        const auto &summary(summaries.getSummary(index));
+        const std::string &label(GetLabelOrDie(ordinal_to_label_map, summary.ordinal_, index));
+        const time_t timestamp(summary.timestamp_);
+        data->emplace_back(label, timestamp, std::to_string(summary.average_));
+        data->emplace_back(label + " min", timestamp, std::to_string(summary.minimum_));
+        data->emplace_back(label + " max", timestamp, std::to_string(summary.maximum_));
+    }
+}
+
+
+// \return The path of the coarsest summaries that still provide a reasonable number of points for the time window or
+//         the empty string if the raw samples should be used.
+std::string GetSummariesPath(const std::string &log_path, const time_t time_start, const time_t time_end) {
+    static constexpr time_t MIN_RANGE_FOR_MINUTE_SUMMARIES(6 * 3600);
+    static constexpr time_t MIN_RANGE_FOR_HOUR_SUMMARIES(7 * 24 * 3600);
+
+    if (time_end == TimeUtil::BAD_TIME_T)
+        return "";
+
+    const time_t range(time_end - time_start);
+    if (range >= MIN_RANGE_FOR_HOUR_SUMMARIES and FileUtil::Exists(log_path + ".hours"))
+        return log_path + ".hours";
+    if (range >= MIN_RANGE_FOR_MINUTE_SUMMARIES and FileUtil::Exists(log_path + ".minutes"))
+        return log_path + ".minutes";
+    return "";
+}
+
+
+// Loads logs in the original format, which was a sequence of unpadded samples of unbounded length.
+void LoadLegacySystemMonitorLog(const std::string &log_path, const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map,
+                                std::vector<Datapoint> * const data)
+{
+    static constexpr size_t DATA_INITIAL_SIZE(1000 * 1000);
 
     File log_file(log_path, "r");
     int entry_num(0);
@@ -156,14 +223,37 @@ void LoadSystemMonitorLog(const std::string &log_path, const std::unordered_map<
             continue;
         }
 
-        if (ordinal_to_label_map.find(ordinal) == ordinal_to_label_map.end())
-            LOG_ERROR("unknown ordinal " + std::to_string(ordinal) + " in log entry " + std::to_string(entry_num));
+        data->emplace_back(GetLabelOrDie(ordinal_to_label_map, ordinal, entry_num), static_cast<time_t>(timestamp),
+                           std::to_string(value));
+    }
+}
+
+
+// \return True if we loaded summaries, which provide minima and maxima in addition to averages, o/w false.
+bool LoadSystemMonitorLog(const std::string &log_path, const std::unordered_map<uint8_t, std::string> &ordinal_to_label_map,
+                          const time_t time_start, const time_t time_end, std::vector<Datapoint> * const data)
+{
+    if (not FileUtil::Exists(log_path))
+        LOG_ERROR("log file '" + log_path + "' does not exist");
 
-        data->emplace_back(ordinal_to_label_map.at(ordinal), static_cast<time_t>(timestamp), std::to_string(value));
+    bool loaded_summaries(false);
+    if (not SystemMonitorRingBuffer::IsRingBuffer(log_path))
+        LoadLegacySystemMonitorLog(log_path, ordinal_to_label_map, data);
+    else {
+        const std::string summaries_path(GetSummariesPath(log_path, time_start, time_end));
+        if (summaries_path.empty())
+            LoadSystemMonitorRingBuffer(log_path, ordinal_to_label_map, time_start, time_end, data);
+        else {
+            LOG_INFO("using the summaries in \"" + summaries_path + "\"");
+            LoadSystemMonitorSummaries(summaries_path, ordinal_to_label_map, time_start, time_end, data);
+            loaded_summaries = true;
+        }
     }
 
     // sort by timestamp
-    std::sort(data->begin(), data->end());
+    std::stable_sort(data->begin(), data->end());
+
+    return loaded_summaries;
 }
 
 
@@ -406,11 +496,30 @@ int Main(int argc, char *argv[]) {
             continue;
         ordinal_to_label_map[StringUtil::ToUnsigned(entry.value_)] = entry.name_;
     }
+    const auto monitored_processes(monitor_ini_file.getSection("Monitored Processes"));
+    if (monitored_processes != monitor_ini_file.end()) {
+        for (const auto &entry : *monitored_processes) {
+            if (entry.name_.empty())
+                continue;
+            const unsigned base_ordinal(StringUtil::ToUnsigned(entry.value_));
+            ordinal_to_label_map[base_ordinal]     = entry.name_ + " RSS";
+            ordinal_to_label_map[base_ordinal + 1] = entry.name_ + " CPU";
+            ordinal_to_label_map[base_ordinal + 2] = entry.name_ + " read";
+            ordinal_to_label_map[base_ordinal + 3] = entry.name_ + " write";
+        }
+    }
 
     std::vector<Datapoint> log_data;
     std::vector<Datapoint>::const_iterator data_range_start, data_range_end;
     TimeUnit time_window_unit;
-    LoadSystemMonitorLog(log_file, ordinal_to_label_map, &log_data);
+    if (LoadSystemMonitorLog(log_file, ordinal_to_label_map, time_start, time_end, &log_data)) {
+        // The extra columns come after the ones that the plotting scripts expect:
+        const size_t label_count(labels.size());
+        for (size_t i(0); i < label_count; ++i) {
+            labels.emplace_back(labels[i] + " min");
+            labels.emplace_back(labels[i] + " max");
+        }
+    }
     GetDataRange(time_start, time_end, log_data, &data_range_start, &data_range_end);
     CalculateBestTimeScale(data_range_start->timestamp_, data_range_end->timestamp_, &time_window_unit);
 
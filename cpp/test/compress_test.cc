@@ -8,7 +8,7 @@
 
 __attribute__((noreturn)) void Usage() {
     std::cerr << "usage: " << ::progname << " mode\n";
-    std::cerr << "       Where \"mode\" has to be either \"compress\" or \"decompress\".\n";
+    std::cerr << "       Where \"mode\" has to be either \"compress\", \"parallel_compress\" or \"decompress\".\n";
     std::cerr << "       Data is either read from (compress) or written to (decompress) stdout.\n";
     std::cerr << "       The compressed or uncompressed data is then written to stdout.\n";
     std::exit(EXIT_FAILURE);
@@ -30,6 +30,17 @@ void Compress() {
 }
 
 
+// Compresses stdin in chunks, i.e. w/o reading it all into memory first.
+void ParallelCompress() {
+    ParallelGzStream compressor(GzStream::COMPRESS, [](const char * const data, const size_t data_size) {
+                                                        std::cout.write(data, data_size); });
+    char chunk[64 * 1024];
+    while (std::cin.read(chunk, sizeof(chunk)) or std::cin.gcount() > 0)
+        compressor.write(chunk, static_cast<size_t>(std::cin.gcount()));
+    compressor.finish();
+}
+
+
 void Decompress() {
     const std::string compressed_data(SnarfUpStdin());
     std::cout << GzStream::DecompressString(compressed_data);
@@ -45,6 +56,8 @@ int main(int argc, char *argv[]) {
 
     if (mode == "compress")
         Compress();
+    else if (mode == "parallel_compress")
+        ParallelCompress();
     else if (mode == "decompress")
         Decompress();
     else
@@ -0,0 +1,37 @@
+/** Test harness for the ControlNumberIndex class.
+ */
+#include <iostream>
+#include <cstdlib>
+#include "ControlNumberGuesser.h"
+#include "ControlNumberIndex.h"
+#include "MARC.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "usage: " << ::progname << " marc_input index_path title\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int Main(int argc, char *argv[]) {
+    if (argc != 4)
+        Usage();
+
+    const auto reader(MARC::Reader::Factory(argv[1]));
+    std::cout << "Indexed " << ControlNumberIndex::Create(reader.get(), argv[2]) << " records.\n";
+
+    const ControlNumberIndex control_number_index(argv[2]);
+    std::cout << "Found " << control_number_index.size() << " distinct control numbers.\n";
+
+    const std::string normalised_title(ControlNumberGuesser::NormaliseTitle(argv[3]));
+    std::set<std::string> control_numbers;
+    control_number_index.lookup(ControlNumberIndex::TITLE, normalised_title, &control_numbers);
+    std::cout << "Exact matches for \"" << normalised_title << "\": " << StringUtil::Join(control_numbers, ", ") << '\n';
+
+    for (const auto &candidate : control_number_index.getTitleCandidates(normalised_title))
+        std::cout << candidate.similarity_ << '\t' << candidate.normalised_title_ << '\n';
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/** \file   download_batch_test.cc
+ *  \brief  Test harness for the DownloadBatch class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "DownloadBatch.h"
+#include "StringUtil.h"
+#include "util.h"
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--max-total-transfers=n] [--max-transfers-per-host=n] [--timeout=milli_seconds] "
+              << "url1 [url2 .. urlN]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    unsigned max_total_transfers(DownloadBatch::DEFAULT_MAX_TOTAL_TRANSFERS);
+    unsigned max_transfers_per_host(DownloadBatch::DEFAULT_MAX_TRANSFERS_PER_HOST);
+    unsigned timeout(Downloader::DEFAULT_TIME_LIMIT);
+    while (argc > 1 and StringUtil::StartsWith(argv[1], "--")) {
+        if (StringUtil::StartsWith(argv[1], "--max-total-transfers=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-total-transfers="), &max_total_transfers))
+                LOG_ERROR("bad maximum number of transfers!");
+        } else if (StringUtil::StartsWith(argv[1], "--max-transfers-per-host=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-transfers-per-host="), &max_transfers_per_host))
+                LOG_ERROR("bad maximum number of transfers per host!");
+        } else if (StringUtil::StartsWith(argv[1], "--timeout=")) {
+            if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--timeout="), &timeout))
+                LOG_ERROR("bad timeout!");
+        } else
+            Usage();
+        --argc, ++argv;
+    }
+    if (argc < 2)
+        Usage();
+
+    DownloadBatch download_batch(max_total_transfers, max_transfers_per_host);
+    for (int arg_no(1); arg_no < argc; ++arg_no)
+        download_batch.addUrl(argv[arg_no], Downloader::Params(), timeout);
+
+    DownloadBatch::Result result;
+    while (download_batch.getNextCompletion(&result)) {
+        std::cout << result.request_id_ << ' ' << result.url_;
+        if (result.anErrorOccurred())
+            std::cout << ": " << result.error_message_ << '\n';
+        else
+            std::cout << ": " << result.response_code_ << ", " << result.message_body_.length() << " bytes\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+/** \file   html_text_extraction_test.cc
+ *  \brief  Test harness for TextUtil::HtmlTextStreamExtractor.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "Downloader.h"
+#include "StringUtil.h"
+#include "TextUtil.h"
+#include "util.h"
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--max-text-size=n] [--http-header-charset=charset] url\n"
+              << "       The document will be handed to the extractor chunk by chunk as it is being downloaded.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    unsigned max_text_size(0);
+    if (StringUtil::StartsWith(argv[1], "--max-text-size=")) {
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-text-size="), &max_text_size))
+            LOG_ERROR("bad maximum text size!");
+        --argc, ++argv;
+    }
+
+    std::string http_header_charset;
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--http-header-charset=")) {
+        http_header_charset = argv[1] + __builtin_strlen("--http-header-charset=");
+        --argc, ++argv;
+    }
+
+    if (argc != 2)
+        Usage();
+
+    TextUtil::HtmlTextStreamExtractor extractor(http_header_charset, max_text_size);
+    Downloader::Params params;
+    size_t document_size(0);
+    params.body_chunk_callback_ = [&extractor, &document_size](const char * const data, const size_t size) {
+        document_size += size;
+        return extractor.feed(data, size);
+    };
+
+    Downloader downloader(params);
+    if (not downloader.newUrl(argv[1]) and not extractor.sizeLimitExceeded())
+        LOG_ERROR("failed to download \"" + std::string(argv[1]) + "\": " + downloader.getLastErrorMessage());
+
+    const std::string extracted_text(extractor.finish());
+    std::cout << extracted_text << '\n';
+    std::cerr << "Read " << document_size << " bytes w/ charset \"" << extractor.getCharset() << "\" and extracted "
+              << extracted_text.size() << " bytes of text" << (extractor.sizeLimitExceeded() ? " (size limit reached)" : "")
+              << ".\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+/** \brief A test harness for the JSON::Document class.
+ */
+#include <iostream>
+#include <cstdlib>
+#include "FileUtil.h"
+#include "JSON.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << ::progname << " json_input_file [json_pointer]\n";
+    std::cerr << "       Prints the document, or the value addressed by \"json_pointer\", as compact JSON.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char *argv[]) {
+    ::progname = argv[0];
+
+    if (argc != 2 and argc != 3)
+        Usage();
+
+    JSON::Document document;
+    if (not document.parse(FileUtil::ReadStringOrDie(argv[1]))) {
+        std::cout << "ERROR: " << document.getErrorMessage() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const JSON::Document::Value * const value(argc == 3 ? document.getRoot().lookup(argv[2]) : &document.getRoot());
+    if (value == nullptr) {
+        std::cout << "not found: " << argv[2] << '\n';
+        return EXIT_FAILURE;
+    }
+    std::cout << value->toString() << '\n';
+
+    return EXIT_SUCCESS;
+}
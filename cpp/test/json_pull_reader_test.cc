@@ -0,0 +1,83 @@
+/** \brief A test harness for the JSON::PullReader class.
+ */
+#include <iostream>
+#include <cstdlib>
+#include "JSON.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << ::progname << " json_input_file [path_pattern]\n";
+    std::cerr << "       If \"path_pattern\" has been specified, only the values at matching paths will be printed.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char *argv[]) {
+    ::progname = argv[0];
+
+    if (argc != 2 and argc != 3)
+        Usage();
+
+    const auto reader(JSON::PullReader::FromFile(argv[1]));
+    const std::string path_pattern(argc == 3 ? argv[2] : "");
+    for (;;) {
+        const JSON::PullReader::EventType event(reader->next());
+        if (event == JSON::PullReader::END_OF_INPUT)
+            return EXIT_SUCCESS;
+        if (event == JSON::PullReader::ERROR) {
+            std::cout << "ERROR: " << reader->getErrorMessage() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        if (not path_pattern.empty()) {
+            if (event != JSON::PullReader::KEY and event != JSON::PullReader::END_OBJECT
+                and event != JSON::PullReader::END_ARRAY and reader->pathMatches(path_pattern))
+            {
+                std::shared_ptr<JSON::JSONNode> value;
+                if (not reader->readValue(&value)) {
+                    std::cout << "ERROR: " << reader->getErrorMessage() << '\n';
+                    return EXIT_FAILURE;
+                }
+                std::cout << reader->getPath() << ": " << value->toString() << '\n';
+            }
+            continue;
+        }
+
+        std::cout << reader->getLineNumber() << ' ' << reader->getPath() << ": ";
+        switch (event) {
+        case JSON::PullReader::START_OBJECT:
+            std::cout << "START_OBJECT\n";
+            break;
+        case JSON::PullReader::END_OBJECT:
+            std::cout << "END_OBJECT\n";
+            break;
+        case JSON::PullReader::START_ARRAY:
+            std::cout << "START_ARRAY\n";
+            break;
+        case JSON::PullReader::END_ARRAY:
+            std::cout << "END_ARRAY\n";
+            break;
+        case JSON::PullReader::KEY:
+            std::cout << "key: " << reader->getString() << '\n';
+            break;
+        case JSON::PullReader::STRING_VALUE:
+            std::cout << "string: " << reader->getString() << '\n';
+            break;
+        case JSON::PullReader::INTEGER_VALUE:
+            std::cout << "integer: " << reader->getInteger() << '\n';
+            break;
+        case JSON::PullReader::DOUBLE_VALUE:
+            std::cout << "double: " << reader->getDouble() << '\n';
+            break;
+        case JSON::PullReader::BOOLEAN_VALUE:
+            std::cout << (reader->getBoolean() ? "true\n" : "false\n");
+            break;
+        case JSON::PullReader::NULL_VALUE:
+            std::cout << "null\n";
+            break;
+        default:
+            break;
+        }
+    }
+}
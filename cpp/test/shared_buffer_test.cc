@@ -2,30 +2,24 @@
 #include <mutex>
 #include <vector>
 #include <cstdlib>
-#include <pthread.h>
-#include <unistd.h>
 #include "SharedBuffer.h"
 #include "StringUtil.h"
-#include "ThreadManager.h"
+#include "ThreadPool.h"
 #include "util.h"
 
 
 std::mutex io_mutex;
 
 
-void *Consumer(void *shared_data) {
-    int old_state;
-    if (::pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state) != 0)
-        logger->error("consumer thread failed to enable cancelability!");
-
-    SharedBuffer<unsigned> * const shared_buffer(reinterpret_cast<SharedBuffer<unsigned> * const>(shared_data));
+// Prints numbers until it encounters a zero.
+void Consumer(SharedBuffer<unsigned> * const shared_buffer) {
     for (;;) {
         const unsigned u(shared_buffer->pop_front());
+        if (u == 0)
+            return;
         std::unique_lock<std::mutex> mutex_locker(io_mutex);
         std::cout << u << '\n';
     }
-
-    return nullptr;
 }
 
 
@@ -51,13 +45,16 @@ int main(int argc, char *argv[]) {
         Usage();
 
     SharedBuffer<unsigned> number_buffer(consumer_thread_count);
-    ThreadManager thread_manager(consumer_thread_count, Consumer, &number_buffer);
+    ThreadPool thread_pool(consumer_thread_count);
+    for (unsigned thread_no(0); thread_no < consumer_thread_count; ++thread_no)
+        thread_pool.submit([&number_buffer]{ Consumer(&number_buffer); });
 
     for (unsigned u(1); u <= number_count; ++u)
         number_buffer.push_back(u);
 
-    while (not number_buffer.empty())
-        ::sleep(1);
+    // One end marker per consumer.  The pool's destructor waits for the consumers to finish.
+    for (unsigned thread_no(0); thread_no < consumer_thread_count; ++thread_no)
+        number_buffer.push_back(0);
 }
 
 
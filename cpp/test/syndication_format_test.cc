@@ -0,0 +1,66 @@
+/** \file   syndication_format_test.cc
+ *  \brief  Test harness for the streaming parsing of RSS and Atom feeds.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "StringUtil.h"
+#include "SyndicationFormat.h"
+#include "TimeUtil.h"
+#include "util.h"
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--max-item-count=n] feed_url\n"
+              << "       If --max-item-count has been specified, we stop reading the feed after n items.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int Main(int argc, char *argv[]) {
+    if (argc < 2)
+        Usage();
+
+    unsigned max_item_count(0);
+    if (StringUtil::StartsWith(argv[1], "--max-item-count=")) {
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-item-count="), &max_item_count))
+            LOG_ERROR("bad maximum item count!");
+        --argc, ++argv;
+    }
+    if (argc != 2)
+        Usage();
+
+    std::string err_msg;
+    const auto syndication_format(SyndicationFormat::StreamingFactory(argv[1], Downloader::Params(), Downloader::DEFAULT_TIME_LIMIT,
+                                                                      SyndicationFormat::AugmentParams(), &err_msg));
+    if (syndication_format == nullptr)
+        LOG_ERROR("failed to download or parse the feed: " + err_msg);
+
+    std::cout << syndication_format->getFormatName() << ": " << syndication_format->getTitle() << '\n';
+    unsigned item_count(0);
+    for (const auto &item : *syndication_format) {
+        std::cout << '\t' << item.getTitle() << " (" << item.getLink() << ", "
+                  << TimeUtil::TimeTToString(item.getPubDate()) << ")\n";
+        if (++item_count == max_item_count)
+            break;
+    }
+    std::cout << "Read " << item_count << " item(s).\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/** \brief Test cases for CachingStemmer
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <thread>
+#include <vector>
+#include "UnitTest.h"
+#include "Stemmer.h"
+
+
+static const std::vector<std::string> WORDS{ "connections", "connected", "running", "runs", "happiness", "ponies",
+                                             "caresses", "generalizations" };
+
+
+TEST(MatchesStemmer) {
+    const Stemmer * const stemmer(Stemmer::StemmerFactory("en"));
+    const CachingStemmer caching_stemmer("en", /* max_cache_size = */3);
+    for (unsigned pass(0); pass < 3; ++pass) { // Hits as well as evictions.
+        for (const auto &word : WORDS)
+            CHECK_EQ(caching_stemmer.stem(word), stemmer->stem(word));
+    }
+}
+
+
+TEST(Factory) {
+    CHECK_TRUE(CachingStemmer::CachingStemmerFactory("xx") == nullptr);
+    const CachingStemmer * const stemmer(CachingStemmer::CachingStemmerFactory("de"));
+    CHECK_TRUE(stemmer != nullptr);
+    CHECK_TRUE(CachingStemmer::CachingStemmerFactory("de") == stemmer);
+    CHECK_EQ(stemmer->getLanguageNameOrCode(), "de");
+}
+
+
+TEST(ConcurrentUse) {
+    const Stemmer * const stemmer(Stemmer::StemmerFactory("en"));
+    std::vector<std::string> expected_stems;
+    for (const auto &word : WORDS)
+        expected_stems.emplace_back(stemmer->stem(word));
+
+    const CachingStemmer * const caching_stemmer(CachingStemmer::CachingStemmerFactory("en"));
+    std::vector<char> mismatches(4, false);
+    std::vector<std::thread> threads;
+    for (unsigned thread_no(0); thread_no < mismatches.size(); ++thread_no)
+        threads.emplace_back([&, thread_no]() {
+            for (unsigned iteration(0); iteration < 1000; ++iteration) {
+                const size_t word_no((iteration + thread_no) % WORDS.size());
+                if (caching_stemmer->stem(WORDS[word_no]) != expected_stems[word_no])
+                    mismatches[thread_no] = true;
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const auto mismatch : mismatches)
+        CHECK_TRUE(not mismatch);
+}
+
+
+TEST_MAIN(CachingStemmer)
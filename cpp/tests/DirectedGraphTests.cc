@@ -0,0 +1,97 @@
+/** \brief Test cases for DirectedGraph
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <vector>
+#include "DirectedGraph.h"
+#include "UnitTest.h"
+
+
+TEST(TopologicalSort) {
+    const DirectedGraph graph(5, { { 3, 1 }, { 1, 0 }, { 3, 0 }, { 4, 2 }, { 3, 1 } });
+    CHECK_EQ(graph.getEdgeCount(), 4u);
+
+    std::vector<DirectedGraph::NodeId> node_order, cycle;
+    CHECK_TRUE(graph.topologicalSort(&node_order, &cycle));
+    CHECK_EQ(node_order, std::vector<DirectedGraph::NodeId>({ 3, 1, 0, 4, 2 }));
+    CHECK_TRUE(cycle.empty());
+}
+
+
+TEST(Cycle) {
+    const DirectedGraph graph(4, { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 1 } });
+    std::vector<DirectedGraph::NodeId> node_order, cycle;
+    CHECK_TRUE(not graph.topologicalSort(&node_order, &cycle));
+    CHECK_EQ(node_order, std::vector<DirectedGraph::NodeId>({ 0 }));
+    CHECK_EQ(cycle, std::vector<DirectedGraph::NodeId>({ 1, 2, 3 }));
+}
+
+
+TEST(StronglyConnectedComponents) {
+    const DirectedGraph graph(6, { { 0, 1 }, { 1, 0 }, { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 2 } });
+    std::vector<DirectedGraph::NodeId> component_ids;
+    CHECK_EQ(graph.findStronglyConnectedComponents(&component_ids), 3u);
+    CHECK_EQ(component_ids[0], component_ids[1]);
+    CHECK_EQ(component_ids[2], component_ids[3]);
+    CHECK_EQ(component_ids[3], component_ids[4]);
+    CHECK_TRUE(component_ids[0] > component_ids[2]);
+    CHECK_TRUE(component_ids[5] != component_ids[0] and component_ids[5] != component_ids[2]);
+}
+
+
+TEST(BreadthFirstSearch) {
+    const DirectedGraph graph(6, { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 5, 4 } }, /* add_reverse_edges = */true);
+    std::vector<size_t> level_sizes;
+    CHECK_EQ(graph.breadthFirstSearch({ 1 }, 1, &level_sizes), std::vector<DirectedGraph::NodeId>({ 1, 0, 2 }));
+    CHECK_EQ(level_sizes, std::vector<size_t>({ 1, 2 }));
+    CHECK_EQ(graph.breadthFirstSearch({ 1, 4 }, UINT_MAX, &level_sizes),
+             std::vector<DirectedGraph::NodeId>({ 1, 4, 0, 2, 5, 3 }));
+    CHECK_EQ(level_sizes, std::vector<size_t>({ 2, 3, 1 }));
+}
+
+
+TEST(ParallelBreadthFirstSearch) {
+    // A long path w/ a wide fan-out at its start so that some levels are large enough to be processed in parallel:
+    const DirectedGraph::NodeId FAN_OUT(100000);
+    std::vector<DirectedGraph::Edge> edges;
+    for (DirectedGraph::NodeId node(1); node <= FAN_OUT; ++node) {
+        edges.emplace_back(0, node);
+        edges.emplace_back(node, FAN_OUT + 1 + node % 7);
+    }
+    const DirectedGraph graph(FAN_OUT + 8, edges);
+
+    std::vector<size_t> level_sizes;
+    const auto reached_nodes(graph.breadthFirstSearch({ 0 }, UINT_MAX, &level_sizes, /* thread_count = */4));
+    CHECK_EQ(reached_nodes.size(), static_cast<size_t>(FAN_OUT + 8));
+    CHECK_EQ(level_sizes, std::vector<size_t>({ 1, FAN_OUT, 7 }));
+    CHECK_EQ(reached_nodes[FAN_OUT + 1], FAN_OUT + 1);
+}
+
+
+TEST(NodeNames) {
+    NodeNameTable node_names;
+    CHECK_EQ(node_names.getOrAddId("b"), 0u);
+    CHECK_EQ(node_names.getOrAddId("a"), 1u);
+    CHECK_EQ(node_names.getOrAddId("b"), 0u);
+    CHECK_EQ(node_names.getId("a"), 1u);
+    CHECK_EQ(node_names.getId("c"), NodeNameTable::NO_ID);
+    CHECK_EQ(node_names.getName(1), "a");
+    CHECK_EQ(node_names.size(), 2u);
+}
+
+
+TEST_MAIN(DirectedGraph)
@@ -0,0 +1,159 @@
+/** \brief Test cases for EventLoop and AsyncTcpConnection
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "EventLoop.h"
+#include "UnitTest.h"
+
+
+TEST(Timers) {
+    EventLoop event_loop;
+    std::vector<int> fired_timers;
+    event_loop.addTimer(30, [&fired_timers]() { fired_timers.emplace_back(3); });
+    event_loop.addTimer(10, [&fired_timers]() { fired_timers.emplace_back(1); });
+    const auto cancelled_timer_id(event_loop.addTimer(20, [&fired_timers]() { fired_timers.emplace_back(2); }));
+    event_loop.addTimer(0, [&event_loop, &fired_timers]() {
+        fired_timers.emplace_back(0);
+        event_loop.addTimer(15, [&fired_timers]() { fired_timers.emplace_back(4); });
+    });
+    CHECK_TRUE(event_loop.cancelTimer(cancelled_timer_id));
+    CHECK_FALSE(event_loop.cancelTimer(cancelled_timer_id));
+
+    event_loop.run();
+    CHECK_EQ(fired_timers, std::vector<int>({ 0, 1, 4, 3 }));
+    CHECK_EQ(event_loop.getTimerCount(), 0u);
+}
+
+
+// Listens on a random port of the loopback interface and echoes everything it receives on accepted connections.
+class EchoServer {
+    EventLoop * const event_loop_;
+    int listen_fd_;
+    unsigned short port_;
+    std::vector<int> connection_fds_;
+public:
+    explicit EchoServer(EventLoop * const event_loop);
+    ~EchoServer();
+    inline unsigned short getPort() const { return port_; }
+};
+
+
+EchoServer::EchoServer(EventLoop * const event_loop): event_loop_(event_loop) {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in address;
+    std::memset(&address, '\0', sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size(sizeof(address));
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 or ::listen(listen_fd_, 16) != 0
+        or ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &address_size) != 0)
+        LOG_ERROR("failed to set up the listening socket!");
+    port_ = ntohs(address.sin_port);
+
+    event_loop_->addFd(listen_fd_, EPOLLIN, [this](const uint32_t /*events*/) {
+        const int connection_fd(::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK));
+        if (connection_fd == -1)
+            return;
+        connection_fds_.emplace_back(connection_fd);
+        event_loop_->addFd(connection_fd, EPOLLIN, [this, connection_fd](const uint32_t /*events*/) {
+            char buffer[1024];
+            const ssize_t read_count(::read(connection_fd, buffer, sizeof(buffer)));
+            if (read_count > 0)
+                CHECK_EQ(::write(connection_fd, buffer, read_count), read_count);
+            else if (read_count == 0) {
+                event_loop_->removeFd(connection_fd);
+                ::close(connection_fd);
+                connection_fds_.erase(std::find(connection_fds_.begin(), connection_fds_.end(), connection_fd));
+            }
+        });
+    });
+}
+
+
+EchoServer::~EchoServer() {
+    for (const int connection_fd : connection_fds_) {
+        event_loop_->removeFd(connection_fd);
+        ::close(connection_fd);
+    }
+    event_loop_->removeFd(listen_fd_);
+    ::close(listen_fd_);
+}
+
+
+TEST(EchoConnection) {
+    EventLoop event_loop;
+    EchoServer echo_server(&event_loop);
+
+    bool opened(false);
+    std::string received_data;
+    const std::string DATA(100000, 'x');
+    AsyncTcpConnection connection(
+        &event_loop,
+        [&opened](AsyncTcpConnection * const /*connection*/) { opened = true; },
+        [&event_loop, &received_data, &DATA](AsyncTcpConnection * const this_connection, const char * const data,
+                                             const size_t size)
+        {
+            received_data.append(data, size);
+            if (received_data.size() == DATA.size() + 1) {
+                this_connection->close();
+                event_loop.stop();
+            }
+        },
+        [&event_loop](AsyncTcpConnection * const /*connection*/, const std::string &/*error_message*/) { event_loop.stop(); });
+
+    connection.write("y"); // Must be queued until we are connected.
+    connection.connect(htonl(INADDR_LOOPBACK), echo_server.getPort(), /* use_tls = */false, 5000);
+    CHECK_EQ(connection.getState(), AsyncTcpConnection::CONNECTING);
+    connection.write(DATA);
+
+    event_loop.run();
+    CHECK_TRUE(opened);
+    CHECK_EQ(connection.getState(), AsyncTcpConnection::CLOSED);
+    CHECK_EQ(received_data, "y" + DATA);
+}
+
+
+TEST(RefusedConnection) {
+    EventLoop event_loop;
+    unsigned short unused_port;
+    {
+        EchoServer echo_server(&event_loop);
+        unused_port = echo_server.getPort();
+    }
+
+    std::string error_message;
+    AsyncTcpConnection connection(&event_loop, nullptr, nullptr,
+                                  [&error_message](AsyncTcpConnection * const /*connection*/, const std::string &message)
+                                      { error_message = message; });
+    connection.connect(htonl(INADDR_LOOPBACK), unused_port, /* use_tls = */false, 5000);
+    event_loop.run();
+    CHECK_EQ(connection.getState(), AsyncTcpConnection::CLOSED);
+    CHECK_FALSE(error_message.empty());
+    CHECK_EQ(event_loop.getFdCount(), 0u);
+    CHECK_EQ(event_loop.getTimerCount(), 0u);
+}
+
+
+TEST_MAIN(EventLoop)
@@ -0,0 +1,62 @@
+/** \brief Test cases for ExternalSorter
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include <utility>
+#include <vector>
+#include "ExternalSorter.h"
+#include "UnitTest.h"
+
+
+// Adds keys in a scrambled order w/ their insertion positions as values and returns them in sorted order.
+static std::vector<std::pair<std::string, std::string>> Sort(const size_t max_memory_usage, size_t * const run_count) {
+    ExternalSorter sorter(max_memory_usage, "/tmp/ExternalSorterTests");
+    for (unsigned i(0); i < 10000; ++i)
+        sorter.add(std::to_string((i * 7919u) % 1000u), std::to_string(i));
+    *run_count = sorter.getRunCount();
+
+    std::vector<std::pair<std::string, std::string>> keys_and_values;
+    sorter.finish([&keys_and_values](const StringView &key, const StringView &value) {
+        keys_and_values.emplace_back(key.toString(), value.toString());
+    });
+
+    return keys_and_values;
+}
+
+
+TEST(InMemoryAndExternalSortsAgree) {
+    size_t run_count;
+    const auto in_memory_keys_and_values(Sort(ExternalSorter::DEFAULT_MAX_MEMORY_USAGE, &run_count));
+    CHECK_EQ(run_count, 0u);
+    const auto external_keys_and_values(Sort(4096, &run_count));
+    CHECK_TRUE(run_count > 10u);
+
+    CHECK_EQ(in_memory_keys_and_values.size(), 10000u);
+    CHECK_TRUE(in_memory_keys_and_values == external_keys_and_values);
+    for (size_t i(1); i < in_memory_keys_and_values.size(); ++i) {
+        const auto &previous(in_memory_keys_and_values[i - 1]), &current(in_memory_keys_and_values[i]);
+        CHECK_TRUE(previous.first <= current.first);
+
+        // Equal keys have to stay in insertion order:
+        if (previous.first == current.first)
+            CHECK_TRUE(std::stoul(previous.second) < std::stoul(current.second));
+    }
+}
+
+
+TEST_MAIN(ExternalSorter)
@@ -0,0 +1,108 @@
+/** \brief Test cases for FrozenIniFile
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include "FileUtil.h"
+#include "FrozenIniFile.h"
+#include "IniFile.h"
+#include "UnitTest.h"
+
+
+static const std::string INI_FILE_CONTENTS(
+    "# A leading comment.\n"
+    "[Global]\n"
+    "user_agent = \"ub_tools (test)\"\n"
+    "max_depth = 3\n"
+    "enabled = true\n"
+    "\n"
+    "[Journal A]\n"
+    "issn = 1234-5678\n"
+    "enabled = true # The same value as above, so it should be interned.\n"
+    "score = -2\n"
+    "weight = 0.5\n"
+    "\n"
+    "[Journal B]\n"
+    "issn = 8765-4321\n"
+);
+
+
+TEST(MatchesIniFile) {
+    const FileUtil::AutoTempFile ini_file_path("/tmp/FrozenIniFileTests", ".conf");
+    FileUtil::WriteStringOrDie(ini_file_path.getFilePath(), INI_FILE_CONTENTS);
+    const IniFile ini_file(ini_file_path.getFilePath());
+    const FrozenIniFile frozen_ini_file(ini_file);
+
+    CHECK_TRUE(frozen_ini_file.getSections() == ini_file.getSections());
+    for (const auto &section_name : ini_file.getSections()) {
+        CHECK_TRUE(frozen_ini_file.sectionIsDefined(section_name));
+        for (const auto &entry_name : ini_file.getSectionEntryNames(section_name)) {
+            if (entry_name.empty())
+                continue;
+            CHECK_EQ(frozen_ini_file.getString(section_name, entry_name), ini_file.getString(section_name, entry_name));
+        }
+    }
+
+    CHECK_EQ(frozen_ini_file.getString("Global", "user_agent"), "ub_tools (test)");
+    CHECK_EQ(frozen_ini_file.getUnsigned("Global", "max_depth"), 3u);
+    CHECK_EQ(frozen_ini_file.getInteger("Journal A", "score"), -2l);
+    CHECK_EQ(frozen_ini_file.getDouble("Journal A", "weight"), 0.5);
+    CHECK_TRUE(frozen_ini_file.getBool("Journal A", "enabled"));
+    CHECK_TRUE(frozen_ini_file.find("Global", "enabled") == frozen_ini_file.find("Journal A", "enabled"));
+    CHECK_EQ(frozen_ini_file.getSectionEntryNames("Journal A").size(), 4u);
+}
+
+
+TEST(MissingSectionsAndEntries) {
+    const FileUtil::AutoTempFile ini_file_path("/tmp/FrozenIniFileTests", ".conf");
+    FileUtil::WriteStringOrDie(ini_file_path.getFilePath(), INI_FILE_CONTENTS);
+    const FrozenIniFile frozen_ini_file(ini_file_path.getFilePath());
+
+    CHECK_FALSE(frozen_ini_file.sectionIsDefined("Journal C"));
+    CHECK_TRUE(frozen_ini_file.find("Journal C", "issn") == nullptr);
+    CHECK_TRUE(frozen_ini_file.find("Journal B", "score") == nullptr);
+    CHECK_TRUE(frozen_ini_file.find("Journal", "A issn") == nullptr);
+    CHECK_EQ(frozen_ini_file.getUnsigned("Journal B", "max_depth", 7), 7u);
+    CHECK_EQ(frozen_ini_file.getString("Journal C", "issn", "none"), "none");
+    CHECK_TRUE(frozen_ini_file.getSectionEntryNames("Journal C").empty());
+}
+
+
+TEST(Cache) {
+    const FileUtil::AutoTempFile ini_file_path("/tmp/FrozenIniFileTests", ".conf");
+    const FileUtil::AutoTempFile cache_path("/tmp/FrozenIniFileTests", ".cache");
+    FileUtil::WriteStringOrDie(ini_file_path.getFilePath(), INI_FILE_CONTENTS);
+    FileUtil::WriteStringOrDie(cache_path.getFilePath(), "garbage");
+
+    const FrozenIniFile parsed_ini_file(ini_file_path.getFilePath(), cache_path.getFilePath());
+    CHECK_FALSE(parsed_ini_file.loadedFromCache());
+
+    const FrozenIniFile cached_ini_file(ini_file_path.getFilePath(), cache_path.getFilePath());
+    CHECK_TRUE(cached_ini_file.loadedFromCache());
+    CHECK_TRUE(cached_ini_file.getSections() == parsed_ini_file.getSections());
+    CHECK_EQ(cached_ini_file.getString("Journal B", "issn"), "8765-4321");
+    CHECK_EQ(cached_ini_file.getUnsigned("Global", "max_depth"), 3u);
+
+    // Any change to the ini file has to invalidate the cache:
+    FileUtil::WriteStringOrDie(ini_file_path.getFilePath(), INI_FILE_CONTENTS + "weight = 2\n");
+    const FrozenIniFile reparsed_ini_file(ini_file_path.getFilePath(), cache_path.getFilePath());
+    CHECK_FALSE(reparsed_ini_file.loadedFromCache());
+    CHECK_EQ(reparsed_ini_file.getDouble("Journal B", "weight"), 2.0);
+}
+
+
+TEST_MAIN(FrozenIniFile)
@@ -0,0 +1,76 @@
+/** \brief Test cases for JSON::PullReader
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include <vector>
+#include "JSON.h"
+#include "UnitTest.h"
+
+
+namespace {
+
+
+std::vector<int> PullAllEvents(const std::string &json_document) {
+    JSON::PullReader reader(json_document);
+    std::vector<int> events;
+    for (;;) {
+        const JSON::PullReader::EventType event(reader.next());
+        events.emplace_back(event);
+        if (event == JSON::PullReader::END_OF_INPUT or event == JSON::PullReader::ERROR)
+            return events;
+    }
+}
+
+
+} // unnamed namespace
+
+
+TEST(EmptyContainers) {
+    CHECK_EQ(PullAllEvents("{}"), std::vector<int>({ JSON::PullReader::START_OBJECT, JSON::PullReader::END_OBJECT,
+                                                     JSON::PullReader::END_OF_INPUT }));
+    CHECK_EQ(PullAllEvents("[]"), std::vector<int>({ JSON::PullReader::START_ARRAY, JSON::PullReader::END_ARRAY,
+                                                     JSON::PullReader::END_OF_INPUT }));
+    CHECK_EQ(PullAllEvents("{\"a\":[]}"),
+             std::vector<int>({ JSON::PullReader::START_OBJECT, JSON::PullReader::KEY, JSON::PullReader::START_ARRAY,
+                                JSON::PullReader::END_ARRAY, JSON::PullReader::END_OBJECT, JSON::PullReader::END_OF_INPUT }));
+}
+
+
+TEST(NestedValues) {
+    const std::string json_document("{\"a\":[1,{}],\"b\":\"x\"}");
+    JSON::PullReader reader(json_document);
+    CHECK_EQ(reader.next(), JSON::PullReader::START_OBJECT);
+    CHECK_EQ(reader.next(), JSON::PullReader::KEY);
+    CHECK_EQ(reader.getString(), "a");
+    CHECK_EQ(reader.next(), JSON::PullReader::START_ARRAY);
+    CHECK_EQ(reader.next(), JSON::PullReader::INTEGER_VALUE);
+    CHECK_EQ(reader.getInteger(), 1);
+    CHECK_EQ(reader.next(), JSON::PullReader::START_OBJECT);
+    CHECK_EQ(reader.next(), JSON::PullReader::END_OBJECT);
+    CHECK_EQ(reader.getDepth(), 2u);
+    CHECK_EQ(reader.next(), JSON::PullReader::END_ARRAY);
+    CHECK_EQ(reader.next(), JSON::PullReader::KEY);
+    CHECK_EQ(reader.next(), JSON::PullReader::STRING_VALUE);
+    CHECK_EQ(reader.getString(), "x");
+    CHECK_EQ(reader.next(), JSON::PullReader::END_OBJECT);
+    CHECK_EQ(reader.getDepth(), 0u);
+    CHECK_EQ(reader.next(), JSON::PullReader::END_OF_INPUT);
+}
+
+
+TEST_MAIN(JSONPullReader)
@@ -0,0 +1,146 @@
+/** \brief Test cases for ThreadUtil::LockFreeBoundedQueue
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "ThreadUtil.h"
+#include "UnitTest.h"
+
+
+TEST(Capacity) {
+    CHECK_EQ(ThreadUtil::LockFreeBoundedQueue<int>(1).capacity(), 1u);
+    CHECK_EQ(ThreadUtil::LockFreeBoundedQueue<int>(5).capacity(), 8u);
+    CHECK_EQ(ThreadUtil::LockFreeBoundedQueue<int>(16).capacity(), 16u);
+}
+
+
+TEST(FullAndEmpty) {
+    ThreadUtil::LockFreeBoundedQueue<int> queue(4);
+    int element;
+    CHECK_FALSE(queue.tryPop(&element));
+
+    // Several laps so that the slots' sequence numbers wrap around:
+    for (int lap(0); lap < 3; ++lap) {
+        for (int i(0); i < 4; ++i)
+            CHECK_TRUE(queue.tryPush(lap * 10 + i));
+        CHECK_FALSE(queue.tryPush(99));
+
+        for (int i(0); i < 4; ++i) {
+            CHECK_TRUE(queue.tryPop(&element));
+            CHECK_EQ(element, lap * 10 + i);
+        }
+        CHECK_FALSE(queue.tryPop(&element));
+    }
+}
+
+
+TEST(Close) {
+    ThreadUtil::LockFreeBoundedQueue<std::unique_ptr<int>> queue(4);
+    CHECK_TRUE(queue.push(std::unique_ptr<int>(new int(1))));
+    CHECK_TRUE(queue.push(std::unique_ptr<int>(new int(2))));
+    CHECK_TRUE(queue.push(std::unique_ptr<int>(new int(3)))); // Never popped, must be freed by the destructor.
+    queue.close();
+    CHECK_FALSE(queue.push(std::unique_ptr<int>(new int(4))));
+    CHECK_FALSE(queue.tryPush(std::unique_ptr<int>(new int(5))));
+
+    std::unique_ptr<int> element;
+    CHECK_TRUE(queue.pop(&element));
+    CHECK_EQ(*element, 1);
+    CHECK_TRUE(queue.pop(&element));
+    CHECK_EQ(*element, 2);
+}
+
+
+TEST(ClosingWakesUpConsumers) {
+    ThreadUtil::LockFreeBoundedQueue<int> queue(4);
+    std::atomic<bool> popped_something(true);
+    std::thread consumer([&queue, &popped_something]() {
+        int element;
+        popped_something = queue.pop(&element);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.close();
+    consumer.join();
+    CHECK_FALSE(popped_something);
+}
+
+
+// Note: the CHECK_* macros are not thread-safe and are therefore only used on the main thread.
+
+
+// A small queue w/ more threads than cores makes producers and consumers run into the full and empty states all the
+// time, including the sleeping paths of push() and pop().
+TEST(ManyProducersAndConsumers) {
+    const unsigned PRODUCER_COUNT(4), CONSUMER_COUNT(4), ITEMS_PER_PRODUCER(50000);
+    ThreadUtil::LockFreeBoundedQueue<unsigned> queue(16);
+
+    std::vector<std::vector<unsigned>> consumed_items(CONSUMER_COUNT);
+    std::vector<std::thread> consumers;
+    for (unsigned consumer_no(0); consumer_no < CONSUMER_COUNT; ++consumer_no) {
+        consumers.emplace_back([&queue, &consumed_items, consumer_no]() {
+            unsigned item;
+            while (queue.pop(&item))
+                consumed_items[consumer_no].emplace_back(item);
+        });
+    }
+
+    std::atomic<unsigned> failed_push_count(0);
+    std::vector<std::thread> producers;
+    for (unsigned producer_no(0); producer_no < PRODUCER_COUNT; ++producer_no) {
+        producers.emplace_back([&queue, &failed_push_count, producer_no, ITEMS_PER_PRODUCER]() {
+            for (unsigned i(0); i < ITEMS_PER_PRODUCER; ++i) {
+                if (not queue.push(producer_no * ITEMS_PER_PRODUCER + i))
+                    ++failed_push_count;
+            }
+        });
+    }
+    for (auto &producer : producers)
+        producer.join();
+    queue.close();
+    for (auto &consumer : consumers)
+        consumer.join();
+    CHECK_EQ(failed_push_count.load(), 0u);
+
+    unsigned out_of_order_count(0);
+    std::vector<unsigned> arrival_counts(PRODUCER_COUNT * ITEMS_PER_PRODUCER, 0);
+    for (const auto &items : consumed_items) {
+        // Items of the same producer must arrive in order at any given consumer:
+        std::vector<unsigned> last_item_plus_one(PRODUCER_COUNT, 0);
+        for (const unsigned item : items) {
+            ++arrival_counts[item];
+            const unsigned producer_no(item / ITEMS_PER_PRODUCER);
+            if (item + 1 <= last_item_plus_one[producer_no])
+                ++out_of_order_count;
+            last_item_plus_one[producer_no] = item + 1;
+        }
+    }
+    CHECK_EQ(out_of_order_count, 0u);
+
+    unsigned missing_or_duplicated_count(0);
+    for (const unsigned arrival_count : arrival_counts) {
+        if (arrival_count != 1)
+            ++missing_or_duplicated_count;
+    }
+    CHECK_EQ(missing_or_duplicated_count, 0u);
+}
+
+
+TEST_MAIN(LockFreeBoundedQueue)
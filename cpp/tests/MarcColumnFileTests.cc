@@ -0,0 +1,78 @@
+/** \brief Test cases for MARC::ColumnFileWriter and MARC::ColumnFileReader.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include <vector>
+#include "FileUtil.h"
+#include "MarcColumnFile.h"
+#include "UnitTest.h"
+
+
+TEST(SplitAndJoin) {
+    CHECK_TRUE(MARC::ColumnFile::SplitValues("").empty());
+    const std::vector<std::string> values{ "a", "", "b c" };
+    const std::string joined_values(MARC::ColumnFile::JoinValues(values));
+    CHECK_EQ(joined_values, std::string("a\x1F\x1F" "b c"));
+    CHECK_TRUE(MARC::ColumnFile::SplitValues(joined_values) == values);
+}
+
+
+TEST(RoundTrip) {
+    FileUtil::AutoTempFile temp_file;
+    const std::string &path(temp_file.getFilePath());
+    {
+        // A tiny chunk size so that we have several chunks, the last of which is only partially filled:
+        MARC::ColumnFileWriter writer(path, { "ppn", "title", "year" }, /* chunk_size = */3);
+        for (unsigned row_no(0); row_no < 10; ++row_no)
+            writer.addRow({ std::to_string(row_no), row_no == 4 ? "" : "Title " + std::to_string(row_no),
+                            std::to_string(2000 + row_no) });
+    }
+    CHECK_TRUE(MARC::ColumnFileReader::IsColumnFile(path));
+
+    MARC::ColumnFileReader all_columns_reader(path);
+    CHECK_EQ(all_columns_reader.getColumnNames().size(), 3u);
+    std::vector<std::string> column_values;
+    unsigned row_count(0);
+    while (all_columns_reader.readRow(&column_values)) {
+        CHECK_EQ(column_values.size(), 3u);
+        CHECK_EQ(column_values[0], std::to_string(row_count));
+        ++row_count;
+    }
+    CHECK_EQ(row_count, 10u);
+
+    // Selected columns are returned in the requested order and the others are skipped:
+    MARC::ColumnFileReader selected_columns_reader(path, { "year", "title" });
+    row_count = 0;
+    while (selected_columns_reader.readRow(&column_values)) {
+        CHECK_EQ(column_values.size(), 2u);
+        CHECK_EQ(column_values[0], std::to_string(2000 + row_count));
+        CHECK_EQ(column_values[1], row_count == 4 ? "" : "Title " + std::to_string(row_count));
+        ++row_count;
+    }
+    CHECK_EQ(row_count, 10u);
+}
+
+
+TEST(NotAColumnFile) {
+    FileUtil::AutoTempFile temp_file;
+    FileUtil::WriteStringOrDie(temp_file.getFilePath(), "00042nam a2200025 4500");
+    CHECK_FALSE(MARC::ColumnFileReader::IsColumnFile(temp_file.getFilePath()));
+}
+
+
+TEST_MAIN(MarcColumnFile)
@@ -17,11 +17,20 @@
  *  You should have received a copy of the GNU Affero General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "FileUtil.h"
 #include "MARC.h"
+#include "MarcAuthorityStore.h"
+#include "MarcOffsetIndex.h"
+#include "ShmRing.h"
 #include "UnitTest.h"
 
 
@@ -71,4 +80,260 @@ TEST(binary_large_record) {
 }
 
 
+TEST(binary_read_view) {
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/marc_record_test.mrc"));
+    const MARC::Record record(reader->read());
+
+    std::unique_ptr<MARC::Reader> view_reader(MARC::Reader::Factory("data/marc_record_test.mrc"));
+    const MARC::RecordView record_view(static_cast<MARC::BinaryReader *>(view_reader.get())->readView());
+    CHECK_TRUE(record_view);
+    CHECK_EQ(record_view.getNumberOfFields(), record.getNumberOfFields());
+    CHECK_EQ(record_view.getLeader(), record.getLeader());
+    CHECK_EQ(record_view.getControlNumber(), record.getControlNumber());
+
+    // Views preserve the physical field order while records get their fields (stably) sorted by tag:
+    std::vector<std::pair<std::string, std::string>> view_tags_and_contents;
+    for (const auto &field_view : record_view)
+        view_tags_and_contents.emplace_back(field_view.getTag().toString(), field_view.getContents().toString());
+    std::stable_sort(view_tags_and_contents.begin(), view_tags_and_contents.end(),
+                     [](const std::pair<std::string, std::string> &lhs, const std::pair<std::string, std::string> &rhs)
+                         { return lhs.first < rhs.first; });
+
+    auto field(record.begin());
+    for (const auto &tag_and_contents : view_tags_and_contents) {
+        CHECK_EQ(tag_and_contents.first, field->getTag().toString());
+        CHECK_EQ(tag_and_contents.second, field->getContents());
+        ++field;
+    }
+
+    const MARC::Record copy(record_view.toRecord());
+    CHECK_EQ(copy.getNumberOfFields(), record.getNumberOfFields());
+    CHECK_EQ(copy.getFirstFieldContents("245"), record.getFirstFieldContents("245"));
+}
+
+
+TEST(binary_read_recycling) {
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+    std::unique_ptr<MARC::Reader> recycling_reader(MARC::Reader::Factory("data/default.mrc"));
+
+    unsigned record_count(0);
+    MARC::Record recycled_record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+    while (const MARC::Record record = reader->read()) {
+        CHECK_TRUE(recycling_reader->read(&recycled_record));
+        CHECK_EQ(recycled_record.getControlNumber(), record.getControlNumber());
+        CHECK_EQ(recycled_record.getNumberOfFields(), record.getNumberOfFields());
+        ++record_count;
+    }
+    CHECK_TRUE(not recycling_reader->read(&recycled_record));
+    CHECK_TRUE(record_count > 0);
+}
+
+
+TEST(gzip_compressed_read_write) {
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+    std::unique_ptr<MARC::Writer> writer(MARC::Writer::Factory("/tmp/default.out.mrc.gz"));
+    std::vector<std::string> control_numbers;
+    while (const MARC::Record record = reader->read()) {
+        writer->write(record);
+        control_numbers.emplace_back(record.getControlNumber());
+    }
+    writer.reset();
+
+    std::unique_ptr<MARC::Reader> compressed_reader(MARC::Reader::Factory("/tmp/default.out.mrc.gz"));
+    CHECK_EQ(compressed_reader->getReaderType(), MARC::FileType::BINARY);
+    for (const auto &control_number : control_numbers)
+        CHECK_EQ(compressed_reader->read().getControlNumber(), control_number);
+    CHECK_TRUE(not compressed_reader->read());
+}
+
+
+TEST(indexed_read_write) {
+    // Both fixtures share the same control number, so we give each record its own one.  The last record repeats the
+    // first control number, but isn't adjacent to it, and should therefore win lookups.
+    std::vector<std::string> control_numbers;
+    {
+        std::unique_ptr<MARC::Writer> writer(MARC::Writer::Factory("/tmp/indexed_test.mrci"));
+        for (const auto &input_filename : { "data/default.mrc", "data/marc_record_test.mrc" }) {
+            std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory(input_filename));
+            while (MARC::Record record = reader->read()) {
+                control_numbers.emplace_back("PPN" + std::to_string(control_numbers.size() + 1));
+                record.erase("001");
+                record.insertField("001", control_numbers.back());
+                writer->write(record);
+            }
+        }
+
+        std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+        MARC::Record duplicate(reader->read());
+        duplicate.erase("001");
+        duplicate.insertField("001", control_numbers.front());
+        duplicate.insertField("TST", "  " "\x1F" "alast occurrence");
+        writer->write(duplicate);
+        control_numbers.emplace_back(control_numbers.front());
+    }
+
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("/tmp/indexed_test.mrci"));
+    CHECK_EQ(reader->getReaderType(), MARC::FileType::INDEXED);
+    CHECK_EQ(MARC::GuessFileType("/tmp/indexed_test.mrci"), MARC::FileType::INDEXED);
+    for (const auto &control_number : control_numbers)
+        CHECK_EQ(reader->read().getControlNumber(), control_number);
+    CHECK_TRUE(not reader->read());
+
+    MARC::IndexedReader * const indexed_reader(static_cast<MARC::IndexedReader *>(reader.get()));
+    CHECK_EQ(indexed_reader->getRecordCount(), control_numbers.size());
+    for (size_t record_no(1); record_no < control_numbers.size() - 1; ++record_no) {
+        CHECK_TRUE(indexed_reader->seekToControlNumber(control_numbers[record_no]));
+        CHECK_EQ(reader->read().getControlNumber(), control_numbers[record_no]);
+    }
+    CHECK_TRUE(not indexed_reader->seekToControlNumber("no such PPN"));
+
+    CHECK_TRUE(indexed_reader->seekToControlNumber(control_numbers.front()));
+    const MARC::Record last_occurrence(reader->read());
+    CHECK_EQ(last_occurrence.getControlNumber(), control_numbers.front());
+    CHECK_EQ(last_occurrence.getFirstFieldContents("TST"), "  " "\x1F" "alast occurrence");
+    CHECK_TRUE(not reader->read());
+
+    CHECK_TRUE(indexed_reader->seekToRecord(0));
+    CHECK_TRUE(reader->read().getFirstFieldContents("TST").empty());
+}
+
+
+TEST(projected_read) {
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+    std::unique_ptr<MARC::Reader> projected_reader(MARC::Reader::Factory("data/default.mrc", MARC::FileType::AUTO,
+                                                                         { "245", "100" }));
+    while (const MARC::Record record = reader->read()) {
+        const MARC::Record projected_record(projected_reader->read());
+        CHECK_EQ(projected_record.getControlNumber(), record.getControlNumber());
+        size_t expected_field_count(0);
+        for (const auto &field : record) {
+            if (field.getTag() == "001" or field.getTag() == "100" or field.getTag() == "245")
+                ++expected_field_count;
+        }
+        CHECK_EQ(projected_record.getNumberOfFields(), expected_field_count);
+        CHECK_EQ(projected_record.getMainTitle(), record.getMainTitle());
+    }
+    CHECK_TRUE(not projected_reader->read());
+}
+
+
+TEST(offset_index) {
+    FileUtil::CopyOrDie("data/default.mrc", "/tmp/offset_index_test.mrc");
+    ::unlink(MARC::OffsetIndex::GetIndexPath("/tmp/offset_index_test.mrc").c_str());
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("/tmp/offset_index_test.mrc"));
+    std::unordered_map<std::string, off_t> control_number_to_offset_map;
+    MARC::CollectRecordOffsets(reader.get(), &control_number_to_offset_map);
+
+    const MARC::OffsetIndex offset_index(reader.get());
+    CHECK_TRUE(MARC::OffsetIndex::IsUpToDate("/tmp/offset_index_test.mrc"));
+    CHECK_EQ(offset_index.size(), control_number_to_offset_map.size());
+    for (const auto &control_number_and_offset : control_number_to_offset_map) {
+        off_t offset;
+        CHECK_TRUE(offset_index.find(control_number_and_offset.first, &offset));
+        CHECK_EQ(offset, control_number_and_offset.second);
+    }
+
+    off_t offset;
+    CHECK_TRUE(not offset_index.find("no such PPN", &offset));
+}
+
+
+TEST(authority_store) {
+    FileUtil::CopyOrDie("data/default.mrc", "/tmp/authority_store_test.mrc");
+    ::unlink(MARC::AuthorityStore::GetStorePath("/tmp/authority_store_test.mrc").c_str());
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("/tmp/authority_store_test.mrc"));
+    std::unordered_map<std::string, off_t> control_number_to_offset_map;
+    MARC::CollectRecordOffsets(reader.get(), &control_number_to_offset_map);
+
+    const MARC::AuthorityStore authority_store(reader.get());
+    CHECK_TRUE(MARC::AuthorityStore::IsUpToDate("/tmp/authority_store_test.mrc"));
+    CHECK_EQ(authority_store.size(), control_number_to_offset_map.size());
+    for (const auto &control_number_and_offset : control_number_to_offset_map) {
+        MARC::Record record(std::string(MARC::Record::LEADER_LENGTH, ' '));
+        CHECK_TRUE(authority_store.getRecord(control_number_and_offset.first, reader.get(), &record));
+        CHECK_EQ(record.getControlNumber(), control_number_and_offset.first);
+    }
+
+    off_t offset;
+    CHECK_TRUE(not authority_store.findRecordOffset("no such PPN", &offset));
+    std::vector<StringView> synonyms;
+    CHECK_TRUE(not authority_store.getSynonyms("no such name", &synonyms));
+    std::vector<uint32_t> ddc_ids;
+    CHECK_EQ(authority_store.appendDDCIds("no such PPN", &ddc_ids), 0u);
+    CHECK_TRUE(ddc_ids.empty());
+}
+
+
+TEST(shm_ring_wrap_around) {
+    const std::string DATA(100000, 'x');
+    std::thread writer_thread([&DATA]() {
+        ShmRing ring("ub_tools_test_wrap_around", ShmRing::WRITER, 4096);
+        for (size_t offset(0); offset < DATA.size(); offset += 1000)
+            ring.write(DATA.data() + offset, 1000);
+    });
+
+    ShmRing ring("ub_tools_test_wrap_around", ShmRing::READER);
+    std::string received_data;
+    size_t available;
+    while ((available = ring.waitForData(3000)) > 0) {
+        received_data.append(ring.getReadPointer(), available);
+        ring.consume(available);
+    }
+    writer_thread.join();
+    CHECK_EQ(received_data, DATA);
+    CHECK_EQ(ring.tell(), DATA.size());
+}
+
+
+TEST(shm_ring_stale) {
+    // A writer that closes its ring and then dies before a reader has attached:
+    const pid_t pid(::fork());
+    if (pid == 0) {
+        ShmRing * const ring(new ShmRing("ub_tools_test_stale", ShmRing::WRITER, 4096));
+        ring->write("stale", 5);
+        ring->close();
+        ::_exit(EXIT_SUCCESS);
+    }
+    int status;
+    CHECK_EQ(::waitpid(pid, &status, 0), pid);
+
+    std::thread writer_thread([]() {
+        ::usleep(100 * 1000); // Give the reader a chance to find the stale ring first.
+        ShmRing ring("ub_tools_test_stale", ShmRing::WRITER, 4096);
+        ring.write("fresh", 5);
+    });
+
+    ShmRing ring("ub_tools_test_stale", ShmRing::READER);
+    const size_t available(ring.waitForData(5));
+    CHECK_EQ(std::string(ring.getReadPointer(), available), "fresh");
+    ring.consume(available);
+    CHECK_EQ(ring.waitForData(1), 0u);
+    writer_thread.join();
+}
+
+
+TEST(shm_ring_read_write) {
+    std::thread writer_thread([]() {
+        std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+        std::unique_ptr<MARC::Writer> writer(MARC::Writer::Factory("shm://ub_tools_test_marc"));
+        while (const MARC::Record record = reader->read())
+            writer->write(record);
+    });
+
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/default.mrc"));
+    std::unique_ptr<MARC::Reader> ring_reader(MARC::Reader::Factory("shm://ub_tools_test_marc"));
+    MARC::BinaryReader * const binary_ring_reader(static_cast<MARC::BinaryReader *>(ring_reader.get()));
+    unsigned record_count(0);
+    while (const MARC::Record record = reader->read()) {
+        const MARC::RecordView view(binary_ring_reader->readView());
+        CHECK_TRUE(view);
+        CHECK_EQ(view.getControlNumber(), record.getControlNumber());
+        ++record_count;
+    }
+    CHECK_TRUE(not binary_ring_reader->readView());
+    writer_thread.join();
+    CHECK_TRUE(record_count > 0);
+}
+
+
 TEST_MAIN(MarcReaderAndWriter)
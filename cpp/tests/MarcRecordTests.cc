@@ -20,6 +20,8 @@
 #include <vector>
 #include "File.h"
 #include "MARC.h"
+#include "MarcAuthorityIdTable.h"
+#include "MarcControlNumberSet.h"
 #include "UnitTest.h"
 
 
@@ -81,6 +83,27 @@ TEST(getTagRange) {
 
     count = record.getTagRange("LOK").size();
     CHECK_EQ(count, 5);
+
+    count = record.getTagRange(std::vector<MARC::Tag>{ "935", "591" }).size();
+    CHECK_EQ(count, record.getTagRange("591").size() + 2);
+}
+
+
+TEST(findTagAfterInsertions) {
+    MARC::Record record(MARC::Record::TypeOfRecord::LANGUAGE_MATERIAL, MARC::Record::BibliographicLevel::MONOGRAPH_OR_ITEM, "123");
+    record.insertField("689", { { 'a', "third" } });
+    record.insertField("100", { { 'a', "first" } });
+    record.insertFieldAtEnd("689", { { 'a', "fourth" } });
+    record.insertField("245", { { 'a', "second" } });
+
+    CHECK_EQ(record.findTag("001")->getContents(), "123");
+    CHECK_EQ(record.findTag("100")->getFirstSubfieldWithCode('a'), "first");
+    CHECK_EQ(record.findTag("245")->getFirstSubfieldWithCode('a'), "second");
+    CHECK_EQ(record.findTag("689")->getFirstSubfieldWithCode('a'), "third");
+    CHECK_EQ(record.getTagRange("689").size(), 2);
+    CHECK_EQ(record.getTagRange("689").back().getFirstSubfieldWithCode('a'), "fourth");
+    CHECK_TRUE(record.findTag("650") == record.end());
+    CHECK_TRUE(record.getTagRange("650").empty());
 }
 
 
@@ -154,4 +177,80 @@ TEST(getLanguageCode) {
 }
 
 
+TEST(fastChecksum) {
+    std::unique_ptr<MARC::Reader> reader(MARC::Reader::Factory("data/marc_record_test.mrc"));
+    MARC::Record record(reader->read());
+    const uint64_t checksum(MARC::CalcFastChecksum(record));
+    CHECK_EQ(MARC::CalcFastChecksum(record, { "001" }, /* suppress_local_fields = */true), checksum);
+    CHECK_NE(MARC::CalcFastChecksum(record, { "001" }, /* suppress_local_fields = */false), checksum);
+
+    CHECK_TRUE(not MARC::StoredFastChecksumMatches(record));
+    const uint64_t stored_checksum(MARC::StoreFastChecksum(&record));
+    uint64_t retrieved_checksum;
+    CHECK_TRUE(MARC::GetStoredFastChecksum(record, &retrieved_checksum));
+    CHECK_EQ(retrieved_checksum, stored_checksum);
+    CHECK_TRUE(MARC::StoredFastChecksumMatches(record));
+
+    record.insertField("500", { { 'a', "A new note." } });
+    CHECK_NE(MARC::CalcFastChecksum(record), checksum);
+    CHECK_TRUE(not MARC::StoredFastChecksumMatches(record));
+}
+
+
+TEST(controlNumberSet) {
+    MARC::ControlNumberSet control_numbers(/* store_values = */true);
+    CHECK_TRUE(control_numbers.empty());
+
+    // More than the initial capacity so that we have to grow:
+    for (unsigned i(0); i < 100000; ++i)
+        CHECK_TRUE(control_numbers.insert(std::to_string(100000000 + i) + "X", i));
+    CHECK_EQ(control_numbers.size(), 100000u);
+
+    uint64_t value;
+    CHECK_TRUE(control_numbers.find("100012345X", &value));
+    CHECK_EQ(value, 12345u);
+    CHECK_TRUE(not control_numbers.insert("100012345X", 42));
+    CHECK_TRUE(control_numbers.find("100012345X", &value));
+    CHECK_EQ(value, 12345u);
+
+    // Leading zeroes matter:
+    CHECK_TRUE(control_numbers.insert("0100012345X"));
+    CHECK_TRUE(not control_numbers.contains("100012345"));
+
+    // Control numbers that can't be packed:
+    CHECK_TRUE(control_numbers.insert("ZDB-12345", 7));
+    CHECK_TRUE(not control_numbers.insert("ZDB-12345"));
+    CHECK_TRUE(control_numbers.find("ZDB-12345", &value));
+    CHECK_EQ(value, 7u);
+    CHECK_EQ(control_numbers.size(), 100002u);
+
+    // GND numbers w/ hyphens can be packed and differ from the same digits w/o the hyphen:
+    CHECK_TRUE(control_numbers.insert("4021477-1", 8));
+    CHECK_TRUE(not control_numbers.contains("40214771"));
+    CHECK_TRUE(control_numbers.find("4021477-1", &value));
+    CHECK_EQ(value, 8u);
+}
+
+
+TEST(authorityIdTable) {
+    MARC::AuthorityIdTable authority_id_table;
+    CHECK_EQ(authority_id_table.add("040214772", "4021477-1"), 0u);
+    CHECK_EQ(authority_id_table.add("118540238X", ""), 1u);
+    CHECK_EQ(authority_id_table.size(), 2u);
+
+    CHECK_EQ(authority_id_table.getIdForPPN("118540238X"), 1u);
+    CHECK_EQ(authority_id_table.getIdForGNDNumber("4021477-1"), 0u);
+    CHECK_EQ(authority_id_table.getIdForGNDNumber("118540238X"), MARC::AuthorityIdTable::NO_ID);
+    CHECK_EQ(authority_id_table.getIdForReference("(DE-588)4021477-1"), 0u);
+    CHECK_EQ(authority_id_table.getIdForReference("(DE-627)118540238X"), 1u);
+    CHECK_EQ(authority_id_table.getIdForReference("(DE-576)118540238X"), MARC::AuthorityIdTable::NO_ID);
+
+    std::vector<uint32_t> ids;
+    authority_id_table.getReferencedIds("  \x1F""aLuther\x1F""0(DE-627)118540238X\x1F""0(DE-588)4021477-1\x1F""2gnd", &ids);
+    CHECK_EQ(ids.size(), 2u);
+    CHECK_EQ(ids[0], 1u);
+    CHECK_EQ(ids[1], 0u);
+}
+
+
 TEST_MAIN(MARC::Record)
@@ -0,0 +1,47 @@
+/** \brief Test cases for MARC::SubjectHeadingIndex
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcSubjectHeadingIndex.h"
+#include "UnitTest.h"
+
+
+TEST(Lookup) {
+    MARC::SubjectHeadingIndex index;
+    const auto church_history(index.add("Church history"));
+    const auto church_history_20th_century(index.add("Church history -- 20th century"));
+    const auto ethics(index.add("Ethics -- Germany"));
+    CHECK_EQ(index.add("church history."), church_history);
+    CHECK_EQ(index.size(), 3u);
+
+    CHECK_EQ(index.lookup(" 0\x1F""aChurch history."), church_history);
+    CHECK_EQ(index.lookup(" 0\x1F""aChurch history\x1F""zItaly"), church_history);
+    CHECK_EQ(index.lookup(" 0\x1F""aChurch history\x1F""y20th century.\x1F""zItaly"), church_history_20th_century);
+    CHECK_EQ(index.lookup(" 0\x1F""aEthics\x1F""zGermany"), ethics);
+    CHECK_EQ(index.lookup(" 0\x1F""aEthics"), MARC::SubjectHeadingIndex::NO_HEADING);
+    CHECK_EQ(index.lookup(" 0\x1F""xChurch history"), MARC::SubjectHeadingIndex::NO_HEADING);
+    CHECK_EQ(index.getHeading(ethics), "Ethics -- Germany");
+}
+
+
+TEST(NormaliseComponent) {
+    CHECK_EQ(MARC::SubjectHeadingIndex::NormaliseComponent(" Church History. "), "church history");
+    CHECK_EQ(MARC::SubjectHeadingIndex::NormaliseComponent("Ökumene."), "ökumene");
+}
+
+
+TEST_MAIN(MarcSubjectHeadingIndex)
@@ -0,0 +1,64 @@
+/** \brief Test cases for MultiPatternMatcher
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "UnitTest.h"
+#include "MultiPatternMatcher.h"
+
+
+TEST(findAll) {
+    const MultiPatternMatcher matcher({ "he", "she", "his", "hers", "" });
+    CHECK_EQ(matcher.getPatternCount(), 5u);
+
+    std::vector<MultiPatternMatcher::Match> matches;
+    matcher.findAll("ushers", &matches);
+    CHECK_EQ(matches.size(), 3u);
+    CHECK_EQ(matches[0].pattern_index_, 1u); // "she" ends together w/ "he" but is longer
+    CHECK_EQ(matches[0].start_, 1u);
+    CHECK_EQ(matches[1].pattern_index_, 0u);
+    CHECK_EQ(matches[1].start_, 2u);
+    CHECK_EQ(matches[2].pattern_index_, 3u);
+    CHECK_EQ(matches[2].start_, 2u);
+    CHECK_EQ(matches[2].length_, 4u);
+
+    matcher.findAll("", &matches);
+    CHECK_TRUE(matches.empty());
+    matcher.findAll("xyz", &matches);
+    CHECK_TRUE(matches.empty());
+}
+
+
+TEST(findLeftmostLongest) {
+    const MultiPatternMatcher matcher({ "mose", "1.mose", "römer", "römerbrief", "mose" });
+
+    std::vector<MultiPatternMatcher::Match> matches;
+    matcher.findLeftmostLongest("vgl. 1.mose 3 und römerbrief 8", &matches);
+    CHECK_EQ(matches.size(), 2u);
+    CHECK_EQ(matches[0].pattern_index_, 1u);
+    CHECK_EQ(matches[0].start_, 5u);
+    CHECK_EQ(matches[1].pattern_index_, 3u); // UTF-8 is fine.
+    CHECK_EQ(matches[1].length_, std::string("römerbrief").length());
+
+    // Duplicate patterns refer to their first occurrence:
+    matcher.findLeftmostLongest("mosemose", &matches);
+    CHECK_EQ(matches.size(), 2u);
+    CHECK_EQ(matches[0].pattern_index_, 0u);
+    CHECK_EQ(matches[1].start_, 4u);
+}
+
+
+TEST_MAIN(MultiPatternMatcher)
@@ -0,0 +1,87 @@
+/** \brief Test cases for PPNMappingStore.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include "FileUtil.h"
+#include "PPNMappingStore.h"
+#include "UnitTest.h"
+
+
+static void CheckContents(const PPNMappingStore &store) {
+    std::string current_ppn;
+    CHECK_TRUE(store.getCurrentPPN("000012345", &current_ppn));
+    CHECK_EQ(current_ppn, "101721410X"); // Via "123456789".
+    CHECK_EQ(store.getNewPPN("000012345"), "123456789");
+    CHECK_FALSE(store.getCurrentPPN("101721410X", &current_ppn));
+    CHECK_EQ(current_ppn, "101721410X");
+
+    CHECK_TRUE(store.isDeleted("987654321"));
+    CHECK_FALSE(store.isDeleted("123456789"));
+    CHECK_FALSE(store.isDeleted("99999999X"));
+
+    // A deletion followed by a replacement:
+    CHECK_FALSE(store.isDeleted("111111111"));
+    CHECK_EQ(store.getNewPPN("111111111"), "222222222");
+
+    CHECK_EQ(store.size(), 4u);
+}
+
+
+TEST(LogAndCompaction) {
+    FileUtil::AutoTempFile temp_file;
+    const std::string path(temp_file.getFilePath());
+    {
+        PPNMappingStore store(path);
+        CHECK_TRUE(store.empty());
+        store.addMapping("000012345", "123456789");
+        store.addMapping("123456789", "101721410X");
+        store.addDeletion("987654321");
+        store.addDeletion("111111111");
+        store.addMapping("111111111", "222222222");
+        CheckContents(store);
+        CHECK_EQ(store.getUncompactedCount(), 4u);
+    }
+
+    {
+        PPNMappingStore store(path); // Replays the log.
+        CheckContents(store);
+        store.compact();
+        CHECK_EQ(store.getUncompactedCount(), 0u);
+        CheckContents(store);
+    }
+
+    {
+        PPNMappingStore store(path); // Only the compacted table.
+        CHECK_EQ(store.getUncompactedCount(), 0u);
+        CheckContents(store);
+
+        // Overriding a compacted entry:
+        store.addDeletion("000012345");
+        CHECK_TRUE(store.isDeleted("000012345"));
+        CHECK_EQ(store.size(), 4u);
+        store.compact();
+        CHECK_TRUE(store.isDeleted("000012345"));
+        CHECK_EQ(store.size(), 4u);
+    }
+
+    FileUtil::DeleteFile(path + ".log");
+    FileUtil::DeleteFile(path + ".table");
+}
+
+
+TEST_MAIN(PPNMappingStore)
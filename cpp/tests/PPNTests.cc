@@ -0,0 +1,87 @@
+/** \brief Test cases for PPN, PPNSet and PPNMap
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "UnitTest.h"
+#include "PPN.h"
+
+
+TEST(parse) {
+    PPN ppn;
+    CHECK_TRUE(ppn.empty());
+    CHECK_TRUE(PPN::Parse("101721410X", &ppn));
+    CHECK_EQ(ppn.toString(), "101721410X");
+    CHECK_TRUE(PPN::Parse("000012345", &ppn));
+    CHECK_EQ(ppn.toString(), "000012345");
+
+    CHECK_FALSE(PPN::Parse("", &ppn));
+    CHECK_FALSE(PPN::Parse("12345", &ppn));
+    CHECK_FALSE(PPN::Parse("10172141X0", &ppn));
+    CHECK_FALSE(PPN::Parse("ZDB1234567", &ppn));
+    CHECK_FALSE(PPN::Parse("10172141000", &ppn));
+    CHECK_EQ(ppn.toString(), "000012345"); // Failed calls don't modify "ppn".
+
+    // Leading zeroes matter and shorter PPN's come first:
+    CHECK_NE(PPN::ParseOrDie("0123456789"), PPN::ParseOrDie("123456789"));
+    CHECK_LT(PPN::ParseOrDie("999999999"), PPN::ParseOrDie("0000000000"));
+    CHECK_LT(PPN::ParseOrDie("1017214100"), PPN::ParseOrDie("101721410X"));
+}
+
+
+TEST(ppnSet) {
+    PPNSet ppns;
+    CHECK_TRUE(ppns.empty());
+
+    // More than the initial capacity so that we have to grow:
+    for (unsigned i(0); i < 10000; ++i)
+        CHECK_TRUE(ppns.insert(std::to_string(100000000 + i) + "X"));
+    CHECK_EQ(ppns.size(), 10000u);
+    CHECK_FALSE(ppns.insert(PPN::ParseOrDie("100001234X")));
+    CHECK_TRUE(ppns.contains("100001234X"));
+    CHECK_FALSE(ppns.contains("1000012345"));
+    CHECK_FALSE(ppns.insert("not a PPN"));
+    CHECK_FALSE(ppns.contains("not a PPN"));
+    CHECK_EQ(ppns.size(), 10000u);
+
+    const auto sorted_ppns(ppns.getSortedPPNs());
+    CHECK_EQ(sorted_ppns.size(), 10000u);
+    CHECK_EQ(sorted_ppns.front().toString(), "100000000X");
+    CHECK_EQ(sorted_ppns.back().toString(), "100009999X");
+}
+
+
+TEST(ppnMap) {
+    PPNMap<std::string> ppns_to_titles;
+    for (unsigned i(0); i < 10000; ++i)
+        CHECK_TRUE(ppns_to_titles.insert(PPN::ParseOrDie(std::to_string(200000000 + i)), "Title " + std::to_string(i)));
+    CHECK_EQ(ppns_to_titles.size(), 10000u);
+
+    // insert() keeps the original value, operator[] doesn't:
+    const PPN ppn(PPN::ParseOrDie("200004711"));
+    CHECK_FALSE(ppns_to_titles.insert(ppn, "Other Title"));
+    CHECK_EQ(*ppns_to_titles.find(ppn), "Title 4711");
+    ppns_to_titles[ppn] = "Other Title";
+    CHECK_EQ(*ppns_to_titles.find("200004711"), "Other Title");
+
+    CHECK_TRUE(ppns_to_titles.find("300000000") == nullptr);
+    CHECK_TRUE(ppns_to_titles.find("bad") == nullptr);
+    CHECK_TRUE(ppns_to_titles[PPN::ParseOrDie("300000000")].empty());
+    CHECK_EQ(ppns_to_titles.size(), 10001u);
+}
+
+
+TEST_MAIN(PPN)
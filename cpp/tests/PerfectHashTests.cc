@@ -0,0 +1,52 @@
+/** \brief Test cases for PerfectHash
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include <utility>
+#include <vector>
+#include "PerfectHash.h"
+#include "UnitTest.h"
+
+
+TEST(StringMap) {
+    std::vector<std::pair<std::string, unsigned>> keys_and_values;
+    for (unsigned i(0); i < 5000; ++i)
+        keys_and_values.emplace_back("key" + std::to_string(i), i);
+    const PerfectHash::StringMap<unsigned> string_map(keys_and_values);
+
+    CHECK_EQ(string_map.size(), 5000u);
+    for (const auto &key_and_value : keys_and_values) {
+        const unsigned * const value(string_map.find(key_and_value.first));
+        CHECK_TRUE(value != nullptr);
+        CHECK_EQ(*value, key_and_value.second);
+    }
+
+    CHECK_TRUE(string_map.find("key5000") == nullptr);
+    CHECK_TRUE(string_map.find("key") == nullptr);
+    CHECK_TRUE(string_map.find("") == nullptr);
+}
+
+
+TEST(EmptyStringMap) {
+    const PerfectHash::StringMap<std::string> string_map;
+    CHECK_TRUE(string_map.empty());
+    CHECK_TRUE(string_map.find("ger") == nullptr);
+}
+
+
+TEST_MAIN(PerfectHash)
@@ -0,0 +1,46 @@
+/** \brief Test cases for ScanUtil
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include "ScanUtil.h"
+#include "UnitTest.h"
+
+
+TEST(FindFirstOf) {
+    CHECK_EQ(ScanUtil::FindFirstOf("", "<>&"), std::string::npos);
+    CHECK_EQ(ScanUtil::FindFirstOf("abc", ""), std::string::npos);
+    CHECK_EQ(ScanUtil::FindFirstOf("a&b", "&"), 1u);
+    CHECK_EQ(ScanUtil::FindFirstOf("a&b<", "<&"), 1u);
+    CHECK_EQ(ScanUtil::FindFirstOf("a&b<", "<&", 2), 3u);
+
+    // Make sure that we find matches in all possible positions of the vectorised and the scalar loops:
+    for (size_t length(1); length < 100; ++length) {
+        for (size_t match_pos(0); match_pos < length; ++match_pos) {
+            std::string s(length, 'x');
+            s[match_pos] = '>';
+            CHECK_EQ(ScanUtil::FindFirstOf(s, "<>&\"'"), match_pos);
+        }
+        CHECK_EQ(ScanUtil::FindFirstOf(std::string(length, 'x'), "<>&\"'"), std::string::npos);
+    }
+
+    // More than MAX_VECTORISED_SET_SIZE characters:
+    CHECK_EQ(ScanUtil::FindFirstOf(std::string(40, 'x') + "9", "0123456789"), 40u);
+}
+
+
+TEST_MAIN(ScanUtil)
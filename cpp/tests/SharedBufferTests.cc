@@ -0,0 +1,79 @@
+/** \brief Test cases for SharedBuffer
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <memory>
+#include <thread>
+#include <vector>
+#include "SharedBuffer.h"
+#include "UnitTest.h"
+
+
+TEST(MoveOnlyItems) {
+    SharedBuffer<std::unique_ptr<int>> shared_buffer(4);
+    shared_buffer.push_back(std::unique_ptr<int>(new int(1)));
+    shared_buffer.push_back(std::unique_ptr<int>(new int(2)));
+    CHECK_EQ(shared_buffer.size(), 2u);
+    CHECK_EQ(*shared_buffer.pop_front(), 1);
+    CHECK_EQ(*shared_buffer.pop_front(), 2);
+    CHECK_TRUE(shared_buffer.empty());
+}
+
+
+TEST(Batches) {
+    SharedBuffer<unsigned> shared_buffer(10);
+    std::vector<unsigned> items{ 1, 2, 3, 4, 5 };
+    shared_buffer.push_back_batch(&items);
+    CHECK_TRUE(items.empty());
+
+    CHECK_EQ(shared_buffer.pop_front_batch(&items, 3), 3u);
+    CHECK_EQ(items, std::vector<unsigned>({ 1, 2, 3 }));
+    CHECK_EQ(shared_buffer.pop_front_batch(&items, 3), 2u);
+    CHECK_EQ(items, std::vector<unsigned>({ 1, 2, 3, 4, 5 }));
+    CHECK_EQ(shared_buffer.getStatistics().max_size_, 5u);
+}
+
+
+// Pushes more items than fit into the buffer from a separate thread, so that the producer has to wait for the consumer.
+TEST(Backpressure) {
+    const unsigned ITEM_COUNT(10000);
+    SharedBuffer<unsigned> shared_buffer(/* high_watermark = */16, /* low_watermark = */4);
+    std::thread producer([&shared_buffer]() {
+        std::vector<unsigned> batch;
+        for (unsigned item(0); item < ITEM_COUNT; ++item) {
+            batch.emplace_back(item);
+            if (batch.size() == 7)
+                shared_buffer.push_back_batch(&batch);
+        }
+        shared_buffer.push_back_batch(&batch);
+    });
+
+    std::vector<unsigned> items;
+    while (items.size() < ITEM_COUNT)
+        shared_buffer.pop_front_batch(&items, 5);
+    producer.join();
+
+    CHECK_TRUE(shared_buffer.empty());
+    bool in_order(true);
+    for (unsigned item(0); item < ITEM_COUNT; ++item)
+        in_order = in_order and items[item] == item;
+    CHECK_TRUE(in_order);
+    CHECK_TRUE(shared_buffer.getStatistics().max_size_ <= 16u);
+}
+
+
+TEST_MAIN(SharedBuffer)
@@ -89,4 +89,20 @@ TEST(Iterators) {
 }
 
 
+TEST(SubfieldRange) {
+    const std::string field_contents("  \x1F""aTest1\x1F""b\x1F""cTest3\x1F");
+    std::string codes, values;
+    for (const auto &code_and_value : MARC::SubfieldRange(field_contents)) {
+        codes += code_and_value.first;
+        values += code_and_value.second.toString() + "|";
+    }
+    CHECK_EQ(codes, "abc");
+    CHECK_EQ(values, "Test1||Test3|");
+
+    const MARC::Subfields subfields(field_contents);
+    CHECK_EQ(subfields.size(), 3);
+    CHECK_TRUE(MARC::SubfieldRange("  ").begin() == MARC::SubfieldRange("  ").end());
+}
+
+
 TEST_MAIN(MARC::Subfields)
@@ -0,0 +1,70 @@
+/** \brief Test cases for StringUtil::XXHash64
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include "StringUtil.h"
+#include "UnitTest.h"
+
+
+// The expected values are the published XXH64 test vectors.
+
+
+TEST(EmptyInput) {
+    CHECK_EQ(StringUtil::CalcXXHash64(""), 0xEF46DB3751D8E999ull);
+    CHECK_EQ(StringUtil::XXHash64(2654435761u).digest(), 0xAC75FDA2929B17EFull);
+}
+
+
+TEST(ShortInput) {
+    CHECK_EQ(StringUtil::CalcXXHash64("a"), 0xD24EC4F1A98C6E5Bull);
+    CHECK_EQ(StringUtil::CalcXXHash64("abc"), 0x44BC2CF5AD770999ull);
+}
+
+
+// These are longer than one 32-byte stripe and thus exercise the 4-lane loop.
+TEST(LongInput) {
+    CHECK_EQ(StringUtil::CalcXXHash64("Nobody inspects the spammish repetition"), 0xFBCEA83C8A378BF1ull);
+    CHECK_EQ(StringUtil::CalcXXHash64("The quick brown fox jumps over the lazy dog"), 0x0B242D361FDA71BCull);
+}
+
+
+TEST(ChunkedUpdates) {
+    std::string data;
+    for (unsigned i(0); i < 1000; ++i)
+        data += static_cast<char>(i * 7 + 3);
+
+    for (const size_t chunk_size : { 1, 3, 8, 31, 32, 33, 100, 999 }) {
+        StringUtil::XXHash64 hash(42);
+        for (size_t offset(0); offset < data.size(); offset += chunk_size)
+            hash.update(data.substr(offset, chunk_size));
+
+        StringUtil::XXHash64 one_shot_hash(42);
+        one_shot_hash.update(data);
+        CHECK_EQ(hash.digest(), one_shot_hash.digest());
+    }
+
+    // digest() must not change the state:
+    StringUtil::XXHash64 hash;
+    hash.update("Nobody inspects");
+    hash.digest();
+    hash.update(" the spammish repetition");
+    CHECK_EQ(hash.digest(), 0xFBCEA83C8A378BF1ull);
+}
+
+
+TEST_MAIN(XXHash64)
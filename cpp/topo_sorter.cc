@@ -18,9 +18,8 @@
 */
 
 #include <iostream>
-#include <unordered_map>
+#include "DirectedGraph.h"
 #include "FileUtil.h"
-#include "MiscUtil.h"
 #include "StringUtil.h"
 #include "util.h"
 
@@ -28,26 +27,7 @@
 namespace {
 
 
-inline unsigned MapVertexNameToVertexID(const std::string &vertex_name,
-                                        std::unordered_map<unsigned, std::string> * const vertex_id_to_vertex_name_map)
-{
-    static unsigned next_id;
-    static std::unordered_map<std::string, unsigned> vertex_name_to_vertex_id_map;
-
-    const auto name_and_id(vertex_name_to_vertex_id_map.find(vertex_name));
-    if (name_and_id != vertex_name_to_vertex_id_map.cend())
-        return name_and_id->second;
-
-    vertex_name_to_vertex_id_map[vertex_name] = next_id;
-    (*vertex_id_to_vertex_name_map)[next_id] = vertex_name;
-    ++next_id;
-    return next_id - 1;
-}
-
-
-void LoadVertices(File * const input, std::vector<std::pair<unsigned, unsigned>> * const &vertices,
-                  std::unordered_map<unsigned, std::string> * const vertex_id_to_vertex_name_map)
-{
+void LoadEdges(File * const input, NodeNameTable * const node_names, std::vector<DirectedGraph::Edge> * const edges) {
     unsigned line_no(0);
     while (not input->eof()) {
         const auto line(input->getline());
@@ -61,9 +41,7 @@ void LoadVertices(File * const input, std::vector<std::pair<unsigned, unsigned>>
 
         const std::string vertex1(StringUtil::Trim(line.substr(0, arrow_start)));
         const std::string vertex2(StringUtil::Trim(line.substr(arrow_start + 2)));
-
-        vertices->emplace_back(std::make_pair(MapVertexNameToVertexID(vertex1, vertex_id_to_vertex_name_map),
-                                              MapVertexNameToVertexID(vertex2, vertex_id_to_vertex_name_map)));
+        edges->emplace_back(node_names->getOrAddId(vertex1), node_names->getOrAddId(vertex2));
     }
 }
 
@@ -78,20 +56,21 @@ int Main(int argc, char *argv[]) {
     const std::string input_filename(argv[1]);
     const auto input(FileUtil::OpenInputFileOrDie(input_filename));
 
-    std::vector<std::pair<unsigned, unsigned>> vertices;
-    std::unordered_map<unsigned, std::string> vertex_id_to_vertex_name_map;
-    LoadVertices(input.get(), &vertices, &vertex_id_to_vertex_name_map);
+    NodeNameTable node_names;
+    std::vector<DirectedGraph::Edge> edges;
+    LoadEdges(input.get(), &node_names, &edges);
+    const DirectedGraph graph(node_names.size(), edges);
 
-    std::vector<unsigned> node_order, cycle;
-    if (not MiscUtil::TopologicalSort(vertices, &node_order, &cycle)) {
+    std::vector<DirectedGraph::NodeId> node_order, cycle;
+    if (not graph.topologicalSort(&node_order, &cycle)) {
         std::cerr << "Cycle:\n";
-        for (const auto &node : cycle)
-            std::cerr << '\t' << vertex_id_to_vertex_name_map[node] << '\n';
+        for (const auto node : cycle)
+            std::cerr << '\t' << node_names.getName(node) << '\n';
         return EXIT_FAILURE;
     }
 
-    for (const auto &node : node_order)
-        std::cout << vertex_id_to_vertex_name_map[node] << '\n';
+    for (const auto node : node_order)
+        std::cout << node_names.getName(node) << '\n';
 
     return EXIT_SUCCESS;
 }
@@ -42,6 +42,7 @@ void Usage() {
     std::cerr << "       insert ppn gnd_code language_code text translator\n";
     std::cerr << "       update token language_code text translator\n";
     std::cerr << "       update ppn gnd_code language_code text translator\n";
+    std::cerr << "       rebuild_stats\n";
     std::exit(EXIT_FAILURE);
 }
 
@@ -250,10 +251,15 @@ int main(int argc, char *argv[]) {
             if (not TranslationUtil::IsValidFake3Or4LetterEnglishLanguagesCode(language_code))
                 logger->error("\"" + language_code + "\" is not a valid fake 3- or 4-letter english language code!");
 
-            if (argc == 6)
+            if (argc == 6) {
                 InsertIntoVuFindTranslations(&db_connection, argv[2], language_code, argv[4], argv[5]);
-            else
+                TranslationUtil::UpdateTranslationStatsAfterInsert(&db_connection, "vufind_translations", "token", argv[2],
+                                                                   language_code);
+            } else {
                 InsertIntoKeywordTranslations(&db_connection, argv[2], argv[3], language_code, argv[5], argv[6]);
+                TranslationUtil::UpdateTranslationStatsAfterInsert(&db_connection, "keyword_translations", "ppn", argv[2],
+                                                                   language_code);
+            }
         } else if (std::strcmp(argv[1], "update") == 0) {
             if (argc != 6 and argc != 7)
                 logger->error("\"update\" requires four or five arguments: token or ppn, gnd_code (if ppn), "
@@ -267,6 +273,11 @@ int main(int argc, char *argv[]) {
                 UpdateIntoVuFindTranslations(&db_connection, argv[2], language_code, argv[4], argv[5]);
             else
                 UpdateIntoKeywordTranslations(&db_connection, argv[2], argv[3], language_code, argv[5], argv[6]);
+        } else if (std::strcmp(argv[1], "rebuild_stats") == 0) {
+            if (argc != 2)
+                logger->error("\"rebuild_stats\" takes no arguments!");
+            TranslationUtil::RebuildTranslationStats(&db_connection, "vufind_translations", "token");
+            TranslationUtil::RebuildTranslationStats(&db_connection, "keyword_translations", "ppn");
         } else if (std::strcmp(argv[1], "validate_keyword") == 0) {
             if (argc != 4)
                 logger->error("\"get_missing\" requires exactly two argument: ppn translation!");
@@ -0,0 +1,77 @@
+/** \brief Uploads files to the BSZ FTP server.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2019 Universitätsbibliothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <iostream>
+#include <cstdlib>
+#include "BSZUpload.h"
+#include "IniFile.h"
+#include "StringUtil.h"
+#include "UBTools.h"
+#include "util.h"
+
+
+namespace {
+
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << ::progname << " [--max-connections=n] remote_folder_path local_file1 [local_file2 .. local_fileN]\n"
+              << "       The default for --max-connections is " << BSZUpload::FtpUploader::DEFAULT_MAX_CONNECTIONS << ".\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+const std::string CONF_FILE_PATH(UBTools::GetTuelibPath() + "cronjobs/fetch_marc_updates.conf");
+
+
+} // unnamed namespace
+
+
+int Main(int argc, char *argv[]) {
+    unsigned max_connections(BSZUpload::FtpUploader::DEFAULT_MAX_CONNECTIONS);
+    if (argc > 1 and StringUtil::StartsWith(argv[1], "--max-connections=")) {
+        if (not StringUtil::ToUnsigned(argv[1] + __builtin_strlen("--max-connections="), &max_connections)
+            or max_connections == 0)
+            LOG_ERROR("bad maximum number of connections!");
+        --argc, ++argv;
+    }
+    if (argc < 3)
+        Usage();
+
+    const IniFile ini_file(CONF_FILE_PATH);
+    BSZUpload::FtpUploader uploader(ini_file.getString("FTP", "host"), ini_file.getString("FTP", "username"),
+                                    ini_file.getString("FTP", "password"), max_connections);
+    const std::string remote_folder_path(argv[1]);
+    for (int arg_no(2); arg_no < argc; ++arg_no)
+        uploader.addFile(argv[arg_no], remote_folder_path);
+
+    unsigned failure_count(0);
+    for (const auto &result : uploader.run()) {
+        if (result.error_message_.empty())
+            LOG_INFO("uploaded \"" + result.local_path_ + "\" to \"" + result.remote_path_ + "\".");
+        else {
+            LOG_WARNING("failed to upload \"" + result.local_path_ + "\" after " + std::to_string(result.attempt_count_)
+                        + " attempt(s): " + result.error_message_);
+            ++failure_count;
+        }
+    }
+
+    if (failure_count > 0)
+        LOG_ERROR(std::to_string(failure_count) + " of " + std::to_string(argc - 2) + " upload(s) failed!");
+
+    return EXIT_SUCCESS;
+}
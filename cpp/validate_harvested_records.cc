@@ -20,6 +20,8 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 #include <cstdio>
 #include <cstdlib>
@@ -28,7 +30,10 @@
 #include "DbResultSet.h"
 #include "EmailSender.h"
 #include "IniFile.h"
+#include "KeyValueStore.h"
 #include "MARC.h"
+#include "MarcParallelProcessor.h"
+#include "StringUtil.h"
 #include "UBTools.h"
 #include "util.h"
 
@@ -42,6 +47,10 @@ void Usage() {
 }
 
 
+// Maps the checksums of records that met the expectations of their journal to the always expected tags at the time.
+const std::string VALIDATION_CACHE_PATH(UBTools::GetTuelibPath() + "validate_harvested_records.db");
+
+
 enum FieldPresence { ALWAYS, SOMETIMES, IGNORE };
 
 
@@ -53,9 +62,24 @@ public:
 };
 
 
+// Two-way mapping required as the map is uni-directional
+const std::map<std::string, std::string> EQUIVALENT_TAGS_MAP{
+    { "700", "100" }, { "100", "700" }
+};
+
+
 class JournalInfo {
     bool not_in_database_yet_;
     std::vector<FieldInfo> field_infos_;
+
+    // The following are set up by compileExpectations():
+    struct RequiredTag {
+        MARC::Tag tag_;
+        bool has_equivalent_tag_;
+        MARC::Tag equivalent_tag_;
+    };
+    std::vector<RequiredTag> required_tags_;
+    std::string required_tags_list_;
 public:
     using const_iterator = std::vector<FieldInfo>::const_iterator;
     using iterator = std::vector<FieldInfo>::iterator;
@@ -76,9 +100,55 @@ public:
         return std::find_if(field_infos_.begin(), field_infos_.end(),
                             [&field_name](const FieldInfo &field_info){ return field_name == field_info.name_; });
     }
+
+    // Has to be called after the last call to addField() and before any of the following member functions.
+    void compileExpectations();
+
+    /** \return A canonical representation of the expectations.  If it changes, earlier validation results are stale. */
+    inline const std::string &getRequiredTagsList() const { return required_tags_list_; }
+
+    bool recordMeetsExpectations(const MARC::Record &record, const std::string &journal_name) const;
 };
 
 
+void JournalInfo::compileExpectations() {
+    required_tags_.clear();
+    std::vector<std::string> required_tags;
+    for (const auto &field_info : field_infos_) {
+        if (field_info.presence_ != ALWAYS)
+            continue;   // we only care about required fields that are missing
+
+        const auto equivalent_tag(EQUIVALENT_TAGS_MAP.find(field_info.name_));
+        if (equivalent_tag == EQUIVALENT_TAGS_MAP.end())
+            required_tags_.emplace_back(RequiredTag{ field_info.name_, false, MARC::Tag() });
+        else
+            required_tags_.emplace_back(RequiredTag{ field_info.name_, true, equivalent_tag->second });
+        required_tags.emplace_back(field_info.name_);
+    }
+
+    std::sort(required_tags.begin(), required_tags.end());
+    required_tags_list_ = StringUtil::Join(required_tags, ",");
+}
+
+
+bool JournalInfo::recordMeetsExpectations(const MARC::Record &record, const std::string &journal_name) const {
+    bool missed_at_least_one_expectation(false);
+    for (const auto &required_tag : required_tags_) {
+        if (record.hasTag(required_tag.tag_))
+            ;// required tag found
+        else if (required_tag.has_equivalent_tag_ and record.hasTag(required_tag.equivalent_tag_))
+            ;// equivalent tag found
+        else {
+            LOG_WARNING("Record w/ control number " + record.getControlNumber() + " in \"" + journal_name
+                     + "\" is missing the always expected " + required_tag.tag_.toString() + " field.");
+            missed_at_least_one_expectation = true;
+        }
+    }
+
+    return not missed_at_least_one_expectation;
+}
+
+
 std::string GetJournalNameOrDie(const MARC::Record &record) {
     const auto journal_name(record.getSuperiorTitle());
     if (unlikely(journal_name.empty()))
@@ -113,31 +183,25 @@ std::string FieldPresenceToString(const FieldPresence field_presence) {
 }
 
 
-void LoadFromDatabaseOrCreateFromScratch(DbConnection * const db_connection, const std::string &journal_name,
-                                         JournalInfo * const journal_info)
-{
-    db_connection->queryOrDie("SELECT metadata_field_name,field_presence FROM metadata_presence_tracer WHERE journal_name='"
-                              + db_connection->escapeString(journal_name) + "'");
+// Loads the expectations of all journals w/ a single query.
+void LoadFromDatabase(DbConnection * const db_connection, std::unordered_map<std::string, JournalInfo> * const journal_name_to_info_map) {
+    db_connection->queryOrDie("SELECT journal_name,metadata_field_name,field_presence FROM metadata_presence_tracer");
     DbResultSet result_set(db_connection->getLastResultSet());
-    if (result_set.empty()) {
-        LOG_INFO("\"" + journal_name + "\" was not yet in the database.");
-        *journal_info = JournalInfo(/* not_in_database_yet = */true);
-        return;
+    while (auto row = result_set.getNextRow()) {
+        auto journal_name_and_info(journal_name_to_info_map->find(row["journal_name"]));
+        if (journal_name_and_info == journal_name_to_info_map->end())
+            journal_name_and_info = journal_name_to_info_map->emplace(row["journal_name"],
+                                                                      JournalInfo(/* not_in_database_yet = */false)).first;
+        journal_name_and_info->second.addField(row["metadata_field_name"], StringToFieldPresence(row["field_presence"]));
     }
 
-    *journal_info = JournalInfo(/* not_in_database_yet = */false);
-    while (auto row = result_set.getNextRow())
-        journal_info->addField(row["metadata_field_name"], StringToFieldPresence(row["field_presence"]));
-    LOG_INFO("Loadad " + std::to_string(journal_info->size()) + " entries for \"" + journal_name + "\" from the database.");
+    for (auto &journal_name_and_info : *journal_name_to_info_map)
+        journal_name_and_info.second.compileExpectations();
+    LOG_INFO("Loaded " + std::to_string(result_set.size()) + " entries for " + std::to_string(journal_name_to_info_map->size())
+             + " journal(s) from the database.");
 }
 
 
-// Two-way mapping required as the map is uni-directional
-const std::map<std::string, std::string> EQUIVALENT_TAGS_MAP{
-    { "700", "100" }, { "100", "700" }
-};
-
-
 void AnalyseNewJournalRecord(const MARC::Record &record, const bool first_record, JournalInfo * const journal_info) {
     std::unordered_set<std::string> seen_tags;
     MARC::Tag last_tag;
@@ -163,38 +227,6 @@ void AnalyseNewJournalRecord(const MARC::Record &record, const bool first_record
 }
 
 
-bool RecordMeetsExpectations(const MARC::Record &record, const std::string &journal_name, const JournalInfo &journal_info) {
-    std::unordered_set<std::string> seen_tags;
-    MARC::Tag last_tag;
-    for (const auto &field : record) {
-        const auto current_tag(field.getTag());
-        if (current_tag == last_tag)
-            continue;
-        seen_tags.emplace(current_tag.toString());
-        last_tag = current_tag;
-    }
-
-    bool missed_at_least_one_expectation(false);
-    for (const auto &field_info : journal_info) {
-        if (field_info.presence_ != ALWAYS)
-            continue;   // we only care about required fields that are missing
-
-        const auto equivalent_tag(EQUIVALENT_TAGS_MAP.find(field_info.name_));
-        if (seen_tags.find(field_info.name_) != seen_tags.end())
-            ;// required tag found
-        else if (equivalent_tag != EQUIVALENT_TAGS_MAP.end() and seen_tags.find(equivalent_tag->second) != seen_tags.end())
-            ;// equivalent tag found
-        else {
-            LOG_WARNING("Record w/ control number " + record.getControlNumber() + " in \"" + journal_name
-                     + "\" is missing the always expected " + field_info.name_ + " field.");
-            missed_at_least_one_expectation = true;
-        }
-    }
-
-    return not missed_at_least_one_expectation;
-}
-
-
 void WriteToDatabase(DbConnection * const db_connection, const std::string &journal_name, const JournalInfo &journal_info) {
     for (const auto &field_info : journal_info)
         db_connection->queryOrDie("INSERT INTO metadata_presence_tracer SET journal_name='" + journal_name
@@ -214,6 +246,16 @@ void SendEmail(const std::string &email_address, const std::string &message_subj
 }
 
 
+enum Outcome { NEW_JOURNAL, MET_EXPECTATIONS, MET_EXPECTATIONS_PREVIOUSLY, MISSED_EXPECTATIONS };
+
+
+struct ValidationResult {
+    Outcome outcome_;
+    std::string journal_name_;
+    std::string checksum_; // Only set for MET_EXPECTATIONS.
+};
+
+
 } // unnamed namespace
 
 
@@ -225,45 +267,96 @@ int Main(int argc, char *argv[]) {
     auto reader(MARC::Reader::Factory(argv[1]));
     auto valid_records_writer(MARC::Writer::Factory(argv[2]));
     auto delinquent_records_writer(MARC::Writer::Factory(argv[3]));
-    std::map<std::string, JournalInfo> journal_name_to_info_map;
     const std::string email_address(argv[4]);
 
-    unsigned total_record_count(0), new_record_count(0), missed_expectation_count(0);
-    while (const auto record = reader->read()) {
-        ++total_record_count;
-        const auto journal_name(GetJournalNameOrDie(record));
-
-        auto journal_name_and_info(journal_name_to_info_map.find(journal_name));
-        bool first_record(false); // True if the current record is the first encounter of a journal
-        if (journal_name_and_info == journal_name_to_info_map.end()) {
-            first_record = true;
-            JournalInfo new_journal_info;
-            LoadFromDatabaseOrCreateFromScratch(&db_connection, journal_name, &new_journal_info);
-            journal_name_to_info_map[journal_name] = new_journal_info;
-            journal_name_and_info = journal_name_to_info_map.find(journal_name);
+    // Only read by the worker threads:
+    std::unordered_map<std::string, JournalInfo> journal_name_to_info_map;
+    LoadFromDatabase(&db_connection, &journal_name_to_info_map);
+    KeyValueStore validation_cache(VALIDATION_CACHE_PATH, KeyValueStore::CREATE);
+
+    // Results are handed from the workers to the consumer by sequence number:
+    std::mutex sequence_nos_and_results_mutex;
+    std::unordered_map<size_t, ValidationResult> sequence_nos_and_results;
+
+    MARC::ParallelProcessor processor(reader.get(), /* writer = */nullptr);
+    const auto record_validator([&](MARC::Record * const record) {
+        ValidationResult result;
+        result.journal_name_ = GetJournalNameOrDie(*record);
+
+        const auto journal_name_and_info(journal_name_to_info_map.find(result.journal_name_));
+        if (journal_name_and_info == journal_name_to_info_map.cend())
+            result.outcome_ = NEW_JOURNAL; // Has to be analysed in input order by the consumer.
+        else {
+            // We include all fields as the expectations are about the presence of any field.
+            const std::string checksum(MARC::CalcChecksum(*record, /* excluded_fields = */{}, /* suppress_local_fields = */false));
+            std::string cached_required_tags_list;
+            if (validation_cache.get(checksum, &cached_required_tags_list)
+                and cached_required_tags_list == journal_name_and_info->second.getRequiredTagsList())
+                result.outcome_ = MET_EXPECTATIONS_PREVIOUSLY;
+            else if (journal_name_and_info->second.recordMeetsExpectations(*record, result.journal_name_)) {
+                result.outcome_ = MET_EXPECTATIONS;
+                result.checksum_ = checksum;
+            } else
+                result.outcome_ = MISSED_EXPECTATIONS;
         }
 
-        bool missed_expectation(false);
-        if (journal_name_and_info->second.isInDatabase()) {
-            if (not RecordMeetsExpectations(record, journal_name_and_info->first, journal_name_and_info->second)) {
-                missed_expectation = true;
-                ++missed_expectation_count;
+        std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_results_mutex);
+        sequence_nos_and_results.emplace(MARC::ParallelProcessor::GetCurrentSequenceNo(), std::move(result));
+        return true;
+    });
+
+    std::map<std::string, JournalInfo> new_journal_name_to_info_map;
+    std::vector<std::pair<std::string, std::string>> newly_validated_checksums_and_required_tags_lists;
+    unsigned new_record_count(0), previously_validated_count(0), missed_expectation_count(0);
+    const size_t total_record_count(processor.process(record_validator, [&](const MARC::Record &record) {
+        ValidationResult result;
+        {
+            std::lock_guard<std::mutex> mutex_locker(sequence_nos_and_results_mutex);
+            const auto sequence_no_and_result(sequence_nos_and_results.find(MARC::ParallelProcessor::GetCurrentSequenceNo()));
+            result = std::move(sequence_no_and_result->second);
+            sequence_nos_and_results.erase(sequence_no_and_result);
+        }
+
+        switch (result.outcome_) {
+        case NEW_JOURNAL: {
+            auto journal_name_and_info(new_journal_name_to_info_map.find(result.journal_name_));
+            const bool first_record(journal_name_and_info == new_journal_name_to_info_map.end());
+            if (first_record) {
+                LOG_INFO("\"" + result.journal_name_ + "\" was not yet in the database.");
+                journal_name_and_info = new_journal_name_to_info_map.emplace(result.journal_name_,
+                                                                             JournalInfo(/* not_in_database_yet = */true)).first;
             }
-        } else {
             AnalyseNewJournalRecord(record, first_record, &journal_name_and_info->second);
             ++new_record_count;
+            valid_records_writer->write(record);
+            break;
         }
-
-        if (missed_expectation)
-            delinquent_records_writer->write(record);
-        else
+        case MET_EXPECTATIONS:
+            newly_validated_checksums_and_required_tags_lists.emplace_back(
+                result.checksum_, journal_name_to_info_map.at(result.journal_name_).getRequiredTagsList());
+            valid_records_writer->write(record);
+            break;
+        case MET_EXPECTATIONS_PREVIOUSLY:
+            ++previously_validated_count;
             valid_records_writer->write(record);
+            break;
+        case MISSED_EXPECTATIONS:
+            ++missed_expectation_count;
+            delinquent_records_writer->write(record);
+            break;
+        }
+    }));
+
+    // Records that missed expectations are never cached so that their warnings get logged on each run.
+    if (not newly_validated_checksums_and_required_tags_lists.empty()) {
+        KeyValueStore::WriteTransaction transaction(&validation_cache);
+        for (const auto &checksum_and_required_tags_list : newly_validated_checksums_and_required_tags_lists)
+            transaction.put(checksum_and_required_tags_list.first, checksum_and_required_tags_list.second);
+        transaction.commit();
     }
 
-    for (const auto &journal_name_and_info : journal_name_to_info_map) {
-        if (not journal_name_and_info.second.isInDatabase())
-            WriteToDatabase(&db_connection, journal_name_and_info.first, journal_name_and_info.second);
-    }
+    for (const auto &journal_name_and_info : new_journal_name_to_info_map)
+        WriteToDatabase(&db_connection, journal_name_and_info.first, journal_name_and_info.second);
 
     if (missed_expectation_count > 0) {
         // send notification to the email address
@@ -273,7 +366,8 @@ int Main(int argc, char *argv[]) {
     }
 
     LOG_INFO("Processed " + std::to_string(total_record_count) + " record(s) of which " + std::to_string(new_record_count)
-             + " was/were (a) record(s) of new journals and " + std::to_string(missed_expectation_count)
+             + " was/were (a) record(s) of new journals, " + std::to_string(previously_validated_count)
+             + " had already been validated unchanged and " + std::to_string(missed_expectation_count)
              + " record(s) missed expectations.");
 
     return EXIT_SUCCESS;
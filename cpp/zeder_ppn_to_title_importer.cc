@@ -20,13 +20,13 @@
 #include <iostream>
 #include <unordered_map>
 #include "Compiler.h"
-#include "Downloader.h"
 #include "FileUtil.h"
 #include "JSON.h"
 #include "MapUtil.h"
 #include "TextUtil.h"
 #include "UBTools.h"
 #include "util.h"
+#include "Zeder.h"
 
 
 namespace {
@@ -38,20 +38,9 @@ namespace {
 }
 
 
-const std::string IXTHEO_ZEDER_URL(
-    "http://www-ub.ub.uni-tuebingen.de/zeder/cgi-bin/zeder.cgi?action=get&Dimension=wert&Bearbeiter=&Instanz=ixtheo");
-
-
 void GetZederJSON(std::string * const json_blob) {
-    Downloader downloader(IXTHEO_ZEDER_URL);
-    if (downloader.anErrorOccurred())
-        LOG_ERROR("failed to download Zeder data: " + downloader.getLastErrorMessage());
-
-    const auto http_response_code(downloader.getResponseCode());
-    if (http_response_code < 200 or http_response_code > 399)
-        LOG_ERROR("got bad HTTP response code: " + std::to_string(http_response_code));
-
-    *json_blob = downloader.getMessageBody();
+    if (not Zeder::GetFullDump(Zeder::GetFullDumpEndpointPath(Zeder::IXTHEO), json_blob))
+        LOG_ERROR("failed to download Zeder data!");
 }
 
 
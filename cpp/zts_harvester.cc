@@ -16,9 +16,14 @@
  *  You should have received a copy of the GNU Affero General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 #include <cstdlib>
 #include "Compiler.h"
 #include "DbConnection.h"
@@ -35,6 +40,9 @@
 namespace {
 
 
+const unsigned DEFAULT_MAX_CONCURRENT_ZTS_REQUESTS(4);
+
+
 [[noreturn]] void Usage() {
     std::cerr << "Usage: " << ::progname << " [options] config_file_path [section1 section2 .. sectionN]\n"
               << "\n"
@@ -133,37 +141,136 @@ void ReadGenericSiteAugmentParams(const IniFile &ini_file, const IniFile::Sectio
 }
 
 
-UnsignedPair ProcessRSSFeed(const IniFile::Section &section, const JournalConfig::Reader &bundle_reader,
-                            const std::shared_ptr<Zotero::HarvestParams> &harvest_params, const Zotero::SiteParams &site_params,
-                            Zotero::HarvesterErrorLogger * const error_logger)
-{
-    const std::string feed_url(bundle_reader.zotero(section.getSectionName()).value(JournalConfig::Zotero::URL));
-    LOG_DEBUG("feed_url: " + feed_url);
+// Everything we need to know to harvest a single journal.
+struct HarvestJob {
+    std::string section_name_;
+    Zotero::HarvesterType type_;
+    std::string url_;
+    unsigned max_crawl_depth_;
+    std::shared_ptr<Zotero::HarvestParams> harvest_params_;
+    std::unique_ptr<Zotero::SiteParams> site_params_; // Heap allocated because the format handler holds on to it.
+};
 
-    return Zotero::HarvestSyndicationURL(feed_url, harvest_params, site_params, error_logger);
+
+UnsignedPair ProcessRSSFeed(const HarvestJob &job, Zotero::HarvesterErrorLogger * const error_logger) {
+    LOG_DEBUG("feed_url: " + job.url_);
+
+    return Zotero::HarvestSyndicationURL(job.url_, job.harvest_params_, *job.site_params_, error_logger);
 }
 
 
-UnsignedPair ProcessCrawl(const IniFile::Section &section, const JournalConfig::Reader &bundle_reader,
-                          const std::shared_ptr<Zotero::HarvestParams> &harvest_params, const Zotero::SiteParams &site_params,
-                          const SimpleCrawler::Params &crawler_params, const std::shared_ptr<RegexMatcher> &supported_urls_regex,
-                          Zotero::HarvesterErrorLogger * const error_logger)
+UnsignedPair ProcessCrawl(const HarvestJob &job, const SimpleCrawler::Params &crawler_params,
+                          const std::shared_ptr<RegexMatcher> &supported_urls_regex, Zotero::HarvesterErrorLogger * const error_logger)
 {
     SimpleCrawler::SiteDesc site_desc;
-    site_desc.start_url_ = bundle_reader.zotero(section.getSectionName()).value(JournalConfig::Zotero::URL);
-    site_desc.max_crawl_depth_ =
-        StringUtil::ToUnsigned(bundle_reader.zotero(section.getSectionName()).value(JournalConfig::Zotero::MAX_CRAWL_DEPTH));
+    site_desc.start_url_ = job.url_;
+    site_desc.max_crawl_depth_ = job.max_crawl_depth_;
 
-    return Zotero::HarvestSite(site_desc, crawler_params, supported_urls_regex, harvest_params, site_params, error_logger);
+    return Zotero::HarvestSite(site_desc, crawler_params, supported_urls_regex, job.harvest_params_, *job.site_params_, error_logger);
 }
 
 
-UnsignedPair ProcessDirectHarvest(const IniFile::Section &section, const JournalConfig::Reader &bundle_reader,
-                                  const std::shared_ptr<Zotero::HarvestParams> &harvest_params, const Zotero::SiteParams &site_params,
-                                  Zotero::HarvesterErrorLogger * const error_logger)
+UnsignedPair ProcessDirectHarvest(const HarvestJob &job, Zotero::HarvesterErrorLogger * const error_logger) {
+    return Zotero::HarvestURL(job.url_, job.harvest_params_, *job.site_params_, error_logger);
+}
+
+
+UnsignedPair ProcessJob(const HarvestJob &job, const bool ignore_robots_dot_txt,
+                        const std::shared_ptr<RegexMatcher> &supported_urls_regex, Zotero::HarvesterErrorLogger * const error_logger)
 {
-    return Zotero::HarvestURL(bundle_reader.zotero(section.getSectionName()).value(JournalConfig::Zotero::URL),
-                              harvest_params, site_params, error_logger);
+    LOG_INFO("\n\nProcessing section \"" + job.section_name_ + "\".");
+
+    if (job.type_ == Zotero::HarvesterType::RSS)
+        return ProcessRSSFeed(job, error_logger);
+    else if (job.type_ == Zotero::HarvesterType::CRAWL) {
+        SimpleCrawler::Params crawler_params;
+        crawler_params.ignore_robots_dot_txt_ = ignore_robots_dot_txt;
+        crawler_params.min_url_processing_time_ = Zotero::DEFAULT_MIN_URL_PROCESSING_TIME;
+        crawler_params.timeout_ = Zotero::DEFAULT_TIMEOUT;
+        crawler_params.user_agent_ = job.harvest_params_->user_agent_;
+
+        return ProcessCrawl(job, crawler_params, supported_urls_regex, error_logger);
+    } else
+        return ProcessDirectHarvest(job, error_logger);
+}
+
+
+// Harvests the journals of "jobs" with up to "max_concurrent_journals" threads.  Zotero's harvesting functions take care
+// of serialising the output, the delivery tracking and the error logging as well as of per-domain crawl delays.
+UnsignedPair ProcessJobs(const std::vector<HarvestJob> &jobs, const unsigned max_concurrent_journals,
+                         const unsigned max_concurrent_zts_requests, const bool ignore_robots_dot_txt,
+                         const std::shared_ptr<RegexMatcher> &supported_urls_regex, Zotero::HarvesterErrorLogger * const error_logger)
+{
+    UnsignedPair total_record_count_and_previously_downloaded_record_count;
+    if (max_concurrent_journals <= 1 or jobs.size() <= 1) {
+        for (const auto &job : jobs)
+            total_record_count_and_previously_downloaded_record_count += ProcessJob(job, ignore_robots_dot_txt, supported_urls_regex,
+                                                                                    error_logger);
+        return total_record_count_and_previously_downloaded_record_count;
+    }
+
+    Zotero::EnableConcurrentHarvesting(max_concurrent_zts_requests);
+
+    std::vector<UnsignedPair> job_indices_to_record_counts(jobs.size());
+    std::exception_ptr exception;
+    std::mutex mutex;
+    size_t next_job_index(0);
+    auto worker([&]() {
+        for (;;) {
+            size_t job_index;
+            {
+                std::lock_guard<std::mutex> mutex_locker(mutex);
+                if (next_job_index == jobs.size() or exception != nullptr)
+                    return;
+                job_index = next_job_index++;
+            }
+
+            try {
+                job_indices_to_record_counts[job_index] = ProcessJob(jobs[job_index], ignore_robots_dot_txt, supported_urls_regex,
+                                                                     error_logger);
+            } catch (...) {
+                std::lock_guard<std::mutex> mutex_locker(mutex);
+                if (exception == nullptr)
+                    exception = std::current_exception();
+                return;
+            }
+        }
+    });
+
+    const unsigned worker_count(std::min(static_cast<size_t>(max_concurrent_journals), jobs.size()));
+    LOG_INFO("harvesting " + std::to_string(jobs.size()) + " journal(s) with " + std::to_string(worker_count) + " threads.");
+    std::vector<std::thread> threads;
+    for (unsigned thread_no(1); thread_no < worker_count; ++thread_no)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+
+    if (exception != nullptr)
+        std::rethrow_exception(exception);
+
+    for (const auto &record_counts : job_indices_to_record_counts)
+        total_record_count_and_previously_downloaded_record_count += record_counts;
+    return total_record_count_and_previously_downloaded_record_count;
+}
+
+
+std::shared_ptr<Zotero::HarvestParams> NewHarvestParams(const IniFile &ini_file, const bool force_downloads,
+                                                        const std::string &harvest_url_regex)
+{
+    std::shared_ptr<Zotero::HarvestParams> harvest_params(new Zotero::HarvestParams);
+    harvest_params->zts_server_url_ = Zotero::TranslationServer::GetUrl();
+    harvest_params->force_downloads_ = force_downloads;
+    harvest_params->journal_harvest_interval_ = ini_file.getUnsigned("", "journal_harvest_interval");
+    harvest_params->force_process_feeds_with_no_pub_dates_ = ini_file.getBool("", "force_process_feeds_with_no_pub_dates");
+    harvest_params->default_crawl_delay_time_ = ini_file.getUnsigned("", "default_crawl_delay_time");
+    harvest_params->skip_online_first_articles_unconditionally_ = ini_file.getBool("", "skip_online_first_articles_unconditionally");
+    if (force_downloads)
+        harvest_params->skip_online_first_articles_unconditionally_ = false;
+    if (not harvest_url_regex.empty())
+        harvest_params->harvest_url_regex_.reset(RegexMatcher::RegexMatcherFactoryOrDie(harvest_url_regex));
+
+    return harvest_params;
 }
 
 
@@ -383,17 +490,7 @@ int Main(int argc, char *argv[]) {
     JournalConfig::Reader bundle_reader(ini_file);
     Zotero::HarvesterErrorLogger harvester_error_logger;
 
-    std::shared_ptr<Zotero::HarvestParams> harvest_params(new Zotero::HarvestParams);
-    harvest_params->zts_server_url_ = Zotero::TranslationServer::GetUrl();
-    harvest_params->force_downloads_ = force_downloads;
-    harvest_params->journal_harvest_interval_ = ini_file.getUnsigned("", "journal_harvest_interval");
-    harvest_params->force_process_feeds_with_no_pub_dates_ = ini_file.getBool("", "force_process_feeds_with_no_pub_dates");
-    harvest_params->default_crawl_delay_time_ = ini_file.getUnsigned("", "default_crawl_delay_time");
-    harvest_params->skip_online_first_articles_unconditionally_ = ini_file.getBool("", "skip_online_first_articles_unconditionally");
-    if (force_downloads)
-        harvest_params->skip_online_first_articles_unconditionally_ = false;
-    if (not harvest_url_regex.empty())
-        harvest_params->harvest_url_regex_.reset(RegexMatcher::RegexMatcherFactoryOrDie(harvest_url_regex));
+    const std::shared_ptr<Zotero::HarvestParams> harvest_params(NewHarvestParams(ini_file, force_downloads, harvest_url_regex));
 
     if (map_directory_path.empty())
         map_directory_path = ini_file.getString("", "map_directory_path");
@@ -418,7 +515,6 @@ int Main(int argc, char *argv[]) {
     for (const auto &type : Zotero::HARVESTER_TYPE_TO_STRING_MAP)
         type_string_to_value_map[type.second] = type.first;
     unsigned processed_section_count(0);
-    UnsignedPair total_record_count_and_previously_downloaded_record_count;
 
     std::unordered_set<std::string> group_names;
     std::unordered_map<std::string, Zotero::GroupParams> group_name_to_params_map;
@@ -448,6 +544,8 @@ int Main(int argc, char *argv[]) {
         return EXIT_SUCCESS;
     }
 
+    Zotero::GlobalAugmentParams global_augment_params(&augment_maps);
+    std::vector<HarvestJob> jobs;
     for (const auto &section : ini_file) {
         const auto section_name(section.getSectionName());
         if (section_name.empty() or group_names.find(section_name) != group_names.end())
@@ -477,44 +575,37 @@ int Main(int argc, char *argv[]) {
         if (not zeder_ids_filter.empty() and zeder_ids_filter.find(zeder_id) == zeder_ids_filter.end())
             continue;
 
-        LOG_INFO("\n\nProcessing section \"" + section_name + "\".");
         ++processed_section_count;
 
-        Zotero::GlobalAugmentParams global_augment_params(&augment_maps);
-
-        Zotero::SiteParams site_params;
-        site_params.global_params_          = &global_augment_params;
-        site_params.group_params_           = &group_name_and_params->second;
-        site_params.delivery_mode_          = delivery_mode;
-        ReadGenericSiteAugmentParams(ini_file, section, bundle_reader, &site_params);
-
-        harvest_params->format_handler_ = GetFormatHandlerForGroup(site_params.group_params_->name_,
-                                                                   group_name_to_format_handler_params_map);
-        harvest_params->format_handler_->setAugmentParams(&site_params);
-        harvest_params->user_agent_ = group_name_and_params->second.user_agent_;
-
-        const Zotero::HarvesterType type(static_cast<Zotero::HarvesterType>(Zotero::STRING_TO_HARVEST_TYPE_MAP.at(bundle_reader
-                                                                            .zotero(section_name)
-                                                                            .value (JournalConfig::Zotero::TYPE))));
-        if (type == Zotero::HarvesterType::RSS) {
-            total_record_count_and_previously_downloaded_record_count += ProcessRSSFeed(section, bundle_reader,harvest_params,
-                                                                                        site_params, &harvester_error_logger);
-        } else if (type == Zotero::HarvesterType::CRAWL) {
-            SimpleCrawler::Params crawler_params;
-            crawler_params.ignore_robots_dot_txt_ = ignore_robots_dot_txt;
-            crawler_params.min_url_processing_time_ = Zotero::DEFAULT_MIN_URL_PROCESSING_TIME;
-            crawler_params.timeout_ = Zotero::DEFAULT_TIMEOUT;
-            crawler_params.user_agent_ = harvest_params->user_agent_;
-
-            total_record_count_and_previously_downloaded_record_count +=
-                ProcessCrawl(section, bundle_reader, harvest_params, site_params, crawler_params, supported_urls_regex,
-                             &harvester_error_logger);
-        } else {
-            total_record_count_and_previously_downloaded_record_count += ProcessDirectHarvest(section, bundle_reader, harvest_params,
-                                                                                              site_params, &harvester_error_logger);
-        }
+        HarvestJob job;
+        job.section_name_ = section_name;
+        job.type_ = static_cast<Zotero::HarvesterType>(Zotero::STRING_TO_HARVEST_TYPE_MAP.at(bundle_reader.zotero(section_name)
+                                                                                             .value(JournalConfig::Zotero::TYPE)));
+        job.url_ = bundle_reader.zotero(section_name).value(JournalConfig::Zotero::URL);
+        job.max_crawl_depth_ = 0;
+        if (job.type_ == Zotero::HarvesterType::CRAWL)
+            job.max_crawl_depth_ = StringUtil::ToUnsigned(bundle_reader.zotero(section_name).value(JournalConfig::Zotero::MAX_CRAWL_DEPTH));
+
+        job.site_params_.reset(new Zotero::SiteParams);
+        job.site_params_->global_params_ = &global_augment_params;
+        job.site_params_->group_params_  = &group_name_and_params->second;
+        job.site_params_->delivery_mode_ = delivery_mode;
+        ReadGenericSiteAugmentParams(ini_file, section, bundle_reader, job.site_params_.get());
+
+        // Each job gets its own harvest parameters so that concurrently harvested journals don't interfere w/ each other:
+        job.harvest_params_ = NewHarvestParams(ini_file, force_downloads, harvest_url_regex);
+        job.harvest_params_->format_handler_ = GetFormatHandlerForGroup(job.site_params_->group_params_->name_,
+                                                                        group_name_to_format_handler_params_map);
+        job.harvest_params_->user_agent_ = group_name_and_params->second.user_agent_;
+
+        jobs.emplace_back(std::move(job));
     }
 
+    const UnsignedPair total_record_count_and_previously_downloaded_record_count(
+        ProcessJobs(jobs, ini_file.getUnsigned("", "max_concurrent_journals", 1),
+                    ini_file.getUnsigned("", "max_concurrent_zts_requests", DEFAULT_MAX_CONCURRENT_ZTS_REQUESTS), ignore_robots_dot_txt,
+                    supported_urls_regex, &harvester_error_logger));
+
     LOG_INFO("Extracted metadata from "
              + std::to_string(total_record_count_and_previously_downloaded_record_count.first
                               - total_record_count_and_previously_downloaded_record_count.second) + " page(s).");
@@ -525,6 +616,10 @@ int Main(int argc, char *argv[]) {
             std::cerr << '\t' << section_name_and_found_flag.first << '\n';
     }
 
+    const std::string latency_report(Zotero::TranslationServer::GetLatencyReport());
+    if (not latency_report.empty())
+        LOG_INFO("Zotero Translation Server round trips:\n" + latency_report);
+
     if (harvester_error_logger.hasErrors())
         LOG_WARNING("Unexpected errors were encountered during the harvesting process");
 
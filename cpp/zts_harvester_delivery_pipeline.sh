@@ -149,14 +149,8 @@ EndPhase
 
 
 StartPhase "Upload to BSZ Server"
-counter=0
-file_count=${#source_filepaths[@]}
-
-while [ "$counter" -lt "$file_count" ]; do
-    upload_to_bsz_ftp_server.sh ${source_filepaths[counter]} \
-                                ${dest_filepaths[counter]} >> "${log}" 2>&1
-    counter=$((counter+1))
-done
+# All files of a delivery go to the same folder and are uploaded concurrently w/ a single login per connection:
+upload_to_bsz_ftp_server ${dest_filepaths[0]} "${source_filepaths[@]}" >> "${log}" 2>&1
 EndPhase
 
 